@@ -18,6 +18,7 @@ EFI_CFLAGS	:= -fshort-wchar -fno-stack-protector -mno-red-zone
 EFI_CFLAGS	+= -Wall -std=c99
 EFI_CFLAGS	+= -ffreestanding -nostdinc -I$(LOCAL_DIR)/include -I$(LOCAL_DIR)/src
 EFI_CFLAGS	+= -Isystem/public -Isystem/private
+EFI_CFLAGS	+= -Ithird_party/ulib/lz4/include/lz4 -DWITH_LZ4_NOALLOC
 ifeq ($(call TOBOOL,$(USE_CLANG)),true)
 EFI_CFLAGS	+= --target=x86_64-windows-msvc
 else
@@ -50,6 +51,7 @@ EFI_SOURCES := \
     $(LOCAL_DIR)/src/pci.c \
     $(LOCAL_DIR)/src/framebuffer.c \
     $(LOCAL_DIR)/src/device_id.c \
+    $(LOCAL_DIR)/src/lz4stream.c \
 
 # libxefi sources
 EFI_SOURCES += \
@@ -63,6 +65,10 @@ EFI_SOURCES += \
     $(LOCAL_DIR)/lib/string.c \
 
 EFI_OBJS := $(patsubst $(LOCAL_DIR)/%.c,$(BUILDDIR)/bootloader/%.o,$(EFI_SOURCES))
+
+# lz4 block decompression, for compressed netboot transfers
+EFI_OBJS += $(BUILDDIR)/bootloader/lz4/lz4.o
+
 EFI_DEPS := $(patsubst %.o,%.d,$(EFI_OBJS))
 
 $(BUILDDIR)/bootloader/%.o : $(LOCAL_DIR)/%.c
@@ -70,6 +76,11 @@ $(BUILDDIR)/bootloader/%.o : $(LOCAL_DIR)/%.c
 	$(call BUILDECHO,compiling $@)
 	$(NOECHO)$(EFI_CC) -MMD -MP -o $@ -c $(EFI_CFLAGS) $<
 
+$(BUILDDIR)/bootloader/lz4/%.o : third_party/ulib/lz4/%.c
+	@$(MKDIR)
+	$(call BUILDECHO,compiling $@)
+	$(NOECHO)$(EFI_CC) -MMD -MP -o $@ -c $(EFI_CFLAGS) $<
+
 ifeq ($(call TOBOOL,$(USE_CLANG)),true)
 
 $(EFI_BOOTLOADER): $(EFI_OBJS)
@@ -0,0 +1,254 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <lz4stream.h>
+#include <xefi.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <lz4.h>
+
+#define LZ4_MAGIC 0x184D2204
+
+#define LZ4_FLAG_VERSION       (1 << 6)
+#define LZ4_FLAG_BLOCK_DEP     (1 << 5)
+#define LZ4_FLAG_BLOCK_CKSUM   (1 << 4)
+#define LZ4_FLAG_CONTENT_SZ    (1 << 3)
+#define LZ4_FLAG_CONTENT_CKSUM (1 << 2)
+#define LZ4_FLAG_DICT_ID       (1 << 0)
+
+#define LZ4_BLOCK_MAX_MASK     (7 << 4)
+#define LZ4_BLOCK_64KB         (4 << 4)
+#define LZ4_BLOCK_MAX          65536
+
+// magic, flags, block descriptor, content size, header checksum
+#define LZ4_HEADER_SIZE (4 + 1 + 1 + 8 + 1)
+
+#define XXH_PRIME1 2654435761u
+#define XXH_PRIME2 2246822519u
+#define XXH_PRIME3 3266489917u
+#define XXH_PRIME4  668265263u
+#define XXH_PRIME5  374761393u
+
+enum {
+    LZ4S_HEADER,     // collecting the frame header
+    LZ4S_BLOCK_SIZE, // collecting a block size
+    LZ4S_BLOCK,      // collecting a block
+    LZ4S_TRAILER,    // collecting the content checksum
+    LZ4S_DONE,       // end mark seen
+    LZ4S_ERROR,
+};
+
+static struct {
+    uint8_t* dst;
+    size_t size;
+    size_t out;
+
+    int state;
+    uint8_t flags;
+    uint64_t content_size;
+    uint32_t block_size;
+
+    // the piece of the frame being collected; whole blocks are gathered
+    // here before they are decompressed as packets rarely line up with them
+    uint8_t* buf;
+    size_t have;
+    size_t need;
+} lz4s;
+
+static uint32_t xxh_rotl(uint32_t x, int r) {
+    return (x << r) | (x >> (32 - r));
+}
+
+static uint32_t xxh_read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t xxh_round(uint32_t acc, uint32_t in) {
+    return xxh_rotl(acc + in * XXH_PRIME2, 13) * XXH_PRIME1;
+}
+
+// XXH32 with a zero seed, which is what frame checksums use; the lz4
+// library's copy wants malloc, which we don't have.
+static uint32_t xxh32(const uint8_t* p, size_t len) {
+    const uint8_t* end = p + len;
+    uint32_t h;
+    if (len >= 16) {
+        uint32_t v1 = XXH_PRIME1 + XXH_PRIME2;
+        uint32_t v2 = XXH_PRIME2;
+        uint32_t v3 = 0;
+        uint32_t v4 = 0 - XXH_PRIME1;
+        do {
+            v1 = xxh_round(v1, xxh_read32(p));
+            v2 = xxh_round(v2, xxh_read32(p + 4));
+            v3 = xxh_round(v3, xxh_read32(p + 8));
+            v4 = xxh_round(v4, xxh_read32(p + 12));
+            p += 16;
+        } while (end - p >= 16);
+        h = xxh_rotl(v1, 1) + xxh_rotl(v2, 7) + xxh_rotl(v3, 12) + xxh_rotl(v4, 18);
+    } else {
+        h = XXH_PRIME5;
+    }
+    h += (uint32_t)len;
+    for (; end - p >= 4; p += 4) {
+        h = xxh_rotl(h + xxh_read32(p) * XXH_PRIME3, 17) * XXH_PRIME4;
+    }
+    for (; p < end; p++) {
+        h = xxh_rotl(h + *p * XXH_PRIME5, 11) * XXH_PRIME1;
+    }
+    h ^= h >> 15;
+    h *= XXH_PRIME2;
+    h ^= h >> 13;
+    h *= XXH_PRIME3;
+    h ^= h >> 16;
+    return h;
+}
+
+static int lz4stream_error(const char* why) {
+    printf("netboot: lz4: %s\n", why);
+    lz4s.state = LZ4S_ERROR;
+    return -1;
+}
+
+int lz4stream_start(uint8_t* dst, size_t size) {
+    // The staging buffer is kept for later transfers.
+    if (lz4s.buf == NULL) {
+        if (EFI_ERROR(gBS->AllocatePool(EfiLoaderData, LZ4_BLOCK_MAX, (void**)&lz4s.buf))) {
+            lz4s.buf = NULL;
+            printf("netboot: lz4: cannot allocate block buffer\n");
+            return -1;
+        }
+    }
+    lz4s.dst = dst;
+    lz4s.size = size;
+    lz4s.out = 0;
+    lz4s.state = LZ4S_HEADER;
+    lz4s.have = 0;
+    lz4s.need = LZ4_HEADER_SIZE;
+    return 0;
+}
+
+// Acts on a completely collected piece of the frame.
+static int lz4stream_advance(void) {
+    uint8_t* p = lz4s.buf;
+    switch (lz4s.state) {
+    case LZ4S_HEADER: {
+        uint32_t magic;
+        memcpy(&magic, p, sizeof(magic));
+        if (magic != LZ4_MAGIC) {
+            return lz4stream_error("bad magic");
+        }
+        lz4s.flags = p[4];
+        if ((lz4s.flags & (LZ4_FLAG_VERSION | LZ4_FLAG_BLOCK_DEP | LZ4_FLAG_BLOCK_CKSUM |
+                           LZ4_FLAG_CONTENT_SZ | LZ4_FLAG_DICT_ID)) !=
+            (LZ4_FLAG_VERSION | LZ4_FLAG_BLOCK_DEP | LZ4_FLAG_CONTENT_SZ)) {
+            return lz4stream_error("unsupported frame flags");
+        }
+        if ((p[5] & LZ4_BLOCK_MAX_MASK) != LZ4_BLOCK_64KB) {
+            return lz4stream_error("max block size must be 64k");
+        }
+        memcpy(&lz4s.content_size, p + 6, sizeof(lz4s.content_size));
+        if (lz4s.content_size > lz4s.size) {
+            return lz4stream_error("content too large for buffer");
+        }
+        // the second byte of the hash of the descriptor, flags through
+        // content size
+        if (((xxh32(p + 4, LZ4_HEADER_SIZE - 5) >> 8) & 0xff) != p[LZ4_HEADER_SIZE - 1]) {
+            return lz4stream_error("bad header checksum");
+        }
+        lz4s.state = LZ4S_BLOCK_SIZE;
+        lz4s.need = sizeof(uint32_t);
+        break;
+    }
+    case LZ4S_BLOCK_SIZE:
+        memcpy(&lz4s.block_size, p, sizeof(lz4s.block_size));
+        if (lz4s.block_size == 0) {
+            if (lz4s.flags & LZ4_FLAG_CONTENT_CKSUM) {
+                lz4s.state = LZ4S_TRAILER;
+                lz4s.need = sizeof(uint32_t);
+            } else {
+                lz4s.state = LZ4S_DONE;
+                lz4s.need = 0;
+            }
+            break;
+        }
+        if ((lz4s.block_size & 0x7fffffff) > LZ4_BLOCK_MAX) {
+            return lz4stream_error("block too large");
+        }
+        lz4s.state = LZ4S_BLOCK;
+        lz4s.need = lz4s.block_size & 0x7fffffff;
+        break;
+    case LZ4S_BLOCK: {
+        size_t room = lz4s.size - lz4s.out;
+        // If the data is uncompressed, the high bit is 1.
+        if (lz4s.block_size >> 31) {
+            if (lz4s.need > room) {
+                return lz4stream_error("content too large for buffer");
+            }
+            memcpy(lz4s.dst + lz4s.out, p, lz4s.need);
+            lz4s.out += lz4s.need;
+        } else {
+            int r = LZ4_decompress_safe((const char*)p, (char*)lz4s.dst + lz4s.out,
+                                        lz4s.need, room);
+            if (r < 0) {
+                return lz4stream_error("decompression failed");
+            }
+            lz4s.out += r;
+        }
+        lz4s.state = LZ4S_BLOCK_SIZE;
+        lz4s.need = sizeof(uint32_t);
+        break;
+    }
+    case LZ4S_TRAILER: {
+        uint32_t cksum;
+        memcpy(&cksum, p, sizeof(cksum));
+        if (cksum != xxh32(lz4s.dst, lz4s.out)) {
+            return lz4stream_error("bad content checksum");
+        }
+        lz4s.state = LZ4S_DONE;
+        lz4s.need = 0;
+        break;
+    }
+    }
+    lz4s.have = 0;
+    return 0;
+}
+
+int lz4stream_write(const uint8_t* data, size_t len) {
+    while (len > 0) {
+        if (lz4s.state == LZ4S_ERROR) {
+            return -1;
+        }
+        if (lz4s.state == LZ4S_DONE) {
+            return lz4stream_error("data after end of frame");
+        }
+        size_t n = lz4s.need - lz4s.have;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(lz4s.buf + lz4s.have, data, n);
+        lz4s.have += n;
+        data += n;
+        len -= n;
+        if ((lz4s.have == lz4s.need) && lz4stream_advance()) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+long lz4stream_finish(void) {
+    if (lz4s.state != LZ4S_DONE) {
+        printf("netboot: lz4: frame truncated\n");
+        return -1;
+    }
+    if (lz4s.out != lz4s.content_size) {
+        printf("netboot: lz4: content size does not match frame\n");
+        return -1;
+    }
+    return lz4s.out;
+}
@@ -0,0 +1,23 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Decompresses an LZ4 frame as it arrives, a packet at a time, straight
+// into its final buffer.  Only the frames written by bootserver -z (and
+// mkbootfs -c) are accepted: independent 64kB blocks, no block checksums,
+// and the content size in the frame header.
+
+// prepare to decompress into dst, which has room for size bytes
+int lz4stream_start(uint8_t* dst, size_t size);
+
+// feed the next len bytes of the frame; returns -1 on a bad frame
+int lz4stream_write(const uint8_t* data, size_t len);
+
+// returns the decompressed size once the whole frame has been seen,
+// or -1 if the frame is incomplete or did not match its content size
+long lz4stream_finish(void);
@@ -136,6 +136,8 @@ int boot_magenta(efi_handle img, efi_system_table* sys,
         }
     }
 
+    boot_stage("osboot:boot_kernel");
+
     // Allocate at 1M and copy kernel down there
     efi_physical_addr mem = 0x100000;
     unsigned pages = BYTES_TO_PAGES(isz);
@@ -186,6 +188,13 @@ int boot_magenta(efi_handle img, efi_system_table* sys,
         goto fail;
     }
 
+    // pass the bootloader's part of the boot timeline, which is not
+    // worth failing the boot over if there is no room left for it
+    boot_stage("osboot:handoff");
+    hdr.type = BOOTDATA_BOOT_STAGES;
+    hdr.length = num_boot_stages * sizeof(bootdata_boot_stage_t);
+    add_bootdata(&bptr, &blen, &hdr, boot_stages);
+
     // fill the remaining gap between pre-data and ramdisk image
     if ((blen < sizeof(bootdata_t)) || (blen & 7)) {
         goto fail;
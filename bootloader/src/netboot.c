@@ -7,6 +7,7 @@
 
 #include <device_id.h>
 #include <inet6.h>
+#include <lz4stream.h>
 #include <netifc.h>
 
 #include <magenta/boot/netboot.h>
@@ -23,6 +24,11 @@ static int nb_active = 0;
 // item being downloaded
 static nbfile* item;
 
+// set while item is sent as an LZ4 frame, which is decompressed as it
+// arrives; item->offset is then only set once the frame is complete
+static int item_lz4 = 0;
+static size_t item_lz4_offset = 0;
+
 static char advertise_nodename[64] = "";
 static char advertise_data[256] = "nodename=magenta";
 
@@ -89,6 +95,7 @@ void udp6_recv(void* data, size_t len,
         msg->data[len - 1] = 0;
         break;
     case NB_SEND_FILE:
+    case NB_SEND_FILE_LZ4:
         if (len == 0)
             return;
         msg->data[len - 1] = 0;
@@ -98,10 +105,16 @@ void udp6_recv(void* data, size_t len,
             }
         }
         item = netboot_get_buffer((const char*)msg->data, msg->arg);
+        item_lz4 = (msg->cmd == NB_SEND_FILE_LZ4);
+        item_lz4_offset = 0;
+        if (item && item_lz4 && lz4stream_start(item->data, item->size)) {
+            item = NULL;
+        }
         if (item) {
             item->offset = 0;
             ack.arg = msg->arg;
-            printf("netboot: Receive File '%s'...\n", (char*) msg->data);
+            printf("netboot: Receive File '%s'%s...\n", (char*) msg->data,
+                   item_lz4 ? " (lz4)" : "");
         } else {
             printf("netboot: Rejected File '%s'...\n", (char*) msg->data);
             ack.cmd = NB_ERROR_BAD_FILE;
@@ -114,7 +127,32 @@ void udp6_recv(void* data, size_t len,
             printf("netboot: > received chunk before NB_FILE\n");
             return;
         }
-        if (msg->arg != item->offset) {
+        if (item_lz4) {
+            // Offsets count compressed bytes, and each packet is
+            // decompressed into place before the next one is taken.
+            if (msg->arg != item_lz4_offset) {
+                ack.arg = item_lz4_offset;
+                ack.cmd = NB_ACK;
+            } else if (lz4stream_write(msg->data, len)) {
+                ack.cmd = NB_ERROR_BAD_FILE;
+                ack.arg = msg->arg;
+            } else {
+                item_lz4_offset += len;
+                ack.cmd = NB_ACK;
+                if (msg->cmd == NB_LAST_DATA) {
+                    long size = lz4stream_finish();
+                    if (size < 0) {
+                        ack.cmd = NB_ERROR_BAD_FILE;
+                        ack.arg = msg->arg;
+                    } else {
+                        item->offset = size;
+                        ack.cmd = NB_FILE_RECEIVED;
+                    }
+                } else {
+                    do_transmit = 0;
+                }
+            }
+        } else if (msg->arg != item->offset) {
             // printf("netboot: < received chunk at offset %d but current offset is %zu\n", msg->arg, item->offset);
             ack.arg = item->offset;
             ack.cmd = NB_ACK;
@@ -32,6 +32,20 @@ static nbfile nbkernel;
 static nbfile nbramdisk;
 static nbfile nbcmdline;
 
+bootdata_boot_stage_t boot_stages[MAX_BOOT_STAGES];
+size_t num_boot_stages;
+
+void boot_stage(const char* name) {
+    if (num_boot_stages == MAX_BOOT_STAGES) {
+        return;
+    }
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    bootdata_boot_stage_t* stage = &boot_stages[num_boot_stages++];
+    stage->ticks = ((uint64_t)hi << 32) | lo;
+    strncpy(stage->name, name, sizeof(stage->name) - 1);
+}
+
 nbfile* netboot_get_buffer(const char* name, size_t size) {
     // we know these are in a buffer large enough
     // that this is safe (todo: implement strcmp)
@@ -292,6 +306,7 @@ void do_netboot() {
 
         // make sure network traffic is not in flight, etc
         netboot_close();
+        boot_stage("osboot:netbooted");
 
         // Restore the TPL before booting the kernel, or failing to netboot
         gBS->RestoreTPL(prev_tpl);
@@ -312,6 +327,7 @@ void do_netboot() {
 }
 
 EFIAPI efi_status efi_main(efi_handle img, efi_system_table* sys) {
+    boot_stage("osboot");
     xefi_init(img, sys);
     gConOut->ClearScreen(gConOut);
 
@@ -357,6 +373,7 @@ EFIAPI efi_status efi_main(efi_handle img, efi_system_table* sys) {
     const char* nodename = cmdline_get("magenta.nodename", "");
 
     // See if there's a network interface
+    boot_stage("osboot:netboot_init");
     bool have_network = netboot_init(nodename) == 0;
     if (have_network) {
         if (have_fb) {
@@ -378,6 +395,7 @@ EFIAPI efi_status efi_main(efi_handle img, efi_system_table* sys) {
 
     // Look for a kernel image on disk
     // TODO: use the filesystem protocol
+    boot_stage("osboot:load_kernel");
     size_t ksz = 0;
     void* kernel = xefi_load_file(L"magenta.bin", &ksz, 0);
 
@@ -413,6 +431,7 @@ EFIAPI efi_status efi_main(efi_handle img, efi_system_table* sys) {
     if (key_idx >= sizeof(valid_keys)) goto fail;
 
     int timeout_s = cmdline_get_uint32("bootloader.timeout", DEFAULT_TIMEOUT);
+    boot_stage("osboot:prompt");
     while (true) {
         printf("\nPress (b) for the boot menu");
         if (have_network) {
@@ -446,6 +465,7 @@ EFIAPI efi_status efi_main(efi_handle img, efi_system_table* sys) {
                 ramdisk_name = "ramdisk.bin";
             }
             if (ramdisk_file) {
+                boot_stage("osboot:load_ramdisk");
                 printf("Loading %s...\n", ramdisk_name);
                 ramdisk = xefi_read_file(ramdisk_file, &rsz, FRONT_BYTES);
                 ramdisk_file->Close(ramdisk_file);
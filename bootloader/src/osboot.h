@@ -9,6 +9,8 @@
 #include <efi/system-table.h>
 #include <efi/protocol/graphics-output.h>
 
+#include <magenta/boot/bootdata.h>
+
 #define PAGE_SIZE (4096)
 #define PAGE_MASK (PAGE_SIZE - 1)
 
@@ -26,6 +28,14 @@ int boot_kernel(efi_handle img, efi_system_table* sys,
                 void* image, size_t sz,
                 void* ramdisk, size_t rsz);
 
+// Notes the time at which a stage of booting starts. The stages are
+// passed to the kernel, which makes them the start of its boot timeline.
+void boot_stage(const char* name);
+
+#define MAX_BOOT_STAGES (16)
+extern bootdata_boot_stage_t boot_stages[MAX_BOOT_STAGES];
+extern size_t num_boot_stages;
+
 uint64_t find_acpi_root(efi_handle img, efi_system_table* sys);
 
 uint32_t get_mx_pixel_format(efi_graphics_output_protocol* gop);
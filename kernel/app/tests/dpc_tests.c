@@ -0,0 +1,116 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include "tests.h"
+
+#include <assert.h>
+#include <err.h>
+#include <stdio.h>
+#include <trace.h>
+#include <arch/ops.h>
+#include <kernel/event.h>
+#include <kernel/mp.h>
+#include <kernel/thread.h>
+#include <lib/dpc.h>
+
+#define LOCAL_TRACE 0
+
+#define TEST_RUNS 100
+
+struct dpc_test {
+    dpc_t dpc;
+    event_t done;
+    uint ran_on;
+};
+
+static void record_cpu_dpc(dpc_t *dpc)
+{
+    struct dpc_test *test = dpc->arg;
+    test->ran_on = arch_curr_cpu_num();
+    event_signal(&test->done, true);
+}
+
+static void dpc_test_init(struct dpc_test *test)
+{
+    list_clear_node(&test->dpc.node);
+    test->dpc.func = record_cpu_dpc;
+    test->dpc.arg = test;
+    event_init(&test->done, false, 0);
+    test->ran_on = UINT32_MAX;
+}
+
+/* queue a dpc on |cpu| and check it ran there */
+static bool queue_on_test(uint cpu)
+{
+    struct dpc_test test;
+    dpc_test_init(&test);
+
+    dpc_queue_on(&test.dpc, cpu, false);
+    event_wait(&test.done);
+    event_destroy(&test.done);
+
+    LTRACEF("  dpc for cpu %u ran on cpu %u\n", cpu, test.ran_on);
+    if (test.ran_on != cpu) {
+        printf("dpc queued on cpu %u ran on cpu %u\n", cpu, test.ran_on);
+        return false;
+    }
+    return true;
+}
+
+/* queues a dpc from the cpu this thread is pinned to, which should run it */
+static int local_queue_thread(void *arg)
+{
+    struct dpc_test *test = arg;
+    dpc_queue(&test->dpc, true);
+    event_wait(&test->done);
+    return 0;
+}
+
+static bool local_queue_test(uint cpu)
+{
+    struct dpc_test test;
+    dpc_test_init(&test);
+
+    thread_t *t = thread_create("dpc_test", local_queue_thread, &test, DEFAULT_PRIORITY,
+                                DEFAULT_STACK_SIZE);
+    if (!t) {
+        printf("failed to create thread\n");
+        return false;
+    }
+    thread_set_pinned_cpu(t, cpu);
+    thread_resume(t);
+    thread_join(t, NULL, INFINITE_TIME);
+    event_destroy(&test.done);
+
+    if (test.ran_on != cpu) {
+        printf("dpc queued from cpu %u ran on cpu %u\n", cpu, test.ran_on);
+        return false;
+    }
+    return true;
+}
+
+int dpc_tests(int argc, const cmd_args *argv)
+{
+    uint runs = TEST_RUNS;
+    if (argc > 1) {
+        runs = argv[1].u;
+    }
+
+    uint num_cpus = arch_max_num_cpus();
+    for (uint i = 0; i < runs; ++i) {
+        for (uint cpu = 0; cpu < num_cpus; ++cpu) {
+            if (!mp_is_cpu_online(cpu))
+                continue;
+            if (!queue_on_test(cpu) || !local_queue_test(cpu)) {
+                printf("Failed\n");
+                return ERR_INTERNAL;
+            }
+        }
+    }
+
+    printf("Success\n");
+    return NO_ERROR;
+}
@@ -0,0 +1,119 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include "tests.h"
+
+#include <err.h>
+#include <list.h>
+#include <platform.h>
+#include <stdio.h>
+#include <kernel/event.h>
+#include <kernel/rcu.h>
+#include <kernel/thread.h>
+
+struct rcu_test {
+    event_t entered;
+    int reader_done;
+    rcu_head_t head;
+    event_t called;
+    int call_ran;
+};
+
+/* stays in a read-side critical section for a while after telling the test */
+static int slow_reader_thread(void *arg)
+{
+    struct rcu_test *test = arg;
+    rcu_token_t token = rcu_read_lock();
+    event_signal(&test->entered, true);
+    thread_sleep_relative(LK_MSEC(20));
+    __atomic_store_n(&test->reader_done, 1, __ATOMIC_SEQ_CST);
+    rcu_read_unlock(token);
+    return 0;
+}
+
+static void record_call(rcu_head_t *head)
+{
+    struct rcu_test *test = containerof(head, struct rcu_test, head);
+    __atomic_store_n(&test->call_ran, 1, __ATOMIC_SEQ_CST);
+    event_signal(&test->called, false);
+}
+
+static void rcu_test_init(struct rcu_test *test)
+{
+    event_init(&test->entered, false, 0);
+    event_init(&test->called, false, 0);
+    test->reader_done = 0;
+    test->call_ran = 0;
+}
+
+static void rcu_test_destroy(struct rcu_test *test)
+{
+    event_destroy(&test->entered);
+    event_destroy(&test->called);
+}
+
+/* rcu_synchronize() must not return before a reader in progress has ended */
+static bool synchronize_test(void)
+{
+    struct rcu_test test;
+    rcu_test_init(&test);
+
+    thread_t *t = thread_create("rcu reader", slow_reader_thread, &test, DEFAULT_PRIORITY,
+                                DEFAULT_STACK_SIZE);
+    if (!t) {
+        printf("failed to create thread\n");
+        return false;
+    }
+    thread_resume(t);
+    event_wait(&test.entered);
+
+    rcu_synchronize();
+    bool ok = __atomic_load_n(&test.reader_done, __ATOMIC_SEQ_CST);
+    if (!ok)
+        printf("rcu_synchronize returned while a reader was in progress\n");
+
+    thread_join(t, NULL, INFINITE_TIME);
+    rcu_test_destroy(&test);
+    return ok;
+}
+
+/* a callback must not run before a reader in progress has ended, and must
+ * run soon after */
+static bool call_test(void)
+{
+    struct rcu_test test;
+    rcu_test_init(&test);
+
+    rcu_token_t token = rcu_read_lock();
+    rcu_call(&test.head, record_call);
+    thread_sleep_relative(LK_MSEC(20));
+    bool ok = !__atomic_load_n(&test.call_ran, __ATOMIC_SEQ_CST);
+    if (!ok)
+        printf("rcu callback ran while a reader was in progress\n");
+    rcu_read_unlock(token);
+
+    if (event_wait_deadline(&test.called, current_time() + LK_SEC(5), false) != NO_ERROR) {
+        printf("rcu callback did not run\n");
+        ok = false;
+    }
+
+    rcu_test_destroy(&test);
+    return ok;
+}
+
+int rcu_tests(int argc, const cmd_args *argv)
+{
+    /* with no readers at all this must not block */
+    rcu_synchronize();
+
+    if (!synchronize_test() || !call_test()) {
+        printf("Failed\n");
+        return ERR_INTERNAL;
+    }
+
+    printf("Success\n");
+    return NO_ERROR;
+}
@@ -13,9 +13,11 @@ MODULE_SRCS += \
     $(LOCAL_DIR)/benchmarks.c \
     $(LOCAL_DIR)/cache_tests.c \
     $(LOCAL_DIR)/clock_tests.c \
+    $(LOCAL_DIR)/dpc_tests.c \
     $(LOCAL_DIR)/fibo.c \
     $(LOCAL_DIR)/mem_tests.cpp \
     $(LOCAL_DIR)/printf_tests.c \
+    $(LOCAL_DIR)/rcu_tests.c \
     $(LOCAL_DIR)/sync_ipi_tests.c \
     $(LOCAL_DIR)/sleep_tests.c \
     $(LOCAL_DIR)/tests.c \
@@ -26,6 +28,7 @@ MODULE_SRCS += \
 
 MODULE_DEPS += \
     kernel/lib/crypto \
+    kernel/lib/dpc \
     kernel/lib/header_tests \
     kernel/lib/mxtl \
     third_party/lib/safeint \
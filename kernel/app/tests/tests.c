@@ -29,6 +29,8 @@ STATIC_COMMAND("fibo", "threaded fibonacci", (console_cmd)&fibo)
 STATIC_COMMAND("spinner", "create a spinning thread", (console_cmd)&spinner)
 STATIC_COMMAND("sync_ipi_tests", "test synchronous IPIs", (console_cmd)&sync_ipi_tests)
 STATIC_COMMAND("timer_tests", "tests timers", (console_cmd)&timer_tests)
+STATIC_COMMAND("dpc_tests", "test per cpu dpc queues", (console_cmd)&dpc_tests)
+STATIC_COMMAND("rcu_tests", "test rcu grace periods and callbacks", (console_cmd)&rcu_tests)
 STATIC_COMMAND_END(tests);
 
 #endif
@@ -30,6 +30,8 @@ int hash_tests(int argc, const cmd_args *argv);
 int vm_tests(int argc, const cmd_args *argv);
 int auto_call_tests(int argc, const cmd_args *argv);
 int sync_ipi_tests(int argc, const cmd_args *argv);
+int dpc_tests(int argc, const cmd_args *argv);
+int rcu_tests(int argc, const cmd_args *argv);
 int arena_tests(int argc, const cmd_args *argv);
 int fifo_tests(int argc, const cmd_args *argv);
 int alloc_checker_tests(int argc, const cmd_args* argv);
@@ -108,6 +108,78 @@ static int mutex_test(void)
     return 0;
 }
 
+static mutex_t pi_mutex_a = MUTEX_INITIAL_VALUE(pi_mutex_a);
+static mutex_t pi_mutex_b = MUTEX_INITIAL_VALUE(pi_mutex_b);
+static event_t pi_low_holds = EVENT_INITIAL_VALUE(pi_low_holds, false, 0);
+static event_t pi_low_release = EVENT_INITIAL_VALUE(pi_low_release, false, 0);
+static volatile int pi_low_priority_after;
+
+static int pi_low_thread(void *arg)
+{
+    mutex_acquire(&pi_mutex_a);
+    event_signal(&pi_low_holds, true);
+    event_wait(&pi_low_release);
+    mutex_release(&pi_mutex_a);
+    pi_low_priority_after = get_current_thread()->priority;
+    return 0;
+}
+
+/* holds b while blocked on a */
+static int pi_mid_thread(void *arg)
+{
+    mutex_acquire(&pi_mutex_b);
+    mutex_acquire(&pi_mutex_a);
+    mutex_release(&pi_mutex_a);
+    mutex_release(&pi_mutex_b);
+    return 0;
+}
+
+static int pi_high_thread(void *arg)
+{
+    mutex_acquire(&pi_mutex_b);
+    mutex_release(&pi_mutex_b);
+    return 0;
+}
+
+static void pi_wait_blocked(thread_t *t)
+{
+    for (int i = 0; i < 1000 && t->state != THREAD_BLOCKED; i++)
+        thread_sleep_relative(LK_MSEC(1));
+}
+
+static void mutex_pi_test(void)
+{
+    printf("testing mutex priority inheritance:\n");
+
+    thread_t *low = thread_create("pi low", &pi_low_thread, NULL, LOW_PRIORITY, DEFAULT_STACK_SIZE);
+    thread_resume(low);
+    event_wait(&pi_low_holds);
+
+    thread_t *mid = thread_create("pi mid", &pi_mid_thread, NULL, DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+    thread_resume(mid);
+    pi_wait_blocked(mid);
+    int low_with_mid = low->priority;
+
+    thread_t *high = thread_create("pi high", &pi_high_thread, NULL, HIGH_PRIORITY, DEFAULT_STACK_SIZE);
+    thread_resume(high);
+    pi_wait_blocked(high);
+    int low_with_high = low->priority;
+    int mid_with_high = mid->priority;
+
+    event_signal(&pi_low_release, true);
+    thread_join(low, NULL, INFINITE_TIME);
+    thread_join(mid, NULL, INFINITE_TIME);
+    thread_join(high, NULL, INFINITE_TIME);
+
+    /* the low holder runs at the priority of what waits on it, also through
+     * the mid thread, and drops back once it lets go */
+    ASSERT(low_with_mid == DEFAULT_PRIORITY);
+    ASSERT(low_with_high == HIGH_PRIORITY);
+    ASSERT(mid_with_high == HIGH_PRIORITY);
+    ASSERT(pi_low_priority_after == LOW_PRIORITY);
+    printf("seems to work\n");
+}
+
 static event_t e;
 
 static int event_signaler(void *arg)
@@ -274,6 +346,62 @@ static void context_switch_test(void)
     thread_sleep_relative(LK_MSEC(100));
 }
 
+static event_t handoff_ping_event;
+static event_t handoff_pong_event;
+static volatile uint handoff_ping_cpu;
+static volatile int handoff_same_cpu;
+
+static int handoff_ponger(void *arg)
+{
+    int iter = (intptr_t)arg;
+
+    for (int i = 0; i < iter; i++) {
+        event_wait(&handoff_ping_event);
+        if (arch_curr_cpu_num() == handoff_ping_cpu)
+            handoff_same_cpu++;
+
+        thread_handoff_arm();
+        event_signal(&handoff_pong_event, false);
+        thread_handoff_disarm();
+    }
+
+    return 0;
+}
+
+static void handoff_test(void)
+{
+    const int iter = 10000;
+
+    event_init(&handoff_ping_event, false, EVENT_FLAG_AUTOUNSIGNAL);
+    event_init(&handoff_pong_event, false, EVENT_FLAG_AUTOUNSIGNAL);
+    handoff_same_cpu = 0;
+
+    thread_t *t = thread_create("handoff ponger", &handoff_ponger, (void *)(intptr_t)iter,
+                                DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+    thread_resume(t);
+    thread_sleep_relative(LK_MSEC(100));
+
+    uint64_t count = arch_cycle_count();
+    for (int i = 0; i < iter; i++) {
+        handoff_ping_cpu = arch_curr_cpu_num();
+
+        thread_handoff_arm();
+        event_signal(&handoff_ping_event, false);
+        thread_handoff_disarm();
+
+        event_wait(&handoff_pong_event);
+    }
+    uint64_t total_count = arch_cycle_count() - count;
+
+    thread_join(t, NULL, INFINITE_TIME);
+    event_destroy(&handoff_ping_event);
+    event_destroy(&handoff_pong_event);
+
+    printf("took %" PRIu64 " cycles for %d handoff round trips, %" PRIu64 " per round trip\n",
+           total_count, iter, total_count / iter);
+    printf("ponger ran on the cpu of the pinger %d of %d times\n", handoff_same_cpu, iter);
+}
+
 static volatile int atomic;
 static volatile int atomic_count;
 
@@ -490,6 +618,30 @@ static void spinlock_test(void)
     c = arch_cycle_count() - c;
 
     printf("%" PRIu64 " cycles to acquire/release lock w/irqsave %u times (%" PRIu64 " cycles per)\n", c, COUNT, c / COUNT);
+
+    // the same for a ticket lock
+    printf("testing ticket spinlock:\n");
+    spin_lock_init_ticket(&lock);
+    ASSERT(!spin_lock_held(&lock));
+    ASSERT(spin_trylock(&lock) == 0);
+    ASSERT(spin_lock_held(&lock));
+    ASSERT(spin_trylock(&lock) != 0);
+    spin_unlock(&lock);
+    ASSERT(!spin_lock_held(&lock));
+    spin_lock_irqsave(&lock, state);
+    ASSERT(spin_lock_held(&lock));
+    spin_unlock_irqrestore(&lock, state);
+    ASSERT(!spin_lock_held(&lock));
+    printf("seems to work\n");
+
+    c = arch_cycle_count();
+    for (uint i = 0; i < COUNT; i++) {
+        spin_lock(&lock);
+        spin_unlock(&lock);
+    }
+    c = arch_cycle_count() - c;
+
+    printf("%" PRIu64 " cycles to acquire/release ticket lock %u times (%" PRIu64 " cycles per)\n", c, COUNT, c / COUNT);
 #undef COUNT
 }
 
@@ -622,6 +774,7 @@ int thread_tests(void)
     kill_tests();
 
     mutex_test();
+    mutex_pi_test();
     event_test();
 
     spinlock_test();
@@ -629,6 +782,7 @@ int thread_tests(void)
 
     thread_sleep_relative(LK_MSEC(200));
     context_switch_test();
+    handoff_test();
 
     preempt_test();
 
@@ -75,8 +75,114 @@ static void timer_test_all_cpus(void)
     printf("%u threads created, %u threads joined\n", max, joined);
 }
 
+#define ORDER_TEST_TIMERS 32
+
+struct timer_order_state {
+    event_t done;
+    int expected;
+    volatile int fired;
+    lk_time_t fire_time[ORDER_TEST_TIMERS];
+    lk_time_t deadline[ORDER_TEST_TIMERS];
+    bool early;
+};
+
+static struct timer_order_state order_state;
+
+static enum handler_return timer_order_cb(struct timer* timer, lk_time_t now, void* arg)
+{
+    struct timer_order_state* state = &order_state;
+    int index = state->fired++;
+
+    state->fire_time[index] = now;
+    state->deadline[index] = timer->scheduled_time;
+    if (now < timer->scheduled_time)
+        state->early = true;
+
+    if (state->fired == state->expected)
+        event_signal(&state->done, false);
+
+    return INT_NO_RESCHEDULE;
+}
+
+static void timer_test_ordering(void)
+{
+    static timer_t t[ORDER_TEST_TIMERS];
+
+    event_init(&order_state.done, false, 0);
+    order_state.fired = 0;
+    order_state.early = false;
+    order_state.expected = 0;
+
+    // queue the timers out of order, then cancel a few of them. keep interrupts
+    // off so they all land on this cpu and the callbacks are serialized.
+    arch_disable_ints();
+    lk_time_t base = current_time() + LK_MSEC(5);
+    for (int i = 0; i < ORDER_TEST_TIMERS; i++) {
+        timer_initialize(&t[i]);
+        timer_set_oneshot(&t[i], base + LK_USEC(250) * ((i * 7) % ORDER_TEST_TIMERS),
+                          timer_order_cb, NULL);
+    }
+    for (int i = 0; i < ORDER_TEST_TIMERS; i++) {
+        if (i % 4 == 0)
+            timer_cancel(&t[i]);
+        else
+            order_state.expected++;
+    }
+    arch_enable_ints();
+
+    event_wait_deadline(&order_state.done, current_time() + LK_SEC(1), false);
+
+    bool ordered = true;
+    for (int i = 1; i < order_state.fired; i++) {
+        if (order_state.deadline[i] < order_state.deadline[i - 1])
+            ordered = false;
+    }
+    printf("%d of %d timers fired, %s, %s\n", order_state.fired, order_state.expected,
+           ordered ? "in order" : "OUT OF ORDER", order_state.early ? "SOME EARLY" : "none early");
+
+    for (int i = 0; i < ORDER_TEST_TIMERS; i++)
+        timer_cancel(&t[i]);
+    event_destroy(&order_state.done);
+}
+
+static void timer_test_coalescing(void)
+{
+    static timer_t t[2];
+
+    event_init(&order_state.done, false, 0);
+    order_state.fired = 0;
+    order_state.early = false;
+    order_state.expected = 2;
+
+    // both deadlines fall within the first timer's slack, so they should fire together
+    arch_disable_ints();
+    lk_time_t deadline = current_time() + LK_MSEC(5);
+    timer_initialize(&t[0]);
+    timer_initialize(&t[1]);
+    timer_set_oneshot_etc(&t[0], deadline, LK_MSEC(1), timer_order_cb, NULL);
+    timer_set_oneshot_etc(&t[1], deadline + LK_USEC(500), LK_MSEC(1), timer_order_cb, NULL);
+    arch_enable_ints();
+
+    event_wait_deadline(&order_state.done, current_time() + LK_SEC(1), false);
+
+    printf("%d of 2 slack timers fired, %s, %s\n", order_state.fired,
+           (order_state.fired == 2 && order_state.fire_time[0] == order_state.fire_time[1]) ?
+               "coalesced" : "not coalesced",
+           order_state.early ? "SOME EARLY" : "none early");
+
+    timer_cancel(&t[0]);
+    timer_cancel(&t[1]);
+    event_destroy(&order_state.done);
+}
+
 void timer_tests(void)
 {
     // timer fires on all cpus
     timer_test_all_cpus();
+
+    // timers fire in deadline order and cancelled ones don't fire
+    timer_test_ordering();
+
+    // timers with overlapping slack share an interrupt
+    timer_test_coalescing();
 }
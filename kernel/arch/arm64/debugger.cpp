@@ -94,3 +94,48 @@ status_t arch_set_regset(struct thread *thread, uint regset, const void *regs, u
         return ERR_INVALID_ARGS;
     }
 }
+
+status_t arch_start_exception_upcall(struct thread *thread, uintptr_t pc, uintptr_t sp,
+                                     uintptr_t arg, uintptr_t return_pc)
+{
+    if (!thread_stopped_in_exception(thread))
+        return ERR_BAD_STATE;
+
+    struct arm64_iframe_long *p = thread->exception_context->frame;
+    if (p == NULL)
+        return ERR_NOT_SUPPORTED;
+
+    p->elr = pc;
+    p->usp = sp;
+    p->r[0] = arg;
+    p->lr = return_pc;
+
+    return NO_ERROR;
+}
+
+status_t arch_finish_exception_upcall(struct thread *thread, const void *regs, uint buf_size)
+{
+    const mx_arm64_general_regs_t *gr = (const mx_arm64_general_regs_t *)regs;
+
+    if (buf_size != sizeof(*gr))
+        return ERR_INVALID_ARGS;
+
+    if (!thread_stopped_in_exception(thread))
+        return ERR_BAD_STATE;
+
+    struct arm64_iframe_long *p = thread->exception_context->frame;
+    if (p == NULL)
+        return ERR_NOT_SUPPORTED;
+
+    // Only take the condition flags from |gr|, the rest of the saved
+    // program status is privileged.
+    const uint64_t user_cpsr = 0xf0000000; // NZCV
+    uint64_t spsr = p->spsr;
+    memcpy(&p->r[0], &gr->r[0], sizeof(p->r));
+    p->lr = gr->lr;
+    p->usp = gr->sp;
+    p->elr = gr->pc;
+    p->spsr = (spsr & ~user_cpsr) | (gr->cpsr & user_cpsr);
+
+    return NO_ERROR;
+}
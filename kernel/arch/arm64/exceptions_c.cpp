@@ -309,6 +309,33 @@ extern "C" void arm64_sync_exception(struct arm64_iframe_long *iframe, uint exce
     }
 }
 
+// The frame of the irq being handled on each cpu, for arch_irq_frame().
+static struct arm64_iframe_short* irq_frames[SMP_MAX_CPUS];
+
+bool arch_irq_frame(uintptr_t *pc, uintptr_t *fp, bool *user)
+{
+    struct arm64_iframe_short* iframe = irq_frames[arch_curr_cpu_num()];
+    if (iframe == nullptr)
+        return false;
+    *pc = iframe->elr;
+    *user = (iframe->spsr & 0xf) == 0; // EL0t
+    *fp = 0;
+    if (!*user) {
+        // The short frame doesn't save x29, but nothing on the way here
+        // touched it, so the first frame record above the iframe is the
+        // interrupted function's.
+        uintptr_t frame = reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+        for (int i = 0; i < 16 && frame != 0; i++) {
+            if (frame > reinterpret_cast<uintptr_t>(iframe)) {
+                *fp = frame;
+                break;
+            }
+            frame = *reinterpret_cast<uintptr_t*>(frame);
+        }
+    }
+    return true;
+}
+
 /* called from assembly */
 extern "C" void arm64_irq(struct arm64_iframe_short *iframe, uint exception_flags)
 {
@@ -316,9 +343,11 @@ extern "C" void arm64_irq(struct arm64_iframe_short *iframe, uint exception_flag
 
     uint32_t curr_cpu = arch_curr_cpu_num();
     arm64_in_int_handler[curr_cpu] = true;
+    irq_frames[curr_cpu] = iframe;
 
     enum handler_return ret = platform_irq(iframe);
 
+    irq_frames[curr_cpu] = nullptr;
     arm64_in_int_handler[curr_cpu] = false;
 
     /* if we came from user space, check to see if we have any signals to handle */
@@ -11,6 +11,7 @@
 
 #include <stdbool.h>
 #include <magenta/compiler.h>
+#include <magenta/features.h>
 #include <reg.h>
 #include <arch/arm64.h>
 #include <arch/arm64/mp.h>
@@ -94,6 +95,32 @@ static inline uint64_t arch_cycle_count(void)
     return ARM64_READ_SYSREG(pmccntr_el0);
 }
 
+// The MX_FEATURE_KIND_CPU bits for this cpu.
+static inline uint32_t arch_cpu_features(void) {
+    uint64_t pfr0 = ARM64_READ_SYSREG(ID_AA64PFR0_EL1);
+    uint64_t isar0 = ARM64_READ_SYSREG(ID_AA64ISAR0_EL1);
+    uint32_t features = 0;
+
+    // 0xf in the FP and AdvSIMD fields means not implemented.
+    if (((pfr0 >> 16) & 0xf) != 0xf)
+        features |= MX_ARM64_FEATURE_ISA_FP;
+    if (((pfr0 >> 20) & 0xf) != 0xf)
+        features |= MX_ARM64_FEATURE_ISA_ASIMD;
+
+    uint32_t aes = (isar0 >> 4) & 0xf;
+    if (aes >= 1)
+        features |= MX_ARM64_FEATURE_ISA_AES;
+    if (aes >= 2)
+        features |= MX_ARM64_FEATURE_ISA_PMULL;
+    if (((isar0 >> 8) & 0xf) >= 1)
+        features |= MX_ARM64_FEATURE_ISA_SHA1;
+    if (((isar0 >> 12) & 0xf) >= 1)
+        features |= MX_ARM64_FEATURE_ISA_SHA2;
+    if (((isar0 >> 16) & 0xf) >= 1)
+        features |= MX_ARM64_FEATURE_ISA_CRC32;
+    return features;
+}
+
 static inline uint32_t arch_dcache_line_size(void) {
     // According to ARMv8 manual D7.2.21, the Cache Type Register (CTR)
     // is a 32 bit control register that contains the smallest icache
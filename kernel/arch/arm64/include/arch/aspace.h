@@ -21,6 +21,9 @@ struct arch_aspace {
 
     uint16_t asid;
 
+    /* nonzero if asid is shared with other address spaces */
+    uint64_t shared_id;
+
     /* pointer to the translation table */
     paddr_t tt_phys;
     pte_t *tt_virt;
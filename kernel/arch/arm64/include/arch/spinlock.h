@@ -45,6 +45,16 @@ static inline void arch_spin_unlock(spin_lock_t *lock)
 }
 #endif
 
+/* Loads the ticket a ticket lock is serving, for a waiter to compare with its
+ * own between calls to arch_spinloop_pause(). The exclusive load arms the
+ * monitor, so the holder's store on unlock ends the waiter's wfe */
+static inline uint32_t arch_spin_load_for_wait(const uint32_t *p)
+{
+    uint32_t value;
+    __asm__ volatile("ldaxr %w0, [%1]" : "=r"(value) : "r"(p) : "memory");
+    return value;
+}
+
 static inline void arch_spin_lock_init(spin_lock_t *lock)
 {
     *lock = SPIN_LOCK_INITIAL_VALUE;
@@ -6,6 +6,7 @@
 // https://opensource.org/licenses/MIT
 
 #include <arch/arm64/mmu.h>
+#include <arch/ops.h>
 #include <assert.h>
 #include <debug.h>
 #include <err.h>
@@ -13,7 +14,6 @@
 #include <kernel/mutex.h>
 #include <kernel/vm.h>
 #include <lib/heap.h>
-#include <rand.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
@@ -27,48 +27,58 @@ static_assert(((long)KERNEL_ASPACE_BASE >> MMU_KERNEL_SIZE_SHIFT) == -1, "");
 static_assert(MMU_KERNEL_SIZE_SHIFT <= 48, "");
 static_assert(MMU_KERNEL_SIZE_SHIFT >= 25, "");
 
+// ASID 0 is never handed out and the top one is what the kernel aspace
+// records as its own, which leaves the one below it to be shared by every
+// address space created once all of the others are in use.
+#define MMU_ARM64_MAX_ASID ((1U << MMU_ARM64_ASID_BITS) - 1)
+#define MMU_ARM64_SHARED_ASID (MMU_ARM64_MAX_ASID - 1)
+
 static uint64_t asid_pool[(1 << MMU_ARM64_ASID_BITS) / 64];
+static uint16_t asid_next = 1;
+static uint64_t asid_shared_next_id = 1;
 static mutex_t asid_lock = MUTEX_INITIAL_VALUE(asid_lock);
 
+// The address space which last used the shared ASID on each cpu.
+static uint64_t asid_shared_owner[SMP_MAX_CPUS];
+
 uint32_t arm64_zva_shift;
 
 /* the main translation table */
 pte_t arm64_kernel_translation_table[MMU_KERNEL_PAGE_TABLE_ENTRIES_TOP] __ALIGNED(MMU_KERNEL_PAGE_TABLE_ENTRIES_TOP * 8)
     __SECTION(".bss.prebss.translation_table");
 
-static status_t arm64_mmu_alloc_asid(uint16_t* asid) {
-
-    uint16_t new_asid;
-    uint32_t retry = 1 << MMU_ARM64_ASID_BITS;
-
+// Hands out ASIDs in order, wrapping around to reuse ones freed since, so
+// that address space switches never need to flush the tlb.  Freed ASIDs are
+// flushed when their address space is destroyed.  Once every ASID is taken
+// the address space shares MMU_ARM64_SHARED_ASID and is given a unique
+// shared_id instead; switching to it then flushes the shared ASID on that
+// cpu if someone else used it there last.
+static void arm64_mmu_alloc_asid(arch_aspace_t* aspace) {
     mutex_acquire(&asid_lock);
-    do {
-        new_asid = static_cast<uint16_t>(rand()) & ~(-(1 << MMU_ARM64_ASID_BITS));
-        retry--;
-        if (retry == 0) {
+    uint16_t asid = asid_next;
+    for (uint32_t i = 0; i < MMU_ARM64_SHARED_ASID - 1; i++) {
+        if (!(asid_pool[asid >> 6] & (1UL << (asid % 64)))) {
+            asid_pool[asid >> 6] |= 1UL << (asid % 64);
+            asid_next = static_cast<uint16_t>((asid + 1 < MMU_ARM64_SHARED_ASID) ? asid + 1 : 1);
+            aspace->asid = asid;
+            aspace->shared_id = 0;
             mutex_release(&asid_lock);
-            return ERR_NO_MEMORY;
+            return;
         }
-    } while ((asid_pool[new_asid >> 6] & (1 << (new_asid % 64))) || (new_asid == 0));
-
-    asid_pool[new_asid >> 6] = asid_pool[new_asid >> 6] | (1 << (new_asid % 64));
-
+        asid = static_cast<uint16_t>((asid + 1 < MMU_ARM64_SHARED_ASID) ? asid + 1 : 1);
+    }
+    aspace->asid = MMU_ARM64_SHARED_ASID;
+    aspace->shared_id = asid_shared_next_id++;
     mutex_release(&asid_lock);
-
-    *asid = new_asid;
-
-    return NO_ERROR;
 }
 
-static status_t arm64_mmu_free_asid(uint16_t asid) {
+static void arm64_mmu_free_asid(arch_aspace_t* aspace) {
+    if (aspace->asid == MMU_ARM64_SHARED_ASID)
+        return;
 
     mutex_acquire(&asid_lock);
-
-    asid_pool[asid >> 6] = asid_pool[asid >> 6] & ~(1 << (asid % 64));
-
+    asid_pool[aspace->asid >> 6] &= ~(1UL << (aspace->asid % 64));
     mutex_release(&asid_lock);
-
-    return NO_ERROR;
 }
 
 static inline bool is_valid_vaddr(arch_aspace_t* aspace, vaddr_t vaddr) {
@@ -244,6 +254,8 @@ static status_t alloc_page_table(paddr_t* paddrp, uint page_size_shift) {
                                           static_cast<uint8_t>(page_size_shift), paddrp, NULL);
         if (ret != count)
             return ERR_NO_MEMORY;
+        for (size_t i = 0; i < count; i++)
+            vm_page_set_state(paddr_to_vm_page(*paddrp + i * PAGE_SIZE), VM_PAGE_STATE_MMU);
     } else if (size == PAGE_SIZE) {
         void* vaddr = pmm_alloc_kpage(paddrp, NULL);
         if (!vaddr)
@@ -341,10 +353,75 @@ static bool page_table_is_clear(pte_t* page_table, uint page_size_shift) {
     return true;
 }
 
+static void arm64_mmu_flush_entry(vaddr_t vaddr, uint asid) {
+    if (asid == MMU_ARM64_GLOBAL_ASID)
+        ARM64_TLBI(vaae1is, vaddr >> 12);
+    else
+        ARM64_TLBI(vae1is, vaddr >> 12 | (vaddr_t)asid << 48);
+}
+
+// Drop every tlb entry for asid on all cpus in the inner shareable domain.
+static void arm64_mmu_flush_asid(uint asid) {
+    if (asid == MMU_ARM64_GLOBAL_ASID)
+        ARM64_TLBI_NOADDR(vmalle1is);
+    else
+        ARM64_TLBI(aside1is, (vaddr_t)asid << 48);
+}
+
+// Unmaps and protects covering more than this many pages skip the per page
+// broadcast invalidates and drop the whole asid once at the end instead.
+static const size_t ARM64_MMU_DEFER_TLBI_PAGES = 64;
+
+// Replace the block descriptor at page_table[index], which maps the block
+// starting at block_vaddr, with a next level table mapping the same range
+// with the same attributes, so that part of the block can be unmapped or
+// reprotected. Returns NULL if the new table can't be allocated.
+static pte_t* arm64_mmu_split_block(vaddr_t block_vaddr, vaddr_t index,
+                                    uint index_shift, uint page_size_shift,
+                                    pte_t* page_table, uint asid) {
+    pte_t pte = page_table[index];
+
+    DEBUG_ASSERT(index_shift > page_size_shift);
+    DEBUG_ASSERT((pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_BLOCK);
+
+    paddr_t table_paddr;
+    if (alloc_page_table(&table_paddr, page_size_shift)) {
+        TRACEF("failed to allocate page table to split block\n");
+        return NULL;
+    }
+    pte_t* table = static_cast<pte_t*>(paddr_to_kvaddr(table_paddr));
+
+    uint next_index_shift = index_shift - (page_size_shift - 3);
+    paddr_t paddr = pte & MMU_PTE_OUTPUT_ADDR_MASK;
+    pte_t attrs = pte & ~(MMU_PTE_OUTPUT_ADDR_MASK | MMU_PTE_DESCRIPTOR_MASK);
+    attrs |= (next_index_shift > page_size_shift) ? MMU_PTE_L012_DESCRIPTOR_BLOCK
+                                                  : MMU_PTE_L3_DESCRIPTOR_PAGE;
+
+    size_t count = 1UL << (page_size_shift - 3);
+    for (size_t i = 0; i < count; i++)
+        table[i] = (paddr + (i << next_index_shift)) | attrs;
+
+    LTRACEF("split block %p[%#" PRIxPTR "] %#" PRIx64 " into table %#" PRIxPTR "\n",
+            page_table, index, pte, table_paddr);
+
+    // the architecture requires break-before-make when changing the size of
+    // a translation, so the block has to be out of the tlb before the table
+    // becomes visible
+    page_table[index] = MMU_PTE_DESCRIPTOR_INVALID;
+    DSB;
+    arm64_mmu_flush_entry(block_vaddr, asid);
+    DSB;
+    page_table[index] = table_paddr | MMU_PTE_L012_DESCRIPTOR_TABLE;
+    __asm__ volatile("dmb ishst" ::
+                         : "memory");
+
+    return table;
+}
+
 static ssize_t arm64_mmu_unmap_pt(vaddr_t vaddr, vaddr_t vaddr_rel,
                                   size_t size,
                                   uint index_shift, uint page_size_shift,
-                                  pte_t* page_table, uint asid) {
+                                  pte_t* page_table, uint asid, bool defer_tlbi) {
     pte_t* next_page_table;
     vaddr_t index;
     size_t chunk_size;
@@ -368,6 +445,15 @@ static ssize_t arm64_mmu_unmap_pt(vaddr_t vaddr, vaddr_t vaddr_rel,
 
         pte = page_table[index];
 
+        // only part of a block is going away, split it so the rest stays mapped.
+        // if that fails the whole block is dropped below and gets faulted back in.
+        if (index_shift > page_size_shift && chunk_size != block_size &&
+            (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_BLOCK &&
+            arm64_mmu_split_block(vaddr - vaddr_rem, index, index_shift, page_size_shift,
+                                  page_table, asid)) {
+            pte = page_table[index];
+        }
+
         if (index_shift > page_size_shift &&
             (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_TABLE) {
             page_table_paddr = pte & MMU_PTE_OUTPUT_ADDR_MASK;
@@ -375,23 +461,28 @@ static ssize_t arm64_mmu_unmap_pt(vaddr_t vaddr, vaddr_t vaddr_rel,
             arm64_mmu_unmap_pt(vaddr, vaddr_rem, chunk_size,
                                index_shift - (page_size_shift - 3),
                                page_size_shift,
-                               next_page_table, asid);
+                               next_page_table, asid, defer_tlbi);
             if (chunk_size == block_size ||
                 page_table_is_clear(next_page_table, page_size_shift)) {
                 LTRACEF("pte %p[0x%lx] = 0 (was page table)\n", page_table, index);
                 page_table[index] = MMU_PTE_DESCRIPTOR_INVALID;
                 __asm__ volatile("dmb ishst" ::
                                      : "memory");
+                // the walk caches may still point into the table, so the
+                // deferred invalidate can't wait until after it is freed
+                if (defer_tlbi) {
+                    DSB;
+                    arm64_mmu_flush_asid(asid);
+                    DSB;
+                }
                 free_page_table(next_page_table, page_table_paddr, page_size_shift);
             }
         } else if (pte) {
             LTRACEF("pte %p[0x%lx] = 0\n", page_table, index);
             page_table[index] = MMU_PTE_DESCRIPTOR_INVALID;
             CF;
-            if (asid == MMU_ARM64_GLOBAL_ASID)
-                ARM64_TLBI(vaae1is, vaddr >> 12);
-            else
-                ARM64_TLBI(vae1is, vaddr >> 12 | (vaddr_t)asid << 48);
+            if (!defer_tlbi)
+                arm64_mmu_flush_entry(vaddr, asid);
         } else {
             LTRACEF("pte %p[0x%lx] already clear\n", page_table, index);
         }
@@ -484,7 +575,7 @@ static ssize_t arm64_mmu_map_pt(vaddr_t vaddr_in, vaddr_t vaddr_rel_in,
 
 err:
     arm64_mmu_unmap_pt(vaddr_in, vaddr_rel_in, size_in - size,
-                       index_shift, page_size_shift, page_table, asid);
+                       index_shift, page_size_shift, page_table, asid, false);
     DSB;
     return ERR_INTERNAL;
 }
@@ -492,7 +583,7 @@ err:
 static int arm64_mmu_protect_pt(vaddr_t vaddr_in, vaddr_t vaddr_rel_in,
                                 size_t size_in, pte_t attrs,
                                 uint index_shift, uint page_size_shift,
-                                pte_t* page_table, uint asid) {
+                                pte_t* page_table, uint asid, bool defer_tlbi) {
     int ret;
     pte_t* next_page_table;
     vaddr_t index;
@@ -525,6 +616,22 @@ static int arm64_mmu_protect_pt(vaddr_t vaddr_in, vaddr_t vaddr_rel_in,
         index = vaddr_rel >> index_shift;
         pte = page_table[index];
 
+        // only part of a block changes permissions, split it first
+        if (index_shift > page_size_shift && chunk_size != block_size &&
+            (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_BLOCK) {
+            if (arm64_mmu_split_block(vaddr - vaddr_rem, index, index_shift, page_size_shift,
+                                      page_table, asid)) {
+                pte = page_table[index];
+            } else {
+                // drop the block instead, subsequent faults will bring it back in
+                // with the right permissions
+                page_table[index] = MMU_PTE_DESCRIPTOR_INVALID;
+                DSB;
+                arm64_mmu_flush_entry(vaddr - vaddr_rem, asid);
+                pte = MMU_PTE_DESCRIPTOR_INVALID;
+            }
+        }
+
         if (index_shift > page_size_shift &&
             (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_TABLE) {
             page_table_paddr = pte & MMU_PTE_OUTPUT_ADDR_MASK;
@@ -533,7 +640,7 @@ static int arm64_mmu_protect_pt(vaddr_t vaddr_in, vaddr_t vaddr_rel_in,
                                        attrs,
                                        index_shift - (page_size_shift - 3),
                                        page_size_shift,
-                                       next_page_table, asid);
+                                       next_page_table, asid, defer_tlbi);
             if (ret != 0) {
                 goto err;
             }
@@ -544,11 +651,8 @@ static int arm64_mmu_protect_pt(vaddr_t vaddr_in, vaddr_t vaddr_rel_in,
             page_table[index] = pte;
 
             CF;
-            if (asid == MMU_ARM64_GLOBAL_ASID) {
-                ARM64_TLBI(vaae1is, vaddr >> 12);
-            } else {
-                ARM64_TLBI(vae1is, vaddr >> 12 | (vaddr_t)asid << 48);
-            }
+            if (!defer_tlbi)
+                arm64_mmu_flush_entry(vaddr, asid);
         } else {
             LTRACEF("page table entry does not exist, index %#" PRIxPTR
                     ", %#" PRIx64 "\n",
@@ -618,9 +722,14 @@ static ssize_t arm64_mmu_unmap(vaddr_t vaddr, size_t size,
         return ERR_INVALID_ARGS;
     }
 
+    bool defer_tlbi = (size >> page_size_shift) > ARM64_MMU_DEFER_TLBI_PAGES;
     ssize_t ret = arm64_mmu_unmap_pt(vaddr, vaddr_rel, size,
-                       top_index_shift, page_size_shift, top_page_table, asid);
+                       top_index_shift, page_size_shift, top_page_table, asid, defer_tlbi);
     DSB;
+    if (defer_tlbi) {
+        arm64_mmu_flush_asid(asid);
+        DSB;
+    }
     return ret;
 }
 
@@ -646,8 +755,13 @@ static status_t arm64_mmu_protect(vaddr_t vaddr, size_t size, pte_t attrs,
         return ERR_INVALID_ARGS;
     }
 
+    bool defer_tlbi = (size >> page_size_shift) > ARM64_MMU_DEFER_TLBI_PAGES;
     status_t ret = arm64_mmu_protect_pt(vaddr, vaddr_rel, size, attrs,
-                           top_index_shift, page_size_shift, top_page_table, asid);
+                           top_index_shift, page_size_shift, top_page_table, asid, defer_tlbi);
+    if (defer_tlbi) {
+        DSB;
+        arm64_mmu_flush_asid(asid);
+    }
     DSB;
     return ret;
 }
@@ -798,16 +912,17 @@ status_t arch_mmu_init_aspace(arch_aspace_t* aspace, vaddr_t base, size_t size,
         //DEBUG_ASSERT(base >= 0);
         DEBUG_ASSERT(base + size <= 1UL << MMU_USER_SIZE_SHIFT);
 
-        if (arm64_mmu_alloc_asid(&aspace->asid) != NO_ERROR)
-            return ERR_NO_MEMORY;
+        arm64_mmu_alloc_asid(aspace);
 
         aspace->base = base;
         aspace->size = size;
 
         paddr_t pa;
-        pte_t* va = static_cast<pte_t*>(pmm_alloc_kpage(&pa, NULL));
+        vm_page_t* page;
+        pte_t* va = static_cast<pte_t*>(pmm_alloc_kpage(&pa, &page));
         if (!va)
             return ERR_NO_MEMORY;
+        vm_page_set_state(page, VM_PAGE_STATE_MMU);
 
         aspace->tt_virt = va;
         aspace->tt_phys = pa;
@@ -836,9 +951,11 @@ status_t arch_mmu_destroy_aspace(arch_aspace_t* aspace) {
     DEBUG_ASSERT(page);
     pmm_free_page(page);
 
-    ARM64_TLBI(ASIDE1IS, aspace->asid);
+    // The ASID goes back in the pool without being flushed on a switch, so
+    // nothing it tagged may be left in any tlb.
+    arm64_mmu_flush_asid(aspace->asid);
 
-    arm64_mmu_free_asid(aspace->asid);
+    arm64_mmu_free_asid(aspace);
     aspace->asid = 0;
 
     aspace->magic = 0;
@@ -860,6 +977,16 @@ void arch_mmu_context_switch(arch_aspace_t* old_aspace, arch_aspace_t* aspace) {
         ttbr = ((uint64_t)aspace->asid << 48) | aspace->tt_phys;
         ARM64_WRITE_SYSREG(ttbr0_el1, ttbr);
 
+        if (aspace->shared_id) {
+            uint cpu = arch_curr_cpu_num();
+            if (asid_shared_owner[cpu] != aspace->shared_id) {
+                ARM64_TLBI(aside1, (uint64_t)MMU_ARM64_SHARED_ASID << 48);
+                DSB;
+                ISB;
+                asid_shared_owner[cpu] = aspace->shared_id;
+            }
+        }
+
         if (TRACE_CONTEXT_SWITCH)
             TRACEF("ttbr %#" PRIx64 ", tcr %#" PRIx64 "\n", ttbr, tcr);
 
@@ -884,3 +1011,15 @@ void arch_zero_page(void* _ptr) {
         ptr += zva_size;
     } while (ptr != end_ptr);
 }
+
+void arch_zero_page_nontemporal(void* _ptr) {
+    uint64_t* ptr = (uint64_t*)_ptr;
+    uint64_t* end_ptr = ptr + PAGE_SIZE / sizeof(uint64_t);
+
+    // stnp hints that the lines needn't be kept in the cache
+    do {
+        __asm volatile("stnp xzr, xzr, [%0]" ::"r"(ptr) : "memory");
+        ptr += 2;
+    } while (ptr != end_ptr);
+    __asm volatile("dmb ishst" ::: "memory");
+}
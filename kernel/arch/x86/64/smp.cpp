@@ -107,7 +107,8 @@ status_t x86_bringup_aps(uint32_t *apic_ids, uint32_t count)
     ASSERT(PHYS_BOOTSTRAP_PAGE < 1 * MB);
     uint8_t vec;
     vec = PHYS_BOOTSTRAP_PAGE >> PAGE_SIZE_SHIFT;
-    // Try up to two times per CPU, as Intel 3A recommends.
+    // Try up to two times per CPU, as Intel 3A recommends.  All the APs are
+    // started at once, so this costs the same however many there are.
     for (int tries = 0; tries < 2; ++tries) {
         for (unsigned int i = 0; i < count; ++i) {
             uint32_t apic_id = apic_ids[i];
@@ -120,18 +121,18 @@ status_t x86_bringup_aps(uint32_t *apic_ids, uint32_t count)
         if (aps_still_booting == 0) {
             break;
         }
-        // Wait 1ms for cores to boot.  The docs recommend 200us between STARTUP
-        // IPIs.
-        thread_sleep_relative(LK_MSEC(1));
+        // The docs recommend 200us between STARTUP IPIs.
+        thread_sleep_relative(LK_USEC(200));
     }
 
     // The docs recommend waiting 200us for cores to boot.  We do a bit more
-    // work before the cores report in, so wait longer (up to 1 second).
-    for (int tries_left = 200;
+    // work before the cores report in, so wait longer (up to 1 second), but
+    // check often so that we don't hold up the boot once they all have.
+    for (int tries_left = 10000;
          aps_still_booting != 0 && tries_left > 0;
          --tries_left) {
 
-        thread_sleep_relative(LK_MSEC(5));
+        thread_sleep_relative(LK_USEC(100));
     }
 
     uint failed_aps;
@@ -21,10 +21,13 @@
 #include <arch/x86.h>
 #include <arch/x86/descriptor.h>
 #include <arch/x86/feature.h>
+#include <arch/x86/idle.h>
 #include <arch/x86/mmu.h>
 #include <arch/x86/mmu_mem_types.h>
 #include <arch/x86/mp.h>
+#include <arch/x86/perf_mon.h>
 #include <arch/x86/proc_trace.h>
+#include <arch/x86/rdt.h>
 #include <arch/mmu.h>
 #include <kernel/vm.h>
 #include <lib/console.h>
@@ -62,11 +65,17 @@ void arch_init(void)
 
     x86_feature_debug();
 
+    x86_idle_init();
+
     x86_mmu_init();
 
     idt_setup_readonly();
 
     x86_processor_trace_init();
+
+    x86_perfmon_init();
+
+    x86_rdt_init();
 }
 
 void arch_chain_load(void *entry, ulong arg0, ulong arg1, ulong arg2, ulong arg3)
@@ -9,7 +9,9 @@
 #include <sys/types.h>
 #include <kernel/thread.h>
 #include <arch/x86.h>
+#include <arch/x86/mmu.h>
 #include <arch/debugger.h>
+#include <lib/user_copy.h>
 #include <magenta/syscalls/debug.h>
 
 uint arch_num_regsets(void)
@@ -124,3 +126,58 @@ status_t arch_set_regset(struct thread *thread, uint regset, const void *regs, u
         return ERR_INVALID_ARGS;
     }
 }
+
+status_t arch_start_exception_upcall(struct thread *thread, uintptr_t pc, uintptr_t sp,
+                                     uintptr_t arg, uintptr_t return_pc)
+{
+    if (!thread_stopped_in_exception(thread))
+        return ERR_BAD_STATE;
+
+    x86_iframe_t *frame = thread->exception_context->frame;
+    if (frame == NULL)
+        return ERR_NOT_SUPPORTED;
+
+    // Push the return address as the call instruction would have.
+    sp -= sizeof(return_pc);
+    status_t status = copy_to_user_unsafe((void *)sp, &return_pc, sizeof(return_pc));
+    if (status != NO_ERROR)
+        return status;
+
+    frame->ip = pc;
+    frame->user_sp = sp;
+    frame->rdi = arg;
+    // The ABI has the direction flag clear on function entry.
+    frame->flags &= ~X86_FLAGS_DF;
+
+    return NO_ERROR;
+}
+
+status_t arch_finish_exception_upcall(struct thread *thread, const void *regs, uint buf_size)
+{
+    const mx_x86_64_general_regs_t *in = (const mx_x86_64_general_regs_t *)regs;
+
+    if (buf_size != sizeof(*in))
+        return ERR_INVALID_ARGS;
+
+    if (!x86_is_vaddr_canonical(in->rip))
+        return ERR_INVALID_ARGS;
+
+    if (!thread_stopped_in_exception(thread))
+        return ERR_BAD_STATE;
+
+    x86_iframe_t *out = thread->exception_context->frame;
+    if (out == NULL)
+        return ERR_NOT_SUPPORTED;
+
+    // Only take the flags userspace could have changed itself.
+    const uint64_t user_flags = X86_FLAGS_CF | X86_FLAGS_PF | X86_FLAGS_AF |
+                                X86_FLAGS_ZF | X86_FLAGS_SF | X86_FLAGS_TF |
+                                X86_FLAGS_DF | X86_FLAGS_OF | X86_FLAGS_AC;
+    uint64_t flags = out->flags;
+    status_t status = arch_set_general_regs(thread, in, buf_size);
+    if (status != NO_ERROR)
+        return status;
+    out->flags = (flags & ~user_flags) | (in->rflags & user_flags);
+
+    return NO_ERROR;
+}
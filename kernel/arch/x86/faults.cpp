@@ -12,7 +12,9 @@
 #include <arch/x86/apic.h>
 #include <arch/x86/feature.h>
 #include <arch/x86/interrupts.h>
+#include <arch/x86/perf_mon.h>
 #include <arch/x86/descriptor.h>
+#include <kernel/irqsoff.h>
 #include <kernel/thread.h>
 #include <platform.h>
 
@@ -299,6 +301,20 @@ static status_t x86_pfe_handler(x86_iframe_t *frame)
     return ERR_NOT_SUPPORTED;
 }
 
+// The frame of the interrupt being handled on each cpu, for arch_irq_frame().
+static x86_iframe_t* irq_frames[SMP_MAX_CPUS];
+
+bool arch_irq_frame(uintptr_t *pc, uintptr_t *fp, bool *user)
+{
+    x86_iframe_t* frame = irq_frames[arch_curr_cpu_num()];
+    if (frame == nullptr)
+        return false;
+    *pc = frame->ip;
+    *fp = frame->rbp;
+    *user = SELECTOR_PL(frame->cs) != 0;
+    return true;
+}
+
 /* top level x86 exception handler for most exceptions and irqs */
 void x86_exception_handler(x86_iframe_t *frame)
 {
@@ -315,8 +331,19 @@ void x86_exception_handler(x86_iframe_t *frame)
     // deliver the interrupt
     enum handler_return ret = INT_NO_RESCHEDULE;
 
+    // taking the interrupt turned interrupts off, which is timed like any
+    // other region. an NMI may arrive inside one, and is left out
+    bool ints_were_on = frame->vector != X86_INT_NMI && (frame->flags & X86_FLAGS_IF);
+    if (ints_were_on)
+        irqsoff_begin(frame->ip);
+
     ktrace_tiny(TAG_IRQ_ENTER, ((uint32_t)frame->vector << 8) | arch_curr_cpu_num());
 
+    // an NMI can arrive while another frame is being handled
+    uint cpu = arch_curr_cpu_num();
+    x86_iframe_t* prev_frame = irq_frames[cpu];
+    irq_frames[cpu] = frame;
+
     switch (frame->vector) {
         case X86_INT_DEBUG:
             THREAD_STATS_INC(exceptions);
@@ -384,6 +411,11 @@ void x86_exception_handler(x86_iframe_t *frame)
             apic_issue_eoi();
             break;
         }
+        case X86_INT_APIC_PMI: {
+            ret = x86_perfmon_interrupt_handler();
+            apic_issue_eoi();
+            break;
+        }
 #if WITH_SMP
         case X86_INT_IPI_GENERIC: {
             ret = x86_ipi_generic_handler();
@@ -412,6 +444,8 @@ void x86_exception_handler(x86_iframe_t *frame)
             break;
     }
 
+    irq_frames[cpu] = prev_frame;
+
     /* at this point we're able to be rescheduled, so we're 'outside' of the int handler */
     arch_set_in_int_handler(false);
 
@@ -431,6 +465,9 @@ void x86_exception_handler(x86_iframe_t *frame)
     DEBUG_ASSERT_MSG(arch_ints_disabled(),
         "ints disabled on way out of exception, vector %" PRIu64 " IP %#" PRIx64 "\n",
         frame->vector, frame->ip);
+
+    if (ints_were_on)
+        irqsoff_end(frame->ip);
 }
 
 __WEAK struct x86_64_syscall_result x86_64_syscall(
@@ -201,6 +201,9 @@ void x86_feature_debug(void)
         { X86_FEATURE_TSC_ADJUST, "tsc_adj" },
         { X86_FEATURE_SMEP, "smep" },
         { X86_FEATURE_SMAP, "smap" },
+        { X86_FEATURE_ERMS, "erms" },
+        { X86_FEATURE_RDT_M, "rdt_m" },
+        { X86_FEATURE_RDT_A, "rdt_a" },
         { X86_FEATURE_RDRAND, "rdrand" },
         { X86_FEATURE_RDSEED, "rdseed" },
         { X86_FEATURE_PKU, "pku" },
@@ -209,6 +212,12 @@ void x86_feature_debug(void)
         { X86_FEATURE_HUGE_PAGE, "huge" },
         { X86_FEATURE_RDTSCP, "rdtscp" },
         { X86_FEATURE_INVAR_TSC, "invar_tsc" },
+        { X86_FEATURE_MON, "monitor" },
+        { X86_FEATURE_ARAT, "arat" },
+        { X86_FEATURE_EST, "est" },
+        { X86_FEATURE_TURBO, "turbo" },
+        { X86_FEATURE_HWP, "hwp" },
+        { X86_FEATURE_HWP_EPP, "hwp_epp" },
         { X86_FEATURE_TSC_DEADLINE, "tsc_deadline" },
         { X86_FEATURE_VMX, "vmx" },
         { X86_FEATURE_HYPERVISOR, "hypervisor" },
@@ -182,6 +182,7 @@ MiscInfo::MiscInfo() {
     uint64_t misc_info = read_msr(X86_MSR_IA32_VMX_MISC);
     wait_for_sipi = BIT_SHIFT(misc_info, 8);
     msr_list_limit = static_cast<uint32_t>(BITS_SHIFT(misc_info, 27, 25) + 1) * 512;
+    preemption_timer_rate = static_cast<uint8_t>(BITS(misc_info, 4, 0));
 }
 
 EptInfo::EptInfo() {
@@ -420,6 +421,9 @@ status_t VmcsPerCpu::Init(const VmxInfo& vmx_info) {
     local_apic_state_.active_interrupt = kInvalidInterrupt;
     local_apic_state_.tsc_deadline = 0;
     local_apic_state_.virtual_apic = local_apic_state_.virtual_apic_page.VirtualAddress();
+    local_apic_state_.virtual_interrupt_delivery = false;
+    local_apic_state_.preemption_timer = false;
+    local_apic_state_.preemption_timer_rate = 0;
 
     memset(&io_apic_state_, 0, sizeof(io_apic_state_));
     return NO_ERROR;
@@ -522,10 +526,24 @@ status_t VmcsPerCpu::Setup(paddr_t pml4_address, paddr_t apic_access_address,
 
     AutoVmcsLoad vmcs_load(&page_);
 
+    // Where the processor supports them, deliver interrupts through the
+    // virtual local APIC, and keep the guest's TSC deadline with the
+    // VMX-preemption timer. Neither needs a VM exit to get an interrupt to the
+    // guest once it is able to take it.
+    uint64_t procbased_ctls2 = read_msr(X86_MSR_IA32_VMX_PROCBASED_CTLS2);
+    uint64_t pinbased_ctls = read_msr(X86_MSR_IA32_VMX_TRUE_PINBASED_CTLS);
+    local_apic_state_.virtual_interrupt_delivery =
+        BIT_SHIFT(procbased_ctls2, 32 + 9) != 0;
+    local_apic_state_.preemption_timer = BIT_SHIFT(pinbased_ctls, 32 + 6) != 0;
+    local_apic_state_.preemption_timer_rate = MiscInfo().preemption_timer_rate;
+
     // Setup secondary processor-based VMCS controls.
     status = set_vmcs_control(VmcsField32::PROCBASED_CTLS2,
-                              read_msr(X86_MSR_IA32_VMX_PROCBASED_CTLS2),
+                              procbased_ctls2,
                               0,
+                              // Enable virtual-interrupt delivery, if we can.
+                              (local_apic_state_.virtual_interrupt_delivery ?
+                               PROCBASED_CTLS2_VIRT_INT_DELIVERY : 0) |
                               // Enable APIC access virtualization.
                               PROCBASED_CTLS2_APIC_ACCESS |
                               // Enable use of extended page tables.
@@ -541,7 +559,7 @@ status_t VmcsPerCpu::Setup(paddr_t pml4_address, paddr_t apic_access_address,
 
     // Setup pin-based VMCS controls.
     status = set_vmcs_control(VmcsField32::PINBASED_CTLS,
-                              read_msr(X86_MSR_IA32_VMX_TRUE_PINBASED_CTLS),
+                              pinbased_ctls,
                               read_msr(X86_MSR_IA32_VMX_PINBASED_CTLS),
                               // External interrupts cause a VM exit.
                               PINBASED_CTLS_EXT_INT_EXITING |
@@ -661,6 +679,16 @@ status_t VmcsPerCpu::Setup(paddr_t pml4_address, paddr_t apic_access_address,
     vmcs_write(VmcsField64::APIC_ACCESS_ADDRESS, apic_access_address);
     vmcs_write(VmcsField64::VIRTUAL_APIC_ADDRESS,
                local_apic_state_.virtual_apic_page.PhysicalAddress());
+    if (local_apic_state_.virtual_interrupt_delivery) {
+        // From Volume 3, Section 29.1.2: The EOI-exit bitmap selects which
+        // vectors cause a VM exit when the guest signals EOI. We have no level
+        // triggered interrupts to complete, so EOI is virtualized for all.
+        vmcs_write(VmcsField16::GUEST_INTERRUPT_STATUS, 0);
+        vmcs_write(VmcsField64::EOI_EXIT_BITMAP_0, 0);
+        vmcs_write(VmcsField64::EOI_EXIT_BITMAP_1, 0);
+        vmcs_write(VmcsField64::EOI_EXIT_BITMAP_2, 0);
+        vmcs_write(VmcsField64::EOI_EXIT_BITMAP_3, 0);
+    }
 
     // Setup MSR handling.
     vmcs_write(VmcsField64::MSR_BITMAPS_ADDRESS, msr_bitmaps_address);
@@ -806,7 +834,7 @@ void vmx_exit(VmxState* vmx_state) {
 }
 
 status_t VmcsPerCpu::Enter(const VmcsContext& context, GuestPhysicalAddressSpace* gpas,
-                           FifoDispatcher* serial_fifo) {
+                           IoTraps* io_traps, FifoDispatcher* serial_fifo) {
     AutoVmcsLoad vmcs_load(&page_);
     // FS is used for thread-local storage — save for this thread.
     vmcs_write(VmcsFieldXX::HOST_FS_BASE, read_msr(X86_MSR_IA32_FS_BASE));
@@ -817,28 +845,34 @@ status_t VmcsPerCpu::Enter(const VmcsContext& context, GuestPhysicalAddressSpace
     edit_msr_list(&host_msr_page_, 0, X86_MSR_IA32_KERNEL_GS_BASE,
                   read_msr(X86_MSR_IA32_KERNEL_GS_BASE));
 
-    if (x86_feature_test(X86_FEATURE_XSAVE)) {
-        // Save the host XCR0, and load the guest XCR0.
-        vmx_state_.host_state.xcr0 = x86_xgetbv(0);
-        x86_xsetbv(0, vmx_state_.guest_state.xcr0);
-    }
-
     if (!vmx_state_.resume) {
         vmcs_write(VmcsFieldXX::GUEST_RIP, context.entry());
         vmcs_write(VmcsFieldXX::GUEST_CR3, context.cr3());
         vmx_state_.guest_state.rsi = context.esi();
     }
 
-    status_t status = vmx_enter(&vmx_state_);
-    if (status != NO_ERROR) {
-        uint64_t error = vmcs_read(VmcsField32::INSTRUCTION_ERROR);
-        dprintf(SPEW, "vmlaunch failed: %#" PRIx64 "\n", error);
-    } else {
+    // Exits handled here resume the guest straight away, rather than making
+    // a round trip through userspace for each of them.
+    status_t status;
+    do {
+        if (x86_feature_test(X86_FEATURE_XSAVE)) {
+            // Save the host XCR0, and load the guest XCR0.
+            vmx_state_.host_state.xcr0 = x86_xgetbv(0);
+            x86_xsetbv(0, vmx_state_.guest_state.xcr0);
+        }
+
+        set_preemption_timer(&local_apic_state_);
+        status = vmx_enter(&vmx_state_);
+        if (status != NO_ERROR) {
+            uint64_t error = vmcs_read(VmcsField32::INSTRUCTION_ERROR);
+            dprintf(SPEW, "vmlaunch failed: %#" PRIx64 "\n", error);
+            return status;
+        }
         vmx_state_.resume = true;
         status = vmexit_handler(&vmx_state_.guest_state, &local_apic_state_, &io_apic_state_, gpas,
-                                serial_fifo);
-    }
-    return status;
+                                io_traps, serial_fifo);
+    } while (status == NO_ERROR);
+    return status == ERR_NEXT ? NO_ERROR : status;
 }
 
 static int vmcs_setup(void* arg) {
@@ -864,6 +898,10 @@ status_t VmcsContext::Create(mxtl::RefPtr<VmObject> guest_phys_mem,
     if (!ac.check())
         return ERR_NO_MEMORY;
 
+    ctx->io_traps_.reset(new (&ac) IoTraps);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
     status_t status = GuestPhysicalAddressSpace::Create(guest_phys_mem, &ctx->gpas_);
     if (status != NO_ERROR)
         return status;
@@ -966,10 +1004,15 @@ status_t VmcsContext::set_esi(uint32_t guest_esi) {
     return NO_ERROR;
 }
 
+status_t VmcsContext::set_io_trap(uint16_t io_port, mxtl::RefPtr<PortDispatcherV2> port,
+                                  uint64_t key) {
+    return io_traps_->Add(io_port, mxtl::move(port), key);
+}
+
 static int vmcs_launch(void* arg) {
     VmcsContext* context = static_cast<VmcsContext*>(arg);
     VmcsPerCpu* per_cpu = context->PerCpu();
-    return per_cpu->Enter(*context, context->gpas(), context->serial_fifo());
+    return per_cpu->Enter(*context, context->gpas(), context->io_traps(), context->serial_fifo());
 }
 
 status_t VmcsContext::Enter() {
@@ -1012,3 +1055,8 @@ status_t x86_guest_set_cr3(const mxtl::unique_ptr<GuestContext>& context, uintpt
 status_t x86_guest_set_esi(const mxtl::unique_ptr<GuestContext>& context, uint32_t guest_esi) {
     return context->set_esi(guest_esi);
 }
+
+status_t x86_guest_set_io_trap(const mxtl::unique_ptr<GuestContext>& context, uint16_t io_port,
+                               mxtl::RefPtr<PortDispatcherV2> port, uint64_t key) {
+    return context->set_io_trap(io_port, mxtl::move(port), key);
+}
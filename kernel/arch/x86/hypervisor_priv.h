@@ -47,6 +47,7 @@ enum class VmcsField16 : uint64_t {
     VPID                            = 0x0000,   /* Virtual processor ID */
     GUEST_CS_SELECTOR               = 0x0802,   /* Guest CS selector */
     GUEST_TR_SELECTOR               = 0x080e,   /* Guest TR selector */
+    GUEST_INTERRUPT_STATUS          = 0x0810,   /* Guest interrupt status */
     HOST_ES_SELECTOR                = 0x0c00,   /* Host ES selector */
     HOST_CS_SELECTOR                = 0x0c02,   /* Host CS selector */
     HOST_SS_SELECTOR                = 0x0c04,   /* Host SS selector */
@@ -64,6 +65,10 @@ enum class VmcsField64 : uint64_t {
     VIRTUAL_APIC_ADDRESS            = 0x2012,   /* Virtual-APIC address */
     APIC_ACCESS_ADDRESS             = 0x2014,   /* APIC-access address */
     EPT_POINTER                     = 0x201a,   /* EPT pointer */
+    EOI_EXIT_BITMAP_0               = 0x201c,   /* EOI-exit bitmap 0 */
+    EOI_EXIT_BITMAP_1               = 0x201e,   /* EOI-exit bitmap 1 */
+    EOI_EXIT_BITMAP_2               = 0x2020,   /* EOI-exit bitmap 2 */
+    EOI_EXIT_BITMAP_3               = 0x2022,   /* EOI-exit bitmap 3 */
     GUEST_PHYSICAL_ADDRESS          = 0x2400,   /* Guest physical address */
     LINK_POINTER                    = 0x2800,   /* VMCS link pointer */
     GUEST_IA32_PAT                  = 0x2804,   /* Guest PAT */
@@ -105,6 +110,7 @@ enum class VmcsField32 : uint64_t {
     GUEST_INTERRUPTIBILITY_STATE    = 0x4824,   /* Guest interruptibility state */
     GUEST_ACTIVITY_STATE            = 0x4826,   /* Guest activity state */
     GUEST_IA32_SYSENTER_CS          = 0x482a,   /* Guest SYSENTER CS */
+    VMX_PREEMPTION_TIMER_VALUE      = 0x482e,   /* VMX-preemption timer value */
 };
 
 enum class VmcsFieldXX : uint64_t {
@@ -140,6 +146,7 @@ enum class VmcsFieldXX : uint64_t {
 #define PROCBASED_CTLS2_EPT                 (1u << 1)
 #define PROCBASED_CTLS2_RDTSCP              (1u << 3)
 #define PROCBASED_CTLS2_VPID                (1u << 5)
+#define PROCBASED_CTLS2_VIRT_INT_DELIVERY   (1u << 9)
 
 /* PROCBASED_CTLS flags */
 #define PROCBASED_CTLS_INT_WINDOW_EXITING   (1u << 2)
@@ -156,6 +163,7 @@ enum class VmcsFieldXX : uint64_t {
 /* PINBASED_CTLS flags */
 #define PINBASED_CTLS_EXT_INT_EXITING       (1u << 0)
 #define PINBASED_CTLS_NMI_EXITING           (1u << 3)
+#define PINBASED_CTLS_PREEMPTION_TIMER      (1u << 6)
 
 /* EXIT_CTLS flags */
 #define EXIT_CTLS_64BIT_MODE                (1u << 9)
@@ -201,6 +209,7 @@ struct VmxInfo {
 struct MiscInfo {
     bool wait_for_sipi;
     uint32_t msr_list_limit;
+    uint8_t preemption_timer_rate;
 
     MiscInfo();
 };
@@ -263,6 +272,13 @@ struct LocalApicState {
     void* virtual_apic;
     // Virtual local APIC page.
     VmxPage virtual_apic_page;
+    // Whether the processor delivers interrupts posted to the virtual local
+    // APIC, rather than us injecting them.
+    bool virtual_interrupt_delivery;
+    // Whether the TSC deadline is kept by the VMX-preemption timer, and the
+    // shift from TSC ticks to timer ticks if so.
+    bool preemption_timer;
+    uint8_t preemption_timer_rate;
 };
 
 /* Stores the IO APIC state across VM exits. */
@@ -283,7 +299,7 @@ public:
     status_t Setup(paddr_t pml4_address, paddr_t apic_access_address,
                    paddr_t msr_bitmaps_address);
     status_t Enter(const VmcsContext& context, GuestPhysicalAddressSpace* gpas,
-                   FifoDispatcher* serial_fifo);
+                   IoTraps* io_traps, FifoDispatcher* serial_fifo);
 
 private:
     VmxPage host_msr_page_;
@@ -0,0 +1,188 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <arch/ops.h>
+#include <arch/x86.h>
+#include <arch/x86/feature.h>
+#include <arch/x86/idle.h>
+#include <debug.h>
+#include <inttypes.h>
+#include <kernel/cmdline.h>
+#include <kernel/irqsoff.h>
+#include <kernel/mp.h>
+#include <kernel/thread.h>
+#include <kernel/timer.h>
+#include <platform.h>
+#include <stdio.h>
+#include <trace.h>
+
+#define LOCAL_TRACE 0
+
+/* The exit latencies and residencies are the conservative numbers for recent
+ * Intel parts; nothing here reads the ACPI _CST tables which would say what
+ * this machine really needs. */
+struct x86_cstate {
+    const char* name;
+    uint32_t hint;
+    /* time from a wakeup event to the cpu running again */
+    lk_time_t exit_latency;
+    /* shortest stay in the state for it to save more than entering it costs */
+    lk_time_t target_residency;
+};
+
+static const struct x86_cstate cstates[] = {
+    { "C1", 0x00, LK_USEC(2), LK_USEC(2) },
+    { "C1E", 0x01, LK_USEC(10), LK_USEC(20) },
+    { "C3", 0x10, LK_USEC(70), LK_USEC(200) },
+    { "C6", 0x20, LK_USEC(85), LK_USEC(300) },
+    { "C7", 0x30, LK_USEC(100), LK_USEC(400) },
+};
+
+/* the states this cpu supports and which exit quickly enough, shallowest first */
+static const struct x86_cstate* usable_cstates[countof(cstates)];
+static uint num_usable_cstates;
+
+enum {
+    IDLE_RUNNING = 0,
+    /* in mwait, watching |wake| */
+    IDLE_WAITING = 1,
+    /* another cpu wrote |wake| to make this one reschedule */
+    IDLE_POKED = 2,
+};
+
+struct idle_state {
+    volatile int wake;
+    /* moving average of how long this cpu stayed idle */
+    lk_time_t average_idle;
+} __CPU_ALIGN;
+
+static struct idle_state idle_states[SMP_MAX_CPUS];
+
+static bool cstate_supported(const struct cpuid_leaf* leaf, const struct x86_cstate* state)
+{
+    /* edx holds the number of sub-states of each C-state, four bits each,
+     * starting from C0 */
+    uint level = (state->hint >> 4) + 1;
+    uint substates = (leaf->d >> (4 * level)) & 0xf;
+    if ((state->hint & 0xf) >= substates)
+        return false;
+
+    /* below C1E the local apic timer and, without an invariant tsc, the tsc
+     * stop, and nothing else would wake us for the next timer */
+    if (state->hint >= 0x10 &&
+        !(x86_feature_test(X86_FEATURE_ARAT) && x86_feature_test(X86_FEATURE_INVAR_TSC)))
+        return false;
+
+    return true;
+}
+
+void x86_idle_init(void)
+{
+    if (!x86_feature_test(X86_FEATURE_MON) || !cmdline_get_bool("kernel.x86.mwait", true)) {
+        dprintf(INFO, "idle: using hlt\n");
+        return;
+    }
+
+    /* without a way to break out of mwait on an interrupt with them masked,
+     * there is no closing the window between checking for a poke and
+     * waiting */
+    const struct cpuid_leaf* leaf = x86_get_cpuid_leaf(X86_CPUID_MON);
+    if (!leaf || (leaf->c & 0x3) != 0x3) {
+        dprintf(INFO, "idle: mwait cannot break on interrupts, using hlt\n");
+        return;
+    }
+
+    lk_time_t max_latency = LK_USEC(cmdline_get_uint32("kernel.x86.idle-max-latency-us",
+                                                       UINT32_MAX));
+    dprintf(INFO, "idle: mwait states:");
+    for (const struct x86_cstate& state : cstates) {
+        if (!cstate_supported(leaf, &state) || state.exit_latency > max_latency)
+            continue;
+        usable_cstates[num_usable_cstates++] = &state;
+        dprintf(INFO, " %s", state.name);
+    }
+    dprintf(INFO, "\n");
+}
+
+/* the deepest state which the cpu is expected to stay idle long enough to be
+ * worth it */
+static const struct x86_cstate* pick_cstate(struct idle_state* idle, lk_time_t now)
+{
+    lk_time_t predicted = idle->average_idle;
+
+    lk_time_t deadline = timer_get_next_deadline();
+    if (deadline != INFINITE_TIME) {
+        lk_time_t until = deadline > now ? deadline - now : 0;
+        if (until < predicted)
+            predicted = until;
+    }
+
+    const struct x86_cstate* picked = usable_cstates[0];
+    for (uint i = 1; i < num_usable_cstates; i++) {
+        if (usable_cstates[i]->target_residency > predicted)
+            break;
+        picked = usable_cstates[i];
+    }
+    return picked;
+}
+
+void arch_idle(void)
+{
+    if (arch_ints_disabled())
+        return;
+
+    if (num_usable_cstates == 0) {
+        x86_hlt();
+        return;
+    }
+
+    arch_disable_ints();
+
+    struct idle_state* idle = &idle_states[arch_curr_cpu_num()];
+    lk_time_t start = current_time();
+    const struct x86_cstate* state = pick_cstate(idle, start);
+
+    /* once |wake| says we are waiting, other cpus may poke it instead of
+     * sending a reschedule ipi, so watch it before checking it one last
+     * time */
+    atomic_store(&idle->wake, IDLE_WAITING);
+    x86_monitor(&idle->wake);
+    if (atomic_load(&idle->wake) == IDLE_WAITING)
+        x86_mwait(state->hint, 1);
+    int woken = atomic_swap(&idle->wake, IDLE_RUNNING);
+
+    /* weight the latest stay by a quarter, so that a single long or short
+     * one does not swing the next choice */
+    lk_time_t idled = current_time() - start;
+    idle->average_idle = idle->average_idle - idle->average_idle / 4 + idled / 4;
+
+    LTRACEF("cpu %u in %s for %" PRIu64 " ns\n", arch_curr_cpu_num(), state->name, idled);
+
+    /* mwait ends at the first interrupt, so the wait holds none up */
+    irqsoff_cancel();
+
+    /* any interrupt which woke us is taken here */
+    arch_enable_ints();
+
+    if (woken == IDLE_POKED && mp_mbx_reschedule_irq() == INT_RESCHEDULE)
+        thread_preempt(false);
+}
+
+mp_cpu_mask_t x86_idle_wake_cpus(mp_cpu_mask_t mask)
+{
+    mp_cpu_mask_t woken = 0;
+    if (num_usable_cstates == 0)
+        return 0;
+
+    for (uint cpu = 0; mask != 0 && cpu < SMP_MAX_CPUS; cpu++, mask >>= 1) {
+        if (!(mask & 1))
+            continue;
+        int expected = IDLE_WAITING;
+        if (atomic_cmpxchg(&idle_states[cpu].wake, &expected, IDLE_POKED))
+            woken |= 1U << cpu;
+    }
+    return woken;
+}
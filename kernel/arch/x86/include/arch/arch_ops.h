@@ -14,20 +14,31 @@
 
 #include <arch/x86.h>
 #include <arch/x86/mp.h>
+#include <kernel/irqsoff.h>
 
 __BEGIN_CDECLS
 
 /* override of some routines */
 static inline void arch_enable_ints(void)
 {
+#if WITH_IRQSOFF_TRACE
+    irqsoff_end(x86_get_ip());
+#endif
     CF;
     __asm__ volatile("sti");
 }
 
 static inline void arch_disable_ints(void)
 {
+#if WITH_IRQSOFF_TRACE
+    bool enabled = (x86_save_flags() & X86_FLAGS_IF) != 0;
+#endif
     __asm__ volatile("cli");
     CF;
+#if WITH_IRQSOFF_TRACE
+    if (enabled)
+        irqsoff_begin(x86_get_ip());
+#endif
 }
 
 static inline bool arch_ints_disabled(void)
@@ -65,6 +76,11 @@ static inline void arch_spinloop_signal(void)
 #define smp_wmb()   wmb()
 #define smp_rmb()   rmb()
 
+// x86 userspace asks cpuid directly.
+static inline uint32_t arch_cpu_features(void) {
+    return 0;
+}
+
 static inline uint32_t arch_dcache_line_size(void) {
     // TODO(mcgrathr): not needed for anything yet
     // cpuid can separately report line sizes for L[123]
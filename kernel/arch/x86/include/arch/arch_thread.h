@@ -42,9 +42,17 @@ struct arch_thread {
     /* buffer to save fpu and extended register (e.g., PT) state */
     vaddr_t *extended_register_state;
     uint8_t extended_register_buffer[X86_MAX_EXTENDED_REGISTER_SIZE + 64];
+    /* cpu whose registers still hold what was last saved to or restored
+     * from |extended_register_state|, or -1 */
+    int32_t extended_register_cpu;
+    /* the saved state is the initial one, and the buffer may be stale */
+    bool extended_register_state_init;
 
     /* if non-NULL, address to return to on page fault */
     void *page_fault_resume;
+
+    /* IA32_PQR_ASSOC value to run with, see arch/x86/rdt.h */
+    uint64_t rdt_group;
 };
 
 static inline void x86_set_suspended_general_regs(struct arch_thread *thread,
@@ -33,6 +33,13 @@ struct arch_aspace {
      * actually an mp_cpu_mask_t, but header dependencies. */
     volatile int active_cpus;
 
+    /* process context id the aspace runs with, 0 for none.  tlb_generation is
+     * bumped by every shootdown; a cpu whose entry in cpu_tlb_generation is
+     * behind it may hold stale entries for pcid and flushes them on switch in */
+    uint16_t pcid;
+    volatile uint64_t tlb_generation;
+    uint64_t cpu_tlb_generation[SMP_MAX_CPUS];
+
     /* Pointer to a bitmap::RleBitmap representing the range of ports
      * enabled in this aspace. */
     void *io_bitmap;
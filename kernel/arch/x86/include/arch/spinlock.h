@@ -8,6 +8,7 @@
 #pragma once
 
 #include <arch/x86.h>
+#include <kernel/irqsoff.h>
 #include <magenta/compiler.h>
 #include <stdbool.h>
 
@@ -66,6 +67,13 @@ static inline void arch_spin_unlock(spin_lock_t *lock)
 }
 #endif // WITH_SMP
 
+/* Loads the ticket a ticket lock is serving, for a waiter to compare with its
+ * own between calls to arch_spinloop_pause() */
+static inline uint32_t arch_spin_load_for_wait(const uint32_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
 /* flags are unused on x86 */
 #define ARCH_DEFAULT_SPIN_LOCK_FLAG_INTERRUPTS  0
 
@@ -75,11 +83,19 @@ arch_interrupt_save(spin_lock_saved_state_t *statep, spin_lock_save_flags_t flag
     *statep = x86_save_flags();
     __asm__ volatile("cli");
     CF;
+#if WITH_IRQSOFF_TRACE
+    if (*statep & X86_FLAGS_IF)
+        irqsoff_begin(x86_get_ip());
+#endif
 }
 
 static inline void
 arch_interrupt_restore(spin_lock_saved_state_t old_state, spin_lock_save_flags_t flags)
 {
+#if WITH_IRQSOFF_TRACE
+    if (old_state & X86_FLAGS_IF)
+        irqsoff_end(x86_get_ip());
+#endif
     x86_restore_flags(old_state);
 }
 
@@ -140,6 +140,15 @@ static inline void x86_clts(void) {__asm__ __volatile__ ("clts"); }
 static inline void x86_hlt(void) {__asm__ __volatile__ ("hlt"); }
 static inline void x86_sti(void) {__asm__ __volatile__ ("sti"); }
 static inline void x86_cli(void) {__asm__ __volatile__ ("cli"); }
+static inline void x86_monitor(volatile void* addr)
+{
+    __asm__ __volatile__("monitor" :: "a"(addr), "c"(0), "d"(0) : "memory");
+}
+/* with |ecx| bit 0 set, an interrupt wakes the cpu even while they are masked */
+static inline void x86_mwait(uint32_t hint, uint32_t ecx)
+{
+    __asm__ __volatile__("mwait" :: "a"(hint), "c"(ecx) : "memory");
+}
 static inline void x86_ltr(uint16_t sel)
 {
     __asm__ __volatile__ ("ltr %%ax" :: "a" (sel));
@@ -423,6 +432,16 @@ static inline uint64_t x86_save_flags(void)
     return state;
 }
 
+/* the address of the instruction after this, in whatever it is inlined into */
+static inline uintptr_t x86_get_ip(void)
+{
+    uintptr_t ip;
+
+    __asm__ volatile("leaq 0(%%rip), %0" : "=r" (ip));
+
+    return ip;
+}
+
 static inline void x86_restore_flags(uint64_t flags)
 {
     __asm__ volatile(
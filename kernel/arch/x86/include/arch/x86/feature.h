@@ -28,8 +28,13 @@ enum x86_cpuid_leaf_num {
     X86_CPUID_MODEL_FEATURES = 0x1,
     X86_CPUID_CACHE_V1 = 0x2,
     X86_CPUID_CACHE_V2 = 0x4,
+    X86_CPUID_MON = 0x5,
+    X86_CPUID_THERMAL_AND_POWER = 0x6,
+    X86_CPUID_PERFORMANCE_MONITORING = 0xa,
     X86_CPUID_TOPOLOGY = 0xb,
     X86_CPUID_XSAVE = 0xd,
+    X86_CPUID_RDT_MONITORING = 0xf,
+    X86_CPUID_RDT_ALLOCATION = 0x10,
     X86_CPUID_PT = 0x14,
     X86_CPUID_TSC = 0x15,
 
@@ -96,10 +101,13 @@ void x86_feature_debug(void);
 
 /* add feature bits to test here */
 #define X86_FEATURE_SSE3         X86_CPUID_BIT(0x1, 2, 0)
+#define X86_FEATURE_MON          X86_CPUID_BIT(0x1, 2, 3)
 #define X86_FEATURE_VMX          X86_CPUID_BIT(0x1, 2, 5)
+#define X86_FEATURE_EST          X86_CPUID_BIT(0x1, 2, 7)
 #define X86_FEATURE_SSSE3        X86_CPUID_BIT(0x1, 2, 9)
 #define X86_FEATURE_SSE4_1       X86_CPUID_BIT(0x1, 2, 19)
 #define X86_FEATURE_SSE4_2       X86_CPUID_BIT(0x1, 2, 20)
+#define X86_FEATURE_PCID         X86_CPUID_BIT(0x1, 2, 17)
 #define X86_FEATURE_X2APIC       X86_CPUID_BIT(0x1, 2, 21)
 #define X86_FEATURE_TSC_DEADLINE X86_CPUID_BIT(0x1, 2, 24)
 #define X86_FEATURE_AESNI        X86_CPUID_BIT(0x1, 2, 25)
@@ -112,10 +120,17 @@ void x86_feature_debug(void);
 #define X86_FEATURE_FXSR         X86_CPUID_BIT(0x1, 3, 24)
 #define X86_FEATURE_SSE          X86_CPUID_BIT(0x1, 3, 25)
 #define X86_FEATURE_SSE2         X86_CPUID_BIT(0x1, 3, 26)
+#define X86_FEATURE_TURBO        X86_CPUID_BIT(0x6, 0, 1)
+#define X86_FEATURE_ARAT         X86_CPUID_BIT(0x6, 0, 2)
+#define X86_FEATURE_HWP          X86_CPUID_BIT(0x6, 0, 7)
+#define X86_FEATURE_HWP_EPP      X86_CPUID_BIT(0x6, 0, 10)
 #define X86_FEATURE_FSGSBASE     X86_CPUID_BIT(0x7, 1, 0)
 #define X86_FEATURE_TSC_ADJUST   X86_CPUID_BIT(0x7, 1, 1)
 #define X86_FEATURE_AVX2         X86_CPUID_BIT(0x7, 1, 5)
 #define X86_FEATURE_SMEP         X86_CPUID_BIT(0x7, 1, 7)
+#define X86_FEATURE_ERMS         X86_CPUID_BIT(0x7, 1, 9)
+#define X86_FEATURE_RDT_M        X86_CPUID_BIT(0x7, 1, 12)
+#define X86_FEATURE_RDT_A        X86_CPUID_BIT(0x7, 1, 15)
 #define X86_FEATURE_RDSEED       X86_CPUID_BIT(0x7, 1, 18)
 #define X86_FEATURE_SMAP         X86_CPUID_BIT(0x7, 1, 20)
 #define X86_FEATURE_PT           X86_CPUID_BIT(0x7, 1, 25)
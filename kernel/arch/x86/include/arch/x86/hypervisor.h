@@ -14,6 +14,8 @@
 typedef struct vm_page vm_page_t;
 
 class FifoDispatcher;
+class IoTraps;
+class PortDispatcherV2;
 class VmObject;
 struct VmxInfo;
 class VmxonPerCpu;
@@ -75,6 +77,8 @@ public:
     uint32_t esi() const { return esi_; }
     GuestPhysicalAddressSpace* gpas() const { return gpas_.get(); }
     FifoDispatcher* serial_fifo() const { return serial_fifo_.get(); }
+    status_t set_io_trap(uint16_t io_port, mxtl::RefPtr<PortDispatcherV2> port, uint64_t key);
+    IoTraps* io_traps() const { return io_traps_.get(); }
 
 private:
     uintptr_t entry_ = UINTPTR_MAX;
@@ -82,6 +86,7 @@ private:
     uint32_t esi_ = UINT32_MAX;
     mxtl::unique_ptr<GuestPhysicalAddressSpace> gpas_;
     mxtl::RefPtr<FifoDispatcher> serial_fifo_;
+    mxtl::unique_ptr<IoTraps> io_traps_;
 
     VmxPage msr_bitmaps_page_;
     VmxPage apic_address_page_;
@@ -102,3 +107,8 @@ status_t x86_guest_set_cr3(const mxtl::unique_ptr<GuestContext>& context, uintpt
 /* Set the initial ESI of the guest context.
 */
 status_t x86_guest_set_esi(const mxtl::unique_ptr<GuestContext>& context, uint32_t guest_esi);
+
+/* Queue guest writes to an IO port on a port, rather than exiting to userspace.
+ */
+status_t x86_guest_set_io_trap(const mxtl::unique_ptr<GuestContext>& context, uint16_t io_port,
+                               mxtl::RefPtr<PortDispatcherV2> port, uint64_t key);
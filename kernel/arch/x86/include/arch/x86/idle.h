@@ -0,0 +1,21 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+#pragma once
+
+#include <kernel/mp.h>
+#include <magenta/compiler.h>
+
+__BEGIN_CDECLS
+
+/* picks the C-states arch_idle() may use, once the cpuid features are known */
+void x86_idle_init(void);
+
+/* wakes each cpu in |mask| which is waiting in mwait by writing to the line it
+ * monitors, so that it reschedules without taking an ipi.  returns the cpus
+ * woken this way; the rest still need one. */
+mp_cpu_mask_t x86_idle_wake_cpus(mp_cpu_mask_t mask);
+
+__END_CDECLS
@@ -93,6 +93,8 @@ uintptr_t x86_init_percpu(uint cpu_num, uintptr_t unsafe_sp);
 void x86_set_local_apic_id(uint32_t apic_id);
 
 int x86_apic_id_to_cpu_num(uint32_t apic_id);
+/* returns -1 if there is no such cpu */
+int64_t x86_cpu_num_to_apic_id(uint cpu_num);
 
 // Allocate all of the necessary structures for all of the APs to run.
 status_t x86_allocate_ap_structures(uint32_t *apic_ids, uint8_t cpu_count);
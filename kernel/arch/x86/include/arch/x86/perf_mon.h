@@ -0,0 +1,38 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <err.h>
+#include <stdint.h>
+
+#include <kernel/thread.h>
+#include <magenta/compiler.h>
+#include <magenta/mtrace.h>
+
+__BEGIN_CDECLS
+
+void x86_perfmon_init(void);
+
+// Turns the counters on or off around a context switch when only one
+// thread is being counted.
+void x86_perfmon_context_switch(thread_t* oldthread, thread_t* newthread);
+
+enum handler_return x86_perfmon_interrupt_handler(void);
+
+__END_CDECLS
+
+#ifdef __cplusplus
+
+status_t x86_perfmon_get_properties(mx_perfmon_properties_t* props);
+
+status_t x86_perfmon_start(const mx_perfmon_config_t* config);
+
+status_t x86_perfmon_stop();
+
+status_t x86_perfmon_get_counts(uint32_t cpu, mx_perfmon_counts_t* counts);
+
+#endif // __cplusplus
@@ -0,0 +1,54 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <err.h>
+#include <stdint.h>
+
+#include <kernel/thread.h>
+#include <magenta/compiler.h>
+
+__BEGIN_CDECLS
+
+void x86_rdt_init(void);
+
+// Loads the class of service and monitoring id of the thread coming in.
+void x86_rdt_context_switch(thread_t* oldthread, thread_t* newthread);
+
+__END_CDECLS
+
+#ifdef __cplusplus
+
+// A resource group is a set of threads that share a part of the last level
+// cache and a memory bandwidth throttle, and whose cache occupancy is counted
+// together. Groups are named by the IA32_PQR_ASSOC value their threads run
+// with. Group 0 is the default every thread starts out in: the whole cache,
+// unthrottled and counted with everything else; it takes no references.
+
+// Creates a group confined to the ways of the L3 set in |l3_mask|, all of them
+// if zero, with |mba_delay| percent of delay added to its memory requests.
+// If |strict| is false, whatever the hardware can't do is left out, otherwise
+// it fails with ERR_NOT_SUPPORTED. Returns ERR_NO_RESOURCES once the hardware
+// runs out of classes of service.
+status_t x86_rdt_group_create(uint64_t l3_mask, uint32_t mba_delay, bool strict,
+                              uint64_t* group);
+
+// Takes and drops references to a group. The last release frees the group's
+// class of service and monitoring id for reuse.
+void x86_rdt_group_acquire(uint64_t group);
+void x86_rdt_group_release(uint64_t group);
+
+// Bytes of the last level cache filled by the group's threads, summed over the
+// packages of the system.
+status_t x86_rdt_group_occupancy(uint64_t group, uint64_t* l3_bytes);
+
+// Puts |thread| in |group| the next time it is switched to.
+static inline void x86_rdt_set_thread_group(thread_t* thread, uint64_t group) {
+    thread->arch.rdt_group = group;
+}
+
+#endif // __cplusplus
@@ -5,27 +5,47 @@
 // https://opensource.org/licenses/MIT
 
 #pragma once
+
+/* options for the _x86_copy functions */
+#define X86_USERCOPY_SMAP (1 << 0) /* SMAP is enabled, stac/clac around the copy */
+#define X86_USERCOPY_ERMS (1 << 1) /* the cpu has fast rep movsb */
+
+#ifndef ASSEMBLY
+
+#include <iovec.h>
 #include <magenta/compiler.h>
 
 __BEGIN_CDECLS
 
 /* These functions are identical to arch_copy_from_user, except they take an
  * additional argument of fault_return, used to handle page faults within the
- * function.  These should not be called anywhere except in the x86 usercopy
- * implementation. */
+ * function, and a set of X86_USERCOPY_ options.  These should not be called
+ * anywhere except in the x86 usercopy implementation. */
 
 status_t _x86_copy_from_user(
         void *dst,
         const void *src,
         size_t len,
-        bool smap_avail,
+        uint32_t options,
         void **fault_return);
 
 status_t _x86_copy_to_user(
         void *dst,
         const void *src,
         size_t len,
-        bool smap_avail,
+        uint32_t options,
+        void **fault_return);
+
+/* Gathers the segments of |iov| into |dst| with a single fault handler and
+ * SMAP window.  Unlike the functions above this does not check the segments,
+ * the caller must already have validated every one of them. */
+status_t _x86_copy_iovec_from_user(
+        void *dst,
+        const iovec_t *iov,
+        size_t count,
+        uint32_t options,
         void **fault_return);
 
 __END_CDECLS
+
+#endif // ASSEMBLY
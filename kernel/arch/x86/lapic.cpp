@@ -323,6 +323,16 @@ enum handler_return apic_timer_interrupt_handler(void) {
     return platform_handle_apic_timer_tick();
 }
 
+// The cpu masks the performance counter interrupt each time it delivers
+// it, so the handler has to unmask it again.
+void apic_pmi_mask(void) {
+    *LVT_PERF_ADDR = LVT_VECTOR(X86_INT_APIC_PMI) | LVT_MASKED;
+}
+
+void apic_pmi_unmask(void) {
+    *LVT_PERF_ADDR = LVT_VECTOR(X86_INT_APIC_PMI);
+}
+
 static void apic_error_init(void) {
     *LVT_ERROR_ADDR = LVT_VECTOR(X86_INT_APIC_ERROR);
     // Re-arm the error interrupt triggering mechanism
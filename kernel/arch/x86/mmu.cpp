@@ -17,6 +17,7 @@
 #include <arch/x86/feature.h>
 #include <arch/x86/mmu.h>
 #include <arch/x86/mmu_mem_types.h>
+#include <kernel/auto_lock.h>
 #include <kernel/mp.h>
 #include <kernel/vm.h>
 
@@ -32,6 +33,15 @@ uint8_t g_paddr_width = 32;
 /* True if the system supports 1GB pages */
 static bool supports_huge_pages = false;
 
+/* True if user aspaces run with their own process context ids */
+static bool pcid_enabled = false;
+
+/* pcids handed out to user aspaces.  pcid 0 is what the kernel aspace and any
+ * aspace that couldn't get one of its own run with. */
+#define X86_NUM_PCIDS (X86_CR3_PCID_MASK + 1)
+static SpinLock pcid_lock;
+static uint64_t pcid_bitmap[X86_NUM_PCIDS / 64] = {1};
+
 /* top level kernel page tables, initialized in start.S */
 pt_entry_t pml4[NO_OF_PT_ENTRIES] __ALIGNED(PAGE_SIZE);
 pt_entry_t pdp[NO_OF_PT_ENTRIES] __ALIGNED(PAGE_SIZE); /* temporary */
@@ -123,69 +133,144 @@ static void x86_tlb_global_invalidate() {
     }
 }
 
-/* Task used for invalidating a TLB entry on each CPU */
-struct tlb_invalidate_page_context {
+/* Collects the TLB invalidations one map, unmap or protect operation needs so
+ * that they can be issued with a single mp_sync_exec once the page tables are
+ * updated, rather than one IPI round per entry.  Past kMaxPages addresses the
+ * whole TLB is flushed instead.  Page tables the operation frees are held until
+ * after the flush, since other cpus may still be walking through them. */
+struct PendingTlbInvalidation {
+    static constexpr uint kMaxPages = 32;
+
+    PendingTlbInvalidation() { list_initialize(&freed_tables); }
+    ~PendingTlbInvalidation() { DEBUG_ASSERT(count == 0 && list_is_empty(&freed_tables)); }
+
+    void enqueue(vaddr_t vaddr, page_table_levels level, bool global_page) {
+        if (global_page)
+            contains_global = true;
+
+        /* top level changes have always been full flushes.  with pcids on, an
+         * invlpg only drops paging structure caches for the current pcid, so
+         * upper level changes to the shared kernel tables need one too */
+        if (level == PML4_L || (global_page && level != PT_L && pcid_enabled)) {
+            full_shootdown = true;
+            return;
+        }
+        if (full_shootdown)
+            return;
+        if (count == kMaxPages) {
+            full_shootdown = true;
+            return;
+        }
+        addrs[count++] = vaddr;
+    }
+
+    void free_table(vm_page_t* page) {
+        list_add_tail(&freed_tables, &page->free.node);
+    }
+
+    void clear() {
+        count = 0;
+        full_shootdown = false;
+        contains_global = false;
+    }
+
+    uint count = 0;
+    bool full_shootdown = false;
+    bool contains_global = false;
+    vaddr_t addrs[kMaxPages];
+    list_node freed_tables;
+};
+
+static uint16_t x86_pcid_alloc() {
+    if (!pcid_enabled)
+        return 0;
+
+    AutoSpinLockIrqSave guard(pcid_lock);
+    for (uint i = 0; i < countof(pcid_bitmap); i++) {
+        if (~pcid_bitmap[i]) {
+            uint bit = __builtin_ctzll(~pcid_bitmap[i]);
+            pcid_bitmap[i] |= 1ull << bit;
+            return static_cast<uint16_t>(i * 64 + bit);
+        }
+    }
+    return 0;
+}
+
+static void x86_pcid_free(uint16_t pcid) {
+    if (pcid == 0)
+        return;
+
+    AutoSpinLockIrqSave guard(pcid_lock);
+    DEBUG_ASSERT(pcid_bitmap[pcid / 64] & (1ull << (pcid % 64)));
+    pcid_bitmap[pcid / 64] &= ~(1ull << (pcid % 64));
+}
+
+/* Task used for invalidating TLB entries on each CPU */
+struct tlb_invalidate_context {
     ulong target_cr3;
-    vaddr_t vaddr;
-    enum page_table_levels level;
-    bool global_page;
+    const PendingTlbInvalidation* pending;
 };
-static void tlb_invalidate_page_task(void* raw_context) {
+static void tlb_invalidate_task(void* raw_context) {
     DEBUG_ASSERT(arch_ints_disabled());
-    tlb_invalidate_page_context* context = (tlb_invalidate_page_context*)raw_context;
+    tlb_invalidate_context* context = (tlb_invalidate_context*)raw_context;
+    const PendingTlbInvalidation* pending = context->pending;
 
-    ulong cr3 = x86_get_cr3();
-    if (context->target_cr3 != cr3 && !context->global_page) {
+    ulong cr3 = x86_get_cr3() & X86_CR3_BASE_MASK;
+    if (context->target_cr3 != cr3 && !pending->contains_global) {
         /* This invalidation doesn't apply to this CPU, ignore it */
         return;
     }
 
-    switch (context->level) {
-    case PML4_L:
-        x86_tlb_global_invalidate();
-        break;
-    case PDP_L:
-    case PD_L:
-    case PT_L:
-        __asm__ volatile("invlpg %0" ::"m"(*(uint8_t*)context->vaddr));
-        break;
+    if (pending->full_shootdown) {
+        if (pending->contains_global) {
+            x86_tlb_global_invalidate();
+        } else {
+            /* reloading cr3 drops the non global entries of the current pcid */
+            x86_set_cr3(x86_get_cr3());
+        }
+        return;
+    }
+
+    for (uint i = 0; i < pending->count; i++) {
+        __asm__ volatile("invlpg %0" ::"m"(*(uint8_t*)pending->addrs[i]));
     }
 }
 
 /**
- * @brief Invalidate a single page at a given page table level
+ * @brief Execute a batch of queued TLB invalidations
  *
  * @param aspace The aspace we're invalidating for (if NULL, assume for current one)
- * @param vaddr The virtual address we are invalidating the TLB entry for
- * @param level The page table level that maps this vaddr
- * @param global_page True if we are invalidating a global mapping
- *
- * TODO(teisenbe): Optimize this.  This is horribly inefficient.
- * We should also change this to pool invalidations from a single
- * "transaction" and then only execute a single mp_sync_exec for that
- * transaction, rather than one per page.
+ * @param pending The invalidations to perform.  Emptied on return.
  */
-void x86_tlb_invalidate_page(arch_aspace_t* aspace, vaddr_t vaddr, enum page_table_levels level,
-                             bool global_page) {
-    ulong cr3 = aspace ? aspace->pt_phys : x86_get_cr3();
-    struct tlb_invalidate_page_context task_context = {
-        .target_cr3 = cr3, .vaddr = vaddr, .level = level, .global_page = global_page,
-    };
+static void x86_tlb_invalidate(arch_aspace_t* aspace, PendingTlbInvalidation* pending) {
+    if (pending->count > 0 || pending->full_shootdown) {
+        ulong cr3 = aspace ? aspace->pt_phys : (x86_get_cr3() & X86_CR3_BASE_MASK);
+        struct tlb_invalidate_context task_context = {
+            .target_cr3 = cr3, .pending = pending,
+        };
+
+        /* Target only CPUs this aspace is active on.  It may be the case that some
+         * other CPU will become active in it after this load, or will have left it
+         * just before this load.  In the former case, it is becoming active after
+         * the write to the page table, so it will see the change.  In the latter
+         * case, it will get a spurious request to flush.  CPUs that ran the aspace
+         * earlier may still hold entries tagged with its pcid; bumping the
+         * generation first makes them flush when they switch back to it. */
+        mp_cpu_mask_t targets;
+        if (pending->contains_global || aspace == nullptr) {
+            targets = MP_CPU_ALL;
+        } else {
+            atomic_add_u64(&aspace->tlb_generation, 1);
+            targets = atomic_load(&aspace->active_cpus);
+            static_assert(sizeof(mp_cpu_mask_t) == sizeof(aspace->active_cpus), "err");
+        }
 
-    /* Target only CPUs this aspace is active on.  It may be the case that some
-     * other CPU will become active in it after this load, or will have left it
-     * just before this load.  In the former case, it is becoming active after
-     * the write to the page table, so it will see the change.  In the latter
-     * case, it will get a spurious request to flush. */
-    mp_cpu_mask_t targets;
-    if (global_page || aspace == nullptr) {
-        targets = MP_CPU_ALL;
-    } else {
-        targets = atomic_load(&aspace->active_cpus);
-        static_assert(sizeof(mp_cpu_mask_t) == sizeof(aspace->active_cpus), "err");
+        mp_sync_exec(targets, tlb_invalidate_task, &task_context);
     }
 
-    mp_sync_exec(targets, tlb_invalidate_page_task, &task_context);
+    if (!list_is_empty(&pending->freed_tables))
+        pmm_free(&pending->freed_tables);
+    pending->clear();
 }
 
 template <int Level>
@@ -375,8 +460,9 @@ struct PageTable : PageTableBase<Level> {
     /**
      * @brief Invalidate a single page at a given page table level
      */
-    static void tlb_invalidate_page(arch_aspace_t* aspace, vaddr_t vaddr, bool global_page) {
-        x86_tlb_invalidate_page(aspace, vaddr, Base::level, global_page);
+    static void tlb_invalidate_page(arch_aspace_t* aspace, vaddr_t vaddr, bool global_page,
+                                    PendingTlbInvalidation* pending) {
+        pending->enqueue(vaddr, Base::level, global_page);
     }
 };
 
@@ -426,7 +512,8 @@ struct ExtendedPageTable : PageTableBase<Level> {
     /**
      * @brief Invalidate a single page at a given page table level
      */
-    static void tlb_invalidate_page(arch_aspace_t* aspace, vaddr_t vaddr, bool global_page) {
+    static void tlb_invalidate_page(arch_aspace_t* aspace, vaddr_t vaddr, bool global_page,
+                                    PendingTlbInvalidation* pending) {
         // TODO(abdulla): Implement this.
     }
 };
@@ -505,7 +592,7 @@ struct MappingCursor {
 
 template <typename PageTable>
 static void update_entry(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte, paddr_t paddr,
-                         arch_flags_t flags) {
+                         arch_flags_t flags, PendingTlbInvalidation* pending) {
     DEBUG_ASSERT(pte);
     DEBUG_ASSERT(IS_PAGE_ALIGNED(paddr));
 
@@ -517,12 +604,13 @@ static void update_entry(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte,
 
     /* attempt to invalidate the page */
     if (IS_PAGE_PRESENT(olde)) {
-        PageTable::tlb_invalidate_page(aspace, vaddr, is_kernel_address(vaddr));
+        PageTable::tlb_invalidate_page(aspace, vaddr, is_kernel_address(vaddr), pending);
     }
 }
 
 template <typename PageTable>
-static void unmap_entry(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte) {
+static void unmap_entry(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte,
+                        PendingTlbInvalidation* pending) {
     DEBUG_ASSERT(pte);
 
     pt_entry_t olde = *pte;
@@ -531,7 +619,7 @@ static void unmap_entry(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte) {
 
     /* attempt to invalidate the page */
     if (IS_PAGE_PRESENT(olde)) {
-        PageTable::tlb_invalidate_page(aspace, vaddr, is_kernel_address(vaddr));
+        PageTable::tlb_invalidate_page(aspace, vaddr, is_kernel_address(vaddr), pending);
     }
 }
 
@@ -546,7 +634,7 @@ static pt_entry_t* _map_alloc_page(void) {
         return nullptr;
 
     arch_zero_page(page_ptr);
-    p->state = VM_PAGE_STATE_MMU;
+    vm_page_set_state(p, VM_PAGE_STATE_MMU);
 
     return page_ptr;
 }
@@ -555,7 +643,8 @@ static pt_entry_t* _map_alloc_page(void) {
  * @brief Split the given large page into smaller pages
  */
 template <typename PageTable>
-static status_t x86_mmu_split(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte) {
+static status_t x86_mmu_split(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte,
+                              PendingTlbInvalidation* pending) {
     static_assert(PageTable::level != PT_L, "tried splitting PT_L");
     LTRACEF_LEVEL(2, "splitting table %p at level %d\n", pte, PageTable::level);
 
@@ -576,14 +665,15 @@ static status_t x86_mmu_split(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t*
         pt_entry_t* e = m + i;
         // If this is a PDP_L (i.e. huge page), flags will include the
         // PS bit still, so the new PD entries will be large pages.
-        update_entry<typename PageTable::LowerTable>(aspace, new_vaddr, e, new_paddr, flags);
+        update_entry<typename PageTable::LowerTable>(aspace, new_vaddr, e, new_paddr, flags,
+                                                     pending);
         new_vaddr += ps;
         new_paddr += ps;
     }
     DEBUG_ASSERT(new_vaddr == vaddr + PageTable::page_size());
 
     flags = PageTable::intermediate_arch_flags();
-    update_entry<PageTable>(aspace, vaddr, pte, X86_VIRT_TO_PHYS(m), flags);
+    update_entry<PageTable>(aspace, vaddr, pte, X86_VIRT_TO_PHYS(m), flags, pending);
     return NO_ERROR;
 }
 
@@ -680,7 +770,8 @@ status_t x86_mmu_get_mapping<ExtendedPageTable<PT_L>>(pt_entry_t* table, vaddr_t
  */
 template <typename PageTable>
 static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table,
-                                   const MappingCursor& start_cursor, MappingCursor* new_cursor) {
+                                   const MappingCursor& start_cursor, MappingCursor* new_cursor,
+                                   PendingTlbInvalidation* pending) {
     DEBUG_ASSERT(table);
     LTRACEF("L: %d, %016" PRIxPTR " %016zx\n", PageTable::level, start_cursor.vaddr,
             start_cursor.size);
@@ -714,7 +805,7 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table,
             bool vaddr_level_aligned = PageTable::page_aligned(new_cursor->vaddr);
             // If the request covers the entire large page, just unmap it
             if (vaddr_level_aligned && new_cursor->size >= ps) {
-                unmap_entry<PageTable>(aspace, new_cursor->vaddr, e);
+                unmap_entry<PageTable>(aspace, new_cursor->vaddr, e, pending);
                 unmapped = true;
 
                 new_cursor->vaddr += ps;
@@ -724,11 +815,11 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table,
             }
             // Otherwise, we need to split it
             vaddr_t page_vaddr = new_cursor->vaddr & ~(ps - 1);
-            status_t status = x86_mmu_split<PageTable>(aspace, page_vaddr, e);
+            status_t status = x86_mmu_split<PageTable>(aspace, page_vaddr, e, pending);
             if (status != NO_ERROR) {
                 // If split fails, just unmap the whole thing, and let a
                 // subsequent page fault clean it up.
-                unmap_entry<PageTable>(aspace, new_cursor->vaddr, e);
+                unmap_entry<PageTable>(aspace, new_cursor->vaddr, e, pending);
                 unmapped = true;
 
                 const size_t size = (new_cursor->size > ps) ? ps : new_cursor->size;
@@ -741,7 +832,7 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table,
         MappingCursor cursor;
         pt_entry_t* next_table = get_next_table_from_entry(*e);
         bool lower_unmapped = x86_mmu_remove_mapping<typename PageTable::LowerTable>(
-            aspace, next_table, *new_cursor, &cursor);
+            aspace, next_table, *new_cursor, &cursor, pending);
 
         // If we were requesting to unmap everything in the lower page table,
         // we know we can unmap the lower level page table.  Otherwise, if
@@ -761,8 +852,8 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table,
             }
         }
         if (unmap_page_table) {
-            unmap_entry<PageTable>(aspace, new_cursor->vaddr, e);
-            pmm_free_page(paddr_to_vm_page(X86_VIRT_TO_PHYS(next_table)));
+            unmap_entry<PageTable>(aspace, new_cursor->vaddr, e, pending);
+            pending->free_table(paddr_to_vm_page(X86_VIRT_TO_PHYS(next_table)));
             unmapped = true;
         }
         *new_cursor = cursor;
@@ -778,7 +869,7 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table,
 template <typename PageTable>
 static bool x86_mmu_remove_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table,
                                       const MappingCursor& start_cursor,
-                                      MappingCursor* new_cursor) {
+                                      MappingCursor* new_cursor, PendingTlbInvalidation* pending) {
     static_assert(PageTable::level == PT_L, "x86_mmu_remove_mapping_l0 used with wrong level");
     LTRACEF("%016" PRIxPTR " %016zx\n", start_cursor.vaddr, start_cursor.size);
     DEBUG_ASSERT(IS_PAGE_ALIGNED(start_cursor.size));
@@ -790,7 +881,7 @@ static bool x86_mmu_remove_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table,
     for (; index != NO_OF_PT_ENTRIES && new_cursor->size != 0; ++index) {
         pt_entry_t* e = table + index;
         if (IS_PAGE_PRESENT(*e)) {
-            unmap_entry<PageTable>(aspace, new_cursor->vaddr, e);
+            unmap_entry<PageTable>(aspace, new_cursor->vaddr, e, pending);
             unmapped = true;
         }
 
@@ -804,16 +895,19 @@ static bool x86_mmu_remove_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table,
 template <>
 bool x86_mmu_remove_mapping<PageTable<PT_L>>(arch_aspace_t* aspace, pt_entry_t* table,
                                              const MappingCursor& start_cursor,
-                                             MappingCursor* new_cursor) {
-    return x86_mmu_remove_mapping_l0<PageTable<PT_L>>(aspace, table, start_cursor, new_cursor);
+                                             MappingCursor* new_cursor,
+                                             PendingTlbInvalidation* pending) {
+    return x86_mmu_remove_mapping_l0<PageTable<PT_L>>(aspace, table, start_cursor, new_cursor,
+                                                      pending);
 }
 
 template <>
 bool x86_mmu_remove_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace, pt_entry_t* table,
                                                      const MappingCursor& start_cursor,
-                                                     MappingCursor* new_cursor) {
+                                                     MappingCursor* new_cursor,
+                                                     PendingTlbInvalidation* pending) {
     return x86_mmu_remove_mapping_l0<ExtendedPageTable<PT_L>>(aspace, table, start_cursor,
-                                                              new_cursor);
+                                                              new_cursor, pending);
 }
 
 /**
@@ -834,7 +928,8 @@ bool x86_mmu_remove_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace, pt_e
  */
 template <typename PageTable>
 static status_t x86_mmu_add_mapping(arch_aspace_t* aspace, pt_entry_t* table, uint mmu_flags,
-                                    const MappingCursor& start_cursor, MappingCursor* new_cursor) {
+                                    const MappingCursor& start_cursor, MappingCursor* new_cursor,
+                                    PendingTlbInvalidation* pending) {
     DEBUG_ASSERT(table);
     DEBUG_ASSERT(x86_mmu_check_vaddr(start_cursor.vaddr));
     DEBUG_ASSERT(x86_mmu_check_paddr(start_cursor.paddr));
@@ -863,7 +958,7 @@ static status_t x86_mmu_add_mapping(arch_aspace_t* aspace, pt_entry_t* table, ui
             level_paligned && new_cursor->size >= ps) {
 
             update_entry<PageTable>(aspace, new_cursor->vaddr, table + index, new_cursor->paddr,
-                                    arch_flags | X86_MMU_PG_PS);
+                                    arch_flags | X86_MMU_PG_PS, pending);
 
             new_cursor->paddr += ps;
             new_cursor->vaddr += ps;
@@ -881,12 +976,12 @@ static status_t x86_mmu_add_mapping(arch_aspace_t* aspace, pt_entry_t* table, ui
                 LTRACEF_LEVEL(2, "new table %p at level %d\n", m, PageTable::level);
 
                 update_entry<PageTable>(aspace, new_cursor->vaddr, e, X86_VIRT_TO_PHYS(m),
-                                        interm_arch_flags);
+                                        interm_arch_flags, pending);
             }
 
             MappingCursor cursor;
             ret = x86_mmu_add_mapping<typename PageTable::LowerTable>(
-                aspace, get_next_table_from_entry(*e), mmu_flags, *new_cursor, &cursor);
+                aspace, get_next_table_from_entry(*e), mmu_flags, *new_cursor, &cursor, pending);
             *new_cursor = cursor;
             DEBUG_ASSERT(new_cursor->size <= start_cursor.size);
             if (ret != NO_ERROR) {
@@ -902,7 +997,8 @@ err:
         // new_cursor->size should be how much is left to be mapped still
         cursor.size -= new_cursor->size;
         if (cursor.size > 0) {
-            x86_mmu_remove_mapping<typename PageTable::TopTable>(aspace, table, cursor, &result);
+            x86_mmu_remove_mapping<typename PageTable::TopTable>(aspace, table, cursor, &result,
+                                                                 pending);
             DEBUG_ASSERT(result.size == 0);
         }
     }
@@ -913,7 +1009,7 @@ err:
 template <typename PageTable>
 static status_t x86_mmu_add_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table, uint mmu_flags,
                                        const MappingCursor& start_cursor,
-                                       MappingCursor* new_cursor) {
+                                       MappingCursor* new_cursor, PendingTlbInvalidation* pending) {
     static_assert(PageTable::level == PT_L, "x86_mmu_remove_mapping_l0 used with wrong level");
     DEBUG_ASSERT(IS_PAGE_ALIGNED(start_cursor.size));
 
@@ -929,7 +1025,7 @@ static status_t x86_mmu_add_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table,
         }
 
         update_entry<PageTable>(aspace, new_cursor->vaddr, table + index, new_cursor->paddr,
-                                arch_flags);
+                                arch_flags, pending);
 
         new_cursor->paddr += PAGE_SIZE;
         new_cursor->vaddr += PAGE_SIZE;
@@ -943,18 +1039,20 @@ static status_t x86_mmu_add_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table,
 template <>
 status_t x86_mmu_add_mapping<PageTable<PT_L>>(arch_aspace_t* aspace, pt_entry_t* table,
                                               uint mmu_flags, const MappingCursor& start_cursor,
-                                              MappingCursor* new_cursor) {
+                                              MappingCursor* new_cursor,
+                                              PendingTlbInvalidation* pending) {
     return x86_mmu_add_mapping_l0<PageTable<PT_L>>(aspace, table, mmu_flags, start_cursor,
-                                                   new_cursor);
+                                                   new_cursor, pending);
 }
 
 template <>
 status_t x86_mmu_add_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace, pt_entry_t* table,
                                                       uint mmu_flags,
                                                       const MappingCursor& start_cursor,
-                                                      MappingCursor* new_cursor) {
+                                                      MappingCursor* new_cursor,
+                                                      PendingTlbInvalidation* pending) {
     return x86_mmu_add_mapping_l0<ExtendedPageTable<PT_L>>(aspace, table, mmu_flags, start_cursor,
-                                                           new_cursor);
+                                                           new_cursor, pending);
 }
 
 /**
@@ -972,7 +1070,7 @@ status_t x86_mmu_add_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace, pt_
 template <typename PageTable>
 static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table, uint mmu_flags,
                                        const MappingCursor& start_cursor,
-                                       MappingCursor* new_cursor) {
+                                       MappingCursor* new_cursor, PendingTlbInvalidation* pending) {
     DEBUG_ASSERT(table);
     LTRACEF("L: %d, %016" PRIxPTR " %016zx\n", PageTable::level, start_cursor.vaddr,
             start_cursor.size);
@@ -1007,7 +1105,7 @@ static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table,
             // permissions
             if (vaddr_level_aligned && new_cursor->size >= ps) {
                 update_entry<PageTable>(aspace, new_cursor->vaddr, e, PageTable::paddr_from_pte(*e),
-                                        arch_flags | X86_MMU_PG_PS);
+                                        arch_flags | X86_MMU_PG_PS, pending);
 
                 new_cursor->vaddr += ps;
                 new_cursor->size -= ps;
@@ -1016,7 +1114,7 @@ static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table,
             }
             // Otherwise, we need to split it
             vaddr_t page_vaddr = new_cursor->vaddr & ~(ps - 1);
-            ret = x86_mmu_split<PageTable>(aspace, page_vaddr, e);
+            ret = x86_mmu_split<PageTable>(aspace, page_vaddr, e, pending);
             if (ret != NO_ERROR) {
                 // If we failed to split the table, just unmap it.  Subsequent
                 // page faults will bring it back in.
@@ -1025,7 +1123,7 @@ static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table,
                 cursor.size = ps;
 
                 MappingCursor tmp_cursor;
-                x86_mmu_remove_mapping<PageTable>(aspace, table, cursor, &tmp_cursor);
+                x86_mmu_remove_mapping<PageTable>(aspace, table, cursor, &tmp_cursor, pending);
 
                 const size_t size = (new_cursor->size > ps) ? ps : new_cursor->size;
                 new_cursor->vaddr += size;
@@ -1036,7 +1134,7 @@ static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table,
         MappingCursor cursor;
         pt_entry_t* next_table = get_next_table_from_entry(*e);
         ret = x86_mmu_update_mapping<typename PageTable::LowerTable>(aspace, next_table, mmu_flags,
-                                                                     *new_cursor, &cursor);
+                                                                     *new_cursor, &cursor, pending);
         *new_cursor = cursor;
         if (ret != NO_ERROR) {
             // Currently this can't happen
@@ -1057,7 +1155,8 @@ err:
 template <typename PageTable>
 static status_t x86_mmu_update_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table, uint mmu_flags,
                                           const MappingCursor& start_cursor,
-                                          MappingCursor* new_cursor) {
+                                          MappingCursor* new_cursor,
+                                          PendingTlbInvalidation* pending) {
     static_assert(PageTable::level == PT_L, "x86_mmu_update_mapping_l0 used with wrong level");
     LTRACEF("%016" PRIxPTR " %016zx\n", start_cursor.vaddr, start_cursor.size);
     DEBUG_ASSERT(IS_PAGE_ALIGNED(start_cursor.size));
@@ -1072,7 +1171,7 @@ static status_t x86_mmu_update_mapping_l0(arch_aspace_t* aspace, pt_entry_t* tab
         // Skip unmapped pages (we may encounter these due to demand paging)
         if (IS_PAGE_PRESENT(*e)) {
             update_entry<PageTable>(aspace, new_cursor->vaddr, e, PageTable::paddr_from_pte(*e),
-                                    arch_flags);
+                                    arch_flags, pending);
         }
 
         new_cursor->vaddr += PAGE_SIZE;
@@ -1085,18 +1184,20 @@ static status_t x86_mmu_update_mapping_l0(arch_aspace_t* aspace, pt_entry_t* tab
 template <>
 status_t x86_mmu_update_mapping<PageTable<PT_L>>(arch_aspace_t* aspace, pt_entry_t* table,
                                                  uint mmu_flags, const MappingCursor& start_cursor,
-                                                 MappingCursor* new_cursor) {
+                                                 MappingCursor* new_cursor,
+                                                 PendingTlbInvalidation* pending) {
     return x86_mmu_update_mapping_l0<PageTable<PT_L>>(aspace, table, mmu_flags, start_cursor,
-                                                      new_cursor);
+                                                      new_cursor, pending);
 }
 
 template <>
 status_t x86_mmu_update_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace, pt_entry_t* table,
                                                          uint mmu_flags,
                                                          const MappingCursor& start_cursor,
-                                                         MappingCursor* new_cursor) {
+                                                         MappingCursor* new_cursor,
+                                                         PendingTlbInvalidation* pending) {
     return x86_mmu_update_mapping_l0<ExtendedPageTable<PT_L>>(aspace, table, mmu_flags,
-                                                              start_cursor, new_cursor);
+                                                              start_cursor, new_cursor, pending);
 }
 
 template <template <int> class PageTable>
@@ -1121,7 +1222,10 @@ static status_t mmu_unmap(arch_aspace_t* aspace, vaddr_t vaddr, const size_t cou
     };
 
     MappingCursor result;
-    x86_mmu_remove_mapping<PageTable<MAX_PAGING_LEVEL>>(aspace, aspace->pt_virt, start, &result);
+    PendingTlbInvalidation pending;
+    x86_mmu_remove_mapping<PageTable<MAX_PAGING_LEVEL>>(aspace, aspace->pt_virt, start, &result,
+                                                        &pending);
+    x86_tlb_invalidate(aspace, &pending);
     DEBUG_ASSERT(result.size == 0);
 
     if (unmapped)
@@ -1167,8 +1271,11 @@ static status_t mmu_map(arch_aspace_t* aspace, vaddr_t vaddr, paddr_t paddr, con
         .paddr = paddr, .vaddr = vaddr, .size = count * PAGE_SIZE,
     };
     MappingCursor result;
+    PendingTlbInvalidation pending;
     status_t status = x86_mmu_add_mapping<PageTable<MAX_PAGING_LEVEL>>(aspace, aspace->pt_virt,
-                                                                       mmu_flags, start, &result);
+                                                                       mmu_flags, start, &result,
+                                                                       &pending);
+    x86_tlb_invalidate(aspace, &pending);
     if (status != NO_ERROR) {
         dprintf(SPEW, "Add mapping failed with err=%d\n", status);
         return status;
@@ -1215,8 +1322,10 @@ static status_t mmu_protect(arch_aspace_t* aspace, vaddr_t vaddr, size_t count,
         .paddr = 0, .vaddr = vaddr, .size = count * PAGE_SIZE,
     };
     MappingCursor result;
+    PendingTlbInvalidation pending;
     status_t status = x86_mmu_update_mapping<PageTable<MAX_PAGING_LEVEL>>(
-        aspace, aspace->pt_virt, mmu_flags, start, &result);
+        aspace, aspace->pt_virt, mmu_flags, start, &result, &pending);
+    x86_tlb_invalidate(aspace, &pending);
     if (status != NO_ERROR) {
         return status;
     }
@@ -1236,10 +1345,13 @@ status_t guest_mmu_protect(guest_paspace_t* paspace, vaddr_t vaddr, size_t count
 
 void x86_mmu_early_init() {
     x86_mmu_mem_type_init();
+    pcid_enabled = x86_feature_test(X86_FEATURE_PCID);
     x86_mmu_percpu_init();
 
     /* unmap the lower identity mapping */
-    unmap_entry<PageTable<PML4_L>>(nullptr, 0, &pml4[0]);
+    PendingTlbInvalidation pending;
+    unmap_entry<PageTable<PML4_L>>(nullptr, 0, &pml4[0], &pending);
+    x86_tlb_invalidate(nullptr, &pending);
 
     /* get the address width from the CPU */
     uint8_t vaddr_width = x86_linear_address_width();
@@ -1290,7 +1402,7 @@ status_t arch_mmu_init_aspace(arch_aspace_t* aspace, vaddr_t base, size_t size,
         }
         aspace->pt_phys = pa;
 
-        p->state = VM_PAGE_STATE_MMU;
+        vm_page_set_state(p, VM_PAGE_STATE_MMU);
 
         /* zero out the user space half of it */
         memset(aspace->pt_virt, 0, sizeof(pt_entry_t) * NO_OF_PT_ENTRIES / 2);
@@ -1305,6 +1417,12 @@ status_t arch_mmu_init_aspace(arch_aspace_t* aspace, vaddr_t base, size_t size,
     aspace->active_cpus = 0;
     spin_lock_init(&aspace->io_bitmap_lock);
 
+    /* every cpu flushes the pcid the first time it switches in, in case a
+     * previous owner of it left entries behind */
+    aspace->pcid = (mmu_flags & ARCH_ASPACE_FLAG_KERNEL) ? 0 : x86_pcid_alloc();
+    aspace->tlb_generation = 1;
+    memset(aspace->cpu_tlb_generation, 0, sizeof(aspace->cpu_tlb_generation));
+
     return NO_ERROR;
 }
 
@@ -1319,7 +1437,7 @@ status_t guest_mmu_init_paspace(guest_paspace_t* paspace, size_t size) {
         TRACEF("error allocating top level page directory\n");
         return ERR_NO_MEMORY;
     }
-    p->state = VM_PAGE_STATE_MMU;
+    vm_page_set_state(p, VM_PAGE_STATE_MMU);
     paspace->pt_virt = static_cast<pt_entry_t*>(paddr_to_kvaddr(paspace->pt_phys));
     memset(paspace->pt_virt, 0, sizeof(pt_entry_t) * NO_OF_PT_ENTRIES);
     LTRACEF("guest paspace: pt phys %#" PRIxPTR ", virt %p\n", paspace->pt_phys, paspace->pt_virt);
@@ -1330,6 +1448,9 @@ status_t guest_mmu_init_paspace(guest_paspace_t* paspace, size_t size) {
     paspace->active_cpus = 0;
     paspace->io_bitmap = nullptr;
     spin_lock_init(&paspace->io_bitmap_lock);
+    paspace->pcid = 0;
+    paspace->tlb_generation = 1;
+    memset(paspace->cpu_tlb_generation, 0, sizeof(paspace->cpu_tlb_generation));
 
     return NO_ERROR;
 }
@@ -1363,6 +1484,7 @@ status_t mmu_destroy_aspace(arch_aspace_t* aspace) {
     }
 
     pmm_free_page(paddr_to_vm_page(aspace->pt_phys));
+    x86_pcid_free(aspace->pcid);
 
     aspace->magic = 0;
 
@@ -1377,17 +1499,36 @@ status_t guest_mmu_destroy_paspace(guest_paspace_t* paspace) {
     return mmu_destroy_aspace<ExtendedPageTable>(paspace);
 }
 
+/* Compute the cr3 to switch into |aspace| with on this cpu.  The TLB entries
+ * tagged with its pcid are kept unless a shootdown of the aspace happened since
+ * this cpu last switched in, since the shootdown may not have reached it.  Must
+ * be called after the cpu is marked active in the aspace, so that any shootdown
+ * that doesn't see it in active_cpus has already bumped the generation. */
+static ulong x86_aspace_cr3(arch_aspace_t* aspace, uint cpu) {
+    ulong cr3 = aspace->pt_phys;
+    if (aspace->pcid == 0)
+        return cr3;
+
+    cr3 |= aspace->pcid;
+    uint64_t generation = atomic_load_u64(&aspace->tlb_generation);
+    if (aspace->cpu_tlb_generation[cpu] == generation)
+        cr3 |= X86_CR3_NOFLUSH;
+    aspace->cpu_tlb_generation[cpu] = generation;
+    return cr3;
+}
+
 void arch_mmu_context_switch(arch_aspace_t* old_aspace, arch_aspace_t* aspace) {
-    mp_cpu_mask_t cpu_bit = 1U << arch_curr_cpu_num();
+    uint cpu = arch_curr_cpu_num();
+    mp_cpu_mask_t cpu_bit = 1U << cpu;
     if (aspace != nullptr) {
         DEBUG_ASSERT(aspace->magic == ARCH_ASPACE_MAGIC);
         LTRACEF_LEVEL(3, "switching to aspace %p, pt %#" PRIXPTR "\n", aspace, aspace->pt_phys);
-        x86_set_cr3(aspace->pt_phys);
+        atomic_or(&aspace->active_cpus, cpu_bit);
+        x86_set_cr3(x86_aspace_cr3(aspace, cpu));
 
         if (old_aspace != nullptr) {
             atomic_and(&old_aspace->active_cpus, ~cpu_bit);
         }
-        atomic_or(&aspace->active_cpus, cpu_bit);
     } else {
         LTRACEF_LEVEL(3, "switching to kernel aspace, pt %#" PRIxPTR "\n", kernel_pt_phys);
         x86_set_cr3(kernel_pt_phys);
@@ -1488,6 +1629,9 @@ void x86_mmu_percpu_init(void) {
         cr4 |= X86_CR4_SMEP;
     if (x86_feature_test(X86_FEATURE_SMAP))
         cr4 |= X86_CR4_SMAP;
+    /* cr3 still points at the kernel page tables here, which run with pcid 0 */
+    if (pcid_enabled)
+        cr4 |= X86_CR4_PCIDE;
     x86_set_cr4(cr4);
 
     /* Set NXE bit in X86_MSR_IA32_EFER*/
@@ -19,6 +19,7 @@
 #include <arch/x86/cpu_topology.h>
 #include <arch/x86/descriptor.h>
 #include <arch/x86/feature.h>
+#include <arch/x86/idle.h>
 #include <arch/x86/interrupts.h>
 #include <arch/x86/mmu.h>
 #include <arch/x86/mp.h>
@@ -238,6 +239,20 @@ int x86_apic_id_to_cpu_num(uint32_t apic_id)
     return -1;
 }
 
+int64_t x86_cpu_num_to_apic_id(uint cpu_num)
+{
+    if (cpu_num == bp_percpu.cpu_num) {
+        return bp_percpu.apic_id;
+    }
+
+    for (uint i = 0; i < (uint)x86_num_cpus - 1; ++i) {
+        if (ap_percpus[i].cpu_num == cpu_num) {
+            return ap_percpus[i].apic_id;
+        }
+    }
+    return -1;
+}
+
 #if WITH_SMP
 status_t arch_mp_send_ipi(mp_cpu_mask_t target, mp_ipi_t ipi)
 {
@@ -266,6 +281,24 @@ status_t arch_mp_send_ipi(mp_cpu_mask_t target, mp_ipi_t ipi)
 
     ASSERT(x86_num_cpus <= sizeof(target) * 8);
 
+    /* cpus idling in mwait only need their monitored line written */
+    if (ipi == MP_IPI_RESCHEDULE) {
+        target &= ~x86_idle_wake_cpus(target);
+        if (target == 0)
+            return NO_ERROR;
+    }
+
+    /* One write to the ICR reaches every other cpu, rather than one for each.
+     * The current cpu can only be trusted with interrupts disabled. */
+    if (arch_ints_disabled()) {
+        mp_cpu_mask_t all = ~0U >> (sizeof(mp_cpu_mask_t) * 8 - x86_num_cpus);
+        mp_cpu_mask_t others = all & ~(1U << arch_curr_cpu_num());
+        if (others != 0 && target == others) {
+            apic_send_broadcast_ipi(vector, DELIVERY_MODE_FIXED);
+            return NO_ERROR;
+        }
+    }
+
     mp_cpu_mask_t remaining = target;
     uint cpu_id = 0;
     while (remaining && cpu_id < x86_num_cpus) {
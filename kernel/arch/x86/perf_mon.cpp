@@ -0,0 +1,337 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+// This file contains the part of the performance monitoring counter
+// support that must be done in the kernel (so that we can read/write msrs).
+// It is reached through mtrace_control(MTRACE_KIND_PERFMON), in the same
+// way as Intel PT is (see proc_trace.cpp).
+//
+// Only the architectural events and the general purpose counters are used,
+// which every cpu with architectural performance monitoring version 2 or
+// later has. Counting can be system wide, with counts kept per cpu, or
+// follow one thread, in which case the counters are only enabled while that
+// thread is running.
+
+#include <arch/arch_ops.h>
+#include <arch/x86.h>
+#include <arch/x86/apic.h>
+#include <arch/x86/feature.h>
+#include <arch/x86/perf_mon.h>
+#include <err.h>
+#include <inttypes.h>
+#include <kernel/mp.h>
+#include <kernel/mutex.h>
+#include <kernel/thread.h>
+#include <lib/ktrace.h>
+#include <magenta/mtrace.h>
+#include <magenta/thread_annotations.h>
+#include <string.h>
+#include <trace.h>
+
+#define LOCAL_TRACE 0
+
+// Control MSRs
+#define IA32_PMC(n) (0xc1 + (n))
+#define IA32_PERFEVTSEL(n) (0x186 + (n))
+#define IA32_PERF_GLOBAL_STATUS 0x38e
+#define IA32_PERF_GLOBAL_CTRL 0x38f
+#define IA32_PERF_GLOBAL_OVF_CTRL 0x390
+
+// IA32_PERFEVTSEL bits
+#define PERFEVTSEL_EVENT(e) ((uint64_t)(e) & 0xff)
+#define PERFEVTSEL_UMASK(u) (((uint64_t)(u) & 0xff) << 8)
+#define PERFEVTSEL_USR (1ull << 16)
+#define PERFEVTSEL_OS (1ull << 17)
+#define PERFEVTSEL_INT (1ull << 20)
+#define PERFEVTSEL_EN (1ull << 22)
+
+// Sample periods are loaded by writing the negated period to IA32_PMC,
+// which only takes 32 bits, sign extended.
+#define MAX_SAMPLE_PERIOD (1ull << 31)
+
+// Event select and unit mask of each MX_PERFMON_EVENT_*.
+// Bit (event - 1) of cpuid leaf 0xa's ebx is set if the cpu lacks it.
+static const struct {
+    uint8_t event;
+    uint8_t umask;
+} perfmon_event_codes[MX_PERFMON_NUM_EVENTS] = {
+    {0, 0},       // MX_PERFMON_EVENT_NONE
+    {0x3c, 0x00}, // MX_PERFMON_EVENT_CYCLES
+    {0xc0, 0x00}, // MX_PERFMON_EVENT_INSTRUCTIONS
+    {0x3c, 0x01}, // MX_PERFMON_EVENT_REF_CYCLES
+    {0x2e, 0x4f}, // MX_PERFMON_EVENT_CACHE_REFERENCES
+    {0x2e, 0x41}, // MX_PERFMON_EVENT_CACHE_MISSES
+    {0xc4, 0x00}, // MX_PERFMON_EVENT_BRANCHES
+    {0xc5, 0x00}, // MX_PERFMON_EVENT_BRANCH_MISSES
+};
+
+// What h/w supports.
+static uint32_t perfmon_version;
+static uint32_t perfmon_num_counters;
+static uint32_t perfmon_counter_width;
+static uint32_t perfmon_events;
+
+struct perfmon_cpu_state_t {
+    // Counter values as of the last stop or read on this cpu.
+    uint64_t counts[MX_PERFMON_MAX_COUNTERS];
+    // Occurrences of events[0] in sample periods which have finished.
+    uint64_t sampled;
+};
+
+static Mutex perfmon_lock;
+
+static bool active TA_GUARDED(perfmon_lock) = false;
+
+// Written only by each cpu for itself, from the tasks below or the
+// overflow interrupt.
+static perfmon_cpu_state_t perfmon_cpu_state[SMP_MAX_CPUS];
+
+// The configuration being counted. These are set before the start task
+// runs on each cpu and only read with interrupts disabled, by the tasks,
+// the context switch hook and the overflow interrupt.
+static uint64_t perfmon_evtsel[MX_PERFMON_MAX_COUNTERS];
+static uint64_t perfmon_global_ctrl;
+static uint64_t perfmon_thread_koid;
+static uint64_t perfmon_sample_period;
+
+void x86_perfmon_init(void)
+{
+    struct cpuid_leaf leaf;
+    if (!x86_get_cpuid_subleaf(X86_CPUID_PERFORMANCE_MONITORING, 0, &leaf)) {
+        return;
+    }
+
+    // Version 1 has no global control register, which we rely on.
+    uint32_t version = leaf.a & 0xff;
+    if (version < 2) {
+        return;
+    }
+
+    perfmon_version = version;
+    perfmon_num_counters = (leaf.a >> 8) & 0xff;
+    if (perfmon_num_counters > MX_PERFMON_MAX_COUNTERS)
+        perfmon_num_counters = MX_PERFMON_MAX_COUNTERS;
+    perfmon_counter_width = (leaf.a >> 16) & 0xff;
+
+    // ebx has a bit per architectural event, for as many events as eax says.
+    uint32_t ebx_length = (leaf.a >> 24) & 0xff;
+    for (uint32_t event = 1; event < MX_PERFMON_NUM_EVENTS; event++) {
+        if (event - 1 < ebx_length && !(leaf.b & (1u << (event - 1))))
+            perfmon_events |= 1u << event;
+    }
+
+    LTRACEF("version %u, %u counters of %u bits, events %#x\n",
+            perfmon_version, perfmon_num_counters, perfmon_counter_width,
+            perfmon_events);
+}
+
+static uint64_t perfmon_counter_mask() {
+    return (perfmon_counter_width >= 64) ? ~0ull : (1ull << perfmon_counter_width) - 1;
+}
+
+static bool perfmon_counting_thread(thread_t* thread) {
+    return perfmon_thread_koid == 0 || thread->user_tid == perfmon_thread_koid;
+}
+
+void x86_perfmon_context_switch(thread_t* oldthread, thread_t* newthread)
+{
+    if (likely(perfmon_thread_koid == 0))
+        return;
+    // Leaving the counters frozen while the thread is off cpu is all the
+    // saving and restoring needed: its counts stay in this cpu's counters,
+    // and are summed across cpus when read.
+    write_msr(IA32_PERF_GLOBAL_CTRL,
+              perfmon_counting_thread(newthread) ? perfmon_global_ctrl : 0);
+}
+
+// Snapshots this cpu's counters into its state.
+static void x86_perfmon_read_counters(perfmon_cpu_state_t* state) {
+    for (uint32_t i = 0; i < perfmon_num_counters; i++) {
+        state->counts[i] = read_msr(IA32_PMC(i));
+    }
+}
+
+static void x86_perfmon_load_sample_period() {
+    write_msr(IA32_PMC(0), -perfmon_sample_period & 0xffffffffull);
+}
+
+enum handler_return x86_perfmon_interrupt_handler(void)
+{
+    uint64_t status = read_msr(IA32_PERF_GLOBAL_STATUS);
+    if ((status & 1) && perfmon_sample_period != 0) {
+        perfmon_cpu_state[arch_curr_cpu_num()].sampled += perfmon_sample_period;
+        x86_perfmon_load_sample_period();
+        ktrace_sample_irq();
+    }
+    write_msr(IA32_PERF_GLOBAL_OVF_CTRL, status);
+    apic_pmi_unmask();
+    return INT_NO_RESCHEDULE;
+}
+
+status_t x86_perfmon_get_properties(mx_perfmon_properties_t* props) {
+    if (perfmon_version == 0)
+        return ERR_NOT_SUPPORTED;
+
+    props->version = perfmon_version;
+    props->num_counters = perfmon_num_counters;
+    props->counter_width = perfmon_counter_width;
+    props->events = perfmon_events;
+    return NO_ERROR;
+}
+
+// This is invoked via mp_sync_exec which thread safety analysis cannot follow.
+static void x86_perfmon_start_task(void* raw_context) TA_NO_THREAD_SAFETY_ANALYSIS {
+    DEBUG_ASSERT(arch_ints_disabled());
+
+    write_msr(IA32_PERF_GLOBAL_CTRL, 0);
+    perfmon_cpu_state_t* state = &perfmon_cpu_state[arch_curr_cpu_num()];
+    memset(state, 0, sizeof(*state));
+    for (uint32_t i = 0; i < perfmon_num_counters; i++) {
+        write_msr(IA32_PERFEVTSEL(i), perfmon_evtsel[i]);
+        write_msr(IA32_PMC(i), 0);
+    }
+    if (perfmon_sample_period != 0) {
+        x86_perfmon_load_sample_period();
+        apic_pmi_unmask();
+    }
+    write_msr(IA32_PERF_GLOBAL_OVF_CTRL, read_msr(IA32_PERF_GLOBAL_STATUS));
+
+    if (perfmon_counting_thread(get_current_thread()))
+        write_msr(IA32_PERF_GLOBAL_CTRL, perfmon_global_ctrl);
+}
+
+// Begin counting.
+
+status_t x86_perfmon_start(const mx_perfmon_config_t* config) {
+    AutoLock al(&perfmon_lock);
+
+    if (perfmon_version == 0)
+        return ERR_NOT_SUPPORTED;
+    if (active)
+        return ERR_BAD_STATE;
+    if (config->flags & ~(MX_PERFMON_FLAG_USER | MX_PERFMON_FLAG_KERNEL))
+        return ERR_INVALID_ARGS;
+    if (config->sample_period >= MAX_SAMPLE_PERIOD ||
+        (config->sample_period != 0 && config->events[0] == MX_PERFMON_EVENT_NONE))
+        return ERR_INVALID_ARGS;
+
+    uint64_t mode = 0;
+    if (config->flags & MX_PERFMON_FLAG_USER)
+        mode |= PERFEVTSEL_USR;
+    if (config->flags & MX_PERFMON_FLAG_KERNEL)
+        mode |= PERFEVTSEL_OS;
+    if (mode == 0)
+        mode = PERFEVTSEL_USR | PERFEVTSEL_OS;
+
+    uint64_t global_ctrl = 0;
+    for (uint32_t i = 0; i < MX_PERFMON_MAX_COUNTERS; i++) {
+        uint32_t event = config->events[i];
+        if (event == MX_PERFMON_EVENT_NONE) {
+            if (i < perfmon_num_counters)
+                perfmon_evtsel[i] = 0;
+            continue;
+        }
+        if (event >= MX_PERFMON_NUM_EVENTS || !(perfmon_events & (1u << event)))
+            return ERR_NOT_SUPPORTED;
+        if (i >= perfmon_num_counters)
+            return ERR_INVALID_ARGS;
+        perfmon_evtsel[i] = PERFEVTSEL_EVENT(perfmon_event_codes[event].event) |
+            PERFEVTSEL_UMASK(perfmon_event_codes[event].umask) | mode | PERFEVTSEL_EN;
+        global_ctrl |= 1ull << i;
+    }
+    if (global_ctrl == 0)
+        return ERR_INVALID_ARGS;
+    if (config->sample_period != 0)
+        perfmon_evtsel[0] |= PERFEVTSEL_INT;
+
+    perfmon_global_ctrl = global_ctrl;
+    perfmon_thread_koid = config->thread_koid;
+    perfmon_sample_period = config->sample_period;
+
+    TRACEF("Enabling performance counters, global ctrl %#" PRIx64 "\n", global_ctrl);
+
+    active = true;
+    mp_sync_exec(MP_CPU_ALL, x86_perfmon_start_task, nullptr);
+    return NO_ERROR;
+}
+
+// This is invoked via mp_sync_exec which thread safety analysis cannot follow.
+static void x86_perfmon_stop_task(void* raw_context) TA_NO_THREAD_SAFETY_ANALYSIS {
+    DEBUG_ASSERT(arch_ints_disabled());
+
+    write_msr(IA32_PERF_GLOBAL_CTRL, 0);
+    apic_pmi_mask();
+    x86_perfmon_read_counters(&perfmon_cpu_state[arch_curr_cpu_num()]);
+    for (uint32_t i = 0; i < perfmon_num_counters; i++) {
+        write_msr(IA32_PERFEVTSEL(i), 0);
+    }
+    write_msr(IA32_PERF_GLOBAL_OVF_CTRL, read_msr(IA32_PERF_GLOBAL_STATUS));
+}
+
+// This can be called while not active, so the caller doesn't have to care
+// during any cleanup.
+
+status_t x86_perfmon_stop() {
+    AutoLock al(&perfmon_lock);
+
+    if (perfmon_version == 0)
+        return ERR_NOT_SUPPORTED;
+    if (!active)
+        return NO_ERROR;
+
+    TRACEF("Disabling performance counters\n");
+
+    mp_sync_exec(MP_CPU_ALL, x86_perfmon_stop_task, nullptr);
+    // Any context switch from now on finds the event selects cleared, so
+    // re-enabling the counters there does nothing.
+    perfmon_thread_koid = 0;
+    active = false;
+    return NO_ERROR;
+}
+
+// This is invoked via mp_sync_exec which thread safety analysis cannot follow.
+static void x86_perfmon_read_task(void* raw_context) TA_NO_THREAD_SAFETY_ANALYSIS {
+    DEBUG_ASSERT(arch_ints_disabled());
+
+    x86_perfmon_read_counters(&perfmon_cpu_state[arch_curr_cpu_num()]);
+}
+
+static void x86_perfmon_add_counts(uint32_t cpu, mx_perfmon_counts_t* counts)
+    TA_REQ(perfmon_lock) {
+    const perfmon_cpu_state_t* state = &perfmon_cpu_state[cpu];
+    for (uint32_t i = 0; i < perfmon_num_counters; i++) {
+        uint64_t count = state->counts[i];
+        if (i == 0 && perfmon_sample_period != 0) {
+            // Counter 0 starts each sample period at the negated period.
+            count = state->sampled +
+                ((count + perfmon_sample_period) & perfmon_counter_mask());
+        }
+        counts->counts[i] += count;
+    }
+}
+
+status_t x86_perfmon_get_counts(uint32_t cpu, mx_perfmon_counts_t* counts) {
+    AutoLock al(&perfmon_lock);
+
+    if (perfmon_version == 0)
+        return ERR_NOT_SUPPORTED;
+    uint32_t num_cpus = arch_max_num_cpus();
+    if (cpu >= num_cpus && cpu != MTRACE_PERFMON_ALL_CPUS)
+        return ERR_INVALID_ARGS;
+
+    if (active)
+        mp_sync_exec(MP_CPU_ALL, x86_perfmon_read_task, nullptr);
+
+    memset(counts, 0, sizeof(*counts));
+    if (cpu == MTRACE_PERFMON_ALL_CPUS) {
+        for (cpu = 0; cpu < num_cpus; cpu++) {
+            x86_perfmon_add_counts(cpu, counts);
+        }
+    } else {
+        x86_perfmon_add_counts(cpu, counts);
+    }
+    return NO_ERROR;
+}
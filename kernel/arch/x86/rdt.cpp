@@ -0,0 +1,299 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+// Intel Resource Director Technology: L3 cache allocation (CAT), memory
+// bandwidth allocation (MBA) and L3 cache occupancy monitoring (CMT).
+//
+// Every logical cpu runs with an IA32_PQR_ASSOC value naming a class of
+// service (CLOS), which selects the L3 ways it may fill and how much its
+// memory requests are delayed, and a resource monitoring id (RMID), under
+// which the cache counts the lines it fills. Threads carry the value of their
+// resource group and it is loaded when they are switched to. There are only a
+// handful of classes of service, so groups with the same mask and throttle
+// share one; each group that can be monitored gets an RMID of its own.
+
+#include <arch/arch_ops.h>
+#include <arch/x86.h>
+#include <arch/x86/cpu_topology.h>
+#include <arch/x86/feature.h>
+#include <arch/x86/mp.h>
+#include <arch/x86/rdt.h>
+#include <err.h>
+#include <kernel/auto_lock.h>
+#include <kernel/mp.h>
+#include <kernel/mutex.h>
+#include <magenta/thread_annotations.h>
+#include <mxtl/algorithm.h>
+#include <trace.h>
+
+#define LOCAL_TRACE 0
+
+// Control MSRs
+#define IA32_QM_EVTSEL 0xc8d
+#define IA32_QM_CTR 0xc8e
+#define IA32_PQR_ASSOC 0xc8f
+#define IA32_L3_QOS_MASK(n) (0xc90 + (n))
+#define IA32_L2_QOS_EXT_BW_THRTL(n) (0xd50 + (n))
+
+// IA32_PQR_ASSOC fields
+#define PQR_ASSOC(clos, rmid) (((uint64_t)(clos) << 32) | (rmid))
+#define PQR_ASSOC_CLOS(assoc) ((uint32_t)((assoc) >> 32))
+#define PQR_ASSOC_RMID(assoc) ((uint32_t)(assoc) & 0x3ff)
+
+// IA32_QM_EVTSEL event ids and IA32_QM_CTR bits
+#define QM_EVTSEL(rmid, event) (((uint64_t)(rmid) << 32) | (event))
+#define QM_EVENT_L3_OCCUPANCY 1
+#define QM_CTR_ERROR (1ull << 63)
+#define QM_CTR_UNAVAILABLE (1ull << 62)
+#define QM_CTR_DATA_MASK ((1ull << 62) - 1)
+
+// The most of each that are used. Hardware with more only has these many
+// handed out.
+#define RDT_MAX_CLOS 16
+#define RDT_MAX_RMID 256
+
+// What h/w supports, zero for what it doesn't. Classes of service are shared
+// between CAT and MBA, so there are as many as the one with fewer has.
+static uint32_t rdt_num_clos;
+static uint32_t rdt_cbm_len;
+static uint32_t rdt_mba_max_delay;
+static uint32_t rdt_num_rmid;
+static uint32_t rdt_occupancy_scale;
+
+struct rdt_clos_t {
+    uint64_t l3_mask;
+    uint32_t mba_delay;
+    uint32_t refs;
+};
+
+static Mutex rdt_lock;
+static rdt_clos_t rdt_clos[RDT_MAX_CLOS] TA_GUARDED(rdt_lock);
+static uint32_t rdt_rmid_refs[RDT_MAX_RMID] TA_GUARDED(rdt_lock);
+
+// Set once a thread may be in a group other than 0, so the context switch
+// hook costs nothing before then, or on hardware without RDT.
+static bool rdt_in_use;
+
+// What each cpu last loaded into its IA32_PQR_ASSOC, written only by the cpu
+// itself with interrupts disabled.
+static uint64_t rdt_cpu_group[SMP_MAX_CPUS];
+
+void x86_rdt_init(void)
+{
+    struct cpuid_leaf leaf;
+    struct cpuid_leaf sub;
+
+    if (x86_feature_test(X86_FEATURE_RDT_A) &&
+        x86_get_cpuid_subleaf(X86_CPUID_RDT_ALLOCATION, 0, &leaf)) {
+        uint32_t num_clos = RDT_MAX_CLOS;
+        bool any = false;
+        // ebx bit 1: L3 CAT
+        if ((leaf.b & (1u << 1)) && x86_get_cpuid_subleaf(X86_CPUID_RDT_ALLOCATION, 1, &sub)) {
+            rdt_cbm_len = (sub.a & 0x1f) + 1;
+            num_clos = mxtl::min(num_clos, (sub.d & 0xffff) + 1);
+            any = true;
+        }
+        // ebx bit 3: MBA
+        if ((leaf.b & (1u << 3)) && x86_get_cpuid_subleaf(X86_CPUID_RDT_ALLOCATION, 3, &sub)) {
+            rdt_mba_max_delay = (sub.a & 0xfff) + 1;
+            num_clos = mxtl::min(num_clos, (sub.d & 0xffff) + 1);
+            any = true;
+        }
+        if (any)
+            rdt_num_clos = num_clos;
+    }
+
+    // edx bit 1 of subleaf 0: L3 monitoring, edx bit 0 of subleaf 1: occupancy
+    if (x86_feature_test(X86_FEATURE_RDT_M) &&
+        x86_get_cpuid_subleaf(X86_CPUID_RDT_MONITORING, 0, &leaf) && (leaf.d & (1u << 1)) &&
+        x86_get_cpuid_subleaf(X86_CPUID_RDT_MONITORING, 1, &sub) && (sub.d & 1u)) {
+        rdt_num_rmid = mxtl::min<uint32_t>(sub.c + 1, RDT_MAX_RMID);
+        rdt_occupancy_scale = sub.b;
+    }
+
+    // class of service 0 and rmid 0 are what every cpu starts out with, and
+    // belong to group 0 for good
+    AutoLock al(&rdt_lock);
+    rdt_clos[0].refs = 1;
+    rdt_rmid_refs[0] = 1;
+
+    LTRACEF("%u classes of service, %u bit cache masks, mba delay up to %u, %u rmids\n",
+            rdt_num_clos, rdt_cbm_len, rdt_mba_max_delay, rdt_num_rmid);
+}
+
+void x86_rdt_context_switch(thread_t* oldthread, thread_t* newthread)
+{
+    if (likely(!rdt_in_use))
+        return;
+
+    uint cpu = arch_curr_cpu_num();
+    uint64_t group = newthread->arch.rdt_group;
+    if (group != rdt_cpu_group[cpu]) {
+        write_msr(IA32_PQR_ASSOC, group);
+        rdt_cpu_group[cpu] = group;
+    }
+}
+
+// Programs class of service |clos| on every cpu. The masks are shared by all
+// the cpus of a cache domain, but writing them everywhere is simplest.
+// This is invoked via mp_sync_exec which thread safety analysis cannot follow.
+static void rdt_program_clos_task(void* context) TA_NO_THREAD_SAFETY_ANALYSIS {
+    uint32_t clos = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(context));
+    if (rdt_cbm_len > 0)
+        write_msr(IA32_L3_QOS_MASK(clos), rdt_clos[clos].l3_mask);
+    if (rdt_mba_max_delay > 0)
+        write_msr(IA32_L2_QOS_EXT_BW_THRTL(clos), rdt_clos[clos].mba_delay);
+}
+
+status_t x86_rdt_group_create(uint64_t l3_mask, uint32_t mba_delay, bool strict,
+                              uint64_t* group)
+{
+    const uint64_t full_mask = (rdt_cbm_len >= 64) ? ~0ull : (1ull << rdt_cbm_len) - 1;
+
+    if (l3_mask != 0 && rdt_cbm_len == 0) {
+        if (strict)
+            return ERR_NOT_SUPPORTED;
+        l3_mask = 0;
+    }
+    if (l3_mask != 0) {
+        // the ways have to be within the cache and next to each other
+        uint64_t shifted = l3_mask >> __builtin_ctzll(l3_mask);
+        if ((l3_mask & ~full_mask) || (shifted & (shifted + 1)))
+            return ERR_INVALID_ARGS;
+        if (l3_mask == full_mask)
+            l3_mask = 0;
+    }
+
+    if (mba_delay != 0 && rdt_mba_max_delay == 0) {
+        if (strict)
+            return ERR_NOT_SUPPORTED;
+        mba_delay = 0;
+    }
+    if (mba_delay > rdt_mba_max_delay)
+        return ERR_INVALID_ARGS;
+
+    AutoLock al(&rdt_lock);
+
+    // groups with the same allocation share a class of service
+    uint32_t clos = 0;
+    if (l3_mask != 0 || mba_delay != 0) {
+        uint32_t free_clos = 0;
+        for (clos = 1; clos < rdt_num_clos; clos++) {
+            if (rdt_clos[clos].refs == 0) {
+                if (free_clos == 0)
+                    free_clos = clos;
+            } else if (rdt_clos[clos].l3_mask == (l3_mask ? l3_mask : full_mask) &&
+                       rdt_clos[clos].mba_delay == mba_delay) {
+                break;
+            }
+        }
+        if (clos == rdt_num_clos) {
+            if (free_clos == 0)
+                return ERR_NO_RESOURCES;
+            clos = free_clos;
+            rdt_clos[clos].l3_mask = l3_mask ? l3_mask : full_mask;
+            rdt_clos[clos].mba_delay = mba_delay;
+            mp_sync_exec(MP_CPU_ALL, rdt_program_clos_task,
+                         reinterpret_cast<void*>(static_cast<uintptr_t>(clos)));
+        }
+    }
+
+    // without a monitoring id of its own the group is counted with group 0
+    uint32_t rmid = 0;
+    for (uint32_t i = 1; i < rdt_num_rmid; i++) {
+        if (rdt_rmid_refs[i] == 0) {
+            rmid = i;
+            break;
+        }
+    }
+    if (rmid == 0 && rdt_num_rmid > 0 && strict)
+        return ERR_NO_RESOURCES;
+
+    rdt_clos[clos].refs++;
+    rdt_rmid_refs[rmid]++;
+
+    *group = PQR_ASSOC(clos, rmid);
+    if (*group != 0)
+        rdt_in_use = true;
+
+    LTRACEF("group %#" PRIx64 ": l3 mask %#" PRIx64 ", mba delay %u\n", *group, l3_mask,
+            mba_delay);
+
+    return NO_ERROR;
+}
+
+void x86_rdt_group_acquire(uint64_t group)
+{
+    if (group == 0)
+        return;
+
+    AutoLock al(&rdt_lock);
+    DEBUG_ASSERT(rdt_clos[PQR_ASSOC_CLOS(group)].refs > 0);
+    DEBUG_ASSERT(rdt_rmid_refs[PQR_ASSOC_RMID(group)] > 0);
+    rdt_clos[PQR_ASSOC_CLOS(group)].refs++;
+    rdt_rmid_refs[PQR_ASSOC_RMID(group)]++;
+}
+
+void x86_rdt_group_release(uint64_t group)
+{
+    if (group == 0)
+        return;
+
+    // a class of service or rmid reused later starts out with whatever masks
+    // or cache lines were left behind until the new owner takes over
+    AutoLock al(&rdt_lock);
+    DEBUG_ASSERT(rdt_clos[PQR_ASSOC_CLOS(group)].refs > 0);
+    DEBUG_ASSERT(rdt_rmid_refs[PQR_ASSOC_RMID(group)] > 0);
+    rdt_clos[PQR_ASSOC_CLOS(group)].refs--;
+    rdt_rmid_refs[PQR_ASSOC_RMID(group)]--;
+}
+
+struct rdt_occupancy_context {
+    uint32_t rmid;
+    // set by the first cpu of each package to get there
+    bool package_done[SMP_MAX_CPUS];
+    uint64_t bytes;
+    bool error;
+};
+
+// Adds the occupancy of the package we're on, once per package.
+static void rdt_occupancy_task(void* raw_context) {
+    auto context = static_cast<rdt_occupancy_context*>(raw_context);
+
+    x86_cpu_topology_t topo;
+    x86_cpu_topology_decode(x86_get_percpu()->apic_id, &topo);
+    if (topo.package_id >= SMP_MAX_CPUS ||
+        __atomic_exchange_n(&context->package_done[topo.package_id], true, __ATOMIC_RELAXED))
+        return;
+
+    write_msr(IA32_QM_EVTSEL, QM_EVTSEL(context->rmid, QM_EVENT_L3_OCCUPANCY));
+    uint64_t ctr = read_msr(IA32_QM_CTR);
+    if (ctr & (QM_CTR_ERROR | QM_CTR_UNAVAILABLE)) {
+        __atomic_store_n(&context->error, true, __ATOMIC_RELAXED);
+        return;
+    }
+    __atomic_fetch_add(&context->bytes, (ctr & QM_CTR_DATA_MASK) * rdt_occupancy_scale,
+                       __ATOMIC_RELAXED);
+}
+
+status_t x86_rdt_group_occupancy(uint64_t group, uint64_t* l3_bytes)
+{
+    if (rdt_num_rmid == 0)
+        return ERR_NOT_SUPPORTED;
+
+    // rmid 0 counts everything that isn't in a monitored group
+    rdt_occupancy_context context = {};
+    context.rmid = PQR_ASSOC_RMID(group);
+    if (context.rmid == 0)
+        return ERR_BAD_STATE;
+
+    mp_sync_exec(MP_CPU_ALL, rdt_occupancy_task, &context);
+    if (context.error)
+        return ERR_UNAVAILABLE;
+
+    *l3_bytes = context.bytes;
+    return NO_ERROR;
+}
@@ -81,6 +81,13 @@ static bool fxsave_supported = false;
 static size_t register_state_size = 0;
 /* Spinlock to guard register state size changes */
 static spin_lock_t state_lock = SPIN_LOCK_INITIAL_VALUE;
+/* Is supervisor state (processor trace) switched along with each thread */
+static bool supervisor_state_switched = false;
+
+/* The thread whose state was last loaded into each cpu's registers.  The
+ * kernel is built without using any of them, so they keep that state while
+ * kernel-only threads run. */
+static thread_t *extended_register_owner[SMP_MAX_CPUS];
 
 /* For FXRSTOR, we need 512 bytes to save the state.  For XSAVE-based
  * mechanisms, we only need 512 + 64 bytes for the initial state, since
@@ -177,6 +184,9 @@ void x86_extended_register_init(void)
     if (!initialized_cpu_already) {
         x86_extended_register_cpu_init();
     }
+
+    /* Whatever this cpu held before it last went down is gone */
+    extended_register_owner[arch_curr_cpu_num()] = NULL;
 }
 
 bool x86_extended_register_enable_feature(
@@ -330,13 +340,77 @@ void x86_extended_register_restore_state(void *register_state)
     }
 }
 
+/* Only threads which can run in user mode have any state of their own */
+static bool uses_extended_registers(const thread_t *t)
+{
+    return t->user_thread != NULL && t->arch.extended_register_state != NULL;
+}
+
+static void save_thread_state(thread_t *t, uint cpu)
+{
+    /* A thread which left every component in its initial configuration
+     * (XINUSE is clear) has nothing worth writing out */
+    if (xgetbv_1_supported && x86_xgetbv(1) == 0) {
+        t->arch.extended_register_state_init = true;
+    } else {
+        x86_extended_register_save_state(t->arch.extended_register_state);
+        t->arch.extended_register_state_init = false;
+    }
+    t->arch.extended_register_cpu = cpu;
+}
+
+static void restore_thread_state(thread_t *t, uint cpu)
+{
+    if (t->arch.extended_register_state_init) {
+        /* Nothing to do if the registers are already initial, though
+         * XINUSE says nothing about processor trace state */
+        if (supervisor_state_switched || !xgetbv_1_supported || x86_xgetbv(1) != 0) {
+            x86_extended_register_restore_state(extended_register_init_state);
+        }
+    } else {
+        x86_extended_register_restore_state(t->arch.extended_register_state);
+    }
+    t->arch.extended_register_cpu = cpu;
+    extended_register_owner[cpu] = t;
+}
+
 void x86_extended_register_context_switch(
         thread_t *old_thread, thread_t *new_thread)
 {
-    if (likely(old_thread)) {
-        x86_extended_register_save_state(old_thread->arch.extended_register_state);
+    uint cpu = arch_curr_cpu_num();
+
+    /* Processor trace state lives with the thread and isn't covered by
+     * XINUSE, so switch everything for every thread while it is */
+    if (unlikely(supervisor_state_switched)) {
+        if (likely(old_thread) && old_thread->arch.extended_register_state) {
+            x86_extended_register_save_state(old_thread->arch.extended_register_state);
+            old_thread->arch.extended_register_state_init = false;
+            old_thread->arch.extended_register_cpu = cpu;
+            extended_register_owner[cpu] = old_thread;
+        }
+        if (new_thread->arch.extended_register_state) {
+            restore_thread_state(new_thread, cpu);
+        }
+        return;
+    }
+
+    thread_t *owner = extended_register_owner[cpu];
+
+    /* The running thread may have changed its registers; save them, but
+     * leave it as the owner in case it is the next one back on this cpu */
+    if (likely(old_thread) && old_thread == owner && uses_extended_registers(old_thread)) {
+        save_thread_state(old_thread, cpu);
+    }
+
+    if (!uses_extended_registers(new_thread)) {
+        return;
+    }
+    /* If it last ran here and only kernel threads ran since, the registers
+     * are still its own */
+    if (new_thread == owner && new_thread->arch.extended_register_cpu == (int32_t)cpu) {
+        return;
     }
-    x86_extended_register_restore_state(new_thread->arch.extended_register_state);
+    restore_thread_state(new_thread, cpu);
 }
 
 static void read_xsave_state_info(void)
@@ -544,6 +618,7 @@ void x86_set_extended_register_pt_state(bool threads) {
     if (!xsaves_supported || !(xss_component_bitmap & X86_XSAVE_STATE_PT))
         return;
 
+    supervisor_state_switched = threads;
     uint64_t xss = read_msr(IA32_XSS_MSR);
     if (threads)
         xss |= X86_XSAVE_STATE_PT;
@@ -63,6 +63,7 @@ MODULE_SRCS += \
 	$(LOCAL_DIR)/mexec.S \
 	$(LOCAL_DIR)/header.S \
 	$(LOCAL_DIR)/hypervisor.cpp \
+	$(LOCAL_DIR)/idle.cpp \
 	$(LOCAL_DIR)/idt.cpp \
 	$(LOCAL_DIR)/ioapic.cpp \
 	$(LOCAL_DIR)/ioport.cpp \
@@ -71,7 +72,9 @@ MODULE_SRCS += \
 	$(LOCAL_DIR)/mmu_mem_types.cpp \
 	$(LOCAL_DIR)/mmu_tests.cpp \
 	$(LOCAL_DIR)/mp.cpp \
+	$(LOCAL_DIR)/perf_mon.cpp \
 	$(LOCAL_DIR)/proc_trace.cpp \
+	$(LOCAL_DIR)/rdt.cpp \
 	$(LOCAL_DIR)/registers.cpp \
 	$(LOCAL_DIR)/thread.cpp \
 	$(LOCAL_DIR)/tsc.cpp \
@@ -17,6 +17,8 @@
 #include <arch/x86.h>
 #include <arch/x86/descriptor.h>
 #include <arch/x86/mp.h>
+#include <arch/x86/perf_mon.h>
+#include <arch/x86/rdt.h>
 #include <arch/x86/registers.h>
 
 void arch_thread_initialize(thread_t *t, vaddr_t entry_point)
@@ -53,6 +55,8 @@ void arch_thread_initialize(thread_t *t, vaddr_t entry_point)
             x86_extended_register_size());
     t->arch.extended_register_state = (vaddr_t *)buf;
     x86_extended_register_init_state(t->arch.extended_register_state);
+    t->arch.extended_register_cpu = -1;
+    t->arch.extended_register_state_init = true;
 
     // set the stack pointer
     t->arch.sp = (vaddr_t)frame;
@@ -64,10 +68,14 @@ void arch_thread_initialize(thread_t *t, vaddr_t entry_point)
     // initialize the fs, gs and kernel bases to 0.
     t->arch.fs_base = 0;
     t->arch.gs_base = 0;
+
+    // start out in the default resource group
+    t->arch.rdt_group = 0;
 }
 
 void arch_thread_construct_first(thread_t *t)
 {
+    t->arch.extended_register_cpu = -1;
 }
 
 void arch_dump_thread(thread_t *t)
@@ -83,6 +91,10 @@ void arch_context_switch(thread_t *oldthread, thread_t *newthread)
 {
     x86_extended_register_context_switch(oldthread, newthread);
 
+    x86_perfmon_context_switch(oldthread, newthread);
+
+    x86_rdt_context_switch(oldthread, newthread);
+
     //printf("cs 0x%llx\n", kstack_top);
 
     /* set the tss SP0 value to point at the top of our stack */
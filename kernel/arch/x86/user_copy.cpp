@@ -26,13 +26,22 @@ static inline bool ac_flag(void)
     return x86_save_flags() & X86_FLAGS_AC;
 }
 
+static inline uint32_t usercopy_options(void)
+{
+    uint32_t options = 0;
+    if (x86_feature_test(X86_FEATURE_SMAP))
+        options |= X86_USERCOPY_SMAP;
+    if (x86_feature_test(X86_FEATURE_ERMS))
+        options |= X86_USERCOPY_ERMS;
+    return options;
+}
+
 status_t arch_copy_from_user(void *dst, const void *src, size_t len)
 {
     DEBUG_ASSERT(!ac_flag());
 
-    bool smap_avail = x86_feature_test(X86_FEATURE_SMAP);
     thread_t *thr = get_current_thread();
-    status_t status = _x86_copy_from_user(dst, src, len, smap_avail,
+    status_t status = _x86_copy_from_user(dst, src, len, usercopy_options(),
                                           &thr->arch.page_fault_resume);
 
     DEBUG_ASSERT(!ac_flag());
@@ -43,15 +52,34 @@ status_t arch_copy_to_user(void *dst, const void *src, size_t len)
 {
     DEBUG_ASSERT(!ac_flag());
 
-    bool smap_avail = x86_feature_test(X86_FEATURE_SMAP);
     thread_t *thr = get_current_thread();
-    status_t status = _x86_copy_to_user(dst, src, len, smap_avail,
+    status_t status = _x86_copy_to_user(dst, src, len, usercopy_options(),
                                         &thr->arch.page_fault_resume);
 
     DEBUG_ASSERT(!ac_flag());
     return status;
 }
 
+status_t arch_copy_iovec_from_user(void *dst, const iovec_t *iov, size_t count)
+{
+    DEBUG_ASSERT(!ac_flag());
+
+    // Validate every segment up front so the copy itself can run as a single
+    // batch, without returning to C between segments.
+    for (size_t i = 0; i < count; i++) {
+        if (iov[i].iov_len > 0 &&
+            !is_user_address_range((vaddr_t)iov[i].iov_base, iov[i].iov_len))
+            return ERR_INVALID_ARGS;
+    }
+
+    thread_t *thr = get_current_thread();
+    status_t status = _x86_copy_iovec_from_user(dst, iov, count, usercopy_options(),
+                                                &thr->arch.page_fault_resume);
+
+    DEBUG_ASSERT(!ac_flag());
+    return status;
+}
+
 static bool can_access(const void *base, size_t len, bool for_write)
 {
     LTRACEF("can_access: base %p, len %zu\n", base, len);
@@ -13,6 +13,7 @@
 #include <arch/x86/interrupts.h>
 #include <arch/x86/mmu.h>
 #include <hypervisor/guest_physical_address_space.h>
+#include <kernel/auto_lock.h>
 #include <kernel/sched.h>
 #include <kernel/timer.h>
 #include <mxtl/algorithm.h>
@@ -45,6 +46,8 @@ static const uint8_t kRexWMask = 1u << 3;
 static const uint8_t kModRMRegMask = 0b00111000;
 
 static const uint32_t kInterruptInfoValid = 1u << 31;
+static const uint16_t kApicIrrOffset = 0x200;
+static const uint16_t kInterruptStatusRviMask = 0xff;
 
 ExitInfo::ExitInfo() {
     exit_reason = static_cast<ExitReason>(vmcs_read(VmcsField32::EXIT_REASON));
@@ -54,7 +57,8 @@ ExitInfo::ExitInfo() {
     guest_rip = vmcs_read(VmcsFieldXX::GUEST_RIP);
 
     if (exit_reason == ExitReason::EXTERNAL_INTERRUPT ||
-        exit_reason == ExitReason::IO_INSTRUCTION)
+        exit_reason == ExitReason::IO_INSTRUCTION ||
+        exit_reason == ExitReason::VMX_PREEMPTION_TIMER)
         return;
 
     dprintf(SPEW, "exit reason: %#" PRIx32 "\n", static_cast<uint32_t>(exit_reason));
@@ -88,10 +92,40 @@ static void next_rip(const ExitInfo& exit_info) {
 }
 
 static void set_interrupt(LocalApicState* local_apic_state) {
-    if (local_apic_state->active_interrupt != kInvalidInterrupt) {
-        uint32_t interrupt_info = kInterruptInfoValid | local_apic_state->active_interrupt;
+    uint32_t vector = local_apic_state->active_interrupt;
+    if (vector == kInvalidInterrupt)
+        return;
+    local_apic_state->active_interrupt = kInvalidInterrupt;
+    if (!local_apic_state->virtual_interrupt_delivery) {
+        uint32_t interrupt_info = kInterruptInfoValid | vector;
         vmcs_write(VmcsField32::ENTRY_INTERRUPTION_INFORMATION, interrupt_info);
-        local_apic_state->active_interrupt = kInvalidInterrupt;
+        return;
+    }
+
+    // From Volume 3, Section 29.2.1: Set the vector in the virtual IRR, and
+    // raise RVI to it. The processor evaluates pending virtual interrupts on
+    // VM entry, and delivers this one as soon as the guest can take it.
+    uintptr_t irr = reinterpret_cast<uintptr_t>(local_apic_state->virtual_apic) +
+                    kApicIrrOffset + (vector / 32) * 0x10;
+    *reinterpret_cast<volatile uint32_t*>(irr) |= 1u << (vector % 32);
+    uint16_t status = vmcs_read(VmcsField16::GUEST_INTERRUPT_STATUS);
+    if ((status & kInterruptStatusRviMask) < vector) {
+        status = static_cast<uint16_t>((status & ~kInterruptStatusRviMask) | vector);
+        vmcs_write(VmcsField16::GUEST_INTERRUPT_STATUS, status);
+    }
+}
+
+/* Delivers the active interrupt, or waits for the guest to enable interrupts
+ * if it must be injected and they are disabled.
+ */
+static void deliver_interrupt(LocalApicState* local_apic_state) {
+    if (local_apic_state->virtual_interrupt_delivery ||
+        vmcs_read(VmcsFieldXX::GUEST_RFLAGS) & X86_FLAGS_IF) {
+        // If interrupts are enabled, we inject any active interrupts.
+        set_interrupt(local_apic_state);
+    } else if (local_apic_state->active_interrupt != kInvalidInterrupt) {
+        // If interrupts are disabled, we set VM exit on interrupt enable.
+        interrupt_window_exiting(true);
     }
 }
 
@@ -112,14 +146,10 @@ static status_t handle_external_interrupt(const ExitInfo& exit_info,
     arch_enable_ints();
     arch_disable_ints();
 
-    if (vmcs_read(VmcsFieldXX::GUEST_RFLAGS) & X86_FLAGS_IF) {
-        // If interrupts are enabled, we inject any active interrupts.
-        set_interrupt(local_apic_state);
-    } else if (local_apic_state->active_interrupt != kInvalidInterrupt) {
-        // If interrupts are disabled, we set VM exit on interrupt enable.
-        interrupt_window_exiting(true);
-    }
-    return NO_ERROR;
+    deliver_interrupt(local_apic_state);
+    // Return to userspace now and then, so that the thread that entered the
+    // guest can be killed or suspended while the guest runs.
+    return ERR_NEXT;
 }
 
 static status_t handle_interrupt_window(const ExitInfo& exit_info,
@@ -165,17 +195,80 @@ static status_t handle_cpuid(const ExitInfo& exit_info, GuestState* guest_state)
     }
 }
 
+static handler_return deadline_callback(timer_t* timer, lk_time_t now, void* arg);
+
 static status_t handle_hlt(const ExitInfo& exit_info, LocalApicState* local_apic_state) {
+    // An interrupt posted to the virtual local APIC is delivered on entry.
+    if (local_apic_state->virtual_interrupt_delivery &&
+        vmcs_read(VmcsField16::GUEST_INTERRUPT_STATUS) & kInterruptStatusRviMask) {
+        next_rip(exit_info);
+        return NO_ERROR;
+    }
+    // The VMX-preemption timer only counts down while the guest runs, so
+    // wait for the deadline with a timer of our own.
+    if (local_apic_state->preemption_timer && local_apic_state->tsc_deadline > 0) {
+        lk_time_t deadline = ticks_to_nanos(local_apic_state->tsc_deadline);
+        timer_set_oneshot(&local_apic_state->timer, deadline, deadline_callback, local_apic_state);
+    }
     // TODO(abdulla): Use an interruptible sleep here, so that we can:
     // a) Continue to deliver interrupts to the guest.
     // b) Kill the hypervisor while a guest is halted.
     event_wait(&local_apic_state->event);
+    if (local_apic_state->preemption_timer)
+        timer_cancel(&local_apic_state->timer);
     set_interrupt(local_apic_state);
     next_rip(exit_info);
     return NO_ERROR;
 }
 
-static status_t handle_io(const ExitInfo& exit_info, GuestState* guest_state,
+IoTraps::~IoTraps() {
+#if WITH_LIB_MAGENTA
+    for (size_t i = 0; i < num_traps_.load(); i++)
+        traps_[i].port->CancelQueued(&traps_[i].packet);
+#endif // WITH_LIB_MAGENTA
+}
+
+status_t IoTraps::Add(uint16_t io_port, mxtl::RefPtr<PortDispatcherV2> port, uint64_t key) {
+#if WITH_LIB_MAGENTA
+    AutoLock lock(&add_lock_);
+    size_t num_traps = num_traps_.load();
+    for (size_t i = 0; i < num_traps; i++) {
+        if (traps_[i].io_port == io_port)
+            return ERR_ALREADY_EXISTS;
+    }
+    if (num_traps == kMaxTraps)
+        return ERR_NO_RESOURCES;
+
+    Trap* trap = &traps_[num_traps];
+    trap->io_port = io_port;
+    trap->port = mxtl::move(port);
+    trap->packet.packet.key = key;
+    trap->packet.packet.type = MX_PKT_TYPE_GUEST_IO;
+    trap->packet.packet.status = NO_ERROR;
+    trap->packet.packet.guest_io.port = io_port;
+    num_traps_.store(num_traps + 1);
+    return NO_ERROR;
+#else // WITH_LIB_MAGENTA
+    return ERR_NOT_SUPPORTED;
+#endif // WITH_LIB_MAGENTA
+}
+
+status_t IoTraps::Write(uint16_t io_port, uint8_t access_size, uint32_t data) {
+#if WITH_LIB_MAGENTA
+    size_t num_traps = num_traps_.load();
+    for (size_t i = 0; i < num_traps; i++) {
+        if (traps_[i].io_port != io_port)
+            continue;
+        // Fails only once the port has no handles left, then no device is
+        // listening for the write.
+        traps_[i].port->QueueGuestIo(&traps_[i].packet, access_size, data);
+        return NO_ERROR;
+    }
+#endif // WITH_LIB_MAGENTA
+    return ERR_NOT_FOUND;
+}
+
+static status_t handle_io(const ExitInfo& exit_info, GuestState* guest_state, IoTraps* io_traps,
                           FifoDispatcher* serial_fifo) {
     next_rip(exit_info);
 #if WITH_LIB_MAGENTA
@@ -185,11 +278,18 @@ static status_t handle_io(const ExitInfo& exit_info, GuestState* guest_state,
             guest_state->rax = kUartStatusIdle;
         return NO_ERROR;
     }
-    if (io_info.string || io_info.repeat || io_info.port != kUartReceiveIoPort)
+    if (io_info.string || io_info.repeat)
+        return NO_ERROR;
+    uint32_t mask = io_info.bytes == 4 ? UINT32_MAX : (1u << (io_info.bytes * 8)) - 1;
+    status_t status = io_traps->Write(io_info.port, io_info.bytes,
+                                      static_cast<uint32_t>(guest_state->rax) & mask);
+    if (status != ERR_NOT_FOUND || io_info.port != kUartReceiveIoPort)
         return NO_ERROR;
     uint8_t* data = reinterpret_cast<uint8_t*>(&guest_state->rax);
     uint32_t actual;
-    return serial_fifo->Write(data, io_info.bytes, &actual);
+    status = serial_fifo->Write(data, io_info.bytes, &actual);
+    // Let userspace drain the fifo.
+    return status != NO_ERROR ? status : ERR_NEXT;
 #else // WITH_LIB_MAGENTA
     return NO_ERROR;
 #endif // WITH_LIB_MAGENTA
@@ -260,7 +360,8 @@ static status_t handle_wrmsr(const ExitInfo& exit_info, GuestState* guest_state,
         timer_cancel(&local_apic_state->timer);
         local_apic_state->active_interrupt = kInvalidInterrupt;
         local_apic_state->tsc_deadline = guest_state->rdx << 32 | (guest_state->rax & 0xffffffff);
-        if (local_apic_state->tsc_deadline > 0) {
+        // The VMX-preemption timer is armed on the way back into the guest.
+        if (local_apic_state->tsc_deadline > 0 && !local_apic_state->preemption_timer) {
             lk_time_t deadline = ticks_to_nanos(local_apic_state->tsc_deadline);
             timer_set_oneshot(&local_apic_state->timer, deadline, deadline_callback, local_apic_state);
         }
@@ -271,6 +372,36 @@ static status_t handle_wrmsr(const ExitInfo& exit_info, GuestState* guest_state,
     }
 }
 
+static status_t handle_preemption_timer(LocalApicState* local_apic_state) {
+    DEBUG_ASSERT(local_apic_state->active_interrupt == kInvalidInterrupt);
+
+    uint32_t* lvt_timer = apic_reg(local_apic_state, ApicRegister::LVT_TIMER);
+    local_apic_state->active_interrupt = *lvt_timer & LVT_TIMER_VECTOR_MASK;
+    local_apic_state->tsc_deadline = 0;
+    deliver_interrupt(local_apic_state);
+    return NO_ERROR;
+}
+
+void set_preemption_timer(LocalApicState* local_apic_state) {
+    if (!local_apic_state->preemption_timer)
+        return;
+
+    uint32_t controls = vmcs_read(VmcsField32::PINBASED_CTLS);
+    if (local_apic_state->tsc_deadline == 0) {
+        vmcs_write(VmcsField32::PINBASED_CTLS, controls & ~PINBASED_CTLS_PREEMPTION_TIMER);
+        return;
+    }
+    // From Volume 3, Section 25.5.1: The timer counts down at the rate of the
+    // TSC divided by 2^rate, and a value of 0 exits before the guest runs.
+    uint64_t now = rdtsc();
+    uint64_t ticks = 0;
+    if (local_apic_state->tsc_deadline > now)
+        ticks = (local_apic_state->tsc_deadline - now) >> local_apic_state->preemption_timer_rate;
+    vmcs_write(VmcsField32::VMX_PREEMPTION_TIMER_VALUE,
+               static_cast<uint32_t>(mxtl::min<uint64_t>(ticks, UINT32_MAX)));
+    vmcs_write(VmcsField32::PINBASED_CTLS, controls | PINBASED_CTLS_PREEMPTION_TIMER);
+}
+
 static status_t get_page(GuestPhysicalAddressSpace* gpas, vaddr_t guest_vaddr,
                          paddr_t* host_paddr) {
     size_t indices[X86_PAGING_LEVELS] = {
@@ -613,7 +744,7 @@ static status_t handle_xsetbv(const ExitInfo& exit_info, GuestState* guest_state
 
 status_t vmexit_handler(GuestState* guest_state, LocalApicState* local_apic_state,
                         IoApicState* io_apic_state, GuestPhysicalAddressSpace* gpas,
-                        FifoDispatcher* serial_fifo) {
+                        IoTraps* io_traps, FifoDispatcher* serial_fifo) {
     ExitInfo exit_info;
 
     switch (exit_info.exit_reason) {
@@ -629,7 +760,7 @@ status_t vmexit_handler(GuestState* guest_state, LocalApicState* local_apic_stat
         dprintf(SPEW, "handling HLT instruction\n\n");
         return handle_hlt(exit_info, local_apic_state);
     case ExitReason::IO_INSTRUCTION:
-        return handle_io(exit_info, guest_state, serial_fifo);
+        return handle_io(exit_info, guest_state, io_traps, serial_fifo);
     case ExitReason::RDMSR:
         dprintf(SPEW, "handling RDMSR instruction\n\n");
         return handle_rdmsr(exit_info, guest_state);
@@ -649,6 +780,8 @@ status_t vmexit_handler(GuestState* guest_state, LocalApicState* local_apic_stat
     case ExitReason::XSETBV:
         dprintf(SPEW, "handling XSETBV instruction\n\n");
         return handle_xsetbv(exit_info, guest_state);
+    case ExitReason::VMX_PREEMPTION_TIMER:
+        return handle_preemption_timer(local_apic_state);
     default:
         dprintf(SPEW, "unhandled VM exit %u\n\n", static_cast<uint32_t>(exit_info.exit_reason));
         return ERR_NOT_SUPPORTED;
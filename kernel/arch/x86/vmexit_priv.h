@@ -8,8 +8,17 @@
 
 #include <stdint.h>
 
+#include <kernel/mutex.h>
+#include <mxtl/atomic.h>
+#include <mxtl/ref_ptr.h>
+
+#if WITH_LIB_MAGENTA
+#include <magenta/port_dispatcher_v2.h>
+#endif // WITH_LIB_MAGENTA
+
 class FifoDispatcher;
 class GuestPhysicalAddressSpace;
+class PortDispatcherV2;
 struct GuestState;
 struct IoApicState;
 struct LocalApicState;
@@ -28,6 +37,7 @@ enum class ExitReason : uint32_t {
     ENTRY_FAILURE_MSR_LOADING   = 34u,
     APIC_ACCESS                 = 44u,
     EPT_VIOLATION               = 48u,
+    VMX_PREEMPTION_TIMER        = 52u,
     XSETBV                      = 55u,
 };
 
@@ -79,9 +89,43 @@ struct Instruction {
     uint64_t* reg;
 };
 
+/* Queues guest writes to IO ports on ports, so that devices can be kicked
+ * without the guest leaving the kernel. Traps can be added while the guest
+ * runs, but are never removed.
+ */
+class IoTraps {
+public:
+    static const size_t kMaxTraps = 16;
+
+    ~IoTraps();
+
+    status_t Add(uint16_t io_port, mxtl::RefPtr<PortDispatcherV2> port, uint64_t key);
+    /* Returns ERR_NOT_FOUND if |io_port| is not trapped. */
+    status_t Write(uint16_t io_port, uint8_t access_size, uint32_t data);
+
+private:
+#if WITH_LIB_MAGENTA
+    struct Trap {
+        uint16_t io_port;
+        mxtl::RefPtr<PortDispatcherV2> port;
+        PortPacket packet;
+    };
+
+    Mutex add_lock_;
+    Trap traps_[kMaxTraps];
+#endif // WITH_LIB_MAGENTA
+    // Published once the trap it counts is filled in.
+    mxtl::atomic<size_t> num_traps_{0};
+};
+
 void interrupt_window_exiting(bool enable);
+/* Arms the VMX-preemption timer for the guest's TSC deadline, if it is used. */
+void set_preemption_timer(LocalApicState* local_apic_state);
 status_t decode_instruction(const uint8_t* inst_buf, uint32_t inst_len, GuestState* guest_state,
                             Instruction* inst);
+/* Returns ERR_NEXT if the exit was handled, but userspace should see it
+ * before the guest is resumed.
+ */
 status_t vmexit_handler(GuestState* guest_state, LocalApicState* local_apic_state,
                         IoApicState* io_apic_state, GuestPhysicalAddressSpace* gpas,
-                        FifoDispatcher* serial_fifo);
+                        IoTraps* io_traps, FifoDispatcher* serial_fifo);
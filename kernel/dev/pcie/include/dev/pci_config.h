@@ -3,7 +3,7 @@
 #include <endian.h>
 #include <mxtl/ref_ptr.h>
 #include <mxtl/ref_counted.h>
-#include <mxtl/intrusive_single_list.h>
+#include <mxtl/intrusive_wavl_tree.h>
 #include <dev/pci_common.h>
 #include <new.h>
 
@@ -45,7 +45,7 @@ private:
 
 /* PciConfig supplies the factory for creating the appropriate pci config
  * object based on the address space of the pci device. */
-class PciConfig : public mxtl::SinglyLinkedListable<mxtl::RefPtr<PciConfig>>
+class PciConfig : public mxtl::WAVLTreeContainable<mxtl::RefPtr<PciConfig>>
                 , public mxtl::RefCounted<PciConfig> {
 public:
     // Standard PCI configuration space values. Offsets from PCI Firmware Spec ch 6.
@@ -116,6 +116,9 @@ public:
     inline uintptr_t base() const { return base_; }
     inline PciAddrSpace addr_space() const { return addr_space_; }
 
+    // WAVLTree properties
+    uintptr_t GetKey() const { return base_; }
+
     // Virtuals
     virtual uint8_t Read(const PciReg8 addr) const = 0;
     virtual uint16_t Read(const PciReg16 addr) const = 0;
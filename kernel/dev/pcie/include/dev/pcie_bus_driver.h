@@ -222,7 +222,7 @@ private:
     Mutex                               bus_rescan_lock_;
     mutable Mutex                       start_lock_;
     RootCollection                      roots_;
-    mxtl::SinglyLinkedList<mxtl::RefPtr<PciConfig>> configs_;
+    mxtl::WAVLTree<uintptr_t, mxtl::RefPtr<PciConfig>> configs_;
 
     RegionAllocator::RegionPool::RefPtr region_bookkeeping_;
     RegionAllocator                     mmio_lo_regions_;
@@ -271,6 +271,29 @@ public:
      */
     status_t MaskUnmaskIrq(uint irq_id, bool mask);
 
+    /**
+     * Deliver the specified IRQ to the given CPU.
+     *
+     * @param irq_id The ID of the IRQ to steer.
+     * @param cpu The CPU which should receive the IRQ.
+     *
+     * @return A status_t indicating the success or failure of the operation.
+     * Status codes may include (but are not limited to)...
+     *
+     * ++ ERR_UNAVAILABLE
+     *    The device has become unplugged and is waiting to be released.
+     * ++ ERR_BAD_STATE
+     *    The device is in DISABLED IRQ mode.
+     * ++ ERR_INVALID_ARGS
+     *    The irq_id parameter is out of range for the currently configured
+     *    mode, or the CPU is not online.
+     * ++ ERR_NOT_SUPPORTED
+     *    The device is not operating in MSI mode, or the platform cannot steer
+     *    MSIs.  Every vector in a block of MSIs shares one target, so this is
+     *    also returned when more than one vector is in use.
+     */
+    status_t SetIrqAffinity(uint irq_id, uint cpu);
+
     void SetQuirksDone() { quirks_done_ = true; }
 
     /**
@@ -385,6 +408,7 @@ private:
     status_t SetIrqModeLocked(pcie_irq_mode_t mode, uint requested_irqs);
     status_t RegisterIrqHandlerLocked(uint irq_id, pcie_irq_handler_fn_t handler, void* ctx);
     status_t MaskUnmaskIrqLocked(uint irq_id, bool mask);
+    status_t SetIrqAffinityLocked(uint irq_id, uint cpu);
 
     // Internal Legacy IRQ support.
     status_t MaskUnmaskLegacyIrq(bool mask);
@@ -401,6 +425,7 @@ private:
 
     bool     MaskUnmaskMsiIrqLocked(uint irq_id, bool mask);
     status_t MaskUnmaskMsiIrq(uint irq_id, bool mask);
+    void     RetargetMsi(uint64_t tgt_addr);
     void     MaskAllMsiVectors();
     void     SetMsiTarget(uint64_t tgt_addr, uint32_t tgt_data);
     void     FreeMsiBlock();
@@ -146,6 +146,21 @@ public:
         DEBUG_ASSERT(false);
     }
 
+    /**
+     * Method used to choose which CPU the IRQs in a block of MSIs are
+     * delivered to.  Platforms which cannot steer MSIs need not implement it.
+     *
+     * @param block A pointer to a block of MSIs allocated using a platform supplied
+     *        platform_alloc_msi_block_t callback.  On success its tgt_addr has
+     *        been updated, and must be written to the device.
+     * @param cpu The CPU to deliver every IRQ in the block to.
+     *
+     * @return A status code indicating the success or failure of the operation.
+     */
+    virtual status_t SetMsiAffinity(pcie_msi_block_t* block, uint cpu) {
+        return ERR_NOT_SUPPORTED;
+    }
+
 protected:
     enum class MsiSupportLevel { NONE, MSI, MSI_WITH_MASKING };
     explicit PciePlatformInterface(MsiSupportLevel msi_support)
@@ -515,12 +515,11 @@ const PciConfig* PcieBusDriver::GetConfig(uint bus_id,
     if (out_cfg_phys)
         *out_cfg_phys = iter->ecam().phys_base + offset;
 
-    // TODO(cja): Move to a BDF based associative container for better lookup time
-    // and insert or find behavior.
+    // Configs are kept in a tree keyed by their address.  A bus scan probes
+    // every device number of every bus, so a list made each probe walk all
+    // of the configs created so far.
     uintptr_t addr = reinterpret_cast<uintptr_t>(static_cast<uint8_t*>(iter->vaddr()) + offset);
-    auto cfg_iter = configs_.find_if([addr](const PciConfig& cfg) {
-                                        return (cfg.base() == addr);
-                                        });
+    auto cfg_iter = configs_.find(addr);
     /* An entry for this bdf config has been found in cache, return it */
     if (cfg_iter.IsValid()) {
         return &(*cfg_iter);
@@ -529,8 +528,11 @@ const PciConfig* PcieBusDriver::GetConfig(uint bus_id,
     // TODO(cja): PIO support here
     // Nothing found, create a new PciConfig for this address
     auto cfg = PciConfig::Create(addr, PciAddrSpace::MMIO);
-    configs_.push_front(cfg);
-    return cfg.get();
+    if (cfg == nullptr)
+        return nullptr;
+    const PciConfig* ret = cfg.get();
+    configs_.insert(mxtl::move(cfg));
+    return ret;
 }
 
 status_t PcieBusDriver::AddEcamRegion(const EcamRegion& ecam) {
@@ -363,6 +363,35 @@ void PcieDevice::SetMsiTarget(uint64_t tgt_addr, uint32_t tgt_data) {
     cfg_->Write(irq_.msi->data_reg(), static_cast<uint16_t>(tgt_data & 0xFFFF));
 }
 
+void PcieDevice::RetargetMsi(uint64_t tgt_addr) {
+    DEBUG_ASSERT(irq_.msi);
+    DEBUG_ASSERT(irq_.msi->is_valid());
+    DEBUG_ASSERT(irq_.msi->is64Bit() || !(tgt_addr >> 32));
+
+    /* The address must not change while the device could be writing it.  If
+     * the device can mask its vectors, do that; an IRQ which arrives in the
+     * meantime stays pending and is sent to the new target once unmasked.
+     * Otherwise, briefly disable MSI altogether. */
+    uint32_t mask_bits = 0;
+    if (irq_.msi->has_pvm()) {
+        mask_bits = cfg_->Read(irq_.msi->mask_bits_reg());
+        cfg_->Write(irq_.msi->mask_bits_reg(), 0xFFFFFFFF);
+    } else {
+        SetMsiEnb(false);
+    }
+
+    cfg_->Write(irq_.msi->addr_reg(), static_cast<uint32_t>(tgt_addr & 0xFFFFFFFF));
+    if (irq_.msi->is64Bit()) {
+        cfg_->Write(irq_.msi->addr_upper_reg(), static_cast<uint32_t>(tgt_addr >> 32));
+    }
+
+    if (irq_.msi->has_pvm()) {
+        cfg_->Write(irq_.msi->mask_bits_reg(), mask_bits);
+    } else {
+        SetMsiEnb(true);
+    }
+}
+
 void PcieDevice::FreeMsiBlock() {
     /* If no block has been allocated, there is nothing to do */
     if (!irq_.msi->irq_block_.allocated)
@@ -743,6 +772,38 @@ status_t PcieDevice::MaskUnmaskIrqLocked(uint irq_id, bool mask) {
     return NO_ERROR;
 }
 
+status_t PcieDevice::SetIrqAffinityLocked(uint irq_id, uint cpu) {
+    DEBUG_ASSERT(plugged_in_);
+    DEBUG_ASSERT(dev_lock_.IsHeld());
+
+    if (irq_.mode == PCIE_IRQ_MODE_DISABLED)
+        return ERR_BAD_STATE;
+
+    DEBUG_ASSERT(irq_.handlers);
+    DEBUG_ASSERT(irq_.handler_count);
+
+    if (irq_id >= irq_.handler_count)
+        return ERR_INVALID_ARGS;
+
+    /* Legacy IRQs may be shared with other devices, and MSI-X is not
+     * implemented yet, so only MSI can be steered. */
+    if (irq_.mode != PCIE_IRQ_MODE_MSI)
+        return ERR_NOT_SUPPORTED;
+
+    /* All of the vectors in an MSI block are sent to the one address, so
+     * moving one of several would move them all. */
+    DEBUG_ASSERT(irq_.msi && irq_.msi->irq_block_.allocated);
+    if (irq_.handler_count > 1)
+        return ERR_NOT_SUPPORTED;
+
+    status_t res = bus_drv_.platform().SetMsiAffinity(&irq_.msi->irq_block_, cpu);
+    if (res != NO_ERROR)
+        return res;
+
+    RetargetMsi(irq_.msi->irq_block_.tgt_addr);
+    return NO_ERROR;
+}
+
 /******************************************************************************
  *
  * Kernel API; prototypes in dev/pcie_irqs.h
@@ -795,6 +856,14 @@ status_t PcieDevice::MaskUnmaskIrq(uint irq_id, bool mask) {
         : ERR_BAD_STATE;
 }
 
+status_t PcieDevice::SetIrqAffinity(uint irq_id, uint cpu) {
+    AutoLock dev_lock(&dev_lock_);
+
+    return (plugged_in_ && !disabled_)
+        ? SetIrqAffinityLocked(irq_id, cpu)
+        : ERR_BAD_STATE;
+}
+
 
 // Map from a device's interrupt pin ID to the proper system IRQ ID.  Follow the
 // PCIe graph up to the root, swizzling as we traverse PCIe switches,
@@ -75,8 +75,11 @@ void PcieUpstreamNode::ScanDownstream() {
             /* If we can find the config, and it has a valid vendor ID, go ahead
              * and scan it looking for a valid function. */
             auto cfg = driver().GetConfig(managed_bus_id_, dev_id, func_id);
+            if (!cfg)
+                break;
+
             uint16_t vendor_id = cfg->Read(PciConfig::kVendorId);
-            bool good_device = cfg && (vendor_id != PCIE_INVALID_VENDOR_ID);
+            bool good_device = (vendor_id != PCIE_INVALID_VENDOR_ID);
             if (good_device) {
                 uint16_t device_id = cfg->Read(PciConfig::kDeviceId);
                 LTRACEF("found valid device %04x:%04x at %02x:%02x.%01x\n",
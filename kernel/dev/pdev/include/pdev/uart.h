@@ -19,6 +19,9 @@ struct pdev_uart_ops {
     /* panic-time uart accessors, intended to be run with interrupts disabled */
     int (*pputc)(char c);
     int (*pgetc)(void);
+
+    /* optional, for drivers that buffer output, see uart_sync_output() */
+    void (*sync_output)(void);
 };
 
 void pdev_register_uart(const struct pdev_uart_ops* ops);
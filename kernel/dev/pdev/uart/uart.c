@@ -56,6 +56,11 @@ int uart_pgetc(void) {
     return uart_ops->pgetc();
 }
 
+void uart_sync_output(void) {
+    if (uart_ops->sync_output)
+        uart_ops->sync_output();
+}
+
 void pdev_register_uart(const struct pdev_uart_ops* ops) {
     uart_ops = ops;
     smp_mb();
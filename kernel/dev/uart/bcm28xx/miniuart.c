@@ -8,6 +8,7 @@
 #include <assert.h>
 #include <dev/interrupt.h>
 #include <dev/uart.h>
+#include <kernel/spinlock.h>
 #include <kernel/thread.h>
 #include <lib/cbuf.h>
 #include <dev/bcm28xx.h>
@@ -21,9 +22,18 @@
 #include <pdev/uart.h>
 
 #define RXBUF_SIZE 16
+#define TXBUF_SIZE 4096 // power of two
 
 static cbuf_t uart_rx_buf;
 
+// Once the irq is up output is queued here and fed to the fifo from the tx
+// interrupt. A full buffer is drained synchronously, nothing is dropped.
+static spin_lock_t uart_tx_lock = SPIN_LOCK_INITIAL_VALUE; // also guards ier
+static char uart_tx_buf[TXBUF_SIZE];
+static size_t uart_tx_head; // free running
+static size_t uart_tx_tail;
+static bool uart_tx_buffered = false;
+
 struct bcm283x_mu_regs {
     uint32_t io;
     uint32_t ier;
@@ -51,9 +61,25 @@ struct bcm283x_aux_regs {
 #define MU_IIR_CLR_RECV_FIFO (1 << 1)
 
 #define MU_IIR_EN_RX_IRQ (1 << 0) // Enable the recv interrupt.
+#define MU_IIR_EN_TX_IRQ (1 << 1) // Enable the xmit interrupt.
 
 #define MU_LSR_TX_EMPTY (1 << 5)
 
+// Tops up the fifo from the buffer, and leaves the tx interrupt on for as long
+// as anything is left. It is asserted for as long as the fifo is empty.
+static void bcm28xx_tx_fill_locked(void) {
+    volatile struct bcm283x_mu_regs* mu_regs =
+        (struct bcm283x_mu_regs*)MINIUART_BASE;
+
+    while (uart_tx_tail != uart_tx_head && (readl(&mu_regs->lsr) & MU_LSR_TX_EMPTY))
+        writel(uart_tx_buf[uart_tx_tail++ % TXBUF_SIZE], &mu_regs->io);
+
+    uint32_t ier = MU_IIR_EN_RX_IRQ;
+    if (uart_tx_tail != uart_tx_head)
+        ier |= MU_IIR_EN_TX_IRQ;
+    writel(ier, &mu_regs->ier);
+}
+
 static enum handler_return aux_irq(void* arg) {
     volatile struct bcm283x_mu_regs* mu_regs =
         (struct bcm283x_mu_regs*)MINIUART_BASE;
@@ -78,18 +104,34 @@ static enum handler_return aux_irq(void* arg) {
         cbuf_write_char(&uart_rx_buf, ch, false);
     }
 
+    spin_lock(&uart_tx_lock);
+    bcm28xx_tx_fill_locked();
+    spin_unlock(&uart_tx_lock);
+
     return resched ? INT_RESCHEDULE : INT_NO_RESCHEDULE;
 }
 
 static int bcm28xx_putc(char c) {
-    struct bcm283x_mu_regs* regs = (struct bcm283x_mu_regs*)MINIUART_BASE;
+    if (!__atomic_load_n(&uart_tx_buffered, __ATOMIC_ACQUIRE)) {
+        struct bcm283x_mu_regs* regs = (struct bcm283x_mu_regs*)MINIUART_BASE;
 
-    /* Wait until there is space in the FIFO */
-    while (!(readl(&regs->lsr) & MU_LSR_TX_EMPTY))
-        ;
+        /* Wait until there is space in the FIFO */
+        while (!(readl(&regs->lsr) & MU_LSR_TX_EMPTY))
+            ;
 
-    /* Send the character */
-    writel(c, &regs->io);
+        /* Send the character */
+        writel(c, &regs->io);
+
+        return 1;
+    }
+
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&uart_tx_lock, state);
+    while (uart_tx_head - uart_tx_tail == TXBUF_SIZE)
+        bcm28xx_tx_fill_locked();
+    uart_tx_buf[uart_tx_head++ % TXBUF_SIZE] = c;
+    bcm28xx_tx_fill_locked();
+    spin_unlock_irqrestore(&uart_tx_lock, state);
 
     return 1;
 }
@@ -119,6 +161,8 @@ static void bcm28xx_uart_init(mdi_node_ref_t* node, uint level) {
 
     // Enable the receive interrupt on the UART peripheral.
     writel(MU_IIR_EN_RX_IRQ, &mu_regs->ier);
+
+    __atomic_store_n(&uart_tx_buffered, true, __ATOMIC_RELEASE);
 }
 
 static int bcm28xx_getc(bool wait) {
@@ -155,11 +199,29 @@ static int bcm28xx_pgetc(void) {
     return readl(&mu_regs->io);
 }
 
+static void bcm28xx_sync_output(void) {
+    volatile struct bcm283x_mu_regs* mu_regs =
+        (struct bcm283x_mu_regs*)MINIUART_BASE;
+
+    if (!__atomic_exchange_n(&uart_tx_buffered, false, __ATOMIC_ACQ_REL))
+        return;
+
+    // The other cpus are stopped or about to be, maybe holding the lock, so
+    // take what is queued without it.
+    writel(MU_IIR_EN_RX_IRQ, &mu_regs->ier);
+    while (uart_tx_tail != uart_tx_head) {
+        while (!(readl(&mu_regs->lsr) & MU_LSR_TX_EMPTY))
+            ;
+        writel(uart_tx_buf[uart_tx_tail++ % TXBUF_SIZE], &mu_regs->io);
+    }
+}
+
 static const struct pdev_uart_ops uart_ops = {
     .putc = bcm28xx_putc,
     .getc = bcm28xx_getc,
     .pputc = bcm28xx_pputc,
     .pgetc = bcm28xx_pgetc,
+    .sync_output = bcm28xx_sync_output,
 };
 
 static void bcm28xx_uart_init_early(mdi_node_ref_t* node, uint level) {
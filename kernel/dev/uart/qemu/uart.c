@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <trace.h>
 #include <lib/cbuf.h>
+#include <kernel/spinlock.h>
 #include <kernel/thread.h>
 #include <dev/interrupt.h>
 #include <dev/uart.h>
@@ -37,6 +38,7 @@
 #define UARTREG(base, reg)  (*REG32((base)  + (reg)))
 
 #define RXBUF_SIZE 16
+#define TXBUF_SIZE 4096 // power of two
 
 // values read from MDI
 static uint64_t uart_base = 0;
@@ -44,6 +46,30 @@ static uint32_t uart_irq = 0;
 
 static cbuf_t uart_rx_buf;
 
+/* once the irq is up output is queued here and fed to the fifo from the tx
+ * interrupt. a full buffer is drained synchronously, nothing is dropped */
+static spin_lock_t uart_tx_lock = SPIN_LOCK_INITIAL_VALUE; // also guards IMSC
+static char uart_tx_buf[TXBUF_SIZE];
+static size_t uart_tx_head; // free running
+static size_t uart_tx_tail;
+static bool uart_tx_buffered = false;
+
+/* tops up the fifo from the buffer, and leaves the tx interrupt on for as
+ * long as anything is left. the interrupt fires when the fifo drains through
+ * its trigger level, so it only comes if the fifo was just filled past it */
+static void qemu_uart_tx_fill_locked(void)
+{
+    while (uart_tx_tail != uart_tx_head && (UARTREG(uart_base, UART_TFR) & (1<<5)) == 0)
+        UARTREG(uart_base, UART_DR) = uart_tx_buf[uart_tx_tail++ % TXBUF_SIZE];
+
+    if (uart_tx_tail != uart_tx_head) {
+        UARTREG(uart_base, UART_IMSC) |= (1<<5); // txim
+    } else {
+        UARTREG(uart_base, UART_IMSC) &= ~(1<<5); // !txim
+        UARTREG(uart_base, UART_ICR) = (1<<5);
+    }
+}
+
 static enum handler_return qemu_uart_irq(void *arg)
 {
     bool resched = false;
@@ -56,7 +82,9 @@ static enum handler_return qemu_uart_irq(void *arg)
         while ((UARTREG(uart_base, UART_TFR) & (1<<4)) == 0) {
             /* if we're out of rx buffer, mask the irq instead of handling it */
             if (cbuf_space_avail(&uart_rx_buf) == 0) {
+                spin_lock(&uart_tx_lock);
                 UARTREG(uart_base, UART_IMSC) &= ~(1<<4); // !rxim
+                spin_unlock(&uart_tx_lock);
                 break;
             }
 
@@ -67,6 +95,12 @@ static enum handler_return qemu_uart_irq(void *arg)
         }
     }
 
+    if (isr & (1<<5)) { // txmis
+        spin_lock(&uart_tx_lock);
+        qemu_uart_tx_fill_locked();
+        spin_unlock(&uart_tx_lock);
+    }
+
     return resched ? INT_RESCHEDULE : INT_NO_RESCHEDULE;
 }
 
@@ -92,14 +126,27 @@ static void qemu_uart_init(mdi_node_ref_t* node, uint level)
 
     // enable interrupt
     unmask_interrupt(uart_irq);
+
+    __atomic_store_n(&uart_tx_buffered, true, __ATOMIC_RELEASE);
 }
 
 static int qemu_uart_putc(char c)
 {
-    /* spin while fifo is full */
-    while (UARTREG(uart_base, UART_TFR) & (1<<5))
-        ;
-    UARTREG(uart_base, UART_DR) = c;
+    if (!__atomic_load_n(&uart_tx_buffered, __ATOMIC_ACQUIRE)) {
+        /* spin while fifo is full */
+        while (UARTREG(uart_base, UART_TFR) & (1<<5))
+            ;
+        UARTREG(uart_base, UART_DR) = c;
+        return 1;
+    }
+
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&uart_tx_lock, state);
+    while (uart_tx_head - uart_tx_tail == TXBUF_SIZE)
+        qemu_uart_tx_fill_locked();
+    uart_tx_buf[uart_tx_head++ % TXBUF_SIZE] = c;
+    qemu_uart_tx_fill_locked();
+    spin_unlock_irqrestore(&uart_tx_lock, state);
 
     return 1;
 }
@@ -108,7 +155,10 @@ static int qemu_uart_getc(bool wait)
 {
     char c;
     if (cbuf_read_char(&uart_rx_buf, &c, wait) == 1) {
-        UARTREG(uart_base, UART_IMSC) = (1<<4); // rxim
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&uart_tx_lock, state);
+        UARTREG(uart_base, UART_IMSC) |= (1<<4); // rxim
+        spin_unlock_irqrestore(&uart_tx_lock, state);
         return c;
     }
 
@@ -135,11 +185,27 @@ static int qemu_uart_pgetc(void)
     }
 }
 
+static void qemu_uart_sync_output(void)
+{
+    if (!__atomic_exchange_n(&uart_tx_buffered, false, __ATOMIC_ACQ_REL))
+        return;
+
+    /* the other cpus are stopped or about to be, maybe holding the lock, so
+     * take what is queued without it */
+    UARTREG(uart_base, UART_IMSC) &= ~(1<<5); // !txim
+    while (uart_tx_tail != uart_tx_head) {
+        while (UARTREG(uart_base, UART_TFR) & (1<<5))
+            ;
+        UARTREG(uart_base, UART_DR) = uart_tx_buf[uart_tx_tail++ % TXBUF_SIZE];
+    }
+}
+
 static const struct pdev_uart_ops uart_ops = {
     .putc = qemu_uart_putc,
     .getc = qemu_uart_getc,
     .pputc = qemu_uart_pputc,
     .pgetc = qemu_uart_pgetc,
+    .sync_output = qemu_uart_sync_output,
 };
 
 static void qemu_uart_init_early(mdi_node_ref_t* node, uint level) {
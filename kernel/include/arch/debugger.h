@@ -27,4 +27,16 @@ status_t arch_get_regset(struct thread *thread, uint regset, void* regs, uint* b
 // privileged and unprivileged fields.
 status_t arch_set_regset(struct thread *thread, uint regset, const void* regs, uint buf_size, bool priv);
 
+// For in-thread exception handlers. |thread| must be the current thread,
+// stopped in an exception.
+// Makes |thread| resume by calling |pc| with the single argument |arg| and
+// the return address |return_pc|, with the stack pointer at |sp| (which is
+// 16-byte aligned) before the call.
+status_t arch_start_exception_upcall(struct thread *thread, uintptr_t pc, uintptr_t sp,
+                                     uintptr_t arg, uintptr_t return_pc);
+// Makes |thread| resume with the general regs |regs|, saved when the
+// handler was called and possibly changed by it since. Privileged state is
+// left as it is.
+status_t arch_finish_exception_upcall(struct thread *thread, const void* regs, uint buf_size);
+
 __END_CDECLS
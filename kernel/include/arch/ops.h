@@ -54,6 +54,11 @@ void arch_flush_state_and_halt(event_t *flush_done) __NO_RETURN;
 
 void arch_idle(void);
 
+/* The pc and frame pointer that the irq being handled on this cpu
+ * interrupted, and whether they were in user mode. Returns false when
+ * not called from an irq handler. */
+bool arch_irq_frame(uintptr_t *pc, uintptr_t *fp, bool *user);
+
 /* function to call in spinloops to idle */
 static void arch_spinloop_pause(void);
 /* function to call when an event happens that may trigger the exit from
@@ -63,6 +68,10 @@ static void arch_spinloop_signal(void);
 /* arch optimized version of a page zero routine against a page aligned buffer */
 void arch_zero_page(void *);
 
+/* same as above, but avoids pulling the page into the cache where the arch
+ * allows it, for pages that won't be touched again soon */
+void arch_zero_page_nontemporal(void *);
+
 /* give the specific arch a chance to override some routines */
 #include <arch/arch_ops.h>
 
@@ -8,6 +8,7 @@
 
 #include <magenta/compiler.h>
 #include <err.h>
+#include <iovec.h>
 
 __BEGIN_CDECLS
 
@@ -39,4 +40,19 @@ status_t arch_copy_from_user(void *dst, const void *src, size_t len);
  */
 status_t arch_copy_to_user(void *dst, const void *src, size_t len);
 
+/*
+ * @brief Gather an array of userspace buffers into one kernelspace buffer
+ *
+ * This function validates that usermode has access to every segment before
+ * copying any data, and lays the segments out back to back in dst.  The
+ * iovec array itself must already be in kernelspace.
+ *
+ * @param dst The destination buffer, large enough for all of the segments.
+ * @param iov The segments to copy.
+ * @param count The number of segments.
+ *
+ * @return NO_ERROR on success
+ */
+status_t arch_copy_iovec_from_user(void *dst, const iovec_t *iov, size_t count);
+
 __END_CDECLS
@@ -23,4 +23,8 @@ int uart_getc(bool wait);
 int uart_pputc(char c);
 int uart_pgetc(void);
 
+/* sends whatever output is still buffered and makes all later output
+ * synchronous, for panic and halt paths that may never take interrupts again */
+void uart_sync_output(void);
+
 __END_CDECLS
@@ -7,6 +7,7 @@
 #pragma once
 
 #include <kernel/mutex.h>
+#include <kernel/rwlock.h>
 #include <kernel/spinlock.h>
 #include <mxtl/auto_lock.h>
 #include <mxtl/macros.h>
@@ -56,3 +57,41 @@ private:
     spin_lock_t* spinlock_;
     spin_lock_saved_state_t state_;
 };
+
+class AutoReadLock {
+public:
+    explicit AutoReadLock(rwlock_t* lock) : lock_(lock) { rwlock_acquire_read(lock_); }
+    ~AutoReadLock() { release(); }
+
+    void release() {
+        if (lock_) {
+            rwlock_release_read(lock_);
+            lock_ = nullptr;
+        }
+    }
+
+    // suppress default constructors
+    DISALLOW_COPY_ASSIGN_AND_MOVE(AutoReadLock);
+
+private:
+    rwlock_t* lock_;
+};
+
+class AutoWriteLock {
+public:
+    explicit AutoWriteLock(rwlock_t* lock) : lock_(lock) { rwlock_acquire_write(lock_); }
+    ~AutoWriteLock() { release(); }
+
+    void release() {
+        if (lock_) {
+            rwlock_release_write(lock_);
+            lock_ = nullptr;
+        }
+    }
+
+    // suppress default constructors
+    DISALLOW_COPY_ASSIGN_AND_MOVE(AutoWriteLock);
+
+private:
+    rwlock_t* lock_;
+};
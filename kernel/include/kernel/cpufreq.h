@@ -0,0 +1,28 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+#pragma once
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include <magenta/compiler.h>
+
+__BEGIN_CDECLS;
+
+/* the cpufreq governor picks each cpu's performance level from how busy the
+ * scheduler kept it, and runs it flat out while threads queue up on it. all
+ * of these do nothing unless the platform can change cpu performance */
+
+/* the current cpu switched threads, going from or to idle */
+void cpufreq_context_switch(uint cpu, bool was_idle, bool is_idle, lk_time_t now);
+
+/* the scheduler tick on the current cpu */
+void cpufreq_tick(uint cpu, lk_time_t now);
+
+/* runnable threads are waiting on |cpu|, which may be another cpu. called
+ * with the thread lock held */
+void cpufreq_boost(uint cpu);
+
+__END_CDECLS;
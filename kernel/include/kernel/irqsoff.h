@@ -0,0 +1,50 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <magenta/compiler.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+__BEGIN_CDECLS
+
+/* The irqsoff tracer, built in with IRQSOFF_TRACE=true, times every stretch a
+ * cpu spends with interrupts disabled, from the instruction that disabled them
+ * to the one that enabled them again. The longest few per cpu are kept for the
+ * "irqsoff" console command, and those longer than kernel.irqsoff-threshold-us
+ * are written to ktrace as they end.
+ *
+ * Preemption can't be disabled in this kernel, so interrupts-off is the only
+ * kind of region there is. The arch code calls the hooks below wherever it
+ * turns interrupts off or back on. */
+
+#if WITH_IRQSOFF_TRACE
+
+/* interrupts were just disabled at |pc|, having been enabled */
+void irqsoff_begin(uintptr_t pc);
+/* interrupts are about to be enabled at |pc| */
+void irqsoff_end(uintptr_t pc);
+/* forget the region in progress, for waits with interrupts off that end at
+ * the first interrupt, such as mwait in the idle loop */
+void irqsoff_cancel(void);
+
+/* For the watchdog, which may call it from an NMI. Notes in ktrace every cpu
+ * that has had interrupts off for longer than |limit|, once per region, and
+ * returns how long |cpu| has had them off. */
+lk_time_t irqsoff_check_stalls(lk_time_t now, lk_time_t limit, uint cpu);
+/* Where |cpu| last disabled interrupts, 0 if they are on. */
+uintptr_t irqsoff_start_pc(uint cpu);
+
+#else
+
+static inline void irqsoff_begin(uintptr_t pc) {}
+static inline void irqsoff_end(uintptr_t pc) {}
+static inline void irqsoff_cancel(void) {}
+
+#endif
+
+__END_CDECLS
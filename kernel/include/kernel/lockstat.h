@@ -0,0 +1,73 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <magenta/compiler.h>
+#include <kernel/spinlock.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+__BEGIN_CDECLS
+
+/* Lock statistics, built in with LOCK_STATS=true. Every acquire of a mutex or
+ * spinlock is timed and counted against its lock class, and the classes that
+ * see the most contention are listed by the "lockstat" console command, which
+ * can also write them out to ktrace.
+ *
+ * A mutex's class is the name it was declared with, see Mutex(const char*)
+ * and MUTEX_INITIAL_VALUE_NAMED(), so every instance of a member lock adds up
+ * in one place. Unnamed mutexes and all spinlocks are classed by their own
+ * address, which symbolizes to the variable for locks with static storage. */
+
+#define LOCKSTAT_KIND_MUTEX     0
+#define LOCKSTAT_KIND_SPIN      1
+
+/* log2 buckets of nanoseconds, the last catches everything longer */
+#define LOCKSTAT_HIST_BUCKETS   32
+/* contending call sites remembered per class */
+#define LOCKSTAT_CALLERS        8
+
+typedef struct lockstat_caller {
+    uintptr_t pc;
+    uint64_t count;
+} lockstat_caller_t;
+
+typedef struct lockstat_class {
+    /* the name, or the lock address for unnamed locks. 0 while free */
+    uintptr_t key;
+    const char *name;
+    uint kind;
+
+    uint64_t acquires;
+    uint64_t contended;
+    lk_time_t wait_total;
+    lk_time_t wait_max;
+    lk_time_t hold_total;
+    lk_time_t hold_max;
+    uint64_t wait_hist[LOCKSTAT_HIST_BUCKETS];
+    uint64_t hold_hist[LOCKSTAT_HIST_BUCKETS];
+
+    /* the first LOCKSTAT_CALLERS call sites to contend, and how often each
+     * did. contended acquires from anywhere else are only in |contended| */
+    lockstat_caller_t callers[LOCKSTAT_CALLERS];
+} lockstat_class_t;
+
+#if WITH_LOCK_STATS
+
+/* The class for |key|, created on first use. Classes are never freed, and
+ * once the table is full new keys share a catch-all class. Lock free, so it
+ * is safe with any lock held and from any context. */
+lockstat_class_t *lockstat_class_get(uintptr_t key, const char *name, uint kind);
+
+/* Count an acquire that waited |wait| for the lock, contended or not. */
+void lockstat_acquired(lockstat_class_t *c, bool contended, lk_time_t wait,
+                       uintptr_t caller);
+void lockstat_released(lockstat_class_t *c, lk_time_t hold);
+
+#endif
+
+__END_CDECLS
@@ -72,6 +72,10 @@ struct mp_state {
     mp_cpu_mask_t idle_cpus;
     mp_cpu_mask_t realtime_cpus;
 
+    /* cpus which have been sent a reschedule ipi that they have not taken
+     * yet */
+    volatile mp_cpu_mask_t reschedule_pending;
+
     spin_lock_t ipi_task_lock;
     /* list of outstanding tasks for CPUs to execute.  Should only be
      * accessed with the ipi_task_lock held */
@@ -79,6 +83,12 @@ struct mp_state {
 
     /* lock for serializing CPU hotplug/unplug operations */
     mutex_t hotplug_lock;
+
+    /* per cpu topology, filled in by the platform during boot. each entry
+     * includes the cpu itself. smt_siblings are the cpus sharing a physical
+     * core, cache_siblings the cpus sharing the last level cache. */
+    mp_cpu_mask_t smt_siblings[SMP_MAX_CPUS];
+    mp_cpu_mask_t cache_siblings[SMP_MAX_CPUS];
 };
 
 extern struct mp_state mp;
@@ -138,6 +148,19 @@ static inline mp_cpu_mask_t mp_get_realtime_mask(void)
 {
     return mp.realtime_cpus;
 }
+
+/* record which cpus share a core and a last level cache with cpu */
+void mp_set_cpu_topology(uint cpu, mp_cpu_mask_t smt_siblings, mp_cpu_mask_t cache_siblings);
+
+static inline mp_cpu_mask_t mp_get_smt_siblings(uint cpu)
+{
+    return mp.smt_siblings[cpu];
+}
+
+static inline mp_cpu_mask_t mp_get_cache_siblings(uint cpu)
+{
+    return mp.cache_siblings[cpu];
+}
 #else
 static inline void mp_init(void) {}
 static inline void mp_reschedule(mp_cpu_mask_t target, uint flags) {}
@@ -171,6 +194,11 @@ static inline void mp_set_cpu_non_realtime(uint cpu) {}
 
 static inline mp_cpu_mask_t mp_get_realtime_mask(void) { return 0; }
 
+static inline void mp_set_cpu_topology(uint cpu, mp_cpu_mask_t smt_siblings,
+                                       mp_cpu_mask_t cache_siblings) {}
+static inline mp_cpu_mask_t mp_get_smt_siblings(uint cpu) { return 1; }
+static inline mp_cpu_mask_t mp_get_cache_siblings(uint cpu) { return 1; }
+
 static inline mp_cpu_mask_t mp_get_active_mask(void) { return 1; }
 static inline mp_cpu_mask_t mp_get_online_mask(void) { return 1; }
 #endif
@@ -24,6 +24,12 @@ typedef struct TA_CAP("mutex") mutex {
     thread_t *holder;
     int count;
     wait_queue_t wait;
+#if WITH_LOCK_STATS
+    /* the lock class, see kernel/lockstat.h. looked up on first acquire */
+    const char *lockstat_name;
+    struct lockstat_class *lockstat_class;
+    lk_time_t lockstat_acquired;
+#endif
 } mutex_t;
 
 #define MUTEX_INITIAL_VALUE(m) \
@@ -34,6 +40,21 @@ typedef struct TA_CAP("mutex") mutex {
     .wait = WAIT_QUEUE_INITIAL_VALUE((m).wait), \
 }
 
+/* names the lock class of the mutex for lock statistics, which are counted
+ * per lock rather than per class when it is left out */
+#if WITH_LOCK_STATS
+#define MUTEX_INITIAL_VALUE_NAMED(m, name) \
+{ \
+    .magic = MUTEX_MAGIC, \
+    .holder = NULL, \
+    .count = 0, \
+    .wait = WAIT_QUEUE_INITIAL_VALUE((m).wait), \
+    .lockstat_name = (name), \
+}
+#else
+#define MUTEX_INITIAL_VALUE_NAMED(m, name) MUTEX_INITIAL_VALUE(m)
+#endif
+
 /* Rules for Mutexes:
  * - Mutexes are only safe to use from thread context.
  * - Mutexes are non-recursive.
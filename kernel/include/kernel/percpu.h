@@ -0,0 +1,64 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+#pragma once
+
+#include <limits.h>
+#include <list.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <magenta/compiler.h>
+#include <arch/ops.h>
+#include <kernel/thread.h>
+#include <kernel/timer.h>
+
+__BEGIN_CDECLS;
+
+/* per cpu kernel state, one cache line aligned block per cpu to avoid false sharing */
+struct percpu {
+    /* per cpu run queue and bitmap of non empty priority levels.
+     * protected by THREAD_LOCK */
+    struct list_node run_queue[NUM_PRIORITIES];
+    uint32_t run_queue_bitmap;
+
+    /* number of threads currently sitting in run_queue or deadline_queue */
+    uint run_queue_len;
+
+    /* runnable deadline class threads sorted by absolute deadline, and those
+     * that exhausted their budget sorted by replenishment time.
+     * protected by THREAD_LOCK */
+    struct list_node deadline_queue;
+    struct list_node throttled_queue;
+
+    /* thread currently running on this cpu, written under THREAD_LOCK on
+     * every context switch. may be read without it, but only compared */
+    thread_t *curr_thread;
+
+    /* absolute deadline of the running thread, INFINITE_TIME if it is not in
+     * the deadline class */
+    lk_time_t curr_deadline;
+
+    /* thread woken by a handoff, run next if nothing more important is queued.
+     * always on this cpu's run queue when non NULL. protected by THREAD_LOCK */
+    thread_t *handoff_thread;
+
+    /* fires on budget exhaustion or replenishment, armed for deadline_timer_time */
+    timer_t deadline_timer;
+    lk_time_t deadline_timer_time;
+
+    /* threads whose sched group ran out of quota, and a timer armed for the
+     * earlier of the running thread running out and those being refilled.
+     * protected by THREAD_LOCK */
+    struct list_node group_throttled_queue;
+    timer_t group_timer;
+    lk_time_t group_timer_time;
+} __CPU_ALIGN;
+
+/* make sure the bitmap is large enough to cover our number of priorities */
+static_assert(NUM_PRIORITIES <= sizeof(((struct percpu *)0)->run_queue_bitmap) * CHAR_BIT, "");
+
+extern struct percpu percpu[SMP_MAX_CPUS];
+
+__END_CDECLS;
@@ -0,0 +1,55 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <magenta/compiler.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+__BEGIN_CDECLS
+
+/* Read-copy-update: readers find objects without taking locks or references,
+ * and writers put off freeing what they have unpublished until every reader
+ * that might still see it is done.
+ *
+ * Preemption can't be disabled in this kernel, so read-side critical sections
+ * are counted per cpu, in one of two epochs, rather than inferred from context
+ * switches. They may nest, block and migrate, and may be entered from
+ * interrupt context, but a long one holds up every grace period. */
+
+typedef uint32_t rcu_token_t;
+
+struct rcu_head;
+typedef void (*rcu_callback_t)(struct rcu_head *);
+
+/* embedded in objects freed through rcu_call() */
+typedef struct rcu_head {
+    struct rcu_head *next;
+    rcu_callback_t func;
+} rcu_head_t;
+
+/* Begin a read-side critical section. Pass the result to rcu_read_unlock() to
+ * end it. */
+rcu_token_t rcu_read_lock(void);
+void rcu_read_unlock(rcu_token_t token);
+
+/* Whether a read-side critical section is in progress anywhere. One that
+ * begins after this returns false sees everything unpublished before it was
+ * called. */
+bool rcu_read_active(void);
+
+/* Wait for every read-side critical section in progress to end. Blocks, so
+ * not from interrupt context or inside a critical section. */
+void rcu_synchronize(void);
+
+/* Have |func| called with |head| once every read-side critical section in
+ * progress has ended. Callbacks queued close together share a grace period
+ * and run in a batch on the dpc thread of the cpu they were queued on, so they
+ * must not block for long. Safe from any context. */
+void rcu_call(rcu_head_t *head, rcu_callback_t func);
+
+__END_CDECLS
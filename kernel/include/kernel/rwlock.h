@@ -0,0 +1,67 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#ifndef __KERNEL_RWLOCK_H
+#define __KERNEL_RWLOCK_H
+
+#include <magenta/compiler.h>
+#include <debug.h>
+#include <stdint.h>
+#include <kernel/thread.h>
+
+__BEGIN_CDECLS;
+
+#define RWLOCK_MAGIC (0x72776C6B)  // 'rwlk'
+
+typedef struct rwlock {
+    uint32_t magic;
+    thread_t *writer;
+    int readers;
+    int waiting_writers;
+    wait_queue_t reader_wait;
+    wait_queue_t writer_wait;
+} rwlock_t;
+
+#define RWLOCK_INITIAL_VALUE(l) \
+{ \
+    .magic = RWLOCK_MAGIC, \
+    .writer = NULL, \
+    .readers = 0, \
+    .waiting_writers = 0, \
+    .reader_wait = WAIT_QUEUE_INITIAL_VALUE((l).reader_wait), \
+    .writer_wait = WAIT_QUEUE_INITIAL_VALUE((l).writer_wait), \
+}
+
+/* Rules for reader/writer locks:
+ * - Only safe to use from thread context.
+ * - Any number of readers may hold the lock at once, a writer holds it alone.
+ * - Not recursive in either mode, and a reader may not upgrade to a writer.
+ * - Writers are preferred: once a writer is waiting new readers block, so a
+ *   steady stream of readers can't starve it.
+ */
+void rwlock_init(rwlock_t *l);
+void rwlock_destroy(rwlock_t *l);
+void rwlock_acquire_read(rwlock_t *l);
+void rwlock_release_read(rwlock_t *l);
+void rwlock_acquire_write(rwlock_t *l);
+void rwlock_release_write(rwlock_t *l);
+
+/* does the current thread hold the lock for writing? */
+static inline bool is_rwlock_write_held(const rwlock_t *l)
+{
+    return l->writer == get_current_thread();
+}
+
+/* is the lock held in either mode? readers aren't tracked individually, so
+ * this can only say that some thread holds it for reading. */
+static inline bool is_rwlock_held(const rwlock_t *l)
+{
+    return is_rwlock_write_held(l) || __atomic_load_n(&l->readers, __ATOMIC_RELAXED) > 0;
+}
+
+__END_CDECLS;
+
+#endif
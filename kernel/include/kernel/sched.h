@@ -21,3 +21,15 @@ void sched_unblock_list(struct list_node *list, bool resched);
 
 void sched_yield(void);
 void sched_preempt(void);
+
+/* change the effective priority of a thread, moving it within its run queue if it is ready */
+void sched_set_priority(thread_t *t, int priority);
+
+/* change the scheduling class of a thread, see thread_set_deadline() */
+status_t sched_set_deadline(thread_t *t, const struct thread_deadline_params *params);
+
+/* the time slice a thread gets, base scaled by the weights of its sched groups */
+lk_time_t sched_time_slice(const thread_t *t, lk_time_t base);
+
+/* move all migratable threads queued on old_cpu to the current cpu's run queue */
+void sched_transition_off_cpu(uint old_cpu);
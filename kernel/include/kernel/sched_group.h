@@ -0,0 +1,69 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+#pragma once
+
+#include <err.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <magenta/compiler.h>
+#include <kernel/thread.h>
+
+__BEGIN_CDECLS;
+
+/* weights scale the time slice of a group's threads relative to the default */
+#define SCHED_GROUP_WEIGHT_DEFAULT 100u
+#define SCHED_GROUP_WEIGHT_MAX 10000u
+
+/* the range of quota periods we accept, and the smallest quota */
+#define SCHED_GROUP_MIN_PERIOD LK_MSEC(1)
+#define SCHED_GROUP_MAX_PERIOD LK_SEC(1)
+#define SCHED_GROUP_MIN_QUOTA LK_MSEC(1)
+
+/* a cpu's share of its group's runtime. threads are charged against the share
+ * of the cpu they run on, and the cpu only goes back to the group's pool once
+ * it is used up */
+struct sched_group_cpu {
+    int64_t runtime;     /* left to run on this cpu */
+    uint64_t period_gen; /* period the runtime was handed out in */
+};
+
+/* cpu bandwidth control for a set of threads, such as those of a job. a
+ * group's threads are charged to it and to all of its ancestors, and are held
+ * back until the next period once any of them is out of quota.
+ * protected by THREAD_LOCK */
+struct sched_group {
+    struct sched_group *parent;
+    uint32_t weight;
+
+    /* cpu time the group may use per period, summed over all cpus. unlimited
+     * if quota is 0 */
+    lk_time_t quota;
+    lk_time_t period;
+
+    /* quota of the current period that hasn't been handed to a cpu yet */
+    int64_t pool;
+    lk_time_t period_end;
+    uint64_t period_gen;
+
+    /* number of times one of the group's threads was held back */
+    uint64_t throttle_count;
+
+    struct sched_group_cpu cpu[SMP_MAX_CPUS];
+};
+
+/* set up an unlimited group with the default weight, nested in parent if non NULL */
+void sched_group_init(struct sched_group *g, struct sched_group *parent);
+
+/* change a group's weight and quota, which take effect right away for the
+ * threads already in it. a quota of 0 removes the limit */
+status_t sched_group_set(struct sched_group *g, uint32_t weight,
+                         lk_time_t quota, lk_time_t period);
+
+/* charge a thread that hasn't been resumed yet to a group. the group has to
+ * outlive the thread */
+void thread_set_sched_group(thread_t *t, struct sched_group *g);
+
+__END_CDECLS;
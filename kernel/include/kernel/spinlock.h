@@ -10,25 +10,117 @@
 #include <magenta/compiler.h>
 #include <magenta/thread_annotations.h>
 #include <arch/spinlock.h>
+#include <stdint.h>
 
 __BEGIN_CDECLS
 
+/* A lock is either a plain test-and-set lock, the default, or a fair ticket
+ * lock, picked by how it is initialized. Ticket locks hand themselves over in
+ * the order they were asked for, which bounds how long a waiter can starve
+ * under heavy contention, at the cost of an atomic add per acquire. Waiters on
+ * a ticket lock only read the lock word, and on arm64 sleep in wfe until it
+ * changes.
+ *
+ * A ticket lock word holds SPIN_LOCK_FLAG_TICKET, the next ticket to hand out
+ * above it, and the ticket being served in the low 32 bits. Tickets wrap at
+ * 31 bits, so only the low 31 bits of the served ticket count. */
+#define SPIN_LOCK_FLAG_TICKET           (1ul << 32)
+#define SPIN_LOCK_TICKET_NEXT_SHIFT     33
+#define SPIN_LOCK_TICKET_MASK           0x7ffffffful
+#define SPIN_LOCK_TICKET_INITIAL_VALUE  SPIN_LOCK_FLAG_TICKET
+
+/* out of line slow paths, which count contended acquires */
+void spin_lock_contended(spin_lock_t *lock);
+void spin_lock_ticket_wait(spin_lock_t *lock, uint32_t ticket);
+
+static inline bool spin_lock_is_ticket(spin_lock_t *lock)
+{
+    return (__atomic_load_n(lock, __ATOMIC_RELAXED) & SPIN_LOCK_FLAG_TICKET) != 0;
+}
+
+static inline uint32_t spin_lock_ticket_next(spin_lock_t value)
+{
+    return (uint32_t)(value >> SPIN_LOCK_TICKET_NEXT_SHIFT);
+}
+
+static inline uint32_t spin_lock_ticket_owner(spin_lock_t value)
+{
+    return (uint32_t)value & SPIN_LOCK_TICKET_MASK;
+}
+
+#if WITH_LOCK_STATS
+/* acquire and release through kernel/lockstat.c, which times the lock */
+void lockstat_spin_lock(spin_lock_t *lock);
+void lockstat_spin_locked(spin_lock_t *lock);
+void lockstat_spin_unlock(spin_lock_t *lock);
+#endif
+
+/* the lock operations without statistics */
+static inline void spin_lock_raw(spin_lock_t *lock)
+{
+    if (spin_lock_is_ticket(lock)) {
+        spin_lock_t old = __atomic_fetch_add(lock, 1ul << SPIN_LOCK_TICKET_NEXT_SHIFT,
+                                             __ATOMIC_ACQUIRE);
+        uint32_t ticket = spin_lock_ticket_next(old);
+        if (unlikely(spin_lock_ticket_owner(old) != ticket))
+            spin_lock_ticket_wait(lock, ticket);
+    } else if (unlikely(arch_spin_trylock(lock))) {
+        spin_lock_contended(lock);
+    }
+}
+
+static inline int spin_trylock_raw(spin_lock_t *lock)
+{
+    if (spin_lock_is_ticket(lock)) {
+        spin_lock_t old = __atomic_load_n(lock, __ATOMIC_RELAXED);
+        if (spin_lock_ticket_owner(old) != spin_lock_ticket_next(old))
+            return 1;
+        return !__atomic_compare_exchange_n(lock, &old, old + (1ul << SPIN_LOCK_TICKET_NEXT_SHIFT),
+                                            false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+    }
+    return arch_spin_trylock(lock);
+}
+
+static inline void spin_unlock_raw(spin_lock_t *lock)
+{
+    if (spin_lock_is_ticket(lock)) {
+        /* only the holder writes the served ticket, the low half of the word */
+        uint32_t *owner = (uint32_t *)lock;
+        __atomic_store_n(owner, __atomic_load_n(owner, __ATOMIC_RELAXED) + 1, __ATOMIC_RELEASE);
+    } else {
+        arch_spin_unlock(lock);
+    }
+}
+
 /* interrupts should already be disabled */
 static inline void spin_lock(spin_lock_t *lock)
 {
-    arch_spin_lock(lock);
+#if WITH_LOCK_STATS
+    lockstat_spin_lock(lock);
+#else
+    spin_lock_raw(lock);
+#endif
 }
 
 /* Returns 0 on success, non-0 on failure */
 static inline int spin_trylock(spin_lock_t *lock)
 {
-    return arch_spin_trylock(lock);
+    int ret = spin_trylock_raw(lock);
+#if WITH_LOCK_STATS
+    if (ret == 0)
+        lockstat_spin_locked(lock);
+#endif
+    return ret;
 }
 
 /* interrupts should already be disabled */
 static inline void spin_unlock(spin_lock_t *lock)
 {
-    arch_spin_unlock(lock);
+#if WITH_LOCK_STATS
+    lockstat_spin_unlock(lock);
+#else
+    spin_unlock_raw(lock);
+#endif
 }
 
 static inline void spin_lock_init(spin_lock_t *lock)
@@ -36,8 +128,17 @@ static inline void spin_lock_init(spin_lock_t *lock)
     arch_spin_lock_init(lock);
 }
 
+static inline void spin_lock_init_ticket(spin_lock_t *lock)
+{
+    *lock = SPIN_LOCK_TICKET_INITIAL_VALUE;
+}
+
 static inline bool spin_lock_held(spin_lock_t *lock)
 {
+    if (spin_lock_is_ticket(lock)) {
+        spin_lock_t value = __atomic_load_n(lock, __ATOMIC_RELAXED);
+        return spin_lock_ticket_owner(value) != spin_lock_ticket_next(value);
+    }
     return arch_spin_lock_held(lock);
 }
 
@@ -81,7 +182,15 @@ __END_CDECLS
 #ifdef __cplusplus
 class TA_CAP("mutex") SpinLock {
 public:
+    enum Kind { kPlain, kTicket };
+
     SpinLock()              { spin_lock_init(&spinlock_); }
+    explicit SpinLock(Kind kind) {
+        if (kind == kTicket)
+            spin_lock_init_ticket(&spinlock_);
+        else
+            spin_lock_init(&spinlock_);
+    }
     void Acquire() TA_ACQ() { spin_lock(&spinlock_); }
     void TryAcquire()       { spin_trylock(&spinlock_); }
     void Release() TA_REL() { spin_unlock(&spinlock_); }
@@ -56,6 +56,7 @@ typedef void (*thread_user_callback_t)(enum thread_user_state_change new_state,
 #define THREAD_FLAG_REAL_TIME                 (1<<3)
 #define THREAD_FLAG_IDLE                      (1<<4)
 #define THREAD_FLAG_DEBUG_STACK_BOUNDS_CHECK  (1<<5)
+#define THREAD_FLAG_HANDOFF                   (1<<6)
 
 #define THREAD_SIGNAL_KILL                    (1<<0)
 #define THREAD_SIGNAL_SUSPEND                 (1<<1)
@@ -68,18 +69,73 @@ typedef void (*thread_user_callback_t)(enum thread_user_state_change new_state,
 
 #define THREAD_LINEBUFFER_LENGTH 128
 
+/* thread priority */
+#define NUM_PRIORITIES 32
+#define LOWEST_PRIORITY 0
+#define HIGHEST_PRIORITY (NUM_PRIORITIES - 1)
+#define DPC_PRIORITY (NUM_PRIORITIES - 2)
+#define IDLE_PRIORITY LOWEST_PRIORITY
+#define LOW_PRIORITY (NUM_PRIORITIES / 4)
+#define DEFAULT_PRIORITY (NUM_PRIORITIES / 2)
+#define HIGH_PRIORITY ((NUM_PRIORITIES / 4) * 3)
+
+/* scheduling classes */
+enum thread_sched_class {
+    SCHED_CLASS_PRIORITY = 0, /* strict priority round robin */
+    SCHED_CLASS_DEADLINE,     /* earliest deadline first with a constant bandwidth server */
+};
+
+/* reservation requested by a deadline class thread: up to capacity worth of
+ * cpu time within deadline of every release, releases at most once per period */
+struct thread_deadline_params {
+    lk_time_t capacity;
+    lk_time_t deadline;
+    lk_time_t period;
+};
+
+/* per thread state of the deadline class, protected by THREAD_LOCK */
+struct thread_deadline_state {
+    struct thread_deadline_params params;
+    uint64_t bandwidth;     /* capacity / period, in fixed point */
+    lk_time_t abs_deadline; /* deadline of the current reservation */
+    int64_t remaining;      /* budget left in the current reservation */
+    lk_time_t last_charge;  /* when time was last charged against remaining */
+    bool throttled;         /* out of budget, waiting for abs_deadline to replenish */
+};
+
+struct sched_group;
+
 typedef struct thread {
     int magic;
     struct list_node thread_list_node;
 
     /* active bits */
     struct list_node queue_node;
-    int priority;
+    int priority;       /* effective priority, base_priority raised by inheritance */
+    int base_priority;
+    /* priorities lent by threads blocked on this one, see thread_inherit_priority().
+     * protected by THREAD_LOCK */
+    uint32_t inherited_bitmap;
+    uint16_t inherited_count[NUM_PRIORITIES];
+    /* while blocked acquiring a mutex, the holder it lent its priority to and
+     * the priority lent, see mutex.c. protected by THREAD_LOCK */
+    struct thread *pi_lent_to;
+    int pi_lent_priority;
     enum thread_state state;
     lk_time_t last_started_running;
+    lk_time_t last_stopped_running;
     lk_time_t remaining_time_slice;
     unsigned int flags;
     unsigned int signals;
+    enum thread_sched_class sched_class;
+    struct thread_deadline_state deadline;
+    /* cpu bandwidth group the thread is charged to, NULL if unlimited, when
+     * its time was last charged, and whether it is held back for being out of
+     * quota. protected by THREAD_LOCK */
+    struct sched_group *sched_group;
+    lk_time_t group_last_charge;
+    bool group_throttled;
+    uint run_queue_cpu; /* cpu whose run queue holds the thread while it is ready */
 #if WITH_SMP
     uint last_cpu; /* last/current cpu the thread is running on */
     int pinned_cpu; /* only run on pinned_cpu if >= 0 */
@@ -101,6 +157,17 @@ typedef struct thread {
      * left the scheduler. */
     lk_time_t runtime_ns;
 
+    /* Scheduler accounting, protected by THREAD_LOCK except for page_faults,
+     * which only the thread itself updates.  wait_ns is the total time spent
+     * THREAD_READY but not running, measured from last_woken or from when the
+     * thread was preempted.  A switch away from a thread is involuntary if it
+     * was still runnable. */
+    lk_time_t last_woken;
+    lk_time_t wait_ns;
+    uint64_t voluntary_switches;
+    uint64_t involuntary_switches;
+    uint64_t page_faults;
+
     /* if blocked, a pointer to the wait queue */
     struct wait_queue *blocking_wait_queue;
 
@@ -152,16 +219,6 @@ typedef struct thread {
 #define thread_set_pinned_cpu(t, c) do {} while(0)
 #endif
 
-/* thread priority */
-#define NUM_PRIORITIES 32
-#define LOWEST_PRIORITY 0
-#define HIGHEST_PRIORITY (NUM_PRIORITIES - 1)
-#define DPC_PRIORITY (NUM_PRIORITIES - 2)
-#define IDLE_PRIORITY LOWEST_PRIORITY
-#define LOW_PRIORITY (NUM_PRIORITIES / 4)
-#define DEFAULT_PRIORITY (NUM_PRIORITIES / 2)
-#define HIGH_PRIORITY ((NUM_PRIORITIES / 4) * 3)
-
 /* stack size */
 #ifdef CUSTOM_DEFAULT_STACK_SIZE
 #define DEFAULT_STACK_SIZE CUSTOM_DEFAULT_STACK_SIZE
@@ -179,6 +236,13 @@ void thread_construct_first(thread_t *t, const char *name);
 thread_t *thread_create_idle_thread(uint cpu_num);
 void thread_set_name(const char *name);
 void thread_set_priority(int priority);
+
+/* priority inheritance: until the matching thread_disinherit_priority() call, |t|
+ * runs at no less than |priority|. calls nest and may come from many threads. */
+void thread_inherit_priority(thread_t *t, int priority);
+void thread_disinherit_priority(thread_t *t, int priority);
+void thread_inherit_priority_locked(thread_t *t, int priority);
+void thread_disinherit_priority_locked(thread_t *t, int priority);
 void thread_set_user_callback(thread_t *t, thread_user_callback_t cb);
 thread_t *thread_create(const char *name, thread_start_routine entry, void *arg, int priority, size_t stack_size);
 thread_t *thread_create_etc(thread_t *t, const char *name, thread_start_routine entry, void *arg, int priority, void *stack, void *unsafe_stack, size_t stack_size, thread_trampoline_routine alt_trampoline);
@@ -192,6 +256,11 @@ status_t thread_join(thread_t *t, int *retcode, lk_time_t deadline);
 status_t thread_detach_and_resume(thread_t *t);
 status_t thread_set_real_time(thread_t *t);
 
+/* move a thread into the deadline scheduling class with the given reservation,
+ * or back to the priority class if params is NULL. returns ERR_NO_RESOURCES if
+ * the reservation would oversubscribe the cpus. */
+status_t thread_set_deadline(thread_t *t, const struct thread_deadline_params *params);
+
 void thread_owner_name(thread_t *t, char out_name[THREAD_NAME_LENGTH]);
 
 #define THREAD_BACKTRACE_DEPTH 10
@@ -225,6 +294,18 @@ status_t thread_sleep_relative(lk_time_t delay);
 /* return the number of nanoseconds a thread has been running for */
 lk_time_t thread_runtime(const thread_t *t);
 
+/* scheduler statistics of a thread, including the time it has accrued
+ * running or waiting to run since it was last charged */
+struct thread_sched_stats {
+    lk_time_t runtime;
+    lk_time_t wait_time;
+    uint64_t voluntary_switches;
+    uint64_t involuntary_switches;
+    uint64_t page_faults;
+};
+
+void thread_get_sched_stats(const thread_t *t, struct thread_sched_stats *stats);
+
 /* deliver a kill signal to a thread */
 void thread_kill(thread_t *t, bool block);
 
@@ -246,11 +327,23 @@ void thread_yield(void);             /* give up the cpu and time slice voluntari
 void thread_preempt(bool interrupt); /* get preempted (return to head of queue and reschedule) */
 void thread_resched(void);
 
+/* the next thread the current thread wakes runs on this cpu ahead of its peers,
+ * inheriting the rest of the time slice if the current thread then blocks.
+ * meant for synchronous ipc, where the waker is about to wait for the wakee.
+ * disarm once the wakeup is done in case nothing was woken */
+void thread_handoff_arm(void);
+void thread_handoff_disarm(void);
+
 static inline bool thread_is_realtime(thread_t *t)
 {
     return (t->flags & THREAD_FLAG_REAL_TIME) && t->priority > DEFAULT_PRIORITY;
 }
 
+static inline bool thread_is_deadline(const thread_t *t)
+{
+    return t->sched_class == SCHED_CLASS_DEADLINE;
+}
+
 static inline bool thread_is_idle(thread_t *t)
 {
     return !!(t->flags & THREAD_FLAG_IDLE);
@@ -292,6 +385,14 @@ struct thread_stats {
     ulong irq_preempts;
     ulong preempts;
     ulong yields;
+    ulong steals; /* threads pulled from another cpu's run queue */
+    ulong handoffs; /* threads run directly on the cpu of the thread that woke them */
+    ulong deadline_throttles; /* deadline threads that ran out of budget */
+    lk_time_t deadline_time; /* time spent running deadline class threads */
+    ulong group_throttles; /* threads held back by their group's quota */
+    ulong mutex_spins; /* contended mutex acquires that succeeded without blocking */
+    ulong mutex_blocks; /* contended mutex acquires that had to block */
+    ulong spin_contended; /* spinlock acquires that had to wait */
 
     /* cpu level interrupts and exceptions */
     ulong interrupts; /* hardware interrupts, minus timer interrupts or inter-processor interrupts */
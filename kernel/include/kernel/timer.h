@@ -24,14 +24,21 @@ typedef enum handler_return (*timer_callback)(struct timer *, lk_time_t now, voi
 
 typedef struct timer {
     int magic;
-    struct list_node node;
+
+    /* pairing heap linkage, only valid while queued_cpu >= 0.
+     * heap_prev is the parent for the leftmost child, otherwise the left sibling. */
+    struct timer *heap_child;
+    struct timer *heap_next;
+    struct timer *heap_prev;
 
     lk_time_t scheduled_time;
+    lk_time_t slack;
     lk_time_t period;
 
     timer_callback callback;
     void *arg;
 
+    int queued_cpu;          // <0 if not queued
     volatile int active_cpu; // <0 if inactive
     volatile bool cancel;    // true if cancel is pending
 } timer_t;
@@ -39,11 +46,15 @@ typedef struct timer {
 #define TIMER_INITIAL_VALUE(t) \
 { \
     .magic = TIMER_MAGIC, \
-    .node = LIST_INITIAL_CLEARED_VALUE, \
+    .heap_child = NULL, \
+    .heap_next = NULL, \
+    .heap_prev = NULL, \
     .scheduled_time = 0, \
+    .slack = 0, \
     .period = 0, \
     .callback = NULL, \
     .arg = NULL, \
+    .queued_cpu = -1, \
     .active_cpu = -1, \
     .cancel = false, \
 }
@@ -57,9 +68,27 @@ typedef struct timer {
 */
 void timer_initialize(timer_t *);
 void timer_set_oneshot(timer_t *, lk_time_t deadline, timer_callback, void *arg);
+
+/* like timer_set_oneshot, but the callback may be deferred by up to slack ns past
+ * deadline so that it can be coalesced with other timers into a single interrupt */
+void timer_set_oneshot_etc(timer_t *, lk_time_t deadline, lk_time_t slack,
+                           timer_callback, void *arg);
 void timer_set_periodic(timer_t *, lk_time_t period, timer_callback, void *arg);
 void timer_cancel(timer_t *);
 
+/* the time the current cpu's next timer fires, INFINITE_TIME if none is queued.
+ * must be called with interrupts disabled */
+lk_time_t timer_get_next_deadline(void);
+
+/* keeps *clock at roughly current_time() from then on, for readers that can't
+ * call into the kernel. it is bumped by the timer interrupts and context
+ * switches that happen anyway rather than by a timer of its own, so while a
+ * thread that isn't real time runs it lags by at most a scheduler tick */
+void timer_publish_clock(uint64_t *clock);
+
+/* called with the current time from the timer interrupt and context switches */
+void timer_update_published_clock(lk_time_t now);
+
 void timer_transition_off_cpu(uint old_cpu);
 void timer_thaw_percpu(void);
 
@@ -38,6 +38,12 @@ __BEGIN_CDECLS
 #define ROUNDUP_PAGE_SIZE(x) ROUNDUP((x), PAGE_SIZE)
 #define IS_PAGE_ALIGNED(x) IS_ALIGNED((x), PAGE_SIZE)
 
+/* size of the range one entry in the last level of page tables above the leaf
+ * level covers, which the arch mmu code maps with a single large page (x86) or
+ * block (arm64) when virtual and physical addresses are both aligned to it */
+#define LARGE_PAGE_SIZE_SHIFT (PAGE_SIZE_SHIFT + (PAGE_SIZE_SHIFT - 3))
+#define LARGE_PAGE_SIZE (1UL << LARGE_PAGE_SIZE_SHIFT)
+
 struct mmu_initial_mapping {
     paddr_t phys;
     vaddr_t virt;
@@ -109,9 +115,32 @@ typedef struct pmm_arena_info {
 /* Add a pre-filled memory arena to the physical allocator. */
 status_t pmm_add_arena(const pmm_arena_info_t* arena) __NONNULL((1));
 
+/* NUMA nodes are numbered densely from 0. Without any NUMA information
+ * everything is on node 0. */
+#define PMM_MAX_NUMA_NODES 8
+
+/* Mark the physical range [base, base + size) as local to NUMA node |node|,
+ * splitting arenas that straddle its edges. Only to be called during boot,
+ * before the secondary cpus are started. */
+status_t pmm_set_numa_node(paddr_t base, size_t size, uint node);
+
+/* Tell the allocator which NUMA node |cpu_num| is on. Allocations without a
+ * node policy prefer memory local to the allocating cpu. */
+void pmm_set_cpu_numa_node(uint cpu_num, uint node);
+
+/* The number of NUMA nodes with memory. */
+uint pmm_numa_node_count(void);
+
 /* flags for allocation routines below */
 #define PMM_ALLOC_FLAG_ANY (0x0)  /* no restrictions on which arena to allocate from */
 #define PMM_ALLOC_FLAG_KMAP (0x1) /* allocate only from arenas marked KMAP */
+#define PMM_ALLOC_FLAG_ZEROED (0x2) /* return zero filled pages, pre-zeroed ones if there are any */
+#define PMM_ALLOC_FLAG_INTERLEAVE (0x4) /* spread pages round robin over the NUMA nodes */
+#define PMM_ALLOC_FLAG_NODE_VALID (0x8) /* prefer the NUMA node in PMM_ALLOC_FLAG_NODE_MASK */
+#define PMM_ALLOC_FLAG_NODE_SHIFT (8)
+#define PMM_ALLOC_FLAG_NODE_MASK (0xff << PMM_ALLOC_FLAG_NODE_SHIFT)
+#define PMM_ALLOC_FLAG_NODE(n) \
+    (PMM_ALLOC_FLAG_NODE_VALID | (((uint)(n) << PMM_ALLOC_FLAG_NODE_SHIFT) & PMM_ALLOC_FLAG_NODE_MASK))
 
 /* Allocate count pages of physical memory, adding to the tail of the passed list.
  * The list must be initialized.
@@ -0,0 +1,50 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <err.h>
+#include <kernel/vm.h>
+#include <mxtl/intrusive_wavl_tree.h>
+#include <mxtl/macros.h>
+#include <mxtl/unique_ptr.h>
+#include <stdint.h>
+
+// The contents of one page of an anonymous VmObjectPaged, LZ4 compressed into
+// the kernel heap while the page is cold. The object keeps these in a tree
+// keyed by offset, next to its page list, and a fault at the offset
+// decompresses the page back into a fresh page.
+//
+// All the compressed pages together are capped at a fraction of physical
+// memory, and pages that don't shrink by at least a quarter are turned away.
+class CompressedPage : public mxtl::WAVLTreeContainable<mxtl::unique_ptr<CompressedPage>> {
+public:
+    // Compresses the page at |pa|, which is to live at |offset| in its object.
+    // Returns null if the page doesn't compress well enough, the pool is full
+    // or the heap is out of memory.
+    static mxtl::unique_ptr<CompressedPage> Create(uint64_t offset, paddr_t pa);
+
+    ~CompressedPage();
+
+    // Fills the page at |pa| with the contents the page had when compressed.
+    void Decompress(paddr_t pa) const;
+
+    uint64_t offset() const { return offset_; }
+    uint64_t GetKey() const { return offset_; }
+
+    // True once the pool can't take any more pages, so callers can stop early.
+    static bool PoolFull();
+
+private:
+    CompressedPage(uint64_t offset, uint8_t* data, size_t len)
+        : offset_(offset), data_(data), len_(len) {}
+
+    DISALLOW_COPY_ASSIGN_AND_MOVE(CompressedPage);
+
+    const uint64_t offset_;
+    uint8_t* const data_;
+    const size_t len_;
+};
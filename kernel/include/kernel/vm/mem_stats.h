@@ -0,0 +1,43 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <kernel/vm/page.h>
+#include <magenta/compiler.h>
+#include <stdint.h>
+
+__BEGIN_CDECLS
+
+// Counters of where kernel memory goes. Each cpu adds to its own copy of a
+// counter and readers sum the copies, so keeping one up to date costs an
+// uncontended atomic add.
+enum kmem_stat {
+    // Pages in each vm_page_state, indexed by the state and kept by
+    // vm_page_set_state(). The pmm counts free pages itself.
+    KMEM_STAT_PAGES,
+    // Bytes of paged vmos covered by pins, counted once per pin.
+    KMEM_STAT_PINNED_BYTES = KMEM_STAT_PAGES + _VM_PAGE_STATE_COUNT,
+    // Bytes of physical memory reachable through physical vmos.
+    KMEM_STAT_PHYSICAL_VMO_BYTES,
+    // Pages of anonymous vmos held compressed, and the heap bytes they take.
+    KMEM_STAT_COMPRESSED_PAGES,
+    KMEM_STAT_COMPRESSED_BYTES,
+    // Compressed pages brought back, and pages the compressed store turned
+    // away because they didn't shrink enough or didn't fit.
+    KMEM_STAT_COMPRESSED_HITS,
+    KMEM_STAT_COMPRESSED_MISSES,
+
+    KMEM_STAT_COUNT
+};
+
+void kmem_stat_add(unsigned int stat, int64_t delta);
+
+// Sums a counter over every cpu. Counters that go up on one cpu and down on
+// another are only right in the sum.
+int64_t kmem_stat_read(unsigned int stat);
+
+__END_CDECLS
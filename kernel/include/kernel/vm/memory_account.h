@@ -0,0 +1,108 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <arch/ops.h>
+#include <err.h>
+#include <kernel/mutex.h>
+#include <magenta/thread_annotations.h>
+#include <mxtl/macros.h>
+#include <mxtl/ref_counted.h>
+#include <mxtl/ref_ptr.h>
+#include <stdint.h>
+
+// Counts the pages committed to a set of VMOs, such as those created by the
+// processes of one job, against optional soft and hard limits. Accounts nest:
+// a charge to an account is also a charge to each of its ancestors, and fails
+// if it would take any of them past its hard limit.
+//
+// Page faults charge one page at a time, so each cpu keeps a stock of pages
+// already charged to the shared counters of the account and its ancestors,
+// and serves charges and uncharges from it. The shared counters are only
+// touched once per |kChargeBatch| pages, at the cost of overstating the usage
+// by up to that many pages per cpu. The stocks are given back when a charge
+// would otherwise fail.
+class MemoryAccount : public mxtl::RefCounted<MemoryAccount> {
+public:
+    // Told when the account goes over or back under its soft limit, when a
+    // charge is refused for the account's own hard limit, and when the usage
+    // is back under the soft limit after that, or an eighth under the hard
+    // limit if there is no soft limit.
+    class Observer {
+    public:
+        virtual void OnMemoryLimits(bool over_soft_limit, bool hit_hard_limit) = 0;
+
+    protected:
+        virtual ~Observer() = default;
+    };
+
+    static mxtl::RefPtr<MemoryAccount> Create(mxtl::RefPtr<MemoryAccount> parent);
+    ~MemoryAccount();
+
+    // Charges |pages| to the account and its ancestors. Returns false, leaving
+    // nothing charged, if that would take any of them over its hard limit.
+    bool Charge(size_t pages);
+    void Uncharge(size_t pages);
+
+    // Charges pages that can't be refused, such as those taken over from
+    // another account's object, even past the hard limits.
+    void ChargeOverLimit(size_t pages);
+
+    // Limits in bytes, 0 for none. Setting a hard limit below the current
+    // usage doesn't take anything away, but no more can be charged.
+    void SetLimits(uint64_t soft_limit, uint64_t hard_limit);
+    void GetLimits(uint64_t* soft_limit, uint64_t* hard_limit) const;
+
+    // Bytes charged to the account, including what its descendants charged.
+    uint64_t usage_bytes() const;
+    // Times a charge was refused because of this account's hard limit.
+    uint64_t failed_charges() const;
+
+    // The observer has to clear itself before it goes away.
+    void set_observer(Observer* observer);
+
+private:
+    explicit MemoryAccount(mxtl::RefPtr<MemoryAccount> parent);
+    DISALLOW_COPY_ASSIGN_AND_MOVE(MemoryAccount);
+
+    static constexpr int64_t kChargeBatch = 32;
+
+    // Charges the shared counters of this account and its ancestors, undoing
+    // it all if any goes over its hard limit.
+    bool ChargeShared(int64_t pages);
+    void UnchargeShared(int64_t pages);
+    // Uncharges the shared counter of just this account.
+    void UnchargeOne(int64_t pages);
+
+    // Gives back what every cpu holds in stock.
+    void DrainStocks();
+
+    // Tells the observer if the usage crossed the soft limit, or a charge
+    // was refused.
+    void UpdateLimitState(bool hit_hard_limit);
+
+    const mxtl::RefPtr<MemoryAccount> parent_;
+
+    // Pages charged to the shared counters, and the limits in pages, with
+    // INT64_MAX for none. Accessed atomically.
+    int64_t usage_ = 0;
+    int64_t soft_limit_ = INT64_MAX;
+    int64_t hard_limit_ = INT64_MAX;
+    uint64_t failed_charges_ = 0;
+
+    // Pages each cpu has charged ahead. Accessed atomically, as a thread may
+    // move to another cpu between picking a stock and using it.
+    struct Stock {
+        int64_t pages;
+    } __CPU_ALIGN;
+    Stock stocks_[SMP_MAX_CPUS] = {};
+
+    mutable Mutex observer_lock_;
+    Observer* observer_ TA_GUARDED(observer_lock_) = nullptr;
+    bool over_soft_limit_ TA_GUARDED(observer_lock_) = false;
+    bool hit_hard_limit_ TA_GUARDED(observer_lock_) = false;
+};
@@ -62,6 +62,10 @@ static inline bool page_is_free(const vm_page_t* page) {
     return page->state == VM_PAGE_STATE_FREE;
 }
 
+// Moves |page| to |state|, keeping the per-state page counts up to date.
+// Every change of state should go through here.
+void vm_page_set_state(vm_page_t* page, enum vm_page_state state);
+
 const char* page_state_to_string(unsigned int state);
 void dump_page(const vm_page_t* page);
 
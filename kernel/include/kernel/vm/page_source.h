@@ -0,0 +1,38 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <err.h>
+#include <mxtl/ref_counted.h>
+#include <stdint.h>
+
+// Provides the pages of a VmObjectPaged whose contents live somewhere other
+// than memory, such as in a file. Faulting on a page the object doesn't hold
+// asks the source for it instead of zero filling it, and the fault then
+// waits until the page is put in the object with VmObject::SupplyPages().
+class PageSource : public mxtl::RefCounted<PageSource> {
+public:
+    virtual ~PageSource() = default;
+
+    // Asks for the page at |offset| in the object. Called with the object's
+    // lock held, so it must not wait on the pager or call back into the
+    // object. Returns
+    // an error if the source can't supply pages any more.
+    virtual status_t RequestPage(uint64_t offset) = 0;
+};
+
+// Threads waiting for pages sleep until any pages are supplied, and then
+// look again. Read the generation before looking for the page, so that a
+// supply landing in between isn't missed.
+uint64_t vm_page_supply_generation();
+
+// Blocks until pages have been supplied since |generation| was read. Returns
+// ERR_INTERRUPTED if the thread is killed or suspended while waiting.
+status_t vm_page_supply_wait(uint64_t generation);
+
+// Wakes up the threads waiting for pages.
+void vm_page_supply_notify();
@@ -41,6 +41,10 @@
 // with execute permissions.  When on a VmMapping, controls whether or not the
 // mapping can gain this permission.
 #define VMAR_FLAG_CAN_MAP_EXECUTE (1 << 6)
+// When a VmMapping takes a page fault, also fault in the following pages of
+// the mapping.  VmMappings and subregions inherit this flag from the region
+// they are created in.
+#define VMAR_FLAG_FAULT_AROUND (1 << 7)
 
 #define VMAR_CAN_RWX_FLAGS (VMAR_FLAG_CAN_MAP_READ |  \
                             VMAR_FLAG_CAN_MAP_WRITE | \
@@ -198,6 +202,34 @@ protected:
     // node for element in list of parent's children.
     mxtl::WAVLTreeNodeState<mxtl::RefPtr<VmAddressRegionOrMapping>, bool> subregion_list_node_;
 
+    // Keeps the subtree_* summaries below up to date as the parent's list of
+    // children changes shape.
+    struct WAVLTreeObserver : public mxtl::tests::intrusive_containers::DefaultWAVLTreeObserver {
+        static constexpr bool kRecordSubtreeChanges = true;
+        static void RecordSubtreeChanged(VmAddressRegionOrMapping* node) {
+            node->UpdateSubtreeGaps();
+        }
+    };
+
+    // children of this node in the parent's list, nullptr if there are none
+    VmAddressRegionOrMapping* subtree_left() const;
+    VmAddressRegionOrMapping* subtree_right() const;
+
+    // Recompute the subtree_* summaries from our own range and those of our
+    // children.  UpdateSubtreeGapsToRoot() also recomputes all of our
+    // ancestors, for when our range changes while we are in the list.
+    void UpdateSubtreeGaps();
+    void UpdateSubtreeGapsToRoot();
+
+    // Summary of the subtree of the parent's list of children rooted at this
+    // node: the range it spans and the largest and total size of the gaps
+    // between the children in it.  Lets the spot allocators skip whole
+    // subtrees without a big enough gap, and pick a gap at random, in O(log n).
+    vaddr_t subtree_first_byte_ = 0;
+    vaddr_t subtree_last_byte_ = 0;
+    size_t subtree_max_gap_ = 0;
+    size_t subtree_gap_bytes_ = 0;
+
     char name_[32];
 };
 
@@ -260,7 +292,7 @@ protected:
 private:
     using ChildList = mxtl::WAVLTree<vaddr_t, mxtl::RefPtr<VmAddressRegionOrMapping>,
                                      mxtl::DefaultKeyedObjectTraits<vaddr_t, VmAddressRegionOrMapping>,
-                                     WAVLTreeTraits>;
+                                     WAVLTreeTraits, WAVLTreeObserver>;
 
     DISALLOW_COPY_ASSIGN_AND_MOVE(VmAddressRegion);
 
@@ -323,9 +355,31 @@ private:
     // Utility for allocators for iterating over gaps between allocations
     // F should have a signature of bool func(vaddr_t gap_base, size_t gap_size).
     // If func returns false, the iteration stops.  gap_base will be aligned in
-    // accordance with align_pow2.
+    // accordance with align_pow2.  Gaps smaller than min_size before
+    // alignment may be skipped.
+    template <typename F>
+    void ForEachGap(F func, uint8_t align_pow2, size_t min_size);
+
+    // Call func(gap_base, gap_size, next) in address order on the gaps of at
+    // least min_size bytes between the children in the subtree rooted at
+    // node, where next is the child right after the gap.  Stops and returns
+    // false as soon as func does.
     template <typename F>
-    void ForEachGap(F func, uint8_t align_pow2);
+    bool ForEachSubtreeGapLocked(VmAddressRegionOrMapping* node, size_t min_size, F& func);
+
+    // Find the gap between children holding byte *offset_inout of the free
+    // space between the children, counting from the lowest gap.  Returns the
+    // gap's range in gap_base/gap_size, and the offset into it in
+    // *offset_inout.
+    void FindGapByOffsetLocked(size_t* offset_inout, vaddr_t* gap_base, size_t* gap_size);
+
+    // root of subregions_, nullptr if it is empty
+    VmAddressRegionOrMapping* SubregionRootLocked();
+
+    // Free space in front of the first child and after the last one; the
+    // whole region counts as the leading gap if there are no children.
+    size_t LeadingGapLocked();
+    size_t TrailingGapLocked();
 
     // list of subregions, indexed by base address
     ChildList subregions_;
@@ -467,11 +521,22 @@ private:
     // Implementation for Protect().  This does not acquire the aspace lock.
     status_t ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_flags);
 
+    // Shrink the mapping in place, keeping its base.
+    void SetSizeLocked(size_t size);
+
     // Version of AllocatedPages() that does not acquire the aspace lock
     size_t AllocatedPagesLocked() const override;
 
     void Activate() override;
 
+    // Map the LARGE_PAGE_SIZE block containing |va| with a single large page if
+    // this mapping covers all of it and the object backs it with a suitable run.
+    bool MapLargePageLocked(vaddr_t va);
+
+    // Fault in and map the pages following |va| after it has been faulted in,
+    // if this mapping was created with VMAR_FLAG_FAULT_AROUND.
+    void FaultAroundLocked(vaddr_t va, uint pf_flags, uint mmu_flags);
+
     // Version of Activate that does not take the object_ lock.
     // Should be annotated TA_REQ(object_->lock()), but due to limitations
     // in Clang around capability aliasing, we need to relax the analysis.
@@ -9,6 +9,7 @@
 #include <arch/mmu.h>
 #include <assert.h>
 #include <kernel/mutex.h>
+#include <kernel/rwlock.h>
 #include <kernel/vm.h>
 #include <kernel/vm/vm_address_region.h>
 #include <lib/crypto/prng.h>
@@ -117,11 +118,19 @@ public:
 
 protected:
     // Share the aspace lock with VmAddressRegion/VmMapping so they can serialize
-    // changes to the aspace.
+    // changes to the aspace.  Changes to the vmar tree take it for writing;
+    // page faults and other operations that leave the tree alone take it for
+    // reading, so faults on different mappings can run in parallel.
     friend class VmAddressRegionOrMapping;
     friend class VmAddressRegion;
     friend class VmMapping;
-    mutex_t* lock() { return &lock_; }
+    rwlock_t* lock() { return &lock_; }
+
+    // Serializes changes to the page tables by threads that don't hold lock()
+    // for writing: faults under the shared lock and vmos unmapping a range of
+    // their mappings.  Acquired after the vmo lock, and held only across the
+    // arch_mmu calls.
+    mutex_t* pt_lock() { return &pt_lock_; }
 
     // Expose the PRNG for ASLR to VmAddressRegion
     crypto::PRNG& AslrPrng() {
@@ -156,7 +165,8 @@ private:
     bool aspace_destroyed_ = false;
     bool aslr_enabled_ = false;
 
-    mutable mutex_t lock_ = MUTEX_INITIAL_VALUE(lock_);
+    mutable rwlock_t lock_ = RWLOCK_INITIAL_VALUE(lock_);
+    mutex_t pt_lock_ = MUTEX_INITIAL_VALUE(pt_lock_);
 
     // root of virtual address space
     // Access to this reference is guarded by lock_.
@@ -21,6 +21,7 @@
 #include <mxtl/ref_ptr.h>
 #include <stdint.h>
 
+class MemoryAccount;
 class VmMapping;
 
 typedef status_t (*vmo_lookup_fn_t)(void* context, size_t offset, size_t index, paddr_t pa);
@@ -44,6 +45,12 @@ public:
     virtual size_t AllocatedPagesInRange(uint64_t offset, uint64_t len) const {
         return 0;
     }
+    // Returns the number of physical pages in the range that the object does
+    // not hold itself but reads through to from a copy-on-write parent, and so
+    // shares with it and any other clones.
+    virtual size_t SharedPagesInRange(uint64_t offset, uint64_t len) const {
+        return 0;
+    }
     // Returns the number of physical pages currently allocated to the object.
     size_t AllocatedPages() const {
         return AllocatedPagesInRange(0, size());
@@ -116,6 +123,85 @@ public:
         return ERR_NOT_SUPPORTED;
     }
 
+    // move the pages backing the page-aligned range [offset, offset + len) to |dest| at the
+    // page-aligned |dest_offset|, replacing whatever dest had there. Every page in the range
+    // must be committed in this vmo itself and the vmo must not have clones, otherwise
+    // ERR_NOT_SUPPORTED is returned and nothing is moved. Afterwards the source range reads
+    // as zeros. |moved| may come back short of len if dest runs out of memory for its page
+    // list, in which case the rest of the range is left in place.
+    // One of the two vmos must not be reachable by any other thread, because both locks are
+    // held at once.
+    virtual status_t MovePages(uint64_t offset, uint64_t len, VmObject* dest,
+                               uint64_t dest_offset, uint64_t* moved) {
+        return ERR_NOT_SUPPORTED;
+    }
+
+    // copy the range [offset, offset + len) into |dest| at |dest_offset| page by page
+    // through the kernel's physical mapping, without either object being mapped. Whole
+    // aligned pages that dest doesn't hold yet are filled directly rather than zeroed
+    // first. Uncommitted source pages copy as zeros. |copied| reports how far it got.
+    virtual status_t CopyRange(uint64_t offset, uint64_t len, VmObject* dest,
+                               uint64_t dest_offset, uint64_t* copied) {
+        return ERR_NOT_SUPPORTED;
+    }
+
+    // for objects created with a PageSource: take the pages backing the page-aligned range
+    // [src_offset, src_offset + len) of |src| and put them in this object at |offset|, where
+    // it doesn't hold pages already. the rest are freed. the same rules as for MovePages()
+    // apply to |src|, which reads as zeros afterwards. threads waiting for the pages are
+    // woken up.
+    virtual status_t SupplyPages(uint64_t offset, uint64_t len, VmObject* src,
+                                 uint64_t src_offset) {
+        return ERR_NOT_SUPPORTED;
+    }
+
+    // keep the pages of a discardable object from being discarded until the matching
+    // UnlockDiscardable(). locks nest. |was_discarded| reports whether the pages were
+    // thrown away, leaving the object zero filled, since it was last locked.
+    // ERR_NOT_SUPPORTED unless the object was created discardable.
+    virtual status_t LockDiscardable(bool* was_discarded) {
+        return ERR_NOT_SUPPORTED;
+    }
+    // ERR_BAD_STATE if the object isn't locked
+    virtual status_t UnlockDiscardable() {
+        return ERR_NOT_SUPPORTED;
+    }
+
+    // commit the range [offset, offset + len) and keep its pages where they are, so
+    // their physical addresses can be handed to devices, until the matching Unpin()
+    // of the same range. |lookup_fn| is called with the address of each page like
+    // Lookup(). pins nest and may overlap. while any pin covers a page it can't be
+    // decommitted, resized away or moved, which fail with ERR_BAD_STATE instead.
+    virtual status_t Pin(uint64_t offset, uint64_t len,
+                         vmo_lookup_fn_t lookup_fn, void* context) {
+        return ERR_NOT_SUPPORTED;
+    }
+    // ERR_NOT_FOUND if no Pin() was made of exactly this range
+    virtual status_t Unpin(uint64_t offset, uint64_t len) {
+        return ERR_NOT_SUPPORTED;
+    }
+
+    // set the cache policy, one of ARCH_MMU_FLAG_CACHED and friends, used by mappings
+    // of the object that don't ask for a policy of their own. ERR_BAD_STATE if the
+    // object is mapped, since all mappings of a page must agree.
+    virtual status_t SetMappingCachePolicy(uint32_t cache_policy) {
+        return ERR_NOT_SUPPORTED;
+    }
+    uint32_t GetMappingCachePolicyLocked() const TA_REQ(lock_) { return cache_policy_; }
+
+    // charge the pages the object commits to |account| from now on. ERR_BAD_STATE
+    // if the object already has pages, which would be uncharged without ever
+    // having been charged.
+    virtual status_t SetMemoryAccount(mxtl::RefPtr<MemoryAccount> account) {
+        return ERR_NOT_SUPPORTED;
+    }
+
+    // true for VmObjectPaged, the only type pages can be moved between
+    virtual bool is_paged() const { return false; }
+
+    // true if faults on missing pages go to a PageSource, here or in a parent
+    virtual bool is_pager_backed() const TA_REQ(lock_) { return false; }
+
     // get a pointer to the page structure and/or physical address at the specified offset.
     // valid flags are VMM_PF_FLAG_*
     virtual status_t GetPageLocked(uint64_t offset, uint pf_flags,
@@ -123,6 +209,14 @@ public:
         return ERR_NOT_SUPPORTED;
     }
 
+    // get the physical address of a run of pages backing [offset, offset + LARGE_PAGE_SIZE)
+    // that is contiguous, aligned to LARGE_PAGE_SIZE and can be mapped writable without a
+    // fault, so the whole range can be mapped with one large page. |offset| must be
+    // aligned to LARGE_PAGE_SIZE. Returns ERR_NOT_FOUND if the range isn't backed that way.
+    virtual status_t GetLargePageLocked(uint64_t offset, paddr_t* pa) TA_REQ(lock_) {
+        return ERR_NOT_SUPPORTED;
+    }
+
     Mutex* lock() TA_RET_CAP(lock_) { return &lock_; }
     Mutex& lock_ref() TA_RET_CAP(lock_) { return lock_; }
 
@@ -173,4 +267,7 @@ protected:
 
     // parent pointer (may be null)
     mxtl::RefPtr<VmObject> parent_ TA_GUARDED(lock_);
+
+    // ARCH_MMU_FLAG_CACHE_MASK bits applied to mappings, see SetMappingCachePolicy()
+    uint32_t cache_policy_ TA_GUARDED(lock_) = ARCH_MMU_FLAG_CACHED;
 };
@@ -9,6 +9,8 @@
 #include <assert.h>
 #include <kernel/mutex.h>
 #include <kernel/vm.h>
+#include <kernel/vm/compressed_page.h>
+#include <kernel/vm/page_source.h>
 #include <kernel/vm/vm_object.h>
 #include <kernel/vm/vm_page_list.h>
 #include <lib/user_copy/user_ptr.h>
@@ -17,9 +19,11 @@
 #include <mxtl/array.h>
 #include <mxtl/canary.h>
 #include <mxtl/intrusive_double_list.h>
+#include <mxtl/intrusive_wavl_tree.h>
 #include <mxtl/macros.h>
 #include <mxtl/ref_counted.h>
 #include <mxtl/ref_ptr.h>
+#include <mxtl/vector.h>
 #include <stdint.h>
 
 // the main VM object type, holding a list of pages
@@ -27,8 +31,21 @@ class VmObjectPaged final : public VmObject {
 public:
     static mxtl::RefPtr<VmObject> Create(uint32_t pmm_alloc_flags, uint64_t size);
 
+    // create an object whose pages the kernel may discard under memory pressure
+    // whenever it isn't locked, see LockDiscardable()
+    static mxtl::RefPtr<VmObject> CreateDiscardable(uint32_t pmm_alloc_flags, uint64_t size);
+
+    // create an anonymous object whose cold pages the kernel may compress under
+    // memory pressure, see CompressCold()
+    static mxtl::RefPtr<VmObject> CreateCompressible(uint32_t pmm_alloc_flags, uint64_t size);
+
     static mxtl::RefPtr<VmObject> CreateFromROData(const void* data, size_t size);
 
+    // create an object whose missing pages are asked of |source| when faulted
+    // on, see PageSource
+    static mxtl::RefPtr<VmObject> CreateWithPageSource(uint32_t pmm_alloc_flags, uint64_t size,
+                                                       mxtl::RefPtr<PageSource> source);
+
     status_t Resize(uint64_t size) override;
     status_t ResizeLocked(uint64_t size) override TA_REQ(lock_);
     uint64_t size() const override
@@ -37,6 +54,7 @@ public:
         TA_NO_THREAD_SAFETY_ANALYSIS { return size_; }
 
     size_t AllocatedPagesInRange(uint64_t offset, uint64_t len) const override;
+    size_t SharedPagesInRange(uint64_t offset, uint64_t len) const override;
 
     status_t CommitRange(uint64_t offset, uint64_t len, uint64_t* committed) override;
     status_t CommitRangeContiguous(uint64_t offset, uint64_t len, uint64_t* committed,
@@ -67,11 +85,52 @@ public:
         // Calls a Locked method of the parent, which confuses analysis.
         TA_NO_THREAD_SAFETY_ANALYSIS;
 
+    status_t GetLargePageLocked(uint64_t offset, paddr_t* pa) override TA_REQ(lock_);
+
     status_t CloneCOW(uint64_t offset, uint64_t size,
                       mxtl::RefPtr<VmObject>* clone_vmo) override
         // Calls a Locked method of the child, which confuses analysis.
         TA_NO_THREAD_SAFETY_ANALYSIS;
 
+    status_t MovePages(uint64_t offset, uint64_t len, VmObject* dest, uint64_t dest_offset,
+                       uint64_t* moved) override
+        // Holds the locks of two objects, which confuses analysis.
+        TA_NO_THREAD_SAFETY_ANALYSIS;
+
+    status_t CopyRange(uint64_t offset, uint64_t len, VmObject* dest, uint64_t dest_offset,
+                       uint64_t* copied) override
+        // Holds the locks of two objects, which confuses analysis.
+        TA_NO_THREAD_SAFETY_ANALYSIS;
+
+    status_t SupplyPages(uint64_t offset, uint64_t len, VmObject* src,
+                         uint64_t src_offset) override
+        // Holds the locks of two objects, which confuses analysis.
+        TA_NO_THREAD_SAFETY_ANALYSIS;
+
+    status_t LockDiscardable(bool* was_discarded) override;
+    status_t UnlockDiscardable() override;
+
+    status_t Pin(uint64_t offset, uint64_t len,
+                 vmo_lookup_fn_t lookup_fn, void* context) override;
+    status_t SetMappingCachePolicy(uint32_t cache_policy) override;
+    status_t SetMemoryAccount(mxtl::RefPtr<MemoryAccount> account) override;
+    status_t Unpin(uint64_t offset, uint64_t len) override;
+
+    bool is_paged() const override { return true; }
+    bool is_pager_backed() const override
+        // Reaches into the parent, which confuses analysis.
+        TA_NO_THREAD_SAFETY_ANALYSIS;
+
+    // discard unlocked discardable objects, least recently unlocked first, until
+    // |target| pages have been freed or there are none left. objects touched since
+    // they were last passed over get a second chance. returns the pages freed.
+    static size_t ReclaimDiscardable(size_t target);
+
+    // compress the pages of compressible objects that went untouched since the
+    // reclaimer last unmapped them, until |target| pages have been freed or every
+    // object has been looked at once. returns the pages freed.
+    static size_t CompressCold(size_t target);
+
     void RangeChangeUpdateFromParentLocked(uint64_t offset, uint64_t len) override
         // Called under the parent's lock, which confuses analysis.
         TA_NO_THREAD_SAFETY_ANALYSIS;
@@ -80,6 +139,16 @@ private:
     // private constructor (use Create())
     explicit VmObjectPaged(uint32_t pmm_alloc_flags, mxtl::RefPtr<VmObject> parent);
 
+    // Traits to belong to the list of discard candidates.
+    struct ReclaimListTraits {
+        static mxtl::DoublyLinkedListNodeState<VmObjectPaged*>& node_state(VmObjectPaged& obj) {
+            return obj.reclaim_node_;
+        }
+    };
+    using ReclaimList = mxtl::DoublyLinkedList<VmObjectPaged*, ReclaimListTraits>;
+
+    using CompressedPageTree = mxtl::WAVLTree<uint64_t, mxtl::unique_ptr<CompressedPage>>;
+
     // private destructor, only called from refptr
     ~VmObjectPaged() override;
     friend mxtl::RefPtr<VmObjectPaged>;
@@ -104,18 +173,102 @@ private:
     template <typename T>
     status_t ReadWriteInternal(uint64_t offset, size_t len, size_t* bytes_copied, bool write,
                                T copyfunc);
+    template <typename T>
+    status_t ReadWriteChunk(uint64_t offset, size_t len, size_t pos, size_t* bytes_copied,
+                            bool write, T copyfunc);
+
+    // GetPageLocked() without folding dead parents in first, for use while
+    // walking page_list_
+    status_t GetPageInternalLocked(uint64_t offset, uint pf_flags, vm_page_t**, paddr_t*)
+        TA_NO_THREAD_SAFETY_ANALYSIS;
+
+    // fill |p| with a copy of the parent's page at |offset|, if the parent
+    // chain has one. returns false when there was nothing to copy.
+    bool CopyParentPageLocked(vm_page_t* p, uint64_t offset)
+        // Calls a Locked method of the parent, which confuses analysis.
+        TA_NO_THREAD_SAFETY_ANALYSIS;
+
+    // number of pages in the page aligned range [offset, end) which faults
+    // would find, either held by us or shown through from the parent chain
+    size_t VisiblePagesInRangeLocked(uint64_t offset, uint64_t end) const
+        // Reaches into the parent, which confuses analysis.
+        TA_NO_THREAD_SAFETY_ANALYSIS;
 
     // set our offset within our parent
     status_t SetParentOffsetLocked(uint64_t o) TA_REQ(lock_);
 
+    // fold any parents that only we are keeping alive into ourselves, so
+    // faults don't have to walk through them
+    void CollapseParentsLocked()
+        // Reaches into the parent, which confuses analysis.
+        TA_NO_THREAD_SAFETY_ANALYSIS;
+
+    // true if a pin covers any page in the page aligned range [start, end)
+    bool IsPinnedLocked(uint64_t start, uint64_t end) const TA_REQ(lock_);
+
+    // free every page of a discardable object, returning how many there were
+    size_t DiscardLocked() TA_REQ(lock_);
+
+    // compress up to |target| of the pages of a compressible object, returning
+    // how many pages were freed
+    size_t CompressLocked(size_t target) TA_REQ(lock_);
+
+    // bring back the compressed pages in the page aligned range [start, end)
+    status_t DecompressRangeLocked(uint64_t start, uint64_t end) TA_REQ(lock_);
+
+    // throw away the compressed pages in the page aligned range [start, end)
+    void FreeCompressedLocked(uint64_t start, uint64_t end) TA_REQ(lock_);
+
     // maximum size of a VMO is one page less than the full 64bit range
     static const uint64_t MAX_SIZE = ROUNDDOWN(UINT64_MAX, PAGE_SIZE);
 
     // members
     uint64_t size_ TA_GUARDED(lock_) = 0;
     uint64_t parent_offset_ TA_GUARDED(lock_) = 0;
+    // only offsets below this are looked up in the parent. starts out unlimited,
+    // and picks up the bounds of any parents folded into us.
+    uint64_t parent_limit_ TA_GUARDED(lock_) = UINT64_MAX;
     uint32_t pmm_alloc_flags_ TA_GUARDED(lock_) = PMM_ALLOC_FLAG_ANY;
 
+    // what the pages in |page_list_| are charged to, if anything. set before
+    // the first page comes in and kept until the destructor has freed them.
+    mxtl::RefPtr<MemoryAccount> account_ TA_GUARDED(lock_);
+
     // a tree of pages
     VmPageList page_list_ TA_GUARDED(lock_);
+
+    // pages taken out of |page_list_| and kept compressed. an offset is never in both.
+    CompressedPageTree compressed_ TA_GUARDED(lock_);
+
+    // Unlocked discardable objects sit on |reclaim_list_| in the order they were
+    // unlocked, making it an inactive list with the locked objects as the active
+    // set. Compressible objects sit on |compress_list_| for as long as they live,
+    // through the same node since no object is both. |reclaim_lock_| is taken
+    // before the lock of any object on either list.
+    static Mutex reclaim_lock_;
+    static ReclaimList reclaim_list_ TA_GUARDED(reclaim_lock_);
+    static ReclaimList compress_list_ TA_GUARDED(reclaim_lock_);
+    mxtl::DoublyLinkedListNodeState<VmObjectPaged*> reclaim_node_ TA_GUARDED(reclaim_lock_);
+
+    // the page aligned ranges held by Pin(), one entry per call
+    struct PinnedRange {
+        uint64_t start;
+        uint64_t end;
+    };
+    mxtl::Vector<PinnedRange> pinned_ranges_ TA_GUARDED(lock_);
+
+    // where missing pages come from instead of being zero filled, if anywhere
+    mxtl::RefPtr<PageSource> page_source_;
+
+    bool discardable_ = false;
+    uint32_t discardable_lock_count_ TA_GUARDED(lock_) = 0;
+    // the pages were thrown away since the last LockDiscardable()
+    bool discarded_ TA_GUARDED(lock_) = false;
+    // the pages were used since the reclaimer last passed over the object
+    bool accessed_ TA_GUARDED(lock_) = false;
+
+    bool compressible_ = false;
+    // the reclaimer unmapped the object so that any use of it since shows up
+    // in |accessed_|
+    bool compress_armed_ TA_GUARDED(lock_) = false;
 };
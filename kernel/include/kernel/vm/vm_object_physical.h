@@ -33,6 +33,9 @@ public:
 
     status_t GetPageLocked(uint64_t offset, uint pf_flags,
                            vm_page_t**, paddr_t* pa) override TA_REQ(lock_);
+    status_t GetLargePageLocked(uint64_t offset, paddr_t* pa) override TA_REQ(lock_);
+
+    status_t SetMappingCachePolicy(uint32_t cache_policy) override;
 
 private:
     // private constructor (use Create())
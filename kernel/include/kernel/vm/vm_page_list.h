@@ -6,63 +6,48 @@
 
 #pragma once
 
+#include <arch/defines.h>
+#include <err.h>
+#include <list.h>
 #include <mxtl/canary.h>
-#include <mxtl/intrusive_wavl_tree.h>
 #include <mxtl/macros.h>
-#include <mxtl/unique_ptr.h>
+#include <stdint.h>
+#include <sys/types.h>
 
 struct vm_page;
+class MemoryAccount;
 
-class VmPageListNode final : public mxtl::WAVLTreeContainable<mxtl::unique_ptr<VmPageListNode>> {
+// A node of the radix tree backing VmPageList. Nodes have the same geometry
+// as a page table, one page worth of pointers. Leaves hold the pages
+// themselves, every other level holds the next level down.
+class VmPageListNode final {
 public:
-    explicit VmPageListNode(uint64_t offset);
+    VmPageListNode();
     ~VmPageListNode();
 
     DISALLOW_COPY_ASSIGN_AND_MOVE(VmPageListNode);
 
-    static const size_t kPageFanOut = 16;
+    static const uint kFanOutShift = PAGE_SIZE_SHIFT - 3;
+    static const size_t kPageFanOut = 1UL << kFanOutShift;
 
-    // accessors
-    uint64_t offset() const { return obj_offset_; }
-    uint64_t GetKey() const { return obj_offset_; }
+    bool IsEmpty() const { return count_ == 0; }
 
-    // for every valid page in the node call the passed in function
-    template <typename T>
-    void ForEveryPage(T func) {
-        for (size_t i = 0; i < kPageFanOut; i++) {
-            if (pages_[i]) {
-                func(pages_[i], obj_offset_ + i * PAGE_SIZE);
-            }
-        }
-    }
-
-    // for every valid page in the node call the passed in function
-    template <typename T>
-    void ForEveryPage(T func) const {
-        for (size_t i = 0; i < kPageFanOut; i++) {
-            if (pages_[i]) {
-                func(pages_[i], obj_offset_ + i * PAGE_SIZE);
-            }
-        }
-    }
-
-    vm_page* GetPage(size_t index);
-    vm_page* RemovePage(size_t index);
-    status_t AddPage(vm_page* p, size_t index);
+private:
+    friend class VmPageList;
 
-    bool IsEmpty() const {
-        for (const auto p : pages_) {
-            if (p)
-                return false;
-        }
-        return true;
-    }
+    union Slot {
+        vm_page* page;
+        VmPageListNode* node;
+    };
 
-private:
     mxtl::Canary<mxtl::magic("PLST")> canary_;
 
-    uint64_t obj_offset_ = 0;
-    vm_page* pages_[kPageFanOut] = {};
+    // number of non null slots
+    uint16_t count_ = 0;
+    // number of pages anywhere below this node, so that counting a range
+    // needn't visit the subtrees it covers entirely
+    size_t pages_ = 0;
+    Slot slots_[kPageFanOut] = {};
 };
 
 class VmPageList final {
@@ -72,27 +57,145 @@ public:
 
     DISALLOW_COPY_ASSIGN_AND_MOVE(VmPageList);
 
-    // walk the page tree, calling the passed in function on every tree node
+    // charge the pages added to the list to |account| from now on, and
+    // uncharge them as they are removed. the owner keeps the account alive.
+    void set_account(MemoryAccount* account) { account_ = account; }
+
+    // walk the page tree in offset order, calling the passed in function on every page
     template <typename T>
     void ForEveryPage(T per_page_func) {
-        for (auto& pl : list_) {
-            pl.ForEveryPage(per_page_func);
-        }
+        auto func = [&per_page_func](vm_page*& p, uint64_t offset) -> status_t {
+            per_page_func(p, offset);
+            return NO_ERROR;
+        };
+        ForEveryPageInIndexRange(root_, height_, 0, UINT64_MAX, func);
     }
 
-    // walk the page tree, calling the passed in function on every tree node
+    // walk the page tree in offset order, calling the passed in function on every page
     template <typename T>
     void ForEveryPage(T per_page_func) const {
-        for (auto& pl : list_) {
-            pl.ForEveryPage(per_page_func);
-        }
+        auto func = [&per_page_func](vm_page* const& p, uint64_t offset) -> status_t {
+            per_page_func(p, offset);
+            return NO_ERROR;
+        };
+        ForEveryPageInIndexRange<const VmPageListNode>(root_, height_, 0, UINT64_MAX, func);
+    }
+
+    // call per_page_func(page, offset) on every page with an offset in
+    // [start_offset, end_offset), in offset order. stops at and returns the
+    // first status other than NO_ERROR. the function must not add or remove pages.
+    template <typename T>
+    status_t ForEveryPageInRange(T per_page_func, uint64_t start_offset, uint64_t end_offset) {
+        return ForEveryPageInIndexRange(root_, height_, OffsetToIndex(start_offset),
+                                        OffsetToIndex(end_offset), per_page_func);
+    }
+
+    template <typename T>
+    status_t ForEveryPageInRange(T per_page_func, uint64_t start_offset,
+                                 uint64_t end_offset) const {
+        return ForEveryPageInIndexRange<const VmPageListNode>(
+            root_, height_, OffsetToIndex(start_offset), OffsetToIndex(end_offset), per_page_func);
+    }
+
+    // like ForEveryPageInRange, but also calls per_gap_func(gap_start, gap_end)
+    // on every page aligned run in the range without pages, in order with the
+    // pages. per_gap_func may add pages inside the gap it was handed.
+    template <typename PAGE_FUNC, typename GAP_FUNC>
+    status_t ForEveryPageAndGapInRange(PAGE_FUNC per_page_func, GAP_FUNC per_gap_func,
+                                       uint64_t start_offset, uint64_t end_offset) {
+        uint64_t gap_start = OffsetToIndex(start_offset) << PAGE_SIZE_SHIFT;
+        uint64_t end = OffsetToIndex(end_offset) << PAGE_SIZE_SHIFT;
+        auto func = [&](vm_page*& p, uint64_t offset) -> status_t {
+            if (offset > gap_start) {
+                status_t status = per_gap_func(gap_start, offset);
+                if (status != NO_ERROR)
+                    return status;
+            }
+            gap_start = offset + PAGE_SIZE;
+            return per_page_func(p, offset);
+        };
+        status_t status = ForEveryPageInRange(func, start_offset, end_offset);
+        if (status != NO_ERROR)
+            return status;
+        if (gap_start < end)
+            return per_gap_func(gap_start, end);
+        return NO_ERROR;
     }
 
+    // number of pages with an offset in [start_offset, end_offset)
+    size_t CountPagesInRange(uint64_t start_offset, uint64_t end_offset) const;
+    // number of pages in the whole list
+    size_t CountPages() const { return root_ ? root_->pages_ : 0; }
+
+    // fails with ERR_NO_MEMORY if the page can't be charged to the account
     status_t AddPage(vm_page*, uint64_t offset);
-    vm_page* GetPage(uint64_t offset);
+    // for pages that were already committed elsewhere and can't be turned
+    // away, charges the account past its limit if need be
+    status_t AddPageOverLimit(vm_page*, uint64_t offset);
+    vm_page* GetPage(uint64_t offset) const;
+    // remove and free the page at offset, returns ERR_NOT_FOUND if there is none
     status_t FreePage(uint64_t offset);
+    // remove the page at offset without freeing it, returns nullptr if there is none
+    vm_page* RemovePage(uint64_t offset);
+    // remove every page with an offset in [start_offset, end_offset) without
+    // freeing them, appending them to |removed| in offset order. returns the count.
+    size_t RemovePages(uint64_t start_offset, uint64_t end_offset, list_node* removed);
     size_t FreeAllPages();
 
 private:
-    mxtl::WAVLTree<uint64_t, mxtl::unique_ptr<VmPageListNode>> list_;
+    // index of the first page at or above offset
+    static uint64_t OffsetToIndex(uint64_t offset) {
+        return (offset >> PAGE_SIZE_SHIFT) + ((offset & (PAGE_SIZE - 1)) ? 1 : 0);
+    }
+
+    // visit the pages with an index in [first, last) below node, which is at
+    // |height| levels above and including the leaves and whose first slot
+    // covers page index |base|
+    template <typename NODE, typename T>
+    static status_t ForEveryPageInIndexRange(NODE* node, uint height, uint64_t base,
+                                             uint64_t first, uint64_t last, T& func) {
+        if (!node)
+            return NO_ERROR;
+        node->canary_.Assert();
+
+        const uint shift = (height - 1) * VmPageListNode::kFanOutShift;
+        size_t i = (first > base) ? static_cast<size_t>((first - base) >> shift) : 0;
+        for (; i < VmPageListNode::kPageFanOut; i++) {
+            uint64_t slot_base = base + (static_cast<uint64_t>(i) << shift);
+            if (slot_base >= last)
+                break;
+
+            status_t status = NO_ERROR;
+            if (height == 1) {
+                if (node->slots_[i].page)
+                    status = func(node->slots_[i].page, slot_base << PAGE_SIZE_SHIFT);
+            } else if (node->slots_[i].node) {
+                status = ForEveryPageInIndexRange<NODE>(node->slots_[i].node, height - 1,
+                                                        slot_base, first, last, func);
+            }
+            if (status != NO_ERROR)
+                return status;
+        }
+        return NO_ERROR;
+    }
+
+    template <typename NODE, typename T>
+    static status_t ForEveryPageInIndexRange(NODE* root, uint height, uint64_t first,
+                                             uint64_t last, T& func) {
+        return ForEveryPageInIndexRange<NODE>(root, height, 0, first, last, func);
+    }
+
+    status_t InsertPage(vm_page* p, uint64_t offset);
+
+    static size_t CountPagesInNode(const VmPageListNode* node, uint height, uint64_t base,
+                                   uint64_t first, uint64_t last);
+    size_t RemovePagesInNode(VmPageListNode* node, uint height, uint64_t base,
+                             uint64_t first, uint64_t last, list_node* removed);
+    void CollapseRoot();
+
+    // number of levels in the tree, 0 when it is empty
+    uint height_ = 0;
+    VmPageListNode* root_ = nullptr;
+
+    MemoryAccount* account_ = nullptr;
 };
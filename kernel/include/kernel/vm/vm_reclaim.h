@@ -0,0 +1,21 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <stddef.h>
+
+// Called from the reclaim thread whenever the system enters or leaves the
+// memory pressure state.
+typedef void (*vm_pressure_callback_t)(bool under_pressure);
+
+// Install the one pressure callback. It is immediately called with the
+// current state.
+void vm_reclaim_set_pressure_callback(vm_pressure_callback_t callback);
+
+// Cheap check called by the pmm after allocating, wakes up the reclaim thread
+// when |free_pages| has dropped below the low watermark.
+void vm_reclaim_check(size_t free_pages);
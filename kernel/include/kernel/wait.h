@@ -55,6 +55,13 @@ status_t wait_queue_block(wait_queue_t *, lk_time_t deadline);
 int wait_queue_wake_one(wait_queue_t *, bool reschedule, status_t wait_queue_error);
 int wait_queue_wake_all(wait_queue_t *, bool reschedule, status_t wait_queue_error);
 
+/* like wait_queue_wake_one() but releases the most recent waiter (LIFO) */
+int wait_queue_wake_newest(wait_queue_t *, bool reschedule, status_t wait_queue_error);
+
+/* like wait_queue_wake_one() but releases the waiter with the highest effective
+ * priority, the oldest among equals */
+int wait_queue_wake_highest(wait_queue_t *, bool reschedule, status_t wait_queue_error);
+
 /*
  * remove the thread from whatever wait queue it's in.
  * return an error if the thread is not currently blocked (or is the current thread)
@@ -43,8 +43,14 @@ static inline void ktrace(uint32_t tag, uint32_t a, uint32_t b, uint32_t c, uint
     } \
 }
 void ktrace_name(uint32_t tag, uint32_t id, uint32_t arg, const char* name);
+void ktrace_boot_stage(const char* name);
+void ktrace_boot_stage_etc(uint64_t ts, const char* name);
 int ktrace_read_user(void* ptr, uint32_t off, uint32_t len);
 status_t ktrace_control(uint32_t action, uint32_t options, void* ptr);
+status_t ktrace_sample_start(uint32_t period_us);
+void ktrace_sample_stop(void);
+// Records a sample of what the interrupt being handled interrupted.
+void ktrace_sample_irq(void);
 #else
 static inline void* ktrace_open(uint32_t tag) { return NULL; }
 static inline void ktrace_tiny(uint32_t tag, uint32_t arg) {}
@@ -52,6 +58,8 @@ static inline void ktrace(uint32_t tag, uint32_t a, uint32_t b, uint32_t c, uint
 static inline void ktrace_probe0(const char* name) {}
 static inline void ktrace_probe2(const char* name, uint32_t arg0, uint32_t arg1) {}
 static inline void ktrace_name(uint32_t tag, uint32_t id, uint32_t arg, const char* name) {}
+static inline void ktrace_boot_stage(const char* name) {}
+static inline void ktrace_boot_stage_etc(uint64_t ts, const char* name) {}
 static inline ssize_t ktrace_read_user(void* ptr, uint32_t off, uint32_t len) {
     if ((len == 0) && (off == 0)) {
         return 0;
@@ -62,6 +70,7 @@ static inline ssize_t ktrace_read_user(void* ptr, uint32_t off, uint32_t len) {
 static inline status_t ktrace_control(uint32_t action, uint32_t options, void* ptr) {
     return ERR_NOT_SUPPORTED;
 }
+static inline void ktrace_sample_irq(void) {}
 #endif
 
 #define KTRACE_DEFAULT_BUFSIZE 32 // MB
@@ -22,4 +22,7 @@ status_t mtrace_control(uint32_t kind, uint32_t action, uint32_t options,
 #ifdef __x86_64__
 status_t mtrace_ipt_control(uint32_t action, uint32_t options,
                             void* arg, uint32_t size);
+
+status_t mtrace_perfmon_control(uint32_t action, uint32_t options,
+                                void* arg, uint32_t size);
 #endif
@@ -42,6 +42,7 @@ enum lk_init_flags {
     LK_INIT_FLAG_ALL_CPUS        = LK_INIT_FLAG_PRIMARY_CPU | LK_INIT_FLAG_SECONDARY_CPUS,
     LK_INIT_FLAG_CPU_SUSPEND     = 0x4,
     LK_INIT_FLAG_CPU_RESUME      = 0x8,
+    LK_INIT_FLAG_ASYNC           = 0x10,
 };
 
 void lk_init_level(enum lk_init_flags flags, uint start_level, uint stop_level);
@@ -61,18 +62,33 @@ struct lk_init_struct {
     uint flags;
     lk_init_hook hook;
     const char *name;
+    uint done_level;
 };
 
-#define LK_INIT_HOOK_FLAGS(_name, _hook, _level, _flags) \
+#define LK_INIT_HOOK_FLAGS_DONE(_name, _hook, _level, _flags, _done_level) \
     extern const struct lk_init_struct _init_struct_##_name; \
     const struct lk_init_struct _init_struct_##_name __ALIGNED(sizeof(void *)) __SECTION("lk_init") = { \
         .level = _level, \
         .flags = _flags, \
         .hook = _hook, \
         .name = #_name, \
+        .done_level = _done_level, \
     };
 
+#define LK_INIT_HOOK_FLAGS(_name, _hook, _level, _flags) \
+    LK_INIT_HOOK_FLAGS_DONE(_name, _hook, _level, _flags, _level)
+
 #define LK_INIT_HOOK(_name, _hook, _level) \
     LK_INIT_HOOK_FLAGS(_name, _hook, _level, LK_INIT_FLAG_PRIMARY_CPU)
 
+/*
+ * A hook which runs on its own thread, in parallel with the boot cpu's
+ * hooks that follow it, and which only has to finish before the first
+ * hook at _done_level or later. Nothing before _done_level may depend
+ * on it. Hooks before LK_INIT_LEVEL_THREADING run in line as usual.
+ */
+#define LK_INIT_HOOK_ASYNC(_name, _hook, _level, _done_level) \
+    LK_INIT_HOOK_FLAGS_DONE(_name, _hook, _level, \
+                            LK_INIT_FLAG_PRIMARY_CPU | LK_INIT_FLAG_ASYNC, _done_level)
+
 __END_CDECLS
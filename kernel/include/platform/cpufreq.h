@@ -0,0 +1,28 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <magenta/compiler.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+__BEGIN_CDECLS
+
+/* performance levels the cpufreq governor asks for, from 0 for the slowest
+ * the platform runs a cpu at to CPUFREQ_LEVEL_MAX for the fastest, turbo
+ * included */
+#define CPUFREQ_LEVEL_MAX 1024u
+
+/* called once on the boot cpu. ERR_NOT_SUPPORTED if the platform has no way
+ * to change the performance of its cpus, which leaves the governor off */
+status_t platform_cpufreq_init(void);
+
+/* run the current cpu at |level|. called with interrupts disabled, possibly
+ * before the platform heard of the cpu in any other way */
+void platform_cpufreq_set_level(uint32_t level);
+
+__END_CDECLS
@@ -0,0 +1,148 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <kernel/cpufreq.h>
+
+#include <arch/ops.h>
+#include <debug.h>
+#include <err.h>
+#include <kernel/cmdline.h>
+#include <kernel/mp.h>
+#include <lk/init.h>
+#include <platform.h>
+#include <platform/cpufreq.h>
+#include <stdio.h>
+#include <trace.h>
+
+#define LOCAL_TRACE 0
+
+/* shortest window the utilization is measured over, so that a boost right
+ * after a tick doesn't judge the cpu by a few microseconds */
+#define MIN_WINDOW LK_MSEC(1)
+
+/* a busier cpu is followed right away, a less busy one only this fraction
+ * (as a shift) of the way down per window, so that the clock doesn't drop for
+ * the short idle stretches between bursts of work */
+#define UTIL_DECAY_SHIFT 2
+
+/* the level asked for is the utilization plus a quarter, so a cpu that is
+ * busy 80% of the time or more runs flat out */
+#define HEADROOM_SHIFT 2
+
+struct cpufreq_state {
+    /* start of the window the busy time is counted in */
+    lk_time_t window_start;
+    lk_time_t busy;
+    /* when the cpu last went busy, INFINITE_TIME while it is idle */
+    lk_time_t busy_since;
+
+    /* decaying utilization and the level last asked for, out of
+     * CPUFREQ_LEVEL_MAX */
+    uint32_t util;
+    uint32_t level;
+
+    /* set by any cpu when threads queue up, taken by this one */
+    int boost;
+} __CPU_ALIGN;
+
+/* only touched by their own cpu with interrupts disabled, except for |boost| */
+static struct cpufreq_state cpufreq_states[SMP_MAX_CPUS];
+static bool cpufreq_enabled;
+
+static void cpufreq_update(uint cpu, struct cpufreq_state *s, lk_time_t now)
+{
+    if (s->busy_since != INFINITE_TIME) {
+        s->busy += now - s->busy_since;
+        s->busy_since = now;
+    }
+
+    lk_time_t elapsed = now - s->window_start;
+    if (elapsed >= MIN_WINDOW) {
+        uint32_t util = (uint32_t)MIN(s->busy * CPUFREQ_LEVEL_MAX / elapsed, CPUFREQ_LEVEL_MAX);
+        if (util >= s->util)
+            s->util = util;
+        else
+            s->util -= (s->util - util) >> UTIL_DECAY_SHIFT;
+
+        s->window_start = now;
+        s->busy = 0;
+    }
+
+    uint32_t level;
+    if (__atomic_exchange_n(&s->boost, 0, __ATOMIC_RELAXED))
+        level = CPUFREQ_LEVEL_MAX;
+    else
+        level = MIN(s->util + (s->util >> HEADROOM_SHIFT), CPUFREQ_LEVEL_MAX);
+
+    if (level == s->level)
+        return;
+
+    LTRACEF("cpu %u util %u level %u\n", cpu, s->util, level);
+    s->level = level;
+    platform_cpufreq_set_level(level);
+}
+
+void cpufreq_context_switch(uint cpu, bool was_idle, bool is_idle, lk_time_t now)
+{
+    if (!cpufreq_enabled)
+        return;
+
+    struct cpufreq_state *s = &cpufreq_states[cpu];
+    if (was_idle && !is_idle) {
+        s->busy_since = now;
+    } else if (!was_idle && is_idle && s->busy_since != INFINITE_TIME) {
+        s->busy += now - s->busy_since;
+        s->busy_since = INFINITE_TIME;
+    }
+
+    if (unlikely(__atomic_load_n(&s->boost, __ATOMIC_RELAXED)))
+        cpufreq_update(cpu, s, now);
+}
+
+void cpufreq_tick(uint cpu, lk_time_t now)
+{
+    if (!cpufreq_enabled)
+        return;
+
+    cpufreq_update(cpu, &cpufreq_states[cpu], now);
+}
+
+void cpufreq_boost(uint cpu)
+{
+    if (!cpufreq_enabled)
+        return;
+
+    struct cpufreq_state *s = &cpufreq_states[cpu];
+    if (__atomic_load_n(&s->boost, __ATOMIC_RELAXED) || s->level == CPUFREQ_LEVEL_MAX)
+        return;
+
+    /* another cpu picks it up at its next tick or context switch */
+    __atomic_store_n(&s->boost, 1, __ATOMIC_RELAXED);
+    if (cpu == arch_curr_cpu_num())
+        cpufreq_update(cpu, s, current_time());
+}
+
+static void cpufreq_init(uint level)
+{
+    if (!cmdline_get_bool("kernel.cpufreq", true))
+        return;
+    if (platform_cpufreq_init() != NO_ERROR)
+        return;
+
+    /* every cpu starts out at the top and is walked down as its utilization
+     * comes in. the level is set on the first update */
+    lk_time_t now = current_time();
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        cpufreq_states[cpu].window_start = now;
+        cpufreq_states[cpu].busy_since = mp_is_cpu_idle(cpu) ? INFINITE_TIME : now;
+        cpufreq_states[cpu].util = CPUFREQ_LEVEL_MAX;
+        cpufreq_states[cpu].level = UINT32_MAX;
+    }
+    smp_mb();
+    cpufreq_enabled = true;
+}
+
+LK_INIT_HOOK(cpufreq, &cpufreq_init, LK_INIT_LEVEL_PLATFORM + 1);
@@ -86,6 +86,14 @@ static int cmd_threadstats(int argc, const cmd_args *argv, uint32_t flags)
         printf("\tcontext_switches: %lu\n", thread_stats[i].context_switches);
         printf("\tpreempts: %lu\n", thread_stats[i].preempts);
         printf("\tyields: %lu\n", thread_stats[i].yields);
+        printf("\tsteals: %lu\n", thread_stats[i].steals);
+        printf("\thandoffs: %lu\n", thread_stats[i].handoffs);
+        printf("\tdeadline time: %" PRIu64 "\n", thread_stats[i].deadline_time);
+        printf("\tdeadline throttles: %lu\n", thread_stats[i].deadline_throttles);
+        printf("\tgroup throttles: %lu\n", thread_stats[i].group_throttles);
+        printf("\tmutex spins: %lu\n", thread_stats[i].mutex_spins);
+        printf("\tmutex blocks: %lu\n", thread_stats[i].mutex_blocks);
+        printf("\tspinlock contended: %lu\n", thread_stats[i].spin_contended);
         printf("\tinterrupts: %lu\n", thread_stats[i].interrupts);
         printf("\ttimer interrupts: %lu\n", thread_stats[i].timer_ints);
         printf("\ttimers: %lu\n", thread_stats[i].timers);
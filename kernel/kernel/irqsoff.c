@@ -0,0 +1,178 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <kernel/irqsoff.h>
+
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <arch/ops.h>
+#include <kernel/cmdline.h>
+#include <kernel/mp.h>
+#include <lib/ktrace.h>
+#include <lk/init.h>
+#include <platform.h>
+
+/* longest regions kept per cpu */
+#define IRQSOFF_WORST 4
+#define IRQSOFF_DEFAULT_THRESHOLD_US 250
+
+struct irqsoff_region {
+    lk_time_t end;
+    lk_time_t length;
+    uintptr_t start_pc;
+    uintptr_t end_pc;
+};
+
+/* only its own cpu writes an entry, with interrupts off, except that the
+ * watchdog reads |start| and |start_pc| from an NMI on another cpu */
+struct irqsoff_cpu {
+    /* the region in progress, 0 while interrupts are on */
+    lk_time_t start;
+    uintptr_t start_pc;
+    /* the start of the last region noted as a stall */
+    lk_time_t stalled;
+    uint64_t stalls;
+    /* longest first */
+    struct irqsoff_region worst[IRQSOFF_WORST];
+} __CPU_ALIGN;
+
+static struct irqsoff_cpu irqsoff_cpu[SMP_MAX_CPUS];
+
+/* nothing is timed until the clock runs */
+static bool irqsoff_running;
+static lk_time_t irqsoff_threshold;
+
+static uint32_t irqsoff_u32(uint64_t v)
+{
+    return v > UINT32_MAX ? UINT32_MAX : (uint32_t)v;
+}
+
+void irqsoff_begin(uintptr_t pc)
+{
+    if (!__atomic_load_n(&irqsoff_running, __ATOMIC_RELAXED))
+        return;
+
+    struct irqsoff_cpu *c = &irqsoff_cpu[arch_curr_cpu_num()];
+    c->start_pc = pc;
+    __atomic_store_n(&c->start, current_time(), __ATOMIC_RELAXED);
+}
+
+void irqsoff_end(uintptr_t pc)
+{
+    uint cpu = arch_curr_cpu_num();
+    struct irqsoff_cpu *c = &irqsoff_cpu[cpu];
+    lk_time_t start = c->start;
+    if (start == 0)
+        return;
+    __atomic_store_n(&c->start, 0, __ATOMIC_RELAXED);
+
+    lk_time_t now = current_time();
+    lk_time_t length = now - start;
+    if (length > irqsoff_threshold)
+        ktrace(TAG_IRQSOFF, cpu, irqsoff_u32(length), (uint32_t)c->start_pc, (uint32_t)pc);
+
+    if (length <= c->worst[IRQSOFF_WORST - 1].length)
+        return;
+    uint i = IRQSOFF_WORST - 1;
+    for (; i > 0 && c->worst[i - 1].length < length; i--)
+        c->worst[i] = c->worst[i - 1];
+    c->worst[i].end = now;
+    c->worst[i].length = length;
+    c->worst[i].start_pc = c->start_pc;
+    c->worst[i].end_pc = pc;
+}
+
+void irqsoff_cancel(void)
+{
+    __atomic_store_n(&irqsoff_cpu[arch_curr_cpu_num()].start, 0, __ATOMIC_RELAXED);
+}
+
+lk_time_t irqsoff_check_stalls(lk_time_t now, lk_time_t limit, uint cpu)
+{
+    lk_time_t off = 0;
+    for (uint i = 0; i < arch_max_num_cpus(); i++) {
+        struct irqsoff_cpu *c = &irqsoff_cpu[i];
+        lk_time_t start = __atomic_load_n(&c->start, __ATOMIC_RELAXED);
+        if (start == 0 || now < start)
+            continue;
+        if (i == cpu)
+            off = now - start;
+        if (now - start > limit && c->stalled != start) {
+            c->stalled = start;
+            c->stalls++;
+            ktrace(TAG_IRQSOFF_STALL, i, irqsoff_u32(now - start),
+                   (uint32_t)__atomic_load_n(&c->start_pc, __ATOMIC_RELAXED), 0);
+        }
+    }
+    return off;
+}
+
+uintptr_t irqsoff_start_pc(uint cpu)
+{
+    if (__atomic_load_n(&irqsoff_cpu[cpu].start, __ATOMIC_RELAXED) == 0)
+        return 0;
+    return __atomic_load_n(&irqsoff_cpu[cpu].start_pc, __ATOMIC_RELAXED);
+}
+
+static void irqsoff_init(uint level)
+{
+    irqsoff_threshold = LK_USEC(cmdline_get_uint32("kernel.irqsoff-threshold-us",
+                                                   IRQSOFF_DEFAULT_THRESHOLD_US));
+    __atomic_store_n(&irqsoff_running, true, __ATOMIC_RELAXED);
+}
+
+LK_INIT_HOOK(irqsoff, irqsoff_init, LK_INIT_LEVEL_KERNEL);
+
+#if WITH_LIB_CONSOLE
+#include <lib/console.h>
+
+static void irqsoff_print(void)
+{
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        if (!mp_is_cpu_active(i))
+            continue;
+        struct irqsoff_cpu *c = &irqsoff_cpu[i];
+        printf("cpu %u: %" PRIu64 " stalls\n", i, c->stalls);
+        for (uint j = 0; j < IRQSOFF_WORST && c->worst[j].length; j++) {
+            const struct irqsoff_region *r = &c->worst[j];
+            printf("\t%" PRIu64 "us from %#" PRIxPTR " to %#" PRIxPTR ", ending at %" PRIu64 "\n",
+                   r->length / 1000, r->start_pc, r->end_pc, r->end);
+        }
+    }
+}
+
+static void irqsoff_reset(void)
+{
+    /* each cpu only races itself, and a region that ends meanwhile may
+     * survive the reset */
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        memset(irqsoff_cpu[i].worst, 0, sizeof(irqsoff_cpu[i].worst));
+        irqsoff_cpu[i].stalls = 0;
+    }
+}
+
+static int cmd_irqsoff(int argc, const cmd_args *argv, uint32_t flags)
+{
+    if (argc < 2) {
+        irqsoff_print();
+    } else if (!strcmp(argv[1].str, "reset")) {
+        irqsoff_reset();
+    } else {
+        printf("usage:\n");
+        printf("%s       : the longest interrupts-off regions of each cpu\n", argv[0].str);
+        printf("%s reset : forget them\n", argv[0].str);
+        return -1;
+    }
+    return 0;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("irqsoff", "longest interrupts disabled regions", &cmd_irqsoff)
+STATIC_COMMAND_END(irqsoff);
+
+#endif // WITH_LIB_CONSOLE
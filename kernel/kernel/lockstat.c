@@ -0,0 +1,311 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <kernel/lockstat.h>
+
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arch/ops.h>
+#include <lib/ktrace.h>
+#include <platform.h>
+
+/* a power of two */
+#define LOCKSTAT_MAX_CLASSES 1024
+/* slots looked at for a key before giving up on it */
+#define LOCKSTAT_MAX_PROBE 32
+/* nested spinlocks one cpu can time the hold of */
+#define LOCKSTAT_MAX_HELD 16
+#define LOCKSTAT_DEFAULT_TOP 10
+#define LOCKSTAT_MAX_TOP 64
+
+static lockstat_class_t lockstat_classes[LOCKSTAT_MAX_CLASSES];
+
+/* shared by every key that found no room in the table */
+static lockstat_class_t lockstat_other = {
+    .key = UINTPTR_MAX,
+    .name = "(other)",
+};
+
+/* the spinlocks held on a cpu, in the order they were taken. interrupts are
+ * off while a spinlock is held, so only the cpu itself touches its entry */
+struct lockstat_cpu {
+    struct {
+        spin_lock_t *lock;
+        lockstat_class_t *class;
+        lk_time_t acquired;
+    } held[LOCKSTAT_MAX_HELD];
+    uint depth;
+} __CPU_ALIGN;
+
+static struct lockstat_cpu lockstat_cpu[SMP_MAX_CPUS];
+
+static uint lockstat_hash(uintptr_t key)
+{
+    uint64_t h = key;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return (uint)h & (LOCKSTAT_MAX_CLASSES - 1);
+}
+
+lockstat_class_t *lockstat_class_get(uintptr_t key, const char *name, uint kind)
+{
+    uint i = lockstat_hash(key);
+    for (uint probe = 0; probe < LOCKSTAT_MAX_PROBE; probe++) {
+        lockstat_class_t *c = &lockstat_classes[i];
+        uintptr_t k = __atomic_load_n(&c->key, __ATOMIC_ACQUIRE);
+        if (k == 0 && __atomic_compare_exchange_n(&c->key, &k, key, false,
+                                                  __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            /* anyone reading the class meanwhile only misses its name */
+            c->name = name;
+            c->kind = kind;
+            return c;
+        }
+        if (k == key)
+            return c;
+        i = (i + 1) & (LOCKSTAT_MAX_CLASSES - 1);
+    }
+    return &lockstat_other;
+}
+
+static uint lockstat_bucket(lk_time_t t)
+{
+    uint b = t ? 64 - __builtin_clzll(t) : 0;
+    return b < LOCKSTAT_HIST_BUCKETS ? b : LOCKSTAT_HIST_BUCKETS - 1;
+}
+
+static void lockstat_max(lk_time_t *max, lk_time_t t)
+{
+    lk_time_t old = __atomic_load_n(max, __ATOMIC_RELAXED);
+    while (t > old && !__atomic_compare_exchange_n(max, &old, t, true,
+                                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static void lockstat_count_caller(lockstat_class_t *c, uintptr_t caller)
+{
+    for (uint i = 0; i < LOCKSTAT_CALLERS; i++) {
+        lockstat_caller_t *s = &c->callers[i];
+        uintptr_t pc = __atomic_load_n(&s->pc, __ATOMIC_RELAXED);
+        if (pc == 0 && __atomic_compare_exchange_n(&s->pc, &pc, caller, false,
+                                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            pc = caller;
+        if (pc == caller) {
+            __atomic_fetch_add(&s->count, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+}
+
+void lockstat_acquired(lockstat_class_t *c, bool contended, lk_time_t wait,
+                       uintptr_t caller)
+{
+    __atomic_fetch_add(&c->acquires, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&c->wait_total, wait, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&c->wait_hist[lockstat_bucket(wait)], 1, __ATOMIC_RELAXED);
+    lockstat_max(&c->wait_max, wait);
+    if (contended) {
+        __atomic_fetch_add(&c->contended, 1, __ATOMIC_RELAXED);
+        lockstat_count_caller(c, caller);
+    }
+}
+
+void lockstat_released(lockstat_class_t *c, lk_time_t hold)
+{
+    __atomic_fetch_add(&c->hold_total, hold, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&c->hold_hist[lockstat_bucket(hold)], 1, __ATOMIC_RELAXED);
+    lockstat_max(&c->hold_max, hold);
+}
+
+static void lockstat_spin_push(spin_lock_t *lock, bool contended, lk_time_t wait,
+                               uintptr_t caller)
+{
+    lockstat_class_t *c = lockstat_class_get((uintptr_t)lock, NULL, LOCKSTAT_KIND_SPIN);
+    lockstat_acquired(c, contended, wait, caller);
+
+    /* past the limit the hold just isn't timed */
+    struct lockstat_cpu *cpu = &lockstat_cpu[arch_curr_cpu_num()];
+    if (cpu->depth < LOCKSTAT_MAX_HELD) {
+        cpu->held[cpu->depth].lock = lock;
+        cpu->held[cpu->depth].class = c;
+        cpu->held[cpu->depth].acquired = current_time();
+        cpu->depth++;
+    }
+}
+
+void lockstat_spin_lock(spin_lock_t *lock)
+{
+    lk_time_t start = current_time();
+    bool contended = spin_trylock_raw(lock) != 0;
+    if (contended)
+        spin_lock_raw(lock);
+    lockstat_spin_push(lock, contended, current_time() - start, (uintptr_t)__GET_CALLER());
+}
+
+void lockstat_spin_locked(spin_lock_t *lock)
+{
+    lockstat_spin_push(lock, false, 0, (uintptr_t)__GET_CALLER());
+}
+
+void lockstat_spin_unlock(spin_lock_t *lock)
+{
+    /* locks needn't be released in the order they were taken */
+    struct lockstat_cpu *cpu = &lockstat_cpu[arch_curr_cpu_num()];
+    for (uint i = cpu->depth; i-- > 0;) {
+        if (cpu->held[i].lock != lock)
+            continue;
+        lockstat_released(cpu->held[i].class, current_time() - cpu->held[i].acquired);
+        cpu->depth--;
+        memmove(&cpu->held[i], &cpu->held[i + 1], (cpu->depth - i) * sizeof(cpu->held[0]));
+        break;
+    }
+    spin_unlock_raw(lock);
+}
+
+/* every class in use, |lockstat_other| last */
+static lockstat_class_t *lockstat_next(lockstat_class_t *c)
+{
+    c = c ? c + 1 : lockstat_classes;
+    for (; c < lockstat_classes + LOCKSTAT_MAX_CLASSES; c++) {
+        if (__atomic_load_n(&c->key, __ATOMIC_ACQUIRE) != 0)
+            return c;
+    }
+    return c == lockstat_classes + LOCKSTAT_MAX_CLASSES ? &lockstat_other : NULL;
+}
+
+static uint32_t lockstat_id(lockstat_class_t *c)
+{
+    return c == &lockstat_other ? LOCKSTAT_MAX_CLASSES : (uint32_t)(c - lockstat_classes);
+}
+
+static uint32_t lockstat_u32(uint64_t v)
+{
+    return v > UINT32_MAX ? UINT32_MAX : (uint32_t)v;
+}
+
+#if WITH_LIB_CONSOLE
+#include <lib/console.h>
+
+static void lockstat_print_hist(const char *what, const uint64_t *hist)
+{
+    printf("\t%s, count by log2(ns):", what);
+    for (uint i = 0; i < LOCKSTAT_HIST_BUCKETS; i++) {
+        if (hist[i])
+            printf(" %u:%" PRIu64, i, hist[i]);
+    }
+    printf("\n");
+}
+
+static void lockstat_print(lockstat_class_t *c)
+{
+    if (c->name)
+        printf("%s", c->name);
+    else
+        printf("%s %#" PRIxPTR, c->kind == LOCKSTAT_KIND_SPIN ? "spinlock" : "mutex", c->key);
+    printf(": acquires %" PRIu64 " contended %" PRIu64 "\n", c->acquires, c->contended);
+    printf("\twait total %" PRIu64 "us max %" PRIu64 "us, hold total %" PRIu64 "us max %" PRIu64 "us\n",
+           c->wait_total / 1000, c->wait_max / 1000, c->hold_total / 1000, c->hold_max / 1000);
+    lockstat_print_hist("wait", c->wait_hist);
+    lockstat_print_hist("hold", c->hold_hist);
+    for (uint i = 0; i < LOCKSTAT_CALLERS && c->callers[i].pc; i++)
+        printf("\tcontended at %#" PRIxPTR ": %" PRIu64 "\n", c->callers[i].pc, c->callers[i].count);
+}
+
+static void lockstat_print_top(uint n)
+{
+    lockstat_class_t *top[LOCKSTAT_MAX_TOP];
+    uint count = 0;
+    for (lockstat_class_t *c = lockstat_next(NULL); c; c = lockstat_next(c)) {
+        if (c->acquires == 0)
+            continue;
+        /* insert by contention, then by acquires */
+        uint i = count;
+        while (i > 0 && (top[i - 1]->contended < c->contended ||
+                         (top[i - 1]->contended == c->contended &&
+                          top[i - 1]->acquires < c->acquires))) {
+            if (i < n)
+                top[i] = top[i - 1];
+            i--;
+        }
+        if (i < n)
+            top[i] = c;
+        if (count < n)
+            count++;
+    }
+    for (uint i = 0; i < count; i++)
+        lockstat_print(top[i]);
+}
+
+static void lockstat_reset(void)
+{
+    for (lockstat_class_t *c = lockstat_next(NULL); c; c = lockstat_next(c)) {
+        /* counts that race the reset may survive it */
+        uintptr_t key = c->key;
+        const char *name = c->name;
+        uint kind = c->kind;
+        memset(c, 0, sizeof(*c));
+        c->key = key;
+        c->name = name;
+        c->kind = kind;
+    }
+}
+
+static void lockstat_ktrace(void)
+{
+    for (lockstat_class_t *c = lockstat_next(NULL); c; c = lockstat_next(c)) {
+        if (c->acquires == 0)
+            continue;
+        uint32_t id = lockstat_id(c);
+        if (c->name)
+            ktrace_name(TAG_LOCK_CLASS_NAME, id, c->kind, c->name);
+        ktrace(TAG_LOCK_CLASS, id, (uint32_t)c->key, (uint32_t)((uint64_t)c->key >> 32), c->kind);
+        ktrace(TAG_LOCK_COUNTS, id, lockstat_u32(c->acquires), lockstat_u32(c->contended), 0);
+        ktrace(TAG_LOCK_TIMES, id, 0, lockstat_u32(c->wait_total / 1000),
+               lockstat_u32(c->wait_max / 1000));
+        ktrace(TAG_LOCK_TIMES, id, 1, lockstat_u32(c->hold_total / 1000),
+               lockstat_u32(c->hold_max / 1000));
+        for (uint i = 0; i < LOCKSTAT_HIST_BUCKETS; i++) {
+            if (c->wait_hist[i])
+                ktrace(TAG_LOCK_HIST, id, i, lockstat_u32(c->wait_hist[i]), 0);
+            if (c->hold_hist[i])
+                ktrace(TAG_LOCK_HIST, id, (1u << 8) | i, lockstat_u32(c->hold_hist[i]), 0);
+        }
+        for (uint i = 0; i < LOCKSTAT_CALLERS && c->callers[i].pc; i++) {
+            ktrace(TAG_LOCK_CALLER, id, (uint32_t)c->callers[i].pc,
+                   (uint32_t)((uint64_t)c->callers[i].pc >> 32), lockstat_u32(c->callers[i].count));
+        }
+    }
+}
+
+static int cmd_lockstat(int argc, const cmd_args *argv, uint32_t flags)
+{
+    if (argc < 2) {
+        lockstat_print_top(LOCKSTAT_DEFAULT_TOP);
+    } else if (!strcmp(argv[1].str, "reset")) {
+        lockstat_reset();
+    } else if (!strcmp(argv[1].str, "ktrace")) {
+        lockstat_ktrace();
+    } else if (argv[1].u > 0) {
+        lockstat_print_top(MIN(argv[1].u, LOCKSTAT_MAX_TOP));
+    } else {
+        printf("usage:\n");
+        printf("%s [count]  : the most contended lock classes, %u by default\n",
+               argv[0].str, LOCKSTAT_DEFAULT_TOP);
+        printf("%s reset    : zero every lock class\n", argv[0].str);
+        printf("%s ktrace   : write every lock class to the trace buffer\n", argv[0].str);
+        return -1;
+    }
+    return 0;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("lockstat", "lock contention statistics", &cmd_lockstat)
+STATIC_COMMAND_END(lockstat);
+
+#endif // WITH_LIB_CONSOLE
@@ -18,6 +18,7 @@
 #include <kernel/event.h>
 #include <kernel/mp.h>
 #include <kernel/mutex.h>
+#include <kernel/sched.h>
 #include <kernel/spinlock.h>
 #include <kernel/timer.h>
 
@@ -40,6 +41,23 @@ void mp_init(void)
     for (uint i = 0; i < countof(mp.ipi_task_list); ++i) {
         list_initialize(&mp.ipi_task_list[i]);
     }
+
+    /* until the platform tells us otherwise, assume every cpu is its own
+     * core and that they all share a cache */
+    for (uint i = 0; i < SMP_MAX_CPUS; ++i) {
+        mp.smt_siblings[i] = 1U << i;
+        mp.cache_siblings[i] = ~0U >> (sizeof(mp_cpu_mask_t) * CHAR_BIT - SMP_MAX_CPUS);
+    }
+}
+
+void mp_set_cpu_topology(uint cpu, mp_cpu_mask_t smt_siblings, mp_cpu_mask_t cache_siblings)
+{
+    DEBUG_ASSERT(cpu < SMP_MAX_CPUS);
+
+    LTRACEF("cpu %u smt 0x%x cache 0x%x\n", cpu, smt_siblings, cache_siblings);
+
+    mp.smt_siblings[cpu] = smt_siblings | (1U << cpu);
+    mp.cache_siblings[cpu] = cache_siblings | (1U << cpu);
 }
 
 void mp_reschedule(mp_cpu_mask_t target, uint flags)
@@ -64,9 +82,15 @@ void mp_reschedule(mp_cpu_mask_t target, uint flags)
     }
     target &= ~(1U << local_cpu);
 
+    /* a cpu with a reschedule ipi already on its way will see whatever the
+     * caller changed when it takes that one, so only interrupt the others */
+    mp_cpu_mask_t pending = atomic_or((volatile int *)&mp.reschedule_pending, target);
+    target &= ~pending;
+
     LTRACEF("local %u, post mask target now 0x%x\n", local_cpu, target);
 
-    arch_mp_send_ipi(target, MP_IPI_RESCHEDULE);
+    if (target)
+        arch_mp_send_ipi(target, MP_IPI_RESCHEDULE);
 }
 
 struct mp_sync_context {
@@ -309,8 +333,10 @@ status_t mp_unplug_cpu(uint cpu_id) {
         status = event_wait(&unplug_done);
     } while (status < 0);
 
-    /* Now that the CPU is no longer processing tasks, move all of its timers */
+    /* Now that the CPU is no longer processing tasks, move all of its timers
+     * and any threads still waiting in its run queue */
     timer_transition_off_cpu(cpu_id);
+    sched_transition_off_cpu(cpu_id);
 
     status = platform_mp_cpu_unplug(cpu_id);
     if (status != NO_ERROR) {
@@ -343,6 +369,9 @@ void mp_set_curr_cpu_online(bool online)
 void mp_set_curr_cpu_active(bool active)
 {
     if (active) {
+        /* an ipi which found this cpu down was never sent, so it must not be
+         * left pending */
+        atomic_and((volatile int *)&mp.reschedule_pending, ~(1U << arch_curr_cpu_num()));
         atomic_or((volatile int *)&mp.active_cpus, 1U << arch_curr_cpu_num());
     } else {
         atomic_and((volatile int *)&mp.active_cpus, ~(1U << arch_curr_cpu_num()));
@@ -378,6 +407,10 @@ enum handler_return mp_mbx_reschedule_irq(void)
 
     THREAD_STATS_INC(reschedule_ipis);
 
+    /* clear this before rescheduling, so that a later mp_reschedule either
+     * sends another ipi or is seen by this one */
+    atomic_and((volatile int *)&mp.reschedule_pending, ~(1U << cpu));
+
     return (mp.active_cpus & (1U << cpu)) ? INT_RESCHEDULE : INT_NO_RESCHEDULE;
 }
 
@@ -19,7 +19,102 @@
 #include <debug.h>
 #include <assert.h>
 #include <err.h>
+#include <kernel/lockstat.h>
+#include <kernel/percpu.h>
 #include <kernel/thread.h>
+#include <lib/ktrace.h>
+#include <platform.h>
+
+/* upper bound on the number of pause loops spent waiting for a running holder
+ * to release the mutex before falling back to blocking */
+#define MUTEX_MAX_SPINS 2048
+#define MUTEX_SPIN_CHECK 64
+
+/* how far a lent priority is passed along a chain of threads, each blocked on
+ * a mutex the next one holds. also what stops a deadlock cycle going round */
+#define MUTEX_PI_MAX_DEPTH 8
+
+/* Priority inheritance: a thread blocked acquiring a mutex lends its priority
+ * to the holder, which passes its own on to the holder of whatever mutex it is
+ * blocked on in turn. The lends are taken back when the holder releases the
+ * mutex, and the waiter woken, the highest priority one, collects those of the
+ * rest once it holds it. All of it is under THREAD_LOCK. */
+
+/* the priority of |t|, which lends it, may have changed */
+static void mutex_pi_update(thread_t *t)
+{
+    for (int depth = 0; depth < MUTEX_PI_MAX_DEPTH; depth++) {
+        thread_t *to = t->pi_lent_to;
+        if (!to || t->pi_lent_priority == t->priority)
+            return;
+
+        int before = to->priority;
+        thread_inherit_priority_locked(to, t->priority);
+        thread_disinherit_priority_locked(to, t->pi_lent_priority);
+        t->pi_lent_priority = t->priority;
+        if (to->priority == before)
+            return;
+        t = to;
+    }
+}
+
+/* |t| is blocked on |m| */
+static void mutex_pi_lend(mutex_t *m, thread_t *t)
+{
+    thread_t *holder = m->holder;
+    if (!holder)
+        return;
+
+    t->pi_lent_to = holder;
+    t->pi_lent_priority = t->priority;
+    int before = holder->priority;
+    thread_inherit_priority_locked(holder, t->priority);
+    if (holder->priority != before)
+        mutex_pi_update(holder);
+}
+
+/* |m| is about to be released, so its waiters take back their priorities */
+static void mutex_pi_unlend_all(mutex_t *m)
+{
+    thread_t *t;
+    list_for_every_entry(&m->wait.list, t, thread_t, queue_node) {
+        thread_t *to = t->pi_lent_to;
+        if (!to)
+            continue;
+        t->pi_lent_to = NULL;
+        int before = to->priority;
+        thread_disinherit_priority_locked(to, t->pi_lent_priority);
+        if (to->priority != before)
+            mutex_pi_update(to);
+    }
+}
+
+/* |m| has a new holder, which the waiters lend to */
+static void mutex_pi_lend_all(mutex_t *m)
+{
+    thread_t *t;
+    list_for_every_entry(&m->wait.list, t, thread_t, queue_node) {
+        if (!t->pi_lent_to)
+            mutex_pi_lend(m, t);
+    }
+}
+
+#if WITH_LOCK_STATS
+/* only called with the mutex held, which keeps the lookup from racing */
+static lockstat_class_t *mutex_lockstat_class(mutex_t *m)
+{
+    if (!m->lockstat_class) {
+        uintptr_t key = m->lockstat_name ? (uintptr_t)m->lockstat_name : (uintptr_t)m;
+        m->lockstat_class = lockstat_class_get(key, m->lockstat_name, LOCKSTAT_KIND_MUTEX);
+    }
+    return m->lockstat_class;
+}
+
+static void mutex_lockstat_release(mutex_t *m)
+{
+    lockstat_released(m->lockstat_class, current_time() - m->lockstat_acquired);
+}
+#endif
 
 /**
  * @brief  Initialize a mutex_t
@@ -55,6 +150,19 @@ void mutex_destroy(mutex_t *m)
     THREAD_UNLOCK(state);
 }
 
+/* whether holder is running on some cpu right now. racy, which only costs a
+ * few spins or an early block when a switch lands in the middle of it */
+static bool mutex_holder_running(const thread_t *holder)
+{
+    if (!holder)
+        return false;
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        if (__atomic_load_n(&percpu[cpu].curr_thread, __ATOMIC_RELAXED) == holder)
+            return true;
+    }
+    return false;
+}
+
 /**
  * @brief  Acquire the mutex
  *
@@ -71,8 +179,30 @@ void mutex_acquire(mutex_t *m) TA_NO_THREAD_SAFETY_ANALYSIS
               get_current_thread(), get_current_thread()->name, m);
 #endif
 
+#if WITH_LOCK_STATS
+    lk_time_t wait_start = current_time();
+#endif
+
+    /* the mutex is usually held briefly, so while the holder is running on
+     * another cpu spin for a bounded time rather than going through a
+     * sleep/wakeup cycle. the holder may exit and be freed at any point, so
+     * it is never dereferenced here, only looked for among the threads the
+     * cpus are running every MUTEX_SPIN_CHECK pauses. */
+    uint spins = 0;
+    while (__atomic_load_n(&m->count, __ATOMIC_RELAXED) > 0 && spins < MUTEX_MAX_SPINS) {
+        if (spins % MUTEX_SPIN_CHECK == 0 &&
+            !mutex_holder_running(__atomic_load_n(&m->holder, __ATOMIC_RELAXED)))
+            break;
+        arch_spinloop_pause();
+        spins++;
+    }
+
+    thread_t *current_thread = get_current_thread();
+    bool blocked = false;
     THREAD_LOCK(state);
     if (unlikely(++m->count > 1)) {
+        blocked = true;
+        mutex_pi_lend(m, current_thread);
         status_t ret = wait_queue_block(&m->wait, INFINITE_TIME);
         if (unlikely(ret < NO_ERROR)) {
             /* mutexes are not interruptable and cannot time out, so it
@@ -83,8 +213,27 @@ void mutex_acquire(mutex_t *m) TA_NO_THREAD_SAFETY_ANALYSIS
         }
     }
 
-    m->holder = get_current_thread();
+    m->holder = current_thread;
+    /* whoever blocked between the release that woke us and now had nobody to
+     * lend to, and the rest took their lends back from the last holder */
+    if (unlikely(blocked && m->count > 1))
+        mutex_pi_lend_all(m);
     THREAD_UNLOCK(state);
+
+    if (unlikely(spins > 0 || blocked)) {
+        if (blocked)
+            THREAD_STATS_INC(mutex_blocks);
+        else
+            THREAD_STATS_INC(mutex_spins);
+        ktrace(TAG_MUTEX_CONTEND, (uint32_t)(uintptr_t)m, spins, blocked,
+               arch_curr_cpu_num());
+    }
+
+#if WITH_LOCK_STATS
+    m->lockstat_acquired = current_time();
+    lockstat_acquired(mutex_lockstat_class(m), spins > 0 || blocked,
+                      m->lockstat_acquired - wait_start, (uintptr_t)__GET_CALLER());
+#endif
 }
 
 
@@ -100,12 +249,17 @@ void mutex_release(mutex_t *m) TA_NO_THREAD_SAFETY_ANALYSIS
     }
 #endif
 
+#if WITH_LOCK_STATS
+    mutex_lockstat_release(m);
+#endif
+
     THREAD_LOCK(state);
     m->holder = 0;
 
     if (unlikely(--m->count >= 1)) {
         /* release a thread */
-        wait_queue_wake_one(&m->wait, true, NO_ERROR);
+        mutex_pi_unlend_all(m);
+        wait_queue_wake_highest(&m->wait, true, NO_ERROR);
     }
     THREAD_UNLOCK(state);
 }
@@ -126,10 +280,15 @@ void mutex_release_thread_locked(mutex_t *m, bool reschedule) TA_NO_THREAD_SAFET
     }
 #endif
 
+#if WITH_LOCK_STATS
+    mutex_lockstat_release(m);
+#endif
+
     m->holder = 0;
 
     if (unlikely(--m->count >= 1)) {
         /* release a thread */
-        wait_queue_wake_one(&m->wait, reschedule, NO_ERROR);
+        mutex_pi_unlend_all(m);
+        wait_queue_wake_highest(&m->wait, reschedule, NO_ERROR);
     }
 }
@@ -0,0 +1,215 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <kernel/rcu.h>
+
+#include <assert.h>
+#include <debug.h>
+#include <err.h>
+#include <arch/ops.h>
+#include <kernel/event.h>
+#include <kernel/mutex.h>
+#include <kernel/spinlock.h>
+#include <kernel/thread.h>
+#include <lib/dpc.h>
+#include <lk/init.h>
+
+/* how long rcu_synchronize() sleeps between looks at an epoch it drains */
+#define RCU_DRAIN_POLL LK_USEC(100)
+
+/* one cache line aligned block per cpu, so readers on different cpus don't
+ * share a line */
+struct rcu_cpu {
+    /* read-side critical sections begun on this cpu in each epoch, less those
+     * ended. a section may end on another cpu, but it gives back its count to
+     * the slot it took it from, so only sums over all cpus mean anything */
+    int64_t readers[2];
+
+    spin_lock_t lock;
+    /* callbacks queued on this cpu that no grace period has taken yet */
+    rcu_head_t *pending;
+    rcu_head_t **pending_tail;
+    /* callbacks whose grace period is over, run by |dpc| */
+    rcu_head_t *done;
+    rcu_head_t **done_tail;
+    dpc_t dpc;
+} __CPU_ALIGN;
+
+static struct rcu_cpu rcu_cpu[SMP_MAX_CPUS];
+
+/* the epoch new read-side critical sections are counted in, only the low bit
+ * is used */
+static uint32_t rcu_epoch;
+
+/* serializes grace periods */
+static mutex_t rcu_gp_lock = MUTEX_INITIAL_VALUE(rcu_gp_lock);
+
+/* wakes the grace period thread when callbacks are queued */
+static event_t rcu_gp_event = EVENT_INITIAL_VALUE(rcu_gp_event, false, EVENT_FLAG_AUTOUNSIGNAL);
+
+rcu_token_t rcu_read_lock(void)
+{
+    uint cpu = arch_curr_cpu_num();
+    uint epoch = __atomic_load_n(&rcu_epoch, __ATOMIC_RELAXED) & 1u;
+    __atomic_fetch_add(&rcu_cpu[cpu].readers[epoch], 1, __ATOMIC_RELAXED);
+    /* order the count before any load of protected data */
+    smp_mb();
+    return (cpu << 1) | epoch;
+}
+
+void rcu_read_unlock(rcu_token_t token)
+{
+    /* order all uses of protected data before the count */
+    smp_mb();
+    __atomic_fetch_sub(&rcu_cpu[token >> 1].readers[token & 1u], 1, __ATOMIC_RELAXED);
+}
+
+static int64_t rcu_readers(uint epoch)
+{
+    int64_t sum = 0;
+    for (uint cpu = 0; cpu < arch_max_num_cpus(); cpu++)
+        sum += __atomic_load_n(&rcu_cpu[cpu].readers[epoch], __ATOMIC_RELAXED);
+    return sum;
+}
+
+bool rcu_read_active(void)
+{
+    /* order the unpublishing before the sampling */
+    smp_mb();
+    return rcu_readers(0) != 0 || rcu_readers(1) != 0;
+}
+
+void rcu_synchronize(void)
+{
+    DEBUG_ASSERT(!arch_in_int_handler());
+
+    /* with no reader at all, any that comes later can't see what was
+     * unpublished */
+    if (!rcu_read_active())
+        return;
+
+    mutex_acquire(&rcu_gp_lock);
+    /* a reader that loaded the epoch just before a flip is counted in the
+     * old epoch after its drain saw it empty, and may still see what was
+     * unpublished before the flip. draining both epochs in turn catches it */
+    for (int i = 0; i < 2; i++) {
+        uint old_epoch = __atomic_fetch_add(&rcu_epoch, 1u, __ATOMIC_RELAXED) & 1u;
+        smp_mb();
+        while (rcu_readers(old_epoch) != 0)
+            thread_sleep_relative(RCU_DRAIN_POLL);
+        smp_mb();
+    }
+    mutex_release(&rcu_gp_lock);
+}
+
+void rcu_call(rcu_head_t *head, rcu_callback_t func)
+{
+    DEBUG_ASSERT(func);
+
+    head->next = NULL;
+    head->func = func;
+
+    /* no migrating between picking the queue and locking it */
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    struct rcu_cpu *c = &rcu_cpu[arch_curr_cpu_num()];
+    spin_lock(&c->lock);
+    *c->pending_tail = head;
+    c->pending_tail = &head->next;
+    spin_unlock(&c->lock);
+
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    event_signal(&rcu_gp_event, false);
+}
+
+/* runs the callbacks of one cpu whose grace period is over */
+static void rcu_run_callbacks(dpc_t *dpc)
+{
+    struct rcu_cpu *c = dpc->arg;
+
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&c->lock, state);
+    rcu_head_t *head = c->done;
+    c->done = NULL;
+    c->done_tail = &c->done;
+    spin_unlock_irqrestore(&c->lock, state);
+
+    while (head) {
+        rcu_head_t *next = head->next;
+        head->func(head);
+        head = next;
+    }
+}
+
+static int rcu_gp_thread(void *arg)
+{
+    for (;;) {
+        event_wait(&rcu_gp_event);
+
+        /* take what every cpu has queued, one grace period covers it all.
+         * whatever is queued meanwhile waits for the next one */
+        rcu_head_t *batch[SMP_MAX_CPUS];
+        rcu_head_t **batch_tail[SMP_MAX_CPUS];
+        bool any = false;
+        for (uint cpu = 0; cpu < arch_max_num_cpus(); cpu++) {
+            struct rcu_cpu *c = &rcu_cpu[cpu];
+            spin_lock_saved_state_t state;
+            spin_lock_irqsave(&c->lock, state);
+            batch[cpu] = c->pending;
+            batch_tail[cpu] = c->pending_tail;
+            c->pending = NULL;
+            c->pending_tail = &c->pending;
+            spin_unlock_irqrestore(&c->lock, state);
+            any |= (batch[cpu] != NULL);
+        }
+        if (!any)
+            continue;
+
+        rcu_synchronize();
+
+        for (uint cpu = 0; cpu < arch_max_num_cpus(); cpu++) {
+            if (!batch[cpu])
+                continue;
+            struct rcu_cpu *c = &rcu_cpu[cpu];
+            spin_lock_saved_state_t state;
+            spin_lock_irqsave(&c->lock, state);
+            *c->done_tail = batch[cpu];
+            c->done_tail = batch_tail[cpu];
+            spin_unlock_irqrestore(&c->lock, state);
+            dpc_queue_on(&c->dpc, cpu, false);
+        }
+    }
+    return 0;
+}
+
+static void rcu_init_early(uint level)
+{
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        struct rcu_cpu *c = &rcu_cpu[cpu];
+        spin_lock_init(&c->lock);
+        c->pending = NULL;
+        c->pending_tail = &c->pending;
+        c->done = NULL;
+        c->done_tail = &c->done;
+        list_clear_node(&c->dpc.node);
+        c->dpc.func = rcu_run_callbacks;
+        c->dpc.arg = c;
+    }
+}
+
+static void rcu_init(uint level)
+{
+    thread_t *t = thread_create("rcu gp", rcu_gp_thread, NULL, HIGH_PRIORITY,
+                                DEFAULT_STACK_SIZE);
+    if (!t)
+        panic("unable to create rcu grace period thread\n");
+    thread_detach_and_resume(t);
+}
+
+LK_INIT_HOOK(rcu_early, rcu_init_early, LK_INIT_LEVEL_EARLIEST);
+LK_INIT_HOOK(rcu, rcu_init, LK_INIT_LEVEL_THREADING);
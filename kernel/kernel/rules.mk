@@ -11,22 +11,40 @@ MODULE := $(LOCAL_DIR)
 
 MODULE_DEPS := \
 	kernel/lib/debug \
+	kernel/lib/dpc \
 	kernel/lib/heap \
 	kernel/lib/libc \
 	kernel/lib/mxtl \
 
 
 MODULE_SRCS := \
+	$(LOCAL_DIR)/cpufreq.c \
 	$(LOCAL_DIR)/debug.c \
 	$(LOCAL_DIR)/event.c \
 	$(LOCAL_DIR)/init.c \
 	$(LOCAL_DIR)/mutex.c \
+	$(LOCAL_DIR)/rcu.c \
+	$(LOCAL_DIR)/rwlock.c \
 	$(LOCAL_DIR)/sched.c \
+	$(LOCAL_DIR)/spinlock.c \
 	$(LOCAL_DIR)/thread.c \
 	$(LOCAL_DIR)/timer.c \
 	$(LOCAL_DIR)/mp.c \
 	$(LOCAL_DIR)/cmdline.c \
 
+# timing every lock acquire costs too much to leave on, so lock statistics
+# are only built in with LOCK_STATS=true
+ifeq ($(call TOBOOL,$(LOCK_STATS)),true)
+KERNEL_DEFINES += WITH_LOCK_STATS=1
+MODULE_SRCS += $(LOCAL_DIR)/lockstat.c
+endif
+
+# the irqsoff tracer is cheap enough for performance builds, but not free
+ifeq ($(call TOBOOL,$(IRQSOFF_TRACE)),true)
+KERNEL_DEFINES += WITH_IRQSOFF_TRACE=1
+MODULE_SRCS += $(LOCAL_DIR)/irqsoff.c
+endif
+
 MODULE_DEPS += kernel/kernel/vm
 
 MDI_INCLUDES += kernel/include/mdi/kernel-defs.mdi
@@ -0,0 +1,115 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <kernel/rwlock.h>
+#include <debug.h>
+#include <assert.h>
+#include <err.h>
+#include <kernel/thread.h>
+
+void rwlock_init(rwlock_t *l)
+{
+    *l = (rwlock_t)RWLOCK_INITIAL_VALUE(*l);
+}
+
+void rwlock_destroy(rwlock_t *l)
+{
+    DEBUG_ASSERT(l->magic == RWLOCK_MAGIC);
+    DEBUG_ASSERT(!arch_in_int_handler());
+
+    THREAD_LOCK(state);
+#if LK_DEBUGLEVEL > 0
+    if (unlikely(l->writer || l->readers > 0)) {
+        panic("rwlock_destroy: thread %p (%s) tried to destroy locked rwlock %p,"
+              " writer %p, %d readers\n",
+              get_current_thread(), get_current_thread()->name, l, l->writer, l->readers);
+    }
+#endif
+    l->magic = 0;
+    wait_queue_destroy(&l->reader_wait);
+    wait_queue_destroy(&l->writer_wait);
+    THREAD_UNLOCK(state);
+}
+
+static void rwlock_block(rwlock_t *l, wait_queue_t *wait)
+{
+    status_t ret = wait_queue_block(wait, INFINITE_TIME);
+    if (unlikely(ret < NO_ERROR)) {
+        /* like mutexes these are not interruptable and cannot time out */
+        panic("rwlock: wait_queue_block returns with error %d l %p, thr %p\n",
+              ret, l, get_current_thread());
+    }
+}
+
+void rwlock_acquire_read(rwlock_t *l)
+{
+    DEBUG_ASSERT(l->magic == RWLOCK_MAGIC);
+    DEBUG_ASSERT(!arch_in_int_handler());
+    DEBUG_ASSERT(l->writer != get_current_thread());
+
+    THREAD_LOCK(state);
+    while (l->writer || l->waiting_writers > 0)
+        rwlock_block(l, &l->reader_wait);
+    l->readers++;
+    THREAD_UNLOCK(state);
+}
+
+void rwlock_release_read(rwlock_t *l)
+{
+    DEBUG_ASSERT(l->magic == RWLOCK_MAGIC);
+    DEBUG_ASSERT(!arch_in_int_handler());
+
+    THREAD_LOCK(state);
+    DEBUG_ASSERT(l->readers > 0);
+    if (--l->readers == 0 && l->waiting_writers > 0)
+        wait_queue_wake_one(&l->writer_wait, true, NO_ERROR);
+    THREAD_UNLOCK(state);
+}
+
+void rwlock_acquire_write(rwlock_t *l)
+{
+    DEBUG_ASSERT(l->magic == RWLOCK_MAGIC);
+    DEBUG_ASSERT(!arch_in_int_handler());
+
+#if LK_DEBUGLEVEL > 0
+    if (unlikely(get_current_thread() == l->writer))
+        panic("rwlock_acquire_write: thread %p (%s) tried to acquire rwlock %p it already owns.\n",
+              get_current_thread(), get_current_thread()->name, l);
+#endif
+
+    THREAD_LOCK(state);
+    l->waiting_writers++;
+    while (l->writer || l->readers > 0)
+        rwlock_block(l, &l->writer_wait);
+    l->waiting_writers--;
+    l->writer = get_current_thread();
+    THREAD_UNLOCK(state);
+}
+
+void rwlock_release_write(rwlock_t *l)
+{
+    DEBUG_ASSERT(l->magic == RWLOCK_MAGIC);
+    DEBUG_ASSERT(!arch_in_int_handler());
+
+#if LK_DEBUGLEVEL > 0
+    if (unlikely(get_current_thread() != l->writer)) {
+        panic("rwlock_release_write: thread %p (%s) tried to release rwlock %p it doesn't own. "
+              "owned by %p\n",
+              get_current_thread(), get_current_thread()->name, l, l->writer);
+    }
+#endif
+
+    THREAD_LOCK(state);
+    l->writer = NULL;
+
+    /* hand off to the next writer if there is one, readers queued behind it
+     * get their turn once the writers have drained */
+    if (l->waiting_writers > 0)
+        wait_queue_wake_one(&l->writer_wait, true, NO_ERROR);
+    else
+        wait_queue_wake_all(&l->reader_wait, true, NO_ERROR);
+    THREAD_UNLOCK(state);
+}
@@ -13,32 +13,22 @@
 #include <string.h>
 #include <printf.h>
 #include <err.h>
+#include <kernel/cpufreq.h>
 #include <kernel/mp.h>
+#include <kernel/percpu.h>
+#include <kernel/sched_group.h>
 #include <kernel/thread.h>
+#include <platform.h>
+#include <kernel/timer.h>
 
-/* legacy implementation that just broadcast ipis for every reschedule */
-#define BROADCAST_RESCHEDULE 0
-
-/* the run queue */
-static struct list_node run_queue[NUM_PRIORITIES];
-static uint32_t run_queue_bitmap;
-
-/* make sure the bitmap is large enough to cover our number of priorities */
-static_assert(NUM_PRIORITIES <= sizeof(run_queue_bitmap) * CHAR_BIT, "");
-
-/* pick a 'random' cpu */
-static mp_cpu_mask_t rand_cpu(const mp_cpu_mask_t mask)
+#if WITH_SMP
+/* pick a 'random' cpu out of the mask */
+static uint rand_cpu(const mp_cpu_mask_t mask)
 {
-    if (unlikely(mask == 0))
-        return 0;
-
-    /* check that the mask passed in has at least one bit set in the online mask */
-    mp_cpu_mask_t online = mp_get_online_mask();
-    if (unlikely((mask & online) == 0))
-        return 0;
+    DEBUG_ASSERT(mask != 0);
 
-    /* compute the highest online cpu */
-    uint highest_cpu = (sizeof(mp_cpu_mask_t) * CHAR_BIT - 1) - __builtin_clz(online);
+    /* compute the highest cpu in the mask */
+    uint highest_cpu = (sizeof(mp_cpu_mask_t) * CHAR_BIT - 1) - __builtin_clz(mask);
 
     /* not very random, round robins a bit through the mask until it gets a hit */
     for (;;) {
@@ -49,56 +39,577 @@ static mp_cpu_mask_t rand_cpu(const mp_cpu_mask_t mask)
             rot = 0;
 
         if ((1u << rot) & mask)
-            return (1u << rot);
+            return rot;
+    }
+}
+
+/* pick the cpu in the mask with the shortest run queue, preferring the
+ * thread's last cpu on a tie since it's likely to still be cache warm */
+static uint least_loaded_cpu(mp_cpu_mask_t mask, uint last_cpu)
+{
+    DEBUG_ASSERT(mask != 0);
+
+    uint best_cpu = (mask & (1u << last_cpu)) ? last_cpu : (uint)__builtin_ctz(mask);
+    uint best_len = percpu[best_cpu].run_queue_len;
+
+    while (mask) {
+        uint cpu = __builtin_ctz(mask);
+        mask &= ~(1u << cpu);
+
+        if (percpu[cpu].run_queue_len < best_len) {
+            best_cpu = cpu;
+            best_len = percpu[cpu].run_queue_len;
+        }
     }
+
+    return best_cpu;
 }
 
-/* find a cpu to wake up */
-static mp_cpu_mask_t find_cpu(thread_t *t)
+/* a thread that stopped running less than this long ago probably still has
+ * useful state in its last cpu's caches, and isn't worth moving just to
+ * balance queue lengths by one */
+#define SCHED_MIGRATION_COST LK_USEC(500)
+
+static bool thread_is_cache_hot(const thread_t *t, lk_time_t now)
 {
-#if BROADCAST_RESCHEDULE
-    return MP_CPU_ALL_BUT_LOCAL;
-#elif WITH_SMP
+    return now - t->last_stopped_running < SCHED_MIGRATION_COST;
+}
+
+/* return the subset of idle cpus whose smt siblings are all idle as well */
+static mp_cpu_mask_t idle_core_mask(mp_cpu_mask_t idle_cpu_mask)
+{
+    mp_cpu_mask_t result = 0;
+    mp_cpu_mask_t mask = idle_cpu_mask;
+
+    while (mask) {
+        uint cpu = __builtin_ctz(mask);
+        mask &= ~(1u << cpu);
+
+        mp_cpu_mask_t siblings = mp_get_smt_siblings(cpu) & mp_get_active_mask();
+        if ((siblings & idle_cpu_mask) == siblings)
+            result |= 1u << cpu;
+    }
+
+    return result;
+}
+#endif
+
+/* find a cpu to place a newly runnable thread on */
+static uint find_cpu(thread_t *t)
+{
+#if WITH_SMP
+    uint curr_cpu = arch_curr_cpu_num();
+
+    /* pinned threads can only ever run in one place */
+    if (unlikely(thread_pinned_cpu(t) >= 0))
+        return (uint)thread_pinned_cpu(t);
+
+    mp_cpu_mask_t active_cpu_mask = mp_get_active_mask();
+
+    /* early in boot no cpu may be marked active yet, so keep it local */
+    if (unlikely(active_cpu_mask == 0))
+        return curr_cpu;
+
     /* get the last cpu the thread ran on */
-    mp_cpu_mask_t last_ran_cpu_mask = (1u << thread_last_cpu(t));
+    uint last_cpu = thread_last_cpu(t);
+    mp_cpu_mask_t last_ran_cpu_mask = (1u << last_cpu);
 
     /* the current cpu */
-    mp_cpu_mask_t curr_cpu_mask = (1u << arch_curr_cpu_num());
+    mp_cpu_mask_t curr_cpu_mask = (1u << curr_cpu);
+
+    /* the cache domain we would like the thread to stay in: the one holding its
+     * working set if it ran recently, otherwise the one shared with its waker */
+    bool cache_hot = thread_is_cache_hot(t, current_time());
+    mp_cpu_mask_t affine_cpu_mask =
+        mp_get_cache_siblings(cache_hot ? last_cpu : curr_cpu) & active_cpu_mask;
 
     /* get a list of idle cpus */
-    mp_cpu_mask_t idle_cpu_mask = mp_get_idle_mask();
+    mp_cpu_mask_t idle_cpu_mask = mp_get_idle_mask() & active_cpu_mask;
     if (idle_cpu_mask != 0) {
         if (idle_cpu_mask & curr_cpu_mask) {
             /* the current cpu is idle, so run it here */
-            return 0;
+            return curr_cpu;
         }
 
         if (last_ran_cpu_mask & idle_cpu_mask) {
             /* the last core it ran on is idle and isn't the current cpu */
-            return last_ran_cpu_mask;
+            return last_cpu;
         }
 
+        /* prefer a whole idle core over an idle smt sibling of a busy cpu, but
+         * either is better than leaving the cache domain */
+        mp_cpu_mask_t idle_cores = idle_core_mask(idle_cpu_mask);
+        if (idle_cores & affine_cpu_mask)
+            return rand_cpu(idle_cores & affine_cpu_mask);
+        if (idle_cpu_mask & affine_cpu_mask)
+            return rand_cpu(idle_cpu_mask & affine_cpu_mask);
+        if (idle_cores)
+            return rand_cpu(idle_cores);
+
         /* pick an idle_cpu */
         return rand_cpu(idle_cpu_mask);
     }
 
-    /* no idle cpus */
-    if (last_ran_cpu_mask == curr_cpu_mask) {
-        /* the last cpu it ran on is us */
-        /* pick a random cpu that isn't the current one */
-        return rand_cpu(mp_get_online_mask() & ~(curr_cpu_mask));
-    } else {
-        /* pick the last cpu it ran on */
-        return last_ran_cpu_mask;
+    /* no idle cpus. queue it wherever the least work is waiting, but not on
+     * the current cpu since nothing would preempt us to run it */
+    mp_cpu_mask_t remote_cpu_mask = active_cpu_mask & ~curr_cpu_mask;
+    if (remote_cpu_mask == 0)
+        return curr_cpu;
+
+    uint best_cpu = least_loaded_cpu(remote_cpu_mask, last_cpu);
+    uint best_len = percpu[best_cpu].run_queue_len;
+
+    /* a cache hot thread stays put unless its old cpu is noticeably busier */
+    if (cache_hot && (remote_cpu_mask & last_ran_cpu_mask) &&
+        percpu[last_cpu].run_queue_len <= best_len + 1)
+        return last_cpu;
+
+    /* otherwise stay inside the cache domain if that costs at most one extra queued thread */
+    if (remote_cpu_mask & affine_cpu_mask) {
+        uint affine_cpu = least_loaded_cpu(remote_cpu_mask & affine_cpu_mask, last_cpu);
+        if (percpu[affine_cpu].run_queue_len <= best_len + 1)
+            return affine_cpu;
     }
+
+    return best_cpu;
 #else /* !WITH_SMP */
-    /* no smp, dont send an IPI */
     return 0;
 #endif
 }
 
+/* deadline class */
+
+/* reservations are tracked as fractions of a cpu in this fixed point format */
+#define DEADLINE_BW_SHIFT 20
+#define DEADLINE_BW_ONE (1ULL << DEADLINE_BW_SHIFT)
+
+/* never hand out more than this much of each cpu to deadline class threads,
+ * so the priority class is guaranteed to make progress */
+#define DEADLINE_BW_MAX_PER_CPU ((DEADLINE_BW_ONE * 3) / 4)
+
+/* shortest period we accept, to bound the timer interrupt rate */
+#define DEADLINE_MIN_PERIOD LK_USEC(100)
+
+/* longest period we accept; capacity <= period, so this also keeps
+ * capacity * DEADLINE_BW_ONE well inside 64 bits */
+#define DEADLINE_MAX_PERIOD LK_SEC(1)
+static_assert(DEADLINE_MAX_PERIOD <= UINT64_MAX / DEADLINE_BW_ONE, "");
+
+/* total bandwidth reserved by all deadline threads, protected by THREAD_LOCK */
+static uint64_t deadline_bandwidth;
+
+/* start a fresh reservation for a deadline thread */
+static void deadline_reset(thread_t *t, lk_time_t now)
+{
+    t->deadline.abs_deadline = now + t->deadline.params.deadline;
+    t->deadline.remaining = (int64_t)t->deadline.params.capacity;
+}
+
+/* the budget has been refilled at the end of a reservation, move on to the
+ * next one. overruns are carried into the next reservation */
+static void deadline_replenish(thread_t *t, lk_time_t now)
+{
+    t->deadline.abs_deadline += t->deadline.params.period;
+    t->deadline.remaining += (int64_t)t->deadline.params.capacity;
+    if (t->deadline.remaining > (int64_t)t->deadline.params.capacity)
+        t->deadline.remaining = (int64_t)t->deadline.params.capacity;
+
+    /* if the thread fell behind by more than a period, don't let it run on
+     * a deadline in the past */
+    if (t->deadline.abs_deadline <= now)
+        deadline_reset(t, now);
+}
+
+/* constant bandwidth server wakeup rule. a thread coming back from being blocked
+ * can keep its current reservation only if running the remaining budget before
+ * the current deadline wouldn't exceed its reserved bandwidth */
+static void deadline_wakeup(thread_t *t, lk_time_t now)
+{
+    if (t->deadline.remaining <= 0)
+        return; /* still owes time, deadline_enqueue will throttle it */
+
+    if (now >= t->deadline.abs_deadline) {
+        deadline_reset(t, now);
+        return;
+    }
+
+    uint64_t remaining = (uint64_t)t->deadline.remaining;
+    uint64_t left = t->deadline.abs_deadline - now;
+
+    /* remaining / left > capacity / period, cross multiplied */
+    if (remaining * t->deadline.params.period > left * t->deadline.params.capacity)
+        deadline_reset(t, now);
+}
+
+/* sched groups */
+
+/* how much of a group's pool a cpu takes at once. smaller means a group's
+ * threads can spread over more cpus before running out, larger means fewer
+ * trips to the pool */
+#define SCHED_GROUP_CPU_SLICE LK_MSEC(5)
+
+/* time slices scaled by group weights stay within this range */
+#define SCHED_GROUP_MIN_TIME_SLICE LK_MSEC(1)
+#define SCHED_GROUP_MAX_TIME_SLICE LK_MSEC(500)
+
+/* start a new period once the current one is over */
+static void group_refresh(struct sched_group *g, lk_time_t now)
+{
+    if (now < g->period_end)
+        return;
+
+    /* unused quota isn't carried over, and neither are periods nobody was around for */
+    g->period_end += g->period;
+    if (g->period_end <= now)
+        g->period_end = now + g->period;
+    g->pool = (int64_t)g->quota;
+    g->period_gen++;
+}
+
+/* make sure the cpu has some of the group's runtime, taking more from the pool
+ * if it has used up its share. returns false once the pool is dry */
+static bool group_take_runtime(struct sched_group *g, uint cpu, lk_time_t now)
+{
+    group_refresh(g, now);
+
+    struct sched_group_cpu *gc = &g->cpu[cpu];
+    if (gc->period_gen != g->period_gen) {
+        /* left over from an earlier period, or a cpu that overran into it */
+        gc->runtime = 0;
+        gc->period_gen = g->period_gen;
+    }
+    if (gc->runtime > 0)
+        return true;
+    if (g->pool <= 0)
+        return false;
+
+    /* pay back any overrun out of what is taken */
+    int64_t take = MIN(g->pool, (int64_t)SCHED_GROUP_CPU_SLICE - gc->runtime);
+    g->pool -= take;
+    gc->runtime += take;
+    return gc->runtime > 0;
+}
+
+/* whether a thread's groups all have runtime left for it on this cpu */
+static bool group_can_run(thread_t *t, uint cpu, lk_time_t now)
+{
+    for (struct sched_group *g = t->sched_group; g; g = g->parent) {
+        if (g->quota != 0 && !group_take_runtime(g, cpu, now))
+            return false;
+    }
+    return true;
+}
+
+/* charge the time a thread has run to all of its groups. only the running
+ * cpu's share is touched, which the next group_take_runtime settles up */
+static void group_charge(thread_t *t, lk_time_t now)
+{
+    lk_time_t delta = now - t->group_last_charge;
+    t->group_last_charge = now;
+
+    uint cpu = arch_curr_cpu_num();
+    for (struct sched_group *g = t->sched_group; g; g = g->parent) {
+        if (g->quota != 0)
+            g->cpu[cpu].runtime -= (int64_t)delta;
+    }
+}
+
+/* a thread pulled off a run queue may only run if its groups have quota left,
+ * otherwise it waits on the cpu's throttled queue for the next period */
+static bool group_admit(uint cpu, thread_t *t)
+{
+    if (likely(!t->sched_group) || thread_is_deadline(t))
+        return true;
+
+    lk_time_t now = current_time();
+    if (group_can_run(t, cpu, now))
+        return true;
+
+    for (struct sched_group *g = t->sched_group; g; g = g->parent)
+        g->throttle_count++;
+
+    t->run_queue_cpu = cpu;
+    t->group_throttled = true;
+    list_add_tail(&percpu[cpu].group_throttled_queue, &t->queue_node);
+    THREAD_STATS_INC(group_throttles);
+    return false;
+}
+
+static enum handler_return group_timer_tick(timer_t *timer, lk_time_t now, void *arg)
+{
+    /* the reschedule charges the running thread and releases throttled threads */
+    return INT_RESCHEDULE;
+}
+
+/* arm the local group timer for when the new thread uses up this cpu's share
+ * of its groups' runtime, or when a throttled thread's groups are refilled */
+static void group_update_timer(uint cpu, thread_t *newthread, lk_time_t now)
+{
+    struct percpu *c = &percpu[cpu];
+    lk_time_t next = INFINITE_TIME;
+
+    if (newthread->sched_group && !thread_is_deadline(newthread)) {
+        for (struct sched_group *g = newthread->sched_group; g; g = g->parent) {
+            if (g->quota != 0)
+                next = MIN(next, now + (lk_time_t)MAX(g->cpu[cpu].runtime, 0));
+        }
+    }
+
+    thread_t *t;
+    list_for_every_entry(&c->group_throttled_queue, t, thread_t, queue_node) {
+        for (struct sched_group *g = t->sched_group; g; g = g->parent) {
+            if (g->quota != 0)
+                next = MIN(next, g->period_end);
+        }
+    }
+
+    if (next == c->group_timer_time)
+        return;
+
+    if (next == INFINITE_TIME) {
+        timer_cancel(&c->group_timer);
+    } else {
+        timer_set_oneshot(&c->group_timer, next, group_timer_tick, NULL);
+    }
+    c->group_timer_time = next;
+}
+
+lk_time_t sched_time_slice(const thread_t *t, lk_time_t base)
+{
+    if (likely(!t->sched_group))
+        return base;
+
+    lk_time_t slice = base;
+    for (const struct sched_group *g = t->sched_group; g; g = g->parent) {
+        slice = slice * g->weight / SCHED_GROUP_WEIGHT_DEFAULT;
+        slice = MIN(MAX(slice, SCHED_GROUP_MIN_TIME_SLICE), SCHED_GROUP_MAX_TIME_SLICE);
+    }
+    return slice;
+}
+
+void sched_group_init(struct sched_group *g, struct sched_group *parent)
+{
+    memset(g, 0, sizeof(*g));
+    g->parent = parent;
+    g->weight = SCHED_GROUP_WEIGHT_DEFAULT;
+}
+
+status_t sched_group_set(struct sched_group *g, uint32_t weight,
+                         lk_time_t quota, lk_time_t period)
+{
+    if (weight == 0 || weight > SCHED_GROUP_WEIGHT_MAX)
+        return ERR_INVALID_ARGS;
+    if (quota != 0 && (period < SCHED_GROUP_MIN_PERIOD || period > SCHED_GROUP_MAX_PERIOD ||
+                       quota < SCHED_GROUP_MIN_QUOTA))
+        return ERR_INVALID_ARGS;
+
+    THREAD_LOCK(state);
+
+    g->weight = weight;
+    g->quota = quota;
+    g->period = quota ? period : 0;
+
+    /* start over with a full period */
+    lk_time_t now = current_time();
+    g->pool = (int64_t)quota;
+    g->period_end = now + g->period;
+    g->period_gen++;
+
+    /* let every cpu look at its throttled threads again */
+    mp_reschedule(mp_get_active_mask(), 0);
+
+    THREAD_UNLOCK(state);
+
+    return NO_ERROR;
+}
+
+void thread_set_sched_group(thread_t *t, struct sched_group *g)
+{
+    DEBUG_ASSERT(t->magic == THREAD_MAGIC);
+
+    THREAD_LOCK(state);
+    DEBUG_ASSERT(t->state == THREAD_INITIAL);
+    t->sched_group = g;
+    THREAD_UNLOCK(state);
+}
+
+/* charge the current thread for the time it has run since it was last charged */
+static void charge_current_thread(thread_t *t, lk_time_t now)
+{
+    if (unlikely(t->sched_group))
+        group_charge(t, now);
+
+    if (likely(!thread_is_deadline(t)))
+        return;
+
+    lk_time_t delta = now - t->deadline.last_charge;
+    t->deadline.remaining -= (int64_t)delta;
+    t->deadline.last_charge = now;
+
+    thread_stats[arch_curr_cpu_num()].deadline_time += delta;
+}
+
+static void insert_sorted(struct list_node *list, thread_t *t, lk_time_t key,
+                          lk_time_t (*key_of)(const thread_t *))
+{
+    thread_t *entry;
+    list_for_every_entry(list, entry, thread_t, queue_node) {
+        if (key < key_of(entry)) {
+            list_add_before(&entry->queue_node, &t->queue_node);
+            return;
+        }
+    }
+    list_add_tail(list, &t->queue_node);
+}
+
+static lk_time_t deadline_key(const thread_t *t)
+{
+    return t->deadline.abs_deadline;
+}
+
+static void deadline_enqueue(uint cpu, thread_t *t, lk_time_t now)
+{
+    struct percpu *c = &percpu[cpu];
+
+    if (t->deadline.remaining <= 0) {
+        if (now < t->deadline.abs_deadline) {
+            /* out of budget until the end of the current reservation */
+            t->deadline.throttled = true;
+            insert_sorted(&c->throttled_queue, t, t->deadline.abs_deadline, deadline_key);
+            THREAD_STATS_INC(deadline_throttles);
+            return;
+        }
+        deadline_replenish(t, now);
+    }
+
+    t->deadline.throttled = false;
+    insert_sorted(&c->deadline_queue, t, t->deadline.abs_deadline, deadline_key);
+    c->run_queue_len++;
+}
+
+/* move any throttled threads whose reservation has ended back to the deadline queue */
+static void deadline_release_throttled(uint cpu, lk_time_t now)
+{
+    struct percpu *c = &percpu[cpu];
+
+    thread_t *t;
+    while ((t = list_peek_head_type(&c->throttled_queue, thread_t, queue_node))) {
+        if (t->deadline.abs_deadline > now)
+            break;
+
+        list_delete(&t->queue_node);
+        deadline_replenish(t, now);
+        t->deadline.throttled = false;
+        insert_sorted(&c->deadline_queue, t, t->deadline.abs_deadline, deadline_key);
+        c->run_queue_len++;
+    }
+}
+
+static enum handler_return deadline_timer_tick(timer_t *timer, lk_time_t now, void *arg)
+{
+    /* the reschedule charges the running thread and releases throttled threads */
+    return INT_RESCHEDULE;
+}
+
+/* arm the local deadline timer for the next budget exhaustion or replenishment */
+static void deadline_update_timer(uint cpu, thread_t *newthread, lk_time_t now)
+{
+    struct percpu *c = &percpu[cpu];
+    lk_time_t next = INFINITE_TIME;
+
+    if (thread_is_deadline(newthread))
+        next = now + (lk_time_t)MAX(newthread->deadline.remaining, 0);
+
+    thread_t *t = list_peek_head_type(&c->throttled_queue, thread_t, queue_node);
+    if (t && t->deadline.abs_deadline < next)
+        next = t->deadline.abs_deadline;
+
+    if (next == c->deadline_timer_time)
+        return;
+
+    if (next == INFINITE_TIME) {
+        timer_cancel(&c->deadline_timer);
+    } else {
+        timer_set_oneshot(&c->deadline_timer, next, deadline_timer_tick, NULL);
+    }
+    c->deadline_timer_time = next;
+}
+
+/* find a cpu for a newly runnable deadline thread: an idle one if possible,
+ * otherwise the one whose current work is least urgent */
+static uint find_cpu_deadline(thread_t *t)
+{
+#if WITH_SMP
+    uint curr_cpu = arch_curr_cpu_num();
+
+    if (unlikely(thread_pinned_cpu(t) >= 0))
+        return (uint)thread_pinned_cpu(t);
+
+    mp_cpu_mask_t active_cpu_mask = mp_get_active_mask();
+    if (unlikely(active_cpu_mask == 0) || (mp_get_idle_mask() & active_cpu_mask))
+        return find_cpu(t);
+
+    mp_cpu_mask_t mask = active_cpu_mask & ~(1u << curr_cpu);
+    if (mask == 0)
+        return curr_cpu;
+
+    uint best_cpu = thread_last_cpu(t);
+    lk_time_t best_deadline = 0;
+    uint best_len = UINT_MAX;
+    while (mask) {
+        uint cpu = __builtin_ctz(mask);
+        mask &= ~(1u << cpu);
+
+        /* prefer cpus running the priority class (infinite deadline), then later
+         * deadlines, then fewer queued threads */
+        lk_time_t d = percpu[cpu].curr_deadline;
+        uint len = percpu[cpu].run_queue_len;
+        if (d > best_deadline || (d == best_deadline && len < best_len)) {
+            best_cpu = cpu;
+            best_deadline = d;
+            best_len = len;
+        }
+    }
+
+    return best_cpu;
+#else
+    return 0;
+#endif
+}
+
+/* the current thread has armed a handoff and is about to give up the cpu, so
+ * the thread it wakes should run right here rather than wherever it last ran */
+static bool take_handoff(thread_t *t)
+{
+    thread_t *current_thread = get_current_thread();
+
+    if (likely(!(current_thread->flags & THREAD_FLAG_HANDOFF)) || arch_in_int_handler())
+        return false;
+    if (thread_is_deadline(t) || thread_is_deadline(current_thread))
+        return false;
+
+    uint cpu = arch_curr_cpu_num();
+    if (thread_pinned_cpu(t) >= 0 && (uint)thread_pinned_cpu(t) != cpu)
+        return false;
+
+    /* only the first thread woken gets the cpu */
+    current_thread->flags &= ~THREAD_FLAG_HANDOFF;
+    return true;
+}
+
+/* a blocked thread is becoming runnable, pick where it should run */
+static uint wakeup_thread(thread_t *t)
+{
+    if (unlikely(thread_is_deadline(t))) {
+        deadline_wakeup(t, current_time());
+        return find_cpu_deadline(t);
+    }
+
+    return find_cpu(t);
+}
+
 /* run queue manipulation */
-static void insert_in_run_queue_head(thread_t *t)
+static void insert_in_run_queue_head(uint cpu, thread_t *t)
 {
     DEBUG_ASSERT(t->magic == THREAD_MAGIC);
     DEBUG_ASSERT(t->state == THREAD_READY);
@@ -106,11 +617,21 @@ static void insert_in_run_queue_head(thread_t *t)
     DEBUG_ASSERT(arch_ints_disabled());
     DEBUG_ASSERT(spin_lock_held(&thread_lock));
 
-    list_add_head(&run_queue[t->priority], &t->queue_node);
-    run_queue_bitmap |= (1<<t->priority);
+    t->run_queue_cpu = cpu;
+
+    if (unlikely(thread_is_deadline(t))) {
+        deadline_enqueue(cpu, t, current_time());
+        return;
+    }
+
+    struct percpu *c = &percpu[cpu];
+
+    list_add_head(&c->run_queue[t->priority], &t->queue_node);
+    c->run_queue_bitmap |= (1<<t->priority);
+    c->run_queue_len++;
 }
 
-static void insert_in_run_queue_tail(thread_t *t)
+static void insert_in_run_queue_tail(uint cpu, thread_t *t)
 {
     DEBUG_ASSERT(t->magic == THREAD_MAGIC);
     DEBUG_ASSERT(t->state == THREAD_READY);
@@ -118,54 +639,306 @@ static void insert_in_run_queue_tail(thread_t *t)
     DEBUG_ASSERT(arch_ints_disabled());
     DEBUG_ASSERT(spin_lock_held(&thread_lock));
 
-    list_add_tail(&run_queue[t->priority], &t->queue_node);
-    run_queue_bitmap |= (1<<t->priority);
+    t->run_queue_cpu = cpu;
+
+    if (unlikely(thread_is_deadline(t))) {
+        deadline_enqueue(cpu, t, current_time());
+        return;
+    }
+
+    struct percpu *c = &percpu[cpu];
+
+    list_add_tail(&c->run_queue[t->priority], &t->queue_node);
+    c->run_queue_bitmap |= (1<<t->priority);
+    c->run_queue_len++;
 }
 
-thread_t *sched_get_top_thread(uint cpu)
+static void remove_from_run_queue(uint cpu, thread_t *t)
 {
-    thread_t *newthread;
-    uint32_t local_run_queue_bitmap = run_queue_bitmap;
+    DEBUG_ASSERT(list_in_list(&t->queue_node));
 
-    while (local_run_queue_bitmap) {
-        /* find the first (remaining) queue with a thread in it */
-        uint next_queue = HIGHEST_PRIORITY - __builtin_clz(local_run_queue_bitmap)
-                          - (sizeof(run_queue_bitmap) * CHAR_BIT - NUM_PRIORITIES);
+    struct percpu *c = &percpu[cpu];
+
+    list_delete(&t->queue_node);
+
+    if (c->handoff_thread == t)
+        c->handoff_thread = NULL;
+
+    /* throttled threads aren't counted as runnable */
+    if (unlikely(t->group_throttled)) {
+        t->group_throttled = false;
+        return;
+    }
+
+    if (unlikely(thread_is_deadline(t))) {
+        if (t->deadline.throttled) {
+            t->deadline.throttled = false;
+            return;
+        }
+    } else if (list_is_empty(&c->run_queue[t->priority])) {
+        c->run_queue_bitmap &= ~(1<<t->priority);
+    }
+
+    DEBUG_ASSERT(c->run_queue_len > 0);
+    c->run_queue_len--;
+}
+
+/* put throttled threads whose groups have been refilled back on the run queue */
+static void group_release_throttled(uint cpu, lk_time_t now)
+{
+    struct percpu *c = &percpu[cpu];
+
+    thread_t *t, *temp;
+    list_for_every_entry_safe(&c->group_throttled_queue, t, temp, thread_t, queue_node) {
+        if (!group_can_run(t, cpu, now))
+            continue;
+
+        list_delete(&t->queue_node);
+        t->group_throttled = false;
+        insert_in_run_queue_tail(cpu, t);
+    }
+}
+
+static inline uint highest_run_queue(uint32_t bitmap)
+{
+    return HIGHEST_PRIORITY - __builtin_clz(bitmap)
+           - (sizeof(bitmap) * CHAR_BIT - NUM_PRIORITIES);
+}
+
+/* the current thread goes back on the local run queue, unless it is pinned elsewhere */
+static uint local_queue_cpu(thread_t *t)
+{
+    if (unlikely(thread_pinned_cpu(t) >= 0))
+        return (uint)thread_pinned_cpu(t);
+    return arch_curr_cpu_num();
+}
 
-        list_for_every_entry(&run_queue[next_queue], newthread, thread_t, queue_node) {
 #if WITH_SMP
-            if (likely(newthread->pinned_cpu < 0) || (uint)newthread->pinned_cpu == cpu)
+/* find the highest priority thread on another cpu's queue that is allowed to migrate */
+static thread_t *peek_stealable_thread(uint victim)
+{
+    uint32_t local_run_queue_bitmap = percpu[victim].run_queue_bitmap;
+
+    while (local_run_queue_bitmap) {
+        uint next_queue = highest_run_queue(local_run_queue_bitmap);
+
+        thread_t *t;
+        list_for_every_entry(&percpu[victim].run_queue[next_queue], t, thread_t, queue_node) {
+            if (likely(thread_pinned_cpu(t) < 0))
+                return t;
+        }
+
+        local_run_queue_bitmap &= ~(1<<next_queue);
+    }
+
+    return NULL;
+}
+
+/* find the earliest deadline thread on another cpu's deadline queue that is allowed to migrate */
+static thread_t *peek_stealable_deadline_thread(uint victim)
+{
+    thread_t *t;
+    list_for_every_entry(&percpu[victim].deadline_queue, t, thread_t, queue_node) {
+        if (likely(thread_pinned_cpu(t) < 0))
+            return t;
+    }
+
+    return NULL;
+}
+
+/* our queue is empty, take the most important migratable thread from another cpu */
+static thread_t *steal_thread(uint cpu)
+{
+    /* runnable deadline threads sitting behind another one come first */
+    thread_t *best_deadline = NULL;
+    uint best_deadline_cpu = 0;
+    for (uint victim = 0; victim < SMP_MAX_CPUS; victim++) {
+        if (victim == cpu || list_is_empty(&percpu[victim].deadline_queue))
+            continue;
+
+        thread_t *t = peek_stealable_deadline_thread(victim);
+        if (t && (!best_deadline ||
+                  t->deadline.abs_deadline < best_deadline->deadline.abs_deadline)) {
+            best_deadline = t;
+            best_deadline_cpu = victim;
+        }
+    }
+
+    if (best_deadline) {
+        remove_from_run_queue(best_deadline_cpu, best_deadline);
+        THREAD_STATS_INC(steals);
+        return best_deadline;
+    }
+
+    thread_t *best = NULL;
+    uint best_cpu = 0;
+    bool best_affine = false;
+    mp_cpu_mask_t cache_siblings = mp_get_cache_siblings(cpu);
+
+    /* take the highest priority thread available. among equals, pull from
+     * a cpu sharing our cache, then from the longest queue */
+    for (uint victim = 0; victim < SMP_MAX_CPUS; victim++) {
+        if (victim == cpu || percpu[victim].run_queue_len == 0)
+            continue;
+
+        thread_t *t = peek_stealable_thread(victim);
+        if (!t)
+            continue;
+
+        bool affine = !!(cache_siblings & (1u << victim));
+        if (!best || t->priority > best->priority ||
+            (t->priority == best->priority &&
+             (affine > best_affine ||
+              (affine == best_affine &&
+               percpu[victim].run_queue_len > percpu[best_cpu].run_queue_len)))) {
+            best = t;
+            best_cpu = victim;
+            best_affine = affine;
+        }
+    }
+
+    if (best) {
+        remove_from_run_queue(best_cpu, best);
+        THREAD_STATS_INC(steals);
+    }
+
+    return best;
+}
 #endif
-            {
-                list_delete(&newthread->queue_node);
 
-                if (list_is_empty(&run_queue[next_queue]))
-                    run_queue_bitmap &= ~(1<<next_queue);
+static thread_t *pick_local_thread(uint cpu)
+{
+    struct percpu *c = &percpu[cpu];
 
+    /* the deadline class runs ahead of the priority class */
+    thread_t *newthread = list_peek_head_type(&c->deadline_queue, thread_t, queue_node);
+    if (unlikely(newthread)) {
+        c->handoff_thread = NULL;
+        remove_from_run_queue(cpu, newthread);
+        return newthread;
+    }
+
+    /* a thread handed the cpu goes first unless that would run it ahead of
+     * something more important. if the thread handing off is blocking it also
+     * gets what is left of its time slice */
+    newthread = c->handoff_thread;
+    if (newthread) {
+        c->handoff_thread = NULL;
+        if (newthread->priority >= (int)highest_run_queue(c->run_queue_bitmap)) {
+            remove_from_run_queue(cpu, newthread);
+            if (likely(group_admit(cpu, newthread))) {
+                thread_t *current_thread = get_current_thread();
+                if (current_thread->state == THREAD_BLOCKED &&
+                    current_thread->remaining_time_slice > 0) {
+                    newthread->remaining_time_slice = current_thread->remaining_time_slice;
+                    current_thread->remaining_time_slice = 0;
+                }
+
+                THREAD_STATS_INC(handoffs);
                 return newthread;
             }
         }
+    }
 
-        local_run_queue_bitmap &= ~(1<<next_queue);
+    while (likely(c->run_queue_bitmap)) {
+        /* find the first queue with a thread in it. everything on our queue is
+         * either unpinned or pinned to us, so the head is always eligible */
+        uint next_queue = highest_run_queue(c->run_queue_bitmap);
+
+        newthread = list_peek_head_type(&c->run_queue[next_queue], thread_t, queue_node);
+        DEBUG_ASSERT(newthread);
+        DEBUG_ASSERT(thread_pinned_cpu(newthread) < 0 || (uint)thread_pinned_cpu(newthread) == cpu);
+
+        remove_from_run_queue(cpu, newthread);
+
+        /* unless its group is out of quota, then try the next one */
+        if (likely(group_admit(cpu, newthread)))
+            return newthread;
     }
+
+#if WITH_SMP
+    /* nothing local to run, go looking for work on other cpus. anything
+     * stolen that is out of quota stays throttled here */
+    thread_t *stolen;
+    while ((stolen = steal_thread(cpu))) {
+        if (likely(group_admit(cpu, stolen)))
+            return stolen;
+    }
+#endif
+
     /* no threads to run, select the idle thread for this cpu */
     return &idle_threads[cpu];
 }
 
+thread_t *sched_get_top_thread(uint cpu)
+{
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    struct percpu *c = &percpu[cpu];
+    bool deadline_active = !list_is_empty(&c->throttled_queue) ||
+                           c->deadline_timer_time != INFINITE_TIME;
+
+    bool group_active = !list_is_empty(&c->group_throttled_queue) ||
+                        c->group_timer_time != INFINITE_TIME;
+
+    lk_time_t now = 0;
+    if (unlikely(deadline_active || group_active)) {
+        now = current_time();
+        if (deadline_active)
+            deadline_release_throttled(cpu, now);
+        if (group_active)
+            group_release_throttled(cpu, now);
+    }
+
+    thread_t *newthread = pick_local_thread(cpu);
+
+    if (unlikely(newthread->sched_group)) {
+        if (!deadline_active && !group_active)
+            now = current_time();
+        newthread->group_last_charge = now;
+        group_active = true;
+    }
+
+    if (unlikely(thread_is_deadline(newthread))) {
+        if (!deadline_active && !group_active)
+            now = current_time();
+        newthread->deadline.last_charge = now;
+        c->curr_deadline = newthread->deadline.abs_deadline;
+        deadline_active = true;
+    } else {
+        c->curr_deadline = INFINITE_TIME;
+    }
+
+    if (unlikely(deadline_active))
+        deadline_update_timer(cpu, newthread, now);
+    if (unlikely(group_active))
+        group_update_timer(cpu, newthread, now);
+
+    return newthread;
+}
+
 void sched_block(void)
 {
-    __UNUSED thread_t *current_thread = get_current_thread();
+    thread_t *current_thread = get_current_thread();
 
     DEBUG_ASSERT(current_thread->magic == THREAD_MAGIC);
     DEBUG_ASSERT(spin_lock_held(&thread_lock));
     DEBUG_ASSERT(current_thread->state != THREAD_RUNNING);
 
-    // XXX deal with time slice fiddling here
+    charge_current_thread(current_thread, current_time());
 
     /* we are blocking on something. the blocking code should have already stuck us on a queue */
     thread_resched();
 }
 
+/* threads woken onto a busy cpu that others are already waiting on would
+ * queue up behind its utilization catching up, so have it speed up now */
+static void wakeup_boost(uint cpu)
+{
+    if (percpu[cpu].run_queue_len > 1 && !mp_is_cpu_idle(cpu))
+        cpufreq_boost(cpu);
+}
+
 void sched_unblock(thread_t *t, bool resched)
 {
     DEBUG_ASSERT(t->magic == THREAD_MAGIC);
@@ -178,15 +951,25 @@ void sched_unblock(thread_t *t, bool resched)
     if (resched) {
         thread_t *current_thread = get_current_thread();
 
+        charge_current_thread(current_thread, current_time());
         current_thread->state = THREAD_READY;
-        insert_in_run_queue_head(current_thread);
+        insert_in_run_queue_head(local_queue_cpu(current_thread), current_thread);
     }
 
-    /* stuff the new thread in the run queue */
+    /* stuff the new thread in the run queue of the cpu it should run on */
     t->state = THREAD_READY;
-    insert_in_run_queue_head(t);
+    t->last_woken = current_time();
+    if (take_handoff(t)) {
+        uint cpu = arch_curr_cpu_num();
+        insert_in_run_queue_head(cpu, t);
+        percpu[cpu].handoff_thread = t;
+    } else {
+        uint cpu = wakeup_thread(t);
+        insert_in_run_queue_head(cpu, t);
+        wakeup_boost(cpu);
 
-    mp_reschedule(find_cpu(t), 0);
+        mp_reschedule(1u << cpu, thread_is_deadline(t) ? MP_RESCHEDULE_FLAG_REALTIME : 0);
+    }
 
     if (resched)
         thread_resched();
@@ -204,23 +987,45 @@ void sched_unblock_list(struct list_node *list, bool resched)
     if (resched) {
         thread_t *current_thread = get_current_thread();
 
+        charge_current_thread(current_thread, current_time());
         current_thread->state = THREAD_READY;
-        insert_in_run_queue_head(current_thread);
+        insert_in_run_queue_head(local_queue_cpu(current_thread), current_thread);
     }
 
     /* pop the list of threads and shove into the scheduler */
+    mp_cpu_mask_t reschedule_mask = 0;
+    mp_cpu_mask_t realtime_reschedule_mask = 0;
+    lk_time_t now = current_time();
     thread_t *t;
     while ((t = list_remove_tail_type(list, thread_t, queue_node))) {
         DEBUG_ASSERT(t->magic == THREAD_MAGIC);
         DEBUG_ASSERT(!thread_is_idle(t));
 
-        /* stuff the new thread in the run queue */
+        /* stuff the new thread in the run queue of the cpu it should run on */
         t->state = THREAD_READY;
-        insert_in_run_queue_head(t);
+        t->last_woken = now;
+        if (take_handoff(t)) {
+            uint cpu = arch_curr_cpu_num();
+            insert_in_run_queue_head(cpu, t);
+            percpu[cpu].handoff_thread = t;
+            continue;
+        }
 
-        mp_reschedule(find_cpu(t), 0);
+        uint cpu = wakeup_thread(t);
+        insert_in_run_queue_head(cpu, t);
+        wakeup_boost(cpu);
+
+        if (thread_is_deadline(t)) {
+            realtime_reschedule_mask |= (1u << cpu);
+        } else {
+            reschedule_mask |= (1u << cpu);
+        }
     }
 
+    /* kick all of the cpus we queued work on at once */
+    mp_reschedule(reschedule_mask & ~realtime_reschedule_mask, 0);
+    mp_reschedule(realtime_reschedule_mask, MP_RESCHEDULE_FLAG_REALTIME);
+
     if (resched)
         thread_resched();
 }
@@ -231,10 +1036,11 @@ void sched_yield(void)
 
     /* we are yielding the cpu, so stick ourselves into the tail of the run queue and reschedule */
     thread_t *current_thread = get_current_thread();
+    charge_current_thread(current_thread, current_time());
     current_thread->state = THREAD_READY;
     current_thread->remaining_time_slice = 0;
     if (likely(!thread_is_idle(current_thread))) { /* idle thread doesn't go in the run queue */
-        insert_in_run_queue_tail(current_thread);
+        insert_in_run_queue_tail(local_queue_cpu(current_thread), current_thread);
     }
     thread_resched();
 }
@@ -244,20 +1050,160 @@ void sched_preempt(void)
     thread_t *current_thread = get_current_thread();
 
     /* we are being preempted, so we get to go back into the front of the run queue if we have quantum left */
+    charge_current_thread(current_thread, current_time());
     current_thread->state = THREAD_READY;
     if (likely(!thread_is_idle(current_thread))) { /* idle thread doesn't go in the run queue */
+        uint cpu = local_queue_cpu(current_thread);
         if (current_thread->remaining_time_slice > 0)
-            insert_in_run_queue_head(current_thread);
+            insert_in_run_queue_head(cpu, current_thread);
         else
-            insert_in_run_queue_tail(current_thread); /* if we're out of quantum, go to the tail of the queue */
+            insert_in_run_queue_tail(cpu, current_thread); /* if we're out of quantum, go to the tail of the queue */
     }
     sched_block();
 }
 
+#if WITH_SMP
+void sched_transition_off_cpu(uint old_cpu)
+{
+    THREAD_LOCK(state);
+
+    uint cpu = arch_curr_cpu_num();
+    DEBUG_ASSERT(cpu != old_cpu);
+
+    /* move every thread that is free to migrate off of old_cpu's queues and onto ours */
+    for (uint i = 0; i < NUM_PRIORITIES; i++) {
+        thread_t *t, *temp;
+        list_for_every_entry_safe(&percpu[old_cpu].run_queue[i], t, temp, thread_t, queue_node) {
+            if (thread_pinned_cpu(t) >= 0)
+                continue;
+
+            remove_from_run_queue(old_cpu, t);
+            insert_in_run_queue_tail(cpu, t);
+        }
+    }
+
+    struct list_node *other_queues[] = {
+        &percpu[old_cpu].deadline_queue,
+        &percpu[old_cpu].throttled_queue,
+        &percpu[old_cpu].group_throttled_queue,
+    };
+    for (uint i = 0; i < countof(other_queues); i++) {
+        thread_t *t, *temp;
+        list_for_every_entry_safe(other_queues[i], t, temp, thread_t, queue_node) {
+            if (thread_pinned_cpu(t) >= 0)
+                continue;
+
+            remove_from_run_queue(old_cpu, t);
+            insert_in_run_queue_tail(cpu, t);
+        }
+    }
+
+    THREAD_UNLOCK(state);
+}
+#endif
+
 void sched_init_early(void)
 {
     /* initialize the run queues */
-    for (int i=0; i < NUM_PRIORITIES; i++)
-        list_initialize(&run_queue[i]);
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        for (int i = 0; i < NUM_PRIORITIES; i++)
+            list_initialize(&percpu[cpu].run_queue[i]);
+        percpu[cpu].run_queue_bitmap = 0;
+        percpu[cpu].run_queue_len = 0;
+
+        list_initialize(&percpu[cpu].deadline_queue);
+        list_initialize(&percpu[cpu].throttled_queue);
+        percpu[cpu].curr_thread = NULL;
+        percpu[cpu].curr_deadline = INFINITE_TIME;
+        percpu[cpu].handoff_thread = NULL;
+        timer_initialize(&percpu[cpu].deadline_timer);
+        percpu[cpu].deadline_timer_time = INFINITE_TIME;
+
+        list_initialize(&percpu[cpu].group_throttled_queue);
+        timer_initialize(&percpu[cpu].group_timer);
+        percpu[cpu].group_timer_time = INFINITE_TIME;
+    }
+}
+
+void sched_set_priority(thread_t *t, int priority)
+{
+    DEBUG_ASSERT(t->magic == THREAD_MAGIC);
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    if (t->priority == priority)
+        return;
+
+    /* deadline threads ignore priorities, and anything not queued picks the
+     * new one up when it is next inserted */
+    if (t->state != THREAD_READY || thread_is_deadline(t) || !list_in_list(&t->queue_node)) {
+        t->priority = priority;
+        return;
+    }
+
+    uint cpu = t->run_queue_cpu;
+    remove_from_run_queue(cpu, t);
+    bool raised = priority > t->priority;
+    t->priority = priority;
+    insert_in_run_queue_tail(cpu, t);
+
+    if (raised)
+        mp_reschedule(1u << cpu, 0);
+}
+
+status_t sched_set_deadline(thread_t *t, const struct thread_deadline_params *params)
+{
+    DEBUG_ASSERT(t->magic == THREAD_MAGIC);
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    uint64_t bandwidth = 0;
+    if (params) {
+        if (params->capacity == 0 || params->capacity > params->deadline ||
+            params->deadline > params->period || params->period < DEADLINE_MIN_PERIOD ||
+            params->period > DEADLINE_MAX_PERIOD)
+            return ERR_INVALID_ARGS;
+
+        /* round up so many small reservations can't sneak past the limit */
+        bandwidth = (params->capacity * DEADLINE_BW_ONE + params->period - 1) / params->period;
+
+        uint64_t limit = DEADLINE_BW_MAX_PER_CPU * __builtin_popcount(mp_get_online_mask());
+        if (deadline_bandwidth - t->deadline.bandwidth + bandwidth > limit)
+            return ERR_NO_RESOURCES;
+    }
+
+    if (t->state == THREAD_DEATH)
+        return ERR_BAD_STATE;
+
+    /* pull a queued thread out so it can be requeued in its new class */
+    bool queued = (t->state == THREAD_READY) && list_in_list(&t->queue_node);
+    uint cpu = t->run_queue_cpu;
+    if (queued)
+        remove_from_run_queue(cpu, t);
+
+    lk_time_t now = current_time();
+    if (t == get_current_thread())
+        charge_current_thread(t, now);
+
+    deadline_bandwidth -= t->deadline.bandwidth;
+    if (params) {
+        deadline_bandwidth += bandwidth;
+        t->sched_class = SCHED_CLASS_DEADLINE;
+        t->deadline.params = *params;
+        t->deadline.bandwidth = bandwidth;
+        t->deadline.last_charge = now;
+        deadline_reset(t, now);
+    } else {
+        t->sched_class = SCHED_CLASS_PRIORITY;
+        memset(&t->deadline, 0, sizeof(t->deadline));
+    }
+
+    if (queued) {
+        insert_in_run_queue_head(cpu, t);
+        mp_reschedule(1u << cpu, MP_RESCHEDULE_FLAG_REALTIME);
+    } else if (t->state == THREAD_RUNNING && t != get_current_thread()) {
+        /* let the cpu it's on reevaluate what it should be running */
+        mp_reschedule(1u << thread_last_cpu(t), MP_RESCHEDULE_FLAG_REALTIME);
+    }
+
+    return NO_ERROR;
 }
 
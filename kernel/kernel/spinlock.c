@@ -0,0 +1,27 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <kernel/spinlock.h>
+
+#include <arch/ops.h>
+#include <kernel/thread.h>
+
+void spin_lock_contended(spin_lock_t *lock)
+{
+    THREAD_STATS_INC(spin_contended);
+    arch_spin_lock(lock);
+}
+
+void spin_lock_ticket_wait(spin_lock_t *lock, uint32_t ticket)
+{
+    THREAD_STATS_INC(spin_contended);
+
+    /* only read the served ticket while waiting, so the line stays shared
+     * until the holder hands the lock over */
+    const uint32_t *owner = (const uint32_t *)lock;
+    while ((arch_spin_load_for_wait(owner) & SPIN_LOCK_TICKET_MASK) != ticket)
+        arch_spinloop_pause();
+}
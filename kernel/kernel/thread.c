@@ -23,10 +23,12 @@
 #include <string.h>
 #include <printf.h>
 #include <err.h>
+#include <kernel/cpufreq.h>
 #include <kernel/sched.h>
 #include <kernel/thread.h>
 #include <kernel/timer.h>
 #include <kernel/mp.h>
+#include <kernel/percpu.h>
 #include <kernel/vm.h>
 #include <platform.h>
 #include <target.h>
@@ -39,6 +41,9 @@
 
 struct thread_stats thread_stats[SMP_MAX_CPUS];
 
+/* per cpu scheduler state */
+struct percpu percpu[SMP_MAX_CPUS];
+
 #define STACK_DEBUG_BYTE (0x99)
 #define STACK_DEBUG_WORD (0x99999999)
 
@@ -50,11 +55,15 @@ struct thread_stats thread_stats[SMP_MAX_CPUS];
 #define THREAD_INITIAL_TIME_SLICE LK_MSEC(50)
 #define THREAD_TICK_RATE          LK_MSEC(10)
 
+/* how late a sleep or wait queue timeout may fire so it can share an interrupt
+ * with other timers. real time and deadline threads always get exact wakeups. */
+#define THREAD_TIMER_SLACK        LK_USEC(50)
+
 /* global thread list */
 static struct list_node thread_list = LIST_INITIAL_VALUE(thread_list);
 
 /* master thread spinlock */
-spin_lock_t thread_lock = SPIN_LOCK_INITIAL_VALUE;
+spin_lock_t thread_lock = SPIN_LOCK_TICKET_INITIAL_VALUE;
 
 /* the idle thread(s) (statically allocated) */
 thread_t idle_threads[SMP_MAX_CPUS];
@@ -147,9 +156,11 @@ thread_t *thread_create_etc(
     t->entry = entry;
     t->arg = arg;
     t->priority = priority;
+    t->base_priority = priority;
     t->state = THREAD_INITIAL;
     t->signals = 0;
     t->blocking_wait_queue = NULL;
+    t->pi_lent_to = NULL;
     t->blocked_status = NO_ERROR;
     t->interruptable = false;
     thread_set_last_cpu(t, 0);
@@ -252,6 +263,36 @@ status_t thread_set_real_time(thread_t *t)
     return NO_ERROR;
 }
 
+/**
+ * @brief Change the scheduling class of a thread
+ *
+ * Moves the thread into the deadline class with the reservation described by
+ * |params|, or back into the priority class if |params| is NULL.  Deadline
+ * class threads run ahead of all priority class threads for up to
+ * params->capacity of cpu time every params->period, and are throttled once
+ * that budget is used up.
+ *
+ * @return NO_ERROR on success, ERR_NO_RESOURCES if admitting the reservation
+ * would oversubscribe the cpus.
+ */
+status_t thread_set_deadline(thread_t *t, const struct thread_deadline_params *params)
+{
+    DEBUG_ASSERT(t->magic == THREAD_MAGIC);
+
+    if (thread_is_idle(t))
+        return ERR_INVALID_ARGS;
+
+    THREAD_LOCK(state);
+    status_t status = sched_set_deadline(t, params);
+
+    /* if we changed ourselves, let the scheduler pick in light of the new class */
+    if (status == NO_ERROR && t == get_current_thread() && !arch_in_int_handler())
+        sched_preempt();
+    THREAD_UNLOCK(state);
+
+    return status;
+}
+
 /**
  * @brief  Make a suspended thread executable.
  *
@@ -429,6 +470,10 @@ status_t thread_detach(thread_t *t)
 
 __NO_RETURN static void thread_exit_locked(thread_t *current_thread, int retcode)
 {
+    /* give back any cpu bandwidth reserved by the thread */
+    if (thread_is_deadline(current_thread))
+        sched_set_deadline(current_thread, NULL);
+
     /* enter the dead state */
     current_thread->state = THREAD_DEATH;
     current_thread->retcode = retcode;
@@ -696,15 +741,24 @@ void thread_resched(void)
 
     lk_time_t now = current_time();
     oldthread->runtime_ns += now - oldthread->last_started_running;
+    oldthread->last_stopped_running = now;
+    if (oldthread->state == THREAD_READY)
+        oldthread->involuntary_switches++;
+    else
+        oldthread->voluntary_switches++;
+    if (!thread_is_idle(newthread))
+        newthread->wait_ns += now - MAX(newthread->last_woken, newthread->last_stopped_running);
     newthread->last_started_running = now;
+    timer_update_published_clock(now);
 
     /* set up quantum for the new thread if it was consumed */
     if (newthread->remaining_time_slice == 0) {
-        newthread->remaining_time_slice = THREAD_INITIAL_TIME_SLICE;
+        newthread->remaining_time_slice = sched_time_slice(newthread, THREAD_INITIAL_TIME_SLICE);
     }
 
     /* mark the cpu ownership of the threads */
     thread_set_last_cpu(newthread, cpu);
+    __atomic_store_n(&percpu[cpu].curr_thread, newthread, __ATOMIC_RELAXED);
 
     /* set the cpu state based on the new thread we've picked */
     if (thread_is_idle(newthread)) {
@@ -728,6 +782,8 @@ void thread_resched(void)
         thread_stats[cpu].last_idle_timestamp = now;
     }
 
+    cpufreq_context_switch(cpu, thread_is_idle(oldthread), thread_is_idle(newthread), now);
+
     ktrace(TAG_CONTEXT_SWITCH, (uint32_t)newthread->user_tid, cpu | (oldthread->state << 16),
            (uint32_t)(uintptr_t)oldthread, (uint32_t)(uintptr_t)newthread);
 
@@ -792,6 +848,32 @@ void thread_resched(void)
     final_context_switch(oldthread, newthread);
 }
 
+/**
+ * @brief Hand the cpu to the next thread woken
+ *
+ * Until disarmed, the first thread the current thread wakes up is queued on
+ * this cpu and picked next, instead of being placed by the usual wakeup
+ * heuristics.  If the current thread blocks, the woken thread inherits the
+ * remainder of its time slice.  Deadline class threads are never handed off.
+ */
+void thread_handoff_arm(void)
+{
+    thread_t *current_thread = get_current_thread();
+
+    THREAD_LOCK(state);
+    current_thread->flags |= THREAD_FLAG_HANDOFF;
+    THREAD_UNLOCK(state);
+}
+
+void thread_handoff_disarm(void)
+{
+    thread_t *current_thread = get_current_thread();
+
+    THREAD_LOCK(state);
+    current_thread->flags &= ~THREAD_FLAG_HANDOFF;
+    THREAD_UNLOCK(state);
+}
+
 /**
  * @brief Yield the cpu to another thread
  *
@@ -862,6 +944,8 @@ enum handler_return thread_timer_tick(void)
 {
     thread_t *current_thread = get_current_thread();
 
+    cpufreq_tick(arch_curr_cpu_num(), current_time());
+
     if (thread_is_real_time_or_idle(current_thread))
         return INT_NO_RESCHEDULE;
 
@@ -876,6 +960,13 @@ enum handler_return thread_timer_tick(void)
     }
 }
 
+static lk_time_t thread_timer_slack(thread_t *t)
+{
+    if ((t->flags & THREAD_FLAG_REAL_TIME) || thread_is_deadline(t))
+        return 0;
+    return THREAD_TIMER_SLACK;
+}
+
 /* timer callback to wake up a sleeping thread */
 static enum handler_return thread_sleep_handler(timer_t *timer, lk_time_t now, void *arg)
 {
@@ -944,7 +1035,8 @@ status_t thread_sleep_etc(lk_time_t deadline, bool interruptable)
 
     if (deadline != INFINITE_TIME) {
         /* set a one shot timer to wake us up and reschedule */
-        timer_set_oneshot(&timer, deadline, thread_sleep_handler, (void *)current_thread);
+        timer_set_oneshot_etc(&timer, deadline, thread_timer_slack(current_thread),
+                              thread_sleep_handler, (void *)current_thread);
     }
     current_thread->state = THREAD_SLEEPING;
     current_thread->blocked_status = NO_ERROR;
@@ -993,6 +1085,32 @@ lk_time_t thread_runtime(const thread_t *t)
     return runtime;
 }
 
+/**
+ * @brief Fill in the scheduler statistics of a thread.
+ *
+ * Like thread_runtime(), this includes the time a running thread has accrued
+ * since it was scheduled, and also the time a ready thread has spent waiting
+ * in its run queue so far.
+ */
+void thread_get_sched_stats(const thread_t *t, struct thread_sched_stats *stats)
+{
+    THREAD_LOCK(state);
+
+    lk_time_t now = current_time();
+    stats->runtime = t->runtime_ns;
+    stats->wait_time = t->wait_ns;
+    if (t->state == THREAD_RUNNING) {
+        stats->runtime += now - t->last_started_running;
+    } else if (t->state == THREAD_READY) {
+        stats->wait_time += now - MAX(t->last_woken, t->last_stopped_running);
+    }
+    stats->voluntary_switches = t->voluntary_switches;
+    stats->involuntary_switches = t->involuntary_switches;
+    stats->page_faults = t->page_faults;
+
+    THREAD_UNLOCK(state);
+}
+
 /**
  * @brief Construct a thread t around the current running state
  *
@@ -1009,6 +1127,7 @@ void thread_construct_first(thread_t *t, const char *name)
 
     init_thread_struct(t, name);
     t->priority = HIGHEST_PRIORITY;
+    t->base_priority = HIGHEST_PRIORITY;
     t->state = THREAD_RUNNING;
     t->flags = THREAD_FLAG_DETACHED;
     t->signals = 0;
@@ -1020,6 +1139,7 @@ void thread_construct_first(thread_t *t, const char *name)
     THREAD_LOCK(state);
     list_add_head(&thread_list, &t->thread_list_node);
     set_current_thread(t);
+    percpu[cpu].curr_thread = t;
     THREAD_UNLOCK(state);
 }
 
@@ -1072,6 +1192,15 @@ void thread_set_user_callback(thread_t *t, thread_user_callback_t cb)
     t->user_callback = cb;
 }
 
+/* base priority raised to the highest inherited one, THREAD_LOCK must be held */
+static int effective_priority(const thread_t *t)
+{
+    if (t->inherited_bitmap == 0)
+        return t->base_priority;
+    int inherited = HIGHEST_PRIORITY - __builtin_clz(t->inherited_bitmap);
+    return MAX(t->base_priority, inherited);
+}
+
 /**
  * @brief Change priority of current thread
  *
@@ -1087,13 +1216,60 @@ void thread_set_priority(int priority)
         priority = IDLE_PRIORITY + 1;
     if (priority > HIGHEST_PRIORITY)
         priority = HIGHEST_PRIORITY;
-    current_thread->priority = priority;
+    current_thread->base_priority = priority;
+    current_thread->priority = effective_priority(current_thread);
 
     sched_preempt();
 
     THREAD_UNLOCK(state);
 }
 
+/**
+ * @brief  Lend a priority to a thread
+ *
+ * Until the matching thread_disinherit_priority(), |t| runs at |priority| if
+ * that is higher than its own. Used to avoid priority inversion when the
+ * caller is about to block waiting on |t|.
+ */
+void thread_inherit_priority(thread_t *t, int priority)
+{
+    THREAD_LOCK(state);
+    thread_inherit_priority_locked(t, priority);
+    THREAD_UNLOCK(state);
+}
+
+void thread_disinherit_priority(thread_t *t, int priority)
+{
+    THREAD_LOCK(state);
+    thread_disinherit_priority_locked(t, priority);
+    THREAD_UNLOCK(state);
+}
+
+/* the above with the thread lock held */
+void thread_inherit_priority_locked(thread_t *t, int priority)
+{
+    DEBUG_ASSERT(t->magic == THREAD_MAGIC);
+    DEBUG_ASSERT(priority >= 0 && priority < NUM_PRIORITIES);
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    DEBUG_ASSERT(t->inherited_count[priority] < UINT16_MAX);
+    t->inherited_count[priority]++;
+    t->inherited_bitmap |= (1u << priority);
+    sched_set_priority(t, effective_priority(t));
+}
+
+void thread_disinherit_priority_locked(thread_t *t, int priority)
+{
+    DEBUG_ASSERT(t->magic == THREAD_MAGIC);
+    DEBUG_ASSERT(priority >= 0 && priority < NUM_PRIORITIES);
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    DEBUG_ASSERT(t->inherited_count[priority] > 0);
+    if (--t->inherited_count[priority] == 0)
+        t->inherited_bitmap &= ~(1u << priority);
+    sched_set_priority(t, effective_priority(t));
+}
+
 /**
  * @brief  Become an idle thread
  *
@@ -1113,6 +1289,7 @@ void thread_become_idle(void)
 
     /* mark ourself as idle */
     t->priority = IDLE_PRIORITY;
+    t->base_priority = IDLE_PRIORITY;
     t->flags |= THREAD_FLAG_IDLE;
     thread_set_pinned_cpu(t, arch_curr_cpu_num());
 
@@ -1383,7 +1560,8 @@ status_t wait_queue_block(wait_queue_t *wait, lk_time_t deadline)
     /* if the deadline is nonzero or noninfinite, set a callback to yank us out of the queue */
     if (deadline != INFINITE_TIME) {
         timer_initialize(&timer);
-        timer_set_oneshot(&timer, deadline, wait_queue_timeout_handler, (void *)current_thread);
+        timer_set_oneshot_etc(&timer, deadline, thread_timer_slack(current_thread),
+                              wait_queue_timeout_handler, (void *)current_thread);
     }
 
     sched_block();
@@ -1396,6 +1574,25 @@ status_t wait_queue_block(wait_queue_t *wait, lk_time_t deadline)
     return current_thread->blocked_status;
 }
 
+static int wait_queue_wake_thread(wait_queue_t *wait, thread_t *t, bool reschedule,
+                                  status_t wait_queue_error)
+{
+    int ret = 0;
+
+    if (t) {
+        wait->count--;
+        DEBUG_ASSERT(t->state == THREAD_BLOCKED);
+        t->blocked_status = wait_queue_error;
+        t->blocking_wait_queue = NULL;
+
+        sched_unblock(t, reschedule);
+
+        ret = 1;
+    }
+
+    return ret;
+}
+
 /**
  * @brief  Wake up one thread sleeping on a wait queue
  *
@@ -1412,26 +1609,56 @@ status_t wait_queue_block(wait_queue_t *wait, lk_time_t deadline)
  */
 int wait_queue_wake_one(wait_queue_t *wait, bool reschedule, status_t wait_queue_error)
 {
-    thread_t *t;
-    int ret = 0;
+    DEBUG_ASSERT(wait->magic == WAIT_QUEUE_MAGIC);
+    DEBUG_ASSERT(arch_ints_disabled());
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
 
+    thread_t *t = list_remove_head_type(&wait->list, thread_t, queue_node);
+    return wait_queue_wake_thread(wait, t, reschedule, wait_queue_error);
+}
+
+/**
+ * @brief  Wake up the thread that most recently blocked on a wait queue
+ *
+ * Like wait_queue_wake_one() but takes the thread from the tail of the wait
+ * queue. The newest waiter is the one most likely to still have a warm cache.
+ *
+ * @return  The number of threads woken (zero or one)
+ */
+int wait_queue_wake_newest(wait_queue_t *wait, bool reschedule, status_t wait_queue_error)
+{
     DEBUG_ASSERT(wait->magic == WAIT_QUEUE_MAGIC);
     DEBUG_ASSERT(arch_ints_disabled());
     DEBUG_ASSERT(spin_lock_held(&thread_lock));
 
-    t = list_remove_head_type(&wait->list, thread_t, queue_node);
-    if (t) {
-        wait->count--;
-        DEBUG_ASSERT(t->state == THREAD_BLOCKED);
-        t->blocked_status = wait_queue_error;
-        t->blocking_wait_queue = NULL;
+    thread_t *t = list_remove_tail_type(&wait->list, thread_t, queue_node);
+    return wait_queue_wake_thread(wait, t, reschedule, wait_queue_error);
+}
 
-        sched_unblock(t, reschedule);
+/**
+ * @brief  Wake up the highest priority thread sleeping on a wait queue
+ *
+ * Like wait_queue_wake_one() but takes the waiter with the highest effective
+ * priority, and the one that has waited longest among equals. Used where
+ * waiters lend their priority, so the one that lent the most goes first.
+ *
+ * @return  The number of threads woken (zero or one)
+ */
+int wait_queue_wake_highest(wait_queue_t *wait, bool reschedule, status_t wait_queue_error)
+{
+    DEBUG_ASSERT(wait->magic == WAIT_QUEUE_MAGIC);
+    DEBUG_ASSERT(arch_ints_disabled());
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
 
-        ret = 1;
+    thread_t *best = NULL;
+    thread_t *t;
+    list_for_every_entry(&wait->list, t, thread_t, queue_node) {
+        if (!best || t->priority > best->priority)
+            best = t;
     }
-
-    return ret;
+    if (best)
+        list_delete(&best->queue_node);
+    return wait_queue_wake_thread(wait, best, reschedule, wait_queue_error);
 }
 
 
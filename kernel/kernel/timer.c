@@ -17,6 +17,12 @@
  *
  * Timer callback functions are called in interrupt context.
  *
+ * Pending timers are kept in a per cpu pairing heap ordered by the latest
+ * time each timer may fire (its deadline plus slack), which gives O(1)
+ * insertion and O(log n) amortized removal. The hardware timer is armed for
+ * the root of the heap and every timer whose deadline has passed is fired from
+ * the same interrupt, so timers with slack coalesce with their neighbors.
+ *
  * @{
  */
 #include <assert.h>
@@ -26,23 +32,31 @@
 #include <kernel/spinlock.h>
 #include <kernel/thread.h>
 #include <kernel/timer.h>
-#include <list.h>
 #include <platform.h>
 #include <platform/timer.h>
 #include <trace.h>
 
 #define LOCAL_TRACE 0
 
-spin_lock_t timer_lock;
+spin_lock_t timer_lock = SPIN_LOCK_TICKET_INITIAL_VALUE;
 
 struct timer_state {
-    struct list_node timer_queue;
+    timer_t *heap_root;
+
+    /* time the hardware timer is currently armed for, INFINITE_TIME if stopped */
+    lk_time_t armed_time;
 } __CPU_ALIGN;
 
 static struct timer_state timers[SMP_MAX_CPUS];
 
 static enum handler_return timer_tick(void *arg, lk_time_t now);
 
+/* see timer_publish_clock. it is only rewritten once it is this far behind, to
+ * keep the cpus from bouncing its cache line around on every interrupt */
+#define PUBLISHED_CLOCK_GRANULARITY LK_USEC(500)
+
+static uint64_t *published_clock;
+
 /**
  * @brief  Initialize a timer object
  */
@@ -51,33 +65,142 @@ void timer_initialize(timer_t *timer)
     *timer = (timer_t)TIMER_INITIAL_VALUE(*timer);
 }
 
-static void insert_timer_in_queue(uint cpu, timer_t *timer)
+/* the latest time the timer may fire, which is what the heap is ordered by */
+static inline lk_time_t timer_latest_time(const timer_t *timer)
 {
-    timer_t *entry;
+    lk_time_t latest = timer->scheduled_time + timer->slack;
+
+    /* saturate rather than wrap for deadlines near INFINITE_TIME */
+    return (latest < timer->scheduled_time) ? INFINITE_TIME : latest;
+}
+
+/* link two heap roots together, returning the new root */
+static timer_t *heap_meld(timer_t *a, timer_t *b)
+{
+    if (!a)
+        return b;
+    if (!b)
+        return a;
+
+    if (TIME_LT(timer_latest_time(b), timer_latest_time(a))) {
+        timer_t *tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    /* b becomes the leftmost child of a */
+    b->heap_prev = a;
+    b->heap_next = a->heap_child;
+    if (a->heap_child)
+        a->heap_child->heap_prev = b;
+    a->heap_child = b;
+
+    return a;
+}
+
+/* standard two pass pairing of a sibling list, returning the new root */
+static timer_t *heap_merge_pairs(timer_t *first)
+{
+    timer_t *pairs = NULL;
+
+    /* first pass, meld siblings pairwise left to right, building a reversed list */
+    while (first) {
+        timer_t *a = first;
+        timer_t *b = a->heap_next;
+        first = b ? b->heap_next : NULL;
+
+        a->heap_prev = a->heap_next = NULL;
+        if (b)
+            b->heap_prev = b->heap_next = NULL;
+
+        timer_t *t = heap_meld(a, b);
+        t->heap_next = pairs;
+        pairs = t;
+    }
+
+    /* second pass, meld the pairs right to left into a single tree */
+    timer_t *root = NULL;
+    while (pairs) {
+        timer_t *next = pairs->heap_next;
+        pairs->heap_next = NULL;
+        root = heap_meld(root, pairs);
+        pairs = next;
+    }
 
+    return root;
+}
+
+static void insert_timer_in_queue(uint cpu, timer_t *timer)
+{
     DEBUG_ASSERT(arch_ints_disabled());
+    DEBUG_ASSERT(timer->queued_cpu < 0);
 
-    LTRACEF("timer %p, cpu %u, scheduled %" PRIu64 ", periodic %" PRIu64 "\n", timer, cpu, timer->scheduled_time, timer->period);
+    LTRACEF("timer %p, cpu %u, scheduled %" PRIu64 ", slack %" PRIu64 ", periodic %" PRIu64 "\n",
+            timer, cpu, timer->scheduled_time, timer->slack, timer->period);
 
-    list_for_every_entry(&timers[cpu].timer_queue, entry, timer_t, node) {
-        if (TIME_GT(entry->scheduled_time, timer->scheduled_time)) {
-            list_add_before(&entry->node, &timer->node);
-            return;
-        }
+    timer->heap_child = timer->heap_next = timer->heap_prev = NULL;
+    timer->queued_cpu = cpu;
+    timers[cpu].heap_root = heap_meld(timers[cpu].heap_root, timer);
+}
+
+static void remove_timer_from_queue(timer_t *timer)
+{
+    DEBUG_ASSERT(timer->queued_cpu >= 0);
+
+    struct timer_state *ts = &timers[timer->queued_cpu];
+
+    if (timer == ts->heap_root) {
+        ts->heap_root = heap_merge_pairs(timer->heap_child);
+    } else {
+        /* unlink from the parent or left sibling */
+        if (timer->heap_prev->heap_child == timer)
+            timer->heap_prev->heap_child = timer->heap_next;
+        else
+            timer->heap_prev->heap_next = timer->heap_next;
+        if (timer->heap_next)
+            timer->heap_next->heap_prev = timer->heap_prev;
+
+        ts->heap_root = heap_meld(ts->heap_root, heap_merge_pairs(timer->heap_child));
     }
 
-    /* walked off the end of the list */
-    list_add_tail(&timers[cpu].timer_queue, &timer->node);
+    timer->heap_child = timer->heap_next = timer->heap_prev = NULL;
+    timer->queued_cpu = -1;
+}
+
+/* arm the hardware timer for the root of this cpu's heap, or stop it if there's
+ * nothing queued so an idle cpu doesn't take any interrupts */
+static void update_platform_timer(uint cpu)
+{
+#if PLATFORM_HAS_DYNAMIC_TIMER
+    DEBUG_ASSERT(cpu == arch_curr_cpu_num());
+
+    struct timer_state *ts = &timers[cpu];
+    lk_time_t deadline = ts->heap_root ? timer_latest_time(ts->heap_root) : INFINITE_TIME;
+
+    if (deadline == ts->armed_time)
+        return;
+
+    ts->armed_time = deadline;
+    if (deadline == INFINITE_TIME) {
+        LTRACEF("stopping hw timer, nothing in the queue\n");
+        platform_stop_timer();
+    } else {
+        LTRACEF("setting new timer for %" PRIu64 " nsecs\n", deadline);
+        platform_set_oneshot_timer(timer_tick, NULL, deadline);
+    }
+#endif
 }
 
-static void timer_set(timer_t *timer, lk_time_t deadline, lk_time_t period, timer_callback callback, void *arg)
+static void timer_set(timer_t *timer, lk_time_t deadline, lk_time_t slack, lk_time_t period,
+                      timer_callback callback, void *arg)
 {
-    LTRACEF("timer %p, deadline %" PRIu64 ", period %" PRIu64 ", callback %p, arg %p\n", timer, deadline, period, callback, arg);
+    LTRACEF("timer %p, deadline %" PRIu64 ", slack %" PRIu64 ", period %" PRIu64 ", callback %p, arg %p\n",
+            timer, deadline, slack, period, callback, arg);
 
     DEBUG_ASSERT(timer->magic == TIMER_MAGIC);
 
-    if (list_in_list(&timer->node)) {
-        panic("timer %p already in list\n", timer);
+    if (timer->queued_cpu >= 0) {
+        panic("timer %p already in queue\n", timer);
     }
 
     spin_lock_saved_state_t state;
@@ -95,6 +218,7 @@ static void timer_set(timer_t *timer, lk_time_t deadline, lk_time_t period, time
 
     /* set up the structure */
     timer->scheduled_time = deadline;
+    timer->slack = slack;
     timer->period = period;
     timer->callback = callback;
     timer->arg = arg;
@@ -105,13 +229,8 @@ static void timer_set(timer_t *timer, lk_time_t deadline, lk_time_t period, time
 
     insert_timer_in_queue(cpu, timer);
 
-#if PLATFORM_HAS_DYNAMIC_TIMER
-    if (list_peek_head_type(&timers[cpu].timer_queue, timer_t, node) == timer) {
-        /* we just modified the head of the timer queue */
-        LTRACEF("setting new timer for %" PRIu64 " nsecs\n", deadline);
-        platform_set_oneshot_timer(timer_tick, NULL, deadline);
-    }
-#endif
+    /* reprograms the hardware only if we became the new root */
+    update_platform_timer(cpu);
 
 out:
     spin_unlock_irqrestore(&timer_lock, state);
@@ -133,7 +252,26 @@ out:
  */
 void timer_set_oneshot(timer_t *timer, lk_time_t deadline, timer_callback callback, void *arg)
 {
-    timer_set(timer, deadline, 0, callback, arg);
+    timer_set(timer, deadline, 0, 0, callback, arg);
+}
+
+/**
+ * @brief  Set up a timer that executes once, with some allowed lateness
+ *
+ * Like timer_set_oneshot(), except the callback may be run as late as
+ * deadline + slack. The timer subsystem uses the slack to fire several
+ * timers from a single interrupt.
+ *
+ * @param  timer The timer to use
+ * @param  deadline The deadline, in ns, after which the timer is executed
+ * @param  slack  How far past deadline, in ns, the callback may be delayed
+ * @param  callback  The function to call when the timer expires
+ * @param  arg  The argument to pass to the callback
+ */
+void timer_set_oneshot_etc(timer_t *timer, lk_time_t deadline, lk_time_t slack,
+                           timer_callback callback, void *arg)
+{
+    timer_set(timer, deadline, slack, 0, callback, arg);
 }
 
 /**
@@ -154,7 +292,7 @@ void timer_set_periodic(timer_t *timer, lk_time_t period, timer_callback callbac
 {
     if (period == 0)
         period = 1;
-    timer_set(timer, current_time() + period, period, callback, arg);
+    timer_set(timer, current_time() + period, 0, period, callback, arg);
 }
 
 /**
@@ -189,26 +327,15 @@ void timer_cancel(timer_t *timer)
     }
 
     /* if the timer is in a queue, remove it and adjust hardware timers if needed */
-    if (list_in_list(&timer->node)) {
-#if PLATFORM_HAS_DYNAMIC_TIMER
-        timer_t *oldhead = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
-#endif
+    if (timer->queued_cpu >= 0) {
+        uint queued_cpu = timer->queued_cpu;
 
-        /* remove it from the queue */
-        list_delete(&timer->node);
+        remove_timer_from_queue(timer);
 
-#if PLATFORM_HAS_DYNAMIC_TIMER
-        /* see if we've just modified the head of this cpu's timer queue */
-        /* if we modified another cpu's queue, we'll just let it fire and sort itself out */
-        timer_t *newhead = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
-        if (newhead == NULL) {
-            LTRACEF("clearing old hw timer, nothing in the queue\n");
-            platform_stop_timer();
-        } else if (newhead != oldhead) {
-            LTRACEF("setting new timer to %" PRIu64 "\n", newhead->scheduled_time);
-            platform_set_oneshot_timer(timer_tick, NULL, newhead->scheduled_time);
-        }
-#endif
+        /* if we modified another cpu's queue, we'll just let its hardware timer
+         * fire and sort itself out */
+        if (queued_cpu == cpu)
+            update_platform_timer(cpu);
     }
 
     spin_unlock_irqrestore(&timer_lock, state);
@@ -224,6 +351,27 @@ void timer_cancel(timer_t *timer)
     timer->period = 0;
 }
 
+void timer_publish_clock(uint64_t *clock)
+{
+    __atomic_store_n(clock, current_time(), __ATOMIC_RELAXED);
+    __atomic_store_n(&published_clock, clock, __ATOMIC_RELEASE);
+}
+
+void timer_update_published_clock(lk_time_t now)
+{
+    uint64_t *clock = __atomic_load_n(&published_clock, __ATOMIC_ACQUIRE);
+    if (!clock)
+        return;
+
+    /* cpus race with slightly different times; only ever move it forward */
+    uint64_t old = __atomic_load_n(clock, __ATOMIC_RELAXED);
+    while (now >= old + PUBLISHED_CLOCK_GRANULARITY) {
+        if (__atomic_compare_exchange_n(clock, &old, now, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+    }
+}
+
 /* called at interrupt time to process any pending timers */
 static enum handler_return timer_tick(void *arg, lk_time_t now)
 {
@@ -238,14 +386,22 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
 
     LTRACEF("cpu %u now %" PRIu64 ", sp %p\n", cpu, now, __GET_FRAME());
 
+    timer_update_published_clock(now);
+
     spin_lock(&timer_lock);
 
+    /* the hardware timer is one shot, it is no longer armed */
+    timers[cpu].armed_time = INFINITE_TIME;
+
     for (;;) {
         /* see if there's an event to process */
-        timer = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+        timer = timers[cpu].heap_root;
         if (likely(timer == 0))
             break;
         LTRACEF("next item on timer queue %p at %" PRIu64 " now %" PRIu64 " (%p, arg %p)\n", timer, timer->scheduled_time, now, timer->callback, timer->arg);
+
+        /* fire everything whose deadline has passed, even if it had slack left, so that
+         * nearby timers are coalesced into this interrupt */
         if (likely(TIME_LT(now, timer->scheduled_time)))
             break;
 
@@ -254,7 +410,7 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
         DEBUG_ASSERT_MSG(timer && timer->magic == TIMER_MAGIC,
                 "ASSERT: timer failed magic check: timer %p, magic 0x%x\n",
                 timer, (uint)timer->magic);
-        list_delete(&timer->node);
+        remove_timer_from_queue(timer);
 
         /* mark the timer busy */
         timer->active_cpu = cpu;
@@ -290,7 +446,7 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
             /* if it is a periodic timer and it hasn't been requeued
              * by the callback put it back in the list
              */
-            if (timer->period > 0 && !list_in_list(&timer->node)) {
+            if (timer->period > 0 && timer->queued_cpu < 0) {
                 LTRACEF("periodic timer, period %" PRIu64 "\n", timer->period);
                 timer->scheduled_time = now + timer->period;
                 insert_timer_in_queue(cpu, timer);
@@ -299,16 +455,9 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
     }
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
-    /* reset the timer to the next event */
-    timer = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
-    if (timer) {
-        /* has to be the case or it would have fired already */
-        DEBUG_ASSERT(TIME_GT(timer->scheduled_time, now));
-
-        LTRACEF("setting new timer for %" PRIu64 " nsecs for event %p\n", timer->scheduled_time,
-                timer);
-        platform_set_oneshot_timer(timer_tick, NULL, timer->scheduled_time);
-    }
+    /* reset the timer to the next event, or leave it off if there is none */
+    DEBUG_ASSERT(!timers[cpu].heap_root || TIME_GT(timers[cpu].heap_root->scheduled_time, now));
+    update_platform_timer(cpu);
 
     /* we're done manipulating the timer queue */
     spin_unlock(&timer_lock);
@@ -343,29 +492,28 @@ status_t timer_trylock_or_cancel(timer_t *t, spin_lock_t *lock)
     return NO_ERROR;
 }
 
+lk_time_t timer_get_next_deadline(void)
+{
+    DEBUG_ASSERT(arch_ints_disabled());
+
+    return timers[arch_curr_cpu_num()].armed_time;
+}
+
 void timer_transition_off_cpu(uint old_cpu)
 {
     spin_lock_saved_state_t state;
     spin_lock_irqsave(&timer_lock, state);
     uint cpu = arch_curr_cpu_num();
 
-    timer_t *old_head = list_peek_head_type(&timers[old_cpu].timer_queue, timer_t, node);
-
-    timer_t *entry = NULL, *tmp_entry = NULL;
     /* Move all timers from old_cpu to this cpu */
-    list_for_every_entry_safe(&timers[old_cpu].timer_queue, entry, tmp_entry, timer_t, node) {
-        list_delete(&entry->node);
+    timer_t *entry;
+    while ((entry = timers[old_cpu].heap_root) != NULL) {
+        remove_timer_from_queue(entry);
         insert_timer_in_queue(cpu, entry);
     }
+    timers[old_cpu].armed_time = INFINITE_TIME;
 
-#if PLATFORM_HAS_DYNAMIC_TIMER
-    timer_t *new_head = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
-    if (new_head != NULL && new_head != old_head) {
-        /* we just modified the head of the timer queue */
-        LTRACEF("setting new timer for %" PRIu64 " nsecs\n", new_head->scheduled_time);
-        platform_set_oneshot_timer(timer_tick, NULL, new_head->scheduled_time);
-    }
-#endif
+    update_platform_timer(cpu);
 
     spin_unlock_irqrestore(&timer_lock, state);
 }
@@ -380,11 +528,9 @@ void timer_thaw_percpu(void)
 
     uint cpu = arch_curr_cpu_num();
 
-    timer_t *t = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
-    if (t) {
-        LTRACEF("rescheduling timer for %" PRIu64 " nsecs\n", t->scheduled_time);
-        platform_set_oneshot_timer(timer_tick, NULL, t->scheduled_time);
-    }
+    /* whatever the hardware timer was armed for was lost across suspend */
+    timers[cpu].armed_time = INFINITE_TIME;
+    update_platform_timer(cpu);
 
     spin_unlock(&timer_lock);
 #endif
@@ -392,9 +538,10 @@ void timer_thaw_percpu(void)
 
 void timer_init(void)
 {
-    timer_lock = SPIN_LOCK_INITIAL_VALUE;
+    spin_lock_init_ticket(&timer_lock);
     for (uint i = 0; i < SMP_MAX_CPUS; i++) {
-        list_initialize(&timers[i].timer_queue);
+        timers[i].heap_root = NULL;
+        timers[i].armed_time = INFINITE_TIME;
     }
 #if !PLATFORM_HAS_DYNAMIC_TIMER
     /* register for a periodic timer tick */
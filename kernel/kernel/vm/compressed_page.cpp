@@ -0,0 +1,98 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <kernel/vm/compressed_page.h>
+
+#include "vm_priv.h"
+#include <assert.h>
+#include <inttypes.h>
+#include <kernel/auto_lock.h>
+#include <kernel/mutex.h>
+#include <kernel/vm/mem_stats.h>
+#include <lz4/lz4.h>
+#include <new.h>
+#include <string.h>
+#include <trace.h>
+
+#define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
+
+namespace {
+
+// a page has to come out at least a quarter smaller to be worth the cost of
+// faulting it back in
+constexpr size_t kMaxCompressedSize = PAGE_SIZE * 3 / 4;
+
+// LZ4's compression state is too large for a kernel stack, and compression
+// only happens on the reclaim thread, so one copy is shared behind a lock
+Mutex compress_lock;
+LZ4_stream_t compress_state TA_GUARDED(compress_lock);
+char compress_buffer[kMaxCompressedSize] TA_GUARDED(compress_lock);
+
+uint64_t pool_limit() {
+    return pmm_count_total_bytes() / 4;
+}
+
+} // namespace
+
+bool CompressedPage::PoolFull() {
+    return static_cast<uint64_t>(kmem_stat_read(KMEM_STAT_COMPRESSED_BYTES)) + kMaxCompressedSize >
+           pool_limit();
+}
+
+mxtl::unique_ptr<CompressedPage> CompressedPage::Create(uint64_t offset, paddr_t pa) {
+    if (PoolFull()) {
+        kmem_stat_add(KMEM_STAT_COMPRESSED_MISSES, 1);
+        return nullptr;
+    }
+
+    AutoLock al(&compress_lock);
+
+    const char* src = reinterpret_cast<const char*>(paddr_to_kvaddr(pa));
+    int len = LZ4_compress_fast_extState(&compress_state, src, compress_buffer, PAGE_SIZE,
+                                         sizeof(compress_buffer), 1);
+    if (len <= 0) {
+        // didn't fit in the buffer, so the page doesn't compress well enough
+        kmem_stat_add(KMEM_STAT_COMPRESSED_MISSES, 1);
+        return nullptr;
+    }
+
+    AllocChecker ac;
+    uint8_t* data = new (&ac) uint8_t[len];
+    if (!ac.check()) {
+        kmem_stat_add(KMEM_STAT_COMPRESSED_MISSES, 1);
+        return nullptr;
+    }
+    memcpy(data, compress_buffer, len);
+
+    mxtl::unique_ptr<CompressedPage> page(new (&ac) CompressedPage(offset, data, len));
+    if (!ac.check()) {
+        delete[] data;
+        kmem_stat_add(KMEM_STAT_COMPRESSED_MISSES, 1);
+        return nullptr;
+    }
+
+    LTRACEF("offset %#" PRIx64 " compressed to %d bytes\n", offset, len);
+
+    kmem_stat_add(KMEM_STAT_COMPRESSED_PAGES, 1);
+    kmem_stat_add(KMEM_STAT_COMPRESSED_BYTES, len);
+    return page;
+}
+
+CompressedPage::~CompressedPage() {
+    delete[] data_;
+    kmem_stat_add(KMEM_STAT_COMPRESSED_PAGES, -1);
+    kmem_stat_add(KMEM_STAT_COMPRESSED_BYTES, -static_cast<int64_t>(len_));
+}
+
+void CompressedPage::Decompress(paddr_t pa) const {
+    char* dst = reinterpret_cast<char*>(paddr_to_kvaddr(pa));
+    int len = LZ4_decompress_safe(reinterpret_cast<const char*>(data_), dst,
+                                  static_cast<int>(len_), PAGE_SIZE);
+    // we made the data ourselves, anything else is memory corruption
+    ASSERT(len == PAGE_SIZE);
+
+    kmem_stat_add(KMEM_STAT_COMPRESSED_HITS, 1);
+}
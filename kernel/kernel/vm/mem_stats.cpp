@@ -0,0 +1,35 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <kernel/vm/mem_stats.h>
+
+#include <arch/ops.h>
+#include <debug.h>
+
+// Statically allocated since pages change state long before there's a heap.
+struct kmem_stats_cpu {
+    int64_t counts[KMEM_STAT_COUNT];
+} __CPU_ALIGN;
+
+static kmem_stats_cpu kmem_stats[SMP_MAX_CPUS];
+
+void kmem_stat_add(unsigned int stat, int64_t delta) {
+    DEBUG_ASSERT(stat < KMEM_STAT_COUNT);
+
+    // we may be preempted onto another cpu here, the add is atomic so the
+    // change just lands in that cpu's copy
+    __atomic_fetch_add(&kmem_stats[arch_curr_cpu_num()].counts[stat], delta,
+                       __ATOMIC_RELAXED);
+}
+
+int64_t kmem_stat_read(unsigned int stat) {
+    DEBUG_ASSERT(stat < KMEM_STAT_COUNT);
+
+    int64_t sum = 0;
+    for (uint cpu = 0; cpu < arch_max_num_cpus(); ++cpu)
+        sum += __atomic_load_n(&kmem_stats[cpu].counts[stat], __ATOMIC_RELAXED);
+    return sum;
+}
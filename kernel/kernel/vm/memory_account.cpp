@@ -0,0 +1,212 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <kernel/vm/memory_account.h>
+
+#include "vm_priv.h"
+#include <assert.h>
+#include <inttypes.h>
+#include <kernel/auto_lock.h>
+#include <kernel/vm.h>
+#include <new.h>
+#include <trace.h>
+
+#define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
+
+namespace {
+
+int64_t bytes_to_pages(uint64_t bytes) {
+    if (bytes == 0 || bytes / PAGE_SIZE >= static_cast<uint64_t>(INT64_MAX))
+        return INT64_MAX;
+    return static_cast<int64_t>(bytes / PAGE_SIZE);
+}
+
+uint64_t pages_to_bytes(int64_t pages) {
+    return pages == INT64_MAX ? 0 : static_cast<uint64_t>(pages) * PAGE_SIZE;
+}
+
+// the level the usage has to get back under for a refused charge to be
+// forgotten: the soft limit, or an eighth under the hard limit without one
+int64_t clear_level(int64_t soft_limit, int64_t hard_limit) {
+    return soft_limit != INT64_MAX ? soft_limit : hard_limit - hard_limit / 8;
+}
+
+} // namespace
+
+mxtl::RefPtr<MemoryAccount> MemoryAccount::Create(mxtl::RefPtr<MemoryAccount> parent) {
+    AllocChecker ac;
+    auto account = mxtl::AdoptRef(new (&ac) MemoryAccount(mxtl::move(parent)));
+    if (!ac.check())
+        return nullptr;
+    return account;
+}
+
+MemoryAccount::MemoryAccount(mxtl::RefPtr<MemoryAccount> parent)
+    : parent_(mxtl::move(parent)) {
+}
+
+MemoryAccount::~MemoryAccount() {
+    // every charging object holds a reference, so only stock can be left
+    DrainStocks();
+    DEBUG_ASSERT(__atomic_load_n(&usage_, __ATOMIC_RELAXED) == 0);
+}
+
+bool MemoryAccount::ChargeShared(int64_t pages) {
+    for (MemoryAccount* a = this; a; a = a->parent_.get()) {
+        int64_t hard_limit = __atomic_load_n(&a->hard_limit_, __ATOMIC_RELAXED);
+        int64_t usage = __atomic_add_fetch(&a->usage_, pages, __ATOMIC_RELAXED);
+        if (usage > hard_limit) {
+            __atomic_sub_fetch(&a->usage_, pages, __ATOMIC_RELAXED);
+            for (MemoryAccount* b = this; b != a; b = b->parent_.get())
+                b->UnchargeOne(pages);
+            return false;
+        }
+
+        int64_t soft_limit = __atomic_load_n(&a->soft_limit_, __ATOMIC_RELAXED);
+        if (usage > soft_limit && usage - pages <= soft_limit)
+            a->UpdateLimitState(false);
+    }
+    return true;
+}
+
+void MemoryAccount::UnchargeShared(int64_t pages) {
+    for (MemoryAccount* a = this; a; a = a->parent_.get())
+        a->UnchargeOne(pages);
+}
+
+void MemoryAccount::UnchargeOne(int64_t pages) {
+    int64_t usage = __atomic_sub_fetch(&usage_, pages, __ATOMIC_RELAXED);
+    DEBUG_ASSERT(usage >= 0);
+
+    // both going back under the soft limit and getting far enough from a
+    // refused charge can change what the observer is told
+    int64_t soft_limit = __atomic_load_n(&soft_limit_, __ATOMIC_RELAXED);
+    int64_t level = clear_level(soft_limit, __atomic_load_n(&hard_limit_, __ATOMIC_RELAXED));
+    if ((usage <= soft_limit && usage + pages > soft_limit) ||
+        (usage <= level && usage + pages > level))
+        UpdateLimitState(false);
+}
+
+bool MemoryAccount::Charge(size_t count) {
+    int64_t pages = static_cast<int64_t>(count);
+
+    // the common case, served from the pages this cpu charged ahead
+    int64_t* stock = &stocks_[arch_curr_cpu_num()].pages;
+    int64_t available = __atomic_load_n(stock, __ATOMIC_RELAXED);
+    while (available >= pages) {
+        if (__atomic_compare_exchange_n(stock, &available, available - pages, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            return true;
+    }
+
+    if (ChargeShared(pages + kChargeBatch)) {
+        __atomic_add_fetch(stock, kChargeBatch, __ATOMIC_RELAXED);
+        return true;
+    }
+
+    // close to a limit, charge exactly, with the stocks handed back first
+    DrainStocks();
+    if (ChargeShared(pages))
+        return true;
+
+    // find whose limit it was so the right job hears about it
+    for (MemoryAccount* a = this; a; a = a->parent_.get()) {
+        if (__atomic_load_n(&a->usage_, __ATOMIC_RELAXED) + pages >
+            __atomic_load_n(&a->hard_limit_, __ATOMIC_RELAXED)) {
+            __atomic_add_fetch(&a->failed_charges_, 1, __ATOMIC_RELAXED);
+            a->UpdateLimitState(true);
+            break;
+        }
+    }
+
+    LTRACEF("account %p refused %" PRId64 " pages\n", this, pages);
+    return false;
+}
+
+void MemoryAccount::ChargeOverLimit(size_t count) {
+    int64_t pages = static_cast<int64_t>(count);
+
+    for (MemoryAccount* a = this; a; a = a->parent_.get()) {
+        int64_t usage = __atomic_add_fetch(&a->usage_, pages, __ATOMIC_RELAXED);
+        int64_t soft_limit = __atomic_load_n(&a->soft_limit_, __ATOMIC_RELAXED);
+        if (usage > soft_limit && usage - pages <= soft_limit)
+            a->UpdateLimitState(false);
+    }
+}
+
+void MemoryAccount::Uncharge(size_t count) {
+    int64_t pages = static_cast<int64_t>(count);
+
+    // keep some stock for the next charges, and give back the rest
+    int64_t* stock = &stocks_[arch_curr_cpu_num()].pages;
+    int64_t available = __atomic_add_fetch(stock, pages, __ATOMIC_RELAXED);
+    if (available > 2 * kChargeBatch) {
+        int64_t excess = __atomic_exchange_n(stock, 0, __ATOMIC_RELAXED);
+        if (excess > kChargeBatch) {
+            __atomic_add_fetch(stock, kChargeBatch, __ATOMIC_RELAXED);
+            excess -= kChargeBatch;
+        }
+        UnchargeShared(excess);
+    }
+}
+
+void MemoryAccount::DrainStocks() {
+    int64_t pages = 0;
+    for (auto& stock : stocks_)
+        pages += __atomic_exchange_n(&stock.pages, 0, __ATOMIC_RELAXED);
+    if (pages > 0)
+        UnchargeShared(pages);
+}
+
+void MemoryAccount::SetLimits(uint64_t soft_limit, uint64_t hard_limit) {
+    __atomic_store_n(&soft_limit_, bytes_to_pages(soft_limit), __ATOMIC_RELAXED);
+    __atomic_store_n(&hard_limit_, bytes_to_pages(hard_limit), __ATOMIC_RELAXED);
+
+    // what is in stock would count against the new limits
+    DrainStocks();
+    UpdateLimitState(false);
+}
+
+void MemoryAccount::GetLimits(uint64_t* soft_limit, uint64_t* hard_limit) const {
+    *soft_limit = pages_to_bytes(__atomic_load_n(&soft_limit_, __ATOMIC_RELAXED));
+    *hard_limit = pages_to_bytes(__atomic_load_n(&hard_limit_, __ATOMIC_RELAXED));
+}
+
+uint64_t MemoryAccount::usage_bytes() const {
+    int64_t usage = __atomic_load_n(&usage_, __ATOMIC_RELAXED);
+    return usage > 0 ? static_cast<uint64_t>(usage) * PAGE_SIZE : 0;
+}
+
+uint64_t MemoryAccount::failed_charges() const {
+    return __atomic_load_n(&failed_charges_, __ATOMIC_RELAXED);
+}
+
+void MemoryAccount::set_observer(Observer* observer) {
+    AutoLock al(&observer_lock_);
+    observer_ = observer;
+    if (observer_)
+        observer_->OnMemoryLimits(over_soft_limit_, hit_hard_limit_);
+}
+
+void MemoryAccount::UpdateLimitState(bool hit_hard_limit) {
+    AutoLock al(&observer_lock_);
+
+    int64_t usage = __atomic_load_n(&usage_, __ATOMIC_RELAXED);
+    int64_t soft_limit = __atomic_load_n(&soft_limit_, __ATOMIC_RELAXED);
+    int64_t hard_limit = __atomic_load_n(&hard_limit_, __ATOMIC_RELAXED);
+
+    bool over_soft_limit = usage > soft_limit;
+    if (!hit_hard_limit)
+        hit_hard_limit = hit_hard_limit_ && usage > clear_level(soft_limit, hard_limit);
+
+    if (over_soft_limit == over_soft_limit_ && hit_hard_limit == hit_hard_limit_)
+        return;
+
+    over_soft_limit_ = over_soft_limit;
+    hit_hard_limit_ = hit_hard_limit;
+    if (observer_)
+        observer_->OnMemoryLimits(over_soft_limit_, hit_hard_limit_);
+}
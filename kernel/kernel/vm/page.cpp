@@ -8,11 +8,20 @@
 #include <err.h>
 #include <inttypes.h>
 #include <kernel/vm.h>
+#include <kernel/vm/mem_stats.h>
 #include <kernel/vm/page.h>
 #include <lib/console.h>
 #include <stdio.h>
 #include <string.h>
 
+void vm_page_set_state(vm_page_t* page, enum vm_page_state state) {
+    if (page->state != VM_PAGE_STATE_FREE)
+        kmem_stat_add(KMEM_STAT_PAGES + page->state, -1);
+    if (state != VM_PAGE_STATE_FREE)
+        kmem_stat_add(KMEM_STAT_PAGES + state, 1);
+    page->state = state;
+}
+
 const char* page_state_to_string(unsigned int state) {
     switch (state) {
     case VM_PAGE_STATE_FREE:
@@ -0,0 +1,48 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <kernel/vm/page_source.h>
+
+#include "vm_priv.h"
+#include <inttypes.h>
+#include <kernel/thread.h>
+#include <kernel/wait.h>
+#include <trace.h>
+
+#define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
+
+// Supplies are rare next to faults, so rather than track which thread waits
+// for which page every supply wakes all the waiters, guarded by the thread
+// lock.
+static uint64_t supply_generation;
+static wait_queue_t supply_wait_queue = WAIT_QUEUE_INITIAL_VALUE(supply_wait_queue);
+
+uint64_t vm_page_supply_generation() {
+    return __atomic_load_n(&supply_generation, __ATOMIC_ACQUIRE);
+}
+
+status_t vm_page_supply_wait(uint64_t generation) {
+    thread_t* current_thread = get_current_thread();
+    status_t status = NO_ERROR;
+
+    THREAD_LOCK(state);
+    if (supply_generation == generation) {
+        current_thread->interruptable = true;
+        status = wait_queue_block(&supply_wait_queue, INFINITE_TIME);
+        current_thread->interruptable = false;
+    }
+    THREAD_UNLOCK(state);
+
+    LTRACEF("generation %" PRIu64 " status %d\n", generation, status);
+    return status;
+}
+
+void vm_page_supply_notify() {
+    THREAD_LOCK(state);
+    __atomic_store_n(&supply_generation, supply_generation + 1, __ATOMIC_RELEASE);
+    wait_queue_wake_all(&supply_wait_queue, false, NO_ERROR);
+    THREAD_UNLOCK(state);
+}
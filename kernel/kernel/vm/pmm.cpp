@@ -10,10 +10,15 @@
 #include <err.h>
 #include <inttypes.h>
 #include <kernel/auto_lock.h>
+#include <kernel/cmdline.h>
+#include <kernel/event.h>
 #include <kernel/mp.h>
 #include <kernel/mutex.h>
+#include <kernel/spinlock.h>
+#include <kernel/thread.h>
 #include <kernel/timer.h>
 #include <kernel/vm.h>
+#include <kernel/vm/vm_reclaim.h>
 #include <lib/console.h>
 #include <list.h>
 #include <lk/init.h>
@@ -31,10 +36,71 @@
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
 // the main arena list
-static Mutex arena_lock;
+static Mutex arena_lock("arena_lock");
 static mxtl::DoublyLinkedList<PmmArena*> arena_list TA_GUARDED(arena_lock);
 static size_t arena_cumulative_size TA_GUARDED(arena_lock);
 
+// Free pages are cached per cpu in front of the arenas so that most page
+// allocations and frees don't contend on |arena_lock|. An empty cache is
+// refilled, and a full one drained, |kPageCacheBatch| pages at a time. Only
+// pages of KMAP arenas are cached, so a cached page can serve any request.
+#if PMM_ENABLE_FREE_FILL
+// Cached pages would bypass the fill checks.
+constexpr size_t kPageCacheSize = 0u;
+#else
+constexpr size_t kPageCacheSize = 64u;
+#endif
+constexpr size_t kPageCacheBatch = kPageCacheSize / 2;
+
+struct PageCache {
+    SpinLock lock;
+    size_t count = 0u;                           // protected by |lock|
+    vm_page_t* pages[kPageCacheSize ? kPageCacheSize : 1] = {}; // protected by |lock|
+
+    // Statistics, protected by |lock|.
+    uint64_t hits = 0u;   // allocations served from the cache
+    uint64_t misses = 0u; // allocations that had to go to the arenas
+    uint64_t drains = 0u; // times a full cache was drained to the arenas
+} __CPU_ALIGN;
+
+static PageCache page_caches[SMP_MAX_CPUS];
+
+// Every arena and cpu starts out on NUMA node 0, the platform fills in the
+// real topology during boot. Allocations try the arenas of one node first and
+// fall back to the others, each in priority order. That node is the allocating
+// cpu's, unless the allocation asked for a node or for interleaving. Only
+// pages local to a cpu are kept in its page cache.
+static uint numa_node_count = 1u;
+static uint cpu_numa_node[SMP_MAX_CPUS];
+static volatile int numa_interleave_next;
+
+// Pages are zeroed ahead of time by a low priority thread and kept in
+// |zero_pool| for PMM_ALLOC_FLAG_ZEROED allocations, which keeps the zeroing
+// off the page fault path. The thread tops the pool back up to
+// |zero_pool_target| pages, vm.zero_pool_pages on the kernel command line,
+// whenever it falls below half of that. Only pages of KMAP arenas are pooled.
+#define DEFAULT_ZERO_POOL_PAGES 1024u
+constexpr size_t kZeroPoolBatch = 16u;
+
+static uint32_t zero_pool_target = DEFAULT_ZERO_POOL_PAGES;
+static SpinLock zero_pool_lock;
+static struct list_node zero_pool = LIST_INITIAL_VALUE(zero_pool); // protected by |zero_pool_lock|
+static size_t zero_pool_count = 0u;                                // protected by |zero_pool_lock|
+static event_t zero_pool_event = EVENT_INITIAL_VALUE(zero_pool_event, false,
+                                                     EVENT_FLAG_AUTOUNSIGNAL);
+
+// Statistics, protected by |zero_pool_lock|.
+static uint64_t zero_pool_hits = 0u;   // pages served already zeroed
+static uint64_t zero_pool_misses = 0u; // pages that had to be zeroed on allocation
+
+static vm_page_t* pmm_alloc_page_from_arenas(uint alloc_flags, paddr_t* pa);
+static size_t pmm_alloc_pages_from_arenas(size_t count, uint alloc_flags, struct list_node* list);
+static size_t pmm_count_free_pages_locked() TA_REQ(arena_lock);
+static size_t pmm_free_to_arenas(struct list_node* list);
+static size_t pmm_alloc_contiguous_from_arenas(size_t count, uint alloc_flags,
+                                               uint8_t alignment_log2, paddr_t* pa,
+                                               struct list_node* list);
+
 #if PMM_ENABLE_FREE_FILL
 static void pmm_enforce_fill(uint level) {
     for (auto& a : arena_list) {
@@ -68,6 +134,209 @@ vm_page_t* paddr_to_vm_page(paddr_t addr) TA_NO_THREAD_SAFETY_ANALYSIS {
     return nullptr;
 }
 
+// Like vm_page_to_paddr(), |arena_list| is only written during early boot.
+static bool page_is_cacheable(const vm_page_t* page) TA_NO_THREAD_SAFETY_ANALYSIS {
+    if (kPageCacheSize == 0u)
+        return false;
+    for (const auto& a : arena_list) {
+        if (a.page_belongs_to_arena(page)) {
+            return (a.flags() & PMM_ARENA_FLAG_KMAP) != 0 &&
+                   a.numa_node() == cpu_numa_node[arch_curr_cpu_num()];
+        }
+    }
+    return false;
+}
+
+// True if |alloc_flags| asks for a placement the page cache and zero pool,
+// which only hold pages local to some cpu, can't vouch for.
+static bool pmm_has_node_policy(uint alloc_flags) {
+    return numa_node_count > 1u &&
+           (alloc_flags & (PMM_ALLOC_FLAG_INTERLEAVE | PMM_ALLOC_FLAG_NODE_VALID)) != 0;
+}
+
+// The node whose arenas an allocation with |alloc_flags| tries first.
+static uint pmm_alloc_node(uint alloc_flags) {
+    if (alloc_flags & PMM_ALLOC_FLAG_NODE_VALID)
+        return (alloc_flags & PMM_ALLOC_FLAG_NODE_MASK) >> PMM_ALLOC_FLAG_NODE_SHIFT;
+    if (alloc_flags & PMM_ALLOC_FLAG_INTERLEAVE)
+        return static_cast<uint>(atomic_add_relaxed(&numa_interleave_next, 1)) % numa_node_count;
+    return cpu_numa_node[arch_curr_cpu_num()];
+}
+
+// Calls |func| on the arenas |alloc_flags| allows, those of the preferred node
+// first, until it returns true.
+template <typename F>
+static void pmm_for_every_arena(uint alloc_flags, F func) TA_REQ(arena_lock) {
+    const uint passes = (numa_node_count > 1u) ? 2u : 1u;
+    const uint node = (passes > 1u) ? pmm_alloc_node(alloc_flags) : 0u;
+    for (uint pass = 0; pass < passes; pass++) {
+        for (auto& a : arena_list) {
+            /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
+            if (alloc_flags & PMM_ALLOC_FLAG_KMAP) {
+                if ((a.flags() & PMM_ARENA_FLAG_KMAP) == 0)
+                    continue;
+            }
+            if (passes > 1u && (a.numa_node() == node) != (pass == 0u))
+                continue;
+
+            if (func(a))
+                return;
+        }
+    }
+}
+
+// Takes up to |count| pages from this cpu's cache.
+static size_t pmm_cache_alloc(size_t count, struct list_node* list) {
+    if (kPageCacheSize == 0u)
+        return 0u;
+
+    PageCache& cache = page_caches[arch_curr_cpu_num()];
+    AutoSpinLockIrqSave lock(cache.lock);
+    size_t taken = 0u;
+    while (taken < count && cache.count > 0u) {
+        vm_page_t* page = cache.pages[--cache.count];
+        vm_page_set_state(page, VM_PAGE_STATE_ALLOC);
+        list_add_tail(list, &page->free.node);
+        taken++;
+    }
+    if (taken > 0u)
+        cache.hits++;
+    else
+        cache.misses++;
+    return taken;
+}
+
+// Caches as many of |list|'s pages as fit, leaving the others in it.
+static void pmm_cache_fill(struct list_node* list) {
+    PageCache& cache = page_caches[arch_curr_cpu_num()];
+    AutoSpinLockIrqSave lock(cache.lock);
+    while (cache.count < kPageCacheSize && !list_is_empty(list)) {
+        vm_page_t* page = list_remove_head_type(list, vm_page_t, free.node);
+        cache.pages[cache.count++] = page;
+    }
+}
+
+static size_t pmm_zero_pool_drain();
+
+// Hands every cached page of every cpu, and the zero pool, back to the arenas,
+// for requests that only the arenas can serve. Returns the number of pages released.
+static size_t pmm_cache_drain_all() {
+    size_t released = pmm_zero_pool_drain();
+    if (kPageCacheSize == 0u)
+        return released;
+
+    struct list_node list = LIST_INITIAL_VALUE(list);
+    for (auto& cache : page_caches) {
+        AutoSpinLockIrqSave lock(cache.lock);
+        while (cache.count > 0u)
+            list_add_tail(&list, &cache.pages[--cache.count]->free.node);
+    }
+    if (list_is_empty(&list))
+        return released;
+    return released + pmm_free_to_arenas(&list);
+}
+
+// Takes up to |count| pages from the zero pool, poking the zeroing thread if
+// that leaves it running low.
+static size_t pmm_zero_pool_alloc(size_t count, struct list_node* list) {
+    size_t taken = 0u;
+    bool refill;
+    {
+        AutoSpinLockIrqSave lock(zero_pool_lock);
+        while (taken < count && zero_pool_count > 0u) {
+            list_add_tail(list, list_remove_head(&zero_pool));
+            zero_pool_count--;
+            taken++;
+        }
+        zero_pool_hits += taken;
+        zero_pool_misses += count - taken;
+        refill = zero_pool_count < zero_pool_target / 2;
+    }
+    if (refill)
+        event_signal(&zero_pool_event, false);
+    return taken;
+}
+
+// Zeroes the pages of |list| that didn't come from the zero pool.
+static void pmm_zero_pages(struct list_node* list) {
+    vm_page_t* page;
+    list_for_every_entry (list, page, vm_page_t, free.node) {
+        void* ptr = paddr_to_kvaddr(vm_page_to_paddr(page));
+        DEBUG_ASSERT(ptr);
+        arch_zero_page(ptr);
+    }
+}
+
+// Hands the whole zero pool back to the arenas when memory runs out.
+// Returns the number of pages released.
+static size_t pmm_zero_pool_drain() {
+    struct list_node list = LIST_INITIAL_VALUE(list);
+    {
+        AutoSpinLockIrqSave lock(zero_pool_lock);
+        if (zero_pool_count == 0u)
+            return 0u;
+        while (!list_is_empty(&zero_pool))
+            list_add_tail(&list, list_remove_head(&zero_pool));
+        zero_pool_count = 0u;
+    }
+    return pmm_free_to_arenas(&list);
+}
+
+static int zero_pool_thread(void*) {
+    for (;;) {
+        event_wait(&zero_pool_event);
+
+        for (;;) {
+            {
+                AutoSpinLockIrqSave lock(zero_pool_lock);
+                if (zero_pool_count >= zero_pool_target)
+                    break;
+            }
+
+            // allocate without draining anything, the pool itself is the
+            // first thing to go when memory runs out
+            struct list_node list = LIST_INITIAL_VALUE(list);
+            size_t allocated = pmm_cache_alloc(kZeroPoolBatch, &list);
+            if (allocated < kZeroPoolBatch)
+                allocated += pmm_alloc_pages_from_arenas(kZeroPoolBatch - allocated,
+                                                         PMM_ALLOC_FLAG_KMAP, &list);
+            if (allocated == 0u)
+                break;
+
+            // nobody is going to look at these pages for a while, keep them
+            // out of the cache
+            vm_page_t* page;
+            list_for_every_entry (&list, page, vm_page_t, free.node) {
+                arch_zero_page_nontemporal(paddr_to_kvaddr(vm_page_to_paddr(page)));
+            }
+
+            AutoSpinLockIrqSave lock(zero_pool_lock);
+            while (!list_is_empty(&list)) {
+                list_add_tail(&zero_pool, list_remove_head(&list));
+                zero_pool_count++;
+            }
+        }
+    }
+    return 0;
+}
+
+static void zero_pool_init(uint level) {
+    zero_pool_target = cmdline_get_uint32("vm.zero_pool_pages", DEFAULT_ZERO_POOL_PAGES);
+    if (zero_pool_target == 0u)
+        return;
+
+    // just above the idle thread, so the zeroing only ever soaks up idle time
+    thread_t* t = thread_create("zero pool", zero_pool_thread, nullptr,
+                                LOWEST_PRIORITY + 1, DEFAULT_STACK_SIZE);
+    if (t == nullptr) {
+        TRACEF("unable to create zero pool thread\n");
+        return;
+    }
+    thread_detach_and_resume(t);
+    event_signal(&zero_pool_event, false);
+}
+LK_INIT_HOOK(pmm_zero_pool, &zero_pool_init, LK_INIT_LEVEL_THREADING);
+
 // We disable thread safety analysis here, since this function is only called
 // during early boot before threading exists.
 status_t pmm_add_arena(const pmm_arena_info_t* info) TA_NO_THREAD_SAFETY_ANALYSIS {
@@ -105,24 +374,127 @@ done_add:
     return NO_ERROR;
 }
 
-vm_page_t* pmm_alloc_page(uint alloc_flags, paddr_t* pa) {
+uint pmm_numa_node_count() {
+    return numa_node_count;
+}
+
+void pmm_set_cpu_numa_node(uint cpu_num, uint node) {
+    DEBUG_ASSERT(cpu_num < SMP_MAX_CPUS);
+    DEBUG_ASSERT(node < PMM_MAX_NUMA_NODES);
+
+    cpu_numa_node[cpu_num] = node;
+}
+
+// Like pmm_add_arena(), this only runs while the boot cpu is the only one up,
+// so the lock free readers of |arena_list| can't see it change.
+status_t pmm_set_numa_node(paddr_t base, size_t size, uint node) {
+    LTRACEF("base %#" PRIxPTR " size %#zx node %u\n", base, size, node);
+
+    if (node >= PMM_MAX_NUMA_NODES || size == 0 || base + size < base)
+        return ERR_INVALID_ARGS;
+
+    // only whole pages are on the node
+    const paddr_t start = ROUNDUP(base, PAGE_SIZE);
+    const paddr_t end = ROUNDDOWN(base + size, PAGE_SIZE);
+    if (start >= end)
+        return ERR_INVALID_ARGS;
+
     AutoLock al(&arena_lock);
 
-    /* walk the arenas in order until we find one with a free page */
-    for (auto& a : arena_list) {
-        /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
-        if (alloc_flags & PMM_ALLOC_FLAG_KMAP) {
-            if ((a.flags() & PMM_ARENA_FLAG_KMAP) == 0)
+    for (auto it = arena_list.begin(); it != arena_list.end(); ++it) {
+        PmmArena& a = *it;
+        if (a.base() >= end || a.base() + a.size() <= start)
+            continue;
+
+        // the part below the range is left as it is, the part above it gets
+        // looked at next
+        paddr_t split = 0;
+        if (a.base() < start)
+            split = start;
+        else if (a.base() + a.size() > end)
+            split = end;
+        if (split) {
+            PmmArena* upper = a.SplitAt(split);
+            if (!upper)
+                return ERR_NO_MEMORY;
+            arena_list.insert_after(it, upper);
+            if (split == start)
                 continue;
         }
 
-        // try to allocate the page out of the arena
-        vm_page_t* page = a.AllocPage(pa);
-        if (page)
+        a.set_numa_node(node);
+    }
+
+    if (node >= numa_node_count)
+        numa_node_count = node + 1;
+
+    return NO_ERROR;
+}
+
+vm_page_t* pmm_alloc_page(uint alloc_flags, paddr_t* pa) {
+    struct list_node list = LIST_INITIAL_VALUE(list);
+    if (pmm_has_node_policy(alloc_flags)) {
+        vm_page_t* page = pmm_alloc_page_from_arenas(alloc_flags, pa);
+        if (!page && pmm_cache_drain_all() > 0u)
+            page = pmm_alloc_page_from_arenas(alloc_flags, pa);
+        if (page && (alloc_flags & PMM_ALLOC_FLAG_ZEROED))
+            arch_zero_page(paddr_to_kvaddr(pa ? *pa : vm_page_to_paddr(page)));
+        return page;
+    }
+
+    if (alloc_flags & PMM_ALLOC_FLAG_ZEROED) {
+        if (pmm_zero_pool_alloc(1u, &list) == 0u) {
+            vm_page_t* page = pmm_alloc_page(alloc_flags & ~PMM_ALLOC_FLAG_ZEROED, pa);
+            if (page)
+                arch_zero_page(paddr_to_kvaddr(pa ? *pa : vm_page_to_paddr(page)));
             return page;
+        }
+        vm_page_t* page = list_remove_head_type(&list, vm_page_t, free.node);
+        if (pa)
+            *pa = vm_page_to_paddr(page);
+        return page;
+    }
+
+    if (pmm_cache_alloc(1u, &list) == 0u) {
+        // Refill the cache from the KMAP arenas, keeping one page for us.
+        if (kPageCacheSize == 0u ||
+            pmm_alloc_pages_from_arenas(kPageCacheBatch + 1, PMM_ALLOC_FLAG_KMAP, &list) == 0u) {
+            vm_page_t* page = pmm_alloc_page_from_arenas(alloc_flags, pa);
+            if (!page && pmm_cache_drain_all() > 0u)
+                page = pmm_alloc_page_from_arenas(alloc_flags, pa);
+            return page;
+        }
+        vm_page_t* page = list_remove_head_type(&list, vm_page_t, free.node);
+        pmm_cache_fill(&list);
+        // We may have migrated to a cpu whose cache filled up meanwhile.
+        if (unlikely(!list_is_empty(&list)))
+            pmm_free_to_arenas(&list);
+        list_add_tail(&list, &page->free.node);
+    }
+
+    vm_page_t* page = list_remove_head_type(&list, vm_page_t, free.node);
+    if (pa)
+        *pa = vm_page_to_paddr(page);
+    return page;
+}
+
+static vm_page_t* pmm_alloc_page_from_arenas(uint alloc_flags, paddr_t* pa) {
+    AutoLock al(&arena_lock);
+
+    /* walk the arenas in order until we find one with a free page */
+    vm_page_t* page = nullptr;
+    pmm_for_every_arena(alloc_flags, [&](PmmArena& a) TA_NO_THREAD_SAFETY_ANALYSIS {
+        // try to allocate the page out of the arena
+        page = a.AllocPage(pa);
+        return page != nullptr;
+    });
+    if (page) {
+        vm_reclaim_check(pmm_count_free_pages_locked());
+        return page;
     }
 
     LTRACEF("failed to allocate page\n");
+    vm_reclaim_check(0);
     return nullptr;
 }
 
@@ -135,25 +507,56 @@ size_t pmm_alloc_pages(size_t count, uint alloc_flags, struct list_node* list) {
     if (count == 0)
         return 0;
 
+    if (pmm_has_node_policy(alloc_flags)) {
+        // go a page at a time, so interleaving spreads the pages themselves
+        size_t allocated = 0;
+        for (; allocated < count; allocated++) {
+            vm_page_t* page = pmm_alloc_page(alloc_flags, nullptr);
+            if (!page)
+                break;
+            list_add_tail(list, &page->free.node);
+        }
+        return allocated;
+    }
+
+    if (alloc_flags & PMM_ALLOC_FLAG_ZEROED) {
+        size_t allocated = pmm_zero_pool_alloc(count, list);
+        if (allocated < count) {
+            struct list_node fresh = LIST_INITIAL_VALUE(fresh);
+            allocated += pmm_alloc_pages(count - allocated, alloc_flags & ~PMM_ALLOC_FLAG_ZEROED,
+                                         &fresh);
+            pmm_zero_pages(&fresh);
+            while (!list_is_empty(&fresh))
+                list_add_tail(list, list_remove_head(&fresh));
+        }
+        return allocated;
+    }
+
+    size_t allocated = pmm_cache_alloc(count, list);
+    if (allocated < count)
+        allocated += pmm_alloc_pages_from_arenas(count - allocated, alloc_flags, list);
+    if (allocated < count && pmm_cache_drain_all() > 0u)
+        allocated += pmm_alloc_pages_from_arenas(count - allocated, alloc_flags, list);
+    return allocated;
+}
+
+static size_t pmm_alloc_pages_from_arenas(size_t count, uint alloc_flags,
+                                          struct list_node* list) {
     AutoLock al(&arena_lock);
 
     /* walk the arenas in order, allocating as many pages as we can from each */
     size_t allocated = 0;
-    for (auto& a : arena_list) {
+    pmm_for_every_arena(alloc_flags, [&](PmmArena& a) TA_NO_THREAD_SAFETY_ANALYSIS {
         DEBUG_ASSERT(count > allocated);
 
-        /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
-        if (alloc_flags & PMM_ALLOC_FLAG_KMAP) {
-            if ((a.flags() & PMM_ARENA_FLAG_KMAP) == 0)
-                continue;
-        }
-
         // ask the arena to allocate some pages
         allocated += a.AllocPages(count - allocated, list);
         DEBUG_ASSERT(allocated <= count);
-        if (allocated == count)
-            break;
-    }
+        return allocated == count;
+    });
+
+    if (allocated > 0)
+        vm_reclaim_check(pmm_count_free_pages_locked());
 
     return allocated;
 }
@@ -161,10 +564,14 @@ size_t pmm_alloc_pages(size_t count, uint alloc_flags, struct list_node* list) {
 size_t pmm_alloc_range(paddr_t address, size_t count, struct list_node* list) {
     LTRACEF("address %#" PRIxPTR ", count %zu\n", address, count);
 
-    uint allocated = 0;
     if (count == 0)
         return 0;
 
+    // A page of the range may be sitting in a cache, pull them all back
+    // before looking.
+    pmm_cache_drain_all();
+
+    uint allocated = 0;
     address = ROUNDDOWN(address, PAGE_SIZE);
 
     AutoLock al(&arena_lock);
@@ -199,21 +606,26 @@ size_t pmm_alloc_contiguous(size_t count, uint alloc_flags, uint8_t alignment_lo
     if (alignment_log2 < PAGE_SIZE_SHIFT)
         alignment_log2 = PAGE_SIZE_SHIFT;
 
-    AutoLock al(&arena_lock);
+    size_t allocated = pmm_alloc_contiguous_from_arenas(count, alloc_flags, alignment_log2, pa, list);
+    // Cached pages may be what breaks up the run.
+    if (allocated == 0 && pmm_cache_drain_all() > 0u)
+        allocated = pmm_alloc_contiguous_from_arenas(count, alloc_flags, alignment_log2, pa, list);
+    return allocated;
+}
 
-    for (auto& a : arena_list) {
-        /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
-        if (alloc_flags & PMM_ALLOC_FLAG_KMAP) {
-            if ((a.flags() & PMM_ARENA_FLAG_KMAP) == 0)
-                continue;
-        }
+static size_t pmm_alloc_contiguous_from_arenas(size_t count, uint alloc_flags,
+                                               uint8_t alignment_log2, paddr_t* pa,
+                                               struct list_node* list) {
+    AutoLock al(&arena_lock);
 
-        size_t allocated = a.AllocContiguous(count, alignment_log2, pa, list);
-        if (allocated > 0) {
-            DEBUG_ASSERT(allocated == count);
-            return allocated;
-        }
-    }
+    size_t allocated = 0;
+    pmm_for_every_arena(alloc_flags, [&](PmmArena& a) TA_NO_THREAD_SAFETY_ANALYSIS {
+        allocated = a.AllocContiguous(count, alignment_log2, pa, list);
+        DEBUG_ASSERT(allocated == 0 || allocated == count);
+        return allocated > 0;
+    });
+    if (allocated > 0)
+        return allocated;
 
     LTRACEF("couldn't find run\n");
     return 0;
@@ -293,6 +705,46 @@ size_t pmm_free(struct list_node* list) {
 
     DEBUG_ASSERT(list);
 
+    if (kPageCacheSize == 0u)
+        return pmm_free_to_arenas(list);
+
+    // Pages of |list| that went into the cache, and cached pages that were
+    // pushed out to make room. The latter are freed along with |overflow|.
+    size_t cached = 0u;
+    size_t drained = 0u;
+    struct list_node overflow = LIST_INITIAL_VALUE(overflow);
+    {
+        PageCache& cache = page_caches[arch_curr_cpu_num()];
+        AutoSpinLockIrqSave lock(cache.lock);
+        while (!list_is_empty(list)) {
+            vm_page_t* page = list_remove_head_type(list, vm_page_t, free.node);
+
+            DEBUG_ASSERT(!page_is_free(page));
+
+            if (!page_is_cacheable(page)) {
+                list_add_tail(&overflow, &page->free.node);
+                continue;
+            }
+            if (cache.count == kPageCacheSize) {
+                // Our cache is full, drain half of it back to the arenas.
+                for (size_t i = 0; i < kPageCacheBatch; ++i)
+                    list_add_tail(&overflow, &cache.pages[--cache.count]->free.node);
+                cache.drains++;
+                drained += kPageCacheBatch;
+            }
+            vm_page_set_state(page, VM_PAGE_STATE_ALLOC);
+            cache.pages[cache.count++] = page;
+            cached++;
+        }
+    }
+
+    size_t count = cached;
+    if (!list_is_empty(&overflow))
+        count += pmm_free_to_arenas(&overflow) - drained;
+    return count;
+}
+
+static size_t pmm_free_to_arenas(struct list_node* list) {
     AutoLock al(&arena_lock);
 
     uint count = 0;
@@ -332,9 +784,39 @@ static size_t pmm_count_free_pages_locked() TA_REQ(arena_lock) {
     return free;
 }
 
+static size_t pmm_count_cached_pages() {
+    size_t cached = 0u;
+    for (auto& cache : page_caches) {
+        AutoSpinLockIrqSave lock(cache.lock);
+        cached += cache.count;
+    }
+    return cached;
+}
+
 size_t pmm_count_free_pages() {
+    size_t cached = pmm_count_cached_pages();
+    {
+        AutoSpinLockIrqSave lock(zero_pool_lock);
+        cached += zero_pool_count;
+    }
     AutoLock al(&arena_lock);
-    return pmm_count_free_pages_locked();
+    return pmm_count_free_pages_locked() + cached;
+}
+
+static void pmm_dump_caches() {
+    for (uint i = 0; i < arch_max_num_cpus(); ++i) {
+        PageCache& cache = page_caches[i];
+        AutoSpinLockIrqSave lock(cache.lock);
+        uint64_t total = cache.hits + cache.misses;
+        printf("cpu %u: %zu pages cached, %" PRIu64 " hits %" PRIu64 " misses (%" PRIu64
+               "%% hit rate), %" PRIu64 " drains\n",
+               i, cache.count, cache.hits, cache.misses,
+               total ? (cache.hits * 100u) / total : 0u, cache.drains);
+    }
+
+    AutoSpinLockIrqSave lock(zero_pool_lock);
+    printf("zero pool: %zu/%u pages, %" PRIu64 " hits %" PRIu64 " misses\n",
+           zero_pool_count, zero_pool_target, zero_pool_hits, zero_pool_misses);
 }
 
 static void pmm_dump_free() TA_REQ(arena_lock) {
@@ -379,6 +861,7 @@ static int cmd_pmm(int argc, const cmd_args* argv, uint32_t flags) {
         printf("usage:\n");
         printf("%s arenas\n", argv[0].str);
         if (!is_panic) {
+            printf("%s caches\n", argv[0].str);
             printf("%s alloc <count>\n", argv[0].str);
             printf("%s alloc_range <address> <count>\n", argv[0].str);
             printf("%s alloc_kpages <count>\n", argv[0].str);
@@ -398,6 +881,8 @@ static int cmd_pmm(int argc, const cmd_args* argv, uint32_t flags) {
         // No other operations will work during a panic.
         printf("Only the \"arenas\" command is available during a panic.\n");
         goto usage;
+    } else if (!strcmp(argv[1].str, "caches")) {
+        pmm_dump_caches();
     } else if (!strcmp(argv[1].str, "free")) {
         static bool show_mem = false;
         static timer_t timer;
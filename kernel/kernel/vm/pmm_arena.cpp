@@ -9,6 +9,7 @@
 
 #include <err.h>
 #include <inttypes.h>
+#include <new.h>
 #include <string.h>
 #include <trace.h>
 
@@ -69,6 +70,43 @@ void PmmArena::BootAllocArray() {
     free_count_ += page_count;
 }
 
+PmmArena* PmmArena::SplitAt(paddr_t pa) {
+    DEBUG_ASSERT(IS_PAGE_ALIGNED(pa));
+    DEBUG_ASSERT(pa > base() && pa < base() + size());
+
+    pmm_arena_info_t info = info_;
+    info.base = pa;
+    info.size = base() + size() - pa;
+
+    AllocChecker ac;
+    PmmArena* upper = new (&ac) PmmArena(&info);
+    if (!ac.check())
+        return nullptr;
+
+    const size_t split_index = (pa - base()) / PAGE_SIZE;
+    upper->page_array_ = page_array_ + split_index;
+    upper->numa_node_ = numa_node_;
+#if PMM_ENABLE_FREE_FILL
+    upper->enforce_fill_ = enforce_fill_;
+#endif
+
+    // hand the free pages above the split over, keeping their order
+    vm_page_t* page;
+    vm_page_t* temp;
+    list_for_every_entry_safe (&free_list_, page, temp, vm_page_t, free.node) {
+        if (page < upper->page_array_)
+            continue;
+        list_delete(&page->free.node);
+        list_add_tail(&upper->free_list_, &page->free.node);
+        free_count_--;
+        upper->free_count_++;
+    }
+
+    info_.size = pa - base();
+
+    return upper;
+}
+
 vm_page_t* PmmArena::AllocPage(paddr_t* pa) {
     vm_page_t* page = list_remove_head_type(&free_list_, vm_page_t, free.node);
     if (!page)
@@ -80,7 +118,7 @@ vm_page_t* PmmArena::AllocPage(paddr_t* pa) {
 
     DEBUG_ASSERT(page_is_free(page));
 
-    page->state = VM_PAGE_STATE_ALLOC;
+    vm_page_set_state(page, VM_PAGE_STATE_ALLOC);
 #if PMM_ENABLE_FREE_FILL
     CheckFreeFill(page);
 #endif
@@ -112,7 +150,7 @@ vm_page_t* PmmArena::AllocSpecific(paddr_t pa) {
 
     list_delete(&page->free.node);
 
-    page->state = VM_PAGE_STATE_ALLOC;
+    vm_page_set_state(page, VM_PAGE_STATE_ALLOC);
 
     DEBUG_ASSERT(free_count_ > 0);
 
@@ -140,7 +178,7 @@ size_t PmmArena::AllocPages(size_t count, list_node* list) {
         CheckFreeFill(page);
 #endif
 
-        page->state = VM_PAGE_STATE_ALLOC;
+        vm_page_set_state(page, VM_PAGE_STATE_ALLOC);
         list_add_tail(list, &page->free.node);
 
         allocated++;
@@ -191,7 +229,7 @@ retry:
             DEBUG_ASSERT(list_in_list(&p->free.node));
 
             list_delete(&p->free.node);
-            p->state = VM_PAGE_STATE_ALLOC;
+            vm_page_set_state(p, VM_PAGE_STATE_ALLOC);
 
             DEBUG_ASSERT(free_count_ > 0);
 
@@ -223,7 +261,7 @@ status_t PmmArena::FreePage(vm_page_t* page) {
     FreeFill(page);
 #endif
 
-    page->state = VM_PAGE_STATE_FREE;
+    vm_page_set_state(page, VM_PAGE_STATE_FREE);
 
     list_add_head(&free_list_, &page->free.node);
     free_count_++;
@@ -231,8 +269,8 @@ status_t PmmArena::FreePage(vm_page_t* page) {
 }
 
 void PmmArena::Dump(bool dump_pages, bool dump_free_ranges) {
-    printf("arena %p: name '%s' base %#" PRIxPTR " size 0x%zx priority %u flags 0x%x\n", this, name(), base(),
-           size(), priority(), flags());
+    printf("arena %p: name '%s' base %#" PRIxPTR " size 0x%zx priority %u flags 0x%x node %u\n", this,
+           name(), base(), size(), priority(), flags(), numa_node());
     printf("\tpage_array %p, free_count %zu\n", page_array_, free_count_);
 
     /* dump all of the pages */
@@ -24,6 +24,11 @@ public:
     // set up the per page structures, allocated out of the boot time allocator
     void BootAllocArray();
 
+    // split off the part of the arena at and above |pa| into a new arena with the
+    // same flags and priority, sharing the page array. returns nullptr if it
+    // can't be allocated.
+    PmmArena* SplitAt(paddr_t pa);
+
 #if PMM_ENABLE_FREE_FILL
     void EnforceFill();
 #endif
@@ -38,6 +43,8 @@ public:
     unsigned int flags() const { return info_.flags; }
     unsigned int priority() const { return info_.priority; }
     size_t free_count() const { return free_count_; };
+    uint numa_node() const { return numa_node_; }
+    void set_numa_node(uint node) { numa_node_ = node; }
 
     vm_page_t* get_page(size_t index) { return &page_array_[index]; }
 
@@ -74,8 +81,9 @@ private:
     void CheckFreeFill(vm_page_t* page);
 #endif
 
-    const pmm_arena_info_t info_;
+    pmm_arena_info_t info_;
     vm_page_t* page_array_ = nullptr;
+    uint numa_node_ = 0;
 
     size_t free_count_ = 0;
     list_node free_list_ = LIST_INITIAL_VALUE(free_list_);
@@ -12,11 +12,16 @@ MODULE := $(LOCAL_DIR)
 MODULE_DEPS += \
     kernel/lib/mxtl \
     kernel/lib/user_copy \
-    third_party/lib/cryptolib
+    third_party/lib/cryptolib \
+    third_party/lib/lz4
 
 MODULE_SRCS += \
     $(LOCAL_DIR)/bootalloc.cpp \
+    $(LOCAL_DIR)/compressed_page.cpp \
+    $(LOCAL_DIR)/mem_stats.cpp \
+    $(LOCAL_DIR)/memory_account.cpp \
     $(LOCAL_DIR)/page.cpp \
+    $(LOCAL_DIR)/page_source.cpp \
     $(LOCAL_DIR)/pmm.cpp \
     $(LOCAL_DIR)/pmm_arena.cpp \
     $(LOCAL_DIR)/vm.cpp \
@@ -28,6 +33,7 @@ MODULE_SRCS += \
     $(LOCAL_DIR)/vm_object_paged.cpp \
     $(LOCAL_DIR)/vm_object_physical.cpp \
     $(LOCAL_DIR)/vm_page_list.cpp \
+    $(LOCAL_DIR)/vm_reclaim.cpp \
     $(LOCAL_DIR)/vm_unittest.cpp \
     $(LOCAL_DIR)/vmm.cpp \
 
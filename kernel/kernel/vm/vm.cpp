@@ -88,7 +88,7 @@ void MarkPagesInUse(vaddr_t va, size_t len) {
 
     // mark all of the pages we allocated as WIRED
     vm_page_t* p;
-    list_for_every_entry (&list, p, vm_page_t, free.node) { p->state = VM_PAGE_STATE_WIRED; }
+    list_for_every_entry (&list, p, vm_page_t, free.node) { vm_page_set_state(p, VM_PAGE_STATE_WIRED); }
 }
 
 status_t ProtectRegion(VmAspace* aspace, vaddr_t va, uint arch_mmu_flags) {
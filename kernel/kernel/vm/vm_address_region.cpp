@@ -10,6 +10,7 @@
 #include <assert.h>
 #include <err.h>
 #include <inttypes.h>
+#include <kernel/auto_lock.h>
 #include <kernel/vm.h>
 #include <kernel/vm/vm_aspace.h>
 #include <kernel/vm/vm_object.h>
@@ -79,7 +80,7 @@ status_t VmAddressRegion::CreateSubVmarInternal(size_t offset, size_t size, uint
                                                 mxtl::RefPtr<VmAddressRegionOrMapping>* out) {
     DEBUG_ASSERT(out);
 
-    AutoLock guard(aspace_->lock());
+    AutoWriteLock guard(aspace_->lock());
     if (state_ != LifeCycleState::ALIVE) {
         return ERR_BAD_STATE;
     }
@@ -94,6 +95,9 @@ status_t VmAddressRegion::CreateSubVmarInternal(size_t offset, size_t size, uint
         return ERR_ACCESS_DENIED;
     }
 
+    // The fault-around policy is inherited by everything created within this region
+    vmar_flags |= flags_ & VMAR_FLAG_FAULT_AROUND;
+
     bool is_specific_overwrite = static_cast<bool>(vmar_flags & VMAR_FLAG_SPECIFIC_OVERWRITE);
     bool is_specific = static_cast<bool>(vmar_flags & VMAR_FLAG_SPECIFIC) || is_specific_overwrite;
     if (!is_specific && offset != 0) {
@@ -184,7 +188,8 @@ status_t VmAddressRegion::CreateSubVmar(size_t offset, size_t size, uint8_t alig
     }
 
     // Check that only allowed flags have been set
-    if (vmar_flags & ~(VMAR_FLAG_SPECIFIC | VMAR_FLAG_CAN_MAP_SPECIFIC | VMAR_FLAG_COMPACT | VMAR_CAN_RWX_FLAGS)) {
+    if (vmar_flags & ~(VMAR_FLAG_SPECIFIC | VMAR_FLAG_CAN_MAP_SPECIFIC | VMAR_FLAG_COMPACT | VMAR_CAN_RWX_FLAGS |
+                       VMAR_FLAG_FAULT_AROUND)) {
         return ERR_INVALID_ARGS;
     }
 
@@ -207,7 +212,8 @@ status_t VmAddressRegion::CreateVmMapping(size_t mapping_offset, size_t size, ui
     LTRACEF("%p %#zx %#zx %x\n", this, mapping_offset, size, vmar_flags);
 
     // Check that only allowed flags have been set
-    if (vmar_flags & ~(VMAR_FLAG_SPECIFIC | VMAR_FLAG_SPECIFIC_OVERWRITE | VMAR_CAN_RWX_FLAGS)) {
+    if (vmar_flags & ~(VMAR_FLAG_SPECIFIC | VMAR_FLAG_SPECIFIC_OVERWRITE | VMAR_CAN_RWX_FLAGS |
+                       VMAR_FLAG_FAULT_AROUND)) {
         return ERR_INVALID_ARGS;
     }
 
@@ -253,7 +259,7 @@ status_t VmAddressRegion::OverwriteVmMapping(vaddr_t base, size_t size, uint32_t
                                              uint arch_mmu_flags, const char* name,
                                              mxtl::RefPtr<VmAddressRegionOrMapping>* out) {
     canary_.Assert();
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_write_held(aspace_->lock()));
     DEBUG_ASSERT(vmo);
     DEBUG_ASSERT(vmar_flags & VMAR_FLAG_SPECIFIC_OVERWRITE);
 
@@ -278,7 +284,7 @@ status_t VmAddressRegion::OverwriteVmMapping(vaddr_t base, size_t size, uint32_t
 
 status_t VmAddressRegion::DestroyLocked() {
     canary_.Assert();
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_write_held(aspace_->lock()));
     LTRACEF("%p '%s'\n", this, name_);
 
     // Take a reference to ourself, so that we do not get destructed after
@@ -313,7 +319,7 @@ void VmAddressRegion::RemoveSubregion(VmAddressRegionOrMapping* region) {
 }
 
 mxtl::RefPtr<VmAddressRegionOrMapping> VmAddressRegion::FindRegion(vaddr_t addr) {
-    AutoLock guard(aspace_->lock());
+    AutoReadLock guard(aspace_->lock());
     if (state_ != LifeCycleState::ALIVE) {
         return nullptr;
     }
@@ -335,7 +341,7 @@ mxtl::RefPtr<VmAddressRegionOrMapping> VmAddressRegion::FindRegionLocked(vaddr_t
 
 size_t VmAddressRegion::AllocatedPagesLocked() const {
     canary_.Assert();
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_held(aspace_->lock()));
 
     if (state_ != LifeCycleState::ALIVE) {
         return 0;
@@ -350,7 +356,7 @@ size_t VmAddressRegion::AllocatedPagesLocked() const {
 
 status_t VmAddressRegion::PageFault(vaddr_t va, uint pf_flags) {
     canary_.Assert();
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_held(aspace_->lock()));
 
     for (auto vmar = WrapRefPtr(this);
          auto next = vmar->FindRegionLocked(va);
@@ -363,7 +369,7 @@ status_t VmAddressRegion::PageFault(vaddr_t va, uint pf_flags) {
 }
 
 bool VmAddressRegion::IsRangeAvailableLocked(vaddr_t base, size_t size) {
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_held(aspace_->lock()));
     DEBUG_ASSERT(size > 0);
 
     // Find the first region with base > *base*.  Since subregions_ has no
@@ -395,7 +401,7 @@ bool VmAddressRegion::CheckGapLocked(const ChildList::iterator& prev,
                                      const ChildList::iterator& next,
                                      vaddr_t* pva, vaddr_t search_base, vaddr_t align,
                                      size_t region_size, size_t min_gap, uint arch_mmu_flags) {
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_held(aspace_->lock()));
 
     safeint::CheckedNumeric<vaddr_t> gap_beg; // first byte of a gap
     safeint::CheckedNumeric<vaddr_t> gap_end; // last byte of a gap
@@ -482,7 +488,7 @@ status_t VmAddressRegion::AllocSpotLocked(size_t size, uint8_t align_pow2, uint
                                           vaddr_t* spot) {
     canary_.Assert();
     DEBUG_ASSERT(size > 0 && IS_PAGE_ALIGNED(size));
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_write_held(aspace_->lock()));
 
     LTRACEF_LEVEL(2, "aspace %p size 0x%zx align %hhu\n", this, size,
                   align_pow2);
@@ -501,7 +507,7 @@ status_t VmAddressRegion::AllocSpotLocked(size_t size, uint8_t align_pow2, uint
 bool VmAddressRegion::EnumerateChildrenLocked(VmEnumerator* ve, uint depth) {
     canary_.Assert();
     DEBUG_ASSERT(ve != nullptr);
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_held(aspace_->lock()));
     for (auto& child : subregions_) {
         DEBUG_ASSERT(child.IsAliveLocked());
         if (child.is_mapping()) {
@@ -538,7 +544,7 @@ void VmAddressRegion::Dump(uint depth, bool verbose) const {
 
 void VmAddressRegion::Activate() {
     DEBUG_ASSERT(state_ == LifeCycleState::NOT_READY);
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_write_held(aspace_->lock()));
 
     state_ = LifeCycleState::ALIVE;
     parent_->subregions_.insert(mxtl::RefPtr<VmAddressRegionOrMapping>(this));
@@ -553,7 +559,7 @@ status_t VmAddressRegion::Unmap(vaddr_t base, size_t size) {
 
     size = ROUNDUP(size, PAGE_SIZE);
 
-    AutoLock guard(aspace_->lock());
+    AutoWriteLock guard(aspace_->lock());
     if (state_ != LifeCycleState::ALIVE) {
         return ERR_BAD_STATE;
     }
@@ -562,7 +568,7 @@ status_t VmAddressRegion::Unmap(vaddr_t base, size_t size) {
 }
 
 status_t VmAddressRegion::UnmapInternalLocked(vaddr_t base, size_t size, bool can_destroy_regions) {
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_write_held(aspace_->lock()));
 
     if (!is_in_range(base, size)) {
         return ERR_INVALID_ARGS;
@@ -649,7 +655,7 @@ status_t VmAddressRegion::Protect(vaddr_t base, size_t size, uint new_arch_mmu_f
 
     size = ROUNDUP(size, PAGE_SIZE);
 
-    AutoLock guard(aspace_->lock());
+    AutoWriteLock guard(aspace_->lock());
     if (state_ != LifeCycleState::ALIVE) {
         return ERR_BAD_STATE;
     }
@@ -723,9 +729,108 @@ status_t VmAddressRegion::Protect(vaddr_t base, size_t size, uint new_arch_mmu_f
     return NO_ERROR;
 }
 
+VmAddressRegionOrMapping* VmAddressRegion::SubregionRootLocked() {
+    using PtrTraits = ChildList::PtrTraits;
+    if (subregions_.is_empty())
+        return nullptr;
+
+    VmAddressRegionOrMapping* node = &subregions_.front();
+    while (PtrTraits::IsValid(node->subregion_list_node_.parent_))
+        node = node->subregion_list_node_.parent_;
+    return node;
+}
+
+size_t VmAddressRegion::LeadingGapLocked() {
+    if (subregions_.is_empty())
+        return size_;
+    return subregions_.front().base() - base_;
+}
+
+size_t VmAddressRegion::TrailingGapLocked() {
+    if (subregions_.is_empty())
+        return 0;
+    const VmAddressRegionOrMapping& last = subregions_.back();
+    return (base_ + size_ - 1) - (last.base() + last.size() - 1);
+}
+
+template <typename F>
+bool VmAddressRegion::ForEachSubtreeGapLocked(VmAddressRegionOrMapping* node, size_t min_size,
+                                              F& func) {
+    if (!node || node->subtree_max_gap_ < min_size)
+        return true;
+
+    VmAddressRegionOrMapping* left = node->subtree_left();
+    VmAddressRegionOrMapping* right = node->subtree_right();
+
+    if (!ForEachSubtreeGapLocked(left, min_size, func))
+        return false;
+
+    if (left) {
+        const vaddr_t gap_base = left->subtree_last_byte_ + 1;
+        const size_t gap = node->base() - gap_base;
+        if (gap > 0 && gap >= min_size && !func(gap_base, gap, node))
+            return false;
+    }
+
+    if (right) {
+        const vaddr_t gap_base = node->base() + node->size();
+        const size_t gap = right->subtree_first_byte_ - gap_base;
+        if (gap > 0 && gap >= min_size) {
+            VmAddressRegionOrMapping* next = right;
+            while (next->subtree_left())
+                next = next->subtree_left();
+            if (!func(gap_base, gap, next))
+                return false;
+        }
+    }
+
+    return ForEachSubtreeGapLocked(right, min_size, func);
+}
+
+void VmAddressRegion::FindGapByOffsetLocked(size_t* offset_inout, vaddr_t* gap_base,
+                                            size_t* gap_size) {
+    size_t offset = *offset_inout;
+    VmAddressRegionOrMapping* node = SubregionRootLocked();
+    DEBUG_ASSERT(node && offset < node->subtree_gap_bytes_);
+
+    // Walk down, skipping whole subtrees of free space on the way.
+    while (true) {
+        VmAddressRegionOrMapping* left = node->subtree_left();
+        VmAddressRegionOrMapping* right = node->subtree_right();
+
+        if (left) {
+            if (offset < left->subtree_gap_bytes_) {
+                node = left;
+                continue;
+            }
+            offset -= left->subtree_gap_bytes_;
+
+            const size_t gap = node->base() - (left->subtree_last_byte_ + 1);
+            if (offset < gap) {
+                *gap_base = left->subtree_last_byte_ + 1;
+                *gap_size = gap;
+                *offset_inout = offset;
+                return;
+            }
+            offset -= gap;
+        }
+
+        DEBUG_ASSERT(right);
+        const size_t gap = right->subtree_first_byte_ - (node->base() + node->size());
+        if (offset < gap) {
+            *gap_base = node->base() + node->size();
+            *gap_size = gap;
+            *offset_inout = offset;
+            return;
+        }
+        offset -= gap;
+        node = right;
+    }
+}
+
 status_t VmAddressRegion::LinearRegionAllocatorLocked(size_t size, uint8_t align_pow2,
                                                      uint arch_mmu_flags, vaddr_t* spot) {
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_write_held(aspace_->lock()));
 
     const vaddr_t base = 0;
 
@@ -733,52 +838,79 @@ status_t VmAddressRegion::LinearRegionAllocatorLocked(size_t size, uint8_t align
         align_pow2 = PAGE_SIZE_SHIFT;
     const vaddr_t align = 1UL << align_pow2;
 
-    // Find the first gap in the address space which can contain a region of the
-    // requested size.
-    auto before_iter = subregions_.end();
-    auto after_iter = subregions_.begin();
+    auto result = [spot]() -> status_t {
+        return (*spot != static_cast<vaddr_t>(-1)) ? NO_ERROR : ERR_NO_MEMORY;
+    };
 
-    do {
-        if (CheckGapLocked(before_iter, after_iter, spot, base, align, size, 0, arch_mmu_flags)) {
-            if (*spot != static_cast<vaddr_t>(-1)) {
-                return NO_ERROR;
-            } else {
-                return ERR_NO_MEMORY;
-            }
-        }
+    // Find the first gap in the address space which can contain a region of the
+    // requested size.  Start with the one in front of the first child.
+    if (CheckGapLocked(subregions_.end(), subregions_.begin(), spot, base, align, size, 0,
+                       arch_mmu_flags)) {
+        return result();
+    }
+    if (subregions_.is_empty())
+        return ERR_NO_MEMORY;
 
-        before_iter = after_iter++;
-    } while (before_iter.IsValid());
+    // Then the ones between children, skipping those too small to possibly
+    // hold the region without looking at them.
+    bool done = false;
+    auto check_gap = [&](vaddr_t gap_base, size_t gap_size,
+                         VmAddressRegionOrMapping* next) -> bool {
+        auto after_iter = subregions_.make_iterator(*next);
+        auto before_iter = after_iter;
+        --before_iter;
+        done = CheckGapLocked(before_iter, after_iter, spot, base, align, size, 0,
+                              arch_mmu_flags);
+        return !done;
+    };
+    ForEachSubtreeGapLocked(SubregionRootLocked(), size, check_gap);
+    if (done)
+        return result();
+
+    // Finally the one after the last child.
+    if (CheckGapLocked(--subregions_.end(), subregions_.end(), spot, base, align, size, 0,
+                       arch_mmu_flags)) {
+        return result();
+    }
 
     // couldn't find anything
     return ERR_NO_MEMORY;
 }
 
 template <typename F>
-void VmAddressRegion::ForEachGap(F func, uint8_t align_pow2) {
+void VmAddressRegion::ForEachGap(F func, uint8_t align_pow2, size_t min_size) {
     const vaddr_t align = 1UL << align_pow2;
 
-    // Scan the regions list to find the gap to the left of each region.  We
-    // round up the end of the previous region to the requested alignment, so
-    // all gaps reported will be for aligned ranges.
-    vaddr_t prev_region_end = ROUNDUP(base_, align);
-    for (const auto& region : subregions_) {
-        if (region.base() > prev_region_end) {
-            const size_t gap = region.base() - prev_region_end;
-            if (!func(prev_region_end, gap)) {
-                return;
-            }
-        }
-        prev_region_end = ROUNDUP(region.base() + region.size(), align);
-    }
+    // Visit the gap to the left of the first region, the gaps between regions
+    // and the gap to the right of the last one.  We round up the start of each
+    // gap to the requested alignment, so all gaps reported will be for aligned
+    // ranges.
+    auto report = [&func, align](vaddr_t gap_base, vaddr_t gap_end) -> bool {
+        const vaddr_t aligned_base = ROUNDUP(gap_base, align);
+        if (gap_end > aligned_base)
+            return func(aligned_base, gap_end - aligned_base);
+        return true;
+    };
 
-    // Grab the gap to the right of the last region (note that if there are no
-    // regions, this handles reporting the VMAR's whole span as a gap).
+    // If there are no regions, this reports the VMAR's whole span as a gap.
     const vaddr_t end = base_ + size_;
-    if (end > prev_region_end) {
-        const size_t gap = end - prev_region_end;
-        func(prev_region_end, gap);
+    if (subregions_.is_empty()) {
+        report(base_, end);
+        return;
     }
+
+    if (!report(base_, subregions_.front().base()))
+        return;
+
+    auto inner = [&report](vaddr_t gap_base, size_t gap_size,
+                           VmAddressRegionOrMapping*) -> bool {
+        return report(gap_base, gap_base + gap_size);
+    };
+    if (!ForEachSubtreeGapLocked(SubregionRootLocked(), min_size, inner))
+        return;
+
+    const VmAddressRegionOrMapping& last = subregions_.back();
+    report(last.base() + last.size(), end);
 }
 
 namespace {
@@ -789,56 +921,103 @@ constexpr size_t AllocationSpotsInRange(size_t range_size, size_t alloc_size, ui
     return ((range_size - alloc_size) >> align_pow2) + 1;
 }
 
+// Number of times the randomized allocator draws a page of free space at
+// random, hoping to land on the start of a spot that fits, before it falls
+// back to counting the spots.
+constexpr uint kRandomSpotAttempts = 16;
+
 } // namespace {}
 
 // Perform allocations for VMARs that aren't using the COMPACT policy.  This
 // allocator works by choosing uniformly at random from the set of positions
 // that could satisfy the allocation.
+//
+// Rather than counting the positions up front, which means looking at every
+// gap, it first picks pages of free space uniformly at random and takes the
+// first one that is a position which fits.  Every position is the start of
+// exactly one page of free space, so this is just as uniform, and each draw
+// only walks down the subregion tree.  If draws keep missing, as they will
+// when little of the free space fits the request, it counts the positions in
+// the gaps large enough to hold it instead.
 status_t VmAddressRegion::NonCompactRandomizedRegionAllocatorLocked(size_t size, uint8_t align_pow2,
                                                                    uint arch_mmu_flags,
                                                                    vaddr_t* spot) {
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_write_held(aspace_->lock()));
     DEBUG_ASSERT(spot);
 
     align_pow2 = mxtl::max(align_pow2, static_cast<uint8_t>(PAGE_SIZE_SHIFT));
     const vaddr_t align = 1UL << align_pow2;
 
-    // Calculate the number of spaces that we can fit this allocation in.
-    size_t candidate_spaces = 0;
-    ForEachGap([align, align_pow2, size, &candidate_spaces](vaddr_t gap_base, size_t gap_len) -> bool {
-        DEBUG_ASSERT(IS_ALIGNED(gap_base, align));
-        if (gap_len >= size) {
-            candidate_spaces += AllocationSpotsInRange(gap_len, size, align_pow2);
+    vaddr_t alloc_spot = static_cast<vaddr_t>(-1);
+
+    const size_t leading_gap = LeadingGapLocked();
+    VmAddressRegionOrMapping* root = SubregionRootLocked();
+    const size_t inner_gaps = root ? root->subtree_gap_bytes_ : 0;
+    const size_t free_pages = (leading_gap + inner_gaps + TrailingGapLocked()) >> PAGE_SIZE_SHIFT;
+
+    for (uint attempt = 0; free_pages > 0 && attempt < kRandomSpotAttempts; attempt++) {
+        size_t offset = aspace_->AslrPrng().RandInt(free_pages) << PAGE_SIZE_SHIFT;
+
+        // Find the gap holding the page we picked, and where in it it is.
+        vaddr_t gap_base;
+        size_t gap_size;
+        if (offset < leading_gap) {
+            gap_base = base_;
+            gap_size = leading_gap;
+        } else if ((offset -= leading_gap) < inner_gaps) {
+            FindGapByOffsetLocked(&offset, &gap_base, &gap_size);
+        } else {
+            offset -= inner_gaps;
+            const VmAddressRegionOrMapping& last = subregions_.back();
+            gap_base = last.base() + last.size();
+            gap_size = TrailingGapLocked();
         }
-        return true;
-    },
-               align_pow2);
+        DEBUG_ASSERT(offset < gap_size);
 
-    if (candidate_spaces == 0) {
-        return ERR_NO_MEMORY;
+        const vaddr_t candidate = gap_base + offset;
+        if (IS_ALIGNED(candidate, align) && gap_size - offset >= size) {
+            alloc_spot = candidate;
+            break;
+        }
     }
 
-    // Choose the index of the allocation to use.
-    size_t selected_index = aspace_->AslrPrng().RandInt(candidate_spaces);
-    DEBUG_ASSERT(selected_index < candidate_spaces);
-
-    // Find which allocation we picked.
-    vaddr_t alloc_spot = static_cast<vaddr_t>(-1);
-    ForEachGap([align_pow2, size, &alloc_spot, &selected_index](vaddr_t gap_base,
-                                                                size_t gap_len) -> bool {
-        if (gap_len < size) {
+    if (alloc_spot == static_cast<vaddr_t>(-1)) {
+        // Calculate the number of spaces that we can fit this allocation in.
+        size_t candidate_spaces = 0;
+        ForEachGap([align, align_pow2, size, &candidate_spaces](vaddr_t gap_base, size_t gap_len) -> bool {
+            DEBUG_ASSERT(IS_ALIGNED(gap_base, align));
+            if (gap_len >= size) {
+                candidate_spaces += AllocationSpotsInRange(gap_len, size, align_pow2);
+            }
             return true;
-        }
+        },
+                   align_pow2, size);
 
-        const size_t spots = AllocationSpotsInRange(gap_len, size, align_pow2);
-        if (selected_index < spots) {
-            alloc_spot = gap_base + (selected_index << align_pow2);
-            return false;
+        if (candidate_spaces == 0) {
+            return ERR_NO_MEMORY;
         }
-        selected_index -= spots;
-        return true;
-    },
-               align_pow2);
+
+        // Choose the index of the allocation to use.
+        size_t selected_index = aspace_->AslrPrng().RandInt(candidate_spaces);
+        DEBUG_ASSERT(selected_index < candidate_spaces);
+
+        // Find which allocation we picked.
+        ForEachGap([align_pow2, size, &alloc_spot, &selected_index](vaddr_t gap_base,
+                                                                    size_t gap_len) -> bool {
+            if (gap_len < size) {
+                return true;
+            }
+
+            const size_t spots = AllocationSpotsInRange(gap_len, size, align_pow2);
+            if (selected_index < spots) {
+                alloc_spot = gap_base + (selected_index << align_pow2);
+                return false;
+            }
+            selected_index -= spots;
+            return true;
+        },
+                   align_pow2, size);
+    }
     ASSERT(alloc_spot != static_cast<vaddr_t>(-1));
     ASSERT(IS_ALIGNED(alloc_spot, align));
 
@@ -867,7 +1046,7 @@ status_t VmAddressRegion::NonCompactRandomizedRegionAllocatorLocked(size_t size,
 status_t VmAddressRegion::CompactRandomizedRegionAllocatorLocked(size_t size, uint8_t align_pow2,
                                                                 uint arch_mmu_flags,
                                                                 vaddr_t* spot) {
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_write_held(aspace_->lock()));
 
     align_pow2 = mxtl::max(align_pow2, static_cast<uint8_t>(PAGE_SIZE_SHIFT));
     const vaddr_t align = 1UL << align_pow2;
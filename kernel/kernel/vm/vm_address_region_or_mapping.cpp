@@ -10,6 +10,7 @@
 #include <assert.h>
 #include <err.h>
 #include <inttypes.h>
+#include <kernel/auto_lock.h>
 #include <kernel/vm.h>
 #include <kernel/vm/vm_aspace.h>
 #include <mxtl/auto_call.h>
@@ -32,7 +33,7 @@ VmAddressRegionOrMapping::VmAddressRegionOrMapping(
 status_t VmAddressRegionOrMapping::Destroy() {
     canary_.Assert();
 
-    AutoLock guard(aspace_->lock());
+    AutoWriteLock guard(aspace_->lock());
     if (state_ != LifeCycleState::ALIVE) {
         return ERR_BAD_STATE;
     }
@@ -50,9 +51,67 @@ VmAddressRegionOrMapping::~VmAddressRegionOrMapping() {
     DEBUG_ASSERT(!subregion_list_node_.InContainer());
 }
 
+VmAddressRegionOrMapping* VmAddressRegionOrMapping::subtree_left() const {
+    using PtrTraits = mxtl::internal::ContainerPtrTraits<mxtl::RefPtr<VmAddressRegionOrMapping>>;
+    const auto& left = subregion_list_node_.left_;
+    return PtrTraits::IsValid(left) ? left.get() : nullptr;
+}
+
+VmAddressRegionOrMapping* VmAddressRegionOrMapping::subtree_right() const {
+    using PtrTraits = mxtl::internal::ContainerPtrTraits<mxtl::RefPtr<VmAddressRegionOrMapping>>;
+    const auto& right = subregion_list_node_.right_;
+    return PtrTraits::IsValid(right) ? right.get() : nullptr;
+}
+
+void VmAddressRegionOrMapping::UpdateSubtreeGaps() {
+    DEBUG_ASSERT(size_ > 0);
+
+    // work in terms of last bytes, the end of a region at the top of the
+    // address space doesn't fit in a vaddr_t
+    subtree_first_byte_ = base_;
+    subtree_last_byte_ = base_ + size_ - 1;
+    subtree_max_gap_ = 0;
+    subtree_gap_bytes_ = 0;
+
+    auto add_gap = [this](size_t gap) {
+        subtree_max_gap_ = MAX(subtree_max_gap_, gap);
+        subtree_gap_bytes_ += gap;
+    };
+
+    VmAddressRegionOrMapping* left = subtree_left();
+    if (left) {
+        DEBUG_ASSERT(left->subtree_last_byte_ < base_);
+        add_gap(base_ - left->subtree_last_byte_ - 1);
+        subtree_first_byte_ = left->subtree_first_byte_;
+        subtree_max_gap_ = MAX(subtree_max_gap_, left->subtree_max_gap_);
+        subtree_gap_bytes_ += left->subtree_gap_bytes_;
+    }
+
+    VmAddressRegionOrMapping* right = subtree_right();
+    if (right) {
+        DEBUG_ASSERT(right->subtree_first_byte_ > base_ + size_ - 1);
+        add_gap(right->subtree_first_byte_ - (base_ + size_ - 1) - 1);
+        subtree_last_byte_ = right->subtree_last_byte_;
+        subtree_max_gap_ = MAX(subtree_max_gap_, right->subtree_max_gap_);
+        subtree_gap_bytes_ += right->subtree_gap_bytes_;
+    }
+}
+
+void VmAddressRegionOrMapping::UpdateSubtreeGapsToRoot() {
+    using PtrTraits = mxtl::internal::ContainerPtrTraits<mxtl::RefPtr<VmAddressRegionOrMapping>>;
+    if (!subregion_list_node_.InContainer())
+        return;
+
+    VmAddressRegionOrMapping* node = this;
+    while (PtrTraits::IsValid(node)) {
+        node->UpdateSubtreeGaps();
+        node = node->subregion_list_node_.parent_;
+    }
+}
+
 bool VmAddressRegionOrMapping::IsAliveLocked() const {
     canary_.Assert();
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_held(aspace_->lock()));
     return state_ == LifeCycleState::ALIVE;
 }
 
@@ -86,7 +145,7 @@ bool VmAddressRegionOrMapping::is_valid_mapping_flags(uint arch_mmu_flags) {
 }
 
 size_t VmAddressRegionOrMapping::AllocatedPages() const {
-    AutoLock guard(aspace_->lock());
+    AutoReadLock guard(aspace_->lock());
     if (state_ != LifeCycleState::ALIVE) {
         return 0;
     }
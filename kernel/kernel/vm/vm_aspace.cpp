@@ -221,7 +221,7 @@ VmAspace::~VmAspace() {
 }
 
 mxtl::RefPtr<VmAddressRegion> VmAspace::RootVmar() {
-    AutoLock guard(&lock_);
+    AutoReadLock guard(&lock_);
     mxtl::RefPtr<VmAddressRegion> ref(root_vmar_);
     return mxtl::move(ref);
 }
@@ -230,7 +230,7 @@ status_t VmAspace::Destroy() {
     canary_.Assert();
     LTRACEF("%p '%s'\n", this, name_);
 
-    AutoLock guard(&lock_);
+    AutoWriteLock guard(&lock_);
 
 #if WITH_LIB_VDSO
     // Don't let a vDSO mapping prevent destroying a VMAR
@@ -252,7 +252,7 @@ status_t VmAspace::Destroy() {
 }
 
 bool VmAspace::is_destroyed() const {
-    AutoLock guard(&lock_);
+    AutoReadLock guard(&lock_);
     return aspace_destroyed_;
 }
 
@@ -518,10 +518,11 @@ status_t VmAspace::PageFault(vaddr_t va, uint flags) {
     DEBUG_ASSERT(!aspace_destroyed_);
     LTRACEF("va %#" PRIxPTR ", flags %#x\n", va, flags);
 
-    // for now, hold the aspace lock across the page fault operation,
+    // hold the aspace lock for reading across the page fault operation,
     // which stops any other operations on the address space from moving
-    // the region out from underneath it
-    AutoLock a(&lock_);
+    // the region out from underneath it while letting faults on other
+    // mappings proceed in parallel
+    AutoReadLock a(&lock_);
 
     return root_vmar_->PageFault(va, flags);
 }
@@ -531,7 +532,7 @@ void VmAspace::Dump(bool verbose) const {
     printf("as %p [%#" PRIxPTR " %#" PRIxPTR "] sz %#zx fl %#x ref %d '%s'\n", this,
            base_, base_ + size_ - 1, size_, flags_, ref_count_debug(), name_);
 
-    AutoLock a(&lock_);
+    AutoReadLock a(&lock_);
 
     if (verbose)
         root_vmar_->Dump(1, verbose);
@@ -540,7 +541,7 @@ void VmAspace::Dump(bool verbose) const {
 bool VmAspace::EnumerateChildren(VmEnumerator* ve) {
     canary_.Assert();
     DEBUG_ASSERT(ve != nullptr);
-    AutoLock a(&lock_);
+    AutoReadLock a(&lock_);
     if (root_vmar_ == nullptr || aspace_destroyed_) {
         // Aspace hasn't been initialized or has already been destroyed.
         return true;
@@ -563,20 +564,20 @@ void DumpAllAspaces(bool verbose) {
 size_t VmAspace::AllocatedPages() const {
     canary_.Assert();
 
-    AutoLock a(&lock_);
+    AutoReadLock a(&lock_);
     return root_vmar_->AllocatedPagesLocked();
 }
 
 void VmAspace::InitializeAslr() {
     aslr_enabled_ = is_user() && !cmdline_get_bool("aslr.disable", false);
 
-    crypto::GlobalPRNG::GetInstance()->Draw(aslr_seed_, sizeof(aslr_seed_));
+    crypto::GlobalPRNG::DrawPerCpu(aslr_seed_, sizeof(aslr_seed_));
     aslr_prng_.AddEntropy(aslr_seed_, sizeof(aslr_seed_));
 }
 
 #if WITH_LIB_VDSO
 uintptr_t VmAspace::vdso_base_address() const {
-    AutoLock a(&lock_);
+    AutoReadLock a(&lock_);
     return VDso::base_address(vdso_code_mapping_);
 }
 #endif
@@ -10,6 +10,9 @@
 #include <assert.h>
 #include <err.h>
 #include <inttypes.h>
+#include <lk/init.h>
+#include <kernel/auto_lock.h>
+#include <kernel/cmdline.h>
 #include <kernel/vm.h>
 #include <kernel/vm/vm_aspace.h>
 #include <kernel/vm/vm_object.h>
@@ -21,6 +24,19 @@
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
+// number of pages past the faulting one that a VMAR_FLAG_FAULT_AROUND mapping
+// faults in, overridable with vm.fault_around_pages on the kernel command line
+#define DEFAULT_FAULT_AROUND_PAGES 16u
+#define MAX_FAULT_AROUND_PAGES 256u
+
+static uint32_t fault_around_pages = DEFAULT_FAULT_AROUND_PAGES;
+
+static void fault_around_init(uint level) {
+    fault_around_pages = MIN(cmdline_get_uint32("vm.fault_around_pages", DEFAULT_FAULT_AROUND_PAGES),
+                             MAX_FAULT_AROUND_PAGES);
+}
+LK_INIT_HOOK(vm_fault_around, &fault_around_init, LK_INIT_LEVEL_VM);
+
 VmMapping::VmMapping(VmAddressRegion& parent, vaddr_t base, size_t size, uint32_t vmar_flags,
                      mxtl::RefPtr<VmObject> vmo, uint64_t vmo_offset, uint arch_mmu_flags,
                      const char* name)
@@ -39,7 +55,7 @@ VmMapping::~VmMapping() {
 
 size_t VmMapping::AllocatedPagesLocked() const {
     canary_.Assert();
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_held(aspace_->lock()));
 
     if (state_ != LifeCycleState::ALIVE) {
         return 0;
@@ -76,7 +92,7 @@ status_t VmMapping::Protect(vaddr_t base, size_t size, uint new_arch_mmu_flags)
 
     size = ROUNDUP(size, PAGE_SIZE);
 
-    AutoLock guard(aspace_->lock());
+    AutoWriteLock guard(aspace_->lock());
     if (state_ != LifeCycleState::ALIVE) {
         return ERR_BAD_STATE;
     }
@@ -89,7 +105,7 @@ status_t VmMapping::Protect(vaddr_t base, size_t size, uint new_arch_mmu_flags)
 }
 
 status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_flags) {
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_write_held(aspace_->lock()));
     DEBUG_ASSERT(size != 0 && IS_PAGE_ALIGNED(base) && IS_PAGE_ALIGNED(size));
 
     // Do not allow changing caching
@@ -102,8 +118,10 @@ status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_f
     }
 
     DEBUG_ASSERT(object_);
-    // grab the lock for the vmo
+    // grab the lock for the vmo, then the page table lock to keep the vmos of
+    // other mappings from unmapping pages while we rewrite the tables
     AutoLock al(object_->lock());
+    AutoLock pt(aspace_->pt_lock());
 
     // Persist our current caching mode
     new_arch_mmu_flags |= (arch_mmu_flags_ & ARCH_MMU_FLAG_CACHE_MASK);
@@ -140,7 +158,7 @@ status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_f
         LTRACEF("arch_mmu_protect returns %d\n", status);
         arch_mmu_flags_ = new_arch_mmu_flags;
 
-        size_ = size;
+        SetSizeLocked(size);
         mapping->ActivateLocked();
         return NO_ERROR;
     }
@@ -162,7 +180,7 @@ status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_f
                                            new_arch_mmu_flags);
         LTRACEF("arch_mmu_protect returns %d\n", status);
 
-        size_ -= size;
+        SetSizeLocked(size_ - size);
         mapping->ActivateLocked();
         return NO_ERROR;
     }
@@ -192,7 +210,7 @@ status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_f
     LTRACEF("arch_mmu_protect returns %d\n", status);
 
     // Turn us into the left half
-    size_ = left_size;
+    SetSizeLocked(left_size);
 
     center_mapping->ActivateLocked();
     right_mapping->ActivateLocked();
@@ -213,7 +231,7 @@ status_t VmMapping::Unmap(vaddr_t base, size_t size) {
         return ERR_BAD_STATE;
     }
 
-    AutoLock guard(aspace->lock());
+    AutoWriteLock guard(aspace->lock());
     if (state_ != LifeCycleState::ALIVE) {
         return ERR_BAD_STATE;
     }
@@ -232,7 +250,7 @@ status_t VmMapping::Unmap(vaddr_t base, size_t size) {
 
 status_t VmMapping::UnmapLocked(vaddr_t base, size_t size) {
     canary_.Assert();
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_write_held(aspace_->lock()));
     DEBUG_ASSERT(size != 0 && IS_PAGE_ALIGNED(size) && IS_PAGE_ALIGNED(base));
     DEBUG_ASSERT(base >= base_ && base - base_ < size_);
     DEBUG_ASSERT(size_ - (base - base_) >= size);
@@ -247,9 +265,10 @@ status_t VmMapping::UnmapLocked(vaddr_t base, size_t size) {
 
     LTRACEF("%p '%s'\n", this, name_);
 
-    // grab the lock for the vmo
+    // grab the lock for the vmo and the page tables
     DEBUG_ASSERT(object_);
     AutoLock al(object_->lock());
+    AutoLock pt(aspace_->pt_lock());
 
     // Check if unmapping from one of the ends
     if (base_ == base || base + size == base_ + size_) {
@@ -261,13 +280,17 @@ status_t VmMapping::UnmapLocked(vaddr_t base, size_t size) {
 
         if (base_ == base && size_ != size) {
             // We need to remove ourselves from tree before updating base_,
-            // since base_ is the tree key.
+            // since base_ is the tree key. The size has to shrink before we
+            // go back in too, or the gaps computed on insertion would see us
+            // overlapping the region that follows.
             mxtl::RefPtr<VmAddressRegionOrMapping> ref(parent_->subregions_.erase(*this));
             base_ += size;
             object_offset_ += size;
+            SetSizeLocked(size_ - size);
             parent_->subregions_.insert(mxtl::move(ref));
+        } else {
+            SetSizeLocked(size_ - size);
         }
-        size_ -= size;
 
         return NO_ERROR;
     }
@@ -295,11 +318,20 @@ status_t VmMapping::UnmapLocked(vaddr_t base, size_t size) {
     }
 
     // Turn us into the left half
-    size_ = base - base_;
+    SetSizeLocked(base - base_);
     mapping->ActivateLocked();
     return NO_ERROR;
 }
 
+void VmMapping::SetSizeLocked(size_t size) {
+    DEBUG_ASSERT(is_rwlock_write_held(aspace_->lock()));
+    DEBUG_ASSERT(size > 0 && size <= size_);
+
+    size_ = size;
+    // the free space our parent tracks around us has grown
+    UpdateSubtreeGapsToRoot();
+}
+
 status_t VmMapping::UnmapVmoRangeLocked(uint64_t offset, uint64_t len) const {
     canary_.Assert();
 
@@ -359,6 +391,8 @@ status_t VmMapping::UnmapVmoRangeLocked(uint64_t offset, uint64_t len) const {
     LTRACEF("going to unmap %#" PRIxPTR ", len %#" PRIx64 " aspace %p\n",
             unmap_base.ValueOrDie(), len_new, aspace_.get());
 
+    // faults on other mappings may be changing the page tables in parallel
+    AutoLock pt(aspace_->pt_lock());
     status_t status = arch_mmu_unmap(&aspace_->arch_aspace(), unmap_base.ValueOrDie(),
                                      static_cast<size_t>(len_new) / PAGE_SIZE, nullptr);
     if (status < 0)
@@ -370,7 +404,7 @@ status_t VmMapping::UnmapVmoRangeLocked(uint64_t offset, uint64_t len) const {
 status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
     canary_.Assert();
 
-    AutoLock guard(aspace_->lock());
+    AutoReadLock guard(aspace_->lock());
     if (state_ != LifeCycleState::ALIVE) {
         return ERR_BAD_STATE;
     }
@@ -382,10 +416,23 @@ status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
     DEBUG_ASSERT(IS_PAGE_ALIGNED(len));
 
     // precompute the flags we'll pass GetPageLocked
-    // if committing, then tell it to soft fault in a page
-    uint pf_flags = VMM_PF_FLAG_WRITE;
+    // if committing, then tell it to soft fault in a page. otherwise only map what
+    // is already there, and don't make private copies of parent pages for a
+    // mapping that can never write to them.
+    uint pf_flags = 0;
     if (commit)
-        pf_flags |= VMM_PF_FLAG_SW_FAULT;
+        pf_flags = VMM_PF_FLAG_WRITE | VMM_PF_FLAG_SW_FAULT;
+    else if (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_WRITE)
+        pf_flags = VMM_PF_FLAG_WRITE;
+
+    // when committing, have the object allocate the whole range in one go
+    // first rather than a page at a time below. this is best effort: the
+    // object may not support it, and pages decommitted in between are
+    // faulted in again by the loop.
+    if (commit) {
+        __UNUSED status_t status = object_->CommitRange(object_offset_ + offset, len, nullptr);
+        LTRACEF("CommitRange returns %d\n", status);
+    }
 
     // grab the lock for the vmo
     AutoLock al(object_->lock());
@@ -396,7 +443,30 @@ status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
     auto ac = mxtl::MakeAutoCall([&]() { currently_faulting_ = false; });
 
     // iterate through the range, grabbing a page from the underlying object and
-    // mapping it in
+    // mapping it in. physically contiguous runs are mapped with one call so the
+    // arch code can use large pages where the run is suitably aligned.
+    vaddr_t run_va = 0;
+    paddr_t run_pa = 0;
+    size_t run_count = 0;
+    auto map_run = [&]() {
+        if (run_count == 0)
+            return;
+        LTRACEF_LEVEL(2, "mapping %zu pages at pa %#" PRIxPTR " to va %#" PRIxPTR "\n",
+                      run_count, run_pa, run_va);
+
+        size_t mapped;
+        AutoLock pt(aspace_->pt_lock());
+        auto ret = arch_mmu_map(&aspace_->arch_aspace(), run_va, run_pa, run_count,
+                                arch_mmu_flags_, &mapped);
+        if (ret < 0) {
+            TRACEF("error %d mapping %zu pages at va %#" PRIxPTR " pa %#" PRIxPTR "\n",
+                   ret, run_count, run_va, run_pa);
+        }
+
+        DEBUG_ASSERT(mapped == run_count);
+        run_count = 0;
+    };
+
     size_t o;
     for (o = offset; o < offset + len; o += PAGE_SIZE) {
         uint64_t vmo_offset = object_offset_ + o;
@@ -408,24 +478,28 @@ status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
             // no page to map
             if (commit) {
                 // fail when we can't commit every requested page
+                map_run();
                 return status;
             } else {
                 // skip ahead
+                map_run();
                 continue;
             }
         }
 
         vaddr_t va = base_ + o;
-        LTRACEF_LEVEL(2, "mapping pa %#" PRIxPTR " to va %#" PRIxPTR "\n", pa, va);
-
-        size_t mapped;
-        auto ret = arch_mmu_map(&aspace_->arch_aspace(), va, pa, 1, arch_mmu_flags_, &mapped);
-        if (ret < 0) {
-            TRACEF("error %d mapping page at va %#" PRIxPTR " pa %#" PRIxPTR "\n", ret, va, pa);
+        if (run_count > 0 && va == run_va + run_count * PAGE_SIZE &&
+            pa == run_pa + run_count * PAGE_SIZE) {
+            run_count++;
+            continue;
         }
 
-        DEBUG_ASSERT(mapped == 1);
+        map_run();
+        run_va = va;
+        run_pa = pa;
+        run_count = 1;
     }
+    map_run();
 
     return NO_ERROR;
 }
@@ -436,7 +510,7 @@ status_t VmMapping::DecommitRange(size_t offset, size_t len,
     LTRACEF("%p '%s' [%#zx+%#zx], offset %#zx, len %#zx\n",
             this, name_, base_, size_, offset, len);
 
-    AutoLock guard(aspace_->lock());
+    AutoReadLock guard(aspace_->lock());
     if (state_ != LifeCycleState::ALIVE) {
         return ERR_BAD_STATE;
     }
@@ -450,7 +524,7 @@ status_t VmMapping::DecommitRange(size_t offset, size_t len,
 
 status_t VmMapping::DestroyLocked() {
     canary_.Assert();
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_write_held(aspace_->lock()));
     LTRACEF("%p '%s'\n", this, name_);
 
     // Take a reference to ourself, so that we do not get destructed after
@@ -500,7 +574,7 @@ status_t VmMapping::DestroyLocked() {
 
 status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
     canary_.Assert();
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_held(aspace_->lock()));
 
     DEBUG_ASSERT(va >= base_ && va <= base_ + size_ - 1);
 
@@ -540,10 +614,20 @@ status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
     currently_faulting_ = true;
     auto ac = mxtl::MakeAutoCall([&]() { currently_faulting_ = false; });
 
+    // committed objects backed by large contiguous runs get mapped a whole large page
+    // at a time. since the object already holds the pages there is nothing to copy
+    // on write, so this maps with the full permissions of the region.
+    if (MapLargePageLocked(va))
+        return NO_ERROR;
+
     // fault in or grab an existing page
     paddr_t new_pa;
     vm_page_t* page;
     status_t status = object_->GetPageLocked(vmo_offset, pf_flags, &page, &new_pa);
+    if (status == ERR_SHOULD_WAIT) {
+        // the page source has been asked for the page
+        return status;
+    }
     if (status < 0) {
         TRACEF("ERROR: failed to fault in or grab existing page\n");
         TRACEF("%p '%s', vmo_offset %#" PRIx64 ", pf_flags %#x\n", this, name_, vmo_offset, pf_flags);
@@ -559,6 +643,11 @@ status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
         mmu_flags &= ~ARCH_MMU_FLAG_PERM_WRITE;
     }
 
+    // the aspace lock is only held for reading, so faults on other mappings
+    // may be editing the page tables too. the vmo lock keeps other faults
+    // off this page, the page table lock keeps the tables consistent.
+    AutoLock pt(aspace_->pt_lock());
+
     // see if something is mapped here now
     // this may happen if we are one of multiple threads racing on a single address
     uint page_flags;
@@ -625,15 +714,122 @@ status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
         }
         DEBUG_ASSERT(mapped == 1);
     }
+    pt.release();
 
 // TODO: figure out what to do with this
 #if ARCH_ARM64
     if (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE)
         arch_sync_cache_range(va, PAGE_SIZE);
 #endif
+
+    if (flags_ & VMAR_FLAG_FAULT_AROUND)
+        FaultAroundLocked(va, pf_flags, mmu_flags);
+
     return NO_ERROR;
 }
 
+bool VmMapping::MapLargePageLocked(vaddr_t va) TA_NO_THREAD_SAFETY_ANALYSIS {
+    DEBUG_ASSERT(object_->lock()->IsHeld());
+
+    const vaddr_t large_va = ROUNDDOWN(va, LARGE_PAGE_SIZE);
+    if (size_ < LARGE_PAGE_SIZE || large_va < base_ || large_va - base_ > size_ - LARGE_PAGE_SIZE)
+        return false;
+
+    const uint64_t vmo_offset = large_va - base_ + object_offset_;
+    if (!IS_ALIGNED(vmo_offset, LARGE_PAGE_SIZE))
+        return false;
+
+    paddr_t pa;
+    if (object_->GetLargePageLocked(vmo_offset, &pa) != NO_ERROR)
+        return false;
+
+    LTRACEF("mapping large page pa %#" PRIxPTR " to va %#" PRIxPTR "\n", pa, large_va);
+
+    // earlier faults may have mapped some of the block one page at a time
+    const size_t count = LARGE_PAGE_SIZE / PAGE_SIZE;
+    AutoLock pt(aspace_->pt_lock());
+    status_t status = arch_mmu_unmap(&aspace_->arch_aspace(), large_va, count, nullptr);
+    if (status < 0)
+        return false;
+
+    size_t mapped;
+    status = arch_mmu_map(&aspace_->arch_aspace(), large_va, pa, count, arch_mmu_flags_, &mapped);
+    if (status < 0) {
+        TRACEF("failed to map large page at va %#" PRIxPTR "\n", large_va);
+        return false;
+    }
+    DEBUG_ASSERT(mapped == count);
+
+#if ARCH_ARM64
+    if (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE)
+        arch_sync_cache_range(large_va, LARGE_PAGE_SIZE);
+#endif
+    return true;
+}
+
+// Best effort: pages are faulted in with the same flags as the original fault,
+// so a read fault maps read only (shared or zero pages) and a write fault commits.
+// Physically contiguous runs are handed to the arch layer in one map call. Stops
+// at the first page that is already mapped or that can't be faulted in.
+void VmMapping::FaultAroundLocked(vaddr_t va, uint pf_flags, uint mmu_flags)
+    TA_NO_THREAD_SAFETY_ANALYSIS {
+    DEBUG_ASSERT(object_->lock()->IsHeld());
+    DEBUG_ASSERT(currently_faulting_);
+
+    const vaddr_t end = base_ + size_;
+    const vaddr_t limit = (end - (va + PAGE_SIZE) > (vaddr_t)fault_around_pages * PAGE_SIZE)
+                              ? va + PAGE_SIZE + (vaddr_t)fault_around_pages * PAGE_SIZE
+                              : end;
+
+    vaddr_t run_va = 0;
+    paddr_t run_pa = 0;
+    size_t run_count = 0;
+
+    auto flush_run = [&]() -> bool {
+        if (run_count == 0)
+            return true;
+        size_t mapped = 0;
+        AutoLock pt(aspace_->pt_lock());
+        status_t status = arch_mmu_map(&aspace_->arch_aspace(), run_va, run_pa, run_count,
+                                       mmu_flags, &mapped);
+#if ARCH_ARM64
+        if (mapped > 0 && (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE))
+            arch_sync_cache_range(run_va, mapped * PAGE_SIZE);
+#endif
+        run_count = 0;
+        return status >= 0;
+    };
+
+    for (vaddr_t addr = va + PAGE_SIZE; addr < limit; addr += PAGE_SIZE) {
+        paddr_t pa;
+        uint page_flags;
+        {
+            AutoLock pt(aspace_->pt_lock());
+            if (arch_mmu_query(&aspace_->arch_aspace(), addr, &pa, &page_flags) >= 0)
+                break;
+        }
+
+        uint64_t vmo_offset = addr - base_ + object_offset_;
+        if (object_->GetPageLocked(vmo_offset, pf_flags, nullptr, &pa) < 0)
+            break;
+
+        // assert that we're not accidentally mapping the zero page writable
+        DEBUG_ASSERT((pa != vm_get_zero_page_paddr()) || !(mmu_flags & ARCH_MMU_FLAG_PERM_WRITE));
+
+        if (run_count > 0 && pa == run_pa + run_count * PAGE_SIZE) {
+            run_count++;
+            continue;
+        }
+        if (!flush_run())
+            return;
+        run_va = addr;
+        run_pa = pa;
+        run_count = 1;
+    }
+
+    flush_run();
+}
+
 // We disable thread safety analysis here because one of the common uses of this
 // function is for splitting one mapping object into several that will be backed
 // by the same VmObject.  In that case, object_->lock() gets aliased across all
@@ -644,11 +840,14 @@ status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
 // function.
 void VmMapping::ActivateLocked() TA_NO_THREAD_SAFETY_ANALYSIS {
     DEBUG_ASSERT(state_ == LifeCycleState::NOT_READY);
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_write_held(aspace_->lock()));
     DEBUG_ASSERT(object_->lock()->IsHeld());
     DEBUG_ASSERT(parent_);
 
     state_ = LifeCycleState::ALIVE;
+    // mappings that didn't ask for a cache policy get the object's
+    if ((arch_mmu_flags_ & ARCH_MMU_FLAG_CACHE_MASK) == ARCH_MMU_FLAG_CACHED)
+        arch_mmu_flags_ |= object_->GetMappingCachePolicyLocked();
     object_->AddMappingLocked(this);
     parent_->subregions_.insert(mxtl::RefPtr<VmAddressRegionOrMapping>(this));
 }
@@ -14,6 +14,8 @@
 #include <inttypes.h>
 #include <kernel/auto_lock.h>
 #include <kernel/vm.h>
+#include <kernel/vm/mem_stats.h>
+#include <kernel/vm/memory_account.h>
 #include <kernel/vm/vm_address_region.h>
 #include <lib/console.h>
 #include <lib/user_copy.h>
@@ -39,8 +41,30 @@ void ZeroPage(vm_page_t* p) {
     ZeroPage(pa);
 }
 
+// long reads and writes take the lock a chunk at a time
+constexpr size_t kReadWriteChunkSize = 256 * 1024;
+
+// run |op|, a read or write of the object, again each time it stops to wait for
+// the page source to supply pages
+template <typename T>
+status_t RetryAfterSupply(T op) {
+    for (;;) {
+        uint64_t generation = vm_page_supply_generation();
+        status_t status = op();
+        if (status != ERR_SHOULD_WAIT)
+            return status;
+        status = vm_page_supply_wait(generation);
+        if (status != NO_ERROR)
+            return status;
+    }
+}
+
 } // namespace
 
+Mutex VmObjectPaged::reclaim_lock_;
+VmObjectPaged::ReclaimList VmObjectPaged::reclaim_list_;
+VmObjectPaged::ReclaimList VmObjectPaged::compress_list_;
+
 VmObjectPaged::VmObjectPaged(uint32_t pmm_alloc_flags, mxtl::RefPtr<VmObject> parent)
     : VmObject(mxtl::move(parent)), pmm_alloc_flags_(pmm_alloc_flags) {
     LTRACEF("%p\n", this);
@@ -51,8 +75,19 @@ VmObjectPaged::~VmObjectPaged() {
 
     LTRACEF("%p\n", this);
 
+    // the reclaimer may be looking at us, wait for it to be done
+    if (discardable_ || compressible_) {
+        AutoLock al(&reclaim_lock_);
+        if (reclaim_node_.InContainer())
+            (discardable_ ? reclaim_list_ : compress_list_).erase(*this);
+    }
+
+    // pins are held through a reference, so none can be left
+    DEBUG_ASSERT(pinned_ranges_.is_empty());
+
     // free all of the pages attached to us
     page_list_.FreeAllPages();
+    compressed_.clear();
 }
 
 mxtl::RefPtr<VmObject> VmObjectPaged::Create(uint32_t pmm_alloc_flags, uint64_t size) {
@@ -76,11 +111,58 @@ mxtl::RefPtr<VmObject> VmObjectPaged::Create(uint32_t pmm_alloc_flags, uint64_t
     return vmo;
 }
 
+mxtl::RefPtr<VmObject> VmObjectPaged::CreateDiscardable(uint32_t pmm_alloc_flags, uint64_t size) {
+    auto vmo = Create(pmm_alloc_flags, size);
+    if (!vmo)
+        return nullptr;
+
+    // nobody else can see the object yet. it starts out unlocked.
+    auto paged = static_cast<VmObjectPaged*>(vmo.get());
+    paged->discardable_ = true;
+
+    AutoLock al(&reclaim_lock_);
+    reclaim_list_.push_back(paged);
+
+    return vmo;
+}
+
+mxtl::RefPtr<VmObject> VmObjectPaged::CreateCompressible(uint32_t pmm_alloc_flags, uint64_t size) {
+    auto vmo = Create(pmm_alloc_flags, size);
+    if (!vmo)
+        return nullptr;
+
+    // nobody else can see the object yet
+    auto paged = static_cast<VmObjectPaged*>(vmo.get());
+    paged->compressible_ = true;
+
+    AutoLock al(&reclaim_lock_);
+    compress_list_.push_back(paged);
+
+    return vmo;
+}
+
+mxtl::RefPtr<VmObject> VmObjectPaged::CreateWithPageSource(uint32_t pmm_alloc_flags, uint64_t size,
+                                                           mxtl::RefPtr<PageSource> source) {
+    auto vmo = Create(pmm_alloc_flags, size);
+    if (!vmo)
+        return nullptr;
+
+    // nobody else can see the object yet
+    auto paged = static_cast<VmObjectPaged*>(vmo.get());
+    paged->page_source_ = mxtl::move(source);
+
+    return vmo;
+}
+
 status_t VmObjectPaged::CloneCOW(uint64_t offset, uint64_t size, mxtl::RefPtr<VmObject>* clone_vmo) {
     LTRACEF("vmo %p offset %#" PRIx64 " size %#" PRIx64 "\n", this, offset, size);
 
     canary_.Assert();
 
+    // clones would keep looking through to pages that can vanish underneath them
+    if (discardable_)
+        return ERR_NOT_SUPPORTED;
+
     AllocChecker ac;
     auto vmo = mxtl::AdoptRef<VmObjectPaged>(new (&ac) VmObjectPaged(pmm_alloc_flags_, mxtl::WrapRefPtr(this)));
     if (!ac.check())
@@ -88,11 +170,20 @@ status_t VmObjectPaged::CloneCOW(uint64_t offset, uint64_t size, mxtl::RefPtr<Vm
 
     AutoLock a(&lock_);
 
+    // the clone looks through to our pages, so they all have to be there.
+    // nothing is compressed again while we have children.
+    status_t status = DecompressRangeLocked(0, ROUNDUP_PAGE_SIZE(size_));
+    if (status != NO_ERROR)
+        return status;
+
     // add it as a child to us
     AddChildLocked(vmo.get());
 
+    // the clone shows our pages, so it has to map them the same way
+    vmo->cache_policy_ = cache_policy_;
+
     // set the new clone's size
-    auto status = vmo->ResizeLocked(size);
+    status = vmo->ResizeLocked(size);
     if (status != NO_ERROR)
         return status;
 
@@ -118,6 +209,12 @@ void VmObjectPaged::Dump(uint depth, bool verbose) {
         printf("  ");
     }
     printf("object %p size %#" PRIx64 " pages %zu ref %d\n", this, size_, count, ref_count_debug());
+    if (!compressed_.is_empty()) {
+        for (uint i = 0; i < depth + 1; ++i) {
+            printf("  ");
+        }
+        printf("compressed pages %zu\n", compressed_.size());
+    }
 
     if (verbose) {
         auto f = [depth](const auto p, uint64_t offset) {
@@ -137,13 +234,53 @@ size_t VmObjectPaged::AllocatedPagesInRange(uint64_t offset, uint64_t len) const
     if (!TrimRange(offset, len, size_, &new_len)) {
         return 0;
     }
-    size_t count = 0;
-    page_list_.ForEveryPage(
-        [&count, offset, new_len](const auto p, uint64_t off) {
-            if (off >= offset && off < offset + new_len) {
-                count++;
-            }
-        });
+    // the common case of a mapping covering the whole object is answered
+    // from the running count rather than by walking the tree
+    if (offset == 0 && new_len == size_)
+        return page_list_.CountPages();
+    return page_list_.CountPagesInRange(offset, offset + new_len);
+}
+
+size_t VmObjectPaged::SharedPagesInRange(uint64_t offset, uint64_t len) const {
+    canary_.Assert();
+    AutoLock a(&lock_);
+    uint64_t new_len;
+    if (!parent_ || !TrimRange(offset, len, size_, &new_len)) {
+        return 0;
+    }
+    // count the same pages as AllocatedPagesInRange() does
+    uint64_t start = ROUNDUP_PAGE_SIZE(offset);
+    uint64_t end = ROUNDUP_PAGE_SIZE(offset + new_len);
+    return VisiblePagesInRangeLocked(start, end) - page_list_.CountPagesInRange(start, end);
+}
+
+size_t VmObjectPaged::VisiblePagesInRangeLocked(uint64_t offset, uint64_t end) const {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    size_t count = page_list_.CountPagesInRange(offset, end);
+    const uint64_t limit = mxtl::min(end, parent_limit_);
+    if (!parent_ || offset >= limit)
+        return count;
+
+    // clones are only ever made of paged objects
+    DEBUG_ASSERT(parent_->is_paged());
+    auto parent = static_cast<const VmObjectPaged*>(parent_.get());
+
+    // every run of our own missing pages looks through to the parent
+    uint64_t gap_start = offset;
+    auto count_gap = [&](uint64_t gap_end) {
+        if (gap_end > gap_start) {
+            count += parent->VisiblePagesInRangeLocked(parent_offset_ + gap_start,
+                                                       parent_offset_ + gap_end);
+        }
+    };
+    page_list_.ForEveryPageInRange([&](vm_page* const&, uint64_t page_offset) -> status_t {
+        count_gap(page_offset);
+        gap_start = page_offset + PAGE_SIZE;
+        return NO_ERROR;
+    }, offset, limit);
+    count_gap(limit);
+
     return count;
 }
 
@@ -168,6 +305,10 @@ status_t VmObjectPaged::AddPageLocked(vm_page_t* p, uint64_t offset) {
     if (err != NO_ERROR)
         return err;
 
+    // the new page replaces whatever was kept compressed
+    if (!compressed_.is_empty())
+        FreeCompressedLocked(ROUNDDOWN(offset, PAGE_SIZE), ROUNDDOWN(offset, PAGE_SIZE) + PAGE_SIZE);
+
     // other mappings may have covered this offset into the vmo, so unmap those ranges
     RangeChangeUpdateLocked(offset, PAGE_SIZE);
 
@@ -200,7 +341,7 @@ mxtl::RefPtr<VmObject> VmObjectPaged::CreateFromROData(const void* data, size_t
                 // it's wired to the kernel, so we can just use it directly
             } else if (page->state == VM_PAGE_STATE_FREE) {
                 ASSERT(pmm_alloc_range(pa, 1, nullptr) == 1);
-                page->state = VM_PAGE_STATE_WIRED;
+                vm_page_set_state(page, VM_PAGE_STATE_WIRED);
             } else {
                 panic("page used to back static vmo in unusable state: paddr %#" PRIxPTR " state %u\n", pa,
                       page->state);
@@ -227,12 +368,25 @@ status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t*
     canary_.Assert();
     DEBUG_ASSERT(lock_.IsHeld());
 
+    // keep faults from having to walk a chain of dead parents
+    CollapseParentsLocked();
+
+    return GetPageInternalLocked(offset, pf_flags, page_out, pa_out);
+}
+
+status_t VmObjectPaged::GetPageInternalLocked(uint64_t offset, uint pf_flags, vm_page_t** const page_out,
+                                              paddr_t* const pa_out) {
+    canary_.Assert();
+    DEBUG_ASSERT(lock_.IsHeld());
+
     if (offset >= size_)
         return ERR_OUT_OF_RANGE;
 
     vm_page_t* p;
     paddr_t pa;
 
+    accessed_ = true;
+
     // see if we already have a page at that offset
     p = page_list_.GetPage(offset);
     if (p) {
@@ -247,8 +401,36 @@ status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t*
     LTRACEF("vmo %p, offset %#" PRIx64 ", pf_flags %#x (%s)\n", this, offset, pf_flags,
             vmm_pf_flags_to_string(pf_flags, pf_string));
 
+    // a compressed page is still there as far as anyone outside is concerned, so
+    // even lookups that mustn't fault get it decompressed
+    if (!compressed_.is_empty()) {
+        auto compressed = compressed_.find(ROUNDDOWN(offset, PAGE_SIZE));
+        if (compressed.IsValid()) {
+            p = pmm_alloc_page(pmm_alloc_flags_, &pa);
+            if (!p)
+                return ERR_NO_MEMORY;
+            vm_page_set_state(p, VM_PAGE_STATE_OBJECT);
+            compressed->Decompress(pa);
+
+            // this drops the compressed copy too
+            status_t status = AddPageLocked(p, ROUNDDOWN(offset, PAGE_SIZE));
+            if (status != NO_ERROR) {
+                pmm_free_page(p);
+                return status;
+            }
+
+            LTRACEF("decompressed page %p, pa %#" PRIxPTR "\n", p, pa);
+
+            if (page_out)
+                *page_out = p;
+            if (pa_out)
+                *pa_out = pa;
+            return NO_ERROR;
+        }
+    }
+
     // if we have a parent see if they have a page for us
-    if (parent_) {
+    if (parent_ && offset < parent_limit_) {
         safeint::CheckedNumeric<uint64_t> parent_offset = parent_offset_;
         parent_offset += offset;
         DEBUG_ASSERT(parent_offset.IsValid());
@@ -257,6 +439,15 @@ status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t*
         uint parent_pf_flags = pf_flags & ~(VMM_PF_FLAG_FAULT_MASK);
 
         status_t status = parent_->GetPageLocked(parent_offset.ValueOrDie(), parent_pf_flags, &p, &pa);
+        if (status == ERR_NOT_FOUND && (pf_flags & VMM_PF_FLAG_FAULT_MASK) &&
+            parent_->is_pager_backed()) {
+            // the parent's pages aren't holes, they just haven't been supplied yet.
+            // have the parent ask for the page, we copy it once it's there.
+            status = parent_->GetPageLocked(parent_offset.ValueOrDie(),
+                                            pf_flags & ~VMM_PF_FLAG_WRITE, &p, &pa);
+            if (status != NO_ERROR)
+                return status;
+        }
         if (status == NO_ERROR) {
             // we have a page from them. if we're read-only faulting, return that page so they can map
             // or read from it directly
@@ -277,7 +468,7 @@ status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t*
             if (!p_clone)
                 return ERR_NO_MEMORY;
 
-            p_clone->state = VM_PAGE_STATE_OBJECT;
+            vm_page_set_state(p_clone, VM_PAGE_STATE_OBJECT);
 
             // do a direct copy of the two pages
             const void* src = paddr_to_kvaddr(pa);
@@ -289,7 +480,10 @@ status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t*
 
             // add the new page and return it
             status = AddPageLocked(p_clone, offset);
-            DEBUG_ASSERT(status == NO_ERROR);
+            if (status != NO_ERROR) {
+                pmm_free_page(p_clone);
+                return status;
+            }
 
             LTRACEF("copy-on-write faulted in page %p, pa %#" PRIxPTR " copied from %p, pa %#" PRIxPTR "\n",
                     p, pa, p_clone, pa_clone);
@@ -307,6 +501,13 @@ status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t*
     if ((pf_flags & VMM_PF_FLAG_FAULT_MASK) == 0)
         return ERR_NOT_FOUND;
 
+    // the page source fills in the page, the fault has to wait for it and try again
+    if (page_source_) {
+        status_t status = page_source_->RequestPage(offset);
+        LTRACEF("requested page at offset %#" PRIx64 ", status %d\n", offset, status);
+        return status == NO_ERROR ? ERR_SHOULD_WAIT : status;
+    }
+
     // if we're read faulting, we don't already have a page, and the parent doesn't have it,
     // return the single global zero page
     if ((pf_flags & VMM_PF_FLAG_WRITE) == 0) {
@@ -318,21 +519,19 @@ status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t*
         return NO_ERROR;
     }
 
-    // allocate a page
-    p = pmm_alloc_page(pmm_alloc_flags_, &pa);
+    // allocate a page, preferably one the pmm zeroed ahead of time
+    p = pmm_alloc_page(pmm_alloc_flags_ | PMM_ALLOC_FLAG_ZEROED, &pa);
     if (!p)
         return ERR_NO_MEMORY;
 
-    p->state = VM_PAGE_STATE_OBJECT;
-
-    // TODO: remove once pmm returns zeroed pages
-    ZeroPage(pa);
+    vm_page_set_state(p, VM_PAGE_STATE_OBJECT);
 
+    // this also unmaps the zero page from wherever a read fault put it
     status_t status = AddPageLocked(p, offset);
-    DEBUG_ASSERT(status == NO_ERROR);
-
-    // other mappings may have covered this offset into the vmo, so unmap those ranges
-    RangeChangeUpdateLocked(offset, PAGE_SIZE);
+    if (status != NO_ERROR) {
+        pmm_free_page(p);
+        return status;
+    }
 
     LTRACEF("faulted in page %p, pa %#" PRIxPTR "\n", p, pa);
 
@@ -344,6 +543,38 @@ status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t*
     return NO_ERROR;
 }
 
+status_t VmObjectPaged::GetLargePageLocked(uint64_t offset, paddr_t* pa_out) {
+    canary_.Assert();
+    DEBUG_ASSERT(lock_.IsHeld());
+    DEBUG_ASSERT(IS_ALIGNED(offset, LARGE_PAGE_SIZE));
+
+    if (offset >= size_ || size_ - offset < LARGE_PAGE_SIZE)
+        return ERR_OUT_OF_RANGE;
+
+    // only pages we hold ourselves qualify, anything still in a parent has to be
+    // copied on write one page at a time
+    vm_page_t* p = page_list_.GetPage(offset);
+    if (!p)
+        return ERR_NOT_FOUND;
+    paddr_t base = vm_page_to_paddr(p);
+    if (!IS_ALIGNED(base, LARGE_PAGE_SIZE))
+        return ERR_NOT_FOUND;
+
+    size_t count = 0;
+    status_t status = page_list_.ForEveryPageInRange(
+        [base, offset, &count](vm_page_t* p, uint64_t o) -> status_t {
+            if (vm_page_to_paddr(p) != base + (o - offset))
+                return ERR_NOT_FOUND;
+            count++;
+            return NO_ERROR;
+        }, offset, offset + LARGE_PAGE_SIZE);
+    if (status != NO_ERROR || count != LARGE_PAGE_SIZE / PAGE_SIZE)
+        return ERR_NOT_FOUND;
+
+    *pa_out = base;
+    return NO_ERROR;
+}
+
 status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* committed) {
     canary_.Assert();
     LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 "\n", offset, len);
@@ -353,6 +584,10 @@ status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* com
 
     AutoLock a(&lock_);
 
+    // the pages have to come from the page source, not be zero filled
+    if (is_pager_backed())
+        return ERR_NOT_SUPPORTED;
+
     // trim the size
     uint64_t new_len;
     if (!TrimRange(offset, len, size_, &new_len))
@@ -366,51 +601,106 @@ status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* com
     uint64_t end = ROUNDUP_PAGE_SIZE(offset + new_len);
     DEBUG_ASSERT(end > offset);
 
-    // make a pass through the list, counting the number of pages we need to allocate
-    size_t count = 0;
-    for (uint64_t o = offset; o < end; o += PAGE_SIZE) {
-        if (!page_list_.GetPage(o))
-            count++;
-    }
+    // folding parents in can add pages, so do it before counting. compressed
+    // pages count as committed, so bring them back first too.
+    CollapseParentsLocked();
+    uint64_t start = ROUNDDOWN(offset, PAGE_SIZE);
+    status_t status = DecompressRangeLocked(start, end);
+    if (status != NO_ERROR)
+        return status;
+
+    // count the number of pages we need to allocate
+    size_t count = (end - start) / PAGE_SIZE - page_list_.CountPagesInRange(start, end);
     if (count == 0)
         return NO_ERROR;
 
-    // allocate count number of pages
+    // back every empty, aligned large page sized chunk of the range with a physically
+    // contiguous run so that mappings of it can use large pages. stop at the first run
+    // the pmm can't find, memory is too fragmented to bother with the rest.
+    constexpr size_t kLargePageCount = LARGE_PAGE_SIZE / PAGE_SIZE;
+    auto chunk_is_empty = [this](uint64_t chunk) TA_NO_THREAD_SAFETY_ANALYSIS {
+        return page_list_.CountPagesInRange(chunk, chunk + LARGE_PAGE_SIZE) == 0;
+    };
+
+    list_node large_page_list;
+    list_initialize(&large_page_list);
+    size_t large_chunks = 0;
+    for (uint64_t chunk = ROUNDUP(offset, LARGE_PAGE_SIZE);
+         chunk < end && end - chunk >= LARGE_PAGE_SIZE; chunk += LARGE_PAGE_SIZE) {
+        if (!chunk_is_empty(chunk))
+            continue;
+        paddr_t pa;
+        if (pmm_alloc_contiguous(kLargePageCount, pmm_alloc_flags_, LARGE_PAGE_SIZE_SHIFT,
+                                 &pa, &large_page_list) != kLargePageCount)
+            break;
+        large_chunks++;
+    }
+
+    // allocate the rest of the pages we need
     list_node page_list;
     list_initialize(&page_list);
 
-    size_t allocated = pmm_alloc_pages(count, pmm_alloc_flags_, &page_list);
-    if (allocated < count) {
-        LTRACEF("failed to allocate enough pages (asked for %zu, got %zu)\n", count, allocated);
+    size_t small_count = count - large_chunks * kLargePageCount;
+    size_t allocated = pmm_alloc_pages(small_count, pmm_alloc_flags_ | PMM_ALLOC_FLAG_ZEROED,
+                                       &page_list);
+    if (allocated < small_count) {
+        LTRACEF("failed to allocate enough pages (asked for %zu, got %zu)\n", small_count, allocated);
         pmm_free(&page_list);
+        pmm_free(&large_page_list);
         return ERR_NO_MEMORY;
     }
 
     // unmap all of the pages in this range on all the mapping regions
     RangeChangeUpdateLocked(offset, end - offset);
 
-    // add them to the appropriate range of the object
-    for (uint64_t o = offset; o < end; o += PAGE_SIZE) {
-        vm_page_t* p = page_list_.GetPage(o);
-        if (p)
-            continue;
+    // fill the gaps in the range. the contiguous runs go to the same chunks that were
+    // picked for them above, which are the first large_chunks aligned ones that fit
+    // entirely inside a gap since gaps are visited in ascending order
+    auto fill_gap = [&](uint64_t gap_start, uint64_t gap_end) TA_NO_THREAD_SAFETY_ANALYSIS {
+        uint64_t large_end = 0;
+        for (uint64_t o = gap_start; o < gap_end; o += PAGE_SIZE) {
+            if (large_chunks > 0 && o >= large_end && IS_ALIGNED(o, LARGE_PAGE_SIZE) &&
+                gap_end - o >= LARGE_PAGE_SIZE) {
+                large_end = o + LARGE_PAGE_SIZE;
+                large_chunks--;
+            }
 
-        p = list_remove_head_type(&page_list, vm_page_t, free.node);
-        ASSERT(p);
+            // the single pages come zeroed from the pmm, the contiguous runs don't.
+            // a clone takes its parent's contents instead, as a write fault would.
+            vm_page_t* p;
+            if (o < large_end) {
+                p = list_remove_head_type(&large_page_list, vm_page_t, free.node);
+                ASSERT(p);
+            } else {
+                p = list_remove_head_type(&page_list, vm_page_t, free.node);
+                ASSERT(p);
+            }
+            if (!CopyParentPageLocked(p, o) && o < large_end)
+                ZeroPage(p);
 
-        p->state = VM_PAGE_STATE_OBJECT;
+            vm_page_set_state(p, VM_PAGE_STATE_OBJECT);
 
-        // TODO: remove once pmm returns zeroed pages
-        ZeroPage(p);
-
-        status_t status = page_list_.AddPage(p, o);
-        DEBUG_ASSERT(status == NO_ERROR);
+            status_t status = page_list_.AddPage(p, o);
+            if (status != NO_ERROR) {
+                list_add_head(&page_list, &p->free.node);
+                return status;
+            }
 
-        if (committed)
-            *committed += PAGE_SIZE;
+            if (committed)
+                *committed += PAGE_SIZE;
+        }
+        return NO_ERROR;
+    };
+    status = page_list_.ForEveryPageAndGapInRange(
+        [](vm_page_t*, uint64_t) { return NO_ERROR; }, fill_gap, start, end);
+    if (status != NO_ERROR) {
+        pmm_free(&page_list);
+        pmm_free(&large_page_list);
+        return status;
     }
 
     DEBUG_ASSERT(list_is_empty(&page_list));
+    DEBUG_ASSERT(list_is_empty(&large_page_list));
 
     // for now we only support committing as much as we were asked for
     DEBUG_ASSERT(!committed || *committed == count * PAGE_SIZE);
@@ -428,6 +718,10 @@ status_t VmObjectPaged::CommitRangeContiguous(uint64_t offset, uint64_t len, uin
 
     AutoLock a(&lock_);
 
+    // the pages have to come from the page source, not be zero filled
+    if (is_pager_backed())
+        return ERR_NOT_SUPPORTED;
+
     // trim the size
     uint64_t new_len;
     if (!TrimRange(offset, len, size_, &new_len))
@@ -442,11 +736,8 @@ status_t VmObjectPaged::CommitRangeContiguous(uint64_t offset, uint64_t len, uin
     DEBUG_ASSERT(end > offset);
 
     // make a pass through the list, making sure we have an empty run on the object
-    size_t count = 0;
-    for (uint64_t o = offset; o < end; o += PAGE_SIZE) {
-        if (!page_list_.GetPage(o))
-            count++;
-    }
+    uint64_t start = ROUNDDOWN(offset, PAGE_SIZE);
+    size_t count = (end - start) / PAGE_SIZE - page_list_.CountPagesInRange(start, end);
 
     DEBUG_ASSERT(count == new_len / PAGE_SIZE);
 
@@ -471,13 +762,17 @@ status_t VmObjectPaged::CommitRangeContiguous(uint64_t offset, uint64_t len, uin
         vm_page_t* p = list_remove_head_type(&page_list, vm_page_t, free.node);
         ASSERT(p);
 
-        p->state = VM_PAGE_STATE_OBJECT;
+        vm_page_set_state(p, VM_PAGE_STATE_OBJECT);
 
         // TODO: remove once pmm returns zeroed pages
         ZeroPage(p);
 
         auto status = page_list_.AddPage(p, o);
-        DEBUG_ASSERT(status == NO_ERROR);
+        if (status != NO_ERROR) {
+            list_add_head(&page_list, &p->free.node);
+            pmm_free(&page_list);
+            return status;
+        }
 
         if (committed)
             *committed += PAGE_SIZE;
@@ -517,21 +812,605 @@ status_t VmObjectPaged::DecommitRange(uint64_t offset, uint64_t len, uint64_t* d
     LTRACEF("start offset %#" PRIx64 ", end %#" PRIx64 ", page_aliged_len %#" PRIx64 "\n", start, end,
             page_aligned_len);
 
+    // a device may still be using pinned pages
+    if (IsPinnedLocked(start, end))
+        return ERR_BAD_STATE;
+
     // unmap all of the pages in this range on all the mapping regions
     RangeChangeUpdateLocked(start, page_aligned_len);
 
-    // iterate through the pages, freeing them
-    while (start < end) {
-        auto status = page_list_.FreePage(start);
-        if (status == NO_ERROR && decommitted) {
-            *decommitted += PAGE_SIZE;
+    // pull the pages out of the range and free them all at once
+    list_node list;
+    list_initialize(&list);
+    size_t count = page_list_.RemovePages(start, end, &list);
+    pmm_free(&list);
+    FreeCompressedLocked(start, end);
+    if (decommitted)
+        *decommitted = count * PAGE_SIZE;
+
+    return NO_ERROR;
+}
+
+status_t VmObjectPaged::MovePages(uint64_t offset, uint64_t len, VmObject* _dest,
+                                 uint64_t dest_offset, uint64_t* moved) {
+    canary_.Assert();
+    LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 ", dest %p, dest_offset %#" PRIx64 "\n",
+            offset, len, _dest, dest_offset);
+
+    *moved = 0;
+
+    if (!IS_PAGE_ALIGNED(offset) || !IS_PAGE_ALIGNED(len) || !IS_PAGE_ALIGNED(dest_offset))
+        return ERR_INVALID_ARGS;
+    if (!_dest->is_paged() || _dest == this)
+        return ERR_NOT_SUPPORTED;
+
+    auto dest = static_cast<VmObjectPaged*>(_dest);
+
+    AutoLock a(&lock_);
+
+    // clones share their parent's lock
+    bool lock_dest = (&dest->lock_ != &lock_);
+    if (lock_dest)
+        dest->lock_.Acquire();
+
+    status_t status = NO_ERROR;
+    uint64_t end = offset + len;
+
+    if (!InRange(offset, len, size_) || !InRange(dest_offset, len, dest->size_)) {
+        status = ERR_OUT_OF_RANGE;
+        goto done;
+    }
+
+    // clones may be looking through to our pages, and pages that are inherited from our
+    // parent or not committed at all aren't ours to give away
+    if (!children_list_.is_empty()) {
+        status = ERR_NOT_SUPPORTED;
+        goto done;
+    }
+    status = DecompressRangeLocked(offset, end);
+    if (status != NO_ERROR)
+        goto done;
+    if (page_list_.CountPagesInRange(offset, end) != len / PAGE_SIZE) {
+        status = ERR_NOT_SUPPORTED;
+        goto done;
+    }
+    // neither the pages leaving nor the ones dest would free may be pinned
+    if (IsPinnedLocked(offset, end) || dest->IsPinnedLocked(dest_offset, dest_offset + len)) {
+        status = ERR_BAD_STATE;
+        goto done;
+    }
+
+    // unmap both ranges everywhere before the pages change hands
+    RangeChangeUpdateLocked(offset, len);
+    dest->RangeChangeUpdateLocked(dest_offset, len);
+    dest->FreeCompressedLocked(dest_offset, dest_offset + len);
+
+    for (uint64_t o = 0; o < len; o += PAGE_SIZE) {
+        vm_page_t* p = page_list_.GetPage(offset + o);
+
+        dest->page_list_.FreePage(dest_offset + o);
+        if (dest->page_list_.AddPage(p, dest_offset + o) != NO_ERROR)
+            break;
+
+        __UNUSED auto removed = page_list_.RemovePage(offset + o);
+        DEBUG_ASSERT(removed == p);
+
+        *moved += PAGE_SIZE;
+    }
+
+done:
+    if (lock_dest)
+        dest->lock_.Release();
+
+    return status;
+}
+
+status_t VmObjectPaged::CopyRange(uint64_t offset, uint64_t len, VmObject* _dest,
+                                 uint64_t dest_offset, uint64_t* copied) {
+    canary_.Assert();
+    LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 ", dest %p, dest_offset %#" PRIx64 "\n",
+            offset, len, _dest, dest_offset);
+
+    *copied = 0;
+
+    if (!_dest->is_paged())
+        return ERR_NOT_SUPPORTED;
+    if (_dest == this && offset < dest_offset + len && dest_offset < offset + len)
+        return ERR_INVALID_ARGS;
+
+    auto dest = static_cast<VmObjectPaged*>(_dest);
+
+    // unlike MovePages either object may be in use elsewhere, so take the two
+    // locks in address order. clones share their parent's lock.
+    Mutex* first = &lock_;
+    Mutex* second = &dest->lock_;
+    if (first == second) {
+        second = nullptr;
+    } else if (second < first) {
+        second = first;
+        first = &dest->lock_;
+    }
+    first->Acquire();
+    if (second)
+        second->Acquire();
+
+    status_t status = NO_ERROR;
+
+    if (!InRange(offset, len, size_) || !InRange(dest_offset, len, dest->size_)) {
+        status = ERR_OUT_OF_RANGE;
+        goto done;
+    }
+
+    CollapseParentsLocked();
+    dest->CollapseParentsLocked();
+
+    while (*copied < len) {
+        uint64_t src_off = offset + *copied;
+        uint64_t dst_off = dest_offset + *copied;
+        uint64_t src_page_off = src_off & (PAGE_SIZE - 1);
+        uint64_t dst_page_off = dst_off & (PAGE_SIZE - 1);
+        size_t tocopy = static_cast<size_t>(MIN(len - *copied,
+                                                PAGE_SIZE - MAX(src_page_off, dst_page_off)));
+
+        // a read fault hands back the zero page for holes
+        paddr_t src_pa;
+        status = GetPageInternalLocked(src_off - src_page_off, VMM_PF_FLAG_SW_FAULT, nullptr,
+                                       &src_pa);
+        if (status < 0)
+            break;
+        const uint8_t* src = reinterpret_cast<const uint8_t*>(paddr_to_kvaddr(src_pa));
+
+        paddr_t dst_pa;
+        if (tocopy == PAGE_SIZE && !dest->page_list_.GetPage(dst_off)) {
+            // the whole page is about to be overwritten, so skip zeroing it or
+            // copying it up from a parent
+            vm_page_t* p = pmm_alloc_page(dest->pmm_alloc_flags_, &dst_pa);
+            if (!p) {
+                status = ERR_NO_MEMORY;
+                break;
+            }
+            vm_page_set_state(p, VM_PAGE_STATE_OBJECT);
+            memcpy(paddr_to_kvaddr(dst_pa), src, PAGE_SIZE);
+            status = dest->AddPageLocked(p, dst_off);
+            if (status < 0) {
+                pmm_free_page(p);
+                break;
+            }
+        } else {
+            status = dest->GetPageInternalLocked(dst_off - dst_page_off,
+                                                 VMM_PF_FLAG_SW_FAULT | VMM_PF_FLAG_WRITE,
+                                                 nullptr, &dst_pa);
+            if (status < 0)
+                break;
+            uint8_t* dst = reinterpret_cast<uint8_t*>(paddr_to_kvaddr(dst_pa));
+            memcpy(dst + dst_page_off, src + src_page_off, tocopy);
         }
-        start += PAGE_SIZE;
+
+        *copied += tocopy;
+    }
+    dest->accessed_ = true;
+
+done:
+    if (second)
+        second->Release();
+    first->Release();
+
+    return status;
+}
+
+status_t VmObjectPaged::SupplyPages(uint64_t offset, uint64_t len, VmObject* _src,
+                                   uint64_t src_offset) {
+    canary_.Assert();
+    LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 ", src %p, src_offset %#" PRIx64 "\n",
+            offset, len, _src, src_offset);
+
+    if (!page_source_)
+        return ERR_NOT_SUPPORTED;
+    if (!IS_PAGE_ALIGNED(offset) || !IS_PAGE_ALIGNED(len) || !IS_PAGE_ALIGNED(src_offset))
+        return ERR_INVALID_ARGS;
+    if (!_src->is_paged() || _src == this)
+        return ERR_NOT_SUPPORTED;
+
+    auto src = static_cast<VmObjectPaged*>(_src);
+
+    // the pager and the objects it supplies from run independently, so take the
+    // two locks in address order like CopyRange
+    Mutex* first = &lock_;
+    Mutex* second = &src->lock_;
+    if (first == second) {
+        second = nullptr;
+    } else if (second < first) {
+        second = first;
+        first = &src->lock_;
     }
+    first->Acquire();
+    if (second)
+        second->Acquire();
+
+    status_t status = NO_ERROR;
+    const uint64_t src_end = src_offset + len;
+    list_node unused = LIST_INITIAL_VALUE(unused);
 
+    if (!InRange(offset, len, size_) || !InRange(src_offset, len, src->size_)) {
+        status = ERR_OUT_OF_RANGE;
+        goto done;
+    }
+
+    // same rules as MovePages: the pages must be the source's own, and no clone
+    // may be looking at them
+    if (!src->children_list_.is_empty()) {
+        status = ERR_NOT_SUPPORTED;
+        goto done;
+    }
+    status = src->DecompressRangeLocked(src_offset, src_end);
+    if (status != NO_ERROR)
+        goto done;
+    if (src->page_list_.CountPagesInRange(src_offset, src_end) != len / PAGE_SIZE) {
+        status = ERR_NOT_SUPPORTED;
+        goto done;
+    }
+
+    src->RangeChangeUpdateLocked(src_offset, len);
+
+    for (uint64_t o = 0; o < len; o += PAGE_SIZE) {
+        vm_page_t* p = src->page_list_.RemovePage(src_offset + o);
+        DEBUG_ASSERT(p);
+
+        // pages written to since they were asked for win over the supplied ones
+        if (page_list_.GetPage(offset + o) || AddPageLocked(p, offset + o) != NO_ERROR) {
+            list_add_tail(&unused, &p->free.node);
+        }
+    }
+
+done:
+    if (second)
+        second->Release();
+    first->Release();
+
+    if (!list_is_empty(&unused))
+        pmm_free(&unused);
+    if (status == NO_ERROR)
+        vm_page_supply_notify();
+
+    return status;
+}
+
+bool VmObjectPaged::is_pager_backed() const {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    return page_source_ || (parent_ && parent_->is_pager_backed());
+}
+
+status_t VmObjectPaged::LockDiscardable(bool* was_discarded) {
+    canary_.Assert();
+
+    if (!discardable_)
+        return ERR_NOT_SUPPORTED;
+
+    AutoLock al(&reclaim_lock_);
+    AutoLock a(&lock_);
+
+    if (discardable_lock_count_++ == 0 && reclaim_node_.InContainer())
+        reclaim_list_.erase(*this);
+
+    if (was_discarded)
+        *was_discarded = discarded_;
+    discarded_ = false;
+
+    return NO_ERROR;
+}
+
+status_t VmObjectPaged::UnlockDiscardable() {
+    canary_.Assert();
+
+    if (!discardable_)
+        return ERR_NOT_SUPPORTED;
+
+    AutoLock al(&reclaim_lock_);
+    AutoLock a(&lock_);
+
+    if (discardable_lock_count_ == 0)
+        return ERR_BAD_STATE;
+
+    // the most recently unlocked objects are the last to go
+    if (--discardable_lock_count_ == 0) {
+        DEBUG_ASSERT(!reclaim_node_.InContainer());
+        accessed_ = false;
+        reclaim_list_.push_back(this);
+    }
+
+    return NO_ERROR;
+}
+
+status_t VmObjectPaged::Pin(uint64_t offset, uint64_t len,
+                           vmo_lookup_fn_t lookup_fn, void* context) {
+    canary_.Assert();
+    LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 "\n", offset, len);
+
+    if (unlikely(len == 0))
+        return ERR_INVALID_ARGS;
+
+    // discarding ignores pins, and locking already keeps the pages
+    if (discardable_)
+        return ERR_NOT_SUPPORTED;
+
+    uint64_t start = ROUNDDOWN(offset, PAGE_SIZE);
+
+    return RetryAfterSupply([&]() -> status_t {
+        AutoLock a(&lock_);
+
+        if (unlikely(!InRange(offset, len, size_)))
+            return ERR_OUT_OF_RANGE;
+
+        uint64_t end = ROUNDUP(offset + len, PAGE_SIZE);
+
+        // make room first so nothing has to be undone once the pages are found
+        AllocChecker ac;
+        pinned_ranges_.reserve(pinned_ranges_.size() + 1, &ac);
+        if (!ac.check())
+            return ERR_NO_MEMORY;
+
+        // write faults give us pages of our own rather than ones shown through from
+        // a parent, which copy-on-write could replace
+        size_t index = 0;
+        for (uint64_t off = start; off != end; off += PAGE_SIZE, index++) {
+            paddr_t pa;
+            auto status = GetPageLocked(off, VMM_PF_FLAG_WRITE | VMM_PF_FLAG_SW_FAULT,
+                                        nullptr, &pa);
+            if (status == ERR_SHOULD_WAIT)
+                return status;
+            if (status < 0)
+                return ERR_NO_MEMORY;
+
+            if (lookup_fn) {
+                status = lookup_fn(context, off, index, pa);
+                if (unlikely(status < 0))
+                    return status;
+            }
+        }
+
+        pinned_ranges_.push_back(PinnedRange{start, end}, &ac);
+        DEBUG_ASSERT(ac.check());
+        kmem_stat_add(KMEM_STAT_PINNED_BYTES, end - start);
+
+        return NO_ERROR;
+    });
+}
+
+status_t VmObjectPaged::Unpin(uint64_t offset, uint64_t len) {
+    canary_.Assert();
+    LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 "\n", offset, len);
+
+    uint64_t start = ROUNDDOWN(offset, PAGE_SIZE);
+    uint64_t end = ROUNDUP(offset + len, PAGE_SIZE);
+
+    AutoLock a(&lock_);
+
+    for (size_t i = 0; i < pinned_ranges_.size(); i++) {
+        if (pinned_ranges_[i].start == start && pinned_ranges_[i].end == end) {
+            pinned_ranges_.erase(i);
+            kmem_stat_add(KMEM_STAT_PINNED_BYTES, -static_cast<int64_t>(end - start));
+            return NO_ERROR;
+        }
+    }
+
+    return ERR_NOT_FOUND;
+}
+
+status_t VmObjectPaged::SetMappingCachePolicy(uint32_t cache_policy) {
+    canary_.Assert();
+
+    if (cache_policy & ~ARCH_MMU_FLAG_CACHE_MASK)
+        return ERR_INVALID_ARGS;
+
+    // pages that come and go behind the object's back would reach their new
+    // owners with stale lines for the old policy
+    if (discardable_ || page_source_)
+        return ERR_NOT_SUPPORTED;
+
+    AutoLock a(&lock_);
+
+    // every mapping of a page has to agree, and clones and parents share pages
+    if (!mapping_list_.is_empty() || !children_list_.is_empty() || parent_)
+        return ERR_BAD_STATE;
+
+    // write back and drop whatever the cached physmap alias left behind, so
+    // uncached mappings don't see stale data or get it written over them later.
+    // compressed pages would come back through the cached alias, so bring them
+    // back now; they aren't compressed again unless the policy goes back.
+    if (cache_policy != ARCH_MMU_FLAG_CACHED && cache_policy_ == ARCH_MMU_FLAG_CACHED) {
+        status_t status = DecompressRangeLocked(0, ROUNDUP_PAGE_SIZE(size_));
+        if (status != NO_ERROR)
+            return status;
+        page_list_.ForEveryPage([](vm_page_t* p, uint64_t) {
+            auto va = reinterpret_cast<addr_t>(paddr_to_kvaddr(vm_page_to_paddr(p)));
+            arch_clean_invalidate_cache_range(va, PAGE_SIZE);
+        });
+    }
+
+    cache_policy_ = cache_policy;
+    return NO_ERROR;
+}
+
+status_t VmObjectPaged::SetMemoryAccount(mxtl::RefPtr<MemoryAccount> account) {
+    canary_.Assert();
+
+    AutoLock a(&lock_);
+
+    // compressed pages come back through |page_list_| and are charged then
+    if (page_list_.CountPages() != 0)
+        return ERR_BAD_STATE;
+
+    account_ = mxtl::move(account);
+    page_list_.set_account(account_.get());
+    return NO_ERROR;
+}
+
+bool VmObjectPaged::IsPinnedLocked(uint64_t start, uint64_t end) const {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    for (const auto& range : pinned_ranges_) {
+        if (range.start < end && start < range.end)
+            return true;
+    }
+    return false;
+}
+
+size_t VmObjectPaged::DiscardLocked() {
+    canary_.Assert();
+    DEBUG_ASSERT(lock_.IsHeld());
+    DEBUG_ASSERT(discardable_ && discardable_lock_count_ == 0);
+
+    size_t count = page_list_.CountPagesInRange(0, size_);
+    if (count == 0)
+        return 0;
+
+    LTRACEF("vmo %p discarding %zu pages\n", this, count);
+
+    // unmap all of the pages on all the mapping regions, later faults see zeros
+    RangeChangeUpdateLocked(0, ROUNDUP_PAGE_SIZE(size_));
+
+    count = page_list_.FreeAllPages();
+    discarded_ = true;
+
+    return count;
+}
+
+size_t VmObjectPaged::ReclaimDiscardable(size_t target) {
+    AutoLock al(&reclaim_lock_);
+
+    // pass over each object at most once, so objects in constant use can't keep
+    // us going around the list forever
+    size_t budget = reclaim_list_.size_slow();
+    size_t reclaimed = 0;
+    while (reclaimed < target && budget-- > 0 && !reclaim_list_.is_empty()) {
+        VmObjectPaged* vmo = reclaim_list_.pop_front();
+
+        // an object being destroyed is waiting on reclaim_lock_ to take itself off
+        // the list, so it is still safe to look at
+        AutoLock a(&vmo->lock_);
+        if (vmo->accessed_) {
+            vmo->accessed_ = false;
+            reclaim_list_.push_back(vmo);
+            continue;
+        }
+
+        // discarded objects stay off the list until they are next unlocked
+        reclaimed += vmo->DiscardLocked();
+    }
+
+    LTRACEF("reclaimed %zu of %zu pages\n", reclaimed, target);
+
+    return reclaimed;
+}
+
+size_t VmObjectPaged::CompressLocked(size_t target) {
+    canary_.Assert();
+    DEBUG_ASSERT(lock_.IsHeld());
+    DEBUG_ASSERT(compressible_);
+
+    // clones look through to our pages, and pages mapped other than cached
+    // would be read and written back through the wrong alias
+    if (!children_list_.is_empty() || cache_policy_ != ARCH_MMU_FLAG_CACHED)
+        return 0;
+
+    // nothing has faulted since the object was armed, so nothing can be using
+    // the pages through a mapping. pinned pages are in use by a device.
+    size_t count = 0;
+    page_list_.ForEveryPage([&](vm_page_t* p, uint64_t offset) TA_NO_THREAD_SAFETY_ANALYSIS {
+        if (count >= target || IsPinnedLocked(offset, offset + PAGE_SIZE) ||
+            CompressedPage::PoolFull())
+            return;
+        auto compressed = CompressedPage::Create(offset, vm_page_to_paddr(p));
+        if (!compressed)
+            return;
+        compressed_.insert(mxtl::move(compressed));
+        count++;
+    });
+    if (count == 0)
+        return 0;
+
+    LTRACEF("vmo %p compressed %zu pages\n", this, count);
+
+    // the offsets that just went into the tree are the only ones still in the
+    // page list too
+    list_node list = LIST_INITIAL_VALUE(list);
+    for (const auto& compressed : compressed_) {
+        vm_page_t* p = page_list_.RemovePage(compressed.offset());
+        if (p)
+            list_add_tail(&list, &p->free.node);
+    }
+    DEBUG_ASSERT(list_length(&list) == count);
+    pmm_free(&list);
+
+    return count;
+}
+
+status_t VmObjectPaged::DecompressRangeLocked(uint64_t start, uint64_t end) {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    while (!compressed_.is_empty()) {
+        auto compressed = compressed_.lower_bound(start);
+        if (!compressed.IsValid() || compressed->offset() >= end)
+            break;
+
+        // looking the page up brings it back
+        uint64_t offset = compressed->offset();
+        status_t status = GetPageInternalLocked(offset, 0, nullptr, nullptr);
+        if (status != NO_ERROR)
+            return status;
+        start = offset + PAGE_SIZE;
+    }
     return NO_ERROR;
 }
 
+void VmObjectPaged::FreeCompressedLocked(uint64_t start, uint64_t end) {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    auto compressed = compressed_.lower_bound(start);
+    while (compressed.IsValid() && compressed->offset() < end)
+        compressed_.erase(compressed++);
+}
+
+size_t VmObjectPaged::CompressCold(size_t target) {
+    AutoLock al(&reclaim_lock_);
+
+    // like ReclaimDiscardable() pass over each object at most once. an object
+    // found untouched is unmapped, and compressed if it is still untouched the
+    // next time around, so pages used only through existing mappings aren't
+    // mistaken for cold ones.
+    size_t budget = compress_list_.size_slow();
+    size_t freed = 0;
+    while (freed < target && budget-- > 0 && !CompressedPage::PoolFull()) {
+        // objects stay on the list for as long as they live
+        VmObjectPaged* vmo = compress_list_.pop_front();
+        compress_list_.push_back(vmo);
+
+        // an object being destroyed is waiting on reclaim_lock_ to take itself off
+        // the list, so it is still safe to look at
+        AutoLock a(&vmo->lock_);
+        if (vmo->page_list_.CountPages() == 0)
+            continue;
+        if (vmo->accessed_) {
+            vmo->accessed_ = false;
+            vmo->compress_armed_ = false;
+            continue;
+        }
+        if (!vmo->compress_armed_) {
+            vmo->RangeChangeUpdateLocked(0, ROUNDUP_PAGE_SIZE(vmo->size_));
+            vmo->compress_armed_ = true;
+            continue;
+        }
+
+        vmo->compress_armed_ = false;
+        freed += vmo->CompressLocked(target - freed);
+    }
+
+    LTRACEF("compressed %zu of %zu pages\n", freed, target);
+
+    return freed;
+}
+
 status_t VmObjectPaged::ResizeLocked(uint64_t s) {
     canary_.Assert();
     DEBUG_ASSERT(lock_.IsHeld());
@@ -552,14 +1431,18 @@ status_t VmObjectPaged::ResizeLocked(uint64_t s) {
 
         // we're only worried about whole pages to be removed
         if (page_aligned_len > 0) {
+            if (IsPinnedLocked(start, end))
+                return ERR_BAD_STATE;
+
             // unmap all of the pages in this range on all the mapping regions
             RangeChangeUpdateLocked(start, page_aligned_len);
 
-            // iterate through the pages, freeing them
-            while (start < end) {
-                page_list_.FreePage(start);
-                start += PAGE_SIZE;
-            }
+            // pull the pages out of the range and free them all at once
+            list_node list;
+            list_initialize(&list);
+            page_list_.RemovePages(start, end, &list);
+            pmm_free(&list);
+            FreeCompressedLocked(start, end);
         }
     } else if (s > size_) {
         // expanding
@@ -607,6 +1490,97 @@ status_t VmObjectPaged::SetParentOffsetLocked(uint64_t offset) {
     return NO_ERROR;
 }
 
+bool VmObjectPaged::CopyParentPageLocked(vm_page_t* p, uint64_t offset) {
+    canary_.Assert();
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    if (!parent_ || offset >= parent_limit_)
+        return false;
+
+    safeint::CheckedNumeric<uint64_t> parent_offset = parent_offset_;
+    parent_offset += offset;
+    DEBUG_ASSERT(parent_offset.IsValid());
+
+    // only look at pages the parent chain already has, don't fault any in
+    paddr_t pa;
+    if (parent_->GetPageLocked(parent_offset.ValueOrDie(), 0, nullptr, &pa) != NO_ERROR)
+        return false;
+
+    const void* src = paddr_to_kvaddr(pa);
+    void* dst = paddr_to_kvaddr(vm_page_to_paddr(p));
+    DEBUG_ASSERT(src && dst);
+    memcpy(dst, src, PAGE_SIZE);
+    return true;
+}
+
+void VmObjectPaged::CollapseParentsLocked() {
+    canary_.Assert();
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    while (parent_ && parent_->is_paged()) {
+        auto parent = static_cast<VmObjectPaged*>(parent_.get());
+
+        // the root of the tree owns the lock we all share, it has to stay. a
+        // parent can only be folded into us if we are its only child, and ours
+        // is the only reference to it left, in which case nobody else can get
+        // hold of it to look at its pages or change them. new references can
+        // only be made from existing ones, so the count can't go back up under us.
+        if (!parent->parent_ || &parent->children_list_.front() != this ||
+            &parent->children_list_.back() != this || parent->ref_count_debug() != 1)
+            return;
+
+        safeint::CheckedNumeric<uint64_t> new_offset = parent_offset_;
+        new_offset += parent->parent_offset_;
+        if (!new_offset.IsValid())
+            return;
+
+        LTRACEF("vmo %p folding parent %p into itself\n", this, parent);
+
+        // offsets past the end of the parent, or past what it could see of its
+        // own parent, read as zeros. keep it that way once the parent is gone.
+        auto limit_below = [this](uint64_t parent_bound) -> uint64_t {
+            return parent_bound > parent_offset_ ? parent_bound - parent_offset_ : 0;
+        };
+        uint64_t new_limit = mxtl::min(parent_limit_, limit_below(parent->size_));
+        new_limit = mxtl::min(new_limit, limit_below(parent->parent_limit_));
+
+        // take over the parent's pages that we can see and don't already have
+        // a copy of. the rest go away with the parent.
+        uint64_t cursor = parent_offset_;
+        const uint64_t end = parent_offset_ + mxtl::min(size_, new_limit);
+        list_node shadowed = LIST_INITIAL_VALUE(shadowed);
+        for (;;) {
+            vm_page_t* p = nullptr;
+            uint64_t parent_page_offset = 0;
+            parent->page_list_.ForEveryPageInRange(
+                [&p, &parent_page_offset](vm_page_t*& page, uint64_t off) -> status_t {
+                    p = page;
+                    parent_page_offset = off;
+                    return ERR_STOP;
+                }, cursor, end);
+            if (!p)
+                break;
+
+            parent->page_list_.RemovePage(parent_page_offset);
+            if (page_list_.AddPageOverLimit(p, parent_page_offset - parent_offset_) != NO_ERROR)
+                list_add_tail(&shadowed, &p->free.node);
+            cursor = parent_page_offset + PAGE_SIZE;
+        }
+        pmm_free(&shadowed);
+
+        // hang ourselves off the grandparent instead
+        parent->RemoveChildLocked(this);
+        parent->parent_->AddChildLocked(this);
+        mxtl::RefPtr<VmObject> old_parent = mxtl::move(parent_);
+        parent_ = parent->parent_;
+        parent_offset_ = new_offset.ValueOrDie();
+        parent_limit_ = new_limit;
+
+        // the old parent is destroyed with the lock of the tree held
+        old_parent.reset();
+    }
+}
+
 // perform some sort of copy in/out on a range of the object using a passed in lambda
 // for the copy routine
 template <typename T>
@@ -616,6 +1590,34 @@ status_t VmObjectPaged::ReadWriteInternal(uint64_t offset, size_t len, size_t* b
     if (bytes_copied)
         *bytes_copied = 0;
 
+    // the lock is dropped between chunks so long copies don't shut everyone
+    // else out, which means the object may shrink under us between them
+    size_t done = 0;
+    status_t status;
+    do {
+        size_t chunk_len = MIN(len - done, kReadWriteChunkSize);
+        size_t copied;
+        status = RetryAfterSupply([&]() {
+            copied = 0;
+            return ReadWriteChunk(offset + done, chunk_len, done, &copied, write, copyfunc);
+        });
+        done += copied;
+        if (status == ERR_OUT_OF_RANGE && done > 0)
+            status = NO_ERROR;
+        if (status < 0 || copied < chunk_len)
+            break;
+    } while (done < len);
+
+    if (bytes_copied)
+        *bytes_copied = done;
+    return status;
+}
+
+// copy one chunk of a ReadWriteInternal() under the lock. |pos| is where the
+// chunk starts in the whole copy, for the offsets passed to |copyfunc|.
+template <typename T>
+status_t VmObjectPaged::ReadWriteChunk(uint64_t offset, size_t len, size_t pos,
+                                       size_t* bytes_copied, bool write, T copyfunc) {
     AutoLock a(&lock_);
 
     // trim the size
@@ -627,35 +1629,82 @@ status_t VmObjectPaged::ReadWriteInternal(uint64_t offset, size_t len, size_t* b
     if (new_len == 0)
         return 0;
 
-    // walk the list of pages and do the write
-    uint64_t src_offset = offset;
-    size_t dest_offset = 0;
-    while (new_len > 0) {
-        size_t page_offset = src_offset % PAGE_SIZE;
-        size_t tocopy = MIN(PAGE_SIZE - page_offset, new_len);
+    accessed_ = true;
 
-        // fault in the page
-        paddr_t pa;
-        auto status = GetPageLocked(src_offset, VMM_PF_FLAG_SW_FAULT | (write ? VMM_PF_FLAG_WRITE : 0), nullptr, &pa);
-        if (status < 0)
-            return status;
+    // pages that are next to each other in physical memory are next to each
+    // other in the physmap too, so runs of them are copied in one call
+    const uint64_t end = offset + new_len;
+    paddr_t run_pa = 0;
+    uint64_t run_start = offset;
+    uint64_t run_end = offset;
+    auto copy_run = [&]() -> status_t {
+        if (run_start == run_end)
+            return NO_ERROR;
 
-        // compute the kernel mapping of this page
-        uint8_t* page_ptr = reinterpret_cast<uint8_t*>(paddr_to_kvaddr(pa));
+        size_t tocopy = static_cast<size_t>(run_end - run_start);
+        auto err = copyfunc(paddr_to_kvaddr(run_pa),
+                            pos + static_cast<size_t>(run_start - offset), tocopy);
+        if (err < 0)
+            return err;
+
+        *bytes_copied += tocopy;
+        run_start = run_end;
+        return NO_ERROR;
+    };
 
-        // call the copy routine
-        auto err = copyfunc(page_ptr + page_offset, dest_offset, tocopy);
+    // add the part of the page at page_offset that falls inside the range
+    auto copy_page = [&](paddr_t pa, uint64_t page_offset) -> status_t {
+        uint64_t copy_start = MAX(page_offset, offset);
+        uint64_t copy_end = MIN(page_offset + PAGE_SIZE, end);
+        paddr_t copy_pa = pa + (copy_start - page_offset);
+        if (run_start != run_end && copy_start == run_end &&
+            copy_pa == run_pa + (run_end - run_start)) {
+            run_end = copy_end;
+            return NO_ERROR;
+        }
+
+        // get the start of the next run coming while the last one is copied
+        __builtin_prefetch(paddr_to_kvaddr(copy_pa));
+        auto err = copy_run();
         if (err < 0)
             return err;
 
-        src_offset += tocopy;
-        if (bytes_copied)
-            *bytes_copied += tocopy;
-        dest_offset += tocopy;
-        new_len -= tocopy;
-    }
+        run_pa = copy_pa;
+        run_start = copy_start;
+        run_end = copy_end;
+        return NO_ERROR;
+    };
 
-    return NO_ERROR;
+    CollapseParentsLocked();
+
+    // walk the pages we hold in one pass, the gaps between them may have to come
+    // from the parent or be faulted in
+    auto per_page = [&copy_page](vm_page_t* p, uint64_t page_offset) {
+        return copy_page(vm_page_to_paddr(p), page_offset);
+    };
+    auto per_gap = [&](uint64_t gap_start, uint64_t gap_end) TA_NO_THREAD_SAFETY_ANALYSIS {
+        for (uint64_t o = gap_start; o < gap_end; o += PAGE_SIZE) {
+            // fault in the page. parents were already folded in above, doing it
+            // now would change page_list_ under the walk.
+            paddr_t pa;
+            auto status = GetPageInternalLocked(o, VMM_PF_FLAG_SW_FAULT |
+                                                       (write ? VMM_PF_FLAG_WRITE : 0),
+                                                nullptr, &pa);
+            if (status < 0)
+                return status;
+
+            status = copy_page(pa, o);
+            if (status < 0)
+                return status;
+        }
+        return static_cast<status_t>(NO_ERROR);
+    };
+
+    auto status = page_list_.ForEveryPageAndGapInRange(per_page, per_gap,
+                                                       ROUNDDOWN(offset, PAGE_SIZE), end);
+    if (status < 0)
+        return status;
+    return copy_run();
 }
 
 status_t VmObjectPaged::Read(void* _ptr, uint64_t offset, size_t len, size_t* bytes_read) {
@@ -861,7 +1910,7 @@ void VmObjectPaged::RangeChangeUpdateFromParentLocked(const uint64_t offset, con
     // with our offset into the parent and pass it on
     uint64_t offset_new;
     uint64_t len_new;
-    if (!GetIntersect(parent_offset_, size_, offset, len,
+    if (!GetIntersect(parent_offset_, mxtl::min(size_, parent_limit_), offset, len,
                       &offset_new, &len_new))
         return;
 
@@ -13,6 +13,7 @@
 #include <inttypes.h>
 #include <kernel/auto_lock.h>
 #include <kernel/vm.h>
+#include <kernel/vm/mem_stats.h>
 #include <lib/console.h>
 #include <lib/user_copy.h>
 #include <new.h>
@@ -26,11 +27,13 @@
 VmObjectPhysical::VmObjectPhysical(paddr_t base, uint64_t size)
     : size_(size), base_(base) {
     LTRACEF("%p\n", this);
+    kmem_stat_add(KMEM_STAT_PHYSICAL_VMO_BYTES, size_);
 }
 
 VmObjectPhysical::~VmObjectPhysical() {
     canary_.Assert();
     LTRACEF("%p\n", this);
+    kmem_stat_add(KMEM_STAT_PHYSICAL_VMO_BYTES, -static_cast<int64_t>(size_));
 }
 
 mxtl::RefPtr<VmObject> VmObjectPhysical::Create(paddr_t base, uint64_t size) {
@@ -80,6 +83,38 @@ status_t VmObjectPhysical::GetPageLocked(uint64_t offset, uint pf_flags, vm_page
     return NO_ERROR;
 }
 
+status_t VmObjectPhysical::GetLargePageLocked(uint64_t offset, paddr_t* pa) {
+    canary_.Assert();
+    DEBUG_ASSERT(IS_ALIGNED(offset, LARGE_PAGE_SIZE));
+
+    if (offset >= size_ || size_ - offset < LARGE_PAGE_SIZE)
+        return ERR_OUT_OF_RANGE;
+
+    uint64_t base = base_ + offset;
+    if (base + LARGE_PAGE_SIZE - 1 > UINTPTR_MAX)
+        return ERR_OUT_OF_RANGE;
+    if (!IS_ALIGNED(base, LARGE_PAGE_SIZE))
+        return ERR_NOT_FOUND;
+
+    *pa = (paddr_t)base;
+    return NO_ERROR;
+}
+
+status_t VmObjectPhysical::SetMappingCachePolicy(uint32_t cache_policy) {
+    canary_.Assert();
+
+    if (cache_policy & ~ARCH_MMU_FLAG_CACHE_MASK)
+        return ERR_INVALID_ARGS;
+
+    AutoLock a(&lock_);
+
+    if (!mapping_list_.is_empty())
+        return ERR_BAD_STATE;
+
+    cache_policy_ = cache_policy;
+    return NO_ERROR;
+}
+
 status_t VmObjectPhysical::LookupUser(uint64_t offset, uint64_t len, user_ptr<paddr_t> buffer,
                                       size_t buffer_size) {
     canary_.Assert();
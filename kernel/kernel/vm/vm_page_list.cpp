@@ -9,6 +9,7 @@
 #include <err.h>
 #include <inttypes.h>
 #include <kernel/vm.h>
+#include <kernel/vm/memory_account.h>
 #include <new.h>
 #include <trace.h>
 
@@ -16,127 +17,298 @@
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
-VmPageListNode::VmPageListNode(uint64_t offset)
-    : obj_offset_(offset) {
-    LTRACEF("%p offset %#" PRIx64 "\n", this, obj_offset_);
+// enough levels to index every page of a MAX_SIZE object
+static const uint kMaxHeight =
+    (64 - PAGE_SIZE_SHIFT + VmPageListNode::kFanOutShift - 1) / VmPageListNode::kFanOutShift;
+
+VmPageListNode::VmPageListNode() {
+    LTRACEF("%p\n", this);
 }
 
 VmPageListNode::~VmPageListNode() {
-    LTRACEF("%p offset %#" PRIx64 "\n", this, obj_offset_);
+    LTRACEF("%p\n", this);
     canary_.Assert();
 
-    for (__UNUSED auto p : pages_) {
-        DEBUG_ASSERT(p == nullptr);
-    }
+    DEBUG_ASSERT(count_ == 0);
+    DEBUG_ASSERT(pages_ == 0);
 }
 
-vm_page* VmPageListNode::GetPage(size_t index) {
-    canary_.Assert();
-    DEBUG_ASSERT(index < kPageFanOut);
-    return pages_[index];
+VmPageList::VmPageList() {
+    LTRACEF("%p\n", this);
 }
 
-vm_page* VmPageListNode::RemovePage(size_t index) {
-    canary_.Assert();
-    DEBUG_ASSERT(index < kPageFanOut);
-
-    auto p = pages_[index];
-    if (!p)
-        return nullptr;
-
-    pages_[index] = nullptr;
+VmPageList::~VmPageList() {
+    LTRACEF("%p\n", this);
+    DEBUG_ASSERT(root_ == nullptr);
+}
 
-    return p;
+// index of the slot covering page |index| in a node |height| levels above and
+// including the leaves
+static size_t slot_index(uint64_t index, uint height) {
+    return (index >> ((height - 1) * VmPageListNode::kFanOutShift)) &
+           (VmPageListNode::kPageFanOut - 1);
 }
 
-status_t VmPageListNode::AddPage(vm_page* p, size_t index) {
-    canary_.Assert();
-    DEBUG_ASSERT(index < kPageFanOut);
-    if (pages_[index])
-        return ERR_ALREADY_EXISTS;
-    pages_[index] = p;
-    return NO_ERROR;
+// true if a tree of |height| levels can hold page |index|
+static bool height_covers(uint64_t index, uint height) {
+    uint shift = height * VmPageListNode::kFanOutShift;
+    return shift >= 64 || (index >> shift) == 0;
 }
 
-VmPageList::VmPageList() {
-    LTRACEF("%p\n", this);
+status_t VmPageList::AddPage(vm_page* p, uint64_t offset) {
+    // charged up front, so a page over the limit never makes it into the tree
+    if (account_ && !account_->Charge(1))
+        return ERR_NO_MEMORY;
+
+    status_t status = InsertPage(p, offset);
+    if (status != NO_ERROR && account_)
+        account_->Uncharge(1);
+    return status;
 }
 
-VmPageList::~VmPageList() {
-    LTRACEF("%p\n", this);
-    DEBUG_ASSERT(list_.is_empty());
+status_t VmPageList::AddPageOverLimit(vm_page* p, uint64_t offset) {
+    if (account_)
+        account_->ChargeOverLimit(1);
+
+    status_t status = InsertPage(p, offset);
+    if (status != NO_ERROR && account_)
+        account_->Uncharge(1);
+    return status;
 }
 
-status_t VmPageList::AddPage(vm_page* p, uint64_t offset) {
-    uint64_t node_offset = ROUNDDOWN(offset, PAGE_SIZE * VmPageListNode::kPageFanOut);
-    size_t index = (offset >> PAGE_SIZE_SHIFT) % VmPageListNode::kPageFanOut;
-
-    LTRACEF_LEVEL(2, "%p page %p, offset %#" PRIx64 " node_offset %#" PRIx64 " index %zu\n", this, p, offset,
-                  node_offset, index);
-
-    // lookup the tree node that holds this page
-    auto pln = list_.find(node_offset);
-    if (!pln.IsValid()) {
-        AllocChecker ac;
-        mxtl::unique_ptr<VmPageListNode> pl =
-            mxtl::unique_ptr<VmPageListNode>(new (&ac) VmPageListNode(node_offset));
-        if (!ac.check())
-            return ERR_NO_MEMORY;
+status_t VmPageList::InsertPage(vm_page* p, uint64_t offset) {
+    uint64_t index = offset >> PAGE_SIZE_SHIFT;
 
-        LTRACEF("allocating new inner node %p\n", pl.get());
-        __UNUSED auto status = pl->AddPage(p, index);
-        DEBUG_ASSERT(status == NO_ERROR);
+    LTRACEF_LEVEL(2, "%p page %p, offset %#" PRIx64 " index %#" PRIx64 "\n", this, p, offset, index);
 
-        list_.insert(mxtl::move(pl));
-    } else {
-        pln->AddPage(p, index);
+    // grow the tree from the top until it reaches this far
+    AllocChecker ac;
+    if (!root_) {
+        root_ = new (&ac) VmPageListNode();
+        if (!ac.check())
+            return ERR_NO_MEMORY;
+        height_ = 1;
+        while (!height_covers(index, height_))
+            height_++;
     }
+    while (!height_covers(index, height_)) {
+        VmPageListNode* new_root = new (&ac) VmPageListNode();
+        if (!ac.check())
+            return ERR_NO_MEMORY;
+        new_root->slots_[0].node = root_;
+        new_root->count_ = 1;
+        new_root->pages_ = root_->pages_;
+        root_ = new_root;
+        height_++;
+    }
+    DEBUG_ASSERT(height_ <= kMaxHeight);
+
+    // walk down to the leaf, filling in any missing inner nodes on the way
+    VmPageListNode* path[kMaxHeight];
+    VmPageListNode* node = root_;
+    for (uint height = height_; height > 1; height--) {
+        path[height - 1] = node;
+        VmPageListNode::Slot& slot = node->slots_[slot_index(index, height)];
+        if (!slot.node) {
+            slot.node = new (&ac) VmPageListNode();
+            if (!ac.check())
+                return ERR_NO_MEMORY;
+            LTRACEF("allocating new inner node %p\n", slot.node);
+            node->count_++;
+        }
+        node = slot.node;
+    }
+
+    VmPageListNode::Slot& slot = node->slots_[slot_index(index, 1)];
+    if (slot.page)
+        return ERR_ALREADY_EXISTS;
+    slot.page = p;
+    node->count_++;
+    node->pages_++;
+    for (uint height = 2; height <= height_; height++)
+        path[height - 1]->pages_++;
 
     return NO_ERROR;
 }
 
-vm_page* VmPageList::GetPage(uint64_t offset) {
-    uint64_t node_offset = ROUNDDOWN(offset, PAGE_SIZE * VmPageListNode::kPageFanOut);
-    size_t index = (offset >> PAGE_SIZE_SHIFT) % VmPageListNode::kPageFanOut;
+vm_page* VmPageList::GetPage(uint64_t offset) const {
+    uint64_t index = offset >> PAGE_SIZE_SHIFT;
 
-    LTRACEF_LEVEL(2, "%p offset %#" PRIx64 " node_offset %#" PRIx64 " index %zu\n", this, offset, node_offset,
-                  index);
+    LTRACEF_LEVEL(2, "%p offset %#" PRIx64 " index %#" PRIx64 "\n", this, offset, index);
 
-    // lookup the tree node that holds this page
-    auto pln = list_.find(node_offset);
-    if (!pln.IsValid()) {
+    if (!root_ || !height_covers(index, height_))
         return nullptr;
+
+    const VmPageListNode* node = root_;
+    for (uint height = height_; height > 1; height--) {
+        node = node->slots_[slot_index(index, height)].node;
+        if (!node)
+            return nullptr;
     }
 
-    return pln->GetPage(index);
+    return node->slots_[slot_index(index, 1)].page;
 }
 
 status_t VmPageList::FreePage(uint64_t offset) {
-    uint64_t node_offset = ROUNDDOWN(offset, PAGE_SIZE * VmPageListNode::kPageFanOut);
-    size_t index = (offset >> PAGE_SIZE_SHIFT) % VmPageListNode::kPageFanOut;
+    vm_page* page = RemovePage(offset);
+    if (!page)
+        return ERR_NOT_FOUND;
+
+    pmm_free_page(page);
+    return NO_ERROR;
+}
 
-    LTRACEF_LEVEL(2, "%p offset %#" PRIx64 " node_offset %#" PRIx64 " index %zu\n", this, offset, node_offset,
-                  index);
+vm_page* VmPageList::RemovePage(uint64_t offset) {
+    uint64_t index = offset >> PAGE_SIZE_SHIFT;
 
-    // lookup the tree node that holds this page
-    auto pln = list_.find(node_offset);
-    if (!pln.IsValid()) {
-        return ERR_NOT_FOUND;
+    LTRACEF_LEVEL(2, "%p offset %#" PRIx64 " index %#" PRIx64 "\n", this, offset, index);
+
+    if (!root_ || !height_covers(index, height_))
+        return nullptr;
+
+    // remember the path down so that emptied nodes can be pruned on the way back up
+    VmPageListNode* path[kMaxHeight];
+    VmPageListNode* node = root_;
+    for (uint height = height_; height > 1; height--) {
+        path[height - 1] = node;
+        node = node->slots_[slot_index(index, height)].node;
+        if (!node)
+            return nullptr;
     }
 
-    // free this page
-    auto page = pln->RemovePage(index);
-    if (page) {
-        // if it was the last page in the node, remove the node from the tree
-        if (pln->IsEmpty()) {
-            LTRACEF_LEVEL(2, "%p freeing the list node\n", this);
-            list_.erase(*pln);
+    VmPageListNode::Slot& slot = node->slots_[slot_index(index, 1)];
+    vm_page* page = slot.page;
+    if (!page)
+        return nullptr;
+    slot.page = nullptr;
+    node->count_--;
+    node->pages_--;
+    for (uint height = 2; height <= height_; height++)
+        path[height - 1]->pages_--;
+
+    for (uint height = 2; height <= height_ && node->IsEmpty(); height++) {
+        LTRACEF_LEVEL(2, "%p freeing the list node %p\n", this, node);
+        delete node;
+        node = path[height - 1];
+        node->slots_[slot_index(index, height)].node = nullptr;
+        node->count_--;
+    }
+    CollapseRoot();
+
+    if (account_)
+        account_->Uncharge(1);
+
+    return page;
+}
+
+size_t VmPageList::CountPagesInNode(const VmPageListNode* node, uint height, uint64_t base,
+                                    uint64_t first, uint64_t last) {
+    node->canary_.Assert();
+
+    const uint shift = (height - 1) * VmPageListNode::kFanOutShift;
+    size_t count = 0;
+    size_t i = (first > base) ? static_cast<size_t>((first - base) >> shift) : 0;
+    for (; i < VmPageListNode::kPageFanOut; i++) {
+        uint64_t slot_base = base + (static_cast<uint64_t>(i) << shift);
+        if (slot_base >= last)
+            break;
+
+        const VmPageListNode::Slot& slot = node->slots_[i];
+        if (height == 1) {
+            if (slot.page)
+                count++;
+        } else if (slot.node) {
+            // subtrees entirely inside the range are counted without descending
+            uint64_t slot_end = slot_base + (1ULL << shift);
+            if (slot_base >= first && slot_end <= last) {
+                count += slot.node->pages_;
+            } else {
+                count += CountPagesInNode(slot.node, height - 1, slot_base, first, last);
+            }
         }
+    }
+
+    return count;
+}
+
+size_t VmPageList::CountPagesInRange(uint64_t start_offset, uint64_t end_offset) const {
+    if (!root_)
+        return 0;
+
+    uint64_t first = OffsetToIndex(start_offset);
+    uint64_t last = OffsetToIndex(end_offset);
+    if (first == 0 && !height_covers(last, height_))
+        return root_->pages_;
+    return CountPagesInNode(root_, height_, 0, first, last);
+}
 
-        pmm_free_page(page);
+size_t VmPageList::RemovePagesInNode(VmPageListNode* node, uint height, uint64_t base,
+                                     uint64_t first, uint64_t last, list_node* removed) {
+    node->canary_.Assert();
+
+    const uint shift = (height - 1) * VmPageListNode::kFanOutShift;
+    size_t count = 0;
+    size_t i = (first > base) ? static_cast<size_t>((first - base) >> shift) : 0;
+    for (; i < VmPageListNode::kPageFanOut && node->count_ > 0; i++) {
+        uint64_t slot_base = base + (static_cast<uint64_t>(i) << shift);
+        if (slot_base >= last)
+            break;
+
+        VmPageListNode::Slot& slot = node->slots_[i];
+        if (height == 1) {
+            if (slot.page) {
+                list_add_tail(removed, &slot.page->free.node);
+                slot.page = nullptr;
+                node->count_--;
+                count++;
+            }
+        } else if (slot.node) {
+            count += RemovePagesInNode(slot.node, height - 1, slot_base, first, last, removed);
+            if (slot.node->IsEmpty()) {
+                delete slot.node;
+                slot.node = nullptr;
+                node->count_--;
+            }
+        }
     }
+    node->pages_ -= count;
 
-    return NO_ERROR;
+    return count;
+}
+
+size_t VmPageList::RemovePages(uint64_t start_offset, uint64_t end_offset, list_node* removed) {
+    LTRACEF("%p start %#" PRIx64 " end %#" PRIx64 "\n", this, start_offset, end_offset);
+
+    if (!root_)
+        return 0;
+
+    size_t count = RemovePagesInNode(root_, height_, 0, OffsetToIndex(start_offset),
+                                     OffsetToIndex(end_offset), removed);
+    CollapseRoot();
+
+    if (account_)
+        account_->Uncharge(count);
+
+    return count;
+}
+
+// drop top levels that no longer lead anywhere but their first slot, and the
+// root itself once the tree is empty
+void VmPageList::CollapseRoot() {
+    while (height_ > 1 && root_->count_ == 1 && root_->slots_[0].node) {
+        VmPageListNode* old_root = root_;
+        root_ = old_root->slots_[0].node;
+        old_root->slots_[0].node = nullptr;
+        old_root->count_ = 0;
+        old_root->pages_ = 0;
+        delete old_root;
+        height_--;
+    }
+    if (root_ && root_->IsEmpty()) {
+        delete root_;
+        root_ = nullptr;
+        height_ = 0;
+    }
 }
 
 size_t VmPageList::FreeAllPages() {
@@ -146,24 +318,20 @@ size_t VmPageList::FreeAllPages() {
     list_initialize(&list);
 
     size_t count = 0;
-
-    // per page get a reference to the page pointer inside the page list node
-    auto per_page_func = [&](vm_page*& p, uint64_t offset) {
-        // add the page to our list and null out the inner node
-        list_add_tail(&list, &p->free.node);
-        p = nullptr;
-        count++;
-    };
-
-    // walk the tree in order, freeing all the pages on every node
-    ForEveryPage(per_page_func);
+    if (root_) {
+        count = RemovePagesInNode(root_, height_, 0, 0, UINT64_MAX, &list);
+        DEBUG_ASSERT(root_->IsEmpty());
+        delete root_;
+        root_ = nullptr;
+        height_ = 0;
+    }
 
     // return all the pages to the pmm at once
     __UNUSED auto freed = pmm_free(&list);
     DEBUG_ASSERT(freed == count);
 
-    // empty the tree
-    list_.clear();
+    if (account_)
+        account_->Uncharge(count);
 
     return count;
 }
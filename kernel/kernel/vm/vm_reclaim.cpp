@@ -0,0 +1,116 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <kernel/vm/vm_reclaim.h>
+
+#include "vm_priv.h"
+#include <arch/ops.h>
+#include <kernel/auto_lock.h>
+#include <kernel/event.h>
+#include <kernel/mutex.h>
+#include <kernel/thread.h>
+#include <kernel/vm.h>
+#include <kernel/vm/vm_object_paged.h>
+#include <lk/init.h>
+#include <platform.h>
+#include <trace.h>
+
+#define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
+
+// The reclaim thread is woken once free memory drops below the low watermark
+// and discards unlocked discardable VMOs, then compresses cold anonymous ones,
+// until it is back above the high watermark. The system is under memory pressure from the time free memory
+// drops below the low watermark until reclaim gets it back above the high one.
+static size_t low_watermark_pages;
+static size_t high_watermark_pages;
+
+static volatile int reclaim_pending;
+static event_t reclaim_event = EVENT_INITIAL_VALUE(reclaim_event, false, EVENT_FLAG_AUTOUNSIGNAL);
+
+// while under pressure the thread keeps retrying on its own, since pages may
+// become discardable without any new allocations
+static const lk_time_t kPressureRetry = LK_SEC(1);
+
+static Mutex pressure_lock;
+static bool under_pressure TA_GUARDED(pressure_lock);
+static vm_pressure_callback_t pressure_callback TA_GUARDED(pressure_lock);
+
+void vm_reclaim_set_pressure_callback(vm_pressure_callback_t callback) {
+    AutoLock al(&pressure_lock);
+    pressure_callback = callback;
+    if (callback)
+        callback(under_pressure);
+}
+
+void vm_reclaim_check(size_t free_pages) {
+    if (likely(free_pages >= low_watermark_pages))
+        return;
+
+    // only the first allocation to notice pays for the wakeup
+    if (atomic_swap(&reclaim_pending, 1) == 0)
+        event_signal(&reclaim_event, false);
+}
+
+static void set_pressure(bool pressure) {
+    AutoLock al(&pressure_lock);
+    if (under_pressure == pressure)
+        return;
+
+    LTRACEF("memory pressure %s\n", pressure ? "on" : "off");
+
+    under_pressure = pressure;
+    if (pressure_callback)
+        pressure_callback(pressure);
+}
+
+static int reclaim_thread(void*) {
+    bool pressure = false;
+    for (;;) {
+        lk_time_t deadline = pressure ? current_time() + kPressureRetry : INFINITE_TIME;
+        event_wait_deadline(&reclaim_event, deadline, false);
+        atomic_store(&reclaim_pending, 0);
+
+        size_t free = pmm_count_free_pages();
+        if (free < high_watermark_pages) {
+            size_t reclaimed = VmObjectPaged::ReclaimDiscardable(high_watermark_pages - free);
+            LTRACEF("free %zu reclaimed %zu\n", free, reclaimed);
+            free += reclaimed;
+        }
+
+        // compressing costs a fault to bring the page back, so it only makes up
+        // for whatever discarding couldn't
+        if (free < high_watermark_pages) {
+            size_t compressed = VmObjectPaged::CompressCold(high_watermark_pages - free);
+            LTRACEF("free %zu compressed %zu\n", free, compressed);
+            free += compressed;
+        }
+
+        if (free < low_watermark_pages)
+            pressure = true;
+        else if (free >= high_watermark_pages)
+            pressure = false;
+        set_pressure(pressure);
+    }
+    return 0;
+}
+
+static void vm_reclaim_init(uint level) {
+    size_t total_pages = pmm_count_total_bytes() / PAGE_SIZE;
+
+    thread_t* t = thread_create("vm reclaim", reclaim_thread, nullptr,
+                                HIGH_PRIORITY, DEFAULT_STACK_SIZE);
+    if (t == nullptr) {
+        TRACEF("unable to create reclaim thread\n");
+        return;
+    }
+    thread_detach_and_resume(t);
+
+    // arm the check only once there is a thread to wake up
+    high_watermark_pages = total_pages / 16;
+    low_watermark_pages = total_pages / 32;
+    event_signal(&reclaim_event, false);
+}
+LK_INIT_HOOK(vm_reclaim, &vm_reclaim_init, LK_INIT_LEVEL_THREADING);
@@ -7,10 +7,13 @@
 #include <assert.h>
 #include <err.h>
 #include <kernel/vm.h>
+#include <kernel/vm/compressed_page.h>
+#include <kernel/vm/memory_account.h>
 #include <kernel/vm/vm_address_region.h>
 #include <kernel/vm/vm_aspace.h>
 #include <kernel/vm/vm_object.h>
 #include <kernel/vm/vm_object_paged.h>
+#include <kernel/vm/vm_page_list.h>
 #include <mxtl/array.h>
 #include <new.h>
 #include <unittest.h>
@@ -409,6 +412,84 @@ static bool vmo_demand_paged_map_test(void* context) {
     END_TEST;
 }
 
+// Creates a vm object, reads it through a demand paged mapping and checks
+// that nothing was committed until it is written to.
+static bool vmo_zero_page_read_test(void* context) {
+    BEGIN_TEST;
+    static const size_t alloc_size = PAGE_SIZE * 16;
+    auto vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, alloc_size);
+    REQUIRE_NONNULL(vmo, "vmobject creation\n");
+
+    auto ka = VmAspace::kernel_aspace();
+    void* ptr;
+    auto ret = ka->MapObjectInternal(vmo, "test", 0, alloc_size, &ptr,
+                             0, 0, kArchRwFlags);
+    REQUIRE_EQ(ret, NO_ERROR, "mapping object");
+
+    // read faults all get the shared zero page
+    volatile uint8_t* bytes = static_cast<volatile uint8_t*>(ptr);
+    for (size_t off = 0; off < alloc_size; off += PAGE_SIZE)
+        EXPECT_EQ(0u, bytes[off], "reading untouched page\n");
+    EXPECT_EQ(0u, vmo->AllocatedPagesInRange(0, alloc_size), "pages committed by reads\n");
+
+    // the first write to a page gives it a page of its own
+    bytes[PAGE_SIZE * 3] = 0x99;
+    EXPECT_EQ(1u, vmo->AllocatedPagesInRange(0, alloc_size), "pages committed by a write\n");
+    EXPECT_EQ(0x99u, bytes[PAGE_SIZE * 3], "reading back written page\n");
+    EXPECT_EQ(0u, bytes[PAGE_SIZE * 2], "reading untouched page\n");
+    EXPECT_EQ(0u, bytes[PAGE_SIZE * 4], "reading untouched page\n");
+
+    auto err = ka->FreeRegion((vaddr_t)ptr);
+    EXPECT_EQ(NO_ERROR, err, "unmapping object");
+    END_TEST;
+}
+
+// Creates a vm object backed by large contiguous runs, maps it demand paged
+// and then decommits a page in the middle, which splits the large mapping.
+static bool vmo_large_page_map_test(void* context) {
+    BEGIN_TEST;
+    static const size_t alloc_size = LARGE_PAGE_SIZE * 2;
+    auto vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, alloc_size);
+    REQUIRE_NONNULL(vmo, "vmobject creation\n");
+
+    uint64_t committed;
+    auto ret = vmo->CommitRange(0, alloc_size, &committed);
+    EXPECT_EQ(NO_ERROR, ret, "committing vm object\n");
+    EXPECT_EQ(alloc_size, committed, "committing vm object\n");
+
+    {
+        AutoLock a(vmo->lock());
+        paddr_t pa;
+        if (vmo->GetLargePageLocked(0, &pa) == NO_ERROR)
+            EXPECT_TRUE(IS_ALIGNED(pa, LARGE_PAGE_SIZE), "large page alignment\n");
+        EXPECT_EQ(ERR_OUT_OF_RANGE, vmo->GetLargePageLocked(alloc_size, &pa),
+                  "large page past the end\n");
+    }
+
+    auto ka = VmAspace::kernel_aspace();
+    void* ptr;
+    ret = ka->MapObjectInternal(vmo, "test", 0, alloc_size, &ptr,
+                                LARGE_PAGE_SIZE_SHIFT, 0, kArchRwFlags);
+    EXPECT_EQ(NO_ERROR, ret, "mapping object");
+
+    if (!fill_and_test(ptr, alloc_size))
+        all_ok = false;
+
+    uint64_t decommitted;
+    ret = vmo->DecommitRange(PAGE_SIZE * 3, PAGE_SIZE, &decommitted);
+    EXPECT_EQ(NO_ERROR, ret, "decommitting a page\n");
+    EXPECT_EQ((uint64_t)PAGE_SIZE, decommitted, "decommitting a page\n");
+
+    // the rest of the first large page must still be there, the hole gets faulted back in
+    EXPECT_TRUE(test_region((uintptr_t)ptr, ptr, PAGE_SIZE * 3), "contents before the hole\n");
+    if (!fill_and_test(ptr, alloc_size))
+        all_ok = false;
+
+    auto err = ka->FreeRegion((vaddr_t)ptr);
+    EXPECT_EQ(NO_ERROR, err, "unmapping object");
+    END_TEST;
+}
+
 // Creates a vm object, maps it, drops ref before unmapping.
 static bool vmo_dropped_ref_test(void* context) {
     BEGIN_TEST;
@@ -619,6 +700,209 @@ static bool vmo_read_write_smoke_test(void* context) {
     END_TEST;
 }
 
+// Reads and writes long enough to be done in several chunks, through both
+// scattered pages and physically contiguous ones.
+static bool vmo_read_write_chunks_test(void* context) {
+    BEGIN_TEST;
+    static const size_t alloc_size = PAGE_SIZE * 300;
+
+    AllocChecker ac;
+    mxtl::Array<uint8_t> a(new (&ac) uint8_t[alloc_size], alloc_size);
+    EXPECT_TRUE(ac.check(), "");
+    fill_region(57, a.get(), alloc_size);
+    mxtl::Array<uint8_t> b(new (&ac) uint8_t[alloc_size], alloc_size);
+    EXPECT_TRUE(ac.check(), "");
+
+    for (int contiguous = 0; contiguous < 2; contiguous++) {
+        auto vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, alloc_size);
+        REQUIRE_NONNULL(vmo, "vmobject creation\n");
+        if (contiguous) {
+            uint64_t committed;
+            EXPECT_EQ(NO_ERROR, vmo->CommitRangeContiguous(0, alloc_size, &committed, 0),
+                      "committing vm object contig\n");
+        }
+
+        size_t bytes_written = -1;
+        status_t err = vmo->Write(a.get(), 0, alloc_size, &bytes_written);
+        EXPECT_EQ(NO_ERROR, err, "writing to object");
+        EXPECT_EQ(alloc_size, bytes_written, "writing to object");
+
+        // an odd offset keeps every chunk and run from lining up with pages,
+        // and the trimmed length ends part way through a chunk
+        size_t bytes_read = -1;
+        err = vmo->Read(b.get(), 31, alloc_size, &bytes_read);
+        EXPECT_EQ(NO_ERROR, err, "reading from object");
+        EXPECT_EQ(alloc_size - 31, bytes_read, "reading from object");
+        EXPECT_EQ(0, memcmp(b.get(), a.get() + 31, alloc_size - 31), "reading from object");
+    }
+    END_TEST;
+}
+
+static bool vm_page_list_range_test(void* context) {
+    BEGIN_TEST;
+
+    // pages spread over several leaves and levels of the tree, in offset order
+    static const uint64_t offsets[] = {
+        0, PAGE_SIZE, 7 * PAGE_SIZE, 512 * PAGE_SIZE, 513 * PAGE_SIZE,
+        (1ull << 40), (1ull << 40) + PAGE_SIZE,
+    };
+    static const size_t count = countof(offsets);
+    vm_page_t pages[count] = {};
+
+    VmPageList pl;
+    for (size_t i = 0; i < count; i++) {
+        EXPECT_EQ(NO_ERROR, pl.AddPage(&pages[i], offsets[i]), "adding page");
+    }
+    EXPECT_EQ(ERR_ALREADY_EXISTS, pl.AddPage(&pages[0], offsets[0]), "adding page twice");
+
+    for (size_t i = 0; i < count; i++) {
+        EXPECT_EQ(&pages[i], pl.GetPage(offsets[i]), "looking up page");
+    }
+    EXPECT_NULL(pl.GetPage(2 * PAGE_SIZE), "looking up missing page");
+    EXPECT_NULL(pl.GetPage(1ull << 50), "looking up page past the tree");
+
+    // pages and gaps come back in order
+    size_t index = 0;
+    uint64_t gap_pages = 0;
+    status_t status = pl.ForEveryPageAndGapInRange(
+        [&](vm_page_t* p, uint64_t offset) -> status_t {
+            if (index >= count || p != &pages[index] || offset != offsets[index])
+                return ERR_INTERNAL;
+            index++;
+            return NO_ERROR;
+        },
+        [&](uint64_t gap_start, uint64_t gap_end) -> status_t {
+            gap_pages += (gap_end - gap_start) / PAGE_SIZE;
+            return NO_ERROR;
+        },
+        0, 1024 * PAGE_SIZE);
+    EXPECT_EQ(NO_ERROR, status, "walking pages and gaps");
+    EXPECT_EQ(5u, index, "pages walked");
+    EXPECT_EQ(1024u - 5u, gap_pages, "gap pages walked");
+
+    EXPECT_EQ(2u, pl.CountPagesInRange(PAGE_SIZE, 512 * PAGE_SIZE), "counting pages");
+    EXPECT_EQ(count, pl.CountPagesInRange(0, UINT64_MAX), "counting all pages");
+    EXPECT_EQ(5u, pl.CountPagesInRange(PAGE_SIZE, (1ull << 40) + PAGE_SIZE),
+              "counting pages across subtrees");
+    EXPECT_EQ(count, pl.CountPages(), "counting the whole list");
+
+    // take them back out without handing them to the pmm
+    EXPECT_EQ(&pages[3], pl.RemovePage(offsets[3]), "removing page");
+    EXPECT_NULL(pl.RemovePage(offsets[3]), "removing page twice");
+    EXPECT_EQ(count - 1, pl.CountPages(), "counting after a removal");
+
+    list_node list;
+    list_initialize(&list);
+    EXPECT_EQ(count - 1, pl.RemovePages(0, UINT64_MAX, &list), "removing all pages");
+    EXPECT_EQ(count - 1, list_length(&list), "removed pages");
+    EXPECT_EQ(0u, pl.CountPagesInRange(0, UINT64_MAX), "counting no pages");
+    EXPECT_EQ(0u, pl.CountPages(), "counting the empty list");
+    END_TEST;
+}
+
+// Clones a committed vm object and checks that the clone's pages are counted
+// as shared until it writes to them.
+static bool vmo_clone_shared_pages_test(void* context) {
+    BEGIN_TEST;
+    static const size_t alloc_size = PAGE_SIZE * 4;
+    auto vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, alloc_size);
+    REQUIRE_NONNULL(vmo, "vmobject creation\n");
+    uint64_t committed;
+    auto ret = vmo->CommitRange(0, alloc_size, &committed);
+    REQUIRE_EQ(NO_ERROR, ret, "committing vm object\n");
+
+    mxtl::RefPtr<VmObject> clone;
+    ret = vmo->CloneCOW(PAGE_SIZE, alloc_size, &clone);
+    REQUIRE_EQ(NO_ERROR, ret, "cloning vm object\n");
+    EXPECT_EQ(0u, clone->AllocatedPagesInRange(0, alloc_size), "clone's own pages\n");
+    EXPECT_EQ(3u, clone->SharedPagesInRange(0, alloc_size), "clone's shared pages\n");
+    EXPECT_EQ(0u, vmo->SharedPagesInRange(0, alloc_size), "parent's shared pages\n");
+
+    uint8_t byte = 0x5a;
+    size_t written;
+    ret = clone->Write(&byte, PAGE_SIZE, sizeof(byte), &written);
+    EXPECT_EQ(NO_ERROR, ret, "writing to clone\n");
+    EXPECT_EQ(1u, clone->AllocatedPagesInRange(0, alloc_size), "clone's own pages\n");
+    EXPECT_EQ(2u, clone->SharedPagesInRange(0, alloc_size), "clone's shared pages\n");
+    EXPECT_EQ(1u, clone->SharedPagesInRange(0, PAGE_SIZE * 2), "shared pages in a range\n");
+    END_TEST;
+}
+
+// Compresses a page that shrinks well and one that doesn't, and checks that
+// the first comes back the same.
+static bool compressed_page_test(void* context) {
+    BEGIN_TEST;
+    paddr_t pa;
+    vm_page_t* page = pmm_alloc_page(0, &pa);
+    REQUIRE_NONNULL(page, "pmm_alloc single page\n");
+    uint8_t* ptr = reinterpret_cast<uint8_t*>(paddr_to_kvaddr(pa));
+
+    for (size_t i = 0; i < PAGE_SIZE; i++)
+        ptr[i] = static_cast<uint8_t>(i / 64);
+    auto compressed = CompressedPage::Create(PAGE_SIZE, pa);
+    REQUIRE_NONNULL(compressed, "compressing a regular page\n");
+    EXPECT_EQ(PAGE_SIZE, compressed->offset(), "offset of the compressed page\n");
+
+    memset(ptr, 0xff, PAGE_SIZE);
+    compressed->Decompress(pa);
+    bool same = true;
+    for (size_t i = 0; i < PAGE_SIZE; i++)
+        same = same && ptr[i] == static_cast<uint8_t>(i / 64);
+    EXPECT_TRUE(same, "decompressed contents\n");
+
+    // a xorshift sequence leaves LZ4 nothing to work with
+    uint32_t x = 0x12345678;
+    for (size_t i = 0; i < PAGE_SIZE; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        ptr[i] = static_cast<uint8_t>(x);
+    }
+    EXPECT_NULL(CompressedPage::Create(0, pa), "compressing a random page\n");
+
+    pmm_free_page(page);
+    END_TEST;
+}
+
+// Commits pages against nested memory limits.
+static bool memory_account_test(void* context) {
+    BEGIN_TEST;
+    static const size_t limit_pages = 16;
+    auto parent = MemoryAccount::Create(nullptr);
+    REQUIRE_NONNULL(parent, "creating the parent account\n");
+    auto child = MemoryAccount::Create(parent);
+    REQUIRE_NONNULL(child, "creating the child account\n");
+    parent->SetLimits(0, limit_pages * PAGE_SIZE);
+
+    auto vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, (limit_pages + 1) * PAGE_SIZE);
+    REQUIRE_NONNULL(vmo, "vmobject creation\n");
+    EXPECT_EQ(NO_ERROR, vmo->SetMemoryAccount(child), "setting the account\n");
+
+    uint64_t committed;
+    auto ret = vmo->CommitRange(0, limit_pages * PAGE_SIZE, &committed);
+    EXPECT_EQ(NO_ERROR, ret, "committing up to the limit\n");
+    EXPECT_EQ(limit_pages * PAGE_SIZE, child->usage_bytes(), "child usage\n");
+    EXPECT_EQ(limit_pages * PAGE_SIZE, parent->usage_bytes(), "parent usage\n");
+
+    ret = vmo->CommitRange(limit_pages * PAGE_SIZE, PAGE_SIZE, &committed);
+    EXPECT_EQ(ERR_NO_MEMORY, ret, "committing past the limit\n");
+    EXPECT_EQ(1u, parent->failed_charges(), "failure charged to the parent\n");
+    EXPECT_EQ(0u, child->failed_charges(), "no failure charged to the child\n");
+    EXPECT_EQ(ERR_BAD_STATE, vmo->SetMemoryAccount(nullptr), "changing a committed account\n");
+
+    uint64_t decommitted;
+    ret = vmo->DecommitRange(0, PAGE_SIZE, &decommitted);
+    EXPECT_EQ(NO_ERROR, ret, "decommitting a page\n");
+    ret = vmo->CommitRange(limit_pages * PAGE_SIZE, PAGE_SIZE, &committed);
+    EXPECT_EQ(NO_ERROR, ret, "committing the freed page elsewhere\n");
+
+    vmo.reset();
+    parent->SetLimits(0, 0);
+    child->SetLimits(0, 0);
+    EXPECT_EQ(0u, parent->usage_bytes(), "usage once the vmo is gone\n");
+    END_TEST;
+}
+
 // Use the function name as the test name
 #define VM_UNITTEST(fname) UNITTEST(#fname, fname)
 
@@ -641,9 +925,16 @@ VM_UNITTEST(vmo_odd_size_commit_test)
 VM_UNITTEST(vmo_contiguous_commit_test)
 VM_UNITTEST(vmo_precommitted_map_test)
 VM_UNITTEST(vmo_demand_paged_map_test)
+VM_UNITTEST(vmo_zero_page_read_test)
+VM_UNITTEST(vmo_large_page_map_test)
 VM_UNITTEST(vmo_dropped_ref_test)
 VM_UNITTEST(vmo_remap_test)
 VM_UNITTEST(vmo_double_remap_test)
 VM_UNITTEST(vmo_read_write_smoke_test)
+VM_UNITTEST(vmo_read_write_chunks_test)
+VM_UNITTEST(vm_page_list_range_test)
+VM_UNITTEST(vmo_clone_shared_pages_test)
+VM_UNITTEST(compressed_page_test)
+VM_UNITTEST(memory_account_test)
 VM_UNITTEST(dump_all_aspaces) // Run last
 UNITTEST_END_TESTCASE(vm_tests, "vmtests", "Virtual memory tests", nullptr, nullptr);
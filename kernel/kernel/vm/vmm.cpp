@@ -11,7 +11,9 @@
 #include <inttypes.h>
 #include <kernel/auto_lock.h>
 #include <kernel/mutex.h>
+#include <kernel/thread.h>
 #include <kernel/vm.h>
+#include <kernel/vm/page_source.h>
 #include <kernel/vm/vm_address_region.h>
 #include <kernel/vm/vm_aspace.h>
 #include <lib/console.h>
@@ -52,13 +54,34 @@ status_t vmm_page_fault_handler(vaddr_t addr, uint flags) {
 
     ktrace(TAG_PAGE_FAULT, (uint32_t)(addr >> 32), (uint32_t)addr, flags, arch_curr_cpu_num());
 
+    // only the faulting thread touches its own count
+    get_current_thread()->page_faults++;
+
     // get the address space object this pointer is in
     VmAspace* aspace = vmm_aspace_to_obj(vaddr_to_aspace((void*)addr));
     if (!aspace)
         return ERR_NOT_FOUND;
 
-    // page fault it
-    status_t status = aspace->PageFault(addr, flags);
+    // page fault it. pages of objects with a page source may have to be waited
+    // for, which only user faults do: a kernel fault could be holding any lock,
+    // including the ones needed to supply the page.
+    status_t status;
+    for (;;) {
+        uint64_t generation = vm_page_supply_generation();
+        status = aspace->PageFault(addr, flags);
+        if (status != ERR_SHOULD_WAIT)
+            break;
+        if (!(flags & VMM_PF_FLAG_USER)) {
+            status = ERR_NOT_FOUND;
+            break;
+        }
+        if (vm_page_supply_wait(generation) != NO_ERROR) {
+            // killed or suspended. go back to user mode to take the signal, the
+            // fault happens again if the thread is resumed.
+            status = NO_ERROR;
+            break;
+        }
+    }
 #if WITH_LIB_MAGENTA
     // If it's a user fault, dump info about process memory usage.
     // If it's a kernel fault, the kernel could possibly already
@@ -12,11 +12,14 @@
 #include <err.h>
 #include <kernel/auto_lock.h>
 #include <kernel/cmdline.h>
+#include <kernel/mp.h>
 #include <kernel/mutex.h>
 #include <lib/crypto/cryptolib.h>
 #include <lib/crypto/prng.h>
+#include <magenta/compiler.h>
 #include <new.h>
 #include <mxtl/algorithm.h>
+#include <mxtl/atomic.h>
 #include <lk/init.h>
 #include <string.h>
 
@@ -31,6 +34,37 @@ PRNG* GetInstance() {
     return kGlobalPrng;
 }
 
+// How many bytes a per-cpu PRNG hands out before it mixes in a fresh key from
+// the global PRNG.
+static constexpr uint64_t kPerCpuReseedBytes = 1u << 20;
+
+struct PerCpuPrng {
+    PRNG* prng;
+    mxtl::atomic<uint64_t> drawn;
+};
+
+static PerCpuPrng kPerCpuPrngs[SMP_MAX_CPUS];
+static bool kPerCpuPrngsReady = false;
+
+void DrawPerCpu(void* out, size_t size) {
+    if (unlikely(!kPerCpuPrngsReady)) {
+        GetInstance()->Draw(out, size);
+        return;
+    }
+
+    // Being migrated to another cpu part way through is harmless, as each of
+    // the PRNGs is thread-safe.
+    PerCpuPrng* percpu = &kPerCpuPrngs[arch_curr_cpu_num()];
+    uint64_t drawn = percpu->drawn.fetch_add(size);
+    if (unlikely(drawn / kPerCpuReseedBytes != (drawn + size) / kPerCpuReseedBytes)) {
+        uint8_t seed[PRNG::kMinEntropy];
+        GetInstance()->Draw(seed, sizeof(seed));
+        percpu->prng->AddEntropy(seed, sizeof(seed));
+        memset(seed, 0, sizeof(seed));
+    }
+    percpu->prng->Draw(out, size);
+}
+
 // TODO(security): Remove this in favor of virtio-rng once it is available and
 // we decide we don't need it for getting entropy from elsewhere.
 static size_t IntegrateCmdlineEntropy() {
@@ -114,6 +148,18 @@ static void BecomeThreadSafe(uint level) {
     GetInstance()->BecomeThreadSafe();
 }
 
+// Key a thread-safe PRNG for each cpu from the global PRNG.
+static void InitPerCpu(uint level) {
+    alignas(alignof(PRNG))static uint8_t prng_space[SMP_MAX_CPUS][sizeof(PRNG)];
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        uint8_t seed[PRNG::kMinEntropy];
+        GetInstance()->Draw(seed, sizeof(seed));
+        kPerCpuPrngs[i].prng = new (&prng_space[i]) PRNG(seed, sizeof(seed));
+        memset(seed, 0, sizeof(seed));
+    }
+    kPerCpuPrngsReady = true;
+}
+
 } //namespace GlobalPRNG
 
 } // namespace crypto
@@ -123,3 +169,6 @@ LK_INIT_HOOK(global_prng_seed, crypto::GlobalPRNG::EarlyBootSeed,
 
 LK_INIT_HOOK(global_prng_thread_safe, crypto::GlobalPRNG::BecomeThreadSafe,
              LK_INIT_LEVEL_THREADING - 1)
+
+LK_INIT_HOOK(global_prng_percpu, crypto::GlobalPRNG::InitPerCpu,
+             LK_INIT_LEVEL_THREADING)
@@ -7,6 +7,7 @@
 #include <lib/crypto/global_prng.h>
 
 #include <stdint.h>
+#include <string.h>
 #include <unittest.h>
 
 namespace crypto {
@@ -24,12 +25,31 @@ bool identical(void*) {
     END_TEST;
 }
 
+bool per_cpu_draws_differ(void*) {
+    BEGIN_TEST;
+
+    // Crossing the reseed point must not repeat output either.
+    uint8_t first[PRNG::kMinEntropy];
+    uint8_t chunk[256];
+    uint8_t second[PRNG::kMinEntropy];
+    GlobalPRNG::DrawPerCpu(first, sizeof(first));
+    for (size_t i = 0; i < (1u << 20) / sizeof(chunk); i++)
+        GlobalPRNG::DrawPerCpu(chunk, sizeof(chunk));
+    GlobalPRNG::DrawPerCpu(second, sizeof(second));
+
+    EXPECT_NEQ(memcmp(first, second, sizeof(first)), 0, "");
+    EXPECT_NEQ(memcmp(first, chunk, sizeof(first)), 0, "");
+
+    END_TEST;
+}
+
 } // namespace
 
 UNITTEST_START_TESTCASE(global_prng_tests)
 UNITTEST("Identical", identical)
+UNITTEST("PerCpuDrawsDiffer", per_cpu_draws_differ)
 UNITTEST_END_TESTCASE(global_prng_tests, "global_prng",
-                      "Validate global PRNG singleton",
+                      "Validate global PRNG singleton and per-cpu PRNGs",
                       nullptr, nullptr);
 
 } // namespace crypto
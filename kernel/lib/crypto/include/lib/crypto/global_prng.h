@@ -16,6 +16,12 @@ namespace GlobalPRNG {
 // guaranteed to be non-null.
 PRNG* GetInstance();
 
+// Fills |out| with |size| bytes from the calling cpu's PRNG.  These are keyed
+// from the global PRNG, and rekeyed from it as they are used, so that frequent
+// callers do not all serialize on the global PRNG's lock.  |size| MUST NOT be
+// greater than PRNG::kMaxDrawLen.
+void DrawPerCpu(void* out, size_t size);
+
 } //namespace GlobalPRNG
 
 } // namespace crypto
@@ -6,6 +6,7 @@
 
 #include <lib/debuglog.h>
 
+#include <arch/ops.h>
 #include <err.h>
 #include <dev/udisplay.h>
 #include <kernel/spinlock.h>
@@ -24,13 +25,30 @@ static_assert((DLOG_SIZE & DLOG_MASK) == 0u, "must be power of two");
 static_assert(DLOG_MAX_RECORD <= DLOG_SIZE, "wat");
 static_assert((DLOG_MAX_RECORD & 3) == 0, "E_DONT_DO_THAT");
 
+// Each cpu's writers stage records here, so they only contend with a
+// drainer on another cpu rather than with every other writer.
+#define DLOG_STAGE_SIZE (4u * DLOG_MAX_RECORD)
+
+static_assert((DLOG_STAGE_SIZE & 3) == 0, "");
+
+typedef struct {
+    spin_lock_t lock;
+    // Offsets of the next record to write and the oldest unmerged one.
+    // Both go back to zero whenever the stage is emptied.
+    volatile size_t head;
+    size_t tail;
+    uint8_t data[DLOG_STAGE_SIZE];
+} __CPU_ALIGN dlog_stage_t;
+
 static uint8_t DLOG_DATA[DLOG_SIZE];
+static dlog_stage_t DLOG_STAGES[SMP_MAX_CPUS];
 
 static dlog_t DLOG = {
     .lock = SPIN_LOCK_INITIAL_VALUE,
     .head = 0,
     .tail = 0,
     .data = DLOG_DATA,
+    .pending = 0,
     .event = EVENT_INITIAL_VALUE(DLOG.event, 0, EVENT_FLAG_AUTOUNSIGNAL),
 
     .readers_lock = MUTEX_INITIAL_VALUE(DLOG.readers_lock),
@@ -66,6 +84,105 @@ static dlog_t DLOG = {
 
 #define ALIGN4(n) (((n) + 3) & (~3))
 
+// Records reach the fifo in two steps.  A writer copies its record into
+// its cpu's stage, and then whoever holds log->lock merges every stage
+// into the fifo, oldest record first.  A writer which finds the lock taken
+// leaves its record for the holder, which keeps draining until no writer
+// has flagged |pending| behind it.  Records staged on different cpus at
+// the same moment land in timestamp order; one staged after a merge has
+// started may land behind a newer record from another cpu.
+
+// Appends a record of |readlen| bytes, taking |wiresize| in the fifo.
+static void dlog_put_locked(dlog_t* log, const void* rec, size_t readlen, size_t wiresize) {
+    // Discard records at tail until there is enough
+    // space for the new record.
+    while ((log->head - log->tail) > (DLOG_SIZE - wiresize)) {
+        uint32_t header = *((uint32_t*) (log->data + (log->tail & DLOG_MASK)));
+        log->tail += DLOG_HDR_GET_FIFOLEN(header);
+    }
+
+    size_t offset = (log->head & DLOG_MASK);
+
+    size_t fifospace = DLOG_SIZE - offset;
+
+    if (fifospace >= readlen) {
+        // everything fits in one write, simple case!
+        memcpy(log->data + offset, rec, readlen);
+    } else {
+        // the header word is 4-aligned, so only the rest of it or the data
+        // can wrap
+        memcpy(log->data + offset, rec, fifospace);
+        memcpy(log->data, rec + fifospace, readlen - fifospace);
+    }
+    log->head += wiresize;
+}
+
+// Moves every staged record into the fifo.  Called with log->lock held,
+// and so with interrupts disabled.  Returns whether there were any.
+static bool dlog_drain_locked(dlog_t* log) {
+    bool drained = false;
+
+    for (;;) {
+        dlog_stage_t* oldest = NULL;
+        lk_time_t oldest_time = 0;
+        for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+            dlog_stage_t* stage = &DLOG_STAGES[i];
+            if (stage->head == 0) {
+                continue;
+            }
+            // Only the drainer moves a tail, so the record there stays
+            // put once seen.
+            spin_lock(&stage->lock);
+            if (stage->tail != stage->head) {
+                dlog_header_t* hdr = (dlog_header_t*) (stage->data + stage->tail);
+                if (oldest == NULL || hdr->timestamp < oldest_time) {
+                    oldest = stage;
+                    oldest_time = hdr->timestamp;
+                }
+            }
+            spin_unlock(&stage->lock);
+        }
+        if (oldest == NULL) {
+            return drained;
+        }
+
+        spin_lock(&oldest->lock);
+        uint32_t header = *((uint32_t*) (oldest->data + oldest->tail));
+        dlog_put_locked(log, oldest->data + oldest->tail,
+                        DLOG_HDR_GET_READLEN(header), DLOG_HDR_GET_FIFOLEN(header));
+        oldest->tail += DLOG_HDR_GET_FIFOLEN(header);
+        if (oldest->tail == oldest->head) {
+            oldest->head = 0;
+            oldest->tail = 0;
+        }
+        spin_unlock(&oldest->lock);
+        drained = true;
+    }
+}
+
+// Drain the stages unless someone else is; interrupts must be disabled.
+static void dlog_flush(dlog_t* log) {
+    atomic_store(&log->pending, 1);
+
+    while (spin_trylock(&log->lock) == 0) {
+        atomic_store(&log->pending, 0);
+
+        // Readers are woken once for everything merged, rather than once
+        // for each record.
+        if (dlog_drain_locked(log)) {
+            event_signal(&log->event, false);
+        }
+        spin_unlock(&log->lock);
+
+        // A writer which staged after the drain passed its cpu and then
+        // failed to take the lock is counting on us to go round again.
+        smp_mb();
+        if (atomic_load(&log->pending) == 0) {
+            break;
+        }
+    }
+}
+
 status_t dlog_write(uint32_t flags, const void* ptr, size_t len) {
     dlog_t* log = &DLOG;
 
@@ -98,41 +215,32 @@ status_t dlog_write(uint32_t flags, const void* ptr, size_t len) {
     }
 
     spin_lock_saved_state_t state;
-    spin_lock_irqsave(&log->lock, state);
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
 
-    // Discard records at tail until there is enough
-    // space for the new record.
-    while ((log->head - log->tail) > (DLOG_SIZE - wiresize)) {
-        uint32_t header = *((uint32_t*) (log->data + (log->tail & DLOG_MASK)));
-        log->tail += DLOG_HDR_GET_FIFOLEN(header);
+    dlog_stage_t* stage = &DLOG_STAGES[arch_curr_cpu_num()];
+    for (;;) {
+        spin_lock(&stage->lock);
+        if (DLOG_STAGE_SIZE - stage->head >= wiresize) {
+            break;
+        }
+        // The stage is full; wait for the lock and empty it ourselves.
+        // Nothing else runs on this cpu to refill it meanwhile.
+        spin_unlock(&stage->lock);
+        spin_lock(&log->lock);
+        if (dlog_drain_locked(log)) {
+            event_signal(&log->event, false);
+        }
+        spin_unlock(&log->lock);
     }
 
-    size_t offset = (log->head & DLOG_MASK);
-
-    size_t fifospace = DLOG_SIZE - offset;
+    memcpy(stage->data + stage->head, &hdr, sizeof(hdr));
+    memcpy(stage->data + stage->head + sizeof(hdr), ptr, len);
+    stage->head += wiresize;
+    spin_unlock(&stage->lock);
 
-    if (fifospace >= wiresize) {
-        // everything fits in one write, simple case!
-        memcpy(log->data + offset, &hdr, sizeof(hdr));
-        memcpy(log->data + offset + sizeof(hdr), ptr, len);
-    } else if (fifospace < sizeof(hdr)) {
-        // the wrap happens in the header
-        memcpy(log->data + offset, &hdr, fifospace);
-        memcpy(log->data, ((void*) &hdr) + fifospace, sizeof(hdr) - fifospace);
-        memcpy(log->data + (sizeof(hdr) - fifospace), ptr, len);
-    } else {
-        // the wrap happens in the data
-        memcpy(log->data + offset, &hdr, sizeof(hdr));
-        offset += sizeof(hdr);
-        fifospace -= sizeof(hdr);
-        memcpy(log->data + offset, ptr, fifospace);
-        memcpy(log->data, ptr + fifospace, len - fifospace);
-    }
-    log->head += wiresize;
-
-    event_signal(&log->event, false);
+    dlog_flush(log);
 
-    spin_unlock_irqrestore(&log->lock, state);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
 
     return NO_ERROR;
 }
@@ -43,6 +43,9 @@ struct dlog {
 
     void* data;
 
+    // Set by a writer whose record is staged but not yet in the fifo.
+    volatile int pending;
+
     bool panic;
 
     event_t event;
@@ -8,72 +8,138 @@
 #include <assert.h>
 #include <err.h>
 #include <list.h>
+#include <stdio.h>
 #include <trace.h>
 
+#include <arch/ops.h>
 #include <kernel/event.h>
+#include <kernel/mp.h>
 #include <kernel/spinlock.h>
+#include <kernel/thread.h>
 #include <lk/init.h>
 
-static spin_lock_t dpc_lock = SPIN_LOCK_INITIAL_VALUE;
-static struct list_node dpc_list = LIST_INITIAL_VALUE(dpc_list);
-static event_t dpc_event = EVENT_INITIAL_VALUE(dpc_event, false, 0);
+/* one cache line aligned block per cpu, so queueing on one cpu does not
+ * contend with the others */
+struct dpc_state {
+    spin_lock_t lock;
+    struct list_node list;
+    event_t event;
+    thread_t *thread;
+} __CPU_ALIGN;
+
+static struct dpc_state dpc_state[SMP_MAX_CPUS];
+
+static status_t queue_on_cpu(dpc_t *dpc, uint cpu, bool reschedule, spin_lock_saved_state_t state)
+{
+    struct dpc_state *q = &dpc_state[cpu];
+
+    spin_lock(&q->lock);
+
+    // a dpc stays where it was first queued until it runs
+    bool queued = !list_in_list(&dpc->node);
+    if (queued) {
+        // put the dpc at the tail of the list and signal the worker
+        list_add_tail(&q->list, &dpc->node);
+        event_signal(&q->event, false);
+    }
+
+    spin_unlock(&q->lock);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    // reschedule here if asked to, which lets the worker run right away
+    if (queued && reschedule)
+        thread_preempt(false);
+
+    return NO_ERROR;
+}
 
 status_t dpc_queue(dpc_t *dpc, bool reschedule)
 {
     DEBUG_ASSERT(dpc);
     DEBUG_ASSERT(dpc->func);
 
-    if (list_in_list(&dpc->node))
-        return NO_ERROR;
-
+    // no migrating between picking the queue and locking it
     spin_lock_saved_state_t state;
-    spin_lock_irqsave(&dpc_lock, state);
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    return queue_on_cpu(dpc, arch_curr_cpu_num(), reschedule, state);
+}
 
-    // put the dpc at the tail of the list and signal the worker
-    list_add_tail(&dpc_list, &dpc->node);
-    event_signal(&dpc_event, false);
+status_t dpc_queue_on(dpc_t *dpc, uint cpu, bool reschedule)
+{
+    DEBUG_ASSERT(dpc);
+    DEBUG_ASSERT(dpc->func);
 
-    spin_unlock_irqrestore(&dpc_lock, state);
+    if (cpu >= SMP_MAX_CPUS)
+        return ERR_INVALID_ARGS;
 
-    // reschedule here if asked to
-    if (reschedule)
-        thread_preempt(false);
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
 
-    return NO_ERROR;
+    uint curr_cpu = arch_curr_cpu_num();
+    if (cpu != curr_cpu && (!mp_is_cpu_online(cpu) || !dpc_state[cpu].thread))
+        cpu = curr_cpu;
+
+    return queue_on_cpu(dpc, cpu, reschedule && cpu == curr_cpu, state);
 }
 
 static int dpc_thread(void *arg)
 {
+    struct dpc_state *q = arg;
+
     for (;;) {
         // wait for a dpc to fire
-        __UNUSED status_t err = event_wait(&dpc_event);
+        __UNUSED status_t err = event_wait(&q->event);
         DEBUG_ASSERT(err == NO_ERROR);
 
         spin_lock_saved_state_t state;
-        spin_lock_irqsave(&dpc_lock, state);
+        spin_lock_irqsave(&q->lock, state);
 
         // pop a dpc off the list
-        dpc_t *dpc = list_remove_head_type(&dpc_list, dpc_t, node);
+        dpc_t *dpc = list_remove_head_type(&q->list, dpc_t, node);
 
         // if the list is now empty, unsignal the event so we block until it is
         if (!dpc)
-            event_unsignal(&dpc_event);
+            event_unsignal(&q->event);
 
-        spin_unlock_irqrestore(&dpc_lock, state);
+        spin_unlock_irqrestore(&q->lock, state);
 
         // call the dpc
         if (dpc && dpc->func)
             dpc->func(dpc);
     }
 
-
     return 0;
 }
 
-static void dpc_init(unsigned int level)
+static void dpc_init_early(unsigned int level)
+{
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        struct dpc_state *q = &dpc_state[i];
+        spin_lock_init(&q->lock);
+        list_initialize(&q->list);
+        event_init(&q->event, false, 0);
+    }
+}
+
+// runs on each cpu as it comes up, including when it is hotplugged again
+// after an unplug, in which case it still has its thread and any dpcs
+// queued before it went down
+static void dpc_init_percpu(unsigned int level)
 {
-    thread_t *t = thread_create("dpc", &dpc_thread, NULL, HIGH_PRIORITY, DEFAULT_STACK_SIZE);
+    uint cpu = arch_curr_cpu_num();
+    struct dpc_state *q = &dpc_state[cpu];
+    if (q->thread)
+        return;
+
+    char name[16];
+    snprintf(name, sizeof(name), "dpc-%u", cpu);
+    thread_t *t = thread_create(name, &dpc_thread, q, HIGH_PRIORITY, DEFAULT_STACK_SIZE);
+    DEBUG_ASSERT(t);
+    thread_set_pinned_cpu(t, cpu);
+    q->thread = t;
     thread_detach_and_resume(t);
 }
 
-LK_INIT_HOOK(dpc, dpc_init, LK_INIT_LEVEL_THREADING);
+LK_INIT_HOOK(dpc_early, dpc_init_early, LK_INIT_LEVEL_EARLIEST);
+LK_INIT_HOOK_FLAGS(dpc, dpc_init_percpu, LK_INIT_LEVEL_THREADING, LK_INIT_FLAG_ALL_CPUS);
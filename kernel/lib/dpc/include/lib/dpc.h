@@ -21,7 +21,16 @@ typedef struct dpc {
     void *arg;
 } dpc_t;
 
+/* Each cpu has its own queue of dpcs and its own thread, pinned to that cpu,
+ * which runs them in the order they were queued. */
+
+/* Queue |dpc| on the current cpu.  Does nothing if it is already queued on
+ * any cpu.  If |reschedule| is set the caller may be preempted by the dpc
+ * thread, so it must not be set from interrupt context. */
 status_t dpc_queue(dpc_t *dpc, bool reschedule);
 
-__END_CDECLS
+/* Queue |dpc| on |cpu| instead, or on the current cpu if |cpu| is not
+ * online.  |reschedule| only has an effect when that is the current cpu. */
+status_t dpc_queue_on(dpc_t *dpc, uint cpu, bool reschedule);
 
+__END_CDECLS
@@ -26,6 +26,13 @@
 // Allocation strategy takes place with a global mutex.  Freelist entries are
 // kept in linked lists with 8 different sizes per binary order of magnitude
 // and the header size is two words with eager coalescing on free.
+//
+// In front of that sits a small per-cpu cache of recently freed small
+// blocks, one stack per bucket, each guarded by a spinlock only its own cpu
+// normally takes.  Cached blocks keep their allocation headers, so to the
+// rest of the heap they look allocated and don't coalesce.  A miss refills
+// the stack a batch at a time and an overflowing stack is flushed a batch at
+// a time, so the global mutex is taken once per batch rather than per call.
 
 #if defined(DEBUG) || LK_DEBUGLEVEL > 2
 #define CMPCT_DEBUG
@@ -86,11 +93,44 @@ struct heap {
 // Heap static vars.
 static struct heap theheap;
 
+// Blocks with a payload in the first CACHE_BUCKETS buckets (up to 512 bytes)
+// go through the per-cpu caches.
+#define CACHE_BUCKETS 32
+#define CACHE_DEPTH 16
+#define CACHE_BATCH 8
+
+static_assert(CACHE_BATCH <= CACHE_DEPTH, "");
+
+typedef struct cache_struct {
+    spin_lock_t lock;
+    // Singly linked through the first word of the payload.
+    void *blocks[CACHE_BUCKETS];
+    uint8_t count[CACHE_BUCKETS];
+
+    // Statistics, updated under the lock.
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t flushes;
+} __CPU_ALIGN cache_t;
+
+static cache_t caches[SMP_MAX_CPUS];
+static bool cache_enabled;
+
+// Global lock statistics, updated under the lock.
+static uint64_t lock_acquires;
+static uint64_t lock_contended;
+
 static ssize_t heap_grow(size_t len, free_t **bucket);
+static void cache_drain_locked(void) TA_REQ(theheap.lock);
 
 static void lock(void) TA_ACQ(theheap.lock)
 {
+    // Racy peek at the mutex, only used to count contention.
+    bool contended = __atomic_load_n(&theheap.lock.count, __ATOMIC_RELAXED) > 0;
     mutex_acquire(&theheap.lock);
+    lock_acquires++;
+    if (contended)
+        lock_contended++;
 }
 
 static void unlock(void) TA_REL(theheap.lock)
@@ -128,10 +168,32 @@ void cmpct_dump(bool panic_time) TA_NO_THREAD_SAFETY_ANALYSIS
         }
     }
 
+    dprintf(INFO, "\tlock acquires %" PRIu64 ", contended %" PRIu64 "\n",
+            lock_acquires, lock_contended);
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        const cache_t *cache = &caches[i];
+        if (cache->hits == 0 && cache->misses == 0)
+            continue;
+        size_t cached = 0;
+        for (int j = 0; j < CACHE_BUCKETS; j++)
+            cached += cache->count[j];
+        dprintf(INFO, "\tcpu %u cache: hits %" PRIu64 ", misses %" PRIu64
+                ", flushes %" PRIu64 ", %zu blocks cached\n",
+                i, cache->hits, cache->misses, cache->flushes, cached);
+    }
+
     if (!panic_time)
         unlock();
 }
 
+void cmpct_get_info(size_t *size_bytes, size_t *free_bytes)
+{
+    lock();
+    *size_bytes = theheap.size;
+    *free_bytes = theheap.remaining;
+    unlock();
+}
+
 // Operates in sizes that don't include the allocation header.
 static int size_to_index_helper(
     size_t size, size_t *rounded_up_out, int adjust, int increment)
@@ -565,6 +627,12 @@ static void cmpct_test_return_to_os(void)
 
 void cmpct_test(void)
 {
+    // The tests below count on blocks going straight back to the free lists.
+    cache_enabled = false;
+    lock();
+    cache_drain_locked();
+    unlock();
+
     cmpct_test_buckets();
     cmpct_test_get_back_newly_freed();
     cmpct_test_return_to_os();
@@ -621,6 +689,7 @@ void cmpct_test(void)
     }
 
     cmpct_dump(false);
+    cache_enabled = true;
 }
 
 static void check_free_fill(void *ptr, size_t size)
@@ -674,6 +743,7 @@ void cmpct_trim(void)
     // header. They might be at the start or the end of a block, so we can trim
     // them and free the page(s).
     lock();
+    cache_drain_locked();
     for (int bucket = size_to_index_freeing(PAGE_SIZE);
             bucket < NUMBER_OF_BUCKETS;
             bucket++) {
@@ -740,18 +810,12 @@ void cmpct_trim(void)
     unlock();
 }
 
-void *cmpct_alloc(size_t size)
+// Takes a block for a payload of |size| bytes, |rounded_up| bytes including
+// the header, out of the free lists starting at |start_bucket|, growing the
+// heap if there is nothing big enough.
+static void *alloc_locked(size_t size, size_t rounded_up, int start_bucket)
+    TA_REQ(theheap.lock)
 {
-    if (size == 0u) return NULL;
-
-    if (size + sizeof(header_t) > (1u << HEAP_ALLOC_VIRTUAL_BITS)) return large_alloc(size);
-
-    size_t rounded_up;
-    int start_bucket = size_to_index_allocating(size, &rounded_up);
-
-    rounded_up += sizeof(header_t);
-
-    lock();
     int bucket = find_nonempty_bucket(start_bucket);
     if (bucket == -1) {
         // Grow heap by at least 12% if we can.
@@ -760,7 +824,6 @@ void *cmpct_alloc(size_t size)
                                 MAX(HEAP_GROW_SIZE, rounded_up)));
         while (heap_grow(growby, NULL) < 0) {
             if (growby <= rounded_up) {
-                unlock();
                 return NULL;
             }
             growby = MAX(growby >> 1, rounded_up);
@@ -791,7 +854,192 @@ void *cmpct_alloc(size_t size)
     memset(result, ALLOC_FILL, size);
     memset(((char *)result) + size, PADDING_FILL, rounded_up - size - sizeof(header_t));
 #endif
+    return result;
+}
+
+// Returns the block with |header| to the free lists, coalescing it with its
+// free neighbours.
+static void free_locked(header_t *header) TA_REQ(theheap.lock)
+{
+    size_t size = header->size;
+    header_t *left = header->left;
+    if (left != NULL && is_tagged_as_free(left)) {
+        // Coalesce with left free object.
+        unlink_free_unknown_bucket((free_t *)left);
+        header_t *right = right_header(header);
+        if (is_tagged_as_free(right)) {
+            // Coalesce both sides.
+            unlink_free_unknown_bucket((free_t *)right);
+            header_t *right_right = right_header(right);
+            FixLeftPointer(right_right, left);
+            free_memory(left, left->left, left->size + size + right->size);
+        } else {
+            // Coalesce only left.
+            FixLeftPointer(right, left);
+            free_memory(left, left->left, left->size + size);
+        }
+    } else {
+        header_t *right = right_header(header);
+        if (is_tagged_as_free(right)) {
+            // Coalesce only right.
+            header_t *right_right = right_header(right);
+            unlink_free_unknown_bucket((free_t *)right);
+            FixLeftPointer(right_right, header);
+            free_memory(header, left, size + right->size);
+        } else {
+            free_memory(header, left, size);
+        }
+    }
+}
+
+static void free_list_locked(void *list) TA_REQ(theheap.lock)
+{
+    while (list) {
+        void *next = *(void **)list;
+        free_locked((header_t *)list - 1);
+        list = next;
+    }
+}
+
+// The cache of the cpu we are running on.  We may migrate right after, in
+// which case we just use another cpu's cache for this call; its lock keeps
+// that safe.
+static cache_t *current_cache(void)
+{
+    return &caches[arch_curr_cpu_num()];
+}
+
+static void *cache_pop(int index)
+{
+    cache_t *cache = current_cache();
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&cache->lock, state);
+    void *result = cache->blocks[index];
+    if (result) {
+        cache->blocks[index] = *(void **)result;
+        cache->count[index]--;
+        cache->hits++;
+    } else {
+        cache->misses++;
+    }
+    spin_unlock_irqrestore(&cache->lock, state);
+    return result;
+}
+
+// Pushes |payload| on its stack.  When the stack is full, first detaches the
+// CACHE_BATCH oldest blocks and returns them so the caller can free them
+// under the heap lock; returns NULL otherwise.
+static void *cache_push(int index, void *payload)
+{
+    cache_t *cache = current_cache();
+    void *flush = NULL;
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&cache->lock, state);
+#ifdef CMPCT_DEBUG
+    for (void *p = cache->blocks[index]; p; p = *(void **)p)
+        ASSERT(p != payload);  // Double free!
+#endif
+    if (cache->count[index] == CACHE_DEPTH) {
+        // Keep the most recently freed, likely cache hot, blocks.
+        void **tail = &cache->blocks[index];
+        for (int i = 0; i < CACHE_DEPTH - CACHE_BATCH; i++)
+            tail = (void **)*tail;
+        flush = *tail;
+        *tail = NULL;
+        cache->count[index] -= CACHE_BATCH;
+        cache->flushes++;
+    }
+    *(void **)payload = cache->blocks[index];
+    cache->blocks[index] = payload;
+    cache->count[index]++;
+    spin_unlock_irqrestore(&cache->lock, state);
+    return flush;
+}
+
+// Returns every cached block to the free lists, so they can coalesce.
+static void cache_drain_locked(void) TA_REQ(theheap.lock)
+{
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        cache_t *cache = &caches[i];
+        for (int j = 0; j < CACHE_BUCKETS; j++) {
+            spin_lock_saved_state_t state;
+            spin_lock_irqsave(&cache->lock, state);
+            void *list = cache->blocks[j];
+            cache->blocks[j] = NULL;
+            cache->count[j] = 0;
+            spin_unlock_irqrestore(&cache->lock, state);
+            free_list_locked(list);
+        }
+    }
+}
+
+#ifdef CMPCT_DEBUG
+static void fill_cached_allocation(void *payload, size_t size)
+{
+    header_t *header = (header_t *)payload - 1;
+    memset(payload, ALLOC_FILL, size);
+    memset((char *)payload + size, PADDING_FILL, header->size - size - sizeof(header_t));
+}
+#endif
+
+void *cmpct_alloc(size_t size)
+{
+    if (size == 0u) return NULL;
+
+    if (size + sizeof(header_t) > (1u << HEAP_ALLOC_VIRTUAL_BITS)) return large_alloc(size);
+
+    size_t rounded_up;
+    int start_bucket = size_to_index_allocating(size, &rounded_up);
+
+    // Blocks are cached by the bucket their payload rounds down to, which for
+    // the bucket sizes we round up to here is an exact match.
+    int cache_index = size_to_index_freeing(rounded_up);
+    bool cacheable = cache_enabled && cache_index < CACHE_BUCKETS;
+    if (cacheable) {
+        void *result = cache_pop(cache_index);
+        if (result) {
+#ifdef CMPCT_DEBUG
+            fill_cached_allocation(result, size);
+#endif
+            return result;
+        }
+    }
+
+    rounded_up += sizeof(header_t);
+
+    lock();
+    void *result = alloc_locked(size, rounded_up, start_bucket);
+    if (result == NULL && cache_enabled) {
+        // The blocks sitting in the caches may be what it takes.
+        cache_drain_locked();
+        result = alloc_locked(size, rounded_up, start_bucket);
+    }
+
+    // Refill the cache while we have the lock.  Best effort, on failure we
+    // still return what we have.
+    void *refill = NULL;
+    if (result && cacheable) {
+        for (int i = 1; i < CACHE_BATCH; i++) {
+            void *block = alloc_locked(size, rounded_up, start_bucket);
+            if (!block)
+                break;
+            *(void **)block = refill;
+            refill = block;
+        }
+    }
     unlock();
+
+    while (refill) {
+        void *next = *(void **)refill;
+        void *flush = cache_push(cache_index, refill);
+        if (flush) {
+            // Only if we migrated to a cpu whose stack was full.
+            lock();
+            free_list_locked(flush);
+            unlock();
+        }
+        refill = next;
+    }
     return result;
 }
 
@@ -829,36 +1077,25 @@ void cmpct_free(void *payload)
     if (payload == NULL) return;
     header_t *header = (header_t *)payload - 1;
     DEBUG_ASSERT(!is_tagged_as_free(header));  // Double free!
-    size_t size = header->size;
-    lock();
-    header_t *left = header->left;
-    if (left != NULL && is_tagged_as_free(left)) {
-        // Coalesce with left free object.
-        unlink_free_unknown_bucket((free_t *)left);
-        header_t *right = right_header(header);
-        if (is_tagged_as_free(right)) {
-            // Coalesce both sides.
-            unlink_free_unknown_bucket((free_t *)right);
-            header_t *right_right = right_header(right);
-            FixLeftPointer(right_right, left);
-            free_memory(left, left->left, left->size + size + right->size);
-        } else {
-            // Coalesce only left.
-            FixLeftPointer(right, left);
-            free_memory(left, left->left, left->size + size);
-        }
-    } else {
-        header_t *right = right_header(header);
-        if (is_tagged_as_free(right)) {
-            // Coalesce only right.
-            header_t *right_right = right_header(right);
-            unlink_free_unknown_bucket((free_t *)right);
-            FixLeftPointer(right_right, header);
-            free_memory(header, left, size + right->size);
-        } else {
-            free_memory(header, left, size);
+
+    if (cache_enabled) {
+        int cache_index = size_to_index_freeing(header->size - sizeof(header_t));
+        if (cache_index < CACHE_BUCKETS) {
+#ifdef CMPCT_DEBUG
+            memset(payload, FREE_FILL, header->size - sizeof(header_t));
+#endif
+            void *flush = cache_push(cache_index, payload);
+            if (flush) {
+                lock();
+                free_list_locked(flush);
+                unlock();
+            }
+            return;
         }
     }
+
+    lock();
+    free_locked(header);
     unlock();
 }
 
@@ -928,4 +1165,8 @@ void cmpct_init(void)
     theheap.remaining = 0;
 
     heap_grow(initial_alloc, NULL);
+
+    for (uint i = 0; i < SMP_MAX_CPUS; i++)
+        spin_lock_init(&caches[i].lock);
+    cache_enabled = true;
 }
@@ -66,6 +66,13 @@ static inline void HEAP_INIT(void)
 }
 #define HEAP_DUMP miniheap_dump
 #define HEAP_TRIM miniheap_trim
+static inline void HEAP_GET_INFO(size_t *size_bytes, size_t *free_bytes)
+{
+    struct miniheap_stats stats;
+    miniheap_get_stats(&stats);
+    *size_bytes = stats.heap_len;
+    *free_bytes = stats.heap_free;
+}
 
 /* end miniheap implementation */
 #elif WITH_LIB_HEAP_CMPCTMALLOC
@@ -79,6 +86,7 @@ static inline void HEAP_INIT(void)
 #define HEAP_INIT cmpct_init
 #define HEAP_DUMP cmpct_dump
 #define HEAP_TRIM cmpct_trim
+#define HEAP_GET_INFO cmpct_get_info
 static inline void *HEAP_CALLOC(size_t n, size_t s)
 {
     size_t realsize = n * s;
@@ -130,6 +138,11 @@ void heap_trim(void)
     HEAP_TRIM();
 }
 
+void heap_get_info(size_t *size_bytes, size_t *free_bytes)
+{
+    HEAP_GET_INFO(size_bytes, free_bytes);
+}
+
 void *malloc(size_t size)
 {
     DEBUG_ASSERT(!arch_in_int_handler());
@@ -28,4 +28,7 @@ void heap_delayed_free(void *);
 /* tell the heap to return any free pages it can find */
 void heap_trim(void);
 
+/* bytes the heap holds from the page allocator, and how many are unallocated */
+void heap_get_info(size_t *size_bytes, size_t *free_bytes);
+
 __END_CDECLS;
@@ -43,7 +43,7 @@ void *page_alloc(size_t pages)
         // mark all of the allocated page as HEAP
         vm_page_t *p;
         list_for_every_entry(&list, p, vm_page_t, free.node) {
-            p->state = VM_PAGE_STATE_HEAP;
+            vm_page_set_state(p, VM_PAGE_STATE_HEAP);
         }
     }
 
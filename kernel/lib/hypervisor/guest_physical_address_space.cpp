@@ -56,12 +56,54 @@ status_t GuestPhysicalAddressSpace::MapApicPage(vaddr_t guest_paddr, paddr_t hos
     return map_page(&paspace_, guest_paddr, host_paddr, kApicMmuFlags);
 }
 
+namespace {
+
+// A run of pages which are contiguous in both guest and host physical memory.
+struct MapRun {
+    guest_paspace_t* paspace;
+    vaddr_t guest_paddr;
+    paddr_t host_paddr;
+    size_t count;
+};
+
+} // namespace
+
+static status_t map_run(MapRun* run) {
+    if (run->count == 0)
+        return NO_ERROR;
+    size_t mapped;
+    status_t status = guest_mmu_map(run->paspace, run->guest_paddr, run->host_paddr, run->count,
+                                    kMmuFlags, &mapped);
+    if (status != NO_ERROR)
+        return status;
+    return mapped != run->count ? ERR_NO_MEMORY : NO_ERROR;
+}
+
 status_t GuestPhysicalAddressSpace::MapRange(size_t offset, size_t len) {
+    // Map each contiguous run with a single call, so that the EPT uses 2MB and
+    // 1GB pages wherever a run covers one, which shortens the two-dimensional
+    // walk on every guest TLB miss.
     auto mmu_map = [](void* context, size_t offset, size_t index, paddr_t pa) -> status_t {
-        guest_paspace_t* paspace = static_cast<guest_paspace_t*>(context);
-        return map_page(paspace, offset, pa, kMmuFlags);
+        MapRun* run = static_cast<MapRun*>(context);
+        size_t run_len = run->count * PAGE_SIZE;
+        if (run->count != 0 && run->guest_paddr + run_len == offset &&
+            run->host_paddr + run_len == pa) {
+            run->count++;
+            return NO_ERROR;
+        }
+        status_t status = map_run(run);
+        if (status != NO_ERROR)
+            return status;
+        run->guest_paddr = offset;
+        run->host_paddr = pa;
+        run->count = 1;
+        return NO_ERROR;
     };
-    return guest_phys_mem_->Lookup(offset, len, kPfFlags, mmu_map, &paspace_);
+    MapRun run = { &paspace_, 0, 0, 0 };
+    status_t status = guest_phys_mem_->Lookup(offset, len, kPfFlags, mmu_map, &run);
+    if (status != NO_ERROR)
+        return status;
+    return map_run(&run);
 }
 
 status_t GuestPhysicalAddressSpace::UnmapPage(vaddr_t guest_paddr) {
@@ -6,12 +6,16 @@
 
 #include <debug.h>
 #include <err.h>
+#include <limits.h>
 #include <platform.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include <arch/defines.h>
 #include <arch/ops.h>
 #include <arch/user_copy.h>
 #include <kernel/cmdline.h>
+#include <kernel/spinlock.h>
 #include <kernel/vm/vm_aspace.h>
 #include <lib/ktrace.h>
 #include <lk/init.h>
@@ -27,6 +31,7 @@
 #endif
 
 static void ktrace_name_etc(uint32_t tag, uint32_t id, uint32_t arg, const char* name, bool always);
+static void ktrace_report_boot_stages(void);
 
 // Generated struct that has the syscall index and name.
 static struct ktrace_syscall_info {
@@ -73,54 +78,119 @@ static void ktrace_add_probe(ktrace_probe_info_t* probe) TA_REQ(probe_list_lock)
     ktrace_name_etc(TAG_PROBE_NAME, probe->num, 0, probe->name, true);
 }
 
-static void ktrace_report_probes(void) {
+static void ktrace_report_probes_locked(void) TA_REQ(probe_list_lock) {
     ktrace_probe_info_t *probe;
-    mutex_acquire(&probe_list_lock);
     for (probe = probe_list; probe != nullptr; probe = probe->next) {
         ktrace_name_etc(TAG_PROBE_NAME, probe->num, 0, probe->name, true);
     }
+}
+
+static void ktrace_report_probes(void) {
+    mutex_acquire(&probe_list_lock);
+    ktrace_report_probes_locked();
     mutex_release(&probe_list_lock);
 }
 
+// Each cpu traces into its own slice of the buffer so that writers on
+// different cpus never share a cache line. The slices are broken into
+// KTRACE_BLOCKSIZE blocks that no record straddles, which lets a reader start
+// parsing at any block boundary once a circular buffer has wrapped.
+typedef struct ktrace_cpu {
+    // bytes ever reserved in this cpu's buffer, only grows
+    uint64_t offset;
+
+    // offset where tracing was stopped
+    uint64_t marker;
+
+    // this cpu's slice of the trace buffer
+    uint8_t* buffer;
+} __ALIGNED(CACHE_LINE) ktrace_cpu_t;
+
 typedef struct ktrace_state {
-    // where the next record will be written
+    // where the next metadata record will be written
     int offset;
 
     // mask of groups we allow, 0 == tracing disabled
     int grpmask;
 
-    // total size of the trace buffer
+    // size of the metadata area at the start of the buffer, which holds the
+    // version, tick rate and names and is never overwritten
     uint32_t bufsize;
 
     // offset where tracing was stopped, 0 if tracing active
     uint32_t marker;
 
+    // in circular mode a full cpu buffer wraps around and overwrites its
+    // oldest blocks, otherwise the first full buffer stops tracing
+    bool circular;
+
+    // size of each cpu's buffer, a power of two multiple of KTRACE_BLOCKSIZE
+    uint32_t cpu_bufsize;
+    uint num_cpus;
+
     // raw trace buffer
     uint8_t* buffer;
+
+    ktrace_cpu_t cpu[SMP_MAX_CPUS];
 } ktrace_state_t;
 
 static ktrace_state_t KTRACE_STATE;
 
+// The range of offsets in a cpu buffer that hold intact records. Once a
+// circular buffer has wrapped the oldest partial block is skipped.
+static void ktrace_cpu_range(const ktrace_state_t* ks, const ktrace_cpu_t* cpu,
+                             uint64_t* start, uint64_t* end) {
+    uint64_t n = ks->marker ? cpu->marker : __atomic_load_n(&cpu->offset, __ATOMIC_RELAXED);
+    if (n > ks->cpu_bufsize) {
+        if (!ks->circular) {
+            n = ks->cpu_bufsize;
+        } else {
+            *start = ROUNDUP(n - ks->cpu_bufsize, KTRACE_BLOCKSIZE);
+            *end = n;
+            return;
+        }
+    }
+    *start = 0;
+    *end = n;
+}
+
+// The trace reads back as the metadata followed by the records of each cpu
+// in turn, oldest first.
 int ktrace_read_user(void* ptr, uint32_t off, uint32_t len) {
     ktrace_state_t* ks = &KTRACE_STATE;
 
-    // Buffer size is limited by the marker if set,
+    // The metadata is limited by the marker if set,
     // otherwise limited by offset (last written point).
     // Offset can end up pointing past the end, so clip
-    // it to the actual buffer size to be safe.
-    uint32_t max;
+    // it to the actual metadata size to be safe.
+    uint32_t meta;
     if (ks->marker) {
-        max = ks->marker;
+        meta = ks->marker;
     } else {
-        max = ks->offset;
-        if (max > ks->bufsize) {
-            max = ks->bufsize;
+        meta = atomic_load(&ks->offset);
+        if (meta > ks->bufsize) {
+            meta = ks->bufsize;
         }
     }
 
+    uint64_t start[SMP_MAX_CPUS];
+    uint64_t end[SMP_MAX_CPUS];
+    uint64_t max = meta;
+    if (__atomic_load_n(&ks->buffer, __ATOMIC_ACQUIRE) == nullptr) {
+        // not set up yet, or disabled
+        max = 0;
+    }
+    for (uint i = 0; max > 0 && i < ks->num_cpus; i++) {
+        ktrace_cpu_range(ks, &ks->cpu[i], &start[i], &end[i]);
+        max += end[i] - start[i];
+    }
+    if (max > INT_MAX) {
+        max = INT_MAX;
+    }
+
     // null read is a query for trace buffer size
     if (ptr == nullptr) {
-        return max;
+        return static_cast<int>(max);
     }
 
     // constrain read to available buffer
@@ -128,26 +198,74 @@ int ktrace_read_user(void* ptr, uint32_t off, uint32_t len) {
         return 0;
     }
     if (len > (max - off)) {
-        len = max - off;
+        len = static_cast<uint32_t>(max - off);
     }
 
-    if (arch_copy_to_user(ptr, ks->buffer + off, len) != NO_ERROR) {
-        return ERR_INVALID_ARGS;
+    uint8_t* out = static_cast<uint8_t*>(ptr);
+    uint32_t remaining = len;
+    uint64_t pos = off;
+    if (pos < meta) {
+        uint32_t n = MIN(remaining, static_cast<uint32_t>(meta - pos));
+        if (arch_copy_to_user(out, ks->buffer + pos, n) != NO_ERROR) {
+            return ERR_INVALID_ARGS;
+        }
+        out += n;
+        remaining -= n;
+        pos = meta;
     }
-    return len;
+    pos -= meta;
+    for (uint i = 0; i < ks->num_cpus && remaining > 0; i++) {
+        uint64_t size = end[i] - start[i];
+        if (pos >= size) {
+            pos -= size;
+            continue;
+        }
+        // copy out of the ring, in up to two pieces if it wraps
+        uint64_t from = start[i] + pos;
+        while (remaining > 0 && from < end[i]) {
+            uint32_t ring_off = static_cast<uint32_t>(from & (ks->cpu_bufsize - 1));
+            uint64_t n = MIN(end[i] - from, ks->cpu_bufsize - ring_off);
+            n = MIN(n, remaining);
+            if (arch_copy_to_user(out, ks->cpu[i].buffer + ring_off, n) != NO_ERROR) {
+                return ERR_INVALID_ARGS;
+            }
+            out += n;
+            remaining -= static_cast<uint32_t>(n);
+            from += n;
+        }
+        pos = 0;
+    }
+    return len - remaining;
+}
+
+static void ktrace_start(ktrace_state_t* ks, uint32_t options, bool circular) {
+    options = KTRACE_GRP_TO_MASK(options);
+    ks->circular = circular;
+    ks->marker = 0;
+    atomic_store(&ks->grpmask, options ? options : KTRACE_GRP_TO_MASK(KTRACE_GRP_ALL));
+    ktrace_report_live_threads();
 }
 
 status_t ktrace_control(uint32_t action, uint32_t options, void* ptr) {
     ktrace_state_t* ks = &KTRACE_STATE;
+    // probes and boot stages can be recorded before the buffer exists,
+    // but there is nothing to start, stop or rewind until it does
+    if (action != KTRACE_ACTION_NEW_PROBE && action != KTRACE_ACTION_BOOT_STAGE &&
+        __atomic_load_n(&ks->buffer, __ATOMIC_ACQUIRE) == nullptr) {
+        return ERR_BAD_STATE;
+    }
     switch (action) {
     case KTRACE_ACTION_START:
-        options = KTRACE_GRP_TO_MASK(options);
-        ks->marker = 0;
-        atomic_store(&ks->grpmask, options ? options : KTRACE_GRP_TO_MASK(KTRACE_GRP_ALL));
-        ktrace_report_live_threads();
+        ktrace_start(ks, options, false);
+        break;
+    case KTRACE_ACTION_START_CIRCULAR:
+        ktrace_start(ks, options, true);
         break;
     case KTRACE_ACTION_STOP: {
         atomic_store(&ks->grpmask, 0);
+        for (uint i = 0; i < ks->num_cpus; i++) {
+            ks->cpu[i].marker = __atomic_load_n(&ks->cpu[i].offset, __ATOMIC_RELAXED);
+        }
         uint32_t n = ks->offset;
         if (n > ks->bufsize) {
             ks->marker = ks->bufsize;
@@ -159,8 +277,21 @@ status_t ktrace_control(uint32_t action, uint32_t options, void* ptr) {
     case KTRACE_ACTION_REWIND:
         // roll back to just after the metadata
         atomic_store(&ks->offset, KTRACE_RECSIZE * 2);
+        for (uint i = 0; i < ks->num_cpus; i++) {
+            __atomic_store_n(&ks->cpu[i].offset, 0, __ATOMIC_RELAXED);
+            ks->cpu[i].marker = 0;
+        }
         ktrace_report_syscalls(kt_syscall_info);
         ktrace_report_probes();
+        ktrace_report_boot_stages();
+        break;
+    case KTRACE_ACTION_BOOT_STAGE:
+        ktrace_boot_stage((const char*) ptr);
+        break;
+    case KTRACE_ACTION_SAMPLE_START:
+        return ktrace_sample_start(options);
+    case KTRACE_ACTION_SAMPLE_STOP:
+        ktrace_sample_stop();
         break;
     case KTRACE_ACTION_NEW_PROBE: {
         ktrace_probe_info_t* probe;
@@ -186,6 +317,59 @@ status_t ktrace_control(uint32_t action, uint32_t options, void* ptr) {
     return NO_ERROR;
 }
 
+// Every boot stage is kept here as well as in the trace, so that the stages
+// recorded before ktrace_init() sets up the buffer (everything from the
+// bootloader and the early init levels) can be written once it exists, and
+// so that they all survive a rewind.
+#define MAX_BOOT_STAGES 256
+
+struct boot_stage {
+    uint64_t ts;
+    char name[32];
+};
+
+// Also held while ktrace_init() publishes the buffer, so that each stage is
+// written exactly once whether it arrives before, during or after that.
+static spin_lock_t boot_stage_lock = SPIN_LOCK_INITIAL_VALUE;
+static boot_stage boot_stages[MAX_BOOT_STAGES];
+static int num_boot_stages;
+
+void ktrace_boot_stage_etc(uint64_t ts, const char* name) {
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&boot_stage_lock, state);
+    if (num_boot_stages < MAX_BOOT_STAGES) {
+        boot_stages[num_boot_stages].ts = ts;
+        strlcpy(boot_stages[num_boot_stages].name, name, sizeof(boot_stages[0].name));
+        num_boot_stages++;
+    }
+    // like names, boot stages live in the metadata area, which is never
+    // overwritten by the records that follow
+    if (KTRACE_STATE.buffer != nullptr) {
+        ktrace_name_etc(TAG_BOOT_STAGE, (uint32_t)ts, (uint32_t)(ts >> 32), name, true);
+    }
+    spin_unlock_irqrestore(&boot_stage_lock, state);
+}
+
+void ktrace_boot_stage(const char* name) {
+    uint64_t ts = ktrace_timestamp();
+    ktrace_boot_stage_etc(ts, name);
+}
+
+// must hold boot_stage_lock
+static void ktrace_report_boot_stages_locked(void) {
+    for (int i = 0; i < num_boot_stages; i++) {
+        ktrace_name_etc(TAG_BOOT_STAGE, (uint32_t)boot_stages[i].ts,
+                        (uint32_t)(boot_stages[i].ts >> 32), boot_stages[i].name, true);
+    }
+}
+
+static void ktrace_report_boot_stages(void) {
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&boot_stage_lock, state);
+    ktrace_report_boot_stages_locked();
+    spin_unlock_irqrestore(&boot_stage_lock, state);
+}
+
 int trace_not_ready = 0;
 
 void ktrace_init(unsigned level) {
@@ -193,6 +377,7 @@ void ktrace_init(unsigned level) {
 
     uint32_t mb = cmdline_get_uint32("ktrace.bufsize", KTRACE_DEFAULT_BUFSIZE);
     uint32_t grpmask = cmdline_get_uint32("ktrace.grpmask", KTRACE_DEFAULT_GRPMASK);
+    ks->circular = cmdline_get_bool("ktrace.circular", false);
 
     if (mb == 0) {
         dprintf(INFO, "ktrace: disabled\n");
@@ -201,58 +386,110 @@ void ktrace_init(unsigned level) {
 
     mb *= (1024*1024);
 
+    // a sixteenth of the buffer holds the metadata, the rest is
+    // split between the cpus
+    ks->num_cpus = arch_max_num_cpus();
+    uint32_t meta = ROUNDUP(mb / 16, KTRACE_BLOCKSIZE);
+    uint32_t per_cpu = (mb - meta) / ks->num_cpus;
+    ks->cpu_bufsize = KTRACE_BLOCKSIZE;
+    while (ks->cpu_bufsize * 2 <= per_cpu) {
+        ks->cpu_bufsize *= 2;
+    }
+    size_t size = meta + static_cast<size_t>(ks->cpu_bufsize) * ks->num_cpus;
+
+    // This runs in parallel with the rest of boot, so the buffer is only
+    // published once it is ready for names to be written to it.
+    uint8_t* buffer;
     status_t status;
     VmAspace* aspace = VmAspace::kernel_aspace();
-    if ((status = aspace->Alloc("ktrace", mb, (void**)&ks->buffer, 0, VMM_FLAG_COMMIT,
+    if ((status = aspace->Alloc("ktrace", size, (void**)&buffer, 0, VMM_FLAG_COMMIT,
                                 ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE)) < 0) {
         dprintf(INFO, "ktrace: cannot alloc buffer %d\n", status);
         return;
     }
 
-    // The last packet written can overhang the end of the buffer,
-    // so we reduce the reported size by the max size of a record
-    ks->bufsize = mb - 256;
-
-    dprintf(INFO, "ktrace: buffer at %p (%u bytes)\n", ks->buffer, mb);
-
-    // register all static probes
-    ktrace_probe_info_t *probe;
-    mutex_acquire(&probe_list_lock);
-    for (probe = __start_ktrace_probe; probe != __stop_ktrace_probe; probe++) {
-        ktrace_add_probe(probe);
+    for (uint i = 0; i < ks->num_cpus; i++) {
+        ks->cpu[i].buffer = buffer + meta + static_cast<size_t>(ks->cpu_bufsize) * i;
     }
-    mutex_release(&probe_list_lock);
+
+    dprintf(INFO, "ktrace: buffer at %p (%zu bytes, %u per cpu%s)\n", buffer, size,
+            ks->cpu_bufsize, ks->circular ? ", circular" : "");
 
     // write metadata to the first two event slots
     uint64_t n = ktrace_ticks_per_ms();
-    ktrace_rec_32b_t* rec = (ktrace_rec_32b_t*) ks->buffer;
+    ktrace_rec_32b_t* rec = (ktrace_rec_32b_t*) buffer;
     rec[0].tag = TAG_VERSION;
     rec[0].a = KTRACE_VERSION;
     rec[1].tag = TAG_TICKS_PER_MS;
     rec[1].a = (uint32_t)n;
     rec[1].b = (uint32_t)(n >> 32);
 
-    // enable tracing
+    // register all static probes, and hold off new probes and boot stages
+    // until their names can go straight into the buffer
+    ktrace_probe_info_t *probe;
+    mutex_acquire(&probe_list_lock);
+    for (probe = __start_ktrace_probe; probe != __stop_ktrace_probe; probe++) {
+        ktrace_add_probe(probe);
+    }
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&boot_stage_lock, state);
+
+    // The last name written can overhang the end of the metadata,
+    // so we reduce the reported size by the max size of a record
     atomic_store(&ks->offset, KTRACE_RECSIZE * 2);
+    ks->bufsize = meta - 256;
+    __atomic_store_n(&ks->buffer, buffer, __ATOMIC_RELEASE);
+
     ktrace_report_syscalls(kt_syscall_info);
-    ktrace_report_probes();
+    ktrace_report_probes_locked();
+    ktrace_report_boot_stages_locked();
+    spin_unlock_irqrestore(&boot_stage_lock, state);
+    mutex_release(&probe_list_lock);
+
+    // enable tracing
     atomic_store(&ks->grpmask, KTRACE_GRP_TO_MASK(grpmask));
 
     // report names of existing threads
     ktrace_report_live_threads();
 }
 
+// Reserve len bytes in the current cpu's buffer. Returns nullptr, and stops
+// tracing, once a non circular buffer is full.
+static void* ktrace_reserve(ktrace_state_t* ks, uint32_t len) {
+    // Being moved to another cpu after picking this one is harmless, the
+    // offsets are atomic and the record just lands in the other cpu's time line.
+    ktrace_cpu_t* cpu = &ks->cpu[arch_curr_cpu_num()];
+    for (;;) {
+        uint64_t off = __atomic_fetch_add(&cpu->offset, len, __ATOMIC_RELAXED);
+        if (!ks->circular && off >= ks->cpu_bufsize) {
+            // if we arrive at the end, stop
+            atomic_store(&ks->grpmask, 0);
+            return nullptr;
+        }
+
+        uint32_t pos = static_cast<uint32_t>(off & (ks->cpu_bufsize - 1));
+        uint32_t room = KTRACE_BLOCKSIZE - (pos & (KTRACE_BLOCKSIZE - 1));
+        if (len <= room) {
+            return cpu->buffer + pos;
+        }
+
+        // The record would straddle a block. Pad out both the end of this
+        // block and our part of the next one, then try again.
+        *reinterpret_cast<uint32_t*>(cpu->buffer + pos) = TAG_PAD(room);
+        pos = static_cast<uint32_t>((off + room) & (ks->cpu_bufsize - 1));
+        if (ks->circular || off + room < ks->cpu_bufsize) {
+            *reinterpret_cast<uint32_t*>(cpu->buffer + pos) = TAG_PAD(len - room);
+        }
+    }
+}
+
 void ktrace_tiny(uint32_t tag, uint32_t arg) {
     uint64_t ts = ktrace_timestamp();
     ktrace_state_t* ks = &KTRACE_STATE;
     if (tag & atomic_load(&ks->grpmask)) {
         tag = (tag & 0xFFFFFFF0) | 2;
-        int off;
-        if ((off = atomic_add(&ks->offset, KTRACE_HDRSIZE)) >= (int)ks->bufsize) {
-            // if we arrive at the end, stop
-            atomic_store(&ks->grpmask, 0);
-        } else {
-            ktrace_header_t* hdr = (ktrace_header_t*) (ks->buffer + off);
+        ktrace_header_t* hdr = (ktrace_header_t*) ktrace_reserve(ks, KTRACE_HDRSIZE);
+        if (hdr) {
             hdr->ts = ts;
             hdr->tag = tag;
             hdr->tid = arg;
@@ -267,14 +504,11 @@ void* ktrace_open(uint32_t tag) {
         return nullptr;
     }
 
-    int off;
-    if ((off = atomic_add(&ks->offset, KTRACE_LEN(tag))) >= (int)ks->bufsize) {
-        // if we arrive at the end, stop
-        atomic_store(&ks->grpmask, 0);
+    ktrace_header_t* hdr = (ktrace_header_t*) ktrace_reserve(ks, KTRACE_LEN(tag));
+    if (!hdr) {
         return nullptr;
     }
 
-    ktrace_header_t* hdr = (ktrace_header_t*) (ks->buffer + off);
     hdr->ts = ts;
     hdr->tag = tag;
     hdr->tid = (uint32_t)get_current_thread()->user_tid;
@@ -289,11 +523,10 @@ static void ktrace_name_etc(uint32_t tag, uint32_t id, uint32_t arg, const char*
         // set size to: sizeof(hdr) + len + 1, round up to multiple of 8
         tag = (tag & 0xFFFFFFF0) | ((KTRACE_NAMESIZE + len + 1 + 7) >> 3);
 
+        // names go in the metadata area, which is never overwritten, and
+        // once it is full later names are dropped without stopping the trace
         int off;
-        if ((off = atomic_add(&ks->offset, KTRACE_LEN(tag))) >= (int)ks->bufsize) {
-            // if we arrive at the end, stop
-            atomic_store(&ks->grpmask, 0);
-        } else {
+        if ((off = atomic_add(&ks->offset, KTRACE_LEN(tag))) < (int)ks->bufsize) {
             ktrace_rec_name_t* rec = (ktrace_rec_name_t*) (ks->buffer + off);
             rec->tag = tag;
             rec->id = id;
@@ -308,4 +541,6 @@ void ktrace_name(uint32_t tag, uint32_t id, uint32_t arg, const char* name) {
     ktrace_name_etc(tag, id, arg, name, false);
 }
 
-LK_INIT_HOOK(ktrace, ktrace_init, LK_INIT_LEVEL_APPS - 1);
+// Committing the buffer takes a while, and nothing waits for tracing to
+// start, so the rest of boot carries on while it happens.
+LK_INIT_HOOK_ASYNC(ktrace, ktrace_init, LK_INIT_LEVEL_APPS - 1, LK_INIT_LEVEL_LAST);
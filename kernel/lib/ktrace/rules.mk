@@ -9,6 +9,7 @@ LOCAL_DIR := $(GET_LOCAL_DIR)
 MODULE := $(LOCAL_DIR)
 
 MODULE_SRCS += \
-	$(LOCAL_DIR)/ktrace.cpp
+	$(LOCAL_DIR)/ktrace.cpp \
+	$(LOCAL_DIR)/sample.cpp
 
 include make/module.mk
@@ -0,0 +1,120 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <err.h>
+#include <string.h>
+
+#include <arch/ops.h>
+#include <kernel/mp.h>
+#include <kernel/mutex.h>
+#include <kernel/thread.h>
+#include <kernel/timer.h>
+#include <lib/ktrace.h>
+#include <magenta/thread_annotations.h>
+
+// Sampling takes a periodic timer on every cpu; x86 performance counter
+// overflows can sample too. Each sample records what the interrupt
+// interrupted: the pc, and if that was in the kernel, the
+// callers found by following frame pointers up the thread's kernel stack.
+//
+// User stacks aren't walked, since reading user memory from an interrupt
+// handler could fault.
+
+#define KTRACE_SAMPLE_MIN_PERIOD_US 100
+
+static timer_t sample_timers[SMP_MAX_CPUS];
+
+static mutex_t sample_lock = MUTEX_INITIAL_VALUE(sample_lock);
+static bool sampling TA_GUARDED(sample_lock);
+
+static size_t ktrace_sample_kernel_stack(uintptr_t fp, uint64_t* pcs, size_t max) {
+    thread_t* t = get_current_thread();
+    uintptr_t lo = reinterpret_cast<uintptr_t>(t->stack);
+    uintptr_t hi = lo + t->stack_size;
+    size_t n = 0;
+    while (n < max && fp >= lo && fp <= hi - 2 * sizeof(uintptr_t) &&
+           (fp & (sizeof(uintptr_t) - 1)) == 0) {
+        const uintptr_t* frame = reinterpret_cast<const uintptr_t*>(fp);
+        if (frame[1] == 0) {
+            break;
+        }
+        pcs[n++] = frame[1];
+        // frames only ever get older going up the stack
+        if (frame[0] <= fp) {
+            break;
+        }
+        fp = frame[0];
+    }
+    return n;
+}
+
+void ktrace_sample_irq(void) {
+    uintptr_t pc, fp;
+    bool user;
+    if (!arch_irq_frame(&pc, &fp, &user)) {
+        return;
+    }
+
+    uint64_t pcs[KTRACE_SAMPLE_MAX_FRAMES];
+    size_t n = 0;
+    pcs[n++] = pc;
+    if (!user && fp != 0) {
+        n += ktrace_sample_kernel_stack(fp, pcs + n, KTRACE_SAMPLE_MAX_FRAMES - n);
+    }
+
+    uint32_t* rec = static_cast<uint32_t*>(ktrace_open(TAG_SAMPLE(n)));
+    if (rec != nullptr) {
+        rec[0] = static_cast<uint32_t>(get_current_thread()->user_pid);
+        rec[1] = arch_curr_cpu_num() | (user ? KTRACE_SAMPLE_FLAG_USER : 0);
+        memcpy(rec + 2, pcs, n * sizeof(pcs[0]));
+    }
+}
+
+static enum handler_return ktrace_sample_tick(timer_t* timer, lk_time_t now, void* arg) {
+    ktrace_sample_irq();
+    return INT_NO_RESCHEDULE;
+}
+
+static void ktrace_sample_start_task(void* context) {
+    lk_time_t period = *static_cast<lk_time_t*>(context);
+    timer_set_periodic(&sample_timers[arch_curr_cpu_num()], period,
+                       ktrace_sample_tick, nullptr);
+}
+
+static void ktrace_sample_stop_locked() TA_REQ(sample_lock) {
+    if (sampling) {
+        for (uint i = 0; i < arch_max_num_cpus(); i++) {
+            timer_cancel(&sample_timers[i]);
+        }
+        sampling = false;
+    }
+}
+
+status_t ktrace_sample_start(uint32_t period_us) {
+    if (period_us == 0) {
+        period_us = 1000;
+    }
+    if (period_us < KTRACE_SAMPLE_MIN_PERIOD_US) {
+        return ERR_INVALID_ARGS;
+    }
+    lk_time_t period = LK_USEC(period_us);
+
+    mutex_acquire(&sample_lock);
+    ktrace_sample_stop_locked();
+    for (uint i = 0; i < arch_max_num_cpus(); i++) {
+        timer_initialize(&sample_timers[i]);
+    }
+    mp_sync_exec(MP_CPU_ALL, ktrace_sample_start_task, &period);
+    sampling = true;
+    mutex_release(&sample_lock);
+    return NO_ERROR;
+}
+
+void ktrace_sample_stop(void) {
+    mutex_acquire(&sample_lock);
+    ktrace_sample_stop_locked();
+    mutex_release(&sample_lock);
+}
@@ -0,0 +1,103 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <assert.h>
+#include <err.h>
+#include <new.h>
+#include <stdio.h>
+#include <arch/ops.h>
+#include <kernel/auto_lock.h>
+#include <kernel/event.h>
+#include <kernel/spinlock.h>
+#include <kernel/thread.h>
+#include <lk/init.h>
+#include <magenta/aspace_reaper.h>
+#include <mxtl/intrusive_double_list.h>
+#include <mxtl/unique_ptr.h>
+#include <trace.h>
+
+#define LOCAL_TRACE 0
+
+// Dead processes' address spaces are torn down by a thread per cpu, so that
+// the exiting thread can signal MX_TASK_TERMINATED without first unmapping
+// and freeing all of the process's memory. Once none of the process's threads
+// are running any more, the aspace is active on no cpu and unmapping it needs
+// no TLB shootdowns.
+namespace {
+
+struct ReapRequest : public mxtl::DoublyLinkedListable<mxtl::unique_ptr<ReapRequest>> {
+    mxtl::RefPtr<VmAspace> aspace;
+};
+
+struct Reaper {
+    SpinLock lock;
+    mxtl::DoublyLinkedList<mxtl::unique_ptr<ReapRequest>> requests; // protected by |lock|
+    event_t event;
+};
+
+Reaper reapers[SMP_MAX_CPUS];
+
+int ReaperRoutine(void* arg) {
+    Reaper* reaper = static_cast<Reaper*>(arg);
+    for (;;) {
+        event_wait(&reaper->event);
+
+        for (;;) {
+            mxtl::unique_ptr<ReapRequest> request;
+            {
+                AutoSpinLockIrqSave lock(reaper->lock);
+                request = reaper->requests.pop_front();
+            }
+            if (!request)
+                break;
+
+            LTRACEF("Reaping aspace %p '%s'\n", request->aspace.get(), request->aspace->name());
+            __UNUSED status_t status = request->aspace->Destroy();
+            DEBUG_ASSERT(status == NO_ERROR);
+        }
+    }
+    return 0;
+}
+
+void ReaperInit(uint level) {
+    for (uint cpu = 0; cpu < arch_max_num_cpus(); ++cpu) {
+        Reaper& reaper = reapers[cpu];
+        event_init(&reaper.event, false, EVENT_FLAG_AUTOUNSIGNAL);
+
+        char name[THREAD_NAME_LENGTH];
+        snprintf(name, sizeof(name), "aspace reaper %u", cpu);
+        thread_t* t = thread_create(name, ReaperRoutine, &reaper,
+                                    DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+        if (t == nullptr)
+            panic("unable to create aspace reaper thread\n");
+        thread_set_pinned_cpu(t, cpu);
+        thread_detach_and_resume(t);
+    }
+}
+
+}  // namespace
+
+void ReapAspace(mxtl::RefPtr<VmAspace> aspace) {
+    LTRACE_ENTRY;
+    AllocChecker ac;
+    mxtl::unique_ptr<ReapRequest> request(new (&ac) ReapRequest);
+    if (!ac.check()) {
+        __UNUSED status_t status = aspace->Destroy();
+        DEBUG_ASSERT(status == NO_ERROR);
+        return;
+    }
+    request->aspace = mxtl::move(aspace);
+
+    // The queue of the cpu we are on is always served by an online cpu.
+    Reaper& reaper = reapers[arch_curr_cpu_num()];
+    {
+        AutoSpinLockIrqSave lock(reaper.lock);
+        reaper.requests.push_back(mxtl::move(request));
+    }
+    event_signal(&reaper.event, false);
+}
+
+LK_INIT_HOOK(aspace_reaper, ReaperInit, LK_INIT_LEVEL_THREADING);
@@ -14,9 +14,11 @@
 #include <trace.h>
 
 #include <kernel/event.h>
+#include <kernel/thread.h>
 #include <platform.h>
 
 #include <magenta/handle.h>
+#include <magenta/magenta.h>
 #include <magenta/message_packet.h>
 #include <magenta/port_client.h>
 #include <magenta/process_dispatcher.h>
@@ -28,18 +30,22 @@
 
 constexpr mx_rights_t kDefaultChannelRights = MX_RIGHT_TRANSFER | MX_RIGHT_READ | MX_RIGHT_WRITE;
 
+DECLARE_STATIC_SLAB_ALLOCATOR_STORAGE(ChannelDispatcherAllocatorTraits,
+                                      MaxObjectSlabs<ChannelDispatcherAllocatorTraits>());
+
 // static
 status_t ChannelDispatcher::Create(uint32_t flags,
                                    mxtl::RefPtr<Dispatcher>* dispatcher0,
                                    mxtl::RefPtr<Dispatcher>* dispatcher1,
                                    mx_rights_t* rights) {
-    AllocChecker ac;
-    auto ch0 = mxtl::AdoptRef(new (&ac) ChannelDispatcher(flags));
-    if (!ac.check())
+    using Allocator = mxtl::SlabAllocator<ChannelDispatcherAllocatorTraits>;
+
+    auto ch0 = Allocator::New(flags);
+    if (!ch0)
         return ERR_NO_MEMORY;
 
-    auto ch1 = mxtl::AdoptRef(new (&ac) ChannelDispatcher(flags));
-    if (!ac.check())
+    auto ch1 = Allocator::New(flags);
+    if (!ch1)
         return ERR_NO_MEMORY;
 
     ch0->Init(ch1);
@@ -52,7 +58,7 @@ status_t ChannelDispatcher::Create(uint32_t flags,
 }
 
 ChannelDispatcher::ChannelDispatcher(uint32_t flags)
-    : state_tracker_(MX_CHANNEL_WRITABLE) {
+    : lock_("ChannelDispatcher::lock_"), state_tracker_(MX_CHANNEL_WRITABLE) {
     DEBUG_ASSERT(flags == 0);
 }
 
@@ -168,6 +174,40 @@ status_t ChannelDispatcher::Read(uint32_t* msg_size,
     return rv;
 }
 
+status_t ChannelDispatcher::ReadMany(mx_channel_msg_t* slots, uint32_t count,
+                                     MessageList* msgs) {
+    canary_.Assert();
+
+    AutoLock lock(&lock_);
+
+    if (messages_.is_empty())
+        return other_ ? ERR_SHOULD_WAIT : ERR_PEER_CLOSED;
+
+    uint32_t read = 0;
+    while (read < count && !messages_.is_empty()) {
+        mx_channel_msg_t* slot = &slots[read];
+        const MessagePacket& next = messages_.front();
+
+        bool fits = next.data_size() <= slot->num_bytes &&
+                    next.num_handles() <= slot->num_handles;
+        slot->num_bytes = next.data_size();
+        slot->num_handles = next.num_handles();
+        if (!fits) {
+            slot->status = ERR_BUFFER_TOO_SMALL;
+            break;
+        }
+
+        slot->status = NO_ERROR;
+        msgs->push_back(messages_.pop_front());
+        read++;
+    }
+
+    if (messages_.is_empty())
+        state_tracker_.UpdateState(MX_CHANNEL_READABLE, 0u);
+
+    return read ? NO_ERROR : ERR_BUFFER_TOO_SMALL;
+}
+
 status_t ChannelDispatcher::Write(mxtl::unique_ptr<MessagePacket> msg) {
     canary_.Assert();
 
@@ -189,6 +229,26 @@ status_t ChannelDispatcher::Write(mxtl::unique_ptr<MessagePacket> msg) {
     return NO_ERROR;
 }
 
+status_t ChannelDispatcher::WriteMany(MessageList* msgs) {
+    canary_.Assert();
+
+    mxtl::RefPtr<ChannelDispatcher> other;
+    {
+        AutoLock lock(&lock_);
+        if (!other_) {
+            for (auto& msg : *msgs)
+                msg.set_owns_handles(false);
+            return ERR_PEER_CLOSED;
+        }
+        other = other_;
+    }
+
+    if (other->WriteSelfMany(msgs) > 0)
+        thread_preempt(false);
+
+    return NO_ERROR;
+}
+
 status_t ChannelDispatcher::Call(mxtl::unique_ptr<MessagePacket> msg,
                                  mx_time_t deadline, bool* return_handles,
                                  mxtl::unique_ptr<MessagePacket>* reply) {
@@ -220,8 +280,12 @@ status_t ChannelDispatcher::Call(mxtl::unique_ptr<MessagePacket> msg,
         waiters_.push_back(waiter);
     }
 
-    // (1) Write outbound message to opposing endpoint.
+    // (1) Write outbound message to opposing endpoint. A server blocked
+    // waiting on it gets this cpu and the rest of our time slice once we
+    // block for the reply.
+    thread_handoff_arm();
     other->WriteSelf(mxtl::move(msg));
+    thread_handoff_disarm();
 
     // Reuse the code from the half-call used for retrying a Call after thread
     // suspend.
@@ -268,6 +332,20 @@ int ChannelDispatcher::WriteSelf(mxtl::unique_ptr<MessagePacket> msg) {
     canary_.Assert();
 
     AutoLock lock(&lock_);
+    return WriteSelfLocked(mxtl::move(msg));
+}
+
+int ChannelDispatcher::WriteSelfMany(MessageList* msgs) {
+    canary_.Assert();
+
+    int woken = 0;
+    AutoLock lock(&lock_);
+    while (!msgs->is_empty())
+        woken += WriteSelfLocked(msgs->pop_front());
+    return woken;
+}
+
+int ChannelDispatcher::WriteSelfLocked(mxtl::unique_ptr<MessagePacket> msg) {
     auto size = msg->data_size();
 
     if (!waiters_.is_empty()) {
@@ -280,8 +358,12 @@ int ChannelDispatcher::WriteSelf(mxtl::unique_ptr<MessagePacket> msg) {
             // Remove waiter from list.
             if (waiter.get_txid() == txid) {
                 waiters_.erase(waiter);
+                // Hand the cpu straight back to the caller, see Call().
+                thread_handoff_arm();
                 // we return how many threads have been woken up, or zero.
-                return waiter.Deliver(mxtl::move(msg));
+                int woken = waiter.Deliver(mxtl::move(msg));
+                thread_handoff_disarm();
+                return woken;
             }
         }
     }
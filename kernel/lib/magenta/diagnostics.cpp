@@ -13,9 +13,14 @@
 #include <kernel/auto_lock.h>
 #include <lib/console.h>
 
+#include <magenta/channel_dispatcher.h>
+#include <magenta/event_dispatcher.h>
+#include <magenta/event_pair_dispatcher.h>
 #include <magenta/job_dispatcher.h>
 #include <magenta/magenta.h>
+#include <magenta/port_dispatcher_v2.h>
 #include <magenta/process_dispatcher.h>
+#include <magenta/user_thread.h>
 
 // Machinery to walk over a job tree and run a callback on each process.
 template <typename ProcessCallbackType>
@@ -348,6 +353,8 @@ public:
                 arch_mmu_flags_to_vm_flags(map->arch_mmu_flags());
             u->committed_pages = map->vmo()->AllocatedPagesInRange(
                 map->object_offset(), map->size());
+            u->shared_pages = map->vmo()->SharedPagesInRange(
+                map->object_offset(), map->size());
             if (maps_.copy_array_to_user(&entry, 1, nelem_) != NO_ERROR) {
                 return false;
             }
@@ -422,6 +429,26 @@ static void DumpAddressSpace(const cmd_args* arg) {
     }
 }
 
+template <typename AllocatorTraits>
+static void DumpSlabAllocator(const char* name) {
+    using Allocator = mxtl::SlabAllocator<AllocatorTraits>;
+    printf("%-16s %8zu %8zu %8zu %8zu %8zu %10zu\n", name,
+           sizeof(typename Allocator::ObjType), Allocator::AllocsPerSlab,
+           Allocator::obj_count(), Allocator::max_obj_count(), Allocator::slab_count(),
+           Allocator::slab_count() * AllocatorTraits::SLAB_SIZE / 1024);
+}
+
+// Dumps the occupancy of the slab pools of the kernel objects that have one.
+static void DumpSlabAllocators() {
+    printf("%-16s %8s %8s %8s %8s %8s %10s\n",
+           "type", "size", "per-slab", "in-use", "peak", "slabs", "memory(K)");
+    DumpSlabAllocator<ChannelDispatcherAllocatorTraits>("channel");
+    DumpSlabAllocator<EventDispatcherAllocatorTraits>("event");
+    DumpSlabAllocator<EventPairDispatcherAllocatorTraits>("event-pair");
+    DumpSlabAllocator<PortObserverAllocatorTraits>("port-observer");
+    DumpSlabAllocator<UserThreadAllocatorTraits>("user-thread");
+}
+
 static size_t mwd_limit = 32 * 256;
 static bool mwd_running;
 
@@ -459,6 +486,7 @@ static int cmd_diagnostics(int argc, const cmd_args* argv, uint32_t flags) {
         printf("%s asd  <pid>|kernel : dump process/kernel address space\n",
                argv[0].str);
         printf("%s htinfo            : handle table info\n", argv[0].str);
+        printf("%s slabs             : kernel object slab pool usage\n", argv[0].str);
         return -1;
     }
 
@@ -499,6 +527,10 @@ static int cmd_diagnostics(int argc, const cmd_args* argv, uint32_t flags) {
         if (argc != 2)
             goto usage;
         internal::DumpHandleTableInfo();
+    } else if (strcmp(argv[1].str, "slabs") == 0) {
+        if (argc != 2)
+            goto usage;
+        DumpSlabAllocators();
     } else {
         printf("unrecognized subcommand '%s'\n", argv[1].str);
         goto usage;
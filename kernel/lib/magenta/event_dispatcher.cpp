@@ -9,6 +9,7 @@
 #include <err.h>
 #include <new.h>
 
+#include <magenta/magenta.h>
 #include <magenta/state_tracker.h>
 
 constexpr mx_rights_t kDefaultEventRights =
@@ -16,15 +17,17 @@ constexpr mx_rights_t kDefaultEventRights =
 
 constexpr uint32_t kUserSignalMask = MX_EVENT_SIGNALED | MX_USER_SIGNAL_ALL;
 
+DECLARE_STATIC_SLAB_ALLOCATOR_STORAGE(EventDispatcherAllocatorTraits,
+                                      MaxObjectSlabs<EventDispatcherAllocatorTraits>());
+
 status_t EventDispatcher::Create(uint32_t options, mxtl::RefPtr<Dispatcher>* dispatcher,
                                  mx_rights_t* rights) {
-    AllocChecker ac;
-    auto disp = new (&ac) EventDispatcher(options);
-    if (!ac.check())
+    auto disp = mxtl::SlabAllocator<EventDispatcherAllocatorTraits>::New(options);
+    if (!disp)
         return ERR_NO_MEMORY;
 
     *rights = kDefaultEventRights;
-    *dispatcher = mxtl::AdoptRef<Dispatcher>(disp);
+    *dispatcher = mxtl::move(disp);
     return NO_ERROR;
 }
 
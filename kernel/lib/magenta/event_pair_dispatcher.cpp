@@ -11,6 +11,7 @@
 #include <new.h>
 
 #include <kernel/auto_lock.h>
+#include <magenta/magenta.h>
 #include <magenta/state_tracker.h>
 
 constexpr mx_rights_t kDefaultEventPairRights =
@@ -18,26 +19,28 @@ constexpr mx_rights_t kDefaultEventPairRights =
 
 constexpr uint32_t kUserSignalMask = MX_EVENT_SIGNALED | MX_USER_SIGNAL_ALL;
 
+DECLARE_STATIC_SLAB_ALLOCATOR_STORAGE(EventPairDispatcherAllocatorTraits,
+                                      MaxObjectSlabs<EventPairDispatcherAllocatorTraits>());
+
 status_t EventPairDispatcher::Create(mxtl::RefPtr<Dispatcher>* dispatcher0,
                                      mxtl::RefPtr<Dispatcher>* dispatcher1,
                                      mx_rights_t* rights) {
-    AllocChecker ac;
-    auto disp0 = new (&ac) EventPairDispatcher();
-    if (!ac.check())
+    using Allocator = mxtl::SlabAllocator<EventPairDispatcherAllocatorTraits>;
+
+    auto disp0 = Allocator::New();
+    if (!disp0)
         return ERR_NO_MEMORY;
 
-    auto disp1 = new (&ac) EventPairDispatcher();
-    if (!ac.check()) {
-        delete disp0;
+    auto disp1 = Allocator::New();
+    if (!disp1)
         return ERR_NO_MEMORY;
-    }
 
-    *rights = kDefaultEventPairRights;
-    *dispatcher0 = mxtl::AdoptRef<Dispatcher>(disp0);
-    *dispatcher1 = mxtl::AdoptRef<Dispatcher>(disp1);
+    disp0->Init(disp1.get());
+    disp1->Init(disp0.get());
 
-    disp0->Init(disp1);
-    disp1->Init(disp0);
+    *rights = kDefaultEventPairRights;
+    *dispatcher0 = mxtl::move(disp0);
+    *dispatcher1 = mxtl::move(disp1);
 
     return NO_ERROR;
 }
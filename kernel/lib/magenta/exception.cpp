@@ -86,6 +86,28 @@ static status_t try_debugger_exception_handler(UserThread* thread,
                                  thread, report, arch_context, estatus);
 }
 
+static status_t try_upcall_return_handler(UserThread* thread,
+                                          const mx_exception_report_t* report,
+                                          const arch_exception_context_t* arch_context,
+                                          UserThread::ExceptionStatus* estatus) {
+    LTRACE_ENTRY;
+    if (!thread->FinishExceptionUpcall(report, arch_context))
+        return ERR_NOT_FOUND;
+    *estatus = UserThread::ExceptionStatus::RESUME;
+    return NO_ERROR;
+}
+
+static status_t try_upcall_exception_handler(UserThread* thread,
+                                             const mx_exception_report_t* report,
+                                             const arch_exception_context_t* arch_context,
+                                             UserThread::ExceptionStatus* estatus) {
+    LTRACE_ENTRY;
+    if (!thread->StartExceptionUpcall(report, arch_context))
+        return ERR_NOT_FOUND;
+    *estatus = UserThread::ExceptionStatus::RESUME;
+    return NO_ERROR;
+}
+
 static status_t try_thread_exception_handler(UserThread* thread,
                                              const mx_exception_report_t* report,
                                              const arch_exception_context_t* arch_context,
@@ -143,8 +165,12 @@ status_t magenta_exception_handler(uint exception_type,
                                const arch_exception_context_t* arch_context,
                                UserThread::ExceptionStatus* estatus);
 
+    // An in-thread handler returning isn't a real exception, so debuggers
+    // don't get to see it.
     static Handler* const handlers[] = {
+        try_upcall_return_handler,
         try_debugger_exception_handler,
+        try_upcall_exception_handler,
         try_thread_exception_handler,
         try_process_exception_handler,
         try_system_exception_handler
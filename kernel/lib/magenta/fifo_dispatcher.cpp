@@ -5,6 +5,7 @@
 // https://opensource.org/licenses/MIT
 
 #include <new.h>
+#include <stddef.h>
 #include <string.h>
 
 #include <kernel/auto_lock.h>
@@ -12,6 +13,7 @@
 #include <magenta/fifo_dispatcher.h>
 #include <magenta/handle.h>
 
+#include <mxtl/algorithm.h>
 
 constexpr mx_rights_t kDefaultFifoRights =
     MX_RIGHT_TRANSFER | MX_RIGHT_DUPLICATE | MX_RIGHT_READ | MX_RIGHT_WRITE;
@@ -50,10 +52,11 @@ status_t FifoDispatcher::Create(uint32_t count, uint32_t elemsize, uint32_t opti
     return NO_ERROR;
 }
 
-FifoDispatcher::FifoDispatcher(uint32_t count, uint32_t elem_size, uint32_t /*options*/)
+FifoDispatcher::FifoDispatcher(uint32_t count, uint32_t elem_size, uint32_t options)
     : elem_count_(count), elem_size_(elem_size), mask_(count - 1),
+      shared_((options & MX_FIFO_SHARED_RING) != 0u),
       peer_koid_(0u), state_tracker_(MX_FIFO_WRITABLE),
-      head_(0u), tail_(0u) {
+      head_(0u), tail_(0u), data_(nullptr) {
 }
 
 FifoDispatcher::~FifoDispatcher() {
@@ -65,11 +68,84 @@ FifoDispatcher::~FifoDispatcher() {
 mx_status_t FifoDispatcher::Init(mxtl::RefPtr<FifoDispatcher> other) TA_NO_THREAD_SAFETY_ANALYSIS {
     other_ = mxtl::move(other);
     peer_koid_ = other_->get_koid();
+
+    if (shared_) {
+        mx_fifo_ring_t header = {};
+        header.elem_count = elem_count_;
+        header.elem_size = elem_size_;
+        return ring_.Init(&header, sizeof(header), MX_FIFO_RING_DATA_OFFSET,
+                          elem_count_ * elem_size_);
+    }
+
     if ((data_ = (uint8_t*) calloc(elem_count_, elem_size_)) == nullptr)
         return ERR_NO_MEMORY;
     return NO_ERROR;
 }
 
+void FifoDispatcher::LoadLocked() {
+    if (!shared_)
+        return;
+
+    // User space can write anything here or even shrink the VMO; all that is
+    // needed is to never believe more than |elem_count_| entries are queued.
+    uint32_t head = ring_.LoadIndex<uint32_t>(offsetof(mx_fifo_ring_t, head));
+    uint32_t tail = ring_.LoadIndex<uint32_t>(offsetof(mx_fifo_ring_t, tail));
+    if (head - tail > elem_count_)
+        tail = head - elem_count_;
+    head_ = head;
+    tail_ = tail;
+}
+
+void FifoDispatcher::StoreIndexLocked(size_t field_offset, uint32_t index) {
+    if (!shared_)
+        return;
+
+    ring_.StoreIndex(field_offset, index);
+}
+
+mx_status_t FifoDispatcher::CopyIn(const uint8_t* ptr, uint32_t offset, size_t len,
+                                   fifo_copy_from_fn_t copy_from_fn) {
+    if (!shared_)
+        return copy_from_fn(ptr, data_ + offset, len);
+
+    // Bounce through the stack, the ring has no kernel mapping.
+    uint8_t buf[128];
+    while (len > 0) {
+        size_t chunk = mxtl::min(len, sizeof(buf));
+        mx_status_t status = copy_from_fn(ptr, buf, chunk);
+        if (status != NO_ERROR)
+            return status;
+        status = ring_.Write(offset, buf, chunk);
+        if (status != NO_ERROR)
+            return status;
+        ptr += chunk;
+        offset += static_cast<uint32_t>(chunk);
+        len -= chunk;
+    }
+    return NO_ERROR;
+}
+
+mx_status_t FifoDispatcher::CopyOut(uint8_t* ptr, uint32_t offset, size_t len,
+                                    fifo_copy_to_fn_t copy_to_fn) {
+    if (!shared_)
+        return copy_to_fn(ptr, data_ + offset, len);
+
+    uint8_t buf[128];
+    while (len > 0) {
+        size_t chunk = mxtl::min(len, sizeof(buf));
+        mx_status_t status = ring_.Read(offset, buf, chunk);
+        if (status != NO_ERROR)
+            return status;
+        status = copy_to_fn(ptr, buf, chunk);
+        if (status != NO_ERROR)
+            return status;
+        ptr += chunk;
+        offset += static_cast<uint32_t>(chunk);
+        len -= chunk;
+    }
+    return NO_ERROR;
+}
+
 void FifoDispatcher::on_zero_handles() {
     canary_.Assert();
 
@@ -145,6 +221,7 @@ mx_status_t FifoDispatcher::WriteSelf(const uint8_t* ptr, size_t bytelen, uint32
 
     AutoLock lock(&lock_);
 
+    LoadLocked();
     uint32_t old_head = head_;
 
     // total number of available empty slots in the fifo
@@ -167,7 +244,8 @@ mx_status_t FifoDispatcher::WriteSelf(const uint8_t* ptr, size_t bytelen, uint32
         // number of slots we can actually copy
         size_t to_copy = (count > n) ? n : count;
 
-        mx_status_t status = copy_from_fn(ptr, data_ + offset * elem_size_, to_copy * elem_size_);
+        mx_status_t status = CopyIn(ptr, offset * elem_size_, to_copy * elem_size_,
+                                    copy_from_fn);
         if (status != NO_ERROR) {
             // roll back, in case this is the second copy
             head_ = old_head;
@@ -181,6 +259,8 @@ mx_status_t FifoDispatcher::WriteSelf(const uint8_t* ptr, size_t bytelen, uint32
         ptr += to_copy * elem_size_;
     }
 
+    StoreIndexLocked(offsetof(mx_fifo_ring_t, head), head_);
+
     // if was empty, we've become readable
     if (was_empty)
         state_tracker_.UpdateState(0u, MX_FIFO_READABLE);
@@ -203,6 +283,7 @@ mx_status_t FifoDispatcher::Read(uint8_t* ptr, size_t bytelen, uint32_t* actual,
 
     AutoLock lock(&lock_);
 
+    LoadLocked();
     uint32_t old_tail = tail_;
 
     // total number of available entries to read from the fifo
@@ -225,7 +306,8 @@ mx_status_t FifoDispatcher::Read(uint8_t* ptr, size_t bytelen, uint32_t* actual,
         // number of slots we can actually copy
         size_t to_copy = (count > n) ? n : count;
 
-        mx_status_t status = copy_to_fn(ptr, data_ + offset * elem_size_, to_copy * elem_size_);
+        mx_status_t status = CopyOut(ptr, offset * elem_size_, to_copy * elem_size_,
+                                     copy_to_fn);
         if (status != NO_ERROR) {
             // roll back, in case this is the second copy
             tail_ = old_tail;
@@ -240,6 +322,8 @@ mx_status_t FifoDispatcher::Read(uint8_t* ptr, size_t bytelen, uint32_t* actual,
 
     }
 
+    StoreIndexLocked(offsetof(mx_fifo_ring_t, tail), tail_);
+
     // if we were full, we have become writable
     if (was_full && other_)
         other_->state_tracker_.UpdateState(0u, MX_FIFO_WRITABLE);
@@ -251,3 +335,70 @@ mx_status_t FifoDispatcher::Read(uint8_t* ptr, size_t bytelen, uint32_t* actual,
     *actual = (tail_ - old_tail);
     return NO_ERROR;
 }
+
+mx_status_t FifoDispatcher::GetRings(mxtl::RefPtr<VmObject>* rx, mxtl::RefPtr<VmObject>* tx) {
+    canary_.Assert();
+
+    if (!shared_)
+        return ERR_NOT_SUPPORTED;
+
+    mxtl::RefPtr<FifoDispatcher> other;
+    {
+        AutoLock lock(&lock_);
+        if (!other_)
+            return ERR_PEER_CLOSED;
+        *rx = ring_.vmo();
+        other = other_;
+    }
+
+    *tx = other->RingVmo();
+    return NO_ERROR;
+}
+
+mxtl::RefPtr<VmObject> FifoDispatcher::RingVmo() {
+    AutoLock lock(&lock_);
+    return ring_.vmo();
+}
+
+mx_status_t FifoDispatcher::RingUpdate() {
+    canary_.Assert();
+
+    if (!shared_)
+        return ERR_NOT_SUPPORTED;
+
+    mxtl::RefPtr<FifoDispatcher> other;
+    {
+        AutoLock lock(&lock_);
+        SyncRingLocked();
+        other = other_;
+    }
+
+    if (other)
+        other->SyncRing();
+    return NO_ERROR;
+}
+
+void FifoDispatcher::SyncRing() {
+    canary_.Assert();
+
+    AutoLock lock(&lock_);
+    SyncRingLocked();
+}
+
+// Recomputes the signals that depend on the ring this end reads from: our
+// READABLE and the peer's WRITABLE.
+void FifoDispatcher::SyncRingLocked() {
+    LoadLocked();
+
+    if (head_ == tail_)
+        state_tracker_.UpdateState(MX_FIFO_READABLE, 0u);
+    else
+        state_tracker_.UpdateState(0u, MX_FIFO_READABLE);
+
+    if (!other_)
+        return;
+    if (head_ - tail_ < elem_count_)
+        other_->state_tracker_.UpdateState(0u, MX_FIFO_WRITABLE);
+    else
+        other_->state_tracker_.UpdateState(MX_FIFO_WRITABLE, 0u);
+}
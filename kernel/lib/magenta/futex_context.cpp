@@ -11,6 +11,7 @@
 #include <magenta/futex_context.h>
 #include <magenta/user_copy.h>
 #include <magenta/user_thread.h>
+#include <mxtl/auto_call.h>
 #include <trace.h>
 
 #define LOCAL_TRACE 0
@@ -24,16 +25,37 @@ FutexContext::~FutexContext() {
 
     // All of the threads should have removed themselves from wait queues
     // by the time the process has exited.
-    DEBUG_ASSERT(futex_table_.is_empty());
+#if LK_DEBUGLEVEL > 0
+    for (auto& bucket : buckets_) {
+        AutoLock lock(&bucket.lock);
+        DEBUG_ASSERT(bucket.futex_table.is_empty());
+    }
+#endif
 }
 
 status_t FutexContext::FutexWait(user_ptr<int> value_ptr, int current_value, mx_time_t deadline) {
     LTRACE_ENTRY;
 
+    return Wait(value_ptr, current_value, nullptr, deadline);
+}
+
+status_t FutexContext::FutexWaitPi(user_ptr<int> value_ptr, int current_value,
+                                   UserThread* owner, mx_time_t deadline) {
+    LTRACE_ENTRY;
+
+    if (owner == nullptr || owner == UserThread::GetCurrent())
+        return ERR_INVALID_ARGS;
+
+    return Wait(value_ptr, current_value, owner, deadline);
+}
+
+status_t FutexContext::Wait(user_ptr<int> value_ptr, int current_value, UserThread* owner,
+                            mx_time_t deadline) {
     uintptr_t futex_key = reinterpret_cast<uintptr_t>(value_ptr.get());
     if (futex_key % sizeof(int))
         return ERR_INVALID_ARGS;
 
+    Bucket* bucket = BucketFor(futex_key);
     FutexNode* node;
 
     // FutexWait() checks that the address value_ptr still contains
@@ -42,16 +64,16 @@ status_t FutexContext::FutexWait(user_ptr<int> value_ptr, int current_value, mx_
     // If a FutexWake() operation could occur between them, a userland mutex
     // operation built on top of futexes would have a race condition that
     // could miss wakeups.
-    lock_.Acquire();
+    bucket->lock.Acquire();
 
     int value;
     status_t result = value_ptr.copy_from_user(&value);
     if (result != NO_ERROR) {
-        lock_.Release();
+        bucket->lock.Release();
         return result;
     }
     if (value != current_value) {
-        lock_.Release();
+        bucket->lock.Release();
         return ERR_BAD_STATE;
     }
 
@@ -60,26 +82,36 @@ status_t FutexContext::FutexWait(user_ptr<int> value_ptr, int current_value, mx_
     node->set_hash_key(futex_key);
     node->SetAsSingletonList();
 
-    QueueNodesLocked(node);
+    QueueNodesLocked(bucket, node);
+
+    // Lend our priority to the owner before blocking, and keep lending it
+    // until we are done waiting no matter how the wait ends.
+    int priority = get_current_thread()->priority;
+    if (owner)
+        owner->InheritPriority(priority);
+
+    // Block current thread.  This releases the bucket lock and does not reacquire it.
+    result = node->BlockThread(&bucket->lock, deadline);
+
+    if (owner)
+        owner->DisinheritPriority(priority);
 
-    // Block current thread.  This releases lock_ and does not reacquire it.
-    result = node->BlockThread(&lock_, deadline);
     if (result == NO_ERROR) {
         // Fix/workaround for MG-624:
         // We must re-acquire the lock here to force this thread to wait until
         // the WakeThreads() marks this thread as not in the queue anymore.
         // Otherwise, this thread can exit before it does that, causing
-        // WakeThreads() to scribble on memory.
-        AutoLock lock(&lock_);
+        // WakeThreads() to scribble on memory. The waker keeps the key of the
+        // futex we were woken from in our node, and holds that bucket's lock.
+        AutoLock lock(&BucketFor(node->GetKey())->lock);
         DEBUG_ASSERT(!node->IsInQueue());
         // All the work necessary for removing us from the hash table was done by FutexWake()
         return NO_ERROR;
     }
 
-    AutoLock lock(&lock_);
     // If we hit the deadline, we need to remove the thread's node from the
     // wait queue, since FutexWake() didn't do that.
-    if (UnqueueNodeLocked(node)) {
+    if (UnqueueNode(node)) {
         return ERR_TIMED_OUT;
     }
     // The current thread was not found on the wait queue.  This means
@@ -115,22 +147,25 @@ status_t FutexContext::FutexWake(user_ptr<const int> value_ptr,
         return ERR_INVALID_ARGS;
 
     {
-        AutoLock lock(&lock_);
+        Bucket* bucket = BucketFor(futex_key);
+        AutoLock lock(&bucket->lock);
 
-        FutexNode* node = futex_table_.erase(futex_key);
+        FutexNode* node = bucket->futex_table.erase(futex_key);
         if (!node) {
             // nothing blocked on this futex if we can't find it
             return NO_ERROR;
         }
         DEBUG_ASSERT(node->GetKey() == futex_key);
 
+        // The woken nodes keep |futex_key|, which tells their threads whose
+        // lock to wait on in FutexWait().
         FutexNode* wake_head = node;
-        node = FutexNode::RemoveFromHead(node, count, futex_key, 0u);
+        node = FutexNode::RemoveFromHead(node, count, futex_key, futex_key);
         // node is now the new blocked thread list head
 
         if (node != nullptr) {
             DEBUG_ASSERT(node->GetKey() == futex_key);
-            futex_table_.insert(node);
+            bucket->futex_table.insert(node);
         }
 
         // Traversing this list of threads must be done while holding the
@@ -144,29 +179,43 @@ status_t FutexContext::FutexWake(user_ptr<const int> value_ptr,
 }
 
 status_t FutexContext::FutexRequeue(user_ptr<int> wake_ptr, uint32_t wake_count, int current_value,
-                                    user_ptr<int> requeue_ptr, uint32_t requeue_count) {
+                                    user_ptr<int> requeue_ptr, uint32_t requeue_count)
+    TA_NO_THREAD_SAFETY_ANALYSIS {
     LTRACE_ENTRY;
 
     if ((requeue_ptr.get() == nullptr) && requeue_count)
         return ERR_INVALID_ARGS;
 
-    AutoLock lock(&lock_);
+    uintptr_t wake_key = reinterpret_cast<uintptr_t>(wake_ptr.get());
+    uintptr_t requeue_key = reinterpret_cast<uintptr_t>(requeue_ptr.get());
+
+    // Both buckets are locked, in address order, so that nodes can move
+    // between the two futexes atomically.
+    Bucket* wake_bucket = BucketFor(wake_key);
+    Bucket* requeue_bucket = BucketFor(requeue_key);
+    Bucket* first = (wake_bucket < requeue_bucket) ? wake_bucket : requeue_bucket;
+    Bucket* second = (wake_bucket < requeue_bucket) ? requeue_bucket : wake_bucket;
+    AutoLock first_lock(&first->lock);
+    if (second != first)
+        second->lock.Acquire();
+    auto release_second = mxtl::MakeAutoCall([first, second]() TA_NO_THREAD_SAFETY_ANALYSIS {
+        if (second != first)
+            second->lock.Release();
+    });
 
     int value;
     status_t result = wake_ptr.copy_from_user(&value);
     if (result != NO_ERROR) return result;
     if (value != current_value) return ERR_BAD_STATE;
 
-    uintptr_t wake_key = reinterpret_cast<uintptr_t>(wake_ptr.get());
-    uintptr_t requeue_key = reinterpret_cast<uintptr_t>(requeue_ptr.get());
     if (wake_key == requeue_key) return ERR_INVALID_ARGS;
     if (wake_key % sizeof(int) || requeue_key % sizeof(int))
         return ERR_INVALID_ARGS;
 
     // This must happen before RemoveFromHead() calls set_hash_key() on
-    // nodes below, because operations on futex_table_ look at the GetKey
+    // nodes below, because operations on futex_table look at the GetKey
     // field of the list head nodes for wake_key and requeue_key.
-    FutexNode* node = futex_table_.erase(wake_key);
+    FutexNode* node = wake_bucket->futex_table.erase(wake_key);
     if (!node) {
         // nothing blocked on this futex if we can't find it
         return NO_ERROR;
@@ -177,7 +226,7 @@ status_t FutexContext::FutexRequeue(user_ptr<int> wake_ptr, uint32_t wake_count,
         wake_head = nullptr;
     } else {
         wake_head = node;
-        node = FutexNode::RemoveFromHead(node, wake_count, wake_key, 0u);
+        node = FutexNode::RemoveFromHead(node, wake_count, wake_key, wake_key);
     }
 
     // node is now the head of wake_ptr futex after possibly removing some threads to wake
@@ -190,22 +239,22 @@ status_t FutexContext::FutexRequeue(user_ptr<int> wake_ptr, uint32_t wake_count,
 
             // now requeue our nodes to requeue_ptr mutex
             DEBUG_ASSERT(requeue_head->GetKey() == requeue_key);
-            QueueNodesLocked(requeue_head);
+            QueueNodesLocked(requeue_bucket, requeue_head);
         }
     }
 
     // add any remaining nodes back to wake_key futex
     if (node != nullptr) {
         DEBUG_ASSERT(node->GetKey() == wake_key);
-        futex_table_.insert(node);
+        wake_bucket->futex_table.insert(node);
     }
 
     FutexNode::WakeThreads(wake_head);
     return NO_ERROR;
 }
 
-void FutexContext::QueueNodesLocked(FutexNode* head) {
-    DEBUG_ASSERT(lock_.IsHeld());
+void FutexContext::QueueNodesLocked(Bucket* bucket, FutexNode* head) {
+    DEBUG_ASSERT(bucket->lock.IsHeld());
 
     FutexNode::HashTable::iterator iter;
 
@@ -213,15 +262,27 @@ void FutexContext::QueueNodesLocked(FutexNode* head) {
     // succeeds, then the current thread is first to block on this futex and we
     // are finished.  If the insert fails, then there is already a thread
     // waiting on this futex.  Add ourselves to that thread's list.
-    if (!futex_table_.insert_or_find(head, &iter))
+    if (!bucket->futex_table.insert_or_find(head, &iter))
         iter->AppendList(head);
 }
 
 // This attempts to unqueue a thread (which may or may not be waiting on a
 // futex), given its FutexNode.  This returns whether the FutexNode was
 // found and removed from a futex wait queue.
-bool FutexContext::UnqueueNodeLocked(FutexNode* node) {
-    DEBUG_ASSERT(lock_.IsHeld());
+bool FutexContext::UnqueueNode(FutexNode* node) {
+    // The node's key tells which bucket to lock, but FutexRequeue() may
+    // change it until that bucket is locked, so check it again after.
+    while (true) {
+        uintptr_t futex_key = node->GetKey();
+        Bucket* bucket = BucketFor(futex_key);
+        AutoLock lock(&bucket->lock);
+        if (node->GetKey() == futex_key)
+            return UnqueueNodeLocked(bucket, node);
+    }
+}
+
+bool FutexContext::UnqueueNodeLocked(Bucket* bucket, FutexNode* node) {
+    DEBUG_ASSERT(bucket->lock.IsHeld());
 
     if (!node->IsInQueue())
         return false;
@@ -232,10 +293,10 @@ bool FutexContext::UnqueueNodeLocked(FutexNode* node) {
     // FutexRequeue(), so we need to re-get the hash table key here.
     uintptr_t futex_key = node->GetKey();
 
-    FutexNode* old_head = futex_table_.erase(futex_key);
+    FutexNode* old_head = bucket->futex_table.erase(futex_key);
     DEBUG_ASSERT(old_head);
     FutexNode* new_head = FutexNode::RemoveNodeFromList(old_head, node);
     if (new_head)
-        futex_table_.insert(new_head);
+        bucket->futex_table.insert(new_head);
     return true;
 }
@@ -63,4 +63,11 @@ mx_status_t GuestDispatcher::set_esi(uint32_t guest_esi) {
 
     return x86_guest_set_esi(context_, guest_esi);
 }
+
+mx_status_t GuestDispatcher::set_io_trap(uint16_t io_port, mxtl::RefPtr<PortDispatcherV2> port,
+                                         uint64_t key) {
+    canary_.Assert();
+
+    return x86_guest_set_io_trap(context_, io_port, mxtl::move(port), key);
+}
 #endif // ARCH_X86_64
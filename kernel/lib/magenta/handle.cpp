@@ -26,7 +26,7 @@ Handle::Handle(const Handle* rhs, mx_rights_t rights, uint32_t base_value)
 }
 
 Handle::~Handle() {
-    dispatcher_->remove_handle();
+    // The handle count was given back by internal::RetireHandle().
 }
 
 mxtl::RefPtr<Dispatcher> Handle::dispatcher() const { return dispatcher_; }
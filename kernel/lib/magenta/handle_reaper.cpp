@@ -6,8 +6,14 @@
 
 #include <assert.h>
 #include <inttypes.h>
-#include <lib/dpc.h>
-#include <kernel/mutex.h>
+#include <stdio.h>
+#include <arch/ops.h>
+#include <kernel/auto_lock.h>
+#include <kernel/event.h>
+#include <kernel/rcu.h>
+#include <kernel/spinlock.h>
+#include <kernel/thread.h>
+#include <lk/init.h>
 #include <magenta/dispatcher.h>
 #include <magenta/handle_reaper.h>
 #include <magenta/magenta.h>
@@ -15,21 +21,94 @@
 
 #define LOCAL_TRACE 0
 
-static void ReaperRoutine(dpc_t* dpc);
+// Handles are reaped by a thread per cpu, fed from a queue per cpu, so that
+// tearing down big processes on several cpus at once doesn't funnel through
+// one lock and one thread.
+namespace {
 
-static Mutex reaper_mutex;
-static mxtl::DoublyLinkedList<Handle*> reaper_handles TA_GUARDED(reaper_mutex);
-static dpc_t reaper_dpc = {
-    .node = LIST_INITIAL_CLEARED_VALUE,
-    .func = ReaperRoutine,
-    .arg = nullptr,
+// How many handles a reaper deletes per DeleteHandles() call.
+constexpr size_t kReapBatch = 64u;
+
+struct Reaper {
+    SpinLock lock;
+    mxtl::DoublyLinkedList<Handle*> handles; // protected by |lock|
+    mxtl::DoublyLinkedList<Handle*> retired; // protected by |lock|
+    event_t event;
 };
 
+Reaper reapers[SMP_MAX_CPUS];
+
+int ReaperRoutine(void* arg) {
+    Reaper* reaper = static_cast<Reaper*>(arg);
+    for (;;) {
+        event_wait(&reaper->event);
+
+        for (;;) {
+            Handle* batch[kReapBatch];
+            size_t count = 0u;
+            {
+                AutoSpinLockIrqSave lock(reaper->lock);
+                while (count < kReapBatch && !reaper->handles.is_empty())
+                    batch[count++] = reaper->handles.pop_front();
+            }
+            if (count == 0u)
+                break;
+
+            for (size_t i = 0; i < count; ++i) {
+                LTRACEF("Reaping handle of koid %" PRIu64 " of pid %" PRIu64 "\n",
+                        batch[i]->dispatcher()->get_koid(), batch[i]->process_id());
+                DEBUG_ASSERT(batch[i]->process_id() == 0u);
+            }
+            DeleteHandles(batch, count);
+        }
+
+        // One wait for the borrowers covers everything retired so far.
+        mxtl::DoublyLinkedList<Handle*> retired;
+        {
+            AutoSpinLockIrqSave lock(reaper->lock);
+            retired.swap(reaper->retired);
+        }
+        if (retired.is_empty())
+            continue;
+        rcu_synchronize();
+        while (!retired.is_empty()) {
+            Handle* batch[kReapBatch];
+            size_t count = 0u;
+            while (count < kReapBatch && !retired.is_empty())
+                batch[count++] = retired.pop_front();
+            internal::FreeRetiredHandles(batch, count);
+        }
+    }
+    return 0;
+}
+
+void ReaperInit(uint level) {
+    for (uint cpu = 0; cpu < arch_max_num_cpus(); ++cpu) {
+        Reaper& reaper = reapers[cpu];
+        event_init(&reaper.event, false, EVENT_FLAG_AUTOUNSIGNAL);
+
+        char name[THREAD_NAME_LENGTH];
+        snprintf(name, sizeof(name), "handle reaper %u", cpu);
+        thread_t* t = thread_create(name, ReaperRoutine, &reaper,
+                                    DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+        if (t == nullptr)
+            panic("unable to create handle reaper thread\n");
+        thread_set_pinned_cpu(t, cpu);
+        thread_detach_and_resume(t);
+    }
+}
+
+}  // namespace
+
 void ReapHandles(mxtl::DoublyLinkedList<Handle*>* handles) {
     LTRACE_ENTRY;
-    AutoLock lock(&reaper_mutex);
-    reaper_handles.splice(reaper_handles.end(), *handles);
-    dpc_queue(&reaper_dpc, false);
+    // The queue of the cpu we are on is always served by an online cpu.
+    Reaper& reaper = reapers[arch_curr_cpu_num()];
+    {
+        AutoSpinLockIrqSave lock(reaper.lock);
+        reaper.handles.splice(reaper.handles.end(), *handles);
+    }
+    event_signal(&reaper.event, false);
 }
 
 void ReapHandles(Handle** handles, uint32_t num_handles) {
@@ -40,20 +119,14 @@ void ReapHandles(Handle** handles, uint32_t num_handles) {
     ReapHandles(&list);
 }
 
-static void ReaperRoutine(dpc_t* dpc) {
-    LTRACE_ENTRY;
-    mxtl::DoublyLinkedList<Handle*> list;
+void RetireHandles(Handle** handles, size_t count) {
+    Reaper& reaper = reapers[arch_curr_cpu_num()];
     {
-        AutoLock lock(&reaper_mutex);
-        list.swap(reaper_handles);
+        AutoSpinLockIrqSave lock(reaper.lock);
+        for (size_t i = 0; i < count; i++)
+            reaper.retired.push_back(handles[i]);
     }
-    Handle* handle;
-    while ((handle = list.pop_front()) != nullptr) {
-        LTRACEF("Reaping handle of koid %" PRIu64 " of pid %" PRIu64 "\n",
-                handle->dispatcher()->get_koid(), handle->process_id());
-        DEBUG_ASSERT(handle->process_id() == 0u);
-        DeleteHandle(handle);
-    }
-    LTRACE_EXIT;
-;
+    event_signal(&reaper.event, false);
 }
+
+LK_INIT_HOOK(handle_reaper, ReaperInit, LK_INIT_LEVEL_THREADING);
@@ -0,0 +1,59 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <magenta/handle_table.h>
+
+#include <assert.h>
+#include <new.h>
+
+HandleTable::~HandleTable() {
+    for (Node* node : root_) {
+        if (!node)
+            continue;
+        for (Leaf* leaf : node->leaves)
+            delete leaf;
+        delete node;
+    }
+}
+
+bool HandleTable::Set(uint32_t index, Handle* handle) {
+    DEBUG_ASSERT(index < kMaxHandleCount);
+
+    // New nodes and leaves are published only once zeroed, so that Get()
+    // never sees garbage.
+    Node* node = root_[index >> kRootShift];
+    if (unlikely(!node)) {
+        AllocChecker ac;
+        node = new (&ac) Node;
+        if (!ac.check())
+            return false;
+        __atomic_store_n(&root_[index >> kRootShift], node, __ATOMIC_RELEASE);
+    }
+
+    Leaf** slot = &node->leaves[(index >> kLeafBits) & kNodeMask];
+    Leaf* leaf = *slot;
+    if (unlikely(!leaf)) {
+        AllocChecker ac;
+        leaf = new (&ac) Leaf;
+        if (!ac.check())
+            return false;
+        __atomic_store_n(slot, leaf, __ATOMIC_RELEASE);
+    }
+
+    __atomic_store_n(&leaf->handles[index & kLeafMask], handle, __ATOMIC_RELEASE);
+    return true;
+}
+
+void HandleTable::Clear(uint32_t index) {
+    DEBUG_ASSERT(index < kMaxHandleCount);
+
+    Node* node = root_[index >> kRootShift];
+    if (!node)
+        return;
+    Leaf* leaf = node->leaves[(index >> kLeafBits) & kNodeMask];
+    if (leaf)
+        __atomic_store_n(&leaf->handles[index & kLeafMask], nullptr, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,15 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <kernel/vm/vm_aspace.h>
+#include <mxtl/ref_ptr.h>
+
+// Destroy an address space out-of-band, on the aspace reaper thread of the
+// current cpu. Falls back to destroying it in place if the request can't be
+// queued.
+void ReapAspace(mxtl::RefPtr<VmAspace> aspace);
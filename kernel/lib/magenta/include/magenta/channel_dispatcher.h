@@ -17,12 +17,20 @@
 #include <mxtl/canary.h>
 #include <mxtl/intrusive_double_list.h>
 #include <mxtl/ref_counted.h>
+#include <mxtl/slab_allocator.h>
 #include <mxtl/unique_ptr.h>
 
+class ChannelDispatcher;
 class PortClient;
 
-class ChannelDispatcher final : public Dispatcher {
+using ChannelDispatcherAllocatorTraits =
+    mxtl::StaticSlabAllocatorTraits<mxtl::RefPtr<ChannelDispatcher>>;
+
+class ChannelDispatcher final : public Dispatcher,
+                                public mxtl::SlabAllocated<ChannelDispatcherAllocatorTraits> {
 public:
+    using MessageList = mxtl::DoublyLinkedList<mxtl::unique_ptr<MessagePacket>>;
+
     static status_t Create(uint32_t flags, mxtl::RefPtr<Dispatcher>* dispatcher0,
                            mxtl::RefPtr<Dispatcher>* dispatcher1, mx_rights_t* rights);
 
@@ -46,8 +54,21 @@ public:
                   mxtl::unique_ptr<MessagePacket>* msg,
                   bool may_disard);
 
+    // Read up to |count| messages under a single hold of the lock. Message i is taken only if
+    // it fits the num_bytes and num_handles limits in |slots[i]|, which are updated to its
+    // actual size and handle count along with a NO_ERROR status. The first message that does
+    // not fit stays queued and gets ERR_BUFFER_TOO_SMALL in its slot. The messages read are
+    // appended to |msgs|. Returns NO_ERROR if at least one message was read, otherwise what
+    // Read() would have returned.
+    status_t ReadMany(mx_channel_msg_t* slots, uint32_t count, MessageList* msgs);
+
     // Write to the opposing endpoint's message queue.
     status_t Write(mxtl::unique_ptr<MessagePacket> msg);
+
+    // Write every message in |msgs| to the opposing endpoint's queue under a single hold of
+    // its lock, emptying |msgs|. On failure the messages are left in |msgs| and no longer own
+    // their handles, so the caller can put them back.
+    status_t WriteMany(MessageList* msgs);
     status_t Call(mxtl::unique_ptr<MessagePacket> msg,
                   mx_time_t deadline, bool* return_handles,
                   mxtl::unique_ptr<MessagePacket>* reply);
@@ -128,14 +149,17 @@ public:
     };
 
 private:
-    using MessageList = mxtl::DoublyLinkedList<mxtl::unique_ptr<MessagePacket>>;
     using WaiterList = mxtl::DoublyLinkedList<MessageWaiter*>;
 
     void RemoveWaiter(MessageWaiter* waiter);
 
+    friend class mxtl::SlabAllocator<ChannelDispatcherAllocatorTraits>;
+
     ChannelDispatcher(uint32_t flags);
     void Init(mxtl::RefPtr<ChannelDispatcher> other);
     int WriteSelf(mxtl::unique_ptr<MessagePacket> msg);
+    int WriteSelfLocked(mxtl::unique_ptr<MessagePacket> msg) TA_REQ(lock_);
+    int WriteSelfMany(MessageList* msgs);
     status_t UserSignalSelf(uint32_t clear_mask, uint32_t set_mask);
     void OnPeerZeroHandles();
 
@@ -149,3 +173,5 @@ private:
     mxtl::RefPtr<ChannelDispatcher> other_ TA_GUARDED(lock_);
     mx_koid_t other_koid_ TA_GUARDED(lock_);
 };
+
+FWD_DECL_STATIC_SLAB_ALLOCATOR(ChannelDispatcherAllocatorTraits);
@@ -116,3 +116,17 @@ template <>
 inline mxtl::RefPtr<Dispatcher> DownCastDispatcher(mxtl::RefPtr<Dispatcher>* disp) {
     return mxtl::move(*disp);
 }
+
+// Like DownCastDispatcher() above, for a Dispatcher borrowed without taking a
+// reference. Returns nullptr if |disp| is not a T.
+template <typename T>
+T* DownCastDispatcher(Dispatcher* disp) {
+    return (likely(DispatchTag<T>::ID == disp->get_type())) ?
+            static_cast<T*>(disp) :
+            nullptr;
+}
+
+template <>
+inline Dispatcher* DownCastDispatcher(Dispatcher* disp) {
+    return disp;
+}
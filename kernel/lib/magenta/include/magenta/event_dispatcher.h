@@ -9,10 +9,16 @@
 #include <magenta/dispatcher.h>
 #include <magenta/state_tracker.h>
 #include <mxtl/canary.h>
+#include <mxtl/slab_allocator.h>
 
 #include <sys/types.h>
 
-class EventDispatcher final : public Dispatcher {
+class EventDispatcher;
+using EventDispatcherAllocatorTraits =
+    mxtl::StaticSlabAllocatorTraits<mxtl::RefPtr<EventDispatcher>>;
+
+class EventDispatcher final : public Dispatcher,
+                              public mxtl::SlabAllocated<EventDispatcherAllocatorTraits> {
 public:
     static status_t Create(uint32_t options, mxtl::RefPtr<Dispatcher>* dispatcher,
                            mx_rights_t* rights);
@@ -24,8 +30,12 @@ public:
     status_t user_signal(uint32_t clear_mask, uint32_t set_mask, bool peer) final;
 
 private:
+    friend class mxtl::SlabAllocator<EventDispatcherAllocatorTraits>;
+
     explicit EventDispatcher(uint32_t options);
     mxtl::Canary<mxtl::magic("EVTD")> canary_;
     StateTracker state_tracker_;
     CookieJar cookie_jar_;
 };
+
+FWD_DECL_STATIC_SLAB_ALLOCATOR(EventDispatcherAllocatorTraits);
@@ -11,9 +11,16 @@
 #include <magenta/state_tracker.h>
 #include <mxtl/canary.h>
 #include <mxtl/ref_ptr.h>
+#include <mxtl/slab_allocator.h>
 #include <sys/types.h>
 
-class EventPairDispatcher final : public Dispatcher {
+class EventPairDispatcher;
+using EventPairDispatcherAllocatorTraits =
+    mxtl::StaticSlabAllocatorTraits<mxtl::RefPtr<EventPairDispatcher>>;
+
+class EventPairDispatcher final
+    : public Dispatcher,
+      public mxtl::SlabAllocated<EventPairDispatcherAllocatorTraits> {
 public:
     static status_t Create(mxtl::RefPtr<Dispatcher>* dispatcher0,
                            mxtl::RefPtr<Dispatcher>* dispatcher1,
@@ -28,6 +35,8 @@ public:
     mx_koid_t get_related_koid() const final { return other_koid_; }
 
 private:
+    friend class mxtl::SlabAllocator<EventPairDispatcherAllocatorTraits>;
+
     explicit EventPairDispatcher();
     void Init(EventPairDispatcher* other);
 
@@ -44,3 +53,5 @@ private:
     Mutex lock_;
     mxtl::RefPtr<EventPairDispatcher> other_ TA_GUARDED(lock_);
 };
+
+FWD_DECL_STATIC_SLAB_ALLOCATOR(EventPairDispatcherAllocatorTraits);
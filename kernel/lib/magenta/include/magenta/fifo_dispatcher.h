@@ -11,11 +11,13 @@
 #include <kernel/mutex.h>
 
 #include <magenta/dispatcher.h>
+#include <magenta/shared_ring.h>
 #include <magenta/state_tracker.h>
 #include <magenta/types.h>
 
 #include <mxtl/canary.h>
 #include <mxtl/ref_counted.h>
+#include <mxtl/ref_ptr.h>
 
 typedef mx_status_t (*fifo_copy_from_fn_t)(const uint8_t* ptr, uint8_t* data, size_t len);
 typedef mx_status_t (*fifo_copy_to_fn_t)(uint8_t* ptr, const uint8_t* data, size_t len);
@@ -40,9 +42,29 @@ public:
     mx_status_t WriteFromUser(const uint8_t* src, size_t len, uint32_t* actual);
     mx_status_t ReadToUser(uint8_t* dst, size_t len, uint32_t* actual);
 
+    // For MX_FIFO_SHARED_RING fifos, returns the ring this end reads from in
+    // |rx| and the ring it writes to in |tx|.
+    mx_status_t GetRings(mxtl::RefPtr<VmObject>* rx, mxtl::RefPtr<VmObject>* tx);
+
+    // Called after user space moved the indices of either shared ring, to
+    // bring the signals of both ends up to date.
+    mx_status_t RingUpdate();
+
 private:
     FifoDispatcher(uint32_t elem_count, uint32_t elem_size, uint32_t options);
     mx_status_t Init(mxtl::RefPtr<FifoDispatcher> other);
+    mxtl::RefPtr<VmObject> RingVmo();
+    void SyncRing();
+    void SyncRingLocked() TA_REQ(lock_);
+    // Shared rings only: pick up the indices published by user space, and
+    // publish ours after moving them.
+    void LoadLocked() TA_REQ(lock_);
+    void StoreIndexLocked(size_t field_offset, uint32_t index) TA_REQ(lock_);
+    // Copies between a caller buffer and the ring at byte |offset|.
+    mx_status_t CopyIn(const uint8_t* ptr, uint32_t offset, size_t len,
+                       fifo_copy_from_fn_t copy_from_fn) TA_REQ(lock_);
+    mx_status_t CopyOut(uint8_t* ptr, uint32_t offset, size_t len,
+                        fifo_copy_to_fn_t copy_to_fn) TA_REQ(lock_);
     mx_status_t Write(const uint8_t* ptr, size_t len, uint32_t* actual,
                       fifo_copy_from_fn_t copy_from_fn);
     mx_status_t WriteSelf(const uint8_t* ptr, size_t len, uint32_t* actual,
@@ -56,6 +78,7 @@ private:
     const uint32_t elem_count_;
     const uint32_t elem_size_;
     const uint32_t mask_;
+    const bool shared_;
     mx_koid_t peer_koid_;
     StateTracker state_tracker_;
 
@@ -64,6 +87,7 @@ private:
     uint32_t head_ TA_GUARDED(lock_);
     uint32_t tail_ TA_GUARDED(lock_);
     uint8_t* data_ TA_GUARDED(lock_);
+    SharedRing ring_ TA_GUARDED(lock_);
 
     static constexpr uint32_t kMaxSizeBytes = 4096;
 };
@@ -11,9 +11,12 @@
 #include <magenta/futex_node.h>
 #include <magenta/types.h>
 
+class UserThread;
+
 // FutexContext is a class that encapsulates support for futex operations.
 // FutexContext uses a hash table keyed on the futex address (a pointer to integer in userspace)
-// to contain all active futexes.
+// to contain all active futexes. The table is split in buckets, each with its own lock, so that
+// operations on unrelated futexes don't contend.
 // A futex is considered active if there is one or more threads blocked on the futex.
 // After no threads are left blocked on a futex it is removed from the hash table.
 // The value in the futex hash table is the FutexNode object associated with the head
@@ -35,6 +38,12 @@ public:
     // on the same |value_ptr| futex.
     status_t FutexWait(user_ptr<int> value_ptr, int current_value, mx_time_t deadline);
 
+    // FutexWaitPi behaves like FutexWait but, for as long as the current thread
+    // is blocked, |owner| runs at no less than the current thread's priority.
+    // |owner| is meant to be the thread holding the lock the futex implements.
+    status_t FutexWaitPi(user_ptr<int> value_ptr, int current_value, UserThread* owner,
+                         mx_time_t deadline);
+
     // FutexWake will wake up to |count| number of threads blocked on the |value_ptr| futex.
     status_t FutexWake(user_ptr<const int> value_ptr, uint32_t count);
 
@@ -51,14 +60,28 @@ private:
     FutexContext(const FutexContext&) = delete;
     FutexContext& operator=(const FutexContext&) = delete;
 
-    void QueueNodesLocked(FutexNode* head) TA_REQ(lock_);
+    static constexpr size_t kNumBuckets = 16u;
+
+    struct Bucket {
+        // protects futex_table
+        Mutex lock;
+
+        // Hash table for the futexes of this bucket. Key is futex address,
+        // value is the FutexNode for the head of futex's blocked thread list.
+        FutexNode::HashTable futex_table TA_GUARDED(lock);
+    };
+
+    Bucket* BucketFor(uintptr_t futex_key) {
+        return &buckets_[(futex_key / sizeof(int)) % kNumBuckets];
+    }
+
+    status_t Wait(user_ptr<int> value_ptr, int current_value, UserThread* owner,
+                  mx_time_t deadline);
 
-    bool UnqueueNodeLocked(FutexNode* node) TA_REQ(lock_);
+    void QueueNodesLocked(Bucket* bucket, FutexNode* head) TA_REQ(bucket->lock);
 
-    // protects futex_table_
-    Mutex lock_;
+    bool UnqueueNode(FutexNode* node);
+    bool UnqueueNodeLocked(Bucket* bucket, FutexNode* node) TA_REQ(bucket->lock);
 
-    // Hash table for futexes in this context.
-    // Key is futex address, value is the FutexNode for the head of futex's blocked thread list.
-    FutexNode::HashTable futex_table_ TA_GUARDED(lock_);
+    Bucket buckets_[kNumBuckets];
 };
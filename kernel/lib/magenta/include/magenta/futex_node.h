@@ -17,7 +17,9 @@
 // Intended to be embedded within a UserThread Instance
 class FutexNode : public mxtl::SinglyLinkedListable<FutexNode*> {
 public:
-    using HashTable = mxtl::HashTable<uintptr_t, FutexNode*>;
+    // FutexContext keeps one table per lock bucket, so each can be small.
+    using HashTable = mxtl::HashTable<uintptr_t, FutexNode*,
+                                      mxtl::SinglyLinkedList<FutexNode*>, size_t, 7>;
 
     FutexNode();
     ~FutexNode();
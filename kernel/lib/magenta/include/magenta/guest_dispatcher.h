@@ -7,6 +7,7 @@
 #pragma once
 
 #include <magenta/hypervisor_dispatcher.h>
+#include <magenta/port_dispatcher_v2.h>
 #include <mxtl/canary.h>
 
 class GuestDispatcher final : public Dispatcher {
@@ -27,6 +28,7 @@ public:
 #if ARCH_X86_64
     mx_status_t set_cr3(uintptr_t guest_cr3);
     mx_status_t set_esi(uint32_t guest_esi);
+    mx_status_t set_io_trap(uint16_t io_port, mxtl::RefPtr<PortDispatcherV2> port, uint64_t key);
 #endif // ARCH_X86_64
 
 private:
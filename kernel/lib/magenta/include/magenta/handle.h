@@ -16,7 +16,8 @@ class Dispatcher;
 class Handle;
 
 namespace internal {
-// Do not call: exposed only so Handle can declare it as a friend.
+// Do not call: exposed only so Handle can declare them as friends.
+void RetireHandle(Handle* handle);
 void TearDownHandle(Handle* handle);
 } // namespace internal
 
@@ -26,6 +27,12 @@ public:
     // Returns the Dispatcher to which this instance points.
     mxtl::RefPtr<Dispatcher> dispatcher() const;
 
+    // Returns the Dispatcher to which this instance points without taking a
+    // reference to it. See HandleBorrowGuard for how long it stays alive.
+    Dispatcher* dispatcher_ptr() const {
+        return dispatcher_.get();
+    }
+
     // Returns the process that owns this instance. Used to guarantee
     // that one process may not access a handle owned by a different process.
     mx_koid_t process_id() const {
@@ -65,7 +72,10 @@ private:
     Handle& operator=(const Handle&) = delete;
 
     // Handle should never be destroyed by anything other than DeleteHandle,
-    // which uses TearDownHandle to do the actual destruction.
+    // which uses RetireHandle to let go of the Dispatcher's handle count
+    // and, once no borrower can be using it, TearDownHandle to do the
+    // actual destruction.
+    friend void internal::RetireHandle(Handle* handle);
     friend void internal::TearDownHandle(Handle* handle);
     ~Handle();
 
@@ -6,9 +6,16 @@
 
 #pragma once
 
+#include <stddef.h>
+
 #include <magenta/handle.h>
 #include <mxtl/intrusive_double_list.h>
 
-// Delete handles out-of-band, using a deferred procedure call.
+// Delete handles out-of-band, on the handle reaper thread of the current cpu.
 void ReapHandles(mxtl::DoublyLinkedList<Handle*>* handles);
 void ReapHandles(Handle** handles, uint32_t num_handles);
+
+// Finish deleting handles, already retired by DeleteHandles(), on the handle
+// reaper thread of the current cpu once no HandleBorrowGuard can be using
+// their dispatchers.
+void RetireHandles(Handle** handles, size_t count);
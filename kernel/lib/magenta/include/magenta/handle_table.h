@@ -0,0 +1,73 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <pow2.h>
+#include <stdint.h>
+
+#include <magenta/magenta.h>
+
+class Handle;
+
+// Maps the arena index of every Handle owned by a process to the Handle.
+//
+// The table is a three level radix tree. Small leaves keep the cost down for
+// the many processes with few, scattered, handles. Interior nodes and leaves
+// are allocated when first needed and stay in place until the table is
+// destroyed, so Get() needs no lock and can race with Set() and Clear().
+// Set() and Clear() must be serialized by the owner, which uses its handle
+// table lock. A Handle found by Get() is only guaranteed to stay alive inside
+// a HandleReadGuard.
+class HandleTable {
+public:
+    HandleTable() = default;
+    ~HandleTable();
+
+    // Returns the Handle at |index|, or nullptr.
+    Handle* Get(uint32_t index) const {
+        Node* node = __atomic_load_n(&root_[index >> kRootShift], __ATOMIC_ACQUIRE);
+        if (!node)
+            return nullptr;
+        Leaf* leaf = __atomic_load_n(&node->leaves[(index >> kLeafBits) & kNodeMask],
+                                     __ATOMIC_ACQUIRE);
+        if (!leaf)
+            return nullptr;
+        return __atomic_load_n(&leaf->handles[index & kLeafMask], __ATOMIC_ACQUIRE);
+    }
+
+    // Stores |handle| at |index|. Returns false if no leaf could be allocated
+    // for |index|, in which case lookups of it must fall back to the lock.
+    bool Set(uint32_t index, Handle* handle);
+
+    // Removes whatever is stored at |index|.
+    void Clear(uint32_t index);
+
+private:
+    HandleTable(const HandleTable&) = delete;
+    HandleTable& operator=(const HandleTable&) = delete;
+
+    // Bits of the arena index resolved by the leaves and interior nodes, the
+    // root resolves the rest.
+    static constexpr uint32_t kLeafBits = 6u;
+    static constexpr uint32_t kNodeBits = 7u;
+    static constexpr uint32_t kIndexBits = log2_uint_floor(kMaxHandleCount);
+    static_assert(kIndexBits > kLeafBits + kNodeBits, "");
+
+    static constexpr uint32_t kLeafMask = (1u << kLeafBits) - 1;
+    static constexpr uint32_t kNodeMask = (1u << kNodeBits) - 1;
+    static constexpr uint32_t kRootShift = kLeafBits + kNodeBits;
+    static constexpr uint32_t kRootSize = 1u << (kIndexBits - kRootShift);
+
+    struct Leaf {
+        Handle* handles[1u << kLeafBits] = {};
+    };
+    struct Node {
+        Leaf* leaves[1u << kNodeBits] = {};
+    };
+
+    Node* root_[kRootSize] = {};
+};
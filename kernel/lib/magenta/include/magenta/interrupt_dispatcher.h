@@ -7,9 +7,13 @@
 #pragma once
 
 #include <kernel/event.h>
+#include <kernel/spinlock.h>
+#include <lib/dpc.h>
 
 #include <magenta/dispatcher.h>
+#include <magenta/port_dispatcher_v2.h>
 #include <mxtl/canary.h>
+#include <mxtl/ref_ptr.h>
 #include <sys/types.h>
 
 // TODO:
@@ -34,9 +38,12 @@ public:
     // Signal the IRQ from non-IRQ state in response to a user-land request.
     virtual status_t UserSignal() = 0;
 
-    status_t WaitForInterrupt() {
-        return event_wait_deadline(&event_, INFINITE_TIME, true);
-    }
+    status_t WaitForInterrupt();
+
+    // From now on deliver the interrupt as MX_PKT_TYPE_INTERRUPT packets with
+    // |key| on |port| instead of signaling waiters. Interrupts which arrive
+    // while the packet is still queued are added to its count.
+    status_t BindPort(mxtl::RefPtr<PortDispatcherV2> port, uint64_t key);
 
     virtual void on_zero_handles() final {
         // Ensure any waiters stop waiting
@@ -44,17 +51,35 @@ public:
     }
 
 protected:
-    InterruptDispatcher() {
-        event_init(&event_, false, 0);
-    }
-    int signal(bool resched = false) {
-        return event_signal(&event_, resched);
-    }
+    InterruptDispatcher();
+    // The derived class must have stopped calling Fire() before this runs.
+    ~InterruptDispatcher();
+
+    // Called when the interrupt fires, possibly in IRQ context. Returns the
+    // number of threads woken, which is always 0 for a bound interrupt.
+    int Fire(bool resched = false);
     void unsignal() {
         event_unsignal(&event_);
     }
 
 private:
+    // Port locks cannot be taken in IRQ context, so packets are queued by
+    // a dpc.
+    static void DeliverDpc(dpc_t* dpc);
+
     mxtl::Canary<mxtl::magic("INTD")> canary_;
     event_t event_;
+
+    // Set once by BindPort() and read by Fire() under |lock_|.
+    mxtl::RefPtr<PortDispatcherV2> port_;
+    PortPacket port_packet_;
+    dpc_t dpc_;
+
+    spin_lock_t lock_;
+    // Interrupts not yet handed to the port, and when the first of them
+    // fired.
+    uint64_t pending_count_;
+    mx_time_t pending_timestamp_;
+    // Set from when the dpc is queued until it has found nothing pending.
+    bool dpc_busy_;
 };
@@ -9,6 +9,8 @@
 #include <stdint.h>
 
 #include <kernel/mutex.h>
+#include <kernel/sched_group.h>
+#include <kernel/vm/memory_account.h>
 
 #include <magenta/dispatcher.h>
 #include <magenta/policy_manager.h>
@@ -36,7 +38,7 @@ protected:
     virtual ~JobEnumerator() = default;
 };
 
-class JobDispatcher final : public Dispatcher {
+class JobDispatcher final : public Dispatcher, private MemoryAccount::Observer {
 public:
     // Traits to belong to the parent's weak job list.
     struct ListTraitsWeak {
@@ -83,6 +85,43 @@ public:
     status_t SetPolicy(uint32_t mode, const mx_policy_basic* in_policy, size_t policy_count);
     pol_cookie_t GetPolicy();
 
+    // Whether the cold pages of anonymous VMOs created by processes in this job
+    // may be compressed under memory pressure. Child jobs start out with their
+    // parent's setting.
+    bool compress_memory();
+    void set_compress_memory(bool compress);
+
+    // Confines the threads of the job's processes to a part of the last level
+    // cache and throttles their memory bandwidth. Like SetPolicy() this only
+    // works on a job without processes or child jobs; child jobs start out
+    // sharing their parent's allocation.
+    status_t SetRdtPolicy(uint32_t mode, const mx_policy_rdt* policy);
+
+    // The resource group the threads of the job's processes run in, 0 unless
+    // SetRdtPolicy() was used on the job or an ancestor.
+    uint64_t rdt_group();
+
+    // Bytes of the last level cache currently filled by the job's threads.
+    status_t GetCacheOccupancy(uint64_t* l3_bytes);
+
+    // Sets the weight and quota of the job's sched group. Unlike the other
+    // policies this can change at any time, and applies to the threads that
+    // already exist. Child jobs' groups are nested in their parent's.
+    status_t SetCpuPolicy(const mx_policy_cpu* policy);
+
+    // The group the job's threads are charged to.
+    struct sched_group* sched_group() { return &sched_group_; }
+
+    // Limits the pages committed to the VMOs created by the job's processes
+    // and those of its child jobs, whose accounts are nested in their
+    // parent's. Like SetCpuPolicy() this can change at any time.
+    status_t SetMemoryPolicy(const mx_policy_memory* policy);
+
+    // The account the job's VMOs are charged to.
+    mxtl::RefPtr<MemoryAccount> memory_account() const { return memory_account_; }
+
+    void GetMemoryInfo(mx_info_job_memory_t* info) const;
+
     // Walks the job/process tree and invokes |je| methods on each node. If
     // |recurse| is false, only visits direct children of this job. Returns
     // false if any methods of |je| return false; returns true otherwise.
@@ -91,17 +130,34 @@ public:
     mxtl::RefPtr<ProcessDispatcher> LookupProcessById(mx_koid_t koid);
     mxtl::RefPtr<JobDispatcher> LookupJobById(mx_koid_t koid);
 
+    // Takes references to the job's direct child processes and jobs. Unlike
+    // EnumerateChildren, nothing is called with the job's lock held, so the
+    // caller is free to take the children's own locks.
+    status_t GetChildren(mxtl::Array<mxtl::RefPtr<ProcessDispatcher>>* procs,
+                         mxtl::Array<mxtl::RefPtr<JobDispatcher>>* jobs);
+
+    // Adds up the scheduler's counters for every process in this job and
+    // its descendants.
+    status_t AddSchedStats(mx_info_thread_stats_t* stats);
+
 private:
     enum class State {
         READY,
         KILLING,
     };
 
-    JobDispatcher(uint32_t flags, mxtl::RefPtr<JobDispatcher> parent, pol_cookie_t policy);
+    JobDispatcher(uint32_t flags, mxtl::RefPtr<JobDispatcher> parent, pol_cookie_t policy,
+                  mxtl::RefPtr<MemoryAccount> memory_account);
+
+    // MemoryAccount::Observer implementation.
+    void OnMemoryLimits(bool over_soft_limit, bool hit_hard_limit) final;
 
     bool AddChildJob(JobDispatcher* job);
     void RemoveChildJob(JobDispatcher* job);
 
+    // Returns the job's resource group with a reference taken for a child.
+    uint64_t AcquireRdtGroup();
+
     void UpdateSignalsIncrementLocked() TA_REQ(lock_);
     void UpdateSignalsDecrementLocked() TA_REQ(lock_);
 
@@ -140,4 +196,15 @@ private:
     WeakProcessList procs_ TA_GUARDED(lock_);
 
     pol_cookie_t policy_ TA_GUARDED(lock_);
+
+    bool compress_memory_ TA_GUARDED(lock_) = false;
+
+    // Holds a reference to the group if nonzero.
+    uint64_t rdt_group_ TA_GUARDED(lock_) = 0;
+
+    // Protected by THREAD_LOCK rather than |lock_|.
+    struct sched_group sched_group_;
+
+    // Does its own locking.
+    const mxtl::RefPtr<MemoryAccount> memory_account_;
 };
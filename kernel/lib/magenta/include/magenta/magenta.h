@@ -6,12 +6,17 @@
 
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include <kernel/rcu.h>
+#include <kernel/spinlock.h>
+
 #include <magenta/handle.h>
 #include <magenta/types.h>
 
 #include <mxtl/ref_ptr.h>
+#include <mxtl/slab_allocator.h>
 #include <mxtl/unique_ptr.h>
 
 class Dispatcher;
@@ -20,6 +25,19 @@ class ProcessDispatcher;
 class JobDispatcher;
 class PolicyManager;
 
+// The number of possible handles in the arena. Only the address space is
+// reserved up front, pages are committed as the arena grows.
+constexpr size_t kMaxHandleCount = 1024 * 1024u;
+
+// The most slabs a static slab allocator of commonly created kernel objects
+// may grow to, enough to hold one object per possible handle. Slabs are never
+// given back to the heap so this is also what a pool can pin down at worst.
+template <typename AllocatorTraits>
+constexpr size_t MaxObjectSlabs() {
+    using Allocator = mxtl::SlabAllocator<AllocatorTraits>;
+    return (kMaxHandleCount + Allocator::AllocsPerSlab - 1) / Allocator::AllocsPerSlab;
+}
+
 // Creates a handle attached to |dispatcher| and with |rights| from a
 // specific arena which makes their addresses come from a fixed range.
 Handle* MakeHandle(mxtl::RefPtr<Dispatcher> dispatcher, mx_rights_t rights);
@@ -30,9 +48,61 @@ Handle* DupHandle(Handle* source, mx_rights_t rights);
 // Deletes a handle created by MakeHandle() or DupHandle().
 void DeleteHandle(Handle* handle);
 
+// Like calling DeleteHandle() on each of |handles|, but frees their slots in
+// bulk.
+void DeleteHandles(Handle** handles, size_t count);
+
+// Returns how many handles exist right now.
+size_t GetOutstandingHandleCount();
+
 // Maps an integer obtained by Handle->base_value() back to a Handle.
 Handle* MapU32ToHandle(uint32_t value);
 
+// Returns the index into the handle arena encoded in a Handle->base_value().
+inline uint32_t MapU32ToHandleIndex(uint32_t value) {
+    return value & static_cast<uint32_t>(kMaxHandleCount - 1);
+}
+
+// Brackets a lookup of a Handle that does not hold the lock that protects the
+// table it was found in. DeleteHandle() waits for every guard alive when the
+// Handle was taken out of its process to end before tearing the Handle down,
+// so inside a guard the Handle and its Dispatcher stay alive. Interrupts are
+// disabled for the lifetime of the guard, which must not block or drop the
+// last reference to anything.
+class HandleReadGuard {
+public:
+    HandleReadGuard();
+    ~HandleReadGuard();
+
+private:
+    HandleReadGuard(const HandleReadGuard&) = delete;
+    HandleReadGuard& operator=(const HandleReadGuard&) = delete;
+
+    spin_lock_saved_state_t irq_state_;
+    uint cpu_;
+};
+
+// Brackets the use of Dispatchers borrowed from their Handles without taking
+// a reference, see ProcessDispatcher::GetBorrowedDispatcherWithRights(). It is
+// an RCU read-side critical section.
+// A Handle deleted while any guard is alive, anywhere, gives back its
+// Dispatcher's handle count right away but keeps its reference until every
+// such guard has ended; the handle reaper waits for that. Unlike a
+// HandleReadGuard this may block, but a guard that blocks for long holds up
+// the release of every Dispatcher whose last handle is closed meanwhile, so
+// syscalls that wait keep taking references instead.
+class HandleBorrowGuard {
+public:
+    HandleBorrowGuard();
+    ~HandleBorrowGuard();
+
+private:
+    HandleBorrowGuard(const HandleBorrowGuard&) = delete;
+    HandleBorrowGuard& operator=(const HandleBorrowGuard&) = delete;
+
+    const rcu_token_t token_;
+};
+
 // Set/get the system exception port.
 mx_status_t SetSystemExceptionPort(mxtl::RefPtr<ExceptionPort> eport);
 // Returns true if a port had been set.
@@ -59,6 +129,11 @@ mx_status_t get_process(ProcessDispatcher* up,
                         mxtl::RefPtr<ProcessDispatcher>* proc);
 
 namespace internal {
+    // Finishes deleting Handles which DeleteHandles() left for the handle
+    // reaper because a HandleBorrowGuard was alive. Must be called after
+    // rcu_synchronize().
+    void FreeRetiredHandles(Handle** handles, size_t count);
+
     // Dumps internal details of the handle table using printf().
     // Should only be called by diagnostics.cpp.
     void DumpHandleTableInfo();
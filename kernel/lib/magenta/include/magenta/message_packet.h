@@ -6,13 +6,17 @@
 
 #pragma once
 
+#include <assert.h>
 #include <stdint.h>
 
+#include <lib/user_copy/user_ptr.h>
 #include <magenta/types.h>
 #include <mxtl/intrusive_double_list.h>
+#include <mxtl/ref_ptr.h>
 #include <mxtl/unique_ptr.h>
 
 class Handle;
+class VmObject;
 
 class MessagePacket : public mxtl::DoublyLinkedListable<mxtl::unique_ptr<MessagePacket>> {
 public:
@@ -20,13 +24,35 @@ public:
     static mx_status_t Create(uint32_t data_size, uint32_t num_handles,
                               mxtl::unique_ptr<MessagePacket>* msg);
 
+    // Creates a message packet whose payload is made of the pages backing
+    // |data| in the current address space, which are moved into the packet
+    // instead of being copied. On success the whole pages of |data| may read
+    // as zeros afterwards. Returns ERR_NOT_SUPPORTED if the payload is too small or the
+    // buffer can't be moved, in which case the caller should fall back to
+    // Create() and a copy.
+    static mx_status_t CreateFromUserPages(user_ptr<const void> data, uint32_t data_size,
+                                           uint32_t num_handles,
+                                           mxtl::unique_ptr<MessagePacket>* msg);
+
+    // Copies the payload out to |data|. With |move_pages|, whole pages of a
+    // page backed payload are moved into the destination mapping when it
+    // allows it. Must be called at most once since it may consume the payload.
+    mx_status_t CopyDataTo(user_ptr<void> data, bool move_pages);
+
     uint32_t data_size() const { return data_size_; }
     uint32_t num_handles() const { return num_handles_; }
 
     void set_owns_handles(bool own_handles) { owns_handles_ = own_handles; }
 
-    const void* data() const { return static_cast<void*>(handles_ + num_handles_); }
-    void* mutable_data() { return static_cast<void*>(handles_ + num_handles_); }
+    // Only valid for packets which were not created from user pages.
+    const void* data() const {
+        DEBUG_ASSERT(!pages_);
+        return static_cast<void*>(handles_ + num_handles_);
+    }
+    void* mutable_data() {
+        DEBUG_ASSERT(!pages_);
+        return static_cast<void*>(handles_ + num_handles_);
+    }
     Handle* const* handles() const { return handles_; }
     Handle** mutable_handles() { return handles_; }
 
@@ -35,6 +61,8 @@ public:
     mx_txid_t get_txid() const {
         if (data_size_ < sizeof(mx_txid_t)) {
             return 0;
+        } else if (pages_) {
+            return pages_txid_;
         } else {
             return *(reinterpret_cast<const mx_txid_t*>(data()));
         }
@@ -44,13 +72,16 @@ private:
     MessagePacket(uint32_t data_size, uint32_t num_handles, Handle** handles);
     ~MessagePacket();
 
-    static void operator delete(void* ptr) {
-        free(ptr);
-    }
+    // Packets come from size class slabs or the heap, see message_packet.cpp.
+    static void operator delete(void* ptr);
     friend class mxtl::unique_ptr<MessagePacket>;
 
     bool owns_handles_;
     uint32_t data_size_;
     uint32_t num_handles_;
     Handle** handles_;
+
+    // Backing store for payloads created from user pages, null otherwise.
+    mxtl::RefPtr<VmObject> pages_;
+    mx_txid_t pages_txid_;
 };
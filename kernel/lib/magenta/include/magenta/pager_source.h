@@ -0,0 +1,26 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <kernel/vm/page_source.h>
+#include <magenta/port_dispatcher_v2.h>
+#include <mxtl/ref_ptr.h>
+
+// The PageSource of a VMO made with mx_pager_vmo_create(). Page requests go
+// to userspace as MX_PKT_TYPE_PAGE_REQUEST packets on a port, and requests
+// made while the packet is still queued widen its range.
+class PagerSource final : public PageSource {
+public:
+    PagerSource(mxtl::RefPtr<PortDispatcherV2> port, uint64_t key);
+    ~PagerSource() final;
+
+    status_t RequestPage(uint64_t offset) final;
+
+private:
+    mxtl::RefPtr<PortDispatcherV2> port_;
+    PortPacket packet_;
+};
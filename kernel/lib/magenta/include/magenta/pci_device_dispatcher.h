@@ -83,6 +83,7 @@ public:
                           mx_rights_t* rights);
     status_t QueryIrqModeCaps(mx_pci_irq_mode_t mode, uint32_t* out_max_irqs);
     status_t SetIrqMode(mx_pci_irq_mode_t mode, uint32_t requested_irq_count);
+    status_t SetIrqAffinity(int32_t which_irq, uint32_t cpu);
 
     bool irqs_maskable() const TA_REQ(lock_) { return irqs_maskable_; }
 
@@ -15,8 +15,10 @@
 #include <magenta/types.h>
 #include <magenta/wait_event.h>
 
+#include <mxtl/atomic.h>
 #include <mxtl/canary.h>
 #include <mxtl/intrusive_double_list.h>
+#include <mxtl/slab_allocator.h>
 #include <mxtl/unique_ptr.h>
 
 #include <sys/types.h>
@@ -82,6 +84,9 @@ class PortObserver;
 struct PortPacket final : public mxtl::DoublyLinkedListable<PortPacket*> {
     mx_port_packet_t packet;
     PortObserver* observer;
+    // The cpu the packet was created on, selects its queue in
+    // MX_PORT_OPT_PERCPU ports.
+    const uint32_t cpu;
 
     PortPacket();
     PortPacket(const PortPacket&) = delete;
@@ -93,7 +98,10 @@ struct PortPacket final : public mxtl::DoublyLinkedListable<PortPacket*> {
 // Observers are weakly contained in state trackers until |remove_| member
 // is false at the end of one of OnInitialize() OnStateChange() or  OnCancel()
 // callbacks.
-class PortObserver final : public StateObserver {
+using PortObserverAllocatorTraits = mxtl::StaticSlabAllocatorTraits<PortObserver*>;
+
+class PortObserver final : public StateObserver,
+                           public mxtl::SlabAllocated<PortObserverAllocatorTraits> {
 public:
     PortObserver(uint32_t type, Handle* handle, mxtl::RefPtr<PortDispatcherV2> port,
                  uint64_t key, mx_signals_t signals);
@@ -119,10 +127,15 @@ private:
     const mx_signals_t trigger_;
     const Handle* const handle_;
     mxtl::RefPtr<PortDispatcherV2> const port_;
+    // Set by OnCancelByKey(), a packet still queued is then discarded rather
+    // than delivered.
+    bool cancelled_ = false;
 
     PortPacket packet_;
 };
 
+FWD_DECL_STATIC_SLAB_ALLOCATOR(PortObserverAllocatorTraits);
+
 class PortDispatcherV2 final : public Dispatcher {
 public:
     static status_t Create(uint32_t options,
@@ -136,23 +149,55 @@ public:
 
     mx_status_t Queue(PortPacket* port_packet, mx_signals_t observed, uint64_t count);
     mx_status_t QueueUser(const mx_port_packet_t& packet);
+    // Queues the MX_PKT_TYPE_INTERRUPT |port_packet|, or adds |count| to it
+    // if it is still queued.
+    mx_status_t QueueInterrupt(PortPacket* port_packet, mx_time_t timestamp, uint64_t count);
+    // Queues the MX_PKT_TYPE_GUEST_IO |port_packet|, or folds the write into
+    // it if it is still queued.
+    mx_status_t QueueGuestIo(PortPacket* port_packet, uint8_t access_size, uint32_t data);
+    // Queues the MX_PKT_TYPE_PAGE_REQUEST |port_packet| for the page at
+    // |offset|, or grows its range to cover the page if it is still queued.
+    mx_status_t QueuePageRequest(PortPacket* port_packet, uint64_t offset);
+    // Takes |port_packet| off the port if it is queued, for packets which
+    // are owned by something other than an observer.
+    void CancelQueued(PortPacket* port_packet);
     mx_status_t DeQueue(mx_time_t deadline, mx_port_packet_t* packet);
 
+    // Like DeQueue() but takes up to |count| packets, blocking until |deadline|
+    // only if none are queued. The number taken is returned in |actual|.
+    mx_status_t DeQueueMany(mx_time_t deadline, mx_port_packet_t* packets, uint32_t count,
+                            uint32_t* actual);
+
     // Decides who is going to destroy the observer. If it returns |true| it
     // is the duty of the caller. If it is false it is the duty of the port.
-    bool CanReap(PortObserver* observer, PortPacket* port_packet);
+    // With |discard| a still queued packet is taken off the port first.
+    bool CanReap(PortObserver* observer, PortPacket* port_packet, bool discard);
 
     // Called under the handle table lock.
     mx_status_t MakeObservers(uint32_t options, Handle* handle,
                               uint64_t key, mx_signals_t signals);
 
 private:
-    PortDispatcherV2(uint32_t options);
-    PortObserver* CopyLocked(PortPacket* port_packet, mx_port_packet_t* packet) TA_REQ(lock_);
+    // Packets are kept in a single shard, or in one shard per cpu for
+    // MX_PORT_OPT_PERCPU ports. Each shard is FIFO, there is no ordering
+    // between shards.
+    struct Shard {
+        Mutex lock;
+        mxtl::DoublyLinkedList<PortPacket*> packets TA_GUARDED(lock);
+    };
+
+    PortDispatcherV2(uint32_t options, mxtl::unique_ptr<Shard[]> shards, uint32_t num_shards);
+    Shard* ShardFor(const PortPacket* port_packet) const;
+    // Called with the lock of the shard that held |port_packet|.
+    PortObserver* CopyLocked(PortPacket* port_packet, mx_port_packet_t* packet);
 
     mxtl::Canary<mxtl::magic("POR2")> canary_;
-    Mutex lock_;
+    const uint32_t num_shards_;
+    // Wake the most recent waiter first, it is the likeliest to be cache hot.
+    const bool wake_newest_;
+    const mxtl::unique_ptr<Shard[]> shards_;
     Semaphore sema_;
-    bool zero_handles_ TA_GUARDED(lock_);
-    mxtl::DoublyLinkedList<PortPacket*> packets_ TA_GUARDED(lock_);
+    // Written once before draining each shard under its lock, so a Queue()
+    // that takes a shard lock after the drain is guaranteed to see it.
+    mxtl::atomic<int> zero_handles_;
 };
@@ -14,6 +14,7 @@
 #include <magenta/dispatcher.h>
 #include <magenta/futex_context.h>
 #include <magenta/handle_owner.h>
+#include <magenta/handle_table.h>
 #include <magenta/magenta.h>
 #include <magenta/policy_manager.h>
 #include <magenta/state_tracker.h>
@@ -94,6 +95,10 @@ public:
     void AddHandle(HandleOwner handle);
     void AddHandleLocked(HandleOwner handle) TA_REQ(handle_table_lock_);
 
+    // Adds the |count| |handles|, which this process now owns, under a single
+    // hold of the handle table lock.
+    void AddHandles(Handle* const* handles, size_t count);
+
     // Removes the Handle corresponding to |handle_value| from this process
     // handle list.
     HandleOwner RemoveHandle(mx_handle_t handle_value);
@@ -102,6 +107,8 @@ public:
     // Puts back the |handle_value| which has not yet been given to another process
     // back into this process.
     void UndoRemoveHandleLocked(mx_handle_t handle_value) TA_REQ(handle_table_lock_);
+    void UndoRemoveHandlesLocked(const mx_handle_t* handle_values, size_t count)
+        TA_REQ(handle_table_lock_);
 
     // Get the dispatcher corresponding to this handle value.
     template <typename T>
@@ -155,6 +162,32 @@ public:
         return GetDispatcherWithRights(handle_value, desired_rights, dispatcher, nullptr);
     }
 
+    // Like GetDispatcherWithRights(), but without taking a reference to the
+    // dispatcher. Must be called inside a HandleBorrowGuard, which keeps
+    // |*dispatcher| alive until it ends even if the handle is closed.
+    template <typename T>
+    mx_status_t GetBorrowedDispatcherWithRights(mx_handle_t handle_value,
+                                                mx_rights_t desired_rights,
+                                                T** dispatcher,
+                                                mx_rights_t* out_rights) {
+        Dispatcher* generic_dispatcher;
+        auto status = GetBorrowedDispatcherInternal(handle_value, desired_rights,
+                                                    &generic_dispatcher, out_rights);
+        if (status != NO_ERROR)
+            return status;
+        *dispatcher = DownCastDispatcher<T>(generic_dispatcher);
+        if (!*dispatcher)
+            return ERR_WRONG_TYPE;
+        return NO_ERROR;
+    }
+
+    template <typename T>
+    mx_status_t GetBorrowedDispatcherWithRights(mx_handle_t handle_value,
+                                                mx_rights_t desired_rights,
+                                                T** dispatcher) {
+        return GetBorrowedDispatcherWithRights(handle_value, desired_rights, dispatcher, nullptr);
+    }
+
     mx_koid_t GetKoidForHandle(mx_handle_t handle_value);
 
     bool IsHandleValid(mx_handle_t handle_value);
@@ -175,6 +208,8 @@ public:
     // Syscall helpers
     status_t GetInfo(mx_info_process_t* info);
     status_t GetStats(mx_info_task_stats_t* stats);
+    // Adds up the scheduler's counters for the live and exited threads.
+    void AddSchedStats(mx_info_thread_stats_t* stats);
     // NOTE: Code outside of the syscall layer should not typically know about
     // user_ptrs; do not use this pattern as an example.
     status_t GetAspaceMaps(user_ptr<mx_info_maps_t> maps, size_t max,
@@ -185,6 +220,8 @@ public:
                               mx_rights_t* out_rights);
 
     status_t GetThreads(mxtl::Array<mx_koid_t>* threads);
+    // Like GetThreads, but takes references to the threads themselves.
+    status_t GetUserThreads(mxtl::Array<mxtl::RefPtr<UserThread>>* threads);
 
     // exception handling support
     status_t SetExceptionPort(mxtl::RefPtr<ExceptionPort> eport);
@@ -242,6 +279,12 @@ private:
     ProcessDispatcher& operator=(const ProcessDispatcher&) = delete;
 
 
+    // Maps a handle value to a Handle owned by this process without taking
+    // |handle_table_lock_|. Must be called inside a HandleReadGuard. Returns
+    // nullptr if the value is not in |handle_table_|, which callers confirm
+    // with GetHandleLocked().
+    Handle* GetHandleLockFree(mx_handle_t handle_value) const;
+
     mx_status_t GetDispatcherInternal(mx_handle_t handle_value, mxtl::RefPtr<Dispatcher>* dispatcher,
                                       mx_rights_t* rights);
 
@@ -249,6 +292,11 @@ private:
                                                 mxtl::RefPtr<Dispatcher>* dispatcher_out,
                                                 mx_rights_t* out_rights);
 
+    mx_status_t GetBorrowedDispatcherInternal(mx_handle_t handle_value,
+                                              mx_rights_t desired_rights,
+                                              Dispatcher** dispatcher_out,
+                                              mx_rights_t* out_rights);
+
     // Thread lifecycle support
     friend class UserThread;
     status_t AddThread(UserThread* t, bool initial_thread);
@@ -276,12 +324,17 @@ private:
     // list of threads in this process
     mxtl::DoublyLinkedList<UserThread*> thread_list_ TA_GUARDED(state_lock_);
 
+    // scheduler counters of the threads which have left |thread_list_|
+    mx_info_thread_stats_t exited_sched_stats_ TA_GUARDED(state_lock_) = {};
+
     // our address space
     mxtl::RefPtr<VmAspace> aspace_;
 
-    // our list of handles
+    // our list of handles, and the same handles indexed for lookups which do
+    // not take the lock. |handle_table_| is only modified with the lock held.
     mutable Mutex handle_table_lock_; // protects |handles_|.
     mxtl::DoublyLinkedList<Handle*> handles_ TA_GUARDED(handle_table_lock_);
+    HandleTable handle_table_;
 
     StateTracker state_tracker_;
 
@@ -17,7 +17,9 @@ public:
     Semaphore(const Semaphore&) = delete;
     Semaphore& operator=(const Semaphore&) = delete;
 
-    int Post();
+    // Wakes at most one waiter. The oldest waiter is woken unless
+    // |wake_newest| is set, in which case the most recent one is.
+    int Post(bool wake_newest = false);
     status_t Wait(lk_time_t deadline);
 
 private:
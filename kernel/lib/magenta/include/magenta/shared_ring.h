@@ -0,0 +1,60 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <kernel/vm/vm_object.h>
+#include <lib/user_copy/user_ptr.h>
+
+#include <magenta/types.h>
+
+#include <mxtl/ref_ptr.h>
+
+// The kernel's end of a ring that lives in a VMO shared with user space, as
+// used by MX_SOCKET_SHARED_RING sockets and MX_FIFO_SHARED_RING fifos. The
+// VMO starts with a header holding the ring's indices, and the data follows
+// at a fixed offset.
+//
+// The ring has no kernel mapping. The header and data are only accessed
+// through the VmObject, so that whatever user space does to the VMO can't
+// fault the kernel. It can still write anything to the header, so callers
+// have to keep whatever they load in range themselves.
+class SharedRing {
+public:
+    // Creates a VMO with |data_size| bytes of data after |data_offset| and
+    // writes |header| to its start.
+    mx_status_t Init(const void* header, size_t header_size, uint64_t data_offset,
+                     size_t data_size);
+
+    const mxtl::RefPtr<VmObject>& vmo() const { return vmo_; }
+
+    // Index fields of the header. A load from a VMO user space shrank
+    // returns 0.
+    template <typename T>
+    T LoadIndex(size_t field_offset) const {
+        T index = 0;
+        vmo_->Read(&index, field_offset, sizeof(index), nullptr);
+        return index;
+    }
+    template <typename T>
+    void StoreIndex(size_t field_offset, T index) {
+        vmo_->Write(&index, field_offset, sizeof(index), nullptr);
+    }
+
+    // Copies |len| bytes between the data at |offset| and a kernel or user
+    // buffer.
+    mx_status_t Read(uint64_t offset, void* dst, size_t len) const;
+    mx_status_t Write(uint64_t offset, const void* src, size_t len);
+    mx_status_t ReadUser(uint64_t offset, user_ptr<void> dst, size_t len) const;
+    mx_status_t WriteUser(uint64_t offset, user_ptr<const void> src, size_t len);
+
+private:
+    mxtl::RefPtr<VmObject> vmo_;
+    uint64_t data_offset_ = 0u;
+};
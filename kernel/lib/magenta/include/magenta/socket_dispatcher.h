@@ -6,11 +6,13 @@
 
 #pragma once
 
+#include <iovec.h>
 #include <stdint.h>
 
 #include <kernel/mutex.h>
 
 #include <magenta/dispatcher.h>
+#include <magenta/shared_ring.h>
 #include <magenta/state_tracker.h>
 #include <magenta/types.h>
 
@@ -40,41 +42,72 @@ public:
     mx_status_t Write(const void* src, size_t len, bool from_user,
                       size_t* written);
 
+    // Like Write() but gathers the data from |iov_cnt| segments, copying
+    // each straight into the buffer. Stops at the first segment that does
+    // not fit entirely.
+    mx_status_t WriteV(const iovec_t* iov, uint iov_cnt, bool from_user,
+                       size_t* written);
+
     status_t HalfClose();
 
     mx_status_t Read(void* dest, size_t len, bool from_user,
                      size_t* nread);
 
+    // For MX_SOCKET_SHARED_RING sockets, returns the ring this end reads
+    // from in |rx| and the ring it writes to in |tx|.
+    mx_status_t GetRings(mxtl::RefPtr<VmObject>* rx, mxtl::RefPtr<VmObject>* tx);
+
+    // Called after user space moved the indices of either shared ring, to
+    // bring the signals of both ends up to date.
+    mx_status_t RingUpdate();
+
     void OnPeerZeroHandles();
 
 private:
     class CBuf {
     public:
         ~CBuf();
-        bool Init(uint32_t len);
+        bool Init(uint32_t len, bool shared);
         size_t Write(const void* src, size_t len, bool from_user);
         size_t Read(void* dest, size_t len, bool from_user);
         size_t CouldRead() const;
         size_t free() const;
         bool empty() const;
 
+        // Shared rings only: picks up the indices published by user space.
+        // Must be called before looking at the state of the buffer.
+        void Load();
+        bool shared() const { return shared_; }
+        const mxtl::RefPtr<VmObject>& ring_vmo() const { return ring_.vmo(); }
+
     private:
+        void Copy(uint64_t offset, void* dest, size_t len, bool from_user);
+        void Copy(const void* src, uint64_t offset, size_t len, bool from_user);
+        void StoreIndex(size_t field_offset, size_t index);
+
         size_t head_ = 0u;
         size_t tail_ = 0u;
         uint32_t len_pow2_ = 0u;
+        bool shared_ = false;
+        SharedRing ring_;
         mxtl::RefPtr<VmMapping> mapping_;
         mxtl::RefPtr<VmObject> vmo_;
     };
 
     SocketDispatcher(uint32_t flags);
     mx_status_t Init(mxtl::RefPtr<SocketDispatcher> other);
-    mx_status_t WriteSelf(const void* src, size_t len, bool from_user,
+    mxtl::RefPtr<VmObject> RingVmo();
+    void SyncRing();
+    void SyncRingLocked() TA_REQ(lock_);
+    mx_status_t WriteSelf(const iovec_t* iov, uint iov_cnt, bool from_user,
                           size_t* nwritten);
     status_t UserSignalSelf(uint32_t clear_mask, uint32_t set_mask);
     status_t HalfCloseOther();
 
     mxtl::Canary<mxtl::magic("SOCK")> canary_;
 
+    const uint32_t flags_;
+
     mx_koid_t peer_koid_;
     StateTracker state_tracker_;
 
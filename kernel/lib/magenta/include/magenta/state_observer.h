@@ -28,7 +28,12 @@ public:
         } entry[2];
     };
 
-    explicit StateObserver() : remove_(false) { }
+    // |trigger_mask| is the set of signals whose changes this observer cares about.
+    // StateTracker skips OnStateChange() when none of them changed.
+    explicit StateObserver(mx_signals_t trigger_mask = ~0u)
+        : remove_(false), trigger_mask_(trigger_mask) { }
+
+    mx_signals_t trigger_mask() const { return trigger_mask_; }
 
     // Called when this object is added to a StateTracker, to give it the initial state.
     // Note that |cinfo| might be null. Returns true if a thread was awoken.
@@ -66,6 +71,7 @@ protected:
 
 private:
     mxtl::Canary<mxtl::magic("SOBS")> canary_;
+    const mx_signals_t trigger_mask_;
 
     friend struct StateObserverListTraits;
     mxtl::DoublyLinkedListNodeState<StateObserver*> state_observer_list_node_state_;
@@ -12,6 +12,7 @@
 #include <kernel/spinlock.h>
 #include <magenta/state_observer.h>
 #include <magenta/types.h>
+#include <mxtl/atomic.h>
 #include <mxtl/canary.h>
 #include <mxtl/intrusive_double_list.h>
 
@@ -26,7 +27,7 @@ public:
 
 class StateTracker {
 public:
-    StateTracker(mx_signals_t signals = 0u) : signals_(signals) { }
+    StateTracker(mx_signals_t signals = 0u) : signals_(signals), watched_(0u) { }
 
     StateTracker(const StateTracker& o) = delete;
     StateTracker& operator=(const StateTracker& o) = delete;
@@ -53,7 +54,7 @@ public:
     // manner.  Waiters on strobe_mask will wake, but the tracked state is unmodified.
     void StrobeState(mx_signals_t strobe_mask);
 
-    mx_signals_t GetSignalsState() { return signals_; }
+    mx_signals_t GetSignalsState() { return signals_.load(); }
 
     using ObserverList = mxtl::DoublyLinkedList<StateObserver*, StateObserverListTraits>;
 
@@ -68,7 +69,15 @@ public:
 private:
     mxtl::Canary<mxtl::magic("STRK")> canary_;
 
-    mx_signals_t signals_;
+    // Written lock free by UpdateState(), so that objects nobody is waiting on
+    // never touch |lock_|.
+    mxtl::atomic<mx_signals_t> signals_;
+
+    // Union of the trigger masks of |observers_|. Grows in AddObserver() and is
+    // recomputed by every walk of the list, so it can have stale bits but never
+    // misses one. UpdateState() skips the walk when no changed signal is in it.
+    mxtl::atomic<mx_signals_t> watched_;
+
     Mutex lock_;
 
     // Active observers are elements in |observers_|.
@@ -8,6 +8,7 @@
 
 #include <magenta/dispatcher.h>
 #include <magenta/syscalls/exception.h>
+#include <magenta/syscalls/profile.h>
 #include <magenta/user_thread.h>
 #include <mxtl/canary.h>
 #include <sys/types.h>
@@ -28,12 +29,16 @@ public:
     void Kill() { thread_->Kill(); }
 
     status_t GetInfo(mx_info_thread_t* info);
+    status_t GetSchedStats(mx_info_thread_stats_t* stats);
 
     status_t GetExceptionReport(mx_exception_report_t* report);
 
     mx_status_t Resume() { return thread_->Resume(); }
     mx_status_t Suspend() { return thread_->Suspend(); }
 
+    // Switch the thread between the priority and deadline scheduling classes.
+    status_t SetProfile(const mx_profile_t& profile);
+
     StateTracker* get_state_tracker() final;
 
     // TODO(dje): Was private. Needed for exception handling.
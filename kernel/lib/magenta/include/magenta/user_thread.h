@@ -23,13 +23,18 @@
 #include <mxtl/intrusive_double_list.h>
 #include <mxtl/ref_counted.h>
 #include <mxtl/ref_ptr.h>
+#include <mxtl/slab_allocator.h>
 #include <mxtl/string_piece.h>
 
 class ProcessDispatcher;
 class ThreadDispatcher;
+class UserThread;
+
+using UserThreadAllocatorTraits = mxtl::StaticSlabAllocatorTraits<mxtl::RefPtr<UserThread>>;
 
 class UserThread : public mxtl::DoublyLinkedListable<UserThread*>
-                 , public mxtl::RefCounted<UserThread> {
+                 , public mxtl::RefCounted<UserThread>
+                 , public mxtl::SlabAllocated<UserThreadAllocatorTraits> {
 public:
     // state of the thread
     enum class State {
@@ -102,6 +107,18 @@ public:
     status_t set_name(const char* name, size_t len);
     void get_name(char out_name[MX_MAX_NAME_LEN]);
     uint64_t runtime_ns() const { return thread_runtime(&thread_); }
+    // Add the scheduler's counters for this thread to |stats|.
+    void AddSchedStats(mx_info_thread_stats_t* stats) const;
+
+    // Move the thread into the deadline scheduling class, or back to the
+    // priority class if |params| is null.
+    status_t SetDeadline(const thread_deadline_params* params) {
+        return thread_set_deadline(&thread_, params);
+    }
+
+    // Priority inheritance, see thread_inherit_priority().
+    void InheritPriority(int priority) { thread_inherit_priority(&thread_, priority); }
+    void DisinheritPriority(int priority) { thread_disinherit_priority(&thread_, priority); }
 
     status_t SetExceptionPort(ThreadDispatcher* td, mxtl::RefPtr<ExceptionPort> eport);
     // Returns true if a port had been set.
@@ -123,6 +140,20 @@ public:
                                       ExceptionStatus* out_estatus);
     // Called when an exception handler is finished processing the exception.
     status_t MarkExceptionHandled(ExceptionStatus estatus);
+
+    // The in-thread exception handler, see mx_exception_handler_t.
+    // These must only be called on the current thread.
+    status_t SetExceptionHandler(const mx_exception_handler_t& handler);
+    // If the thread has an in-thread exception handler and isn't already
+    // running it, saves the thread's state on the handler's stack and sets the
+    // thread up to resume in the handler. Returns true if it did.
+    bool StartExceptionUpcall(const mx_exception_report_t* report,
+                              const arch_exception_context_t* arch_context);
+    // If the exception is the in-thread exception handler returning, sets the
+    // thread up to resume with the state saved on the handler's stack.
+    // Returns true if it did.
+    bool FinishExceptionUpcall(const mx_exception_report_t* report,
+                               const arch_exception_context_t* arch_context);
     // Called when exception port |eport| is removed.
     // If the thread is waiting for the associated exception handler, continue
     // exception processing as if the exception port had not been installed.
@@ -222,6 +253,12 @@ private:
     // cleanup dpc structure
     dpc_t cleanup_dpc_ = {};
 
+    // The in-thread exception handler, and the address of the frame it was
+    // passed if it is running (zero otherwise). Only used by the thread
+    // itself.
+    mx_exception_handler_t exception_handler_ = {};
+    uintptr_t exception_upcall_frame_ = 0;
+
     // Used to protect thread name read/writes
     SpinLock name_lock_;
 
@@ -247,4 +284,6 @@ private:
     thread_t thread_ = {};
 };
 
+FWD_DECL_STATIC_SLAB_ALLOCATOR(UserThreadAllocatorTraits);
+
 const char* StateToString(UserThread::State state);
@@ -8,7 +8,9 @@
 
 #include <magenta/dispatcher.h>
 #include <magenta/state_tracker.h>
+#include <kernel/mutex.h>
 #include <mxtl/canary.h>
+#include <mxtl/vector.h>
 
 #include <lib/user_copy/user_ptr.h>
 
@@ -34,6 +36,7 @@ public:
     mx_status_t SetSize(uint64_t);
     mx_status_t GetSize(uint64_t* size);
     mx_status_t RangeOp(uint32_t op, uint64_t offset, uint64_t size, user_ptr<void> buffer, size_t buffer_size);
+    mx_status_t SetCachePolicy(uint32_t cache_policy);
     mx_status_t Clone(uint32_t options, uint64_t offset, uint64_t size, mxtl::RefPtr<VmObject>* clone_vmo);
 
     mxtl::RefPtr<VmObject> vmo() const { return vmo_; }
@@ -41,8 +44,21 @@ public:
 private:
     explicit VmObjectDispatcher(mxtl::RefPtr<VmObject> vmo);
 
+    // MX_VMO_OP_LOCK and MX_VMO_OP_UNLOCK of objects that aren't discardable
+    mx_status_t Pin(uint64_t offset, uint64_t size, user_ptr<void> buffer, size_t buffer_size);
+    mx_status_t Unpin(uint64_t offset, uint64_t size);
+
     mxtl::Canary<mxtl::magic("VMOD")> canary_;
     mxtl::RefPtr<VmObject> vmo_;
+
+    // the ranges pinned through us, given back when the last handle goes away
+    struct PinnedRange {
+        uint64_t offset;
+        uint64_t size;
+    };
+    Mutex pin_lock_;
+    mxtl::Vector<PinnedRange> pins_ TA_GUARDED(pin_lock_);
+
     StateTracker state_tracker_;
     CookieJar cookie_jar_;
 };
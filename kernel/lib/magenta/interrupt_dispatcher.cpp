@@ -0,0 +1,113 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <magenta/interrupt_dispatcher.h>
+
+#include <err.h>
+#include <platform.h>
+
+#include <kernel/thread.h>
+
+InterruptDispatcher::InterruptDispatcher()
+    : pending_count_(0u), pending_timestamp_(0u), dpc_busy_(false) {
+    event_init(&event_, false, 0);
+    spin_lock_init(&lock_);
+    dpc_ = {};
+    dpc_.func = DeliverDpc;
+    dpc_.arg = this;
+}
+
+InterruptDispatcher::~InterruptDispatcher() {
+    if (!port_)
+        return;
+
+    // Wait out a delivery in flight. Nothing can queue the dpc again now.
+    for (;;) {
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&lock_, state);
+        bool busy = dpc_busy_;
+        spin_unlock_irqrestore(&lock_, state);
+        if (!busy)
+            break;
+        thread_yield();
+    }
+    port_->CancelQueued(&port_packet_);
+}
+
+status_t InterruptDispatcher::WaitForInterrupt() {
+    canary_.Assert();
+
+    // Bound interrupts never signal the event.
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&lock_, state);
+    bool bound = port_ != nullptr;
+    spin_unlock_irqrestore(&lock_, state);
+    if (bound)
+        return ERR_BAD_STATE;
+
+    return event_wait_deadline(&event_, INFINITE_TIME, true);
+}
+
+status_t InterruptDispatcher::BindPort(mxtl::RefPtr<PortDispatcherV2> port, uint64_t key) {
+    canary_.Assert();
+
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&lock_, state);
+    if (port_) {
+        spin_unlock_irqrestore(&lock_, state);
+        return ERR_ALREADY_BOUND;
+    }
+    port_packet_.packet.key = key;
+    port_packet_.packet.type = MX_PKT_TYPE_INTERRUPT;
+    port_packet_.packet.status = NO_ERROR;
+    port_ = mxtl::move(port);
+    spin_unlock_irqrestore(&lock_, state);
+    return NO_ERROR;
+}
+
+int InterruptDispatcher::Fire(bool resched) {
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&lock_, state);
+    if (!port_) {
+        spin_unlock_irqrestore(&lock_, state);
+        return event_signal(&event_, resched);
+    }
+
+    if (pending_count_++ == 0u)
+        pending_timestamp_ = current_time();
+    if (!dpc_busy_) {
+        dpc_busy_ = true;
+        dpc_queue(&dpc_, false);
+    }
+    spin_unlock_irqrestore(&lock_, state);
+    return 0;
+}
+
+// static
+void InterruptDispatcher::DeliverDpc(dpc_t* dpc) {
+    InterruptDispatcher* thiz = reinterpret_cast<InterruptDispatcher*>(dpc->arg);
+
+    // Interrupts which fire while a packet is being queued are picked up by
+    // the next time around rather than by queueing the dpc again.
+    for (;;) {
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&thiz->lock_, state);
+        uint64_t count = thiz->pending_count_;
+        mx_time_t timestamp = thiz->pending_timestamp_;
+        thiz->pending_count_ = 0u;
+        if (count == 0u) {
+            // |thiz| may be destroyed as soon as this is dropped.
+            thiz->dpc_busy_ = false;
+            spin_unlock_irqrestore(&thiz->lock_, state);
+            return;
+        }
+        spin_unlock_irqrestore(&thiz->lock_, state);
+
+        // Fails only once the port has no handles left, then the interrupts
+        // have nowhere to go.
+        thiz->port_->QueueInterrupt(&thiz->port_packet_, timestamp, count);
+    }
+}
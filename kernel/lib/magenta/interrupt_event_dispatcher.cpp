@@ -88,7 +88,7 @@ status_t InterruptEventDispatcher::UserSignal() {
     canary_.Assert();
 
     mask_interrupt(vector_);
-    signal(true);
+    Fire(true);
     return NO_ERROR;
 }
 
@@ -98,7 +98,7 @@ enum handler_return InterruptEventDispatcher::IrqHandler(void* ctx) {
     // TODO(johngro): make sure that this is safe to do from an IRQ.
     mask_interrupt(thiz->vector_);
 
-    if (thiz->signal() > 0) {
+    if (thiz->Fire() > 0) {
         return INT_RESCHEDULE;
     } else {
         return INT_NO_RESCHEDULE;
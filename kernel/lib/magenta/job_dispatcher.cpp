@@ -11,6 +11,10 @@
 
 #include <kernel/auto_lock.h>
 
+#if ARCH_X86_64
+#include <arch/x86/rdt.h>
+#endif
+
 #include <magenta/process_dispatcher.h>
 #include <magenta/syscalls/policy.h>
 
@@ -20,8 +24,13 @@ constexpr mx_rights_t kDefaultJobRights =
     MX_RIGHT_SET_POLICY | MX_RIGHT_GET_POLICY;
 
 mxtl::RefPtr<JobDispatcher> JobDispatcher::CreateRootJob() {
+    auto memory_account = MemoryAccount::Create(nullptr);
+    if (!memory_account)
+        return nullptr;
+
     AllocChecker ac;
-    auto job = mxtl::AdoptRef(new (&ac) JobDispatcher(0u, nullptr, kPolicyEmpty));
+    auto job = mxtl::AdoptRef(new (&ac) JobDispatcher(0u, nullptr, kPolicyEmpty,
+                                                      mxtl::move(memory_account)));
     return ac.check() ? job  : nullptr;
 }
 
@@ -29,10 +38,21 @@ status_t JobDispatcher::Create(uint32_t flags,
                                mxtl::RefPtr<JobDispatcher> parent,
                                mxtl::RefPtr<Dispatcher>* dispatcher,
                                mx_rights_t* rights) {
+    auto memory_account = MemoryAccount::Create(parent->memory_account());
+    if (!memory_account)
+        return ERR_NO_MEMORY;
+
     AllocChecker ac;
-    auto job = new (&ac) JobDispatcher(flags, parent, parent->GetPolicy());
+    auto job = new (&ac) JobDispatcher(flags, parent, parent->GetPolicy(),
+                                       mxtl::move(memory_account));
     if (!ac.check())
         return ERR_NO_MEMORY;
+    job->set_compress_memory(parent->compress_memory());
+    {
+        uint64_t rdt_group = parent->AcquireRdtGroup();
+        AutoLock lock(&job->lock_);
+        job->rdt_group_ = rdt_group;
+    }
 
     if (!parent->AddChildJob(job)) {
         delete job;
@@ -46,17 +66,26 @@ status_t JobDispatcher::Create(uint32_t flags,
 
 JobDispatcher::JobDispatcher(uint32_t /*flags*/,
                              mxtl::RefPtr<JobDispatcher> parent,
-                             pol_cookie_t policy)
+                             pol_cookie_t policy,
+                             mxtl::RefPtr<MemoryAccount> memory_account)
     : parent_(mxtl::move(parent)),
       state_(State::READY),
       process_count_(0u), job_count_(0u),
       state_tracker_(MX_JOB_NO_PROCESSES|MX_JOB_NO_JOBS),
-      policy_(policy) {
+      policy_(policy),
+      memory_account_(mxtl::move(memory_account)) {
+    sched_group_init(&sched_group_, parent_ ? &parent_->sched_group_ : nullptr);
+    memory_account_->set_observer(this);
 }
 
 JobDispatcher::~JobDispatcher() {
+    // VMOs may outlive the job and keep charging the account.
+    memory_account_->set_observer(nullptr);
     if (parent_)
         parent_->RemoveChildJob(this);
+#if ARCH_X86_64
+    x86_rdt_group_release(rdt_group_);
+#endif
 }
 
 void JobDispatcher::on_zero_handles() {
@@ -160,6 +189,96 @@ pol_cookie_t JobDispatcher::GetPolicy() {
     return policy_;
 }
 
+bool JobDispatcher::compress_memory() {
+    AutoLock lock(&lock_);
+    return compress_memory_;
+}
+
+void JobDispatcher::set_compress_memory(bool compress) {
+    AutoLock lock(&lock_);
+    compress_memory_ = compress;
+}
+
+status_t JobDispatcher::SetRdtPolicy(uint32_t mode, const mx_policy_rdt* policy) {
+#if ARCH_X86_64
+    if (policy->reserved != 0u)
+        return ERR_INVALID_ARGS;
+
+    // Can't set policy when there are active processes or jobs.
+    AutoLock lock(&lock_);
+
+    if (!procs_.is_empty() || !jobs_.is_empty())
+        return ERR_BAD_STATE;
+
+    uint64_t group;
+    auto status = x86_rdt_group_create(policy->l3_mask, policy->mba_delay,
+                                       mode == MX_JOB_POL_ABSOLUTE, &group);
+    if (status != NO_ERROR)
+        return status;
+
+    x86_rdt_group_release(rdt_group_);
+    rdt_group_ = group;
+    return NO_ERROR;
+#else
+    return ERR_NOT_SUPPORTED;
+#endif
+}
+
+status_t JobDispatcher::SetCpuPolicy(const mx_policy_cpu* policy) {
+    if (policy->reserved != 0u)
+        return ERR_INVALID_ARGS;
+    if ((policy->quota == 0u) != (policy->period == 0u))
+        return ERR_INVALID_ARGS;
+
+    return sched_group_set(&sched_group_, policy->weight, policy->quota, policy->period);
+}
+
+status_t JobDispatcher::SetMemoryPolicy(const mx_policy_memory* policy) {
+    if (policy->soft_limit != 0u && policy->hard_limit != 0u &&
+        policy->soft_limit > policy->hard_limit)
+        return ERR_INVALID_ARGS;
+
+    memory_account_->SetLimits(policy->soft_limit, policy->hard_limit);
+    return NO_ERROR;
+}
+
+void JobDispatcher::GetMemoryInfo(mx_info_job_memory_t* info) const {
+    info->committed_bytes = memory_account_->usage_bytes();
+    memory_account_->GetLimits(&info->soft_limit, &info->hard_limit);
+    info->failed_commits = memory_account_->failed_charges();
+}
+
+void JobDispatcher::OnMemoryLimits(bool over_soft_limit, bool hit_hard_limit) {
+    mx_signals_t set = 0u;
+    if (over_soft_limit)
+        set |= MX_JOB_MEMORY_OVER_SOFT_LIMIT;
+    if (hit_hard_limit)
+        set |= MX_JOB_MEMORY_HARD_LIMIT;
+    state_tracker_.UpdateState(
+        (MX_JOB_MEMORY_OVER_SOFT_LIMIT | MX_JOB_MEMORY_HARD_LIMIT) & ~set, set);
+}
+
+uint64_t JobDispatcher::rdt_group() {
+    AutoLock lock(&lock_);
+    return rdt_group_;
+}
+
+uint64_t JobDispatcher::AcquireRdtGroup() {
+    AutoLock lock(&lock_);
+#if ARCH_X86_64
+    x86_rdt_group_acquire(rdt_group_);
+#endif
+    return rdt_group_;
+}
+
+status_t JobDispatcher::GetCacheOccupancy(uint64_t* l3_bytes) {
+#if ARCH_X86_64
+    return x86_rdt_group_occupancy(rdt_group(), l3_bytes);
+#else
+    return ERR_NOT_SUPPORTED;
+#endif
+}
+
 void JobDispatcher::Kill() {
     canary_.Assert();
 
@@ -244,6 +363,57 @@ bool JobDispatcher::EnumerateChildren(JobEnumerator* je, bool recurse) {
     return true;
 }
 
+status_t JobDispatcher::GetChildren(mxtl::Array<mxtl::RefPtr<ProcessDispatcher>>* out_procs,
+                                    mxtl::Array<mxtl::RefPtr<JobDispatcher>>* out_jobs) {
+    canary_.Assert();
+
+    AutoLock lock(&lock_);
+    AllocChecker ac;
+    size_t num_procs = procs_.size_slow();
+    mxtl::Array<mxtl::RefPtr<ProcessDispatcher>> procs(
+        new (&ac) mxtl::RefPtr<ProcessDispatcher>[num_procs], num_procs);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+    size_t num_jobs = jobs_.size_slow();
+    mxtl::Array<mxtl::RefPtr<JobDispatcher>> jobs(
+        new (&ac) mxtl::RefPtr<JobDispatcher>[num_jobs], num_jobs);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    size_t i = 0;
+    for (auto& proc : procs_) {
+        procs[i++] = mxtl::RefPtr<ProcessDispatcher>(&proc);
+    }
+    i = 0;
+    for (auto& job : jobs_) {
+        jobs[i++] = mxtl::RefPtr<JobDispatcher>(&job);
+    }
+    *out_procs = mxtl::move(procs);
+    *out_jobs = mxtl::move(jobs);
+    return NO_ERROR;
+}
+
+status_t JobDispatcher::AddSchedStats(mx_info_thread_stats_t* stats) {
+    canary_.Assert();
+
+    mxtl::Array<mxtl::RefPtr<ProcessDispatcher>> procs;
+    mxtl::Array<mxtl::RefPtr<JobDispatcher>> jobs;
+    status_t status = GetChildren(&procs, &jobs);
+    if (status != NO_ERROR)
+        return status;
+
+    for (size_t i = 0; i < procs.size(); i++) {
+        procs[i]->AddSchedStats(stats);
+    }
+    for (size_t i = 0; i < jobs.size(); i++) {
+        // Like EnumerateChildren, this recurses as deep as the job tree.
+        status = jobs[i]->AddSchedStats(stats);
+        if (status != NO_ERROR)
+            return status;
+    }
+    return NO_ERROR;
+}
+
 mxtl::RefPtr<ProcessDispatcher> JobDispatcher::LookupProcessById(mx_koid_t koid) {
     canary_.Assert();
 
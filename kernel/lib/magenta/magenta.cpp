@@ -9,9 +9,12 @@
 #include <pow2.h>
 #include <trace.h>
 
+#include <arch/ops.h>
+
 #include <kernel/auto_lock.h>
 #include <kernel/cmdline.h>
 #include <kernel/mutex.h>
+#include <kernel/rcu.h>
 
 #include <lk/init.h>
 
@@ -21,6 +24,7 @@
 #include <magenta/excp_port.h>
 #include <magenta/job_dispatcher.h>
 #include <magenta/handle.h>
+#include <magenta/handle_reaper.h>
 #include <magenta/policy_manager.h>
 #include <magenta/process_dispatcher.h>
 #include <magenta/resource_dispatcher.h>
@@ -37,9 +41,6 @@
 
 #define LOCAL_TRACE 0
 
-// The number of possible handles in the arena.
-constexpr size_t kMaxHandleCount = 256 * 1024u;
-
 // Warning level: high_handle_count() is called when
 // there are this many outstanding handles.
 constexpr size_t kHighHandleCount = (kMaxHandleCount * 7) / 8;
@@ -47,7 +48,27 @@ constexpr size_t kHighHandleCount = (kMaxHandleCount * 7) / 8;
 // The handle arena and its mutex.
 static Mutex handle_mutex;
 static mxtl::Arena TA_GUARDED(handle_mutex) handle_arena;
-static size_t outstanding_handles TA_GUARDED(handle_mutex) = 0u;
+static size_t outstanding_handles = 0u;
+
+// Free handle slots are cached per cpu in front of the arena so that making
+// and deleting handles doesn't contend on |handle_mutex|. An empty magazine
+// is refilled, and a full one drained, |kHandleMagazineBatch| slots at a time.
+constexpr size_t kHandleMagazineSize = 64u;
+constexpr size_t kHandleMagazineBatch = kHandleMagazineSize / 2;
+
+struct HandleMagazine {
+    SpinLock lock;
+    size_t count = 0u;                    // protected by |lock|
+    void* slots[kHandleMagazineSize] = {}; // protected by |lock|
+} __CPU_ALIGN;
+static HandleMagazine handle_magazines[SMP_MAX_CPUS];
+
+// Per cpu count of HandleReadGuards begun and ended, odd while one is alive on
+// that cpu. Only ever written by its own cpu with interrupts disabled.
+struct HandleReadSeq {
+    uint32_t seq;
+} __CPU_ALIGN;
+static HandleReadSeq handle_read_seq[SMP_MAX_CPUS];
 
 // The system exception port.
 static mutex_t system_exception_mutex = MUTEX_INITIAL_VALUE(system_exception_mutex);
@@ -99,8 +120,9 @@ static_assert(((3 << 30) ^ kHandleGenerationMask ^ kHandleIndexMask) ==
 // Returns a new |base_value| based on the value stored in the free
 // |handle_arena| slot pointed to by |addr|. The new value will be different
 // from the last |base_value| used by this slot.
-static uint32_t GetNewHandleBaseValue(void* addr) TA_REQ(handle_mutex) {
-    // Get the index of this slot within handle_arena.
+static uint32_t GetNewHandleBaseValue(void* addr) TA_NO_THREAD_SAFETY_ANALYSIS {
+    // Get the index of this slot within handle_arena. The arena never moves,
+    // and the free slot belongs to the caller.
     auto va = reinterpret_cast<Handle*>(addr) -
               reinterpret_cast<Handle*>(handle_arena.start());
     uint32_t handle_index = static_cast<uint32_t>(va);
@@ -120,12 +142,56 @@ static uint32_t GetNewHandleBaseValue(void* addr) TA_REQ(handle_mutex) {
     return (((old_gen + 1) << kHandleGenerationShift) & kHandleGenerationMask) | handle_index;
 }
 
+HandleReadGuard::HandleReadGuard() {
+    arch_interrupt_save(&irq_state_, SPIN_LOCK_FLAG_INTERRUPTS);
+    cpu_ = arch_curr_cpu_num();
+    __atomic_store_n(&handle_read_seq[cpu_].seq, handle_read_seq[cpu_].seq + 1, __ATOMIC_RELAXED);
+    // Order the count before any load of the table or the Handle.
+    smp_mb();
+}
+
+HandleReadGuard::~HandleReadGuard() {
+    // Order all uses of the Handle before the count.
+    smp_mb();
+    __atomic_store_n(&handle_read_seq[cpu_].seq, handle_read_seq[cpu_].seq + 1, __ATOMIC_RELAXED);
+    arch_interrupt_restore(irq_state_, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
+// Waits until every HandleReadGuard that was alive on entry has ended. Guards
+// only cover a few loads and a reference count increment, so this spins.
+static void WaitForHandleReaders() {
+    // Order the removal of the Handle from its process before sampling.
+    smp_mb();
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; ++cpu) {
+        uint32_t seq = __atomic_load_n(&handle_read_seq[cpu].seq, __ATOMIC_ACQUIRE);
+        if (!(seq & 1))
+            continue;
+        while (__atomic_load_n(&handle_read_seq[cpu].seq, __ATOMIC_ACQUIRE) == seq)
+            arch_spinloop_pause();
+    }
+}
+
+HandleBorrowGuard::HandleBorrowGuard() : token_(rcu_read_lock()) {}
+
+HandleBorrowGuard::~HandleBorrowGuard() {
+    rcu_read_unlock(token_);
+}
+
+// Gives back the Handle's count of handles to its Dispatcher, which runs the
+// Dispatcher's on_zero_handles() if it was the last one.
+void internal::RetireHandle(Handle* handle) {
+    handle->dispatcher_->remove_handle();
+}
+
 // Destroys, but does not free, the Handle, and fixes up its memory to protect
 // against stale pointers to it. Also stashes the Handle's base_value for reuse
 // the next time this slot is allocated.
 void internal::TearDownHandle(Handle *handle) TA_EXCL(handle_mutex) {
     uint32_t base_value = handle->base_value();
 
+    // Lock free lookups may still be using the Handle, see HandleReadGuard.
+    WaitForHandleReaders();
+
     // Calling the handle dtor can cause many things to happen, so it is
     // important to call it outside the lock.
     handle->~Handle();
@@ -148,44 +214,107 @@ void internal::TearDownHandle(Handle *handle) TA_EXCL(handle_mutex) {
 
 static void high_handle_count(size_t count) {
     // TODO: Avoid calling this for every handle after kHighHandleCount;
-    // printfs are slow and |handle_mutex| is held by our caller.
+    // printfs are slow.
     printf("WARNING: High handle count: %zu handles\n", count);
 }
 
-Handle* MakeHandle(mxtl::RefPtr<Dispatcher> dispatcher, mx_rights_t rights) {
+// Puts as many of |slots| as fit into the current cpu's magazine and returns
+// how many were left over.
+static size_t StashHandleSlots(void** slots, size_t count) {
+    HandleMagazine& mag = handle_magazines[arch_curr_cpu_num()];
+    AutoSpinLockIrqSave lock(mag.lock);
+    while (count > 0 && mag.count < kHandleMagazineSize)
+        mag.slots[mag.count++] = slots[--count];
+    return count;
+}
+
+static void FreeHandleSlots(void** slots, size_t count) {
     AutoLock lock(&handle_mutex);
-    void* addr = handle_arena.Alloc();
+    for (size_t i = 0; i < count; ++i)
+        handle_arena.Free(slots[i]);
+}
+
+static void* AllocHandleSlot() {
+    {
+        HandleMagazine& mag = handle_magazines[arch_curr_cpu_num()];
+        AutoSpinLockIrqSave lock(mag.lock);
+        if (likely(mag.count > 0))
+            return mag.slots[--mag.count];
+    }
+
+    // Our magazine is empty, refill it from the arena.
+    void* batch[kHandleMagazineBatch];
+    size_t count = 0u;
+    {
+        AutoLock lock(&handle_mutex);
+        while (count < kHandleMagazineBatch) {
+            void* addr = handle_arena.Alloc();
+            if (addr == nullptr)
+                break;
+            batch[count++] = addr;
+        }
+    }
+    if (count == 0u)
+        return nullptr;
+
+    void* addr = batch[--count];
+    // We may have migrated to a cpu whose magazine has filled up meanwhile.
+    size_t left = StashHandleSlots(batch, count);
+    if (unlikely(left > 0))
+        FreeHandleSlots(batch, left);
+    return addr;
+}
+
+static void FreeHandleSlot(void* addr) {
+    void* batch[kHandleMagazineBatch];
+    {
+        HandleMagazine& mag = handle_magazines[arch_curr_cpu_num()];
+        AutoSpinLockIrqSave lock(mag.lock);
+        if (likely(mag.count < kHandleMagazineSize)) {
+            mag.slots[mag.count++] = addr;
+            return;
+        }
+
+        // Our magazine is full, drain half of it back to the arena.
+        mag.count -= kHandleMagazineBatch;
+        memcpy(batch, &mag.slots[mag.count], sizeof(batch));
+        mag.slots[mag.count++] = addr;
+    }
+    FreeHandleSlots(batch, kHandleMagazineBatch);
+}
+
+// Returns a free slot for a new Handle and its base_value, or nullptr.
+static void* NewHandleSlot(uint32_t* base_value, const char* what) {
+    void* addr = AllocHandleSlot();
+    size_t oh = __atomic_add_fetch(&outstanding_handles, addr ? 1u : 0u, __ATOMIC_RELAXED);
     if (addr == nullptr) {
-        const auto oh = outstanding_handles;
-        lock.release();
-        printf("WARNING: Could not allocate new handle (%zu outstanding)\n",
-               oh);
+        printf("WARNING: Could not allocate %s handle (%zu outstanding)\n", what, oh);
         return nullptr;
     }
-    if (++outstanding_handles > kHighHandleCount)
-        high_handle_count(outstanding_handles);
-    uint32_t base_value = GetNewHandleBaseValue(addr);
+    if (oh > kHighHandleCount)
+        high_handle_count(oh);
+    *base_value = GetNewHandleBaseValue(addr);
+    return addr;
+}
+
+Handle* MakeHandle(mxtl::RefPtr<Dispatcher> dispatcher, mx_rights_t rights) {
+    uint32_t base_value;
+    void* addr = NewHandleSlot(&base_value, "new");
+    if (addr == nullptr)
+        return nullptr;
     return new (addr) Handle(mxtl::move(dispatcher), rights, base_value);
 }
 
 Handle* DupHandle(Handle* source, mx_rights_t rights) {
-    AutoLock lock(&handle_mutex);
-    void* addr = handle_arena.Alloc();
-    if (addr == nullptr) {
-        const auto oh = outstanding_handles;
-        lock.release();
-        printf(
-            "WARNING: Could not allocate duplicate handle (%zu outstanding)\n",
-            oh);
+    uint32_t base_value;
+    void* addr = NewHandleSlot(&base_value, "duplicate");
+    if (addr == nullptr)
         return nullptr;
-    }
-    if (++outstanding_handles > kHighHandleCount)
-        high_handle_count(outstanding_handles);
-    uint32_t base_value = GetNewHandleBaseValue(addr);
     return new (addr) Handle(source, rights, base_value);
 }
 
-void DeleteHandle(Handle* handle) {
+// Everything DeleteHandle() does short of freeing the slot.
+static void DestroyHandle(Handle* handle) {
     StateTracker* state_tracker = handle->dispatcher()->get_state_tracker();
     if (state_tracker) {
         state_tracker->Cancel(handle);
@@ -206,18 +335,56 @@ void DeleteHandle(Handle* handle) {
         };
     }
 
-    // Destroys, but does not free, the Handle, and fixes up its memory
-    // to protect against stale pointers to it. Also stashes the Handle's
-    // base_value for reuse the next time this slot is allocated.
+    // Give back the Dispatcher's handle count now, so that its peers and
+    // observers learn of the close as soon as they would without borrowers.
+    internal::RetireHandle(handle);
+}
+
+void DeleteHandle(Handle* handle) {
+    DestroyHandle(handle);
+
+    if (rcu_read_active()) {
+        RetireHandles(&handle, 1u);
+        return;
+    }
     internal::TearDownHandle(handle);
 
-    AutoLock lock(&handle_mutex);
-    --outstanding_handles;
-    handle_arena.Free(handle);
+    __atomic_sub_fetch(&outstanding_handles, 1u, __ATOMIC_RELAXED);
+    FreeHandleSlot(handle);
 }
 
-bool HandleInRange(void* addr) {
-    AutoLock lock(&handle_mutex);
+void DeleteHandles(Handle** handles, size_t count) {
+    for (size_t i = 0; i < count; ++i)
+        DestroyHandle(handles[i]);
+
+    // A borrower may still be using a Dispatcher these Handles hold the last
+    // reference to. Rather than wait for it here, let the reaper do it.
+    if (rcu_read_active()) {
+        RetireHandles(handles, count);
+        return;
+    }
+    internal::FreeRetiredHandles(handles, count);
+}
+
+void internal::FreeRetiredHandles(Handle** handles, size_t count) {
+    // Destroys, but does not free, the Handles, and fixes up their memory
+    // to protect against stale pointers to them. Also stashes each Handle's
+    // base_value for reuse the next time its slot is allocated.
+    for (size_t i = 0; i < count; ++i)
+        internal::TearDownHandle(handles[i]);
+
+    __atomic_sub_fetch(&outstanding_handles, count, __ATOMIC_RELAXED);
+
+    // Fill this cpu's magazine, and return what doesn't fit to the arena
+    // under a single acquisition of |handle_mutex|.
+    void** slots = reinterpret_cast<void**>(handles);
+    size_t left = StashHandleSlots(slots, count);
+    if (left > 0)
+        FreeHandleSlots(slots, left);
+}
+
+bool HandleInRange(void* addr) TA_NO_THREAD_SAFETY_ANALYSIS {
+    // The arena only ever grows, see Arena::in_range().
     return handle_arena.in_range(addr);
 }
 
@@ -230,8 +397,20 @@ Handle* MapU32ToHandle(uint32_t value) TA_NO_THREAD_SAFETY_ANALYSIS {
     return handle->base_value() == value ? handle : nullptr;
 }
 
+size_t GetOutstandingHandleCount() {
+    return __atomic_load_n(&outstanding_handles, __ATOMIC_RELAXED);
+}
+
 void internal::DumpHandleTableInfo() {
+    size_t cached = 0u;
+    for (auto& mag : handle_magazines) {
+        AutoSpinLockIrqSave lock(mag.lock);
+        cached += mag.count;
+    }
+
     AutoLock lock(&handle_mutex);
+    printf("%zu handles outstanding, %zu free slots cached per cpu\n",
+           __atomic_load_n(&outstanding_handles, __ATOMIC_RELAXED), cached);
     handle_arena.Dump();
 }
 
@@ -7,13 +7,161 @@
 #include <err.h>
 #include <new.h>
 
+#include <arch/ops.h>
+#include <kernel/vm.h>
+#include <kernel/vm/vm_address_region.h>
+#include <kernel/vm/vm_aspace.h>
+#include <kernel/vm/vm_object.h>
+#include <kernel/vm/vm_object_paged.h>
+
 #include <magenta/handle_reaper.h>
 #include <magenta/magenta.h>
 #include <magenta/message_packet.h>
+#include <magenta/process_dispatcher.h>
+
+#include <mxtl/slab_allocator.h>
 
 constexpr uint32_t kMaxMessageSize = 65536u;
 constexpr uint32_t kMaxMessageHandles = 1024u;
 
+// Below this the page table updates and tlb shootdowns of moving pages
+// cost more than simply copying the payload.
+constexpr uint32_t kMinMovePagesSize = 4u * PAGE_SIZE;
+
+// Small packets come from per cpu slab caches in a few size classes so the
+// channel write path doesn't contend on the heap lock. Each allocation is
+// preceded by a header recording where it has to be returned to.
+namespace {
+
+struct AllocationHeader {
+    uint16_t cpu;
+    uint16_t size_class;
+} __ALIGNED(alignof(MessagePacket));
+
+constexpr uint16_t kHeapSizeClass = UINT16_MAX;
+
+// Every size class has room for this many handles on top of its payload.
+constexpr size_t kSlabHandleSlots = 4u;
+
+template <size_t DataSize, size_t SlabSize, size_t MaxSlabs>
+class MessageSizeClass {
+public:
+    static constexpr size_t kCapacity = DataSize + kSlabHandleSlots * sizeof(Handle*);
+    static constexpr size_t kBlockSize =
+        sizeof(AllocationHeader) + sizeof(MessagePacket) + kCapacity;
+
+    static void* Alloc(uint cpu) {
+        Block* block = slabs_[cpu].allocator.New();
+        if (!block)
+            return nullptr;
+        DEBUG_ASSERT(static_cast<void*>(block->storage) == static_cast<void*>(block));
+        return block->storage;
+    }
+
+    static void Free(uint cpu, void* ptr) {
+        slabs_[cpu].allocator.Delete(reinterpret_cast<Block*>(ptr));
+    }
+
+private:
+    struct Block;
+    using Traits = mxtl::ManualDeleteSlabAllocatorTraits<Block*, SlabSize>;
+
+    struct Block : public mxtl::SlabAllocated<Traits> {
+        alignas(AllocationHeader) uint8_t storage[kBlockSize];
+    };
+
+    struct PerCpuSlab {
+        mxtl::SlabAllocator<Traits> allocator{MaxSlabs};
+    } __CPU_ALIGN;
+
+    static PerCpuSlab slabs_[SMP_MAX_CPUS];
+};
+
+template <size_t DataSize, size_t SlabSize, size_t MaxSlabs>
+typename MessageSizeClass<DataSize, SlabSize, MaxSlabs>::PerCpuSlab
+    MessageSizeClass<DataSize, SlabSize, MaxSlabs>::slabs_[SMP_MAX_CPUS];
+
+struct SizeClassOps {
+    size_t capacity;
+    void* (*alloc)(uint cpu);
+    void (*free)(uint cpu, void* ptr);
+};
+
+// Slabs are never returned to the heap, so the number of them per cpu caps
+// how much memory each class can pin down. Anything past that, or larger
+// than the largest class, falls back to malloc.
+using SizeClass64 = MessageSizeClass<64u, 16u * 1024u, 4u>;
+using SizeClass256 = MessageSizeClass<256u, 16u * 1024u, 8u>;
+using SizeClass1K = MessageSizeClass<1024u, 32u * 1024u, 4u>;
+using SizeClass4K = MessageSizeClass<4096u, 64u * 1024u, 2u>;
+
+const SizeClassOps kSizeClasses[] = {
+    { SizeClass64::kCapacity, &SizeClass64::Alloc, &SizeClass64::Free },
+    { SizeClass256::kCapacity, &SizeClass256::Alloc, &SizeClass256::Free },
+    { SizeClass1K::kCapacity, &SizeClass1K::Alloc, &SizeClass1K::Free },
+    { SizeClass4K::kCapacity, &SizeClass4K::Alloc, &SizeClass4K::Free },
+};
+
+// Returns storage for a packet whose handles and data take |payload| bytes.
+void* AllocatePacket(size_t payload) {
+    uint cpu = arch_curr_cpu_num();
+    void* mem = nullptr;
+    uint16_t size_class;
+
+    for (size_class = 0; size_class < countof(kSizeClasses); size_class++) {
+        if (payload <= kSizeClasses[size_class].capacity) {
+            mem = kSizeClasses[size_class].alloc(cpu);
+            break;
+        }
+    }
+    if (mem == nullptr) {
+        size_class = kHeapSizeClass;
+        mem = malloc(sizeof(AllocationHeader) + sizeof(MessagePacket) + payload);
+        if (mem == nullptr)
+            return nullptr;
+    }
+
+    auto header = static_cast<AllocationHeader*>(mem);
+    header->cpu = static_cast<uint16_t>(cpu);
+    header->size_class = size_class;
+    return header + 1;
+}
+
+void FreePacket(void* ptr) {
+    auto header = static_cast<AllocationHeader*>(ptr) - 1;
+    if (header->size_class == kHeapSizeClass) {
+        free(header);
+    } else {
+        kSizeClasses[header->size_class].free(header->cpu, header);
+    }
+}
+
+} // namespace
+
+// Finds the vm object and offset backing the page aligned user range
+// [va, va + len), which must be covered by a single mapping of the current
+// process with at least |mmu_flags| permissions.
+static mx_status_t lookup_user_pages(vaddr_t va, size_t len, uint mmu_flags,
+                                     mxtl::RefPtr<VmObject>* vmo, uint64_t* vmo_offset) {
+    if (!IS_PAGE_ALIGNED(va) || len == 0u)
+        return ERR_NOT_SUPPORTED;
+
+    auto aspace = ProcessDispatcher::GetCurrent()->aspace();
+    auto region = aspace->FindRegion(va);
+    if (!region || !region->is_mapping())
+        return ERR_NOT_SUPPORTED;
+
+    auto mapping = region->as_vm_mapping();
+    if (va < mapping->base() || len > mapping->size() - (va - mapping->base()))
+        return ERR_NOT_SUPPORTED;
+    if ((mapping->arch_mmu_flags() & mmu_flags) != mmu_flags)
+        return ERR_NOT_SUPPORTED;
+
+    *vmo = mapping->vmo();
+    *vmo_offset = mapping->object_offset() + (va - mapping->base());
+    return NO_ERROR;
+}
+
 // static
 mx_status_t MessagePacket::Create(uint32_t data_size, uint32_t num_handles,
                                   mxtl::unique_ptr<MessagePacket>* msg) {
@@ -24,9 +172,7 @@ mx_status_t MessagePacket::Create(uint32_t data_size, uint32_t num_handles,
 
     // Allocate space for the MessagePacket object followed by num_handles
     // Handle*s followed by data_size bytes.
-    char* ptr = static_cast<char*>(malloc(sizeof(MessagePacket) +
-                                          num_handles * sizeof(Handle*) +
-                                          data_size));
+    char* ptr = static_cast<char*>(AllocatePacket(num_handles * sizeof(Handle*) + data_size));
     if (ptr == nullptr)
         return ERR_NO_MEMORY;
 
@@ -38,6 +184,106 @@ mx_status_t MessagePacket::Create(uint32_t data_size, uint32_t num_handles,
     return NO_ERROR;
 }
 
+// static
+mx_status_t MessagePacket::CreateFromUserPages(user_ptr<const void> data, uint32_t data_size,
+                                               uint32_t num_handles,
+                                               mxtl::unique_ptr<MessagePacket>* msg) {
+    if (data_size > kMaxMessageSize)
+        return ERR_OUT_OF_RANGE;
+    if (data_size < kMinMovePagesSize)
+        return ERR_NOT_SUPPORTED;
+
+    // Taking pages away is a write to the sender's memory, so its mapping
+    // must be writable as well as readable.
+    vaddr_t va = reinterpret_cast<vaddr_t>(data.get());
+    size_t move_len = ROUNDDOWN(data_size, PAGE_SIZE);
+    mxtl::RefPtr<VmObject> src;
+    uint64_t src_offset;
+    mx_status_t status = lookup_user_pages(va, move_len,
+                                           ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE,
+                                           &src, &src_offset);
+    if (status != NO_ERROR)
+        return status;
+
+    auto pages = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, ROUNDUP_PAGE_SIZE(data_size));
+    if (!pages)
+        return ERR_NO_MEMORY;
+
+    // This is where the copy went. The packet's vmo is not visible to anyone
+    // else yet, which makes holding both vmo locks safe.
+    uint64_t moved;
+    status = src->MovePages(src_offset, move_len, pages.get(), 0, &moved);
+    if (status != NO_ERROR)
+        return status;
+
+    status = Create(0u, num_handles, msg);
+    if (status != NO_ERROR) {
+        // Hand the pages back rather than losing the sender's data.
+        uint64_t returned;
+        pages->MovePages(0, moved, src.get(), src_offset, &returned);
+        return status;
+    }
+
+    // Copy whatever couldn't be moved, which is at least the partial last page.
+    if (moved < data_size) {
+        size_t written;
+        status = pages->WriteUser(data.byte_offset(moved), moved, data_size - moved, &written);
+        if (status != NO_ERROR) {
+            uint64_t returned;
+            pages->MovePages(0, moved, src.get(), src_offset, &returned);
+            msg->reset();
+            return ERR_INVALID_ARGS;
+        }
+    }
+
+    MessagePacket* packet = msg->get();
+    packet->data_size_ = data_size;
+    packet->pages_txid_ = 0;
+    if (data_size >= sizeof(mx_txid_t)) {
+        size_t read;
+        pages->Read(&packet->pages_txid_, 0, sizeof(mx_txid_t), &read);
+    }
+    packet->pages_ = mxtl::move(pages);
+
+    return NO_ERROR;
+}
+
+mx_status_t MessagePacket::CopyDataTo(user_ptr<void> data, bool move_pages) {
+    if (data_size_ == 0u)
+        return NO_ERROR;
+
+    if (!pages_)
+        return data.copy_array_to_user(this->data(), data_size_);
+
+    uint64_t moved = 0;
+    if (move_pages) {
+        vaddr_t va = reinterpret_cast<vaddr_t>(data.get());
+        size_t move_len = ROUNDDOWN(data_size_, PAGE_SIZE);
+        mxtl::RefPtr<VmObject> dest;
+        uint64_t dest_offset;
+        if (lookup_user_pages(va, move_len, ARCH_MMU_FLAG_PERM_WRITE, &dest, &dest_offset) ==
+            NO_ERROR) {
+            // Failure just means falling back to the copy below.
+            pages_->MovePages(0, move_len, dest.get(), dest_offset, &moved);
+        }
+    }
+
+    if (moved < data_size_) {
+        size_t read;
+        mx_status_t status = pages_->ReadUser(data.byte_offset(moved), moved,
+                                              data_size_ - moved, &read);
+        if (status != NO_ERROR)
+            return ERR_INVALID_ARGS;
+    }
+
+    return NO_ERROR;
+}
+
+// static
+void MessagePacket::operator delete(void* ptr) {
+    FreePacket(ptr);
+}
+
 MessagePacket::~MessagePacket() {
     if (owns_handles_) {
         // Delete handles out-of-band to avoid the worst case recursive
@@ -47,5 +293,6 @@ MessagePacket::~MessagePacket() {
 }
 
 MessagePacket::MessagePacket(uint32_t data_size, uint32_t num_handles, Handle** handles)
-    : owns_handles_(false), data_size_(data_size), num_handles_(num_handles), handles_(handles) {
+    : owns_handles_(false), data_size_(data_size), num_handles_(num_handles), handles_(handles),
+      pages_txid_(0) {
 }
@@ -0,0 +1,28 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <magenta/pager_source.h>
+
+#include <err.h>
+
+#include <magenta/syscalls/port.h>
+
+PagerSource::PagerSource(mxtl::RefPtr<PortDispatcherV2> port, uint64_t key)
+    : port_(mxtl::move(port)) {
+    packet_.packet.key = key;
+    packet_.packet.type = MX_PKT_TYPE_PAGE_REQUEST;
+    packet_.packet.status = NO_ERROR;
+}
+
+PagerSource::~PagerSource() {
+    port_->CancelQueued(&packet_);
+}
+
+status_t PagerSource::RequestPage(uint64_t offset) {
+    // Once the port is gone nothing will supply the page, so the fault fails
+    // instead of waiting forever.
+    return port_->QueuePageRequest(&packet_, offset);
+}
@@ -247,6 +247,19 @@ status_t PciDeviceDispatcher::SetIrqMode(mx_pci_irq_mode_t mode, uint32_t reques
     return ret;
 }
 
+status_t PciDeviceDispatcher::SetIrqAffinity(int32_t which_irq, uint32_t cpu) {
+    canary_.Assert();
+
+    AutoLock lock(&lock_);
+    DEBUG_ASSERT(device_ && device_->device());
+
+    if (!device_->claimed()) return ERR_BAD_STATE;  // Are we not claimed yet?
+    if ((which_irq < 0) ||
+        (static_cast<uint32_t>(which_irq) >= irqs_avail_cnt_)) return ERR_INVALID_ARGS;
+
+    return device_->device()->SetIrqAffinity(which_irq, cpu);
+}
+
 PciDeviceDispatcher::PciDeviceWrapper::PciDeviceWrapper(
         mxtl::RefPtr<PcieDevice>&& device)
     : device_(mxtl::move(device)) {
@@ -36,7 +36,7 @@ pcie_irq_handler_retval_t PciInterruptDispatcher::IrqThunk(const PcieDevice& dev
 
     // Mask the IRQ at the PCIe hardware level if we can, and (if any threads
     // just became runable) tell the kernel to trigger a reschedule event.
-    if (thiz->signal() > 0) {
+    if (thiz->Fire() > 0) {
         return PCIE_IRQRET_MASK_AND_RESCHED;
     } else {
         return PCIE_IRQRET_MASK;
@@ -99,7 +99,7 @@ status_t PciInterruptDispatcher::UserSignal() {
     if (maskable_)
         device_->device()->MaskIrq(irq_id_);
 
-    signal(true);
+    Fire(true);
 
     return NO_ERROR;
 }
@@ -13,21 +13,30 @@
 #include <pow2.h>
 
 #include <magenta/compiler.h>
+#include <magenta/magenta.h>
 #include <magenta/state_tracker.h>
 #include <magenta/syscalls/port.h>
 
+#include <arch/ops.h>
+
 #include <kernel/auto_lock.h>
 
+#include <mxtl/algorithm.h>
+
 constexpr mx_rights_t kDefaultIOPortRightsV2 =
     MX_RIGHT_DUPLICATE | MX_RIGHT_TRANSFER | MX_RIGHT_READ | MX_RIGHT_WRITE;
 
-PortPacket::PortPacket() : packet{}, observer(nullptr) {
+DECLARE_STATIC_SLAB_ALLOCATOR_STORAGE(PortObserverAllocatorTraits,
+                                      MaxObjectSlabs<PortObserverAllocatorTraits>());
+
+PortPacket::PortPacket() : packet{}, observer(nullptr), cpu(arch_curr_cpu_num()) {
     // Note that packet is initialized to zeros.
 }
 
 PortObserver::PortObserver(uint32_t type, Handle* handle, mxtl::RefPtr<PortDispatcherV2> port,
                            uint64_t key, mx_signals_t signals)
-    : type_(type),
+    : StateObserver(signals),
+      type_(type),
       key_(key),
       trigger_(signals),
       handle_(handle),
@@ -68,14 +77,15 @@ bool PortObserver::OnCancel(Handle* handle) {
 }
 
 bool PortObserver::OnCancelByKey(Handle* handle, const void* port, uint64_t key) {
-    if ((key_ != key) || (handle_ != handle))
+    if ((key_ != key) || (handle_ != handle) || (port_.get() != port))
         return false;
     remove_ = true;
+    cancelled_ = true;
     return false;
 }
 
 void PortObserver::OnRemoved() {
-    if (port_->CanReap(this, &packet_))
+    if (port_->CanReap(this, &packet_, cancelled_))
         delete this;
 }
 
@@ -95,9 +105,15 @@ void PortObserver::MaybeQueue(mx_signals_t new_state, uint64_t count) {
 mx_status_t PortDispatcherV2::Create(uint32_t options,
                                      mxtl::RefPtr<Dispatcher>* dispatcher,
                                      mx_rights_t* rights) {
-    DEBUG_ASSERT(options == MX_PORT_OPT_V2);
+    DEBUG_ASSERT(options & MX_PORT_OPT_V2);
+    uint32_t num_shards = (options & MX_PORT_OPT_PERCPU) ? arch_max_num_cpus() : 1u;
+
     AllocChecker ac;
-    auto disp = new (&ac) PortDispatcherV2(options);
+    mxtl::unique_ptr<Shard[]> shards(new (&ac) Shard[num_shards]);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    auto disp = new (&ac) PortDispatcherV2(options, mxtl::move(shards), num_shards);
     if (!ac.check())
         return ERR_NO_MEMORY;
 
@@ -106,24 +122,29 @@ mx_status_t PortDispatcherV2::Create(uint32_t options,
     return NO_ERROR;
 }
 
-PortDispatcherV2::PortDispatcherV2(uint32_t /*options*/)
-    : zero_handles_(false) {
+PortDispatcherV2::PortDispatcherV2(uint32_t options, mxtl::unique_ptr<Shard[]> shards,
+                                   uint32_t num_shards)
+    : num_shards_(num_shards),
+      wake_newest_((options & MX_PORT_OPT_PERCPU) != 0u),
+      shards_(mxtl::move(shards)),
+      zero_handles_(0) {
 }
 
 PortDispatcherV2::~PortDispatcherV2() {
-    DEBUG_ASSERT(zero_handles_);
+    DEBUG_ASSERT(zero_handles_.load());
 }
 
 void PortDispatcherV2::on_zero_handles() {
     canary_.Assert();
 
-    {
-        AutoLock al(&lock_);
-        zero_handles_ = true;
-    }
+    zero_handles_.store(1);
     while (DeQueue(0ull, nullptr) == NO_ERROR) {}
 }
 
+PortDispatcherV2::Shard* PortDispatcherV2::ShardFor(const PortPacket* port_packet) const {
+    return &shards_[port_packet->cpu % num_shards_];
+}
+
 mx_status_t PortDispatcherV2::QueueUser(const mx_port_packet_t& packet) {
     canary_.Assert();
 
@@ -146,21 +167,26 @@ mx_status_t PortDispatcherV2::Queue(PortPacket* port_packet,
                                     uint64_t count) {
     canary_.Assert();
 
+    Shard* shard = ShardFor(port_packet);
     int wake_count = 0;
     {
-        AutoLock al(&lock_);
-        if (zero_handles_)
+        AutoLock al(&shard->lock);
+        if (zero_handles_.load())
             return ERR_BAD_STATE;
 
         if (observed) {
-            if (port_packet->InContainer())
+            // A repeating wait has at most one packet queued. Refresh it with
+            // the latest state rather than queueing another.
+            if (port_packet->InContainer()) {
+                port_packet->packet.signal.observed = observed;
                 return NO_ERROR;
+            }
             port_packet->packet.signal.observed = observed;
             port_packet->packet.signal.count = count;
         }
 
-        packets_.push_back(port_packet);
-        wake_count = sema_.Post();
+        shard->packets.push_back(port_packet);
+        wake_count = sema_.Post(wake_newest_);
     }
 
     if (wake_count)
@@ -169,33 +195,197 @@ mx_status_t PortDispatcherV2::Queue(PortPacket* port_packet,
     return NO_ERROR;
 }
 
-mx_status_t PortDispatcherV2::DeQueue(mx_time_t deadline, mx_port_packet_t* packet) {
+mx_status_t PortDispatcherV2::QueueInterrupt(PortPacket* port_packet, mx_time_t timestamp,
+                                             uint64_t count) {
+    canary_.Assert();
+
+    Shard* shard = ShardFor(port_packet);
+    int wake_count = 0;
+    {
+        AutoLock al(&shard->lock);
+        if (zero_handles_.load())
+            return ERR_BAD_STATE;
+
+        // Coalesce with the packet the driver has not taken yet, keeping the
+        // time of the first interrupt.
+        if (port_packet->InContainer()) {
+            port_packet->packet.interrupt.count += count;
+            return NO_ERROR;
+        }
+        port_packet->packet.interrupt.timestamp = timestamp;
+        port_packet->packet.interrupt.count = count;
+
+        shard->packets.push_back(port_packet);
+        wake_count = sema_.Post(wake_newest_);
+    }
+
+    if (wake_count)
+        thread_preempt(false);
+
+    return NO_ERROR;
+}
+
+mx_status_t PortDispatcherV2::QueueGuestIo(PortPacket* port_packet, uint8_t access_size,
+                                           uint32_t data) {
+    canary_.Assert();
+
+    Shard* shard = ShardFor(port_packet);
+    int wake_count = 0;
+    {
+        AutoLock al(&shard->lock);
+        if (zero_handles_.load())
+            return ERR_BAD_STATE;
+
+        // A device only needs to know it was kicked, and with what, so later
+        // writes replace the data of the packet the VMM has not taken yet.
+        port_packet->packet.guest_io.access_size = access_size;
+        port_packet->packet.guest_io.data = data;
+        if (port_packet->InContainer()) {
+            port_packet->packet.guest_io.count++;
+            return NO_ERROR;
+        }
+        port_packet->packet.guest_io.count = 1;
+
+        shard->packets.push_back(port_packet);
+        wake_count = sema_.Post(wake_newest_);
+    }
+
+    if (wake_count)
+        thread_preempt(false);
+
+    return NO_ERROR;
+}
+
+mx_status_t PortDispatcherV2::QueuePageRequest(PortPacket* port_packet, uint64_t offset) {
+    canary_.Assert();
+
+    Shard* shard = ShardFor(port_packet);
+    int wake_count = 0;
+    {
+        AutoLock al(&shard->lock);
+        if (zero_handles_.load())
+            return ERR_BAD_STATE;
+
+        // The pager reads ahead best when it sees the whole span of pages
+        // being waited for, so the packet it has not taken yet just grows.
+        mx_packet_page_request_t* request = &port_packet->packet.page_request;
+        if (port_packet->InContainer()) {
+            uint64_t end = mxtl::max(request->offset + request->length, offset + PAGE_SIZE);
+            request->offset = mxtl::min(request->offset, offset);
+            request->length = end - request->offset;
+            return NO_ERROR;
+        }
+        request->offset = offset;
+        request->length = PAGE_SIZE;
+
+        shard->packets.push_back(port_packet);
+        wake_count = sema_.Post(wake_newest_);
+    }
+
+    if (wake_count)
+        thread_preempt(false);
+
+    return NO_ERROR;
+}
+
+void PortDispatcherV2::CancelQueued(PortPacket* port_packet) {
     canary_.Assert();
 
-    PortPacket* port_packet = nullptr;
-    PortObserver* observer = nullptr;
+    Shard* shard = ShardFor(port_packet);
+    AutoLock al(&shard->lock);
+    // The waiter woken for this packet finds the shard empty and waits again.
+    if (port_packet->InContainer())
+        shard->packets.erase(*port_packet);
+}
+
+mx_status_t PortDispatcherV2::DeQueue(mx_time_t deadline, mx_port_packet_t* packet) {
+    canary_.Assert();
 
     while (true) {
+        // Start with the current cpu's shard and steal from the others.
+        uint32_t first = arch_curr_cpu_num() % num_shards_;
+        for (uint32_t i = 0; i < num_shards_; ++i) {
+            Shard* shard = &shards_[(first + i) % num_shards_];
+            PortPacket* port_packet = nullptr;
+            PortObserver* observer = nullptr;
+            {
+                AutoLock al(&shard->lock);
+                if (shard->packets.is_empty())
+                    continue;
+
+                port_packet = shard->packets.pop_front();
+                observer = CopyLocked(port_packet, packet);
+            }
+
+            if (observer)
+                delete observer;
+            else if (port_packet->type() == MX_PKT_TYPE_USER)
+                delete port_packet;
+            return NO_ERROR;
+        }
+
+        status_t st = sema_.Wait(deadline);
+        if (st != NO_ERROR)
+            return st;
+    }
+}
+
+mx_status_t PortDispatcherV2::DeQueueMany(mx_time_t deadline, mx_port_packet_t* packets,
+                                          uint32_t count, uint32_t* actual) {
+    canary_.Assert();
+
+    // Packets are taken a chunk at a time, so that the lock is not held for
+    // long and what has to be destroyed fits on the stack.
+    constexpr uint32_t kChunkSize = 16u;
+
+    uint32_t taken = 0u;
+    uint32_t shard_index = arch_curr_cpu_num() % num_shards_;
+    uint32_t empty_shards = 0u;
+    while (taken < count) {
+        PortObserver* observers[kChunkSize];
+        PortPacket* user_packets[kChunkSize];
+        uint32_t num_observers = 0u;
+        uint32_t num_user_packets = 0u;
+        uint32_t limit = mxtl::min(count, taken + kChunkSize);
+        Shard* shard = &shards_[shard_index];
         {
-            AutoLock al(&lock_);
-            if (packets_.is_empty())
-                goto wait;
+            AutoLock al(&shard->lock);
+            while (taken < limit && !shard->packets.is_empty()) {
+                PortPacket* port_packet = shard->packets.pop_front();
+                PortObserver* observer = CopyLocked(port_packet, &packets[taken++]);
+                if (observer)
+                    observers[num_observers++] = observer;
+                else if (port_packet->type() == MX_PKT_TYPE_USER)
+                    user_packets[num_user_packets++] = port_packet;
+            }
+        }
 
-            port_packet = packets_.pop_front();
-            observer = CopyLocked(port_packet, packet);
+        for (uint32_t i = 0; i < num_observers; ++i)
+            delete observers[i];
+        for (uint32_t i = 0; i < num_user_packets; ++i)
+            delete user_packets[i];
+
+        if (taken == limit) {
+            empty_shards = 0u;
+            continue;
         }
 
-        if (observer)
-            delete observer;
-        else if (packet && packet->type == MX_PKT_TYPE_USER)
-            delete port_packet;
-        return NO_ERROR;
+        // This shard ran dry, move on to the next one.
+        shard_index = (shard_index + 1) % num_shards_;
+        if (++empty_shards < num_shards_)
+            continue;
+        empty_shards = 0u;
 
-wait:
+        // Every shard ran dry, return what we have rather than block.
+        if (taken > 0u)
+            break;
         status_t st = sema_.Wait(deadline);
         if (st != NO_ERROR)
             return st;
     }
+
+    *actual = taken;
+    return NO_ERROR;
 }
 
 PortObserver* PortDispatcherV2::CopyLocked(PortPacket* port_packet, mx_port_packet_t* packet) {
@@ -205,12 +395,19 @@ PortObserver* PortDispatcherV2::CopyLocked(PortPacket* port_packet, mx_port_pack
     return (port_packet->type() == MX_PKT_TYPE_USER) ? nullptr : port_packet->observer;
 }
 
-bool PortDispatcherV2::CanReap(PortObserver* observer, PortPacket* port_packet) {
+bool PortDispatcherV2::CanReap(PortObserver* observer, PortPacket* port_packet,
+                               bool discard) {
     canary_.Assert();
 
-    AutoLock al(&lock_);
+    Shard* shard = ShardFor(port_packet);
+    AutoLock al(&shard->lock);
     if (!port_packet->InContainer())
         return true;
+    if (discard) {
+        // The waiter woken for this packet finds the shard empty and waits again.
+        shard->packets.erase(*port_packet);
+        return true;
+    }
     // The destruction will happen when the packet is dequeued.
     DEBUG_ASSERT(port_packet->observer == nullptr);
     port_packet->observer = observer;
@@ -227,13 +424,12 @@ mx_status_t PortDispatcherV2::MakeObservers(uint32_t options, Handle* handle,
     if (!dispatcher->get_state_tracker())
         return ERR_NOT_SUPPORTED;
 
-    AllocChecker ac;
     auto type = (options == MX_WAIT_ASYNC_ONCE) ?
         MX_PKT_TYPE_SIGNAL_ONE : MX_PKT_TYPE_SIGNAL_REP;
 
-    auto observer = new (&ac) PortObserver(type,
+    auto observer = mxtl::SlabAllocator<PortObserverAllocatorTraits>::New(type,
             handle, mxtl::RefPtr<PortDispatcherV2>(this), key, signals);
-    if (!ac.check())
+    if (!observer)
         return ERR_NO_MEMORY;
 
     dispatcher->add_observer(observer);
@@ -25,6 +25,7 @@
 #include <lib/crypto/global_prng.h>
 #include <lib/ktrace.h>
 
+#include <magenta/aspace_reaper.h>
 #include <magenta/diagnostics.h>
 #include <magenta/futex_context.h>
 #include <magenta/handle_owner.h>
@@ -102,8 +103,7 @@ ProcessDispatcher::ProcessDispatcher(mxtl::RefPtr<JobDispatcher> job,
 
     // Generate handle XOR mask with top bit and bottom two bits cleared
     uint32_t secret;
-    auto prng = crypto::GlobalPRNG::GetInstance();
-    prng->Draw(&secret, sizeof(secret));
+    crypto::GlobalPRNG::DrawPerCpu(&secret, sizeof(secret));
 
     // Handle values cannot be negative values, so we mask the high bit.
     handle_rand_ = (secret << 2) & INT_MAX;
@@ -264,9 +264,10 @@ void ProcessDispatcher::RemoveThread(UserThread* t) {
     // we're going to check for state and possibly transition below
     AutoLock state_lock(&state_lock_);
 
-    // remove the thread from our list
+    // remove the thread from our list, keeping its share of the counters
     DEBUG_ASSERT(t != nullptr);
     thread_list_.erase(*t);
+    t->AddSchedStats(&exited_sched_stats_);
 
     // if this was the last thread, transition directly to DEAD state
     if (thread_list_.is_empty()) {
@@ -331,6 +332,7 @@ void ProcessDispatcher::SetStateLocked(State s) {
             AutoLock lock(&handle_table_lock_);
             for (auto& handle : handles_) {
                 handle.set_process_id(0u);
+                handle_table_.Clear(MapU32ToHandleIndex(handle.base_value()));
             }
             // Delete handles out-of-band to avoid the worst case recursive
             // destruction behavior.
@@ -338,16 +340,17 @@ void ProcessDispatcher::SetStateLocked(State s) {
         }
         LTRACEF_LEVEL(2, "done cleaning up handle table on proc %p\n", this);
 
-        // tear down the address space
-        aspace_->Destroy();
+        // Tear down the address space out-of-band as well. Unmapping and
+        // freeing a big process's memory can take a long time, and waiters
+        // on MX_TASK_TERMINATED needn't wait for it.
+        ReapAspace(aspace_);
 
         // Send out exception reports before signalling MX_TASK_TERMINATED,
         // the theory being that marking the process as terminated is the
         // last thing that is done.
         //
-        // Note: If we need OnProcessExit for the debugger to do an exchange
-        // with the debugger then this should preceed aspace destruction.
-        // For now it is left here, following aspace destruction.
+        // Note: The address space may still be being torn down while
+        // OnProcessExit runs, so the debugger can no longer read it here.
         //
         // Note: If an eport is bound, it will have a reference to the
         // ProcessDispatcher and thus keep the object around until someone
@@ -406,8 +409,25 @@ void ProcessDispatcher::AddHandle(HandleOwner handle) {
     AddHandleLocked(mxtl::move(handle));
 }
 
+void ProcessDispatcher::AddHandles(Handle* const* handles, size_t count) {
+    AutoLock lock(&handle_table_lock_);
+    for (size_t i = 0; i < count; ++i)
+        AddHandleLocked(HandleOwner(handles[i]));
+}
+
+Handle* ProcessDispatcher::GetHandleLockFree(mx_handle_t handle_value) const {
+    uint32_t base_value = static_cast<uint32_t>(handle_value ^ handle_rand_) >> 1;
+    Handle* handle = handle_table_.Get(MapU32ToHandleIndex(base_value));
+    // The slot holds whichever generation of the handle this process owns.
+    if (!handle || handle->base_value() != base_value)
+        return nullptr;
+    return handle;
+}
+
 void ProcessDispatcher::AddHandleLocked(HandleOwner handle) {
     handle->set_process_id(get_koid());
+    // If the table can't grow the handle is still found by the slow path.
+    handle_table_.Set(MapU32ToHandleIndex(handle->base_value()), handle.get());
     handles_.push_front(handle.release());
 }
 
@@ -422,6 +442,7 @@ HandleOwner ProcessDispatcher::RemoveHandleLocked(mx_handle_t handle_value) {
         return nullptr;
 
     handle->set_process_id(0u);
+    handle_table_.Clear(MapU32ToHandleIndex(handle->base_value()));
     handles_.erase(*handle);
 
     return HandleOwner(handle);
@@ -432,43 +453,102 @@ void ProcessDispatcher::UndoRemoveHandleLocked(mx_handle_t handle_value) {
     AddHandleLocked(HandleOwner(handle));
 }
 
+void ProcessDispatcher::UndoRemoveHandlesLocked(const mx_handle_t* handle_values,
+                                                size_t count) {
+    for (size_t i = 0; i < count; ++i)
+        UndoRemoveHandleLocked(handle_values[i]);
+}
+
 mx_koid_t ProcessDispatcher::GetKoidForHandle(mx_handle_t handle_value) {
+    {
+        HandleReadGuard guard;
+        Handle* handle = GetHandleLockFree(handle_value);
+        if (likely(handle))
+            return handle->dispatcher_ptr()->get_koid();
+    }
+
     AutoLock lock(&handle_table_lock_);
     Handle* handle = GetHandleLocked(handle_value);
     if (!handle)
         return MX_KOID_INVALID;
-    return handle->dispatcher()->get_koid();
+    return handle->dispatcher_ptr()->get_koid();
 }
 
 mx_status_t ProcessDispatcher::GetDispatcherInternal(mx_handle_t handle_value,
                                                      mxtl::RefPtr<Dispatcher>* dispatcher,
                                                      mx_rights_t* rights) {
-    AutoLock lock(&handle_table_lock_);
-    Handle* handle = GetHandleLocked(handle_value);
-    if (!handle)
-        return ERR_BAD_HANDLE;
-
-    *dispatcher = handle->dispatcher();
-    if (rights)
-        *rights = handle->rights();
-    return NO_ERROR;
+    return GetDispatcherWithRightsInternal(handle_value, 0u, dispatcher, rights);
 }
 
 mx_status_t ProcessDispatcher::GetDispatcherWithRightsInternal(mx_handle_t handle_value,
                                                                mx_rights_t desired_rights,
                                                                mxtl::RefPtr<Dispatcher>* dispatcher_out,
                                                                mx_rights_t* out_rights) {
-    AutoLock lock(&handle_table_lock_);
-    Handle* handle = GetHandleLocked(handle_value);
-    if (!handle)
-        return ERR_BAD_HANDLE;
+    // Take the reference into a local, so that whatever |dispatcher_out| held
+    // is released outside of the guard.
+    mxtl::RefPtr<Dispatcher> dispatcher;
+    mx_rights_t rights = 0u;
+    {
+        HandleReadGuard guard;
+        Handle* handle = GetHandleLockFree(handle_value);
+        if (likely(handle)) {
+            dispatcher = handle->dispatcher();
+            rights = handle->rights();
+        }
+    }
 
-    if (!magenta_rights_check(handle, desired_rights))
+    if (unlikely(!dispatcher)) {
+        // Not found in the table, which holds all of our handles unless it
+        // failed to grow.
+        AutoLock lock(&handle_table_lock_);
+        Handle* handle = GetHandleLocked(handle_value);
+        if (!handle)
+            return ERR_BAD_HANDLE;
+        dispatcher = handle->dispatcher();
+        rights = handle->rights();
+    }
+
+    if ((rights & desired_rights) != desired_rights)
         return ERR_ACCESS_DENIED;
 
-    *dispatcher_out = handle->dispatcher();
+    *dispatcher_out = mxtl::move(dispatcher);
     if (out_rights)
-        *out_rights = handle->rights();
+        *out_rights = rights;
+    return NO_ERROR;
+}
+
+mx_status_t ProcessDispatcher::GetBorrowedDispatcherInternal(mx_handle_t handle_value,
+                                                             mx_rights_t desired_rights,
+                                                             Dispatcher** dispatcher_out,
+                                                             mx_rights_t* out_rights) {
+    // The caller's HandleBorrowGuard, not a reference, keeps the dispatcher
+    // alive once it is out of the HandleReadGuard.
+    Dispatcher* dispatcher = nullptr;
+    mx_rights_t rights = 0u;
+    {
+        HandleReadGuard guard;
+        Handle* handle = GetHandleLockFree(handle_value);
+        if (likely(handle)) {
+            dispatcher = handle->dispatcher_ptr();
+            rights = handle->rights();
+        }
+    }
+
+    if (unlikely(!dispatcher)) {
+        AutoLock lock(&handle_table_lock_);
+        Handle* handle = GetHandleLocked(handle_value);
+        if (!handle)
+            return ERR_BAD_HANDLE;
+        dispatcher = handle->dispatcher_ptr();
+        rights = handle->rights();
+    }
+
+    if ((rights & desired_rights) != desired_rights)
+        return ERR_ACCESS_DENIED;
+
+    *dispatcher_out = dispatcher;
+    if (out_rights)
+        *out_rights = rights;
     return NO_ERROR;
 }
 
@@ -518,6 +598,18 @@ status_t ProcessDispatcher::GetStats(mx_info_task_stats_t* stats) {
     return NO_ERROR;
 }
 
+void ProcessDispatcher::AddSchedStats(mx_info_thread_stats_t* stats) {
+    AutoLock lock(&state_lock_);
+    stats->runtime_ns += exited_sched_stats_.runtime_ns;
+    stats->wait_ns += exited_sched_stats_.wait_ns;
+    stats->voluntary_switches += exited_sched_stats_.voluntary_switches;
+    stats->involuntary_switches += exited_sched_stats_.involuntary_switches;
+    stats->page_faults += exited_sched_stats_.page_faults;
+    for (auto& thread : thread_list_) {
+        thread.AddSchedStats(stats);
+    }
+}
+
 status_t ProcessDispatcher::GetAspaceMaps(
     user_ptr<mx_info_maps_t> maps, size_t max,
     size_t* actual, size_t* available) {
@@ -531,10 +623,9 @@ status_t ProcessDispatcher::GetAspaceMaps(
 status_t ProcessDispatcher::CreateUserThread(mxtl::StringPiece name, uint32_t flags,
                                              mxtl::RefPtr<Dispatcher>* out_thread,
                                              mx_rights_t* out_rights) {
-    AllocChecker ac;
-    auto ut = mxtl::AdoptRef(new (&ac) UserThread(mxtl::WrapRefPtr(this),
-                                                  flags));
-    if (!ac.check())
+    auto ut = mxtl::SlabAllocator<UserThreadAllocatorTraits>::New(mxtl::WrapRefPtr(this),
+                                                                  flags);
+    if (!ut)
         return ERR_NO_MEMORY;
 
     status_t result = ut->Initialize(name.data(), name.length());
@@ -574,6 +665,25 @@ status_t ProcessDispatcher::GetThreads(mxtl::Array<mx_koid_t>* out_threads) {
     return NO_ERROR;
 }
 
+status_t ProcessDispatcher::GetUserThreads(
+    mxtl::Array<mxtl::RefPtr<UserThread>>* out_threads) {
+    AutoLock lock(&state_lock_);
+    size_t n = thread_list_.size_slow();
+    mxtl::Array<mxtl::RefPtr<UserThread>> threads;
+    AllocChecker ac;
+    threads.reset(new (&ac) mxtl::RefPtr<UserThread>[n], n);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+    size_t i = 0;
+    for (auto& thread : thread_list_) {
+        threads[i] = mxtl::WrapRefPtr(&thread);
+        ++i;
+    }
+    DEBUG_ASSERT(i == n);
+    *out_threads = mxtl::move(threads);
+    return NO_ERROR;
+}
+
 status_t ProcessDispatcher::SetExceptionPort(mxtl::RefPtr<ExceptionPort> eport) {
     LTRACE_ENTRY_OBJ;
     bool debugger = false;
@@ -747,6 +857,12 @@ const char* StateToString(ProcessDispatcher::State state) {
 }
 
 bool ProcessDispatcher::IsHandleValid(mx_handle_t handle_value) {
+    {
+        HandleReadGuard guard;
+        if (likely(GetHandleLockFree(handle_value) != nullptr))
+            return true;
+    }
+
     AutoLock lock(&handle_table_lock_);
     return (GetHandleLocked(handle_value) != nullptr);
 }
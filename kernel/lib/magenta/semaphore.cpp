@@ -19,13 +19,15 @@ Semaphore::~Semaphore() {
     THREAD_UNLOCK(state);
 }
 
-int Semaphore::Post() {
+int Semaphore::Post(bool wake_newest) {
     // If the count is or was negative then a thread is waiting for a resource,
     // otherwise it's safe to just increase the count available with no downsides.
     int ret = 0;
     THREAD_LOCK(state);
-    if (unlikely(++count_ <= 0))
-        ret = wait_queue_wake_one(&waitq_, false, NO_ERROR);
+    if (unlikely(++count_ <= 0)) {
+        ret = wake_newest ? wait_queue_wake_newest(&waitq_, false, NO_ERROR) :
+                            wait_queue_wake_one(&waitq_, false, NO_ERROR);
+    }
     THREAD_UNLOCK(state);
     return ret;
 }
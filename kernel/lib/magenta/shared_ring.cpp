@@ -0,0 +1,38 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <magenta/shared_ring.h>
+
+#include <err.h>
+
+#include <kernel/vm/vm_object_paged.h>
+
+mx_status_t SharedRing::Init(const void* header, size_t header_size, uint64_t data_offset,
+                             size_t data_size) {
+    DEBUG_ASSERT(header_size <= data_offset);
+
+    vmo_ = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, data_offset + data_size);
+    if (!vmo_)
+        return ERR_NO_MEMORY;
+    data_offset_ = data_offset;
+    return vmo_->Write(header, 0u, header_size, nullptr);
+}
+
+mx_status_t SharedRing::Read(uint64_t offset, void* dst, size_t len) const {
+    return vmo_->Read(dst, data_offset_ + offset, len, nullptr);
+}
+
+mx_status_t SharedRing::Write(uint64_t offset, const void* src, size_t len) {
+    return vmo_->Write(src, data_offset_ + offset, len, nullptr);
+}
+
+mx_status_t SharedRing::ReadUser(uint64_t offset, user_ptr<void> dst, size_t len) const {
+    return vmo_->ReadUser(dst, data_offset_ + offset, len, nullptr);
+}
+
+mx_status_t SharedRing::WriteUser(uint64_t offset, user_ptr<const void> src, size_t len) {
+    return vmo_->WriteUser(src, data_offset_ + offset, len, nullptr);
+}
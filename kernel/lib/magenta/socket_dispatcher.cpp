@@ -6,6 +6,7 @@
 
 #include <magenta/socket_dispatcher.h>
 
+#include <stddef.h>
 #include <string.h>
 
 #include <assert.h>
@@ -47,7 +48,18 @@ SocketDispatcher::CBuf::~CBuf() {
     }
 }
 
-bool SocketDispatcher::CBuf::Init(uint32_t len) {
+bool SocketDispatcher::CBuf::Init(uint32_t len, bool shared) {
+    if (shared) {
+        mx_socket_ring_t header = {};
+        header.size = len;
+        if (ring_.Init(&header, sizeof(header), MX_SOCKET_RING_DATA_OFFSET, len) != NO_ERROR)
+            return false;
+
+        shared_ = true;
+        len_pow2_ = log2_uint_floor(len);
+        return true;
+    }
+
     vmo_ = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, len);
     if (!vmo_)
         return false;
@@ -65,6 +77,55 @@ bool SocketDispatcher::CBuf::Init(uint32_t len) {
     return true;
 }
 
+void SocketDispatcher::CBuf::Load() {
+    if (!shared_)
+        return;
+
+    // User space can write anything here or even shrink the VMO; all that is
+    // needed is to keep the indices inside the ring.
+    uint64_t head = ring_.LoadIndex<uint64_t>(offsetof(mx_socket_ring_t, head));
+    uint64_t tail = ring_.LoadIndex<uint64_t>(offsetof(mx_socket_ring_t, tail));
+    head_ = vmodpow2(head, len_pow2_);
+    tail_ = vmodpow2(tail, len_pow2_);
+}
+
+void SocketDispatcher::CBuf::StoreIndex(size_t field_offset, size_t index) {
+    if (!shared_)
+        return;
+
+    ring_.StoreIndex<uint64_t>(field_offset, index);
+}
+
+void SocketDispatcher::CBuf::Copy(const void* src, uint64_t offset, size_t len, bool from_user) {
+    if (shared_) {
+        if (from_user)
+            ring_.WriteUser(offset, user_ptr<const void>(src), len);
+        else
+            ring_.Write(offset, src, len);
+    } else if (from_user) {
+        // TODO: find a safer way to do this
+        user_ptr<const void> uptr(src);
+        vmo_->WriteUser(uptr, offset, len, nullptr);
+    } else {
+        memcpy(reinterpret_cast<void*>(mapping_->base() + offset), src, len);
+    }
+}
+
+void SocketDispatcher::CBuf::Copy(uint64_t offset, void* dest, size_t len, bool from_user) {
+    if (shared_) {
+        if (from_user)
+            ring_.ReadUser(offset, user_ptr<void>(dest), len);
+        else
+            ring_.Read(offset, dest, len);
+    } else if (from_user) {
+        // TODO: find a safer way to do this
+        user_ptr<void> uptr(dest);
+        vmo_->ReadUser(uptr, offset, len, nullptr);
+    } else {
+        memcpy(dest, reinterpret_cast<void*>(mapping_->base() + offset), len);
+    }
+}
+
 size_t SocketDispatcher::CBuf::free() const {
     uint consumed = modpow2((uint)(head_ - tail_), len_pow2_);
     return valpow2(len_pow2_) - consumed - 1;
@@ -102,17 +163,13 @@ size_t SocketDispatcher::CBuf::Write(const void* src, size_t len, bool from_user
 
         const char *ptr = (const char*)src;
         ptr += pos;
-        if (from_user) {
-            // TODO: find a safer way to do this
-            user_ptr<const void> uptr(ptr);
-            vmo_->WriteUser(uptr, head_, write_len, nullptr);
-        } else {
-            memcpy(reinterpret_cast<void*>(mapping_->base() + head_), ptr, write_len);
-        }
+        Copy(ptr, head_, write_len, from_user);
 
         head_ = INC_POINTER(len_pow2_, head_, write_len);
         pos += write_len;
     }
+    if (pos > 0)
+        StoreIndex(offsetof(mx_socket_ring_t, head), head_);
     return pos;
 }
 
@@ -135,17 +192,12 @@ size_t SocketDispatcher::CBuf::Read(void* dest, size_t len, bool from_user) {
 
             char *ptr = (char*)dest;
             ptr += pos;
-            if (from_user) {
-                // TODO: find a safer way to do this
-                user_ptr<void> uptr(ptr);
-                vmo_->ReadUser(uptr, tail_, read_len, nullptr);
-            } else {
-                memcpy(ptr, reinterpret_cast<void*>(mapping_->base() + tail_), read_len);
-            }
+            Copy(tail_, ptr, read_len, from_user);
 
             tail_ = INC_POINTER(len_pow2_, tail_, read_len);
             pos += read_len;
         }
+        StoreIndex(offsetof(mx_socket_ring_t, tail), tail_);
         ret = pos;
     }
     return ret;
@@ -183,8 +235,9 @@ status_t SocketDispatcher::Create(uint32_t flags,
     return NO_ERROR;
 }
 
-SocketDispatcher::SocketDispatcher(uint32_t /*flags*/)
-    : peer_koid_(0u),
+SocketDispatcher::SocketDispatcher(uint32_t flags)
+    : flags_(flags),
+      peer_koid_(0u),
       state_tracker_(MX_SOCKET_WRITABLE),
       half_closed_{false, false} {
 }
@@ -197,7 +250,8 @@ SocketDispatcher::~SocketDispatcher() {
 mx_status_t SocketDispatcher::Init(mxtl::RefPtr<SocketDispatcher> other) TA_NO_THREAD_SAFETY_ANALYSIS {
     other_ = mxtl::move(other);
     peer_koid_ = other_->get_koid();
-    return cbuf_.Init(kDeFaultSocketBufferSize) ? NO_ERROR : ERR_NO_MEMORY;
+    bool shared = (flags_ & MX_SOCKET_SHARED_RING) != 0u;
+    return cbuf_.Init(kDeFaultSocketBufferSize, shared) ? NO_ERROR : ERR_NO_MEMORY;
 }
 
 void SocketDispatcher::on_zero_handles() {
@@ -274,6 +328,7 @@ status_t SocketDispatcher::set_port_client(mxtl::unique_ptr<PortClient> client)
 
     iopc_ = mxtl::move(client);
 
+    cbuf_.Load();
     if (!cbuf_.empty())
         iopc_->Signal(MX_SOCKET_READABLE, 0u, &lock_);
 
@@ -308,6 +363,12 @@ status_t SocketDispatcher::HalfCloseOther() {
 
 mx_status_t SocketDispatcher::Write(const void* src, size_t len,
                                     bool from_user, size_t* nwritten) {
+    iovec_t iov = { const_cast<void*>(src), len };
+    return WriteV(&iov, 1u, from_user, nwritten);
+}
+
+mx_status_t SocketDispatcher::WriteV(const iovec_t* iov, uint iov_cnt,
+                                     bool from_user, size_t* nwritten) {
     canary_.Assert();
 
     mxtl::RefPtr<SocketDispatcher> other;
@@ -320,21 +381,28 @@ mx_status_t SocketDispatcher::Write(const void* src, size_t len,
         other = other_;
     }
 
-    return other->WriteSelf(src, len, from_user, nwritten);
+    return other->WriteSelf(iov, iov_cnt, from_user, nwritten);
 }
 
-mx_status_t SocketDispatcher::WriteSelf(const void* src, size_t len,
+mx_status_t SocketDispatcher::WriteSelf(const iovec_t* iov, uint iov_cnt,
                                         bool from_user, size_t* written) {
     canary_.Assert();
 
     AutoLock lock(&lock_);
 
+    cbuf_.Load();
     if (!cbuf_.free())
         return ERR_SHOULD_WAIT;
 
     bool was_empty = cbuf_.empty();
 
-    auto st = cbuf_.Write(src, len, from_user);
+    size_t st = 0u;
+    for (uint i = 0; i < iov_cnt; ++i) {
+        size_t len = cbuf_.Write(iov[i].iov_base, iov[i].iov_len, from_user);
+        st += len;
+        if (len < iov[i].iov_len)
+            break;
+    }
 
     if (st > 0) {
         if (was_empty)
@@ -356,6 +424,8 @@ mx_status_t SocketDispatcher::Read(void* dest, size_t len,
 
     AutoLock lock(&lock_);
 
+    cbuf_.Load();
+
     // Just query for bytes outstanding.
     if (!dest && len == 0) {
         *nread = cbuf_.CouldRead();
@@ -381,3 +451,72 @@ mx_status_t SocketDispatcher::Read(void* dest, size_t len,
     *nread = static_cast<size_t>(st);
     return NO_ERROR;
 }
+
+mx_status_t SocketDispatcher::GetRings(mxtl::RefPtr<VmObject>* rx, mxtl::RefPtr<VmObject>* tx) {
+    canary_.Assert();
+
+    mxtl::RefPtr<SocketDispatcher> other;
+    {
+        AutoLock lock(&lock_);
+        if (!cbuf_.shared())
+            return ERR_NOT_SUPPORTED;
+        if (!other_)
+            return ERR_PEER_CLOSED;
+        *rx = cbuf_.ring_vmo();
+        other = other_;
+    }
+
+    *tx = other->RingVmo();
+    return NO_ERROR;
+}
+
+mxtl::RefPtr<VmObject> SocketDispatcher::RingVmo() {
+    AutoLock lock(&lock_);
+    return cbuf_.ring_vmo();
+}
+
+mx_status_t SocketDispatcher::RingUpdate() {
+    canary_.Assert();
+
+    mxtl::RefPtr<SocketDispatcher> other;
+    {
+        AutoLock lock(&lock_);
+        if (!cbuf_.shared())
+            return ERR_NOT_SUPPORTED;
+        SyncRingLocked();
+        other = other_;
+    }
+
+    if (other)
+        other->SyncRing();
+    return NO_ERROR;
+}
+
+void SocketDispatcher::SyncRing() {
+    canary_.Assert();
+
+    AutoLock lock(&lock_);
+    SyncRingLocked();
+}
+
+// Recomputes the signals that depend on the ring this end reads from: our
+// READABLE and the peer's WRITABLE.
+void SocketDispatcher::SyncRingLocked() {
+    cbuf_.Load();
+
+    bool was_readable = (state_tracker_.GetSignalsState() & MX_SOCKET_READABLE) != 0u;
+    if (cbuf_.empty()) {
+        state_tracker_.UpdateState(MX_SOCKET_READABLE, 0u);
+    } else if (!was_readable) {
+        state_tracker_.UpdateState(0u, MX_SOCKET_READABLE);
+        if (iopc_)
+            iopc_->Signal(MX_SOCKET_READABLE, cbuf_.CouldRead(), &lock_);
+    }
+
+    if (!other_ || half_closed_[1])
+        return;
+    if (cbuf_.free())
+        other_->state_tracker_.UpdateState(0u, MX_SOCKET_WRITABLE);
+    else
+        other_->state_tracker_.UpdateState(MX_SOCKET_WRITABLE, 0u);
+}
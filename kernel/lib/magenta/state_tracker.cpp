@@ -12,13 +12,15 @@
 namespace {
 
 template <typename Func>
-void CancelWithFunc(StateTracker::ObserverList* observers, Mutex* observer_lock, Func f) {
+void CancelWithFunc(StateTracker::ObserverList* observers, Mutex* observer_lock,
+                    mxtl::atomic<mx_signals_t>* watched, Func f) {
     bool awoke_threads = false;
 
     StateTracker::ObserverList obs_to_remove;
 
     {
         AutoLock lock(observer_lock);
+        mx_signals_t still_watched = 0u;
         for (auto it = observers->begin(); it != observers->end();) {
             awoke_threads = f(it.CopyPointer()) || awoke_threads;
             if (it->remove()) {
@@ -26,9 +28,11 @@ void CancelWithFunc(StateTracker::ObserverList* observers, Mutex* observer_lock,
                 ++it;
                 obs_to_remove.push_back(observers->erase(to_remove));
             } else {
+                still_watched |= it->trigger_mask();
                 ++it;
             }
         }
+        watched->store(still_watched);
     }
 
     while (!obs_to_remove.is_empty()) {
@@ -48,7 +52,12 @@ void StateTracker::AddObserver(StateObserver* observer, const StateObserver::Cou
     {
         AutoLock lock(&lock_);
 
-        awoke_threads = observer->OnInitialize(signals_, cinfo);
+        // Publish the trigger mask before sampling the signals, so that a
+        // concurrent lock free UpdateState() either sees it and walks the list
+        // or changed the signals early enough for OnInitialize() to see it.
+        watched_.fetch_or(observer->trigger_mask());
+
+        awoke_threads = observer->OnInitialize(signals_.load(), cinfo);
         if (!observer->remove())
             observers_.push_front(observer);
     }
@@ -62,12 +71,14 @@ void StateTracker::RemoveObserver(StateObserver* observer) {
     AutoLock lock(&lock_);
     DEBUG_ASSERT(observer != nullptr);
     observers_.erase(*observer);
+    if (observers_.is_empty())
+        watched_.store(0u);
 }
 
 void StateTracker::Cancel(Handle* handle) {
     canary_.Assert();
 
-    CancelWithFunc(&observers_, &lock_, [handle](StateObserver* obs) {
+    CancelWithFunc(&observers_, &lock_, &watched_, [handle](StateObserver* obs) {
         return obs->OnCancel(handle);
     });
 }
@@ -75,7 +86,7 @@ void StateTracker::Cancel(Handle* handle) {
 void StateTracker::CancelByKey(Handle* handle, const void* port, uint64_t key) {
     canary_.Assert();
 
-    CancelWithFunc(&observers_, &lock_, [handle, port, key](StateObserver* obs) {
+    CancelWithFunc(&observers_, &lock_, &watched_, [handle, port, key](StateObserver* obs) {
         return obs->OnCancelByKey(handle, port, key);
     });
 }
@@ -84,6 +95,22 @@ void StateTracker::UpdateState(mx_signals_t clear_mask,
                                mx_signals_t set_mask) {
     canary_.Assert();
 
+    auto previous_signals = signals_.load();
+    mx_signals_t new_signals;
+    do {
+        new_signals = (previous_signals & ~clear_mask) | set_mask;
+        if (previous_signals == new_signals)
+            return;
+    } while (!signals_.compare_exchange_weak(&previous_signals, new_signals,
+                                             mxtl::memory_order_seq_cst,
+                                             mxtl::memory_order_seq_cst));
+
+    // Pairs with the fetch_or() in AddObserver(): an observer whose trigger
+    // mask is not visible yet will sample the new signals when it is added.
+    const mx_signals_t changed = previous_signals ^ new_signals;
+    if ((changed & watched_.load()) == 0u)
+        return;
+
     bool awoke_threads = false;
 
     ObserverList obs_to_remove;
@@ -91,23 +118,24 @@ void StateTracker::UpdateState(mx_signals_t clear_mask,
     {
         AutoLock lock(&lock_);
 
-        auto previous_signals = signals_;
-        signals_ &= ~clear_mask;
-        signals_ |= set_mask;
-
-        if (previous_signals == signals_)
-            return;
+        // Observers are level triggered, so give them the latest state even if
+        // another update has landed since ours.
+        const mx_signals_t signals = signals_.load();
+        mx_signals_t still_watched = 0u;
 
         for (auto it = observers_.begin(); it != observers_.end();) {
-            awoke_threads = it->OnStateChange(signals_) || awoke_threads;
+            if (it->trigger_mask() & changed)
+                awoke_threads = it->OnStateChange(signals) || awoke_threads;
             if (it->remove()) {
                 auto to_remove = it;
                 ++it;
                 obs_to_remove.push_back(observers_.erase(to_remove));
             } else {
+                still_watched |= it->trigger_mask();
                 ++it;
             }
         }
+        watched_.store(still_watched);
     }
 
     while (!obs_to_remove.is_empty()) {
@@ -122,6 +150,9 @@ void StateTracker::UpdateState(mx_signals_t clear_mask,
 void StateTracker::StrobeState(mx_signals_t notify_mask) {
     canary_.Assert();
 
+    if ((notify_mask & watched_.load()) == 0u)
+        return;
+
     bool awoke_threads = false;
 
     ObserverList obs_to_remove;
@@ -129,19 +160,24 @@ void StateTracker::StrobeState(mx_signals_t notify_mask) {
     {
         AutoLock lock(&lock_);
 
+        mx_signals_t still_watched = 0u;
+
         // include currently active signals as well
-        notify_mask |= signals_;
+        const mx_signals_t signals = notify_mask | signals_.load();
 
         for (auto it = observers_.begin(); it != observers_.end();) {
-            awoke_threads = it->OnStateChange(notify_mask) || awoke_threads;
+            if (it->trigger_mask() & notify_mask)
+                awoke_threads = it->OnStateChange(signals) || awoke_threads;
             if (it->remove()) {
                 auto to_remove = it;
                 ++it;
                 obs_to_remove.push_back(observers_.erase(to_remove));
             } else {
+                still_watched |= it->trigger_mask();
                 ++it;
             }
         }
+        watched_.store(still_watched);
     }
 
     while (!obs_to_remove.is_empty()) {
@@ -53,6 +53,32 @@ status_t ThreadDispatcher::GetInfo(mx_info_thread_t* info) {
     return NO_ERROR;
 }
 
+status_t ThreadDispatcher::GetSchedStats(mx_info_thread_stats_t* stats) {
+    canary_.Assert();
+
+    *stats = {};
+    thread_->AddSchedStats(stats);
+    return NO_ERROR;
+}
+
+status_t ThreadDispatcher::SetProfile(const mx_profile_t& profile) {
+    canary_.Assert();
+
+    switch (profile.type) {
+    case MX_PROFILE_TYPE_PRIORITY:
+        return thread_->SetDeadline(nullptr);
+    case MX_PROFILE_TYPE_DEADLINE: {
+        thread_deadline_params params;
+        params.capacity = profile.deadline.capacity;
+        params.deadline = profile.deadline.deadline;
+        params.period = profile.deadline.period;
+        return thread_->SetDeadline(&params);
+    }
+    default:
+        return ERR_INVALID_ARGS;
+    }
+}
+
 status_t ThreadDispatcher::GetExceptionReport(mx_exception_report_t* report) {
     canary_.Assert();
 
@@ -15,10 +15,17 @@
 #include <trace.h>
 
 #include <lib/dpc.h>
+#include <lib/user_copy.h>
 
 #include <arch/debugger.h>
+#include <arch/ops.h>
+
+#if ARCH_X86_64
+#include <arch/x86/rdt.h>
+#endif
 
 #include <kernel/auto_lock.h>
+#include <kernel/spinlock.h>
 #include <kernel/thread.h>
 #include <kernel/vm.h>
 #include <kernel/vm/vm_aspace.h>
@@ -28,6 +35,7 @@
 #include <magenta/c_user_thread.h>
 #include <magenta/exception.h>
 #include <magenta/excp_port.h>
+#include <magenta/job_dispatcher.h>
 #include <magenta/magenta.h>
 #include <magenta/process_dispatcher.h>
 #include <magenta/syscalls/debug.h>
@@ -38,6 +46,9 @@
 
 #define LOCAL_TRACE 0
 
+DECLARE_STATIC_SLAB_ALLOCATOR_STORAGE(UserThreadAllocatorTraits,
+                                      MaxObjectSlabs<UserThreadAllocatorTraits>());
+
 UserThread::UserThread(mxtl::RefPtr<ProcessDispatcher> process,
                        uint32_t flags)
     : koid_(MX_KOID_INVALID),
@@ -56,6 +67,69 @@ void UserThread::set_dispatcher(ThreadDispatcher* dispatcher) {
     koid_ = dispatcher->get_koid();
  }
 
+namespace {
+
+// Kernel stacks of destroyed threads are kept in a small cache per cpu and
+// handed to new threads, so that creating a thread usually doesn't have to
+// create a VMO, carve out a vmar and fault in the stack pages. The guard
+// pages around a stack are just unmapped space in its vmar, so they come
+// along for free. Safe and unsafe stacks are the same size and share the
+// cache.
+struct CachedStack {
+    mxtl::RefPtr<VmMapping> mapping;
+    mxtl::RefPtr<VmAddressRegion> vmar;
+};
+
+struct StackCache {
+    static constexpr size_t kMaxStacks = 8;
+
+    SpinLock lock;
+    CachedStack stacks[kMaxStacks]; // protected by |lock|
+    size_t count = 0;               // protected by |lock|
+};
+
+StackCache stack_caches[SMP_MAX_CPUS];
+
+// Takes a stack from the current cpu's cache, or failing that from any
+// other cpu's, since threads often die on a different cpu than the one
+// their replacements are created on.
+bool take_cached_stack(CachedStack* out) {
+    const uint num_cpus = arch_max_num_cpus();
+    const uint cpu = arch_curr_cpu_num();
+    for (uint i = 0; i < num_cpus; ++i) {
+        StackCache& cache = stack_caches[(cpu + i) % num_cpus];
+        AutoSpinLockIrqSave lock(cache.lock);
+        if (cache.count > 0) {
+            *out = mxtl::move(cache.stacks[--cache.count]);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Puts a stack in the current cpu's cache, or destroys it if that is full.
+void free_stack(mxtl::RefPtr<VmMapping>* kstack_mapping,
+                mxtl::RefPtr<VmAddressRegion>* kstack_vmar) {
+    if (!*kstack_vmar)
+        return;
+
+    CachedStack stack = {mxtl::move(*kstack_mapping), mxtl::move(*kstack_vmar)};
+    {
+        StackCache& cache = stack_caches[arch_curr_cpu_num()];
+        AutoSpinLockIrqSave lock(cache.lock);
+        if (cache.count < StackCache::kMaxStacks) {
+            cache.stacks[cache.count++] = mxtl::move(stack);
+            return;
+        }
+    }
+
+    // the cache is full
+    stack.mapping.reset();
+    stack.vmar->Destroy();
+}
+
+}; // namespace
+
 UserThread::~UserThread() {
     LTRACE_ENTRY_OBJ;
 
@@ -78,18 +152,10 @@ UserThread::~UserThread() {
         DEBUG_ASSERT_MSG(false, "bad state %s, this %p\n", StateToString(state_), this);
     }
 
-    // free the kernel stack
-    kstack_mapping_.reset();
-    if (kstack_vmar_) {
-        kstack_vmar_->Destroy();
-        kstack_vmar_.reset();
-    }
+    // return the kernel stack to the cache, or free it
+    free_stack(&kstack_mapping_, &kstack_vmar_);
 #if __has_feature(safe_stack)
-    unsafe_kstack_mapping_.reset();
-    if (unsafe_kstack_vmar_) {
-        unsafe_kstack_vmar_->Destroy();
-        unsafe_kstack_vmar_.reset();
-    }
+    free_stack(&unsafe_kstack_mapping_, &unsafe_kstack_vmar_);
 #endif
 
     event_destroy(&exception_event_);
@@ -100,6 +166,15 @@ namespace {
 status_t allocate_stack(const mxtl::RefPtr<VmAddressRegion>& vmar, bool unsafe,
                         mxtl::RefPtr<VmMapping>* out_kstack_mapping,
                         mxtl::RefPtr<VmAddressRegion>* out_kstack_vmar) {
+    CachedStack cached;
+    if (take_cached_stack(&cached)) {
+        LTRACEF("reusing stack mapping at %#" PRIxPTR " as %s stack\n",
+                cached.mapping->base(), unsafe ? "unsafe" : "safe");
+        *out_kstack_mapping = mxtl::move(cached.mapping);
+        *out_kstack_vmar = mxtl::move(cached.vmar);
+        return NO_ERROR;
+    }
+
     LTRACEF("allocating %s stack\n", unsafe ? "unsafe" : "safe");
 
     // Create a VMO for our stack
@@ -278,6 +353,10 @@ status_t UserThread::Start(uintptr_t entry, uintptr_t sp,
 
     thread_.user_tid = dispatcher_->get_koid();
     thread_.user_pid = process_->get_koid();
+    thread_set_sched_group(&thread_, process_->job()->sched_group());
+#if ARCH_X86_64
+    x86_rdt_set_thread_group(&thread_, process_->job()->rdt_group());
+#endif
     thread_resume(&thread_);
 
     return NO_ERROR;
@@ -703,6 +782,85 @@ status_t UserThread::MarkExceptionHandled(ExceptionStatus estatus) {
     return NO_ERROR;
 }
 
+status_t UserThread::SetExceptionHandler(const mx_exception_handler_t& handler) {
+    canary_.Assert();
+    DEBUG_ASSERT(get_current_thread() == &thread_);
+
+    if (handler.pc != 0) {
+        // The stack must have room for the frame, aligned.
+        if (handler.stack + handler.stack_size < handler.stack ||
+            handler.stack_size < sizeof(mx_exception_frame_t) + 16)
+            return ERR_INVALID_ARGS;
+    }
+
+    exception_handler_ = handler;
+    return NO_ERROR;
+}
+
+bool UserThread::StartExceptionUpcall(const mx_exception_report_t* report,
+                                      const arch_exception_context_t* arch_context) {
+    canary_.Assert();
+    DEBUG_ASSERT(get_current_thread() == &thread_);
+
+    // Exceptions in the handler itself go to the exception ports, so that a
+    // broken handler can't loop forever. Breakpoints are for debuggers.
+    if (exception_handler_.pc == 0 || exception_upcall_frame_ != 0)
+        return false;
+    if (report->header.type == MX_EXCP_SW_BREAKPOINT ||
+        report->header.type == MX_EXCP_HW_BREAKPOINT)
+        return false;
+
+    // Register access is only allowed while stopped in an exception.
+    thread_.exception_context = arch_context;
+    auto cleanup = mxtl::MakeAutoCall([this]() { thread_.exception_context = nullptr; });
+
+    mx_exception_frame_t frame;
+    frame.report = *report;
+    uint32_t regs_size = sizeof(frame.regs);
+    if (arch_get_regset(&thread_, 0, &frame.regs, &regs_size) != NO_ERROR)
+        return false;
+
+    const uintptr_t top = exception_handler_.stack + exception_handler_.stack_size;
+    const uintptr_t frame_addr = ROUNDDOWN(top - sizeof(frame), 16);
+    if (copy_to_user_unsafe(reinterpret_cast<void*>(frame_addr), &frame, sizeof(frame)) != NO_ERROR)
+        return false;
+
+    if (arch_start_exception_upcall(&thread_, exception_handler_.pc, frame_addr, frame_addr,
+                                    MX_EXCEPTION_HANDLER_RETURN_PC) != NO_ERROR)
+        return false;
+
+    LTRACEF("upcall to %#" PRIxPTR ", frame at %#" PRIxPTR "\n",
+            exception_handler_.pc, frame_addr);
+    exception_upcall_frame_ = frame_addr;
+    return true;
+}
+
+bool UserThread::FinishExceptionUpcall(const mx_exception_report_t* report,
+                                       const arch_exception_context_t* arch_context) {
+    canary_.Assert();
+    DEBUG_ASSERT(get_current_thread() == &thread_);
+
+    if (exception_upcall_frame_ == 0 ||
+        report->context.arch.pc != MX_EXCEPTION_HANDLER_RETURN_PC)
+        return false;
+
+    // The handler may have changed the registers in the frame, so read them
+    // back from there rather than keeping a copy.
+    decltype(mx_exception_frame_t::regs) regs;
+    auto frame = reinterpret_cast<const mx_exception_frame_t*>(exception_upcall_frame_);
+    if (copy_from_user_unsafe(&regs, &frame->regs, sizeof(regs)) != NO_ERROR)
+        return false;
+
+    thread_.exception_context = arch_context;
+    status_t status = arch_finish_exception_upcall(&thread_, &regs, sizeof(regs));
+    thread_.exception_context = nullptr;
+    if (status != NO_ERROR)
+        return false;
+
+    exception_upcall_frame_ = 0;
+    return true;
+}
+
 void UserThread::OnExceptionPortRemoval(const mxtl::RefPtr<ExceptionPort>& eport) {
     canary_.Assert();
 
@@ -728,6 +886,16 @@ bool UserThread::InExceptionLocked() {
     return thread_stopped_in_exception(&thread_);
 }
 
+void UserThread::AddSchedStats(mx_info_thread_stats_t* stats) const {
+    thread_sched_stats sched;
+    thread_get_sched_stats(&thread_, &sched);
+    stats->runtime_ns += sched.runtime;
+    stats->wait_ns += sched.wait_time;
+    stats->voluntary_switches += sched.voluntary_switches;
+    stats->involuntary_switches += sched.involuntary_switches;
+    stats->page_faults += sched.page_faults;
+}
+
 void UserThread::GetInfoForUserspace(mx_info_thread_t* info) {
     canary_.Assert();
 
@@ -6,6 +6,7 @@
 
 #include <magenta/vm_object_dispatcher.h>
 
+#include <kernel/auto_lock.h>
 #include <kernel/vm/vm_aspace.h>
 #include <kernel/vm/vm_object.h>
 
@@ -36,7 +37,11 @@ status_t VmObjectDispatcher::Create(mxtl::RefPtr<VmObject> vmo,
 VmObjectDispatcher::VmObjectDispatcher(mxtl::RefPtr<VmObject> vmo)
     : vmo_(vmo), state_tracker_(0u) {}
 
-VmObjectDispatcher::~VmObjectDispatcher() {}
+VmObjectDispatcher::~VmObjectDispatcher() {
+    AutoLock lock(&pin_lock_);
+    for (const auto& pin : pins_)
+        vmo_->Unpin(pin.offset, pin.size);
+}
 
 mx_status_t VmObjectDispatcher::Read(user_ptr<void> user_data,
                                      size_t length,
@@ -89,10 +94,30 @@ mx_status_t VmObjectDispatcher::RangeOp(uint32_t op, uint64_t offset, uint64_t s
             auto status = vmo_->DecommitRange(offset, size, nullptr);
             return status;
         }
-        case MX_VMO_OP_LOCK:
-        case MX_VMO_OP_UNLOCK:
-            // TODO: handle
-            return ERR_NOT_SUPPORTED;
+        case MX_VMO_OP_LOCK: {
+            // locks of discardable objects cover the whole object, the range is ignored
+            bool was_discarded;
+            auto status = vmo_->LockDiscardable(&was_discarded);
+            if (status == ERR_NOT_SUPPORTED)
+                return Pin(offset, size, buffer, buffer_size);
+            if (status != NO_ERROR || !buffer)
+                return status;
+
+            // tell the caller whether the contents are gone
+            uint32_t discarded = was_discarded ? 1u : 0u;
+            if (buffer_size < sizeof(discarded) ||
+                buffer.reinterpret<uint32_t>().copy_to_user(discarded) != NO_ERROR) {
+                vmo_->UnlockDiscardable();
+                return ERR_INVALID_ARGS;
+            }
+            return NO_ERROR;
+        }
+        case MX_VMO_OP_UNLOCK: {
+            auto status = vmo_->UnlockDiscardable();
+            if (status != ERR_NOT_SUPPORTED)
+                return status;
+            return Unpin(offset, size);
+        }
         case MX_VMO_OP_LOOKUP:
             // we will be using the user pointer
             if (!buffer)
@@ -115,6 +140,68 @@ mx_status_t VmObjectDispatcher::RangeOp(uint32_t op, uint64_t offset, uint64_t s
     }
 }
 
+mx_status_t VmObjectDispatcher::Pin(uint64_t offset, uint64_t size,
+                                    user_ptr<void> buffer, size_t buffer_size) {
+    canary_.Assert();
+
+    if (size == 0 || offset + size < offset)
+        return ERR_INVALID_ARGS;
+
+    // the physical address of each page goes in the buffer, like MX_VMO_OP_LOOKUP
+    auto user_buffer = buffer.reinterpret<paddr_t>();
+    if (buffer) {
+        uint64_t start = ROUNDDOWN(offset, PAGE_SIZE);
+        uint64_t end = ROUNDUP(offset + size, PAGE_SIZE);
+        if ((end - start) / PAGE_SIZE * sizeof(paddr_t) > buffer_size)
+            return ERR_BUFFER_TOO_SMALL;
+    }
+    vmo_lookup_fn_t copy_to_user = [](void* context, size_t offset, size_t index,
+                                      paddr_t pa) -> status_t {
+        user_ptr<paddr_t>* buffer = static_cast<user_ptr<paddr_t>*>(context);
+        return buffer->element_offset(index).copy_to_user(pa);
+    };
+
+    AutoLock lock(&pin_lock_);
+
+    AllocChecker ac;
+    pins_.reserve(pins_.size() + 1, &ac);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    auto status = vmo_->Pin(offset, size, buffer ? copy_to_user : nullptr, &user_buffer);
+    if (status != NO_ERROR)
+        return status;
+
+    pins_.push_back(PinnedRange{offset, size}, &ac);
+    DEBUG_ASSERT(ac.check());
+
+    return NO_ERROR;
+}
+
+mx_status_t VmObjectDispatcher::Unpin(uint64_t offset, uint64_t size) {
+    canary_.Assert();
+
+    AutoLock lock(&pin_lock_);
+
+    // only ranges pinned through this object can be unpinned through it
+    for (size_t i = 0; i < pins_.size(); i++) {
+        if (pins_[i].offset == offset && pins_[i].size == size) {
+            auto status = vmo_->Unpin(offset, size);
+            DEBUG_ASSERT(status == NO_ERROR);
+            pins_.erase(i);
+            return status;
+        }
+    }
+
+    return ERR_NOT_FOUND;
+}
+
+mx_status_t VmObjectDispatcher::SetCachePolicy(uint32_t cache_policy) {
+    canary_.Assert();
+
+    return vmo_->SetMappingCachePolicy(cache_policy);
+}
+
 mx_status_t VmObjectDispatcher::Clone(uint32_t options, uint64_t offset, uint64_t size,
         mxtl::RefPtr<VmObject>* clone_vmo) {
     canary_.Assert();
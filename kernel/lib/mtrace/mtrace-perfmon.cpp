@@ -0,0 +1,75 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#ifdef __x86_64__ // entire file
+
+#include <inttypes.h>
+
+#include <arch/user_copy.h>
+#include "lib/mtrace.h"
+#include "trace.h"
+
+#include <magenta/mtrace.h>
+
+#include "arch/x86/perf_mon.h"
+
+#define LOCAL_TRACE 0
+
+status_t mtrace_perfmon_control(uint32_t action, uint32_t options,
+                                void* arg, uint32_t size) {
+    LTRACEF("action %u, options 0x%x, arg %p, size 0x%x\n",
+            action, options, arg, size);
+
+    switch (action) {
+    case MTRACE_PERFMON_GET_PROPERTIES: {
+        mx_perfmon_properties_t props;
+        if (options != 0 || size != sizeof(props))
+            return ERR_INVALID_ARGS;
+        auto status = x86_perfmon_get_properties(&props);
+        if (status != NO_ERROR)
+            return status;
+        if (arch_copy_to_user(arg, &props, size) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+        return NO_ERROR;
+    }
+
+    case MTRACE_PERFMON_START: {
+        mx_perfmon_config_t config;
+        if (options != 0 || size != sizeof(config))
+            return ERR_INVALID_ARGS;
+        if (arch_copy_from_user(&config, arg, size) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+        LTRACEF("action %u, flags 0x%x, thread %" PRIu64 ", period %" PRIu64 "\n",
+                action, config.flags, config.thread_koid, config.sample_period);
+        return x86_perfmon_start(&config);
+    }
+
+    case MTRACE_PERFMON_STOP:
+        if (options != 0 || size != 0)
+            return ERR_INVALID_ARGS;
+        return x86_perfmon_stop();
+
+    case MTRACE_PERFMON_GET_COUNTS: {
+        mx_perfmon_counts_t counts;
+        if (size != sizeof(counts))
+            return ERR_INVALID_ARGS;
+        uint32_t cpu = MTRACE_PERFMON_OPTIONS_CPU(options);
+        if ((options & ~MTRACE_PERFMON_OPTIONS_CPU_MASK) != 0)
+            return ERR_INVALID_ARGS;
+        auto status = x86_perfmon_get_counts(cpu, &counts);
+        if (status != NO_ERROR)
+            return status;
+        if (arch_copy_to_user(arg, &counts, size) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+        return NO_ERROR;
+    }
+
+    default:
+        return ERR_INVALID_ARGS;
+    }
+}
+
+#endif
@@ -24,6 +24,8 @@ status_t mtrace_control(uint32_t kind, uint32_t action, uint32_t options,
 #ifdef __x86_64__
     case MTRACE_KIND_IPT:
         return mtrace_ipt_control(action, options, arg, size);
+    case MTRACE_KIND_PERFMON:
+        return mtrace_perfmon_control(action, options, arg, size);
 #endif
     default:
         return ERR_INVALID_ARGS;
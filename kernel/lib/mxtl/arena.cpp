@@ -187,7 +187,8 @@ void* Arena::Pool::Pop() {
         }
     }
     char* slot = top_;
-    top_ += slot_size_;
+    // Pairs with the unlocked read in InRange().
+    __atomic_store_n(&top_, top_ + slot_size_, __ATOMIC_RELEASE);
     return slot;
 }
 
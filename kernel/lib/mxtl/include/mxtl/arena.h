@@ -34,6 +34,10 @@ public:
     status_t Init(const char* name, size_t ob_size, size_t max_count);
     void* Alloc();
     void Free(void* addr);
+
+    // Objects are never given back to the data pool once allocated, so
+    // a true result stays true and this is safe to call without
+    // serializing against Alloc() and Free().
     bool in_range(void* addr) const {
         return data_.InRange(static_cast<char*>(addr));
     }
@@ -78,7 +82,7 @@ private:
         // Returns true if |addr| could have been returned by Pop and has
         // not been reclaimed by Push.
         bool InRange(void* addr) const {
-            return (addr >= start_ && addr < top_);
+            return (addr >= start_ && addr < __atomic_load_n(&top_, __ATOMIC_ACQUIRE));
         }
 
         // The lowest address of the memory managed by this Pool.
@@ -12,6 +12,7 @@ MODULE := $(LOCAL_DIR)
 MODULE_DEPS := \
     kernel/lib/console \
     kernel/lib/crypto \
+    kernel/lib/iovec \
     kernel/lib/magenta \
     kernel/lib/user_copy \
     kernel/lib/vdso \
@@ -7,11 +7,15 @@
 #include <err.h>
 #include <lib/ktrace.h>
 #include <kernel/thread.h>
+#include <lk/init.h>
 #include <platform.h>
 #include <trace.h>
 
 #include <inttypes.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "syscalls_priv.h"
 
@@ -22,6 +26,55 @@ int sys_invalid_syscall(void) {
     return ERR_BAD_SYSCALL;
 }
 
+// Per-cpu histograms of syscall latency. Each cpu only bumps its own counters
+// and readers sum them up, so neither side takes a lock.
+typedef uint64_t syscall_latency_hist_t[SYSCALL_LATENCY_MAX_SYSCALLS]
+                                       [MX_INFO_SYSCALL_LATENCY_BUCKETS];
+
+static syscall_latency_hist_t* syscall_latency;
+static uint syscall_latency_cpus;
+
+static void syscall_latency_init(uint level) {
+    uint cpus = arch_max_num_cpus();
+    syscall_latency = static_cast<syscall_latency_hist_t*>(
+        calloc(cpus, sizeof(syscall_latency_hist_t)));
+    if (syscall_latency)
+        syscall_latency_cpus = cpus;
+}
+
+static inline void syscall_latency_record(uint64_t syscall_num, lk_time_t start) {
+    uint cpu = arch_curr_cpu_num();
+    if (unlikely(syscall_num >= SYSCALL_LATENCY_MAX_SYSCALLS || cpu >= syscall_latency_cpus))
+        return;
+
+    // floor(log2(elapsed)), with anything under 2ns in the first bucket
+    lk_time_t elapsed = current_time() - start;
+    uint bucket = 63 - __builtin_clzll(elapsed | 1);
+    if (bucket >= MX_INFO_SYSCALL_LATENCY_BUCKETS)
+        bucket = MX_INFO_SYSCALL_LATENCY_BUCKETS - 1;
+
+    // we may be preempted onto another cpu here, the add is atomic so the
+    // count just lands in that cpu's histogram
+    __atomic_fetch_add(&syscall_latency[cpu][syscall_num][bucket], 1u, __ATOMIC_RELAXED);
+}
+
+void syscall_latency_read(uint32_t syscall_num, mx_info_syscall_latency_t* info) {
+    memset(info, 0, sizeof(*info));
+    info->syscall_num = syscall_num;
+    if (syscall_num >= SYSCALL_LATENCY_MAX_SYSCALLS)
+        return;
+
+    for (uint cpu = 0; cpu < syscall_latency_cpus; ++cpu) {
+        for (uint i = 0; i < MX_INFO_SYSCALL_LATENCY_BUCKETS; ++i) {
+            uint64_t n = __atomic_load_n(&syscall_latency[cpu][syscall_num][i], __ATOMIC_RELAXED);
+            info->buckets[i] += n;
+            info->count += n;
+        }
+    }
+}
+
+LK_INIT_HOOK(syscall_latency, syscall_latency_init, LK_INIT_LEVEL_APPS - 1);
+
 inline uint64_t invoke_syscall(uint64_t syscall_num, uint64_t arg1, uint64_t arg2, uint64_t arg3,
                                uint64_t arg4, uint64_t arg5, uint64_t arg6, uint64_t arg7, uint64_t arg8) {
     uint64_t ret;
@@ -35,6 +88,50 @@ inline uint64_t invoke_syscall(uint64_t syscall_num, uint64_t arg1, uint64_t arg
     return ret;
 }
 
+// Like invoke_syscall(), but only knows the syscalls that may be batched.
+static uint64_t invoke_batched_syscall(uint64_t syscall_num, uint64_t arg1, uint64_t arg2,
+                                       uint64_t arg3, uint64_t arg4, uint64_t arg5,
+                                       uint64_t arg6, uint64_t arg7, uint64_t arg8) {
+    uint64_t ret;
+
+    switch (syscall_num) {
+#include <magenta/syscall-batch-cases.inc>
+        default:
+            ret = ERR_BAD_SYSCALL;
+    }
+
+    return ret;
+}
+
+mx_status_t sys_syscall_batch(user_ptr<mx_batch_op_t> ops, uint32_t count, uint32_t options) {
+    if (options & ~MX_BATCH_STOP_ON_ERROR)
+        return ERR_INVALID_ARGS;
+    if (count > MX_BATCH_MAX_OPS)
+        return ERR_OUT_OF_RANGE;
+
+    bool stopped = false;
+    for (uint32_t i = 0; i < count; ++i) {
+        user_ptr<mx_batch_op_t> uop = ops.element_offset(i);
+        auto ustatus = uop.byte_offset(offsetof(mx_batch_op_t, status)).reinterpret<mx_status_t>();
+
+        mx_status_t status = ERR_CANCELED;
+        if (!stopped) {
+            mx_batch_op_t op;
+            if (uop.copy_from_user(&op) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            status = static_cast<mx_status_t>(invoke_batched_syscall(
+                op.syscall_num, op.args[0], op.args[1], op.args[2], op.args[3],
+                op.args[4], op.args[5], op.args[6], op.args[7]));
+            stopped = (status < 0) && (options & MX_BATCH_STOP_ON_ERROR);
+        }
+
+        if (ustatus.copy_to_user(status) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+    }
+
+    return NO_ERROR;
+}
+
 #if ARCH_ARM64
 #include <arch/arm64.h>
 
@@ -59,8 +156,10 @@ extern "C" void arm64_syscall(struct arm64_iframe_long* frame, bool is_64bit, ui
     LTRACEF_LEVEL(2, "num %" PRIu64 "\n", syscall_num);
 
     /* call the routine */
+    lk_time_t start = current_time();
     uint64_t ret = invoke_syscall(syscall_num, frame->r[0], frame->r[1], frame->r[2], frame->r[3],
                                   frame->r[4], frame->r[5], frame->r[6], frame->r[7]);
+    syscall_latency_record(syscall_num, start);
 
     LTRACEF_LEVEL(2, "ret %#" PRIx64 "\n", ret);
 
@@ -109,7 +208,9 @@ struct x86_64_syscall_result x86_64_syscall(
     LTRACEF_LEVEL(2, "t %p syscall num %" PRIu64 " ip %#" PRIx64 "\n",
                   thread, syscall_num, ip);
 
+    lk_time_t start = current_time();
     uint64_t ret = invoke_syscall(syscall_num, arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8);
+    syscall_latency_record(syscall_num, start);
 
     LTRACEF_LEVEL(2, "t %p ret %#" PRIx64 "\n", thread, ret);
 
@@ -92,11 +92,11 @@ void msg_get_handles(ProcessDispatcher* up, MessagePacket* msg,
     } while (num_copied < num_handles);
 
     for (size_t idx = 0u; idx < num_handles; ++idx) {
-        if (handle_list[idx]->dispatcher()->get_state_tracker())
-            handle_list[idx]->dispatcher()->get_state_tracker()->Cancel(handle_list[idx]);
-        HandleOwner handle(handle_list[idx]);
-        up->AddHandle(mxtl::move(handle));
+        StateTracker* state_tracker = handle_list[idx]->dispatcher_ptr()->get_state_tracker();
+        if (state_tracker)
+            state_tracker->Cancel(handle_list[idx]);
     }
+    up->AddHandles(handle_list, num_handles);
 }
 
 mx_status_t sys_channel_read(mx_handle_t handle_value, uint32_t options,
@@ -108,13 +108,13 @@ mx_status_t sys_channel_read(mx_handle_t handle_value, uint32_t options,
 
     auto up = ProcessDispatcher::GetCurrent();
 
-    mxtl::RefPtr<ChannelDispatcher> channel;
-    mx_status_t result = up->GetDispatcherWithRights(handle_value, MX_RIGHT_READ, &channel);
+    HandleBorrowGuard borrow;
+    ChannelDispatcher* channel;
+    mx_status_t result = up->GetBorrowedDispatcherWithRights(handle_value, MX_RIGHT_READ, &channel);
     if (result != NO_ERROR)
         return result;
 
-    // Currently MAY_DISCARD is the only allowable option.
-    if (options & ~MX_CHANNEL_READ_MAY_DISCARD)
+    if (options & ~(MX_CHANNEL_READ_MAY_DISCARD | MX_CHANNEL_READ_MOVE_PAGES))
         return ERR_NOT_SUPPORTED;
 
     mxtl::unique_ptr<MessagePacket> msg;
@@ -137,7 +137,7 @@ mx_status_t sys_channel_read(mx_handle_t handle_value, uint32_t options,
         return result;
 
     if (num_bytes > 0u) {
-        if (_bytes.copy_array_to_user(msg->data(), num_bytes) != NO_ERROR)
+        if (msg->CopyDataTo(_bytes, options & MX_CHANNEL_READ_MOVE_PAGES) != NO_ERROR)
             return ERR_INVALID_ARGS;
     }
 
@@ -157,44 +157,78 @@ static mx_status_t msg_put_handles(ProcessDispatcher* up, MessagePacket* msg, mx
         return ERR_INVALID_ARGS;
 
     {
-        // Loop twice, first we collect and validate handles, the second pass
-        // we remove them from this process.
+        // Validate and take out each handle in one pass under one hold of
+        // the lock, putting back what was taken out if any turns out bad.
         AutoLock lock(up->handle_table_lock());
 
+        Handle** msg_handles = msg->mutable_handles();
         for (size_t ix = 0; ix != num_handles; ++ix) {
-            auto handle = up->GetHandleLocked(handles[ix]);
-            if (!handle)
-                return ERR_BAD_HANDLE;
-
-            if (handle->dispatcher().get() == channel) {
+            Handle* handle = up->GetHandleLocked(handles[ix]);
+            mx_status_t status = NO_ERROR;
+            if (!handle) {
+                // Passing duplicate handles is not allowed; an earlier copy
+                // of this value took the handle out already.
+                up->UndoRemoveHandlesLocked(handles, ix);
+                // TODO: more specific error?
+                return up->GetHandleLocked(handles[ix]) ? ERR_INVALID_ARGS : ERR_BAD_HANDLE;
+            } else if (handle->dispatcher_ptr() == channel) {
                 // You may not write a channel endpoint handle
                 // into that channel endpoint
-                return ERR_NOT_SUPPORTED;
+                status = ERR_NOT_SUPPORTED;
+            } else if (!magenta_rights_check(handle, MX_RIGHT_TRANSFER)) {
+                status = ERR_ACCESS_DENIED;
+            }
+            if (status != NO_ERROR) {
+                up->UndoRemoveHandlesLocked(handles, ix);
+                return status;
             }
 
-            if (!magenta_rights_check(handle, MX_RIGHT_TRANSFER))
-                return ERR_ACCESS_DENIED;
-
-            msg->mutable_handles()[ix] = handle;
+            msg_handles[ix] = up->RemoveHandleLocked(handles[ix]).release();
         }
+    }
 
-        for (size_t ix = 0; ix != num_handles; ++ix) {
-            auto handle = up->RemoveHandleLocked(handles[ix]).release();
-            // Passing duplicate handles is not allowed.
-            // If we've already seen this handle flag an error.
-            if (!handle) {
-                // Put back the handles we've already removed.
-                for (size_t idx = 0; idx < ix; ++idx) {
-                    up->UndoRemoveHandleLocked(handles[idx]);
-                }
-                // TODO: more specific error?
+    // On success, the MessagePacket owns the handles.
+    msg->set_owns_handles(true);
+    return NO_ERROR;
+}
+
+// Builds a message from user memory for writing to |channel|, taking the handles out of the
+// process. |handles| must have room for |num_handles| values.
+static mx_status_t msg_create_from_user(ProcessDispatcher* up, ChannelDispatcher* channel,
+                                        uint32_t options,
+                                        user_ptr<const void> _bytes, uint32_t num_bytes,
+                                        mx_handle_t* handles,
+                                        user_ptr<const mx_handle_t> _handles,
+                                        uint32_t num_handles,
+                                        mxtl::unique_ptr<MessagePacket>* out) {
+    mxtl::unique_ptr<MessagePacket> msg;
+    mx_status_t result = ERR_NOT_SUPPORTED;
+    if (options & MX_CHANNEL_WRITE_MOVE_PAGES) {
+        // Large page aligned payloads are moved rather than copied, anything
+        // else silently takes the copying path.
+        result = MessagePacket::CreateFromUserPages(_bytes, num_bytes, num_handles, &msg);
+        if (result != NO_ERROR && result != ERR_NOT_SUPPORTED)
+            return result;
+    }
+    if (result == ERR_NOT_SUPPORTED) {
+        result = MessagePacket::Create(num_bytes, num_handles, &msg);
+        if (result != NO_ERROR)
+            return result;
+
+        if (num_bytes > 0u) {
+            if (_bytes.copy_array_from_user(msg->mutable_data(), num_bytes) != NO_ERROR)
                 return ERR_INVALID_ARGS;
-            }
         }
     }
 
-    // On success, the MessagePacket owns the handles.
-    msg->set_owns_handles(true);
+    if (num_handles > 0u) {
+        result = msg_put_handles(up, msg.get(), handles, _handles, num_handles,
+                                 static_cast<Dispatcher*>(channel));
+        if (result)
+            return result;
+    }
+
+    *out = mxtl::move(msg);
     return NO_ERROR;
 }
 
@@ -204,45 +238,117 @@ mx_status_t sys_channel_write(mx_handle_t handle_value, uint32_t options,
     LTRACEF("handle %d bytes %p num_bytes %u handles %p num_handles %u options 0x%x\n",
             handle_value, _bytes.get(), num_bytes, _handles.get(), num_handles, options);
 
-    if (options)
+    if (options & ~MX_CHANNEL_WRITE_MOVE_PAGES)
         return ERR_INVALID_ARGS;
 
     auto up = ProcessDispatcher::GetCurrent();
 
-    mxtl::RefPtr<ChannelDispatcher> channel;
-    mx_status_t result = up->GetDispatcherWithRights(handle_value, MX_RIGHT_WRITE, &channel);
+    HandleBorrowGuard borrow;
+    ChannelDispatcher* channel;
+    mx_status_t result = up->GetBorrowedDispatcherWithRights(handle_value, MX_RIGHT_WRITE, &channel);
     if (result != NO_ERROR)
         return result;
 
+    AllocChecker ac;
+    mxtl::InlineArray<mx_handle_t, kChannelWriteHandlesInlineCount> handles(&ac, num_handles);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
 
     mxtl::unique_ptr<MessagePacket> msg;
-    result = MessagePacket::Create(num_bytes, num_handles, &msg);
+    result = msg_create_from_user(up, channel, options, _bytes, num_bytes,
+                                  handles.get(), _handles, num_handles, &msg);
     if (result != NO_ERROR)
         return result;
 
-    if (num_bytes > 0u) {
-        if (_bytes.copy_array_from_user(msg->mutable_data(), num_bytes) != NO_ERROR)
-            return ERR_INVALID_ARGS;
+    result = channel->Write(mxtl::move(msg));
+    if (result != NO_ERROR) {
+        // Write failed, put back the handles into this process.
+        AutoLock lock(up->handle_table_lock());
+        up->UndoRemoveHandlesLocked(handles.get(), num_handles);
     }
 
-    AllocChecker ac;
-    mxtl::InlineArray<mx_handle_t, kChannelWriteHandlesInlineCount> handles(&ac, num_handles);
-    if (!ac.check())
-        return ERR_NO_MEMORY;
+    ktrace(TAG_CHANNEL_WRITE, (uint32_t)channel->get_koid(), num_bytes, num_handles, 0);
+    return result;
+}
+
+// Like msg_create_from_user() but gathers the payload from |num_vec| user
+// segments straight into the MessagePacket.
+static mx_status_t msg_create_from_user_iovec(ProcessDispatcher* up, ChannelDispatcher* channel,
+                                              const iovec_t* vec, uint32_t num_vec,
+                                              mx_handle_t* handles,
+                                              user_ptr<const mx_handle_t> _handles,
+                                              uint32_t num_handles,
+                                              mxtl::unique_ptr<MessagePacket>* out) {
+    ssize_t total = iovec_size(vec, num_vec);
+    if (total < 0)
+        return static_cast<mx_status_t>(total);
+    // Each segment is checked so that the total can't have wrapped around.
+    for (uint32_t i = 0; i < num_vec; ++i) {
+        if (vec[i].iov_len > UINT32_MAX)
+            return ERR_OUT_OF_RANGE;
+    }
+    if (static_cast<size_t>(total) > UINT32_MAX)
+        return ERR_OUT_OF_RANGE;
+    uint32_t num_bytes = static_cast<uint32_t>(total);
+
+    mxtl::unique_ptr<MessagePacket> msg;
+    mx_status_t result = MessagePacket::Create(num_bytes, num_handles, &msg);
+    if (result != NO_ERROR)
+        return result;
+
+    if (copy_iovec_from_user_unsafe(msg->mutable_data(), vec, num_vec) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
     if (num_handles > 0u) {
-        result = msg_put_handles(up, msg.get(), handles.get(), _handles, num_handles,
-                                 static_cast<Dispatcher*>(channel.get()));
+        result = msg_put_handles(up, msg.get(), handles, _handles, num_handles,
+                                 static_cast<Dispatcher*>(channel));
         if (result)
             return result;
     }
 
+    *out = mxtl::move(msg);
+    return NO_ERROR;
+}
+
+mx_status_t sys_channel_writev(mx_handle_t handle_value, uint32_t options,
+                               user_ptr<const mx_iovec_t> _vec, uint32_t num_vec,
+                               user_ptr<const mx_handle_t> _handles, uint32_t num_handles) {
+    LTRACEF("handle %d num_vec %u handles %p num_handles %u options 0x%x\n",
+            handle_value, num_vec, _handles.get(), num_handles, options);
+
+    if (options)
+        return ERR_INVALID_ARGS;
+
+    iovec_t vec[MX_IOVEC_MAX];
+    mx_status_t result = copy_iovec_from_user(_vec, num_vec, vec);
+    if (result != NO_ERROR)
+        return result;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    HandleBorrowGuard borrow;
+    ChannelDispatcher* channel;
+    result = up->GetBorrowedDispatcherWithRights(handle_value, MX_RIGHT_WRITE, &channel);
+    if (result != NO_ERROR)
+        return result;
+
+    AllocChecker ac;
+    mxtl::InlineArray<mx_handle_t, kChannelWriteHandlesInlineCount> handles(&ac, num_handles);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    mxtl::unique_ptr<MessagePacket> msg;
+    result = msg_create_from_user_iovec(up, channel, vec, num_vec,
+                                        handles.get(), _handles, num_handles, &msg);
+    if (result != NO_ERROR)
+        return result;
+
+    uint32_t num_bytes = msg->data_size();
     result = channel->Write(mxtl::move(msg));
     if (result != NO_ERROR) {
         // Write failed, put back the handles into this process.
         AutoLock lock(up->handle_table_lock());
-        for (size_t ix = 0; ix != num_handles; ++ix) {
-            up->UndoRemoveHandleLocked(handles[ix]);
-        }
+        up->UndoRemoveHandlesLocked(handles.get(), num_handles);
     }
 
     ktrace(TAG_CHANNEL_WRITE, (uint32_t)channel->get_koid(), num_bytes, num_handles, 0);
@@ -304,9 +410,7 @@ mx_status_t sys_channel_call(mx_handle_t handle_value, uint32_t options,
             // Write phase failed:
             // 1. Put back the handles into this process.
             AutoLock lock(up->handle_table_lock());
-            for (size_t ix = 0; ix != num_handles; ++ix) {
-                up->UndoRemoveHandleLocked(handles[ix]);
-            }
+            up->UndoRemoveHandlesLocked(handles.get(), num_handles);
             // 2. Return error directly.  Note that if err is
             // ERR_SUSPEND_PENDING, the syscall glue will fully retry the Call
             // on resume.
@@ -351,7 +455,7 @@ mx_status_t sys_channel_call(mx_handle_t handle_value, uint32_t options,
     }
 
     if (num_bytes > 0u) {
-        if (make_user_ptr(args.rd_bytes).copy_array_to_user(reply->data(), num_bytes) != NO_ERROR) {
+        if (reply->CopyDataTo(make_user_ptr(args.rd_bytes), false) != NO_ERROR) {
             result = ERR_INVALID_ARGS;
             goto read_failed;
         }
@@ -368,3 +472,149 @@ read_failed:
         read_status.copy_to_user(result);
     return ERR_CALL_FAILED;
 }
+
+mx_status_t sys_channel_read_many(mx_handle_t handle_value, uint32_t options,
+                                  user_ptr<mx_channel_msg_t> _msgs, uint32_t count,
+                                  user_ptr<uint32_t> _actual) {
+    LTRACEF("handle %d msgs %p count %u options 0x%x\n",
+            handle_value, _msgs.get(), count, options);
+
+    if (options & ~MX_CHANNEL_READ_MOVE_PAGES)
+        return ERR_NOT_SUPPORTED;
+    if (count == 0u || count > MX_CHANNEL_MAX_BATCH)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    HandleBorrowGuard borrow;
+    ChannelDispatcher* channel;
+    mx_status_t result = up->GetBorrowedDispatcherWithRights(handle_value, MX_RIGHT_READ, &channel);
+    if (result != NO_ERROR)
+        return result;
+
+    AllocChecker ac;
+    mxtl::unique_ptr<mx_channel_msg_t[]> slots(new (&ac) mx_channel_msg_t[count]);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+    if (_msgs.copy_array_from_user(slots.get(), count) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    ChannelDispatcher::MessageList msgs;
+    result = channel->ReadMany(slots.get(), count, &msgs);
+    if (result != NO_ERROR && result != ERR_BUFFER_TOO_SMALL)
+        return result;
+
+    // The slots taken are followed by at most one more, holding the size of the message that
+    // did not fit. As with channel_read the messages are consumed even if the copy out faults.
+    uint32_t actual = 0u;
+    uint32_t num_bytes = 0u;
+    uint32_t num_handles = 0u;
+    while (!msgs.is_empty()) {
+        mxtl::unique_ptr<MessagePacket> msg = msgs.pop_front();
+        mx_channel_msg_t* slot = &slots[actual++];
+        num_bytes += slot->num_bytes;
+        num_handles += slot->num_handles;
+
+        if (slot->num_bytes > 0u) {
+            if (msg->CopyDataTo(make_user_ptr(slot->bytes),
+                                options & MX_CHANNEL_READ_MOVE_PAGES) != NO_ERROR)
+                slot->status = ERR_INVALID_ARGS;
+        }
+        if (slot->num_handles > 0u)
+            msg_get_handles(up, msg.get(), make_user_ptr(slot->handles), slot->num_handles);
+    }
+
+    uint32_t num_slots = (actual < count && slots[actual].status == ERR_BUFFER_TOO_SMALL) ?
+                         actual + 1u : actual;
+    if (_msgs.copy_array_to_user(slots.get(), num_slots) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+    if (_actual.copy_to_user(actual) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    ktrace(TAG_CHANNEL_READ, (uint32_t)channel->get_koid(), num_bytes, num_handles, 0);
+    return result;
+}
+
+mx_status_t sys_channel_write_many(mx_handle_t handle_value, uint32_t options,
+                                   user_ptr<mx_channel_msg_t> _msgs, uint32_t count,
+                                   user_ptr<uint32_t> _actual) {
+    LTRACEF("handle %d msgs %p count %u options 0x%x\n",
+            handle_value, _msgs.get(), count, options);
+
+    if (options & ~MX_CHANNEL_WRITE_MOVE_PAGES)
+        return ERR_INVALID_ARGS;
+    if (count == 0u || count > MX_CHANNEL_MAX_BATCH)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    HandleBorrowGuard borrow;
+    ChannelDispatcher* channel;
+    mx_status_t result = up->GetBorrowedDispatcherWithRights(handle_value, MX_RIGHT_WRITE, &channel);
+    if (result != NO_ERROR)
+        return result;
+
+    AllocChecker ac;
+    mxtl::unique_ptr<mx_channel_msg_t[]> slots(new (&ac) mx_channel_msg_t[count]);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+    if (_msgs.copy_array_from_user(slots.get(), count) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    // Build messages until the first one that fails, those before it are still written.
+    ChannelDispatcher::MessageList msgs;
+    uint32_t actual = 0u;
+    uint32_t num_bytes = 0u;
+    uint32_t num_handles = 0u;
+    for (; actual < count; ++actual) {
+        mx_channel_msg_t* slot = &slots[actual];
+
+        mxtl::InlineArray<mx_handle_t, kChannelWriteHandlesInlineCount> handles(
+            &ac, slot->num_handles);
+        if (!ac.check()) {
+            slot->status = ERR_NO_MEMORY;
+            break;
+        }
+
+        mxtl::unique_ptr<MessagePacket> msg;
+        slot->status = msg_create_from_user(up, channel, options,
+                                            make_user_ptr<const void>(slot->bytes),
+                                            slot->num_bytes, handles.get(),
+                                            make_user_ptr<const mx_handle_t>(slot->handles),
+                                            slot->num_handles, &msg);
+        if (slot->status != NO_ERROR)
+            break;
+
+        num_bytes += slot->num_bytes;
+        num_handles += slot->num_handles;
+        msgs.push_back(mxtl::move(msg));
+    }
+
+    // Report back the status of every message built and of the one that failed, if any.
+    uint32_t num_slots = actual < count ? actual + 1u : actual;
+    if (actual > 0u) {
+        result = channel->WriteMany(&msgs);
+        if (result != NO_ERROR) {
+            // Write failed, put back the handles of every message into this process.
+            AutoLock lock(up->handle_table_lock());
+            for (auto& msg : msgs) {
+                for (size_t ix = 0; ix != msg.num_handles(); ++ix)
+                    up->AddHandleLocked(HandleOwner(msg.handles()[ix]));
+            }
+            msgs.clear();
+            for (uint32_t ix = 0; ix != actual; ++ix)
+                slots[ix].status = result;
+            actual = 0u;
+        }
+    } else {
+        result = slots[0].status;
+    }
+
+    if (_msgs.copy_array_to_user(slots.get(), num_slots) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+    if (_actual.copy_to_user(actual) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    ktrace(TAG_CHANNEL_WRITE, (uint32_t)channel->get_koid(), num_bytes, num_handles, 0);
+    return result;
+}
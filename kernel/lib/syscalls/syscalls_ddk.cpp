@@ -29,6 +29,7 @@
 #include <magenta/interrupt_event_dispatcher.h>
 #include <magenta/io_mapping_dispatcher.h>
 #include <magenta/magenta.h>
+#include <magenta/port_dispatcher_v2.h>
 #include <magenta/process_dispatcher.h>
 #include <magenta/syscalls/pci.h>
 #include <magenta/user_copy.h>
@@ -106,6 +107,27 @@ mx_status_t sys_interrupt_signal(mx_handle_t handle_value) {
     return interrupt->UserSignal();
 }
 
+mx_status_t sys_interrupt_bind(mx_handle_t handle_value, mx_handle_t port_handle,
+                               uint64_t key, uint32_t options) {
+    LTRACEF("handle %d port %d\n", handle_value, port_handle);
+
+    if (options != 0u)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+    mxtl::RefPtr<InterruptDispatcher> interrupt;
+    mx_status_t status = up->GetDispatcherWithRights(handle_value, MX_RIGHT_READ, &interrupt);
+    if (status != NO_ERROR)
+        return status;
+
+    mxtl::RefPtr<PortDispatcherV2> port;
+    status = up->GetDispatcherWithRights(port_handle, MX_RIGHT_WRITE, &port);
+    if (status != NO_ERROR)
+        return status;
+
+    return interrupt->BindPort(mxtl::move(port), key);
+}
+
 mx_status_t sys_mmap_device_memory(mx_handle_t hrsrc, uintptr_t paddr, uint32_t len,
                                    mx_cache_policy_t cache_policy,
                                    user_ptr<uintptr_t> _out_vaddr) {
@@ -573,6 +573,19 @@ mx_status_t sys_pci_set_irq_mode(mx_handle_t dev_handle,
 
     return pci_device->SetIrqMode((mx_pci_irq_mode_t)mode, requested_irq_count);
 }
+
+mx_status_t sys_pci_set_irq_affinity(mx_handle_t dev_handle, int32_t which_irq, uint32_t cpu) {
+    LTRACEF("handle %d irq %d cpu %u\n", dev_handle, which_irq, cpu);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<PciDeviceDispatcher> pci_device;
+    mx_status_t status = up->GetDispatcherWithRights(dev_handle, MX_RIGHT_WRITE, &pci_device);
+    if (status != NO_ERROR)
+        return status;
+
+    return pci_device->SetIrqAffinity(which_irq, cpu);
+}
 #else  // WITH_DEV_PCIE
 mx_status_t sys_pci_init(mx_handle_t, user_ptr<<const>mx_pci_init_arg_t>, uint32_t) {
     shutdown_early_init_console();
@@ -630,4 +643,8 @@ mx_status_t sys_pci_query_irq_mode_caps(mx_handle_t, uint32_t, user_ptr<uint32_t
 mx_status_t sys_pci_set_irq_mode(mx_handle_t, uint32_t, uint32_t) {
     return ERR_NOT_SUPPORTED;
 }
+
+mx_status_t sys_pci_set_irq_affinity(mx_handle_t, int32_t, uint32_t) {
+    return ERR_NOT_SUPPORTED;
+}
 #endif // WITH_DEV_PCIE
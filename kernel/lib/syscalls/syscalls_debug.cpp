@@ -142,7 +142,8 @@ mx_status_t sys_ktrace_control(
     }
 
     switch (action) {
-    case KTRACE_ACTION_NEW_PROBE: {
+    case KTRACE_ACTION_NEW_PROBE:
+    case KTRACE_ACTION_BOOT_STAGE: {
         char name[MX_MAX_NAME_LEN];
         if (_ptr.copy_array_from_user(name, sizeof(name) - 1) != NO_ERROR)
             return ERR_INVALID_ARGS;
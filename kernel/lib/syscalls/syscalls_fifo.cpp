@@ -28,6 +28,9 @@
 
 mx_status_t sys_fifo_create(uint32_t count, uint32_t elemsize, uint32_t options,
                             user_ptr<mx_handle_t> _out0, user_ptr<mx_handle_t> _out1) {
+    if (options & ~MX_FIFO_SHARED_RING)
+        return ERR_INVALID_ARGS;
+
     mxtl::RefPtr<Dispatcher> dispatcher0;
     mxtl::RefPtr<Dispatcher> dispatcher1;
     mx_rights_t rights;
@@ -95,3 +98,36 @@ mx_status_t sys_fifo_read(mx_handle_t handle, user_ptr<void> entries, size_t len
 
     return NO_ERROR;
 }
+
+mx_status_t sys_fifo_get_rings(mx_handle_t handle, user_ptr<mx_handle_t> _rx,
+                               user_ptr<mx_handle_t> _tx) {
+    LTRACEF("handle %d\n", handle);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<FifoDispatcher> fifo;
+    mx_status_t status = up->GetDispatcherWithRights(
+        handle, MX_RIGHT_READ | MX_RIGHT_WRITE, &fifo);
+    if (status != NO_ERROR)
+        return status;
+
+    mxtl::RefPtr<VmObject> rx_vmo, tx_vmo;
+    status = fifo->GetRings(&rx_vmo, &tx_vmo);
+    if (status != NO_ERROR)
+        return status;
+
+    return copy_ring_handles_to_user(mxtl::move(rx_vmo), mxtl::move(tx_vmo), _rx, _tx);
+}
+
+mx_status_t sys_fifo_ring_update(mx_handle_t handle) {
+    LTRACEF("handle %d\n", handle);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<FifoDispatcher> fifo;
+    mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_WRITE, &fifo);
+    if (status != NO_ERROR)
+        return status;
+
+    return fifo->RingUpdate();
+}
@@ -7,6 +7,9 @@
 #include <trace.h>
 
 #include <magenta/process_dispatcher.h>
+#include <magenta/thread_dispatcher.h>
+
+#include <mxtl/ref_ptr.h>
 
 #include "syscalls_priv.h"
 
@@ -20,6 +23,24 @@ mx_status_t sys_futex_wait(user_ptr<mx_futex_t> value_ptr, int current_value, mx
         value_ptr, current_value, deadline);
 }
 
+mx_status_t sys_futex_wait_pi(user_ptr<mx_futex_t> value_ptr, int current_value,
+                             mx_handle_t owner, mx_time_t deadline) {
+    LTRACEF("futex %p current %d owner %d\n", value_ptr.get(), current_value, owner);
+    magenta_check_deadline("futex_wait_pi", deadline);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    // Changing how the owner is scheduled needs the same right as setting
+    // its profile.
+    mxtl::RefPtr<ThreadDispatcher> thread;
+    mx_status_t status = up->GetDispatcherWithRights(owner, MX_RIGHT_WRITE, &thread);
+    if (status != NO_ERROR)
+        return status;
+
+    // |thread| keeps the owner alive for as long as it is boosted.
+    return up->futex_context()->FutexWaitPi(value_ptr, current_value, thread->thread(), deadline);
+}
+
 mx_status_t sys_futex_wake(user_ptr<const mx_futex_t> value_ptr, uint32_t count) {
     LTRACEF("futex %p count %" PRIu32 "\n", value_ptr.get(), count);
 
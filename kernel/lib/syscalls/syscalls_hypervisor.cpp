@@ -8,6 +8,7 @@
 #include <magenta/guest_dispatcher.h>
 #include <magenta/handle_owner.h>
 #include <magenta/hypervisor_dispatcher.h>
+#include <magenta/port_dispatcher_v2.h>
 #include <magenta/process_dispatcher.h>
 #include <magenta/syscalls/hypervisor.h>
 #include <magenta/vm_object_dispatcher.h>
@@ -108,6 +109,22 @@ static mx_status_t guest_set_esi(mx_handle_t handle, uint32_t guest_esi) {
 
     return guest->set_esi(guest_esi);
 }
+
+static mx_status_t guest_set_io_trap(mx_handle_t handle, const mx_guest_io_trap_t& io_trap) {
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<GuestDispatcher> guest;
+    mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_EXECUTE, &guest);
+    if (status != NO_ERROR)
+        return status;
+
+    mxtl::RefPtr<PortDispatcherV2> port;
+    status = up->GetDispatcherWithRights(io_trap.port, MX_RIGHT_WRITE, &port);
+    if (status != NO_ERROR)
+        return status;
+
+    return guest->set_io_trap(io_trap.io_port, mxtl::move(port), io_trap.key);
+}
 #endif
 
 static mx_status_t guest_set_entry(mx_handle_t handle, uintptr_t guest_entry) {
@@ -167,6 +184,16 @@ static mx_status_t guest_set_entry(mx_handle_t handle, uintptr_t guest_entry) {
             return ERR_INVALID_ARGS;
         return guest_set_esi(handle, guest_esi);
     }
+    case MX_HYPERVISOR_OP_GUEST_SET_IO_TRAP: {
+        mx_guest_io_trap_t io_trap;
+        if (args_len != sizeof(io_trap))
+            return ERR_INVALID_ARGS;
+        if (args.copy_array_from_user(&io_trap, sizeof(io_trap)) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+        if (io_trap.reserved != 0)
+            return ERR_INVALID_ARGS;
+        return guest_set_io_trap(handle, io_trap);
+    }
 #endif // ARCH_X86_64
     default:
         return ERR_INVALID_ARGS;
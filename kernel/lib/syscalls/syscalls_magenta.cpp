@@ -189,7 +189,11 @@ mx_status_t sys_log_create(uint32_t options, user_ptr<mx_handle_t> out) {
 mx_status_t sys_log_write(mx_handle_t log_handle, uint32_t len, user_ptr<const void> _ptr, uint32_t options) {
     LTRACEF("log handle %d, len 0x%x, ptr 0x%p\n", log_handle, len, _ptr.get());
 
-    if (len > DLOG_MAX_DATA)
+    if (options & ~MX_LOG_WRITE_MULTIPLE)
+        return ERR_INVALID_ARGS;
+
+    bool multiple = (options & MX_LOG_WRITE_MULTIPLE) != 0;
+    if (len > (multiple ? MX_LOG_WRITE_MULTIPLE_MAX : DLOG_MAX_DATA))
         return ERR_OUT_OF_RANGE;
 
     auto up = ProcessDispatcher::GetCurrent();
@@ -200,16 +204,39 @@ mx_status_t sys_log_write(mx_handle_t log_handle, uint32_t len, user_ptr<const v
         return status;
 
     char buf[DLOG_MAX_RECORD];
-    // TODO(andymutton): Change to use a user_ptr copy.
-    if (magenta_copy_from_user(_ptr.get(), buf, len) != NO_ERROR)
-        return ERR_INVALID_ARGS;
+    if (!multiple) {
+        // TODO(andymutton): Change to use a user_ptr copy.
+        if (magenta_copy_from_user(_ptr.get(), buf, len) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+
+        return log->Write(0, buf, len);
+    }
+
+    // Each entry is padded out to 4 bytes, so the writer steps from one to
+    // the next with MX_LOG_ENTRY_SIZE(), as readers do with records.
+    uint32_t off = 0;
+    while (off < len && len - off >= sizeof(mx_log_entry_t)) {
+        mx_log_entry_t entry;
+        if (_ptr.byte_offset(off).reinterpret<const mx_log_entry_t>().copy_from_user(&entry) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+        if (entry.datalen > DLOG_MAX_DATA || entry.datalen > len - off - sizeof(entry))
+            return ERR_INVALID_ARGS;
+        if (_ptr.byte_offset(off + sizeof(entry)).copy_array_from_user(buf, entry.datalen) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+        if ((status = log->Write(0, buf, entry.datalen)) != NO_ERROR)
+            return status;
+        off += static_cast<uint32_t>(MX_LOG_ENTRY_SIZE(&entry));
+    }
 
-    return log->Write(options, buf, len);
+    return NO_ERROR;
 }
 
 mx_status_t sys_log_read(mx_handle_t log_handle, uint32_t len, user_ptr<void> _ptr, uint32_t options) {
     LTRACEF("log handle %d, len 0x%x, ptr 0x%p\n", log_handle, len, _ptr.get());
 
+    if (options & ~MX_LOG_READ_MULTIPLE)
+        return ERR_INVALID_ARGS;
+
     if (len < DLOG_MAX_RECORD)
         return ERR_BUFFER_TOO_SMALL;
 
@@ -220,15 +247,23 @@ mx_status_t sys_log_read(mx_handle_t log_handle, uint32_t len, user_ptr<void> _p
     if (status != NO_ERROR)
         return status;
 
+    // Each record is padded out to 4 bytes, so a reader can step from one
+    // to the next with MX_LOG_RECORD_SIZE().
     char buf[DLOG_MAX_RECORD];
-    size_t actual;
-    if ((status = log->Read(options, buf, DLOG_MAX_RECORD, &actual)) < 0)
-        return status;
-
-    if (_ptr.copy_array_to_user(buf, actual) != NO_ERROR)
-        return ERR_INVALID_ARGS;
+    uint32_t total = 0;
+    do {
+        size_t actual;
+        if ((status = log->Read(0, buf, DLOG_MAX_RECORD, &actual)) < 0) {
+            if (total > 0)
+                break;
+            return status;
+        }
+        if (_ptr.byte_offset(total).copy_array_to_user(buf, actual) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+        total += static_cast<uint32_t>(ROUNDUP(actual, 4u));
+    } while ((options & MX_LOG_READ_MULTIPLE) && len - total >= DLOG_MAX_RECORD);
 
-    return static_cast<mx_status_t>(actual);
+    return static_cast<mx_status_t>(total);
 }
 
 mx_status_t sys_cprng_draw(user_ptr<void> _buffer, size_t len, user_ptr<size_t> _actual) {
@@ -237,9 +272,7 @@ mx_status_t sys_cprng_draw(user_ptr<void> _buffer, size_t len, user_ptr<size_t>
 
     uint8_t kernel_buf[kMaxCPRNGDraw];
 
-    auto prng = crypto::GlobalPRNG::GetInstance();
-    ASSERT(prng->is_thread_safe());
-    prng->Draw(kernel_buf, static_cast<int>(len));
+    crypto::GlobalPRNG::DrawPerCpu(kernel_buf, len);
 
     if (_buffer.copy_array_to_user(kernel_buf, len) != NO_ERROR)
         return ERR_INVALID_ARGS;
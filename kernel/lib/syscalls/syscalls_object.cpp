@@ -8,6 +8,10 @@
 #include <inttypes.h>
 #include <trace.h>
 
+#include <kernel/vm.h>
+#include <kernel/vm/mem_stats.h>
+#include <lib/heap.h>
+
 #include <magenta/handle_owner.h>
 #include <magenta/job_dispatcher.h>
 #include <magenta/magenta.h>
@@ -68,6 +72,120 @@ private:
     size_t count_ = 0;
     size_t avail_ = 0;
 };
+
+void AddThreadStats(const mx_info_thread_stats_t& from, mx_info_thread_stats_t* to) {
+    to->runtime_ns += from.runtime_ns;
+    to->wait_ns += from.wait_ns;
+    to->voluntary_switches += from.voluntary_switches;
+    to->involuntary_switches += from.involuntary_switches;
+    to->page_faults += from.page_faults;
+}
+
+// Writes out a job and everything below it as records, in the order that
+// walk_job_tree() visits them: the job, its processes each followed by their
+// threads, then its child jobs. Records past |max| are only counted.
+class TaskTreeWriter final {
+public:
+    TaskTreeWriter(user_ptr<mx_info_task_record_t> ptr, size_t max)
+        : ptr_(ptr), max_(max) {}
+
+    size_t get_avail() const { return avail_; }
+    size_t get_count() const { return avail_ < max_ ? avail_ : max_; }
+
+    // Adds |job| and its descendants, and their counters to |sched|.
+    status_t AddJob(JobDispatcher* job, mx_koid_t parent_koid, uint32_t depth,
+                    mx_info_thread_stats_t* sched) {
+        mx_info_task_record_t record = {};
+        record.koid = job->get_koid();
+        record.parent_koid = parent_koid;
+        record.type = MX_OBJ_TYPE_JOB;
+        record.depth = depth;
+        job->get_name(record.name);
+
+        // A job's counters are the sum of its children's, so its slot is
+        // filled in once they have all been visited.
+        size_t index = avail_++;
+
+        mxtl::Array<mxtl::RefPtr<ProcessDispatcher>> procs;
+        mxtl::Array<mxtl::RefPtr<JobDispatcher>> jobs;
+        status_t status = job->GetChildren(&procs, &jobs);
+        if (status != NO_ERROR)
+            return status;
+        for (size_t i = 0; i < procs.size(); i++) {
+            status = AddProcess(procs[i].get(), record.koid, depth + 1, &record.sched);
+            if (status != NO_ERROR)
+                return status;
+        }
+        for (size_t i = 0; i < jobs.size(); i++) {
+            // Like EnumerateChildren, this recurses as deep as the job tree.
+            status = AddJob(jobs[i].get(), record.koid, depth + 1, &record.sched);
+            if (status != NO_ERROR)
+                return status;
+        }
+
+        AddThreadStats(record.sched, sched);
+        return Write(index, record);
+    }
+
+private:
+    status_t AddProcess(ProcessDispatcher* proc, mx_koid_t parent_koid, uint32_t depth,
+                        mx_info_thread_stats_t* sched) {
+        mx_info_task_record_t record = {};
+        record.koid = proc->get_koid();
+        record.parent_koid = parent_koid;
+        record.type = MX_OBJ_TYPE_PROCESS;
+        record.depth = depth;
+        proc->get_name(record.name);
+        status_t status = proc->GetInfo(&record.process);
+        if (status != NO_ERROR)
+            return status;
+        // A process which has exited no longer has an address space to measure.
+        status = proc->GetStats(&record.task);
+        if (status != NO_ERROR && status != ERR_BAD_STATE)
+            return status;
+        proc->AddSchedStats(&record.sched);
+        AddThreadStats(record.sched, sched);
+        status = Write(avail_++, record);
+        if (status != NO_ERROR)
+            return status;
+
+        mxtl::Array<mxtl::RefPtr<UserThread>> threads;
+        status = proc->GetUserThreads(&threads);
+        if (status != NO_ERROR)
+            return status;
+        for (size_t i = 0; i < threads.size(); i++) {
+            status = AddThread(threads[i].get(), record.koid, depth + 1);
+            if (status != NO_ERROR)
+                return status;
+        }
+        return NO_ERROR;
+    }
+
+    status_t AddThread(UserThread* thread, mx_koid_t parent_koid, uint32_t depth) {
+        mx_info_task_record_t record = {};
+        record.koid = thread->get_koid();
+        record.parent_koid = parent_koid;
+        record.type = MX_OBJ_TYPE_THREAD;
+        record.depth = depth;
+        thread->get_name(record.name);
+        thread->GetInfoForUserspace(&record.thread);
+        thread->AddSchedStats(&record.sched);
+        return Write(avail_++, record);
+    }
+
+    status_t Write(size_t index, const mx_info_task_record_t& record) {
+        if (index >= max_)
+            return NO_ERROR;
+        if (ptr_.element_offset(index).copy_to_user(record) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+        return NO_ERROR;
+    }
+
+    const user_ptr<mx_info_task_record_t> ptr_;
+    const size_t max_;
+
+    size_t avail_ = 0;
+};
 } // namespace
 
 // actual is an optional return parameter for the number of records returned
@@ -210,6 +328,28 @@ mx_status_t sys_object_get_info(mx_handle_t handle, uint32_t topic,
                 return ERR_INVALID_ARGS;
             return NO_ERROR;
         }
+        case MX_INFO_JOB_TREE: {
+            mxtl::RefPtr<JobDispatcher> job;
+            auto error = up->GetDispatcherWithRights(
+                handle, MX_RIGHT_ENUMERATE | MX_RIGHT_READ, &job);
+            if (error < 0)
+                return error;
+
+            // The whole tree is gathered in this one call, but it is not
+            // frozen while that happens: tasks may come and go meanwhile.
+            size_t max = buffer_size / sizeof(mx_info_task_record_t);
+            TaskTreeWriter writer(_buffer.reinterpret<mx_info_task_record_t>(), max);
+            mx_info_thread_stats_t sched = {};
+            auto status = writer.AddJob(job.get(), job->get_related_koid(),
+                                        /* depth */ 0, &sched);
+            if (status != NO_ERROR)
+                return status;
+            if (_actual && (_actual.copy_to_user(writer.get_count()) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (_avail && (_avail.copy_to_user(writer.get_avail()) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            return NO_ERROR;
+        }
         case MX_INFO_RESOURCE_CHILDREN:
         case MX_INFO_RESOURCE_RECORDS: {
             mxtl::RefPtr<ResourceDispatcher> resource;
@@ -328,6 +468,168 @@ mx_status_t sys_object_get_info(mx_handle_t handle, uint32_t topic,
                 return ERR_BUFFER_TOO_SMALL;
             return NO_ERROR;
         }
+        case MX_INFO_THREAD_STATS: {
+            size_t actual =
+                (buffer_size < sizeof(mx_info_thread_stats_t)) ? 0 : 1;
+            size_t avail = 1;
+
+            // Threads report their own counters, processes and jobs the sum
+            // over the threads in them.
+            mxtl::RefPtr<Dispatcher> dispatcher;
+            auto error = up->GetDispatcherWithRights(handle, MX_RIGHT_READ,
+                                                     &dispatcher);
+            if (error < 0)
+                return error;
+
+            mx_info_thread_stats_t info = {};
+            status_t err;
+            if (auto thread = DownCastDispatcher<ThreadDispatcher>(&dispatcher)) {
+                err = thread->GetSchedStats(&info);
+            } else if (auto process = DownCastDispatcher<ProcessDispatcher>(&dispatcher)) {
+                process->AddSchedStats(&info);
+                err = NO_ERROR;
+            } else if (auto job = DownCastDispatcher<JobDispatcher>(&dispatcher)) {
+                err = job->AddSchedStats(&info);
+            } else {
+                return ERR_WRONG_TYPE;
+            }
+            if (err != NO_ERROR)
+                return err;
+
+            if (actual > 0) {
+                if (_buffer.copy_array_to_user(&info, sizeof(info)) != NO_ERROR)
+                    return ERR_INVALID_ARGS;
+            }
+            if (_actual && (_actual.copy_to_user(actual) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (_avail && (_avail.copy_to_user(avail) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (actual == 0)
+                return ERR_BUFFER_TOO_SMALL;
+            return NO_ERROR;
+        }
+        case MX_INFO_SYSCALL_LATENCY: {
+            mx_status_t status = validate_resource_handle(handle);
+            if (status < 0)
+                return status;
+
+            // only the syscalls that have been called are reported
+            auto entries = _buffer.reinterpret<mx_info_syscall_latency_t>();
+            size_t count = buffer_size / sizeof(mx_info_syscall_latency_t);
+            size_t actual = 0;
+            size_t avail = 0;
+            for (uint32_t num = 0; num < SYSCALL_LATENCY_MAX_SYSCALLS; ++num) {
+                mx_info_syscall_latency_t info;
+                syscall_latency_read(num, &info);
+                if (info.count == 0)
+                    continue;
+                if (actual < count) {
+                    if (entries.element_offset(actual).copy_to_user(info) != NO_ERROR)
+                        return ERR_INVALID_ARGS;
+                    ++actual;
+                }
+                ++avail;
+            }
+
+            if (_actual && (_actual.copy_to_user(actual) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (_avail && (_avail.copy_to_user(avail) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            return NO_ERROR;
+        }
+        case MX_INFO_KMEM_STATS: {
+            // TODO: finer grained validation
+            mx_status_t status = validate_resource_handle(handle);
+            if (status < 0)
+                return status;
+
+            size_t actual = (buffer_size < sizeof(mx_info_kmem_stats_t)) ? 0 : 1;
+            size_t avail = 1;
+            if (actual > 0) {
+                auto pages = [](unsigned int state) -> uint64_t {
+                    int64_t count = kmem_stat_read(KMEM_STAT_PAGES + state);
+                    return count > 0 ? count * PAGE_SIZE : 0;
+                };
+                mx_info_kmem_stats_t info = {};
+                info.total_bytes = pmm_count_total_bytes();
+                info.free_bytes = pmm_count_free_pages() * PAGE_SIZE;
+                info.wired_bytes = pages(VM_PAGE_STATE_WIRED);
+                info.heap_bytes = pages(VM_PAGE_STATE_HEAP);
+                size_t heap_size, heap_free;
+                heap_get_info(&heap_size, &heap_free);
+                info.heap_used_bytes = heap_size - heap_free;
+                info.mmu_bytes = pages(VM_PAGE_STATE_MMU);
+                info.vmo_bytes = pages(VM_PAGE_STATE_OBJECT);
+                info.other_bytes = pages(VM_PAGE_STATE_ALLOC);
+                int64_t pinned = kmem_stat_read(KMEM_STAT_PINNED_BYTES);
+                info.pinned_bytes = pinned > 0 ? pinned : 0;
+                int64_t physical = kmem_stat_read(KMEM_STAT_PHYSICAL_VMO_BYTES);
+                info.physical_vmo_bytes = physical > 0 ? physical : 0;
+                info.handle_count = GetOutstandingHandleCount();
+                int64_t compressed = kmem_stat_read(KMEM_STAT_COMPRESSED_PAGES);
+                info.compressed_bytes = compressed > 0 ? compressed * PAGE_SIZE : 0;
+                int64_t pool = kmem_stat_read(KMEM_STAT_COMPRESSED_BYTES);
+                info.compressed_pool_bytes = pool > 0 ? pool : 0;
+                info.compressed_hits = kmem_stat_read(KMEM_STAT_COMPRESSED_HITS);
+                info.compressed_misses = kmem_stat_read(KMEM_STAT_COMPRESSED_MISSES);
+
+                if (_buffer.copy_array_to_user(&info, sizeof(info)) != NO_ERROR)
+                    return ERR_INVALID_ARGS;
+            }
+            if (_actual && (_actual.copy_to_user(actual) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (_avail && (_avail.copy_to_user(avail) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (actual == 0)
+                return ERR_BUFFER_TOO_SMALL;
+            return NO_ERROR;
+        }
+        case MX_INFO_JOB_CACHE_OCCUPANCY: {
+            mxtl::RefPtr<JobDispatcher> job;
+            mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_READ, &job);
+            if (status < 0)
+                return status;
+
+            size_t actual = (buffer_size < sizeof(mx_info_cache_occupancy_t)) ? 0 : 1;
+            size_t avail = 1;
+            if (actual > 0) {
+                mx_info_cache_occupancy_t info = {};
+                status = job->GetCacheOccupancy(&info.l3_bytes);
+                if (status != NO_ERROR)
+                    return status;
+                if (_buffer.copy_array_to_user(&info, sizeof(info)) != NO_ERROR)
+                    return ERR_INVALID_ARGS;
+            }
+            if (_actual && (_actual.copy_to_user(actual) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (_avail && (_avail.copy_to_user(avail) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (actual == 0)
+                return ERR_BUFFER_TOO_SMALL;
+            return NO_ERROR;
+        }
+        case MX_INFO_JOB_MEMORY: {
+            mxtl::RefPtr<JobDispatcher> job;
+            mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_READ, &job);
+            if (status < 0)
+                return status;
+
+            size_t actual = (buffer_size < sizeof(mx_info_job_memory_t)) ? 0 : 1;
+            size_t avail = 1;
+            if (actual > 0) {
+                mx_info_job_memory_t info = {};
+                job->GetMemoryInfo(&info);
+                if (_buffer.copy_array_to_user(&info, sizeof(info)) != NO_ERROR)
+                    return ERR_INVALID_ARGS;
+            }
+            if (_actual && (_actual.copy_to_user(actual) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (_avail && (_avail.copy_to_user(avail) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (actual == 0)
+                return ERR_BUFFER_TOO_SMALL;
+            return NO_ERROR;
+        }
         case MX_INFO_PROCESS_MAPS: {
             mxtl::RefPtr<ProcessDispatcher> process;
             mx_status_t status =
@@ -417,6 +719,17 @@ mx_status_t sys_object_get_property(mx_handle_t handle_value, uint32_t property,
                 return ERR_INVALID_ARGS;
             return NO_ERROR;
         }
+        case MX_PROP_EXCEPTION_HANDLER: {
+            if (size < sizeof(mx_exception_handler_t))
+                return ERR_BUFFER_TOO_SMALL;
+            mx_status_t status = is_current_thread(&dispatcher);
+            if (status != NO_ERROR)
+                return status;
+            mx_exception_handler_t handler;
+            if (_value.reinterpret<const mx_exception_handler_t>().copy_from_user(&handler) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            return UserThread::GetCurrent()->SetExceptionHandler(handler);
+        }
         case MX_PROP_PROCESS_DEBUG_ADDR: {
             if (size < sizeof(uintptr_t))
                 return ERR_BUFFER_TOO_SMALL;
@@ -437,6 +750,17 @@ mx_status_t sys_object_get_property(mx_handle_t handle_value, uint32_t property,
             uintptr_t value = process->aspace()->vdso_base_address();
             return _value.reinterpret<uintptr_t>().copy_to_user(value);
         }
+        case MX_PROP_JOB_COMPRESS_MEMORY: {
+            if (size < sizeof(uint32_t))
+                return ERR_BUFFER_TOO_SMALL;
+            auto job = DownCastDispatcher<JobDispatcher>(&dispatcher);
+            if (!job)
+                return ERR_WRONG_TYPE;
+            uint32_t value = job->compress_memory() ? 1u : 0u;
+            if (_value.reinterpret<uint32_t>().copy_to_user(value) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            return NO_ERROR;
+        }
         default:
             return ERR_INVALID_ARGS;
     }
@@ -501,18 +825,54 @@ mx_status_t sys_object_set_property(mx_handle_t handle_value, uint32_t property,
                 return ERR_INVALID_ARGS;
             return process->set_debug_addr(value);
         }
+        case MX_PROP_JOB_COMPRESS_MEMORY: {
+            if (size < sizeof(uint32_t))
+                return ERR_BUFFER_TOO_SMALL;
+            auto job = DownCastDispatcher<JobDispatcher>(&dispatcher);
+            if (!job)
+                return ERR_WRONG_TYPE;
+            uint32_t value = 0;
+            if (_value.reinterpret<const uint32_t>().copy_from_user(&value) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            job->set_compress_memory(value != 0);
+            return NO_ERROR;
+        }
     }
 
     return ERR_INVALID_ARGS;
 }
 
+mx_status_t sys_object_set_profile(mx_handle_t handle_value, user_ptr<const mx_profile_t> _profile,
+                                   uint32_t options) {
+    LTRACEF("handle %d\n", handle_value);
+
+    if (options != 0u)
+        return ERR_INVALID_ARGS;
+
+    mx_profile_t profile;
+    if (_profile.copy_from_user(&profile) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+    if (profile.reserved != 0u)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<ThreadDispatcher> thread;
+    mx_status_t status = up->GetDispatcherWithRights(handle_value, MX_RIGHT_WRITE, &thread);
+    if (status != NO_ERROR)
+        return status;
+
+    return thread->SetProfile(profile);
+}
+
 mx_status_t sys_object_signal(mx_handle_t handle_value, uint32_t clear_mask, uint32_t set_mask) {
     LTRACEF("handle %d\n", handle_value);
 
     auto up = ProcessDispatcher::GetCurrent();
-    mxtl::RefPtr<Dispatcher> dispatcher;
+    HandleBorrowGuard borrow;
+    Dispatcher* dispatcher;
 
-    auto status = up->GetDispatcherWithRights(handle_value, MX_RIGHT_WRITE, &dispatcher);
+    auto status = up->GetBorrowedDispatcherWithRights(handle_value, MX_RIGHT_WRITE, &dispatcher);
     if (status != NO_ERROR)
         return status;
 
@@ -523,9 +883,10 @@ mx_status_t sys_object_signal_peer(mx_handle_t handle_value, uint32_t clear_mask
     LTRACEF("handle %d\n", handle_value);
 
     auto up = ProcessDispatcher::GetCurrent();
-    mxtl::RefPtr<Dispatcher> dispatcher;
+    HandleBorrowGuard borrow;
+    Dispatcher* dispatcher;
 
-    auto status = up->GetDispatcher(handle_value, &dispatcher);
+    auto status = up->GetBorrowedDispatcherWithRights(handle_value, 0u, &dispatcher);
     if (status != NO_ERROR)
         return status;
 
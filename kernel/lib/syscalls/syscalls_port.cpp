@@ -18,6 +18,7 @@
 #include <magenta/user_copy.h>
 
 #include <mxtl/ref_ptr.h>
+#include <mxtl/unique_ptr.h>
 
 #include "syscalls_priv.h"
 
@@ -26,14 +27,17 @@
 mx_status_t sys_port_create(uint32_t options, user_ptr<mx_handle_t> _out) {
     LTRACEF("options %u\n", options);
 
-    // Currently, the only allowed option is to switch on PortsV2.
-    if (options & ~MX_PORT_OPT_V2)
+    // The only allowed options are to switch on PortsV2 and, for those,
+    // per cpu packet queues.
+    if (options & ~(MX_PORT_OPT_V2 | MX_PORT_OPT_PERCPU))
+        return ERR_INVALID_ARGS;
+    if ((options & MX_PORT_OPT_PERCPU) && !(options & MX_PORT_OPT_V2))
         return ERR_INVALID_ARGS;
 
     mxtl::RefPtr<Dispatcher> dispatcher;
     mx_rights_t rights;
 
-    mx_status_t result = (options == MX_PORT_OPT_V2) ?
+    mx_status_t result = (options & MX_PORT_OPT_V2) ?
         PortDispatcherV2::Create(options, &dispatcher, &rights):
         PortDispatcher::Create(options, &dispatcher, &rights);
 
@@ -61,8 +65,9 @@ mx_status_t sys_port_create(uint32_t options, user_ptr<mx_handle_t> _out) {
 static mx_status_t sys_port_queue2(mx_handle_t handle, user_ptr<const void> _packet) {
     auto up = ProcessDispatcher::GetCurrent();
 
-    mxtl::RefPtr<PortDispatcherV2> port;
-    mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_WRITE, &port);
+    HandleBorrowGuard borrow;
+    PortDispatcherV2* port;
+    mx_status_t status = up->GetBorrowedDispatcherWithRights(handle, MX_RIGHT_WRITE, &port);
     if (status != NO_ERROR)
         return status;
 
@@ -81,8 +86,9 @@ mx_status_t sys_port_queue(mx_handle_t handle, user_ptr<const void> _packet, siz
 
     auto up = ProcessDispatcher::GetCurrent();
 
-    mxtl::RefPtr<PortDispatcher> port;
-    mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_WRITE, &port);
+    HandleBorrowGuard borrow;
+    PortDispatcher* port;
+    mx_status_t status = up->GetBorrowedDispatcherWithRights(handle, MX_RIGHT_WRITE, &port);
     if (status != NO_ERROR) {
         return (size == 0u) ? sys_port_queue2(handle, _packet) : status;
     }
@@ -119,6 +125,40 @@ mx_status_t sys_port_wait2(mx_handle_t handle, mx_time_t deadline, user_ptr<void
     return NO_ERROR;
 }
 
+mx_status_t sys_port_wait_many(mx_handle_t handle, mx_time_t deadline,
+                               user_ptr<mx_port_packet_t> _packets, uint32_t count,
+                               user_ptr<uint32_t> _actual) {
+    magenta_check_deadline("port_wait_many", deadline);
+    LTRACEF("handle %d count %u\n", handle, count);
+
+    if (count == 0u || count > MX_PORT_MAX_BATCH)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<PortDispatcherV2> port;
+    mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_WRITE, &port);
+    if (status != NO_ERROR)
+        return status;
+
+    AllocChecker ac;
+    mxtl::unique_ptr<mx_port_packet_t[]> packets(new (&ac) mx_port_packet_t[count]);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    uint32_t actual;
+    status = port->DeQueueMany(deadline, packets.get(), count, &actual);
+    if (status != NO_ERROR)
+        return status;
+
+    // The packets are gone from the port even if the copy out fails.
+    if (_packets.copy_array_to_user(packets.get(), actual) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+    if (_actual.copy_to_user(actual) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+    return NO_ERROR;
+}
+
 mx_status_t sys_port_wait(mx_handle_t handle, mx_time_t deadline,
                           user_ptr<void> _packet, size_t size) {
     magenta_check_deadline("port_wait", deadline);
@@ -6,8 +6,48 @@
 
 #pragma once
 
+#include <err.h>
+#include <iovec.h>
 #include <magenta/types.h>
+#include <magenta/syscalls/batch.h>
+#include <magenta/syscalls/object.h>
+#include <magenta/syscalls/port.h>
 #include <magenta/syscalls/types.h>
 #include <lib/user_copy/user_ptr.h>
+#include <mxtl/ref_ptr.h>
 
 #include <magenta/syscall-definitions.h>
+
+class VmObject;
+
+// Syscalls numbered at or above this aren't counted in the latency histograms.
+#define SYSCALL_LATENCY_MAX_SYSCALLS 256u
+
+// Sums the per-cpu latency histograms of |syscall_num| into |info|.
+void syscall_latency_read(uint32_t syscall_num, mx_info_syscall_latency_t* info);
+
+// Copies the segment array of a writev call into |vec|, which must have room
+// for MX_IOVEC_MAX entries. The segments themselves stay user pointers.
+static inline mx_status_t copy_iovec_from_user(user_ptr<const mx_iovec_t> _vec, uint32_t num_vec,
+                                               iovec_t* vec) {
+    if (num_vec > MX_IOVEC_MAX)
+        return ERR_OUT_OF_RANGE;
+
+    mx_iovec_t uvec[MX_IOVEC_MAX];
+    if (num_vec > 0u && _vec.copy_array_from_user(uvec, num_vec) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    for (uint32_t i = 0; i < num_vec; ++i) {
+        vec[i].iov_base = const_cast<void*>(uvec[i].buffer);
+        vec[i].iov_len = uvec[i].size;
+        if (vec[i].iov_len > 0u && !vec[i].iov_base)
+            return ERR_INVALID_ARGS;
+    }
+    return NO_ERROR;
+}
+
+// Hands the two VMOs of a shared ring socket or fifo to the current process,
+// as the |rx| and |tx| results of a get_rings call.
+mx_status_t copy_ring_handles_to_user(mxtl::RefPtr<VmObject> rx_vmo,
+                                      mxtl::RefPtr<VmObject> tx_vmo,
+                                      user_ptr<mx_handle_t> _rx, user_ptr<mx_handle_t> _tx);
@@ -29,7 +29,7 @@
 mx_status_t sys_socket_create(uint32_t options, user_ptr<mx_handle_t> _out0, user_ptr<mx_handle_t> _out1) {
     LTRACEF("entry out_handles %p, %p\n", _out0.get(), _out1.get());
 
-    if (options != 0u)
+    if (options & ~MX_SOCKET_SHARED_RING)
         return ERR_INVALID_ARGS;
 
     mxtl::RefPtr<Dispatcher> socket0, socket1;
@@ -90,12 +90,42 @@ mx_status_t sys_socket_write(mx_handle_t handle, uint32_t options,
     case MX_SOCKET_HALF_CLOSE:
         if (size == 0)
             return socket->HalfClose();
-    // fall thru if size != 0.
+        return ERR_INVALID_ARGS;
     default:
         return ERR_INVALID_ARGS;
     }
 }
 
+mx_status_t sys_socket_writev(mx_handle_t handle, uint32_t options,
+                              user_ptr<const mx_iovec_t> _vec, uint32_t num_vec,
+                              user_ptr<size_t> _actual) {
+    LTRACEF("handle %d num_vec %u\n", handle, num_vec);
+
+    if (options)
+        return ERR_INVALID_ARGS;
+
+    iovec_t vec[MX_IOVEC_MAX];
+    mx_status_t status = copy_iovec_from_user(_vec, num_vec, vec);
+    if (status != NO_ERROR)
+        return status;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<SocketDispatcher> socket;
+    status = up->GetDispatcherWithRights(handle, MX_RIGHT_WRITE, &socket);
+    if (status != NO_ERROR)
+        return status;
+
+    size_t nwritten;
+    status = socket->WriteV(vec, num_vec, true, &nwritten);
+
+    // Caller may ignore results if desired.
+    if (status == NO_ERROR && _actual)
+        status = _actual.copy_to_user(nwritten);
+
+    return status;
+}
+
 mx_status_t sys_socket_read(mx_handle_t handle, uint32_t options,
                             user_ptr<void> _buffer, size_t size,
                             user_ptr<size_t> _actual) {
@@ -124,3 +154,36 @@ mx_status_t sys_socket_read(mx_handle_t handle, uint32_t options,
 
     return status;
 }
+
+mx_status_t sys_socket_get_rings(mx_handle_t handle, user_ptr<mx_handle_t> _rx,
+                                 user_ptr<mx_handle_t> _tx) {
+    LTRACEF("handle %d\n", handle);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<SocketDispatcher> socket;
+    mx_status_t status = up->GetDispatcherWithRights(
+        handle, MX_RIGHT_READ | MX_RIGHT_WRITE, &socket);
+    if (status != NO_ERROR)
+        return status;
+
+    mxtl::RefPtr<VmObject> rx_vmo, tx_vmo;
+    status = socket->GetRings(&rx_vmo, &tx_vmo);
+    if (status != NO_ERROR)
+        return status;
+
+    return copy_ring_handles_to_user(mxtl::move(rx_vmo), mxtl::move(tx_vmo), _rx, _tx);
+}
+
+mx_status_t sys_socket_ring_update(mx_handle_t handle) {
+    LTRACEF("handle %d\n", handle);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<SocketDispatcher> socket;
+    mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_WRITE, &socket);
+    if (status != NO_ERROR)
+        return status;
+
+    return socket->RingUpdate();
+}
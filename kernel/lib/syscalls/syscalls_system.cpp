@@ -12,7 +12,11 @@
 #include <kernel/thread.h>
 #include <kernel/vm.h>
 #include <kernel/vm/vm_aspace.h>
+#include <kernel/vm/vm_reclaim.h>
+#include <lk/init.h>
 #include <magenta/compiler.h>
+#include <magenta/event_dispatcher.h>
+#include <magenta/handle_owner.h>
 #include <magenta/process_dispatcher.h>
 #include <magenta/types.h>
 #include <magenta/vm_object_dispatcher.h>
@@ -153,7 +157,9 @@ static mx_status_t vmo_coalesce_pages(mx_handle_t vmo_hdl, paddr_t* addr, size_t
 
     mxtl::RefPtr<VmObject> vmo = vmo_dispatcher->vmo();
 
-    const size_t num_pages = vmo->AllocatedPages();
+    // Every page, not just those committed so far: a clone of a file's VMO
+    // may not have faulted in any of its own.
+    const size_t num_pages = static_cast<size_t>(ROUNDUP(vmo->size(), PAGE_SIZE) / PAGE_SIZE);
 
     paddr_t base_addr;
     const size_t allocated = pmm_alloc_contiguous(num_pages, PMM_ALLOC_FLAG_ANY,
@@ -331,4 +337,40 @@ mx_status_t sys_system_mexec(mx_handle_t kernel_vmo,
 
     panic("Execution should never reach here\n");
     return NO_ERROR;
-}
\ No newline at end of file
+}
+// Signaled while the system is under memory pressure, shared by every process
+// that asks for it.
+static mxtl::RefPtr<Dispatcher> memory_pressure_event;
+
+static void memory_pressure_changed(bool under_pressure) {
+    memory_pressure_event->get_state_tracker()->UpdateState(
+        under_pressure ? 0u : MX_EVENT_SIGNALED, under_pressure ? MX_EVENT_SIGNALED : 0u);
+}
+
+static void memory_pressure_init(uint level) {
+    mx_rights_t rights;
+    if (EventDispatcher::Create(0u, &memory_pressure_event, &rights) != NO_ERROR)
+        panic("unable to create the memory pressure event\n");
+    vm_reclaim_set_pressure_callback(memory_pressure_changed);
+}
+LK_INIT_HOOK(memory_pressure, memory_pressure_init, LK_INIT_LEVEL_THREADING);
+
+mx_status_t sys_system_get_memory_pressure_event(uint32_t options, user_ptr<mx_handle_t> _out) {
+    if (options)
+        return ERR_INVALID_ARGS;
+
+    // no write right, only the kernel gets to signal it
+    HandleOwner handle(MakeHandle(memory_pressure_event,
+                                  MX_RIGHT_DUPLICATE | MX_RIGHT_TRANSFER | MX_RIGHT_READ));
+    if (!handle)
+        return ERR_NO_MEMORY;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    if (_out.copy_to_user(up->MapHandleToValue(handle)) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    up->AddHandle(mxtl::move(handle));
+
+    return NO_ERROR;
+}
@@ -491,6 +491,63 @@ mx_status_t sys_job_create(mx_handle_t parent_job, uint32_t options, user_ptr<mx
     return NO_ERROR;
 }
 
+static mx_status_t job_set_rdt_policy(mx_handle_t job_handle, uint32_t options,
+                                      user_ptr<const void> _policy, uint32_t count) {
+    if (count != 1u)
+        return ERR_INVALID_ARGS;
+
+    mx_policy_rdt policy;
+    if (_policy.reinterpret<const mx_policy_rdt>().copy_from_user(&policy) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<JobDispatcher> job;
+    auto status = up->GetDispatcherWithRights(job_handle, MX_RIGHT_SET_POLICY, &job);
+    if (status != NO_ERROR)
+        return status;
+
+    return job->SetRdtPolicy(options, &policy);
+}
+
+static mx_status_t job_set_cpu_policy(mx_handle_t job_handle,
+                                      user_ptr<const void> _policy, uint32_t count) {
+    if (count != 1u)
+        return ERR_INVALID_ARGS;
+
+    mx_policy_cpu policy;
+    if (_policy.reinterpret<const mx_policy_cpu>().copy_from_user(&policy) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<JobDispatcher> job;
+    auto status = up->GetDispatcherWithRights(job_handle, MX_RIGHT_SET_POLICY, &job);
+    if (status != NO_ERROR)
+        return status;
+
+    return job->SetCpuPolicy(&policy);
+}
+
+static mx_status_t job_set_memory_policy(mx_handle_t job_handle,
+                                         user_ptr<const void> _policy, uint32_t count) {
+    if (count != 1u)
+        return ERR_INVALID_ARGS;
+
+    mx_policy_memory policy;
+    if (_policy.reinterpret<const mx_policy_memory>().copy_from_user(&policy) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<JobDispatcher> job;
+    auto status = up->GetDispatcherWithRights(job_handle, MX_RIGHT_SET_POLICY, &job);
+    if (status != NO_ERROR)
+        return status;
+
+    return job->SetMemoryPolicy(&policy);
+}
+
 mx_status_t sys_job_set_policy(mx_handle_t job_handle, uint32_t options,
     uint32_t topic, user_ptr<const void> _policy, uint32_t count) {
 
@@ -499,6 +556,12 @@ mx_status_t sys_job_set_policy(mx_handle_t job_handle, uint32_t options,
     if (!_policy || (count == 0u))
         return ERR_INVALID_ARGS;
 
+    if (topic == MX_JOB_POL_RDT)
+        return job_set_rdt_policy(job_handle, options, _policy, count);
+    if (topic == MX_JOB_POL_CPU)
+        return job_set_cpu_policy(job_handle, _policy, count);
+    if (topic == MX_JOB_POL_MEMORY)
+        return job_set_memory_policy(job_handle, _policy, count);
     if (topic != MX_JOB_POL_BASIC)
         return ERR_INVALID_ARGS;
 
@@ -123,6 +123,12 @@ mx_status_t sys_vmar_map(mx_handle_t vmar_handle, size_t vmar_offset,
         map_flags &= ~MX_VM_FLAG_MAP_RANGE;
     }
 
+    bool do_populate = false;
+    if (map_flags & MX_VM_FLAG_MAP_POPULATE) {
+        do_populate = true;
+        map_flags &= ~MX_VM_FLAG_MAP_POPULATE;
+    }
+
     // Usermode is not allowed to specify these flags on mappings, though we may
     // set them below.
     if (map_flags & (MX_VM_FLAG_CAN_MAP_READ | MX_VM_FLAG_CAN_MAP_WRITE | MX_VM_FLAG_CAN_MAP_EXECUTE)) {
@@ -162,7 +168,13 @@ mx_status_t sys_vmar_map(mx_handle_t vmar_handle, size_t vmar_offset,
         vm_mapping->Destroy();
     });
 
-    if (do_map_range) {
+    if (do_populate) {
+        // commits and maps every page, so it covers MX_VM_FLAG_MAP_RANGE too
+        status = vm_mapping->MapRange(0, vm_mapping->size(), true);
+        if (status != NO_ERROR) {
+            return status;
+        }
+    } else if (do_map_range) {
         status = vm_mapping->MapRange(0, len, false);
         if (status != NO_ERROR) {
             return status;
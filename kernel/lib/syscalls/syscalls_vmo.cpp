@@ -6,6 +6,7 @@
 
 #include <err.h>
 #include <inttypes.h>
+#include <new.h>
 #include <trace.h>
 
 #include <kernel/vm/vm_object.h>
@@ -15,7 +16,10 @@
 #include <lib/user_copy/user_ptr.h>
 
 #include <magenta/handle_owner.h>
+#include <magenta/job_dispatcher.h>
 #include <magenta/magenta.h>
+#include <magenta/pager_source.h>
+#include <magenta/port_dispatcher_v2.h>
 #include <magenta/process_dispatcher.h>
 #include <magenta/user_copy.h>
 #include <magenta/vm_object_dispatcher.h>
@@ -29,14 +33,46 @@
 mx_status_t sys_vmo_create(uint64_t size, uint32_t options, user_ptr<mx_handle_t> _out) {
     LTRACEF("size %#" PRIx64 "\n", size);
 
-    if (options)
+    if (options & ~(MX_VMO_DISCARDABLE | MX_VMO_NUMA_INTERLEAVE | MX_VMO_NUMA_NODE_VALID |
+                    MX_VMO_NUMA_NODE_MASK))
         return ERR_INVALID_ARGS;
 
-    // create a vm object
-    mxtl::RefPtr<VmObject> vmo = VmObjectPaged::Create(0, size);
+    // translate the placement policy into pmm allocation flags
+    uint32_t pmm_alloc_flags = 0;
+    if (options & MX_VMO_NUMA_NODE_VALID) {
+        if (options & MX_VMO_NUMA_INTERLEAVE)
+            return ERR_INVALID_ARGS;
+        uint32_t node = (options & MX_VMO_NUMA_NODE_MASK) >> MX_VMO_NUMA_NODE_SHIFT;
+        if (node >= PMM_MAX_NUMA_NODES)
+            return ERR_INVALID_ARGS;
+        pmm_alloc_flags = PMM_ALLOC_FLAG_NODE(node);
+    } else if (options & MX_VMO_NUMA_NODE_MASK) {
+        return ERR_INVALID_ARGS;
+    } else if (options & MX_VMO_NUMA_INTERLEAVE) {
+        pmm_alloc_flags = PMM_ALLOC_FLAG_INTERLEAVE;
+    }
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    // create a vm object. jobs that opted in get objects whose cold pages may
+    // be compressed, discardable ones are thrown away instead.
+    mxtl::RefPtr<VmObject> vmo;
+    auto job = up->job();
+    if (options & MX_VMO_DISCARDABLE)
+        vmo = VmObjectPaged::CreateDiscardable(pmm_alloc_flags, size);
+    else if (job && job->compress_memory())
+        vmo = VmObjectPaged::CreateCompressible(pmm_alloc_flags, size);
+    else
+        vmo = VmObjectPaged::Create(pmm_alloc_flags, size);
     if (!vmo)
         return ERR_NO_MEMORY;
 
+    // the pages it commits count against the job's memory limits
+    if (job) {
+        mx_status_t status = vmo->SetMemoryAccount(job->memory_account());
+        DEBUG_ASSERT(status == NO_ERROR);
+    }
+
     // create a Vm Object dispatcher
     mxtl::RefPtr<Dispatcher> dispatcher;
     mx_rights_t rights;
@@ -49,8 +85,6 @@ mx_status_t sys_vmo_create(uint64_t size, uint32_t options, user_ptr<mx_handle_t
     if (!handle)
         return ERR_NO_MEMORY;
 
-    auto up = ProcessDispatcher::GetCurrent();
-
     if (_out.copy_to_user(up->MapHandleToValue(handle)) != NO_ERROR)
         return ERR_INVALID_ARGS;
 
@@ -200,6 +234,23 @@ mx_status_t sys_vmo_op_range(mx_handle_t handle, uint32_t op, uint64_t offset, u
     return vmo->RangeOp(op, offset, size, _buffer, buffer_size);
 }
 
+mx_status_t sys_vmo_set_cache_policy(mx_handle_t handle, uint32_t cache_policy) {
+    LTRACEF("handle %d cache_policy %u\n", handle, cache_policy);
+
+    if (cache_policy & ~ARCH_MMU_FLAG_CACHE_MASK)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    // lookup the dispatcher from handle
+    mxtl::RefPtr<VmObjectDispatcher> vmo;
+    mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_WRITE | MX_RIGHT_MAP, &vmo);
+    if (status != NO_ERROR)
+        return status;
+
+    return vmo->SetCachePolicy(cache_policy);
+}
+
 mx_status_t sys_vmo_clone(mx_handle_t handle, uint32_t options, uint64_t offset, uint64_t size,
         user_ptr<mx_handle_t>(_out_handle)) {
     LTRACEF("handle %d options %#x offset %#" PRIx64 " size %#" PRIx64 "\n",
@@ -226,6 +277,12 @@ mx_status_t sys_vmo_clone(mx_handle_t handle, uint32_t options, uint64_t offset,
         DEBUG_ASSERT(clone_vmo);
     }
 
+    // pages copied into the clone are charged to the job that made it
+    if (auto job = up->job()) {
+        status = clone_vmo->SetMemoryAccount(job->memory_account());
+        DEBUG_ASSERT(status == NO_ERROR);
+    }
+
     // create a Vm Object dispatcher
     mxtl::RefPtr<Dispatcher> dispatcher;
     mx_rights_t default_rights;
@@ -260,3 +317,123 @@ mx_status_t sys_vmo_clone(mx_handle_t handle, uint32_t options, uint64_t offset,
 
     return NO_ERROR;
 }
+
+mx_status_t sys_vmo_copy(mx_handle_t src_handle, uint64_t src_offset,
+                         mx_handle_t dst_handle, uint64_t dst_offset, uint64_t len) {
+    LTRACEF("src %d offset %#" PRIx64 " dst %d offset %#" PRIx64 " len %#" PRIx64 "\n",
+            src_handle, src_offset, dst_handle, dst_offset, len);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<VmObjectDispatcher> src;
+    mx_status_t status = up->GetDispatcherWithRights(src_handle, MX_RIGHT_READ, &src);
+    if (status != NO_ERROR)
+        return status;
+
+    mxtl::RefPtr<VmObjectDispatcher> dst;
+    status = up->GetDispatcherWithRights(dst_handle, MX_RIGHT_WRITE, &dst);
+    if (status != NO_ERROR)
+        return status;
+
+    uint64_t copied;
+    return src->vmo()->CopyRange(src_offset, len, dst->vmo().get(), dst_offset, &copied);
+}
+
+mx_status_t sys_pager_vmo_create(mx_handle_t port_handle, uint64_t key, uint64_t size,
+                                 uint32_t options, user_ptr<mx_handle_t> _out) {
+    LTRACEF("port %d key %#" PRIx64 " size %#" PRIx64 "\n", port_handle, key, size);
+
+    if (options != 0u)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<PortDispatcherV2> port;
+    mx_status_t status = up->GetDispatcherWithRights(port_handle, MX_RIGHT_WRITE, &port);
+    if (status != NO_ERROR)
+        return status;
+
+    AllocChecker ac;
+    mxtl::RefPtr<PageSource> source =
+        mxtl::AdoptRef<PageSource>(new (&ac) PagerSource(mxtl::move(port), key));
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    mxtl::RefPtr<VmObject> vmo = VmObjectPaged::CreateWithPageSource(0u, size, mxtl::move(source));
+    if (!vmo)
+        return ERR_NO_MEMORY;
+
+    mxtl::RefPtr<Dispatcher> dispatcher;
+    mx_rights_t rights;
+    status = VmObjectDispatcher::Create(mxtl::move(vmo), &dispatcher, &rights);
+    if (status != NO_ERROR)
+        return status;
+
+    HandleOwner handle(MakeHandle(mxtl::move(dispatcher), rights));
+    if (!handle)
+        return ERR_NO_MEMORY;
+
+    if (_out.copy_to_user(up->MapHandleToValue(handle)) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    up->AddHandle(mxtl::move(handle));
+
+    return NO_ERROR;
+}
+
+mx_status_t sys_pager_supply_pages(mx_handle_t pager_vmo, uint64_t offset, uint64_t size,
+                                   mx_handle_t aux_vmo, uint64_t aux_offset) {
+    LTRACEF("vmo %d offset %#" PRIx64 " size %#" PRIx64 " aux %d offset %#" PRIx64 "\n",
+            pager_vmo, offset, size, aux_vmo, aux_offset);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<VmObjectDispatcher> dst;
+    mx_status_t status = up->GetDispatcherWithRights(pager_vmo, MX_RIGHT_WRITE, &dst);
+    if (status != NO_ERROR)
+        return status;
+
+    mxtl::RefPtr<VmObjectDispatcher> src;
+    status = up->GetDispatcherWithRights(aux_vmo, MX_RIGHT_READ | MX_RIGHT_WRITE, &src);
+    if (status != NO_ERROR)
+        return status;
+
+    return dst->vmo()->SupplyPages(offset, size, src->vmo().get(), aux_offset);
+}
+
+mx_status_t copy_ring_handles_to_user(mxtl::RefPtr<VmObject> rx_vmo,
+                                      mxtl::RefPtr<VmObject> tx_vmo,
+                                      user_ptr<mx_handle_t> _rx, user_ptr<mx_handle_t> _tx) {
+    auto up = ProcessDispatcher::GetCurrent();
+
+    // The rings have to be mapped writable by both ends, but there is no
+    // reason to ever execute from them.
+    mxtl::RefPtr<Dispatcher> rx, tx;
+    mx_rights_t rights;
+    mx_status_t status = VmObjectDispatcher::Create(mxtl::move(rx_vmo), &rx, &rights);
+    if (status != NO_ERROR)
+        return status;
+    status = VmObjectDispatcher::Create(mxtl::move(tx_vmo), &tx, &rights);
+    if (status != NO_ERROR)
+        return status;
+    rights &= ~MX_RIGHT_EXECUTE;
+
+    HandleOwner h0(MakeHandle(mxtl::move(rx), rights));
+    if (!h0)
+        return ERR_NO_MEMORY;
+
+    HandleOwner h1(MakeHandle(mxtl::move(tx), rights));
+    if (!h1)
+        return ERR_NO_MEMORY;
+
+    if (_rx.copy_to_user(up->MapHandleToValue(h0)) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    if (_tx.copy_to_user(up->MapHandleToValue(h1)) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    up->AddHandle(mxtl::move(h0));
+    up->AddHandle(mxtl::move(h1));
+
+    return NO_ERROR;
+}
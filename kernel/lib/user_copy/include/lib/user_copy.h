@@ -18,6 +18,9 @@ inline status_t copy_to_user_unsafe(void* dst, const void* src, size_t len) {
 inline status_t copy_from_user_unsafe(void* dst, const void* src, size_t len) {
   return arch_copy_from_user(dst, src, len);
 }
+inline status_t copy_iovec_from_user_unsafe(void* dst, const iovec_t* iov, size_t count) {
+  return arch_copy_iovec_from_user(dst, iov, count);
+}
 
 // Convenience functions for common data types.
 #define MAKE_COPY_TO_USER_UNSAFE(name, type) \
@@ -22,3 +22,16 @@ __WEAK status_t arch_copy_to_user(void *dst, const void *src, size_t len) {
     memcpy(dst, src, len);
     return NO_ERROR;
 }
+
+__WEAK status_t arch_copy_iovec_from_user(void *dst, const iovec_t *iov, size_t count) {
+    uint8_t *out = dst;
+    for (size_t i = 0; i < count; i++) {
+        if (iov[i].iov_len == 0)
+            continue;
+        status_t status = arch_copy_from_user(out, iov[i].iov_base, iov[i].iov_len);
+        if (status != NO_ERROR)
+            return status;
+        out += iov[i].iov_len;
+    }
+    return NO_ERROR;
+}
@@ -0,0 +1,25 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+// This file is used both in the kernel and in the vDSO implementation.
+// So it must be compatible with both the kernel and userland header
+// environments.  It must use only the basic types so that struct
+// layouts match exactly in both contexts.
+
+#include <stdint.h>
+
+// Unlike vdso_constants, this struct is rewritten by the kernel for as
+// long as the system runs.  Every member is a naturally aligned 64-bit
+// word that the kernel stores with a single atomic write, so the vDSO
+// code only needs an atomic load of the member it wants.
+struct vdso_clock {
+
+    // MX_CLOCK_MONOTONIC as of the kernel's last update, which happens
+    // on timer interrupts and context switches; see timer_publish_clock().
+    uint64_t monotonic;
+};
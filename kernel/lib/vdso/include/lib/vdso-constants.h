@@ -31,4 +31,7 @@ struct vdso_constants {
 
     // Total amount of physical memory in the system, in bytes.
     uint64_t physmem;
+
+    // MX_FEATURE_KIND_CPU bits from <magenta/features.h>.
+    uint32_t cpu_features;
 };
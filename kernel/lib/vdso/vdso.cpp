@@ -5,9 +5,11 @@
 // https://opensource.org/licenses/MIT
 
 #include <lib/vdso.h>
+#include <lib/vdso-clock.h>
 #include <lib/vdso-constants.h>
 
 #include <kernel/cmdline.h>
+#include <kernel/timer.h>
 #include <kernel/vm.h>
 #include <kernel/vm/vm_aspace.h>
 #include <kernel/vm/vm_object.h>
@@ -44,6 +46,9 @@ public:
                 0 /* ignored */, size, 0 /* align pow2 */, 0 /* vmar flags */,
                 mxtl::move(vmo), page_offset, arch_mmu_flags, name, &mapping_);
         ASSERT(status == NO_ERROR);
+        // Map the pages up front so the window can be written at interrupt time.
+        status = mapping_->MapRange(0, size, false);
+        ASSERT(status == NO_ERROR);
         data_ = reinterpret_cast<T*>(mapping_->base() + offset_in_page);
     }
 
@@ -102,6 +107,10 @@ private:
         dynsym_window.set_symbol(_ ## symbol, target);          \
     } while (0)
 
+// The vDSO's coarse clock is written through this window for as long as the
+// system runs, by the timer code.
+KernelVmoWindow<vdso_clock>* clock_window;
+
 }; // anonymous namespace
 
 const VDso* VDso::instance_ = NULL;
@@ -133,8 +142,16 @@ const VDso* VDso::Create() {
         arch_dcache_line_size(),
         per_second,
         pmm_count_total_bytes(),
+        arch_cpu_features(),
     };
 
+    static_assert(sizeof(vdso_clock) == VDSO_DATA_CLOCK_SIZE,
+                  "gen-rodso-code.sh is suspect");
+    clock_window = new(&ac) KernelVmoWindow<vdso_clock>(
+        "vDSO clock", instance_->vmo()->vmo(), VDSO_DATA_CLOCK);
+    ASSERT(ac.check());
+    timer_publish_clock(&clock_window->data()->monotonic);
+
     // If ticks_per_second has not been calibrated, it will return 0. In this
     // case, use soft_ticks instead.
     if (per_second == 0 || cmdline_get_bool("vdso.soft_ticks", false)) {
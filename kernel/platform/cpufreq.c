@@ -0,0 +1,21 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <err.h>
+#include <platform/cpufreq.h>
+
+/*
+ * default implementations for platforms that leave the cpu clocks alone.
+ */
+
+__WEAK status_t platform_cpufreq_init(void)
+{
+    return ERR_NOT_SUPPORTED;
+}
+
+__WEAK void platform_cpufreq_set_level(uint32_t level)
+{
+}
@@ -114,6 +114,7 @@ static void halt_other_cpus(void)
 void platform_panic_start(void)
 {
     arch_disable_ints();
+    uart_sync_output();
 
     halt_other_cpus();
 
@@ -212,7 +213,7 @@ static void platform_preserve_ramdisk(void) {
     // mark all of the pages we allocated as WIRED
     vm_page_t *p;
     list_for_every_entry(&list, p, vm_page_t, free.node) {
-        p->state = VM_PAGE_STATE_WIRED;
+        vm_page_set_state(p, VM_PAGE_STATE_WIRED);
     }
 }
 
@@ -550,6 +551,7 @@ int platform_dgetc(char *c, bool wait)
 
 void platform_pputc(char c)
 {
+    uart_sync_output();
     uart_pputc(c);
 }
 
@@ -576,6 +578,7 @@ status_t display_get_info(struct display_info *info) {
 
 void platform_halt(platform_halt_action suggested_action, platform_halt_reason reason)
 {
+    uart_sync_output();
 
     if (suggested_action == HALT_ACTION_REBOOT) {
 
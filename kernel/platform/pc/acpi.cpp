@@ -276,6 +276,164 @@ status_t platform_enumerate_interrupt_source_overrides(
     return NO_ERROR;
 }
 
+static status_t acpi_get_srat_record_limits(uintptr_t *start, uintptr_t *end)
+{
+    ACPI_TABLE_HEADER *table = NULL;
+    ACPI_STATUS status = AcpiGetTable((char *)ACPI_SIG_SRAT, 1, &table);
+    if (status != AE_OK) {
+        LTRACEF("could not find SRAT\n");
+        return ERR_NOT_FOUND;
+    }
+    ACPI_TABLE_SRAT *srat = (ACPI_TABLE_SRAT *)table;
+    uintptr_t records_start = ((uintptr_t)srat) + sizeof(*srat);
+    uintptr_t records_end = ((uintptr_t)srat) + srat->Header.Length;
+    if (records_start > records_end) {
+        TRACEF("SRAT wraps around address space\n");
+        return ERR_INTERNAL;
+    }
+    *start = records_start;
+    *end = records_end;
+    return NO_ERROR;
+}
+
+/* @brief Enumerate the memory ranges the SRAT places in proximity domains
+ *
+ * If ranges is NULL, just returns the number of ranges via num_ranges.
+ *
+ * @param ranges Array to populate ranges into.
+ * @param len Length of ranges.
+ * @param num_ranges Number of enabled ranges found
+ *
+ * @return NO_ERROR on success, ERR_NOT_FOUND if there is no SRAT. Note that
+ *         if len < *num_ranges, not all ranges will be returned.
+ */
+status_t platform_enumerate_numa_memory(
+        struct acpi_numa_memory *ranges,
+        uint32_t len,
+        uint32_t *num_ranges)
+{
+    if (num_ranges == NULL) {
+        return ERR_INVALID_ARGS;
+    }
+
+    uintptr_t records_start, records_end;
+    status_t status = acpi_get_srat_record_limits(&records_start, &records_end);
+    if (status != NO_ERROR) {
+        return status;
+    }
+
+    uint32_t count = 0;
+    uintptr_t addr;
+    for (addr = records_start; addr < records_end;) {
+        ACPI_SUBTABLE_HEADER *record_hdr = (ACPI_SUBTABLE_HEADER *)addr;
+        if (record_hdr->Length == 0) {
+            break;
+        }
+        switch (record_hdr->Type) {
+            case ACPI_SRAT_TYPE_MEMORY_AFFINITY: {
+                ACPI_SRAT_MEM_AFFINITY *mem = (ACPI_SRAT_MEM_AFFINITY *)record_hdr;
+                if (!(mem->Flags & ACPI_SRAT_MEM_ENABLED) || mem->Length == 0) {
+                    break;
+                }
+                if (ranges != NULL && count < len) {
+                    ranges[count].domain = mem->ProximityDomain;
+                    ranges[count].base = mem->BaseAddress;
+                    ranges[count].length = mem->Length;
+                }
+                count++;
+                break;
+            }
+        }
+
+        addr += record_hdr->Length;
+    }
+    if (addr != records_end) {
+      TRACEF("malformed SRAT\n");
+      return ERR_INTERNAL;
+    }
+    *num_ranges = count;
+    return NO_ERROR;
+}
+
+/* @brief Enumerate the processors the SRAT places in proximity domains
+ *
+ * If cpus is NULL, just returns the number of processors via num_cpus.
+ *
+ * @param cpus Array to populate processors into.
+ * @param len Length of cpus.
+ * @param num_cpus Number of enabled processors found
+ *
+ * @return NO_ERROR on success, ERR_NOT_FOUND if there is no SRAT. Note that
+ *         if len < *num_cpus, not all processors will be returned.
+ */
+status_t platform_enumerate_numa_cpus(
+        struct acpi_numa_cpu *cpus,
+        uint32_t len,
+        uint32_t *num_cpus)
+{
+    if (num_cpus == NULL) {
+        return ERR_INVALID_ARGS;
+    }
+
+    uintptr_t records_start, records_end;
+    status_t status = acpi_get_srat_record_limits(&records_start, &records_end);
+    if (status != NO_ERROR) {
+        return status;
+    }
+
+    uint32_t count = 0;
+    uintptr_t addr;
+    for (addr = records_start; addr < records_end;) {
+        ACPI_SUBTABLE_HEADER *record_hdr = (ACPI_SUBTABLE_HEADER *)addr;
+        if (record_hdr->Length == 0) {
+            break;
+        }
+        uint32_t domain, apic_id;
+        bool found = false;
+        switch (record_hdr->Type) {
+            case ACPI_SRAT_TYPE_CPU_AFFINITY: {
+                ACPI_SRAT_CPU_AFFINITY *cpu = (ACPI_SRAT_CPU_AFFINITY *)record_hdr;
+                if (!(cpu->Flags & ACPI_SRAT_CPU_USE_AFFINITY)) {
+                    break;
+                }
+                domain = cpu->ProximityDomainLo |
+                         ((uint32_t)cpu->ProximityDomainHi[0] << 8) |
+                         ((uint32_t)cpu->ProximityDomainHi[1] << 16) |
+                         ((uint32_t)cpu->ProximityDomainHi[2] << 24);
+                apic_id = cpu->ApicId;
+                found = true;
+                break;
+            }
+            case ACPI_SRAT_TYPE_X2APIC_CPU_AFFINITY: {
+                ACPI_SRAT_X2APIC_CPU_AFFINITY *cpu =
+                        (ACPI_SRAT_X2APIC_CPU_AFFINITY *)record_hdr;
+                if (!(cpu->Flags & ACPI_SRAT_CPU_ENABLED)) {
+                    break;
+                }
+                domain = cpu->ProximityDomain;
+                apic_id = cpu->ApicId;
+                found = true;
+                break;
+            }
+        }
+        if (found) {
+            if (cpus != NULL && count < len) {
+                cpus[count].domain = domain;
+                cpus[count].apic_id = apic_id;
+            }
+            count++;
+        }
+
+        addr += record_hdr->Length;
+    }
+    if (addr != records_end) {
+      TRACEF("malformed SRAT\n");
+      return ERR_INTERNAL;
+    }
+    *num_cpus = count;
+    return NO_ERROR;
+}
+
 /* @brief Return information about the High Precision Event Timer, if present.
  *
  * @param hpet Descriptor to populate
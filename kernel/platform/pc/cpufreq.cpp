@@ -0,0 +1,149 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <arch/ops.h>
+#include <arch/x86.h>
+#include <arch/x86/feature.h>
+#include <debug.h>
+#include <err.h>
+#include <platform/cpufreq.h>
+#include <stdio.h>
+#include <trace.h>
+
+#define LOCAL_TRACE 0
+
+#define MSR_PLATFORM_INFO       0xce
+#define IA32_PERF_CTL           0x199
+#define MSR_TURBO_RATIO_LIMIT   0x1ad
+#define IA32_PM_ENABLE          0x770
+#define IA32_HWP_CAPABILITIES   0x771
+#define IA32_HWP_REQUEST        0x774
+
+#define HWP_CAP_HIGHEST(cap)    ((uint32_t)(cap) & 0xff)
+#define HWP_CAP_LOWEST(cap)     ((uint32_t)((cap) >> 24) & 0xff)
+
+#define HWP_REQ_MIN(perf)       ((uint64_t)(perf))
+#define HWP_REQ_MAX(perf)       ((uint64_t)(perf) << 8)
+#define HWP_REQ_DESIRED(perf)   ((uint64_t)(perf) << 16)
+#define HWP_REQ_EPP(epp)        ((uint64_t)(epp) << 24)
+
+/* halfway between performance and energy saving, which the hardware uses to
+ * pick a frequency around the desired one */
+#define HWP_EPP_BALANCED        0x80
+
+/* Intel parts are driven through hardware p-states (HWP) when they have them,
+ * and through IA32_PERF_CTL bus ratios when they don't. Either way the range
+ * comes from MSRs; nothing here reads the ACPI _PSS tables, so other vendors'
+ * cpus keep running wherever the firmware left them. */
+enum class Mode {
+    NONE,
+    HWP,
+    PERF_CTL,
+};
+
+static Mode mode = Mode::NONE;
+
+/* the bus ratios for PERF_CTL, the same on every cpu */
+static uint32_t ratio_lowest;
+static uint32_t ratio_highest;
+
+struct cpufreq_cpu {
+    bool ready;
+    /* in HWP performance units or bus ratios */
+    uint32_t lowest;
+    uint32_t highest;
+    uint32_t current;
+} __CPU_ALIGN;
+
+static cpufreq_cpu cpus[SMP_MAX_CPUS];
+
+status_t platform_cpufreq_init(void)
+{
+    /* hypervisors rarely pass the MSRs through, and the host picks the clocks */
+    if (x86_vendor != X86_VENDOR_INTEL || x86_feature_test(X86_FEATURE_HYPERVISOR))
+        return ERR_NOT_SUPPORTED;
+
+    if (x86_feature_test(X86_FEATURE_HWP)) {
+        mode = Mode::HWP;
+        dprintf(INFO, "cpufreq: using hardware p-states\n");
+        return NO_ERROR;
+    }
+
+    if (!x86_feature_test(X86_FEATURE_EST) || x86_microarch == X86_MICROARCH_UNKNOWN)
+        return ERR_NOT_SUPPORTED;
+
+    /* the maximum efficiency and non-turbo ratios, and the single core turbo
+     * ratio on top of that if turbo is on */
+    uint64_t info;
+    if (read_msr_safe(MSR_PLATFORM_INFO, &info) != NO_ERROR)
+        return ERR_NOT_SUPPORTED;
+    ratio_lowest = (info >> 40) & 0xff;
+    ratio_highest = (info >> 8) & 0xff;
+
+    uint64_t turbo;
+    if (x86_feature_test(X86_FEATURE_TURBO) &&
+        read_msr_safe(MSR_TURBO_RATIO_LIMIT, &turbo) == NO_ERROR && (turbo & 0xff) > ratio_highest)
+        ratio_highest = turbo & 0xff;
+
+    if (ratio_lowest == 0 || ratio_highest <= ratio_lowest)
+        return ERR_NOT_SUPPORTED;
+
+    mode = Mode::PERF_CTL;
+    dprintf(INFO, "cpufreq: using bus ratios %u to %u\n", ratio_lowest, ratio_highest);
+    return NO_ERROR;
+}
+
+static void cpufreq_cpu_init(cpufreq_cpu* cpu)
+{
+    if (mode == Mode::HWP) {
+        /* HWP can't be turned off again short of a reset, and the range can
+         * differ between cores, so every cpu reads its own */
+        write_msr(IA32_PM_ENABLE, 1);
+        uint64_t cap = read_msr(IA32_HWP_CAPABILITIES);
+        cpu->lowest = HWP_CAP_LOWEST(cap);
+        cpu->highest = HWP_CAP_HIGHEST(cap);
+    } else {
+        cpu->lowest = ratio_lowest;
+        cpu->highest = ratio_highest;
+    }
+    cpu->current = UINT32_MAX;
+    cpu->ready = true;
+
+    LTRACEF("cpu %u range %u to %u\n", arch_curr_cpu_num(), cpu->lowest, cpu->highest);
+}
+
+void platform_cpufreq_set_level(uint32_t level)
+{
+    DEBUG_ASSERT(arch_ints_disabled());
+    DEBUG_ASSERT(level <= CPUFREQ_LEVEL_MAX);
+
+    if (mode == Mode::NONE)
+        return;
+
+    cpufreq_cpu* cpu = &cpus[arch_curr_cpu_num()];
+    if (unlikely(!cpu->ready))
+        cpufreq_cpu_init(cpu);
+
+    uint32_t perf = cpu->lowest +
+        ((cpu->highest - cpu->lowest) * level + CPUFREQ_LEVEL_MAX / 2) / CPUFREQ_LEVEL_MAX;
+
+    /* many levels share a ratio, and msr writes aren't free */
+    if (perf == cpu->current)
+        return;
+    cpu->current = perf;
+
+    if (mode == Mode::HWP) {
+        /* a nonzero desired performance turns off the hardware's own choice
+         * within the range */
+        uint64_t req = HWP_REQ_MIN(cpu->lowest) | HWP_REQ_MAX(cpu->highest) |
+                       HWP_REQ_DESIRED(perf);
+        if (x86_feature_test(X86_FEATURE_HWP_EPP))
+            req |= HWP_REQ_EPP(HWP_EPP_BALANCED);
+        write_msr(IA32_HWP_REQUEST, req);
+    } else {
+        write_msr(IA32_PERF_CTL, (uint64_t)perf << 8);
+    }
+}
@@ -8,6 +8,7 @@
 #include <stdarg.h>
 #include <reg.h>
 #include <stdio.h>
+#include <kernel/spinlock.h>
 #include <kernel/thread.h>
 #include <kernel/timer.h>
 #include <lk/init.h>
@@ -28,9 +29,53 @@
 static const int uart_baud_rate = 115200;
 static const int uart_io_port = 0x3f8;
 
+// Once the uart interrupt is up, output is queued here and fed to the fifo
+// from the transmit holding register empty interrupt, so printing costs a
+// copy rather than ~87us of spinning per character. A full buffer is drained
+// synchronously, nothing is dropped.
+#define UART_TX_BUF_SIZE 4096 // power of two
+#define UART_FIFO_SIZE 16
+
 cbuf_t console_input_buf;
 static bool output_enabled = false;
 
+// guards the tx buffer and the interrupt enable register
+static spin_lock_t uart_tx_lock = SPIN_LOCK_INITIAL_VALUE;
+static char uart_tx_buf[UART_TX_BUF_SIZE];
+// free running, the next slot to fill and the next character to send
+static size_t uart_tx_head;
+static size_t uart_tx_tail;
+// shadows the interrupt enable register
+static uint8_t uart_ier;
+// output goes through the buffer, cleared for panic and halt
+static bool uart_tx_buffered = false;
+
+static void uart_set_ier_locked(uint8_t ier)
+{
+    if (ier != uart_ier) {
+        uart_ier = ier;
+        outp(uart_io_port + 1, ier);
+    }
+}
+
+// if the fifo is empty, refills it from the buffer, and leaves the transmit
+// interrupt on for as long as anything is left
+static void uart_tx_fill_locked(void)
+{
+    if (inp(uart_io_port + 5) & (1<<5)) {
+        for (int i = 0; i < UART_FIFO_SIZE && uart_tx_tail != uart_tx_head; i++)
+            outp(uart_io_port + 0, uart_tx_buf[uart_tx_tail++ % UART_TX_BUF_SIZE]);
+    }
+    uart_set_ier_locked(uart_tx_tail != uart_tx_head ? 0x3 : 0x1);
+}
+
+static void uart_tx_drain(void)
+{
+    spin_lock(&uart_tx_lock);
+    uart_tx_fill_locked();
+    spin_unlock(&uart_tx_lock);
+}
+
 static enum handler_return platform_drain_debug_uart_rx(void)
 {
     unsigned char c;
@@ -47,7 +92,17 @@ static enum handler_return platform_drain_debug_uart_rx(void)
 
 static enum handler_return uart_irq_handler(void *arg)
 {
-    return platform_drain_debug_uart_rx();
+    enum handler_return ret = INT_NO_RESCHEDULE;
+
+    // the isa line is edge triggered, a source left pending would hold it
+    // high and no interrupt would come again, so go until none is
+    while ((inp(uart_io_port + 2) & (1<<0)) == 0) {
+        if (platform_drain_debug_uart_rx() == INT_RESCHEDULE)
+            ret = INT_RESCHEDULE;
+        uart_tx_drain();
+    }
+
+    return ret;
 }
 
 // for devices where the uart rx interrupt doesn't seem to work
@@ -97,15 +152,39 @@ void platform_init_debug(void)
     register_int_handler(irq, uart_irq_handler, NULL);
     unmask_interrupt(irq);
 
-    outp(uart_io_port + 1, 0x1); // enable receive data available interrupt
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&uart_tx_lock, state);
+    uart_set_ier_locked(0x1); // enable receive data available interrupt
+    spin_unlock_irqrestore(&uart_tx_lock, state);
 
     // modem control register: Axiliary Output 2 is another IRQ enable bit
     const uint8_t mcr = inp(uart_io_port + 4);
     outp(uart_io_port + 4, mcr | 0x8);
 
     if (cmdline_get_bool("kernel.debug_uart_poll", false)) {
+        // the transmit interrupt is unlikely to work either, and a 10ms
+        // poll can't keep up with the line, so tx stays synchronous
         platform_debug_start_uart_timer();
+    } else {
+        __atomic_store_n(&uart_tx_buffered, true, __ATOMIC_RELEASE);
+    }
+}
+
+void platform_debug_sync_output(void)
+{
+    if (!__atomic_exchange_n(&uart_tx_buffered, false, __ATOMIC_ACQ_REL))
+        return;
+
+    // the other cpus are stopped or about to be, maybe holding the lock, so
+    // take what is queued without it
+    while (uart_tx_tail != uart_tx_head) {
+        while ((inp(uart_io_port + 5) & (1<<5)) == 0)
+            arch_spinloop_pause();
+        for (int i = 0; i < UART_FIFO_SIZE && uart_tx_tail != uart_tx_head; i++)
+            outp(uart_io_port + 0, uart_tx_buf[uart_tx_tail++ % UART_TX_BUF_SIZE]);
     }
+    uart_ier = 0x1;
+    outp(uart_io_port + 1, uart_ier);
 }
 
 static void debug_uart_putc(char c)
@@ -116,10 +195,24 @@ static void debug_uart_putc(char c)
     if (unlikely(!output_enabled))
         return;
 
-    while ((inp(uart_io_port + 5) & (1<<6)) == 0) {
-        arch_spinloop_pause();
+    if (!__atomic_load_n(&uart_tx_buffered, __ATOMIC_ACQUIRE)) {
+        while ((inp(uart_io_port + 5) & (1<<6)) == 0) {
+            arch_spinloop_pause();
+        }
+        outp(uart_io_port + 0, c);
+        return;
+    }
+
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&uart_tx_lock, state);
+    while (uart_tx_head - uart_tx_tail == UART_TX_BUF_SIZE) {
+        while ((inp(uart_io_port + 5) & (1<<5)) == 0)
+            arch_spinloop_pause();
+        uart_tx_fill_locked();
     }
-    outp(uart_io_port + 0, c);
+    uart_tx_buf[uart_tx_head++ % UART_TX_BUF_SIZE] = c;
+    uart_tx_fill_locked();
+    spin_unlock_irqrestore(&uart_tx_lock, state);
 }
 
 void platform_dputs(const char* str, size_t len)
@@ -141,6 +234,7 @@ int platform_dgetc(char *c, bool wait)
 // panic time polling IO for the panic shell
 void platform_pputc(char c)
 {
+    platform_debug_sync_output();
     platform_dputc(c);
 }
 
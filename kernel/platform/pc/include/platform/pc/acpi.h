@@ -22,6 +22,19 @@ struct acpi_hpet_descriptor {
     uint8_t sequence;
 };
 
+/* memory range local to an ACPI proximity domain */
+struct acpi_numa_memory {
+    uint32_t domain;
+    uint64_t base;
+    uint64_t length;
+};
+
+/* processor local to an ACPI proximity domain */
+struct acpi_numa_cpu {
+    uint32_t domain;
+    uint32_t apic_id;
+};
+
 void platform_init_acpi_tables(uint levels);
 void platform_init_acpi(void);
 status_t platform_enumerate_cpus(
@@ -37,6 +50,14 @@ status_t platform_enumerate_interrupt_source_overrides(
         uint32_t len,
         uint32_t *num_isos);
 status_t platform_find_hpet(struct acpi_hpet_descriptor *hpet);
+status_t platform_enumerate_numa_memory(
+        struct acpi_numa_memory *ranges,
+        uint32_t len,
+        uint32_t *num_ranges);
+status_t platform_enumerate_numa_cpus(
+        struct acpi_numa_cpu *cpus,
+        uint32_t len,
+        uint32_t *num_cpus);
 
 __END_CDECLS
 
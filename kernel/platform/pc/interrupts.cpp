@@ -11,11 +11,13 @@
 #include <err.h>
 #include <reg.h>
 #include <assert.h>
+#include <kernel/mp.h>
 #include <kernel/thread.h>
 #include <dev/interrupt.h>
 #include <arch/x86.h>
 #include <arch/x86/interrupts.h>
 #include <arch/x86/apic.h>
+#include <arch/x86/mp.h>
 #include <lk/init.h>
 #include <kernel/spinlock.h>
 #include "platform_p.h"
@@ -311,11 +313,9 @@ status_t x86_alloc_msi_block(uint requested_irqs,
         // See section 10.11.1 of the Intel 64 and IA-32 Architectures Software
         // Developer's Manual Volume 3A.
         //
-        // TODO(johngro) : don't just bind this block to the Local APIC of the
-        // processor which is active when calling alloc_msi_block.  Instead,
-        // there should either be a system policy (like, always send to any
-        // processor, or just processor 0, or something), or the decision of
-        // which CPUs to bind to should be left to the caller.
+        // The block starts out bound to the Local APIC of the processor
+        // which is active when calling alloc_msi_block.  Drivers may move it
+        // afterwards with x86_set_msi_affinity.
         uint32_t tgt_addr = 0xFEE00000;                 // base addr
         tgt_addr |= ((uint32_t)apic_local_id()) << 12;  // Dest ID == our local APIC ID
         tgt_addr |= 0x08;                               // Redir hint == 1
@@ -367,4 +367,23 @@ void x86_register_msi_handler(const pcie_msi_block_t* block,
     int_handler_table[x86_vector].arg     = handler ? ctx : NULL;
     spin_unlock(&int_handler_table[x86_vector].lock);
 }
+
+status_t x86_set_msi_affinity(pcie_msi_block_t* block, uint cpu) {
+    DEBUG_ASSERT(block && block->allocated);
+
+    if (!mp_is_cpu_online(cpu))
+        return ERR_INVALID_ARGS;
+
+    // The destination ID field of the target address is only 8 bits wide.
+    int64_t apic_id = x86_cpu_num_to_apic_id(cpu);
+    if (apic_id < 0)
+        return ERR_INVALID_ARGS;
+    if (apic_id > 0xFF)
+        return ERR_NOT_SUPPORTED;
+
+    uint64_t tgt_addr = block->tgt_addr & ~0xFF000ull;
+    tgt_addr |= static_cast<uint64_t>(apic_id) << 12;
+    block->tgt_addr = tgt_addr;
+    return NO_ERROR;
+}
 #endif  // WITH_DEV_PCIE
@@ -8,7 +8,9 @@
 #include <efi/boot-services.h>
 #include <err.h>
 #include <kernel/vm.h>
+#include <lk/init.h>
 #include <magenta/boot/multiboot.h>
+#include <platform/pc/acpi.h>
 #include <platform/pc/bootloader.h>
 #include <platform/pc/memory.h>
 #include <string.h>
@@ -480,3 +482,48 @@ void platform_mem_init(void)
         TRACEF("ERROR - No e820 range entries found!  This is going to end badly for everyone.\n");
     }
 }
+
+/* ACPI proximity domains are sparse, pmm NUMA nodes are dense. nodes are
+ * handed out in the order their domains are first seen. */
+static uint32_t numa_domains[PMM_MAX_NUMA_NODES];
+static uint numa_domain_count;
+
+int platform_numa_domain_to_node(uint32_t domain)
+{
+    for (uint i = 0; i < numa_domain_count; i++) {
+        if (numa_domains[i] == domain)
+            return i;
+    }
+    if (numa_domain_count == PMM_MAX_NUMA_NODES)
+        return -1;
+    numa_domains[numa_domain_count] = domain;
+    return numa_domain_count++;
+}
+
+/* Tag the pmm arenas with the NUMA node of the memory behind them, once the
+ * ACPI tables are available. */
+static void platform_init_numa_memory(uint level)
+{
+    uint32_t num_ranges = 0;
+    if (platform_enumerate_numa_memory(NULL, 0, &num_ranges) != NO_ERROR || num_ranges == 0)
+        return;
+
+    struct acpi_numa_memory ranges[64];
+    if (num_ranges > countof(ranges)) {
+        TRACEF("too many SRAT memory ranges (%u), ignoring NUMA layout\n", num_ranges);
+        return;
+    }
+    if (platform_enumerate_numa_memory(ranges, countof(ranges), &num_ranges) != NO_ERROR)
+        return;
+
+    for (uint32_t i = 0; i < num_ranges; i++) {
+        int node = platform_numa_domain_to_node(ranges[i].domain);
+        if (node < 0) {
+            TRACEF("too many NUMA domains, leaving domain %u on node 0\n", ranges[i].domain);
+            continue;
+        }
+        pmm_set_numa_node(ranges[i].base, ranges[i].length, node);
+    }
+}
+
+LK_INIT_HOOK(numa_memory, &platform_init_numa_memory, LK_INIT_LEVEL_VM + 2);
@@ -31,6 +31,7 @@
 #include <string.h>
 #include <assert.h>
 #include <lk/init.h>
+#include <lib/ktrace.h>
 #include <kernel/cmdline.h>
 #include <kernel/vm/vm_aspace.h>
 
@@ -107,6 +108,14 @@ static int process_bootitem(bootdata_t* bd, void* item) {
         bootloader.e820_table = item;
         bootloader.e820_count = bd->length / sizeof(e820entry_t);
         break;
+    case BOOTDATA_BOOT_STAGES: {
+        bootdata_boot_stage_t* stage = static_cast<bootdata_boot_stage_t*>(item);
+        for (size_t n = bd->length / sizeof(*stage); n > 0; n--, stage++) {
+            stage->name[sizeof(stage->name) - 1] = 0;
+            ktrace_boot_stage_etc(stage->ticks, stage->name);
+        }
+        break;
+    }
     case BOOTDATA_IGNORE:
         break;
     }
@@ -200,7 +209,7 @@ static void platform_preserve_ramdisk(void) {
     // mark all of the pages we allocated as WIRED
     vm_page_t *p;
     list_for_every_entry(&list, p, vm_page_t, free.node) {
-        p->state = VM_PAGE_STATE_WIRED;
+        vm_page_set_state(p, VM_PAGE_STATE_WIRED);
     }
 
     ramdisk_base = paddr_to_kvaddr(bootloader.ramdisk_base);
@@ -315,6 +324,68 @@ void platform_early_init(void)
 }
 
 #if WITH_SMP
+// Tell the scheduler which of the cpus we are using share a core or a cache.
+// We don't decode the cache hierarchy, so the package is used as the last
+// level cache domain.
+static void platform_init_cpu_topology(const uint32_t *apic_ids, uint32_t num_cpus)
+{
+    x86_cpu_topology_t topo[SMP_MAX_CPUS];
+    int cpu_num[SMP_MAX_CPUS];
+
+    DEBUG_ASSERT(num_cpus <= SMP_MAX_CPUS);
+    for (uint32_t i = 0; i < num_cpus; ++i) {
+        x86_cpu_topology_decode(apic_ids[i], &topo[i]);
+        cpu_num[i] = x86_apic_id_to_cpu_num(apic_ids[i]);
+    }
+
+    for (uint32_t i = 0; i < num_cpus; ++i) {
+        if (cpu_num[i] < 0)
+            continue;
+
+        mp_cpu_mask_t smt = 0;
+        mp_cpu_mask_t cache = 0;
+        for (uint32_t j = 0; j < num_cpus; ++j) {
+            if (cpu_num[j] < 0 || topo[j].package_id != topo[i].package_id)
+                continue;
+
+            cache |= 1u << cpu_num[j];
+            if (topo[j].core_id == topo[i].core_id)
+                smt |= 1u << cpu_num[j];
+        }
+
+        mp_set_cpu_topology(cpu_num[i], smt, cache);
+    }
+}
+
+/* Tell the pmm which NUMA node each cpu is local to, so that it allocates
+ * from the nearest memory first. Machines without an SRAT stay on node 0. */
+static void platform_init_numa_cpus(void)
+{
+    uint32_t num_cpus = 0;
+    if (platform_enumerate_numa_cpus(NULL, 0, &num_cpus) != NO_ERROR || num_cpus == 0)
+        return;
+
+    struct acpi_numa_cpu *cpus =
+            (struct acpi_numa_cpu *)calloc(num_cpus, sizeof(*cpus));
+    if (!cpus)
+        return;
+
+    uint32_t count = num_cpus;
+    if (platform_enumerate_numa_cpus(cpus, count, &num_cpus) == NO_ERROR) {
+        if (num_cpus > count)
+            num_cpus = count;
+        for (uint32_t i = 0; i < num_cpus; ++i) {
+            int cpu = x86_apic_id_to_cpu_num(cpus[i].apic_id);
+            int node = platform_numa_domain_to_node(cpus[i].domain);
+            if (cpu < 0 || node < 0)
+                continue;
+            pmm_set_cpu_numa_node(cpu, node);
+        }
+    }
+
+    free(cpus);
+}
+
 static void platform_init_smp(void)
 {
     uint32_t num_cpus = 0;
@@ -402,6 +473,8 @@ static void platform_init_smp(void)
     }
 
     x86_init_smp(apic_ids, num_cpus);
+    platform_init_cpu_topology(apic_ids, num_cpus);
+    platform_init_numa_cpus();
 
     for (uint i = 0; i < num_cpus - 1; ++i) {
         if (apic_ids[i] == bsp_apic_id) {
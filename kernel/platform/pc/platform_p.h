@@ -28,9 +28,16 @@ extern uint16_t pcie_pio_size;
 
 void platform_init_debug_early(void);
 void platform_init_debug(void);
+/* Sends whatever debug output is still buffered and makes all later output
+ * synchronous, for panic and halt paths that may never take interrupts again. */
+void platform_debug_sync_output(void);
 void platform_init_timer_percpu(void);
 void platform_mem_init(void);
 
+/* Dense NUMA node number for an ACPI proximity domain, -1 if there are more
+ * domains than the pmm supports. */
+int platform_numa_domain_to_node(uint32_t domain);
+
 status_t x86_alloc_msi_block(uint requested_irqs, bool can_target_64bit,
                              bool is_msix, pcie_msi_block_t* out_block);
 void x86_free_msi_block(pcie_msi_block_t* block);
@@ -38,6 +45,8 @@ void x86_register_msi_handler(const pcie_msi_block_t* block,
                               uint msi_id,
                               int_handler handler,
                               void* ctx);
+/* Retargets every vector of |block| at |cpu|. */
+status_t x86_set_msi_affinity(pcie_msi_block_t* block, uint cpu);
 
 status_t platform_configure_watchdog(uint32_t frequency);
 
@@ -40,6 +40,10 @@ public:
                             void*                   ctx) override {
         x86_register_msi_handler(block, msi_id, handler, ctx);
     }
+
+    status_t SetMsiAffinity(pcie_msi_block_t* block, uint cpu) override {
+        return x86_set_msi_affinity(block, cpu);
+    }
 };
 
 X86PciePlatformSupport platform_pcie_support;
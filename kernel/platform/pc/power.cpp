@@ -22,6 +22,8 @@
 #include <lib/debuglog.h>
 #endif
 
+#include "platform_p.h"
+
 static void reboot(void) {
     // Try legacy reboot path first
     pc_keyboard_reboot();
@@ -101,6 +103,7 @@ static void store_panic_in_capsule(void) {
 
 void platform_panic_start(void) {
     arch_disable_ints();
+    platform_debug_sync_output();
 
     if (atomic_swap(&panic_started, 1) == 0) {
 #if WITH_LIB_DEBUGLOG
@@ -117,6 +120,7 @@ void platform_halt(
         platform_halt_action suggested_action,
         platform_halt_reason reason)
 {
+    platform_debug_sync_output();
     printf("platform_halt suggested_action %d reason %d\n", suggested_action, reason);
 
     arch_disable_ints();
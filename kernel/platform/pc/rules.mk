@@ -17,6 +17,7 @@ MODULE_DEPS += \
 MODULE_SRCS += \
     $(LOCAL_DIR)/acpi.cpp \
     $(LOCAL_DIR)/console.cpp \
+    $(LOCAL_DIR)/cpufreq.cpp \
     $(LOCAL_DIR)/debug.cpp \
     $(LOCAL_DIR)/hpet.cpp \
     $(LOCAL_DIR)/interrupts.cpp \
@@ -1,8 +1,11 @@
 #include <arch/x86.h>
 #include <arch/x86/apic.h>
+#include <inttypes.h>
 #include <lk/init.h>
 #include <kernel/cmdline.h>
+#include <kernel/irqsoff.h>
 #include <kernel/timer.h>
+#include <stdio.h>
 #include <platform.h>
 #include <platform/keyboard.h>
 #include "platform_p.h"
@@ -14,14 +17,30 @@ static volatile lk_time_t watchdog_last_time = 0;
 // If the LK timer hasn't checked in in this long, reset the machine.
 #define ASSUMED_DEAD_PERIOD_NS LK_MSEC(150)
 
+// A cpu that has had interrupts off for a whole checkin period is locked up,
+// if not yet dead, and is noted in ktrace by the irqsoff tracer.
+#define SOFT_LOCKUP_PERIOD_NS WATCHDOG_CHECKIN_PERIOD_NS
+
 void platform_handle_watchdog(void);
 void platform_handle_watchdog(void)
 {
     lk_time_t last_time = watchdog_last_time;
 
     lk_time_t now = current_time();
+#if WITH_IRQSOFF_TRACE
+    uint cpu = arch_curr_cpu_num();
+    lk_time_t off = irqsoff_check_stalls(now, SOFT_LOCKUP_PERIOD_NS, cpu);
+#endif
     lk_time_t deadline = last_time + ASSUMED_DEAD_PERIOD_NS;
     if (now < last_time - LK_MSEC(2) || now > deadline) {
+#if WITH_IRQSOFF_TRACE
+        // the trace goes down with the machine, so say where it stopped
+        if (off > 0) {
+            printf("watchdog: cpu %u has had interrupts off for %" PRIu64 "us, since %#" PRIxPTR "\n",
+                   cpu, off / 1000, irqsoff_start_pc(cpu));
+        }
+#endif
+
         // Shoot all other cores
         apic_send_broadcast_ipi(0, DELIVERY_MODE_INIT);
 
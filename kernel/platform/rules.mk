@@ -11,6 +11,7 @@ MODULE := $(LOCAL_DIR)
 
 # shared platform code
 MODULE_SRCS += \
+	$(LOCAL_DIR)/cpufreq.c \
 	$(LOCAL_DIR)/debug.c \
 	$(LOCAL_DIR)/init.c \
 	$(LOCAL_DIR)/power.c
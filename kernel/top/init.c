@@ -17,6 +17,8 @@
 #include <assert.h>
 #include <magenta/compiler.h>
 #include <debug.h>
+#include <kernel/thread.h>
+#include <lib/ktrace.h>
 #include <trace.h>
 
 #define LOCAL_TRACE 0
@@ -28,6 +30,55 @@
 extern const struct lk_init_struct __start_lk_init[] __WEAK;
 extern const struct lk_init_struct __stop_lk_init[] __WEAK;
 
+/* async hooks which are still running, only touched by the boot cpu's
+ * init thread */
+#define MAX_ASYNC_HOOKS 16
+
+static struct {
+    const struct lk_init_struct *hook;
+    thread_t *thread;
+} async_hooks[MAX_ASYNC_HOOKS];
+static uint num_async_hooks;
+
+static int async_hook_thread(void *arg)
+{
+    const struct lk_init_struct *hook = arg;
+    hook->hook(hook->level);
+    return 0;
+}
+
+/* start an async hook on its own thread, or return false to run it in line */
+static bool start_async_hook(const struct lk_init_struct *hook)
+{
+    if (hook->level < LK_INIT_LEVEL_THREADING || num_async_hooks == MAX_ASYNC_HOOKS)
+        return false;
+
+    thread_t *t = thread_create(hook->name, &async_hook_thread, (void *)hook,
+                                DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+    if (!t)
+        return false;
+
+    async_hooks[num_async_hooks].hook = hook;
+    async_hooks[num_async_hooks].thread = t;
+    num_async_hooks++;
+    thread_resume(t);
+    return true;
+}
+
+/* wait for the async hooks which have to be done before level */
+static void join_async_hooks(uint level)
+{
+    for (uint i = 0; i < num_async_hooks;) {
+        if (async_hooks[i].hook->done_level > level) {
+            i++;
+            continue;
+        }
+        LTRACEF("joining %s\n", async_hooks[i].hook->name);
+        thread_join(async_hooks[i].thread, NULL, INFINITE_TIME);
+        async_hooks[i] = async_hooks[--num_async_hooks];
+    }
+}
+
 void lk_init_level(enum lk_init_flags required_flag, uint start_level, uint stop_level)
 {
     LTRACEF("flags %#x, start_level %#x, stop_level %#x\n",
@@ -77,16 +128,29 @@ void lk_init_level(enum lk_init_flags required_flag, uint start_level, uint stop
         if (!found)
             break;
 
+        bool primary = (required_flag == LK_INIT_FLAG_PRIMARY_CPU);
+        if (primary)
+            join_async_hooks(found->level);
+
 #if TRACE_INIT
         if (found->level >= EARLIEST_TRACE_LEVEL) {
             printf("INIT: cpu %u, calling hook %p (%s) at level %#x, flags %#x\n",
                    arch_curr_cpu_num(), found->hook, found->name, found->level, found->flags);
         }
 #endif
-        found->hook(found->level);
+        /* the boot cpu's hooks make up the kernel's part of the boot timeline */
+        if (primary) {
+            ktrace_boot_stage(found->name);
+        }
+        if (!primary || !(found->flags & LK_INIT_FLAG_ASYNC) || !start_async_hook(found))
+            found->hook(found->level);
         last_called_level = found->level;
         last = found;
     }
+
+    /* whatever the caller does next counts as the start of the next level */
+    if (required_flag == LK_INIT_FLAG_PRIMARY_CPU)
+        join_async_hooks(stop_level == LK_INIT_LEVEL_LAST ? LK_INIT_LEVEL_LAST : stop_level + 1);
 }
 
 #if 0
@@ -16,6 +16,7 @@ TARGET_MODDEPS += $(STAMPY)
 SG_MAGENTA := $(GENERATED_INCLUDES)/magenta
 
 SG_KERNEL_CODE := $(SG_MAGENTA)/syscall-invocation-cases.inc
+SG_KERNEL_BATCH_CODE := $(SG_MAGENTA)/syscall-batch-cases.inc
 SG_KERNEL_HEADER := $(SG_MAGENTA)/syscall-definitions.h
 SG_KERNEL_TRACE := $(SG_MAGENTA)/syscall-ktrace-info.inc
 
@@ -28,30 +29,35 @@ SG_ULIB_X86 := $(SG_MAGENTA)/syscalls-x86-64.S
 SG_SYSCALLS := $(SG_MAGENTA)/syscalls
 SG_PUBLIC_HEADER := $(SG_SYSCALLS)/definitions.h
 SG_PUBLIC_RUST := $(SG_SYSCALLS)/definitions.rs
+SG_PUBLIC_BATCH_OPS := $(SG_SYSCALLS)/batch-ops.h
 
 SG_SYSROOT_MAGENTA := $(BUILDSYSROOT)/include/magenta
 SG_SYSROOT_HEADER := $(SG_SYSROOT_MAGENTA)/syscalls/definitions.h
 SG_SYSROOT_RUST := $(SG_SYSROOT_MAGENTA)/syscalls/definitions.rs
+SG_SYSROOT_BATCH_OPS := $(SG_SYSROOT_MAGENTA)/syscalls/batch-ops.h
 
 # STAMPY ultimately generates most of the files and paths here.
 $(STAMPY): $(SYSGEN_APP) $(SYSCALLS_SRC)
 	$(call BUILDECHO,generating syscall files from $(SYSCALLS_SRC))
 	$(NOECHO) mkdir -p $(SG_SYSCALLS)
 	$(NOECHO) $(SYSGEN_APP) -kernel-code $(SG_KERNEL_CODE) -trace $(SG_KERNEL_TRACE) \
+		-kernel-batch-code $(SG_KERNEL_BATCH_CODE) -batch-ops $(SG_PUBLIC_BATCH_OPS) \
 		-kernel-header $(SG_KERNEL_HEADER) -arm-asm $(SG_ULIB_ARM) -x86-asm $(SG_ULIB_X86) \
 		-vdso-header $(SG_ULIB_VDSO_HEADER) -vdso-wrappers $(SG_ULIB_VDSO_WRAPPERS) \
 		-numbers $(SG_ULIB_SYSCALL_NUMBER) -user-header $(SG_PUBLIC_HEADER) -rust $(SG_PUBLIC_RUST) \
 		$(SYSCALLS_SRC)
 	$(NOECHO) touch $(STAMPY)
 
-run-sysgen $(SG_PUBLIC_HEADER) $(SG_PUBLIC_RUST) $(SG_SYSROOT_HEADER) $(SG_SYSROOT_RUST): $(STAMPY)
+run-sysgen $(SG_PUBLIC_HEADER) $(SG_PUBLIC_RUST) $(SG_PUBLIC_BATCH_OPS) \
+           $(SG_SYSROOT_HEADER) $(SG_SYSROOT_RUST) $(SG_SYSROOT_BATCH_OPS): $(STAMPY)
 
-GENERATED += $(SG_KERNEL_CODE) $(SG_KERNEL_HEADER) $(SG_KERNEL_TRACE) $(SG_ULIB_X86) \
-             $(SG_ULIB_ARM) $(SG_ULIB_SYSCALL_NUMBERS) $(SG_ULIB_VDSO_HEADER) \
-             $(SG_ULIB_VDSO_WRAPPERS) $(SG_PUBLIC_HEADER) $(SG_PUBLIC_RUST) $(SG_SYSROOT_HEADER) \
-             $(SG_SYSROOT_RUST) $(STAMPY)
+GENERATED += $(SG_KERNEL_CODE) $(SG_KERNEL_BATCH_CODE) $(SG_KERNEL_HEADER) $(SG_KERNEL_TRACE) \
+             $(SG_ULIB_X86) $(SG_ULIB_ARM) $(SG_ULIB_SYSCALL_NUMBERS) $(SG_ULIB_VDSO_HEADER) \
+             $(SG_ULIB_VDSO_WRAPPERS) $(SG_PUBLIC_HEADER) $(SG_PUBLIC_RUST) $(SG_PUBLIC_BATCH_OPS) \
+             $(SG_SYSROOT_HEADER) $(SG_SYSROOT_RUST) $(SG_SYSROOT_BATCH_OPS) $(STAMPY)
 
 $(call copy-dst-src,$(SG_SYSROOT_HEADER),$(SG_PUBLIC_HEADER))
 $(call copy-dst-src,$(SG_SYSROOT_RUST),$(SG_PUBLIC_RUST))
+$(call copy-dst-src,$(SG_SYSROOT_BATCH_OPS),$(SG_PUBLIC_BATCH_OPS))
 
-SYSROOT_DEPS += $(SG_SYSROOT_HEADER) $(SG_SYSROOT_RUST)
+SYSROOT_DEPS += $(SG_SYSROOT_HEADER) $(SG_SYSROOT_RUST) $(SG_SYSROOT_BATCH_OPS)
@@ -41,6 +41,12 @@ static int acpi_ec_thread(void* arg) {
         }
         mx_object_signal(pending_sci_evt, MX_EVENT_SIGNALED, 0);
 
+        // Drain every pending query under the global lock and run the
+        // handlers after dropping it.  A burst of events (say, battery and
+        // AC at once, or repeated thermal updates) then only takes the lock
+        // once and runs each _Qxx method once.
+        uint32_t pending[256 / 32] = {};
+
         UINT32 global_lock;
         while (AcpiAcquireGlobalLock(0xFFFF, &global_lock) != AE_OK)
             ;
@@ -67,15 +73,22 @@ static int acpi_ec_thread(void* arg) {
             while ((status = inp(ec_info.cmd_port)) & EC_SC_OBF) {
                 /* Read until the output buffer is empty */
                 uint8_t event_code = inp(ec_info.data_port);
-                char method[5] = {0};
-                snprintf(method, sizeof(method), "_Q%02x", event_code);
-                xprintf("Invoking method %s\n", method);
-                AcpiEvaluateObject(ec_info.handle, method, NULL, NULL);
-                xprintf("Invoked method %s\n", method);
+                pending[event_code / 32] |= 1u << (event_code % 32);
             }
         } while (status & EC_SC_SCI_EVT);
 
         AcpiReleaseGlobalLock(global_lock);
+
+        for (unsigned event_code = 0; event_code < 256; event_code++) {
+            if (!(pending[event_code / 32] & (1u << (event_code % 32)))) {
+                continue;
+            }
+            char method[5] = {0};
+            snprintf(method, sizeof(method), "_Q%02x", event_code);
+            xprintf("Invoking method %s\n", method);
+            AcpiEvaluateObject(ec_info.handle, method, NULL, NULL);
+            xprintf("Invoked method %s\n", method);
+        }
     }
 
     printf("acpi ec thread terminated\n");
@@ -7,6 +7,8 @@
 #include <assert.h>
 #include <mxio/debug.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <acpica/acpi.h>
 
@@ -316,7 +318,31 @@ static mx_status_t find_pcie_config(mx_pci_init_arg_t* arg) {
  *
  * @return NO_ERROR on success
  */
+// The MCFG table and the root bridge's _PRT do not change, so they are
+// only decoded the first time they are asked for.
+static mx_pci_init_arg_t* cached_arg;
+static uint32_t cached_arg_size;
+
+static mx_status_t build_pci_init_arg(mx_pci_init_arg_t** arg, uint32_t* size);
+
 mx_status_t get_pci_init_arg(mx_pci_init_arg_t** arg, uint32_t* size) {
+    if (cached_arg == NULL) {
+        mx_status_t status = build_pci_init_arg(&cached_arg, &cached_arg_size);
+        if (status != NO_ERROR) {
+            return status;
+        }
+    }
+    mx_pci_init_arg_t* res = malloc(cached_arg_size);
+    if (!res) {
+        return ERR_NO_MEMORY;
+    }
+    memcpy(res, cached_arg, cached_arg_size);
+    *arg = res;
+    *size = cached_arg_size;
+    return NO_ERROR;
+}
+
+static mx_status_t build_pci_init_arg(mx_pci_init_arg_t** arg, uint32_t* size) {
     mx_pci_init_arg_t* res = NULL;
 
     // TODO(teisenbe): We assume only one ECAM window right now...
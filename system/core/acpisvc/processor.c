@@ -8,6 +8,7 @@
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <threads.h>
 
 #include <acpica/acpi.h>
 #include <acpisvc/protocol.h>
@@ -54,6 +55,45 @@ static const cmd_handler_t cmd_table[] = {
         [ACPI_CMD_NEW_CONNECTION] = cmd_new_connection,
 };
 
+// Commands which evaluate AML methods that may be slow, such as battery
+// methods which have to talk to the EC.  These are run on the eval thread
+// so that namespace queries from drivers binding are not stuck behind them.
+// ACPICA only runs one method at a time, so more threads would not help.
+static const bool cmd_is_slow[] = {
+        [ACPI_CMD_PS0] = true,
+        [ACPI_CMD_BST] = true,
+        [ACPI_CMD_BIF] = true,
+};
+
+typedef struct slow_cmd {
+    struct slow_cmd* next;
+    mx_handle_t h; // duplicate of the channel the command came in on
+    acpi_handle_ctx_t ctx;
+    cmd_handler_t handler;
+    uint8_t buf[ACPI_MAX_REQUEST_SIZE];
+} slow_cmd_t;
+
+static struct {
+    mtx_t lock;
+    cnd_t cond;
+    slow_cmd_t* head;
+    slow_cmd_t* tail;
+    bool running;
+} eval_queue;
+
+// The result of ACPI_CMD_LIST_CHILDREN for one namespace node.  Devices
+// and their _HID and _CID do not change once the tables are loaded, and
+// AcpiGetObjectInfo runs several methods per child, so the response is
+// built only once per node.
+typedef struct child_list {
+    struct child_list* next;
+    ACPI_HANDLE ns_node;
+    acpi_rsp_list_children_t* rsp;
+    uint32_t rsp_size;
+} child_list_t;
+
+static child_list_t* child_lists;
+
 static mx_status_t send_error(mx_handle_t h, uint32_t req_id, mx_status_t status);
 
 static inline uint32_t acpi_event_type(uint16_t events) {
@@ -92,6 +132,72 @@ static void notify_handler(ACPI_HANDLE node, uint32_t value, void* _ctx) {
     mx_port_queue(ctx->notify, &pkt, sizeof(pkt));
 }
 
+static int eval_thread(void* arg) {
+    for (;;) {
+        mtx_lock(&eval_queue.lock);
+        while (eval_queue.head == NULL) {
+            cnd_wait(&eval_queue.cond, &eval_queue.lock);
+        }
+        slow_cmd_t* cmd = eval_queue.head;
+        eval_queue.head = cmd->next;
+        if (eval_queue.head == NULL) {
+            eval_queue.tail = NULL;
+        }
+        mtx_unlock(&eval_queue.lock);
+
+        // The connection cannot be aborted from here, so a failure just
+        // leaves the client without a reply, as a closed channel would.
+        cmd->handler(cmd->h, &cmd->ctx, cmd->buf);
+        mx_handle_close(cmd->h);
+        free(cmd);
+    }
+    return 0;
+}
+
+// Hands a slow command to the eval thread, which replies on its own copy
+// of the channel handle.
+static mx_status_t queue_slow_cmd(mx_handle_t h, acpi_handle_ctx_t* ctx,
+                                  cmd_handler_t handler, void* buf, uint32_t len) {
+    acpi_cmd_hdr_t* hdr = buf;
+    slow_cmd_t* cmd = malloc(sizeof(*cmd));
+    if (cmd == NULL) {
+        return send_error(h, hdr->request_id, ERR_NO_MEMORY);
+    }
+    mx_status_t status = mx_handle_duplicate(h, MX_RIGHT_SAME_RIGHTS, &cmd->h);
+    if (status != NO_ERROR) {
+        free(cmd);
+        return send_error(h, hdr->request_id, status);
+    }
+    cmd->next = NULL;
+    cmd->ctx = *ctx;
+    cmd->ctx.notify = MX_HANDLE_INVALID;
+    cmd->handler = handler;
+    memcpy(cmd->buf, buf, len);
+
+    mtx_lock(&eval_queue.lock);
+    if (eval_queue.tail) {
+        eval_queue.tail->next = cmd;
+    } else {
+        eval_queue.head = cmd;
+    }
+    eval_queue.tail = cmd;
+    cnd_signal(&eval_queue.cond);
+    mtx_unlock(&eval_queue.lock);
+    return NO_ERROR;
+}
+
+static void start_eval_thread(void) {
+    mtx_init(&eval_queue.lock, mtx_plain);
+    cnd_init(&eval_queue.cond);
+    thrd_t thread;
+    if (thrd_create_with_name(&thread, eval_thread, NULL, "acpi-eval") != thrd_success) {
+        printf("acpi: failed to start eval thread, evaluating methods inline\n");
+        return;
+    }
+    thrd_detach(thread);
+    eval_queue.running = true;
+}
+
 static mxio_dispatcher_t* dispatcher;
 static mx_status_t dispatch(mx_handle_t h, void* _ctx, void* cookie) {
     acpi_handle_ctx_t* ctx = _ctx;
@@ -183,6 +289,9 @@ static mx_status_t dispatch(mx_handle_t h, void* _ctx, void* cookie) {
             goto cleanup;
         }
     }
+    if (hdr->cmd < countof(cmd_is_slow) && cmd_is_slow[hdr->cmd] && eval_queue.running) {
+        return queue_slow_cmd(h, ctx, cmd_table[hdr->cmd], buf, num_bytes);
+    }
     return cmd_table[hdr->cmd](h, ctx, buf);
 
 cleanup:
@@ -209,6 +318,8 @@ mx_status_t begin_processing(mx_handle_t acpi_root) {
     }
     root_context->root_node = true;
 
+    start_eval_thread();
+
     status = mxio_dispatcher_create(&dispatcher, dispatch);
     if (status != NO_ERROR) {
         goto fail;
@@ -278,6 +389,13 @@ static mx_status_t cmd_list_children(mx_handle_t h, acpi_handle_ctx_t* ctx, void
         return send_error(h, cmd->hdr.request_id, ERR_INVALID_ARGS);
     }
 
+    for (child_list_t* list = child_lists; list != NULL; list = list->next) {
+        if (list->ns_node == ctx->ns_node) {
+            list->rsp->hdr.request_id = cmd->hdr.request_id;
+            return mx_channel_write(h, 0, list->rsp, list->rsp_size, NULL, 0);
+        }
+    }
+
     // Begin by finding the number of children
     uint32_t num_children = 0;
     ACPI_HANDLE child = NULL;
@@ -378,6 +496,16 @@ static mx_status_t cmd_list_children(mx_handle_t h, acpi_handle_ctx_t* ctx, void
 
     status = mx_channel_write(h, 0, rsp, rsp_size, NULL, 0);
 
+    child_list_t* list = malloc(sizeof(*list));
+    if (list != NULL) {
+        list->ns_node = ctx->ns_node;
+        list->rsp = rsp;
+        list->rsp_size = rsp_size;
+        list->next = child_lists;
+        child_lists = list;
+        return status;
+    }
+
 cleanup:
     free(rsp);
     return status;
@@ -28,7 +28,9 @@
 #include "utils.h"
 
 // Keep open debug info for this many files.
-constexpr size_t kDebugInfoCacheNumWays = 2;
+// The cache lives as long as crashlogger does, so a crashing program
+// doesn't have its debug info loaded again every time it crashes.
+constexpr size_t kDebugInfoCacheNumWays = 4;
 
 // Error callback for libbacktrace.
 
@@ -51,28 +53,28 @@ bt_so_iterator (void* iter_state, backtrace_so_callback* callback, void* data) {
     return 1;
 }
 
-// A cache of data stored for each shared lib.
+// A cache of data stored for each shared lib, keyed by build ID.
 // This lets us lazily obtain debug info, and only keep
 // a subset of it in memory.
 class DebugInfoCache {
  public:
-    DebugInfoCache(dsoinfo_t* dso_list, size_t nr_ways);
+    explicit DebugInfoCache(size_t nr_ways);
     ~DebugInfoCache();
 
-    dsoinfo_t* dso_list() { return dso_list_; }
+    mx_status_t GetDebugInfo(dsoinfo_t* dso_list, uintptr_t pc, dsoinfo_t** out_dso,
+                             backtrace_state** out_bt_state, uintptr_t* out_bt_pc);
 
-    mx_status_t GetDebugInfo(uintptr_t pc, dsoinfo_t** out_dso, backtrace_state** out_bt_state);
-    
  private:
-    dsoinfo_t* dso_list_;
-
     size_t last_used_ = 0;
 
     bool cache_avail_ = false;
 
     struct way {
-        // Not owned by us. This is the "tag".
-        dsoinfo_t* dso = nullptr;
+        // This is the "tag". Empty if the way is unused.
+        char buildid[MAX_BUILDID_SIZE * 2 + 1] = {};
+        // The load address |bt_state| was created with. The same DSO can
+        // be loaded elsewhere in the next process that crashes.
+        uintptr_t base = 0;
         // Owned by us.
         backtrace_state* bt_state = nullptr;
     };
@@ -80,10 +82,7 @@ class DebugInfoCache {
     mxtl::Array<way> ways_;
 };
 
-// Note: We take ownership of |dso_list|.
-
-DebugInfoCache::DebugInfoCache(dsoinfo_t* dso_list, size_t nr_ways)
-    : dso_list_(dso_list) {
+DebugInfoCache::DebugInfoCache(size_t nr_ways) {
     AllocChecker ac;
     auto ways = new (&ac) way[nr_ways];
     if (!ac.check()) {
@@ -100,8 +99,6 @@ DebugInfoCache::~DebugInfoCache() {
             backtrace_destroy_state(ways_[i].bt_state, bt_error_callback, nullptr);
         }
     }
-
-    dso_free_list(dso_list_);
 }
 
 // Find the DSO and debug info (backtrace_state) for PC.
@@ -110,12 +107,16 @@ DebugInfoCache::~DebugInfoCache() {
 // info for libbacktrace (e.g., -g1 info).
 // If the result is NO_ERROR then |*out_dso| is set.
 // If the result is NO_ERROR then |*out_bt_state| is set to the
-// accompanying libbacktrace state if available or nullptr if not.
+// accompanying libbacktrace state if available or nullptr if not,
+// and |*out_bt_pc| to |pc| relocated to where that state thinks the
+// DSO is loaded.
 
-mx_status_t DebugInfoCache::GetDebugInfo(uintptr_t pc,
+mx_status_t DebugInfoCache::GetDebugInfo(dsoinfo_t* dso_list,
+                                         uintptr_t pc,
                                          dsoinfo_t** out_dso,
-                                         backtrace_state** out_bt_state) {
-    dsoinfo_t* dso = dso_lookup(dso_list_, pc);
+                                         backtrace_state** out_bt_state,
+                                         uintptr_t* out_bt_pc) {
+    dsoinfo_t* dso = dso_lookup(dso_list, pc);
     if (dso == nullptr) {
         debugf(1, "No DSO found for pc %p\n", (void*) pc);
         return ERR_NOT_FOUND;
@@ -137,11 +138,15 @@ mx_status_t DebugInfoCache::GetDebugInfo(uintptr_t pc,
 
     const size_t nr_ways = ways_.size();
 
-    for (size_t i = 0; i < nr_ways; ++i) {
-        if (ways_[i].dso == dso) {
+    // An unknown build ID is all 'x's and can't be used as a tag.
+    const bool have_buildid = dso->buildid[0] != 'x';
+
+    for (size_t i = 0; have_buildid && i < nr_ways; ++i) {
+        if (strcmp(ways_[i].buildid, dso->buildid) == 0) {
             debugf(1, "using cached debug info entry for pc %p\n", (void*) pc);
             *out_dso = dso;
             *out_bt_state = ways_[i].bt_state;
+            *out_bt_pc = pc - dso->base + ways_[i].base;
             return NO_ERROR;
         }
     }
@@ -157,7 +162,7 @@ mx_status_t DebugInfoCache::GetDebugInfo(uintptr_t pc,
 
     const char* debug_file = nullptr;
     auto status = dso_find_debug_file(dso, &debug_file);
-    if (status != NO_ERROR) {
+    if (status != NO_ERROR || !have_buildid) {
         // There's no additional debug file available, but we did find the DSO.
         return NO_ERROR;
     }
@@ -172,21 +177,23 @@ mx_status_t DebugInfoCache::GetDebugInfo(uintptr_t pc,
 
     // last_used_+1: KISS until there's data warranting something better
     size_t way = (last_used_ + 1) % nr_ways;
-    if (ways_[way].dso != nullptr) {
+    if (ways_[way].buildid[0] != '\0') {
         // Free the entry.
         backtrace_destroy_state(ways_[way].bt_state, bt_error_callback, nullptr);
-        ways_[way].dso = nullptr;
+        ways_[way].buildid[0] = '\0';
         ways_[way].bt_state = nullptr;
     }
 
-    // The iterator doesn't do anything, but we pass |list| anyway
-    // in case some day we need it to.
-    backtrace_set_so_iterator(bt_state, bt_so_iterator, dso_list_);
+    // The iterator doesn't do anything, and the dso list doesn't outlive
+    // the crash, so there's nothing to pass it.
+    backtrace_set_so_iterator(bt_state, bt_so_iterator, nullptr);
     backtrace_set_base_address(bt_state, dso->base);
 
-    ways_[way].dso = dso;
+    strlcpy(ways_[way].buildid, dso->buildid, sizeof(ways_[way].buildid));
+    ways_[way].base = dso->base;
     ways_[way].bt_state = bt_state;
     *out_bt_state = bt_state;
+    *out_bt_pc = pc;
     last_used_ = way;
     return NO_ERROR;
 }
@@ -216,10 +223,12 @@ btprint_callback(void* vdata, uintptr_t pc, const char* filename, int lineno,
     return 0;
 }
 
-static void btprint(DebugInfoCache* di_cache, int n, uintptr_t pc, uintptr_t sp) {
+static void btprint(DebugInfoCache* di_cache, dsoinfo_t* dso_list,
+                    int n, uintptr_t pc, uintptr_t sp) {
     dsoinfo_t* dso;
     backtrace_state* bt_state;
-    auto status = di_cache->GetDebugInfo(pc, &dso, &bt_state);
+    uintptr_t bt_pc = pc;
+    auto status = di_cache->GetDebugInfo(dso_list, pc, &dso, &bt_state, &bt_pc);
 
     if (status != NO_ERROR) {
         // The pc is not in any DSO.
@@ -234,7 +243,7 @@ static void btprint(DebugInfoCache* di_cache, int n, uintptr_t pc, uintptr_t sp)
     memset(&pcinfo_data, 0, sizeof(pcinfo_data));
 
     if (bt_state != nullptr) {
-        auto ret = backtrace_pcinfo(bt_state, pc, btprint_callback,
+        auto ret = backtrace_pcinfo(bt_state, bt_pc, btprint_callback,
                                     bt_error_callback, &pcinfo_data);
         if (ret == 0) {
             // FIXME: How to interpret the result is seriously confusing.
@@ -265,25 +274,9 @@ static int dso_lookup_for_unw(dsoinfo_t* dso_list, unw_word_t pc,
     return 1;
 }
 
-void backtrace(mx_handle_t process, mx_handle_t thread,
+void backtrace(mx_handle_t process, mx_handle_t thread, dsoinfo_t* dso_list,
                uintptr_t pc, uintptr_t sp, uintptr_t fp,
                bool use_libunwind) {
-    // Prepend "app:" to the name we print for the process binary to tell the
-    // reader (and the symbolize script!) that the name is the process's.
-    // The name property is only 32 characters which may be insufficient.
-    // N.B. The symbolize script looks for "app" and "app:".
-#define PROCESS_NAME_PREFIX "app:"
-#define PROCESS_NAME_PREFIX_LEN (sizeof(PROCESS_NAME_PREFIX) - 1)
-    char name[MX_MAX_NAME_LEN + PROCESS_NAME_PREFIX_LEN];
-    strcpy(name, PROCESS_NAME_PREFIX);
-    auto status = mx_object_get_property(process, MX_PROP_NAME, name + PROCESS_NAME_PREFIX_LEN,
-                                         sizeof(name) - PROCESS_NAME_PREFIX_LEN);
-    if (status != NO_ERROR) {
-        print_mx_error("mx_object_get_property, falling back to \"app\" for program name", status);
-        strlcpy(name, "app", sizeof(name));
-    }
-    dsoinfo_t* dso_list = dso_fetch_list(process, name);
-
     dso_print_list(dso_list);
 
     // Set up libunwind if requested.
@@ -337,14 +330,12 @@ void backtrace(mx_handle_t process, mx_handle_t thread,
 
     // Keep a cache of loaded debug info to maintain some performance
     // without loading debug info for all shared libs.
-    // This won't get used if initializing libunwind failed, but we can still
-    // use |dso_list|.
-    DebugInfoCache di_cache(dso_list, kDebugInfoCacheNumWays);
+    static DebugInfoCache di_cache(kDebugInfoCacheNumWays);
 
     // On with the show.
 
     int n = 1;
-    btprint(&di_cache, n++, pc, sp);
+    btprint(&di_cache, dso_list, n++, pc, sp);
     while ((sp >= 0x1000000) && (n < 50)) {
         if (libunwind_ok) {
             int ret = unw_step(&cursor);
@@ -369,7 +360,7 @@ void backtrace(mx_handle_t process, mx_handle_t thread,
                 break;
             }
         }
-        btprint(&di_cache, n++, pc, sp);
+        btprint(&di_cache, dso_list, n++, pc, sp);
     }
     printf("bt#%02d: end\n", n);
 
@@ -10,7 +10,11 @@ __BEGIN_CDECLS;
 
 #include <inttypes.h>
 
-void backtrace(mx_handle_t process, mx_handle_t thread,
+struct dsoinfo;
+
+// Prints the backtrace of |thread|. |dso_list| is the list of DSOs loaded
+// in |process|; the caller still owns it.
+void backtrace(mx_handle_t process, mx_handle_t thread, struct dsoinfo* dso_list,
                uintptr_t pc, uintptr_t sp, uintptr_t fp,
                bool use_libunwind);
 
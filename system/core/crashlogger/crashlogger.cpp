@@ -40,6 +40,11 @@ using gregs_type = int; // unsupported arch
 // Ultimately will want to switch this to off.
 static bool swbreak_backtrace_enabled = true;
 
+// A crash whose signature matches one reported within this many seconds
+// only gets a one line note, so a service stuck in a crash/restart loop
+// can't keep crashlogger busy printing the same backtrace. 0 disables.
+static int repeat_crash_seconds = 10;
+
 #ifdef __x86_64__
 // If true then an attempt is made to dump processor trace data.
 // Requires processor tracing turned on in the kernel.
@@ -98,6 +103,73 @@ const char* excp_type_to_str(uint32_t type) {
     }
 }
 
+// The signatures of recently reported crashes.
+constexpr size_t kNumRecentCrashes = 16;
+
+struct recent_crash {
+    uint64_t signature;
+    mx_time_t reported;
+    uint32_t suppressed;
+};
+
+static recent_crash recent_crashes[kNumRecentCrashes];
+static size_t next_recent_crash;
+
+static uint64_t fnv1a(uint64_t hash, const void* data, size_t len) {
+    auto p = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= p[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// A crash's signature is the exception type and where it happened,
+// as a DSO build ID and offset so that it's the same whatever address
+// the DSO gets loaded at next time.
+static uint64_t crash_signature(dsoinfo_t* dso_list, uint32_t type, uintptr_t pc) {
+    uint64_t hash = fnv1a(14695981039346656037ull, &type, sizeof(type));
+    dsoinfo_t* dso = dso_lookup(dso_list, pc);
+    if (dso != nullptr) {
+        hash = fnv1a(hash, dso->name, strlen(dso->name));
+        hash = fnv1a(hash, dso->buildid, strlen(dso->buildid));
+        pc -= dso->base;
+    }
+    return fnv1a(hash, &pc, sizeof(pc));
+}
+
+// Returns true if this crash was reported too recently to report again,
+// after printing a note saying so.
+
+static bool is_repeated_crash(dsoinfo_t* dso_list, uint32_t type, uintptr_t pc) {
+    if (repeat_crash_seconds <= 0)
+        return false;
+
+    uint64_t signature = crash_signature(dso_list, type, pc);
+    mx_time_t now = mx_time_get(MX_CLOCK_MONOTONIC);
+    for (auto& crash : recent_crashes) {
+        if (crash.reported == 0 || crash.signature != signature)
+            continue;
+        if (now - crash.reported < MX_SEC(repeat_crash_seconds)) {
+            crash.suppressed++;
+            printf("<== same crash as %" PRIu64 " ms ago, skipping backtrace\n",
+                   (now - crash.reported) / MX_MSEC(1));
+            return true;
+        }
+        if (crash.suppressed > 0) {
+            printf("<== %u more crashes like this one were not reported\n",
+                   crash.suppressed);
+        }
+        crash.reported = now;
+        crash.suppressed = 0;
+        return false;
+    }
+
+    recent_crashes[next_recent_crash] = { signature, now, 0 };
+    next_recent_crash = (next_recent_crash + 1) % kNumRecentCrashes;
+    return false;
+}
+
 constexpr uint64_t kSysExceptionKey = 1166444u;
 constexpr uint64_t kSelfExceptionKey = 0x646a65u;
 
@@ -267,6 +339,12 @@ void process_report(const mx_exception_report_t* report, bool use_libunwind) {
     gregs_type *regs = nullptr;
     mx_vaddr_t pc = 0, sp = 0, fp = 0;
     const char* arch = "unknown";
+    dsoinfo_t* dso_list = dso_fetch_process_list(process);
+
+    // Explicit backtrace requests are never skipped.
+    if (!is_resumable_swbreak(report) &&
+        is_repeated_crash(dso_list, report->header.type, context.arch.pc))
+        goto Fail;
 
     if (!read_general_regs(thread, &reg_buf, sizeof(reg_buf)))
         goto Fail;
@@ -304,7 +382,7 @@ void process_report(const mx_exception_report_t* report, bool use_libunwind) {
     printf("bottom of user stack:\n");
     dump_memory(process, sp, kMemoryDumpSize);
     printf("arch: %s\n", arch);
-    backtrace(process, thread, pc, sp, fp, use_libunwind);
+    backtrace(process, thread, dso_list, pc, sp, fp, use_libunwind);
 
     // TODO(dje): Print a backtrace of all other threads in the process.
     // Need to be able to suspend/resume threads first. MG-588
@@ -316,6 +394,7 @@ void process_report(const mx_exception_report_t* report, bool use_libunwind) {
 #endif
 
 Fail:
+    dso_free_list(dso_list);
     debugf(1, "Done handling thread %" PRIu64 ".%" PRIu64 ".\n", get_koid(process), get_koid(thread));
 
     // allow the thread (and then process) to die, unless the exception is
@@ -405,6 +484,8 @@ void usage() {
     fprintf(stderr, "      requires PT turned on in the kernel\n");
 #endif
     fprintf(stderr, "  -n = do not use libunwind\n");
+    fprintf(stderr, "  -r[n] = skip the backtrace of a crash repeated within\n");
+    fprintf(stderr, "      N seconds (default 10; -r or -r0 never skips)\n");
     fprintf(stderr, "  -s[on|off] = enable s/w breakpoints to trigger\n");
     fprintf(stderr, "      a backtrace without terminating the process\n");
 }
@@ -440,6 +521,8 @@ int main(int argc, char** argv) {
 #endif
         } else if (strcmp(arg, "-n") == 0) {
             use_libunwind = false;
+        } else if (strncmp(arg, "-r", 2) == 0) {
+            repeat_crash_seconds = atoi(arg + 2);
         } else if (strncmp(arg, "-s", 2) == 0) {
             if (arg[2] == '\0') {
                 swbreak_backtrace_enabled = true;
@@ -12,6 +12,7 @@
 #include <magenta/assert.h>
 #include <magenta/types.h>
 #include <magenta/syscalls.h>
+#include <magenta/syscalls/object.h>
 
 #include "dso-list.h"
 #include "utils.h"
@@ -25,6 +26,18 @@
 const char kDebugDirectory[] = "/boot/debug";
 const char kDebugSuffix[] = ".debug";
 
+// What we found in kDebugDirectory for each build ID, kept for the life of
+// crashlogger so that a crash loop doesn't search for the same files over
+// and over. /boot is read-only, so the answers can't go stale.
+struct debug_file_entry {
+    debug_file_entry* next;
+    mx_status_t status;
+    char* path;
+    char buildid[MAX_BUILDID_SIZE * 2 + 1];
+};
+
+static debug_file_entry* debug_file_cache;
+
 static dsoinfo_t* dsolist_add(dsoinfo_t** list, const char* name, uintptr_t base) {
     if (!strncmp(name, "app:devhost:", 12)) {
         // devhost processes use their name field to describe
@@ -93,6 +106,24 @@ dsoinfo_t* dso_fetch_list(mx_handle_t h, const char* name) {
     return dsolist;
 }
 
+dsoinfo_t* dso_fetch_process_list(mx_handle_t process) {
+    // Prepend "app:" to the name we print for the process binary to tell the
+    // reader (and the symbolize script!) that the name is the process's.
+    // The name property is only 32 characters which may be insufficient.
+    // N.B. The symbolize script looks for "app" and "app:".
+#define PROCESS_NAME_PREFIX "app:"
+#define PROCESS_NAME_PREFIX_LEN (sizeof(PROCESS_NAME_PREFIX) - 1)
+    char name[MX_MAX_NAME_LEN + PROCESS_NAME_PREFIX_LEN];
+    strcpy(name, PROCESS_NAME_PREFIX);
+    auto status = mx_object_get_property(process, MX_PROP_NAME, name + PROCESS_NAME_PREFIX_LEN,
+                                         sizeof(name) - PROCESS_NAME_PREFIX_LEN);
+    if (status != NO_ERROR) {
+        print_mx_error("mx_object_get_property, falling back to \"app\" for program name", status);
+        strlcpy(name, "app", sizeof(name));
+    }
+    return dso_fetch_list(process, name);
+}
+
 void dso_free_list(dsoinfo_t* list) {
     while (list != NULL) {
         dsoinfo_t* next = list->next;
@@ -139,6 +170,22 @@ mx_status_t dso_find_debug_file(dsoinfo_t* dso, const char** out_debug_file) {
 
     dso->debug_file_tried = true;
 
+    for (debug_file_entry* e = debug_file_cache; e != nullptr; e = e->next) {
+        if (strcmp(e->buildid, dso->buildid) != 0)
+            continue;
+        debugf(2, "using cached debug file result %d for %s\n", e->status, dso->name);
+        dso->debug_file_status = e->status;
+        if (e->status == NO_ERROR) {
+            dso->debug_file = strdup(e->path);
+            if (dso->debug_file == nullptr) {
+                dso->debug_file_status = ERR_NO_MEMORY;
+            } else {
+                *out_debug_file = dso->debug_file;
+            }
+        }
+        return dso->debug_file_status;
+    }
+
     char* path;
     if (asprintf(&path, "%s/%s%s", kDebugDirectory, dso->buildid, kDebugSuffix) < 0) {
         debugf(1, "OOM building debug file path for dso %s\n", dso->name);
@@ -161,5 +208,21 @@ mx_status_t dso_find_debug_file(dsoinfo_t* dso, const char** out_debug_file) {
         dso->debug_file_status = NO_ERROR;
     }
 
+    // An unknown build ID is all 'x's; don't let those share an entry.
+    if (dso->buildid[0] != 'x') {
+        auto e = reinterpret_cast<debug_file_entry*>(calloc(1, sizeof(debug_file_entry)));
+        if (e != nullptr) {
+            e->status = dso->debug_file_status;
+            e->path = dso->debug_file != nullptr ? strdup(dso->debug_file) : nullptr;
+            if (e->status != NO_ERROR || e->path != nullptr) {
+                strlcpy(e->buildid, dso->buildid, sizeof(e->buildid));
+                e->next = debug_file_cache;
+                debug_file_cache = e;
+            } else {
+                free(e);
+            }
+        }
+    }
+
     return dso->debug_file_status;
 }
@@ -20,6 +20,9 @@ typedef struct dsoinfo {
 
 extern dsoinfo_t* dso_fetch_list(mx_handle_t h, const char* name);
 
+// Like dso_fetch_list, naming the main executable after |process|.
+extern dsoinfo_t* dso_fetch_process_list(mx_handle_t process);
+
 extern void dso_free_list(dsoinfo_t*);
 
 extern dsoinfo_t* dso_lookup (dsoinfo_t* dso_list, mx_vaddr_t pc);
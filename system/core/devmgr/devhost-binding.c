@@ -156,6 +156,43 @@ bool dc_is_bindable(driver_ctx_t* drv, uint32_t protocol_id,
     return is_bindable(&ctx);
 }
 #else
+uint32_t devhost_device_protocol(mx_device_t* dev) {
+    bpctx_t ctx;
+    ctx.props = dev->props;
+    ctx.end = dev->props + dev->prop_count;
+    ctx.protocol_id = dev->protocol_id;
+    ctx.autobind = 0;
+    return dev_get_prop(&ctx, BIND_PROTOCOL);
+}
+
+// Aborts have no side effects, so if a binding program starts with a run
+// of them that includes ABORT_IF(NE, BIND_PROTOCOL, x), or consists of
+// nothing else but a final MATCH_IF(EQ, BIND_PROTOCOL, x), the driver
+// can only ever bind to devices of protocol x.
+bool devhost_binding_protocol(mx_driver_t* drv, uint32_t* protocol) {
+    const mx_bind_inst_t* ip = drv->binding;
+    const mx_bind_inst_t* end = ip + (drv->binding_size / sizeof(mx_bind_inst_t));
+
+    for (; ip < end; ip++) {
+        uint32_t inst = ip->op;
+        bool is_protocol = (BINDINST_CC(inst) != COND_AL) &&
+                           (BINDINST_PB(inst) == BIND_PROTOCOL);
+        if (BINDINST_OP(inst) == OP_ABORT) {
+            if (is_protocol && (BINDINST_CC(inst) == COND_NE)) {
+                *protocol = ip->arg;
+                return true;
+            }
+        } else if ((BINDINST_OP(inst) == OP_MATCH) && is_protocol &&
+                   (BINDINST_CC(inst) == COND_EQ) && (ip + 1 == end)) {
+            *protocol = ip->arg;
+            return true;
+        } else {
+            break;
+        }
+    }
+    return false;
+}
+
 bool devhost_is_bindable_drv(mx_driver_t* drv, mx_device_t* dev, bool autobind) {
     bpctx_t ctx;
     ctx.props = dev->props;
@@ -8,6 +8,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -105,6 +106,29 @@ static mx_status_t default_resume(void* ctx, uint32_t flags) {
 static struct list_node unmatched_device_list = LIST_INITIAL_VALUE(unmatched_device_list);
 static struct list_node driver_list = LIST_INITIAL_VALUE(driver_list);
 
+#if !DEVHOST_V2
+// Drivers whose binding program can only match one protocol are kept in
+// a hash by that protocol, everything else on the wildcard list, so that
+// probing a device only evaluates the binding programs that might match.
+// seq preserves driver_list order when merging a bucket with the wildcards.
+typedef struct {
+    struct list_node node;
+    mx_driver_t* drv;
+    uint64_t seq;
+    uint32_t protocol;
+} driver_index_entry_t;
+
+#define DRIVER_INDEX_BUCKETS 32
+
+static struct list_node driver_index[DRIVER_INDEX_BUCKETS];
+static struct list_node driver_wildcard_list = LIST_INITIAL_VALUE(driver_wildcard_list);
+static bool driver_index_ready;
+static uint64_t driver_index_seq;
+
+// binds slower than this are reported
+#define SLOW_BIND_MS 50
+#endif
+
 static inline bool device_is_bound(mx_device_t* dev) {
     return dev->owner != NULL;
 }
@@ -133,14 +157,47 @@ void dev_ref_release(mx_device_t* dev) {
             printf("device: %p(%s): still has children! not good.\n", dev, dev->name);
         }
 
+        // instances hold a reference on the device they were opened from
+        mx_device_t* origin = (dev->flags & DEV_FLAG_INSTANCE) ? dev->parent : NULL;
+
         mx_handle_close(dev->event);
         DM_UNLOCK();
         device_op_release(dev);
         DM_LOCK();
+
+        if (origin) {
+            dev_ref_release(origin);
+        }
     }
 }
 
 #if !DEVHOST_V2
+static void driver_index_init(void) {
+    if (!driver_index_ready) {
+        for (unsigned n = 0; n < DRIVER_INDEX_BUCKETS; n++) {
+            list_initialize(&driver_index[n]);
+        }
+        driver_index_ready = true;
+    }
+}
+
+static mx_status_t driver_index_add(mx_driver_t* drv, bool* keyed, uint32_t* protocol) {
+    driver_index_entry_t* entry = calloc(1, sizeof(driver_index_entry_t));
+    if (entry == NULL) {
+        return ERR_NO_MEMORY;
+    }
+    driver_index_init();
+    entry->drv = drv;
+    entry->seq = driver_index_seq++;
+    if ((*keyed = devhost_binding_protocol(drv, &entry->protocol))) {
+        *protocol = entry->protocol;
+        list_add_tail(&driver_index[entry->protocol % DRIVER_INDEX_BUCKETS], &entry->node);
+    } else {
+        list_add_tail(&driver_wildcard_list, &entry->node);
+    }
+    return NO_ERROR;
+}
+
 static mx_status_t devhost_device_probe(mx_device_t* dev, mx_driver_t* drv, bool autobind) {
     mx_status_t status;
 
@@ -159,12 +216,20 @@ static mx_status_t devhost_device_probe(mx_device_t* dev, mx_driver_t* drv, bool
 
     void *cookie = NULL;
     DM_UNLOCK();
+    mx_time_t t0 = mx_time_get(MX_CLOCK_MONOTONIC);
     // Load driver if it's not already loaded
     if ((status = devhost_load_driver(drv)) < 0) {
         DM_LOCK();
         return status;
     }
+    mx_time_t t1 = mx_time_get(MX_CLOCK_MONOTONIC);
     status = drv->ops->bind(drv, dev, &cookie);
+    mx_time_t t2 = mx_time_get(MX_CLOCK_MONOTONIC);
+    if ((t2 - t0) > MX_MSEC(SLOW_BIND_MS)) {
+        printf("devhost: slow bind: drv '%s' dev '%s': load %" PRIu64 "ms bind %" PRIu64 "ms (%d)\n",
+               drv->name ? drv->name : "<NULL>", dev->name,
+               (t1 - t0) / MX_MSEC(1), (t2 - t1) / MX_MSEC(1), status);
+    }
     DM_LOCK();
     if (status < 0) {
         return status;
@@ -193,15 +258,42 @@ static void devhost_device_probe_all(mx_device_t* dev, bool autobind) {
         return;
     }
 
-    mx_driver_t* drv = NULL;
-    list_for_every_entry (&driver_list, drv, mx_driver_t, node) {
-        if (devhost_device_probe(dev, drv, autobind) == NO_ERROR) {
+    driver_index_init();
+
+    // walk the device's protocol bucket and the wildcard drivers together
+    // in the order the drivers were added
+    uint32_t protocol = devhost_device_protocol(dev);
+    struct list_node* bucket = &driver_index[protocol % DRIVER_INDEX_BUCKETS];
+    driver_index_entry_t* keyed =
+        list_peek_head_type(bucket, driver_index_entry_t, node);
+    driver_index_entry_t* wild =
+        list_peek_head_type(&driver_wildcard_list, driver_index_entry_t, node);
+    for (;;) {
+        if (keyed && (keyed->protocol != protocol)) {
+            keyed = list_next_type(bucket, &keyed->node, driver_index_entry_t, node);
+            continue;
+        }
+        driver_index_entry_t* entry;
+        if (keyed && (!wild || (keyed->seq < wild->seq))) {
+            entry = keyed;
+        } else if (wild) {
+            entry = wild;
+        } else {
+            break;
+        }
+        if (devhost_device_probe(dev, entry->drv, autobind) == NO_ERROR) {
             // if the probe succeeded and we are not a multi-bind
             // device, we can stop looking for further matches now
             if (!(dev->flags & DEV_FLAG_MULTI_BIND)) {
                 break;
             }
         }
+        if (entry == keyed) {
+            keyed = list_next_type(bucket, &keyed->node, driver_index_entry_t, node);
+        } else {
+            wild = list_next_type(&driver_wildcard_list, &wild->node,
+                                  driver_index_entry_t, node);
+        }
     }
 
     // if no driver is bound, add the device to the unmatched list
@@ -440,6 +532,11 @@ mx_status_t devhost_device_add(mx_device_t* dev, mx_device_t* parent,
         if (resource != MX_HANDLE_INVALID) {
             mx_handle_close(resource);
         }
+        // nor are they added to the device tree, but remember the
+        // device they were opened from so a bind through the open
+        // instance can be directed at it
+        dev_ref_acquire(parent);
+        dev->parent = parent;
     }
     dev->flags |= DEV_FLAG_ADDED;
 
@@ -548,6 +645,11 @@ mx_status_t devhost_device_remove(mx_device_t* dev) {
 
 #if !DEVHOST_V2
 mx_status_t devhost_device_bind(mx_device_t* dev, const char* drv_name) {
+    if ((dev->flags & DEV_FLAG_INSTANCE) && dev->parent) {
+        // binding to an instance means binding to the device it is an
+        // open of
+        dev = dev->parent;
+    }
     if (device_is_bound(dev)) {
         return ERR_INVALID_ARGS;
     }
@@ -647,6 +749,13 @@ mx_status_t devhost_device_close(mx_device_t* dev, uint32_t flags) {
 mx_status_t devhost_driver_add(mx_driver_t* drv) {
     xprintf("driver add: %p(%s)\n", drv, drv->name);
 
+    bool keyed;
+    uint32_t protocol;
+    mx_status_t status;
+    if ((status = driver_index_add(drv, &keyed, &protocol)) < 0) {
+        return status;
+    }
+
     // add the driver to the driver list
     list_add_tail(&driver_list, &drv->node);
 
@@ -654,6 +763,9 @@ mx_status_t devhost_driver_add(mx_driver_t* drv) {
     mx_device_t* dev = NULL;
     mx_device_t* temp = NULL;
     list_for_every_entry_safe (&unmatched_device_list, dev, temp, mx_device_t, unode) {
+        if (keyed && (devhost_device_protocol(dev) != protocol)) {
+            continue;
+        }
         devhost_device_probe(dev, drv, true);
     }
     return NO_ERROR;
@@ -420,7 +420,7 @@ static void devhost_io_init(void) {
         return;
     }
     mxio_t* logger;
-    if ((logger = mxio_logger_create(h)) == NULL) {
+    if ((logger = mxio_logger_create_batched(h)) == NULL) {
         return;
     }
     close(1);
@@ -49,7 +49,7 @@ static void devhost_io_init(void) {
         return;
     }
     mxio_t* logger;
-    if ((logger = mxio_logger_create(h)) == NULL) {
+    if ((logger = mxio_logger_create_batched(h)) == NULL) {
         return;
     }
     close(STDOUT_FILENO);
@@ -196,6 +196,8 @@ static int devhost_cmdline(int argc, char** argv) {
 
 extern driver_api_t devhost_api;
 
+#define DEVHOST_RPC_THREADS_MAX 16
+
 void devhost_init_drivers(bool as_root);
 
 int main(int argc, char** argv) {
@@ -229,6 +231,19 @@ int main(int argc, char** argv) {
 
     devhost_init_drivers(as_root);
 
+    // Each channel is still served by one thread at a time, so requests
+    // on one connection stay ordered, but a slow ioctl no longer holds
+    // up the other clients of this devhost.
+    const char* threads = getenv("devhost.rpc.threads");
+    long count = threads ? strtol(threads, NULL, 10) : 1;
+    if (count > DEVHOST_RPC_THREADS_MAX) {
+        count = DEVHOST_RPC_THREADS_MAX;
+    }
+    if (count > 1) {
+        if (mxio_dispatcher_start_pool(devhost_rio_dispatcher, "devhost-rpc", count - 1) < 0) {
+            printf("devhost: could not start rpc thread pool\n");
+        }
+    }
     mxio_dispatcher_run(devhost_rio_dispatcher);
     printf("devhost: rio dispatcher exited?\n");
     return 0;
@@ -62,6 +62,13 @@ void devhost_device_destroy(mx_device_t* dev);
 
 bool devhost_is_bindable_drv(mx_driver_t* drv, mx_device_t* dev, bool autobind);
 
+// The protocol a device presents to binding programs.
+uint32_t devhost_device_protocol(mx_device_t* dev);
+
+// If a driver's binding program can only match devices of one protocol,
+// return true and that protocol.
+bool devhost_binding_protocol(mx_driver_t* drv, uint32_t* protocol);
+
 mx_status_t devhost_load_driver(mx_driver_t* drv);
 
 mx_status_t devhost_load_firmware(mx_driver_t* drv, const char* path,
@@ -14,6 +14,7 @@
 
 #include "acpi.h"
 #include "devcoordinator.h"
+#include "devmgr.h"
 #include "log.h"
 
 uint32_t log_flags = LOG_ERROR | LOG_INFO;
@@ -829,6 +830,11 @@ static mx_status_t dc_attempt_bind(driver_t* drv, device_t* dev) {
     if ((dev->flags & DEV_CTX_BOUND) && (!(dev->flags & DEV_CTX_MULTI_BIND))) {
         return ERR_BAD_STATE;
     }
+
+    char stage[MX_MAX_NAME_LEN];
+    snprintf(stage, sizeof(stage), "bind:%s", drv->name);
+    devmgr_boot_stage(stage);
+
     if (!(dev->flags & DEV_CTX_BUSDEV)) {
         // non-busdev is pretty simple
         if (dev->host == NULL) {
@@ -956,6 +962,7 @@ void coordinator(void) {
 
     do_publish(&root_device, &misc_device);
 
+    devmgr_boot_stage("devmgr:drivers");
     enumerate_drivers();
 
     driver_t* drv;
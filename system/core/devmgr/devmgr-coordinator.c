@@ -279,6 +279,7 @@ void coordinator(void) {
         return;
     }
     root->vnode = vnroot;
+    devmgr_boot_stage("devmgr:devhost");
     const char* args[2] = { "/boot/bin/devhost", "root" };
     devmgr_launch_devhost(devhost_job_handle, "devhost:root", 2, (char**)args, hdevice, hrpc);
 
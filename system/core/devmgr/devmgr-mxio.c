@@ -24,6 +24,7 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -40,13 +41,15 @@ struct bootfile {
 struct callback_data {
     mx_handle_t vmo;
     unsigned int file_count;
-    mx_status_t (*add_file)(const char* path, mx_handle_t vmo, mx_off_t off, size_t len);
+    bool file_compressed;
+    mx_status_t (*add_file)(const char* path, mx_handle_t vmo, mx_off_t off, size_t len,
+                            bool compressed);
 };
 
 static void callback(void* arg, const char* path, size_t off, size_t len) {
     struct callback_data* cd = arg;
     //printf("bootfs: %s @%zd (%zd bytes)\n", path, off, len);
-    cd->add_file(path, cd->vmo, off, len);
+    cd->add_file(path, cd->vmo, off, len, cd->file_compressed);
     ++cd->file_count;
 }
 
@@ -125,8 +128,16 @@ static ssize_t setup_bootfs_vmo(uint32_t n, uint32_t type, mx_handle_t vmo) {
     if (size == 0) {
         return 0;
     }
+    bootdata_t hdr;
+    size_t actual;
+    status = mx_vmo_read(vmo, &hdr, 0, sizeof(hdr), &actual);
+    if ((status != NO_ERROR) || (actual != sizeof(hdr))) {
+        printf("devmgr: failed to read bootfs#%u header (%d)\n", n, status);
+        return (status != NO_ERROR) ? status : ERR_IO;
+    }
     struct callback_data cd = {
         .vmo = vmo,
+        .file_compressed = (hdr.flags & BOOTDATA_BOOTFS_FLAG_FILE_COMPRESSED) != 0,
         .add_file = (type == BOOTDATA_BOOTFS_SYSTEM) ? systemfs_add_file : bootfs_add_file,
     };
     if ((type == BOOTDATA_BOOTFS_SYSTEM) && !has_secondary_bootfs) {
@@ -153,6 +164,7 @@ static void setup_bootfs(void) {
     }
 
     for (unsigned n = 0; (vmo = mx_get_startup_handle(HND_BOOTDATA(n))); n++) {
+        size_t keep = 0;
         bootdata_t bootdata;
         size_t actual;
         mx_status_t status = mx_vmo_read(vmo, &bootdata, 0, sizeof(bootdata), &actual);
@@ -163,6 +175,7 @@ static void setup_bootfs(void) {
             printf("devmgr: bootdata item does not contain bootdata\n");
             goto done;
         }
+        keep = sizeof(bootdata) + bootdata.length;
 
         size_t len = bootdata.length;
         size_t off = sizeof(bootdata);
@@ -181,17 +194,25 @@ static void setup_bootfs(void) {
             case BOOTDATA_CONTAINER:
                 printf("devmgr: unexpected bootdata container header\n");
                 goto done;
-            case BOOTDATA_BOOTFS_DISCARD:
-                // this was already unpacked for us by userboot
+            case BOOTDATA_BOOTFS_DISCARD: {
+                // this was already unpacked for us by userboot, which
+                // marked it so; put it back for the next kernel
+                uint32_t type = BOOTDATA_BOOTFS_BOOT;
+                mx_vmo_write(vmo, &type, off + offsetof(bootdata_t, type), sizeof(type), &actual);
                 break;
+            }
             case BOOTDATA_BOOTFS_BOOT:
             case BOOTDATA_BOOTFS_SYSTEM: {
                 const char* errmsg;
                 mx_handle_t bootfs_vmo;
-                printf("devmgr: decompressing bootfs #%u\n", idx);
-                status = decompress_bootdata(mx_vmar_root_self(), vmo,
-                                             off, bootdata.length + sizeof(bootdata),
-                                             &bootfs_vmo, &errmsg);
+                if (bootdata.flags & BOOTDATA_BOOTFS_FLAG_COMPRESSED) {
+                    printf("devmgr: decompressing bootfs #%u\n", idx);
+                }
+                // Boot waits on this, so use every cpu.
+                status = decompress_bootdata_parallel(mx_vmar_root_self(), vmo,
+                                                      off, bootdata.length + sizeof(bootdata),
+                                                      mx_system_get_num_cpus(),
+                                                      &bootfs_vmo, &errmsg);
                 if (status < 0) {
                     printf("devmgr: failed to decompress bootdata\n");
                 } else {
@@ -216,7 +237,12 @@ static void setup_bootfs(void) {
             len -= itemlen;
         }
 done:
-        mx_handle_close(vmo);
+        // The first bootdata lives on in /boot, for mexec; the file keeps
+        // the handle.
+        if ((n > 0) || (keep == 0) ||
+            (bootfs_add_file(BOOTDATA_FILE, vmo, 0, keep, false) < 0)) {
+            mx_handle_close(vmo);
+        }
     }
 }
 
@@ -12,6 +12,7 @@
 #include <magenta/device/console.h>
 #include <magenta/device/vfs.h>
 #include <magenta/dlfcn.h>
+#include <magenta/ktrace.h>
 #include <magenta/process.h>
 #include <magenta/processargs.h>
 #include <magenta/syscalls.h>
@@ -46,6 +47,13 @@ mx_handle_t application_launcher;
 mx_handle_t get_root_resource(void) {
     return root_resource_handle;
 }
+void devmgr_boot_stage(const char* name) {
+    // the kernel always reads a whole name's worth
+    char buf[MX_MAX_NAME_LEN] = {};
+    strncpy(buf, name, sizeof(buf) - 1);
+    mx_ktrace_control(root_resource_handle, KTRACE_ACTION_BOOT_STAGE, 0, buf);
+}
+
 mx_handle_t get_sysinfo_job_root(void) {
     mx_handle_t h;
     //TODO: limit to enumerate rights
@@ -240,6 +248,7 @@ int devmgr_start_system_init(void* arg) {
     mtx_lock(&lock);
     struct stat s;
     if (!init_started && stat(argv_init[0], &s) == 0) {
+        devmgr_boot_stage("devmgr:init");
         unsigned int init_hnd_count = 0;
         mx_handle_t init_hnds[2] = {};
         uint32_t init_ids[2] = {};
@@ -386,6 +395,7 @@ int main(int argc, char** argv) {
     root_resource_handle = mx_get_startup_handle(PA_HND(PA_RESOURCE, 0));
     root_job_handle = mx_job_default();
 
+    devmgr_boot_stage("devmgr");
     printf("devmgr: main()\n");
 
     char** e = environ;
@@ -393,6 +403,7 @@ int main(int argc, char** argv) {
         printf("cmdline: %s\n", *e++);
     }
 
+    devmgr_boot_stage("devmgr:vfs");
     devmgr_init(root_job_handle);
     devmgr_vfs_init();
 
@@ -455,6 +466,7 @@ int main(int argc, char** argv) {
         }
     }
 
+    devmgr_boot_stage("devmgr:coordinator");
     devmgr_handle_messages();
     printf("devmgr: message handler returned?!\n");
     return 0;
@@ -35,4 +35,12 @@ int devmgr_start_system_init(void* arg);
 
 mx_handle_t get_service_root(void);
 
+// Where in /boot devmgr leaves the bootdata the system started with, as
+// the bootloader handed it over, for dmctl's mexec to boot again with.
+#define BOOTDATA_FILE "kernel/bootdata.bin"
+
+// Marks the start of a stage of devmgr's work in the kernel's boot
+// timeline, which bootchart displays.
+void devmgr_boot_stage(const char* name);
+
 __END_CDECLS
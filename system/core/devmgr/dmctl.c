@@ -6,20 +6,28 @@
 #include <ddk/driver.h>
 #include <ddk/protocol/devmgr.h>
 
+#include <magenta/device/device.h>
 #include <magenta/device/dmctl.h>
 #include <magenta/ktrace.h>
+#include <magenta/syscalls.h>
 #include <magenta/types.h>
 
 #include <mxio/io.h>
 #include <mxio/loader-service.h>
 
+#include <dirent.h>
+#include <fcntl.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "acpi.h"
 #include "devhost.h"
 #include "devcoordinator.h"
+#include "devmgr.h"
 
 static mx_handle_t dmctl_handle = MX_HANDLE_INVALID;
 
@@ -50,12 +58,119 @@ static int reboot_async(void* arg) {
     return 0;
 }
 
+// Suspends every device at or below |path| in devfs, children before
+// their parents, as IOCTL_DEVICE_DEBUG_SUSPEND would one at a time.
+static void suspend_devices(const char* path, unsigned* count) {
+    DIR* dir = opendir(path);
+    if (dir != NULL) {
+        struct dirent* de;
+        while ((de = readdir(dir)) != NULL) {
+            if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) {
+                continue;
+            }
+            // /dev/class only holds more names for devices found elsewhere
+            if (!strcmp(path, "/dev") && !strcmp(de->d_name, "class")) {
+                continue;
+            }
+            char child[PATH_MAX];
+            snprintf(child, sizeof(child), "%s/%s", path, de->d_name);
+            suspend_devices(child, count);
+        }
+        closedir(dir);
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        if (ioctl_device_debug_suspend(fd) == NO_ERROR) {
+            (*count)++;
+        }
+        close(fd);
+    }
+}
+
+typedef struct {
+    mx_handle_t kernel;
+    mx_handle_t bootdata;
+} mexec_args_t;
+
+static int mexec_async(void* arg) {
+    mexec_args_t* args = arg;
+    signal_devmgr_shutdown();
+
+    unsigned count = 0;
+    suspend_devices("/dev", &count);
+    printf("dmctl: suspended %u devices, starting the new kernel\n", count);
+
+    mx_status_t r = mx_system_mexec(args->kernel, args->bootdata);
+
+    // Filesystems are gone and devices are suspended: there is no way back
+    // but a cold boot.
+    printf("dmctl: mexec failed: %d, rebooting\n", r);
+    devhost_acpi_reboot();
+    return 0;
+}
+
+static mx_status_t load_vmo(const char* path, mx_handle_t* vmo) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("dmctl: cannot open '%s'\n", path);
+        return ERR_NOT_FOUND;
+    }
+    mx_status_t r = mxio_get_vmo(fd, vmo);
+    close(fd);
+    if (r < 0) {
+        printf("dmctl: cannot read '%s': %d\n", path, r);
+    }
+    return r;
+}
+
+// "<kernel> [<bootdata>]": with no bootdata, the new kernel gets what the
+// bootloader gave this one, ramdisk and all.
+static mx_status_t devmgr_mexec(char* arg) {
+    static mexec_args_t args;
+    static bool started;
+    if (started) {
+        return ERR_BAD_STATE;
+    }
+
+    char* kernel = strtok(arg, " ");
+    char* bootdata = strtok(NULL, " ");
+    if (kernel == NULL) {
+        printf("usage: mexec <kernel> [<bootdata>]\n");
+        return ERR_INVALID_ARGS;
+    }
+    if (bootdata == NULL) {
+        bootdata = "/boot/" BOOTDATA_FILE;
+    }
+
+    // Read both in now, while the filesystems they're on are still mounted.
+    mx_status_t r;
+    if ((r = load_vmo(kernel, &args.kernel)) < 0) {
+        return r;
+    }
+    if ((r = load_vmo(bootdata, &args.bootdata)) < 0) {
+        mx_handle_close(args.kernel);
+        return r;
+    }
+
+    thrd_t t;
+    if (thrd_create_with_name(&t, mexec_async, &args, "mexec")) {
+        mx_handle_close(args.kernel);
+        mx_handle_close(args.bootdata);
+        return ERR_NO_RESOURCES;
+    }
+    thrd_detach(t);
+    started = true;
+    return NO_ERROR;
+}
+
 static mx_status_t devmgr_control(const char* cmd) {
     if (!strcmp(cmd, "help")) {
         printf("dump        - dump device tree\n"
                "poweroff    - power off the system\n"
                "shutdown    - power off the system\n"
                "reboot      - reboot the system\n"
+               "mexec       - reboot into a new kernel without the firmware:\n"
+               "              mexec <kernel> [<bootdata>]\n"
                "kerneldebug - send a command to the kernel\n"
                "ktraceoff   - stop kernel tracing\n"
                "ktraceon    - start kernel tracing\n"
@@ -82,6 +197,11 @@ static mx_status_t devmgr_control(const char* cmd) {
         }
         return NO_ERROR;
     }
+    if (!strcmp(cmd, "mexec") || !strncmp(cmd, "mexec ", 6)) {
+        char arg[strlen(cmd) + 1];
+        strcpy(arg, cmd + 5);
+        return devmgr_mexec(arg);
+    }
     const char* prefix = "kerneldebug ";
     if (!strncmp(cmd, prefix, strlen(prefix))) {
         const char* arg = cmd + strlen(prefix);
@@ -75,6 +75,12 @@ void Dnode::Detach() {
     vnode_ = nullptr;
 }
 
+void Dnode::NotifyParent(unsigned event) const {
+    if (parent_) {
+        parent_->vnode_->Notify(name_.get(), NameLen(), event);
+    }
+}
+
 void Dnode::AddChild(mxtl::RefPtr<Dnode> parent, mxtl::RefPtr<Dnode> child) {
     MX_DEBUG_ASSERT(parent != nullptr);
     MX_DEBUG_ASSERT(child != nullptr);
@@ -187,7 +193,12 @@ void Dnode::Readdir(fs::DirentFiller* df, void* cookie) const {
             continue;
         }
         uint32_t vtype = dn.IsDirectory() ? V_TYPE_DIR : V_TYPE_FILE;
-        if ((r = df->Next(dn.name_.get(), dn.NameLen(), VTYPE_TO_DTYPE(vtype))) != NO_ERROR) {
+        vnattr_t attr;
+        vnattr_t* attrp = nullptr;
+        if (df->WantsAttrs() && dn.vnode_->Getattr(&attr) == NO_ERROR) {
+            attrp = &attr;
+        }
+        if ((r = df->Next(dn.name_.get(), dn.NameLen(), VTYPE_TO_DTYPE(vtype), attrp)) != NO_ERROR) {
             return;
         }
         c->order = dn.ordering_token_ + 1;
@@ -61,6 +61,10 @@ public:
 
     bool HasChildren() const { return !children_.is_empty(); }
 
+    // Passes |event| about this entry to watchers of the parent directory
+    // (if dnode has a parent).
+    void NotifyParent(unsigned event) const;
+
     // Look up the child dnode (within a parent directory) by name.
     // Returns NO_ERROR if the child is found.
     //
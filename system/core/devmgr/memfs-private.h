@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <threads.h>
 
 #include <ddk/device.h>
@@ -17,6 +18,7 @@
 #ifdef __cplusplus
 
 #include <mxtl/intrusive_double_list.h>
+#include <mxtl/mutex.h>
 #include <mxtl/ref_ptr.h>
 #include <mxtl/unique_ptr.h>
 
@@ -66,8 +68,15 @@ private:
     mx_status_t Truncate(size_t len) final;
     mx_status_t Getattr(vnattr_t* a) final;
 
+    // Ensures there's room to hold 'len' bytes of the file.
+    mx_status_t Reserve(size_t len);
+
+    // The contents live in 'inline_' until the file outgrows it, and in
+    // 'vmo_' from then on; either way, there's room for 'capacity_' bytes.
+    mxtl::unique_ptr<uint8_t[]> inline_;
     mx_handle_t vmo_;
     mx_off_t length_;
+    size_t capacity_;
 };
 
 class VnodeDir : public VnodeMemfs {
@@ -82,13 +91,13 @@ public:
     // Fails if the vnode already exists.
     // Passes the vmo to the Vnode; does not duplicate it.
     mx_status_t CreateFromVmo(const char* name, size_t namelen, mx_handle_t vmo, mx_off_t off,
-                              mx_off_t len);
+                              mx_off_t len, mx_off_t compressed_len = 0);
 
     mx_status_t CreateDeviceAtLocked(mxtl::RefPtr<memfs::VnodeDir>* out, const char* name,
                                      mx_handle_t h);
 
     // Use the watcher container to implement a directory watcher
-    void NotifyAdd(const char* name, size_t len) final;
+    void Notify(const char* name, size_t len, unsigned event) final;
     mx_status_t WatchDir(mx_handle_t* out) final;
 
     // The vnode is acting as a mount point for a remote filesystem or device.
@@ -100,6 +109,8 @@ public:
 
 private:
     mx_status_t Readdir(void* cookie, void* dirents, size_t len) final;
+    mx_status_t ReaddirPlus(void* cookie, void* dirents, size_t len) final;
+    mx_status_t ReaddirInternal(void* cookie, void* dirents, size_t len, bool attrs);
 
     // Resolves the question, "Can this directory create a child node with the name?"
     // Returns "NO_ERROR" on success; otherwise explains failure with error message.
@@ -133,7 +144,10 @@ private:
 
 class VnodeVmo final : public VnodeMemfs {
 public:
-    VnodeVmo(mx_handle_t vmo, mx_off_t offset, mx_off_t length);
+    // If compressed_len is nonzero, the file's data is an LZ4 frame of that
+    // many bytes at offset, which is decompressed on first use.
+    VnodeVmo(mx_handle_t vmo, mx_off_t offset, mx_off_t length,
+             mx_off_t compressed_len = 0);
     ~VnodeVmo();
 
 private:
@@ -143,9 +157,15 @@ private:
     mx_status_t GetHandles(uint32_t flags, mx_handle_t* hnds,
                            uint32_t* type, void* extra, uint32_t* esize) final;
 
+    // Replaces vmo_ with a VMO of its own holding the decompressed data.
+    mx_status_t Decompress();
+
+    mxtl::Mutex lock_;
     mx_handle_t vmo_;
     mx_off_t offset_;
     mx_off_t length_;
+    mx_off_t compressed_len_ TA_GUARDED(lock_);
+    bool owns_vmo_;
 };
 
 } // namespace memfs
@@ -180,11 +200,15 @@ mx_status_t memfs_create_device_at(VnodeDir* parent, VnodeDir** out, const char*
 mx_status_t devfs_remove(VnodeDir* vn);
 
 // boot fs
-mx_status_t bootfs_add_file(const char* path, mx_handle_t vmo, mx_off_t off, size_t len);
+// len is the length of the file's data in vmo; if compressed, that data is
+// an LZ4 frame which is decompressed when the file is first used.
+mx_status_t bootfs_add_file(const char* path, mx_handle_t vmo, mx_off_t off, size_t len,
+                            bool compressed);
 
 // system fs
 VnodeDir* systemfs_get_root(void);
-mx_status_t systemfs_add_file(const char* path, mx_handle_t vmo, mx_off_t off, size_t len);
+mx_status_t systemfs_add_file(const char* path, mx_handle_t vmo, mx_off_t off, size_t len,
+                              bool compressed);
 
 // memory fs
 mx_status_t memfs_add_link(VnodeDir* parent, const char* name,
@@ -3,12 +3,16 @@
 // found in the LICENSE file.
 
 #include <inttypes.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 
+#include <bootdata/decompress.h>
 #include <ddk/device.h>
 #include <fs/vfs.h>
+#include <magenta/process.h>
+#include <magenta/syscalls.h>
 #include <mxio/debug.h>
 #include <mxio/io.h>
 #include <mxio/vfs.h>
@@ -27,12 +31,36 @@ mx_status_t VnodeVmo::Serve(mx_handle_t h, uint32_t flags) {
     return NO_ERROR;
 }
 
+mx_status_t VnodeVmo::Decompress() {
+    mxtl::AutoLock lock(&lock_);
+    if (compressed_len_ == 0) {
+        return NO_ERROR;
+    }
+    mx_handle_t vmo;
+    const char* errmsg;
+    mx_status_t status = decompress_bootfs_file(mx_vmar_root_self(), vmo_, offset_,
+                                                compressed_len_, &vmo, &errmsg);
+    if (status != NO_ERROR) {
+        printf("bootfs: cannot decompress file: %s (%d)\n", errmsg, status);
+        return status;
+    }
+    // vmo_ was the whole bootfs image, which is shared with other vnodes.
+    vmo_ = vmo;
+    offset_ = 0;
+    compressed_len_ = 0;
+    owns_vmo_ = true;
+    return NO_ERROR;
+}
+
 mx_status_t VnodeVmo::GetHandles(uint32_t flags, mx_handle_t* hnds,
                                  uint32_t* type, void* extra, uint32_t* esize) {
     mx_off_t* off = static_cast<mx_off_t*>(extra);
     mx_off_t* len = off + 1;
     mx_handle_t vmo;
-    mx_status_t status = mx_handle_duplicate(vmo_, MX_RIGHT_READ | MX_RIGHT_DUPLICATE | MX_RIGHT_TRANSFER, &vmo);
+    mx_status_t status = Decompress();
+    if (status != NO_ERROR)
+        return status;
+    status = mx_handle_duplicate(vmo_, MX_RIGHT_READ | MX_RIGHT_DUPLICATE | MX_RIGHT_TRANSFER, &vmo);
     if (status < 0)
         return status;
     xprintf("vmofile: %x (%x) off=%" PRIu64 " len=%" PRIu64 "\n", vmo, vmo_, offset_, length_);
@@ -46,17 +74,27 @@ mx_status_t VnodeVmo::GetHandles(uint32_t flags, mx_handle_t* hnds,
 }
 
 static mx_status_t add_file(mxtl::RefPtr<VnodeDir> vnb, const char* path, mx_handle_t vmo,
-                            mx_off_t off, size_t len) {
+                            mx_off_t off, size_t len, bool compressed) {
     mx_status_t r;
     if ((path[0] == '/') || (path[0] == 0))
         return ERR_INVALID_ARGS;
+    size_t compressed_len = 0;
+    if (compressed) {
+        // Only the frame header is read now; see VnodeVmo::Decompress.
+        const char* errmsg;
+        compressed_len = len;
+        if ((r = bootfs_file_size(vmo, off, compressed_len, &len, &errmsg)) < 0) {
+            printf("bootfs: bad compressed file '%s': %s\n", path, errmsg);
+            return r;
+        }
+    }
     for (;;) {
         const char* nextpath = strchr(path, '/');
         if (nextpath == nullptr) {
             if (path[0] == 0) {
                 return ERR_INVALID_ARGS;
             }
-            return vnb->CreateFromVmo(path, strlen(path), vmo, off, len);
+            return vnb->CreateFromVmo(path, strlen(path), vmo, off, len, compressed_len);
         } else {
             if (nextpath == path) {
                 return ERR_INVALID_ARGS;
@@ -82,10 +120,12 @@ static mx_status_t add_file(mxtl::RefPtr<VnodeDir> vnb, const char* path, mx_han
 // The following functions exist outside the memfs namespace so they can
 // be exposed to C:
 
-mx_status_t bootfs_add_file(const char* path, mx_handle_t vmo, mx_off_t off, size_t len) {
-    return add_file(BootfsRoot(), path, vmo, off, len);
+mx_status_t bootfs_add_file(const char* path, mx_handle_t vmo, mx_off_t off, size_t len,
+                            bool compressed) {
+    return add_file(BootfsRoot(), path, vmo, off, len, compressed);
 }
 
-mx_status_t systemfs_add_file(const char* path, mx_handle_t vmo, mx_off_t off, size_t len) {
-    return add_file(SystemfsRoot(), path, vmo, off, len);
+mx_status_t systemfs_add_file(const char* path, mx_handle_t vmo, mx_off_t off, size_t len,
+                              bool compressed) {
+    return add_file(SystemfsRoot(), path, vmo, off, len, compressed);
 }
@@ -25,6 +25,11 @@ mx_status_t devfs_remove(VnodeDir* vn) {
     xprintf("devfs_remove(%p)\n", vn);
     vn->DetachRemote();
 
+    // The device leaves every directory it appears in, /dev/class included.
+    for (const memfs::Dnode& dn : vn->devices_) {
+        dn.NotifyParent(VFS_WATCH_EVT_REMOVED);
+    }
+
     // If this vnode is a directory, delete its dnode
     if (vn->IsDirectory()) {
         xprintf("devfs_remove(%p) delete dnode\n", vn);
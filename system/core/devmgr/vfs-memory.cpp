@@ -15,6 +15,7 @@
 #include <magenta/thread_annotations.h>
 #include <mxio/debug.h>
 #include <mxio/vfs.h>
+#include <mxtl/algorithm.h>
 #include <mxtl/auto_lock.h>
 #include <mxtl/ref_ptr.h>
 #include <mxtl/unique_ptr.h>
@@ -27,7 +28,17 @@
 
 namespace memfs {
 
-constexpr size_t kMinfsMaxFileSize = (8192 * 8192);
+// Files start out in a small heap buffer, and move into a VMO once they
+// outgrow kMemfsInlineMax. Either way, capacity grows geometrically, so
+// appending doesn't resize on every write; everything past the end of the
+// file, up to the capacity, is kept zeroed.
+constexpr size_t kMemfsInlineMin = 64;
+constexpr size_t kMemfsInlineMax = PAGE_SIZE / 2;
+
+// No one file may take up more than a quarter of memory
+static size_t MaxFileSize() {
+    return mx_system_get_physmem() / 4;
+}
 
 static mxtl::RefPtr<VnodeDir> vfs_root = nullptr;
 static mxtl::RefPtr<VnodeDir> memfs_root = nullptr;
@@ -44,7 +55,7 @@ VnodeMemfs::~VnodeMemfs() {
     }
 }
 
-VnodeFile::VnodeFile() : vmo_(MX_HANDLE_INVALID), length_(0) {}
+VnodeFile::VnodeFile() : vmo_(MX_HANDLE_INVALID), length_(0), capacity_(0) {}
 VnodeFile::~VnodeFile() {
     if (vmo_ != MX_HANDLE_INVALID) {
         mx_handle_close(vmo_);
@@ -56,9 +67,15 @@ VnodeDir::VnodeDir() {
 }
 VnodeDir::~VnodeDir() {}
 
-VnodeVmo::VnodeVmo(mx_handle_t vmo, mx_off_t offset, mx_off_t length) :
-    vmo_(vmo), offset_(offset), length_(length) {}
-VnodeVmo::~VnodeVmo() {}
+VnodeVmo::VnodeVmo(mx_handle_t vmo, mx_off_t offset, mx_off_t length,
+                   mx_off_t compressed_len) :
+    vmo_(vmo), offset_(offset), length_(length),
+    compressed_len_(compressed_len), owns_vmo_(false) {}
+VnodeVmo::~VnodeVmo() {
+    if (owns_vmo_) {
+        mx_handle_close(vmo_);
+    }
+}
 
 VnodeDevice::VnodeDevice() {
     flags_ |= V_FLAG_DEVICE;
@@ -82,10 +99,17 @@ mx_status_t VnodeMemfs::Open(uint32_t flags) {
 }
 
 ssize_t VnodeFile::Read(void* data, size_t len, size_t off) {
-    if ((off >= length_) || (vmo_ == MX_HANDLE_INVALID)) {
+    if (off >= length_) {
         return 0;
     }
+    if (len > length_ - off) {
+        len = length_ - off;
+    }
 
+    if (vmo_ == MX_HANDLE_INVALID) {
+        memcpy(data, &inline_[off], len);
+        return len;
+    }
     size_t actual;
     mx_status_t status;
     if ((status = mx_vmo_read(vmo_, data, off, len, &actual)) != NO_ERROR) {
@@ -97,6 +121,10 @@ ssize_t VnodeFile::Read(void* data, size_t len, size_t off) {
 ssize_t VnodeVmo::Read(void* data, size_t len, size_t off) {
     if (off > length_)
         return 0;
+    mx_status_t status = Decompress();
+    if (status != NO_ERROR) {
+        return status;
+    }
     size_t rlen = length_ - off;
     if (len > rlen)
         len = rlen;
@@ -107,37 +135,71 @@ ssize_t VnodeVmo::Read(void* data, size_t len, size_t off) {
     return len;
 }
 
-ssize_t VnodeFile::Write(const void* data, size_t len, size_t off) {
-    mx_status_t status;
-    size_t newlen = off + len;
-    newlen = newlen > kMinfsMaxFileSize ? kMinfsMaxFileSize : newlen;
+mx_status_t VnodeFile::Reserve(size_t len) {
+    if (len <= capacity_) {
+        return NO_ERROR;
+    }
+    size_t capacity = mxtl::max(mxtl::min(capacity_ * 2, MaxFileSize()), len);
 
-    // TODO(smklein): Round up to PAGE_SIZE increments to reduce overhead on a series of small
-    // writes.
-    if (vmo_ == MX_HANDLE_INVALID) {
-        // First access to the file? Allocate it.
-        if ((status = mx_vmo_create(newlen, 0, &vmo_)) != NO_ERROR) {
+    mx_status_t status;
+    if ((vmo_ == MX_HANDLE_INVALID) && (capacity <= kMemfsInlineMax)) {
+        capacity = mxtl::max(capacity, kMemfsInlineMin);
+        AllocChecker ac;
+        mxtl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[capacity]);
+        if (!ac.check()) {
+            return ERR_NO_MEMORY;
+        }
+        if (capacity_ != 0) {
+            memcpy(data.get(), inline_.get(), capacity_);
+        }
+        memset(&data[capacity_], 0, capacity - capacity_);
+        inline_ = mxtl::move(data);
+    } else if (vmo_ == MX_HANDLE_INVALID) {
+        // Outgrown the inline buffer; move into a VMO
+        capacity = mxtl::roundup(capacity, static_cast<size_t>(PAGE_SIZE));
+        mx_handle_t vmo;
+        if ((status = mx_vmo_create(capacity, 0, &vmo)) != NO_ERROR) {
             return status;
         }
-    } else if (newlen > length_) {
-        // Accessing beyond the end of the file? Extend it.
-        if ((status = mx_vmo_set_size(vmo_, newlen)) != NO_ERROR) {
+        size_t actual;
+        if ((length_ != 0) &&
+            ((status = mx_vmo_write(vmo, inline_.get(), 0, length_, &actual)) != NO_ERROR)) {
+            mx_handle_close(vmo);
+            return status;
+        }
+        vmo_ = vmo;
+        inline_.reset();
+    } else {
+        capacity = mxtl::roundup(capacity, static_cast<size_t>(PAGE_SIZE));
+        if ((status = mx_vmo_set_size(vmo_, capacity)) != NO_ERROR) {
             return status;
         }
     }
+    capacity_ = capacity;
+    return NO_ERROR;
+}
 
-    size_t actual;
-    if ((status = mx_vmo_write(vmo_, data, off, len, &actual)) != NO_ERROR) {
+ssize_t VnodeFile::Write(const void* data, size_t len, size_t off) {
+    if ((off > MaxFileSize()) || (len > MaxFileSize() - off)) {
+        return ERR_FILE_BIG;
+    }
+    size_t newlen = off + len;
+
+    mx_status_t status;
+    if ((status = Reserve(newlen)) != NO_ERROR) {
+        return status;
+    }
+
+    size_t actual = len;
+    if (vmo_ == MX_HANDLE_INVALID) {
+        memcpy(&inline_[off], data, len);
+    } else if ((status = mx_vmo_write(vmo_, data, off, len, &actual)) != NO_ERROR) {
         return status;
     }
 
     if (newlen > length_) {
         length_ = newlen;
     }
-    if (actual == 0 && off >= kMinfsMaxFileSize) {
-        // short write because we're beyond the end of the permissible length
-        return ERR_FILE_BIG;
-    }
     modify_time_ = mx_time_get(MX_CLOCK_UTC);
     return actual;
 }
@@ -220,8 +282,8 @@ mx_status_t VnodeMemfs::Setattr(vnattr_t* attr) {
     return NO_ERROR;
 }
 
-mx_status_t VnodeDir::Readdir(void* cookie, void* data, size_t len) {
-    fs::DirentFiller df(data, len);
+mx_status_t VnodeDir::ReaddirInternal(void* cookie, void* data, size_t len, bool attrs) {
+    fs::DirentFiller df(data, len, attrs);
     if (!IsDirectory()) {
         // This WAS a directory, but it has been deleted.
         Dnode::ReaddirStart(&df, cookie);
@@ -231,6 +293,15 @@ mx_status_t VnodeDir::Readdir(void* cookie, void* data, size_t len) {
     return df.BytesFilled();
 }
 
+mx_status_t VnodeDir::Readdir(void* cookie, void* data, size_t len) {
+    return ReaddirInternal(cookie, data, len, false);
+}
+
+mx_status_t VnodeDir::ReaddirPlus(void* cookie, void* data, size_t len) {
+    // Every child's vnode hangs off its dnode, so the attributes come free.
+    return ReaddirInternal(cookie, data, len, true);
+}
+
 // postcondition: reference taken on vn returned through "out"
 mx_status_t VnodeDir::Create(mxtl::RefPtr<fs::Vnode>* out, const char* name, size_t len, uint32_t mode) {
     mx_status_t status;
@@ -282,35 +353,36 @@ mx_status_t VnodeDir::Unlink(const char* name, size_t len, bool must_be_dir) {
 }
 
 mx_status_t VnodeFile::Truncate(size_t len) {
-    mx_status_t status;
-    len = len > kMinfsMaxFileSize ? kMinfsMaxFileSize : len;
+    if (len > MaxFileSize()) {
+        return ERR_FILE_BIG;
+    }
 
-    if (vmo_ == MX_HANDLE_INVALID) {
-        // First access to the file? Allocate it.
-        if ((status = mx_vmo_create(len, 0, &vmo_)) != NO_ERROR) {
+    mx_status_t status;
+    if (len >= length_) {
+        // Everything up to the capacity is zero already
+        if ((status = Reserve(len)) != NO_ERROR) {
             return status;
         }
-    } else if ((len < length_) && (len % PAGE_SIZE != 0)) {
-        // TODO(smklein): Remove this case when the VMO system causes 'shrinking to a partial page'
-        // to fill the end of that page with zeroes.
-        //
-        // Currently, if the file is truncated to a 'partial page', an later re-expanded, then the
-        // partial page is *not necessarily* filled with zeroes. As a consequence, we manually must
-        // fill the portion between "len" and the next highest page (or vn->length, whichever
-        // is smaller) with zeroes.
-        char buf[PAGE_SIZE];
-        size_t ppage_size = PAGE_SIZE - (len % PAGE_SIZE);
-        ppage_size = len + ppage_size < length_ ? ppage_size : length_ - len;
-        memset(buf, 0, ppage_size);
-        size_t actual;
-        status = mx_vmo_write(vmo_, buf, len, ppage_size, &actual);
-        if ((status != NO_ERROR) || (actual != ppage_size)) {
-            return status != NO_ERROR ? ERR_IO : status;
-        } else if ((status = mx_vmo_set_size(vmo_, len)) != NO_ERROR) {
+    } else if (vmo_ == MX_HANDLE_INVALID) {
+        memset(&inline_[len], 0, length_ - len);
+    } else {
+        // Give back the pages past the new end of the file. The VMO doesn't
+        // zero the tail of a partial page when it shrinks, so do that first.
+        size_t capacity = mxtl::roundup(len, static_cast<size_t>(PAGE_SIZE));
+        size_t ppage_size = mxtl::min(capacity, static_cast<size_t>(length_)) - len;
+        if (ppage_size != 0) {
+            char buf[PAGE_SIZE];
+            memset(buf, 0, ppage_size);
+            size_t actual;
+            status = mx_vmo_write(vmo_, buf, len, ppage_size, &actual);
+            if ((status != NO_ERROR) || (actual != ppage_size)) {
+                return status != NO_ERROR ? status : ERR_IO;
+            }
+        }
+        if ((status = mx_vmo_set_size(vmo_, capacity)) != NO_ERROR) {
             return status;
         }
-    } else if ((status = mx_vmo_set_size(vmo_, len)) != NO_ERROR) {
-        return status;
+        capacity_ = capacity;
     }
 
     length_ = len;
@@ -547,7 +619,7 @@ mx_status_t VnodeDir::CreateDeviceAtLocked(mxtl::RefPtr<VnodeDir>* out, const ch
         vn->AttachRemote(h);
     }
 
-    NotifyAdd(name, len);
+    Notify(name, len, VFS_WATCH_EVT_ADDED);
     *out = mxtl::move(vn);
     return NO_ERROR;
 }
@@ -586,19 +658,20 @@ got_name:
         return ERR_NO_MEMORY;
     }
     Dnode::AddChild(parent->dnode_, mxtl::move(dn));
-    parent->NotifyAdd(name, len);
+    parent->Notify(name, len, VFS_WATCH_EVT_ADDED);
     return NO_ERROR;
 }
 
 mx_status_t VnodeDir::CreateFromVmo(const char* name, size_t namelen,
-                                    mx_handle_t vmo, mx_off_t off, mx_off_t len) {
+                                    mx_handle_t vmo, mx_off_t off, mx_off_t len,
+                                    mx_off_t compressed_len) {
     mx_status_t status;
     if ((status = CanCreate(name, namelen)) != NO_ERROR) {
         return status;
     }
 
     AllocChecker ac;
-    mxtl::RefPtr<VnodeMemfs> vn = mxtl::AdoptRef(new (&ac) VnodeVmo(vmo, off, len));
+    mxtl::RefPtr<VnodeMemfs> vn = mxtl::AdoptRef(new (&ac) VnodeVmo(vmo, off, len, compressed_len));
     if (!ac.check()) {
         return ERR_NO_MEMORY;
     }
@@ -15,6 +15,7 @@
 #include <inet6/inet6.h>
 #include <inet6/netifc.h>
 
+#include <magenta/process.h>
 #include <magenta/processargs.h>
 #include <magenta/syscalls.h>
 #include <launchpad/launchpad.h>
@@ -52,6 +53,43 @@ static int netfile_mkdir(const char* filename) {
     }
 }
 
+// The write buffer lives for as long as netsvc does; it's only set up
+// the first time a file is opened for writing.
+static int netfile_wbuf_init(void) {
+    if (netfile.wbuf != NULL) {
+        return 0;
+    }
+    mx_handle_t vmo;
+    if (mx_vmo_create(NETFILE_WBUF_SIZE, 0, &vmo) < 0) {
+        return -1;
+    }
+    mx_status_t status = mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, NETFILE_WBUF_SIZE,
+                                     MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE,
+                                     (uintptr_t*)&netfile.wbuf);
+    mx_handle_close(vmo);
+    if (status < 0) {
+        netfile.wbuf = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+// Hand whatever has been gathered in the write buffer to the file.
+// Returns 0 or a negative errno.
+static int netfile_flush(void) {
+    size_t off = 0;
+    while (off < netfile.wlen) {
+        ssize_t n = write(netfile.fd, netfile.wbuf + off, netfile.wlen - off);
+        if (n <= 0) {
+            netfile.wlen = 0;
+            return (n < 0 && errno) ? -errno : -EIO;
+        }
+        off += n;
+    }
+    netfile.wlen = 0;
+    return 0;
+}
+
 void netfile_open(const char *filename, uint32_t cookie, uint32_t arg,
                   const ip6_addr_t* saddr, uint16_t sport, uint16_t dport) {
     nbmsg m;
@@ -65,6 +103,7 @@ void netfile_open(const char *filename, uint32_t cookie, uint32_t arg,
         close(netfile.fd);
         netfile.fd = -1;
     }
+    netfile.wlen = 0;
     size_t len = strlen(filename);
     strlcpy(netfile.filename, filename, sizeof(netfile.filename));
     netfile.blocknum = 0;
@@ -90,6 +129,10 @@ again: // label here to catch filename=/path/to/new/directory/
             errno = ENAMETOOLONG;
             goto err;
         }
+        if (netfile_wbuf_init() < 0) {
+            errno = ENOMEM;
+            goto err;
+        }
         strcat(netfile.filename, TMP_SUFFIX);
         netfile.needs_rename = true;
         netfile.fd = open(netfile.filename, O_WRONLY|O_CREAT|O_TRUNC);
@@ -191,18 +234,22 @@ void netfile_write(const char* data, size_t len, uint32_t cookie, uint32_t arg,
         // ignore bogus write requests -- host will timeout if they're confused
         return;
     } else {
-        ssize_t n = write(netfile.fd, data, len);
-        if (n != (ssize_t)len) {
-            printf("netsvc: error writing %s: %d\n", netfile.filename, errno);
-            m.arg = -errno;
-            if (m.arg == 0) {
-                m.arg = -EIO;
+        // Copy the block out of the packet into the write buffer, which is
+        // written out once it fills up. This way the host can keep a window
+        // of blocks in flight without waiting on the filesystem for each.
+        if (netfile.wlen + len > NETFILE_WBUF_SIZE) {
+            int r = netfile_flush();
+            if (r < 0) {
+                printf("netsvc: error writing %s: %d\n", netfile.filename, -r);
+                m.arg = r;
+                close(netfile.fd);
+                netfile.fd = -1;
+                udp6_send(&m, sizeof(m), saddr, sport, dport);
+                return;
             }
-            close(netfile.fd);
-            netfile.fd = -1;
-            udp6_send(&m, sizeof(m), saddr, sport, dport);
-            return;
         }
+        memcpy(netfile.wbuf + netfile.wlen, data, len);
+        netfile.wlen += len;
         netfile.blocknum++;
         netfile.cookie = cookie;
     }
@@ -221,6 +268,13 @@ void netfile_close(uint32_t cookie,
     if (netfile.fd < 0) {
         printf("netsvc: close, but no open file\n");
     } else {
+        int r = netfile_flush();
+        if (r < 0) {
+            printf("netsvc: error writing %s: %d\n", netfile.filename, -r);
+            m.arg = r;
+            // don't replace the destination with a partial file
+            netfile.needs_rename = false;
+        }
         if (netfile.needs_rename) {
             char src[PATH_MAX];
             strlcpy(src, netfile.filename, sizeof(netfile.filename));
@@ -229,7 +283,7 @@ void netfile_close(uint32_t cookie,
                 printf("netsvc: failed to rename temporary file: %s\n", strerror(errno));
             }
         }
-        if (close(netfile.fd)) {
+        if (close(netfile.fd) && m.arg == 0) {
             m.arg = -errno;
             if (m.arg == 0) {
                 m.arg = -EIO;
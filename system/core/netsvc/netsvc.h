@@ -21,8 +21,14 @@ typedef struct netfile_state_t {
     uint32_t cookie;
     uint8_t  data[1024];
     size_t   datasize;
+    // Blocks written by the host are gathered straight from the packet into
+    // this buffer (a mapped vmo), and go to the file in big chunks.
+    uint8_t* wbuf;
+    size_t   wlen;
 } netfile_state;
 
+#define NETFILE_WBUF_SIZE (1024 * 1024)
+
 extern netfile_state netfile;
 
 typedef struct netfilemsg_t {
@@ -7,6 +7,7 @@
 
 #pragma GCC visibility push(hidden)
 
+#include <bootdata/decompress.h>
 #include <magenta/boot/bootdata.h>
 #include <magenta/syscalls.h>
 #include <string.h>
@@ -20,8 +21,12 @@ void bootfs_mount(mx_handle_t vmar, mx_handle_t log, mx_handle_t vmo, struct boo
     uintptr_t addr = 0;
     status = mx_vmar_map(vmar, 0, vmo, 0, size, MX_VM_FLAG_PERM_READ, &addr);
     check(log, status, "mx_vmar_map failed on bootfs vmo\n");
+    fs->vmar = vmar;
     fs->contents = (const void*)addr;
     fs->len = size;
+    fs->file_compressed = size >= sizeof(bootdata_t) &&
+        (((const bootdata_t*)fs->contents)->flags &
+         BOOTDATA_BOOTFS_FLAG_FILE_COMPRESSED);
     status = mx_handle_duplicate(
         vmo,
         MX_RIGHT_READ | MX_RIGHT_EXECUTE | MX_RIGHT_MAP |
@@ -106,14 +111,24 @@ mx_handle_t bootfs_open(mx_handle_t log, const char* purpose,
     if (fs->len - file.offset < file.size)
         fail(log, ERR_INVALID_ARGS, "bogus size in bootfs header!\n");
 
-    // Clone a private copy of the file's subset of the bootfs VMO.
-    // TODO(mcgrathr): Create a plain read-only clone when the feature
-    // is implemented in the VM.
     mx_handle_t vmo;
-    mx_status_t status = mx_vmo_clone(fs->vmo, MX_VMO_CLONE_COPY_ON_WRITE,
-                                      file.offset, file.size, &vmo);
-    if (status != NO_ERROR)
-        fail(log, status, "mx_vmo_clone failed\n");
+    mx_status_t status;
+    if (fs->file_compressed) {
+        // Only the files actually used pay for decompression.
+        const char* errmsg;
+        status = decompress_bootfs_file(fs->vmar, fs->vmo,
+                                        file.offset, file.size,
+                                        &vmo, &errmsg);
+        check(log, status, errmsg);
+    } else {
+        // Clone a private copy of the file's subset of the bootfs VMO.
+        // TODO(mcgrathr): Create a plain read-only clone when the feature
+        // is implemented in the VM.
+        status = mx_vmo_clone(fs->vmo, MX_VMO_CLONE_COPY_ON_WRITE,
+                              file.offset, file.size, &vmo);
+        if (status != NO_ERROR)
+            fail(log, status, "mx_vmo_clone failed\n");
+    }
     // Drop unnecessary MX_RIGHT_WRITE rights.
     // TODO(mcgrathr): Should be superfluous with read-only mx_vmo_clone.
     status = mx_handle_replace(
@@ -7,13 +7,17 @@
 #pragma GCC visibility push(hidden)
 
 #include <magenta/types.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
 struct bootfs {
+    mx_handle_t vmar;
     mx_handle_t vmo;
     const uint8_t* contents;
     size_t len;
+    // Each file is compressed separately, see bootfs_open.
+    bool file_compressed;
 };
 
 void bootfs_mount(mx_handle_t vmar, mx_handle_t log, mx_handle_t vmo, struct bootfs *fs);
@@ -11,6 +11,7 @@
 
 #pragma GCC visibility push(hidden)
 
+#include <magenta/ktrace.h>
 #include <magenta/stack.h>
 #include <magenta/syscalls.h>
 #include <magenta/syscalls/log.h>
@@ -51,6 +52,16 @@ static void load_child_process(mx_handle_t log,
     *vdso_base = elf_load_vmo(log, vmar, vdso_vmo);
 }
 
+// Marks the start of one of our stages in the kernel's boot timeline.
+static void boot_stage(mx_handle_t root_resource, const char* name) {
+    // The kernel always reads a whole name's worth.
+    char buf[MX_MAX_NAME_LEN];
+    size_t len = MIN(strlen(name), sizeof(buf) - 1);
+    memcpy(buf, name, len);
+    memset(buf + len, 0, sizeof(buf) - len);
+    mx_ktrace_control(root_resource, KTRACE_ACTION_BOOT_STAGE, 0, buf);
+}
+
 // Reserve roughly the low half of the address space, so the initial
 // process can use sanitizers that need to allocate shadow memory there.
 // The reservation VMAR is kept around just long enough to make sure all
@@ -202,10 +213,12 @@ static noreturn void bootstrap(mx_handle_t log, mx_handle_t bootstrap_pipe) {
                                  &root_resource_handle);
     if (status < 0)
         fail(log, status, "mx_handle_duplicate failed\n");
+    boot_stage(root_resource_handle, "userboot");
 
     // Locate the first bootfs bootdata section and decompress it.
     // We need it to load devmgr and libc from.
     // Later bootfs sections will be processed by devmgr.
+    boot_stage(root_resource_handle, "userboot:bootfs");
     mx_handle_t bootfs_vmo = bootdata_get_bootfs(log, vmar_self, bootdata_vmo);
 
     // Pass the decompressed bootfs VMO on.
@@ -223,6 +236,7 @@ static noreturn void bootstrap(mx_handle_t log, mx_handle_t bootstrap_pipe) {
     status = mx_channel_create(0, &to_child, &child_start_handle);
     check(log, status, "mx_channel_create failed\n");
 
+    boot_stage(root_resource_handle, "userboot:load");
     const char* filename = o.value[OPTION_FILENAME];
     mx_handle_t proc;
     mx_handle_t vmar;
@@ -303,6 +317,7 @@ static noreturn void bootstrap(mx_handle_t log, mx_handle_t bootstrap_pipe) {
     check(log, status, "mx_handle_close failed on channel handle\n");
 
     // Start the process going.
+    boot_stage(root_resource_handle, "userboot:start");
     status = mx_process_start(proc, thread, entry, sp,
                               child_start_handle, vdso_base);
     check(log, status, "mx_process_start failed\n");
@@ -26,6 +26,8 @@
 
 #include <magenta/boot/netboot.h>
 
+#include <lz4frame.h>
+
 #define DEFAULT_US_BETWEEN_PACKETS 20
 
 static uint32_t cookie = 1;
@@ -35,6 +37,7 @@ static const char spinner[] = {'|', '/', '-', '\\'};
 static const int MAX_READ_RETRIES = 10;
 static const int MAX_SEND_RETRIES = 10000;
 static int64_t us_between_packets = DEFAULT_US_BETWEEN_PACKETS;
+static bool compress = false;
 
 static int io_rcv(int s, nbmsg* msg, nbmsg* ack) {
     for (int i = 0; i < MAX_READ_RETRIES; i++) {
@@ -192,6 +195,7 @@ static int io(int s, nbmsg* msg, size_t len, nbmsg* ack, bool wait_reply) {
 
 typedef struct {
     FILE* fp;
+    const char* base;
     const char* data;
     size_t datalen;
 } xferdata;
@@ -214,6 +218,70 @@ static ssize_t xread(xferdata* xd, void* data, size_t len) {
     }
 }
 
+static int xseek(xferdata* xd, size_t pos) {
+    if (xd->fp == NULL) {
+        size_t end = (xd->data - xd->base) + xd->datalen;
+        if (pos > end) {
+            return -1;
+        }
+        xd->data = xd->base + pos;
+        xd->datalen = end - pos;
+        return 0;
+    } else {
+        return fseek(xd->fp, pos, SEEK_SET);
+    }
+}
+
+// The bootloader decompresses each block as soon as it has arrived, so the
+// frame is restricted the same way bootfs images are: independent 64kB
+// blocks, no block checksums, and the content size in the header.
+static LZ4F_preferences_t lz4_prefs = {
+    .frameInfo = {
+        .blockSizeID = LZ4F_max64KB,
+        .blockMode = LZ4F_blockIndependent,
+    },
+    .compressionLevel = 4,
+};
+
+// Replaces the file being sent with an LZ4 frame of its contents, held in
+// memory.  On return xd->data holds the frame.
+static int xcompress(xferdata* xd, const char* fn, size_t sz) {
+    char* raw = malloc(sz);
+    if (raw == NULL) {
+        fprintf(stderr, "%s: error: Out of memory reading %s\n", appname, fn);
+        return -1;
+    }
+    if (fread(raw, 1, sz, xd->fp) != sz) {
+        fprintf(stderr, "%s: error: Reading '%s'\n", appname, fn);
+        free(raw);
+        return -1;
+    }
+    LZ4F_preferences_t prefs = lz4_prefs;
+    prefs.frameInfo.contentSize = sz;
+    size_t max = LZ4F_compressFrameBound(sz, &prefs);
+    char* frame = malloc(max);
+    if (frame == NULL) {
+        fprintf(stderr, "%s: error: Out of memory compressing %s\n", appname, fn);
+        free(raw);
+        return -1;
+    }
+    size_t r = LZ4F_compressFrame(frame, max, raw, sz, &prefs);
+    free(raw);
+    if (LZ4F_isError(r)) {
+        fprintf(stderr, "%s: error: Compressing '%s': %s\n", appname, fn,
+                LZ4F_getErrorName(r));
+        free(frame);
+        return -1;
+    }
+    fprintf(stderr, "%s: compressed '%s' from %zu to %zu bytes\n", appname, fn, sz, r);
+    fclose(xd->fp);
+    xd->fp = NULL;
+    xd->base = frame;
+    xd->data = frame;
+    xd->datalen = r;
+    return 0;
+}
+
 // UDP6_MAX_PAYLOAD (ETH_MTU - ETH_HDR_LEN - IP6_HDR_LEN - UDP_HDR_LEN)
 //      1452           1514   -     14      -     40      -    8
 // nbfile is PAYLOAD_SIZE + 2 * sizeof(size_t)
@@ -222,8 +290,8 @@ static ssize_t xread(xferdata* xd, void* data, size_t len) {
 // 1280 is friendlier
 #define PAYLOAD_SIZE 1280
 
-static int xfer(struct sockaddr_in6* addr, const char* fn, const char* name, bool boot) {
-    xferdata xd;
+static int xfer(struct sockaddr_in6* addr, const char* fn, const char* name, bool boot, bool lz4) {
+    xferdata xd = {};
     char msgbuf[2048];
     char ackbuf[2048];
     char tmp[INET6_ADDRSTRLEN];
@@ -241,6 +309,7 @@ static int xfer(struct sockaddr_in6* addr, const char* fn, const char* name, boo
 
     if (!strcmp(fn, "(cmdline)")) {
         xd.fp = NULL;
+        xd.base = name;
         xd.data = name;
         xd.datalen = strlen(name) + 1;
         name = "cmdline";
@@ -262,6 +331,21 @@ static int xfer(struct sockaddr_in6* addr, const char* fn, const char* name, boo
         }
     }
 
+    // The bootloader is told the uncompressed size, so that it can find
+    // room for it; offsets in the transfer count compressed bytes.
+    long raw_sz = sz;
+    char* frame = NULL;
+    if (lz4 && xd.fp && sz > 0) {
+        if (xcompress(&xd, fn, sz)) {
+            fclose(xd.fp);
+            return -1;
+        }
+        frame = (char*)xd.base;
+        sz = xd.datalen;
+    } else {
+        lz4 = false;
+    }
+
     if ((s = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP)) < 0) {
         fprintf(stderr, "%s: error: Cannot create socket %d\n", appname, errno);
         goto done;
@@ -278,8 +362,8 @@ static int xfer(struct sockaddr_in6* addr, const char* fn, const char* name, boo
         goto done;
     }
 
-    msg->cmd = NB_SEND_FILE;
-    msg->arg = sz;
+    msg->cmd = lz4 ? NB_SEND_FILE_LZ4 : NB_SEND_FILE;
+    msg->arg = raw_sz;
     strcpy((void*)msg->data, name);
     if (io(s, msg, sizeof(nbmsg) + strlen(name) + 1, ack, true)) {
         fprintf(stderr, "%s: error: Failed to start transfer\n", appname);
@@ -365,7 +449,7 @@ static int xfer(struct sockaddr_in6* addr, const char* fn, const char* name, boo
         if (ack->cookie > 0 && ack->cmd == NB_ACK && ack->arg != current_pos) {
             fprintf(stderr, "\n%s: need to rewind to %d from %zu\n", appname, ack->arg, current_pos);
             current_pos = ack->arg;
-            if (fseek(xd.fp, current_pos, SEEK_SET)) {
+            if (xseek(&xd, current_pos)) {
                 fprintf(stderr, "\n%s: error: Failed to rewind '%s' to %zu\n", appname, fn, current_pos);
                 goto done;
             }
@@ -406,6 +490,7 @@ done:
     if (xd.fp != NULL) {
         fclose(xd.fp);
     }
+    free(frame);
     return status;
 }
 
@@ -418,7 +503,8 @@ void usage(void) {
             "  -a      only boot device with this IPv6 address\n"
             "  -i <NN> number of microseconds between packets\n"
             "          set between 50-250 to deal with poor bootloader network stacks (default=%d)\n"
-            "  -n      only boot device with this nodename\n",
+            "  -n      only boot device with this nodename\n"
+            "  -z      compress the kernel and ramdisk with lz4 while sending\n",
             appname, DEFAULT_US_BETWEEN_PACKETS);
     exit(1);
 }
@@ -495,6 +581,8 @@ int main(int argc, char** argv) {
             nodename = argv[2];
             argc--;
             argv++;
+        } else if (!strcmp(argv[1], "-z")) {
+            compress = true;
         } else if (!strcmp(argv[1], "--")) {
             while (argc > 2) {
                 size_t len = strlen(argv[2]);
@@ -592,7 +680,9 @@ int main(int argc, char** argv) {
             continue;
         if (msg->cmd != NB_ADVERTISE)
             continue;
-        if (msg->arg != NB_VERSION_CURRENT) {
+        // Bootloaders from before compressed transfers work as long as
+        // everything is sent uncompressed.
+        if (msg->arg != NB_VERSION_CURRENT && msg->arg != NB_VERSION_1_1) {
             fprintf(stderr, "%s: Incompatible version 0x%08X of bootloader detected from [%s]%d, please upgrade your bootloader\n", appname, msg->arg,
                     inet_ntop(AF_INET6, &ra.sin6_addr, tmp, sizeof(tmp)),
                     ntohs(ra.sin6_port));
@@ -639,21 +729,27 @@ int main(int argc, char** argv) {
                     appname, appname, adv_version, BOOTLOADER_VERSION, appname);
         }
 
+        bool lz4 = compress && (msg->arg >= NB_VERSION_1_2);
+        if (compress && !lz4) {
+            fprintf(stderr, "%s: bootloader cannot take compressed files, sending them as is\n",
+                    appname);
+        }
+
         if (cmdline[0]) {
-            status = xfer(&ra, "(cmdline)", cmdline, false);
+            status = xfer(&ra, "(cmdline)", cmdline, false, false);
         } else {
             status = 0;
         }
         if (status == 0) {
             struct stat s;
             if (ramdisk_fn) {
-                status = xfer(&ra, ramdisk_fn, "ramdisk.bin", false);
+                status = xfer(&ra, ramdisk_fn, "ramdisk.bin", false, lz4);
             } else if (auto_ramdisk_fn && (stat(auto_ramdisk_fn, &s) == 0)) {
-                status = xfer(&ra, auto_ramdisk_fn, "ramdisk.bin", false);
+                status = xfer(&ra, auto_ramdisk_fn, "ramdisk.bin", false, lz4);
             }
         }
         if (status == 0) {
-            xfer(&ra, kernel_fn, "kernel.bin", true);
+            xfer(&ra, kernel_fn, "kernel.bin", true, lz4);
         }
         if (once) {
             break;
@@ -4,10 +4,19 @@
 
 LOCAL_DIR := $(GET_LOCAL_DIR)
 
+LZ4_DIR := third_party/ulib/lz4
+
 MODULE := $(LOCAL_DIR)
 
 MODULE_TYPE := hostapp
 
-MODULE_SRCS += $(LOCAL_DIR)/bootserver.c
+MODULE_SRCS += \
+    $(LZ4_DIR)/lz4.c \
+    $(LZ4_DIR)/lz4frame.c \
+    $(LZ4_DIR)/lz4hc.c \
+    $(LZ4_DIR)/xxhash.c \
+    $(LOCAL_DIR)/bootserver.c \
+
+MODULE_CFLAGS := -I$(LZ4_DIR)/include/lz4
 
 include make/module.mk
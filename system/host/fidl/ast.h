@@ -27,51 +27,87 @@ struct CompoundIdentifier {
 };
 
 struct Literal {
+    enum struct Kind {
+        String,
+        Numeric,
+        True,
+        False,
+        Default,
+    };
+
+    explicit Literal(Kind kind)
+        : kind(kind) {}
+    virtual ~Literal() {}
+
+    const Kind kind;
 };
 
 struct StringLiteral : public Literal {
     StringLiteral(Token literal)
-        : literal(literal) {}
+        : Literal(Kind::String),
+          literal(literal) {}
 
     Token literal;
 };
 
 struct NumericLiteral : public Literal {
     NumericLiteral(Token literal)
-        : literal(literal) {}
+        : Literal(Kind::Numeric),
+          literal(literal) {}
 
     Token literal;
 };
 
 struct TrueLiteral : public Literal {
+    TrueLiteral()
+        : Literal(Kind::True) {}
 };
 
 struct FalseLiteral : public Literal {
+    FalseLiteral()
+        : Literal(Kind::False) {}
 };
 
 struct DefaultLiteral : public Literal {
+    DefaultLiteral()
+        : Literal(Kind::Default) {}
 };
 
 struct Type {
+    enum struct Kind {
+        Handle,
+        Request,
+        Identifier,
+        Primitive,
+    };
+
+    explicit Type(Kind kind)
+        : kind(kind) {}
+    virtual ~Type() {}
+
+    const Kind kind;
 };
 
 struct HandleType : public Type {
     HandleType(std::unique_ptr<Identifier> maybe_subtype)
-        : maybe_subtype(std::move(maybe_subtype)) {}
+        : Type(Kind::Handle),
+          maybe_subtype(std::move(maybe_subtype)) {}
 
     std::unique_ptr<Identifier> maybe_subtype;
 };
 
 struct RequestType : public Type {
     RequestType(std::unique_ptr<CompoundIdentifier> subtype)
-        : subtype(std::move(subtype)) {}
+        : Type(Kind::Request),
+          subtype(std::move(subtype)) {}
 
     std::unique_ptr<CompoundIdentifier> subtype;
 };
 
 struct IdentifierType : public Type {
     IdentifierType(std::unique_ptr<CompoundIdentifier> identifier)
-        : identifier(std::move(identifier)) {}
+        : Type(Kind::Identifier),
+          identifier(std::move(identifier)) {}
 
     std::unique_ptr<CompoundIdentifier> identifier;
 };
@@ -93,24 +129,37 @@ struct PrimitiveType : public Type {
     };
 
     PrimitiveType(TypeKind type_kind)
-        : type_kind(type_kind) {}
+        : Type(Kind::Primitive),
+          type_kind(type_kind) {}
 
     TypeKind type_kind;
 };
 
 struct Constant {
+    enum struct Kind {
+        Identifier,
+        Literal,
+    };
+
+    explicit Constant(Kind kind)
+        : kind(kind) {}
+    virtual ~Constant() {}
+
+    const Kind kind;
 };
 
 struct IdentifierConstant : Constant {
     IdentifierConstant(std::unique_ptr<CompoundIdentifier> identifier)
-        : identifier(std::move(identifier)) {}
+        : Constant(Kind::Identifier),
+          identifier(std::move(identifier)) {}
 
     std::unique_ptr<CompoundIdentifier> identifier;
 };
 
 struct LiteralConstant : Constant {
     LiteralConstant(std::unique_ptr<Literal> literal)
-        : literal(std::move(literal)) {}
+        : Constant(Kind::Literal),
+          literal(std::move(literal)) {}
 
     std::unique_ptr<Literal> literal;
 };
@@ -137,13 +186,27 @@ struct UsingList {
 };
 
 struct Declaration {
+    enum struct Kind {
+        Const,
+        Enum,
+        Interface,
+        Struct,
+        Union,
+    };
+
+    explicit Declaration(Kind kind)
+        : kind(kind) {}
+    virtual ~Declaration() {}
+
+    const Kind kind;
 };
 
 struct ConstDeclaration : public Declaration {
     ConstDeclaration(std::unique_ptr<Type> type,
                      std::unique_ptr<Identifier> identifier,
                      std::unique_ptr<Constant> constant)
-        : type(std::move(type)),
+        : Declaration(Kind::Const),
+          type(std::move(type)),
           identifier(std::move(identifier)),
           constant(std::move(constant)) {}
 
@@ -153,18 +216,30 @@ struct ConstDeclaration : public Declaration {
 };
 
 struct EnumMemberValue {
+    enum struct Kind {
+        Identifier,
+        Numeric,
+    };
+
+    explicit EnumMemberValue(Kind kind)
+        : kind(kind) {}
+    virtual ~EnumMemberValue() {}
+
+    const Kind kind;
 };
 
 struct EnumMemberValueIdentifier : public EnumMemberValue {
     EnumMemberValueIdentifier(std::unique_ptr<CompoundIdentifier> identifier)
-        : identifier(std::move(identifier)) {}
+        : EnumMemberValue(Kind::Identifier),
+          identifier(std::move(identifier)) {}
 
     std::unique_ptr<CompoundIdentifier> identifier;
 };
 
 struct EnumMemberValueNumeric : public EnumMemberValue {
     EnumMemberValueNumeric(std::unique_ptr<NumericLiteral> literal)
-        : literal(std::move(literal)) {}
+        : EnumMemberValue(Kind::Numeric),
+          literal(std::move(literal)) {}
 
     std::unique_ptr<NumericLiteral> literal;
 };
@@ -190,7 +265,8 @@ struct EnumDeclaration : public Declaration {
     EnumDeclaration(std::unique_ptr<Identifier> identifier,
                     std::unique_ptr<PrimitiveType> maybe_subtype,
                     std::unique_ptr<EnumBody> body)
-        : identifier(std::move(identifier)),
+        : Declaration(Kind::Enum),
+          identifier(std::move(identifier)),
           maybe_subtype(std::move(maybe_subtype)),
           body(std::move(body)) {}
 
@@ -200,18 +276,31 @@ struct EnumDeclaration : public Declaration {
 };
 
 struct InterfaceMember {
+    enum struct Kind {
+        Const,
+        Enum,
+        Method,
+    };
+
+    explicit InterfaceMember(Kind kind)
+        : kind(kind) {}
+    virtual ~InterfaceMember() {}
+
+    const Kind kind;
 };
 
 struct InterfaceMemberConst : public InterfaceMember {
     InterfaceMemberConst(std::unique_ptr<ConstDeclaration> const_declaration)
-        : const_declaration(std::move(const_declaration)) {}
+        : InterfaceMember(Kind::Const),
+          const_declaration(std::move(const_declaration)) {}
 
     std::unique_ptr<ConstDeclaration> const_declaration;
 };
 
 struct InterfaceMemberEnum : public InterfaceMember {
     InterfaceMemberEnum(std::unique_ptr<EnumDeclaration> enum_declaration)
-        : enum_declaration(std::move(enum_declaration)) {}
+        : InterfaceMember(Kind::Enum),
+          enum_declaration(std::move(enum_declaration)) {}
 
     std::unique_ptr<EnumDeclaration> enum_declaration;
 };
@@ -245,7 +334,8 @@ struct InterfaceMemberMethod : public InterfaceMember {
                           std::unique_ptr<Identifier> identifier,
                           std::unique_ptr<ParameterList> parameter_list,
                           std::unique_ptr<Response> maybe_response)
-        : ordinal(std::move(ordinal)),
+        : InterfaceMember(Kind::Method),
+          ordinal(std::move(ordinal)),
           identifier(std::move(identifier)),
           parameter_list(std::move(parameter_list)),
           maybe_response(std::move(maybe_response)) {}
@@ -266,7 +356,8 @@ struct InterfaceBody {
 struct InterfaceDeclaration : public Declaration {
     InterfaceDeclaration(std::unique_ptr<Identifier> identifier,
                          std::unique_ptr<InterfaceBody> body)
-        : identifier(std::move(identifier)),
+        : Declaration(Kind::Interface),
+          identifier(std::move(identifier)),
           body(std::move(body)) {}
 
     std::unique_ptr<Identifier> identifier;
@@ -274,18 +365,31 @@ struct InterfaceDeclaration : public Declaration {
 };
 
 struct StructMember {
+    enum struct Kind {
+        Const,
+        Enum,
+        Field,
+    };
+
+    explicit StructMember(Kind kind)
+        : kind(kind) {}
+    virtual ~StructMember() {}
+
+    const Kind kind;
 };
 
 struct StructMemberConst : public StructMember {
     StructMemberConst(std::unique_ptr<ConstDeclaration> const_declaration)
-        : const_declaration(std::move(const_declaration)) {}
+        : StructMember(Kind::Const),
+          const_declaration(std::move(const_declaration)) {}
 
     std::unique_ptr<ConstDeclaration> const_declaration;
 };
 
 struct StructMemberEnum : public StructMember {
     StructMemberEnum(std::unique_ptr<EnumDeclaration> enum_declaration)
-        : enum_declaration(std::move(enum_declaration)) {}
+        : StructMember(Kind::Enum),
+          enum_declaration(std::move(enum_declaration)) {}
 
     std::unique_ptr<EnumDeclaration> enum_declaration;
 };
@@ -301,7 +405,8 @@ struct StructMemberField : public StructMember {
     StructMemberField(std::unique_ptr<Type> type,
                       std::unique_ptr<Identifier> identifier,
                       std::unique_ptr<StructDefaultValue> maybe_default_value)
-        : type(std::move(type)),
+        : StructMember(Kind::Field),
+          type(std::move(type)),
           identifier(std::move(identifier)),
           maybe_default_value(std::move(maybe_default_value)) {}
 
@@ -320,7 +425,8 @@ struct StructBody {
 struct StructDeclaration : public Declaration {
     StructDeclaration(std::unique_ptr<Identifier> identifier,
                       std::unique_ptr<StructBody> body)
-        : identifier(std::move(identifier)),
+        : Declaration(Kind::Struct),
+          identifier(std::move(identifier)),
           body(std::move(body)) {}
 
     std::unique_ptr<Identifier> identifier;
@@ -347,7 +453,8 @@ struct UnionBody {
 struct UnionDeclaration : public Declaration {
     UnionDeclaration(std::unique_ptr<Identifier> identifier,
                      std::unique_ptr<UnionBody> body)
-        : identifier(std::move(identifier)),
+        : Declaration(Kind::Union),
+          identifier(std::move(identifier)),
           body(std::move(body)) {}
 
     std::unique_ptr<Identifier> identifier;
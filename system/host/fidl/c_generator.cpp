@@ -0,0 +1,735 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "c_generator.h"
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <set>
+
+namespace fidl {
+
+namespace {
+
+std::string ToString(StringView view) {
+    return std::string(view.data(), view.size());
+}
+
+std::string NameOf(const Identifier& identifier) {
+    return ToString(identifier.identifier.data());
+}
+
+std::string NameOf(const CompoundIdentifier& identifier) {
+    std::string name;
+    for (const auto& component : identifier.components) {
+        if (!name.empty())
+            name += '.';
+        name += NameOf(*component);
+    }
+    return name;
+}
+
+std::string Join(const std::string& scope, const std::string& name) {
+    return scope.empty() ? name : scope + "." + name;
+}
+
+std::string ToCName(std::string name) {
+    for (auto& c : name) {
+        if (c == '.')
+            c = '_';
+    }
+    return name;
+}
+
+uint32_t AlignTo(uint32_t offset, uint32_t alignment) {
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+bool ParseUint32(StringView text, uint32_t* out) {
+    std::string string = ToString(text);
+    char* end;
+    unsigned long long value = strtoull(string.c_str(), &end, 0);
+    if (*end != '\0' || string[0] == '-' || value > UINT32_MAX)
+        return false;
+    *out = static_cast<uint32_t>(value);
+    return true;
+}
+
+void Appendf(std::string* out, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+void Appendf(std::string* out, const char* format, ...) {
+    char buffer[1024];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    *out += buffer;
+}
+
+// fidl_message_header_t, which every message starts with.
+constexpr uint32_t kMessageHeaderSize = 16u;
+constexpr uint32_t kMessageHeaderAlignment = 4u;
+
+} // namespace
+
+std::string CGenerator::Decl::FullName() const {
+    return Join(scope, name);
+}
+
+std::string CGenerator::Decl::CName() const {
+    return ToCName(FullName());
+}
+
+bool CGenerator::Fail(const std::string& message) {
+    fprintf(stderr, "fidl: %s\n", message.c_str());
+    ok_ = false;
+    return false;
+}
+
+CGenerator::Decl* CGenerator::AddDecl(Decl::Kind kind, const std::string& scope,
+                                      const Identifier& identifier) {
+    decls_.emplace_back(new Decl(kind, scope, NameOf(identifier)));
+    Decl* decl = decls_.back().get();
+    if (!names_.insert(std::make_pair(decl->FullName(), decl)).second)
+        Fail(decl->FullName() + " is declared more than once");
+    return decl;
+}
+
+void CGenerator::AddFile(const File& file) {
+    std::string scope;
+    if (file.maybe_module)
+        scope = NameOf(*file.maybe_module->identifier);
+
+    for (const auto& declaration : file.declaration_list->declaration_list) {
+        switch (declaration->kind) {
+        case Declaration::Kind::Const:
+            AddConst(scope, static_cast<const ConstDeclaration&>(*declaration));
+            break;
+        case Declaration::Kind::Enum:
+            AddEnum(scope, static_cast<const EnumDeclaration&>(*declaration));
+            break;
+        case Declaration::Kind::Interface:
+            AddInterface(scope, static_cast<const InterfaceDeclaration&>(*declaration));
+            break;
+        case Declaration::Kind::Struct:
+            AddStruct(scope, static_cast<const StructDeclaration&>(*declaration));
+            break;
+        case Declaration::Kind::Union:
+            AddUnion(scope, static_cast<const UnionDeclaration&>(*declaration));
+            break;
+        }
+    }
+}
+
+void CGenerator::AddConst(const std::string& scope, const ConstDeclaration& const_decl) {
+    Decl* decl = AddDecl(Decl::Kind::Const, scope, *const_decl.identifier);
+    decl->const_decl = &const_decl;
+}
+
+void CGenerator::AddEnum(const std::string& scope, const EnumDeclaration& enum_decl) {
+    Decl* decl = AddDecl(Decl::Kind::Enum, scope, *enum_decl.identifier);
+    decl->enum_decl = &enum_decl;
+
+    Decl* previous = nullptr;
+    for (const auto& member : enum_decl.body->fields) {
+        Decl* member_decl = AddDecl(Decl::Kind::EnumMember, decl->FullName(), *member->identifier);
+        member_decl->enum_member = member.get();
+        member_decl->parent = decl;
+        // A member without a value follows the previous one.
+        if (previous != nullptr)
+            member_decl->value = previous->CName();
+        previous = member_decl;
+    }
+}
+
+void CGenerator::AddInterface(const std::string& scope,
+                              const InterfaceDeclaration& interface_decl) {
+    Decl* decl = AddDecl(Decl::Kind::Interface, scope, *interface_decl.identifier);
+    decl->interface_decl = &interface_decl;
+    std::string inner_scope = decl->FullName();
+
+    std::set<std::string> method_names;
+    std::set<uint32_t> ordinals;
+    for (const auto& member : interface_decl.body->fields) {
+        switch (member->kind) {
+        case InterfaceMember::Kind::Const:
+            AddConst(inner_scope,
+                     *static_cast<const InterfaceMemberConst&>(*member).const_declaration);
+            break;
+        case InterfaceMember::Kind::Enum:
+            AddEnum(inner_scope,
+                    *static_cast<const InterfaceMemberEnum&>(*member).enum_declaration);
+            break;
+        case InterfaceMember::Kind::Method: {
+            const auto& method = static_cast<const InterfaceMemberMethod&>(*member);
+            std::string method_name = NameOf(*method.identifier);
+            if (!method_names.insert(method_name).second)
+                Fail(Join(inner_scope, method_name) + " is declared more than once");
+
+            uint32_t ordinal;
+            if (!ParseUint32(method.ordinal->literal.data(), &ordinal)) {
+                Fail(Join(inner_scope, method_name) + " needs an ordinal which fits in a uint32");
+                ordinal = 0;
+            } else if (!ordinals.insert(ordinal).second) {
+                Fail(Join(inner_scope, method_name) + " reuses ordinal " +
+                     ToString(method.ordinal->literal.data()));
+            }
+
+            decls_.emplace_back(new Decl(Decl::Kind::Message, inner_scope, method_name + "_Request"));
+            Decl* request = decls_.back().get();
+            request->message_params = method.parameter_list.get();
+            request->parent = decl;
+            request->ordinal = ordinal;
+
+            if (method.maybe_response) {
+                decls_.emplace_back(new Decl(Decl::Kind::Message, inner_scope,
+                                             method_name + "_Response"));
+                Decl* response = decls_.back().get();
+                response->message_params = method.maybe_response->parameter_list.get();
+                response->parent = decl;
+                response->ordinal = ordinal;
+            }
+            break;
+        }
+        }
+    }
+}
+
+void CGenerator::AddStruct(const std::string& scope, const StructDeclaration& struct_decl) {
+    Decl* decl = AddDecl(Decl::Kind::Struct, scope, *struct_decl.identifier);
+    decl->struct_decl = &struct_decl;
+    std::string inner_scope = decl->FullName();
+
+    for (const auto& member : struct_decl.body->fields) {
+        switch (member->kind) {
+        case StructMember::Kind::Const:
+            AddConst(inner_scope, *static_cast<const StructMemberConst&>(*member).const_declaration);
+            break;
+        case StructMember::Kind::Enum:
+            AddEnum(inner_scope, *static_cast<const StructMemberEnum&>(*member).enum_declaration);
+            break;
+        case StructMember::Kind::Field:
+            break;
+        }
+    }
+}
+
+void CGenerator::AddUnion(const std::string& scope, const UnionDeclaration& union_decl) {
+    Decl* decl = AddDecl(Decl::Kind::Union, scope, *union_decl.identifier);
+    decl->union_decl = &union_decl;
+}
+
+// Looks |identifier| up in |scope|, then in each scope enclosing it.
+CGenerator::Decl* CGenerator::Lookup(const std::string& scope,
+                                     const CompoundIdentifier& identifier) {
+    std::string name = NameOf(identifier);
+    std::string current = scope;
+    for (;;) {
+        auto iter = names_.find(Join(current, name));
+        if (iter != names_.end())
+            return iter->second;
+        if (current.empty())
+            return nullptr;
+        size_t dot = current.rfind('.');
+        current = dot == std::string::npos ? std::string() : current.substr(0, dot);
+    }
+}
+
+bool CGenerator::ResolveType(const std::string& scope, const Type& type, FieldType* out) {
+    switch (type.kind) {
+    case Type::Kind::Handle:
+        // The kernel checks what a handle is when it is used, so its
+        // subtype doesn't change the layout or the coding.
+        out->c_type = "mx_handle_t";
+        out->size = out->alignment = 4u;
+        out->coding_table = "&fidl_handle_type";
+        return true;
+
+    case Type::Kind::Request: {
+        const auto& request = static_cast<const RequestType&>(type);
+        Decl* decl = Lookup(scope, *request.subtype);
+        if (decl == nullptr || decl->kind != Decl::Kind::Interface)
+            return Fail("request<" + NameOf(*request.subtype) + "> does not name an interface");
+        out->c_type = "mx_handle_t";
+        out->size = out->alignment = 4u;
+        out->coding_table = "&fidl_handle_type";
+        return true;
+    }
+
+    case Type::Kind::Identifier: {
+        const auto& identifier = static_cast<const IdentifierType&>(type);
+        Decl* decl = Lookup(scope, *identifier.identifier);
+        if (decl == nullptr ||
+            (decl->kind != Decl::Kind::Enum && decl->kind != Decl::Kind::Struct &&
+             decl->kind != Decl::Kind::Union))
+            return Fail(NameOf(*identifier.identifier) + " is not a type");
+        if (decl->state == Decl::State::Resolving)
+            return Fail(decl->FullName() + " contains itself");
+        if (!Resolve(decl))
+            return false;
+        *out = decl->type;
+        return true;
+    }
+
+    case Type::Kind::Primitive:
+        break;
+    }
+
+    const auto& primitive = static_cast<const PrimitiveType&>(type);
+    out->coding_table.clear();
+    switch (primitive.type_kind) {
+    case PrimitiveType::TypeKind::String:
+        out->c_type = "fidl_string_t";
+        out->size = 16u;
+        out->alignment = 8u;
+        out->coding_table = "&fidl_string_type";
+        return true;
+    case PrimitiveType::TypeKind::Bool:
+        out->c_type = "bool";
+        out->size = 1u;
+        break;
+    case PrimitiveType::TypeKind::Int8:
+        out->c_type = "int8_t";
+        out->size = 1u;
+        break;
+    case PrimitiveType::TypeKind::Int16:
+        out->c_type = "int16_t";
+        out->size = 2u;
+        break;
+    case PrimitiveType::TypeKind::Int32:
+        out->c_type = "int32_t";
+        out->size = 4u;
+        break;
+    case PrimitiveType::TypeKind::Int64:
+        out->c_type = "int64_t";
+        out->size = 8u;
+        break;
+    case PrimitiveType::TypeKind::Uint8:
+        out->c_type = "uint8_t";
+        out->size = 1u;
+        break;
+    case PrimitiveType::TypeKind::Uint16:
+        out->c_type = "uint16_t";
+        out->size = 2u;
+        break;
+    case PrimitiveType::TypeKind::Uint32:
+        out->c_type = "uint32_t";
+        out->size = 4u;
+        break;
+    case PrimitiveType::TypeKind::Uint64:
+        out->c_type = "uint64_t";
+        out->size = 8u;
+        break;
+    case PrimitiveType::TypeKind::Float32:
+        out->c_type = "float";
+        out->size = 4u;
+        break;
+    case PrimitiveType::TypeKind::Float64:
+        out->c_type = "double";
+        out->size = 8u;
+        break;
+    }
+    out->alignment = out->size;
+    return true;
+}
+
+// |type_decl| is the enum the constant has the type of, if it has one, so
+// that its members can be named without the enum in front.
+bool CGenerator::ResolveConstant(const std::string& scope, const std::string& name,
+                                 const FieldType& type, const Decl* type_decl,
+                                 const Constant& constant, std::string* out) {
+    if (constant.kind == Constant::Kind::Identifier) {
+        const auto& identifier = *static_cast<const IdentifierConstant&>(constant).identifier;
+        Decl* decl = nullptr;
+        if (type_decl != nullptr)
+            decl = Lookup(type_decl->FullName(), identifier);
+        if (decl == nullptr)
+            decl = Lookup(scope, identifier);
+        if (decl == nullptr ||
+            (decl->kind != Decl::Kind::Const && decl->kind != Decl::Kind::EnumMember))
+            return Fail(NameOf(identifier) + " is not a constant");
+        if (decl->state == Decl::State::Resolving)
+            return Fail(decl->FullName() + " is defined in terms of itself");
+        if (!Resolve(decl))
+            return false;
+        if (decl->kind == Decl::Kind::EnumMember && decl->parent != type_decl)
+            return Fail(name + " can't be " + decl->FullName());
+        *out = decl->CName();
+        return true;
+    }
+
+    const auto& literal = *static_cast<const LiteralConstant&>(constant).literal;
+    switch (literal.kind) {
+    case Literal::Kind::String:
+        if (type.c_type != "fidl_string_t")
+            return Fail(name + " can't be a string");
+        *out = ToString(static_cast<const StringLiteral&>(literal).literal.data());
+        return true;
+    case Literal::Kind::Numeric:
+        if (type.c_type == "fidl_string_t" || type.c_type == "bool")
+            return Fail(name + " can't be a number");
+        *out = "((" + type.c_type + ")" +
+               ToString(static_cast<const NumericLiteral&>(literal).literal.data()) + ")";
+        return true;
+    case Literal::Kind::True:
+    case Literal::Kind::False:
+        if (type.c_type != "bool")
+            return Fail(name + " can't be a bool");
+        *out = literal.kind == Literal::Kind::True ? "true" : "false";
+        return true;
+    case Literal::Kind::Default:
+        break;
+    }
+    return Fail(name + " can't be default");
+}
+
+bool CGenerator::ResolveConst(Decl* decl) {
+    const auto& const_decl = *decl->const_decl;
+    if (!ResolveType(decl->scope, *const_decl.type, &decl->type))
+        return false;
+
+    const Decl* type_decl = nullptr;
+    if (const_decl.type->kind == Type::Kind::Identifier) {
+        type_decl = Lookup(decl->scope,
+                           *static_cast<const IdentifierType&>(*const_decl.type).identifier);
+        if (type_decl->kind != Decl::Kind::Enum)
+            return Fail(decl->FullName() + " can't be a " + type_decl->FullName());
+    } else if (const_decl.type->kind != Type::Kind::Primitive) {
+        return Fail(decl->FullName() + " can't be a handle");
+    }
+    return ResolveConstant(decl->scope, decl->FullName(), decl->type, type_decl,
+                           *const_decl.constant, &decl->value);
+}
+
+bool CGenerator::ResolveEnum(Decl* decl) {
+    const auto& enum_decl = *decl->enum_decl;
+    if (enum_decl.maybe_subtype) {
+        if (!ResolveType(decl->scope, *enum_decl.maybe_subtype, &decl->type))
+            return false;
+        switch (enum_decl.maybe_subtype->type_kind) {
+        case PrimitiveType::TypeKind::String:
+        case PrimitiveType::TypeKind::Bool:
+        case PrimitiveType::TypeKind::Float32:
+        case PrimitiveType::TypeKind::Float64:
+            return Fail(decl->FullName() + " needs an integer type");
+        default:
+            break;
+        }
+        decl->value = decl->type.c_type;
+    } else {
+        decl->type.size = decl->type.alignment = 4u;
+        decl->value = "uint32_t";
+    }
+    // Fields of the enum type are declared as the enum, so the name of the
+    // enum ends up in the C struct.
+    decl->type.c_type = decl->CName();
+    return true;
+}
+
+bool CGenerator::ResolveEnumMember(Decl* decl) {
+    Decl* enum_decl = decl->parent;
+    if (!Resolve(enum_decl))
+        return false;
+
+    const auto& maybe_value = decl->enum_member->maybe_value;
+    std::string value;
+    if (!maybe_value) {
+        value = decl->value.empty() ? "0" : decl->value + " + 1";
+    } else if (maybe_value->kind == EnumMemberValue::Kind::Numeric) {
+        value = ToString(
+            static_cast<const EnumMemberValueNumeric&>(*maybe_value).literal->literal.data());
+    } else {
+        const auto& identifier =
+            *static_cast<const EnumMemberValueIdentifier&>(*maybe_value).identifier;
+        Decl* other = Lookup(decl->scope, identifier);
+        if (other == nullptr || other->kind != Decl::Kind::EnumMember ||
+            other->parent != enum_decl)
+            return Fail(NameOf(identifier) + " is not a member of " + enum_decl->FullName());
+        if (other->state == Decl::State::Resolving)
+            return Fail(decl->FullName() + " is defined in terms of itself");
+        if (!Resolve(other))
+            return false;
+        value = other->CName();
+    }
+    decl->value = "((" + enum_decl->CName() + ")(" + value + "))";
+    return true;
+}
+
+// Lays the members out at their natural alignment, after |start| bytes of
+// something else, and works out the size and alignment of the whole.
+bool CGenerator::LayOutStruct(Decl* decl, uint32_t start, uint32_t alignment) {
+    std::set<std::string> names;
+    uint32_t offset = start;
+    for (auto& member : decl->members) {
+        if (!names.insert(member.name).second)
+            return Fail(decl->FullName() + " has more than one " + member.name);
+        member.offset = AlignTo(offset, member.type.alignment);
+        offset = member.offset + member.type.size;
+        if (member.type.alignment > alignment)
+            alignment = member.type.alignment;
+        if (!member.type.coding_table.empty())
+            decl->type.coding_table = "&" + decl->CName() + "_table";
+    }
+    // C has no empty structs, so an empty struct holds one zero byte.
+    if (offset == 0u) {
+        Member padding;
+        padding.name = "reserved";
+        padding.type.c_type = "uint8_t";
+        padding.type.size = 1u;
+        decl->members.push_back(padding);
+        offset = 1u;
+    }
+    decl->type.c_type = decl->CName();
+    decl->type.size = AlignTo(offset, alignment);
+    decl->type.alignment = alignment;
+    return true;
+}
+
+bool CGenerator::ResolveStruct(Decl* decl) {
+    std::string inner_scope = decl->FullName();
+    for (const auto& member : decl->struct_decl->body->fields) {
+        if (member->kind != StructMember::Kind::Field)
+            continue;
+        // Defaults only matter to bindings which construct values; C
+        // callers fill in every field.
+        const auto& field = static_cast<const StructMemberField&>(*member);
+        Member out;
+        out.name = NameOf(*field.identifier);
+        if (!ResolveType(inner_scope, *field.type, &out.type))
+            return false;
+        decl->members.push_back(out);
+    }
+    return LayOutStruct(decl, 0u, 1u);
+}
+
+bool CGenerator::ResolveUnion(Decl* decl) {
+    std::set<std::string> names;
+    uint32_t size = 0u;
+    uint32_t alignment = 4u;
+    for (const auto& member : decl->union_decl->body->fields) {
+        Member out;
+        out.name = NameOf(*member->identifier);
+        if (!names.insert(out.name).second)
+            return Fail(decl->FullName() + " has more than one " + out.name);
+        if (!ResolveType(decl->scope, *member->type, &out.type))
+            return false;
+        if (out.type.size > size)
+            size = out.type.size;
+        if (out.type.alignment > alignment)
+            alignment = out.type.alignment;
+        decl->members.push_back(out);
+    }
+    if (decl->members.empty())
+        return Fail(decl->FullName() + " has no members");
+
+    uint32_t data_offset = AlignTo(4u, alignment);
+    for (auto& member : decl->members)
+        member.offset = data_offset;
+    decl->type.c_type = decl->CName();
+    decl->type.size = AlignTo(data_offset + size, alignment);
+    decl->type.alignment = alignment;
+    // Even a union of plain data has a tag to check.
+    decl->type.coding_table = "&" + decl->CName() + "_table";
+    return true;
+}
+
+bool CGenerator::ResolveMessage(Decl* decl) {
+    for (const auto& parameter : decl->message_params->parameter_list) {
+        Member out;
+        out.name = NameOf(*parameter->identifier);
+        if (!ResolveType(decl->scope, *parameter->type, &out.type))
+            return false;
+        decl->members.push_back(out);
+    }
+    if (!LayOutStruct(decl, kMessageHeaderSize, kMessageHeaderAlignment))
+        return false;
+    // fidl_decode() needs a table for every message, to know its size.
+    decl->type.coding_table = "&" + decl->CName() + "_table";
+    return true;
+}
+
+bool CGenerator::Resolve(Decl* decl) {
+    if (decl->state == Decl::State::Resolved)
+        return true;
+    decl->state = Decl::State::Resolving;
+
+    bool ok = true;
+    switch (decl->kind) {
+    case Decl::Kind::Const:
+        ok = ResolveConst(decl);
+        break;
+    case Decl::Kind::Enum:
+        ok = ResolveEnum(decl);
+        break;
+    case Decl::Kind::EnumMember:
+        ok = ResolveEnumMember(decl);
+        break;
+    case Decl::Kind::Interface:
+        break;
+    case Decl::Kind::Struct:
+        ok = ResolveStruct(decl);
+        break;
+    case Decl::Kind::Union:
+        ok = ResolveUnion(decl);
+        break;
+    case Decl::Kind::Message:
+        ok = ResolveMessage(decl);
+        break;
+    }
+
+    // Failures are left Resolving, which stops anything that depends on
+    // them from being reported again as a cycle.
+    if (!ok)
+        return false;
+    decl->state = Decl::State::Resolved;
+    emit_order_.push_back(decl);
+    return true;
+}
+
+void CGenerator::EmitHeaderDecl(const Decl& decl, std::string* out) {
+    std::string c_name = decl.CName();
+    switch (decl.kind) {
+    case Decl::Kind::Const:
+    case Decl::Kind::EnumMember:
+        Appendf(out, "#define %s %s\n", c_name.c_str(), decl.value.c_str());
+        return;
+
+    case Decl::Kind::Enum:
+        Appendf(out, "\ntypedef %s %s;\n", decl.value.c_str(), c_name.c_str());
+        return;
+
+    case Decl::Kind::Interface:
+        return;
+
+    case Decl::Kind::Struct:
+    case Decl::Kind::Message:
+        Appendf(out, "\ntypedef struct %s {\n", c_name.c_str());
+        if (decl.kind == Decl::Kind::Message)
+            Appendf(out, "    fidl_message_header_t hdr;\n");
+        for (const auto& member : decl.members)
+            Appendf(out, "    %s %s;\n", member.type.c_type.c_str(), member.name.c_str());
+        Appendf(out, "} %s;\n", c_name.c_str());
+        break;
+
+    case Decl::Kind::Union:
+        Appendf(out, "\n");
+        for (size_t i = 0; i < decl.members.size(); i++)
+            Appendf(out, "#define %s_tag_%s ((uint32_t)%zu)\n", c_name.c_str(),
+                    decl.members[i].name.c_str(), i);
+        Appendf(out, "typedef struct %s {\n    uint32_t tag;\n    union {\n", c_name.c_str());
+        for (const auto& member : decl.members)
+            Appendf(out, "        %s %s;\n", member.type.c_type.c_str(), member.name.c_str());
+        Appendf(out, "    };\n} %s;\n", c_name.c_str());
+        break;
+    }
+
+    if (decl.kind == Decl::Kind::Message && decl.name.size() > 8 &&
+        decl.name.compare(decl.name.size() - 8, 8, "_Request") == 0) {
+        std::string method = decl.name.substr(0, decl.name.size() - 8);
+        Appendf(out, "#define %s_%s_ordinal ((uint32_t)%" PRIu32 ")\n",
+                decl.parent->CName().c_str(), method.c_str(), decl.ordinal);
+    }
+    if (!decl.type.coding_table.empty())
+        Appendf(out, "extern const fidl_type_t %s_table;\n", c_name.c_str());
+}
+
+void CGenerator::EmitSourceDecl(const Decl& decl, std::string* out) {
+    if (decl.kind != Decl::Kind::Struct && decl.kind != Decl::Kind::Union &&
+        decl.kind != Decl::Kind::Message)
+        return;
+    std::string c_name = decl.CName();
+    const char* name = c_name.c_str();
+
+    // The C compiler has to agree with the layout the wire format gives.
+    Appendf(out, "\n_Static_assert(sizeof(%s) == %" PRIu32 ", \"%s has the wrong size\");\n",
+            name, decl.type.size, name);
+    for (const auto& member : decl.members) {
+        Appendf(out, "_Static_assert(offsetof(%s, %s) == %" PRIu32
+                     ", \"%s.%s is in the wrong place\");\n",
+                name, member.name.c_str(), member.offset, name, member.name.c_str());
+    }
+
+    if (decl.type.coding_table.empty())
+        return;
+
+    if (decl.kind == Decl::Kind::Union) {
+        Appendf(out, "static const fidl_type_t* const %s_types[] = {\n", name);
+        for (const auto& member : decl.members) {
+            Appendf(out, "    %s,\n",
+                    member.type.coding_table.empty() ? "NULL" : member.type.coding_table.c_str());
+        }
+        Appendf(out, "};\n");
+        Appendf(out, "const fidl_type_t %s_table = {\n", name);
+        Appendf(out, "    .type_tag = fidl_type_union,\n");
+        Appendf(out, "    .coded_union = {\n");
+        Appendf(out, "        .types = %s_types,\n", name);
+        Appendf(out, "        .type_count = %zu,\n", decl.members.size());
+        Appendf(out, "        .data_offset = offsetof(%s, %s),\n", name,
+                decl.members[0].name.c_str());
+        Appendf(out, "        .size = sizeof(%s),\n", name);
+        Appendf(out, "        .name = \"%s\",\n", decl.FullName().c_str());
+        Appendf(out, "    },\n};\n");
+        return;
+    }
+
+    size_t field_count = 0;
+    for (const auto& member : decl.members) {
+        if (member.type.coding_table.empty())
+            continue;
+        if (field_count++ == 0)
+            Appendf(out, "static const fidl_field_t %s_fields[] = {\n", name);
+        Appendf(out, "    {%s, offsetof(%s, %s)},\n", member.type.coding_table.c_str(), name,
+                member.name.c_str());
+    }
+    if (field_count != 0)
+        Appendf(out, "};\n");
+    Appendf(out, "const fidl_type_t %s_table = {\n", name);
+    Appendf(out, "    .type_tag = fidl_type_struct,\n");
+    Appendf(out, "    .coded_struct = {\n");
+    if (field_count != 0)
+        Appendf(out, "        .fields = %s_fields,\n", name);
+    else
+        Appendf(out, "        .fields = NULL,\n");
+    Appendf(out, "        .field_count = %zu,\n", field_count);
+    Appendf(out, "        .size = sizeof(%s),\n", name);
+    Appendf(out, "        .name = \"%s\",\n", decl.FullName().c_str());
+    Appendf(out, "    },\n};\n");
+}
+
+bool CGenerator::Generate(const std::string& header_path, std::string* header_out,
+                          std::string* source_out) {
+    for (const auto& decl : decls_)
+        Resolve(decl.get());
+    if (!ok_)
+        return false;
+
+    std::string header =
+        "// Generated by fidl.  Do not edit.\n"
+        "\n"
+        "#pragma once\n"
+        "\n"
+        "#include <fidl/coding.h>\n"
+        "\n"
+        "__BEGIN_CDECLS\n";
+    std::string source =
+        "// Generated by fidl.  Do not edit.\n"
+        "\n"
+        "#include \"" + header_path + "\"\n"
+        "\n"
+        "#include <stddef.h>\n";
+    for (const Decl* decl : emit_order_) {
+        EmitHeaderDecl(*decl, &header);
+        EmitSourceDecl(*decl, &source);
+    }
+    header += "\n__END_CDECLS\n";
+
+    *header_out = std::move(header);
+    *source_out = std::move(source);
+    return true;
+}
+
+} // namespace fidl
@@ -0,0 +1,135 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ast.h"
+
+namespace fidl {
+
+// CGenerator turns parsed files into the C bindings for them: a header,
+// which lays each type out as docs/fidl_wire_format.md does so that a
+// decoded message can be read in place, and a source file which holds the
+// coding tables that libfidl's fidl_decode() and fidl_encode() walk.
+//
+// Names are scoped by the module, then by the declaration they are nested
+// in, and become C identifiers by joining the components with '_'.
+class CGenerator {
+public:
+    // The files, and the sources they were parsed from, must outlive the
+    // generator.
+    void AddFile(const File& file);
+
+    // Returns false, after printing what was wrong, if the files don't make
+    // sense together.  |header_path| is what the source file #includes.
+    bool Generate(const std::string& header_path, std::string* header_out,
+                  std::string* source_out);
+
+private:
+    // What a field of some type looks like.
+    struct FieldType {
+        std::string c_type;
+        uint32_t size = 0;
+        uint32_t alignment = 1;
+        // The coding table for the field, or empty for plain data.
+        std::string coding_table;
+    };
+
+    struct Member {
+        std::string name;
+        FieldType type;
+        uint32_t offset = 0;
+    };
+
+    struct Decl {
+        enum struct Kind {
+            Const,
+            Enum,
+            EnumMember,
+            Interface,
+            Struct,
+            Union,
+            Message,
+        };
+
+        enum struct State {
+            Unresolved,
+            Resolving,
+            Resolved,
+        };
+
+        Decl(Kind kind, std::string scope, std::string name)
+            : kind(kind), scope(std::move(scope)), name(std::move(name)) {}
+
+        std::string FullName() const;
+        std::string CName() const;
+
+        const Kind kind;
+        // The dotted name of whatever the declaration is nested in.
+        const std::string scope;
+        const std::string name;
+
+        // The one which matches |kind|.
+        const ConstDeclaration* const_decl = nullptr;
+        const EnumDeclaration* enum_decl = nullptr;
+        const EnumMember* enum_member = nullptr;
+        const InterfaceDeclaration* interface_decl = nullptr;
+        const StructDeclaration* struct_decl = nullptr;
+        const UnionDeclaration* union_decl = nullptr;
+        const ParameterList* message_params = nullptr;
+
+        // Enum members point at their enum, messages at their interface.
+        Decl* parent = nullptr;
+        uint32_t ordinal = 0;
+
+        State state = State::Unresolved;
+        FieldType type;
+        std::vector<Member> members;
+        // A C expression for a constant or an enum member, or the C type an
+        // enum is stored as.
+        std::string value;
+    };
+
+    Decl* AddDecl(Decl::Kind kind, const std::string& scope, const Identifier& identifier);
+    void AddConst(const std::string& scope, const ConstDeclaration& const_decl);
+    void AddEnum(const std::string& scope, const EnumDeclaration& enum_decl);
+    void AddInterface(const std::string& scope, const InterfaceDeclaration& interface_decl);
+    void AddStruct(const std::string& scope, const StructDeclaration& struct_decl);
+    void AddUnion(const std::string& scope, const UnionDeclaration& union_decl);
+
+    Decl* Lookup(const std::string& scope, const CompoundIdentifier& identifier);
+
+    bool Resolve(Decl* decl);
+    bool ResolveType(const std::string& scope, const Type& type, FieldType* out);
+    bool ResolveConstant(const std::string& scope, const std::string& name,
+                         const FieldType& type, const Decl* type_decl,
+                         const Constant& constant, std::string* out);
+    bool ResolveConst(Decl* decl);
+    bool ResolveEnum(Decl* decl);
+    bool ResolveEnumMember(Decl* decl);
+    bool ResolveStruct(Decl* decl);
+    bool ResolveUnion(Decl* decl);
+    bool ResolveMessage(Decl* decl);
+    bool LayOutStruct(Decl* decl, uint32_t start, uint32_t alignment);
+
+    void EmitHeaderDecl(const Decl& decl, std::string* out);
+    void EmitSourceDecl(const Decl& decl, std::string* out);
+
+    bool Fail(const std::string& message);
+
+    std::vector<std::unique_ptr<Decl>> decls_;
+    std::map<std::string, Decl*> names_;
+    // Each declaration comes after the ones it needs.
+    std::vector<Decl*> emit_order_;
+    bool ok_ = true;
+};
+
+} // namespace fidl
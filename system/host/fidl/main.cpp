@@ -10,6 +10,7 @@
 #include <utility>
 #include <vector>
 
+#include "c_generator.h"
 #include "identifier_table.h"
 #include "lexer.h"
 #include "make_unique.h"
@@ -21,11 +22,27 @@ namespace {
 
 enum struct Behavior {
     None,
+    CBindings,
 };
 
-bool TestParser(int file_count, char** file_names, Behavior behavior) {
+bool WriteFile(const char* file_name, const std::string& contents) {
+    FILE* file = fopen(file_name, "w");
+    if (file == nullptr) {
+        fprintf(stderr, "Couldn't open %s for writing\n", file_name);
+        return false;
+    }
+    bool ok = fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok)
+        fprintf(stderr, "Couldn't write %s\n", file_name);
+    return ok;
+}
+
+bool TestParser(int file_count, char** file_names, Behavior behavior,
+                const char* header_name, const char* source_name) {
     SourceManager source_manager;
     IdentifierTable identifier_table;
+    std::vector<std::unique_ptr<File>> files;
 
     for (int idx = 0; idx < file_count; ++idx) {
         StringView source;
@@ -42,9 +59,26 @@ bool TestParser(int file_count, char** file_names, Behavior behavior) {
             fprintf(stderr, "Parse failed!\n");
             return false;
         }
+        files.push_back(std::move(raw_ast));
+    }
+
+    switch (behavior) {
+    case Behavior::None:
+        return true;
+
+    case Behavior::CBindings: {
+        CGenerator generator;
+        for (const auto& file : files)
+            generator.AddFile(*file);
+        std::string header;
+        std::string source;
+        if (!generator.Generate(header_name, &header, &source))
+            return false;
+        return WriteFile(header_name, header) && WriteFile(source_name, source);
+    }
     }
 
-    return true;
+    return false;
 }
 
 } // namespace
@@ -62,10 +96,25 @@ int main(int argc, char* argv[]) {
     fidl::Behavior behavior;
     if (!strncmp(argv[0], "none", 4))
         behavior = fidl::Behavior::None;
+    else if (!strcmp(argv[0], "c"))
+        behavior = fidl::Behavior::CBindings;
     else
         return 1;
     --argc;
     ++argv;
 
-    return TestParser(argc, argv, behavior) ? 0 : 1;
+    // The C bindings are written to a header and a source file, given in
+    // that order before the input files.
+    const char* header_name = nullptr;
+    const char* source_name = nullptr;
+    if (behavior == fidl::Behavior::CBindings) {
+        if (argc < 3)
+            return 1;
+        header_name = argv[0];
+        source_name = argv[1];
+        argc -= 2;
+        argv += 2;
+    }
+
+    return TestParser(argc, argv, behavior, header_name, source_name) ? 0 : 1;
 }
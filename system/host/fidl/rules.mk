@@ -11,6 +11,7 @@ MODULE_TYPE := hostapp
 MODULE_COMPILEFLAGS := -O0 -g
 
 MODULE_SRCS := \
+    $(LOCAL_DIR)/c_generator.cpp \
     $(LOCAL_DIR)/identifier_table.cpp \
     $(LOCAL_DIR)/lexer.cpp \
     $(LOCAL_DIR)/main.cpp \
@@ -24,9 +24,12 @@ MODULE_SRCS += \
 	system/ulib/mxcpp/new.cpp \
 	$(LOCAL_DIR)/merkleroot.cpp
 
+# merkle::Tree::Create hashes on several threads
+MODULE_HOST_LIBS := -lpthread
+
 ifneq (,$(wildcard $(OPENSSL_DIR)/sha.h))
 MODULE_DEFINES += USE_LIBCRYPTO=1
-MODULE_HOST_LIBS := -lcrypto
+MODULE_HOST_LIBS += -lcrypto
 else
 MODULE_COMPILEFLAGS += -Ithird_party/ulib/cryptolib/include
 MODULE_SRCS += third_party/ulib/cryptolib/cryptolib.c
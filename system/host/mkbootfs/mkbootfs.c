@@ -50,6 +50,10 @@ struct fsentry {
     uint32_t length;
 
     char* srcpath;
+
+    // With --compress-files, the file's LZ4 frame, whose size replaces
+    // the file's size in length.
+    void* cdata;
 };
 
 #define ITEM_BOOTDATA 0
@@ -488,6 +492,57 @@ static const io_ops io_compressed = {
     .finish = compress_finish,
 };
 
+// Compress one file into an LZ4 frame of its own, so that it can be
+// decompressed on its own when it is first used at runtime.
+int compress_entry(fsentry_t* e) {
+    if (e->length == 0) {
+        // Empty files are stored with no frame at all.
+        return 0;
+    }
+
+    int fdi;
+    if ((fdi = open(e->srcpath, O_RDONLY)) < 0) {
+        fprintf(stderr, "error: cannot open '%s'\n", e->srcpath);
+        return -1;
+    }
+    void* src = malloc(e->length);
+    if (src == NULL) {
+        fprintf(stderr, "OUT OF MEMORY\n");
+        close(fdi);
+        return -1;
+    }
+    if (readx(fdi, src, e->length) < 0) {
+        fprintf(stderr, "error: cannot read '%s'\n", e->srcpath);
+        free(src);
+        close(fdi);
+        return -1;
+    }
+    close(fdi);
+
+    LZ4F_preferences_t prefs = lz4_prefs;
+    prefs.frameInfo.contentSize = e->length;
+    size_t max = LZ4F_compressFrameBound(e->length, &prefs);
+    if ((e->cdata = malloc(max)) == NULL) {
+        fprintf(stderr, "OUT OF MEMORY\n");
+        free(src);
+        return -1;
+    }
+    size_t r = LZ4F_compressFrame(e->cdata, max, src, e->length, &prefs);
+    free(src);
+    if (check_and_log_lz4_error(r, "could not compress file")) {
+        return -1;
+    }
+    if (r > INT32_MAX) {
+        fprintf(stderr, "error: file too large '%s'\n", e->srcpath);
+        return -1;
+    }
+    if (verbose) {
+        fprintf(stderr, "%08x -> %08zx %s\n", e->length, r, e->name);
+    }
+    e->length = r;
+    return 0;
+}
+
 ssize_t copybootdatafile(int fd, const char* fn, size_t len) {
     char buf[MAXBUFFER];
     int r, fdi;
@@ -539,7 +594,8 @@ char fill[4096];
 
 #define CHECK(w) do { if ((w) < 0) goto fail; } while (0)
 
-int write_bootfs(int fd, const io_ops* op, item_t* item, bool compressed) {
+int write_bootfs(int fd, const io_ops* op, item_t* item, bool compressed,
+                 bool file_compressed) {
     uint32_t n;
     fsentry_t* e;
 
@@ -593,7 +649,11 @@ fail:
         if (verbose) {
             fprintf(stderr, "%08x %08x %s\n", e->offset, e->length, e->name);
         }
-        CHECK(op->write_file(fd, e->srcpath, e->length, cookie));
+        if (e->cdata) {
+            CHECK(op->write(fd, e->cdata, e->length, cookie));
+        } else {
+            CHECK(op->write_file(fd, e->srcpath, e->length, cookie));
+        }
         if ((n = PAGEFILL(e->length))) {
             CHECK(op->write(fd, fill, n, cookie));
         }
@@ -634,7 +694,8 @@ fail:
                 BOOTDATA_BOOTFS_SYSTEM : BOOTDATA_BOOTFS_BOOT,
         .length = wrote,
         .extra = compressed ? item->outsize : wrote,
-        .flags = compressed ? BOOTDATA_BOOTFS_FLAG_COMPRESSED : 0
+        .flags = compressed ? BOOTDATA_BOOTFS_FLAG_COMPRESSED :
+                 file_compressed ? BOOTDATA_BOOTFS_FLAG_FILE_COMPRESSED : 0
     };
     if (writex(fd, &boothdr, sizeof(boothdr)) < 0) {
         return -1;
@@ -648,10 +709,7 @@ fail:
     return 0;
 }
 
-int write_bootdata(const char* fn, item_t* item) {
-    //TODO: re-enable for debugging someday
-    bool compressed = true;
-
+int write_bootdata(const char* fn, item_t* item, bool compressed, bool file_compressed) {
     int fd;
     const io_ops* op = compressed ? &io_compressed : &io_plain;
 
@@ -693,7 +751,7 @@ int write_bootdata(const char* fn, item_t* item) {
         }
         case ITEM_BOOTFS_BOOT:
         case ITEM_BOOTFS_SYSTEM:
-            CHECK(write_bootfs(fd, op, item, compressed));
+            CHECK(write_bootfs(fd, op, item, compressed, file_compressed));
             break;
         default:
             fprintf(stderr, "error: internal: type %08x unknown\n", item->type);
@@ -809,6 +867,8 @@ void usage(void) {
     "         -v               verbose output\n"
     "         -t <filename>    dump bootdata contents\n"
     "         --uncompressed   don't compress bootfs image (debug only)\n"
+    "         --compress-files compress each file in the bootfs separately,\n"
+    "                          so each is decompressed only when first used\n"
     "         --target=system  bootfs to be unpacked at /system\n"
     "         --target=boot    bootfs to be unpacked at /boot\n"
     "\n"
@@ -826,6 +886,7 @@ int main(int argc, char **argv) {
     const char* output_file = "user.bootfs";
 
     bool compressed = true;
+    bool file_compressed = false;
     bool have_kernel = false;
     unsigned incount = 0;
 
@@ -881,8 +942,13 @@ int main(int argc, char **argv) {
             return 0;
         } else if (!strcmp(cmd,"-c")) {
             compressed = true;
+            file_compressed = false;
         } else if (!strcmp(cmd,"--uncompressed")) {
             compressed = false;
+            file_compressed = false;
+        } else if (!strcmp(cmd,"--compress-files")) {
+            compressed = false;
+            file_compressed = true;
         } else if (!strcmp(cmd,"--target=system")) {
             system = true;
         } else if (!strcmp(cmd,"--target=boot")) {
@@ -929,6 +995,9 @@ int main(int argc, char **argv) {
             size_t off = PAGEALIGN(item->hdrsize);
             fsentry_t* last_entry = NULL;
             for (fsentry_t* e = item->first; e != NULL; e = e->next) {
+                if (file_compressed && compress_entry(e) < 0) {
+                    return -1;
+                }
                 e->offset = off;
                 off += PAGEALIGN(e->length);
                 if (off > INT32_MAX) {
@@ -947,5 +1016,5 @@ int main(int argc, char **argv) {
         }
     }
 
-    return write_bootdata(output_file, first_item);
+    return write_bootdata(output_file, first_item, compressed, file_compressed);
 }
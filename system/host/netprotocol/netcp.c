@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <errno.h>
@@ -28,6 +29,16 @@
 
 static const char* appname;
 
+// Fits in a 1500 byte ethernet frame along with the IPv6, UDP and
+// netboot headers and the trailing NUL netsvc expects.
+#define PUSH_BLOCK_SIZE 1400
+#define PUSH_WINDOW 32
+
+typedef struct {
+    struct nbmsg_t hdr;
+    uint8_t data[PUSH_BLOCK_SIZE + 1];
+} wmsg;
+
 static int pull_file(int s, const char* dst, const char* src) {
     int r;
     msg in, out;
@@ -150,35 +161,79 @@ again:
         return -1;
     }
 
+    // Keep a window of writes in flight. netsvc takes blocks strictly in
+    // order and acks each one with the cookie it came with, so on a timeout
+    // everything from the first unacked block on is sent again.
+    static wmsg window[PUSH_WINDOW];
+    int lens[PUSH_WINDOW];
+    uint32_t cookie_base = (uint32_t)time(NULL) << 12;
+    uint32_t acked = 0;
+    uint32_t sent = 0;
+    bool eof = false;
+    int retry = 5;
     int n = 0;
-    int len = 0;
-    int blocknum = 0;
     for (;;) {
-        memset(&out, 0, sizeof(out));
-        out.hdr.cmd = NB_WRITE;
-        out.hdr.arg = blocknum;
+        while (!eof && sent - acked < PUSH_WINDOW) {
+            wmsg* w = &window[sent % PUSH_WINDOW];
+            memset(w, 0, sizeof(*w));
+            int len = read(fd, w->data, PUSH_BLOCK_SIZE);
+            if (len < 0) {
+                fprintf(stderr, "%s: error reading block %u (%d)\n",
+                        appname, sent, errno);
+                close(fd);
+                return -1;
+            }
+            if (len == 0) {
+                eof = true;
+                break;
+            }
+            w->hdr.magic = NB_MAGIC;
+            w->hdr.cookie = cookie_base + sent;
+            w->hdr.cmd = NB_WRITE;
+            w->hdr.arg = sent;
+            // netsvc drops the last byte as the terminator
+            lens[sent % PUSH_WINDOW] = sizeof(w->hdr) + len + 1;
+            write(s, w, lens[sent % PUSH_WINDOW]);
+            sent++;
+            n += len;
+        }
+        if (acked == sent) {
+            break;
+        }
 
-        len = read(fd, out.data, sizeof(out.data));
-        if (len < 0) {
-            fprintf(stderr, "%s: error reading block %d (%d)\n",
-                    appname, blocknum, errno);
+        ssize_t rlen = recv(s, &in, sizeof(in), 0);
+        if (rlen < 0) {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                if (retry-- > 0) {
+                    for (uint32_t b = acked; b != sent; b++) {
+                        write(s, &window[b % PUSH_WINDOW], lens[b % PUSH_WINDOW]);
+                    }
+                    continue;
+                }
+                errno = ETIMEDOUT;
+            }
+            fprintf(stderr, "%s: error writing block %u (%d)\n",
+                    appname, acked, errno);
             close(fd);
-            return r;
+            return -1;
         }
-        if (len == 0) {
-            break; // EOF
+        if ((rlen < (ssize_t)sizeof(in.hdr)) ||
+            (in.hdr.magic != NB_MAGIC) ||
+            (in.hdr.cmd != NB_ACK)) {
+            continue;
         }
-
-        r = netboot_txn(s, &in, &out, sizeof(out.hdr) + len + 1);
-        if (r < 0) {
-            fprintf(stderr, "%s: error writing block %d (%d)\n",
-                    appname, blocknum, errno);
+        if ((int)in.hdr.arg < 0) {
+            errno = -(int)in.hdr.arg;
+            fprintf(stderr, "%s: error writing block %u (%d)\n",
+                    appname, in.hdr.cookie - cookie_base, errno);
             close(fd);
-            return r;
+            return -1;
+        }
+        uint32_t b = in.hdr.cookie - cookie_base;
+        if (b - acked < sent - acked) {
+            acked = b + 1;
+            retry = 5;
         }
-
-        blocknum++;
-        n += len;
     }
 
     memset(&out, 0, sizeof(out));
@@ -67,6 +67,46 @@ bool SyscallNumbersGenerator::syscall(ofstream& os, const Syscall& sc) const {
     return os.good();
 }
 
+bool BatchOpGenerator::header(ofstream& os) const {
+    if (!Generator::header(os))
+        return false;
+
+    os << "#pragma once\n\n"
+       << "#include <magenta/syscalls.h>\n\n"
+       << "__BEGIN_CDECLS\n\n";
+    return os.good();
+}
+
+bool BatchOpGenerator::syscall(ofstream& os, const Syscall& sc) const {
+    if (!sc.is_batchable())
+        return true;
+
+    // static inline void mx_batch_op_foo(mx_batch_op_t* batch_op, type1 arg1, ...) {
+    os << "static inline void " << function_prefix_ << sc.name << "(mx_batch_op_t* batch_op";
+    sc.for_each_kernel_arg([&](const TypeSpec& arg) {
+        os << ", " << arg.as_cpp_declaration(false);
+    });
+    os << ") {\n";
+
+    os << "    batch_op->syscall_num = " << sc.index << ";\n"
+       << "    batch_op->status = 0;\n";
+    size_t arg_index = 0;
+    sc.for_each_kernel_arg([&](const TypeSpec& arg) {
+        os << "    batch_op->args[" << arg_index++ << "] = (uint64_t)"
+           << (arg.arr_spec ? "(uintptr_t)" : "") << "(" << arg.name << ");\n";
+    });
+    for (; arg_index < kMaxArgs; arg_index++)
+        os << "    batch_op->args[" << arg_index << "] = 0;\n";
+    os << "}\n\n";
+
+    return os.good();
+}
+
+bool BatchOpGenerator::footer(ofstream& os) const {
+    os << "__END_CDECLS\n";
+    return os.good();
+}
+
 bool TraceInfoGenerator::syscall(ofstream& os, const Syscall& sc) const {
     if (sc.is_vdso())
         return true;
@@ -78,6 +78,21 @@ private:
     const std::string define_prefix_;
 };
 
+// Generate the inline functions that fill in a mx_batch_op_t for each
+// syscall mx_syscall_batch() can run.
+class BatchOpGenerator : public Generator {
+public:
+    BatchOpGenerator(const std::string& function_prefix)
+        : function_prefix_(function_prefix) {}
+
+    bool header(std::ofstream& os) const override;
+    bool syscall(std::ofstream& os, const Syscall& sc) const override;
+    bool footer(std::ofstream& os) const override;
+
+private:
+    const std::string function_prefix_;
+};
+
 // Generate debug trace info.
 class TraceInfoGenerator : public Generator {
 public:
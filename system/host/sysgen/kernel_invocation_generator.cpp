@@ -23,7 +23,7 @@ static string invocation(std::ofstream& os, const string& out_var, const string&
 }
 
 bool KernelInvocationGenerator::syscall(std::ofstream& os, const Syscall& sc) const {
-    if (sc.is_vdso())
+    if (sc.is_vdso() || (batchable_only_ && !sc.is_batchable()))
         return true;
 
     string code_sp = string(8u, ' ');
@@ -14,9 +14,10 @@
 class KernelInvocationGenerator : public Generator {
 public:
     KernelInvocationGenerator(const std::string& syscall_prefix, const std::string& return_var,
-                              const std::string& return_type, const std::string& arg_prefix) :
+                              const std::string& return_type, const std::string& arg_prefix,
+                              bool batchable_only = false) :
         syscall_prefix_(syscall_prefix), return_var_(return_var),
-        return_type_(return_type), arg_prefix_(arg_prefix) {}
+        return_type_(return_type), arg_prefix_(arg_prefix), batchable_only_(batchable_only) {}
 
     bool syscall(std::ofstream& os, const Syscall& sc) const override;
 
@@ -25,4 +26,6 @@ private:
     const std::string return_var_;
     const std::string return_type_;
     const std::string arg_prefix_;
+    // Only emit the syscalls that mx_syscall_batch() may run.
+    const bool batchable_only_;
 };
@@ -49,6 +49,15 @@ static KernelInvocationGenerator kernel_code(
     "uint64_t", // type of result variable
     "arg");     // prefix for syscall arguments);
 
+static KernelInvocationGenerator kernel_batch_code(
+    "sys_",     // function prefix
+    "ret",      //  variable to assign invocation result to
+    "uint64_t", // type of result variable
+    "arg",      // prefix for syscall arguments
+    true);      // only the batchable syscalls
+
+static BatchOpGenerator batch_op_generator("mx_batch_op_");
+
 static HeaderGenerator user_header(
     "extern ",                       // function prefix
     vector<string>({"mx_", "_mx_"}), // function name prefixes
@@ -101,6 +110,12 @@ const map<string, const Generator&> type_to_generator = {
     // The kernel C++ code. A switch statement set.
     {"kernel-code", kernel_code},
 
+    // The same, but only for the syscalls mx_syscall_batch() may run.
+    {"kernel-batch-code", kernel_batch_code},
+
+    // A C header of inline functions filling in batch operations.
+    {"batch-ops", batch_op_generator},
+
     //  The assembly file for x86-64.
     {"x86-asm", x86_generator},
 
@@ -125,6 +140,8 @@ const map<string, string> type_to_default_suffix = {
     {"vdso-header", ".vdso.h"},
     {"kernel-header", ".kernel.h"},
     {"kernel-code", ".kernel.inc"},
+    {"kernel-batch-code", ".kernel-batch.inc"},
+    {"batch-ops", ".batch-ops.h"},
     {"x86-asm", ".x86-64.S"},
     {"arm-asm", ".arm64.S"},
     {"numbers", ".syscall-numbers.h"},
@@ -160,6 +160,14 @@ bool Syscall::is_blocking() const {
     return has_attribute("blocking", attributes);
 }
 
+// Batched calls run back to back within one trap, so they must not block,
+// must come back, and need to report a status the batch can record.
+bool Syscall::is_batchable() const {
+    return !is_vdso() && !is_noreturn() && !is_blocking() &&
+           !has_attribute("nobatch", attributes) &&
+           !ret_spec.empty() && ret_spec[0].type == "mx_status_t";
+}
+
 size_t Syscall::num_kernel_args() const {
     return is_noreturn() ? arg_spec.size() : arg_spec.size() + ret_spec.size() - 1;
 }
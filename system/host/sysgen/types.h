@@ -62,6 +62,7 @@ struct Syscall {
     bool is_noreturn() const;
     bool is_no_wrap() const;
     bool is_blocking() const;
+    bool is_batchable() const;
     size_t num_kernel_args() const;
     void for_each_kernel_arg(const std::function<void(const TypeSpec&)>& cb) const;
     bool validate() const;
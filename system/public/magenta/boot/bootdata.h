@@ -42,6 +42,12 @@
 // Flag indicating that the bootfs is compressed.
 #define BOOTDATA_BOOTFS_FLAG_COMPRESSED  (1 << 0)
 
+// Flag indicating that the bootfs directory is not compressed, but each
+// file's data is a separate LZ4 frame.  The directory entries give the
+// offset and compressed length of each frame; the frame header holds the
+// file's size.  Files can then be decompressed as they are first used.
+#define BOOTDATA_BOOTFS_FLAG_FILE_COMPRESSED  (1 << 1)
+
 
 // These items are for passing from bootloader to kernel
 
@@ -70,6 +76,10 @@
 // Content: a uint64_t physical address of the table
 #define BOOTDATA_EFI_SYSTEM_TABLE (0x53494645) // EFIS
 
+// Bootloader Boot Stages
+// Content: bootdata_boot_stage_t[]
+#define BOOTDATA_BOOT_STAGES      (0x47545342) // BSTG
+
 #define BOOTDATA_IGNORE           (0x50494b53) // SKIP
 
 #ifndef ASSEMBLY
@@ -106,6 +116,14 @@ typedef struct {
     uint32_t format;
 } bootdata_swfb_t;
 
+// The start of one stage of the bootloader's work, timed with the same
+// clock the kernel uses for ktrace (the TSC on x86) so that the stages line
+// up with the kernel's own.
+typedef struct {
+    uint64_t ticks;
+    char name[24];
+} bootdata_boot_stage_t;
+
 typedef struct {
     uint64_t entry64;
     uint64_t reserved;
@@ -9,7 +9,7 @@
 
 // clang-format off
 
-#define BOOTLOADER_VERSION "0.5.2"
+#define BOOTLOADER_VERSION "0.5.3"
 
 #define NB_MAGIC              0xAA774217
 
@@ -29,6 +29,7 @@
 #define NB_WRITE              9 // arg=blocknum, data=data
 #define NB_CLOSE             10 // arg=0
 #define NB_LAST_DATA         11  // arg=blocknum, data=data
+#define NB_SEND_FILE_LZ4     12 // arg=uncompressed size, data=filename
 
 #define NB_ACK                0 // arg=0 or -err, NB_READ: data=data
 #define NB_FILE_RECEIVED      0x70000001 // arg=size
@@ -43,7 +44,8 @@
 
 #define NB_VERSION_1_0  0x0001000
 #define NB_VERSION_1_1  0x0001010
-#define NB_VERSION_CURRENT NB_VERSION_1_1
+#define NB_VERSION_1_2  0x0001020
+#define NB_VERSION_CURRENT NB_VERSION_1_2
 
 typedef struct nbmsg_t {
     uint32_t magic;
@@ -150,6 +150,10 @@ typedef struct audio2_rb_position_notify {
     // The current position (in bytes) of the driver/hardware's read (output) or
     // write (input) pointer in the ring buffer.
     uint32_t ring_buffer_pos;
+
+    // The value of mx_ticks_get() when ring_buffer_pos was sampled, so clients
+    // can relate the position to their own clock.
+    uint64_t position_ticks;
 } audio2_rb_position_notify_t;
 
 __END_CDECLS
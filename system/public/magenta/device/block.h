@@ -43,6 +43,13 @@
 #define IOCTL_BLOCK_FIFO_CLOSE \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_BLOCK, 10)
 
+// Configure the block cache (block-cache devices only)
+#define IOCTL_BLOCK_CACHE_CONFIG \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_BLOCK, 11)
+// Get the block cache's configuration and statistics (block-cache devices only)
+#define IOCTL_BLOCK_CACHE_GET_STATS \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_BLOCK, 12)
+
 // Block Core ioctls (specific to each block device):
 
 #define BLOCK_FLAG_READONLY  0x00000001
@@ -71,6 +78,28 @@ IOCTL_WRAPPER_VAROUT(ioctl_block_get_name, IOCTL_BLOCK_GET_NAME, char);
 // ssize_t ioctl_block_rr_part(int fd);
 IOCTL_WRAPPER(ioctl_block_rr_part, IOCTL_BLOCK_RR_PART);
 
+typedef struct {
+    uint64_t capacity;  // Bytes of memory the cache may use, 0 disables it
+    uint32_t readahead; // Cache lines to read past the end of a missed read
+    uint32_t reserved;
+} block_cache_config_t;
+
+typedef struct {
+    uint64_t capacity;
+    uint32_t readahead;
+    uint32_t line_size; // Bytes cached and evicted as a unit
+    uint64_t hits;      // Reads served entirely from the cache
+    uint64_t misses;    // Reads that went to the device
+    uint64_t prefetched; // Lines brought in by readahead
+    uint64_t evictions;
+} block_cache_stats_t;
+
+// ssize_t ioctl_block_cache_config(int fd, const block_cache_config_t* in);
+IOCTL_WRAPPER_IN(ioctl_block_cache_config, IOCTL_BLOCK_CACHE_CONFIG, block_cache_config_t);
+
+// ssize_t ioctl_block_cache_get_stats(int fd, block_cache_stats_t* out);
+IOCTL_WRAPPER_OUT(ioctl_block_cache_get_stats, IOCTL_BLOCK_CACHE_GET_STATS, block_cache_stats_t);
+
 // TODO(smklein): Move these to a separate file
 // Block Device ioctls (shared between all block devices):
 
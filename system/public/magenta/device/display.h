@@ -44,6 +44,33 @@ typedef struct mx_display_info {
 #define IOCTL_DISPLAY_SET_FULLSCREEN \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_DISPLAY, 4)
 
+// Scan out of a client VMO in place; it must hold a framebuffer in the
+// display's current mode.  The VMO is made write-combining if it isn't
+// mapped yet, so map it after importing it
+//   in: mx_handle_t (vmo)
+//   out: uint32_t (buffer id)
+#define IOCTL_DISPLAY_IMPORT_VMO \
+    IOCTL(IOCTL_KIND_SET_HANDLE, IOCTL_FAMILY_DISPLAY, 5)
+
+// Release an imported buffer, which must not be on screen or about to be
+//   in: uint32_t (buffer id)
+//   out: none
+#define IOCTL_DISPLAY_RELEASE_BUFFER \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_DISPLAY, 6)
+
+// Scan out of a buffer from the next vblank on; buffer id 0 is the
+// framebuffer returned by IOCTL_DISPLAY_GET_FB
+//   in: uint32_t (buffer id)
+//   out: none
+#define IOCTL_DISPLAY_FLIP \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_DISPLAY, 7)
+
+// Queue a packet on a port at each vblank
+//   in: ioctl_display_vsync_port_t
+//   out: none
+#define IOCTL_DISPLAY_SET_VSYNC_PORT \
+    IOCTL(IOCTL_KIND_SET_HANDLE, IOCTL_FAMILY_DISPLAY, 8)
+
 typedef struct {
     mx_handle_t vmo;
     mx_display_info_t info;
@@ -56,6 +83,21 @@ typedef struct {
     uint32_t height;
 } ioctl_display_region_t;
 
+typedef struct {
+    mx_handle_t port;
+    uint32_t reserved;
+    // key of the MX_PKT_TYPE_USER packets queued on |port|, whose user
+    // payload is a display_vsync_t
+    uint64_t key;
+} ioctl_display_vsync_port_t;
+
+typedef struct {
+    mx_time_t timestamp;
+    // the buffer on screen for the frame starting at this vblank
+    uint32_t buffer_id;
+    uint32_t reserved;
+} display_vsync_t;
+
 // ssize_t ioctl_display_get_fb(int fd, ioctl_display_get_fb_t* out);
 IOCTL_WRAPPER_OUT(ioctl_display_get_fb, IOCTL_DISPLAY_GET_FB, ioctl_display_get_fb_t);
 
@@ -67,3 +109,15 @@ IOCTL_WRAPPER_IN(ioctl_display_flush_fb_region, IOCTL_DISPLAY_FLUSH_FB_REGION, i
 
 // ssize_t ioctl_display_set_fullscreen(int fd, uint32_t in);
 IOCTL_WRAPPER_IN(ioctl_display_set_fullscreen, IOCTL_DISPLAY_SET_FULLSCREEN, uint32_t);
+
+// ssize_t ioctl_display_import_vmo(int fd, mx_handle_t* in, uint32_t* out_buffer_id);
+IOCTL_WRAPPER_INOUT(ioctl_display_import_vmo, IOCTL_DISPLAY_IMPORT_VMO, mx_handle_t, uint32_t);
+
+// ssize_t ioctl_display_release_buffer(int fd, const uint32_t* in);
+IOCTL_WRAPPER_IN(ioctl_display_release_buffer, IOCTL_DISPLAY_RELEASE_BUFFER, uint32_t);
+
+// ssize_t ioctl_display_flip(int fd, const uint32_t* in);
+IOCTL_WRAPPER_IN(ioctl_display_flip, IOCTL_DISPLAY_FLIP, uint32_t);
+
+// ssize_t ioctl_display_set_vsync_port(int fd, const ioctl_display_vsync_port_t* in);
+IOCTL_WRAPPER_IN(ioctl_display_set_vsync_port, IOCTL_DISPLAY_SET_VSYNC_PORT, ioctl_display_vsync_port_t);
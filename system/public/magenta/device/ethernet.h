@@ -25,7 +25,11 @@ typedef struct eth_info_t {
     uint32_t reserved[12];
 } eth_info_t;
 
-#define ETH_FEATURE_WLAN 1
+#define ETH_FEATURE_WLAN    1
+// the device checksums ETH_FIFO_TX_CSUM frames itself (others are
+// completed in software), and reports ETH_FIFO_RX_CSUM_OK
+#define ETH_FEATURE_TX_CSUM 2
+#define ETH_FEATURE_RX_CSUM 4
 
 // Get the fifos to submit tx and rx operations
 //   in: none
@@ -62,6 +66,59 @@ typedef struct eth_fifos_t {
 #define IOCTL_ETHERNET_TX_LISTEN_STOP \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_ETH, 6)
 
+// Receive from a buffer shared with other clients instead of the io buffer
+//   in: none
+//  out: mx_handle_t (vmo, read-only)
+#define IOCTL_ETHERNET_GET_RX_VMO \
+    IOCTL(IOCTL_KIND_GET_HANDLE, IOCTL_FAMILY_ETH, 7)
+
+// Choose the depths of the fifos, before they are obtained
+// Each must be a power of two no greater than ETH_FIFO_MAX_DEPTH,
+// or zero for the default (which is ETH_FIFO_MAX_DEPTH).
+//   in: eth_fifo_depths_t*
+//  out: none
+#define IOCTL_ETHERNET_SET_FIFO_DEPTHS \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_ETH, 8)
+
+// the largest fifo the kernel allows for eth_fifo_entry_t
+#define ETH_FIFO_MAX_DEPTH 256
+
+typedef struct eth_fifo_depths_t {
+    uint32_t tx_depth;
+    uint32_t rx_depth;
+} eth_fifo_depths_t;
+
+// Spread received packets over several rx fifos ("queues") by flow
+// (receive side scaling): the Toeplitz hash of a packet's addresses,
+// and ports for TCP and UDP, selects table[hash % ETH_RSS_TABLE_SIZE],
+// which is taken modulo queue_count.  Packets that are not IPv4 or IPv6
+// go to queue 0.  An all-zero key selects the usual default key.
+// The number of queues can be raised but not lowered, and this cannot
+// be combined with IOCTL_ETHERNET_GET_RX_VMO.
+//   in: eth_rss_config_t*
+//  out: none
+#define IOCTL_ETHERNET_SET_RSS \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_ETH, 9)
+
+// Get the rx fifo of queue n (1 <= n < queue_count); queue 0 is the rx
+// fifo from IOCTL_ETHERNET_GET_FIFOS.  Packets for a queue whose fifo
+// has not been obtained go to queue 0.  Rx fifos all have the same depth.
+//   in: uint32_t (queue)
+//  out: mx_handle_t (fifo)
+#define IOCTL_ETHERNET_GET_RX_QUEUE_FIFO \
+    IOCTL(IOCTL_KIND_GET_HANDLE, IOCTL_FAMILY_ETH, 10)
+
+#define ETH_RSS_MAX_QUEUES 16
+#define ETH_RSS_KEY_SIZE   40
+#define ETH_RSS_TABLE_SIZE 128
+
+typedef struct eth_rss_config_t {
+    uint32_t queue_count;
+    uint32_t reserved;
+    uint8_t key[ETH_RSS_KEY_SIZE];
+    uint8_t table[ETH_RSS_TABLE_SIZE];
+} eth_rss_config_t;
+
 
 // Operation
 //
@@ -79,19 +136,35 @@ typedef struct eth_fifos_t {
 // of the received packet.  The flags field will indicate success or a
 // specific failure condition.
 //
+// A client that has asked for the shared rx vmo no longer queues rx
+// buffers.  Each received packet is copied once into the shared vmo, and
+// every such client is sent an eth_fifo_entry_t on its rx fifo whose
+// offset and length locate the packet in that vmo (the cookie is NULL).
+// The client writes the entry back to its rx fifo when it is done with
+// the packet; until every client has done so that part of the vmo is not
+// reused.  A client holding more than half its rx fifo depth of entries
+// misses packets until it returns some.
+//
+// The driver reads and writes the fifos many entries at a time: a batch
+// of tx entries is handed to the ethermac together and completed with
+// one fifo write, and received packets are posted in batches as well.
+//
 // IMPORTANT: The driver *will not* buffer response messages.  It is the
 // client's responsibility to ensure that there is space in the reply side
 // of each fifo for each outstanding tx or rx request.  The fifo sizes
 // are returned along with the fifo handles in the eth_fifos_t.
 
 // flags values for request messages
-// - none -
+// Complete the TCP, UDP or ICMPv6 checksum of an IPv4 or IPv6 tx packet,
+// whose checksum field holds the (uncomplemented) pseudo-header sum.
+#define ETH_FIFO_TX_CSUM (8u)
 
 // flags values for response messages
-#define ETH_FIFO_RX_OK   (1u)   // packet received okay
-#define ETH_FIFO_TX_OK   (1u)   // packet transmitted okay
-#define ETH_FIFO_INVALID (2u)   // offset+length not within io_vmo bounds
-#define ETH_FIFO_RX_TX   (4u)   // received our own tx packet (when TX_LISTEN)
+#define ETH_FIFO_RX_OK      (1u)  // packet received okay
+#define ETH_FIFO_TX_OK      (1u)  // packet transmitted okay
+#define ETH_FIFO_INVALID    (2u)  // offset+length not within io_vmo bounds
+#define ETH_FIFO_RX_TX      (4u)  // received our own tx packet (when TX_LISTEN)
+#define ETH_FIFO_RX_CSUM_OK (16u) // device verified the TCP/UDP checksum
 
 typedef struct eth_fifo_entry {
     // offset from start of io_vmo to packet data
@@ -124,3 +197,17 @@ IOCTL_WRAPPER(ioctl_ethernet_tx_listen_start, IOCTL_ETHERNET_TX_LISTEN_START);
 
 // ssize_t ioctl_ethernet_tx_listen_stop(int fd);
 IOCTL_WRAPPER(ioctl_ethernet_tx_listen_stop, IOCTL_ETHERNET_TX_LISTEN_STOP);
+
+// ssize_t ioctl_ethernet_get_rx_vmo(int fd, mx_handle_t* out);
+IOCTL_WRAPPER_OUT(ioctl_ethernet_get_rx_vmo, IOCTL_ETHERNET_GET_RX_VMO, mx_handle_t);
+
+// ssize_t ioctl_ethernet_set_fifo_depths(int fd, const eth_fifo_depths_t* in);
+IOCTL_WRAPPER_IN(ioctl_ethernet_set_fifo_depths, IOCTL_ETHERNET_SET_FIFO_DEPTHS,
+                 eth_fifo_depths_t);
+
+// ssize_t ioctl_ethernet_set_rss(int fd, const eth_rss_config_t* in);
+IOCTL_WRAPPER_IN(ioctl_ethernet_set_rss, IOCTL_ETHERNET_SET_RSS, eth_rss_config_t);
+
+// ssize_t ioctl_ethernet_get_rx_queue_fifo(int fd, const uint32_t* queue, mx_handle_t* out);
+IOCTL_WRAPPER_INOUT(ioctl_ethernet_get_rx_queue_fifo, IOCTL_ETHERNET_GET_RX_QUEUE_FIFO,
+                    uint32_t, mx_handle_t);
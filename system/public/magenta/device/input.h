@@ -7,6 +7,7 @@
 #include <stdint.h>
 #include <magenta/device/ioctl.h>
 #include <magenta/device/ioctl-wrapper.h>
+#include <magenta/types.h>
 
 #define IOCTL_INPUT_GET_PROTOCOL \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_INPUT, 0)
@@ -26,6 +27,10 @@
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_INPUT, 7)
 #define IOCTL_INPUT_SET_REPORT \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_INPUT, 8)
+// Deliver input reports through a fifo rather than read(); see
+// input_fifo_entry_t
+#define IOCTL_INPUT_GET_REPORT_FIFO \
+    IOCTL(IOCTL_KIND_GET_HANDLE, IOCTL_FAMILY_INPUT, 9)
 
 enum {
     INPUT_PROTO_NONE = 0,
@@ -73,6 +78,24 @@ typedef struct boot_mouse_report {
 
 extern const boot_kbd_report_t report_err_rollover;
 
+// Once an instance hands out its report fifo, each input report is written
+// to it as one element instead of being queued for read().  The fifo is
+// created with MX_FIFO_SHARED_RING, so a reader can take every pending
+// report with one mx_fifo_read(), or map the ring and skip the syscalls.
+// Elements are INPUT_FIFO_ENTRY_SIZE(max) bytes, where max is the size from
+// IOCTL_INPUT_GET_MAX_REPORTSIZE.  Reports arriving while the fifo is full
+// are dropped.
+typedef struct input_fifo_entry {
+    // when the report arrived from the device, on MX_CLOCK_MONOTONIC
+    mx_time_t timestamp;
+    input_report_size_t len;
+    uint8_t reserved[6];
+    uint8_t data[];
+} input_fifo_entry_t;
+
+#define INPUT_FIFO_ENTRY_SIZE(max_report) \
+    ((sizeof(input_fifo_entry_t) + (max_report) + 7) & ~(size_t)7)
+
 // ssize_t ioctl_input_get_protocol(int fd, int* out);
 IOCTL_WRAPPER_OUT(ioctl_input_get_protocol, IOCTL_INPUT_GET_PROTOCOL, int);
 
@@ -103,3 +126,6 @@ IOCTL_WRAPPER_IN_VAROUT(ioctl_input_get_report, IOCTL_INPUT_GET_REPORT,
 
 // ssize_t ioctl_input_set_report(int fd, const input_set_report_t* in, size_t in_len);
 IOCTL_WRAPPER_VARIN(ioctl_input_set_report, IOCTL_INPUT_SET_REPORT, input_set_report_t);
+
+// ssize_t ioctl_input_get_report_fifo(int fd, mx_handle_t* out);
+IOCTL_WRAPPER_OUT(ioctl_input_get_report_fifo, IOCTL_INPUT_GET_REPORT_FIFO, mx_handle_t);
@@ -29,12 +29,28 @@
 // Watch a directory for changes
 //   in: none
 //   out: handle to channel to get notified on.
-//        Notification messages will be a string child entry name WITHOUT a
-//        null-terminating character; the length of the string should be
-//        determined by the message length during the channel read.
+//        Each notification message is a run of vfs_watch_msg_t records, one
+//        per event, packed back to back with no padding and together at most
+//        VFS_WATCH_MSG_MAX bytes. Events arriving close together are
+//        coalesced into one message.
 #define IOCTL_VFS_WATCH_DIR \
     IOCTL(IOCTL_KIND_GET_HANDLE, IOCTL_FAMILY_VFS, 7)
 
+// Events reported by IOCTL_VFS_WATCH_DIR
+#define VFS_WATCH_EVT_ADDED    1 // the entry was added or renamed into the directory
+#define VFS_WATCH_EVT_REMOVED  2 // the entry was removed or renamed out of the directory
+#define VFS_WATCH_EVT_MODIFIED 3 // the entry's contents were replaced (opened with O_TRUNC)
+#define VFS_WATCH_EVT_OVERFLOW 4 // events were lost: rescan the directory (|len| is 0)
+
+// The longest notification message
+#define VFS_WATCH_MSG_MAX 8192
+
+typedef struct vfs_watch_msg {
+    uint8_t event;
+    uint8_t len; // of name, which is NOT null-terminated
+    char name[];
+} vfs_watch_msg_t;
+
 // ssize_t ioctl_vfs_mount_fs(int fd, mx_handle_t* in);
 IOCTL_WRAPPER_IN(ioctl_vfs_mount_fs, IOCTL_VFS_MOUNT_FS, mx_handle_t);
 
@@ -0,0 +1,20 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+// clang-format off
+
+// Kinds of features which can be asked for with mx_system_get_features().
+#define MX_FEATURE_KIND_CPU          0
+
+// arm64 instruction set features, from ID_AA64PFR0_EL1 and ID_AA64ISAR0_EL1.
+// On x86 the CPU kind reports no features; use cpuid there.
+#define MX_ARM64_FEATURE_ISA_FP      (1u << 1)
+#define MX_ARM64_FEATURE_ISA_ASIMD   (1u << 2)
+#define MX_ARM64_FEATURE_ISA_AES     (1u << 3)
+#define MX_ARM64_FEATURE_ISA_PMULL   (1u << 4)
+#define MX_ARM64_FEATURE_ISA_SHA1    (1u << 5)
+#define MX_ARM64_FEATURE_ISA_SHA2    (1u << 6)
+#define MX_ARM64_FEATURE_ISA_CRC32   (1u << 7)
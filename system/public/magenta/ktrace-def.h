@@ -10,6 +10,7 @@
 
 KTRACE_DEF(0x000,32B,VERSION,META) // version
 KTRACE_DEF(0x001,32B,TICKS_PER_MS,META) // lo32, hi32
+// 0x002 is TAG_PAD(), see magenta/ktrace.h
 
 KTRACE_DEF(0x020,NAME,KTHREAD_NAME,META) // ktid, 0, name[]
 KTRACE_DEF(0x021,NAME,THREAD_NAME,META) // tid, pid, name[]
@@ -17,6 +18,8 @@ KTRACE_DEF(0x022,NAME,PROC_NAME,META) // pid, 0, name[]
 KTRACE_DEF(0x023,NAME,SYSCALL_NAME,META) // num, 0, name[]
 KTRACE_DEF(0x024,NAME,IRQ_NAME,META) // num, 0, name[]
 KTRACE_DEF(0x025,NAME,PROBE_NAME,META) // num, 0, name[]
+KTRACE_DEF(0x026,NAME,BOOT_STAGE,META) // ts_lo32, ts_hi32, name[]
+KTRACE_DEF(0x027,NAME,LOCK_CLASS_NAME,META) // id, kind, name[]
 
 KTRACE_DEF(0x030,16B,IRQ_ENTER,IRQ) // (irqn << 8) | cpu
 KTRACE_DEF(0x031,16B,IRQ_EXIT,IRQ) // (irqn << 8) | cpu
@@ -24,8 +27,16 @@ KTRACE_DEF(0x032,16B,SYSCALL_ENTER,IRQ) // (n << 8) | cpu
 KTRACE_DEF(0x033,16B,SYSCALL_EXIT,IRQ) // (n << 8) | cpu
 
 KTRACE_DEF(0x034,32B,PAGE_FAULT,IRQ) // virtual_address_hi, virtual_address_lo, flags, cpu
+KTRACE_DEF(0x035,32B,IRQSOFF,IRQ) // cpu, length-ns, start-pc-lo32, end-pc-lo32
+KTRACE_DEF(0x036,32B,IRQSOFF_STALL,IRQ) // cpu, length-ns-so-far, start-pc-lo32
 
 KTRACE_DEF(0x040,32B,CONTEXT_SWITCH,SCHEDULER) // to-tid, (state<<16|cpu), from-kt, to-kt
+KTRACE_DEF(0x041,32B,MUTEX_CONTEND,SCHEDULER) // mutex-lo32, spins, blocked, cpu
+KTRACE_DEF(0x042,32B,LOCK_CLASS,SCHEDULER) // id, key-lo32, key-hi32, kind
+KTRACE_DEF(0x043,32B,LOCK_COUNTS,SCHEDULER) // id, acquires, contended
+KTRACE_DEF(0x044,32B,LOCK_TIMES,SCHEDULER) // id, wait=0/hold=1, total-us, max-us
+KTRACE_DEF(0x045,32B,LOCK_HIST,SCHEDULER) // id, (hold<<8)|log2-ns, count
+KTRACE_DEF(0x046,32B,LOCK_CALLER,SCHEDULER) // id, pc-lo32, pc-hi32, count
 
 // events from 0x100 on all share the tag/tid/ts common header
 
@@ -51,6 +62,8 @@ KTRACE_DEF(0x143,32B,PORT_QUEUE,IPC) // id, size
 KTRACE_DEF(0x150,32B,WAIT_ONE,IPC) // id, signals, timeoutlo, timeouthi
 KTRACE_DEF(0x151,32B,WAIT_ONE_DONE,IPC) // id, status, pending
 
+// 0x160 is TAG_SAMPLE(n), which varies in size
+
 // events from 0x200-0x2ff are for arch-specific needs
 
 #ifdef __x86_64__
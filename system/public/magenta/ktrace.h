@@ -36,6 +36,10 @@ __BEGIN_CDECLS
 
 #define KTRACE_VERSION            (0x00020000)
 
+// Records never straddle a block, so a reader can start at any block
+// boundary of a circular trace.
+#define KTRACE_BLOCKSIZE          (4096)
+
 // Filter Groups
 #define KTRACE_GRP_ALL            0xFFF
 #define KTRACE_GRP_META           0x001
@@ -46,6 +50,7 @@ __BEGIN_CDECLS
 #define KTRACE_GRP_IRQ            0x020
 #define KTRACE_GRP_PROBE          0x040
 #define KTRACE_GRP_ARCH           0x080
+#define KTRACE_GRP_SAMPLE         0x100
 
 #define KTRACE_GRP_TO_MASK(grp)   ((grp) << 20)
 
@@ -75,6 +80,21 @@ typedef struct ktrace_rec_name {
     char name[1];
 } ktrace_rec_name_t;
 
+// A stack sample from KTRACE_ACTION_SAMPLE_START. The header's tid is the
+// sampled thread. pcs[0] is the interrupted pc, followed by its callers
+// when it was in the kernel.
+#define KTRACE_SAMPLE_MAX_FRAMES  12
+#define KTRACE_SAMPLE_FLAG_USER   (1u << 16) // the pc is in user mode
+
+typedef struct ktrace_rec_sample {
+    uint32_t tag;
+    uint32_t tid;
+    uint64_t ts;
+    uint32_t pid;
+    uint32_t flags; // cpu number in the low 16 bits
+    uint64_t pcs[KTRACE_SAMPLE_MAX_FRAMES];
+} ktrace_rec_sample_t;
+
 #define KTRACE_DEF(num,type,name,group) TAG_##name = KTRACE_TAG_##type(num,KTRACE_GRP_##group),
 enum {
 #include <magenta/ktrace-def.h>
@@ -83,10 +103,21 @@ enum {
 #define TAG_PROBE_16(n) KTRACE_TAG(((n)|0x800),KTRACE_GRP_PROBE,16)
 #define TAG_PROBE_24(n) KTRACE_TAG(((n)|0x800),KTRACE_GRP_PROBE,24)
 
+// A sample with n frames
+#define TAG_SAMPLE(n) KTRACE_TAG(0x160,KTRACE_GRP_SAMPLE,24+8*(n))
+#define KTRACE_SAMPLE_NUM_FRAMES(tag) ((KTRACE_LEN(tag) - 24) / 8)
+
+// Fills out the end of a block, only the tag is written and readers skip it
+#define TAG_PAD(siz) KTRACE_TAG(0x002,KTRACE_GRP_META,siz)
+
 // Actions for ktrace control
 #define KTRACE_ACTION_START     1 // options = grpmask, 0 = all
 #define KTRACE_ACTION_STOP      2 // options ignored
 #define KTRACE_ACTION_REWIND    3 // options ignored
 #define KTRACE_ACTION_NEW_PROBE 4 // options ignored, ptr = name
+#define KTRACE_ACTION_START_CIRCULAR 5 // options = grpmask, 0 = all
+#define KTRACE_ACTION_BOOT_STAGE 6 // options ignored, ptr = name
+#define KTRACE_ACTION_SAMPLE_START 7 // options = period in us, 0 = 1000
+#define KTRACE_ACTION_SAMPLE_STOP 8 // options ignored
 
 __END_CDECLS
@@ -10,13 +10,18 @@
 
 #pragma once
 
+#include <magenta/compiler.h>
+#include <stdint.h>
+
 __BEGIN_CDECLS
 
-// mtrace_control() can operate on a range of features, for now just IPT.
+// mtrace_control() can operate on a range of features, for now IPT and the
+// performance monitoring counters.
 // It's an abstraction that doesn't mean much, and will likely be replaced
 // before it's useful; it's here in the interests of hackability in the
 // interim.
 #define MTRACE_KIND_IPT 0
+#define MTRACE_KIND_PERFMON 1
 
 // Actions for perf_control
 
@@ -45,4 +50,72 @@ __BEGIN_CDECLS
 
 #define MTRACE_IPT_OPTIONS_CPU(options) ((options) & MTRACE_IPT_OPTIONS_CPU_MASK)
 
+// Actions for MTRACE_KIND_PERFMON
+
+// Fetch an mx_perfmon_properties_t describing the counters.
+#define MTRACE_PERFMON_GET_PROPERTIES 0
+
+// Program every cpu with the mx_perfmon_config_t passed and start counting.
+#define MTRACE_PERFMON_START 1
+
+// Stop counting. The counts stay readable until the next start.
+#define MTRACE_PERFMON_STOP 2
+
+// Fetch an mx_perfmon_counts_t for the cpu in options, which may be
+// MTRACE_PERFMON_ALL_CPUS for the sum over every cpu. Works while counting.
+#define MTRACE_PERFMON_GET_COUNTS 3
+
+#define MTRACE_PERFMON_OPTIONS_CPU_MASK 0x3f
+#define MTRACE_PERFMON_OPTIONS(cpu) ((cpu) & MTRACE_PERFMON_OPTIONS_CPU_MASK)
+#define MTRACE_PERFMON_ALL_CPUS 32
+#define MTRACE_PERFMON_OPTIONS_CPU(options) ((options) & MTRACE_PERFMON_OPTIONS_CPU_MASK)
+
+// The events which can be counted. These are the ones every cpu with a
+// performance monitoring unit can count, so they mean the same everywhere.
+#define MX_PERFMON_EVENT_NONE 0
+#define MX_PERFMON_EVENT_CYCLES 1
+#define MX_PERFMON_EVENT_INSTRUCTIONS 2
+#define MX_PERFMON_EVENT_REF_CYCLES 3
+#define MX_PERFMON_EVENT_CACHE_REFERENCES 4 // last level cache
+#define MX_PERFMON_EVENT_CACHE_MISSES 5 // last level cache
+#define MX_PERFMON_EVENT_BRANCHES 6
+#define MX_PERFMON_EVENT_BRANCH_MISSES 7
+#define MX_PERFMON_NUM_EVENTS 8
+
+#define MX_PERFMON_MAX_COUNTERS 8
+
+// Count what happens in user mode and kernel mode respectively. Neither
+// means both.
+#define MX_PERFMON_FLAG_USER (1u << 0)
+#define MX_PERFMON_FLAG_KERNEL (1u << 1)
+
+typedef struct {
+    // Architectural performance monitoring version, 0 if there is none.
+    uint32_t version;
+    // How many events can be counted at once.
+    uint32_t num_counters;
+    // Width of each counter in bits.
+    uint32_t counter_width;
+    // Bit (1u << MX_PERFMON_EVENT_*) is set for each event this cpu has.
+    uint32_t events;
+} mx_perfmon_properties_t;
+
+typedef struct {
+    // Counter i counts events[i]; unused counters are MX_PERFMON_EVENT_NONE.
+    uint32_t events[MX_PERFMON_MAX_COUNTERS];
+    // MX_PERFMON_FLAG_* values.
+    uint32_t flags;
+    uint32_t reserved;
+    // If not zero, only count while the thread with this koid is running.
+    // Its counts are spread across the cpus it ran on.
+    uint64_t thread_koid;
+    // If not zero, every |sample_period| occurrences of events[0] record
+    // what was running in the KTRACE_GRP_SAMPLE ktrace group.
+    uint64_t sample_period;
+} mx_perfmon_config_t;
+
+typedef struct {
+    uint64_t counts[MX_PERFMON_MAX_COUNTERS];
+} mx_perfmon_counts_t;
+
 __END_CDECLS
@@ -7,7 +7,10 @@
 #include <magenta/types.h>
 #include <magenta/syscalls/types.h>
 
+#include <magenta/syscalls/batch.h>
 #include <magenta/syscalls/pci.h>
+#include <magenta/syscalls/port.h>
+#include <magenta/syscalls/profile.h>
 #include <magenta/syscalls/resource.h>
 
 __BEGIN_CDECLS
@@ -0,0 +1,31 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <magenta/types.h>
+
+__BEGIN_CDECLS
+
+// ask clang format not to mess up the indentation:
+// clang-format off
+
+// mx_syscall_batch() options
+#define MX_BATCH_STOP_ON_ERROR  1u  // don't run anything after a failed op
+
+// The most operations one mx_syscall_batch() call accepts.
+#define MX_BATCH_MAX_OPS        64u
+
+// One syscall to run from mx_syscall_batch(). Fill these in with the
+// mx_batch_op_*() functions from <magenta/syscalls/batch-ops.h> rather
+// than by hand, they take the same arguments as the syscall itself.
+typedef struct mx_batch_op {
+    uint32_t syscall_num;
+    // Set by the kernel to what the syscall returned, or to ERR_CANCELED
+    // if MX_BATCH_STOP_ON_ERROR skipped it.
+    mx_status_t status;
+    uint64_t args[8];
+} mx_batch_op_t;
+
+__END_CDECLS
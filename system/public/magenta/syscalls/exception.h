@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <magenta/syscalls/debug.h>
 #include <magenta/types.h>
 
 __BEGIN_CDECLS
@@ -126,6 +127,40 @@ typedef struct mx_exception_report {
     mx_exception_context_t context;
 } mx_exception_report_t;
 
+// An in-thread exception handler, set with the MX_PROP_EXCEPTION_HANDLER
+// property of the thread itself.
+// When the thread gets an architectural exception other than a breakpoint
+// that no debugger handles, it is made to call |pc| as
+//   void handler(mx_exception_frame_t* frame);
+// on the stack [|stack|, |stack| + |stack_size|), which must be able to hold
+// the frame. When the handler returns, the thread resumes with |frame->regs|,
+// which the handler may change, e.g. to step over the faulting instruction.
+// Exceptions taken while the handler runs go to the exception ports instead.
+// A handler that can't deal with an exception can clear the property and
+// return; the exception then happens again and goes to the exception ports.
+// Setting |pc| to zero removes the handler.
+typedef struct mx_exception_handler {
+    uintptr_t pc;
+    uintptr_t stack;
+    size_t stack_size;
+} mx_exception_handler_t;
+
+// What an in-thread exception handler is passed.
+typedef struct mx_exception_frame {
+    mx_exception_report_t report;
+    // The thread's general registers when the exception happened.
+#if defined(__x86_64__)
+    mx_x86_64_general_regs_t regs;
+#elif defined(__aarch64__)
+    mx_arm64_general_regs_t regs;
+#endif
+} mx_exception_frame_t;
+
+// In-thread exception handlers are called with this as their return
+// address. It is in the never-mapped first page of the address space, so
+// returning there faults, which the kernel takes as the end of the handler.
+#define MX_EXCEPTION_HANDLER_RETURN_PC ((uintptr_t)0xe0)
+
 // Options for mx_task_resume()
 #define MX_RESUME_EXCEPTION (1)
 // Indicates that we should resume the thread from stopped-in-exception state
@@ -6,6 +6,8 @@
 
 #pragma once
 
+#include <magenta/types.h>
+
 #define MX_HYPERVISOR_OP_GUEST_CREATE       1u
 #define MX_HYPERVISOR_OP_GUEST_ENTER        2u
 
@@ -14,5 +16,17 @@
 #if __x86_64__
 #define MX_HYPERVISOR_OP_GUEST_SET_CR3      4u
 #define MX_HYPERVISOR_OP_GUEST_SET_ESI      5u
+#define MX_HYPERVISOR_OP_GUEST_SET_IO_TRAP  6u
+
+// Arguments to MX_HYPERVISOR_OP_GUEST_SET_IO_TRAP. Writes by the guest to
+// |io_port| are queued on |port| as MX_PKT_TYPE_GUEST_IO packets with |key|,
+// without the guest leaving the kernel. Writes made before the packet is
+// dequeued are coalesced into it.
+typedef struct mx_guest_io_trap {
+    mx_handle_t port;
+    uint16_t io_port;
+    uint16_t reserved;
+    uint64_t key;
+} mx_guest_io_trap_t;
 #endif // __x86_64__
 
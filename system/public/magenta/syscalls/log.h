@@ -32,4 +32,30 @@ typedef struct mx_log_record {
 
 #define MX_LOG_FLAG_READABLE  0x40000000
 
+// Option for mx_log_read(): rather than one record, read as many as the
+// buffer is sure to hold, each starting where the last one's
+// MX_LOG_RECORD_SIZE() ends.
+#define MX_LOG_READ_MULTIPLE  0x1
+
+#define MX_LOG_RECORD_SIZE(rec) \
+    ((sizeof(mx_log_record_t) + (rec)->datalen + 3u) & ~3u)
+
+// Option for mx_log_write(): the buffer holds several entries, each an
+// mx_log_entry_t and its data, starting where the last one's
+// MX_LOG_ENTRY_SIZE() ends. Each entry becomes one record, as if written
+// on its own, but the whole batch costs a single call.
+#define MX_LOG_WRITE_MULTIPLE 0x1
+
+// The most bytes of entries one mx_log_write() takes.
+#define MX_LOG_WRITE_MULTIPLE_MAX 4096
+
+typedef struct mx_log_entry {
+    uint16_t datalen;
+    uint16_t reserved;
+    char data[0];
+} mx_log_entry_t;
+
+#define MX_LOG_ENTRY_SIZE(entry) \
+    ((sizeof(mx_log_entry_t) + (entry)->datalen + 3u) & ~3u)
+
 __END_CDECLS
@@ -27,6 +27,12 @@ typedef enum {
     MX_INFO_THREAD_EXCEPTION_REPORT    = 11, // mx_exception_report_t[1]
     MX_INFO_TASK_STATS                 = 12, // mx_info_task_stats_t[1]
     MX_INFO_PROCESS_MAPS               = 13, // mx_info_maps_t[n]
+    MX_INFO_SYSCALL_LATENCY            = 14, // mx_info_syscall_latency_t[n]
+    MX_INFO_THREAD_STATS               = 15, // mx_info_thread_stats_t[1]
+    MX_INFO_JOB_TREE                   = 16, // mx_info_task_record_t[n]
+    MX_INFO_KMEM_STATS                 = 17, // mx_info_kmem_stats_t[1]
+    MX_INFO_JOB_CACHE_OCCUPANCY        = 18, // mx_info_cache_occupancy_t[1]
+    MX_INFO_JOB_MEMORY                 = 19, // mx_info_job_memory_t[1]
     MX_INFO_LAST
 } mx_object_info_topic_t;
 
@@ -122,6 +128,137 @@ typedef struct mx_info_task_stats {
     size_t mem_committed_bytes;
 } mx_info_task_stats_t;
 
+// Scheduler statistics of a thread. For a process these are summed over its
+// threads, including the ones which have exited, and for a job over all the
+// processes in it and in its child jobs.
+typedef struct mx_info_thread_stats {
+    // Time spent running on a cpu, in nanoseconds.
+    uint64_t runtime_ns;
+
+    // Time spent runnable but waiting for a cpu, in nanoseconds.
+    uint64_t wait_ns;
+
+    // Number of times the thread gave up the cpu by blocking or sleeping.
+    uint64_t voluntary_switches;
+
+    // Number of times the thread was switched out while still runnable,
+    // by preemption or by yielding.
+    uint64_t involuntary_switches;
+
+    // Number of page faults taken.
+    uint64_t page_faults;
+} mx_info_thread_stats_t;
+
+// Last level cache used by a job with a cache allocation policy, as reported
+// by MX_INFO_JOB_CACHE_OCCUPANCY.
+typedef struct mx_info_cache_occupancy {
+    // Bytes of the cache holding lines filled by the job's threads, summed
+    // over all packages.
+    uint64_t l3_bytes;
+} mx_info_cache_occupancy_t;
+
+// Memory committed by a job and its descendants, as reported by
+// MX_INFO_JOB_MEMORY.
+typedef struct mx_info_job_memory {
+    // Bytes of VMO pages charged to the job. This may run ahead of what is
+    // actually committed by a few pages per cpu.
+    uint64_t committed_bytes;
+    // The limits set with MX_JOB_POL_MEMORY, zero if none.
+    uint64_t soft_limit;
+    uint64_t hard_limit;
+    // Commits refused because of the job's hard limit.
+    uint64_t failed_commits;
+} mx_info_job_memory_t;
+
+// One task in the tree returned by MX_INFO_JOB_TREE.
+typedef struct mx_info_task_record {
+    // The task's koid, and the koid of the job or process it belongs to.
+    mx_koid_t koid;
+    mx_koid_t parent_koid;
+
+    // MX_OBJ_TYPE_JOB, MX_OBJ_TYPE_PROCESS or MX_OBJ_TYPE_THREAD.
+    uint32_t type;                // mx_obj_type_t;
+
+    // The distance from the queried job, which has depth 0. A process's
+    // threads are one deeper than the process.
+    uint32_t depth;
+
+    char name[MX_MAX_NAME_LEN];
+
+    // Only valid for processes. |task| is zero if the process is no longer
+    // running.
+    mx_info_process_t process;
+    mx_info_task_stats_t task;
+
+    // Only valid for threads.
+    mx_info_thread_t thread;
+
+    // As reported by MX_INFO_THREAD_STATS: summed over a process's threads,
+    // and over everything below a job.
+    mx_info_thread_stats_t sched;
+} mx_info_task_record_t;
+
+#define MX_INFO_SYSCALL_LATENCY_BUCKETS 32
+
+// Latency histogram of one syscall, summed over all cpus.
+typedef struct mx_info_syscall_latency {
+    // The MX_SYS_ number of the syscall.
+    uint32_t syscall_num;
+    uint32_t reserved;
+
+    // Total number of calls.
+    uint64_t count;
+
+    // buckets[i] counts the calls that took [2^i, 2^(i+1)) nanoseconds from
+    // kernel entry to exit. Bucket 0 also holds the calls under a nanosecond,
+    // and the last bucket every call longer than its lower bound.
+    uint64_t buckets[MX_INFO_SYSCALL_LATENCY_BUCKETS];
+} mx_info_syscall_latency_t;
+
+// Where the kernel's memory goes, as reported by MX_INFO_KMEM_STATS on the
+// root resource. All sizes are in bytes.
+typedef struct mx_info_kmem_stats {
+    // Physical memory managed by the kernel, and how much of it is free.
+    uint64_t total_bytes;
+    uint64_t free_bytes;
+
+    // Pages wired for the kernel image, boot allocations and committed vmos.
+    uint64_t wired_bytes;
+
+    // Pages given to the kernel heap, and how much of them is allocated.
+    uint64_t heap_bytes;
+    uint64_t heap_used_bytes;
+
+    // Pages holding page tables.
+    uint64_t mmu_bytes;
+
+    // Pages committed to paged vmos.
+    uint64_t vmo_bytes;
+
+    // Pages allocated for any other use, mostly by the kernel itself.
+    uint64_t other_bytes;
+
+    // Paged vmo memory covered by pins, counted once per pin.
+    uint64_t pinned_bytes;
+
+    // Memory reachable through physical vmos. These pages are not counted
+    // above unless they are also allocated.
+    uint64_t physical_vmo_bytes;
+
+    // Handles that exist across all processes.
+    uint64_t handle_count;
+
+    // Pages of anonymous vmos the kernel holds compressed, by their original
+    // size, and the memory the compressed data takes.
+    uint64_t compressed_bytes;
+    uint64_t compressed_pool_bytes;
+
+    // Compressed pages brought back on use, and pages the compressed store
+    // turned away because they didn't shrink enough or didn't fit.
+    uint64_t compressed_hits;
+    uint64_t compressed_misses;
+} mx_info_kmem_stats_t;
+
 typedef struct mx_info_vmar {
     // Base address of the region.
     uintptr_t base;
@@ -141,6 +278,11 @@ typedef struct mx_info_maps_mapping {
     // The number of PAGE_SIZE pages in the mapped region of the VMO
     // that are backed by physical memory.
     size_t committed_pages;
+    // The number of PAGE_SIZE pages in the mapped region that the VMO
+    // does not hold itself but reads through to from a copy-on-write
+    // parent, sharing them with it and any other clones. Not included in
+    // committed_pages.
+    size_t shared_pages;
 } mx_info_maps_mapping_t;
 
 // Types of entries represented by mx_info_maps_t.
@@ -194,6 +336,13 @@ typedef struct mx_info_maps {
 // Argument is the base address of the vDSO mapping (or zero), a uintptr_t.
 #define MX_PROP_PROCESS_VDSO_BASE_ADDRESS   6u
 
+// Argument is a mx_exception_handler_t. Only settable on the calling thread.
+#define MX_PROP_EXCEPTION_HANDLER           7u
+
+// Argument is a uint32_t, nonzero to let the kernel compress the cold pages of
+// VMOs later created in the job under memory pressure. Inherited by new child jobs.
+#define MX_PROP_JOB_COMPRESS_MEMORY         8u
+
 // Values for mx_info_thread_t.state.
 #define MX_THREAD_STATE_NEW                 0u
 #define MX_THREAD_STATE_RUNNING             1u
@@ -48,4 +48,50 @@ typedef struct mx_policy_basic {
 #define MX_POL_ACTION_ALARM                 2u
 #define MX_POL_ACTION_KILL                  5u
 
+// Cache and memory bandwidth allocation topic. With MX_JOB_POL_ABSOLUTE
+// the call fails if the hardware can't do all of what is asked, with
+// MX_JOB_POL_RELATIVE whatever it can't do is left out.
+#define MX_JOB_POL_RDT                      1u
+
+// Input structure to use with MX_JOB_POL_RDT; exactly one is passed.
+typedef struct mx_policy_rdt {
+    // Ways of the last level cache the job's threads may fill, all of them
+    // if zero. The bits set must be contiguous.
+    uint64_t l3_mask;
+    // Percent of delay added to the job's memory requests, none if zero.
+    uint32_t mba_delay;
+    uint32_t reserved;
+} mx_policy_rdt_t;
+
+// Cpu bandwidth topic. Limits apply to the job and everything below it, on
+// top of those of its ancestors, whichever mode is used.
+#define MX_JOB_POL_CPU                      2u
+
+// Input structure to use with MX_JOB_POL_CPU; exactly one is passed.
+typedef struct mx_policy_cpu {
+    // Relative share of the cpu among threads of the same priority, from 1 to
+    // MX_CPU_WEIGHT_MAX. MX_CPU_WEIGHT_DEFAULT is what jobs start out with.
+    uint32_t weight;
+    uint32_t reserved;
+    // Cpu time the job may use every period, summed over all cpus. Unlimited
+    // if zero.
+    mx_duration_t quota;
+    mx_duration_t period;
+} mx_policy_cpu_t;
+
+#define MX_CPU_WEIGHT_DEFAULT               100u
+#define MX_CPU_WEIGHT_MAX                   10000u
+
+#define MX_JOB_POL_MEMORY                   3u
+
+// Input structure to use with MX_JOB_POL_MEMORY; exactly one is passed.
+typedef struct mx_policy_memory {
+    // Bytes of VMO pages the job's processes and child jobs may have
+    // committed. Past the soft limit the job asserts
+    // MX_JOB_MEMORY_OVER_SOFT_LIMIT; commits that would go past the hard limit
+    // fail with ERR_NO_MEMORY. Zero for no limit.
+    uint64_t soft_limit;
+    uint64_t hard_limit;
+} mx_policy_memory_t;
+
 __END_CDECLS
@@ -12,6 +12,9 @@ __BEGIN_CDECLS
 // mx_port_create() options.
 #define MX_PORT_OPT_V1 0u
 #define MX_PORT_OPT_V2 1u
+// Only valid with MX_PORT_OPT_V2: queue packets per cpu and wake the most
+// recent waiter first. Packets are no longer dequeued in global FIFO order.
+#define MX_PORT_OPT_PERCPU 2u
 
 // mx_port V1 packet structures.
 
@@ -46,10 +49,16 @@ typedef struct mx_exception_packet {
 #define MX_WAIT_ASYNC_ONCE          0u
 #define MX_WAIT_ASYNC_REPEATING     1u
 
+// The most packets mx_port_wait_many() returns at once.
+#define MX_PORT_MAX_BATCH           64u
+
 // packet types.
 #define MX_PKT_TYPE_USER            0u
 #define MX_PKT_TYPE_SIGNAL_ONE      1u
 #define MX_PKT_TYPE_SIGNAL_REP      2u
+#define MX_PKT_TYPE_INTERRUPT       3u
+#define MX_PKT_TYPE_GUEST_IO        4u
+#define MX_PKT_TYPE_PAGE_REQUEST    5u
 
 // port_packet_t::type MX_PKT_TYPE_USER.
 typedef union mx_packet_user {
@@ -66,6 +75,34 @@ typedef struct mx_packet_signal {
     uint64_t count;
 } mx_packet_signal_t;
 
+// port_packet_t::type MX_PKT_TYPE_INTERRUPT.
+typedef struct mx_packet_interrupt {
+    // When the first of the interrupts in this packet fired.
+    mx_time_t timestamp;
+    // How many times the interrupt fired since the packet was last dequeued.
+    uint64_t count;
+} mx_packet_interrupt_t;
+
+// port_packet_t::type MX_PKT_TYPE_GUEST_IO.
+typedef struct mx_packet_guest_io {
+    // The trapped IO port, and the size of the last write to it.
+    uint16_t port;
+    uint8_t access_size;
+    uint8_t reserved0;
+    // The value of the last write.
+    uint32_t data;
+    // How many writes there were since the packet was last dequeued.
+    uint64_t count;
+} mx_packet_guest_io_t;
+
+// port_packet_t::type MX_PKT_TYPE_PAGE_REQUEST.
+typedef struct mx_packet_page_request {
+    // The range of the pager VMO holding the pages threads have faulted on
+    // since the packet was last dequeued.
+    uint64_t offset;
+    uint64_t length;
+} mx_packet_page_request_t;
+
 typedef struct mx_port_packet {
     uint64_t key;
     uint32_t type;
@@ -73,6 +110,9 @@ typedef struct mx_port_packet {
     union {
         mx_packet_user_t user;
         mx_packet_signal_t signal;
+        mx_packet_interrupt_t interrupt;
+        mx_packet_guest_io_t guest_io;
+        mx_packet_page_request_t page_request;
     };
 } mx_port_packet_t;
 
@@ -0,0 +1,36 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <magenta/types.h>
+
+__BEGIN_CDECLS
+
+// ask clang format not to mess up the indentation:
+// clang-format off
+
+// mx_profile_t::type
+#define MX_PROFILE_TYPE_PRIORITY    0u  // default strict priority round robin
+#define MX_PROFILE_TYPE_DEADLINE    1u  // earliest deadline first reservation
+
+// MX_PROFILE_TYPE_DEADLINE: the thread may run for up to |capacity| within
+// |deadline| of each activation, and is activated at most once per |period|.
+// Requires capacity <= deadline <= period.
+typedef struct mx_profile_deadline {
+    mx_duration_t capacity;
+    mx_duration_t deadline;
+    mx_duration_t period;
+} mx_profile_deadline_t;
+
+typedef struct mx_profile {
+    uint32_t type;
+    uint32_t reserved;
+    union {
+        mx_profile_deadline_t deadline;
+        uint8_t padding[64];
+    };
+} mx_profile_t;
+
+__END_CDECLS
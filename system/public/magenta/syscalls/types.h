@@ -10,5 +10,6 @@ __BEGIN_CDECLS
 typedef struct mx_pcie_device_info mx_pcie_device_info_t;
 typedef struct mx_pci_init_arg mx_pci_init_arg_t;
 typedef union mx_rrec mx_rrec_t;
+typedef struct mx_profile mx_profile_t;
 
 __END_CDECLS
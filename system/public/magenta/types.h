@@ -136,6 +136,8 @@ typedef uint32_t mx_signals_t;
 // Job
 #define MX_JOB_NO_PROCESSES         __MX_OBJECT_SIGNALED
 #define MX_JOB_NO_JOBS              __MX_OBJECT_SIGNAL_4
+#define MX_JOB_MEMORY_OVER_SOFT_LIMIT __MX_OBJECT_SIGNAL_5
+#define MX_JOB_MEMORY_HARD_LIMIT    __MX_OBJECT_SIGNAL_6
 
 // Process
 #define MX_PROCESS_TERMINATED       __MX_OBJECT_SIGNALED
@@ -172,6 +174,35 @@ typedef struct {
     uint32_t rd_num_handles;
 } mx_channel_call_args_t;
 
+// Per message slot for mx_channel_read_many() and mx_channel_write_many().
+typedef struct {
+    void* bytes;
+    mx_handle_t* handles;
+    uint32_t num_bytes;
+    uint32_t num_handles;
+    mx_status_t status;
+    uint32_t reserved;
+} mx_channel_msg_t;
+
+// Segment of a gathered buffer for mx_socket_writev() and mx_channel_writev().
+typedef struct {
+    const void* buffer;
+    size_t size;
+} mx_iovec_t;
+
+// Header at the start of each VMO returned by mx_socket_get_rings(). The
+// data follows at MX_SOCKET_RING_DATA_OFFSET. |head| and |tail| are byte
+// offsets into the data, written only by the producer and the consumer
+// respectively; the ring is empty when they are equal and one byte is always
+// left unused so that a full ring can be told apart.
+typedef struct {
+    uint64_t head;
+    uint64_t reserved0[7];
+    uint64_t tail;
+    uint64_t reserved1[7];
+    uint64_t size;
+} mx_socket_ring_t;
+
 // Structure for mx_object_wait_many():
 typedef struct {
     mx_handle_t handle;
@@ -203,6 +234,16 @@ typedef uint32_t mx_rights_t;
 
 #define MX_RIGHT_SAME_RIGHTS      ((mx_rights_t)1u << 31)
 
+// VM Object creation options
+#define MX_VMO_DISCARDABLE               1u
+#define MX_VMO_NUMA_INTERLEAVE           (1u << 1)
+#define MX_VMO_NUMA_NODE_VALID           (1u << 2)
+#define MX_VMO_NUMA_NODE_SHIFT           8
+#define MX_VMO_NUMA_NODE_MASK            (0xffu << MX_VMO_NUMA_NODE_SHIFT)
+#define MX_VMO_NUMA_NODE(n)              (MX_VMO_NUMA_NODE_VALID | \
+                                          (((uint32_t)(n) << MX_VMO_NUMA_NODE_SHIFT) & \
+                                           MX_VMO_NUMA_NODE_MASK))
+
 // VM Object opcodes
 #define MX_VMO_OP_COMMIT                 1u
 #define MX_VMO_OP_DECOMMIT               2u
@@ -229,6 +270,8 @@ typedef uint32_t mx_rights_t;
 #define MX_VM_FLAG_CAN_MAP_WRITE      (1u << 8)
 #define MX_VM_FLAG_CAN_MAP_EXECUTE    (1u << 9)
 #define MX_VM_FLAG_MAP_RANGE          (1u << 10)
+#define MX_VM_FLAG_FAULT_AROUND       (1u << 11)
+#define MX_VM_FLAG_MAP_POPULATE       (1u << 12)
 
 // clock ids
 #define MX_CLOCK_MONOTONIC        (0u)
@@ -257,9 +300,17 @@ typedef int64_t mx_rel_off_t;
 
 // Channel options and limits.
 #define MX_CHANNEL_READ_MAY_DISCARD         1u
+#define MX_CHANNEL_READ_MOVE_PAGES          2u
+#define MX_CHANNEL_WRITE_MOVE_PAGES         1u
+#define MX_CHANNEL_MAX_BATCH                64u
+
+// Largest number of segments accepted by the writev calls.
+#define MX_IOVEC_MAX                        16u
 
 // Socket options and limits.
+#define MX_SOCKET_SHARED_RING               1u
 #define MX_SOCKET_HALF_CLOSE                1u
+#define MX_SOCKET_RING_DATA_OFFSET          4096u
 
 // Flags which can be used to to control cache policy for APIs which map memory.
 typedef enum {
@@ -275,6 +326,25 @@ typedef struct {
     uint64_t tail;
 } mx_fifo_state_t;
 
+// mx_fifo_create() options.
+#define MX_FIFO_SHARED_RING         1u
+
+// Header at the start of each VMO returned by mx_fifo_get_rings(). The
+// elements follow at MX_FIFO_RING_DATA_OFFSET. |head| and |tail| count the
+// elements ever written and read, modulo 2^32, and element n lives in slot
+// n % elem_count. The producer only writes |head| and the consumer only
+// writes |tail|.
+typedef struct {
+    uint32_t head;
+    uint32_t reserved0[15];
+    uint32_t tail;
+    uint32_t reserved1[15];
+    uint32_t elem_count;
+    uint32_t elem_size;
+} mx_fifo_ring_t;
+
+#define MX_FIFO_RING_DATA_OFFSET    4096u
+
 // Fifo ops
 typedef enum {
     MX_FIFO_OP_READ_STATE         = 0,
@@ -46,13 +46,24 @@ mx_status_t SineSource::PackFrames(void* buffer, uint32_t buf_space, uint32_t* o
     double pos = sine_scalar_ * static_cast<double>(frames_produced_);
     auto   buf = reinterpret_cast<uint32_t*>(buffer);
 
+    // Rather than calling sin() for every frame, step the wave with the
+    // recurrence sin(x + w) = 2cos(w)sin(x) - sin(x - w).  It is seeded
+    // exactly at the start of each call, so the rounding error it picks up
+    // never builds past a single buffer's worth of frames.
+    double k    = 2.0 * cos(sine_scalar_);
+    double prev = amp_ * sin(pos - sine_scalar_);
+    double cur  = amp_ * sin(pos);
+
     for (uint64_t i = 0; i < todo; ++i) {
-        int16_t  val  = static_cast<int16_t>(amp_ * sin(pos));
+        int16_t  val  = static_cast<int16_t>(cur);
         uint32_t bits = static_cast<uint32_t>(static_cast<uint16_t>(val));
 
         bits |= bits << 16;
         buf[i] = bits;
-        pos += sine_scalar_;
+
+        double next = k * cur - prev;
+        prev = cur;
+        cur  = next;
     }
 
     *out_packed = static_cast<uint32_t>(todo * FRAME_SIZE);
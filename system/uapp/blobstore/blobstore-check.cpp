@@ -0,0 +1,267 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#include <lz4/lz4.h>
+#include <magenta/new.h>
+#include <magenta/syscalls.h>
+#include <merkle/digest.h>
+#include <merkle/tree.h>
+#include <mxtl/algorithm.h>
+#include <mxtl/atomic.h>
+#include <mxtl/unique_ptr.h>
+
+#include "blobstore-private.h"
+
+namespace blobstore {
+namespace {
+
+// Verifying a blob is mostly hashing it, so blobs are verified by a thread
+// per cpu, up to this many.
+constexpr uint32_t kBlobstoreCheckThreads = 8;
+
+// Shared by the threads verifying blobs
+struct CheckState {
+    Blobstore* fs;
+    const size_t* blobs;
+    size_t count;
+    bool progress;
+    mxtl::atomic<size_t> next;
+    mxtl::atomic<size_t> verified;
+    mxtl::atomic<size_t> failed;
+};
+
+// Count the bits in [0, bitmax) which are set in 'a' but not in 'b', a word
+// at a time.
+uint64_t count_missing(const void* a, const void* b, uint64_t bitmax) {
+    constexpr size_t kBits = sizeof(size_t) * 8;
+    const size_t* wa = static_cast<const size_t*>(a);
+    const size_t* wb = static_cast<const size_t*>(b);
+    uint64_t count = 0;
+    for (size_t w = 0; w * kBits < bitmax; w++) {
+        size_t bits = wa[w] & ~wb[w];
+        if ((w + 1) * kBits > bitmax) {
+            bits &= ~0ul >> ((w + 1) * kBits - bitmax);
+        }
+        count += __builtin_popcountl(bits);
+    }
+    return count;
+}
+
+// Decompress a compressed blob into 'data', from its 'region', which holds
+// everything past the Merkle tree.
+mx_status_t lz4_decompress_blob(const blobstore_inode_t& inode, const uint8_t* region,
+                                uint8_t* data) {
+    uint64_t chunks = LZ4ChunkCount(inode);
+    AllocChecker ac;
+    mxtl::unique_ptr<uint64_t[]> offsets(new (&ac) uint64_t[chunks + 1]);
+    if (!ac.check()) {
+        return ERR_NO_MEMORY;
+    }
+    mx_status_t status;
+    if ((status = lz4_read_seek_table(inode, region, offsets.get())) != NO_ERROR) {
+        return status;
+    }
+    for (uint64_t c = 0; c < chunks; c++) {
+        uint64_t len = LZ4ChunkLength(inode, c);
+        uint64_t stored = offsets[c + 1] - offsets[c];
+        uint8_t* out = data + c * kBlobstoreLZ4ChunkSize;
+        if (stored == len) {
+            memcpy(out, region + offsets[c], len);
+            continue;
+        }
+        int r = LZ4_decompress_safe(reinterpret_cast<const char*>(region + offsets[c]),
+                                    reinterpret_cast<char*>(out),
+                                    static_cast<int>(stored), static_cast<int>(len));
+        if ((r < 0) || (static_cast<uint64_t>(r) != len)) {
+            error("blobstore: cannot decompress chunk %lu\n", c);
+            return ERR_IO_DATA_INTEGRITY;
+        }
+    }
+    return NO_ERROR;
+}
+
+} // namespace
+
+mx_status_t Blobstore::VerifyBlob(size_t map_index) const {
+    const blobstore_inode_t& inode = node_map_[map_index];
+    uint64_t merkle_blocks = MerkleTreeBlocks(inode);
+    uint64_t data_blocks = BlobDataBlocks(inode);
+
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> tree(new (&ac) uint8_t[merkle_blocks * kBlobstoreBlockSize]);
+    if (!ac.check()) {
+        return ERR_NO_MEMORY;
+    }
+    mxtl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[data_blocks * kBlobstoreBlockSize]);
+    if (!ac.check()) {
+        return ERR_NO_MEMORY;
+    }
+
+    mx_status_t status;
+    if ((merkle_blocks > 0) &&
+        ((status = readblks(blockfd_, inode.start_block, merkle_blocks,
+                            tree.get())) != NO_ERROR)) {
+        return status;
+    }
+    if (inode.flags & kBlobstoreInodeFlagLZ4) {
+        uint64_t region_blocks = inode.num_blocks - merkle_blocks;
+        mxtl::unique_ptr<uint8_t[]> region(new (&ac) uint8_t[region_blocks * kBlobstoreBlockSize]);
+        if (!ac.check()) {
+            return ERR_NO_MEMORY;
+        }
+        if ((status = readblks(blockfd_, inode.start_block + merkle_blocks, region_blocks,
+                               region.get())) != NO_ERROR) {
+            return status;
+        }
+        if ((status = lz4_decompress_blob(inode, region.get(), data.get())) != NO_ERROR) {
+            return status;
+        }
+    } else if ((data_blocks > 0) &&
+               ((status = readblks(blockfd_, inode.start_block + merkle_blocks, data_blocks,
+                                   data.get())) != NO_ERROR)) {
+        return status;
+    }
+
+    merkle::Digest digest(inode.merkle_root_hash);
+    merkle::Tree mt;
+    status = mt.Verify(data.get(), inode.blob_size, tree.get(),
+                       merkle::Tree::GetTreeLength(inode.blob_size), 0, inode.blob_size,
+                       digest);
+    if (status != NO_ERROR) {
+        char name[merkle::Digest::kLength * 2 + 1];
+        digest.ToString(name, sizeof(name));
+        fprintf(stderr, "blobstore: check: blob %s does not match its Merkle tree\n", name);
+    }
+    return status;
+}
+
+int Blobstore::VerifyThread(void* arg) {
+    CheckState* state = static_cast<CheckState*>(arg);
+    size_t i;
+    while ((i = state->next.fetch_add(1)) < state->count) {
+        if (state->fs->VerifyBlob(state->blobs[i]) != NO_ERROR) {
+            state->failed.fetch_add(1);
+        }
+        size_t done = state->verified.fetch_add(1) + 1;
+        if (state->progress && ((done * 10) / state->count != ((done - 1) * 10) / state->count)) {
+            fprintf(stderr, "blobstore: check: %zu of %zu blobs verified\n",
+                    done, state->count);
+        }
+    }
+    return 0;
+}
+
+mx_status_t Blobstore::Check(bool progress) {
+    mx_status_t status;
+    uint64_t data_start = DataStartBlock(info_);
+    if (data_start > info_.block_count) {
+        fprintf(stderr, "blobstore: check: metadata runs past the last block\n");
+        return ERR_IO_DATA_INTEGRITY;
+    }
+
+    // The blocks the metadata and the blobs say are in use; everything
+    // before the data area belongs to the metadata.
+    BlockMap used;
+    if ((status = used.Reset(info_.block_count)) != NO_ERROR) {
+        return status;
+    }
+    used.Set(0, data_start);
+
+    AllocChecker ac;
+    mxtl::unique_ptr<size_t[]> blobs(new (&ac) size_t[info_.inode_count]);
+    if (!ac.check()) {
+        return ERR_NO_MEMORY;
+    }
+    size_t count = 0;
+    uint64_t errors = 0;
+    for (size_t i = 0; i < info_.inode_count; i++) {
+        const blobstore_inode_t& inode = node_map_[i];
+        if (inode.start_block == kStartBlockFree) {
+            continue;
+        } else if (inode.start_block < kStartBlockMinimum) {
+            fprintf(stderr, "blobstore: check: node %zu: left reserved\n", i);
+            errors++;
+            continue;
+        }
+        uint64_t end = inode.start_block + inode.num_blocks;
+        if ((inode.start_block < data_start) || (end < inode.start_block) ||
+            (end > info_.block_count)) {
+            fprintf(stderr, "blobstore: check: node %zu: blocks %lu-%lu out of range\n",
+                    i, inode.start_block, end - 1);
+            errors++;
+            continue;
+        }
+        uint64_t needed = MerkleTreeBlocks(inode) +
+                          ((inode.flags & kBlobstoreInodeFlagLZ4) ? LZ4HeaderBlocks(inode)
+                                                                  : BlobDataBlocks(inode));
+        if (inode.num_blocks < needed) {
+            fprintf(stderr, "blobstore: check: node %zu: %lu blocks can't hold %lu bytes\n",
+                    i, inode.num_blocks, inode.blob_size);
+            errors++;
+            continue;
+        }
+        if (used.Scan(inode.start_block, end, false) != end) {
+            fprintf(stderr, "blobstore: check: node %zu: blocks %lu-%lu are used twice\n",
+                    i, inode.start_block, end - 1);
+            errors++;
+        }
+        used.Set(inode.start_block, end);
+        blobs[count++] = i;
+    }
+
+    // Compare what is in use with what the block bitmap says is allocated
+    const void* allocated = block_map_.StorageUnsafe()->GetData();
+    const void* in_use = used.StorageUnsafe()->GetData();
+    uint64_t missing;
+    if ((missing = count_missing(allocated, in_use, info_.block_count)) != 0) {
+        fprintf(stderr, "blobstore: check: %lu allocated blocks not in use\n", missing);
+        errors++;
+    }
+    if ((missing = count_missing(in_use, allocated, info_.block_count)) != 0) {
+        fprintf(stderr, "blobstore: check: %lu blocks in use not marked allocated\n", missing);
+        errors++;
+    }
+
+    // This thread verifies blobs alongside the workers, and on its own if
+    // none could be started
+    CheckState state;
+    state.fs = this;
+    state.blobs = blobs.get();
+    state.count = count;
+    state.progress = progress;
+    state.next.store(0);
+    state.verified.store(0);
+    state.failed.store(0);
+    uint32_t threads = mxtl::min(mx_system_get_num_cpus(), kBlobstoreCheckThreads);
+    thrd_t workers[kBlobstoreCheckThreads];
+    uint32_t started = 0;
+    while ((started + 1 < threads) && (started + 1 < count)) {
+        if (thrd_create(&workers[started], VerifyThread, &state) != thrd_success) {
+            break;
+        }
+        started++;
+    }
+    VerifyThread(&state);
+    for (uint32_t i = 0; i < started; i++) {
+        thrd_join(workers[i], nullptr);
+    }
+    if (state.failed.load() != 0) {
+        fprintf(stderr, "blobstore: check: %zu of %zu blobs failed verification\n",
+                state.failed.load(), count);
+        errors++;
+    }
+
+    if (errors) {
+        return ERR_IO_DATA_INTEGRITY;
+    }
+    fprintf(stderr, "blobstore: check: okay, %zu blobs\n", count);
+    return NO_ERROR;
+}
+
+} // namespace blobstore
@@ -41,7 +41,15 @@ mx_status_t VnodeBlob::Readdir(void* cookie, void* dirents, size_t len) {
         return ERR_NOT_DIR;
     }
 
-    return blobstore_->Readdir(cookie, dirents, len);
+    return blobstore_->Readdir(cookie, dirents, len, false);
+}
+
+mx_status_t VnodeBlob::ReaddirPlus(void* cookie, void* dirents, size_t len) {
+    if (!IsDirectory()) {
+        return ERR_NOT_DIR;
+    }
+
+    return blobstore_->Readdir(cookie, dirents, len, true);
 }
 
 ssize_t VnodeBlob::Read(void* data, size_t len, size_t off) {
@@ -184,6 +192,11 @@ mx_status_t VnodeBlob::Mmap(int flags, size_t len, size_t* off, mx_handle_t* out
     if (flags & MXIO_MMAP_FLAG_WRITE) {
         return ERR_NOT_SUPPORTED;
     }
+    // Handing out the VMO verifies the whole blob and keeps it from ever
+    // being discarded, while reads only load and verify what they touch.
+    if (flags & MXIO_MMAP_FLAG_READS) {
+        return ERR_NOT_SUPPORTED;
+    }
 
     mx_rights_t rights = MX_RIGHT_TRANSFER | MX_RIGHT_MAP;
     rights |= (flags & MXIO_MMAP_FLAG_READ) ? MX_RIGHT_READ : 0;
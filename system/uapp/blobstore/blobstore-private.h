@@ -7,7 +7,9 @@
 #include "blobstore.h"
 
 #include <bitmap/raw-bitmap.h>
+#include <bitmap/storage.h>
 #include <merkle/digest.h>
+#include <merkle/tree.h>
 #include <mxtl/algorithm.h>
 #include <mxtl/macros.h>
 #include <mxtl/ref_counted.h>
@@ -23,6 +25,16 @@ class VnodeBlob;
 
 typedef uint32_t BlobFlags;
 
+// Tracks which blocks of a VMO have been read in (or verified)
+using BlockMap = bitmap::RawBitmapGeneric<bitmap::DefaultStorage>;
+
+// Verification works a block at a time
+static_assert(kBlobstoreBlockSize == merkle::Tree::kNodeSize,
+              "Blobstore blocks should line up with Merkle tree nodes");
+
+// Most blocks read from disk in one go while filling a VMO
+constexpr uint64_t kBlobstoreFillBlocks = 32;
+
 // After Open;
 constexpr BlobFlags kBlobStateEmpty       = 0x00000000; // Not yet allocated
 // After Ioctl configuring size:
@@ -40,6 +52,7 @@ constexpr BlobFlags kBlobStateMask        = 0x00FF0000;
 constexpr BlobFlags kBlobFlagSync         = 0x01000000; // The blob is being written to disk
 constexpr BlobFlags kBlobFlagDeletable    = 0x02000000; // This node should be unlinked when closed
 constexpr BlobFlags kBlobFlagDirectory    = 0x04000000; // This node represents the root directory
+constexpr BlobFlags kBlobFlagVmoShared    = 0x08000000; // The data VMO has been handed out, and stays locked
 constexpr BlobFlags kBlobOtherMask        = 0xFF000000;
 
 static_assert(((kBlobStateMask | kBlobOtherMask) & V_FLAG_RESERVED_MASK) == 0,
@@ -124,6 +137,7 @@ private:
                            uint32_t* type, void* extra, uint32_t* esize) final;
     mx_status_t Open(uint32_t flags) final;
     mx_status_t Readdir(void* cookie, void* dirents, size_t len) final;
+    mx_status_t ReaddirPlus(void* cookie, void* dirents, size_t len) final;
     ssize_t Read(void* data, size_t len, size_t off) final;
     ssize_t Write(const void* data, size_t len, size_t off) final;
     mx_status_t Lookup(mxtl::RefPtr<fs::Vnode>* out, const char* name, size_t len) final;
@@ -134,14 +148,47 @@ private:
     mx_status_t Mmap(int flags, size_t len, size_t* off, mx_handle_t* out) final;
     mx_status_t Sync() final;
 
-    // Read both VMOs into memory, if we haven't already.
+    // Create (empty) VMOs for the blob, if we haven't already.
     //
     // TODO(smklein): When we have can register the Blob Store as a pager
     // service, and it can properly handle pages faults on a vnode's contents,
-    // then we can avoid reading the entire blob up-front. Until then, read
-    // the contents of a VMO into memory when it is opened.
+    // then we can let the kernel fault the blob in. Until then, LoadRange
+    // reads in the parts of the VMOs each read touches.
+    //
+    // The VMOs are discardable: while they're unlocked the kernel may throw
+    // their contents away under memory pressure, cold blobs first.
     mx_status_t InitVmos();
 
+    // Lock both VMOs against being discarded while they are in use,
+    // forgetting whatever parts were loaded if they have been. Locks nest.
+    mx_status_t LockVmos();
+    void UnlockVmos();
+
+    // Size the maps tracking which blocks of the VMOs are loaded, and which
+    // blocks of data have been verified.
+    mx_status_t InitBlockMaps();
+
+    // Make sure the data in [off, off + len) is in the data VMO and verified,
+    // reading in it and the parts of the Merkle tree needed to verify it
+    // where they aren't loaded yet.
+    mx_status_t LoadRange(uint64_t off, uint64_t len);
+
+    // Read blocks [n, n_end) of 'vmo', stored on disk from 'start_block' on,
+    // wherever 'loaded' doesn't have them yet.
+    mx_status_t FillBlocks(mx_handle_t vmo, BlockMap* loaded, uint64_t start_block,
+                           uint64_t n, uint64_t n_end);
+
+    // For compressed blobs: read in the seek table, if we haven't already.
+    mx_status_t LoadSeekTable();
+
+    // For compressed blobs: decompress the chunks covering data blocks
+    // [n, n_end) into the data VMO, wherever they aren't loaded yet.
+    mx_status_t FillCompressed(uint64_t n, uint64_t n_end);
+
+    // Write out the data VMO once it's complete, compressed if that saves
+    // space, freeing the blocks it doesn't need.
+    mx_status_t WriteData();
+
     mx_status_t WriteShared(const void** data, size_t* len, size_t* actual,
                             uint64_t maxlen, mx_handle_t vmo, uint64_t start_block);
 
@@ -157,6 +204,11 @@ private:
     mx_handle_t vmo_blob_;
     uintptr_t   vmo_blob_addr_;
 
+    BlockMap merkle_loaded_;
+    BlockMap data_loaded_;
+    BlockMap data_verified_;
+    mxtl::unique_ptr<uint64_t[]> lz4_offsets_;
+
     mx_handle_t readable_event_;
     uint64_t bytes_written_;
 
@@ -185,6 +237,8 @@ public:
     friend class VnodeBlob;
 
     static mx_status_t Create(int blockfd, const blobstore_info_t* info, mxtl::RefPtr<VnodeBlob>* out);
+    // Loads the filesystem without creating its root vnode, for fsck.
+    static mx_status_t Load(int blockfd, const blobstore_info_t* info, mxtl::RefPtr<Blobstore>* out);
     mx_status_t Unmount();
     virtual ~Blobstore();
 
@@ -209,7 +263,13 @@ public:
     // Removes blob from 'active' hashmap.
     mx_status_t ReleaseBlob(VnodeBlob* blob);
 
-    mx_status_t Readdir(void* cookie, void* dirents, size_t len);
+    // Fills vdirent_plus_t records if 'attrs' is set.
+    mx_status_t Readdir(void* cookie, void* dirents, size_t len, bool attrs);
+
+    // Checks that the blob nodes and the block bitmap agree with each other,
+    // and verifies every blob against its Merkle tree, spreading the blobs
+    // over a few worker threads.
+    mx_status_t Check(bool progress);
 
     int blockfd_;
     blobstore_info_t info_;
@@ -237,6 +297,11 @@ private:
     // Given a node within the node map at an index, write it to disk.
     mx_status_t WriteNode(size_t map_index);
 
+    // Read all of the blob at 'map_index' and check it against its Merkle tree.
+    mx_status_t VerifyBlob(size_t map_index) const;
+    // Body of Check's worker threads.
+    static int VerifyThread(void* arg);
+
     // VnodeBlobs exist in the WAVLTree as long as one or more reference exists;
     // when the Vnode is deleted, it is immediately removed from the WAVL tree.
     using WAVLTreeByMerkle = mxtl::WAVLTree<const uint8_t*,
@@ -252,8 +317,16 @@ private:
 int blobstore_mkfs(int fd);
 
 mx_status_t blobstore_mount(mxtl::RefPtr<VnodeBlob>* out, int blockfd);
+mx_status_t blobstore_check(int blockfd, bool progress);
 
 mx_status_t readblk(int fd, uint64_t bno, void* data);
+mx_status_t readblks(int fd, uint64_t bno, uint64_t count, void* data);
 mx_status_t writeblk(int fd, uint64_t bno, const void* data);
+mx_status_t writeblks(int fd, uint64_t bno, uint64_t count, const void* data);
+
+// Check the header of a compressed blob, at 'header', and copy its seek table
+// into 'offsets'. The blob's blocks must be able to hold the header.
+mx_status_t lz4_read_seek_table(const blobstore_inode_t& inode, const void* header,
+                                uint64_t* offsets);
 
 } // namespace blobstore
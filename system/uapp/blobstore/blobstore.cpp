@@ -10,12 +10,14 @@
 #include <unistd.h>
 #include <sys/stat.h>
 
+#include <lz4/lz4.h>
 #include <magenta/new.h>
 #include <magenta/process.h>
 #include <magenta/syscalls.h>
 #include <merkle/digest.h>
 #include <merkle/tree.h>
 #include <mxtl/ref_ptr.h>
+#include <mxtl/unique_ptr.h>
 #include <mxio/debug.h>
 
 #define MXDEBUG 0
@@ -46,10 +48,39 @@ mx_status_t vmo_write_exact(mx_handle_t h, const void* data, uint64_t offset, si
     return NO_ERROR;
 }
 
-// Number of blocks reserved for the Merkle Tree
-uint64_t MerkleTreeBlocks(const blobstore_inode_t& blobNode) {
-    uint64_t size_merkle = merkle::Tree::GetTreeLength(blobNode.blob_size);
-    return mxtl::roundup(size_merkle, kBlobstoreBlockSize) / kBlobstoreBlockSize;
+// Compress the 'len' bytes of 'data' a chunk at a time into 'out', after
+// room for the header and seek table, filling in the 'chunks' + 1 entries of
+// 'offsets'. Returns the length of the compressed region, or zero if it
+// won't fit in 'capacity' bytes.
+uint64_t lz4_compress_chunks(const uint8_t* data, uint64_t len, uint64_t chunks,
+                             uint8_t* out, uint64_t capacity, uint64_t* offsets) {
+    uint64_t pos = sizeof(blobstore_lz4_header_t) + (chunks + 1) * sizeof(uint64_t);
+    for (uint64_t i = 0; i < chunks; i++) {
+        uint64_t off = i * kBlobstoreLZ4ChunkSize;
+        uint64_t chunk_len = mxtl::min(len - off, static_cast<uint64_t>(kBlobstoreLZ4ChunkSize));
+        if (pos >= capacity) {
+            return 0;
+        }
+        offsets[i] = pos;
+        // Chunks which don't get any smaller are stored as they are
+        uint64_t room = mxtl::min(capacity - pos, chunk_len - 1);
+        int r = 0;
+        if (room > 0) {
+            r = LZ4_compress_default(reinterpret_cast<const char*>(data + off),
+                                     reinterpret_cast<char*>(out + pos),
+                                     static_cast<int>(chunk_len), static_cast<int>(room));
+        }
+        if (r <= 0) {
+            if (capacity - pos < chunk_len) {
+                return 0;
+            }
+            memcpy(out + pos, data + off, chunk_len);
+            r = static_cast<int>(chunk_len);
+        }
+        pos += r;
+    }
+    offsets[chunks] = pos;
+    return pos;
 }
 
 // Get a pointer to the nth block of the bitmap.
@@ -60,15 +91,17 @@ inline void* get_raw_bitmap_data(const RawBitmap& bm, uint64_t n) {
                    (uintptr_t)(kBlobstoreBlockSize * n));
 }
 
-// Read data from disk at block 'bno', into the 'nth' logical block of the vmo.
-mx_status_t vn_fill_block(int fd, mx_handle_t vmo, uint64_t n, uint64_t bno) {
+// Read 'count' blocks from disk at block 'bno', into the vmo starting at its
+// 'nth' logical block. 'buf' must hold 'count' blocks.
+mx_status_t vn_fill_blocks(int fd, mx_handle_t vmo, uint64_t n, uint64_t bno,
+                           uint64_t count, void* buf) {
     // TODO(smklein): read directly from block device into vmo; no need to copy
     // into an intermediate buffer.
-    char bdata[kBlobstoreBlockSize];
-    if (blobstore::readblk(fd, bno, bdata) != NO_ERROR) {
+    if (blobstore::readblks(fd, bno, count, buf) != NO_ERROR) {
         return ERR_IO;
     }
-    mx_status_t status = vmo_write_exact(vmo, bdata, n * kBlobstoreBlockSize, kBlobstoreBlockSize);
+    mx_status_t status = vmo_write_exact(vmo, buf, n * kBlobstoreBlockSize,
+                                         count * kBlobstoreBlockSize);
     if (status != NO_ERROR) {
         return status;
     }
@@ -144,57 +177,91 @@ void* Blobstore::GetNodemapData(uint64_t n) const {
     return (void*)((uintptr_t)(node_map_.get()) + (uintptr_t)(kBlobstoreBlockSize * n));
 }
 
+// Blocks are read and written at explicit offsets, without moving the file
+// offset, so the workers of fsck can share the device.
 mx_status_t readblk(int fd, uint64_t bno, void* data) {
     off_t off = bno * kBlobstoreBlockSize;
-    if (lseek(fd, off, SEEK_SET) < 0) {
-        fprintf(stderr, "blobstore: cannot seek to block %lu\n", bno);
+    if (pread(fd, data, kBlobstoreBlockSize, off) != kBlobstoreBlockSize) {
+        fprintf(stderr, "blobstore: cannot read block %lu\n", bno);
         return ERR_IO;
     }
-    if (read(fd, data, kBlobstoreBlockSize) != kBlobstoreBlockSize) {
-        fprintf(stderr, "blobstore: cannot read block %lu\n", bno);
+    return NO_ERROR;
+}
+
+mx_status_t readblks(int fd, uint64_t bno, uint64_t count, void* data) {
+    off_t off = bno * kBlobstoreBlockSize;
+    ssize_t len = count * kBlobstoreBlockSize;
+    if (pread(fd, data, len, off) != len) {
+        fprintf(stderr, "blobstore: cannot read blocks %lu-%lu\n", bno, bno + count - 1);
         return ERR_IO;
     }
     return NO_ERROR;
 }
 
-mx_status_t writeblk(int fd, uint64_t bno, const void* data) {
+mx_status_t writeblks(int fd, uint64_t bno, uint64_t count, const void* data) {
     off_t off = bno * kBlobstoreBlockSize;
-    if (lseek(fd, off, SEEK_SET) < 0) {
-        fprintf(stderr, "blobstore: cannot seek to block %lu\n", bno);
+    ssize_t len = count * kBlobstoreBlockSize;
+    if (pwrite(fd, data, len, off) != len) {
+        fprintf(stderr, "blobstore: cannot write blocks %lu-%lu\n", bno, bno + count - 1);
         return ERR_IO;
     }
-    if (write(fd, data, kBlobstoreBlockSize) != kBlobstoreBlockSize) {
+    return NO_ERROR;
+}
+
+mx_status_t writeblk(int fd, uint64_t bno, const void* data) {
+    off_t off = bno * kBlobstoreBlockSize;
+    if (pwrite(fd, data, kBlobstoreBlockSize, off) != kBlobstoreBlockSize) {
         fprintf(stderr, "blobstore: cannot write block %lu\n", bno);
         return ERR_IO;
     }
     return NO_ERROR;
 }
 
+mx_status_t lz4_read_seek_table(const blobstore_inode_t& inode, const void* header,
+                                uint64_t* offsets) {
+    uint64_t chunks = LZ4ChunkCount(inode);
+    uint64_t region_size = (inode.num_blocks - MerkleTreeBlocks(inode)) * kBlobstoreBlockSize;
+    auto hdr = reinterpret_cast<const blobstore_lz4_header_t*>(header);
+    if ((hdr->magic != kBlobstoreLZ4Magic) || (hdr->chunk_size != kBlobstoreLZ4ChunkSize) ||
+        (hdr->chunk_count != chunks)) {
+        error("blobstore: bad compressed blob header\n");
+        return ERR_IO;
+    }
+    memcpy(offsets, hdr + 1, (chunks + 1) * sizeof(uint64_t));
+
+    // The Merkle tree covers what comes out of the chunks, not the table
+    // itself, so check it before trusting it with any reads
+    if ((offsets[0] != LZ4HeaderSize(inode)) || (offsets[chunks] > region_size)) {
+        error("blobstore: bad compressed blob seek table\n");
+        return ERR_IO;
+    }
+    for (uint64_t i = 0; i < chunks; i++) {
+        if ((offsets[i + 1] <= offsets[i]) ||
+            (offsets[i + 1] - offsets[i] > LZ4ChunkLength(inode, i))) {
+            error("blobstore: bad compressed blob seek table\n");
+            return ERR_IO;
+        }
+    }
+    return NO_ERROR;
+}
+
 mx_status_t VnodeBlob::InitVmos() {
     if (vmo_blob_ != MX_HANDLE_INVALID) {
         return NO_ERROR;
     }
 
     mx_status_t status;
-    int fd = blobstore_->blockfd_;
     blobstore_inode_t* inode = &blobstore_->node_map_[map_index_];
     uint64_t merkle_vmo_size = MerkleTreeBlocks(*inode) * kBlobstoreBlockSize;
     uint64_t data_vmo_size = BlobDataBlocks(*inode) * kBlobstoreBlockSize;
 
     if (merkle_vmo_size != 0) {
-        if ((status = mx_vmo_create(merkle_vmo_size, 0, &vmo_merkle_tree_)) != NO_ERROR) {
+        if ((status = mx_vmo_create(merkle_vmo_size, MX_VMO_DISCARDABLE,
+                                    &vmo_merkle_tree_)) != NO_ERROR) {
             error("Failed to initialize vmo; error: %d\n", status);
             goto fail;
         }
 
-        for (uint64_t n = 0; n < MerkleTreeBlocks(*inode); n++) {
-            uint64_t bno = inode->start_block + n;
-            if ((status = vn_fill_block(fd, vmo_merkle_tree_, n, bno)) != NO_ERROR) {
-                error("Failed to fill bno\n");
-                goto fail;
-            }
-        }
-
         if ((status = mx_vmar_map(mx_vmar_root_self(), 0, vmo_merkle_tree_, 0,
                                   merkle_vmo_size,
                                   MX_VM_FLAG_PERM_READ,
@@ -203,19 +270,11 @@ mx_status_t VnodeBlob::InitVmos() {
         }
     }
 
-    if ((status = mx_vmo_create(data_vmo_size, 0, &vmo_blob_)) != NO_ERROR) {
+    if ((status = mx_vmo_create(data_vmo_size, MX_VMO_DISCARDABLE, &vmo_blob_)) != NO_ERROR) {
         error("Failed to initialize vmo; error: %d\n", status);
         goto fail;
     }
 
-    for (uint64_t n = 0; n < BlobDataBlocks(*inode); n++) {
-        uint64_t bno = inode->start_block + n + MerkleTreeBlocks(*inode);
-        if ((status = vn_fill_block(fd, vmo_blob_, n, bno)) != NO_ERROR) {
-            error("Failed to fill bno\n");
-            goto fail;
-        }
-    }
-
     if ((status = mx_vmar_map(mx_vmar_root_self(), 0, vmo_blob_, 0,
                               data_vmo_size,
                               MX_VM_FLAG_PERM_READ,
@@ -223,12 +282,251 @@ mx_status_t VnodeBlob::InitVmos() {
         goto fail;
     }
 
+    if ((status = InitBlockMaps()) != NO_ERROR) {
+        goto fail;
+    }
     return NO_ERROR;
 fail:
     BlobCloseHandles();
     return status;
 }
 
+mx_status_t VnodeBlob::InitBlockMaps() {
+    blobstore_inode_t* inode = &blobstore_->node_map_[map_index_];
+    mx_status_t status;
+    if ((status = merkle_loaded_.Reset(MerkleTreeBlocks(*inode))) != NO_ERROR) {
+        return status;
+    } else if ((status = data_loaded_.Reset(BlobDataBlocks(*inode))) != NO_ERROR) {
+        return status;
+    }
+    return data_verified_.Reset(BlobDataBlocks(*inode));
+}
+
+mx_status_t VnodeBlob::LockVmos() {
+    mx_status_t status;
+    uint32_t discarded;
+    if (vmo_merkle_tree_ != MX_HANDLE_INVALID) {
+        if ((status = mx_vmo_op_range(vmo_merkle_tree_, MX_VMO_OP_LOCK, 0, 0,
+                                      &discarded, sizeof(discarded))) != NO_ERROR) {
+            return status;
+        }
+        if (discarded) {
+            merkle_loaded_.ClearAll();
+        }
+    }
+    if ((status = mx_vmo_op_range(vmo_blob_, MX_VMO_OP_LOCK, 0, 0,
+                                  &discarded, sizeof(discarded))) != NO_ERROR) {
+        if (vmo_merkle_tree_ != MX_HANDLE_INVALID) {
+            mx_vmo_op_range(vmo_merkle_tree_, MX_VMO_OP_UNLOCK, 0, 0, nullptr, 0);
+        }
+        return status;
+    }
+    if (discarded) {
+        // Whatever was verified is gone with it, but the Merkle tree (if it
+        // survived) can be trusted as much as ever.
+        data_loaded_.ClearAll();
+        data_verified_.ClearAll();
+    }
+    return NO_ERROR;
+}
+
+void VnodeBlob::UnlockVmos() {
+    if (vmo_merkle_tree_ != MX_HANDLE_INVALID) {
+        mx_vmo_op_range(vmo_merkle_tree_, MX_VMO_OP_UNLOCK, 0, 0, nullptr, 0);
+    }
+    mx_vmo_op_range(vmo_blob_, MX_VMO_OP_UNLOCK, 0, 0, nullptr, 0);
+}
+
+mx_status_t VnodeBlob::FillBlocks(mx_handle_t vmo, BlockMap* loaded, uint64_t start_block,
+                                  uint64_t n, uint64_t n_end) {
+    mx_status_t status;
+    mxtl::unique_ptr<uint8_t[]> buf;
+    while ((n = loaded->Scan(n, n_end, true)) < n_end) {
+        // Read each run of missing blocks in as few requests as we can
+        uint64_t run_end = loaded->Scan(n, mxtl::min(n_end, n + kBlobstoreFillBlocks), false);
+        if (buf == nullptr) {
+            AllocChecker ac;
+            buf.reset(new (&ac) uint8_t[kBlobstoreFillBlocks * kBlobstoreBlockSize]);
+            if (!ac.check()) {
+                return ERR_NO_MEMORY;
+            }
+        }
+        if ((status = vn_fill_blocks(blobstore_->blockfd_, vmo, n, start_block + n,
+                                     run_end - n, buf.get())) != NO_ERROR) {
+            error("Failed to fill bno\n");
+            return status;
+        }
+        loaded->Set(n, run_end);
+        n = run_end;
+    }
+    return NO_ERROR;
+}
+
+mx_status_t VnodeBlob::LoadSeekTable() {
+    if (lz4_offsets_ != nullptr) {
+        return NO_ERROR;
+    }
+
+    auto inode = &blobstore_->node_map_[map_index_];
+    uint64_t chunks = LZ4ChunkCount(*inode);
+    uint64_t header_blocks = LZ4HeaderBlocks(*inode);
+    uint64_t merkle_blocks = MerkleTreeBlocks(*inode);
+    if (inode->num_blocks < merkle_blocks + header_blocks) {
+        error("blobstore: compressed blob is too short\n");
+        return ERR_IO;
+    }
+
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> buf(new (&ac) uint8_t[header_blocks * kBlobstoreBlockSize]);
+    if (!ac.check()) {
+        return ERR_NO_MEMORY;
+    }
+    mxtl::unique_ptr<uint64_t[]> offsets(new (&ac) uint64_t[chunks + 1]);
+    if (!ac.check()) {
+        return ERR_NO_MEMORY;
+    }
+    if (readblks(blobstore_->blockfd_, inode->start_block + merkle_blocks, header_blocks,
+                 buf.get()) != NO_ERROR) {
+        return ERR_IO;
+    }
+    mx_status_t status;
+    if ((status = lz4_read_seek_table(*inode, buf.get(), offsets.get())) != NO_ERROR) {
+        return status;
+    }
+    lz4_offsets_ = mxtl::move(offsets);
+    return NO_ERROR;
+}
+
+mx_status_t VnodeBlob::FillCompressed(uint64_t n, uint64_t n_end) {
+    mx_status_t status;
+    if ((status = LoadSeekTable()) != NO_ERROR) {
+        return status;
+    }
+
+    constexpr uint64_t kChunkBlocks = kBlobstoreLZ4ChunkSize / kBlobstoreBlockSize;
+    auto inode = &blobstore_->node_map_[map_index_];
+    uint64_t region_start = inode->start_block + MerkleTreeBlocks(*inode);
+    uint64_t data_blocks = BlobDataBlocks(*inode);
+    mxtl::unique_ptr<uint8_t[]> buf;
+    while ((n = data_loaded_.Scan(n, n_end, true)) < n_end) {
+        // A stored chunk is never larger than the chunk itself, but may
+        // straddle a block on either side; past that, room to decompress it.
+        if (buf == nullptr) {
+            AllocChecker ac;
+            buf.reset(new (&ac) uint8_t[(kChunkBlocks + 1) * kBlobstoreBlockSize +
+                                        kBlobstoreLZ4ChunkSize]);
+            if (!ac.check()) {
+                return ERR_NO_MEMORY;
+            }
+        }
+        uint64_t c = n / kChunkBlocks;
+        uint64_t start = lz4_offsets_[c];
+        uint64_t end = lz4_offsets_[c + 1];
+        uint64_t b = start / kBlobstoreBlockSize;
+        uint64_t b_end = mxtl::roundup(end, kBlobstoreBlockSize) / kBlobstoreBlockSize;
+        if (readblks(blobstore_->blockfd_, region_start + b, b_end - b,
+                     buf.get()) != NO_ERROR) {
+            error("Failed to fill bno\n");
+            return ERR_IO;
+        }
+
+        const uint8_t* chunk = buf.get() + (start - b * kBlobstoreBlockSize);
+        uint64_t len = LZ4ChunkLength(*inode, c);
+        if (end - start < len) {
+            uint8_t* out = buf.get() + (kChunkBlocks + 1) * kBlobstoreBlockSize;
+            int r = LZ4_decompress_safe(reinterpret_cast<const char*>(chunk),
+                                        reinterpret_cast<char*>(out),
+                                        static_cast<int>(end - start), static_cast<int>(len));
+            if ((r < 0) || (static_cast<uint64_t>(r) != len)) {
+                error("blobstore: cannot decompress chunk %lu\n", c);
+                return ERR_IO;
+            }
+            chunk = out;
+        }
+
+        // Leave alone whichever blocks of the chunk are already in (they
+        // may have been verified)
+        uint64_t m_start = c * kChunkBlocks;
+        uint64_t m_end = mxtl::min(m_start + kChunkBlocks, data_blocks);
+        uint64_t m = m_start;
+        while ((m = data_loaded_.Scan(m, m_end, true)) < m_end) {
+            uint64_t run_end = data_loaded_.Scan(m, m_end, false);
+            uint64_t off = (m - m_start) * kBlobstoreBlockSize;
+            uint64_t run_len = mxtl::min((run_end - m_start) * kBlobstoreBlockSize, len) - off;
+            if ((status = vmo_write_exact(vmo_blob_, chunk + off, m * kBlobstoreBlockSize,
+                                          run_len)) != NO_ERROR) {
+                return status;
+            }
+            data_loaded_.Set(m, run_end);
+            m = run_end;
+        }
+        n = m_end;
+    }
+    return NO_ERROR;
+}
+
+mx_status_t VnodeBlob::LoadRange(uint64_t off, uint64_t len) {
+    if (len == 0) {
+        return NO_ERROR;
+    }
+
+    // Only the blocks which haven't been verified yet need any work
+    uint64_t n = data_verified_.Scan(off / kBlobstoreBlockSize,
+                                     mxtl::roundup(off + len, kBlobstoreBlockSize) /
+                                     kBlobstoreBlockSize, true);
+    uint64_t n_end = mxtl::roundup(off + len, kBlobstoreBlockSize) / kBlobstoreBlockSize;
+    if (n == n_end) {
+        return NO_ERROR;
+    }
+    while (data_verified_.Get(n_end - 1, n_end)) {
+        n_end--;
+    }
+
+    mx_status_t status;
+    auto inode = &blobstore_->node_map_[map_index_];
+    uint64_t voff = n * kBlobstoreBlockSize;
+    uint64_t vlen = mxtl::min(n_end * kBlobstoreBlockSize, inode->blob_size) - voff;
+
+    // Read in the nodes of the Merkle tree which cover the range
+    merkle::Tree mt;
+    if ((status = mt.SetRanges(inode->blob_size, voff, vlen)) != NO_ERROR) {
+        return status;
+    }
+    for (const auto& range : mt.ranges()) {
+        uint64_t m = range.offset / kBlobstoreBlockSize;
+        uint64_t m_end = mxtl::roundup(range.offset + range.length, kBlobstoreBlockSize) /
+                         kBlobstoreBlockSize;
+        if ((status = FillBlocks(vmo_merkle_tree_, &merkle_loaded_, inode->start_block,
+                                 m, m_end)) != NO_ERROR) {
+            return status;
+        }
+    }
+
+    // ... and the data itself
+    if (inode->flags & kBlobstoreInodeFlagLZ4) {
+        status = FillCompressed(n, n_end);
+    } else {
+        status = FillBlocks(vmo_blob_, &data_loaded_,
+                            inode->start_block + MerkleTreeBlocks(*inode), n, n_end);
+    }
+    if (status != NO_ERROR) {
+        return status;
+    }
+
+    merkle::Digest d;
+    d = ((const uint8_t*) &digest_[0]);
+    uint64_t size_merkle = merkle::Tree::GetTreeLength(inode->blob_size);
+    status = mt.Verify((const void*)vmo_blob_addr_, inode->blob_size,
+                       (const void*)vmo_merkle_tree_addr_, size_merkle,
+                       voff, vlen, d);
+    if (status != NO_ERROR) {
+        // Read the blocks again next time, in case the disk gave us garbage
+        data_loaded_.Clear(n, n_end);
+        return status;
+    }
+    return data_verified_.Set(n, n_end);
+}
+
 uint64_t VnodeBlob::SizeData() const {
     if (GetState() == kBlobStateReadable) {
         auto inode = &blobstore_->node_map_[map_index_];
@@ -263,11 +561,12 @@ VnodeBlob::VnodeBlob(mxtl::RefPtr<Blobstore> bs) :
 void VnodeBlob::BlobCloseHandles() {
     auto inode = &blobstore_->node_map_[map_index_];
     if (vmo_merkle_tree_addr_ != 0) {
-        uint64_t size_merkle = merkle::Tree::GetTreeLength(inode->blob_size);
-        mx_vmar_unmap(mx_vmar_root_self(), vmo_merkle_tree_addr_, size_merkle);
+        uint64_t merkle_vmo_size = MerkleTreeBlocks(*inode) * kBlobstoreBlockSize;
+        mx_vmar_unmap(mx_vmar_root_self(), vmo_merkle_tree_addr_, merkle_vmo_size);
     }
     if (vmo_blob_addr_ != 0) {
-        mx_vmar_unmap(mx_vmar_root_self(), vmo_blob_addr_, inode->blob_size);
+        uint64_t data_vmo_size = BlobDataBlocks(*inode) * kBlobstoreBlockSize;
+        mx_vmar_unmap(mx_vmar_root_self(), vmo_blob_addr_, data_vmo_size);
     }
     if (vmo_merkle_tree_ != MX_HANDLE_INVALID) {
         mx_handle_close(vmo_merkle_tree_);
@@ -304,26 +603,35 @@ mx_status_t VnodeBlob::SpaceAllocate(uint64_t size_data) {
     memset(inode->merkle_root_hash, 0, merkle::Digest::kLength);
     inode->blob_size = size_data;
     inode->num_blocks = MerkleTreeBlocks(*inode) + BlobDataBlocks(*inode);
+    inode->flags = 0;
+    inode->reserved = 0;
 
-    // Open VMOs, so we can begin writing after allocate succeeds.
-    uint64_t size_merkle = merkle::Tree::GetTreeLength(size_data);
-    if (size_merkle != 0) {
-        if ((status = mx_vmo_create(size_merkle, 0, &vmo_merkle_tree_)) != NO_ERROR) {
+    // Open VMOs, so we can begin writing after allocate succeeds. They stay
+    // locked until the whole blob has been written.
+    uint64_t merkle_vmo_size = MerkleTreeBlocks(*inode) * kBlobstoreBlockSize;
+    uint64_t data_vmo_size = BlobDataBlocks(*inode) * kBlobstoreBlockSize;
+    if (merkle_vmo_size != 0) {
+        if ((status = mx_vmo_create(merkle_vmo_size, MX_VMO_DISCARDABLE,
+                                    &vmo_merkle_tree_)) != NO_ERROR) {
             goto fail;
         } else if ((status = mx_vmar_map(mx_vmar_root_self(), 0, vmo_merkle_tree_, 0,
-                                         size_merkle,
+                                         merkle_vmo_size,
                                          MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE,
                                          &vmo_merkle_tree_addr_)) != NO_ERROR) {
             goto fail;
         }
     }
-    if ((status = mx_vmo_create(size_data, 0, &vmo_blob_)) != NO_ERROR) {
+    if ((status = mx_vmo_create(data_vmo_size, MX_VMO_DISCARDABLE, &vmo_blob_)) != NO_ERROR) {
         goto fail;
     } else if ((status = mx_vmar_map(mx_vmar_root_self(), 0, vmo_blob_, 0,
-                                     size_data,
+                                     data_vmo_size,
                                      MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE,
                                      &vmo_blob_addr_)) != NO_ERROR) {
         goto fail;
+    } else if ((status = InitBlockMaps()) != NO_ERROR) {
+        goto fail;
+    } else if ((status = LockVmos()) != NO_ERROR) {
+        goto fail;
     }
 
     // Allocate space for the blob
@@ -331,7 +639,7 @@ mx_status_t VnodeBlob::SpaceAllocate(uint64_t size_data) {
         goto fail;
     }
 
-    SetState(size_merkle != 0 ? kBlobStateMerkleWrite : kBlobStateDataWrite);
+    SetState(merkle_vmo_size != 0 ? kBlobStateMerkleWrite : kBlobStateDataWrite);
     return NO_ERROR;
 
 fail:
@@ -340,7 +648,7 @@ fail:
     return status;
 }
 
-// A helper function for dumping either the Merkle Tree or the actual blob data
+// A helper function for dumping the Merkle Tree
 // to both (1) The containing VMO, and (2) disk.
 mx_status_t VnodeBlob::WriteShared(const void** data, size_t* len, size_t* actual,
                                    uint64_t maxlen, mx_handle_t vmo, uint64_t start_block) {
@@ -379,13 +687,79 @@ mx_status_t VnodeBlob::WriteShared(const void** data, size_t* len, size_t* actua
     return NO_ERROR;
 }
 
+mx_status_t VnodeBlob::WriteData() {
+    auto inode = &blobstore_->node_map_[map_index_];
+    uint64_t data_start = inode->start_block + MerkleTreeBlocks(*inode);
+    uint64_t data_blocks = BlobDataBlocks(*inode);
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(vmo_blob_addr_);
+
+    // Compression is only worth it if it saves a block; failing to find the
+    // memory for it just means storing the blob as it is.
+    uint64_t capacity = (data_blocks - 1) * kBlobstoreBlockSize;
+    uint64_t chunks = LZ4ChunkCount(*inode);
+    if (LZ4HeaderSize(*inode) < capacity) {
+        AllocChecker ac;
+        mxtl::unique_ptr<uint8_t[]> buf(new (&ac) uint8_t[capacity]);
+        if (!ac.check()) {
+            buf.reset();
+        }
+        mxtl::unique_ptr<uint64_t[]> offsets(new (&ac) uint64_t[chunks + 1]);
+        if (!ac.check()) {
+            offsets.reset();
+        }
+        uint64_t len = 0;
+        if ((buf != nullptr) && (offsets != nullptr)) {
+            len = lz4_compress_chunks(data, inode->blob_size, chunks, buf.get(), capacity,
+                                      offsets.get());
+        }
+        if (len != 0) {
+            auto hdr = reinterpret_cast<blobstore_lz4_header_t*>(buf.get());
+            hdr->magic = kBlobstoreLZ4Magic;
+            hdr->chunk_size = kBlobstoreLZ4ChunkSize;
+            hdr->chunk_count = static_cast<uint32_t>(chunks);
+            memcpy(buf.get() + sizeof(blobstore_lz4_header_t), offsets.get(),
+                   (chunks + 1) * sizeof(uint64_t));
+            uint64_t nblocks = mxtl::roundup(len, kBlobstoreBlockSize) / kBlobstoreBlockSize;
+            memset(buf.get() + len, 0, nblocks * kBlobstoreBlockSize - len);
+            if (writeblks(blobstore_->blockfd_, data_start, nblocks, buf.get()) != NO_ERROR) {
+                return ERR_IO;
+            }
+
+            // Give back the blocks the compressed blob doesn't need; they
+            // haven't made it into the on-disk bitmap yet.
+            blobstore_->FreeBlocks(data_blocks - nblocks, data_start + nblocks);
+            inode->num_blocks -= data_blocks - nblocks;
+            inode->flags |= kBlobstoreInodeFlagLZ4;
+            lz4_offsets_ = mxtl::move(offsets);
+            return NO_ERROR;
+        }
+    }
+
+    // The VMO is block-sized, and zero past the end of the blob
+    if (writeblks(blobstore_->blockfd_, data_start, data_blocks, data) != NO_ERROR) {
+        return ERR_IO;
+    }
+    return NO_ERROR;
+}
+
 mx_status_t VnodeBlob::WriteMetadata() {
     assert(GetState() == kBlobStateDataWrite);
 
-    // All data has been written to the containing VMO
+    mx_status_t status;
+    if ((status = WriteData()) != NO_ERROR) {
+        return status;
+    }
+
+    // All data has been written to the containing VMO. It still has to be
+    // verified before it's read, but otherwise may be discarded, and read
+    // back in from disk, like that of any other blob.
+    auto inode = &blobstore_->node_map_[map_index_];
+    merkle_loaded_.Set(0, MerkleTreeBlocks(*inode));
+    data_loaded_.Set(0, BlobDataBlocks(*inode));
+    UnlockVmos();
     SetState(kBlobStateReadable);
     if (readable_event_ != MX_HANDLE_INVALID) {
-        mx_status_t status = mx_object_signal(readable_event_, 0u, MX_USER_SIGNAL_0);
+        status = mx_object_signal(readable_event_, 0u, MX_USER_SIGNAL_0);
         if (status != NO_ERROR) {
             SetState(kBlobStateError);
             return status;
@@ -399,7 +773,6 @@ mx_status_t VnodeBlob::WriteMetadata() {
     // This 'kBlobFlagSync' is currently not used, but it indicates when the sync is
     // complete.
     flags_ |= kBlobFlagSync;
-    auto inode = &blobstore_->node_map_[map_index_];
 
     // Write block allocation bitmap
     if (blobstore_->WriteBitmap(inode->num_blocks, inode->start_block) != NO_ERROR) {
@@ -451,11 +824,14 @@ mx_status_t VnodeBlob::WriteInternal(const void* data, size_t len, size_t* actua
     }
 
     if (GetState() == kBlobStateDataWrite) {
-        status = WriteShared(&data, &len, actual, inode->blob_size,
-                             vmo_blob_, inode->start_block + MerkleTreeBlocks(*inode));
-        if (status != NO_ERROR) {
+        // The data only goes out to disk once it's all here, when we know
+        // whether it's worth compressing
+        size_t to_write = mxtl::min(len, inode->blob_size - bytes_written_);
+        if ((status = vmo_write_exact(vmo_blob_, data, bytes_written_, to_write)) != NO_ERROR) {
             return status;
         }
+        bytes_written_ += to_write;
+        *actual += to_write;
 
         // More data to write.
         if (bytes_written_ < inode->blob_size) {
@@ -499,6 +875,8 @@ mx_status_t VnodeBlob::CopyVmo(mx_rights_t rights, mx_handle_t* out) {
     mx_status_t status = InitVmos();
     if (status != NO_ERROR) {
         return status;
+    } else if ((status = LockVmos()) != NO_ERROR) {
+        return status;
     }
 
     // TODO(smklein): We could lazily verify more of the VMO if:
@@ -506,19 +884,23 @@ mx_status_t VnodeBlob::CopyVmo(mx_rights_t rights, mx_handle_t* out) {
     // 2) We could create a COW subsection of the original VMO.
     //
     // For now, we aggressively verify the entire VMO up front.
-    merkle::Tree mt;
-    merkle::Digest d;
-    d = ((const uint8_t*) &digest_[0]);
     auto inode = &blobstore_->node_map_[map_index_];
-    uint64_t size_merkle = merkle::Tree::GetTreeLength(inode->blob_size);
-    status = mt.Verify((const void*)vmo_blob_addr_, inode->blob_size,
-                       (const void*)vmo_merkle_tree_addr_, size_merkle,
-                       0, inode->blob_size, d);
-    if (status != NO_ERROR) {
+    if ((status = LoadRange(0, inode->blob_size)) != NO_ERROR) {
+        UnlockVmos();
+        return status;
+    }
+    if ((status = mx_handle_duplicate(vmo_blob_, rights, out)) != NO_ERROR) {
+        UnlockVmos();
         return status;
     }
 
-    return mx_handle_duplicate(vmo_blob_, rights, out);
+    // Nothing tells us when the holders of the VMO are done with it, so it
+    // can't be discarded from here on; keep the lock taken above.
+    if (flags_ & kBlobFlagVmoShared) {
+        UnlockVmos();
+    }
+    flags_ |= kBlobFlagVmoShared;
+    return NO_ERROR;
 }
 
 mx_status_t VnodeBlob::ReadInternal(void* data, size_t len, size_t off, size_t* actual) {
@@ -526,24 +908,25 @@ mx_status_t VnodeBlob::ReadInternal(void* data, size_t len, size_t off, size_t*
         return ERR_BAD_STATE;
     }
 
-    mx_status_t status = InitVmos();
-    if (status != NO_ERROR) {
-        return status;
+    auto inode = &blobstore_->node_map_[map_index_];
+    if (off >= inode->blob_size) {
+        *actual = 0;
+        return NO_ERROR;
     }
+    len = mxtl::min(len, static_cast<size_t>(inode->blob_size - off));
 
-    merkle::Tree mt;
-    merkle::Digest d;
-    d = ((const uint8_t*) &digest_[0]);
-    auto inode = &blobstore_->node_map_[map_index_];
-    uint64_t size_merkle = merkle::Tree::GetTreeLength(inode->blob_size);
-    status = mt.Verify((const void*)vmo_blob_addr_, inode->blob_size,
-                       (const void*)vmo_merkle_tree_addr_, size_merkle,
-                       off, len, d);
+    mx_status_t status = InitVmos();
     if (status != NO_ERROR) {
         return status;
+    } else if ((status = LockVmos()) != NO_ERROR) {
+        return status;
     }
 
-    return mx_vmo_read(vmo_blob_, data, off, len, actual);
+    if ((status = LoadRange(off, len)) == NO_ERROR) {
+        status = mx_vmo_read(vmo_blob_, data, off, len, actual);
+    }
+    UnlockVmos();
+    return status;
 }
 
 void VnodeBlob::QueueUnlink() {
@@ -683,8 +1066,8 @@ typedef struct dircookie {
 static_assert(sizeof(dircookie_t) <= sizeof(vdircookie_t),
               "Blobstore dircookie too large to fit in IO state");
 
-mx_status_t Blobstore::Readdir(void* cookie, void* dirents, size_t len) {
-    fs::DirentFiller df(dirents, len);
+mx_status_t Blobstore::Readdir(void* cookie, void* dirents, size_t len, bool attrs) {
+    fs::DirentFiller df(dirents, len, attrs);
     dircookie_t* c = static_cast<dircookie_t*>(cookie);
 
     for (size_t i = c->index; i < info_.inode_count; ++i) {
@@ -695,7 +1078,12 @@ mx_status_t Blobstore::Readdir(void* cookie, void* dirents, size_t len) {
             if (r < 0) {
                 return r;
             }
-            if ((r = df.Next(name, strlen(name), VTYPE_TO_DTYPE(V_TYPE_FILE))) != NO_ERROR) {
+            // The node map has everything VnodeBlob::Getattr reports
+            vnattr_t attr = {};
+            attr.mode = V_TYPE_FILE;
+            attr.size = node_map_[i].blob_size;
+            attr.nlink = 1;
+            if ((r = df.Next(name, strlen(name), VTYPE_TO_DTYPE(V_TYPE_FILE), &attr)) != NO_ERROR) {
                 break;
             }
             c->index = i + 1;
@@ -748,6 +1136,21 @@ Blobstore::Blobstore(int fd, const blobstore_info_t* info) : blockfd_(fd) {
 Blobstore::~Blobstore() {}
 
 mx_status_t Blobstore::Create(int fd, const blobstore_info_t* info, mxtl::RefPtr<VnodeBlob>* out) {
+    mxtl::RefPtr<Blobstore> fs;
+    mx_status_t status;
+    if ((status = Load(fd, info, &fs)) != NO_ERROR) {
+        return status;
+    }
+
+    AllocChecker ac;
+    *out = mxtl::AdoptRef(new (&ac) VnodeBlob(mxtl::move(fs)));
+    if (!ac.check()) {
+        return ERR_NO_MEMORY;
+    }
+    return NO_ERROR;
+}
+
+mx_status_t Blobstore::Load(int fd, const blobstore_info_t* info, mxtl::RefPtr<Blobstore>* out) {
     uint64_t blocks = info->block_count;
 
     mx_status_t status = blobstore_check_info(info, blocks);
@@ -782,10 +1185,7 @@ mx_status_t Blobstore::Create(int fd, const blobstore_info_t* info, mxtl::RefPtr
         return status;
     }
 
-    *out = mxtl::AdoptRef(new (&ac) VnodeBlob(mxtl::move(fs)));
-    if (!ac.check()) {
-        return ERR_NO_MEMORY;
-    }
+    *out = mxtl::move(fs);
     return NO_ERROR;
 }
 
@@ -793,14 +1193,19 @@ mx_status_t Blobstore::LoadBitmaps() {
     uint64_t bbm_blocks = BlockMapBlocks(info_);
     uint64_t nbm_blocks = NodeMapBlocks(info_);
 
-    for (uint64_t n = 0; n < bbm_blocks; n++) {
-        if (readblk(blockfd_, BlockMapStartBlock() + n, GetBlockmapData(n))) {
+    // Both are contiguous in memory as well as on disk, so read each in
+    // large runs rather than a block at a time
+    for (uint64_t n = 0; n < bbm_blocks; n += kBlobstoreFillBlocks) {
+        uint64_t count = mxtl::min(bbm_blocks - n, kBlobstoreFillBlocks);
+        if (readblks(blockfd_, BlockMapStartBlock() + n, count, GetBlockmapData(n))) {
             fprintf(stderr, "blobstore: failed reading alloc bitmap\n");
             return ERR_IO;
         }
     }
-    for (uint64_t n = 0; n < nbm_blocks; n++) {
-        if (readblk(blockfd_, NodeMapStartBlock(info_) + n, GetNodemapData(n))) {
+    block_map_.RebuildSummary();
+    for (uint64_t n = 0; n < nbm_blocks; n += kBlobstoreFillBlocks) {
+        uint64_t count = mxtl::min(nbm_blocks - n, kBlobstoreFillBlocks);
+        if (readblks(blockfd_, NodeMapStartBlock(info_) + n, count, GetNodemapData(n))) {
             fprintf(stderr, "blobstore: failed reading inode map\n");
             return ERR_IO;
         }
@@ -808,17 +1213,20 @@ mx_status_t Blobstore::LoadBitmaps() {
     return NO_ERROR;
 }
 
-mx_status_t blobstore_mount(mxtl::RefPtr<VnodeBlob>* out, int blockfd) {
+namespace {
+
+// Read the info block into 'block', and check it describes a blobstore which
+// fits on the device.
+mx_status_t blobstore_read_info(int blockfd, void* block) {
     mx_status_t status;
     struct stat s;
 
-    char block[kBlobstoreBlockSize];
-    if ((status = readblk(blockfd, 0, (void*) block)) < 0) {
+    if ((status = readblk(blockfd, 0, block)) < 0) {
         fprintf(stderr, "blobstore: could not read info block\n");
         return status;
     }
 
-    blobstore_info_t* info = reinterpret_cast<blobstore_info_t*>(&block[0]);
+    blobstore_info_t* info = reinterpret_cast<blobstore_info_t*>(block);
 
     if (fstat(blockfd, &s) < 0) {
         fprintf(stderr, "blobstore: cannot find end of underlying device\n");
@@ -826,7 +1234,21 @@ mx_status_t blobstore_mount(mxtl::RefPtr<VnodeBlob>* out, int blockfd) {
     } else if ((status = blobstore_check_info(info, s.st_size / kBlobstoreBlockSize)) != NO_ERROR) {
         fprintf(stderr, "blobstore: Info check failed\n");
         return status;
-    } else if ((status = Blobstore::Create(blockfd, info, out)) != NO_ERROR) {
+    }
+    return NO_ERROR;
+}
+
+} // namespace
+
+mx_status_t blobstore_mount(mxtl::RefPtr<VnodeBlob>* out, int blockfd) {
+    mx_status_t status;
+    char block[kBlobstoreBlockSize];
+    if ((status = blobstore_read_info(blockfd, block)) != NO_ERROR) {
+        return status;
+    }
+
+    blobstore_info_t* info = reinterpret_cast<blobstore_info_t*>(&block[0]);
+    if ((status = Blobstore::Create(blockfd, info, out)) != NO_ERROR) {
         fprintf(stderr, "blobstore: mount failed\n");
         return status;
     }
@@ -834,6 +1256,22 @@ mx_status_t blobstore_mount(mxtl::RefPtr<VnodeBlob>* out, int blockfd) {
     return NO_ERROR;
 }
 
+mx_status_t blobstore_check(int blockfd, bool progress) {
+    mx_status_t status;
+    char block[kBlobstoreBlockSize];
+    if ((status = blobstore_read_info(blockfd, block)) != NO_ERROR) {
+        return status;
+    }
+
+    blobstore_info_t* info = reinterpret_cast<blobstore_info_t*>(&block[0]);
+    mxtl::RefPtr<Blobstore> fs;
+    if ((status = Blobstore::Load(blockfd, info, &fs)) != NO_ERROR) {
+        fprintf(stderr, "blobstore: check failed to load filesystem\n");
+        return status;
+    }
+    return fs->Check(progress);
+}
+
 int blobstore_mkfs(int fd) {
     struct stat s;
     if (fstat(fd, &s) < 0) {
@@ -6,6 +6,7 @@
 
 #include <bitmap/raw-bitmap.h>
 #include <bitmap/storage.h>
+#include <bitmap/summary-bitmap.h>
 #include <merkle/digest.h>
 #include <merkle/tree.h>
 #include <mxtl/algorithm.h>
@@ -23,7 +24,13 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-using RawBitmap = bitmap::RawBitmapGeneric<bitmap::VmoStorage>;
+// The block bitmap keeps a summary in memory so extent allocation on a
+// nearly full disk doesn't have to walk the whole map.
+#ifdef __Fuchsia__
+using RawBitmap = bitmap::SummaryBitmapGeneric<bitmap::VmoStorage>;
+#else
+using RawBitmap = bitmap::SummaryBitmapGeneric<bitmap::DefaultStorage>;
+#endif
 
 // clang-format off
 
@@ -39,8 +46,10 @@ constexpr uint32_t kBlobstoreBlockMapStart  = 1;
 constexpr uint32_t kBlobstoreInodeSize      = 64;
 constexpr uint32_t kBlobstoreInodesPerBlock = (kBlobstoreBlockSize / kBlobstoreInodeSize);
 
+#ifdef __Fuchsia__
 static_assert(kBlobstoreBlockSize % PAGE_SIZE == 0,
               "Blobstore block size should be a multiple of page size");
+#endif
 
 // Notes:
 // - block 0 is always allocated
@@ -89,9 +98,13 @@ typedef struct {
     uint64_t start_block;
     uint64_t num_blocks;
     uint64_t blob_size;
-    uint64_t reserved;
+    uint32_t flags;
+    uint32_t reserved;
 } blobstore_inode_t;
 
+// Inode flags
+constexpr uint32_t kBlobstoreInodeFlagLZ4 = 1; // Data is stored as LZ4-compressed chunks
+
 static_assert(sizeof(blobstore_inode_t) == kBlobstoreInodeSize,
               "Blobstore Inode size is wrong");
 static_assert(kBlobstoreBlockSize % kBlobstoreInodeSize == 0,
@@ -102,5 +115,45 @@ constexpr uint64_t BlobDataBlocks(const blobstore_inode_t& blobNode) {
     return mxtl::roundup(blobNode.blob_size, kBlobstoreBlockSize) / kBlobstoreBlockSize;
 }
 
+// Number of blocks reserved for the Merkle Tree
+inline uint64_t MerkleTreeBlocks(const blobstore_inode_t& blobNode) {
+    uint64_t size_merkle = merkle::Tree::GetTreeLength(blobNode.blob_size);
+    return mxtl::roundup(size_merkle, kBlobstoreBlockSize) / kBlobstoreBlockSize;
+}
+
+// Compressed blobs keep the Merkle tree (of the uncompressed data) as usual,
+// followed by a header, a seek table, and the data compressed a chunk at a
+// time, so any chunk can be decompressed on its own. Chunk 'i' occupies bytes
+// [offsets[i], offsets[i + 1]) of the compressed region, counting from the
+// start of the header; a chunk which is no smaller compressed is stored as is.
+constexpr uint64_t kBlobstoreLZ4Magic     = (0x3f8f5ab7a645c9e1ULL);
+constexpr uint32_t kBlobstoreLZ4ChunkSize = (8 * kBlobstoreBlockSize);
+
+typedef struct {
+    uint64_t magic;
+    uint32_t chunk_size;
+    uint32_t chunk_count;
+    // Followed by the seek table: chunk_count + 1 uint64_t offsets
+} blobstore_lz4_header_t;
+
+constexpr uint64_t LZ4ChunkCount(const blobstore_inode_t& blobNode) {
+    return mxtl::roundup(blobNode.blob_size, kBlobstoreLZ4ChunkSize) / kBlobstoreLZ4ChunkSize;
+}
+
+// Bytes taken by the header and seek table of a compressed blob
+constexpr uint64_t LZ4HeaderSize(const blobstore_inode_t& blobNode) {
+    return sizeof(blobstore_lz4_header_t) + (LZ4ChunkCount(blobNode) + 1) * sizeof(uint64_t);
+}
+
+constexpr uint64_t LZ4HeaderBlocks(const blobstore_inode_t& blobNode) {
+    return mxtl::roundup(LZ4HeaderSize(blobNode), kBlobstoreBlockSize) / kBlobstoreBlockSize;
+}
+
+// Length of the 'nth' chunk of a compressed blob, once decompressed
+constexpr uint64_t LZ4ChunkLength(const blobstore_inode_t& blobNode, uint64_t n) {
+    return mxtl::min(blobNode.blob_size - n * kBlobstoreLZ4ChunkSize,
+                     static_cast<uint64_t>(kBlobstoreLZ4ChunkSize));
+}
+
 void* GetBlock(const RawBitmap& bitmap, uint32_t blkno);
 void* GetBitBlock(const RawBitmap& bitmap, uint32_t* blkno_out, uint32_t bitno);
@@ -0,0 +1,376 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Builds blobstore images on the host. Every blob is placed in a single
+// planning pass, the Merkle trees are computed on a thread per cpu, and the
+// image is then written front to back in large runs, rather than a block at
+// a time through the filesystem.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <magenta/new.h>
+#include <merkle/digest.h>
+#include <merkle/tree.h>
+#include <mxtl/algorithm.h>
+#include <mxtl/atomic.h>
+#include <mxtl/unique_ptr.h>
+
+#include "blobstore.h"
+
+namespace {
+
+// Hashing is most of the work, so blobs are hashed by a thread per cpu, up
+// to this many.
+constexpr uint32_t kHostHashThreads = 8;
+
+// Blob data is staged and written this many blocks at a time
+constexpr uint64_t kHostWriteBlocks = 256;
+
+// Matches what blobstore_mkfs gives a device
+constexpr uint64_t kHostInodeCount = 32768;
+
+struct HostBlob {
+    const char* path;
+    void* data;
+    mxtl::unique_ptr<uint8_t[]> tree;
+    blobstore_inode_t inode;
+};
+
+// Shared by the threads hashing blobs
+struct HashState {
+    HostBlob* blobs;
+    size_t count;
+    mxtl::atomic<size_t> next;
+    mxtl::atomic<size_t> failed;
+};
+
+void* hash_thread(void* arg) {
+    HashState* state = static_cast<HashState*>(arg);
+    size_t i;
+    while ((i = state->next.fetch_add(1)) < state->count) {
+        HostBlob* blob = &state->blobs[i];
+        merkle::Tree mt;
+        merkle::Digest digest;
+        size_t tree_len = merkle::Tree::GetTreeLength(blob->inode.blob_size);
+        if ((mt.Create(blob->data, blob->inode.blob_size, blob->tree.get(), tree_len,
+                       &digest) != NO_ERROR) ||
+            (digest.CopyTo(blob->inode.merkle_root_hash,
+                           sizeof(blob->inode.merkle_root_hash)) != NO_ERROR)) {
+            fprintf(stderr, "blobstore: cannot hash '%s'\n", blob->path);
+            state->failed.fetch_add(1);
+        }
+    }
+    return nullptr;
+}
+
+// Collects the blob region in a buffer and writes it out in large pieces.
+// Blobs are laid out back to back, so the writes are sequential.
+class ImageWriter {
+public:
+    ImageWriter(int fd, uint64_t start_block, uint8_t* buffer)
+        : fd_(fd), off_(start_block * kBlobstoreBlockSize), buffer_(buffer), len_(0) {}
+
+    mx_status_t Append(const void* data, size_t len) {
+        const uint8_t* ptr = static_cast<const uint8_t*>(data);
+        while (len > 0) {
+            size_t xfer = mxtl::min(len, kHostWriteBlocks * kBlobstoreBlockSize - len_);
+            memcpy(buffer_ + len_, ptr, xfer);
+            len_ += xfer;
+            ptr += xfer;
+            len -= xfer;
+            mx_status_t status;
+            if ((len_ == kHostWriteBlocks * kBlobstoreBlockSize) &&
+                ((status = Flush()) != NO_ERROR)) {
+                return status;
+            }
+        }
+        return NO_ERROR;
+    }
+
+    // Zero fill up to the next block boundary
+    mx_status_t Pad() {
+        size_t tail = len_ % kBlobstoreBlockSize;
+        if (tail != 0) {
+            memset(buffer_ + len_, 0, kBlobstoreBlockSize - tail);
+            len_ += kBlobstoreBlockSize - tail;
+        }
+        return (len_ == kHostWriteBlocks * kBlobstoreBlockSize) ? Flush() : NO_ERROR;
+    }
+
+    mx_status_t Flush() {
+        if (len_ == 0) {
+            return NO_ERROR;
+        }
+        if (pwrite(fd_, buffer_, len_, off_) != static_cast<ssize_t>(len_)) {
+            fprintf(stderr, "blobstore: cannot write image at offset %llu\n",
+                    static_cast<unsigned long long>(off_));
+            return ERR_IO;
+        }
+        off_ += len_;
+        len_ = 0;
+        return NO_ERROR;
+    }
+
+private:
+    int fd_;
+    off_t off_;
+    uint8_t* buffer_;
+    size_t len_;
+};
+
+int usage() {
+    fprintf(stderr,
+            "usage: blobstore <image>[@<size>] create [ <file>* ]\n"
+            "\n"
+            "Builds a blobstore image holding each file as a blob. Without a size,\n"
+            "an existing image keeps its size and a new one is made just large\n"
+            "enough.\n");
+    return -1;
+}
+
+bool parse_size(const char* str, uint64_t* out) {
+    char* end;
+    uint64_t size = strtoull(str, &end, 10);
+    if (end == str) {
+        return false;
+    }
+    switch (end[0]) {
+    case 'M':
+    case 'm':
+        size *= (1024 * 1024);
+        end++;
+        break;
+    case 'G':
+    case 'g':
+        size *= (1024 * 1024 * 1024);
+        end++;
+        break;
+    }
+    *out = size;
+    return end[0] == 0;
+}
+
+// Map the blobs and size their Merkle trees
+int load_blobs(HostBlob* blobs, size_t* count, int argc, char** argv) {
+    AllocChecker ac;
+    size_t n = 0;
+    for (int i = 0; i < argc; i++) {
+        struct stat s;
+        int fd;
+        if ((fd = open(argv[i], O_RDONLY)) < 0 || fstat(fd, &s) < 0) {
+            fprintf(stderr, "blobstore: cannot open '%s': %s\n", argv[i], strerror(errno));
+            return -1;
+        } else if (!S_ISREG(s.st_mode)) {
+            fprintf(stderr, "blobstore: '%s' is not a file\n", argv[i]);
+            close(fd);
+            return -1;
+        } else if (s.st_size == 0) {
+            // The filesystem has no way to hold an empty blob either
+            fprintf(stderr, "blobstore: skipping empty '%s'\n", argv[i]);
+            close(fd);
+            continue;
+        }
+        HostBlob* blob = &blobs[n];
+        blob->path = argv[i];
+        blob->data = mmap(nullptr, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (blob->data == MAP_FAILED) {
+            fprintf(stderr, "blobstore: cannot map '%s'\n", argv[i]);
+            return -1;
+        }
+        memset(&blob->inode, 0, sizeof(blob->inode));
+        blob->inode.blob_size = s.st_size;
+        blob->tree.reset(new (&ac) uint8_t[merkle::Tree::GetTreeLength(s.st_size)]);
+        if (!ac.check()) {
+            fprintf(stderr, "blobstore: out of memory\n");
+            return -1;
+        }
+        n++;
+    }
+    *count = n;
+    return 0;
+}
+
+int hash_blobs(HostBlob* blobs, size_t count) {
+    HashState state;
+    state.blobs = blobs;
+    state.count = count;
+    state.next.store(0);
+    state.failed.store(0);
+
+    // This thread hashes alongside the workers, and on its own if none
+    // could be started
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t threads = (cpus > 0) ? mxtl::min(static_cast<uint32_t>(cpus), kHostHashThreads) : 1;
+    pthread_t workers[kHostHashThreads];
+    uint32_t started = 0;
+    while ((started + 1 < threads) && (started + 1 < count)) {
+        if (pthread_create(&workers[started], nullptr, hash_thread, &state) != 0) {
+            break;
+        }
+        started++;
+    }
+    hash_thread(&state);
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(workers[i], nullptr);
+    }
+    return (state.failed.load() == 0) ? 0 : -1;
+}
+
+int do_create(int fd, uint64_t size, int argc, char** argv) {
+    AllocChecker ac;
+    mxtl::unique_ptr<HostBlob[]> blobs(new (&ac) HostBlob[argc]);
+    if (!ac.check()) {
+        fprintf(stderr, "blobstore: out of memory\n");
+        return -1;
+    }
+    size_t count;
+    if (load_blobs(blobs.get(), &count, argc, argv) < 0 ||
+        hash_blobs(blobs.get(), count) < 0) {
+        return -1;
+    }
+    if (count > kHostInodeCount) {
+        fprintf(stderr, "blobstore: %zu blobs, but only room for %lu\n", count, kHostInodeCount);
+        return -1;
+    }
+
+    // Plan the whole image: nodes are handed out in order, and blobs are
+    // packed back to back after the metadata, each Merkle tree first.
+    blobstore_info_t info;
+    memset(&info, 0, sizeof(info));
+    info.magic0 = kBlobstoreMagic0;
+    info.magic1 = kBlobstoreMagic1;
+    info.version = kBlobstoreVersion;
+    info.flags = kBlobstoreFlagClean;
+    info.block_size = kBlobstoreBlockSize;
+    info.inode_count = kHostInodeCount;
+
+    uint64_t data_blocks = 0;
+    for (size_t i = 0; i < count; i++) {
+        blobstore_inode_t* inode = &blobs[i].inode;
+        for (size_t j = 0; j < i; j++) {
+            if (!memcmp(blobs[j].inode.merkle_root_hash, inode->merkle_root_hash,
+                        sizeof(inode->merkle_root_hash))) {
+                fprintf(stderr, "blobstore: '%s' and '%s' are the same blob\n",
+                        blobs[j].path, blobs[i].path);
+                return -1;
+            }
+        }
+        inode->num_blocks = MerkleTreeBlocks(*inode) + BlobDataBlocks(*inode);
+        inode->start_block = data_blocks;
+        data_blocks += inode->num_blocks;
+    }
+
+    // The map sizes depend on the block count, so settle the count before
+    // placing the data.
+    info.block_count = size / kBlobstoreBlockSize;
+    if (size == 0) {
+        info.block_count = 1 + NodeMapBlocks(info) + data_blocks;
+        while (DataStartBlock(info) + data_blocks > info.block_count) {
+            info.block_count++;
+        }
+    }
+    uint64_t data_start = DataStartBlock(info);
+    if (data_start + data_blocks > info.block_count) {
+        fprintf(stderr, "blobstore: %lu blocks of blobs don't fit in %lu blocks\n",
+                data_blocks, info.block_count);
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        blobs[i].inode.start_block += data_start;
+    }
+
+    // The metadata goes out in one write
+    uint64_t meta_len = data_start * kBlobstoreBlockSize;
+    mxtl::unique_ptr<uint8_t[]> meta(new (&ac) uint8_t[meta_len]);
+    if (!ac.check()) {
+        fprintf(stderr, "blobstore: out of memory\n");
+        return -1;
+    }
+    memset(meta.get(), 0, meta_len);
+    memcpy(meta.get(), &info, sizeof(info));
+    RawBitmap abm;
+    if (abm.Reset(BlockMapBlocks(info) * kBlobstoreBlockBits) != NO_ERROR ||
+        abm.Shrink(info.block_count) != NO_ERROR) {
+        fprintf(stderr, "blobstore: cannot allocate block map\n");
+        return -1;
+    }
+    abm.Set(0, data_start + data_blocks);
+    memcpy(meta.get() + BlockMapStartBlock() * kBlobstoreBlockSize,
+           abm.StorageUnsafe()->GetData(), BlockMapBlocks(info) * kBlobstoreBlockSize);
+    blobstore_inode_t* nodes = reinterpret_cast<blobstore_inode_t*>(
+            meta.get() + NodeMapStartBlock(info) * kBlobstoreBlockSize);
+    for (size_t i = 0; i < count; i++) {
+        nodes[i] = blobs[i].inode;
+    }
+    if (pwrite(fd, meta.get(), meta_len, 0) != static_cast<ssize_t>(meta_len)) {
+        fprintf(stderr, "blobstore: cannot write metadata\n");
+        return -1;
+    }
+
+    mxtl::unique_ptr<uint8_t[]> buffer(new (&ac) uint8_t[kHostWriteBlocks * kBlobstoreBlockSize]);
+    if (!ac.check()) {
+        fprintf(stderr, "blobstore: out of memory\n");
+        return -1;
+    }
+    ImageWriter writer(fd, data_start, buffer.get());
+    for (size_t i = 0; i < count; i++) {
+        const blobstore_inode_t& inode = blobs[i].inode;
+        if ((writer.Append(blobs[i].tree.get(),
+                           merkle::Tree::GetTreeLength(inode.blob_size)) != NO_ERROR) ||
+            (writer.Pad() != NO_ERROR) ||
+            (writer.Append(blobs[i].data, inode.blob_size) != NO_ERROR) ||
+            (writer.Pad() != NO_ERROR)) {
+            return -1;
+        }
+        munmap(blobs[i].data, inode.blob_size);
+    }
+    if ((writer.Flush() != NO_ERROR) ||
+        (ftruncate(fd, info.block_count * kBlobstoreBlockSize) < 0)) {
+        fprintf(stderr, "blobstore: cannot finish image\n");
+        return -1;
+    }
+    return 0;
+}
+
+} // namespace anonymous
+
+int main(int argc, char** argv) {
+    if (argc < 3 || (strcmp(argv[2], "create") && strcmp(argv[2], "mkfs"))) {
+        return usage();
+    }
+
+    char* fn = argv[1];
+    uint64_t size = 0;
+    char* sizestr;
+    if ((sizestr = strchr(fn, '@')) != nullptr) {
+        *sizestr++ = 0;
+        if (!parse_size(sizestr, &size) || size == 0) {
+            fprintf(stderr, "blobstore: bad size: %s\n", sizestr);
+            return usage();
+        }
+    }
+
+    int fd;
+    if ((fd = open(fn, O_RDWR | O_CREAT, 0644)) < 0) {
+        fprintf(stderr, "error: cannot open '%s'\n", fn);
+        return -1;
+    }
+    struct stat s;
+    if (size == 0 && fstat(fd, &s) == 0) {
+        size = s.st_size;
+    }
+    int r = do_create(fd, size, argc - 3, argv + 3);
+    close(fd);
+    return r;
+}
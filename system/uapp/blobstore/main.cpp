@@ -18,10 +18,10 @@
 #include "blobstore-private.h"
 #include "fs/vfs.h"
 
-// TODO(smklein): Implement fsck for blobstore
-
 namespace {
 
+bool report_progress = false;
+
 int do_blobstore_mount(int fd, int argc, char** argv) {
     mxtl::RefPtr<blobstore::VnodeBlob> vn;
     if (blobstore::blobstore_mount(&vn, fd) < 0) {
@@ -40,6 +40,10 @@ int do_blobstore_mkfs(int fd, int argc, char** argv) {
     return blobstore::blobstore_mkfs(fd);
 }
 
+int do_blobstore_check(int fd, int argc, char** argv) {
+    return blobstore::blobstore_check(fd, report_progress);
+}
+
 struct {
     const char* name;
     int (*func)(int fd, int argc, char**argv);
@@ -47,12 +51,16 @@ struct {
 } CMDS[] = {
     {"create", do_blobstore_mkfs, "initialize filesystem"},
     {"mkfs", do_blobstore_mkfs, "initialize filesystem"},
+    {"check", do_blobstore_check, "check filesystem integrity"},
+    {"fsck", do_blobstore_check, "check filesystem integrity"},
     {"mount", do_blobstore_mount, "mount filesystem"},
 };
 
 int usage() {
     fprintf(stderr,
-            "usage: blobstore <command> [ <arg>* ]\n"
+            "usage: blobstore [ <option>* ] <command> [ <arg>* ]\n"
+            "\n"
+            "options:  -p         report progress while checking\n"
             "\n"
             "On Fuchsia, blobstore takes the block device argument by handle.\n"
             "This can make 'blobstore' commands hard to invoke from command line.\n"
@@ -69,6 +77,17 @@ int usage() {
 } // namespace anonymous
 
 int main(int argc, char** argv) {
+    while (argc > 1) {
+        if (!strcmp(argv[1], "-p")) {
+            report_progress = true;
+        } else if (!strcmp(argv[1], "-v")) {
+            // Nothing more to say; accepted since fsck passes it to every filesystem
+        } else {
+            break;
+        }
+        argc--;
+        argv++;
+    }
     if (argc < 2) {
         return usage();
     }
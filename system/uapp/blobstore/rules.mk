@@ -13,6 +13,7 @@ MODULE_NAME := blobstore
 # app main
 MODULE_SRCS := \
     $(LOCAL_DIR)/blobstore.cpp \
+    $(LOCAL_DIR)/blobstore-check.cpp \
     $(LOCAL_DIR)/blobstore-ops.cpp \
     $(LOCAL_DIR)/main.cpp \
     $(LOCAL_DIR)/rpc.cpp \
@@ -21,6 +22,7 @@ MODULE_STATIC_LIBS := \
     system/ulib/fs \
     system/ulib/merkle \
     third_party/ulib/cryptolib \
+    third_party/ulib/lz4 \
     system/ulib/mxcpp \
     system/ulib/mxtl \
 
@@ -31,3 +33,47 @@ MODULE_LIBS := \
     system/ulib/bitmap \
 
 include make/module.mk
+
+
+# host blobstore image builder
+
+# As with merkleroot, hash with cryptolib on hosts without the OpenSSL headers
+OPENSSL_DIR ?= /usr/include/openssl
+
+MODULE := $(LOCAL_DIR).host
+
+MODULE_NAME := blobstore
+
+MODULE_TYPE := hostapp
+
+MODULE_SRCS := \
+    $(LOCAL_DIR)/host.cpp \
+    system/ulib/bitmap/raw-bitmap.cpp \
+    system/ulib/bitmap/summary-bitmap.cpp \
+    system/ulib/merkle/digest.cpp \
+    system/ulib/merkle/tree.cpp \
+    system/ulib/mxcpp/new.cpp \
+    system/ulib/mxcpp/pure_virtual.cpp \
+
+MODULE_COMPILEFLAGS := \
+    -Werror-implicit-function-declaration \
+    -Wstrict-prototypes -Wwrite-strings \
+    -Isystem/ulib/bitmap/include \
+    -Isystem/ulib/merkle/include \
+    -Isystem/ulib/mxcpp/include \
+    -Isystem/ulib/mxtl/include \
+
+MODULE_DEFINES := _POSIX_C_SOURCE=200809L
+
+# Blobs are hashed on several threads
+MODULE_HOST_LIBS := -lpthread
+
+ifneq (,$(wildcard $(OPENSSL_DIR)/sha.h))
+MODULE_DEFINES += USE_LIBCRYPTO=1
+MODULE_HOST_LIBS += -lcrypto
+else
+MODULE_COMPILEFLAGS += -Ithird_party/ulib/cryptolib/include
+MODULE_SRCS += third_party/ulib/cryptolib/cryptolib.c
+endif
+
+include make/module.mk
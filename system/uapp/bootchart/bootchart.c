@@ -0,0 +1,183 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <magenta/ktrace.h>
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// The start of one stage of booting, as recorded by the bootloader, the
+// kernel's init hooks, userboot or devmgr.
+typedef struct {
+    uint64_t ts;
+    char name[32];
+} stage_t;
+
+typedef struct {
+    stage_t* stages;
+    size_t num_stages;
+    size_t capacity;
+    uint64_t ticks_per_ms;
+} timeline_t;
+
+static void add_stage(timeline_t* t, uint64_t ts, const char* name, size_t len) {
+    if (t->num_stages == t->capacity) {
+        t->capacity = t->capacity ? t->capacity * 2 : 64;
+        t->stages = realloc(t->stages, t->capacity * sizeof(stage_t));
+    }
+    stage_t* s = &t->stages[t->num_stages++];
+    s->ts = ts;
+    len = strnlen(name, len < sizeof(s->name) ? len : sizeof(s->name) - 1);
+    memcpy(s->name, name, len);
+    s->name[len] = 0;
+}
+
+// Boot stages are kept in the metadata at the start of the trace, so this
+// stops at the first record which is not metadata.
+static int read_timeline(int fd, timeline_t* t) {
+    static uint8_t buf[64 * 1024];
+    size_t avail = 0;
+    for (;;) {
+        ssize_t r = read(fd, buf + avail, sizeof(buf) - avail);
+        if (r < 0) {
+            return -1;
+        }
+        avail += r;
+        uint8_t* p = buf;
+        while (avail >= sizeof(uint32_t)) {
+            uint32_t tag;
+            memcpy(&tag, p, sizeof(tag));
+            size_t len = KTRACE_LEN(tag);
+            if (len == 0 || KTRACE_GROUP(tag) != KTRACE_GRP_META) {
+                return 0;
+            }
+            if (len > avail) {
+                break;
+            }
+            switch (KTRACE_EVENT(tag)) {
+            case KTRACE_EVENT(TAG_TICKS_PER_MS): {
+                ktrace_rec_32b_t rec;
+                memcpy(&rec, p, sizeof(rec));
+                t->ticks_per_ms = ((uint64_t)rec.b << 32) | rec.a;
+                break;
+            }
+            case KTRACE_EVENT(TAG_BOOT_STAGE): {
+                ktrace_rec_name_t* rec = (ktrace_rec_name_t*)p;
+                add_stage(t, ((uint64_t)rec->arg << 32) | rec->id,
+                          rec->name, len - KTRACE_NAMESIZE);
+                break;
+            }
+            }
+            p += len;
+            avail -= len;
+        }
+        if (r == 0) {
+            return 0;
+        }
+        memmove(buf, p, avail);
+    }
+}
+
+static int compare_stages(const void* a, const void* b) {
+    uint64_t ta = ((const stage_t*)a)->ts;
+    uint64_t tb = ((const stage_t*)b)->ts;
+    return ta < tb ? -1 : ta > tb;
+}
+
+// Prints each stage with its start and how long it ran until the next one,
+// and a bar scaled to the longest stage shown.
+static void print_timeline(const timeline_t* t, double min_ms, int width) {
+    double scale = 1.0 / (t->ticks_per_ms ? t->ticks_per_ms : 1);
+    double longest = 0.0;
+    for (size_t i = 0; i + 1 < t->num_stages; i++) {
+        double ms = (t->stages[i + 1].ts - t->stages[i].ts) * scale;
+        if (ms > longest) {
+            longest = ms;
+        }
+    }
+
+    printf("%10s %10s  %-32s\n", "START(ms)", "TIME(ms)", "STAGE");
+    uint64_t start = t->stages[0].ts;
+    for (size_t i = 0; i < t->num_stages; i++) {
+        const stage_t* s = &t->stages[i];
+        double ms = (i + 1 < t->num_stages) ? (s[1].ts - s->ts) * scale : 0.0;
+        if (ms < min_ms && i + 1 < t->num_stages) {
+            continue;
+        }
+        printf("%10.3f %10.3f  %-32s ", (s->ts - start) * scale, ms, s->name);
+        int n = longest > 0.0 ? (int)(ms / longest * width + 0.5) : 0;
+        for (int j = 0; j < n; j++) {
+            putchar('#');
+        }
+        putchar('\n');
+    }
+    printf("%zu stages, %.3f ms from the first to the last\n", t->num_stages,
+           (t->stages[t->num_stages - 1].ts - start) * scale);
+}
+
+static void print_help(FILE* f) {
+    fprintf(f, "Usage: bootchart [options] [FILE]\n");
+    fprintf(f, "Shows where boot time went, from the bootloader through devmgr,\n");
+    fprintf(f, "using the boot stages recorded in the ktrace buffer.\n");
+    fprintf(f, "FILE defaults to /dev/misc/ktrace.\n");
+    fprintf(f, "Options:\n");
+    fprintf(f, " -m MS     Hide stages shorter than MS milliseconds (default 0)\n");
+    fprintf(f, " -w WIDTH  Width of the longest bar (default 40)\n");
+}
+
+int main(int argc, char** argv) {
+    const char* path = "/dev/misc/ktrace";
+    double min_ms = 0.0;
+    long width = 40;
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        char* end;
+        if (!strcmp(arg, "--help")) {
+            print_help(stdout);
+            return 0;
+        } else if (!strcmp(arg, "-m")) {
+            if (++i == argc || (min_ms = strtod(argv[i], &end)) < 0.0 || *end != '\0') {
+                fprintf(stderr, "-m needs a number of milliseconds\n");
+                return 1;
+            }
+        } else if (!strcmp(arg, "-w")) {
+            if (++i == argc || (width = strtol(argv[i], &end, 10)) <= 0 || *end != '\0') {
+                fprintf(stderr, "-w needs a positive number\n");
+                return 1;
+            }
+        } else if (arg[0] == '-') {
+            fprintf(stderr, "Unknown option: %s\n", arg);
+            print_help(stderr);
+            return 1;
+        } else {
+            path = arg;
+        }
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "error: cannot open '%s'\n", path);
+        return 1;
+    }
+    timeline_t t = {};
+    if (read_timeline(fd, &t) < 0) {
+        fprintf(stderr, "error: cannot read '%s'\n", path);
+        close(fd);
+        return 1;
+    }
+    close(fd);
+
+    if (t.num_stages == 0) {
+        fprintf(stderr, "error: no boot stages in '%s'\n", path);
+        return 1;
+    }
+    qsort(t.stages, t.num_stages, sizeof(stage_t), compare_stages);
+    print_timeline(&t, min_ms, (int)width);
+    free(t.stages);
+    return 0;
+}
@@ -22,6 +22,7 @@ struct {
     const char* name;
     disk_format_t df;
 } FILESYSTEMS[] = {
+    {"blobstore", DISK_FORMAT_BLOBFS},
     {"minfs", DISK_FORMAT_MINFS},
     {"fat", DISK_FORMAT_FAT},
 };
@@ -29,6 +30,7 @@ struct {
 int usage(void) {
     fprintf(stderr, "usage: fsck [ <option>* ] devicepath filesystem\n");
     fprintf(stderr, " -v  : Verbose mode\n");
+    fprintf(stderr, " -p  : Report progress while checking\n");
     fprintf(stderr, " values for 'filesystem' include:\n");
     for (size_t i = 0; i < countof(FILESYSTEMS); i++) {
         fprintf(stderr, "  '%s'\n", FILESYSTEMS[i].name);
@@ -42,6 +44,8 @@ int parse_args(int argc, char** argv, fsck_options_t* options, disk_format_t* df
     while (argc > 1) {
         if (!strcmp(argv[1], "-v")) {
             options->verbose = true;
+        } else if (!strcmp(argv[1], "-p")) {
+            options->progress = true;
         } else {
             break;
         }
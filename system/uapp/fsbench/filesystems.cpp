@@ -0,0 +1,95 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "fsbench.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fs-management/ramdisk.h>
+
+namespace fsbench {
+
+namespace {
+
+constexpr uint64_t kBlockSize = 512;
+
+bool MakeRoot(const char* path) {
+    if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+        fprintf(stderr, "fsbench: cannot create %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool Setup(const FsInfo& info, const Options& options, Mount* mount) {
+    mount->info = &info;
+    mount->disk[0] = '\0';
+    snprintf(mount->root, sizeof(mount->root), "/tmp/fsbench-%s", info.name);
+    if (!MakeRoot(mount->root))
+        return false;
+    if (info.format == DISK_FORMAT_UNKNOWN)
+        return true;
+
+    if (create_ramdisk("fsbench", mount->disk, kBlockSize, options.disk_size / kBlockSize)) {
+        fprintf(stderr, "fsbench: %s: cannot create ramdisk\n", info.name);
+        rmdir(mount->root);
+        return false;
+    }
+    mx_status_t status = mkfs(mount->disk, info.format, launch_stdio_sync);
+    if (status != NO_ERROR) {
+        fprintf(stderr, "fsbench: %s: mkfs failed: %d\n", info.name, status);
+        destroy_ramdisk(mount->disk);
+        rmdir(mount->root);
+        return false;
+    }
+
+    // The fd is consumed by mount(), which waits until the filesystem is
+    // ready.
+    int fd = open(mount->disk, O_RDWR);
+    if (fd < 0) {
+        fprintf(stderr, "fsbench: %s: cannot open %s\n", info.name, mount->disk);
+        destroy_ramdisk(mount->disk);
+        rmdir(mount->root);
+        return false;
+    }
+    status = ::mount(fd, mount->root, info.format, &default_mount_options, launch_logs_async);
+    if (status != NO_ERROR) {
+        fprintf(stderr, "fsbench: %s: mount failed: %d\n", info.name, status);
+        destroy_ramdisk(mount->disk);
+        rmdir(mount->root);
+        return false;
+    }
+    return true;
+}
+
+bool Teardown(Mount* mount) {
+    bool ok = true;
+    if (mount->info->format != DISK_FORMAT_UNKNOWN) {
+        mx_status_t status = umount(mount->root);
+        if (status != NO_ERROR) {
+            fprintf(stderr, "fsbench: %s: unmount failed: %d\n", mount->info->name, status);
+            ok = false;
+        }
+        if (destroy_ramdisk(mount->disk)) {
+            fprintf(stderr, "fsbench: %s: cannot destroy ramdisk\n", mount->info->name);
+            ok = false;
+        }
+    }
+    // The workloads remove everything they make, so this only fails if one
+    // of them could not.
+    if (rmdir(mount->root) < 0) {
+        fprintf(stderr, "fsbench: cannot remove %s: %s\n", mount->root, strerror(errno));
+        ok = false;
+    }
+    return ok;
+}
+
+} // namespace fsbench
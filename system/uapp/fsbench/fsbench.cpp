@@ -0,0 +1,298 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// fsbench runs a set of workloads against each filesystem, each on a fresh
+// ramdisk (memfs uses a directory in /tmp): sequential and random reads
+// and writes at each block size, a storm of creates and unlinks, reading
+// directories of growing size and fsync() after small writes.  Each runs
+// on one or more threads at once, and reports its throughput and the
+// distribution of the time each operation took.
+
+#include "fsbench.h"
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace fsbench {
+
+namespace {
+
+const FsInfo kFilesystems[] = {
+    {"memfs", DISK_FORMAT_UNKNOWN, false},
+    {"minfs", DISK_FORMAT_MINFS, false},
+    {"blobstore", DISK_FORMAT_BLOBFS, true},
+};
+
+const struct {
+    const char* name;
+    Workload workload;
+} kWorkloads[] = {
+    {"seqwrite", kSeqWrite},
+    {"seqread", kSeqRead},
+    {"randwrite", kRandWrite},
+    {"randread", kRandRead},
+    {"create", kCreate},
+    {"readdir", kReaddir},
+    {"fsync", kFsync},
+};
+
+// Reads a size with an optional K, M or G suffix.
+bool ParseSize(const char* str, uint64_t* out) {
+    char* end;
+    uint64_t n = strtoull(str, &end, 10);
+    switch (*end) {
+    case 'G':
+    case 'g':
+        n *= 1024;
+    // fall through
+    case 'M':
+    case 'm':
+        n *= 1024;
+    // fall through
+    case 'K':
+    case 'k':
+        n *= 1024;
+        end++;
+        break;
+    }
+    *out = n;
+    return end != str && *end == '\0' && n != 0;
+}
+
+// Reads a comma-separated list of sizes.
+template <typename T>
+bool ParseSizes(char* str, T* sizes, size_t* count) {
+    *count = 0;
+    for (char* item = strtok(str, ","); item != nullptr; item = strtok(nullptr, ",")) {
+        uint64_t size;
+        if (*count == kMaxSizes || !ParseSize(item, &size))
+            return false;
+        sizes[(*count)++] = static_cast<T>(size);
+    }
+    return *count != 0;
+}
+
+bool ParseWorkloads(char* str, uint32_t* out) {
+    *out = 0;
+    for (char* item = strtok(str, ","); item != nullptr; item = strtok(nullptr, ",")) {
+        uint32_t workload = 0;
+        for (const auto& w : kWorkloads) {
+            if (!strcmp(item, w.name))
+                workload = w.workload;
+        }
+        if (workload == 0)
+            return false;
+        *out |= workload;
+    }
+    return *out != 0;
+}
+
+bool ParseCount(const char* str, uint32_t* out) {
+    uint64_t n;
+    if (!ParseSize(str, &n) || n > UINT32_MAX)
+        return false;
+    *out = static_cast<uint32_t>(n);
+    return true;
+}
+
+int Usage(const char* argv0) {
+    fprintf(stderr,
+            "Usage: %s [options ...] [memfs|minfs|blobstore ...]\n"
+            "\n"
+            "Benchmarks each filesystem given (all of them by default).\n"
+            "\n"
+            "Options:\n"
+            "  -h          show help (this)\n"
+            "  -w LIST     workloads to run, from seqwrite, seqread, randwrite,\n"
+            "              randread, create, readdir and fsync (default: all)\n"
+            "  -b SIZES    block sizes for reads and writes (default: 4K,64K,1M)\n"
+            "  -s SIZE     size of each thread's file (default: 16M)\n"
+            "  -j N        threads to run each workload on at once (default: 1)\n"
+            "  -n COUNTS   directory sizes to read (default: 10000,100000,1000000)\n"
+            "  -p N        passes over each directory (default: 10)\n"
+            "  -c N        files each thread creates and unlinks (default: 1000)\n"
+            "  -y N        writes each thread fsyncs (default: 100)\n"
+            "  -m SIZE     size of the ramdisk (default: 512M)\n"
+            "  -o FILE     write the latencies to FILE as perftest JSON\n"
+            "\n"
+            "Sizes take a K, M or G suffix.  Filesystems which run out of\n"
+            "space for a directory skip the larger sizes.\n",
+            argv0);
+    return 1;
+}
+
+bool RunAll(const Mount& mount, const Options& options, Report* report) {
+    bool ok = true;
+    uint32_t io = kSeqWrite | kSeqRead | kRandWrite | kRandRead;
+    if (options.workloads & io) {
+        for (size_t i = 0; i < options.num_block_sizes; i++)
+            ok = RunIo(mount, options, options.block_sizes[i], report) && ok;
+    }
+    if (options.workloads & kCreate)
+        ok = RunCreate(mount, options, report) && ok;
+    if (options.workloads & kReaddir) {
+        for (size_t i = 0; i < options.num_dir_sizes; i++)
+            ok = RunReaddir(mount, options, options.dir_sizes[i], report) && ok;
+    }
+    if (options.workloads & kFsync)
+        ok = RunFsync(mount, options, report) && ok;
+    return ok;
+}
+
+} // namespace
+
+void FormatSize(uint64_t size, char* out, size_t len) {
+    if (size >= (1u << 30) && size % (1u << 30) == 0)
+        snprintf(out, len, "%" PRIu64 "GB", size >> 30);
+    else if (size >= (1u << 20) && size % (1u << 20) == 0)
+        snprintf(out, len, "%" PRIu64 "MB", size >> 20);
+    else if (size >= (1u << 10) && size % (1u << 10) == 0)
+        snprintf(out, len, "%" PRIu64 "KB", size >> 10);
+    else
+        snprintf(out, len, "%" PRIu64 "B", size);
+}
+
+void Report::PrintHeader() const {
+    printf("%-10s %-10s %8s %7s %9s %22s %10s %10s %10s %10s\n", "fs", "workload", "size",
+           "threads", "ops", "throughput", "p50 us", "p90 us", "p99 us", "max us");
+}
+
+bool Report::Add(const Mount& mount, const char* workload, const char* size, uint32_t threads,
+                 double* latencies, uint32_t ops, double amount, const char* unit,
+                 double elapsed) {
+    char label[128];
+    snprintf(label, sizeof(label), "%s/%s/%s/j%u", mount.info->name, workload, size, threads);
+    perftest::Result result;
+    perftest::Summarize(label, latencies, ops, &result);
+
+    char rate[32];
+    snprintf(rate, sizeof(rate), "%.1f %s/s", amount / (elapsed / 1e9), unit);
+    printf("%-10s %-10s %8s %7u %9u %22s %10.1f %10.1f %10.1f %10.1f\n", mount.info->name,
+           workload, size, threads, ops, rate, result.median / 1e3,
+           perftest::Percentile(latencies, ops, 0.9) / 1e3,
+           perftest::Percentile(latencies, ops, 0.99) / 1e3, result.max / 1e3);
+
+    if (!results_->Add(result)) {
+        fprintf(stderr, "fsbench: out of memory\n");
+        return false;
+    }
+    return true;
+}
+
+void Report::Skip(const Mount& mount, const char* workload, const char* why) const {
+    printf("%-10s %-10s skipped: %s\n", mount.info->name, workload, why);
+}
+
+} // namespace fsbench
+
+int main(int argc, char** argv) {
+    using namespace fsbench;
+
+    Options options = {};
+    options.block_sizes[0] = 4 * 1024;
+    options.block_sizes[1] = 64 * 1024;
+    options.block_sizes[2] = 1024 * 1024;
+    options.num_block_sizes = 3;
+    options.file_size = 16 * 1024 * 1024;
+    options.threads = 1;
+    options.dir_sizes[0] = 10000;
+    options.dir_sizes[1] = 100000;
+    options.dir_sizes[2] = 1000000;
+    options.num_dir_sizes = 3;
+    options.readdir_passes = 10;
+    options.create_count = 1000;
+    options.fsync_count = 100;
+    options.disk_size = 512 * 1024 * 1024;
+    options.workloads = kAllWorkloads;
+    const char* out_path = nullptr;
+
+    int opt;
+    uint64_t size;
+    while ((opt = getopt(argc, argv, "hw:b:s:j:n:p:c:y:m:o:")) != -1) {
+        bool valid = true;
+        switch (opt) {
+        case 'w':
+            valid = ParseWorkloads(optarg, &options.workloads);
+            break;
+        case 'b':
+            valid = ParseSizes(optarg, options.block_sizes, &options.num_block_sizes);
+            break;
+        case 's':
+            valid = ParseSize(optarg, &size);
+            options.file_size = size;
+            break;
+        case 'j':
+            valid = ParseCount(optarg, &options.threads);
+            break;
+        case 'n':
+            valid = ParseSizes(optarg, options.dir_sizes, &options.num_dir_sizes);
+            break;
+        case 'p':
+            valid = ParseCount(optarg, &options.readdir_passes);
+            break;
+        case 'c':
+            valid = ParseCount(optarg, &options.create_count);
+            break;
+        case 'y':
+            valid = ParseCount(optarg, &options.fsync_count);
+            break;
+        case 'm':
+            valid = ParseSize(optarg, &options.disk_size);
+            break;
+        case 'o':
+            out_path = optarg;
+            break;
+        default:
+            valid = false;
+        }
+        if (!valid)
+            return Usage(argv[0]);
+    }
+
+    const FsInfo* selected[countof(kFilesystems)];
+    size_t num_selected = 0;
+    if (optind == argc) {
+        for (const auto& info : kFilesystems)
+            selected[num_selected++] = &info;
+    }
+    for (int i = optind; i < argc; i++) {
+        const FsInfo* found = nullptr;
+        for (const auto& info : kFilesystems) {
+            if (!strcmp(argv[i], info.name))
+                found = &info;
+        }
+        if (found == nullptr || num_selected == countof(selected))
+            return Usage(argv[0]);
+        selected[num_selected++] = found;
+    }
+
+    perftest::ResultSet results;
+    Report report(&results);
+    report.PrintHeader();
+    bool ok = true;
+    for (size_t i = 0; i < num_selected; i++) {
+        Mount mount;
+        if (!Setup(*selected[i], options, &mount)) {
+            ok = false;
+            continue;
+        }
+        ok = RunAll(mount, options, &report) && ok;
+        ok = Teardown(&mount) && ok;
+    }
+
+    if (out_path != nullptr) {
+        FILE* out = fopen(out_path, "w");
+        bool written = out != nullptr && results.WriteJson(out);
+        if (out != nullptr && fclose(out) != 0)
+            written = false;
+        if (!written) {
+            fprintf(stderr, "fsbench: cannot write %s\n", out_path);
+            ok = false;
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <fs-management/mount.h>
+#include <perftest/perftest.h>
+
+namespace fsbench {
+
+enum Workload : uint32_t {
+    kSeqWrite = 1u << 0,
+    kSeqRead = 1u << 1,
+    kRandWrite = 1u << 2,
+    kRandRead = 1u << 3,
+    kCreate = 1u << 4,
+    kReaddir = 1u << 5,
+    kFsync = 1u << 6,
+    kAllWorkloads = (1u << 7) - 1,
+};
+
+constexpr size_t kMaxSizes = 8;
+
+struct Options {
+    // Each thread does its own I/O to its own file of |file_size| bytes, once
+    // for each block size.
+    size_t block_sizes[kMaxSizes];
+    size_t num_block_sizes;
+    size_t file_size;
+    uint32_t threads;
+    // Directories are enumerated once they hold each count of entries.
+    uint32_t dir_sizes[kMaxSizes];
+    size_t num_dir_sizes;
+    uint32_t readdir_passes;
+    // Files each thread creates and then unlinks.
+    uint32_t create_count;
+    // Writes, each followed by an fsync(), by each thread.
+    uint32_t fsync_count;
+    // Size of the ramdisk backing the filesystems which need one.
+    uint64_t disk_size;
+    uint32_t workloads;
+};
+
+struct FsInfo {
+    const char* name;
+    // DISK_FORMAT_UNKNOWN for memfs, which lives in /tmp rather than on a
+    // device of its own.
+    disk_format_t format;
+    // Blobstore only holds blobs: files named by the Merkle root of their
+    // contents and written once, in full, before they can be read.
+    bool blobs;
+};
+
+// A filesystem set up for the workloads to run on.
+struct Mount {
+    const FsInfo* info;
+    char root[PATH_MAX];
+    char disk[PATH_MAX];
+};
+
+bool Setup(const FsInfo& info, const Options& options, Mount* mount);
+bool Teardown(Mount* mount);
+
+// Collects the measurements of each workload, prints them and keeps them
+// in |results| for writing out as JSON.
+class Report {
+public:
+    explicit Report(perftest::ResultSet* results) : results_(results) {}
+
+    void PrintHeader() const;
+    // |latencies| holds |ops| > 0 durations in nanoseconds, and is sorted
+    // in place.  |amount| is how many |unit|s the threads got through, all
+    // together, in the |elapsed| nanoseconds the workload took.
+    bool Add(const Mount& mount, const char* workload, const char* size, uint32_t threads,
+             double* latencies, uint32_t ops, double amount, const char* unit, double elapsed);
+    void Skip(const Mount& mount, const char* workload, const char* why) const;
+
+private:
+    perftest::ResultSet* results_;
+};
+
+// Each returns false if the filesystem misbehaved, after cleaning up what
+// it created.
+bool RunIo(const Mount& mount, const Options& options, size_t block_size, Report* report);
+bool RunCreate(const Mount& mount, const Options& options, Report* report);
+bool RunReaddir(const Mount& mount, const Options& options, uint32_t entries, Report* report);
+bool RunFsync(const Mount& mount, const Options& options, Report* report);
+
+// Formats |size| as "4KB", "1MB" and so on.
+void FormatSize(uint64_t size, char* out, size_t len);
+
+} // namespace fsbench
@@ -0,0 +1,29 @@
+# Copyright 2017 The Fuchsia Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+LOCAL_DIR := $(GET_LOCAL_DIR)
+
+MODULE := $(LOCAL_DIR)
+
+MODULE_TYPE := userapp
+
+MODULE_SRCS += \
+    $(LOCAL_DIR)/filesystems.cpp \
+    $(LOCAL_DIR)/fsbench.cpp \
+    $(LOCAL_DIR)/workloads.cpp \
+
+MODULE_STATIC_LIBS := \
+    system/ulib/perftest \
+    system/ulib/merkle \
+    third_party/ulib/cryptolib \
+    system/ulib/mxtl \
+    system/ulib/mxcpp \
+
+MODULE_LIBS := \
+    system/ulib/fs-management \
+    system/ulib/mxio \
+    system/ulib/magenta \
+    system/ulib/c \
+
+include make/module.mk
@@ -0,0 +1,704 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "fsbench.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include <magenta/device/vfs.h>
+#include <magenta/new.h>
+#include <magenta/syscalls.h>
+#include <merkle/digest.h>
+#include <merkle/tree.h>
+#include <mxtl/unique_ptr.h>
+
+namespace fsbench {
+
+namespace {
+
+constexpr double kMB = 1024.0 * 1024.0;
+constexpr size_t kFsyncBlockSize = 4096;
+// Room for a blob's name: the hex digest and a slash.
+constexpr size_t kBlobNameLen = merkle::Digest::kLength * 2 + 2;
+// The contents of the small blobs which stand in for empty files.
+constexpr size_t kSmallBlobSize = 64;
+
+double NsPerTick() {
+    return 1e9 / static_cast<double>(mx_ticks_per_second());
+}
+
+// Holds the threads of a workload back until all of them have been
+// created, so that creating them is not part of what is timed.
+class StartGate {
+public:
+    StartGate() {
+        mtx_init(&lock_, mtx_plain);
+        cnd_init(&cond_);
+    }
+    ~StartGate() {
+        cnd_destroy(&cond_);
+        mtx_destroy(&lock_);
+    }
+
+    void Wait() {
+        mtx_lock(&lock_);
+        while (!open_)
+            cnd_wait(&cond_, &lock_);
+        mtx_unlock(&lock_);
+    }
+
+    void Open() {
+        mtx_lock(&lock_);
+        open_ = true;
+        cnd_broadcast(&cond_);
+        mtx_unlock(&lock_);
+    }
+
+private:
+    mtx_t lock_;
+    cnd_t cond_;
+    bool open_ = false;
+};
+
+struct Thread {
+    const Mount* mount;
+    const Options* options;
+    uint32_t index;
+    StartGate* gate;
+    bool (*work)(Thread* thread);
+    bool ok;
+
+    // How long each operation took, in nanoseconds.
+    mxtl::unique_ptr<double[]> latencies;
+    uint32_t max_ops;
+    uint32_t ops;
+
+    // The file each thread works on, and for blobs the digest-named path
+    // and Merkle tree of |data|.
+    char path[PATH_MAX];
+    size_t block_size;
+    mxtl::unique_ptr<uint8_t[]> data;
+    size_t data_size;
+    mxtl::unique_ptr<uint8_t[]> merkle;
+    size_t merkle_size;
+
+    // The names for create and unlink: |max_ops| of them, |name_len| apart.
+    mxtl::unique_ptr<char[]> names;
+    size_t name_len;
+
+    // How many entries readdir should find in |path|.
+    size_t entries;
+};
+
+void Record(Thread* thread, uint64_t start) {
+    thread->latencies[thread->ops++] = static_cast<double>(mx_ticks_get() - start) * NsPerTick();
+}
+
+bool AllocThreads(const Mount& mount, const Options& options, uint32_t max_ops,
+                  mxtl::unique_ptr<Thread[]>* out) {
+    AllocChecker ac;
+    mxtl::unique_ptr<Thread[]> threads(new (&ac) Thread[options.threads]);
+    if (!ac.check()) {
+        fprintf(stderr, "fsbench: out of memory\n");
+        return false;
+    }
+    for (uint32_t i = 0; i < options.threads; i++) {
+        Thread* thread = &threads[i];
+        thread->mount = &mount;
+        thread->options = &options;
+        thread->index = i;
+        thread->max_ops = max_ops;
+        thread->latencies.reset(new (&ac) double[max_ops]);
+        if (!ac.check()) {
+            fprintf(stderr, "fsbench: out of memory\n");
+            return false;
+        }
+    }
+    *out = mxtl::move(threads);
+    return true;
+}
+
+int ThreadMain(void* arg) {
+    Thread* thread = static_cast<Thread*>(arg);
+    thread->gate->Wait();
+    thread->ok = thread->work(thread);
+    return 0;
+}
+
+// Runs |work| on each of the threads at once.  |elapsed| is from when they
+// were let go until the last of them finished.
+bool RunThreads(Thread* threads, uint32_t count, bool (*work)(Thread* thread), double* elapsed) {
+    AllocChecker ac;
+    mxtl::unique_ptr<thrd_t[]> handles(new (&ac) thrd_t[count]);
+    if (!ac.check()) {
+        fprintf(stderr, "fsbench: out of memory\n");
+        return false;
+    }
+
+    StartGate gate;
+    uint32_t started = 0;
+    for (; started < count; started++) {
+        Thread* thread = &threads[started];
+        thread->gate = &gate;
+        thread->work = work;
+        thread->ok = false;
+        thread->ops = 0;
+        if (thrd_create(&handles[started], ThreadMain, thread) != thrd_success) {
+            fprintf(stderr, "fsbench: cannot create thread\n");
+            break;
+        }
+    }
+
+    uint64_t start = mx_ticks_get();
+    gate.Open();
+    bool ok = started == count;
+    for (uint32_t i = 0; i < started; i++) {
+        thrd_join(handles[i], nullptr);
+        ok = ok && threads[i].ok;
+    }
+    *elapsed = static_cast<double>(mx_ticks_get() - start) * NsPerTick();
+    return ok;
+}
+
+// Gathers every thread's latencies and reports them together.
+bool Finish(Report* report, const Mount& mount, const char* workload, const char* size,
+            Thread* threads, uint32_t count, double amount_per_op, const char* unit,
+            double elapsed) {
+    uint32_t ops = 0;
+    for (uint32_t i = 0; i < count; i++)
+        ops += threads[i].ops;
+    if (ops == 0)
+        return true;
+
+    AllocChecker ac;
+    mxtl::unique_ptr<double[]> latencies(new (&ac) double[ops]);
+    if (!ac.check()) {
+        fprintf(stderr, "fsbench: out of memory\n");
+        return false;
+    }
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        memcpy(&latencies[n], threads[i].latencies.get(), threads[i].ops * sizeof(double));
+        n += threads[i].ops;
+    }
+    return report->Add(mount, workload, size, count, latencies.get(), ops, ops * amount_per_op,
+                       unit, elapsed);
+}
+
+bool Fail(const Thread* thread, const char* what) {
+    fprintf(stderr, "fsbench: %s: %s %s: %s\n", thread->mount->info->name, what, thread->path,
+            strerror(errno));
+    return false;
+}
+
+bool WriteAll(int fd, const uint8_t* buf, size_t len) {
+    while (len > 0) {
+        ssize_t r = write(fd, buf, len);
+        if (r <= 0)
+            return false;
+        buf += r;
+        len -= r;
+    }
+    return true;
+}
+
+// Fills in |data|, |merkle| and |path| for a blob of |size| random bytes,
+// different for each thread.
+bool MakeBlob(Thread* thread, size_t size) {
+    AllocChecker ac;
+    thread->data.reset(new (&ac) uint8_t[size]);
+    if (!ac.check())
+        return false;
+    thread->data_size = size;
+    unsigned int seed = thread->index + 1;
+    for (size_t i = 0; i < size; i++)
+        thread->data[i] = static_cast<uint8_t>(rand_r(&seed));
+
+    merkle::Tree tree;
+    thread->merkle_size = tree.GetTreeLength(size);
+    thread->merkle.reset();
+    if (thread->merkle_size != 0) {
+        thread->merkle.reset(new (&ac) uint8_t[thread->merkle_size]);
+        if (!ac.check())
+            return false;
+    }
+    merkle::Digest digest;
+    if (tree.Create(thread->data.get(), size, thread->merkle.get(), thread->merkle_size,
+                    &digest) != NO_ERROR)
+        return false;
+    size_t len = snprintf(thread->path, sizeof(thread->path), "%s/", thread->mount->root);
+    return digest.ToString(thread->path + len, sizeof(thread->path) - len) == NO_ERROR;
+}
+
+// Writes the name of a small blob, which is unique to |thread| and |n|, to
+// |name| (kBlobNameLen bytes), and its contents to |data|.
+bool SmallBlobName(uint32_t thread, uint32_t n, uint8_t* data, char* name) {
+    memset(data, 0, kSmallBlobSize);
+    snprintf(reinterpret_cast<char*>(data), kSmallBlobSize, "fsbench %u %u", thread, n);
+    merkle::Tree tree;
+    merkle::Digest digest;
+    if (tree.Create(data, kSmallBlobSize, nullptr, 0, &digest) != NO_ERROR)
+        return false;
+    name[0] = '/';
+    return digest.ToString(name + 1, kBlobNameLen - 1) == NO_ERROR;
+}
+
+// Makes an empty file or a small blob at |path|.
+bool CreateEntry(const Mount& mount, const char* path, const uint8_t* blob_data) {
+    int fd = open(path, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+        return false;
+    bool ok = true;
+    if (mount.info->blobs) {
+        blob_ioctl_config_t config;
+        config.size_data = kSmallBlobSize;
+        ok = ioctl_blobstore_blob_init(fd, &config) == 0 &&
+             WriteAll(fd, blob_data, kSmallBlobSize);
+    }
+    return close(fd) == 0 && ok;
+}
+
+// I/O:
+
+bool SeqWrite(Thread* thread) {
+    int fd = open(thread->path, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0)
+        return Fail(thread, "cannot create");
+
+    // A blob is told its size and given its Merkle tree before its data,
+    // but only the data is counted.
+    if (thread->mount->info->blobs) {
+        blob_ioctl_config_t config;
+        config.size_data = thread->data_size;
+        if (ioctl_blobstore_blob_init(fd, &config) != 0 ||
+            !WriteAll(fd, thread->merkle.get(), thread->merkle_size)) {
+            close(fd);
+            return Fail(thread, "cannot start");
+        }
+    }
+
+    size_t block_size = thread->block_size;
+    for (size_t offset = 0; offset + block_size <= thread->options->file_size;
+         offset += block_size) {
+        const uint8_t* data = thread->data.get();
+        if (thread->mount->info->blobs)
+            data += offset;
+        uint64_t start = mx_ticks_get();
+        if (write(fd, data, block_size) != static_cast<ssize_t>(block_size)) {
+            close(fd);
+            return Fail(thread, "cannot write");
+        }
+        Record(thread, start);
+    }
+    if (close(fd) < 0)
+        return Fail(thread, "cannot close");
+    return true;
+}
+
+bool SeqRead(Thread* thread) {
+    int fd = open(thread->path, O_RDONLY);
+    if (fd < 0)
+        return Fail(thread, "cannot open");
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> buf(new (&ac) uint8_t[thread->block_size]);
+    if (!ac.check()) {
+        close(fd);
+        return false;
+    }
+
+    size_t block_size = thread->block_size;
+    for (size_t offset = 0; offset + block_size <= thread->options->file_size;
+         offset += block_size) {
+        uint64_t start = mx_ticks_get();
+        if (read(fd, buf.get(), block_size) != static_cast<ssize_t>(block_size)) {
+            close(fd);
+            return Fail(thread, "cannot read");
+        }
+        Record(thread, start);
+    }
+    close(fd);
+    return true;
+}
+
+// Reads or writes the same number of blocks as a sequential pass, at
+// block-aligned offsets each thread picks at random.
+bool RandomIo(Thread* thread, bool writing) {
+    int fd = open(thread->path, writing ? O_RDWR : O_RDONLY);
+    if (fd < 0)
+        return Fail(thread, "cannot open");
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> buf(new (&ac) uint8_t[thread->block_size]);
+    if (!ac.check()) {
+        close(fd);
+        return false;
+    }
+    if (writing)
+        memcpy(buf.get(), thread->data.get(), thread->block_size);
+
+    size_t block_size = thread->block_size;
+    uint32_t blocks = static_cast<uint32_t>(thread->options->file_size / block_size);
+    unsigned int seed = thread->index + 1;
+    for (uint32_t i = 0; i < blocks; i++) {
+        off_t offset = static_cast<off_t>(rand_r(&seed) % blocks) * block_size;
+        uint64_t start = mx_ticks_get();
+        ssize_t r = writing ? pwrite(fd, buf.get(), block_size, offset)
+                            : pread(fd, buf.get(), block_size, offset);
+        if (r != static_cast<ssize_t>(block_size)) {
+            close(fd);
+            return Fail(thread, writing ? "cannot write" : "cannot read");
+        }
+        Record(thread, start);
+    }
+    if (close(fd) < 0)
+        return Fail(thread, "cannot close");
+    return true;
+}
+
+bool RandRead(Thread* thread) {
+    return RandomIo(thread, false);
+}
+
+bool RandWrite(Thread* thread) {
+    return RandomIo(thread, true);
+}
+
+// Create and unlink:
+
+bool CreateFiles(Thread* thread) {
+    uint8_t blob_data[kSmallBlobSize];
+    for (uint32_t n = 0; n < thread->max_ops; n++) {
+        char* name = &thread->names[n * thread->name_len];
+        if (thread->mount->info->blobs)
+            SmallBlobName(thread->index, n, blob_data, name);
+        snprintf(thread->path, sizeof(thread->path), "%s%s", thread->mount->root, name);
+        uint64_t start = mx_ticks_get();
+        if (!CreateEntry(*thread->mount, thread->path, blob_data))
+            return Fail(thread, "cannot create");
+        Record(thread, start);
+    }
+    return true;
+}
+
+bool UnlinkFiles(Thread* thread) {
+    for (uint32_t n = 0; n < thread->max_ops; n++) {
+        snprintf(thread->path, sizeof(thread->path), "%s%s", thread->mount->root,
+                 &thread->names[n * thread->name_len]);
+        uint64_t start = mx_ticks_get();
+        if (unlink(thread->path) < 0)
+            return Fail(thread, "cannot unlink");
+        Record(thread, start);
+    }
+    return true;
+}
+
+// Directory enumeration:
+
+bool ReaddirPasses(Thread* thread) {
+    for (uint32_t pass = 0; pass < thread->max_ops; pass++) {
+        size_t count = 0;
+        uint64_t start = mx_ticks_get();
+        DIR* dir = opendir(thread->path);
+        if (dir == nullptr)
+            return Fail(thread, "cannot open");
+        struct dirent* de;
+        while ((de = readdir(dir)) != nullptr) {
+            if (strcmp(de->d_name, ".") && strcmp(de->d_name, ".."))
+                count++;
+        }
+        closedir(dir);
+        Record(thread, start);
+        if (count != thread->entries) {
+            fprintf(stderr, "fsbench: %s: %s has %zu entries, not %zu\n",
+                    thread->mount->info->name, thread->path, count, thread->entries);
+            return false;
+        }
+    }
+    return true;
+}
+
+// The entries of the directory being read: numbered files, or small blobs
+// in the root (blobstore has no directories).
+void EntryPath(const Mount& mount, uint32_t n, uint8_t* blob_data, char* path, size_t len) {
+    if (mount.info->blobs) {
+        char name[kBlobNameLen];
+        SmallBlobName(UINT32_MAX, n, blob_data, name);
+        snprintf(path, len, "%s%s", mount.root, name);
+    } else {
+        snprintf(path, len, "%s/dir/%u", mount.root, n);
+    }
+}
+
+// Removes the first |count| entries.
+bool RemoveEntries(const Mount& mount, uint32_t count) {
+    bool ok = true;
+    uint8_t blob_data[kSmallBlobSize];
+    char path[PATH_MAX];
+    for (uint32_t n = 0; n < count; n++) {
+        EntryPath(mount, n, blob_data, path, sizeof(path));
+        if (unlink(path) < 0) {
+            fprintf(stderr, "fsbench: %s: cannot unlink %s: %s\n", mount.info->name, path,
+                    strerror(errno));
+            ok = false;
+        }
+    }
+    if (!mount.info->blobs) {
+        snprintf(path, sizeof(path), "%s/dir", mount.root);
+        if (rmdir(path) < 0) {
+            fprintf(stderr, "fsbench: %s: cannot remove %s: %s\n", mount.info->name, path,
+                    strerror(errno));
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// Fsync:
+
+bool FsyncWrites(Thread* thread) {
+    int fd = open(thread->path, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0)
+        return Fail(thread, "cannot create");
+    for (uint32_t n = 0; n < thread->max_ops; n++) {
+        if (pwrite(fd, thread->data.get(), kFsyncBlockSize, n * kFsyncBlockSize) !=
+            static_cast<ssize_t>(kFsyncBlockSize)) {
+            close(fd);
+            return Fail(thread, "cannot write");
+        }
+        uint64_t start = mx_ticks_get();
+        if (fsync(fd) < 0) {
+            close(fd);
+            return Fail(thread, "cannot fsync");
+        }
+        Record(thread, start);
+    }
+    if (close(fd) < 0)
+        return Fail(thread, "cannot close");
+    return true;
+}
+
+} // namespace
+
+bool RunIo(const Mount& mount, const Options& options, size_t block_size, Report* report) {
+    char size[16];
+    FormatSize(block_size, size, sizeof(size));
+    uint32_t blocks = static_cast<uint32_t>(options.file_size / block_size);
+    if (blocks == 0) {
+        char why[64];
+        snprintf(why, sizeof(why), "%s blocks are larger than the file", size);
+        report->Skip(mount, "io", why);
+        return true;
+    }
+
+    mxtl::unique_ptr<Thread[]> threads;
+    if (!AllocThreads(mount, options, blocks, &threads))
+        return false;
+    for (uint32_t i = 0; i < options.threads; i++) {
+        Thread* thread = &threads[i];
+        thread->block_size = block_size;
+        bool made;
+        if (mount.info->blobs) {
+            made = MakeBlob(thread, blocks * block_size);
+        } else {
+            snprintf(thread->path, sizeof(thread->path), "%s/file-%u", mount.root, i);
+            AllocChecker ac;
+            thread->data.reset(new (&ac) uint8_t[block_size]);
+            made = ac.check();
+            if (made)
+                memset(thread->data.get(), 0xee, block_size);
+        }
+        if (!made) {
+            fprintf(stderr, "fsbench: out of memory\n");
+            return false;
+        }
+    }
+
+    // The other workloads need the files to have been written, so the
+    // sequential writes happen either way.
+    double elapsed;
+    double mb_per_op = block_size / kMB;
+    bool ok = RunThreads(threads.get(), options.threads, SeqWrite, &elapsed);
+    if (ok && (options.workloads & kSeqWrite))
+        ok = Finish(report, mount, "seqwrite", size, threads.get(), options.threads, mb_per_op,
+                    "MB", elapsed);
+    if (ok && (options.workloads & kSeqRead)) {
+        ok = RunThreads(threads.get(), options.threads, SeqRead, &elapsed) &&
+             Finish(report, mount, "seqread", size, threads.get(), options.threads, mb_per_op,
+                    "MB", elapsed);
+    }
+    if (ok && (options.workloads & kRandRead)) {
+        ok = RunThreads(threads.get(), options.threads, RandRead, &elapsed) &&
+             Finish(report, mount, "randread", size, threads.get(), options.threads, mb_per_op,
+                    "MB", elapsed);
+    }
+    if (ok && (options.workloads & kRandWrite)) {
+        if (mount.info->blobs) {
+            report->Skip(mount, "randwrite", "blobs cannot be rewritten");
+        } else {
+            ok = RunThreads(threads.get(), options.threads, RandWrite, &elapsed) &&
+                 Finish(report, mount, "randwrite", size, threads.get(), options.threads,
+                        mb_per_op, "MB", elapsed);
+        }
+    }
+
+    for (uint32_t i = 0; i < options.threads; i++) {
+        if (unlink(threads[i].path) < 0 && errno != ENOENT)
+            ok = Fail(&threads[i], "cannot unlink");
+    }
+    return ok;
+}
+
+bool RunCreate(const Mount& mount, const Options& options, Report* report) {
+    if (options.create_count == 0)
+        return true;
+    mxtl::unique_ptr<Thread[]> threads;
+    if (!AllocThreads(mount, options, options.create_count, &threads))
+        return false;
+
+    // Each thread works in a directory of its own, except in blobstore
+    // which has only the one.  File names are made here, so that only the
+    // filesystem is timed; a blob's name is the digest of its contents, so
+    // that is worked out just before each blob is created.
+    size_t name_len = mount.info->blobs ? kBlobNameLen : 32;
+    bool ok = true;
+    uint32_t made_dirs = 0;
+    for (uint32_t i = 0; i < options.threads && ok; i++) {
+        Thread* thread = &threads[i];
+        thread->name_len = name_len;
+        AllocChecker ac;
+        thread->names.reset(new (&ac) char[options.create_count * name_len]);
+        if (!ac.check()) {
+            fprintf(stderr, "fsbench: out of memory\n");
+            ok = false;
+            break;
+        }
+        if (mount.info->blobs)
+            continue;
+        for (uint32_t n = 0; n < options.create_count; n++)
+            snprintf(&thread->names[n * name_len], name_len, "/create-%u/%u", i, n);
+        snprintf(thread->path, sizeof(thread->path), "%s/create-%u", mount.root, i);
+        if (mkdir(thread->path, 0755) < 0)
+            ok = Fail(thread, "cannot create");
+        else
+            made_dirs++;
+    }
+
+    double elapsed;
+    if (ok) {
+        ok = RunThreads(threads.get(), options.threads, CreateFiles, &elapsed);
+        if (ok)
+            ok = Finish(report, mount, "create", "-", threads.get(), options.threads, 1.0,
+                        "ops", elapsed);
+        // Unlink whatever was made, even after a failure.
+        for (uint32_t i = 0; i < options.threads; i++)
+            threads[i].max_ops = threads[i].ops;
+        bool unlinked = RunThreads(threads.get(), options.threads, UnlinkFiles, &elapsed);
+        if (ok && unlinked)
+            ok = Finish(report, mount, "unlink", "-", threads.get(), options.threads, 1.0,
+                        "ops", elapsed);
+        ok = ok && unlinked;
+    }
+
+    for (uint32_t i = 0; i < made_dirs; i++) {
+        snprintf(threads[i].path, sizeof(threads[i].path), "%s/create-%u", mount.root, i);
+        if (rmdir(threads[i].path) < 0)
+            ok = Fail(&threads[i], "cannot remove");
+    }
+    return ok;
+}
+
+bool RunReaddir(const Mount& mount, const Options& options, uint32_t entries, Report* report) {
+    char size[16];
+    snprintf(size, sizeof(size), "%u", entries);
+    char dir[PATH_MAX];
+    if (mount.info->blobs) {
+        snprintf(dir, sizeof(dir), "%s", mount.root);
+    } else {
+        snprintf(dir, sizeof(dir), "%s/dir", mount.root);
+        if (mkdir(dir, 0755) < 0) {
+            fprintf(stderr, "fsbench: %s: cannot create %s: %s\n", mount.info->name, dir,
+                    strerror(errno));
+            return false;
+        }
+    }
+
+    // Filling the directory isn't timed; the create workload covers it.
+    uint8_t blob_data[kSmallBlobSize];
+    char path[PATH_MAX];
+    for (uint32_t n = 0; n < entries; n++) {
+        EntryPath(mount, n, blob_data, path, sizeof(path));
+        if (!CreateEntry(mount, path, blob_data)) {
+            int error = errno;
+            bool removed = RemoveEntries(mount, n);
+            if (error == ENOSPC || error == ENOMEM) {
+                char why[64];
+                snprintf(why, sizeof(why), "filesystem is full after %u entries", n);
+                report->Skip(mount, "readdir", why);
+                return removed;
+            }
+            fprintf(stderr, "fsbench: %s: cannot create %s: %s\n", mount.info->name, path,
+                    strerror(error));
+            return false;
+        }
+    }
+
+    mxtl::unique_ptr<Thread[]> threads;
+    bool ok = AllocThreads(mount, options, options.readdir_passes, &threads);
+    if (ok) {
+        for (uint32_t i = 0; i < options.threads; i++) {
+            snprintf(threads[i].path, sizeof(threads[i].path), "%s", dir);
+            threads[i].entries = entries;
+        }
+        double elapsed;
+        ok = RunThreads(threads.get(), options.threads, ReaddirPasses, &elapsed) &&
+             Finish(report, mount, "readdir", size, threads.get(), options.threads, entries,
+                    "entries", elapsed);
+    }
+    return RemoveEntries(mount, entries) && ok;
+}
+
+bool RunFsync(const Mount& mount, const Options& options, Report* report) {
+    if (mount.info->blobs) {
+        report->Skip(mount, "fsync", "blobs cannot be rewritten");
+        return true;
+    }
+    if (options.fsync_count == 0)
+        return true;
+
+    mxtl::unique_ptr<Thread[]> threads;
+    if (!AllocThreads(mount, options, options.fsync_count, &threads))
+        return false;
+    for (uint32_t i = 0; i < options.threads; i++) {
+        Thread* thread = &threads[i];
+        snprintf(thread->path, sizeof(thread->path), "%s/fsync-%u", mount.root, i);
+        AllocChecker ac;
+        thread->data.reset(new (&ac) uint8_t[kFsyncBlockSize]);
+        if (!ac.check()) {
+            fprintf(stderr, "fsbench: out of memory\n");
+            return false;
+        }
+        memset(thread->data.get(), 0xee, kFsyncBlockSize);
+    }
+
+    char size[16];
+    FormatSize(kFsyncBlockSize, size, sizeof(size));
+    double elapsed;
+    bool ok = RunThreads(threads.get(), options.threads, FsyncWrites, &elapsed) &&
+              Finish(report, mount, "fsync", size, threads.get(), options.threads, 1.0, "ops",
+                     elapsed);
+    for (uint32_t i = 0; i < options.threads; i++) {
+        if (unlink(threads[i].path) < 0 && errno != ENOENT)
+            ok = Fail(&threads[i], "cannot unlink");
+    }
+    return ok;
+}
+
+} // namespace fsbench
@@ -25,6 +25,7 @@
 #define DEV_INPUT       "/dev/class/input"
 #define VIRTUAL_CONSOLE "/dev/class/console/vc"
 #define CLEAR_BTN_SIZE 50
+#define FIFO_BATCH 16
 #define I2C_HID_DEBUG 0
 
 // Array of colors for each finger
@@ -287,7 +288,13 @@ next_node:
         printf("failed to get max report size: %zd\n", ret);
         return -1;
     }
-    void* buf = malloc(max_rpt_sz);
+    // take reports in batches from the report fifo if there is one
+    mx_handle_t fifo = MX_HANDLE_INVALID;
+    if (ioctl_input_get_report_fifo(touchfd, &fifo) < 0) {
+        fifo = MX_HANDLE_INVALID;
+    }
+    size_t entry_sz = INPUT_FIFO_ENTRY_SIZE(max_rpt_sz);
+    void* buf = malloc(fifo != MX_HANDLE_INVALID ? entry_sz * FIFO_BATCH : max_rpt_sz);
     if (buf == NULL) {
         printf("no memory!\n");
         return -1;
@@ -301,19 +308,48 @@ next_node:
     }
 
     clear_screen((void*)fbo, &fb);
-    while (1) {
-        ssize_t r = read(touchfd, buf, max_rpt_sz);
-        if (r < 0) {
-            printf("touchscreen read error: %zd (errno=%d)\n", r, errno);
-            break;
+    if (fifo != MX_HANDLE_INVALID) {
+        while (1) {
+            mx_signals_t pending;
+            mx_status_t status = mx_object_wait_one(fifo, MX_FIFO_READABLE | MX_FIFO_PEER_CLOSED,
+                                                    MX_TIME_INFINITE, &pending);
+            uint32_t count = 0;
+            if (status == NO_ERROR && (pending & MX_FIFO_READABLE)) {
+                status = mx_fifo_read(fifo, buf, entry_sz * FIFO_BATCH, &count);
+            } else if (status == NO_ERROR) {
+                status = ERR_PEER_CLOSED;
+            }
+            if (status < 0) {
+                printf("touchscreen fifo read error: %d\n", status);
+                break;
+            }
+            for (uint32_t i = 0; i < count; i++) {
+                input_fifo_entry_t* entry = (input_fifo_entry_t*)((uint8_t*)buf + i * entry_sz);
+                if (entry->data[0] == ACER12_RPT_ID_TOUCH) {
+                    process_touchscreen_input(entry->data, entry->len, vcfd, pixels32, &fb);
+                } else if (entry->data[0] == ACER12_RPT_ID_STYLUS) {
+                    process_stylus_input(entry->data, entry->len, vcfd, pixels32, &fb);
+                }
+            }
         }
-        if (*(uint8_t*)buf == ACER12_RPT_ID_TOUCH) {
-            process_touchscreen_input(buf, r, vcfd, pixels32, &fb);
-        } else if (*(uint8_t*)buf == ACER12_RPT_ID_STYLUS) {
-            process_stylus_input(buf, r, vcfd, pixels32, &fb);
+    } else {
+        while (1) {
+            ssize_t r = read(touchfd, buf, max_rpt_sz);
+            if (r < 0) {
+                printf("touchscreen read error: %zd (errno=%d)\n", r, errno);
+                break;
+            }
+            if (*(uint8_t*)buf == ACER12_RPT_ID_TOUCH) {
+                process_touchscreen_input(buf, r, vcfd, pixels32, &fb);
+            } else if (*(uint8_t*)buf == ACER12_RPT_ID_STYLUS) {
+                process_stylus_input(buf, r, vcfd, pixels32, &fb);
+            }
         }
     }
 
+    if (fifo != MX_HANDLE_INVALID) {
+        mx_handle_close(fifo);
+    }
     free(buf);
     free(rpt_desc);
     close(touchfd);
@@ -4,6 +4,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -249,12 +250,207 @@ int iotime_fread(int argc, char** argv) {
     return 0;
 }
 
+typedef struct qread_slot {
+    struct qread_state* state;
+    block_fifo_request_t request;
+    mx_time_t start;
+} qread_slot_t;
+
+typedef struct qread_state {
+    qread_slot_t* slots;
+    size_t* ready;      // indices of slots with nothing outstanding
+    size_t ready_count;
+    mx_time_t* latency;
+    size_t done;
+    mx_status_t status;
+} qread_state_t;
+
+static void qread_complete(void* cookie, mx_status_t status) {
+    qread_slot_t* slot = cookie;
+    qread_state_t* state = slot->state;
+    if (status != NO_ERROR) {
+        state->status = status;
+    }
+    state->latency[state->done++] = mx_time_get(MX_CLOCK_MONOTONIC) - slot->start;
+    state->ready[state->ready_count++] = (size_t)(slot - state->slots);
+}
+
+static int cmp_time(const void* a, const void* b) {
+    mx_time_t x = *(const mx_time_t*)a;
+    mx_time_t y = *(const mx_time_t*)b;
+    return (x > y) - (x < y);
+}
+
+static mx_time_t percentile(const mx_time_t* sorted, size_t count, unsigned pct) {
+    size_t i = (count * pct) / 100;
+    return sorted[i < count ? i : count - 1];
+}
+
+// Runs 'ios' reads of 'iosize' bytes with 'depth' of them outstanding at a
+// time, using one txnid per outstanding read.
+static int qread_run(fifo_client_t* client, txnid_t* txnids, vmoid_t vmoid,
+                     size_t region, size_t iosize, size_t ios, size_t depth,
+                     qread_slot_t* slots, size_t* ready, mx_time_t* latency) {
+    qread_state_t state = {
+        .slots = slots,
+        .ready = ready,
+        .ready_count = depth,
+        .latency = latency,
+        .done = 0,
+        .status = NO_ERROR,
+    };
+    for (size_t i = 0; i < depth; i++) {
+        slots[i].state = &state;
+        slots[i].request = (block_fifo_request_t) {
+            .txnid = txnids[i],
+            .vmoid = vmoid,
+            .opcode = BLOCKIO_READ,
+            .length = iosize,
+            .vmo_offset = i * iosize,
+        };
+        ready[i] = i;
+    }
+
+    block_async_txn_t txns[depth];
+    size_t issued = 0;
+    mx_time_t t0 = mx_time_get(MX_CLOCK_MONOTONIC);
+    while (state.done < ios) {
+        // Refill every free slot with one FIFO write.
+        size_t n = 0;
+        mx_time_t now = mx_time_get(MX_CLOCK_MONOTONIC);
+        while (state.ready_count > 0 && issued < ios) {
+            qread_slot_t* slot = &slots[state.ready[--state.ready_count]];
+            slot->request.dev_offset = (issued++ * iosize) % region;
+            slot->start = now;
+            txns[n++] = (block_async_txn_t) {
+                .requests = &slot->request,
+                .count = 1,
+                .cb = qread_complete,
+                .cookie = slot,
+            };
+        }
+        mx_status_t status;
+        if (n > 0 && (status = block_fifo_async_submit(client, txns, n)) != NO_ERROR) {
+            fprintf(stderr, "error: block_fifo_async_submit error %d\n", status);
+            return -1;
+        }
+        if ((status = block_fifo_async_dispatch(client, MX_TIME_INFINITE)) != NO_ERROR) {
+            fprintf(stderr, "error: block_fifo_async_dispatch error %d\n", status);
+            return -1;
+        }
+        if (state.status != NO_ERROR) {
+            fprintf(stderr, "error: read failed %d\n", state.status);
+            return -1;
+        }
+    }
+    mx_time_t t1 = mx_time_get(MX_CLOCK_MONOTONIC);
+
+    qsort(latency, ios, sizeof(mx_time_t), cmp_time);
+    double secs = ((double)(t1 - t0)) / ((double)1000000000);
+    fprintf(stderr, "depth %3zu: %10.0f IOPS  latency us: p50 %6" PRIu64 "  p90 %6" PRIu64
+            "  p99 %6" PRIu64 "  max %6" PRIu64 "  ",
+            depth, ((double)ios) / secs,
+            percentile(latency, ios, 50) / 1000, percentile(latency, ios, 90) / 1000,
+            percentile(latency, ios, 99) / 1000, latency[ios - 1] / 1000);
+    bytes_per_second(ios * iosize, t1 - t0);
+    return 0;
+}
+
+int iotime_qread(int argc, char** argv) {
+    if (argc != 6) {
+        return usage();
+    }
+    size_t total = number(argv[3]);
+    size_t iosize = number(argv[4]);
+    size_t maxdepth = number(argv[5]);
+
+    if ((total % 4096) || (iosize % 4096) || iosize == 0 || total < iosize) {
+        fprintf(stderr, "error: bytes and iosize must be multiples of 4K\n");
+        return -1;
+    }
+    if (maxdepth == 0 || maxdepth > BLOCK_FIFO_MAX_DEPTH) {
+        fprintf(stderr, "error: depth must be between 1 and %zu\n", BLOCK_FIFO_MAX_DEPTH);
+        return -1;
+    }
+
+    mx_handle_t vmo;
+    if (mx_vmo_create(iosize * maxdepth, 0, &vmo) != NO_ERROR) {
+        fprintf(stderr, "error: out of memory\n");
+        return -1;
+    }
+
+    int fd = open(argv[2], O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "error: cannot open '%s'\n", argv[2]);
+        return -1;
+    }
+
+    mx_handle_t fifo;
+    if (ioctl_block_get_fifos(fd, &fifo) != sizeof(fifo)) {
+        fprintf(stderr, "err: cannot get fifo for '%s'\n", argv[2]);
+        return -1;
+    }
+
+    txnid_t txnids[maxdepth];
+    for (size_t i = 0; i < maxdepth; i++) {
+        if (ioctl_block_alloc_txn(fd, &txnids[i]) != sizeof(txnid_t)) {
+            fprintf(stderr, "err: cannot allocate txn for '%s'\n", argv[2]);
+            return -1;
+        }
+    }
+
+    mx_handle_t dup;
+    if (mx_handle_duplicate(vmo, MX_RIGHT_SAME_RIGHTS, &dup) != NO_ERROR) {
+        fprintf(stderr, "error: cannot duplicate handle\n");
+        return -1;
+    }
+
+    vmoid_t vmoid;
+    if (ioctl_block_attach_vmo(fd, &dup, &vmoid) != sizeof(vmoid)) {
+        fprintf(stderr, "error: cannot attach vmo for '%s'\n", argv[2]);
+        return -1;
+    }
+
+    fifo_client_t* client;
+    if (block_fifo_create_client(fifo, &client) != NO_ERROR) {
+        fprintf(stderr, "err: cannot create block client for '%s'\n", argv[2]);
+        return -1;
+    }
+
+    // Each depth reads the region once.
+    size_t ios = total / iosize;
+    qread_slot_t* slots = calloc(maxdepth, sizeof(qread_slot_t));
+    size_t* ready = calloc(maxdepth, sizeof(size_t));
+    mx_time_t* latency = calloc(ios, sizeof(mx_time_t));
+    if (slots == NULL || ready == NULL || latency == NULL) {
+        fprintf(stderr, "error: out of memory\n");
+        return -1;
+    }
+
+    // Powers of two, always finishing with the requested depth itself.
+    for (size_t depth = 1; ; depth *= 2) {
+        if (depth > maxdepth) {
+            depth = maxdepth;
+        }
+        if (qread_run(client, txnids, vmoid, total, iosize, ios, depth,
+                      slots, ready, latency) < 0) {
+            return -1;
+        }
+        if (depth == maxdepth) {
+            break;
+        }
+    }
+    return 0;
+}
+
 int usage(void) {
     fprintf(stderr,
             "usage: iotime <op>...\n\n"
             "   op: lread <device> <bytes> <bufsize>   posix linear read\n"
             "       bread <device> <bytes> <bufsize>   block linear read\n"
-            "       fread <device> <bytes> <bufsize>   fifo linear read\n");
+            "       fread <device> <bytes> <bufsize>   fifo linear read\n"
+            "       qread <device> <bytes> <iosize> <depth>\n"
+            "                                          fifo reads at queue depths 1..depth\n");
     return -1;
 }
 
@@ -269,6 +465,8 @@ int main(int argc, char** argv) {
         return iotime_bread(argc, argv);
     } else if (!strcmp(argv[1], "fread")) {
         return iotime_fread(argc, argv);
+    } else if (!strcmp(argv[1], "qread")) {
+        return iotime_qread(argc, argv);
     } else {
         return usage();
     }
@@ -4,6 +4,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -11,44 +12,67 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <threads.h>
 #include <unistd.h>
 
+#include <bootdata/decompress.h>
+#include <lz4/lz4.h>
 #include <lz4/lz4frame.h>
+#include <lz4/lz4hc.h>
+#include <magenta/syscalls.h>
 
 #define BLOCK_SIZE 65536
 
+// Blocks are compressed and decompressed this many at a time per thread,
+// which bounds the memory used whatever the size of the file.
+#define BATCH_BLOCKS 16
+#define MAX_THREADS 16
+
 #define WR_NEWFILE O_WRONLY | O_CREAT | O_TRUNC
 #define PERM_644 S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH
 
 static void usage(const char* arg0) {
-    printf("usage: %s [-1|-9] [-d] <input file> <output file>\n", arg0);
+    printf("usage: %s [-1|-9] [-d] [-t <threads>] <input file> <output file>\n", arg0);
     printf("   -1  fast compression (default)\n");
     printf("   -9  high compression (slower)\n");
     printf("   -d  decompress\n");
+    printf("   -t  number of threads to use (default: one per cpu)\n");
 }
 
-static int do_decompress(const char* infile, const char* outfile) {
-    int infd, outfd;
-
-    infd = open(infile, O_RDONLY);
-    if (infd < 0) {
-        fprintf(stderr, "could not open %s: %s\n", infile, strerror(errno));
-        return -1;
+// Like read, but only comes up short at the end of the file.
+static ssize_t read_full(int fd, uint8_t* buf, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t nr = read(fd, buf + done, len - done);
+        if (nr < 0) {
+            return nr;
+        } else if (nr == 0) {
+            break;
+        }
+        done += nr;
     }
+    return done;
+}
 
-    outfd = open(outfile, WR_NEWFILE, PERM_644);
-    if (outfd < 0) {
-        fprintf(stderr, "could not open %s: %s\n", outfile, strerror(errno));
-        close(infd);
-        return -1;
+static bool write_full(int fd, const uint8_t* buf, size_t len, const char* outfile) {
+    ssize_t nw = write(fd, buf, len);
+    if (nw != (ssize_t)len) {
+        fprintf(stderr, "could not write to %s", outfile);
+        if (nw < 0) {
+            fprintf(stderr, ": %s", strerror(errno));
+        }
+        fprintf(stderr, "\n");
+        return false;
     }
+    return true;
+}
 
+// Decompresses any LZ4 frame, a block at a time on this thread.
+static int decompress_serial(int infd, const char* infile, int outfd, const char* outfile) {
     LZ4F_decompressionContext_t dctx;
     LZ4F_errorCode_t errc = LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION);
     if (LZ4F_isError(errc)) {
         fprintf(stderr, "could not initialize decompression: %s\n", LZ4F_getErrorName(errc));
-        close(outfd);
-        close(infd);
         return -1;
     }
 
@@ -118,12 +142,154 @@ static int do_decompress(const char* infile, const char* outfile) {
 
 done:
     LZ4F_freeDecompressionContext(dctx);
+    return 0;
+}
+
+// Frames of independent blocks with a content size, as this tool and
+// mkbootfs write them, are streamed through bounded buffers and their
+// blocks decompressed on several threads, by the same code devmgr uses for
+// bootfs. Returns 1 if the frame is of some other kind.
+static int decompress_parallel(int infd, const char* infile, int outfd, const char* outfile,
+                               uint32_t threads) {
+    uint8_t header[32];
+    ssize_t nr = read_full(infd, header, sizeof(header));
+    uint64_t content_size;
+    size_t header_size;
+    const char* errmsg;
+    if (nr < 0 || lz4_frame_header(header, nr, &content_size, &header_size, &errmsg) < 0) {
+        return 1;
+    }
+
+    size_t batch = (size_t)threads * BATCH_BLOCKS;
+    size_t insize = batch * (BLOCK_SIZE + sizeof(uint32_t));
+    size_t outsize = batch * BLOCK_SIZE;
+    uint8_t* inbuf = malloc(insize);
+    uint8_t* outbuf = malloc(outsize);
+    int r = -1;
+    if (!inbuf || !outbuf) {
+        fprintf(stderr, "out of memory\n");
+        goto done;
+    }
+
+    // The rest of what was read for the header starts the first batch.
+    size_t have = nr - header_size;
+    memcpy(inbuf, header + header_size, have);
+    uint64_t total = 0;
+    bool short_block = false;
+    bool end = false;
+    while (!end) {
+        if ((nr = read_full(infd, inbuf + have, insize - have)) < 0) {
+            fprintf(stderr, "error reading %s: %s\n", infile, strerror(errno));
+            goto done;
+        }
+        have += nr;
+        size_t in_used, out_used;
+        mx_status_t status = lz4_decompress_parallel(inbuf, have, outbuf, outsize, threads,
+                                                     &in_used, &out_used, &end, &errmsg);
+        if (status < 0) {
+            fprintf(stderr, "could not decompress %s: %s\n", infile, errmsg);
+            goto done;
+        }
+        if (in_used == 0 && !end) {
+            fprintf(stderr, "could not decompress %s: lz4 data truncated\n", infile);
+            goto done;
+        }
+        // Only the last block of the frame may be short.
+        if (out_used > 0 && short_block) {
+            fprintf(stderr, "could not decompress %s: lz4 block smaller than the block size\n",
+                    infile);
+            goto done;
+        }
+        short_block = (out_used % BLOCK_SIZE) != 0;
+        if (!write_full(outfd, outbuf, out_used, outfile)) {
+            goto done;
+        }
+        total += out_used;
+        have -= in_used;
+        memmove(inbuf, inbuf + in_used, have);
+    }
+    if (total != content_size) {
+        fprintf(stderr, "could not decompress %s: content size does not match\n", infile);
+        goto done;
+    }
+    r = 0;
+
+done:
+    free(inbuf);
+    free(outbuf);
+    return r;
+}
+
+static int do_decompress(const char* infile, const char* outfile, uint32_t threads) {
+    int infd, outfd;
+
+    infd = open(infile, O_RDONLY);
+    if (infd < 0) {
+        fprintf(stderr, "could not open %s: %s\n", infile, strerror(errno));
+        return -1;
+    }
+
+    outfd = open(outfile, WR_NEWFILE, PERM_644);
+    if (outfd < 0) {
+        fprintf(stderr, "could not open %s: %s\n", outfile, strerror(errno));
+        close(infd);
+        return -1;
+    }
+
+    int r = decompress_parallel(infd, infile, outfd, outfile, threads);
+    if (r > 0) {
+        if (lseek(infd, 0, SEEK_SET) < 0) {
+            fprintf(stderr, "could not seek in %s: %s\n", infile, strerror(errno));
+            r = -1;
+        } else {
+            r = decompress_serial(infd, infile, outfd, outfile);
+        }
+    }
     close(outfd);
     close(infd);
+    return r;
+}
+
+typedef struct {
+    const uint8_t* in;
+    size_t in_size;
+    uint8_t* out;
+    size_t out_stride;
+    uint32_t* out_sizes;
+    size_t count;
+    int clevel;
+    atomic_size_t next;
+} compress_job_t;
+
+// Compresses blocks of the batch until there are none left. A block which
+// doesn't get any smaller is stored as it is, with the high bit of its
+// size set, as LZ4F does.
+static int compress_worker(void* arg) {
+    compress_job_t* job = arg;
+    size_t i;
+    while ((i = atomic_fetch_add(&job->next, 1)) < job->count) {
+        const char* src = (const char*)job->in + i * BLOCK_SIZE;
+        char* dst = (char*)job->out + i * job->out_stride;
+        int len = (int)(job->in_size - i * BLOCK_SIZE < BLOCK_SIZE ?
+                        job->in_size - i * BLOCK_SIZE : BLOCK_SIZE);
+        // Like LZ4F, levels below 3 use the fast compressor.
+        int csz = job->clevel < 3 ?
+                  LZ4_compress_default(src, dst, len, len - 1) :
+                  LZ4_compress_HC(src, dst, len, len - 1, job->clevel);
+        if (csz <= 0) {
+            memcpy(dst, src, len);
+            job->out_sizes[i] = (uint32_t)len | 0x80000000;
+        } else {
+            job->out_sizes[i] = csz;
+        }
+    }
     return 0;
 }
 
-static int do_compress(const char* infile, const char* outfile, int clevel) {
+// Writes one LZ4 frame of independent 64kB blocks, which any LZ4 decoder
+// reads and bootdata can decompress in parallel. The blocks are compressed
+// a batch at a time on several threads and written in order.
+static int do_compress(const char* infile, const char* outfile, int clevel, uint32_t threads) {
     int infd, outfd;
 
     infd = open(infile, O_RDONLY);
@@ -142,52 +308,108 @@ static int do_compress(const char* infile, const char* outfile, int clevel) {
     LZ4F_preferences_t prefs;
     memset(&prefs, 0, sizeof(prefs));
     prefs.compressionLevel = clevel;
+    prefs.frameInfo.blockSizeID = LZ4F_max64KB;
+    prefs.frameInfo.blockMode = LZ4F_blockIndependent;
+    struct stat st;
+    if (fstat(infd, &st) == 0 && S_ISREG(st.st_mode)) {
+        prefs.frameInfo.contentSize = st.st_size;
+    }
 
-    uint8_t inbuf[BLOCK_SIZE];
-    size_t outsize = LZ4F_compressFrameBound(BLOCK_SIZE, &prefs);
-    uint8_t* outbuf = malloc(outsize);
-    if (!outbuf) {
+    size_t batch = (size_t)threads * BATCH_BLOCKS;
+    size_t stride = LZ4_compressBound(BLOCK_SIZE);
+    uint8_t* inbuf = malloc(batch * BLOCK_SIZE);
+    uint8_t* outbuf = malloc(batch * stride);
+    uint32_t* sizes = malloc(batch * sizeof(uint32_t));
+    LZ4F_compressionContext_t cctx = NULL;
+    int r = -1;
+    if (!inbuf || !outbuf || !sizes) {
         fprintf(stderr, "out of memory\n");
-        close(outfd);
-        close(infd);
-        return ENOMEM;
+        goto done;
     }
 
-    // TODO: do the whole file in one frame, using the LZ4F begin/update/end
-    // functions.
-    ssize_t nr = 0;
-    while ((nr = read(infd, inbuf, BLOCK_SIZE)) > 0) {
-        ssize_t csz = LZ4F_compressFrame(outbuf, outsize, inbuf, nr, &prefs);
-        if (LZ4F_isError(csz)) {
-            fprintf(stderr, "error compressing %s: %s\n", infile, LZ4F_getErrorName(csz));
-            goto done;
+    // Only the frame header comes from LZ4F; the blocks are our own.
+    LZ4F_errorCode_t errc = LZ4F_createCompressionContext(&cctx, LZ4F_VERSION);
+    if (LZ4F_isError(errc)) {
+        fprintf(stderr, "could not initialize compression: %s\n", LZ4F_getErrorName(errc));
+        goto done;
+    }
+    size_t hsz = LZ4F_compressBegin(cctx, outbuf, stride, &prefs);
+    if (LZ4F_isError(hsz)) {
+        fprintf(stderr, "error compressing %s: %s\n", infile, LZ4F_getErrorName(hsz));
+        goto done;
+    }
+    if (!write_full(outfd, outbuf, hsz, outfile)) {
+        goto done;
+    }
+
+    uint64_t total = 0;
+    ssize_t nr;
+    while ((nr = read_full(infd, inbuf, batch * BLOCK_SIZE)) > 0) {
+        compress_job_t job = {
+            .in = inbuf,
+            .in_size = nr,
+            .out = outbuf,
+            .out_stride = stride,
+            .out_sizes = sizes,
+            .count = (nr + BLOCK_SIZE - 1) / BLOCK_SIZE,
+            .clevel = clevel,
+        };
+        atomic_init(&job.next, 0);
+
+        // This thread compresses alongside the others, and on its own if
+        // none could be started.
+        thrd_t workers[MAX_THREADS];
+        uint32_t started = 0;
+        while (started + 1 < threads && started + 1 < job.count) {
+            if (thrd_create(&workers[started], compress_worker, &job) != thrd_success) {
+                break;
+            }
+            started++;
+        }
+        compress_worker(&job);
+        for (uint32_t i = 0; i < started; i++) {
+            thrd_join(workers[i], NULL);
         }
 
-        ssize_t nw = write(outfd, outbuf, csz);
-        if (nw != csz) {
-            fprintf(stderr, "could not write to %s", outfile);
-            if (nw < 0) {
-                fprintf(stderr, ": %s", strerror(errno));
+        for (size_t i = 0; i < job.count; i++) {
+            if (!write_full(outfd, (const uint8_t*)&sizes[i], sizeof(uint32_t), outfile) ||
+                !write_full(outfd, outbuf + i * stride, sizes[i] & 0x7fffffff, outfile)) {
+                goto done;
             }
-            fprintf(stderr, "\n");
-            goto done;
         }
+        total += nr;
     }
-
     if (nr < 0) {
         fprintf(stderr, "error reading %s: %s\n", infile, strerror(errno));
         goto done;
     }
+    if (prefs.frameInfo.contentSize != 0 && total != prefs.frameInfo.contentSize) {
+        fprintf(stderr, "%s changed size while compressing\n", infile);
+        goto done;
+    }
+
+    // The end mark; there is no content checksum.
+    uint32_t end = 0;
+    if (!write_full(outfd, (const uint8_t*)&end, sizeof(end), outfile)) {
+        goto done;
+    }
+    r = 0;
 
 done:
+    if (cctx) {
+        LZ4F_freeCompressionContext(cctx);
+    }
+    free(sizes);
     free(outbuf);
+    free(inbuf);
     close(outfd);
     close(infd);
-    return 0;
+    return r;
 }
 
 int main(int argc, char* argv[]) {
     int clevel = 1;
+    uint32_t threads = mx_system_get_num_cpus();
     bool decompress = false;
     const char* infile = NULL;
     const char* outfile = NULL;
@@ -197,10 +419,24 @@ int main(int argc, char* argv[]) {
             decompress = true;
             continue;
         }
+        if (!strcmp("-1", argv[i])) {
+            clevel = 1;
+            continue;
+        }
         if (!strcmp("-9", argv[i])) {
             clevel = 9;
             continue;
         }
+        if (!strcmp("-t", argv[i])) {
+            char* end;
+            long n = (i + 1 < argc) ? strtol(argv[++i], &end, 10) : 0;
+            if (n <= 0 || *end != '\0') {
+                fprintf(stderr, "-t needs a positive number\n");
+                return -1;
+            }
+            threads = n;
+            continue;
+        }
         if (!strcmp("-h", argv[i])) {
             usage(argv[0]);
             return 0;
@@ -234,9 +470,12 @@ int main(int argc, char* argv[]) {
     }
     printf("\n");
 
+    if (threads > MAX_THREADS) {
+        threads = MAX_THREADS;
+    }
     if (decompress) {
-        return do_decompress(infile, outfile);
+        return do_decompress(infile, outfile, threads);
     } else {
-        return do_compress(infile, outfile, clevel);
+        return do_compress(infile, outfile, clevel, threads);
     }
 }
@@ -11,7 +11,9 @@ MODULE_TYPE := userapp
 MODULE_SRCS += \
     $(LOCAL_DIR)/main.c
 
-MODULE_STATIC_LIBS := third_party/ulib/lz4
+MODULE_STATIC_LIBS := \
+    system/ulib/bootdata \
+    third_party/ulib/lz4 \
 
 MODULE_LIBS := \
     system/ulib/magenta \
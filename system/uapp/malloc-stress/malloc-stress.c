@@ -0,0 +1,110 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#include <magenta/process.h>
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/object.h>
+
+#define MAX_THREADS 64
+#define SLOTS_PER_THREAD 1024
+#define OPS_PER_THREAD (1024 * 1024)
+#define MAX_SMALL 512
+#define MAX_LARGE (64 * 1024)
+
+typedef struct {
+    uint32_t seed;
+    void* slots[SLOTS_PER_THREAD];
+} worker_t;
+
+static uint32_t next_rand(uint32_t* seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+// Mostly small blocks, with the occasional large one, replaced at random
+// so that frees land in a different order than the allocations did.
+static int worker(void* arg) {
+    worker_t* w = arg;
+    for (int i = 0; i < OPS_PER_THREAD; ++i) {
+        uint32_t r = next_rand(&w->seed);
+        void** slot = &w->slots[r % SLOTS_PER_THREAD];
+        free(*slot);
+        size_t size = (r & 0xf0000) == 0 ? (r % MAX_LARGE) + 1 : ((r >> 4) % MAX_SMALL) + 1;
+        *slot = malloc(size);
+        if (*slot == NULL) {
+            printf("malloc(%zu) failed\n", size);
+            return -1;
+        }
+        memset(*slot, 0xa5, size < 64 ? size : 64);
+    }
+    return 0;
+}
+
+static size_t committed_bytes(void) {
+    mx_info_task_stats_t stats;
+    if (mx_object_get_info(mx_process_self(), MX_INFO_TASK_STATS,
+                           &stats, sizeof(stats), NULL, NULL) != NO_ERROR) {
+        return 0;
+    }
+    return stats.mem_committed_bytes;
+}
+
+static int run(int nthreads) {
+    static worker_t workers[MAX_THREADS];
+    thrd_t threads[MAX_THREADS];
+
+    memset(workers, 0, sizeof(workers));
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    for (int i = 0; i < nthreads; ++i) {
+        workers[i].seed = i + 1;
+        if (thrd_create_with_name(&threads[i], worker, &workers[i],
+                                  "malloc-stress") != thrd_success) {
+            printf("Failed to create thread %d\n", i);
+            return -1;
+        }
+    }
+    int failed = 0;
+    for (int i = 0; i < nthreads; ++i) {
+        int ret;
+        thrd_join(threads[i], &ret);
+        failed |= ret;
+    }
+    mx_time_t done = mx_time_get(MX_CLOCK_MONOTONIC);
+    size_t peak = committed_bytes();
+
+    for (int i = 0; i < nthreads; ++i) {
+        for (int j = 0; j < SLOTS_PER_THREAD; ++j) {
+            free(workers[i].slots[j]);
+        }
+    }
+    size_t after = committed_bytes();
+
+    double secs = (done - start) / 1e9;
+    printf("%2d threads: %.3fs, %.2f Mops/s, committed %zu KiB, %zu KiB after free\n",
+           nthreads, secs, (double)nthreads * OPS_PER_THREAD / secs / 1e6,
+           peak / 1024, after / 1024);
+    return failed;
+}
+
+int main(int argc, char** argv) {
+    int max_threads = argc > 1 ? atoi(argv[1]) : 16;
+    if (max_threads < 1 || max_threads > MAX_THREADS) {
+        printf("usage: %s [max-threads (1-%d)]\n", argv[0], MAX_THREADS);
+        return -1;
+    }
+
+    printf("Running malloc stress test...\n");
+    for (int n = 1; n <= max_threads; n *= 2) {
+        if (run(n) != 0)
+            return -1;
+    }
+    return 0;
+}
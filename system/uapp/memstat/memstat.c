@@ -0,0 +1,123 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <magenta/device/sysinfo.h>
+#include <magenta/status.h>
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/object.h>
+#include <pretty/sizes.h>
+
+static mx_status_t get_root_resource(mx_handle_t* root_resource) {
+    int fd = open("/dev/misc/sysinfo", O_RDWR);
+    if (fd < 0) {
+        return ERR_NOT_FOUND;
+    }
+    ssize_t n = ioctl_sysinfo_get_root_resource(fd, root_resource);
+    close(fd);
+    if (n != sizeof(*root_resource)) {
+        return n < 0 ? (mx_status_t)n : ERR_NOT_SUPPORTED;
+    }
+    return NO_ERROR;
+}
+
+static void print_line(const char* name, uint64_t bytes, uint64_t total, bool raw) {
+    char str[MAX_FORMAT_SIZE_LEN];
+    printf("%-14s", name);
+    if (raw) {
+        printf(" %16" PRIu64, bytes);
+    } else {
+        printf(" %8s", format_size(str, sizeof(str), bytes));
+    }
+    if (total > 0) {
+        printf(" %5.1f%%", 100.0 * bytes / total);
+    }
+    printf("\n");
+}
+
+static void print_stats(const mx_info_kmem_stats_t* stats, bool raw) {
+    uint64_t total = stats->total_bytes;
+    print_line("total", total, 0, raw);
+    print_line("free", stats->free_bytes, total, raw);
+    print_line("vmo", stats->vmo_bytes, total, raw);
+    print_line("wired", stats->wired_bytes, total, raw);
+    print_line("heap", stats->heap_bytes, total, raw);
+    print_line("  used", stats->heap_used_bytes, total, raw);
+    print_line("mmu", stats->mmu_bytes, total, raw);
+    print_line("other", stats->other_bytes, total, raw);
+    print_line("pinned", stats->pinned_bytes, total, raw);
+    print_line("physical vmo", stats->physical_vmo_bytes, 0, raw);
+    print_line("compressed", stats->compressed_bytes, 0, raw);
+    print_line("  pool", stats->compressed_pool_bytes, total, raw);
+    printf("%-14s %8" PRIu64 "\n", "  hits", stats->compressed_hits);
+    printf("%-14s %8" PRIu64 "\n", "  misses", stats->compressed_misses);
+    printf("%-14s %8" PRIu64 "\n", "handles", stats->handle_count);
+}
+
+static void print_help(FILE* f) {
+    fprintf(f, "Usage: memstat [options]\n");
+    fprintf(f, "Shows where the kernel's memory goes.\n");
+    fprintf(f, "Options:\n");
+    fprintf(f, " -b          Show sizes in bytes\n");
+    fprintf(f, " -r SECONDS  Repeat every SECONDS seconds\n");
+}
+
+int main(int argc, char** argv) {
+    bool raw = false;
+    long delay = 0;
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        char* end;
+        if (!strcmp(arg, "--help")) {
+            print_help(stdout);
+            return 0;
+        } else if (!strcmp(arg, "-b")) {
+            raw = true;
+        } else if (!strcmp(arg, "-r")) {
+            if (++i == argc || (delay = strtol(argv[i], &end, 10)) <= 0 || *end != '\0') {
+                fprintf(stderr, "-r needs a positive number\n");
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", arg);
+            print_help(stderr);
+            return 1;
+        }
+    }
+
+    mx_handle_t root_resource;
+    mx_status_t status = get_root_resource(&root_resource);
+    if (status != NO_ERROR) {
+        fprintf(stderr, "memstat: cannot get the root resource: %s (%d)\n",
+                mx_status_get_string(status), status);
+        return 1;
+    }
+
+    for (;;) {
+        mx_info_kmem_stats_t stats;
+        status = mx_object_get_info(root_resource, MX_INFO_KMEM_STATS,
+                                    &stats, sizeof(stats), NULL, NULL);
+        if (status != NO_ERROR) {
+            fprintf(stderr, "memstat: cannot read the kernel's memory stats: %s (%d)\n",
+                    mx_status_get_string(status), status);
+            break;
+        }
+        print_stats(&stats, raw);
+        if (delay == 0) {
+            break;
+        }
+        mx_nanosleep(mx_deadline_after(MX_SEC(delay)));
+        printf("\n");
+    }
+
+    mx_handle_close(root_resource);
+    return status == NO_ERROR ? 0 : 1;
+}
@@ -10,42 +10,299 @@
 #include <fs/trace.h>
 
 #include <magenta/new.h>
+#include <mxtl/algorithm.h>
+#include <mxtl/auto_lock.h>
 #include <mxtl/ref_ptr.h>
 #include <mxtl/unique_ptr.h>
 
+#ifdef __Fuchsia__
+#include <magenta/device/block.h>
+#include <magenta/syscalls.h>
+#endif
+
 #include "minfs.h"
 #include "minfs-private.h"
 
 namespace minfs {
 
-mx_status_t Bcache::Readblk(uint32_t bno, void* data) {
-    off_t off = bno * kMinfsBlockSize;
-    trace(IO, "readblk() bno=%u off=%#llx\n", bno, (unsigned long long)off);
-    if (lseek(fd_, off, SEEK_SET) < 0) {
-        error("minfs: cannot seek to block %u\n", bno);
-        return ERR_IO;
+mx_status_t Bcache::DevReadblk(uint32_t bno, void* data) {
+#ifdef __Fuchsia__
+    if (fifo_client_ != nullptr) {
+        return DevReadblks(&bno, 1, data);
     }
-    if (read(fd_, data, kMinfsBlockSize) != kMinfsBlockSize) {
+#endif
+    off_t off = (off_t)bno * kMinfsBlockSize;
+    trace(IO, "readblk() bno=%u off=%#llx\n", bno, (unsigned long long)off);
+    if (pread(fd_, data, kMinfsBlockSize, off) != kMinfsBlockSize) {
         error("minfs: cannot read block %u\n", bno);
         return ERR_IO;
     }
     return NO_ERROR;
 }
 
-mx_status_t Bcache::Writeblk(uint32_t bno, const void* data) {
-    off_t off = bno * kMinfsBlockSize;
-    trace(IO, "writeblk() bno=%u off=%#llx\n", bno, (unsigned long long)off);
-    if (lseek(fd_, off, SEEK_SET) < 0) {
-        error("minfs: cannot seek to block %u\n", bno);
-        return ERR_IO;
+mx_status_t Bcache::DevWriteblk(uint32_t bno, const void* data) {
+#ifdef __Fuchsia__
+    if (fifo_client_ != nullptr) {
+        return DevWriteblks(&bno, 1, data);
     }
-    if (write(fd_, data, kMinfsBlockSize) != kMinfsBlockSize) {
+#endif
+    off_t off = (off_t)bno * kMinfsBlockSize;
+    trace(IO, "writeblk() bno=%u off=%#llx\n", bno, (unsigned long long)off);
+    if (pwrite(fd_, data, kMinfsBlockSize, off) != kMinfsBlockSize) {
         error("minfs: cannot write block %u\n", bno);
         return ERR_IO;
     }
     return NO_ERROR;
 }
 
+mx_status_t Bcache::DevReadblks(const uint32_t* bnos, uint32_t count, void* data) {
+#ifdef __Fuchsia__
+    if (fifo_client_ != nullptr) {
+        while (count > 0) {
+            uint32_t xfer = mxtl::min(count, kMinfsFifoBlocks);
+            trace(IO, "readblks() bno=%u count=%u\n", bnos[0], xfer);
+            if (FifoTxn(BLOCKIO_READ, bnos, xfer) != NO_ERROR) {
+                error("minfs: cannot read %u blocks at %u\n", xfer, bnos[0]);
+                return ERR_IO;
+            }
+            memcpy(data, fifo_buffer_->GetData(), xfer * blocksize_);
+            data = (void*)((uintptr_t)data + xfer * blocksize_);
+            bnos += xfer;
+            count -= xfer;
+        }
+        return NO_ERROR;
+    }
+#endif
+    // Runs of consecutive blocks go to the file in one call
+    while (count > 0) {
+        uint32_t run = 1;
+        while ((run < count) && (bnos[run] == bnos[0] + run)) {
+            run++;
+        }
+        off_t off = (off_t)bnos[0] * blocksize_;
+        size_t len = (size_t)run * blocksize_;
+        trace(IO, "readblks() bno=%u count=%u\n", bnos[0], run);
+        if (pread(fd_, data, len, off) != (ssize_t)len) {
+            error("minfs: cannot read %u blocks at %u\n", run, bnos[0]);
+            return ERR_IO;
+        }
+        data = (void*)((uintptr_t)data + len);
+        bnos += run;
+        count -= run;
+    }
+    return NO_ERROR;
+}
+
+mx_status_t Bcache::DevWriteblks(const uint32_t* bnos, uint32_t count, const void* data) {
+#ifdef __Fuchsia__
+    if (fifo_client_ != nullptr) {
+        while (count > 0) {
+            uint32_t xfer = mxtl::min(count, kMinfsFifoBlocks);
+            trace(IO, "writeblks() bno=%u count=%u\n", bnos[0], xfer);
+            memcpy(fifo_buffer_->GetData(), data, xfer * blocksize_);
+            if (FifoTxn(BLOCKIO_WRITE, bnos, xfer) != NO_ERROR) {
+                error("minfs: cannot write %u blocks at %u\n", xfer, bnos[0]);
+                return ERR_IO;
+            }
+            data = (const void*)((uintptr_t)data + xfer * blocksize_);
+            bnos += xfer;
+            count -= xfer;
+        }
+        return NO_ERROR;
+    }
+#endif
+    // Runs of consecutive blocks go to the file in one call
+    while (count > 0) {
+        uint32_t run = 1;
+        while ((run < count) && (bnos[run] == bnos[0] + run)) {
+            run++;
+        }
+        off_t off = (off_t)bnos[0] * blocksize_;
+        size_t len = (size_t)run * blocksize_;
+        trace(IO, "writeblks() bno=%u count=%u\n", bnos[0], run);
+        if (pwrite(fd_, data, len, off) != (ssize_t)len) {
+            error("minfs: cannot write %u blocks at %u\n", run, bnos[0]);
+            return ERR_IO;
+        }
+        data = (const void*)((uintptr_t)data + len);
+        bnos += run;
+        count -= run;
+    }
+    return NO_ERROR;
+}
+
+mx_status_t Bcache::Readblk(uint32_t bno, void* data) {
+    mxtl::AutoLock lock(&lock_);
+    return ReadblkLocked(bno, data);
+}
+
+mx_status_t Bcache::ReadblkLocked(uint32_t bno, void* data) {
+    if ((journal_ != nullptr) && journal_->Lookup(bno, data)) {
+        return NO_ERROR;
+    }
+    return DevReadblk(bno, data);
+}
+
+mx_status_t Bcache::Writeblk(uint32_t bno, const void* data) {
+    mxtl::AutoLock lock(&lock_);
+    return WriteblkLocked(bno, data);
+}
+
+mx_status_t Bcache::WriteblkLocked(uint32_t bno, const void* data) {
+    if (journal_ != nullptr) {
+        return journal_->Log(bno, data);
+    }
+    return DevWriteblk(bno, data);
+}
+
+mx_status_t Bcache::Readblks(const uint32_t* bnos, uint32_t count, void* data) {
+    mxtl::AutoLock lock(&lock_);
+    if (journal_ != nullptr) {
+        for (uint32_t i = 0; i < count; i++) {
+            if (journal_->Contains(bnos[i])) {
+                // rare; fall back to reading the blocks one at a time
+                for (i = 0; i < count; i++) {
+                    mx_status_t status;
+                    if ((status = ReadblkLocked(bnos[i], (void*)((uintptr_t)data + i * blocksize_))) != NO_ERROR) {
+                        return status;
+                    }
+                }
+                return NO_ERROR;
+            }
+        }
+    }
+    return DevReadblks(bnos, count, data);
+}
+
+mx_status_t Bcache::ReadblkRun(uint32_t bno, uint32_t count, void* data) {
+    uint32_t bnos[kMinfsFifoBlocks];
+    while (count > 0) {
+        uint32_t xfer = mxtl::min(count, kMinfsFifoBlocks);
+        for (uint32_t i = 0; i < xfer; i++) {
+            bnos[i] = bno + i;
+        }
+        mx_status_t status;
+        if ((status = Readblks(bnos, xfer, data)) != NO_ERROR) {
+            return status;
+        }
+        data = (void*)((uintptr_t)data + xfer * blocksize_);
+        bno += xfer;
+        count -= xfer;
+    }
+    return NO_ERROR;
+}
+
+mx_status_t Bcache::Writeblks(const uint32_t* bnos, uint32_t count, const void* data) {
+    mxtl::AutoLock lock(&lock_);
+    if (journal_ != nullptr) {
+        for (uint32_t i = 0; i < count; i++) {
+            if (journal_->Contains(bnos[i])) {
+                // A block that was metadata until recently, and is still in the
+                // log; writing it in place could be undone by a checkpoint or
+                // a replay. Log the new contents over it instead.
+                for (i = 0; i < count; i++) {
+                    mx_status_t status;
+                    const void* src = (const void*)((uintptr_t)data + i * blocksize_);
+                    if (journal_->Contains(bnos[i])) {
+                        status = journal_->Log(bnos[i], src);
+                    } else {
+                        status = DevWriteblk(bnos[i], src);
+                    }
+                    if (status != NO_ERROR) {
+                        return status;
+                    }
+                }
+                return NO_ERROR;
+            }
+        }
+    }
+    return DevWriteblks(bnos, count, data);
+}
+
+mx_status_t Bcache::JournalInit(uint32_t start, uint32_t blocks) {
+    mxtl::AutoLock lock(&lock_);
+    return Journal::Create(this, start, blocks, &journal_);
+}
+
+void Bcache::TxnBegin() {
+    mxtl::AutoLock lock(&lock_);
+    if (journal_ != nullptr) {
+        journal_->Begin();
+    }
+}
+
+void Bcache::TxnEnd() {
+    mxtl::AutoLock lock(&lock_);
+    if ((journal_ != nullptr) && (journal_->End() != NO_ERROR)) {
+        error("minfs: journal commit failed\n");
+    }
+}
+
+#ifdef __Fuchsia__
+mx_status_t Bcache::FifoTxn(uint16_t opcode, const uint32_t* bnos, uint32_t count) {
+    assert(count <= kMinfsFifoBlocks);
+    block_fifo_request_t requests[MAX_TXN_MESSAGES];
+    size_t n = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if ((n > 0) && (bnos[i] == bnos[i - 1] + 1)) {
+            // extend the run of adjacent blocks
+            requests[n - 1].length += blocksize_;
+            continue;
+        }
+        if (n == MAX_TXN_MESSAGES) {
+            mx_status_t status;
+            if ((status = block_fifo_txn(fifo_client_, requests, n)) != NO_ERROR) {
+                return status;
+            }
+            n = 0;
+        }
+        requests[n].txnid = txnid_;
+        requests[n].vmoid = vmoid_;
+        requests[n].opcode = opcode;
+        requests[n].length = blocksize_;
+        requests[n].vmo_offset = static_cast<uint64_t>(i) * blocksize_;
+        requests[n].dev_offset = static_cast<uint64_t>(bnos[i]) * blocksize_;
+        n++;
+    }
+    return block_fifo_txn(fifo_client_, requests, n);
+}
+
+mx_status_t Bcache::AttachFifo() {
+    mx_handle_t fifo;
+    if (ioctl_block_get_fifos(fd_, &fifo) != sizeof(fifo)) {
+        return ERR_NOT_SUPPORTED;
+    }
+
+    mx_status_t status;
+    mx_handle_t dup;
+    if (ioctl_block_alloc_txn(fd_, &txnid_) != sizeof(txnid_)) {
+        status = ERR_NO_RESOURCES;
+        goto fail;
+    }
+    if ((status = MappedVmo::Create(kMinfsFifoBlocks * blocksize_, &fifo_buffer_)) != NO_ERROR) {
+        goto fail;
+    }
+    if ((status = mx_handle_duplicate(fifo_buffer_->GetVmo(), MX_RIGHT_SAME_RIGHTS,
+                                      &dup)) != NO_ERROR) {
+        goto fail;
+    }
+    if (ioctl_block_attach_vmo(fd_, &dup, &vmoid_) != sizeof(vmoid_)) {
+        status = ERR_IO;
+        goto fail;
+    }
+    if ((status = block_fifo_create_client(fifo, &fifo_client_)) != NO_ERROR) {
+        goto fail;
+    }
+    return NO_ERROR;
+
+fail:
+    fifo_buffer_.reset();
+    mx_handle_close(fifo);
+    ioctl_block_fifo_close(fd_);
+    return status;
+}
+#endif
+
 constexpr uint32_t kModeFind = 0;
 constexpr uint32_t kModeLoad = 1;
 constexpr uint32_t kModeZero = 2;
@@ -60,6 +317,7 @@ static const char* modestr(uint32_t mode) {
 }
 
 void Bcache::Invalidate() {
+    mxtl::AutoLock lock(&lock_);
     mxtl::RefPtr<BlockNode> blk;
     uint32_t n = 0;
     while ((blk = lists_.PopFront(kBlockLRU)) != nullptr) {
@@ -77,6 +335,7 @@ mxtl::RefPtr<BlockNode> Bcache::Get(uint32_t bno, uint32_t mode) {
     if (bno >= blockmax_) {
         return nullptr;
     }
+    mxtl::AutoLock lock(&lock_);
     mxtl::RefPtr<BlockNode> blk = hash_.find(bno).CopyPointer();
     if (blk != nullptr) {
         // remove from lru
@@ -106,7 +365,7 @@ mxtl::RefPtr<BlockNode> Bcache::Get(uint32_t bno, uint32_t mode) {
         if (mode == kModeZero) {
             blk->flags_ |= kBlockDirty;
             memset(blk->data(), 0, blocksize_);
-        } else if (Readblk(bno, blk->data()) < 0) {
+        } else if (ReadblkLocked(bno, blk->data()) < 0) {
             panic("bcache: bno %u read error!\n", bno);
         }
     }
@@ -128,11 +387,12 @@ mxtl::RefPtr<BlockNode> Bcache::GetZero(uint32_t bno) {
 
 void Bcache::Put(mxtl::RefPtr<BlockNode> blk, uint32_t flags) {
     trace(BCACHE, "bcache_put() bno=%u%s\n", blk->bno_, (flags & kBlockDirty) ? " DIRTY" : "");
+    mxtl::AutoLock lock(&lock_);
     assert(blk->flags_ & kBlockBusy);
     // remove from busy list
     lists_.Erase(blk, kBlockBusy);
     if ((flags | blk->flags_) & kBlockDirty) {
-        if (Writeblk(blk->bno_, blk->data()) < 0) {
+        if (WriteblkLocked(blk->bno_, blk->data()) < 0) {
             error("block write error!\n");
         }
         blk->flags_ &= ~kBlockDirty;
@@ -173,6 +433,10 @@ mx_status_t Bcache::Write(uint32_t bno, const void* data, uint32_t off, uint32_t
 }
 
 int Bcache::Sync() {
+    mxtl::AutoLock lock(&lock_);
+    if ((journal_ != nullptr) && (journal_->Commit() != NO_ERROR)) {
+        return ERR_IO;
+    }
     return fsync(fd_);
 }
 
@@ -190,11 +454,30 @@ mx_status_t Bcache::Create(Bcache** out, int fd, uint32_t blockmax, uint32_t blo
         }
         num--;
     }
+#ifdef __Fuchsia__
+    if (bc->AttachFifo() != NO_ERROR) {
+        trace(IO, "bcache: no block fifo, using read/write\n");
+    }
+#endif
     *out = bc.release();
     return NO_ERROR;
 }
 
 int Bcache::Close() {
+    mxtl::AutoLock lock(&lock_);
+    if (journal_ != nullptr) {
+        if (journal_->Checkpoint() != NO_ERROR) {
+            error("minfs: journal checkpoint failed\n");
+        }
+        journal_.reset();
+    }
+#ifdef __Fuchsia__
+    if (fifo_client_ != nullptr) {
+        ioctl_block_fifo_close(fd_);
+        block_fifo_release_client(fifo_client_);
+        fifo_client_ = nullptr;
+    }
+#endif
     return close(fd_);
 }
 
@@ -0,0 +1,97 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <magenta/new.h>
+#include <mxtl/unique_ptr.h>
+
+#include "minfs.h"
+#include "minfs-private.h"
+
+namespace minfs {
+
+// Records with less to spare than the smallest dirent are left off the spare list
+constexpr uint32_t kMinfsMinDirentSize = DirentSize(1);
+
+DirentCache::~DirentCache() {
+    // the name table and spare list hold unmanaged pointers into records_
+    names_.clear();
+    spare_.clear();
+    records_.clear();
+}
+
+mx_status_t DirentCache::Insert(uint32_t off, uint32_t size, uint32_t used, uint64_t hash) {
+    if ((used > 0) && (names_.find(hash) != names_.end())) {
+        return ERR_ALREADY_EXISTS;
+    }
+    AllocChecker ac;
+    mxtl::unique_ptr<Record> r(new (&ac) Record());
+    if (!ac.check()) {
+        return ERR_NO_MEMORY;
+    }
+    r->off = off;
+    r->size = size;
+    r->used = used;
+    r->hash = hash;
+    if (used > 0) {
+        names_.insert(r.get());
+    }
+    if (r->Spare() >= kMinfsMinDirentSize) {
+        spare_.push_front(r.get());
+    }
+    records_.insert(mxtl::move(r));
+    return NO_ERROR;
+}
+
+void DirentCache::Remove(Record* r) {
+    if (r->name_state_.InContainer()) {
+        names_.erase(*r);
+    }
+    if (r->spare_state_.InContainer()) {
+        spare_.erase(*r);
+    }
+    records_.erase(*r);
+}
+
+void DirentCache::Erase(uint32_t start, uint32_t end) {
+    auto it = records_.lower_bound(start);
+    while (it.IsValid() && (it->off < end)) {
+        Record* r = &(*it);
+        ++it;
+        Remove(r);
+    }
+}
+
+const DirentCache::Record* DirentCache::FindName(uint64_t hash) const {
+    auto it = names_.find(hash);
+    return (it == names_.end()) ? nullptr : &(*it);
+}
+
+const DirentCache::Record* DirentCache::FindSpare(uint32_t len) const {
+    for (const auto& r : spare_) {
+        if (r.Spare() >= len) {
+            return &r;
+        }
+    }
+    return nullptr;
+}
+
+const DirentCache::Record* DirentCache::Prev(uint32_t off) const {
+    auto it = records_.find(off);
+    if (!it.IsValid() || (it == records_.begin())) {
+        return nullptr;
+    }
+    --it;
+    return &(*it);
+}
+
+const DirentCache::Record* DirentCache::Next(uint32_t off) const {
+    auto it = records_.find(off);
+    if (!it.IsValid()) {
+        return nullptr;
+    }
+    ++it;
+    return it.IsValid() ? &(*it) : nullptr;
+}
+
+} // namespace minfs
@@ -0,0 +1,282 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string.h>
+
+#include "minfs.h"
+#include "minfs-private.h"
+
+namespace minfs {
+namespace {
+
+// Index of the entry in the sorted 'ext' array which covers (or would cover)
+// logical block 'n': the last one starting at or before it, or 0.
+uint32_t extent_find(const minfs_extent_t* ext, uint32_t count, uint32_t n) {
+    uint32_t lo = 0;
+    uint32_t hi = count;
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (ext[mid].start <= n) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+uint32_t extent_lookup(const minfs_extent_t* ext, uint32_t count, uint32_t n) {
+    if (count == 0) {
+        return 0;
+    }
+    const minfs_extent_t* e = &ext[extent_find(ext, count, n)];
+    if ((n < e->start) || (n - e->start >= e->count)) {
+        return 0;
+    }
+    return e->bno + (n - e->start);
+}
+
+// Map logical block 'n' to disk block 'bno' in the sorted 'ext' array,
+// growing a neighbouring extent when the block continues it. Returns false
+// if a new entry is needed and the array is full.
+bool extent_insert(minfs_extent_t* ext, uint32_t* count, uint32_t max, uint32_t n, uint32_t bno) {
+    uint32_t pos = 0;
+    while ((pos < *count) && (ext[pos].start < n)) {
+        pos++;
+    }
+    if (pos > 0) {
+        minfs_extent_t* prev = &ext[pos - 1];
+        if ((prev->start + prev->count == n) && (prev->bno + prev->count == bno)) {
+            prev->count++;
+            // the new block may close the gap to the next extent
+            if ((pos < *count) && (ext[pos].start == n + 1) && (ext[pos].bno == bno + 1)) {
+                prev->count += ext[pos].count;
+                memmove(&ext[pos], &ext[pos + 1], (*count - pos - 1) * sizeof(minfs_extent_t));
+                (*count)--;
+            }
+            return true;
+        }
+    }
+    if ((pos < *count) && (ext[pos].start == n + 1) && (ext[pos].bno == bno + 1)) {
+        ext[pos].start--;
+        ext[pos].bno--;
+        ext[pos].count++;
+        return true;
+    }
+    if (*count == max) {
+        return false;
+    }
+    memmove(&ext[pos + 1], &ext[pos], (*count - pos) * sizeof(minfs_extent_t));
+    ext[pos].start = n;
+    ext[pos].count = 1;
+    ext[pos].bno = bno;
+    (*count)++;
+    return true;
+}
+
+} // namespace anonymous
+
+mx_status_t Minfs::BlockRangeFree(uint32_t bno, uint32_t count, mxtl::RefPtr<BlockNode>* bitmap_blk) {
+    for (uint32_t b = bno; b < bno + count; b++) {
+        if ((*bitmap_blk = BitmapBlockGet(*bitmap_blk, b)) == nullptr) {
+            return ERR_IO;
+        }
+        block_map_.Clear(b, b + 1);
+    }
+    return NO_ERROR;
+}
+
+// Release the blocks mapped at or past 'start' by the sorted 'ext' array.
+mx_status_t Minfs::ExtentTrim(minfs_inode_t* inode, minfs_extent_t* ext, uint32_t* count,
+                              uint32_t start, mxtl::RefPtr<BlockNode>* bitmap_blk) {
+    mx_status_t status;
+    while (*count > 0) {
+        minfs_extent_t* e = &ext[*count - 1];
+        if (e->start + e->count <= start) {
+            break;
+        }
+        uint32_t keep = (e->start < start) ? start - e->start : 0;
+        if ((status = BlockRangeFree(e->bno + keep, e->count - keep, bitmap_blk)) != NO_ERROR) {
+            return status;
+        }
+        inode->block_count -= e->count - keep;
+        if (keep > 0) {
+            e->count = keep;
+            break;
+        }
+        (*count)--;
+    }
+    return NO_ERROR;
+}
+
+mx_status_t Minfs::ExtentLookup(const minfs_inode_t* inode, uint32_t n, uint32_t* bno_out) const {
+    const minfs_extent_t* ext = MinfsInodeExtents(inode);
+    if (!(inode->flags & kMinfsInodeFlagExtentIndex)) {
+        *bno_out = extent_lookup(ext, inode->extent_count, n);
+        return NO_ERROR;
+    }
+
+    const minfs_extent_t* idx = &ext[extent_find(ext, inode->extent_count, n)];
+    mxtl::RefPtr<BlockNode> blk;
+    if ((blk = bc_->Get(idx->bno)) == nullptr) {
+        return ERR_IO;
+    }
+    *bno_out = extent_lookup(static_cast<const minfs_extent_t*>(blk->data()), idx->count, n);
+    bc_->Put(blk, 0);
+    return NO_ERROR;
+}
+
+mx_status_t Minfs::ExtentInsert(minfs_inode_t* inode, uint32_t n, uint32_t bno) {
+    minfs_extent_t* ext = MinfsInodeExtents(inode);
+    mx_status_t status;
+    if (!(inode->flags & kMinfsInodeFlagExtentIndex)) {
+        if (extent_insert(ext, &inode->extent_count, kMinfsInlineExtents, n, bno)) {
+            return NO_ERROR;
+        }
+
+        // The inline extents are full; move them out to an extent block, and
+        // index that from the inode instead.
+        uint32_t ebno;
+        mxtl::RefPtr<BlockNode> eblk;
+        if ((status = BlockNew(0, &ebno, &eblk)) != NO_ERROR) {
+            return status;
+        }
+        memcpy(eblk->data(), ext, inode->extent_count * sizeof(minfs_extent_t));
+        bc_->Put(eblk, kBlockDirty);
+        inode->block_count++;
+
+        ext[0].count = inode->extent_count;
+        ext[0].bno = ebno;
+        memset(&ext[1], 0, (kMinfsInlineExtents - 1) * sizeof(minfs_extent_t));
+        inode->extent_count = 1;
+        inode->flags |= kMinfsInodeFlagExtentIndex;
+    }
+
+    uint32_t i = extent_find(ext, inode->extent_count, n);
+    mxtl::RefPtr<BlockNode> blk;
+    if ((blk = bc_->Get(ext[i].bno)) == nullptr) {
+        return ERR_IO;
+    }
+    minfs_extent_t* leaf = static_cast<minfs_extent_t*>(blk->data());
+    if (!extent_insert(leaf, &ext[i].count, kMinfsExtentsPerBlock, n, bno)) {
+        // Split the full extent block in two, indexing the upper half from
+        // a new inline entry.
+        if (inode->extent_count == kMinfsInlineExtents) {
+            bc_->Put(blk, 0);
+            return ERR_NO_SPACE;
+        }
+        uint32_t ebno;
+        mxtl::RefPtr<BlockNode> eblk;
+        if ((status = BlockNew(ext[i].bno + 1, &ebno, &eblk)) != NO_ERROR) {
+            bc_->Put(blk, 0);
+            return status;
+        }
+        inode->block_count++;
+        // Files mostly grow at the end: appending starts a new extent block
+        // rather than leaving two half full ones behind.
+        uint32_t half = ext[i].count / 2;
+        if (n > leaf[ext[i].count - 1].start) {
+            half = ext[i].count;
+        }
+        minfs_extent_t* upper = static_cast<minfs_extent_t*>(eblk->data());
+        memcpy(upper, &leaf[half], (ext[i].count - half) * sizeof(minfs_extent_t));
+
+        memmove(&ext[i + 2], &ext[i + 1],
+                (inode->extent_count - i - 1) * sizeof(minfs_extent_t));
+        ext[i + 1].start = (half < ext[i].count) ? upper[0].start : n;
+        ext[i + 1].count = ext[i].count - half;
+        ext[i + 1].bno = ebno;
+        ext[i].count = half;
+        inode->extent_count++;
+
+        // both halves have room now
+        if (n >= ext[i + 1].start) {
+            extent_insert(upper, &ext[i + 1].count, kMinfsExtentsPerBlock, n, bno);
+            ext[i + 1].start = upper[0].start;
+        } else {
+            extent_insert(leaf, &ext[i].count, kMinfsExtentsPerBlock, n, bno);
+        }
+        bc_->Put(eblk, kBlockDirty);
+    }
+    ext[i].start = leaf[0].start;
+    bc_->Put(blk, kBlockDirty);
+    return NO_ERROR;
+}
+
+mx_status_t Minfs::ExtentShrink(minfs_inode_t* inode, uint32_t start) {
+    minfs_extent_t* ext = MinfsInodeExtents(inode);
+    mxtl::RefPtr<BlockNode> bitmap_blk = nullptr;
+    mx_status_t status;
+    if (!(inode->flags & kMinfsInodeFlagExtentIndex)) {
+        status = ExtentTrim(inode, ext, &inode->extent_count, start, &bitmap_blk);
+        BitmapBlockPut(bitmap_blk);
+        return status;
+    }
+
+    while (inode->extent_count > 0) {
+        minfs_extent_t* idx = &ext[inode->extent_count - 1];
+        mxtl::RefPtr<BlockNode> blk;
+        if ((blk = bc_->Get(idx->bno)) == nullptr) {
+            BitmapBlockPut(bitmap_blk);
+            return ERR_IO;
+        }
+        uint32_t count = idx->count;
+        status = ExtentTrim(inode, static_cast<minfs_extent_t*>(blk->data()), &idx->count,
+                            start, &bitmap_blk);
+        bc_->Put(blk, (idx->count != count) ? kBlockDirty : 0);
+        if (status != NO_ERROR) {
+            BitmapBlockPut(bitmap_blk);
+            return status;
+        }
+        if (idx->count > 0) {
+            break;
+        }
+        // release the emptied extent block itself
+        if ((status = BlockRangeFree(idx->bno, 1, &bitmap_blk)) != NO_ERROR) {
+            BitmapBlockPut(bitmap_blk);
+            return status;
+        }
+        inode->block_count--;
+        memset(idx, 0, sizeof(*idx));
+        inode->extent_count--;
+    }
+
+    // Once what's left fits in the inode again, fold it back in
+    if ((inode->extent_count <= 1) &&
+        ((inode->extent_count == 0) || (ext[0].count <= kMinfsInlineExtents))) {
+        minfs_extent_t leaf[kMinfsInlineExtents];
+        uint32_t count = 0;
+        if (inode->extent_count == 1) {
+            mxtl::RefPtr<BlockNode> blk;
+            if ((blk = bc_->Get(ext[0].bno)) == nullptr) {
+                BitmapBlockPut(bitmap_blk);
+                return ERR_IO;
+            }
+            count = ext[0].count;
+            memcpy(leaf, blk->data(), count * sizeof(minfs_extent_t));
+            bc_->Put(blk, 0);
+            if ((status = BlockRangeFree(ext[0].bno, 1, &bitmap_blk)) != NO_ERROR) {
+                BitmapBlockPut(bitmap_blk);
+                return status;
+            }
+            inode->block_count--;
+        }
+        memset(ext, 0, kMinfsInlineExtents * sizeof(minfs_extent_t));
+        memcpy(ext, leaf, count * sizeof(minfs_extent_t));
+        inode->extent_count = count;
+        inode->flags &= ~kMinfsInodeFlagExtentIndex;
+    }
+    BitmapBlockPut(bitmap_blk);
+    return NO_ERROR;
+}
+
+uint32_t Minfs::BlockRunHint(uint32_t len) const {
+    size_t bitoff;
+    if (block_map_.Find(false, info_.dat_block, block_map_.size(), len, &bitoff) != NO_ERROR) {
+        return 0;
+    }
+    return static_cast<uint32_t>(bitoff);
+}
+
+} // namespace minfs
@@ -0,0 +1,306 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <fs/trace.h>
+
+#include <magenta/new.h>
+#include <mxtl/unique_ptr.h>
+
+#include "minfs.h"
+#include "minfs-private.h"
+
+namespace minfs {
+namespace {
+
+mx_time_t journal_gettime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return MX_SEC(ts.tv_sec) + ts.tv_nsec;
+}
+
+int bno_cmp(const void* a, const void* b) {
+    uint32_t x = *static_cast<const uint32_t*>(a);
+    uint32_t y = *static_cast<const uint32_t*>(b);
+    return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+} // namespace anonymous
+
+Journal::Journal(Bcache* bc, uint32_t start, uint32_t blocks) :
+    bc_(bc), start_(start), blocks_(blocks), next_(1), seq_(1), depth_(0),
+    last_commit_(0), running_count_(0) {}
+
+Journal::~Journal() {
+    entries_.clear();
+}
+
+mx_status_t Journal::Create(Bcache* bc, uint32_t start, uint32_t blocks,
+                            mxtl::unique_ptr<Journal>* out) {
+    if ((blocks < kMinfsJournalMinBlocks) || (start + blocks > bc->Maxblk())) {
+        error("minfs: journal at %u (%u blocks) will not fit\n", start, blocks);
+        return ERR_INVALID_ARGS;
+    }
+    AllocChecker ac;
+    mxtl::unique_ptr<Journal> journal(new (&ac) Journal(bc, start, blocks));
+    if (!ac.check()) {
+        return ERR_NO_MEMORY;
+    }
+    journal->buf_.reset(new (&ac) uint8_t[kMinfsFifoBlocks * kMinfsBlockSize]);
+    if (!ac.check()) {
+        return ERR_NO_MEMORY;
+    }
+
+    mx_status_t status;
+    if ((status = journal->Replay()) != NO_ERROR) {
+        return status;
+    }
+    journal->last_commit_ = journal_gettime();
+    *out = mxtl::move(journal);
+    return NO_ERROR;
+}
+
+mx_status_t Journal::Replay() {
+    mx_status_t status;
+    minfs_journal_info_t* info = reinterpret_cast<minfs_journal_info_t*>(buf_.get());
+    if ((status = bc_->DevReadblk(start_, info)) != NO_ERROR) {
+        return status;
+    }
+    if (info->magic != kMinfsJournalMagic) {
+        // never written; there is nothing to replay
+        trace(MINFS, "minfs: journal info block not found, starting a new log\n");
+        seq_ = 1;
+        return WriteInfo();
+    }
+    seq_ = info->seq;
+
+    uint32_t replayed = 0;
+    uint32_t pos = 1;
+    void* payload = buf_.get() + kMinfsBlockSize;
+    while (pos + 1 < blocks_) {
+        minfs_journal_header_t* hdr = reinterpret_cast<minfs_journal_header_t*>(buf_.get());
+        if ((status = bc_->DevReadblk(start_ + pos, hdr)) != NO_ERROR) {
+            return status;
+        }
+        if ((hdr->magic != kMinfsJournalRecordMagic) || (hdr->seq != seq_) ||
+            (hdr->count == 0) || (hdr->count > kMinfsJournalTxnBlocks) ||
+            (pos + 1 + hdr->count > blocks_)) {
+            break;
+        }
+        uint32_t bnos[kMinfsJournalTxnBlocks];
+        for (uint32_t i = 0; i < hdr->count; i++) {
+            bnos[i] = start_ + pos + 1 + i;
+        }
+        if ((status = bc_->DevReadblks(bnos, hdr->count, payload)) != NO_ERROR) {
+            return status;
+        }
+        if (fnv1a32(payload, hdr->count * kMinfsBlockSize) != hdr->checksum) {
+            // torn record; the commit never completed
+            break;
+        }
+        bool valid = true;
+        for (uint32_t i = 0; i < hdr->count; i++) {
+            if ((hdr->bno[i] >= bc_->Maxblk()) ||
+                ((hdr->bno[i] >= start_) && (hdr->bno[i] < start_ + blocks_))) {
+                valid = false;
+            }
+        }
+        if (!valid) {
+            error("minfs: journal record %" PRIu64 " is corrupt, not replaying it\n", seq_);
+            break;
+        }
+        if ((status = bc_->DevWriteblks(hdr->bno, hdr->count, payload)) != NO_ERROR) {
+            return status;
+        }
+        pos += 1 + hdr->count;
+        seq_++;
+        replayed++;
+    }
+    next_ = 1;
+    if (replayed == 0) {
+        // the info block already starts the log at seq_, leave it be (the
+        // device may be read-only)
+        return NO_ERROR;
+    }
+    trace(MINFS, "minfs: replayed %u journal records\n", replayed);
+    if (fsync(bc_->fd_) < 0) {
+        return ERR_IO;
+    }
+    return WriteInfo();
+}
+
+mx_status_t Journal::WriteInfo() {
+    memset(buf_.get(), 0, kMinfsBlockSize);
+    minfs_journal_info_t* info = reinterpret_cast<minfs_journal_info_t*>(buf_.get());
+    info->magic = kMinfsJournalMagic;
+    info->seq = seq_;
+    next_ = 1;
+    return bc_->DevWriteblk(start_, info);
+}
+
+bool Journal::Contains(uint32_t bno) const {
+    return entries_.find(bno) != entries_.end();
+}
+
+bool Journal::Lookup(uint32_t bno, void* data) const {
+    auto e = entries_.find(bno);
+    if (e == entries_.end()) {
+        return false;
+    }
+    memcpy(data, e->data, kMinfsBlockSize);
+    return true;
+}
+
+mx_status_t Journal::Log(uint32_t bno, const void* data) {
+    mx_status_t status;
+    auto e = entries_.find(bno);
+    if (e == entries_.end()) {
+        AllocChecker ac;
+        mxtl::unique_ptr<Entry> entry(new (&ac) Entry());
+        if (!ac.check()) {
+            // Make room by emptying the log, and write this one in place
+            if ((status = Checkpoint()) != NO_ERROR) {
+                return status;
+            }
+            return bc_->DevWriteblk(bno, data);
+        }
+        entry->bno = bno;
+        entry->running = false;
+        entries_.insert(mxtl::move(entry));
+        e = entries_.find(bno);
+    }
+    if (!e->running) {
+        if (running_count_ == kMinfsJournalTxnBlocks) {
+            // the transaction outgrew one record
+            if ((status = Commit()) != NO_ERROR) {
+                return status;
+            }
+            // a checkpoint may have dropped the entry
+            return Log(bno, data);
+        }
+        e->running = true;
+        running_[running_count_++] = bno;
+    }
+    memcpy(e->data, data, kMinfsBlockSize);
+    return NO_ERROR;
+}
+
+mx_status_t Journal::End() {
+    MX_DEBUG_ASSERT(depth_ > 0);
+    if ((--depth_ > 0) || (running_count_ == 0)) {
+        return NO_ERROR;
+    }
+    if ((running_count_ >= kMinfsJournalCommitBlocks) ||
+        (journal_gettime() - last_commit_ >= kMinfsJournalCommitInterval)) {
+        return Commit();
+    }
+    return NO_ERROR;
+}
+
+mx_status_t Journal::Commit() {
+    if (running_count_ == 0) {
+        return NO_ERROR;
+    }
+    mx_status_t status;
+    if (next_ + 1 + running_count_ > blocks_) {
+        // Only wraps if the checkpoint below failed last time around
+        return Checkpoint();
+    }
+
+    memset(buf_.get(), 0, kMinfsBlockSize);
+    minfs_journal_header_t* hdr = reinterpret_cast<minfs_journal_header_t*>(buf_.get());
+    hdr->magic = kMinfsJournalRecordMagic;
+    hdr->seq = seq_;
+    hdr->count = running_count_;
+    uint8_t* payload = buf_.get() + kMinfsBlockSize;
+    uint32_t bnos[kMinfsFifoBlocks];
+    bnos[0] = start_ + next_;
+    for (uint32_t i = 0; i < running_count_; i++) {
+        auto e = entries_.find(running_[i]);
+        MX_DEBUG_ASSERT(e != entries_.end());
+        memcpy(payload + i * kMinfsBlockSize, e->data, kMinfsBlockSize);
+        e->running = false;
+        hdr->bno[i] = running_[i];
+        bnos[i + 1] = start_ + next_ + 1 + i;
+    }
+    hdr->checksum = fnv1a32(payload, running_count_ * kMinfsBlockSize);
+
+    // header and payload land in consecutive log blocks, in one request
+    if ((status = bc_->DevWriteblks(bnos, running_count_ + 1, buf_.get())) != NO_ERROR) {
+        return status;
+    }
+    next_ += running_count_ + 1;
+    seq_++;
+    running_count_ = 0;
+    last_commit_ = journal_gettime();
+
+    if (blocks_ - next_ < kMinfsFifoBlocks) {
+        return Checkpoint();
+    }
+    return NO_ERROR;
+}
+
+mx_status_t Journal::Checkpoint() {
+    mx_status_t status;
+    if ((running_count_ > 0) && (next_ + 1 + running_count_ <= blocks_)) {
+        // Commit the running record first, so the log covers everything
+        // about to be written in place. (Commit calls back in here once the
+        // log is low on space, leaving nothing for us to do.)
+        if ((status = Commit()) != NO_ERROR) {
+            return status;
+        }
+    }
+    // With no room left to commit it in, the running record goes straight
+    // in place along with the rest
+    for (uint32_t i = 0; i < running_count_; i++) {
+        entries_.find(running_[i])->running = false;
+    }
+    running_count_ = 0;
+    size_t count = entries_.size();
+    if (count == 0) {
+        return NO_ERROR;
+    }
+
+    // The log has to be on disk before anything it covers is overwritten
+    if (fsync(bc_->fd_) < 0) {
+        return ERR_IO;
+    }
+
+    AllocChecker ac;
+    mxtl::unique_ptr<uint32_t[]> sorted(new (&ac) uint32_t[count]);
+    if (!ac.check()) {
+        return ERR_NO_MEMORY;
+    }
+    size_t n = 0;
+    for (auto& e : entries_) {
+        sorted[n++] = e.bno;
+    }
+    qsort(sorted.get(), count, sizeof(uint32_t), bno_cmp);
+
+    // sorted, so runs of neighbouring blocks coalesce into single requests
+    for (size_t i = 0; i < count; i += kMinfsFifoBlocks) {
+        uint32_t batch = static_cast<uint32_t>(mxtl::min(count - i, static_cast<size_t>(kMinfsFifoBlocks)));
+        for (uint32_t j = 0; j < batch; j++) {
+            auto e = entries_.find(sorted[i + j]);
+            memcpy(buf_.get() + j * kMinfsBlockSize, e->data, kMinfsBlockSize);
+        }
+        if ((status = bc_->DevWriteblks(&sorted[i], batch, buf_.get())) != NO_ERROR) {
+            return status;
+        }
+    }
+    if (fsync(bc_->fd_) < 0) {
+        return ERR_IO;
+    }
+
+    // Everything logged is in place; start the log over
+    entries_.clear();
+    return WriteInfo();
+}
+
+} // namespace minfs
@@ -6,6 +6,7 @@
 #define _XOPEN_SOURCE
 #include <dirent.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -36,8 +37,10 @@ void drop_cache() {
 
 namespace {
 
+bool report_progress = false;
+
 int do_minfs_check(minfs::Bcache* bc, int argc, char** argv) {
-    return minfs_check(bc);
+    return minfs_check(bc, report_progress);
 }
 
 #ifdef __Fuchsia__
@@ -74,23 +77,15 @@ int do_minfs_test(minfs::Bcache* bc, int argc, char** argv) {
     return run_fs_tests(argc, argv);
 }
 
-int do_cp(minfs::Bcache* bc, int argc, char** argv) {
-    if (argc != 2) {
-        fprintf(stderr, "cp requires two arguments\n");
-        return -1;
-    }
-
-    if (io_setup(bc)) {
-        return -1;
-    }
-
+int copy_file(const char* src, const char* dst) {
     int fdi, fdo;
-    if ((fdi = emu_open(argv[0], O_RDONLY, 0)) < 0) {
-        fprintf(stderr, "error: cannot open '%s'\n", argv[0]);
+    if ((fdi = emu_open(src, O_RDONLY, 0)) < 0) {
+        fprintf(stderr, "error: cannot open '%s'\n", src);
         return -1;
     }
-    if ((fdo = emu_open(argv[1], O_WRONLY | O_CREAT | O_EXCL, 0644)) < 0) {
-        fprintf(stderr, "error: cannot open '%s'\n", argv[1]);
+    if ((fdo = emu_open(dst, O_WRONLY | O_CREAT | O_EXCL, 0644)) < 0) {
+        fprintf(stderr, "error: cannot open '%s'\n", dst);
+        emu_close(fdi);
         return -1;
     }
 
@@ -98,7 +93,7 @@ int do_cp(minfs::Bcache* bc, int argc, char** argv) {
     ssize_t r;
     for (;;) {
         if ((r = emu_read(fdi, buffer, sizeof(buffer))) < 0) {
-            fprintf(stderr, "error: reading from '%s'\n", argv[0]);
+            fprintf(stderr, "error: reading from '%s'\n", src);
             break;
         } else if (r == 0) {
             break;
@@ -107,7 +102,7 @@ int do_cp(minfs::Bcache* bc, int argc, char** argv) {
         ssize_t len = r;
         while (len > 0) {
             if ((r = emu_write(fdo, ptr, len)) < 0) {
-                fprintf(stderr, "error: writing to '%s'\n", argv[1]);
+                fprintf(stderr, "error: writing to '%s'\n", dst);
                 goto done;
             }
             ptr = (void*)((uintptr_t)ptr + r);
@@ -120,6 +115,72 @@ done:
     return r;
 }
 
+int do_cp(minfs::Bcache* bc, int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "cp requires two arguments\n");
+        return -1;
+    }
+
+    if (io_setup(bc)) {
+        return -1;
+    }
+    return copy_file(argv[0], argv[1]);
+}
+
+// Copies every file of a manifest, one "path/in/minfs=host/path" per line,
+// making directories along the way. Building an image this way mounts it
+// once, and the block cache and journal batch the writes of all the files,
+// rather than paying for a mount and a checkpoint per 'cp'.
+int do_manifest(minfs::Bcache* bc, int argc, char** argv) {
+    if (argc != 1) {
+        fprintf(stderr, "manifest requires one argument\n");
+        return -1;
+    }
+    if (io_setup(bc)) {
+        return -1;
+    }
+    FILE* manifest;
+    if ((manifest = fopen(argv[0], "r")) == nullptr) {
+        fprintf(stderr, "error: cannot open '%s'\n", argv[0]);
+        return -1;
+    }
+
+    char line[PATH_MAX * 2];
+    char dst[PATH_MAX + PREFIX_SIZE];
+    int r = 0;
+    while ((r == 0) && (fgets(line, sizeof(line), manifest) != nullptr)) {
+        line[strcspn(line, "\r\n")] = 0;
+        char* src = strchr(line, '=');
+        if ((line[0] == 0) || (line[0] == '#')) {
+            continue;
+        } else if (src == nullptr) {
+            fprintf(stderr, "error: manifest line '%s' has no '='\n", line);
+            r = -1;
+            break;
+        }
+        *src++ = 0;
+        const char* path = line;
+        while (path[0] == '/') {
+            path++;
+        }
+        if (snprintf(dst, sizeof(dst), "%s%s", PATH_PREFIX, path) >= (int)sizeof(dst)) {
+            fprintf(stderr, "error: path too long: '%s'\n", path);
+            r = -1;
+            break;
+        }
+        // Directories that already exist fail harmlessly here
+        for (char* slash = strchr(dst + PREFIX_SIZE, '/'); slash != nullptr;
+             slash = strchr(slash + 1, '/')) {
+            *slash = 0;
+            emu_mkdir(dst, 0);
+            *slash = '/';
+        }
+        r = copy_file(src, dst);
+    }
+    fclose(manifest);
+    return r;
+}
+
 int do_mkdir(minfs::Bcache* bc, int argc, char** argv) {
     if (argc != 1) {
         fprintf(stderr, "mkdir requires one argument\n");
@@ -246,6 +307,7 @@ struct {
 #else
     {"test", do_minfs_test, O_RDWR, "run tests against filesystem"},
     {"cp", do_cp, O_RDWR, "copy to/from fs"},
+    {"manifest", do_manifest, O_RDWR, "copy the files of a manifest into fs"},
     {"mkdir", do_mkdir, O_RDWR, "create directory"},
     {"rm", do_unlink, O_RDWR, "delete file or directory"},
     {"unlink", do_unlink, O_RDWR, "delete file or directory"},
@@ -261,6 +323,7 @@ int usage() {
             "\n"
             "options:  -v         some debug messages\n"
             "          -vv        all debug messages\n"
+            "          -p         report progress while checking\n"
 #ifdef __Fuchsia__
             "\n"
             "On Fuchsia, MinFS takes the block device argument by handle.\n"
@@ -296,6 +359,8 @@ int main(int argc, char** argv) {
             trace_on(TRACE_SOME);
         } else if (!strcmp(argv[1], "-vv")) {
             trace_on(TRACE_ALL);
+        } else if (!strcmp(argv[1], "-p")) {
+            report_progress = true;
         } else {
             break;
         }
@@ -386,7 +451,12 @@ found:
 
     for (unsigned i = 0; i < countof(CMDS); i++) {
         if (!strcmp(cmd, CMDS[i].name)) {
-            return CMDS[i].func(bc, argc - 3, argv + 3);
+            int r = CMDS[i].func(bc, argc - 3, argv + 3);
+#ifndef __Fuchsia__
+            // checkpoint whatever the journal still holds
+            bc->Close();
+#endif
+            return r;
         }
     }
     return -1;
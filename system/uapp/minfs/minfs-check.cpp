@@ -7,24 +7,22 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <magenta/new.h>
+#include <mxtl/unique_ptr.h>
+
 #include "minfs.h"
 #include "minfs-private.h"
 
 namespace minfs {
 namespace {
 
-mx_status_t get_inode(const Minfs* fs, minfs_inode_t* inode, uint32_t ino) {
+mx_status_t get_inode(const CheckMaps* chk, const Minfs* fs, minfs_inode_t* inode, uint32_t ino) {
     if (ino >= fs->info_.inode_count) {
         error("check: ino %u out of range (>=%u)\n",
               ino, fs->info_.inode_count);
         return ERR_OUT_OF_RANGE;
     }
-    mx_status_t status;
-    uint32_t bno_of_ino = fs->info_.ino_block + ino / kMinfsInodesPerBlock;
-    uint32_t off_of_ino = (ino % kMinfsInodesPerBlock) * kMinfsInodeSize;
-    if ((status = fs->bc_->Read(bno_of_ino, inode, off_of_ino, kMinfsInodeSize)) < 0) {
-        return status;
-    }
+    memcpy(inode, (void*)((uintptr_t)chk->inode_table + ino * kMinfsInodeSize), kMinfsInodeSize);
     if ((inode->magic != kMinfsMagicFile) && (inode->magic != kMinfsMagicDir)) {
         error("check: ino %u has bad magic %#x\n", ino, inode->magic);
         return ERR_IO_DATA_INTEGRITY;
@@ -32,11 +30,37 @@ mx_status_t get_inode(const Minfs* fs, minfs_inode_t* inode, uint32_t ino) {
     return NO_ERROR;
 }
 
+// Count the bits in [bitoff, bitmax) which are set in 'a' but not in 'b', a
+// word at a time.
+uint32_t count_missing(const RawBitmap& a, const RawBitmap& b, size_t bitoff, size_t bitmax) {
+    constexpr size_t kBits = sizeof(size_t) * 8;
+    const size_t* wa = static_cast<const size_t*>(a.StorageUnsafe()->GetData());
+    const size_t* wb = static_cast<const size_t*>(b.StorageUnsafe()->GetData());
+    uint32_t count = 0;
+    for (size_t w = bitoff / kBits; w * kBits < bitmax; w++) {
+        size_t bits = wa[w] & ~wb[w];
+        if (w == bitoff / kBits) {
+            bits &= ~0ul << (bitoff % kBits);
+        }
+        if ((w + 1) * kBits > bitmax) {
+            bits &= ~0ul >> ((w + 1) * kBits - bitmax);
+        }
+        count += __builtin_popcountl(bits);
+    }
+    return count;
+}
+
 #define CD_DUMP 1
 #define CD_RECURSE 2
 
 mx_status_t get_inode_nth_bno(const Minfs* fs, minfs_inode_t* inode, uint32_t n,
                               uint32_t* bno_out) {
+    if (inode->flags & kMinfsInodeFlagExtents) {
+        if (n >= kMinfsMaxExtentFileBlock) {
+            return ERR_OUT_OF_RANGE;
+        }
+        return fs->ExtentLookup(inode, n, bno_out);
+    }
     if (n < kMinfsDirect) {
         *bno_out = inode->dnum[n];
         return NO_ERROR;
@@ -79,7 +103,7 @@ mx_status_t file_read(const Minfs* fs, minfs_inode_t* inode, void* data, size_t
     uint32_t n = static_cast<uint32_t>(off / kMinfsBlockSize);
     uint32_t adjust = off % kMinfsBlockSize;
 
-    while ((len > 0) && (n < kMinfsMaxFileBlock)) {
+    while ((len > 0) && (n < MinfsMaxFileBlock(inode))) {
         uint32_t xfer;
         if (len > (kMinfsBlockSize - adjust)) {
             xfer = kMinfsBlockSize - adjust;
@@ -122,7 +146,7 @@ mx_status_t file_write(const Minfs* fs, minfs_inode_t* inode, const void* data,
     uint32_t n = static_cast<uint32_t>(off / kMinfsBlockSize);
     uint32_t adjust = off % kMinfsBlockSize;
 
-    while ((len > 0) && (n < kMinfsMaxFileBlock)) {
+    while ((len > 0) && (n < MinfsMaxFileBlock(inode))) {
         uint32_t xfer;
         if (len > (kMinfsBlockSize - adjust)) {
             xfer = kMinfsBlockSize - adjust;
@@ -287,8 +311,101 @@ const char* check_data_block(CheckMaps* chk, const Minfs* fs, uint32_t bno) {
     return nullptr;
 }
 
+void check_file_size(const minfs_inode_t* inode, uint32_t ino, unsigned max, uint32_t blocks) {
+    if (max) {
+        unsigned sizeblocks = inode->size / kMinfsBlockSize;
+        if (sizeblocks > max) {
+            warn("check: ino#%u: filesize too large\n", ino);
+        } else if (sizeblocks < (max - 1)) {
+            warn("check: ino#%u: filesize too small\n", ino);
+        }
+    } else {
+        if (inode->size) {
+            warn("check: ino#%u: filesize too large\n", ino);
+        }
+    }
+    if (blocks != inode->block_count) {
+        warn("check: ino#%u: block count %u, actual blocks %u\n",
+             ino, inode->block_count, blocks);
+    }
+}
+
+// Check the sorted, non-overlapping extents 'ext', counting their blocks and
+// tracking the end of the last one.
+void check_extent_list(CheckMaps* chk, const Minfs* fs, const minfs_extent_t* ext,
+                       uint32_t count, uint32_t ino, unsigned* max, uint32_t* blocks) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (ext[i].count == 0) {
+            warn("check: ino#%u: empty extent at %u\n", ino, ext[i].start);
+            continue;
+        }
+        if (ext[i].start < *max) {
+            warn("check: ino#%u: extent at %u overlaps or is out of order\n", ino, ext[i].start);
+        }
+        for (uint32_t b = 0; b < ext[i].count; b++) {
+            const char* msg;
+            if ((msg = check_data_block(chk, fs, ext[i].bno + b)) != nullptr) {
+                warn("check: ino#%u: block %u(@%u): %s\n",
+                     ino, ext[i].start + b, ext[i].bno + b, msg);
+            }
+        }
+        *blocks += ext[i].count;
+        *max = ext[i].start + ext[i].count;
+    }
+}
+
+mx_status_t check_extents(CheckMaps* chk, const Minfs* fs,
+                          minfs_inode_t* inode, uint32_t ino) {
+    const minfs_extent_t* ext = MinfsInodeExtents(inode);
+    info("Extents: %u%s\n", inode->extent_count,
+         (inode->flags & kMinfsInodeFlagExtentIndex) ? " (indexed)" : "");
+    if (inode->extent_count > kMinfsInlineExtents) {
+        error("check: ino#%u: too many extents (%u)\n", ino, inode->extent_count);
+        return ERR_IO_DATA_INTEGRITY;
+    }
+
+    unsigned max = 0;
+    uint32_t blocks = 0;
+    if (!(inode->flags & kMinfsInodeFlagExtentIndex)) {
+        check_extent_list(chk, fs, ext, inode->extent_count, ino, &max, &blocks);
+        check_file_size(inode, ino, max, blocks);
+        return NO_ERROR;
+    }
+
+    for (uint32_t i = 0; i < inode->extent_count; i++) {
+        const char* msg;
+        if ((msg = check_data_block(chk, fs, ext[i].bno)) != nullptr) {
+            warn("check: ino#%u: extent block %u(@%u): %s\n", ino, i, ext[i].bno, msg);
+            continue;
+        }
+        blocks++;
+        if (ext[i].count > kMinfsExtentsPerBlock) {
+            error("check: ino#%u: extent block %u holds too many extents (%u)\n",
+                  ino, i, ext[i].count);
+            return ERR_IO_DATA_INTEGRITY;
+        }
+        mxtl::RefPtr<BlockNode> blk;
+        if ((blk = fs->bc_->Get(ext[i].bno)) == nullptr) {
+            return ERR_IO;
+        }
+        const minfs_extent_t* leaf = static_cast<const minfs_extent_t*>(blk->data());
+        if ((ext[i].count > 0) && (leaf[0].start != ext[i].start)) {
+            warn("check: ino#%u: extent block %u starts at %u, not %u\n",
+                 ino, i, leaf[0].start, ext[i].start);
+        }
+        check_extent_list(chk, fs, leaf, ext[i].count, ino, &max, &blocks);
+        fs->bc_->Put(mxtl::move(blk), 0);
+    }
+    check_file_size(inode, ino, max, blocks);
+    return NO_ERROR;
+}
+
 mx_status_t check_file(CheckMaps* chk, const Minfs* fs,
                        minfs_inode_t* inode, uint32_t ino) {
+    if (inode->flags & kMinfsInodeFlagExtents) {
+        return check_extents(chk, fs, inode, ino);
+    }
+
     info("Direct blocks: \n");
     for (unsigned n = 0; n < kMinfsDirect; n++) {
         info(" %d,", inode->dnum[n]);
@@ -331,22 +448,7 @@ mx_status_t check_file(CheckMaps* chk, const Minfs* fs,
             max = n + 1;
         }
     }
-    if (max) {
-        unsigned sizeblocks = inode->size / kMinfsBlockSize;
-        if (sizeblocks > max) {
-            warn("check: ino#%u: filesize too large\n", ino);
-        } else if (sizeblocks < (max - 1)) {
-            warn("check: ino#%u: filesize too small\n", ino);
-        }
-    } else {
-        if (inode->size) {
-            warn("check: ino#%u: filesize too large\n", ino);
-        }
-    }
-    if (blocks != inode->block_count) {
-        warn("check: ino#%u: block count %u, actual blocks %u\n",
-             ino, inode->block_count, blocks);
-    }
+    check_file_size(inode, ino, max, blocks);
     return NO_ERROR;
 }
 
@@ -361,9 +463,16 @@ mx_status_t check_inode(CheckMaps* chk, const Minfs* fs, uint32_t ino, uint32_t
     if (!fs->inode_map_.Get(ino, ino + 1)) {
         warn("check: ino#%u: not marked in-use\n", ino);
     }
+    if (chk->progress && chk->inodes_allocated) {
+        uint32_t done = ++chk->inodes_checked;
+        if ((done <= chk->inodes_allocated) &&
+            ((done * 10ull) / chk->inodes_allocated != ((done - 1) * 10ull) / chk->inodes_allocated)) {
+            fprintf(stderr, "check: %u of %u inodes checked\n", done, chk->inodes_allocated);
+        }
+    }
     mx_status_t status;
     minfs_inode_t inode;
-    if ((status = get_inode(fs, &inode, ino)) < 0) {
+    if ((status = get_inode(chk, fs, &inode, ino)) < 0) {
         error("check: ino#%u: not readable\n", ino);
         return status;
     }
@@ -389,7 +498,7 @@ mx_status_t check_inode(CheckMaps* chk, const Minfs* fs, uint32_t ino, uint32_t
     return NO_ERROR;
 }
 
-mx_status_t minfs_check(Bcache* bc) {
+mx_status_t minfs_check(Bcache* bc, bool progress) {
     mx_status_t status;
 
     minfs_info_t info;
@@ -413,34 +522,41 @@ mx_status_t minfs_check(Bcache* bc) {
     if ((status = Minfs::Create(&fs, bc, &info)) < 0) {
         return status;
     }
+#ifdef __Fuchsia__
+    // Minfs::Create has already read in the inode table
+    chk.inode_table = fs->inode_table_->GetData();
+#else
+    uint32_t inoblks = (info.inode_count + kMinfsInodesPerBlock - 1) / kMinfsInodesPerBlock;
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> inode_table(new (&ac) uint8_t[inoblks * kMinfsBlockSize]);
+    if (!ac.check()) {
+        return ERR_NO_MEMORY;
+    }
+    if ((status = bc->ReadblkRun(info.ino_block, inoblks, inode_table.get())) != NO_ERROR) {
+        error("check: could not read inode table\n");
+        return status;
+    }
+    chk.inode_table = inode_table.get();
+#endif
+    chk.progress = progress;
+    // Nothing has been checked yet, so this counts the allocated inodes
+    chk.inodes_allocated = count_missing(fs->inode_map_, chk.checked_inodes, 1, info.inode_count);
+    chk.inodes_checked = 0;
 
     //TODO: check root not a directory
     if ((status = check_inode(&chk, fs, 1, 1)) < 0) {
         return status;
     }
 
-    unsigned missing = 0;
-    for (unsigned n = info.dat_block; n < info.block_count; n++) {
-        if (fs->block_map_.Get(n, n + 1)) {
-            if (!chk.checked_blocks.Get(n, n + 1)) {
-                missing++;
-            }
-        }
-    }
+    uint32_t missing = count_missing(fs->block_map_, chk.checked_blocks,
+                                     info.dat_block, info.block_count);
     if (missing) {
         error("check: %u allocated block%s not in use\n",
               missing, missing > 1 ? "s" : "");
         status = ERR_BAD_STATE;
     }
 
-    missing = 0;
-    for (unsigned n = 1; n < info.inode_count; n++) {
-        if (fs->inode_map_.Get(n, n + 1)) {
-            if (!chk.checked_inodes.Get(n, n + 1)) {
-                missing++;
-            }
-        }
-    }
+    missing = count_missing(fs->inode_map_, chk.checked_inodes, 1, info.inode_count);
     if (missing) {
         error("check: %u allocated inode%s not in use\n",
               missing, missing > 1 ? "s" : "");
@@ -12,6 +12,7 @@
 #include <sys/stat.h>
 
 #include <mxtl/algorithm.h>
+#include <mxtl/auto_lock.h>
 #include <magenta/device/vfs.h>
 
 #ifdef __Fuchsia__
@@ -114,6 +115,12 @@ void VnodeMinfs::InodeSync(uint32_t flags) {
 // Delete all blocks (relative to a file) from "start" (inclusive) to the end of
 // the file. Does not update mtime/atime.
 mx_status_t VnodeMinfs::BlocksShrink(uint32_t start) {
+    if (inode_.flags & kMinfsInodeFlagExtents) {
+        mx_status_t status = fs_->ExtentShrink(&inode_, start);
+        InodeSync(kMxFsSyncDefault);
+        return status;
+    }
+
     mxtl::RefPtr<BlockNode> bitmap_blk = nullptr;
 
     bool doSync = false;
@@ -202,28 +209,39 @@ mx_status_t VnodeMinfs::BlocksShrink(uint32_t start) {
 }
 
 #ifdef __Fuchsia__
-// Read data from disk at block 'bno', into the 'nth' logical block of the file.
-mx_status_t VnodeMinfs::FillBlock(uint32_t n, uint32_t bno) {
+// Read data from disk at blocks 'bnos', into the 'ns' logical blocks of the file.
+mx_status_t VnodeMinfs::FillBlocks(const uint32_t* ns, const uint32_t* bnos, uint32_t count) {
     // TODO(smklein): read directly from block device into vmo; no need to copy
     // into an intermediate buffer.
-    char bdata[kMinfsBlockSize];
-    if (fs_->bc_->Readblk(bno, bdata)) {
+    if (count == 0) {
+        return NO_ERROR;
+    }
+    mxtl::unique_free_ptr<char> bdata(static_cast<char*>(malloc(count * kMinfsBlockSize)));
+    if (bdata == nullptr) {
+        return ERR_NO_MEMORY;
+    }
+    if (fs_->bc_->Readblks(bnos, count, bdata.get())) {
         return ERR_IO;
     }
-    mx_status_t status = vmo_write_exact(vmo_, bdata, n * kMinfsBlockSize, kMinfsBlockSize);
-    if (status != NO_ERROR) {
-        return status;
+    for (uint32_t i = 0; i < count; i++) {
+        mx_status_t status = vmo_write_exact(vmo_, bdata.get() + i * kMinfsBlockSize,
+                                             ns[i] * kMinfsBlockSize, kMinfsBlockSize);
+        if (status != NO_ERROR) {
+            return status;
+        }
     }
     return NO_ERROR;
 }
 
 // Since we cannot yet register the filesystem as a paging service (and cleanly
-// fault on pages when they are actually needed), we currently read an entire
-// file to a VMO when a file's data block are accessed.
+// fault on pages when they are actually needed), a file's data blocks are read
+// into a VMO before they are accessed. The VMO is filled from the front:
+// everything below 'vmo_loaded_' has been read, and reads pull in the blocks
+// they touch plus a readahead window, rather than the entire file up-front.
 //
-// TODO(smklein): Even this hack can be optimized; a bitmap could be used to
-// track all 'empty/read/dirty' blocks for each vnode, rather than reading
-// the entire file.
+// TODO(smklein): A bitmap could be used to track all 'empty/read/dirty' blocks
+// for each vnode, so random access wouldn't need to fill the VMO up to the
+// block being accessed.
 mx_status_t VnodeMinfs::InitVmo() {
     if (vmo_ != MX_HANDLE_INVALID) {
         return NO_ERROR;
@@ -234,53 +252,126 @@ mx_status_t VnodeMinfs::InitVmo() {
         error("Failed to initialize vmo; error: %d\n", status);
         return status;
     }
+    vmo_loaded_ = 0;
+    return NO_ERROR;
+}
+
+mx_status_t VnodeMinfs::EnsureLoaded(uint32_t end) {
+    uint32_t nblocks = static_cast<uint32_t>(mxtl::roundup(inode_.size, kMinfsBlockSize) /
+                                             kMinfsBlockSize);
+    if (end > nblocks) {
+        end = nblocks;
+    }
 
-    // Initialize all direct blocks
-    uint32_t bno;
-    for (uint32_t d = 0; d < kMinfsDirect; d++) {
-        if ((bno = inode_.dnum[d]) != 0) {
-            if ((status = FillBlock(d, bno)) != NO_ERROR) {
-                error("Failed to fill bno %u; error: %d\n", bno, status);
+    // Gather the blocks so they are read from disk in batches; holes are left
+    // as zeroes in the VMO.
+    uint32_t ns[kMinfsFifoBlocks];
+    uint32_t bnos[kMinfsFifoBlocks];
+    uint32_t count = 0;
+    mx_status_t status;
+    for (uint32_t n = vmo_loaded_; n < end; n++) {
+        uint32_t bno;
+        if ((status = GetBno(n, &bno, false)) != NO_ERROR) {
+            return status;
+        }
+        if (bno == 0) {
+            continue;
+        }
+        ns[count] = n;
+        bnos[count] = bno;
+        if (++count == kMinfsFifoBlocks) {
+            if ((status = FillBlocks(ns, bnos, count)) != NO_ERROR) {
                 return status;
             }
+            count = 0;
+            vmo_loaded_ = n + 1;
+        }
+    }
+    if ((status = FillBlocks(ns, bnos, count)) != NO_ERROR) {
+        return status;
+    }
+    if (vmo_loaded_ < end) {
+        vmo_loaded_ = end;
+    }
+    return NO_ERROR;
+}
+
+// Blocks are only written to disk once the queue fills up, on sync, or before
+// the vnode goes away. The queue holds block numbers, the data itself stays in
+// the VMO until the flush.
+mx_status_t VnodeMinfs::QueueWrite(uint32_t n, uint32_t bno) {
+    for (uint32_t i = 0; i < dirty_count_; i++) {
+        if (dirty_n_[i] == n) {
+            return NO_ERROR;
+        }
+    }
+    if (dirty_count_ == kMinfsFifoBlocks) {
+        mx_status_t status;
+        if ((status = FlushWrites()) != NO_ERROR) {
+            return status;
+        }
+    }
+    dirty_n_[dirty_count_] = n;
+    dirty_bno_[dirty_count_] = bno;
+    dirty_count_++;
+    return NO_ERROR;
+}
+
+mx_status_t VnodeMinfs::FlushWrites() {
+    if (dirty_count_ == 0) {
+        return NO_ERROR;
+    }
+
+    // Sort by disk block, so the block cache can merge neighbours into
+    // single transfers.
+    for (uint32_t i = 1; i < dirty_count_; i++) {
+        uint32_t n = dirty_n_[i];
+        uint32_t bno = dirty_bno_[i];
+        uint32_t j = i;
+        for (; j > 0 && dirty_bno_[j - 1] > bno; j--) {
+            dirty_n_[j] = dirty_n_[j - 1];
+            dirty_bno_[j] = dirty_bno_[j - 1];
         }
+        dirty_n_[j] = n;
+        dirty_bno_[j] = bno;
     }
 
-    // Initialize all indirect blocks
-    for (uint32_t i = 0; i < kMinfsIndirect; i++) {
-        uint32_t ibno;
-        mxtl::RefPtr<BlockNode> iblk;
-        if ((ibno = inode_.inum[i]) != 0) {
-            // TODO(smklein): Should there be a separate vmo for indirect blocks?
-            if ((iblk = fs_->bc_->Get(ibno)) == nullptr) {
+    mxtl::unique_free_ptr<char> bdata(static_cast<char*>(malloc(dirty_count_ * kMinfsBlockSize)));
+    if (bdata == nullptr) {
+        return ERR_NO_MEMORY;
+    }
+    mx_status_t status;
+    for (uint32_t i = 0; i < dirty_count_; i++) {
+        if ((status = vmo_read_exact(vmo_, bdata.get() + i * kMinfsBlockSize,
+                                     dirty_n_[i] * kMinfsBlockSize, kMinfsBlockSize)) != NO_ERROR) {
+            return ERR_IO;
+        }
+    }
+    if (IsDirectory()) {
+        // directory blocks are metadata, and go through the journal
+        for (uint32_t i = 0; i < dirty_count_; i++) {
+            if (fs_->bc_->Writeblk(dirty_bno_[i], bdata.get() + i * kMinfsBlockSize)) {
                 return ERR_IO;
             }
-            uint32_t* ientry = static_cast<uint32_t*>(iblk->data());
-
-            const uint32_t direct_per_indirect = kMinfsBlockSize / sizeof(uint32_t);
-            for (uint32_t j = 0; j < direct_per_indirect; j++) {
-                if ((bno = ientry[j]) != 0) {
-                    uint32_t n = kMinfsDirect + i * direct_per_indirect + j;
-                    if ((status = FillBlock(n, bno)) != NO_ERROR) {
-                        fs_->bc_->Put(iblk, 0);
-                        return status;
-                    }
-                }
-            }
-            fs_->bc_->Put(iblk, 0);
         }
+    } else if (fs_->bc_->Writeblks(dirty_bno_, dirty_count_, bdata.get())) {
+        return ERR_IO;
     }
-
+    dirty_count_ = 0;
     return NO_ERROR;
 }
 #endif
 
 // Get the bno corresponding to the nth logical block within the file.
 mx_status_t VnodeMinfs::GetBno(uint32_t n, uint32_t* bno, bool alloc) {
-    uint32_t hint = 0;
+    if (inode_.flags & kMinfsInodeFlagExtents) {
+        return GetBnoExtent(n, bno, alloc);
+    }
+
     // direct blocks are simple... is there an entry in dnum[]?
     if (n < kMinfsDirect) {
         if (((*bno = inode_.dnum[n]) == 0) && alloc) {
+            uint32_t hint = (n > 0) ? AllocHint(inode_.dnum[n - 1]) : AllocHint(0);
             mx_status_t status = fs_->BlockNew(hint, bno, nullptr);
             if (status != NO_ERROR) {
                 return status;
@@ -331,7 +422,9 @@ mx_status_t VnodeMinfs::GetBno(uint32_t n, uint32_t* bno, bool alloc) {
     uint32_t* ientry = static_cast<uint32_t*>(iblk->data());
 
     if (((*bno = ientry[j]) == 0) && alloc) {
-        // allocate a new block
+        // allocate a new block, after the previous one if possible
+        uint32_t prev = (j > 0) ? ientry[j - 1] : ((i == 0) ? inode_.dnum[kMinfsDirect - 1] : 0);
+        uint32_t hint = AllocHint(prev);
         mx_status_t status = fs_->BlockNew(hint, bno, nullptr);
         if (status != NO_ERROR) {
             fs_->bc_->Put(iblk, iflags);
@@ -352,6 +445,47 @@ mx_status_t VnodeMinfs::GetBno(uint32_t n, uint32_t* bno, bool alloc) {
     return NO_ERROR;
 }
 
+mx_status_t VnodeMinfs::GetBnoExtent(uint32_t n, uint32_t* bno, bool alloc) {
+    if (n >= kMinfsMaxExtentFileBlock) {
+        return ERR_OUT_OF_RANGE;
+    }
+    mx_status_t status;
+    if ((status = fs_->ExtentLookup(&inode_, n, bno)) != NO_ERROR) {
+        return status;
+    } else if ((*bno != 0) || !alloc) {
+        return NO_ERROR;
+    }
+
+    // Try to extend the extent holding the previous block
+    uint32_t prev = 0;
+    if ((n > 0) && ((status = fs_->ExtentLookup(&inode_, n - 1, &prev)) != NO_ERROR)) {
+        return status;
+    }
+    if ((status = fs_->BlockNew(AllocHint(prev), bno, nullptr)) != NO_ERROR) {
+        return status;
+    }
+    if ((status = fs_->ExtentInsert(&inode_, n, *bno)) != NO_ERROR) {
+        mxtl::RefPtr<BlockNode> bitmap_blk = fs_->BitmapBlockGet(nullptr, *bno);
+        if (bitmap_blk != nullptr) {
+            fs_->block_map_.Clear(*bno, *bno + 1);
+            fs_->BitmapBlockPut(bitmap_blk);
+        }
+        return status;
+    }
+    inode_.block_count++;
+    InodeSync(kMxFsSyncDefault);
+    return NO_ERROR;
+}
+
+// Allocate a file's blocks contiguously: right after the block before it, or
+// at the start of a free run when there isn't one.
+uint32_t VnodeMinfs::AllocHint(uint32_t prev_bno) {
+    if (prev_bno != 0) {
+        return prev_bno + 1;
+    }
+    return fs_->BlockRunHint(kMinfsAllocRun);
+}
+
 // Immediately stop iterating over the directory.
 #define DIR_CB_DONE 0
 // Access the next direntry in the directory. Offsets updated.
@@ -684,9 +818,14 @@ static mx_status_t cb_dir_append(mxtl::RefPtr<VnodeMinfs> vndir, minfs_dirent_t*
 //  'offs': Offset info about where in the directory this direntry is located.
 //          Since 'func' may create / remove surrounding dirents, it is responsible for
 //          updating the offset information to access the next dirent.
-mx_status_t VnodeMinfs::ForEachDirent(DirArgs* args,
-                                      mx_status_t (*func)(mxtl::RefPtr<VnodeMinfs>, minfs_dirent_t*,
-                                                          DirArgs*, DirectoryOffset*)) {
+mx_status_t VnodeMinfs::ForEachDirent(DirArgs* args, DirentCallback func) {
+    if (dirent_cache_ == nullptr) {
+        DirentCacheInit();
+    }
+    if (dirent_cache_ != nullptr) {
+        return ForEachDirentCached(args, func);
+    }
+
     char data[kMinfsMaxDirentSize];
     minfs_dirent_t* de = (minfs_dirent_t*) data;
     DirectoryOffset offs = {
@@ -718,7 +857,114 @@ mx_status_t VnodeMinfs::ForEachDirent(DirArgs* args,
     return ERR_NOT_FOUND;
 }
 
+mx_status_t VnodeMinfs::ForEachDirentCached(DirArgs* args, DirentCallback func) {
+    // Every callback but cb_dir_append is looking for a name
+    const DirentCache::Record* rec;
+    if (func == cb_dir_append) {
+        rec = dirent_cache_->FindSpare(args->reclen);
+    } else {
+        rec = dirent_cache_->FindName(DirentCache::NameHash(args->name, args->len));
+    }
+    if (rec == nullptr) {
+        return ERR_NOT_FOUND;
+    }
+
+    // 'func' may split the record, or merge it with its neighbours; either
+    // way, the records it changes all lie within [start, end).
+    const DirentCache::Record* prev = dirent_cache_->Prev(rec->off);
+    const DirentCache::Record* next = dirent_cache_->Next(rec->off);
+    DirectoryOffset offs = {
+        .off = rec->off,
+        .off_prev = (prev != nullptr) ? prev->off : rec->off,
+    };
+    uint32_t start = static_cast<uint32_t>(offs.off_prev);
+    uint32_t end = (next != nullptr) ? next->off + next->size : rec->off + rec->size;
+
+    char data[kMinfsMaxDirentSize];
+    minfs_dirent_t* de = (minfs_dirent_t*) data;
+    size_t r;
+    mx_status_t status = ReadInternal(data, kMinfsMaxDirentSize, offs.off, &r);
+    if ((status != NO_ERROR) || ((status = validate_dirent(de, r, offs.off)) != NO_ERROR)) {
+        dirent_cache_.reset();
+        return status;
+    }
+
+    switch ((status = func(mxtl::RefPtr<VnodeMinfs>(this), de, args, &offs))) {
+    case DIR_CB_NEXT:
+        // A different name with the same hash. No two cached names share a
+        // hash, so the one we want isn't in the directory.
+        return ERR_NOT_FOUND;
+    case DIR_CB_SAVE_SYNC:
+        inode_.seq_num++;
+        InodeSync(kMxFsSyncMtime);
+        dirent_cache_->Erase(start, end);
+        if (DirentCacheLoad(start, end) != NO_ERROR) {
+            // rebuilt from scratch on the next lookup
+            dirent_cache_.reset();
+        }
+        return NO_ERROR;
+    case DIR_CB_DONE:
+        return status;
+    default:
+        // a failed update may have left the records half changed
+        dirent_cache_.reset();
+        return status;
+    }
+}
+
+void VnodeMinfs::DirentCacheInit() {
+    if ((flags_ & kMinfsFlagNoDirentCache) || (inode_.size < kMinfsDirentCacheMinSize)) {
+        return;
+    }
+    AllocChecker ac;
+    dirent_cache_.reset(new (&ac) DirentCache());
+    if (!ac.check() || (DirentCacheLoad(0, kMinfsMaxDirectorySize) != NO_ERROR)) {
+        error("minfs: cannot cache dirents of vnode #%u, scanning it instead\n", ino_);
+        dirent_cache_.reset();
+        flags_ |= kMinfsFlagNoDirentCache;
+    }
+}
+
+mx_status_t VnodeMinfs::DirentCacheLoad(uint32_t start, uint32_t end) {
+    char data[kMinfsMaxDirentSize];
+    minfs_dirent_t* de = (minfs_dirent_t*) data;
+    uint32_t off = start;
+    while ((off < end) && (off + MINFS_DIRENT_SIZE < kMinfsMaxDirectorySize)) {
+        size_t r;
+        mx_status_t status = ReadInternal(data, kMinfsMaxDirentSize, off, &r);
+        if (status != NO_ERROR) {
+            return status;
+        } else if ((status = validate_dirent(de, r, off)) != NO_ERROR) {
+            return status;
+        }
+        uint32_t reclen = MinfsReclen(de, off);
+        if (de->ino == 0) {
+            status = dirent_cache_->Insert(off, reclen, 0, 0);
+        } else {
+            status = dirent_cache_->Insert(off, reclen, DirentSize(de->namelen),
+                                           DirentCache::NameHash(de->name, de->namelen));
+        }
+        if (status != NO_ERROR) {
+            return status;
+        }
+        if (de->reclen & kMinfsReclenLast) {
+            break;
+        }
+        off += reclen;
+    }
+    return NO_ERROR;
+}
+
 VnodeMinfs::~VnodeMinfs() {
+    JournalScope txn(fs_->bc_);
+#ifdef __Fuchsia__
+    // Blocks of an unlinked file are about to be freed, don't bother writing them
+    if (inode_.link_count == 0) {
+        dirty_count_ = 0;
+    } else if (FlushWrites() != NO_ERROR) {
+        error("minfs: failed to write back vnode #%u\n", ino_);
+    }
+#endif
     if (inode_.link_count == 0) {
         fs_->InoFree(inode_, ino_);
     }
@@ -763,9 +1009,27 @@ mx_status_t VnodeMinfs::ReadInternal(void* data, size_t len, size_t off, size_t*
 
     mx_status_t status;
 #ifdef __Fuchsia__
-    if ((status = InitVmo()) != NO_ERROR) {
-        return status;
-    } else if ((status = mx_vmo_read(vmo_, data, off, len, actual)) != NO_ERROR) {
+    {
+        mxtl::AutoLock lock(&vmo_lock_);
+        if ((status = InitVmo()) != NO_ERROR) {
+            return status;
+        }
+
+        // Grow the readahead window while the file is being read sequentially
+        if (off == last_read_end_) {
+            readahead_ = mxtl::min(readahead_ * 2, kMinfsReadaheadMax);
+        } else {
+            readahead_ = kMinfsReadaheadMin;
+        }
+        last_read_end_ = off + len;
+        uint32_t end = static_cast<uint32_t>(mxtl::roundup(off + len, kMinfsBlockSize) /
+                                             kMinfsBlockSize);
+        if ((status = EnsureLoaded(end + readahead_)) != NO_ERROR) {
+            return status;
+        }
+    }
+    // Once loaded, concurrent readers copy out of the VMO side by side
+    if ((status = mx_vmo_read(vmo_, data, off, len, actual)) != NO_ERROR) {
         return status;
     }
 #else
@@ -773,7 +1037,7 @@ mx_status_t VnodeMinfs::ReadInternal(void* data, size_t len, size_t off, size_t*
     uint32_t n = off / kMinfsBlockSize;
     size_t adjust = off % kMinfsBlockSize;
 
-    while ((len > 0) && (n < kMinfsMaxFileBlock)) {
+    while ((len > 0) && (n < MinfsMaxFileBlock(&inode_))) {
         size_t xfer;
         if (len > (kMinfsBlockSize - adjust)) {
             xfer = kMinfsBlockSize - adjust;
@@ -811,6 +1075,7 @@ ssize_t VnodeMinfs::Write(const void* data, size_t len, size_t off) {
     if (IsDirectory()) {
         return ERR_NOT_FILE;
     }
+    JournalScope txn(fs_->bc_);
     size_t actual;
     mx_status_t status = WriteInternal(data, len, off, &actual);
     if (status != NO_ERROR) {
@@ -839,7 +1104,7 @@ mx_status_t VnodeMinfs::WriteInternal(const void* data, size_t len, size_t off,
     uint32_t n = static_cast<uint32_t>(off / kMinfsBlockSize);
     size_t adjust = off % kMinfsBlockSize;
 
-    while ((len > 0) && (n < kMinfsMaxFileBlock)) {
+    while ((len > 0) && (n < MinfsMaxFileBlock(&inode_))) {
         size_t xfer;
         if (len > (kMinfsBlockSize - adjust)) {
             xfer = kMinfsBlockSize - adjust;
@@ -863,27 +1128,24 @@ mx_status_t VnodeMinfs::WriteInternal(const void* data, size_t len, size_t off,
         // the file. As a consequence, an error is returned (ERR_IO) rather than
         // doing a partial read.
 
+        // The block must be current in the VMO before it is partially
+        // overwritten, and before it is queued for write-behind
+        if ((status = EnsureLoaded(n + 1)) != NO_ERROR) {
+            return ERR_IO;
+        }
+
         // Update this block of the in-memory VMO
         if ((status = vmo_write_exact(vmo_, data, xfer_off, xfer)) != NO_ERROR) {
             return ERR_IO;
         }
 
-        // Update this block on-disk
-        char bdata[kMinfsBlockSize];
-        // TODO(smklein): Can we write directly from the VMO to the block device,
-        // preventing the need for a 'bdata' variable?
-        if (xfer != kMinfsBlockSize) {
-            if (vmo_read_exact(vmo_, bdata, n * kMinfsBlockSize, kMinfsBlockSize) != NO_ERROR) {
-                return ERR_IO;
-            }
-        }
-        const void* wdata = (xfer != kMinfsBlockSize) ? bdata : data;
+        // Queue this block to be updated on-disk
         uint32_t bno;
         if ((status = GetBno(n, &bno, true)) != NO_ERROR) {
             return status;
         }
         assert(bno != 0);
-        if (fs_->bc_->Writeblk(bno, wdata)) {
+        if (QueueWrite(n, bno) != NO_ERROR) {
             return ERR_IO;
         }
 #else
@@ -913,7 +1175,7 @@ done:
     if (len == 0) {
         // If more than zero bytes were requested, but zero bytes were written,
         // return an error explicitly (rather than zero).
-        if (off >= kMinfsMaxFileSize) {
+        if (off >= MinfsMaxFileBlock(&inode_) * kMinfsBlockSize) {
             return ERR_FILE_BIG;
         }
 
@@ -922,6 +1184,12 @@ done:
     if ((off + len) > inode_.size) {
         inode_.size = static_cast<uint32_t>(off + len);
     }
+#ifdef __Fuchsia__
+    // Directory updates are not deferred
+    if (IsDirectory() && FlushWrites() != NO_ERROR) {
+        return ERR_IO;
+    }
+#endif
 
     *actual = len;
     return NO_ERROR;
@@ -977,6 +1245,7 @@ mx_status_t VnodeMinfs::Getattr(vnattr_t* a) {
 mx_status_t VnodeMinfs::Setattr(vnattr_t* a) {
     int dirty = 0;
     trace(MINFS, "minfs_setattr() vn=%p(#%u)\n", this, ino_);
+    JournalScope txn(fs_->bc_);
     if ((a->valid & ~(ATTR_CTIME|ATTR_MTIME)) != 0) {
         return ERR_NOT_SUPPORTED;
     }
@@ -1005,9 +1274,17 @@ static_assert(sizeof(dircookie_t) <= sizeof(vdircookie_t),
               "MinFS dircookie too large to fit in IO state");
 
 mx_status_t VnodeMinfs::Readdir(void* cookie, void* dirents, size_t len) {
+    return ReaddirInternal(cookie, dirents, len, false);
+}
+
+mx_status_t VnodeMinfs::ReaddirPlus(void* cookie, void* dirents, size_t len) {
+    return ReaddirInternal(cookie, dirents, len, true);
+}
+
+mx_status_t VnodeMinfs::ReaddirInternal(void* cookie, void* dirents, size_t len, bool attrs) {
     trace(MINFS, "minfs_readdir() vn=%p(#%u) cookie=%p len=%zd\n", this, ino_, cookie, len);
     dircookie_t* dc = reinterpret_cast<dircookie_t*>(cookie);
-    fs::DirentFiller df(dirents, len);
+    fs::DirentFiller df(dirents, len, attrs);
 
     if (!IsDirectory()) {
         return ERR_NOT_SUPPORTED;
@@ -1046,8 +1323,17 @@ mx_status_t VnodeMinfs::Readdir(void* cookie, void* dirents, size_t len) {
         }
 
         if (de->ino) {
+            // Dirents carry the inode number, so the attributes come straight
+            // from the in-memory inode table rather than a lookup by name.
+            vnattr_t attr;
+            vnattr_t* attrp = nullptr;
+            mxtl::RefPtr<VnodeMinfs> vn;
+            if (attrs && fs_->VnodeGet(&vn, de->ino) == NO_ERROR &&
+                vn->Getattr(&attr) == NO_ERROR) {
+                attrp = &attr;
+            }
             mx_status_t status;
-            if ((status = df.Next(de->name, de->namelen, de->type)) != NO_ERROR) {
+            if ((status = df.Next(de->name, de->namelen, de->type, attrp)) != NO_ERROR) {
                 // no more space
                 goto done;
             }
@@ -1070,7 +1356,12 @@ fail:
 }
 
 #ifdef __Fuchsia__
-VnodeMinfs::VnodeMinfs(Minfs* fs) : fs_(fs), vmo_(MX_HANDLE_INVALID) {}
+#ifdef __Fuchsia__
+VnodeMinfs::VnodeMinfs(Minfs* fs) : fs_(fs), vmo_(MX_HANDLE_INVALID), vmo_loaded_(0),
+    last_read_end_(0), readahead_(kMinfsReadaheadMin), dirty_count_(0) {}
+#else
+VnodeMinfs::VnodeMinfs(Minfs* fs) : fs_(fs) {}
+#endif
 #else
 VnodeMinfs::VnodeMinfs(Minfs* fs) : fs_(fs) {}
 #endif
@@ -1090,6 +1381,9 @@ mx_status_t VnodeMinfs::Allocate(Minfs* fs, uint32_t type, mxtl::RefPtr<VnodeMin
     (*out)->inode_.magic = MinfsMagic(type);
     (*out)->inode_.create_time = (*out)->inode_.modify_time = minfs_gettime_utc();
     (*out)->inode_.link_count = (type == kMinfsTypeDir ? 2 : 1);
+    if (fs->info_.version >= kMinfsVersion) {
+        (*out)->inode_.flags = kMinfsInodeFlagExtents;
+    }
     return NO_ERROR;
 }
 
@@ -1105,6 +1399,7 @@ mx_status_t VnodeMinfs::AllocateHollow(Minfs* fs, mxtl::RefPtr<VnodeMinfs>* out)
 mx_status_t VnodeMinfs::Create(mxtl::RefPtr<fs::Vnode>* out, const char* name, size_t len, uint32_t mode) {
     trace(MINFS, "minfs_create() vn=%p(#%u) name='%.*s' mode=%#x\n",
           this, ino_, (int)len, name, mode);
+    JournalScope txn(fs_->bc_);
     assert(len <= kMinfsMaxNameSize);
     assert(memchr(name, '/', len) == NULL);
     if (!IsDirectory()) {
@@ -1183,6 +1478,7 @@ ssize_t VnodeMinfs::Ioctl(uint32_t op, const void* in_buf, size_t in_len, void*
 
 mx_status_t VnodeMinfs::Unlink(const char* name, size_t len, bool must_be_dir) {
     trace(MINFS, "minfs_unlink() vn=%p(#%u) name='%.*s'\n", this, ino_, (int)len, name);
+    JournalScope txn(fs_->bc_);
     assert(len <= kMinfsMaxNameSize);
     assert(memchr(name, '/', len) == NULL);
     if (!IsDirectory()) {
@@ -1205,6 +1501,7 @@ mx_status_t VnodeMinfs::Truncate(size_t len) {
     if (IsDirectory()) {
         return ERR_NOT_FILE;
     }
+    JournalScope txn(fs_->bc_);
 
     mx_status_t status = TruncateInternal(len);
     if (status != NO_ERROR) {
@@ -1223,6 +1520,16 @@ mx_status_t VnodeMinfs::TruncateInternal(size_t len) {
 #endif
 
     if (len < inode_.size) {
+#ifdef __Fuchsia__
+        // Queued blocks may be past the truncation point, and about to be
+        // freed; write them out while they're still ours.
+        if (FlushWrites() != NO_ERROR) {
+            return ERR_IO;
+        }
+        if (EnsureLoaded(static_cast<uint32_t>(len / kMinfsBlockSize) + 1) != NO_ERROR) {
+            return ERR_IO;
+        }
+#endif
         // Truncate should make the file shorter
         size_t bno = inode_.size / kMinfsBlockSize;
         size_t trunc_bno = len / kMinfsBlockSize;
@@ -1275,7 +1582,7 @@ mx_status_t VnodeMinfs::TruncateInternal(size_t len) {
         inode_.size = static_cast<uint32_t>(len);
     } else if (len > inode_.size) {
         // Truncate should make the file longer, filled with zeroes.
-        if (kMinfsMaxFileSize < len) {
+        if (MinfsMaxFileBlock(&inode_) * kMinfsBlockSize < len) {
             return ERR_INVALID_ARGS;
         }
         char zero = 0;
@@ -1318,6 +1625,7 @@ mx_status_t VnodeMinfs::Rename(mxtl::RefPtr<fs::Vnode> _newdir, const char* oldn
     auto newdir = mxtl::RefPtr<VnodeMinfs>::Downcast(_newdir);
     trace(MINFS, "minfs_rename() olddir=%p(#%u) newdir=%p(#%u) oldname='%.*s' newname='%.*s'\n",
           this, ino_, newdir.get(), newdir->ino_, (int)oldlen, oldname, (int)newlen, newname);
+    JournalScope txn(fs_->bc_);
     assert(oldlen <= kMinfsMaxNameSize);
     assert(memchr(oldname, '/', oldlen) == NULL);
     assert(newlen <= kMinfsMaxNameSize);
@@ -1401,6 +1709,7 @@ mx_status_t VnodeMinfs::Rename(mxtl::RefPtr<fs::Vnode> _newdir, const char* oldn
 
 mx_status_t VnodeMinfs::Link(const char* name, size_t len, mxtl::RefPtr<fs::Vnode> _target) {
     trace(MINFS, "minfs_link() vndir=%p(#%u) name='%.*s'\n", this, ino_, (int)len, name);
+    JournalScope txn(fs_->bc_);
     assert(len <= kMinfsMaxNameSize);
     assert(memchr(name, '/', len) == NULL);
     if (!IsDirectory()) {
@@ -1445,6 +1754,12 @@ mx_status_t VnodeMinfs::Link(const char* name, size_t len, mxtl::RefPtr<fs::Vnod
 }
 
 mx_status_t VnodeMinfs::Sync() {
+#ifdef __Fuchsia__
+    mx_status_t status;
+    if ((status = FlushWrites()) != NO_ERROR) {
+        return status;
+    }
+#endif
     return fs_->bc_->Sync();
 }
 
@@ -5,9 +5,12 @@
 #pragma once
 
 #include <mxtl/algorithm.h>
+#include <mxtl/intrusive_double_list.h>
 #include <mxtl/intrusive_hash_table.h>
 #include <mxtl/intrusive_single_list.h>
+#include <mxtl/intrusive_wavl_tree.h>
 #include <mxtl/macros.h>
+#include <mxtl/mutex.h>
 #include <mxtl/ref_ptr.h>
 #include <mxtl/unique_ptr.h>
 
@@ -30,11 +33,115 @@ constexpr uint32_t kMxFsSyncMtime   = (1<<0);
 constexpr uint32_t kMxFsSyncCtime   = (1<<1);
 
 constexpr uint32_t kMinfsBlockCacheSize = 64;
+// Number of blocks in the VMO shared with the block device, which bounds
+// how many blocks a single raw multi-block transfer moves at once
+constexpr uint32_t kMinfsFifoBlocks = 64;
+// Length of the free run a file's first block (or the first block after a
+// hole) is placed at, so the blocks that follow can be allocated next to it
+constexpr uint32_t kMinfsAllocRun = 8;
+// Readahead window for sequential reads, in blocks. It starts at the minimum
+// and doubles on every sequential read, up to one full block FIFO transfer.
+constexpr uint32_t kMinfsReadaheadMin = 4;
+constexpr uint32_t kMinfsReadaheadMax = kMinfsFifoBlocks;
+// Size given to the metadata journal by mkfs, in blocks, and the smallest
+// journal that can be used: the info block and room for one full record
+constexpr uint32_t kMinfsJournalBlocks = 128;
+constexpr uint32_t kMinfsJournalMinBlocks = kMinfsFifoBlocks + 1;
+// Most blocks in one journal record; a record and its header go down in a
+// single block FIFO transfer
+constexpr uint32_t kMinfsJournalTxnBlocks = kMinfsFifoBlocks - 1;
+// Once the outermost transaction ends, the running record is committed if
+// it holds this many blocks, or if this long has passed since the last commit
+constexpr uint32_t kMinfsJournalCommitBlocks = kMinfsJournalTxnBlocks / 2;
+constexpr mx_time_t kMinfsJournalCommitInterval = MX_SEC(1);
+static_assert(kMinfsJournalTxnBlocks <= kMinfsJournalRecordMax,
+              "Journal records must fit their header");
 
 // Used by fsck
 struct CheckMaps {
     RawBitmap checked_inodes;
     RawBitmap checked_blocks;
+    // The whole inode table, read in once up front
+    const void* inode_table;
+    // Report how far along the check is, every tenth of the allocated inodes
+    bool progress;
+    uint32_t inodes_allocated;
+    uint32_t inodes_checked;
+};
+
+// Write-ahead log of the metadata blocks written through Bcache.
+//
+// Blocks written while it is attached are gathered into a running record,
+// and kept in memory as the latest copy of each block. A commit writes the
+// record to the log as one sequential write. The blocks only go to their
+// place on disk at a checkpoint, when the log runs low on space (or at
+// Close), which then starts the log over.
+class Journal {
+public:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(Journal);
+
+    // Replay whatever the log at [start, start + blocks) holds, then start
+    // a new one there.
+    static mx_status_t Create(Bcache* bc, uint32_t start, uint32_t blocks,
+                              mxtl::unique_ptr<Journal>* out);
+    ~Journal();
+
+    // Is a copy of 'bno' held by the journal?
+    bool Contains(uint32_t bno) const;
+    // Copy out the journal's copy of 'bno', if it has one.
+    bool Lookup(uint32_t bno, void* data) const;
+    // Add 'bno' to the running record.
+    mx_status_t Log(uint32_t bno, const void* data);
+
+    // Transactions nest; the running record is only committed on its own
+    // once the outermost one ends.
+    void Begin() { depth_++; }
+    mx_status_t End();
+
+    // Write the running record to the log.
+    mx_status_t Commit();
+    // Commit, write every logged block in place, and empty the log.
+    mx_status_t Checkpoint();
+
+private:
+    struct Entry : public mxtl::SinglyLinkedListable<mxtl::unique_ptr<Entry>> {
+        uint32_t GetKey() const { return bno; }
+        static size_t GetHash(uint32_t key) { return fnv1a_tiny(key, kMinfsHashBits); }
+
+        uint32_t bno;
+        bool running;
+        uint8_t data[kMinfsBlockSize];
+    };
+
+    Journal(Bcache* bc, uint32_t start, uint32_t blocks);
+    mx_status_t Replay();
+    mx_status_t WriteInfo();
+
+    Bcache* bc_;
+    uint32_t start_;
+    uint32_t blocks_;
+    uint32_t next_;         // log block the next record is written at
+    uint64_t seq_;          // sequence number of the next record
+    uint32_t depth_;
+    mx_time_t last_commit_;
+    // staging area for one record, header included
+    mxtl::unique_ptr<uint8_t[]> buf_;
+    using HashTable = mxtl::HashTable<uint32_t, mxtl::unique_ptr<Entry>>;
+    HashTable entries_;
+    uint32_t running_count_;
+    uint32_t running_[kMinfsJournalTxnBlocks];
+};
+
+// Groups the metadata updates made while it is in scope into one journal
+// transaction.
+class JournalScope {
+public:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(JournalScope);
+    explicit JournalScope(Bcache* bc) : bc_(bc) { bc_->TxnBegin(); }
+    ~JournalScope() { bc_->TxnEnd(); }
+
+private:
+    Bcache* bc_;
 };
 
 class VnodeMinfs;
@@ -64,6 +171,19 @@ public:
     // free ino in inode bitmap, release all blocks held by inode
     mx_status_t InoFree(const minfs_inode_t& inode, uint32_t ino);
 
+    // Extent mapped inodes (kMinfsInodeFlagExtents):
+    // Look up the disk block backing logical block 'n', or 0 for a hole.
+    mx_status_t ExtentLookup(const minfs_inode_t* inode, uint32_t n, uint32_t* bno_out) const;
+    // Map the unmapped logical block 'n' to the newly allocated disk block 'bno'.
+    mx_status_t ExtentInsert(minfs_inode_t* inode, uint32_t n, uint32_t bno);
+    // Release every block mapped at or past logical block 'start', along with
+    // any extent blocks left empty. Does not write back the inode.
+    mx_status_t ExtentShrink(minfs_inode_t* inode, uint32_t start);
+
+    // Find the start of a free run of 'len' data blocks, for a file to grow
+    // into contiguously. Returns 0 if there is no such run.
+    uint32_t BlockRunHint(uint32_t len) const;
+
     // Writes back an inode into the inode table on persistent storage.
     // Does not modify inode bitmap.
     mx_status_t InodeSync(uint32_t ino, const minfs_inode_t* inode);
@@ -80,6 +200,10 @@ public:
     void BitmapBlockPut(const mxtl::RefPtr<BlockNode>& blk);
 
     mx_status_t AddDispatcher(mx_handle_t h, vfs_iostate_t* cookie);
+#ifdef __Fuchsia__
+    pthread_rwlock_t* DispatchLock() { return &dispatch_lock_; }
+    fs::LookupCache* GetLookupCache() { return &lookup_cache_; }
+#endif
 
     Bcache* bc_;
     RawBitmap block_map_;
@@ -88,14 +212,22 @@ public:
 private:
     // Fsck can introspect Minfs
     friend mx_status_t check_inode(CheckMaps*, const Minfs*, uint32_t, uint32_t);
-    friend mx_status_t minfs_check(Bcache*);
+    friend mx_status_t minfs_check(Bcache*, bool);
     Minfs(Bcache* bc_, minfs_info_t* info_);
     // Find a free inode, allocate it in the inode bitmap, and write it back to disk
     mx_status_t InoNew(const minfs_inode_t* inode, uint32_t* ino_out);
     mx_status_t LoadBitmaps();
+    // Release the blocks [bno, bno + count) in the block bitmap, see BitmapBlockGet.
+    mx_status_t BlockRangeFree(uint32_t bno, uint32_t count, mxtl::RefPtr<BlockNode>* bitmap_blk);
+    mx_status_t ExtentTrim(minfs_inode_t* inode, minfs_extent_t* ext, uint32_t* count,
+                           uint32_t start, mxtl::RefPtr<BlockNode>* bitmap_blk);
 
 #ifdef __Fuchsia__
     mxtl::unique_ptr<fs::VfsDispatcher> dispatcher_;
+    // Held around every message to the filesystem (see
+    // fs::Vnode::DispatchLock): shared by reads, which only go as far as
+    // filling vnode VMOs through the block cache, exclusively by the rest.
+    pthread_rwlock_t dispatch_lock_;
 #endif
     uint32_t abmblks_;
     uint32_t ibmblks_;
@@ -107,6 +239,11 @@ private:
     // when the Vnode is deleted, it is immediately removed from the map.
     using HashTable = mxtl::HashTable<uint32_t, VnodeMinfs*>;
     HashTable vnode_hash_;
+#ifdef __Fuchsia__
+    // Directories only change through the Vfs operations, so path walks can
+    // skip searching them (see fs::Vnode::GetLookupCache).
+    fs::LookupCache lookup_cache_;
+#endif
 };
 
 struct DirArgs {
@@ -125,11 +262,101 @@ struct DirectoryOffset {
 #define INO_HASH(ino) fnv1a_tiny(ino, kMinfsHashBits)
 
 constexpr uint32_t kMinfsFlagDeletedDirectory = 0x00010000;
+// Set once building a DirentCache for the directory failed; it is scanned
+// linearly from then on
+constexpr uint32_t kMinfsFlagNoDirentCache    = 0x00020000;
 constexpr uint32_t kMinfsFlagReservedMask     = 0xFFFF0000;
 
 static_assert((kMinfsFlagReservedMask & V_FLAG_RESERVED_MASK) == 0,
               "MinFS should not be using any Vnode flags which are reserved");
 
+// Directories at least this large get a DirentCache
+constexpr uint32_t kMinfsDirentCacheMinSize = 4 * kMinfsBlockSize;
+constexpr size_t kMinfsDirentCacheBuckets = 4099;
+
+// An in-memory index of the records of a directory, letting directory
+// operations go straight to the record they need rather than scanning every
+// dirent from the start. The on-disk format stays the same linear list.
+//
+// Every record in the directory, used or free, is kept, sorted by offset;
+// used records can be found by a hash of their name, and records with
+// room to spare for another dirent are kept on a list of their own.
+class DirentCache {
+public:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(DirentCache);
+
+    struct Record {
+        uint32_t off;       // offset of the record in the directory
+        uint32_t size;      // reclen, MinfsReclen() for the last record
+        uint32_t used;      // DirentSize() of the dirent, 0 if it is free
+        uint64_t hash;      // hash of the name, if used
+
+        uint32_t GetKey() const { return off; }
+        uint32_t Spare() const { return size - used; }
+
+    private:
+        friend class DirentCache;
+        using TreeState = mxtl::WAVLTreeNodeState<mxtl::unique_ptr<Record>>;
+        using ListState = mxtl::DoublyLinkedListNodeState<Record*>;
+        struct NameListTraits {
+            static ListState& node_state(Record& r) { return r.name_state_; }
+        };
+        struct SpareListTraits {
+            static ListState& node_state(Record& r) { return r.spare_state_; }
+        };
+        struct TreeTraits {
+            static TreeState& node_state(Record& r) { return r.tree_state_; }
+        };
+        struct NameKeyTraits {
+            static uint64_t GetKey(const Record& r) { return r.hash; }
+            static bool LessThan(uint64_t k1, uint64_t k2) { return k1 < k2; }
+            static bool EqualTo(uint64_t k1, uint64_t k2) { return k1 == k2; }
+        };
+        struct NameHashTraits {
+            static size_t GetHash(uint64_t key) { return key % kMinfsDirentCacheBuckets; }
+        };
+
+        TreeState tree_state_;
+        ListState name_state_;
+        ListState spare_state_;
+    };
+
+    DirentCache() {}
+    ~DirentCache();
+
+    static uint64_t NameHash(const char* name, size_t len) { return fnv1a64(name, len); }
+
+    // Add the record at 'off'. Returns ERR_ALREADY_EXISTS if another used
+    // record's name has the same hash; the cache can't be used then.
+    mx_status_t Insert(uint32_t off, uint32_t size, uint32_t used, uint64_t hash);
+    // Forget the records starting in [start, end).
+    void Erase(uint32_t start, uint32_t end);
+
+    // The used record whose name hashes to 'hash', if any.
+    const Record* FindName(uint64_t hash) const;
+    // A record with at least 'len' bytes to spare, if any.
+    const Record* FindSpare(uint32_t len) const;
+    // The records either side of the one at 'off', if any.
+    const Record* Prev(uint32_t off) const;
+    const Record* Next(uint32_t off) const;
+
+private:
+    using Tree = mxtl::WAVLTree<uint32_t, mxtl::unique_ptr<Record>,
+                                mxtl::DefaultKeyedObjectTraits<uint32_t, Record>,
+                                Record::TreeTraits>;
+    using NameList = mxtl::DoublyLinkedList<Record*, Record::NameListTraits>;
+    using NameTable = mxtl::HashTable<uint64_t, Record*, NameList, size_t,
+                                      kMinfsDirentCacheBuckets, Record::NameKeyTraits,
+                                      Record::NameHashTraits>;
+    using SpareList = mxtl::DoublyLinkedList<Record*, Record::SpareListTraits>;
+
+    void Remove(Record* r);
+
+    Tree records_;
+    NameTable names_;
+    SpareList spare_;
+};
+
 class VnodeMinfs final : public fs::Vnode, public mxtl::SinglyLinkedListable<VnodeMinfs*> {
 public:
     // Allocates a Vnode and initializes the inode given the type.
@@ -153,6 +380,10 @@ public:
     mx_status_t WriteInternal(const void* data, size_t len, size_t off, size_t* actual);
     mx_status_t WriteExactInternal(const void* data, size_t len, size_t off);
     mx_status_t TruncateInternal(size_t len);
+#ifdef __Fuchsia__
+    // Write the blocks queued by write-behind out to disk
+    mx_status_t FlushWrites();
+#endif
     ssize_t Ioctl(uint32_t op, const void* in_buf, size_t in_len, void* out_buf,
                   size_t out_len) final;
     mx_status_t Lookup(mxtl::RefPtr<fs::Vnode>* out, const char* name, size_t len) final;
@@ -176,6 +407,8 @@ private:
     mx_status_t Getattr(vnattr_t* a) final;
     mx_status_t Setattr(vnattr_t* a) final;
     mx_status_t Readdir(void* cookie, void* dirents, size_t len) final;
+    mx_status_t ReaddirPlus(void* cookie, void* dirents, size_t len) final;
+    mx_status_t ReaddirInternal(void* cookie, void* dirents, size_t len, bool attrs);
     mx_status_t Create(mxtl::RefPtr<fs::Vnode>* out, const char* name, size_t len, uint32_t mode) final;
     mx_status_t Unlink(const char* name, size_t len, bool must_be_dir) final;
     mx_status_t Rename(mxtl::RefPtr<fs::Vnode> newdir,
@@ -189,12 +422,24 @@ private:
 
     mx_status_t InitVmo();
 
-    // Read data from disk at block 'bno', into the 'nth' logical block of the file.
-    mx_status_t FillBlock(uint32_t n, uint32_t bno);
+#ifdef __Fuchsia__
+    // Make sure the logical blocks [0, end) of the file are present in the VMO
+    mx_status_t EnsureLoaded(uint32_t end);
+
+    // Queue the 'nth' logical block, backed by disk block 'bno', to be written
+    // from the VMO to disk later
+    mx_status_t QueueWrite(uint32_t n, uint32_t bno);
+#endif
+
+    // Read the disk blocks 'bnos' into the logical blocks 'ns' of the file's VMO
+    mx_status_t FillBlocks(const uint32_t* ns, const uint32_t* bnos, uint32_t count);
 
     // Get the disk block 'bno' corresponding to the 'nth' logical block of the file.
     // Allocate the block if reqeusted.
     mx_status_t GetBno(uint32_t n, uint32_t* bno, bool alloc);
+    mx_status_t GetBnoExtent(uint32_t n, uint32_t* bno, bool alloc);
+    // Pick where to allocate a block, given the disk block of the one before it (or 0)
+    uint32_t AllocHint(uint32_t prev_bno);
 
     // Deletes all blocks (relateive to a file) from "start" (inclusive) to the end
     // of the file. Does not update mtime/atime.
@@ -204,12 +449,23 @@ private:
     void InodeSync(uint32_t flags);
 
     // Directories only
-    mx_status_t ForEachDirent(DirArgs* args,
-                              mx_status_t (*func)(mxtl::RefPtr<VnodeMinfs>, minfs_dirent_t*, DirArgs*,
-                                                  DirectoryOffset*));
+    using DirentCallback = mx_status_t (*)(mxtl::RefPtr<VnodeMinfs>, minfs_dirent_t*, DirArgs*,
+                                           DirectoryOffset*);
+    mx_status_t ForEachDirent(DirArgs* args, DirentCallback func);
+    // Used by ForEachDirent once the directory has a DirentCache: calls
+    // 'func' on the one record it is looking for, then reloads the records
+    // around it if they changed.
+    mx_status_t ForEachDirentCached(DirArgs* args, DirentCallback func);
+    // Build the directory's DirentCache, if it is large enough to want one.
+    void DirentCacheInit();
+    // (Re)read the records in [start, end) of the directory into the cache.
+    mx_status_t DirentCacheLoad(uint32_t start, uint32_t end);
+    mxtl::unique_ptr<DirentCache> dirent_cache_;
 
 #ifdef __Fuchsia__
     mx_status_t AddDispatcher(mx_handle_t h, vfs_iostate_t* cookie) final;
+    pthread_rwlock_t* DispatchLock() final { return fs_->DispatchLock(); }
+    fs::LookupCache* GetLookupCache() final { return fs_->GetLookupCache(); }
 
     // The following functionality interacts with handles directly, and are not applicable outside
     // Fuchsia (since there is no "handle-equivalent" in host-side tools).
@@ -219,6 +475,22 @@ private:
     // avoid reading the entire file up-front. Until then, read the contents of
     // a VMO into memory when it is read/written.
     mx_handle_t vmo_;
+    // Reads only hold the dispatch lock shared; this serializes them while
+    // they set up and fill the VMO, and move the readahead window. Everything
+    // else is already serialized by the dispatch lock.
+    mxtl::Mutex vmo_lock_;
+    // Logical blocks [0, vmo_loaded_) of the file have been read into vmo_.
+    uint32_t vmo_loaded_;
+
+    // Where the previous read ended, and the current readahead window (in blocks).
+    size_t last_read_end_;
+    uint32_t readahead_;
+
+    // Write-behind queue: logical blocks whose up to date contents are in vmo_,
+    // and the disk blocks they still need to be written to.
+    uint32_t dirty_count_;
+    uint32_t dirty_n_[kMinfsFifoBlocks];
+    uint32_t dirty_bno_[kMinfsFifoBlocks];
 
 #endif
     // The vnode is acting as a mount point for a remote filesystem or device.
@@ -239,7 +511,7 @@ void minfs_dump_info(minfs_info_t* info);
 int minfs_mkfs(Bcache* bc);
 
 mx_status_t check_inode(CheckMaps*, const Minfs*, uint32_t, uint32_t);
-mx_status_t minfs_check(Bcache* bc);
+mx_status_t minfs_check(Bcache* bc, bool progress);
 
 mx_status_t minfs_mount(mxtl::RefPtr<VnodeMinfs>* root_out, Bcache* bc);
 
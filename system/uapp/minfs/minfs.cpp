@@ -37,6 +37,9 @@ void minfs_dump_info(minfs_info_t* info) {
     printf("minfs: inode bitmap @ %10u\n", info->ibm_block);
     printf("minfs: alloc bitmap @ %10u\n", info->abm_block);
     printf("minfs: inode table  @ %10u\n", info->ino_block);
+    if (info->jnl_blocks > 0) {
+        printf("minfs: journal      @ %10u (%u blocks)\n", info->jnl_block, info->jnl_blocks);
+    }
     printf("minfs: data blocks  @ %10u\n", info->dat_block);
 }
 
@@ -46,7 +49,7 @@ mx_status_t minfs_check_info(minfs_info_t* info, uint32_t max) {
         error("minfs: bad magic\n");
         return ERR_INVALID_ARGS;
     }
-    if (info->version != kMinfsVersion) {
+    if ((info->version != kMinfsVersion) && (info->version != kMinfsVersionBlockMap)) {
         error("minfs: FS Version: %08x. Driver version: %08x\n", info->version,
               kMinfsVersion);
         return ERR_INVALID_ARGS;
@@ -60,6 +63,13 @@ mx_status_t minfs_check_info(minfs_info_t* info, uint32_t max) {
         error("minfs: too large for device\n");
         return ERR_INVALID_ARGS;
     }
+    if ((info->jnl_blocks > 0) &&
+        ((info->jnl_blocks < kMinfsJournalMinBlocks) || (info->jnl_block < info->ino_block) ||
+         (info->jnl_block + info->jnl_blocks > info->dat_block))) {
+        error("minfs: journal at %u (%u blocks) outside metadata area\n",
+              info->jnl_block, info->jnl_blocks);
+        return ERR_INVALID_ARGS;
+    }
     //TODO: validate layout
     return 0;
 }
@@ -84,6 +94,9 @@ mx_status_t Minfs::InodeSync(uint32_t ino, const minfs_inode_t* inode) {
 
 Minfs::Minfs(Bcache* bc, minfs_info_t* info) : bc_(bc) {
     memcpy(&info_, info, sizeof(minfs_info_t));
+#ifdef __Fuchsia__
+    pthread_rwlock_init(&dispatch_lock_, nullptr);
+#endif
 }
 
 mx_status_t Minfs::InoFree(const minfs_inode_t& inode, uint32_t ino) {
@@ -105,6 +118,11 @@ mx_status_t Minfs::InoFree(const minfs_inode_t& inode, uint32_t ino) {
     memcpy(block_ibm->data(), bmdata, kMinfsBlockSize);
     bc_->Put(block_ibm, kBlockDirty);
 
+    if (inode.flags & kMinfsInodeFlagExtents) {
+        minfs_inode_t copy = inode;
+        return ExtentShrink(&copy, 0);
+    }
+
     mxtl::RefPtr<BlockNode> bitmap_blk;
 
     // release all direct blocks
@@ -377,6 +395,12 @@ mx_status_t Minfs::Create(Minfs** out, Bcache* bc, minfs_info_t* info) {
         return status;
     }
 
+    // Replay the journal before reading any metadata it may cover
+    if ((info->jnl_blocks > 0) &&
+        ((status = bc->JournalInit(info->jnl_block, info->jnl_blocks)) != NO_ERROR)) {
+        return status;
+    }
+
     if ((status = fs->LoadBitmaps()) < 0) {
         return status;
     }
@@ -390,12 +414,8 @@ mx_status_t Minfs::Create(Minfs** out, Bcache* bc, minfs_info_t* info) {
         return status;
     }
 
-    for (uint32_t n = 0; n < inoblks; n++) {
-        void* bmdata = (void*)((uintptr_t)(fs->inode_table_->GetData()) +
-                               (uintptr_t)(kMinfsBlockSize * n));
-        if (fs->bc_->Readblk(fs->info_.ino_block + n, bmdata)) {
-            error("minfs: failed reading inode table\n");
-        }
+    if (fs->bc_->ReadblkRun(fs->info_.ino_block, inoblks, fs->inode_table_->GetData())) {
+        error("minfs: failed reading inode table\n");
     }
 #endif
 
@@ -404,18 +424,14 @@ mx_status_t Minfs::Create(Minfs** out, Bcache* bc, minfs_info_t* info) {
 }
 
 mx_status_t Minfs::LoadBitmaps() {
-    for (uint32_t n = 0; n < abmblks_; n++) {
-        void* bmdata = GetBlock(block_map_, n);
-        if (bc_->Readblk(info_.abm_block + n, bmdata)) {
-            error("minfs: failed reading alloc bitmap\n");
-        }
+    if (bc_->ReadblkRun(info_.abm_block, abmblks_, GetBlock(block_map_, 0))) {
+        error("minfs: failed reading alloc bitmap\n");
     }
-    for (uint32_t n = 0; n < ibmblks_; n++) {
-        void* bmdata = GetBlock(inode_map_, n);
-        if (bc_->Readblk(info_.ibm_block + n, bmdata)) {
-            error("minfs: failed reading inode bitmap\n");
-        }
+    if (bc_->ReadblkRun(info_.ibm_block, ibmblks_, GetBlock(inode_map_, 0))) {
+        error("minfs: failed reading inode bitmap\n");
     }
+    block_map_.RebuildSummary();
+    inode_map_.RebuildSummary();
     return NO_ERROR;
 }
 
@@ -447,7 +463,17 @@ mx_status_t minfs_mount(mxtl::RefPtr<VnodeMinfs>* out, Bcache* bc) {
 
 mx_status_t Minfs::Unmount() {
 #ifdef __Fuchsia__
+    // Unmount runs under the dispatch lock, which workers may be waiting on;
+    // let go of it while the pool finishes up, and its connections close.
+    pthread_rwlock_unlock(&dispatch_lock_);
     dispatcher_ = nullptr;
+    pthread_rwlock_wrlock(&dispatch_lock_);
+    // Write back anything still queued by open vnodes
+    for (auto& vn : vnode_hash_) {
+        if (vn.FlushWrites() != NO_ERROR) {
+            error("minfs: failed to write back vnode #%u on unmount\n", vn.GetKey());
+        }
+    }
 #endif
     return bc_->Close();
 }
@@ -490,7 +516,13 @@ int minfs_mkfs(Bcache* bc) {
     info.ibm_block = 8;
     info.abm_block = info.ibm_block + mxtl::roundup(ibmblks, 8u);
     info.ino_block = info.abm_block + mxtl::roundup(abmblks, 8u);
-    info.dat_block = info.ino_block + inoblks;
+    // The metadata journal follows the inode table, unless the volume is too
+    // small to spare the space
+    info.jnl_block = info.ino_block + inoblks;
+    if (blocks >= kMinfsJournalBlocks * 16) {
+        info.jnl_blocks = kMinfsJournalBlocks;
+    }
+    info.dat_block = info.jnl_block + info.jnl_blocks;
     minfs_dump_info(&info);
 
     RawBitmap abm;
@@ -557,6 +589,17 @@ int minfs_mkfs(Bcache* bc) {
         bc->Put(blk, kBlockDirty);
     }
 
+    // write an empty journal
+    for (uint32_t n = 0; n < info.jnl_blocks; n++) {
+        blk = bc->GetZero(info.jnl_block + n);
+        if (n == 0) {
+            minfs_journal_info_t* ji = static_cast<minfs_journal_info_t*>(blk->data());
+            ji->magic = kMinfsJournalMagic;
+            ji->seq = 1;
+        }
+        bc->Put(blk, kBlockDirty);
+    }
+
     // setup root inode
     blk = bc->Get(info.ino_block);
     minfs_inode_t* ino = (minfs_inode_t*) blk->data();
@@ -565,7 +608,12 @@ int minfs_mkfs(Bcache* bc) {
     ino[kMinfsRootIno].block_count = 1;
     ino[kMinfsRootIno].link_count = 1;
     ino[kMinfsRootIno].dirent_count = 2;
-    ino[kMinfsRootIno].dnum[0] = info.dat_block;
+    ino[kMinfsRootIno].flags = kMinfsInodeFlagExtents;
+    ino[kMinfsRootIno].extent_count = 1;
+    minfs_extent_t* ext = MinfsInodeExtents(&ino[kMinfsRootIno]);
+    ext[0].start = 0;
+    ext[0].count = 1;
+    ext[0].bno = info.dat_block;
     bc->Put(blk, kBlockDirty);
 
     blk = bc->GetZero(0);
@@ -6,15 +6,23 @@
 
 #include <bitmap/raw-bitmap.h>
 #include <bitmap/storage.h>
+#include <bitmap/summary-bitmap.h>
 #include <mxtl/intrusive_double_list.h>
 #include <mxtl/intrusive_hash_table.h>
 #include <mxtl/macros.h>
+#include <mxtl/mutex.h>
 #include <mxtl/ref_counted.h>
 #include <mxtl/ref_ptr.h>
 #include <mxtl/unique_free_ptr.h>
+#include <mxtl/unique_ptr.h>
 
 #include <magenta/types.h>
 
+#ifdef __Fuchsia__
+#include <block-client/client.h>
+#include <fs/mapped-vmo.h>
+#endif
+
 #include <assert.h>
 #include <limits.h>
 #include <stdint.h>
@@ -22,10 +30,12 @@
 
 #include "misc.h"
 
+// The allocation bitmaps keep a summary in memory so allocating on a nearly
+// full disk doesn't have to walk the whole map.
 #ifdef __Fuchsia__
-using RawBitmap = bitmap::RawBitmapGeneric<bitmap::VmoStorage>;
+using RawBitmap = bitmap::SummaryBitmapGeneric<bitmap::VmoStorage>;
 #else
-using RawBitmap = bitmap::RawBitmapGeneric<bitmap::DefaultStorage>;
+using RawBitmap = bitmap::SummaryBitmapGeneric<bitmap::DefaultStorage>;
 #endif
 
 // clang-format off
@@ -34,7 +44,10 @@ namespace minfs {
 
 constexpr uint64_t kMinfsMagic0 = (0x002153466e694d21ULL);
 constexpr uint64_t kMinfsMagic1 = (0x385000d3d3d3d304ULL);
-constexpr uint32_t kMinfsVersion = 0x00000002;
+constexpr uint32_t kMinfsVersion = 0x00000003;
+// Volumes of this version are still mounted, but their inodes only ever use
+// direct and indirect block pointers, so older drivers can keep reading them.
+constexpr uint32_t kMinfsVersionBlockMap = 0x00000002;
 
 constexpr uint32_t kMinfsRootIno        = 1;
 constexpr uint32_t kMinfsFlagClean      = 1;
@@ -51,6 +64,10 @@ constexpr uint32_t kMinfsIndirect = 32;
 constexpr uint64_t kMinfsMaxFileBlock = (kMinfsDirect + kMinfsIndirect * (kMinfsBlockSize / sizeof(uint32_t)));
 constexpr uint64_t kMinfsMaxFileSize  = kMinfsMaxFileBlock * kMinfsBlockSize;
 
+// files mapped by extents are only limited by the 32 bit inode size
+constexpr uint64_t kMinfsMaxExtentFileBlock = (UINT32_MAX / kMinfsBlockSize);
+constexpr uint64_t kMinfsMaxExtentFileSize  = kMinfsMaxExtentFileBlock * kMinfsBlockSize;
+
 constexpr uint32_t kMinfsTypeFile = 8;
 constexpr uint32_t kMinfsTypeDir  = 4;
 
@@ -72,6 +89,8 @@ typedef struct {
     uint32_t abm_block;     // first blockno of block allocation bitmap
     uint32_t ino_block;     // first blockno of inode table
     uint32_t dat_block;     // first blockno available for file data
+    uint32_t jnl_block;     // first blockno of the metadata journal
+    uint32_t jnl_blocks;    // size of the journal, 0 if there is none
 } minfs_info_t;
 
 // Notes:
@@ -87,6 +106,23 @@ typedef struct {
 //     ino_block + ino / kMinfsInodesPerBlock
 //   at offset: ino % kMinfsInodesPerBlock
 // - inode 0 is never used, should be marked allocated but ignored
+// - the journal, if any, sits between the inode table and the data blocks
+
+// A run of 'count' logical blocks of a file, starting at 'start', stored on
+// disk at blocks [bno, bno + count).
+typedef struct {
+    uint32_t start;
+    uint32_t count;
+    uint32_t bno;
+} minfs_extent_t;
+
+constexpr uint32_t kMinfsInlineExtents =
+    (kMinfsDirect + kMinfsIndirect) * sizeof(uint32_t) / sizeof(minfs_extent_t);
+constexpr uint32_t kMinfsExtentsPerBlock = (kMinfsBlockSize / sizeof(minfs_extent_t));
+
+// inode flags
+constexpr uint32_t kMinfsInodeFlagExtents     = 0x00000001; // block map is an extent tree
+constexpr uint32_t kMinfsInodeFlagExtentIndex = 0x00000002; // inline extents index extent blocks
 
 typedef struct {
     uint32_t magic;
@@ -98,13 +134,63 @@ typedef struct {
     uint32_t seq_num;               // bumped when modified
     uint32_t gen_num;               // bumped when deleted
     uint32_t dirent_count;          // for directories
-    uint32_t rsvd[5];
+    uint32_t flags;                 // kMinfsInodeFlag*
+    uint32_t extent_count;          // inline extents in use
+    uint32_t rsvd[3];
     uint32_t dnum[kMinfsDirect];    // direct blocks
     uint32_t inum[kMinfsIndirect];  // indirect blocks
 } minfs_inode_t;
 
 static_assert(sizeof(minfs_inode_t) == kMinfsInodeSize,
               "minfs inode size is wrong");
+static_assert(kMinfsInlineExtents * sizeof(minfs_extent_t) <=
+              sizeof(minfs_inode_t::dnum) + sizeof(minfs_inode_t::inum),
+              "minfs inline extents overflow the block map");
+
+// Notes on extent mapped inodes (kMinfsInodeFlagExtents):
+// - the dnum and inum arrays are reused to hold 'extent_count' inline extents,
+//   sorted by start and not overlapping
+// - with kMinfsInodeFlagExtentIndex set, each inline extent instead describes
+//   an extent block: 'bno' is the block, 'count' the number of (sorted) extents
+//   it holds, and 'start' the first logical block they map
+// - extent blocks are included in the inode's block_count
+inline minfs_extent_t* MinfsInodeExtents(minfs_inode_t* inode) {
+    return reinterpret_cast<minfs_extent_t*>(inode->dnum);
+}
+inline const minfs_extent_t* MinfsInodeExtents(const minfs_inode_t* inode) {
+    return reinterpret_cast<const minfs_extent_t*>(inode->dnum);
+}
+
+inline uint64_t MinfsMaxFileBlock(const minfs_inode_t* inode) {
+    return (inode->flags & kMinfsInodeFlagExtents) ? kMinfsMaxExtentFileBlock : kMinfsMaxFileBlock;
+}
+
+// Metadata journal:
+// - block 0 of the journal holds a minfs_journal_info_t
+// - the log follows it: a sequence of records, each a minfs_journal_header_t
+//   block followed by the 'count' blocks it lists, which belong at 'bno'
+// - records are numbered; the first one has the info block's 'seq', and
+//   the log ends at the first record with the wrong magic, sequence number,
+//   or checksum
+// - replaying the log writes the blocks of each record in place, in order
+constexpr uint64_t kMinfsJournalMagic       = (0x6c6e724a53466e4dULL);
+constexpr uint64_t kMinfsJournalRecordMagic = (0x6463724a53466e4dULL);
+
+typedef struct {
+    uint64_t magic;
+    uint64_t seq;                   // sequence number of the first record
+} minfs_journal_info_t;
+
+typedef struct {
+    uint64_t magic;
+    uint64_t seq;
+    uint32_t count;                 // blocks in the record
+    uint32_t checksum;              // fnv1a32 of those blocks
+    uint32_t bno[];
+} minfs_journal_header_t;
+
+constexpr uint32_t kMinfsJournalRecordMax =
+    (kMinfsBlockSize - sizeof(minfs_journal_header_t)) / sizeof(uint32_t);
 
 typedef struct {
     uint32_t ino;                   // inode number
@@ -161,6 +247,7 @@ static_assert(kMinfsMaxDirectorySize <= kMinfsReclenMask,
 
 // Block Cache (bcache.c)
 class Bcache;
+class Journal;
 
 // Flag denoting if a block is dirty or not
 constexpr uint32_t kBlockDirty = 0x01;
@@ -238,10 +325,30 @@ public:
                               uint32_t num);
 
     // Raw block read functions.
-    // These do not track blocks (or attempt to access the block cache)
+    // These do not track blocks (or attempt to access the block cache).
+    // Once a journal is attached, Writeblk logs the block to it rather than
+    // writing it in place, and reads see the logged contents.
     mx_status_t Readblk(uint32_t bno, void* data);
     mx_status_t Writeblk(uint32_t bno, const void* data);
 
+    // Raw multi-block functions, moving the blocks listed in 'bnos' to or
+    // from 'count' consecutive blocks at 'data'. Over a block FIFO runs of
+    // adjacent blocks become single requests, batched into as few
+    // transactions as possible. Writeblks is meant for file data, which is
+    // not journaled, and goes straight to disk.
+    mx_status_t Readblks(const uint32_t* bnos, uint32_t count, void* data);
+    mx_status_t Writeblks(const uint32_t* bnos, uint32_t count, const void* data);
+    // Read the 'count' consecutive blocks starting at 'bno', such as a
+    // whole bitmap or the inode table, in as few requests as Readblks can.
+    mx_status_t ReadblkRun(uint32_t bno, uint32_t count, void* data);
+
+    // Replay the journal at [start, start + blocks) and log metadata to it
+    mx_status_t JournalInit(uint32_t start, uint32_t blocks);
+    // Bracket a filesystem operation, so its metadata updates are committed
+    // together. These nest.
+    void TxnBegin();
+    void TxnEnd();
+
     uint32_t Maxblk() const { return blockmax_; };
 
     // acquire a block, reading from disk if necessary,
@@ -268,14 +375,46 @@ public:
     ~Bcache();
 
 private:
+    friend class Journal;
+
     Bcache(int fd, uint32_t blockmax, uint32_t blocksize);
 
     mxtl::RefPtr<BlockNode> Get(uint32_t bno, uint32_t mode);
 
+    // Readblk and Writeblk, for callers already holding lock_
+    mx_status_t ReadblkLocked(uint32_t bno, void* data) __TA_REQUIRES(lock_);
+    mx_status_t WriteblkLocked(uint32_t bno, const void* data) __TA_REQUIRES(lock_);
+
+    // Device I/O, bypassing the journal
+    mx_status_t DevReadblk(uint32_t bno, void* data);
+    mx_status_t DevWriteblk(uint32_t bno, const void* data);
+    mx_status_t DevReadblks(const uint32_t* bnos, uint32_t count, void* data);
+    mx_status_t DevWriteblks(const uint32_t* bnos, uint32_t count, const void* data);
+
+#ifdef __Fuchsia__
+    // Attach a transfer VMO to the block device's FIFO. If this fails the
+    // raw block functions fall back to lseek and read/write on fd_.
+    mx_status_t AttachFifo();
+    // Move the blocks in 'bnos' between the device and the start of the
+    // transfer VMO, count <= kMinfsFifoBlocks.
+    mx_status_t FifoTxn(uint16_t opcode, const uint32_t* bnos, uint32_t count);
+
+    fifo_client_t* fifo_client_ = nullptr;
+    txnid_t txnid_;
+    vmoid_t vmoid_;
+    mxtl::unique_ptr<MappedVmo> fifo_buffer_;
+#endif
+
     using HashTableBucket = mxtl::DoublyLinkedList<mxtl::RefPtr<BlockNode>, BlockNode::TypeHashTraits>;
     using HashTable = mxtl::HashTable<uint32_t, mxtl::RefPtr<BlockNode>, HashTableBucket>;
-    HashTable hash_; // Map of all 'in use' blocks, accessible by bno
-    BcacheLists lists_;
+    // Reads of the filesystem may run on several threads at once, so the
+    // cache, the journal and the device (including its file offset) are
+    // only touched with this held. Blocks between Get and Put belong to the
+    // caller; concurrent readers never need the same one.
+    mxtl::Mutex lock_;
+    HashTable hash_ __TA_GUARDED(lock_); // Map of all 'in use' blocks, accessible by bno
+    BcacheLists lists_ __TA_GUARDED(lock_);
+    mxtl::unique_ptr<Journal> journal_ __TA_GUARDED(lock_);
     int fd_;
     uint32_t blockmax_;
     uint32_t blocksize_;
@@ -0,0 +1,230 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <perfmon/perfmon.h>
+
+#include <magenta/status.h>
+#include <magenta/syscalls.h>
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Counted when no -e is given, as many as there are counters for.
+static const uint32_t default_events[] = {
+    MX_PERFMON_EVENT_CYCLES,
+    MX_PERFMON_EVENT_INSTRUCTIONS,
+    MX_PERFMON_EVENT_CACHE_REFERENCES,
+    MX_PERFMON_EVENT_CACHE_MISSES,
+    MX_PERFMON_EVENT_BRANCHES,
+    MX_PERFMON_EVENT_BRANCH_MISSES,
+};
+
+// Parses a comma separated list of event names into |config|.
+static bool parse_events(char* list, mx_perfmon_config_t* config) {
+    uint32_t n = 0;
+    for (char* name = strtok(list, ","); name != NULL; name = strtok(NULL, ",")) {
+        uint32_t event = perfmon_event_from_name(name);
+        if (event == MX_PERFMON_EVENT_NONE) {
+            fprintf(stderr, "Unknown event: %s\n", name);
+            return false;
+        }
+        if (n == MX_PERFMON_MAX_COUNTERS) {
+            fprintf(stderr, "At most %d events can be counted\n", MX_PERFMON_MAX_COUNTERS);
+            return false;
+        }
+        config->events[n++] = event;
+    }
+    return n > 0;
+}
+
+static void fill_default_events(const mx_perfmon_properties_t* props,
+                                mx_perfmon_config_t* config) {
+    uint32_t n = 0;
+    for (size_t i = 0; i < countof(default_events) && n < props->num_counters; i++) {
+        if (props->events & (1u << default_events[i])) {
+            config->events[n++] = default_events[i];
+        }
+    }
+}
+
+static const uint64_t* find_count(const mx_perfmon_config_t* config,
+                                  const mx_perfmon_counts_t* counts, uint32_t event) {
+    for (uint32_t i = 0; i < MX_PERFMON_MAX_COUNTERS; i++) {
+        if (config->events[i] == event) {
+            return &counts->counts[i];
+        }
+    }
+    return NULL;
+}
+
+// Prints one line per event, and the usual ratios between them when both
+// sides were counted.
+static void print_counts(const mx_perfmon_config_t* config,
+                         const mx_perfmon_counts_t* counts) {
+    const uint64_t* cycles = find_count(config, counts, MX_PERFMON_EVENT_CYCLES);
+    const uint64_t* cache_refs = find_count(config, counts, MX_PERFMON_EVENT_CACHE_REFERENCES);
+    const uint64_t* branches = find_count(config, counts, MX_PERFMON_EVENT_BRANCHES);
+    for (uint32_t i = 0; i < MX_PERFMON_MAX_COUNTERS; i++) {
+        uint32_t event = config->events[i];
+        if (event == MX_PERFMON_EVENT_NONE) {
+            continue;
+        }
+        uint64_t count = counts->counts[i];
+        printf("%18" PRIu64 "  %-18s", count, perfmon_event_name(event));
+        if (event == MX_PERFMON_EVENT_INSTRUCTIONS && cycles && *cycles) {
+            printf(" # %6.2f insns per cycle", (double)count / *cycles);
+        } else if (event == MX_PERFMON_EVENT_CACHE_MISSES && cache_refs && *cache_refs) {
+            printf(" # %6.2f%% of cache refs", 100.0 * count / *cache_refs);
+        } else if (event == MX_PERFMON_EVENT_BRANCH_MISSES && branches && *branches) {
+            printf(" # %6.2f%% of branches", 100.0 * count / *branches);
+        }
+        printf("\n");
+    }
+}
+
+static void print_help(FILE* f) {
+    fprintf(f, "Usage: perfstat [options]\n");
+    fprintf(f, "Counts hardware events, such as cycles and cache misses, across\n");
+    fprintf(f, "the whole system or for one thread.\n");
+    fprintf(f, "Options:\n");
+    fprintf(f, " -e EVENT[,EVENT...]  Events to count (default: as many of\n");
+    fprintf(f, "                      cycles, instructions, cache-references,\n");
+    fprintf(f, "                      cache-misses, branches and branch-misses\n");
+    fprintf(f, "                      as there are counters)\n");
+    fprintf(f, " -d SECONDS           How long to count for (default 1)\n");
+    fprintf(f, " -t KOID              Only count while this thread runs\n");
+    fprintf(f, " -u                   Only count in user mode\n");
+    fprintf(f, " -k                   Only count in kernel mode\n");
+    fprintf(f, " -c                   Show the counts of each cpu too\n");
+    fprintf(f, " -s PERIOD            Also sample every PERIOD occurrences of the\n");
+    fprintf(f, "                      first event into ktrace's sample group\n");
+    fprintf(f, " -l                   List the events this cpu can count\n");
+}
+
+static void print_events(const mx_perfmon_properties_t* props) {
+    printf("Performance monitoring version %u, %u counters of %u bits\n",
+           props->version, props->num_counters, props->counter_width);
+    for (uint32_t event = 1; event < MX_PERFMON_NUM_EVENTS; event++) {
+        if (props->events & (1u << event)) {
+            printf("  %s\n", perfmon_event_name(event));
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    mx_perfmon_config_t config = {};
+    long seconds = 1;
+    long long thread_koid = 0;
+    long long period = 0;
+    bool per_cpu = false;
+    bool list = false;
+    char* events = NULL;
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        char* end;
+        if (!strcmp(arg, "--help")) {
+            print_help(stdout);
+            return 0;
+        } else if (!strcmp(arg, "-e")) {
+            if (++i == argc) {
+                fprintf(stderr, "-e needs a list of events\n");
+                return 1;
+            }
+            events = argv[i];
+        } else if (!strcmp(arg, "-d")) {
+            if (++i == argc || (seconds = strtol(argv[i], &end, 10)) <= 0 || *end != '\0') {
+                fprintf(stderr, "-d needs a positive number\n");
+                return 1;
+            }
+        } else if (!strcmp(arg, "-t")) {
+            if (++i == argc || (thread_koid = strtoll(argv[i], &end, 10)) <= 0 || *end != '\0') {
+                fprintf(stderr, "-t needs a thread koid\n");
+                return 1;
+            }
+        } else if (!strcmp(arg, "-s")) {
+            if (++i == argc || (period = strtoll(argv[i], &end, 10)) <= 0 || *end != '\0') {
+                fprintf(stderr, "-s needs a positive number\n");
+                return 1;
+            }
+        } else if (!strcmp(arg, "-u")) {
+            config.flags |= MX_PERFMON_FLAG_USER;
+        } else if (!strcmp(arg, "-k")) {
+            config.flags |= MX_PERFMON_FLAG_KERNEL;
+        } else if (!strcmp(arg, "-c")) {
+            per_cpu = true;
+        } else if (!strcmp(arg, "-l")) {
+            list = true;
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", arg);
+            print_help(stderr);
+            return 1;
+        }
+    }
+    config.thread_koid = thread_koid;
+    config.sample_period = period;
+
+    mx_handle_t resource;
+    mx_status_t status = perfmon_get_resource(&resource);
+    if (status != NO_ERROR) {
+        fprintf(stderr, "error: cannot get the root resource: %s (%d)\n",
+                mx_status_get_string(status), status);
+        return 1;
+    }
+    mx_perfmon_properties_t props;
+    status = perfmon_get_properties(resource, &props);
+    if (status != NO_ERROR) {
+        fprintf(stderr, "error: no performance counters: %s (%d)\n",
+                mx_status_get_string(status), status);
+        mx_handle_close(resource);
+        return 1;
+    }
+    if (list) {
+        print_events(&props);
+        mx_handle_close(resource);
+        return 0;
+    }
+    if (events != NULL) {
+        if (!parse_events(events, &config)) {
+            mx_handle_close(resource);
+            return 1;
+        }
+    } else {
+        fill_default_events(&props, &config);
+    }
+
+    status = perfmon_start(resource, &config);
+    if (status != NO_ERROR) {
+        fprintf(stderr, "error: cannot start counting: %s (%d)\n",
+                mx_status_get_string(status), status);
+        mx_handle_close(resource);
+        return 1;
+    }
+    mx_nanosleep(mx_deadline_after(MX_SEC(seconds)));
+    perfmon_stop(resource);
+
+    printf("Counts for %ld seconds, %s\n\n", seconds,
+           thread_koid ? "one thread" : "the whole system");
+    mx_perfmon_counts_t counts;
+    status = perfmon_get_counts(resource, MTRACE_PERFMON_ALL_CPUS, &counts);
+    if (status == NO_ERROR) {
+        print_counts(&config, &counts);
+    }
+    for (uint32_t cpu = 0; per_cpu && status == NO_ERROR && cpu < MTRACE_PERFMON_ALL_CPUS; cpu++) {
+        if (perfmon_get_counts(resource, cpu, &counts) != NO_ERROR) {
+            // Past the last cpu.
+            break;
+        }
+        printf("\ncpu %u:\n", cpu);
+        print_counts(&config, &counts);
+    }
+    if (status != NO_ERROR) {
+        fprintf(stderr, "error: cannot read the counts: %s (%d)\n",
+                mx_status_get_string(status), status);
+    }
+    mx_handle_close(resource);
+    return status == NO_ERROR ? 0 : 1;
+}
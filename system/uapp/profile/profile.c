@@ -0,0 +1,303 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// N.B. scripts/fold-samples reads our output, don't break it.
+
+#include <elf.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <link.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <magenta/device/ktrace.h>
+#include <magenta/ktrace.h>
+#include <magenta/status.h>
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/object.h>
+#include <task-utils/walker.h>
+
+#define MAX_BUILDID_SIZE 64
+
+typedef struct {
+    uint32_t pid;
+    uint32_t tid;
+    uint32_t flags;
+    uint32_t num_pcs;
+    uint64_t pcs[KTRACE_SAMPLE_MAX_FRAMES];
+} sample_t;
+
+typedef struct {
+    uint32_t pid;
+    char name[MX_MAX_NAME_LEN];
+} proc_t;
+
+static sample_t* samples;
+static size_t num_samples;
+static size_t samples_capacity;
+
+// Every process named in the trace metadata or seen in a sample.
+static proc_t* procs;
+static size_t num_procs;
+static size_t procs_capacity;
+
+static void add_sample(const ktrace_rec_sample_t* rec, uint32_t num_pcs) {
+    if (num_samples == samples_capacity) {
+        samples_capacity = samples_capacity ? samples_capacity * 2 : 1024;
+        samples = realloc(samples, samples_capacity * sizeof(sample_t));
+    }
+    sample_t* s = &samples[num_samples++];
+    s->pid = rec->pid;
+    s->tid = rec->tid;
+    s->flags = rec->flags;
+    s->num_pcs = num_pcs;
+    memcpy(s->pcs, rec->pcs, num_pcs * sizeof(uint64_t));
+}
+
+static proc_t* find_proc(uint32_t pid) {
+    for (size_t i = 0; i < num_procs; i++) {
+        if (procs[i].pid == pid) {
+            return &procs[i];
+        }
+    }
+    return NULL;
+}
+
+static proc_t* add_proc(uint32_t pid) {
+    proc_t* p = find_proc(pid);
+    if (p == NULL) {
+        if (num_procs == procs_capacity) {
+            procs_capacity = procs_capacity ? procs_capacity * 2 : 64;
+            procs = realloc(procs, procs_capacity * sizeof(proc_t));
+        }
+        p = &procs[num_procs++];
+        p->pid = pid;
+        p->name[0] = 0;
+    }
+    return p;
+}
+
+static void read_samples(int fd) {
+    static uint8_t buf[64 * 1024];
+    size_t avail = 0;
+    for (;;) {
+        ssize_t r = read(fd, buf + avail, sizeof(buf) - avail);
+        if (r <= 0) {
+            return;
+        }
+        avail += r;
+        uint8_t* p = buf;
+        while (avail >= sizeof(uint32_t)) {
+            uint32_t tag;
+            memcpy(&tag, p, sizeof(tag));
+            size_t len = KTRACE_LEN(tag);
+            if (len == 0) {
+                return;
+            }
+            if (len > avail) {
+                break;
+            }
+            if (tag == TAG_PROC_NAME) {
+                ktrace_rec_name_t* rec = (ktrace_rec_name_t*)p;
+                proc_t* proc = add_proc(rec->id);
+                size_t n = len - KTRACE_NAMESIZE;
+                n = strnlen(rec->name, n < sizeof(proc->name) ? n : sizeof(proc->name) - 1);
+                memcpy(proc->name, rec->name, n);
+                proc->name[n] = 0;
+            } else if (KTRACE_GROUP(tag) == KTRACE_GRP_SAMPLE &&
+                       KTRACE_EVENT(tag) == KTRACE_EVENT(TAG_SAMPLE(0)) &&
+                       len >= KTRACE_LEN(TAG_SAMPLE(1)) &&
+                       len <= sizeof(ktrace_rec_sample_t)) {
+                ktrace_rec_sample_t rec;
+                memcpy(&rec, p, len);
+                add_sample(&rec, KTRACE_SAMPLE_NUM_FRAMES(tag));
+                add_proc(rec.pid);
+            }
+            p += len;
+            avail -= len;
+        }
+        memmove(buf, p, avail);
+    }
+}
+
+static mx_status_t read_mem(mx_handle_t h, mx_vaddr_t vaddr, void* ptr, size_t len) {
+    size_t actual;
+    mx_status_t status = mx_process_read_memory(h, vaddr, ptr, len, &actual);
+    if (status == NO_ERROR && actual != len) {
+        status = ERR_IO;
+    }
+    return status;
+}
+
+static void fetch_build_id(mx_handle_t h, mx_vaddr_t base, char* buf) {
+    strcpy(buf, "x");
+    Elf64_Ehdr ehdr;
+    if (read_mem(h, base, &ehdr, sizeof(ehdr)) != NO_ERROR ||
+        memcmp(ehdr.e_ident, ELFMAG, SELFMAG)) {
+        return;
+    }
+    for (unsigned i = 0; i < ehdr.e_phnum; i++) {
+        Elf64_Phdr phdr;
+        if (read_mem(h, base + ehdr.e_phoff + i * sizeof(phdr), &phdr, sizeof(phdr)) != NO_ERROR) {
+            return;
+        }
+        if (phdr.p_type != PT_NOTE) {
+            continue;
+        }
+        size_t off = 0;
+        while (off + sizeof(Elf64_Nhdr) + 4 <= phdr.p_filesz) {
+            struct {
+                Elf64_Nhdr hdr;
+                char name[4];
+            } note;
+            if (read_mem(h, base + phdr.p_offset + off, &note, sizeof(note)) != NO_ERROR) {
+                return;
+            }
+            off += sizeof(Elf64_Nhdr) + ((note.hdr.n_namesz + 3) & -4);
+            mx_vaddr_t desc = base + phdr.p_offset + off;
+            off += (note.hdr.n_descsz + 3) & -4;
+            if (note.hdr.n_type != NT_GNU_BUILD_ID || note.hdr.n_namesz != 4 ||
+                memcmp(note.name, "GNU", 4) || note.hdr.n_descsz > MAX_BUILDID_SIZE) {
+                continue;
+            }
+            uint8_t id[MAX_BUILDID_SIZE];
+            if (read_mem(h, desc, id, note.hdr.n_descsz) != NO_ERROR) {
+                return;
+            }
+            for (uint32_t j = 0; j < note.hdr.n_descsz; j++) {
+                sprintf(buf + j * 2, "%02x", id[j]);
+            }
+            return;
+        }
+    }
+}
+
+// Prints the dsos loaded in a sampled process, in the same form as
+// crashlogger does so that the symbolizer can find them.
+static mx_status_t print_dsos(int depth, mx_handle_t process, mx_koid_t koid) {
+    proc_t* proc = find_proc((uint32_t)koid);
+    if (proc == NULL) {
+        return NO_ERROR;
+    }
+    uintptr_t debug_addr, lmap;
+    if (mx_object_get_property(process, MX_PROP_PROCESS_DEBUG_ADDR,
+                               &debug_addr, sizeof(debug_addr)) != NO_ERROR ||
+        read_mem(process, debug_addr + offsetof(struct r_debug, r_map),
+                 &lmap, sizeof(lmap)) != NO_ERROR) {
+        return NO_ERROR;
+    }
+    while (lmap != 0) {
+        struct link_map map;
+        if (read_mem(process, lmap, &map, sizeof(map)) != NO_ERROR) {
+            break;
+        }
+        char name[64] = "";
+        size_t actual;
+        if (map.l_name != NULL) {
+            mx_process_read_memory(process, (uintptr_t)map.l_name, name,
+                                   sizeof(name) - 1, &actual);
+        }
+        char buildid[MAX_BUILDID_SIZE * 2 + 1];
+        fetch_build_id(process, map.l_addr, buildid);
+        printf("dso: pid=%u id=%s base=%#" PRIxPTR " name=%s%s\n", proc->pid, buildid,
+               (uintptr_t)map.l_addr, name[0] ? "" : "app:", name[0] ? name : proc->name);
+        lmap = (uintptr_t)map.l_next;
+    }
+    return NO_ERROR;
+}
+
+static void print_samples(void) {
+    for (size_t i = 0; i < num_procs; i++) {
+        printf("process: pid=%u name=%s\n", procs[i].pid, procs[i].name);
+    }
+    walk_root_job_tree(NULL, print_dsos, NULL);
+    for (size_t i = 0; i < num_samples; i++) {
+        const sample_t* s = &samples[i];
+        printf("sample: pid=%u tid=%u cpu=%u %s", s->pid, s->tid, s->flags & 0xffff,
+               (s->flags & KTRACE_SAMPLE_FLAG_USER) ? "user" : "kernel");
+        for (uint32_t j = 0; j < s->num_pcs; j++) {
+            printf(" %#" PRIx64, s->pcs[j]);
+        }
+        printf("\n");
+    }
+}
+
+static void print_help(FILE* f) {
+    fprintf(f, "Usage: profile [options]\n");
+    fprintf(f, "Samples what every cpu is running and prints the samples for\n");
+    fprintf(f, "scripts/fold-samples to turn into a flame graph.\n");
+    fprintf(f, "Options:\n");
+    fprintf(f, " -d SECONDS  How long to sample for (default 5)\n");
+    fprintf(f, " -p USEC     Time between samples on each cpu (default 1000)\n");
+    fprintf(f, "This rewinds the ktrace buffer, and leaves every trace group\n");
+    fprintf(f, "enabled when done.\n");
+}
+
+int main(int argc, char** argv) {
+    long seconds = 5;
+    long period = 1000;
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        if (!strcmp(arg, "--help")) {
+            print_help(stdout);
+            return 0;
+        }
+        long* value = NULL;
+        if (!strcmp(arg, "-d")) {
+            value = &seconds;
+        } else if (!strcmp(arg, "-p")) {
+            value = &period;
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", arg);
+            print_help(stderr);
+            return 1;
+        }
+        char* end;
+        if (++i == argc || (*value = strtol(argv[i], &end, 10)) <= 0 || *end != '\0') {
+            fprintf(stderr, "%s needs a positive number\n", arg);
+            return 1;
+        }
+    }
+
+    int fd = open("/dev/misc/ktrace", O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "error: cannot open /dev/misc/ktrace\n");
+        return 1;
+    }
+    mx_handle_t kt;
+    if (ioctl_ktrace_get_handle(fd, &kt) < 0) {
+        fprintf(stderr, "error: cannot get ktrace handle\n");
+        close(fd);
+        return 1;
+    }
+
+    mx_ktrace_control(kt, KTRACE_ACTION_STOP, 0, NULL);
+    mx_ktrace_control(kt, KTRACE_ACTION_REWIND, 0, NULL);
+    mx_ktrace_control(kt, KTRACE_ACTION_START, KTRACE_GRP_SAMPLE, NULL);
+    mx_status_t status = mx_ktrace_control(kt, KTRACE_ACTION_SAMPLE_START, (uint32_t)period, NULL);
+    if (status == NO_ERROR) {
+        mx_nanosleep(mx_deadline_after(MX_SEC(seconds)));
+        mx_ktrace_control(kt, KTRACE_ACTION_SAMPLE_STOP, 0, NULL);
+    }
+    mx_ktrace_control(kt, KTRACE_ACTION_STOP, 0, NULL);
+    if (status != NO_ERROR) {
+        fprintf(stderr, "error: cannot start sampling: %s (%d)\n",
+                mx_status_get_string(status), status);
+    } else {
+        read_samples(fd);
+        print_samples();
+        fprintf(stderr, "%zu samples from %zu processes\n", num_samples, num_procs);
+    }
+
+    mx_ktrace_control(kt, KTRACE_ACTION_REWIND, 0, NULL);
+    mx_ktrace_control(kt, KTRACE_ACTION_START, KTRACE_GRP_ALL, NULL);
+    mx_handle_close(kt);
+    close(fd);
+    free(samples);
+    free(procs);
+    return status == NO_ERROR ? 0 : 1;
+}
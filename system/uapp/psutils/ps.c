@@ -17,6 +17,7 @@
 #include <string.h>
 
 #define MAX_STATE_LEN (7 + 1)  // +1 for trailing NUL
+#define MAX_COUNT_LEN sizeof("18446744073709551616")
 
 // A single task (job or process).
 typedef struct {
@@ -27,6 +28,11 @@ typedef struct {
     char mapped_bytes_str[MAX_FORMAT_SIZE_LEN];
     char state_str[MAX_STATE_LEN];
     char allocated_bytes_str[MAX_FORMAT_SIZE_LEN];
+    char runtime_str[MAX_COUNT_LEN];
+    char wait_str[MAX_COUNT_LEN];
+    char vcsw_str[MAX_COUNT_LEN];
+    char icsw_str[MAX_COUNT_LEN];
+    char faults_str[MAX_COUNT_LEN];
 } task_entry_t;
 
 // An array of tasks.
@@ -49,47 +55,23 @@ void add_entry(task_table_t* table, const task_entry_t* entry) {
     table->entries[table->num_entries++] = *entry;
 }
 
-// The array of tasks built by the callbacks.
+// The array of tasks built from the job tree.
 static task_table_t tasks = {};
 
-// Adds a job's information to |tasks|.
-static mx_status_t job_callback(int depth, mx_handle_t job, mx_koid_t koid) {
-    task_entry_t e = {.type = 'j', .depth = depth};
-    mx_status_t status =
-        mx_object_get_property(job, MX_PROP_NAME, e.name, sizeof(e.name));
-    if (status != NO_ERROR) {
-        return status;
-    }
-    snprintf(e.koid_str, sizeof(e.koid_str), "%" PRIu64, koid);
-    add_entry(&tasks, &e);
-    return NO_ERROR;
+// Formats nanoseconds as seconds to the millisecond.
+static void format_time(char* buf, size_t len, uint64_t ns) {
+    uint64_t ms = ns / 1000000;
+    snprintf(buf, len, "%" PRIu64 ".%03" PRIu64, ms / 1000, ms % 1000);
 }
 
-// Adds a process's information to |tasks|.
-static mx_status_t process_callback(int depth, mx_handle_t process, mx_koid_t koid) {
-    task_entry_t e = {.type = 'p', .depth = depth};
-    mx_status_t status =
-        mx_object_get_property(process, MX_PROP_NAME, e.name, sizeof(e.name));
-    if (status != NO_ERROR) {
-        return status;
-    }
-    mx_info_task_stats_t info;
-    status = mx_object_get_info(
-        process, MX_INFO_TASK_STATS, &info, sizeof(info), NULL, NULL);
-    if (status == ERR_BAD_STATE) {
-        // process has exited, but has not been destroyed
-        info.mem_mapped_bytes = 0;
-        info.mem_committed_bytes = 0;
-    } else if (status != NO_ERROR) {
-        return status;
-    }
-    format_size(e.mapped_bytes_str, sizeof(e.mapped_bytes_str),
-                info.mem_mapped_bytes);
-    format_size(e.allocated_bytes_str, sizeof(e.allocated_bytes_str),
-                info.mem_committed_bytes);
-    snprintf(e.koid_str, sizeof(e.koid_str), "%" PRIu64, koid);
-    add_entry(&tasks, &e);
-    return NO_ERROR;
+// Fills in the scheduler columns of |e|, which the kernel sums over the
+// threads for a job or a process.
+static void format_thread_stats(task_entry_t* e, const mx_info_thread_stats_t* info) {
+    format_time(e->runtime_str, sizeof(e->runtime_str), info->runtime_ns);
+    format_time(e->wait_str, sizeof(e->wait_str), info->wait_ns);
+    snprintf(e->vcsw_str, sizeof(e->vcsw_str), "%" PRIu64, info->voluntary_switches);
+    snprintf(e->icsw_str, sizeof(e->icsw_str), "%" PRIu64, info->involuntary_switches);
+    snprintf(e->faults_str, sizeof(e->faults_str), "%" PRIu64, info->page_faults);
 }
 
 // Return text representation of thread state.
@@ -116,36 +98,67 @@ static const char* state_string(const mx_info_thread_t* info) {
     }
 }
 
-// Adds a thread's information to |tasks|.
-static mx_status_t thread_callback(int depth, mx_handle_t thread, mx_koid_t koid) {
-    task_entry_t e = {.type = 't', .depth = depth};
-    mx_status_t status =
-        mx_object_get_property(thread, MX_PROP_NAME, e.name, sizeof(e.name));
-    if (status != NO_ERROR) {
-        return status;
-    }
-    mx_info_thread_t info;
-    status = mx_object_get_info(thread, MX_INFO_THREAD, &info, sizeof(info), NULL, NULL);
-    if (status != NO_ERROR) {
-        return status;
+// Adds a task's information to |tasks|.
+static void add_record(const mx_info_task_record_t* r) {
+    task_entry_t e = {.depth = r->depth};
+    switch (r->type) {
+    case MX_OBJ_TYPE_JOB:
+        e.type = 'j';
+        break;
+    case MX_OBJ_TYPE_PROCESS:
+        e.type = 'p';
+        // A process which has exited but not been destroyed reports zeros.
+        format_size(e.mapped_bytes_str, sizeof(e.mapped_bytes_str),
+                    r->task.mem_mapped_bytes);
+        format_size(e.allocated_bytes_str, sizeof(e.allocated_bytes_str),
+                    r->task.mem_committed_bytes);
+        break;
+    case MX_OBJ_TYPE_THREAD:
+        e.type = 't';
+        // TODO: Print thread stack size in one of the memory usage fields?
+        snprintf(e.state_str, sizeof(e.state_str), "%s", state_string(&r->thread));
+        break;
+    default:
+        return;
     }
-    // TODO: Print thread stack size in one of the memory usage fields?
-    snprintf(e.koid_str, sizeof(e.koid_str), "%" PRIu64, koid);
-    snprintf(e.state_str, sizeof(e.state_str), "%s", state_string(&info));
+    snprintf(e.name, sizeof(e.name), "%s", r->name);
+    snprintf(e.koid_str, sizeof(e.koid_str), "%" PRIu64, r->koid);
+    format_thread_stats(&e, &r->sched);
     add_entry(&tasks, &e);
-    return NO_ERROR;
 }
 
-void print_header(int id_w, bool with_threads) {
+// Prints one row of the table; the optional columns are skipped unless
+// asked for.
+static void print_row(int id_w, const char* id, const task_entry_t* e,
+                      bool with_threads, bool with_sched) {
+    printf("%*s %7s %7s %9s", -id_w, id,
+           e->mapped_bytes_str, e->allocated_bytes_str, e->runtime_str);
+    if (with_sched) {
+        printf(" %9s %8s %8s %8s", e->wait_str, e->vcsw_str, e->icsw_str, e->faults_str);
+    }
     if (with_threads) {
-        printf("%*s %7s %7s %7s %s\n", -id_w, "TASK", "VIRT", "RES", "STATE", "NAME");
-    } else {
-        printf("%*s %7s %7s %s\n", -id_w, "TASK", "VIRT", "RES", "NAME");
+        printf(" %7s", e->state_str);
     }
+    printf(" %s\n", e->name);
+}
+
+void print_header(int id_w, bool with_threads, bool with_sched) {
+    const task_entry_t header = {
+        .name = "NAME",
+        .mapped_bytes_str = "VIRT",
+        .state_str = "STATE",
+        .allocated_bytes_str = "RES",
+        .runtime_str = "TIME",
+        .wait_str = "WAIT",
+        .vcsw_str = "VCSW",
+        .icsw_str = "ICSW",
+        .faults_str = "FAULTS",
+    };
+    print_row(id_w, "TASK", &header, with_threads, with_sched);
 }
 
 // Prints the contents of |table| to stdout.
-void print_table(task_table_t* table, bool with_threads) {
+void print_table(task_table_t* table, bool with_threads, bool with_sched) {
     if (table->num_entries == 0) {
         return;
     }
@@ -161,7 +174,7 @@ void print_table(task_table_t* table, bool with_threads) {
         }
     }
 
-    print_header(id_w, with_threads);
+    print_header(id_w, with_threads, with_sched);
     char* idbuf = (char*)malloc(id_w + 1);
     for (size_t i = 0; i < table->num_entries; i++) {
         const task_entry_t* e = table->entries + i;
@@ -170,18 +183,10 @@ void print_table(task_table_t* table, bool with_threads) {
         }
         snprintf(idbuf, id_w + 1,
                  "%*s%c:%s", e->depth * 2, "", e->type, e->koid_str);
-        if (with_threads) {
-            printf("%*s %7s %7s %7s %s\n",
-                   -id_w, idbuf,
-                   e->mapped_bytes_str, e->allocated_bytes_str, e->state_str, e->name);
-        } else {
-            printf("%*s %7s %7s %s\n",
-                   -id_w, idbuf,
-                   e->mapped_bytes_str, e->allocated_bytes_str, e->name);
-        }
+        print_row(id_w, idbuf, e, with_threads, with_sched);
     }
     free(idbuf);
-    print_header(id_w, with_threads);
+    print_header(id_w, with_threads, with_sched);
 }
 
 static void print_help(FILE* f) {
@@ -189,10 +194,13 @@ static void print_help(FILE* f) {
     fprintf(f, "Options:\n");
     // -T for compatibility with linux ps
     fprintf(f, " -T  Include threads in the output\n");
+    fprintf(f, " -s  Include time spent waiting to run (WAIT), voluntary (VCSW)\n");
+    fprintf(f, "     and involuntary (ICSW) context switches and page FAULTS\n");
 }
 
 int main(int argc, char** argv) {
     bool with_threads = false;
+    bool with_sched = false;
     for (int i = 1; i < argc; ++i) {
         const char* arg = argv[i];
         if (!strcmp(arg, "--help")) {
@@ -201,6 +209,8 @@ int main(int argc, char** argv) {
         }
         if (!strcmp(arg, "-T")) {
             with_threads = true;
+        } else if (!strcmp(arg, "-s")) {
+            with_sched = true;
         } else {
             fprintf(stderr, "Unknown option: %s\n", arg);
             print_help(stderr);
@@ -208,15 +218,24 @@ int main(int argc, char** argv) {
         }
     }
 
+    // The whole tree comes back from one query, so the rows are consistent
+    // with each other rather than sampled one syscall at a time.
     int ret = 0;
-    mx_status_t status = walk_root_job_tree(job_callback, process_callback,
-                                            with_threads ? thread_callback : NULL);
+    mx_info_task_record_t* records = NULL;
+    size_t num_records = 0;
+    mx_status_t status = get_root_job_tree(&records, &num_records);
     if (status != NO_ERROR) {
-        fprintf(stderr, "WARNING: walk_root_job_tree failed: %s (%d)\n",
+        fprintf(stderr, "WARNING: get_root_job_tree failed: %s (%d)\n",
                 mx_status_get_string(status), status);
         ret = 1;
     }
-    print_table(&tasks, with_threads);
+    for (size_t i = 0; i < num_records; i++) {
+        if (records[i].type != MX_OBJ_TYPE_THREAD || with_threads) {
+            add_record(records + i);
+        }
+    }
+    free(records);
+    print_table(&tasks, with_threads, with_sched);
     free(tasks.entries);
     return ret;
 }
@@ -77,3 +77,21 @@ MODULE_STATIC_LIBS := \
     system/ulib/task-utils
 
 include make/module.mk
+
+MODULE := $(LOCAL_DIR).top
+
+MODULE_TYPE := userapp
+
+MODULE_SRCS += $(LOCAL_DIR)/top.c
+
+MODULE_NAME := top
+
+MODULE_LIBS := \
+    system/ulib/mxio \
+    system/ulib/magenta \
+    system/ulib/c
+
+MODULE_STATIC_LIBS := \
+    system/ulib/task-utils
+
+include make/module.mk
@@ -0,0 +1,227 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <magenta/status.h>
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/object.h>
+#include <task-utils/walker.h>
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The scheduler counters of one process or thread at one point in time.
+typedef struct {
+    mx_koid_t koid;
+    char name[MX_MAX_NAME_LEN];
+    mx_info_thread_stats_t stats;
+} sample_t;
+
+// The samples of one pass over the job tree, sorted by koid.
+typedef struct {
+    sample_t* entries;
+    size_t num_entries;
+    size_t capacity; // allocation size
+    mx_time_t time;
+} sample_table_t;
+
+// What changed for one task between two samples.
+typedef struct {
+    const sample_t* sample;
+    uint64_t runtime_ns;
+    uint64_t wait_ns;
+    uint64_t voluntary_switches;
+    uint64_t involuntary_switches;
+    uint64_t page_faults;
+} delta_t;
+
+static void add_sample(sample_table_t* table, const sample_t* sample) {
+    if (table->num_entries + 1 >= table->capacity) {
+        size_t new_cap = table->capacity * 2;
+        if (new_cap < 128) {
+            new_cap = 128;
+        }
+        table->entries = realloc(table->entries, new_cap * sizeof(*sample));
+        table->capacity = new_cap;
+    }
+    table->entries[table->num_entries++] = *sample;
+}
+
+static int compare_koids(const void* a, const void* b) {
+    mx_koid_t ka = ((const sample_t*)a)->koid;
+    mx_koid_t kb = ((const sample_t*)b)->koid;
+    return ka < kb ? -1 : ka > kb;
+}
+
+// Samples every process, or every thread, with a single job tree query so
+// that polling stays cheap however many tasks there are.
+static mx_status_t take_samples(sample_table_t* table, bool threads) {
+    table->num_entries = 0;
+    table->time = mx_time_get(MX_CLOCK_MONOTONIC);
+    mx_info_task_record_t* records;
+    size_t num_records;
+    mx_status_t status = get_root_job_tree(&records, &num_records);
+    if (status != NO_ERROR) {
+        return status;
+    }
+    uint32_t type = threads ? MX_OBJ_TYPE_THREAD : MX_OBJ_TYPE_PROCESS;
+    for (size_t i = 0; i < num_records; i++) {
+        const mx_info_task_record_t* r = records + i;
+        if (r->type != type) {
+            continue;
+        }
+        sample_t s = {.koid = r->koid, .stats = r->sched};
+        memcpy(s.name, r->name, sizeof(s.name));
+        add_sample(table, &s);
+    }
+    free(records);
+    qsort(table->entries, table->num_entries, sizeof(sample_t), compare_koids);
+    return NO_ERROR;
+}
+
+static int compare_deltas(const void* a, const void* b) {
+    const delta_t* da = a;
+    const delta_t* db = b;
+    if (da->runtime_ns != db->runtime_ns) {
+        return da->runtime_ns > db->runtime_ns ? -1 : 1;
+    }
+    return da->wait_ns > db->wait_ns ? -1 : da->wait_ns < db->wait_ns;
+}
+
+// Prints the |lines| tasks which ran the most between |prev| and |cur|.
+// Tasks which were not in |prev| started during the interval, so all of
+// their counters are new.
+static void print_deltas(const sample_table_t* prev, const sample_table_t* cur,
+                         size_t lines) {
+    delta_t* deltas = malloc(cur->num_entries * sizeof(*deltas));
+    uint64_t total_runtime = 0;
+    for (size_t i = 0; i < cur->num_entries; i++) {
+        const sample_t* s = cur->entries + i;
+        const sample_t* p = bsearch(s, prev->entries, prev->num_entries,
+                                    sizeof(sample_t), compare_koids);
+        const mx_info_thread_stats_t zero = {};
+        const mx_info_thread_stats_t* before = p ? &p->stats : &zero;
+        deltas[i] = (delta_t){
+            .sample = s,
+            .runtime_ns = s->stats.runtime_ns - before->runtime_ns,
+            .wait_ns = s->stats.wait_ns - before->wait_ns,
+            .voluntary_switches =
+                s->stats.voluntary_switches - before->voluntary_switches,
+            .involuntary_switches =
+                s->stats.involuntary_switches - before->involuntary_switches,
+            .page_faults = s->stats.page_faults - before->page_faults,
+        };
+        total_runtime += deltas[i].runtime_ns;
+    }
+    qsort(deltas, cur->num_entries, sizeof(*deltas), compare_deltas);
+
+    double interval = (double)(cur->time - prev->time);
+    printf("%zu tasks, %.1f cpu-seconds/s\n\n", cur->num_entries,
+           total_runtime / interval);
+    printf("%8s %6s %6s %7s %7s %7s %10s %s\n",
+           "KOID", "CPU%", "WAIT%", "VCSW", "ICSW", "FAULTS", "TIME", "NAME");
+    for (size_t i = 0; i < cur->num_entries && i < lines; i++) {
+        const delta_t* d = deltas + i;
+        uint64_t ms = d->sample->stats.runtime_ns / 1000000;
+        char time_str[sizeof("18446744073709551616")];
+        snprintf(time_str, sizeof(time_str), "%" PRIu64 ".%03" PRIu64,
+                 ms / 1000, ms % 1000);
+        printf("%8" PRIu64 " %6.1f %6.1f %7" PRIu64 " %7" PRIu64 " %7" PRIu64
+               " %10s %s\n",
+               d->sample->koid,
+               100.0 * d->runtime_ns / interval, 100.0 * d->wait_ns / interval,
+               d->voluntary_switches, d->involuntary_switches, d->page_faults,
+               time_str, d->sample->name);
+    }
+    free(deltas);
+}
+
+static void print_help(FILE* f) {
+    fprintf(f, "Usage: top [options]\n");
+    fprintf(f, "Shows the processes which used the most cpu time in each interval.\n");
+    fprintf(f, "Options:\n");
+    fprintf(f, " -d SECONDS  Time between updates (default 1)\n");
+    fprintf(f, " -n COUNT    Exit after COUNT updates (default: run until killed)\n");
+    fprintf(f, " -l LINES    Number of tasks to show (default 20)\n");
+    fprintf(f, " -t          Show threads instead of processes\n");
+    fprintf(f, " -b          Batch mode: don't clear the screen between updates\n");
+    fprintf(f, "WAIT%% is time spent runnable but waiting for a cpu; VCSW and ICSW\n");
+    fprintf(f, "count voluntary and involuntary context switches.\n");
+}
+
+int main(int argc, char** argv) {
+    long delay = 1;
+    long count = -1;
+    long lines = 20;
+    bool threads = false;
+    bool batch = false;
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        if (!strcmp(arg, "--help")) {
+            print_help(stdout);
+            return 0;
+        }
+        long* value = NULL;
+        if (!strcmp(arg, "-d")) {
+            value = &delay;
+        } else if (!strcmp(arg, "-n")) {
+            value = &count;
+        } else if (!strcmp(arg, "-l")) {
+            value = &lines;
+        } else if (!strcmp(arg, "-t")) {
+            threads = true;
+        } else if (!strcmp(arg, "-b")) {
+            batch = true;
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", arg);
+            print_help(stderr);
+            return 1;
+        }
+        if (value != NULL) {
+            char* end;
+            if (++i == argc || (*value = strtol(argv[i], &end, 10)) <= 0 || *end != '\0') {
+                fprintf(stderr, "%s needs a positive number\n", arg);
+                print_help(stderr);
+                return 1;
+            }
+        }
+    }
+
+    sample_table_t tables[2] = {};
+    sample_table_t* prev = &tables[0];
+    sample_table_t* cur = &tables[1];
+    mx_status_t status = take_samples(prev, threads);
+    while (status == NO_ERROR && count != 0) {
+        mx_nanosleep(mx_deadline_after(MX_SEC(delay)));
+        status = take_samples(cur, threads);
+        if (status != NO_ERROR) {
+            break;
+        }
+        if (!batch) {
+            // Home the cursor and clear the screen.
+            printf("\033[H\033[J");
+        }
+        print_deltas(prev, cur, lines);
+        if (batch) {
+            printf("\n");
+        }
+        fflush(stdout);
+
+        sample_table_t* t = prev;
+        prev = cur;
+        cur = t;
+        if (count > 0) {
+            count--;
+        }
+    }
+    if (status != NO_ERROR) {
+        fprintf(stderr, "ERROR: get_root_job_tree failed: %s (%d)\n",
+                mx_status_get_string(status), status);
+    }
+    free(tables[0].entries);
+    free(tables[1].entries);
+    return status == NO_ERROR ? 0 : 1;
+}
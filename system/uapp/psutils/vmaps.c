@@ -141,8 +141,11 @@ mx_status_t print_maps(mx_info_maps_t* maps, size_t count, size_t avail) {
             format_size(size_str, sizeof(size_str),
                         u->committed_pages * PAGE_SIZE);
             printf(" %*s:res", (int)(MAX_FORMAT_SIZE_LEN - 1), size_str);
+            format_size(size_str, sizeof(size_str),
+                        u->shared_pages * PAGE_SIZE);
+            printf(" %*s:shr", (int)(MAX_FORMAT_SIZE_LEN - 1), size_str);
         } else {
-            printf("%12s", "");
+            printf("%24s", "");
         }
 
         printf("  %s\n", e->name);
@@ -213,6 +216,11 @@ void try_help(char** argv) {
     printf("  \"M\"  -- Mapping\n");
     printf("\n");
     printf("  Indentation indicates parent/child relationship.\n");
+    printf("\n");
+    printf("Sizes:\n");
+    printf("  \"sz\"  -- Size of the range\n");
+    printf("  \"res\" -- Memory the mapped VMO holds itself\n");
+    printf("  \"shr\" -- Memory a copy-on-write clone reads from its parent\n");
     exit(0);
 }
 
@@ -3,12 +3,53 @@
 // found in the LICENSE file.
 
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <magenta/syscalls.h>
 
 #define TRIALS 10000
 #define BINS 32
+#define MAX_THREADS 16
+
+// Each thread draws TRIALS times, so that the time it takes shows whether
+// concurrent draws serialize in the kernel.
+static void* draw_thread(void* arg) {
+    size_t len = *(size_t*)arg;
+    uint8_t buf[MX_CPRNG_DRAW_MAX_LEN];
+    for (unsigned int i = 0; i < TRIALS; ++i) {
+        size_t sz = 0;
+        if (mx_cprng_draw(buf, len, &sz) != NO_ERROR || sz != len)
+            return (void*)1;
+    }
+    return NULL;
+}
+
+static int time_draws(unsigned int threads, size_t len) {
+    pthread_t tids[MAX_THREADS];
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    for (unsigned int i = 0; i < threads; ++i) {
+        if (pthread_create(&tids[i], NULL, draw_thread, &len) != 0) {
+            printf("cannot create thread\n");
+            return 1;
+        }
+    }
+    int failed = 0;
+    for (unsigned int i = 0; i < threads; ++i) {
+        void* ret;
+        pthread_join(tids[i], &ret);
+        failed |= ret != NULL;
+    }
+    mx_time_t elapsed = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+    if (failed) {
+        printf("mx_cprng_draw failed\n");
+        return 1;
+    }
+    printf("%u threads, %3zu bytes: %" PRIu64 " ns per draw\n", threads, len,
+           elapsed / TRIALS);
+    return 0;
+}
 
 int main(int argc, char** argv) {
     static uint8_t buf[32];
@@ -41,5 +82,15 @@ int main(int argc, char** argv) {
         printf("bin %u: %" PRIu64 "\n", i, values[i]);
     }
 
+    unsigned int max_threads = argc > 1 ? (unsigned int)atoi(argv[1]) : 4;
+    if (max_threads < 1 || max_threads > MAX_THREADS) {
+        printf("usage: %s [threads (1-%d)]\n", argv[0], MAX_THREADS);
+        return 1;
+    }
+    for (unsigned int threads = 1; threads <= max_threads; threads *= 2) {
+        if (time_draws(threads, 8) || time_draws(threads, MX_CPRNG_DRAW_MAX_LEN))
+            return 1;
+    }
+
     return 0;
 }
@@ -0,0 +1,190 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Runs every perftest binary in /boot/test/perf, the way runtests runs the
+// unit tests, and gathers their results into one JSON file which can be
+// kept as the baseline for the next run.
+
+#include <dirent.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <launchpad/launchpad.h>
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/object.h>
+#include <perftest/perftest.h>
+
+namespace {
+
+constexpr char kPerfTestDir[] = "/boot/test/perf";
+
+// Runs one test binary, which writes its results to |json_path|.
+bool RunBinary(const char* path, const char* json_path, const char* runs, const char* filter) {
+    const char* argv[7] = {path, "-o", json_path};
+    int argc = 3;
+    if (runs != nullptr) {
+        argv[argc++] = "-r";
+        argv[argc++] = runs;
+    }
+    if (filter != nullptr) {
+        argv[argc++] = "-f";
+        argv[argc++] = filter;
+    }
+
+    launchpad_t* lp;
+    launchpad_create(0u, path, &lp);
+    launchpad_load_from_file(lp, path);
+    launchpad_clone(lp, LP_CLONE_ALL);
+    launchpad_set_args(lp, argc, argv);
+    const char* errmsg;
+    mx_handle_t process;
+    mx_status_t status = launchpad_go(lp, &process, &errmsg);
+    if (status < 0) {
+        printf("FAILURE: Failed to launch %s: %d: %s\n", path, status, errmsg);
+        return false;
+    }
+
+    status = mx_object_wait_one(process, MX_PROCESS_SIGNALED, MX_TIME_INFINITE, nullptr);
+    mx_info_process_t info;
+    if (status == NO_ERROR)
+        status = mx_object_get_info(process, MX_INFO_PROCESS, &info, sizeof(info), nullptr,
+                                    nullptr);
+    mx_handle_close(process);
+    if (status != NO_ERROR) {
+        printf("FAILURE: Failed to wait for %s: %d\n", path, status);
+        return false;
+    }
+    if (info.return_code != 0) {
+        printf("FAILED: %s exited with nonzero status: %d\n", path, info.return_code);
+        return false;
+    }
+    return true;
+}
+
+int Usage(const char* argv0) {
+    fprintf(stderr,
+            "Usage: %s [options ...]\n"
+            "\n"
+            "Runs each perftest binary in %s.\n"
+            "\n"
+            "Options:\n"
+            "  -h       show help (this)\n"
+            "  -r N     time N runs of each test\n"
+            "  -f NAME  only run the tests whose names contain NAME\n"
+            "  -o FILE  write all of the results to FILE as JSON\n"
+            "  -c FILE  compare the results with the JSON baseline in FILE\n"
+            "  -t PCT   how much slower a median has to be to count as a\n"
+            "           regression (default: 10)\n"
+            "\n"
+            "Exits with 1 if a test fails or regresses.\n",
+            argv0, kPerfTestDir);
+    return 1;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const char* runs = nullptr;
+    const char* filter = nullptr;
+    const char* out_path = nullptr;
+    const char* baseline_path = nullptr;
+    double threshold = 10.0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "hr:f:o:c:t:")) != -1) {
+        switch (opt) {
+        case 'r':
+            runs = optarg;
+            break;
+        case 'f':
+            filter = optarg;
+            break;
+        case 'o':
+            out_path = optarg;
+            break;
+        case 'c':
+            baseline_path = optarg;
+            break;
+        case 't':
+            threshold = strtod(optarg, nullptr);
+            break;
+        default:
+            return Usage(argv[0]);
+        }
+    }
+
+    perftest::ResultSet baseline;
+    if (baseline_path != nullptr) {
+        const char* error;
+        if (!baseline.ReadJsonFile(baseline_path, &error)) {
+            fprintf(stderr, "%s: %s: %s\n", argv[0], baseline_path, error);
+            return 1;
+        }
+    }
+
+    DIR* dir = opendir(kPerfTestDir);
+    if (dir == nullptr) {
+        printf("Failed: Could not open %s\n", kPerfTestDir);
+        return 1;
+    }
+
+    perftest::ResultSet results;
+    int total_count = 0;
+    int failed_count = 0;
+    struct dirent* de;
+    while ((de = readdir(dir)) != nullptr) {
+        char path[64 + NAME_MAX];
+        snprintf(path, sizeof(path), "%s/%s", kPerfTestDir, de->d_name);
+        struct stat st;
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+
+        total_count++;
+        printf("\n------------------------------------------------\n"
+               "RUNNING PERF TEST: %s\n\n",
+               de->d_name);
+
+        char json_path[64 + NAME_MAX];
+        snprintf(json_path, sizeof(json_path), "/tmp/runperftests-%s.json", de->d_name);
+        bool ok = RunBinary(path, json_path, runs, filter);
+        if (ok) {
+            const char* error;
+            ok = results.ReadJsonFile(json_path, &error);
+            if (!ok)
+                printf("FAILED: %s: %s: %s\n", de->d_name, json_path, error);
+        }
+        unlink(json_path);
+        if (!ok)
+            failed_count++;
+    }
+    closedir(dir);
+
+    printf("\nSUMMARY: Ran %d perf tests: %d failed\n", total_count, failed_count);
+
+    if (out_path != nullptr) {
+        FILE* out = fopen(out_path, "w");
+        bool written = out != nullptr && results.WriteJson(out);
+        if (out != nullptr && fclose(out) != 0)
+            written = false;
+        if (!written) {
+            printf("Failed: Could not write %s\n", out_path);
+            failed_count++;
+        }
+    }
+
+    if (baseline_path != nullptr) {
+        printf("\nCompared with %s:\n", baseline_path);
+        uint32_t regressions = results.Compare(baseline, threshold, stdout);
+        printf("%u regression%s\n", regressions, regressions == 1 ? "" : "s");
+        if (regressions != 0)
+            failed_count++;
+    }
+
+    return failed_count ? 1 : 0;
+}
@@ -15,6 +15,16 @@ mx_status_t callback(int dirfd, int event, const char* fn, void* cookie) {
         fprintf(stderr, "watch: '%s/%s'\n", path, fn);
         break;
     }
+    case WATCH_EVENT_REMOVE_FILE: {
+        const char* path = cookie;
+        fprintf(stderr, "watch: '%s/%s' removed\n", path, fn);
+        break;
+    }
+    case WATCH_EVENT_MODIFY_FILE: {
+        const char* path = cookie;
+        fprintf(stderr, "watch: '%s/%s' modified\n", path, fn);
+        break;
+    }
     case WATCH_EVENT_WAITING:
         fprintf(stderr, "watch: waiting...\n");
         break;
@@ -9,7 +9,8 @@
 //    rate for the device and to power the device on. Additionally, the Pi3's
 //    controller does not appear to support any type of DMA natively and relies
 //    on the BCM28xx's DMA controller for DMA. For this reason, this driver uses
-//    PIO to communicate with the device. A more complete (and generic) driver
+//    PIO to communicate with the device, a block at a time, so iotxns don't
+//    have to be physically contiguous. A more complete (and generic) driver
 //    might attempt [S/A]DMA and fall back on PIO in case of failure.
 //    Additionally, the Pi's controller doesn't appear to populate the SDHCI
 //    capabilities registers to expose what capabilities the EMMC controller
@@ -325,6 +326,13 @@ static void emmc_iotxn_queue(void* ctx, iotxn_t* txn) {
     const uint16_t blksiz = pdata->blocksize;
     uint32_t cmd = pdata->cmd;
 
+    // Blocks are moved through a buffer on the stack.
+    if ((cmd & SDMMC_RESP_DATA_PRESENT) &&
+        (blksiz > SDHC_BLOCK_SIZE || blksiz % sizeof(uint32_t))) {
+        iotxn_complete(txn, ERR_INVALID_ARGS, 0);
+        goto exit;
+    }
+
     // Every command requires that the Command Inhibit is unset.
     uint32_t inhibit_mask = EMMC_STATE_CMD_INHIBIT;
 
@@ -339,16 +347,9 @@ static void emmc_iotxn_queue(void* ctx, iotxn_t* txn) {
     while (regs->state & inhibit_mask)
         mx_nanosleep(mx_deadline_after(MX_MSEC(1)));
 
-    // This command has a data phase?
-    if (cmd & SDMMC_RESP_DATA_PRESENT) {
-        iotxn_physmap(txn);
-        MX_DEBUG_ASSERT(txn->phys_count == 1);
-        regs->arg2 = iotxn_phys(txn) + BCM_SDRAM_BUS_ADDR_BASE;
-
-        iotxn_cacheop(txn, IOTXN_CACHE_CLEAN, 0, blkcnt * blksiz);
-
-        if (cmd & SDMMC_CMD_MULTI_BLK)
-            cmd |= SDMMC_CMD_AUTO12;
+    // Have the host stop multi block transfers for us.
+    if ((cmd & SDMMC_RESP_DATA_PRESENT) && (cmd & SDMMC_CMD_MULTI_BLK)) {
+        cmd |= SDMMC_CMD_AUTO12;
     }
 
     regs->blkcntsiz = (blksiz | (blkcnt << 16));
@@ -404,7 +405,11 @@ static void emmc_iotxn_queue(void* ctx, iotxn_t* txn) {
         // BCM28xx quirk: The BCM28xx appears to use its internal DMA engine to
         // perform transfers against the SD card. Normally we would use SDMA or
         // ADMA (if the part supported it). Since this part doesn't appear to
-        // support either, we just use PIO.
+        // support either, we just use PIO. Each block goes through |block|
+        // so that the iotxn is only copied to or from once per block rather
+        // than once per word.
+        uint32_t block[SDHC_BLOCK_SIZE / sizeof(uint32_t)];
+        const size_t words = blksiz / sizeof(uint32_t);
         for (size_t blkid = 0; blkid < blkcnt; blkid++) {
             mx_status_t st;
             if ((st = emmc_await_irq(emmc)) != NO_ERROR) {
@@ -412,18 +417,19 @@ static void emmc_iotxn_queue(void* ctx, iotxn_t* txn) {
                 goto exit;
             }
 
-            uint32_t wrd;
-            for (size_t byteid = 0; byteid < blksiz; byteid += 4) {
-                const size_t offset = blkid * blksiz + byteid;
-                if (cmd & SDMMC_CMD_READ) {
-                    wrd = regs->data;
-                    iotxn_copyto(txn, &wrd, sizeof(wrd), offset);
-                } else {
-                    iotxn_copyfrom(txn, &wrd, sizeof(wrd), offset);
-                    regs->data = wrd;
+            const size_t offset = blkid * blksiz;
+            if (cmd & SDMMC_CMD_READ) {
+                for (size_t i = 0; i < words; i++) {
+                    block[i] = regs->data;
+                }
+                iotxn_copyto(txn, block, blksiz, offset);
+            } else {
+                iotxn_copyfrom(txn, block, blksiz, offset);
+                for (size_t i = 0; i < words; i++) {
+                    regs->data = block[i];
                 }
-                bytes_copied += sizeof(wrd);
             }
+            bytes_copied += blksiz;
         }
 
         if ((regs->state & EMMC_STATE_DAT_INHIBIT) == 0) {
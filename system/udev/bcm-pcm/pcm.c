@@ -185,8 +185,10 @@ static int pcm_notify_thread(void* arg) {
         bcm_dma_paddr_to_offset(&ctx->dma, pos, &offset);
 
         audio2_rb_position_notify_t resp;
+        resp.hdr.transaction_id = AUDIO2_INVALID_TRANSACTION_ID;
         resp.hdr.cmd = AUDIO2_RB_POSITION_NOTIFY;
         resp.ring_buffer_pos = offset;
+        resp.position_ticks = mx_ticks_get();
 
         status = mx_channel_write(ctx->buffer_ch, 0, &resp, sizeof(resp), NULL, 0);
         if (status != NO_ERROR)
@@ -0,0 +1,624 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <ddk/device.h>
+#include <ddk/driver.h>
+#include <ddk/binding.h>
+#include <ddk/protocol/block.h>
+
+#include <magenta/process.h>
+#include <magenta/syscalls.h>
+#include <magenta/types.h>
+#include <magenta/listnode.h>
+#include <sys/param.h>
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <threads.h>
+
+// This block device keeps recently read blocks of the underlying device in
+// memory. Reads that miss fetch the lines they touch plus some readahead;
+// writes go straight through and drop whatever they overlap.
+//
+// Bind it on a whole disk in place of gpt or mbr, and those on the block
+// device it publishes, so every partition on the disk shares one cache and
+// one memory budget.
+
+#define CACHE_LINE_SIZE (16 * 1024)
+#define CACHE_DEFAULT_CAPACITY (8 * 1024 * 1024)
+#define CACHE_MAX_CAPACITY (256 * 1024 * 1024)
+#define CACHE_DEFAULT_READAHEAD 4
+#define CACHE_MAX_READAHEAD 64
+
+typedef struct cache_line {
+    list_node_t lru_node;  // on the lru list, or the free list
+    list_node_t hash_node; // in a bucket while it holds data
+    uint64_t lineno;
+} cache_line_t;
+
+typedef struct cache_device {
+    mx_device_t* mxdev;
+    mx_device_t* parent;
+
+    block_info_t info;
+    block_callbacks_t* callbacks;
+    uint64_t line_size;
+    uint64_t dev_lines; // whole lines on the device; a partial tail isn't cached
+
+    mtx_t lock;
+    mx_handle_t vmo;
+    uintptr_t data;
+    uint64_t capacity;
+    cache_line_t* lines;
+    size_t line_count;
+    list_node_t* buckets;
+    size_t bucket_mask;
+    list_node_t lru; // most recently used first
+    list_node_t free;
+    list_node_t fills; // fills waiting on the device
+    uint32_t readahead;
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t prefetched;
+    uint64_t evictions;
+} cache_device_t;
+
+// Lives in the extra data of the iotxns we send to the parent.
+typedef struct cache_fill {
+    cache_device_t* dev;
+    list_node_t node;
+    bool stale; // a write overlapped the fill, so its data may be old
+} cache_fill_t;
+
+static_assert(sizeof(cache_fill_t) <= sizeof(iotxn_extra_data_t), "cache_fill_t too big");
+
+static inline cache_fill_t* to_fill(iotxn_t* txn) {
+    return (cache_fill_t*)txn->extra;
+}
+
+static void* line_data(cache_device_t* dev, cache_line_t* line) {
+    return (void*)(dev->data + (line - dev->lines) * dev->line_size);
+}
+
+static cache_line_t* cache_lookup_locked(cache_device_t* dev, uint64_t lineno) {
+    cache_line_t* line;
+    list_for_every_entry (&dev->buckets[lineno & dev->bucket_mask], line, cache_line_t,
+                          hash_node) {
+        if (line->lineno == lineno) {
+            return line;
+        }
+    }
+    return NULL;
+}
+
+static void cache_drop_locked(cache_device_t* dev, cache_line_t* line) {
+    list_delete(&line->hash_node);
+    list_delete(&line->lru_node);
+    list_add_head(&dev->free, &line->lru_node);
+}
+
+// Installs one line of data. Lines that were asked for go to the hot end of
+// the list; readahead goes to the cold end, so it is the first to go if
+// nobody reads it.
+static void cache_insert_locked(cache_device_t* dev, uint64_t lineno, const void* src, bool hot) {
+    cache_line_t* line = cache_lookup_locked(dev, lineno);
+    if (line != NULL) {
+        // no write has touched it since it was filled, so it's current
+        if (hot) {
+            list_delete(&line->lru_node);
+            list_add_head(&dev->lru, &line->lru_node);
+        }
+        return;
+    }
+
+    if ((line = list_remove_head_type(&dev->free, cache_line_t, lru_node)) == NULL) {
+        line = list_remove_tail_type(&dev->lru, cache_line_t, lru_node);
+        list_delete(&line->hash_node);
+        dev->evictions++;
+    }
+    line->lineno = lineno;
+    memcpy(line_data(dev, line), src, dev->line_size);
+    list_add_head(&dev->buckets[lineno & dev->bucket_mask], &line->hash_node);
+    if (hot) {
+        list_add_head(&dev->lru, &line->lru_node);
+    } else {
+        list_add_tail(&dev->lru, &line->lru_node);
+    }
+}
+
+// Drops the cached lines in [offset, offset + length) and marks any fill
+// of that range still in flight as stale.
+static void cache_invalidate_locked(cache_device_t* dev, mx_off_t offset, mx_off_t length) {
+    if (length == 0) {
+        return;
+    }
+    mx_off_t end = (offset + length < offset) ? UINT64_MAX : offset + length;
+
+    cache_fill_t* fill;
+    list_for_every_entry (&dev->fills, fill, cache_fill_t, node) {
+        iotxn_t* txn = containerof(fill, iotxn_t, extra);
+        if (offset < txn->offset + txn->length && txn->offset < end) {
+            fill->stale = true;
+        }
+    }
+
+    if (dev->line_count == 0) {
+        return;
+    }
+    uint64_t first = offset / dev->line_size;
+    uint64_t last = (end - 1) / dev->line_size;
+    if (last - first >= dev->line_count) {
+        cache_line_t* line;
+        cache_line_t* temp;
+        list_for_every_entry_safe (&dev->lru, line, temp, cache_line_t, lru_node) {
+            if (line->lineno >= first && line->lineno <= last) {
+                cache_drop_locked(dev, line);
+            }
+        }
+    } else {
+        for (uint64_t lineno = first; lineno <= last; lineno++) {
+            cache_line_t* line = cache_lookup_locked(dev, lineno);
+            if (line != NULL) {
+                cache_drop_locked(dev, line);
+            }
+        }
+    }
+}
+
+static void cache_free_locked(cache_device_t* dev) {
+    cache_fill_t* fill;
+    list_for_every_entry (&dev->fills, fill, cache_fill_t, node) {
+        fill->stale = true;
+    }
+    if (dev->data != 0) {
+        mx_vmar_unmap(mx_vmar_root_self(), dev->data, dev->capacity);
+        dev->data = 0;
+    }
+    if (dev->vmo != MX_HANDLE_INVALID) {
+        mx_handle_close(dev->vmo);
+        dev->vmo = MX_HANDLE_INVALID;
+    }
+    free(dev->lines);
+    free(dev->buckets);
+    dev->lines = NULL;
+    dev->buckets = NULL;
+    dev->line_count = 0;
+    dev->capacity = 0;
+    list_initialize(&dev->lru);
+    list_initialize(&dev->free);
+}
+
+static mx_status_t cache_alloc_locked(cache_device_t* dev, uint64_t capacity) {
+    cache_free_locked(dev);
+
+    size_t count = MIN(capacity, CACHE_MAX_CAPACITY) / dev->line_size;
+    if (count == 0) {
+        return NO_ERROR;
+    }
+    size_t buckets = 1;
+    while (buckets < count) {
+        buckets <<= 1;
+    }
+
+    mx_status_t status;
+    uint64_t size = count * dev->line_size;
+    dev->lines = calloc(count, sizeof(cache_line_t));
+    dev->buckets = calloc(buckets, sizeof(list_node_t));
+    if (dev->lines == NULL || dev->buckets == NULL) {
+        status = ERR_NO_MEMORY;
+        goto fail;
+    }
+    // pages are only committed as lines fill up
+    if ((status = mx_vmo_create(size, 0, &dev->vmo)) != NO_ERROR) {
+        goto fail;
+    }
+    if ((status = mx_vmar_map(mx_vmar_root_self(), 0, dev->vmo, 0, size,
+                              MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE,
+                              &dev->data)) != NO_ERROR) {
+        goto fail;
+    }
+
+    for (size_t i = 0; i < buckets; i++) {
+        list_initialize(&dev->buckets[i]);
+    }
+    for (size_t i = 0; i < count; i++) {
+        list_add_tail(&dev->free, &dev->lines[i].lru_node);
+    }
+    dev->bucket_mask = buckets - 1;
+    dev->line_count = count;
+    dev->capacity = size;
+    return NO_ERROR;
+
+fail:
+    cache_free_locked(dev);
+    return status;
+}
+
+// Copies the requested range out of the cache if every line of it is
+// present.
+static bool cache_read_locked(cache_device_t* dev, iotxn_t* txn, uint64_t first,
+                              uint64_t last) {
+    for (uint64_t lineno = first; lineno <= last; lineno++) {
+        if (cache_lookup_locked(dev, lineno) == NULL) {
+            return false;
+        }
+    }
+    mx_off_t end = txn->offset + txn->length;
+    for (uint64_t lineno = first; lineno <= last; lineno++) {
+        cache_line_t* line = cache_lookup_locked(dev, lineno);
+        mx_off_t start = MAX(txn->offset, lineno * dev->line_size);
+        mx_off_t stop = MIN(end, (lineno + 1) * dev->line_size);
+        iotxn_copyto(txn, line_data(dev, line) + (start - lineno * dev->line_size),
+                     stop - start, start - txn->offset);
+        list_delete(&line->lru_node);
+        list_add_head(&dev->lru, &line->lru_node);
+    }
+    return true;
+}
+
+static void cache_fill_complete(iotxn_t* fill, void* cookie) {
+    iotxn_t* txn = cookie;
+    cache_device_t* dev = to_fill(fill)->dev;
+
+    mx_status_t status = fill->status;
+    if (status == NO_ERROR && fill->actual < txn->offset + txn->length - fill->offset) {
+        status = ERR_IO;
+    }
+    if (status != NO_ERROR) {
+        mtx_lock(&dev->lock);
+        list_delete(&to_fill(fill)->node);
+        mtx_unlock(&dev->lock);
+        iotxn_release(fill);
+        iotxn_complete(txn, status, 0);
+        return;
+    }
+
+    void* buffer;
+    iotxn_mmap(fill, &buffer);
+    iotxn_copyto(txn, buffer + (txn->offset - fill->offset), txn->length, 0);
+
+    // stays on the fills list until here, so a write can't slip in
+    // between checking for staleness and installing
+    mtx_lock(&dev->lock);
+    list_delete(&to_fill(fill)->node);
+    if (!to_fill(fill)->stale && dev->line_count > 0) {
+        uint64_t first = fill->offset / dev->line_size;
+        uint64_t count = fill->actual / dev->line_size;
+        uint64_t last_wanted = (txn->offset + txn->length - 1) / dev->line_size;
+        for (uint64_t i = 0; i < count; i++) {
+            bool hot = first + i <= last_wanted;
+            cache_insert_locked(dev, first + i, buffer + i * dev->line_size, hot);
+            if (!hot) {
+                dev->prefetched++;
+            }
+        }
+    }
+    mtx_unlock(&dev->lock);
+
+    iotxn_release(fill);
+    iotxn_complete(txn, NO_ERROR, txn->length);
+}
+
+static void cache_write_complete(iotxn_t* clone, void* cookie) {
+    iotxn_t* txn = cookie;
+    cache_device_t* dev = to_fill(clone)->dev;
+
+    // a fill that read while the write was on its way may have seen
+    // either version, so drop the range again now that it has landed
+    mtx_lock(&dev->lock);
+    cache_invalidate_locked(dev, clone->offset, clone->length);
+    mtx_unlock(&dev->lock);
+
+    mx_status_t status = clone->status;
+    mx_off_t actual = clone->actual;
+    iotxn_release(clone);
+    iotxn_complete(txn, status, actual);
+}
+
+static void cache_write(cache_device_t* dev, iotxn_t* txn) {
+    iotxn_t* clone;
+    mx_status_t status;
+    if ((status = iotxn_clone(txn, &clone)) != NO_ERROR) {
+        iotxn_complete(txn, status, 0);
+        return;
+    }
+    clone->complete_cb = cache_write_complete;
+    clone->cookie = txn;
+    to_fill(clone)->dev = dev;
+
+    mtx_lock(&dev->lock);
+    cache_invalidate_locked(dev, txn->offset, txn->length);
+    mtx_unlock(&dev->lock);
+
+    iotxn_queue(dev->parent, clone);
+}
+
+static void cache_read(cache_device_t* dev, iotxn_t* txn) {
+    uint64_t line_size = dev->line_size;
+    mx_off_t end = txn->offset + txn->length;
+    // reads reaching into a partial last line aren't worth caching
+    if (txn->length == 0 || end < txn->offset || end > dev->dev_lines * line_size) {
+        iotxn_queue(dev->parent, txn);
+        return;
+    }
+    uint64_t first = txn->offset / line_size;
+    uint64_t last = (end - 1) / line_size;
+
+    mtx_lock(&dev->lock);
+    // large reads stream past the cache rather than flush it
+    if (last - first >= dev->line_count / 4) {
+        mtx_unlock(&dev->lock);
+        iotxn_queue(dev->parent, txn);
+        return;
+    }
+    if (cache_read_locked(dev, txn, first, last)) {
+        dev->hits++;
+        mtx_unlock(&dev->lock);
+        iotxn_complete(txn, NO_ERROR, txn->length);
+        return;
+    }
+    dev->misses++;
+
+    uint64_t fill_last = MIN(last + dev->readahead, dev->dev_lines - 1);
+    fill_last = MIN(fill_last, first + dev->line_count / 2);
+    if (dev->info.max_transfer_size != 0) {
+        uint64_t max_lines = dev->info.max_transfer_size / line_size;
+        if (max_lines < last - first + 1) {
+            mtx_unlock(&dev->lock);
+            iotxn_queue(dev->parent, txn);
+            return;
+        }
+        fill_last = MIN(fill_last, first + max_lines - 1);
+    }
+    mtx_unlock(&dev->lock);
+
+    iotxn_t* fill;
+    mx_off_t length = (fill_last - first + 1) * line_size;
+    mx_status_t status;
+    if ((status = iotxn_alloc(&fill, IOTXN_ALLOC_POOL, length)) != NO_ERROR) {
+        iotxn_complete(txn, status, 0);
+        return;
+    }
+    fill->opcode = IOTXN_OP_READ;
+    fill->offset = first * line_size;
+    fill->length = length;
+    fill->complete_cb = cache_fill_complete;
+    fill->cookie = txn;
+    to_fill(fill)->dev = dev;
+    to_fill(fill)->stale = false;
+
+    // registered before it is queued, so a write that overtakes it marks it
+    mtx_lock(&dev->lock);
+    list_add_tail(&dev->fills, &to_fill(fill)->node);
+    mtx_unlock(&dev->lock);
+
+    iotxn_queue(dev->parent, fill);
+}
+
+// implement device protocol:
+
+static mx_status_t cache_ioctl(void* ctx, uint32_t op, const void* cmd,
+                               size_t cmdlen, void* reply, size_t max, size_t* out_actual) {
+    cache_device_t* dev = ctx;
+    switch (op) {
+    case IOCTL_BLOCK_CACHE_CONFIG: {
+        const block_cache_config_t* config = cmd;
+        if (cmdlen < sizeof(*config) || config->readahead > CACHE_MAX_READAHEAD) {
+            return ERR_INVALID_ARGS;
+        }
+        mtx_lock(&dev->lock);
+        mx_status_t status = NO_ERROR;
+        if (config->capacity != dev->capacity) {
+            status = cache_alloc_locked(dev, config->capacity);
+        }
+        dev->readahead = config->readahead;
+        mtx_unlock(&dev->lock);
+        return status;
+    }
+    case IOCTL_BLOCK_CACHE_GET_STATS: {
+        block_cache_stats_t* stats = reply;
+        if (max < sizeof(*stats)) {
+            return ERR_BUFFER_TOO_SMALL;
+        }
+        mtx_lock(&dev->lock);
+        stats->capacity = dev->capacity;
+        stats->readahead = dev->readahead;
+        stats->line_size = dev->line_size;
+        stats->hits = dev->hits;
+        stats->misses = dev->misses;
+        stats->prefetched = dev->prefetched;
+        stats->evictions = dev->evictions;
+        mtx_unlock(&dev->lock);
+        *out_actual = sizeof(*stats);
+        return NO_ERROR;
+    }
+    default:
+        return device_op_ioctl(dev->parent, op, cmd, cmdlen, reply, max, out_actual);
+    }
+}
+
+static void cache_iotxn_queue(void* ctx, iotxn_t* txn) {
+    cache_device_t* dev = ctx;
+    switch (txn->opcode) {
+    case IOTXN_OP_READ:
+        cache_read(dev, txn);
+        break;
+    case IOTXN_OP_WRITE:
+        cache_write(dev, txn);
+        break;
+    default:
+        iotxn_queue(dev->parent, txn);
+        break;
+    }
+}
+
+static mx_off_t cache_getsize(void* ctx) {
+    cache_device_t* dev = ctx;
+    return device_op_get_size(dev->parent);
+}
+
+static void cache_unbind(void* ctx) {
+    cache_device_t* dev = ctx;
+    device_remove(dev->mxdev);
+}
+
+static void cache_release(void* ctx) {
+    cache_device_t* dev = ctx;
+    cache_free_locked(dev);
+    free(dev);
+}
+
+static mx_protocol_device_t cache_proto = {
+    .version = DEVICE_OPS_VERSION,
+    .ioctl = cache_ioctl,
+    .iotxn_queue = cache_iotxn_queue,
+    .get_size = cache_getsize,
+    .unbind = cache_unbind,
+    .release = cache_release,
+};
+
+static void cache_block_set_callbacks(mx_device_t* mxdev, block_callbacks_t* cb) {
+    cache_device_t* dev = mxdev->ctx;
+    dev->callbacks = cb;
+}
+
+static void cache_block_get_info(mx_device_t* mxdev, block_info_t* info) {
+    cache_device_t* dev = mxdev->ctx;
+    memcpy(info, &dev->info, sizeof(*info));
+}
+
+static void cache_block_complete(iotxn_t* txn, void* cookie) {
+    cache_device_t* dev;
+    memcpy(&dev, txn->extra, sizeof(cache_device_t*));
+    dev->callbacks->complete(cookie, txn->status);
+    iotxn_release(txn);
+}
+
+static void block_do_txn(cache_device_t* dev, uint32_t opcode, mx_handle_t vmo, uint64_t length,
+                         uint64_t vmo_offset, uint64_t dev_offset, void* cookie) {
+    block_info_t* info = &dev->info;
+    if ((dev_offset % info->block_size) || (length % info->block_size)) {
+        dev->callbacks->complete(cookie, ERR_INVALID_ARGS);
+        return;
+    }
+    uint64_t size = info->block_count * info->block_size;
+    if ((dev_offset >= size) || (length > (size - dev_offset))) {
+        dev->callbacks->complete(cookie, ERR_OUT_OF_RANGE);
+        return;
+    }
+
+    mx_status_t status;
+    iotxn_t* txn;
+    if ((status = iotxn_alloc_vmo(&txn, IOTXN_ALLOC_POOL, vmo, vmo_offset, length)) != NO_ERROR) {
+        dev->callbacks->complete(cookie, status);
+        return;
+    }
+    txn->opcode = opcode;
+    txn->length = length;
+    txn->offset = dev_offset;
+    txn->complete_cb = cache_block_complete;
+    txn->cookie = cookie;
+    memcpy(txn->extra, &dev, sizeof(cache_device_t*));
+    cache_iotxn_queue(dev, txn);
+}
+
+static void cache_block_read(mx_device_t* mxdev, mx_handle_t vmo, uint64_t length,
+                             uint64_t vmo_offset, uint64_t dev_offset, void* cookie) {
+    block_do_txn(mxdev->ctx, IOTXN_OP_READ, vmo, length, vmo_offset, dev_offset, cookie);
+}
+
+static void cache_block_write(mx_device_t* mxdev, mx_handle_t vmo, uint64_t length,
+                              uint64_t vmo_offset, uint64_t dev_offset, void* cookie) {
+    block_do_txn(mxdev->ctx, IOTXN_OP_WRITE, vmo, length, vmo_offset, dev_offset, cookie);
+}
+
+static void cache_block_poll(mx_device_t* mxdev) {
+    // misses and writes complete through the parent, so poll it
+    cache_device_t* dev = mxdev->ctx;
+    block_ops_t* ops;
+    if (device_op_get_protocol(dev->parent, MX_PROTOCOL_BLOCK_CORE, (void**)&ops) == NO_ERROR &&
+        ops->poll != NULL) {
+        ops->poll(dev->parent);
+    }
+}
+
+static block_ops_t cache_block_ops = {
+    .set_callbacks = cache_block_set_callbacks,
+    .get_info = cache_block_get_info,
+    .read = cache_block_read,
+    .write = cache_block_write,
+    .poll = cache_block_poll,
+};
+
+static mx_status_t cache_bind(mx_driver_t* drv, mx_device_t* parent, void** cookie) {
+    cache_device_t* dev = calloc(1, sizeof(cache_device_t));
+    if (!dev) {
+        return ERR_NO_MEMORY;
+    }
+    dev->parent = parent;
+    dev->vmo = MX_HANDLE_INVALID;
+    mtx_init(&dev->lock, mtx_plain);
+    list_initialize(&dev->lru);
+    list_initialize(&dev->free);
+    list_initialize(&dev->fills);
+
+    size_t actual = 0;
+    mx_status_t status = device_op_ioctl(parent, IOCTL_BLOCK_GET_INFO, NULL, 0, &dev->info,
+                                         sizeof(dev->info), &actual);
+    if (status < 0) {
+        goto fail;
+    } else if (actual != sizeof(dev->info) || dev->info.block_size == 0) {
+        status = ERR_INTERNAL;
+        goto fail;
+    }
+
+    // lines are whole blocks; use the block size itself if it doesn't divide
+    // the default line
+    dev->line_size = CACHE_LINE_SIZE;
+    if (dev->info.block_size >= CACHE_LINE_SIZE || CACHE_LINE_SIZE % dev->info.block_size) {
+        dev->line_size = dev->info.block_size;
+    }
+    dev->dev_lines = (dev->info.block_count * dev->info.block_size) / dev->line_size;
+    dev->readahead = CACHE_DEFAULT_READAHEAD;
+    if ((status = cache_alloc_locked(dev, CACHE_DEFAULT_CAPACITY)) != NO_ERROR) {
+        goto fail;
+    }
+
+    char name[MX_DEVICE_NAME_MAX + 1];
+    snprintf(name, sizeof(name), "%s (cached)", device_get_name(parent));
+
+    device_add_args_t args = {
+        .version = DEVICE_ADD_ARGS_VERSION,
+        .name = name,
+        .ctx = dev,
+        .driver = drv,
+        .ops = &cache_proto,
+        .proto_id = MX_PROTOCOL_BLOCK_CORE,
+        .proto_ops = &cache_block_ops,
+    };
+
+    if ((status = device_add(parent, &args, &dev->mxdev)) != NO_ERROR) {
+        goto fail;
+    }
+    return NO_ERROR;
+
+fail:
+    cache_free_locked(dev);
+    free(dev);
+    return status;
+}
+
+static mx_driver_ops_t cache_driver_ops = {
+    .version = DRIVER_OPS_VERSION,
+    .bind = cache_bind,
+};
+
+MAGENTA_DRIVER_BEGIN(bcache, cache_driver_ops, "magenta", "0.1", 2)
+    BI_ABORT_IF_AUTOBIND,
+    BI_MATCH_IF(EQ, BIND_PROTOCOL, MX_PROTOCOL_BLOCK),
+MAGENTA_DRIVER_END(bcache)
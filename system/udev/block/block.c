@@ -26,39 +26,50 @@ typedef struct blkdev {
     mx_device_t* mxdev;
     mx_device_t* parent;
     block_ops_t* blockops;
+} blkdev_t;
+
+// Every open of the block device gets its own instance, and with it its
+// own BlockServer, FIFO and server thread. Clients that each open the
+// device are served in parallel rather than funneling through one thread.
+typedef struct blkdev_instance {
+    mx_device_t* mxdev;
+    blkdev_t* bdev;
 
     mtx_t lock;
     BlockServer* bs;
     uint32_t flags;
     thrd_t bs_thread;
-} blkdev_t;
+} blkdev_instance_t;
+
+extern mx_driver_t _driver_block;
 
 static int blockserver_thread(void* arg) {
-    blkdev_t* bdev = (blkdev_t*)arg;
-    BlockServer* bs = bdev->bs;
-    blockserver_serve(bs, device_get_parent(bdev->mxdev), bdev->blockops);
+    blkdev_instance_t* inst = (blkdev_instance_t*)arg;
+    BlockServer* bs = inst->bs;
+    blockserver_serve(bs, inst->bdev->parent, inst->bdev->blockops);
 
-    mtx_lock(&bdev->lock);
-    bdev->bs = NULL;
-    bdev->flags |= FLAG_BG_THREAD_JOINABLE;
-    mtx_unlock(&bdev->lock);
+    mtx_lock(&inst->lock);
+    inst->bs = NULL;
+    inst->flags |= FLAG_BG_THREAD_JOINABLE;
+    mtx_unlock(&inst->lock);
 
     blockserver_free(bs);
     return 0;
 }
 
-static mx_status_t blkdev_get_fifos(blkdev_t* bdev, void* out_buf, size_t out_len) {
+static mx_status_t blkdev_get_fifos(blkdev_instance_t* inst, void* out_buf, size_t out_len) {
     if (out_len < sizeof(mx_handle_t)) {
         return ERR_INVALID_ARGS;
     }
     mx_status_t status;
-    mtx_lock(&bdev->lock);
-    if (bdev->bs != NULL) {
+    mtx_lock(&inst->lock);
+    if (inst->bs != NULL) {
         status = ERR_ALREADY_BOUND;
         goto done;
-    } else if (bdev->flags & FLAG_BG_THREAD_JOINABLE) {
+    } else if (inst->flags & FLAG_BG_THREAD_JOINABLE) {
         // Clean up the thread that came before us
-        thrd_join(bdev->bs_thread, NULL);
+        thrd_join(inst->bs_thread, NULL);
+        inst->flags &= ~FLAG_BG_THREAD_JOINABLE;
     }
 
     BlockServer* bs;
@@ -67,22 +78,22 @@ static mx_status_t blkdev_get_fifos(blkdev_t* bdev, void* out_buf, size_t out_le
     }
 
     // As soon as we launch a thread, the background thread is responsible
-    // for the blockserver in the bdev->bs field.
-    bdev->bs = bs;
-    if (thrd_create(&bdev->bs_thread, blockserver_thread, bdev) != thrd_success) {
+    // for the blockserver in the inst->bs field.
+    inst->bs = bs;
+    if (thrd_create(&inst->bs_thread, blockserver_thread, inst) != thrd_success) {
         blockserver_free(bs);
-        bdev->bs = NULL;
+        inst->bs = NULL;
         status = ERR_NO_MEMORY;
         goto done;
     }
 
     status = sizeof(mx_handle_t);
 done:
-    mtx_unlock(&bdev->lock);
+    mtx_unlock(&inst->lock);
     return status;
 }
 
-static mx_status_t blkdev_attach_vmo(blkdev_t* bdev,
+static mx_status_t blkdev_attach_vmo(blkdev_instance_t* inst,
                                  const void* in_buf, size_t in_len,
                                  void* out_buf, size_t out_len, size_t* out_actual) {
     if ((in_len < sizeof(mx_handle_t)) || (out_len < sizeof(vmoid_t))) {
@@ -90,24 +101,24 @@ static mx_status_t blkdev_attach_vmo(blkdev_t* bdev,
     }
 
     mx_status_t status;
-    mtx_lock(&bdev->lock);
-    if (bdev->bs == NULL) {
+    mtx_lock(&inst->lock);
+    if (inst->bs == NULL) {
         status = ERR_BAD_STATE;
         goto done;
     }
 
     mx_handle_t h = *(mx_handle_t*)in_buf;
-    if ((status = blockserver_attach_vmo(bdev->bs, h, out_buf)) != NO_ERROR) {
+    if ((status = blockserver_attach_vmo(inst->bs, h, out_buf)) != NO_ERROR) {
         goto done;
     }
     *out_actual = sizeof(vmoid_t);
 
 done:
-    mtx_unlock(&bdev->lock);
+    mtx_unlock(&inst->lock);
     return status;
 }
 
-static mx_status_t blkdev_alloc_txn(blkdev_t* bdev,
+static mx_status_t blkdev_alloc_txn(blkdev_instance_t* inst,
                                 const void* in_buf, size_t in_len,
                                 void* out_buf, size_t out_len, size_t* out_actual) {
     if ((in_len != 0) || (out_len < sizeof(txnid_t))) {
@@ -115,54 +126,60 @@ static mx_status_t blkdev_alloc_txn(blkdev_t* bdev,
     }
 
     mx_status_t status;
-    mtx_lock(&bdev->lock);
-    if (bdev->bs == NULL) {
+    mtx_lock(&inst->lock);
+    if (inst->bs == NULL) {
         status = ERR_BAD_STATE;
         goto done;
     }
 
-    if ((status = blockserver_allocate_txn(bdev->bs, out_buf)) != NO_ERROR) {
+    if ((status = blockserver_allocate_txn(inst->bs, out_buf)) != NO_ERROR) {
         goto done;
     }
     *out_actual = sizeof(vmoid_t);
 
 done:
-    mtx_unlock(&bdev->lock);
+    mtx_unlock(&inst->lock);
     return status;
 }
 
-static mx_status_t blkdev_free_txn(blkdev_t* bdev,
+static mx_status_t blkdev_free_txn(blkdev_instance_t* inst,
                                const void* in_buf, size_t in_len) {
     if (in_len != sizeof(txnid_t)) {
         return ERR_INVALID_ARGS;
     }
 
     mx_status_t status;
-    mtx_lock(&bdev->lock);
-    if (bdev->bs == NULL) {
+    mtx_lock(&inst->lock);
+    if (inst->bs == NULL) {
         status = ERR_BAD_STATE;
         goto done;
     }
 
     txnid_t txnid = *(txnid_t*)in_buf;
-    blockserver_free_txn(bdev->bs, txnid);
+    blockserver_free_txn(inst->bs, txnid);
     status = NO_ERROR;
 done:
-    mtx_unlock(&bdev->lock);
+    mtx_unlock(&inst->lock);
     return status;
 }
 
-static mx_status_t blkdev_fifo_close(blkdev_t* bdev) {
-    mtx_lock(&bdev->lock);
-    if (bdev->bs != NULL) {
-        blockserver_shutdown(bdev->bs);
-        mtx_unlock(&bdev->lock);
-        thrd_join(bdev->bs_thread, NULL);
-        bdev->bs = NULL;
-        bdev->flags &= ~FLAG_BG_THREAD_JOINABLE;
+static mx_status_t blkdev_fifo_close(blkdev_instance_t* inst) {
+    mtx_lock(&inst->lock);
+    if (inst->bs != NULL) {
+        blockserver_shutdown(inst->bs);
+        mtx_unlock(&inst->lock);
+        thrd_join(inst->bs_thread, NULL);
+        inst->bs = NULL;
+        inst->flags &= ~FLAG_BG_THREAD_JOINABLE;
+    } else if (inst->flags & FLAG_BG_THREAD_JOINABLE) {
+        // The server already exited; reap its thread, since instances
+        // come and go with every open
+        mtx_unlock(&inst->lock);
+        thrd_join(inst->bs_thread, NULL);
+        inst->flags &= ~FLAG_BG_THREAD_JOINABLE;
     } else {
         // No background thread running.
-        mtx_unlock(&bdev->lock);
+        mtx_unlock(&inst->lock);
     }
 
     return NO_ERROR;
@@ -172,31 +189,80 @@ static mx_status_t blkdev_fifo_close(blkdev_t* bdev) {
 
 static mx_status_t blkdev_ioctl(void* ctx, uint32_t op, const void* cmd,
                             size_t cmdlen, void* reply, size_t max, size_t* out_actual) {
-    blkdev_t* blkdev = ctx;
+    blkdev_instance_t* inst = ctx;
     switch (op) {
     case IOCTL_BLOCK_GET_FIFOS:
-        return blkdev_get_fifos(blkdev, reply, max);
+        return blkdev_get_fifos(inst, reply, max);
     case IOCTL_BLOCK_ATTACH_VMO:
-        return blkdev_attach_vmo(blkdev, cmd, cmdlen, reply, max, out_actual);
+        return blkdev_attach_vmo(inst, cmd, cmdlen, reply, max, out_actual);
     case IOCTL_BLOCK_ALLOC_TXN:
-        return blkdev_alloc_txn(blkdev, cmd, cmdlen, reply, max, out_actual);
+        return blkdev_alloc_txn(inst, cmd, cmdlen, reply, max, out_actual);
     case IOCTL_BLOCK_FREE_TXN:
-        return blkdev_free_txn(blkdev, cmd, cmdlen);
+        return blkdev_free_txn(inst, cmd, cmdlen);
     case IOCTL_BLOCK_FIFO_CLOSE:
-        return blkdev_fifo_close(blkdev);
+        return blkdev_fifo_close(inst);
     default:
-        return device_op_ioctl(blkdev->parent, op, cmd, cmdlen, reply, max, out_actual);
+        return device_op_ioctl(inst->bdev->parent, op, cmd, cmdlen, reply, max, out_actual);
     }
 }
 
 static void blkdev_iotxn_queue(void* ctx, iotxn_t* txn) {
-    blkdev_t* blkdev = ctx;
-    iotxn_queue(blkdev->parent, txn);
+    blkdev_instance_t* inst = ctx;
+    iotxn_queue(inst->bdev->parent, txn);
 }
 
 static mx_off_t blkdev_get_size(void* ctx) {
+    blkdev_instance_t* inst = ctx;
+    return device_op_get_size(inst->bdev->parent);
+}
+
+static void blkdev_instance_unbind(void* ctx) {
+    blkdev_instance_t* inst = ctx;
+    device_remove(inst->mxdev);
+}
+
+static void blkdev_instance_release(void* ctx) {
+    blkdev_instance_t* inst = ctx;
+    blkdev_fifo_close(inst);
+    free(inst);
+}
+
+static mx_protocol_device_t blkdev_instance_ops = {
+    .version = DEVICE_OPS_VERSION,
+    .ioctl = blkdev_ioctl,
+    .iotxn_queue = blkdev_iotxn_queue,
+    .get_size = blkdev_get_size,
+    .unbind = blkdev_instance_unbind,
+    .release = blkdev_instance_release,
+};
+
+static mx_status_t blkdev_open(void* ctx, mx_device_t** dev_out, uint32_t flags) {
     blkdev_t* blkdev = ctx;
-    return device_op_get_size(blkdev->parent);
+    blkdev_instance_t* inst;
+    if ((inst = calloc(1, sizeof(blkdev_instance_t))) == NULL) {
+        return ERR_NO_MEMORY;
+    }
+    mtx_init(&inst->lock, mtx_plain);
+    inst->bdev = blkdev;
+
+    device_add_args_t args = {
+        .version = DEVICE_ADD_ARGS_VERSION,
+        .name = "block",
+        .ctx = inst,
+        .driver = &_driver_block,
+        .ops = &blkdev_instance_ops,
+        .proto_id = MX_PROTOCOL_BLOCK,
+        .flags = DEVICE_ADD_INSTANCE,
+    };
+
+    mx_status_t status;
+    if ((status = device_add(blkdev->mxdev, &args, &inst->mxdev)) != NO_ERROR) {
+        free(inst);
+        return status;
+    }
+
+    *dev_out = inst->mxdev;
+    return NO_ERROR;
 }
 
 static void blkdev_unbind(void* ctx) {
@@ -206,15 +272,34 @@ static void blkdev_unbind(void* ctx) {
 
 static void blkdev_release(void* ctx) {
     blkdev_t* blkdev = ctx;
-    blkdev_fifo_close(blkdev);
     free(blkdev);
 }
 
+// The device itself has no FIFO server; those live in its instances. It
+// still passes everything else through for the drivers bound on top of it
+// (gpt, mbr, align), which talk to it directly rather than through an open.
+static mx_status_t blkdev_base_ioctl(void* ctx, uint32_t op, const void* cmd,
+                                     size_t cmdlen, void* reply, size_t max, size_t* out_actual) {
+    blkdev_t* blkdev = ctx;
+    return device_op_ioctl(blkdev->parent, op, cmd, cmdlen, reply, max, out_actual);
+}
+
+static void blkdev_base_iotxn_queue(void* ctx, iotxn_t* txn) {
+    blkdev_t* blkdev = ctx;
+    iotxn_queue(blkdev->parent, txn);
+}
+
+static mx_off_t blkdev_base_get_size(void* ctx) {
+    blkdev_t* blkdev = ctx;
+    return device_op_get_size(blkdev->parent);
+}
+
 static mx_protocol_device_t blkdev_ops = {
     .version = DEVICE_OPS_VERSION,
-    .ioctl = blkdev_ioctl,
-    .iotxn_queue = blkdev_iotxn_queue,
-    .get_size = blkdev_get_size,
+    .open = blkdev_open,
+    .ioctl = blkdev_base_ioctl,
+    .iotxn_queue = blkdev_base_iotxn_queue,
+    .get_size = blkdev_base_get_size,
     .unbind = blkdev_unbind,
     .release = blkdev_release,
 };
@@ -224,7 +309,6 @@ static mx_status_t block_driver_bind(mx_driver_t* drv, mx_device_t* dev, void**
     if ((bdev = calloc(1, sizeof(blkdev_t))) == NULL) {
         return ERR_NO_MEMORY;
     }
-    mtx_init(&bdev->lock, mtx_plain);
     bdev->parent = dev;
 
     mx_status_t status;
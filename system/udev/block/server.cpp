@@ -6,6 +6,7 @@
 
 #include <stdbool.h>
 #include <string.h>
+#include <sys/param.h>
 
 #include <magenta/compiler.h>
 #include <magenta/device/block.h>
@@ -117,15 +118,34 @@ void BlockTransaction::RespondLocked() {
 IoBuffer::IoBuffer(mx_handle_t vmo, vmoid_t id) : io_vmo_(vmo), vmoid_(id) {}
 
 IoBuffer::~IoBuffer() {
+    if (pinned_) {
+        mx_vmo_op_range(io_vmo_, MX_VMO_OP_UNLOCK, 0, pinned_size_, nullptr, 0);
+    }
     mx_handle_close(io_vmo_);
 }
 
-mx_status_t IoBuffer::ValidateVmoHack(uint64_t length, uint64_t vmo_offset) {
+mx_status_t IoBuffer::Pin() {
     uint64_t vmo_size;
     mx_status_t status;
     if ((status = mx_vmo_get_size(io_vmo_, &vmo_size)) != NO_ERROR) {
         return status;
-    } else if (length + vmo_offset > vmo_size) {
+    } else if (vmo_size == 0) {
+        return NO_ERROR;
+    }
+    status = mx_vmo_op_range(io_vmo_, MX_VMO_OP_LOCK, 0, vmo_size, nullptr, 0);
+    if (status == NO_ERROR) {
+        pinned_ = true;
+    } else if (status != ERR_NOT_SUPPORTED) {
+        return status;
+    }
+    // VMOs that can't be pinned, such as physical ones, can't be resized
+    // either.
+    pinned_size_ = vmo_size;
+    return NO_ERROR;
+}
+
+mx_status_t IoBuffer::ValidateVmo(uint64_t length, uint64_t vmo_offset) {
+    if (length > pinned_size_ || vmo_offset > pinned_size_ - length) {
         return ERR_INVALID_ARGS;
     }
     return NO_ERROR;
@@ -162,6 +182,9 @@ mx_status_t BlockServer::AttachVmo(mx_handle_t vmo, vmoid_t* out) {
     if (!ac.check()) {
         return ERR_NO_MEMORY;
     }
+    if ((status = ibuf->Pin()) != NO_ERROR) {
+        return status;
+    }
     tree_.insert(mxtl::move(ibuf));
     *out = id;
     return NO_ERROR;
@@ -212,11 +235,64 @@ mx_status_t BlockServer::Create(mx_handle_t* fifo_out, BlockServer** out) {
 
 void blockserver_fifo_complete(void* cookie, mx_status_t status) {
     block_msg_t* msg = static_cast<block_msg_t*>(cookie);
+    BlockServer* server = msg->server;
     // Since iobuf is a RefPtr, it lives at least as long as the txn,
     // and is not discarded underneath the block device driver.
     msg->iobuf = nullptr;
     msg->txn->Complete(status);
     msg->txn = nullptr;
+    msg->server = nullptr;
+    if (server != nullptr) {
+        server->MessageComplete();
+    }
+}
+
+// Batches at most this large are polled for; bigger transfers take long
+// enough that the interrupt path is not what dominates.
+constexpr uint64_t kPollMaxBytes = 1 << 16;
+
+// Bounds on how long Serve spins on the driver before going back to
+// waiting on the FIFO and leaving completions to the interrupt thread.
+constexpr mx_duration_t kPollBudgetMin = MX_USEC(2);
+constexpr mx_duration_t kPollBudgetMax = MX_USEC(50);
+constexpr mx_duration_t kPollBudgetInitial = MX_USEC(10);
+
+void BlockServer::PollCompletions(mx_device_t* dev, block_ops_t* ops) {
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    mx_duration_t elapsed = 0;
+    while (in_flight_.load() > 0) {
+        ops->poll(dev);
+        elapsed = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+        if (in_flight_.load() == 0) {
+            break;
+        }
+        if (elapsed > poll_budget_) {
+            // The device is slower than we bet on; spin less next time
+            poll_budget_ = MAX(poll_budget_ / 2, kPollBudgetMin);
+            return;
+        }
+    }
+
+    // Everything came back while polling. Track how long that takes and
+    // allow twice as much, so the budget follows the device's latency.
+    poll_latency_ = (poll_latency_ * 7 + elapsed) / 8;
+    poll_budget_ = MIN(MAX(poll_latency_ * 2, kPollBudgetMin), kPollBudgetMax);
+}
+
+// Longest run of requests that Serve will hand to the driver as one.
+constexpr uint64_t kMaxMergeLength = 1 << 17;
+
+// Returns true if "next" continues "req" (which has grown to "length"
+// bytes so far) in both the VMO and on the device, so that the two can
+// be issued to the driver as a single read or write.
+static bool CanMerge(const block_fifo_request_t* req, uint64_t length,
+                     const block_fifo_request_t* next) {
+    return ((next->opcode & BLOCKIO_OP_MASK) == (req->opcode & BLOCKIO_OP_MASK)) &&
+           (next->txnid == req->txnid) &&
+           (next->vmoid == req->vmoid) &&
+           (next->vmo_offset == req->vmo_offset + length) &&
+           (next->dev_offset == req->dev_offset + length) &&
+           (length + next->length <= kMaxMergeLength);
 }
 
 static block_callbacks_t cb = {
@@ -237,9 +313,15 @@ mx_status_t BlockServer::Serve(mx_device_t* dev, block_ops_t* ops) {
     }
     while (true) {
         if ((status = do_read(fifo, &requests[0], &count)) != NO_ERROR) {
+            // Completions still in flight point back at this server, which
+            // the caller frees as soon as we return
+            while (in_flight_.load() > 0) {
+                mx_nanosleep(mx_deadline_after(MX_MSEC(1)));
+            }
             return status;
         }
 
+        uint64_t submitted = 0;
         for (size_t i = 0; i < count; i++) {
             bool wants_reply = requests[i].opcode & BLOCKIO_TXN_END;
             txnid_t txnid = requests[i].txnid;
@@ -265,6 +347,18 @@ mx_status_t BlockServer::Serve(mx_device_t* dev, block_ops_t* ops) {
             switch (requests[i].opcode & BLOCKIO_OP_MASK) {
             case BLOCKIO_READ:
             case BLOCKIO_WRITE: {
+                // Small sequential requests (e.g. a filesystem reading
+                // neighbouring blocks) that arrive in the same batch go
+                // down to the driver as one larger command.
+                const block_fifo_request_t* req = &requests[i];
+                uint64_t length = req->length;
+                while (!wants_reply && (i + 1 < count) &&
+                       CanMerge(req, length, &requests[i + 1])) {
+                    i++;
+                    length += requests[i].length;
+                    wants_reply = requests[i].opcode & BLOCKIO_TXN_END;
+                }
+
                 block_msg_t* msg;
                 status = txns_[txnid]->Enqueue(wants_reply, &msg);
                 if (status != NO_ERROR) {
@@ -272,22 +366,24 @@ mx_status_t BlockServer::Serve(mx_device_t* dev, block_ops_t* ops) {
                 }
                 msg->txn = txns_[txnid];
                 msg->iobuf = iobuf.CopyPointer();
+                msg->server = nullptr;
 
-                // Hack to ensure that the vmo is valid.
-                // In the future, this code will be responsible for pinning VMO pages,
-                // and the completion will be responsible for un-pinning those same pages.
-                status = iobuf->ValidateVmoHack(requests[i].length, requests[i].vmo_offset);
+                // The pages were pinned when the vmo was attached.
+                status = iobuf->ValidateVmo(length, req->vmo_offset);
                 if (status != NO_ERROR) {
                     cb.complete(msg, status);
                     break;
                 }
 
-                if ((requests[i].opcode & BLOCKIO_OP_MASK) == BLOCKIO_READ) {
-                    ops->read(dev, iobuf->io_vmo_, requests[i].length,
-                              requests[i].vmo_offset, requests[i].dev_offset, msg);
+                msg->server = this;
+                in_flight_.fetch_add(1);
+                submitted += length;
+                if ((req->opcode & BLOCKIO_OP_MASK) == BLOCKIO_READ) {
+                    ops->read(dev, iobuf->io_vmo_, length,
+                              req->vmo_offset, req->dev_offset, msg);
                 } else {
-                    ops->write(dev, iobuf->io_vmo_, requests[i].length,
-                               requests[i].vmo_offset, requests[i].dev_offset, msg);
+                    ops->write(dev, iobuf->io_vmo_, length,
+                               req->vmo_offset, req->dev_offset, msg);
                 }
                 break;
             }
@@ -309,10 +405,15 @@ mx_status_t BlockServer::Serve(mx_device_t* dev, block_ops_t* ops) {
             }
             }
         }
+
+        if ((ops->poll != nullptr) && (submitted > 0) && (submitted <= kPollMaxBytes)) {
+            PollCompletions(dev, ops);
+        }
     }
 }
 
-BlockServer::BlockServer() : fifo_(MX_HANDLE_INVALID), last_id(0) {}
+BlockServer::BlockServer() : fifo_(MX_HANDLE_INVALID), last_id(0), in_flight_(0),
+    poll_budget_(kPollBudgetInitial), poll_latency_(kPollBudgetInitial / 2) {}
 BlockServer::~BlockServer() {
     ShutDown();
 }
@@ -14,6 +14,7 @@
 
 #ifdef __cplusplus
 
+#include <mxtl/atomic.h>
 #include <mxtl/intrusive_wavl_tree.h>
 #include <mxtl/mutex.h>
 #include <mxtl/ref_counted.h>
@@ -26,14 +27,16 @@ class IoBuffer : public mxtl::WAVLTreeContainable<mxtl::RefPtr<IoBuffer>>,
 public:
     vmoid_t GetKey() const { return vmoid_; }
 
-    // TODO(smklein): This function is currently labelled 'hack' since we have
-    // no way to ensure that the size of the VMO won't change in between
-    // checking it and using it.  This will require a mechanism to "pin" VMO pages.
-    mx_status_t ValidateVmoHack(uint64_t length, uint64_t vmo_offset);
+    // Ensures that the range lies within the pinned part of the VMO, which
+    // can't be decommitted or shrunk out from under the device.
+    mx_status_t ValidateVmo(uint64_t length, uint64_t vmo_offset);
 
     IoBuffer(mx_handle_t vmo, vmoid_t vmoid);
     ~IoBuffer();
 
+    // Pins the whole VMO, so its pages stay put for as long as it is attached.
+    mx_status_t Pin();
+
 private:
     friend class BlockServer;
     friend struct TypeWAVLTraits;
@@ -41,15 +44,20 @@ private:
 
     const mx_handle_t io_vmo_;
     const vmoid_t vmoid_;
+    // Size of the VMO when it was pinned, which it can't shrink below.
+    uint64_t pinned_size_ = 0;
+    bool pinned_ = false;
 };
 
 constexpr uint32_t kTxnFlagRespond = 0x00000001; // Should a reponse be sent when we hit goal?
 
 class BlockTransaction;
+class BlockServer;
 
 typedef struct {
     mxtl::RefPtr<BlockTransaction> txn;
     mxtl::RefPtr<IoBuffer> iobuf;
+    BlockServer* server;
 } block_msg_t;
 
 class BlockTransaction : public mxtl::RefCounted<BlockTransaction> {
@@ -94,6 +102,9 @@ public:
 
     void ShutDown();
 
+    // Called as each message handed to the driver completes.
+    void MessageComplete() { in_flight_.fetch_sub(1); }
+
     ~BlockServer();
 private:
     DISALLOW_COPY_ASSIGN_AND_MOVE(BlockServer);
@@ -101,6 +112,15 @@ private:
 
     mx_status_t FindVmoIDLocked(vmoid_t* out);
 
+    // Spins on the driver's poll op for a short while after submitting, so
+    // that fast completions are reaped here instead of by the interrupt
+    // thread. The budget adapts to what this device has been doing.
+    void PollCompletions(mx_device_t* dev, block_ops_t* ops);
+
+    mxtl::atomic<uint32_t> in_flight_;
+    mx_duration_t poll_budget_;
+    mx_duration_t poll_latency_; // moving average of polled completions
+
     mxtl::Mutex server_lock_;
     mx_handle_t fifo_;
     mxtl::WAVLTree<vmoid_t, mxtl::RefPtr<IoBuffer>> tree_;
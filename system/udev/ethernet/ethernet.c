@@ -18,7 +18,7 @@
 #include <string.h>
 #include <threads.h>
 
-#define FIFO_DEPTH 256
+#define FIFO_DEPTH ETH_FIFO_MAX_DEPTH
 #define FIFO_ESIZE sizeof(eth_fifo_entry_t)
 
 #define TRACE 0
@@ -34,6 +34,26 @@
 // ensure that we will not exceed fifo capacity
 static_assert((FIFO_DEPTH * FIFO_ESIZE) <= 4096, "");
 
+// shared rx buffer: slots of at least 2K, and a cap on how many a client
+// may hold which keeps its rx fifo from overflowing
+#define RX_SLOTS 512
+#define RX_SLOT_MIN_SIZE 2048
+#define RX_MAX_HELD(edev) ((edev)->rx_depth / 2)
+
+// frames handed to the clients, or to the ethmac, in one go
+#define RX_BATCH 64
+#define TX_BATCH (FIFO_DEPTH / 2)
+
+#define ETH_TYPE_IP4   0x0800
+#define ETH_TYPE_IP6   0x86DD
+#define ETH_TYPE_VLAN  0x8100
+
+#define IP_PROTO_TCP   6
+#define IP_PROTO_UDP   17
+#define IP_PROTO_ICMP6 58
+
+typedef struct ethdev ethdev_t;
+
 // ethernet device
 typedef struct ethdev0 {
     // shared state
@@ -55,6 +75,18 @@ typedef struct ethdev0 {
     ethmac_info_t info;
 
     mx_device_t* mxdev;
+
+    // rx buffer shared by the clients that ask for it, so a packet is
+    // copied once no matter how many of them there are
+    mx_handle_t rx_vmo;
+    uint8_t* rx_buf;
+    uint32_t rx_slot_size;
+    uint32_t rx_next;
+    // how many clients have yet to return each slot
+    uint16_t rx_refs[RX_SLOTS];
+
+    // the client whose rss configuration the ethmac is using
+    ethdev_t* rss_owner;
 } ethdev0_t;
 
 static void eth0_downref(ethdev0_t* edev0) {
@@ -62,6 +94,13 @@ static void eth0_downref(ethdev0_t* edev0) {
     edev0->refcount--;
     if (edev0->refcount == 0) {
         mtx_unlock(&edev0->lock);
+        if (edev0->rx_buf) {
+            mx_vmar_unmap(mx_vmar_root_self(), (uintptr_t)edev0->rx_buf,
+                          RX_SLOTS * edev0->rx_slot_size);
+        }
+        if (edev0->rx_vmo) {
+            mx_handle_close(edev0->rx_vmo);
+        }
         free(edev0);
     } else {
         mtx_unlock(&edev0->lock);
@@ -83,8 +122,11 @@ static void eth0_downref(ethdev0_t* edev0) {
 // This client wants to observe loopback tx packets
 #define ETHDEV_TX_LISTEN (16u)
 
+// This client receives into the shared rx buffer
+#define ETHDEV_RX_SHARED (32u)
+
 // ethernet instance device
-typedef struct ethdev {
+struct ethdev {
     list_node_t node;
 
     ethdev0_t* edev0;
@@ -109,20 +151,66 @@ typedef struct ethdev {
 
     mx_device_t* mxdev;
 
+    // shared rx slots sent to this client and not yet returned
+    uint32_t rx_held;
+    uint32_t rx_held_map[RX_SLOTS / 32];
+
+    // receive side scaling: packets are spread over rss_queues rx
+    // fifos by flow; rss_fifo[0] is unused, that queue is rx_fifo
+    uint32_t rss_queues;
+    mx_handle_t rss_fifo[ETH_RSS_MAX_QUEUES];
+    uint8_t rss_key[ETH_RSS_KEY_SIZE];
+    uint8_t rss_table[ETH_RSS_TABLE_SIZE];
+
     uint32_t fail_rx_read;
     uint32_t fail_rx_write;
     uint32_t fail_tx_write;
-} ethdev_t;
+};
 
 #define FAIL_REPORT_RATE 50
 
-static void eth_handle_rx(ethdev_t* edev, const void* data, size_t len, uint32_t extra) {
-    eth_fifo_entry_t e;
+// A packet on its way to the clients; copied into a shared slot the first
+// time a shared client needs it.
+typedef struct eth_rx_packet {
+    const void* data;
+    size_t len;
+    int slot;
+    uint32_t flags;
+    // rx queue the ethmac steered it to
+    uint32_t queue;
+} eth_rx_packet_t;
+
+#define RX_SLOT_NONE (-1)
+#define RX_SLOT_DROPPED (-2)
+
+static void eth_rx_write_locked(ethdev_t* edev, mx_handle_t fifo,
+                                eth_fifo_entry_t* entries, uint32_t n) {
+    mx_status_t status;
+    uint32_t count;
+    if ((status = mx_fifo_write(fifo, entries, sizeof(*entries) * n, &count)) < 0) {
+        if (status == ERR_SHOULD_WAIT) {
+            if ((edev->fail_rx_write++ % FAIL_REPORT_RATE) == 0) {
+                printf("eth: no rx_fifo space available (%u times)\n",
+                       edev->fail_rx_write);
+            }
+        } else {
+            // Fatal, should force teardown
+            printf("eth: rx_fifo write failed %d\n", status);
+        }
+    } else if (count != n) {
+        printf("eth: rx_fifo: only wrote %u of %u!\n", count, n);
+    }
+}
+
+// Copies up to RX_BATCH packets into rx buffers the client queued, with
+// one fifo read for the buffers and one fifo write for the completions.
+static void eth_handle_rx(ethdev_t* edev, mx_handle_t fifo, eth_rx_packet_t* pkts, uint32_t n,
+                          uint32_t extra) {
+    eth_fifo_entry_t entries[RX_BATCH];
     mx_status_t status;
     uint32_t count;
 
-    // TODO: read multiple and cache locally to reduce syscalls
-    if ((status = mx_fifo_read(edev->rx_fifo, &e, sizeof(e), &count)) < 0) {
+    if ((status = mx_fifo_read(fifo, entries, sizeof(*entries) * n, &count)) < 0) {
         if (status == ERR_SHOULD_WAIT) {
             if ((edev->fail_rx_read++ % FAIL_REPORT_RATE) == 0) {
                 printf("eth: no rx buffers available (%u times)\n",
@@ -134,22 +222,126 @@ static void eth_handle_rx(ethdev_t* edev, const void* data, size_t len, uint32_t
         }
         return;
     }
+    if ((count < n) && ((edev->fail_rx_read++ % FAIL_REPORT_RATE) == 0)) {
+        printf("eth: no rx buffers available (%u times)\n", edev->fail_rx_read);
+    }
 
-    if ((e.offset >= edev->io_size) || ((e.length > (edev->io_size - e.offset)))) {
-        // invalid offset/length. report error. drop packet
-        e.length = 0;
-        e.flags = ETH_FIFO_INVALID;
-    } else if (len > e.length) {
-        e.length = 0;
-        e.flags = ETH_FIFO_INVALID;
-    } else {
-        // packet fits. deliver it
-        memcpy(edev->io_buf + e.offset, data, len);
-        e.length = len;
-        e.flags = ETH_FIFO_RX_OK | extra;
+    for (uint32_t i = 0; i < count; i++) {
+        eth_fifo_entry_t* e = entries + i;
+        if ((e->offset >= edev->io_size) || ((e->length > (edev->io_size - e->offset)))) {
+            // invalid offset/length. report error. drop packet
+            e->length = 0;
+            e->flags = ETH_FIFO_INVALID;
+        } else if (pkts[i].len > e->length) {
+            e->length = 0;
+            e->flags = ETH_FIFO_INVALID;
+        } else {
+            // packet fits. deliver it
+            memcpy(edev->io_buf + e->offset, pkts[i].data, pkts[i].len);
+            e->length = pkts[i].len;
+            e->flags = ETH_FIFO_RX_OK | pkts[i].flags | extra;
+        }
+    }
+
+    eth_rx_write_locked(edev, fifo, entries, count);
+}
+
+static void eth_rx_put_locked(ethdev_t* edev, uint32_t slot) {
+    edev->rx_held_map[slot / 32] &= ~(1u << (slot % 32));
+    edev->rx_held--;
+    edev->edev0->rx_refs[slot]--;
+}
+
+// Takes back the shared slots the client has written back to its rx fifo.
+static void eth_rx_reclaim_locked(ethdev_t* edev) {
+    ethdev0_t* edev0 = edev->edev0;
+    eth_fifo_entry_t entries[FIFO_DEPTH / 2];
+    uint32_t count;
+    while (edev->rx_held > 0 &&
+           mx_fifo_read(edev->rx_fifo, entries, sizeof(entries), &count) == NO_ERROR) {
+        for (uint32_t n = 0; n < count; n++) {
+            uint32_t slot = entries[n].offset / edev0->rx_slot_size;
+            // ignore anything that isn't a slot this client holds
+            if ((entries[n].offset % edev0->rx_slot_size) || (slot >= RX_SLOTS) ||
+                !(edev->rx_held_map[slot / 32] & (1u << (slot % 32)))) {
+                continue;
+            }
+            eth_rx_put_locked(edev, slot);
+        }
+        if (count < countof(entries)) {
+            break;
+        }
+    }
+}
+
+// Gives back every slot the client still holds, when it goes away.
+static void eth_rx_release_all_locked(ethdev_t* edev) {
+    for (uint32_t slot = 0; edev->rx_held > 0 && slot < RX_SLOTS; slot++) {
+        if (edev->rx_held_map[slot / 32] & (1u << (slot % 32))) {
+            eth_rx_put_locked(edev, slot);
+        }
+    }
+}
+
+static int eth_rx_alloc_slot_locked(ethdev0_t* edev0) {
+    for (uint32_t n = 0; n < RX_SLOTS; n++) {
+        uint32_t slot = (edev0->rx_next + n) % RX_SLOTS;
+        if (edev0->rx_refs[slot] == 0) {
+            edev0->rx_next = slot + 1;
+            return slot;
+        }
+    }
+    return RX_SLOT_DROPPED;
+}
+
+static void eth_handle_rx_shared(ethdev_t* edev, eth_rx_packet_t* pkts, uint32_t n,
+                                 uint32_t extra) {
+    ethdev0_t* edev0 = edev->edev0;
+    eth_fifo_entry_t entries[RX_BATCH];
+    mx_status_t status;
+    uint32_t count = 0;
+
+    eth_rx_reclaim_locked(edev);
+    for (uint32_t i = 0; i < n; i++) {
+        eth_rx_packet_t* pkt = pkts + i;
+        if (edev->rx_held + count >= RX_MAX_HELD(edev)) {
+            if ((edev->fail_rx_read++ % FAIL_REPORT_RATE) == 0) {
+                printf("eth: shared rx buffers not returned (%u times)\n", edev->fail_rx_read);
+            }
+            break;
+        }
+
+        if (pkt->slot == RX_SLOT_NONE) {
+            if (pkt->len <= edev0->rx_slot_size) {
+                pkt->slot = eth_rx_alloc_slot_locked(edev0);
+            } else {
+                pkt->slot = RX_SLOT_DROPPED;
+            }
+            if (pkt->slot >= 0) {
+                // the batch holds it until every client has been offered it
+                edev0->rx_refs[pkt->slot]++;
+                memcpy(edev0->rx_buf + pkt->slot * edev0->rx_slot_size, pkt->data, pkt->len);
+            }
+        }
+        if (pkt->slot < 0) {
+            if ((edev->fail_rx_read++ % FAIL_REPORT_RATE) == 0) {
+                printf("eth: no shared rx buffers available (%u times)\n", edev->fail_rx_read);
+            }
+            continue;
+        }
+
+        entries[count].offset = pkt->slot * edev0->rx_slot_size;
+        entries[count].length = pkt->len;
+        entries[count].flags = ETH_FIFO_RX_OK | pkt->flags | extra;
+        entries[count].cookie = NULL;
+        count++;
+    }
+    if (count == 0) {
+        return;
     }
 
-    if ((status = mx_fifo_write(edev->rx_fifo, &e, sizeof(e), &count)) < 0) {
+    uint32_t actual = 0;
+    if ((status = mx_fifo_write(edev->rx_fifo, entries, sizeof(*entries) * count, &actual)) < 0) {
         if (status == ERR_SHOULD_WAIT) {
             if ((edev->fail_rx_write++ % FAIL_REPORT_RATE) == 0) {
                 printf("eth: no rx_fifo space available (%u times)\n",
@@ -159,8 +351,130 @@ static void eth_handle_rx(ethdev_t* edev, const void* data, size_t len, uint32_t
             // Fatal, should force teardown
             printf("eth: rx_fifo write failed %d\n", status);
         }
+        actual = 0;
+    }
+    for (uint32_t i = 0; i < actual; i++) {
+        uint32_t slot = entries[i].offset / edev0->rx_slot_size;
+        edev->rx_held_map[slot / 32] |= 1u << (slot % 32);
+        edev->rx_held++;
+        edev0->rx_refs[slot]++;
+    }
+}
+
+// Drops the batch's hold on the shared slots its packets were copied into.
+static void eth_rx_batch_done_locked(ethdev0_t* edev0, eth_rx_packet_t* pkts, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        if (pkts[i].slot >= 0) {
+            edev0->rx_refs[pkts[i].slot]--;
+        }
+    }
+}
+
+// The Toeplitz hash of RSS, over the flow's addresses and ports.
+static uint32_t eth_rss_hash(const uint8_t* key, const uint8_t* data, size_t len) {
+    uint32_t hash = 0;
+    uint32_t window = (key[0] << 24) | (key[1] << 16) | (key[2] << 8) | key[3];
+    for (size_t i = 0; i < len; i++) {
+        for (int bit = 7; bit >= 0; bit--) {
+            if (data[i] & (1u << bit)) {
+                hash ^= window;
+            }
+            window <<= 1;
+            if ((i + 4 < ETH_RSS_KEY_SIZE) && (key[i + 4] & (1u << bit))) {
+                window |= 1;
+            }
+        }
+    }
+    return hash;
+}
+
+// Picks the rx queue of a packet in software; anything that isn't
+// IPv4 or IPv6 goes to queue 0.
+static uint32_t eth_rss_queue(ethdev_t* edev, const uint8_t* data, size_t len) {
+    uint8_t tuple[36];
+    size_t tlen;
+    size_t hdr = 14;
+    if (len < hdr) {
+        return 0;
+    }
+    uint16_t type = (data[12] << 8) | data[13];
+    if (type == ETH_TYPE_VLAN) {
+        hdr += 4;
+        if (len < hdr) {
+            return 0;
+        }
+        type = (data[16] << 8) | data[17];
+    }
+
+    size_t l4;
+    uint8_t proto;
+    if (type == ETH_TYPE_IP4) {
+        if (len < hdr + 20) {
+            return 0;
+        }
+        memcpy(tuple, data + hdr + 12, 8);
+        tlen = 8;
+        l4 = hdr + (data[hdr] & 0x0f) * 4;
+        proto = data[hdr + 9];
+        // only the first fragment has the ports
+        if ((data[hdr + 6] & 0x3f) || data[hdr + 7]) {
+            proto = 0;
+        }
+    } else if (type == ETH_TYPE_IP6) {
+        if (len < hdr + 40) {
+            return 0;
+        }
+        memcpy(tuple, data + hdr + 8, 32);
+        tlen = 32;
+        l4 = hdr + 40;
+        proto = data[hdr + 6];
+    } else {
+        return 0;
+    }
+    if (((proto == IP_PROTO_TCP) || (proto == IP_PROTO_UDP)) && (len >= l4 + 4)) {
+        memcpy(tuple + tlen, data + l4, 4);
+        tlen += 4;
+    }
+
+    uint32_t hash = eth_rss_hash(edev->rss_key, tuple, tlen);
+    return edev->rss_table[hash % ETH_RSS_TABLE_SIZE] % edev->rss_queues;
+}
+
+static void eth_deliver_locked(ethdev_t* edev, eth_rx_packet_t* pkts, uint32_t n,
+                               uint32_t extra) {
+    if (edev->state & ETHDEV_RX_SHARED) {
+        eth_handle_rx_shared(edev, pkts, n, extra);
+        return;
+    }
+    if (edev->rss_queues <= 1) {
+        eth_handle_rx(edev, edev->rx_fifo, pkts, n, extra);
         return;
     }
+
+    // steer each packet to its queue's fifo, batching per queue; the
+    // ethmac has already picked queues if it is using our configuration
+    bool hw = (edev->edev0->rss_owner == edev) && !(extra & ETH_FIFO_RX_TX);
+    uint8_t queue[RX_BATCH];
+    for (uint32_t i = 0; i < n; i++) {
+        queue[i] = hw ? (pkts[i].queue % edev->rss_queues) :
+                        eth_rss_queue(edev, pkts[i].data, pkts[i].len);
+    }
+    eth_rx_packet_t batch[RX_BATCH];
+    for (uint32_t q = 0; q < edev->rss_queues; q++) {
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            if (queue[i] == q) {
+                batch[count++] = pkts[i];
+            }
+        }
+        if (count > 0) {
+            mx_handle_t fifo = edev->rss_fifo[q];
+            if ((q == 0) || (fifo == MX_HANDLE_INVALID)) {
+                fifo = edev->rx_fifo;
+            }
+            eth_handle_rx(edev, fifo, batch, count, extra);
+        }
+    }
 }
 
 static void eth0_status(void* cookie, uint32_t status) {
@@ -169,30 +483,53 @@ static void eth0_status(void* cookie, uint32_t status) {
 
 // TODO: I think if this arrives at the wrong time during teardown we
 // can deadlock with the ethermac device
-static void eth0_recv(void* cookie, void* data, size_t len, uint32_t flags) {
+static void eth0_recv_batch(void* cookie, ethmac_frame_t* frames, size_t count,
+                            uint32_t flags) {
     ethdev0_t* edev0 = cookie;
+    eth_rx_packet_t pkts[RX_BATCH];
 
-    ethdev_t* edev;
     mtx_lock(&edev0->lock);
-    list_for_every_entry(&edev0->list_active, edev, ethdev_t, node) {
-        eth_handle_rx(edev, data, len, 0);
+    while (count > 0) {
+        uint32_t n = (count > RX_BATCH) ? RX_BATCH : count;
+        for (uint32_t i = 0; i < n; i++) {
+            pkts[i].data = frames[i].data;
+            pkts[i].len = frames[i].length;
+            pkts[i].slot = RX_SLOT_NONE;
+            pkts[i].flags = ((frames[i].flags | flags) & ETHMAC_RX_CSUM_OK) ?
+                            ETH_FIFO_RX_CSUM_OK : 0;
+            pkts[i].queue = ETHMAC_RX_QUEUE(frames[i].flags | flags);
+        }
+        ethdev_t* edev;
+        list_for_every_entry(&edev0->list_active, edev, ethdev_t, node) {
+            eth_deliver_locked(edev, pkts, n, 0);
+        }
+        eth_rx_batch_done_locked(edev0, pkts, n);
+        frames += n;
+        count -= n;
     }
     mtx_unlock(&edev0->lock);
 }
 
+static void eth0_recv(void* cookie, void* data, size_t len, uint32_t flags) {
+    ethmac_frame_t frame = { .data = data, .length = len, .flags = flags };
+    eth0_recv_batch(cookie, &frame, 1, flags);
+}
+
 static ethmac_ifc_t ethmac_ifc = {
     .status = eth0_status,
     .recv = eth0_recv,
+    .recv_batch = eth0_recv_batch,
 };
 
-static void eth_tx_echo(ethdev0_t* edev0, const void* data, size_t len) {
+static void eth_tx_echo(ethdev0_t* edev0, eth_rx_packet_t* pkts, uint32_t n) {
     ethdev_t* edev;
     mtx_lock(&edev0->lock);
     list_for_every_entry(&edev0->list_active, edev, ethdev_t, node) {
         if (edev->state & ETHDEV_TX_LISTEN) {
-            eth_handle_rx(edev, data, len, ETH_FIFO_RX_TX);
+            eth_deliver_locked(edev, pkts, n, ETH_FIFO_RX_TX);
         }
     }
+    eth_rx_batch_done_locked(edev0, pkts, n);
     mtx_unlock(&edev0->lock);
 }
 
@@ -226,10 +563,123 @@ static mx_status_t eth_tx_listen_locked(ethdev_t* edev, bool yes) {
     return NO_ERROR;
 }
 
+// Finds the TCP, UDP or ICMPv6 checksum of an IPv4 or IPv6 frame, and
+// where the datagram ends.  Returns the protocol, or 0 if there is none
+// we know how to complete.
+static uint8_t eth_csum_locate(const uint8_t* data, size_t len, uint16_t* start,
+                               uint16_t* offset, size_t* end) {
+    size_t hdr = 14;
+    if (len < hdr) {
+        return 0;
+    }
+    uint16_t type = (data[12] << 8) | data[13];
+    if (type == ETH_TYPE_VLAN) {
+        hdr += 4;
+        if (len < hdr) {
+            return 0;
+        }
+        type = (data[16] << 8) | data[17];
+    }
+
+    uint8_t proto;
+    size_t l4;
+    if (type == ETH_TYPE_IP4) {
+        if (len < hdr + 20) {
+            return 0;
+        }
+        // a fragment can't be checksummed on its own
+        if ((data[hdr + 6] & 0x3f) || data[hdr + 7]) {
+            return 0;
+        }
+        l4 = hdr + (data[hdr] & 0x0f) * 4;
+        *end = hdr + ((data[hdr + 2] << 8) | data[hdr + 3]);
+        proto = data[hdr + 9];
+    } else if (type == ETH_TYPE_IP6) {
+        if (len < hdr + 40) {
+            return 0;
+        }
+        // extension headers are not walked
+        l4 = hdr + 40;
+        *end = l4 + ((data[hdr + 4] << 8) | data[hdr + 5]);
+        proto = data[hdr + 6];
+    } else {
+        return 0;
+    }
+
+    switch (proto) {
+    case IP_PROTO_TCP:
+        *offset = 16;
+        break;
+    case IP_PROTO_UDP:
+        *offset = 6;
+        break;
+    case IP_PROTO_ICMP6:
+        if (type != ETH_TYPE_IP6) {
+            return 0;
+        }
+        *offset = 2;
+        break;
+    default:
+        return 0;
+    }
+    if ((*end > len) || (l4 + *offset + 2 > *end)) {
+        return 0;
+    }
+    *start = l4;
+    return proto;
+}
+
+static void eth_csum_complete(uint8_t* data, size_t start, size_t end, size_t field, bool udp) {
+    uint32_t sum = 0;
+    uint16_t word;
+    size_t n;
+    for (n = start; n + 1 < end; n += 2) {
+        memcpy(&word, data + n, 2);
+        sum += word;
+    }
+    if (n < end) {
+        word = 0;
+        memcpy(&word, data + n, 1);
+        sum += word;
+    }
+    while (sum > 0xffff) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    word = ~sum;
+    // for udp, 0 means no checksum at all
+    if (udp && (word == 0)) {
+        word = 0xffff;
+    }
+    memcpy(data + field, &word, 2);
+}
+
+// Completes the checksum of an ETH_FIFO_TX_CSUM frame, or marks it for
+// the ethmac to.  Looped back frames are always done here, so listeners
+// see what went on the wire.
+static void eth_tx_csum(ethdev_t* edev, ethmac_frame_t* frame) {
+    ethdev0_t* edev0 = edev->edev0;
+    uint16_t start, offset;
+    size_t end;
+    uint8_t proto = eth_csum_locate(frame->data, frame->length, &start, &offset, &end);
+    if (proto == 0) {
+        return;
+    }
+    if ((edev0->info.features & ETHMAC_FEATURE_TX_CSUM) && edev0->macops->send_batch &&
+        (proto != IP_PROTO_ICMP6) && (end == frame->length) &&
+        !(edev->state & ETHDEV_TX_LOOPBACK)) {
+        frame->flags = ETHMAC_FRAME_TX_CSUM;
+        frame->csum_start = start;
+        frame->csum_offset = offset;
+    } else {
+        eth_csum_complete(frame->data, start, end, start + offset, proto == IP_PROTO_UDP);
+    }
+}
+
 static int eth_tx_thread(void* arg) {
     ethdev_t* edev = (ethdev_t*)arg;
     ethdev0_t* edev0 = edev->edev0;
-    eth_fifo_entry_t entries[FIFO_DEPTH / 2];
+    eth_fifo_entry_t entries[TX_BATCH];
+    ethmac_frame_t frames[TX_BATCH];
     mx_status_t status;
     uint32_t count;
 
@@ -251,16 +701,43 @@ static int eth_tx_thread(void* arg) {
             }
         }
 
+        // hand every valid frame to the ethmac at once, then
+        // complete the whole batch with a single fifo write
         uint32_t n = count;
+        uint32_t nframes = 0;
         for (eth_fifo_entry_t* e = entries; count-- > 0; e++) {
             if ((e->offset > edev->io_size) || ((e->length > (edev->io_size - e->offset)))) {
                 e->flags = ETH_FIFO_INVALID;
             } else {
-                edev0->macops->send(edev0->mac, 0, edev->io_buf + e->offset, e->length);
+                ethmac_frame_t* frame = frames + nframes++;
+                frame->data = edev->io_buf + e->offset;
+                frame->length = e->length;
+                frame->flags = 0;
+                if (e->flags & ETH_FIFO_TX_CSUM) {
+                    eth_tx_csum(edev, frame);
+                }
                 e->flags = ETH_FIFO_TX_OK;
-                if (edev->state & ETHDEV_TX_LOOPBACK) {
-                    eth_tx_echo(edev0, edev->io_buf + e->offset, e->length);
+            }
+        }
+        if (edev0->macops->send_batch) {
+            edev0->macops->send_batch(edev0->mac, 0, frames, nframes);
+        } else {
+            for (uint32_t i = 0; i < nframes; i++) {
+                edev0->macops->send(edev0->mac, 0, frames[i].data, frames[i].length);
+            }
+        }
+        if (edev->state & ETHDEV_TX_LOOPBACK) {
+            eth_rx_packet_t pkts[RX_BATCH];
+            for (uint32_t i = 0; i < nframes; i += RX_BATCH) {
+                uint32_t k;
+                for (k = 0; (k < RX_BATCH) && (i + k < nframes); k++) {
+                    pkts[k].data = frames[i + k].data;
+                    pkts[k].len = frames[i + k].length;
+                    pkts[k].slot = RX_SLOT_NONE;
+                    pkts[k].flags = 0;
+                    pkts[k].queue = 0;
                 }
+                eth_tx_echo(edev0, pkts, k);
             }
         }
 
@@ -284,6 +761,26 @@ static int eth_tx_thread(void* arg) {
     return 0;
 }
 
+static mx_status_t eth_set_fifo_depths_locked(ethdev_t* edev, const void* in_buf,
+                                              size_t in_len) {
+    if (in_len < sizeof(eth_fifo_depths_t)) {
+        return ERR_INVALID_ARGS;
+    }
+    if (edev->tx_fifo != MX_HANDLE_INVALID) {
+        return ERR_ALREADY_BOUND;
+    }
+    const eth_fifo_depths_t* depths = in_buf;
+    uint32_t tx = depths->tx_depth ? depths->tx_depth : FIFO_DEPTH;
+    uint32_t rx = depths->rx_depth ? depths->rx_depth : FIFO_DEPTH;
+    // the fifo itself insists on a power of two
+    if ((tx > FIFO_DEPTH) || (tx & (tx - 1)) || (rx > FIFO_DEPTH) || (rx & (rx - 1))) {
+        return ERR_OUT_OF_RANGE;
+    }
+    edev->tx_depth = tx;
+    edev->rx_depth = rx;
+    return NO_ERROR;
+}
+
 static mx_status_t eth_get_fifos_locked(ethdev_t* edev, void* out_buf, size_t out_len,
                                     size_t* out_actual) {
     if (out_len < sizeof(eth_fifos_t)) {
@@ -295,12 +792,21 @@ static mx_status_t eth_get_fifos_locked(ethdev_t* edev, void* out_buf, size_t ou
 
     eth_fifos_t* fifos = out_buf;
 
+    if (edev->tx_depth == 0) {
+        edev->tx_depth = FIFO_DEPTH;
+    }
+    if (edev->rx_depth == 0) {
+        edev->rx_depth = FIFO_DEPTH;
+    }
+
     mx_status_t status;
-    if ((status = mx_fifo_create(FIFO_DEPTH, FIFO_ESIZE, 0, &fifos->tx_fifo, &edev->tx_fifo)) < 0) {
+    if ((status = mx_fifo_create(edev->tx_depth, FIFO_ESIZE, 0,
+                                 &fifos->tx_fifo, &edev->tx_fifo)) < 0) {
         fprintf(stderr, "eth_create: failed to create tx fifo: %d\n", status);
         return status;
     }
-    if ((status = mx_fifo_create(FIFO_DEPTH, FIFO_ESIZE, 0, &fifos->rx_fifo, &edev->rx_fifo)) < 0) {
+    if ((status = mx_fifo_create(edev->rx_depth, FIFO_ESIZE, 0,
+                                 &fifos->rx_fifo, &edev->rx_fifo)) < 0) {
         fprintf(stderr, "eth_create: failed to create rx fifo: %d\n", status);
         mx_handle_close(fifos->rx_fifo);
         mx_handle_close(edev->tx_fifo);
@@ -308,10 +814,8 @@ static mx_status_t eth_get_fifos_locked(ethdev_t* edev, void* out_buf, size_t ou
         return status;
     }
 
-    edev->tx_depth = FIFO_DEPTH;
-    edev->rx_depth = FIFO_DEPTH;
-    fifos->tx_depth = FIFO_DEPTH;
-    fifos->rx_depth = FIFO_DEPTH;
+    fifos->tx_depth = edev->tx_depth;
+    fifos->rx_depth = edev->rx_depth;
 
     *out_actual = sizeof(*fifos);
     return NO_ERROR;
@@ -352,6 +856,138 @@ fail:
     return status;
 }
 
+static mx_status_t eth_get_rx_vmo_locked(ethdev_t* edev, void* out_buf, size_t out_len,
+                                         size_t* out_actual) {
+    ethdev0_t* edev0 = edev->edev0;
+    if (out_len < sizeof(mx_handle_t)) {
+        return ERR_INVALID_ARGS;
+    }
+    if (edev->state & ETHDEV_RX_SHARED) {
+        return ERR_ALREADY_BOUND;
+    }
+    if (edev->rss_queues > 1) {
+        return ERR_BAD_STATE;
+    }
+
+    mx_status_t status;
+    if (edev0->rx_vmo == MX_HANDLE_INVALID) {
+        uint32_t slot_size = RX_SLOT_MIN_SIZE;
+        // room for the header, vlan tag and fcs on top of the mtu
+        while (slot_size < edev0->info.mtu + 64) {
+            slot_size *= 2;
+        }
+        size_t size = RX_SLOTS * slot_size;
+        mx_handle_t vmo;
+        if ((status = mx_vmo_create(size, 0, &vmo)) < 0) {
+            return status;
+        }
+        uintptr_t buf;
+        if ((status = mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, size,
+                                  MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &buf)) < 0) {
+            printf("eth: could not map shared rx buffer: %d\n", status);
+            mx_handle_close(vmo);
+            return status;
+        }
+        edev0->rx_vmo = vmo;
+        edev0->rx_buf = (uint8_t*)buf;
+        edev0->rx_slot_size = slot_size;
+    }
+
+    // clients only ever read it
+    if ((status = mx_handle_duplicate(edev0->rx_vmo,
+                                      MX_RIGHT_READ | MX_RIGHT_MAP |
+                                      MX_RIGHT_DUPLICATE | MX_RIGHT_TRANSFER,
+                                      out_buf)) < 0) {
+        return status;
+    }
+    edev->state |= ETHDEV_RX_SHARED;
+    *out_actual = sizeof(mx_handle_t);
+    return NO_ERROR;
+}
+
+// the key most RSS implementations default to
+static const uint8_t eth_rss_default_key[ETH_RSS_KEY_SIZE] = {
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+    0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+    0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+    0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+    0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa,
+};
+
+static mx_status_t eth_set_rss_locked(ethdev_t* edev, const void* in_buf, size_t in_len) {
+    ethdev0_t* edev0 = edev->edev0;
+    if (in_len < sizeof(eth_rss_config_t)) {
+        return ERR_INVALID_ARGS;
+    }
+    const eth_rss_config_t* config = in_buf;
+    if ((config->queue_count == 0) || (config->queue_count > ETH_RSS_MAX_QUEUES)) {
+        return ERR_OUT_OF_RANGE;
+    }
+    if (edev->state & ETHDEV_RX_SHARED) {
+        return ERR_BAD_STATE;
+    }
+    // queues can be added but not taken away, as their fifos are out there
+    if (config->queue_count < edev->rss_queues) {
+        return ERR_BAD_STATE;
+    }
+
+    bool zero = true;
+    for (unsigned n = 0; n < ETH_RSS_KEY_SIZE; n++) {
+        if (config->key[n]) {
+            zero = false;
+            break;
+        }
+    }
+    memcpy(edev->rss_key, zero ? eth_rss_default_key : config->key, ETH_RSS_KEY_SIZE);
+    memcpy(edev->rss_table, config->table, ETH_RSS_TABLE_SIZE);
+    edev->rss_queues = config->queue_count;
+
+    // hand it to the ethmac if it can steer that many queues itself;
+    // only one client's configuration can be in the hardware at a time
+    if ((edev0->info.features & ETHMAC_FEATURE_RSS) && edev0->macops->set_rss &&
+        (edev0->info.rx_queues >= config->queue_count) &&
+        ((edev0->rss_owner == NULL) || (edev0->rss_owner == edev))) {
+        ethmac_rss_config_t hw = {
+            .queue_count = config->queue_count,
+        };
+        memcpy(hw.key, edev->rss_key, sizeof(hw.key));
+        memcpy(hw.table, edev->rss_table, sizeof(hw.table));
+        if (edev0->macops->set_rss(edev0->mac, &hw) == NO_ERROR) {
+            edev0->rss_owner = edev;
+        } else if (edev0->rss_owner == edev) {
+            edev0->rss_owner = NULL;
+        }
+    }
+    return NO_ERROR;
+}
+
+static mx_status_t eth_get_rx_queue_fifo_locked(ethdev_t* edev, const void* in_buf,
+                                                size_t in_len, void* out_buf, size_t out_len,
+                                                size_t* out_actual) {
+    if ((in_len < sizeof(uint32_t)) || (out_len < sizeof(mx_handle_t))) {
+        return ERR_INVALID_ARGS;
+    }
+    // queue 0 is the rx fifo from IOCTL_ETHERNET_GET_FIFOS
+    uint32_t queue = *((const uint32_t*)in_buf);
+    if ((queue == 0) || (queue >= edev->rss_queues)) {
+        return ERR_OUT_OF_RANGE;
+    }
+    if (edev->rx_fifo == MX_HANDLE_INVALID) {
+        return ERR_BAD_STATE;
+    }
+    if (edev->rss_fifo[queue] != MX_HANDLE_INVALID) {
+        return ERR_ALREADY_BOUND;
+    }
+
+    mx_status_t status;
+    if ((status = mx_fifo_create(edev->rx_depth, FIFO_ESIZE, 0,
+                                 out_buf, &edev->rss_fifo[queue])) < 0) {
+        return status;
+    }
+    *out_actual = sizeof(mx_handle_t);
+    return NO_ERROR;
+}
+
 static mx_status_t eth_start_locked(ethdev_t* edev) {
     ethdev0_t* edev0 = edev->edev0;
 
@@ -434,12 +1070,21 @@ static mx_status_t eth_ioctl(void* ctx, uint32_t op,
             if (edev->edev0->info.features & ETHMAC_FEATURE_WLAN) {
                 info->features |= ETH_FEATURE_WLAN;
             }
+            if (edev->edev0->info.features & ETHMAC_FEATURE_TX_CSUM) {
+                info->features |= ETH_FEATURE_TX_CSUM;
+            }
+            if (edev->edev0->info.features & ETHMAC_FEATURE_RX_CSUM) {
+                info->features |= ETH_FEATURE_RX_CSUM;
+            }
             info->mtu = edev->edev0->info.mtu;
             *out_actual = sizeof(*info);
             status = NO_ERROR;
         }
         break;
     }
+    case IOCTL_ETHERNET_SET_FIFO_DEPTHS:
+        status = eth_set_fifo_depths_locked(edev, in_buf, in_len);
+        break;
     case IOCTL_ETHERNET_GET_FIFOS:
         status = eth_get_fifos_locked(edev, out_buf, out_len, out_actual);
         break;
@@ -458,6 +1103,16 @@ static mx_status_t eth_ioctl(void* ctx, uint32_t op,
     case IOCTL_ETHERNET_TX_LISTEN_STOP:
         status = eth_tx_listen_locked(edev, false);
         break;
+    case IOCTL_ETHERNET_GET_RX_VMO:
+        status = eth_get_rx_vmo_locked(edev, out_buf, out_len, out_actual);
+        break;
+    case IOCTL_ETHERNET_SET_RSS:
+        status = eth_set_rss_locked(edev, in_buf, in_len);
+        break;
+    case IOCTL_ETHERNET_GET_RX_QUEUE_FIFO:
+        status = eth_get_rx_queue_fifo_locked(edev, in_buf, in_len,
+                                              out_buf, out_len, out_actual);
+        break;
     default:
         // TODO: consider if we want this under the edev0->lock or not
         status = device_op_ioctl(edev->edev0->mac, op, in_buf, in_len, out_buf, out_len, out_actual);
@@ -483,11 +1138,25 @@ static void eth_kill_locked(ethdev_t* edev) {
     // make sure any future ioctls or other ops will fail
     edev->state |= ETHDEV_DEAD;
 
+    // nothing will be returned any more
+    eth_rx_release_all_locked(edev);
+
+    // the ethmac's queue choices mean nothing to anyone else
+    if (edev->edev0->rss_owner == edev) {
+        edev->edev0->rss_owner = NULL;
+    }
+
     // try to convince clients to close us
     if (edev->rx_fifo) {
         mx_handle_close(edev->rx_fifo);
         edev->rx_fifo = MX_HANDLE_INVALID;
     }
+    for (unsigned n = 1; n < ETH_RSS_MAX_QUEUES; n++) {
+        if (edev->rss_fifo[n]) {
+            mx_handle_close(edev->rss_fifo[n]);
+            edev->rss_fifo[n] = MX_HANDLE_INVALID;
+        }
+    }
     if (edev->tx_fifo) {
         mx_handle_close(edev->tx_fifo);
         edev->tx_fifo = MX_HANDLE_INVALID;
@@ -496,26 +496,30 @@ static int vc_log_reader_thread(void* arg) {
         return -1;
     }
 
-    char buf[MX_LOG_RECORD_MAX];
-    mx_log_record_t* rec = (mx_log_record_t*)buf;
+    alignas(mx_log_record_t) static char buf[MX_LOG_RECORD_MAX * 16];
     mx_status_t status;
     for (;;) {
-        if ((status = mx_log_read(h, MX_LOG_RECORD_MAX, rec, 0)) < 0) {
+        if ((status = mx_log_read(h, sizeof(buf), buf, MX_LOG_READ_MULTIPLE)) < 0) {
             if (status == ERR_SHOULD_WAIT) {
                 mx_object_wait_one(h, MX_LOG_READABLE, MX_TIME_INFINITE, NULL);
                 continue;
             }
             break;
         }
-        char tmp[64];
-        snprintf(tmp, 64, "\033[32m%05d.%03d\033[39m] \033[31m%05" PRIu64 ".\033[36m%05" PRIu64 "\033[39m> ",
-                 (int)(rec->timestamp / 1000000000ULL),
-                 (int)((rec->timestamp / 1000000ULL) % 1000ULL),
-                 rec->pid, rec->tid);
-        vc_device_write(dev, tmp, strlen(tmp), 0);
-        vc_device_write(dev, rec->data, rec->datalen, 0);
-        if ((rec->datalen == 0) || (rec->data[rec->datalen - 1] != '\n')) {
-            vc_device_write(dev, "\n", 1, 0);
+        for (size_t off = 0; off < static_cast<size_t>(status);) {
+            auto rec = reinterpret_cast<mx_log_record_t*>(buf + off);
+            off += MX_LOG_RECORD_SIZE(rec);
+
+            char tmp[64];
+            snprintf(tmp, 64, "\033[32m%05d.%03d\033[39m] \033[31m%05" PRIu64 ".\033[36m%05" PRIu64 "\033[39m> ",
+                     (int)(rec->timestamp / 1000000000ULL),
+                     (int)((rec->timestamp / 1000000ULL) % 1000ULL),
+                     rec->pid, rec->tid);
+            vc_device_write(dev, tmp, strlen(tmp), 0);
+            vc_device_write(dev, rec->data, rec->datalen, 0);
+            if ((rec->datalen == 0) || (rec->data[rec->datalen - 1] != '\n')) {
+                vc_device_write(dev, "\n", 1, 0);
+            }
         }
     }
 
@@ -600,7 +604,12 @@ static int vc_battery_dir_poll_thread(void* arg) {
 static mx_protocol_device_t vc_root_proto;
 
 static void display_flush(uint starty, uint endy) {
-    g_fb_display_protocol->flush(g_fb_device);
+    if (g_fb_display_protocol->flush_region) {
+        g_fb_display_protocol->flush_region(g_fb_device, 0, starty, g_hw_gfx.width,
+                                            endy - starty + 1);
+    } else {
+        g_fb_display_protocol->flush(g_fb_device);
+    }
 }
 
 static mx_status_t vc_root_bind(mx_driver_t* drv, mx_device_t* dev, void** cookie) {
@@ -245,11 +245,22 @@ static void gpt_block_write(mx_device_t* dev, mx_handle_t vmo, uint64_t length,
     block_do_txn((gptpart_device_t*)dev->ctx, IOTXN_OP_WRITE, vmo, length, vmo_offset, dev_offset, cookie);
 }
 
+static void gpt_block_poll(mx_device_t* dev) {
+    // our txns complete through the parent, so poll it
+    gptpart_device_t* device = dev->ctx;
+    block_ops_t* ops;
+    if (device_op_get_protocol(device->parent, MX_PROTOCOL_BLOCK_CORE, (void**)&ops) == NO_ERROR &&
+        ops->poll != NULL) {
+        ops->poll(device->parent);
+    }
+}
+
 static block_ops_t gpt_block_ops = {
     .set_callbacks = gpt_block_set_callbacks,
     .get_info = gpt_block_get_info,
     .read = gpt_block_read,
     .write = gpt_block_write,
+    .poll = gpt_block_poll,
 };
 
 static void gpt_read_sync_complete(iotxn_t* txn, void* cookie) {
@@ -11,6 +11,7 @@
 
 #include <magenta/assert.h>
 #include <magenta/listnode.h>
+#include <magenta/syscalls.h>
 
 #include <assert.h>
 #include <stdio.h>
@@ -31,6 +32,9 @@
     list_for_every_entry(&base->instance_list, instance, hid_instance_t, node)
 #define bits_to_bytes(n) (((n) + 7) / 8)
 
+// The most a report fifo may hold, which is as big as the kernel allows.
+#define HID_REPORT_FIFO_BYTES 4096
+
 // Until we do full HID parsing, we put mouse and keyboard devices into boot
 // protocol mode. In particular, a mouse will always send 3 byte reports (see
 // ddk/protocol/input.h for the format). This macro sets ioctl return values for
@@ -87,6 +91,12 @@ typedef struct hid_instance {
 
     mx_hid_fifo_t fifo;
 
+    // Once the reader has asked for its reports through a fifo, they go
+    // there instead of |fifo|.  Guarded by fifo.lock.
+    mx_handle_t report_fifo;
+    uint8_t* report_entry;
+    size_t report_entry_size;
+
     struct list_node node;
 } hid_instance_t;
 
@@ -229,19 +239,21 @@ static mx_status_t hid_get_report_size(hid_device_t* hid, const void* in_buf, si
     return NO_ERROR;
 }
 
+static input_report_size_t hid_get_max_input_report_bytes(hid_device_t* hid) {
+    input_report_size_t size = 0;
+    for (size_t i = 0; i < hid->num_reports; i++) {
+        if (hid->sizes[i].in_size > size)
+            size = hid->sizes[i].in_size;
+    }
+    return bits_to_bytes(size);
+}
+
 static ssize_t hid_get_max_input_reportsize(hid_device_t* hid, void* out_buf, size_t out_len,
                                             size_t* out_actual) {
     if (out_len < sizeof(input_report_size_t)) return ERR_INVALID_ARGS;
 
     input_report_size_t* reply = out_buf;
-
-    *reply = 0;
-    for (size_t i = 0; i < hid->num_reports; i++) {
-        if (hid->sizes[i].in_size > *reply)
-            *reply = hid->sizes[i].in_size;
-    }
-
-    *reply = bits_to_bytes(*reply);
+    *reply = hid_get_max_input_report_bytes(hid);
     *out_actual = sizeof(*reply);
     return NO_ERROR;
 }
@@ -277,6 +289,46 @@ static mx_status_t hid_set_report(hid_device_t* hid, const void* in_buf, size_t
 }
 
 
+static mx_status_t hid_get_report_fifo(hid_instance_t* hid, void* out_buf, size_t out_len,
+                                       size_t* out_actual) {
+    if (out_len < sizeof(mx_handle_t)) return ERR_INVALID_ARGS;
+
+    size_t entry_size = INPUT_FIFO_ENTRY_SIZE(hid_get_max_input_report_bytes(hid->base));
+    if (entry_size > HID_REPORT_FIFO_BYTES) return ERR_NOT_SUPPORTED;
+    uint32_t depth = 1;
+    while (depth * 2 * entry_size <= HID_REPORT_FIFO_BYTES) {
+        depth *= 2;
+    }
+
+    uint8_t* entry = calloc(1, entry_size);
+    if (entry == NULL) return ERR_NO_MEMORY;
+
+    mtx_lock(&hid->fifo.lock);
+    if (hid->report_fifo != MX_HANDLE_INVALID) {
+        mtx_unlock(&hid->fifo.lock);
+        free(entry);
+        return ERR_ALREADY_BOUND;
+    }
+    mx_handle_t remote;
+    mx_status_t status = mx_fifo_create(depth, entry_size, MX_FIFO_SHARED_RING,
+                                        &hid->report_fifo, &remote);
+    if (status != NO_ERROR) {
+        hid->report_fifo = MX_HANDLE_INVALID;
+        mtx_unlock(&hid->fifo.lock);
+        free(entry);
+        return status;
+    }
+    hid->report_entry = entry;
+    hid->report_entry_size = entry_size;
+    // read() has nothing more to give
+    device_state_clr(hid->mxdev, DEV_STATE_READABLE);
+    mtx_unlock(&hid->fifo.lock);
+
+    *(mx_handle_t*)out_buf = remote;
+    *out_actual = sizeof(remote);
+    return NO_ERROR;
+}
+
 static mx_status_t hid_read_instance(void* ctx, void* buf, size_t count, mx_off_t off,
                                      size_t* actual) {
     hid_instance_t* hid = ctx;
@@ -287,6 +339,10 @@ static mx_status_t hid_read_instance(void* ctx, void* buf, size_t count, mx_off_
 
     size_t left;
     mtx_lock(&hid->fifo.lock);
+    if (hid->report_fifo != MX_HANDLE_INVALID) {
+        mtx_unlock(&hid->fifo.lock);
+        return ERR_BAD_STATE;
+    }
     size_t xfer;
     uint8_t rpt_id;
     ssize_t r = mx_hid_fifo_peek(&hid->fifo, &rpt_id);
@@ -348,6 +404,8 @@ static mx_status_t hid_ioctl_instance(void* ctx, uint32_t op,
         return hid_get_report(hid->base, in_buf, in_len, out_buf, out_len, out_actual);
     case IOCTL_INPUT_SET_REPORT:
         return hid_set_report(hid->base, in_buf, in_len);
+    case IOCTL_INPUT_GET_REPORT_FIFO:
+        return hid_get_report_fifo(hid, out_buf, out_len, out_actual);
     }
     return ERR_NOT_SUPPORTED;
 }
@@ -384,6 +442,10 @@ static void hid_downref(hid_device_t* hid) {
 
 static void hid_release_instance(void* ctx) {
     hid_instance_t* hid = ctx;
+    if (hid->report_fifo != MX_HANDLE_INVALID) {
+        mx_handle_close(hid->report_fifo);
+    }
+    free(hid->report_entry);
     hid_downref(hid->base);
     free(hid);
 }
@@ -695,6 +757,7 @@ static mx_status_t hid_open_device(void* ctx, mx_device_t** dev_out, uint32_t fl
         return ERR_NO_MEMORY;
     }
     mx_hid_fifo_init(&inst->fifo);
+    inst->report_fifo = MX_HANDLE_INVALID;
 
     device_add_args_t args = {
         .version = DEVICE_ADD_ARGS_VERSION,
@@ -742,8 +805,24 @@ mx_protocol_device_t hid_device_proto = {
     .release = hid_release_device,
 };
 
+static ssize_t hid_write_report_fifo_locked(hid_instance_t* instance, const uint8_t* rbuf,
+                                            size_t rlen, mx_time_t timestamp) {
+    MX_DEBUG_ASSERT(sizeof(input_fifo_entry_t) + rlen <= instance->report_entry_size);
+
+    input_fifo_entry_t* entry = (input_fifo_entry_t*)instance->report_entry;
+    entry->timestamp = timestamp;
+    entry->len = (input_report_size_t)rlen;
+    memcpy(entry->data, rbuf, rlen);
+
+    uint32_t actual;
+    mx_status_t status = mx_fifo_write(instance->report_fifo, entry,
+                                       instance->report_entry_size, &actual);
+    return status == NO_ERROR ? (ssize_t)rlen : status;
+}
+
 void hid_io_queue(void* cookie, const uint8_t* buf, size_t len) {
     hid_device_t* hid = cookie;
+    mx_time_t now = mx_time_get(MX_CLOCK_MONOTONIC);
 
     mtx_lock(&hid->instance_lock);
 
@@ -816,8 +895,14 @@ void hid_io_queue(void* cookie, const uint8_t* buf, size_t len) {
         hid_instance_t* instance;
         foreach_instance(hid, instance) {
             mtx_lock(&instance->fifo.lock);
-            bool was_empty = mx_hid_fifo_size(&instance->fifo) == 0;
-            ssize_t wrote = mx_hid_fifo_write(&instance->fifo, rbuf, rlen);
+            bool was_empty = false;
+            ssize_t wrote;
+            if (instance->report_fifo != MX_HANDLE_INVALID) {
+                wrote = hid_write_report_fifo_locked(instance, rbuf, rlen, now);
+            } else {
+                was_empty = mx_hid_fifo_size(&instance->fifo) == 0;
+                wrote = mx_hid_fifo_write(&instance->fifo, rbuf, rlen);
+            }
 
             if (wrote <= 0) {
                 if (!(instance->flags & HID_FLAGS_WRITE_FAILED)) {
@@ -20,6 +20,11 @@
 typedef mx_status_t status_t;
 #include "ie.h"
 
+#define ETH_RX_BATCH 16
+
+// frames handled per poll before the lock is given up for a moment
+#define ETH_RX_BUDGET 64
+
 typedef struct ethernet_device {
     ethdev_t eth;
     mtx_t lock;
@@ -37,6 +42,38 @@ typedef struct ethernet_device {
     void* cookie;
 } ethernet_device_t;
 
+// Hands up to budget frames from the rx ring to the ethernet layer,
+// in batches, returning their buffers to the hardware once per batch.
+static unsigned eth_rx_poll_locked(ethernet_device_t* edev, unsigned budget, size_t* bytes) {
+    ethmac_frame_t frames[ETH_RX_BATCH];
+    unsigned total = 0;
+    unsigned count;
+    do {
+        for (count = 0; (count < ETH_RX_BATCH) && (total + count < budget); count++) {
+            bool csum_ok;
+            if (eth_rx_peek(&edev->eth, count, &frames[count].data,
+                            &frames[count].length, &csum_ok) != NO_ERROR) {
+                break;
+            }
+            frames[count].flags = csum_ok ? ETHMAC_RX_CSUM_OK : 0;
+            *bytes += frames[count].length;
+        }
+        if (count && edev->ifc) {
+            if (edev->ifc->recv_batch) {
+                edev->ifc->recv_batch(edev->cookie, frames, count, 0);
+            } else {
+                for (unsigned n = 0; n < count; n++) {
+                    edev->ifc->recv(edev->cookie, frames[n].data,
+                                    frames[n].length, frames[n].flags);
+                }
+            }
+        }
+        eth_rx_ack_many(&edev->eth, count);
+        total += count;
+    } while ((count == ETH_RX_BATCH) && (total < budget));
+    return total;
+}
+
 static int irq_thread(void* arg) {
     ethernet_device_t* edev = arg;
     for (;;) {
@@ -52,15 +89,34 @@ static int irq_thread(void* arg) {
 
         mtx_lock(&edev->lock);
         if (eth_handle_irq(&edev->eth) & ETH_IRQ_RX) {
-            void* data;
-            size_t len;
-
-            while (eth_rx(&edev->eth, &data, &len) == NO_ERROR) {
-                if (edev->ifc) {
-                    edev->ifc->recv(edev->cookie, data, len, 0);
+            // With the rx interrupt masked, poll the ring until it is
+            // empty, so a flood of packets costs one interrupt rather
+            // than one each.
+            unsigned packets = 0;
+            size_t bytes = 0;
+            eth_enable_rx_irq(&edev->eth, false);
+            for (;;) {
+                unsigned n = eth_rx_poll_locked(edev, ETH_RX_BUDGET, &bytes);
+                packets += n;
+                if (n == ETH_RX_BUDGET) {
+                    // still busy: let stop(), start() and friends in
+                    mtx_unlock(&edev->lock);
+                    thrd_yield();
+                    mtx_lock(&edev->lock);
+                    continue;
+                }
+                // drop causes raised while masked, unmask, and look once
+                // more for a frame that slipped in before the unmask
+                eth_handle_irq(&edev->eth);
+                eth_enable_rx_irq(&edev->eth, true);
+                void* data;
+                size_t len;
+                if (eth_rx(&edev->eth, &data, &len) != NO_ERROR) {
+                    break;
                 }
-                eth_rx_ack(&edev->eth);
+                eth_enable_rx_irq(&edev->eth, false);
             }
+            eth_update_itr(&edev->eth, packets, bytes);
         }
         mtx_unlock(&edev->lock);
 
@@ -78,6 +134,7 @@ static mx_status_t eth_query(mx_device_t* dev, uint32_t options, ethmac_info_t*
     }
 
     memset(info, 0, sizeof(*info));
+    info->features = ETHMAC_FEATURE_TX_CSUM | ETHMAC_FEATURE_RX_CSUM;
     info->mtu = ETH_RXBUF_SIZE; //TODO: not actually the mtu!
     memcpy(info->mac, edev->eth.mac, sizeof(edev->eth.mac));
 
@@ -112,11 +169,40 @@ static void eth_send(mx_device_t* dev, uint32_t options, void* data, size_t leng
     eth_tx(&edev->eth, data, length);
 }
 
+static void eth_send_batch(mx_device_t* dev, uint32_t options,
+                           ethmac_frame_t* frames, size_t count) {
+    ethernet_device_t* edev = dev->ctx;
+    eth_txbuf_t bufs[ETH_TXBUF_COUNT];
+    while (count > 0) {
+        unsigned n = (count > countof(bufs)) ? countof(bufs) : count;
+        for (unsigned i = 0; i < n; i++) {
+            bufs[i].data = frames[i].data;
+            bufs[i].len = frames[i].length;
+            bufs[i].csum = (frames[i].flags & ETHMAC_FRAME_TX_CSUM) &&
+                           (frames[i].csum_start + frames[i].csum_offset <= 0xff);
+            bufs[i].csum_start = frames[i].csum_start;
+            bufs[i].csum_field = frames[i].csum_start + frames[i].csum_offset;
+        }
+        mx_status_t status;
+        unsigned queued = eth_tx_many(&edev->eth, bufs, n, &status);
+        if (status == ERR_INVALID_ARGS) {
+            // drop the bad frame, as send() would, and carry on
+            queued++;
+        } else if (queued < n) {
+            // ring is full: the remaining frames are dropped
+            return;
+        }
+        frames += queued;
+        count -= queued;
+    }
+}
+
 static ethmac_protocol_t ethmac_ops = {
     .query = eth_query,
     .stop = eth_stop,
     .start = eth_start,
     .send = eth_send,
+    .send_batch = eth_send_batch,
 };
 
 static void eth_release(void* ctx) {
@@ -15,6 +15,7 @@
 #define IE_TXCW      0x0178 // TX Config Word
 #define IE_RXCW      0x0180 // RX Config Word
 #define IE_ICR       0x00C0 // Interrupt Cause Read
+#define IE_ITR       0x00C4 // Interrupt Throttling
 #define IE_ICS       0x00C8 // Interrupt Cause Set
 #define IE_IMS       0x00D0 // Interrupt Mask Set / Read
 #define IE_IMC       0x00D8 // Interrupt Mask Clear
@@ -103,6 +104,9 @@
 #define IE_RCTL_BSEX      (1 << 25) // Buffer Size Extension (x16)
 #define IE_RCTL_SECRC     (1 << 26) // Strip CRC Field
 
+#define IE_RXCSUM_IPOFL   (1 << 8) // IP Checksum Off-load Enable
+#define IE_RXCSUM_TUOFL   (1 << 9) // TCP/UDP Checksum Off-load Enable
+
 #define IE_TCTL_RST       (1 << 0) // TX Reset?
 #define IE_TCTL_EN        (1 << 1) // TX Enable
 #define IE_TCTL_PSP       (1 << 3) // Pad Short Packets (to 64b)
@@ -45,8 +45,53 @@ unsigned eth_handle_irq(ethdev_t* eth) {
     return readl(IE_ICR);
 }
 
+void eth_enable_rx_irq(ethdev_t* eth, bool enable) {
+    writel(IE_INT_RXT0, enable ? IE_IMS : IE_IMC);
+}
+
+static const uint32_t eth_itr_rate[] = {
+    [ETH_ITR_BULK] = 4000,
+    [ETH_ITR_LOW] = 20000,
+    [ETH_ITR_LOWEST] = 70000,
+};
+
+static void eth_set_itr(ethdev_t* eth, unsigned itr) {
+    // the interval is in units of 256ns
+    writel(1000000000 / (eth_itr_rate[itr] * 256), IE_ITR);
+    eth->itr = itr;
+}
+
+void eth_update_itr(ethdev_t* eth, unsigned packets, size_t bytes) {
+    if (packets == 0) {
+        return;
+    }
+    // many or large packets per interrupt: trade latency for fewer
+    // interrupts; a trickle of small ones: interrupt promptly
+    unsigned target;
+    if ((packets > 35) || (bytes > 25000)) {
+        target = ETH_ITR_BULK;
+    } else if ((bytes > 10000) || ((bytes / packets) > 1200)) {
+        target = ETH_ITR_LOW;
+    } else {
+        target = ETH_ITR_LOWEST;
+    }
+    if (target > eth->itr) {
+        eth_set_itr(eth, eth->itr + 1);
+    } else if (target < eth->itr) {
+        eth_set_itr(eth, eth->itr - 1);
+    }
+}
+
 status_t eth_rx(ethdev_t* eth, void** data, size_t* len) {
-    uint32_t n = eth->rx_rd_ptr;
+    bool csum_ok;
+    return eth_rx_peek(eth, 0, data, len, &csum_ok);
+}
+
+status_t eth_rx_peek(ethdev_t* eth, unsigned k, void** data, size_t* len, bool* csum_ok) {
+    if (k >= ETH_RXBUF_COUNT - 1) {
+        return ERR_SHOULD_WAIT;
+    }
+    uint32_t n = (eth->rx_rd_ptr + k) & (ETH_RXBUF_COUNT - 1);
     uint64_t info = eth->rxd[n].info;
 
     if (!(info & IE_RXD_DONE)) {
@@ -58,26 +103,48 @@ status_t eth_rx(ethdev_t* eth, void** data, size_t* len) {
 
     *data = eth->rxb + ETH_RXBUF_SIZE * n;
     *len = r;
+    *csum_ok = (info & IE_RXD_TCPCS) && !(info & (IE_RXD_IXSM | IE_RXD_TCPE | IE_RXD_IPE));
 
     return NO_ERROR;
 }
 
 void eth_rx_ack(ethdev_t* eth) {
+    eth_rx_ack_many(eth, 1);
+}
+
+void eth_rx_ack_many(ethdev_t* eth, unsigned count) {
+    if (count == 0) {
+        return;
+    }
     uint32_t n = eth->rx_rd_ptr;
+    uint32_t last = n;
 
-    // make buffer available to hw
-    eth->rxd[n].info = 0;
-    writel(n, IE_RDT);
-    n = (n + 1) & (ETH_RXBUF_COUNT - 1);
+    // make buffers available to hw, with a single tail update
+    while (count-- > 0) {
+        eth->rxd[n].info = 0;
+        last = n;
+        n = (n + 1) & (ETH_RXBUF_COUNT - 1);
+    }
+    writel(last, IE_RDT);
     eth->rx_rd_ptr = n;
 }
 
 status_t eth_tx(ethdev_t* eth, const void* data, size_t len) {
-    if ((len < 60) || (len > ETH_TXBUF_DSIZE)) {
-        return ERR_INVALID_ARGS;
+    eth_txbuf_t buf = {
+        .data = data,
+        .len = len,
+        .csum = false,
+    };
+    mx_status_t status = NO_ERROR;
+    if (eth_tx_many(eth, &buf, 1, &status) == 0) {
+        return status;
     }
+    return NO_ERROR;
+}
 
-    mx_status_t status = NO_ERROR;
+unsigned eth_tx_many(ethdev_t* eth, const eth_txbuf_t* bufs, unsigned count,
+                     mx_status_t* status) {
+    *status = NO_ERROR;
 
     mtx_lock(&eth->send_lock);
 
@@ -99,27 +166,41 @@ status_t eth_tx(ethdev_t* eth, const void* data, size_t len) {
     }
     eth->tx_rd_ptr = n;
 
-    // obtain buffer, copy into it, setup descriptor
-    framebuf_t *frame = list_remove_head_type(&eth->free_frames, framebuf_t, node);
-    if (frame == NULL) {
-        status = ERR_NO_MEMORY;
-        goto out;
-    }
-
+    // obtain buffers, copy into them, setup descriptors
+    unsigned queued = 0;
     n = eth->tx_wr_ptr;
-    memcpy(frame->data, data, len);
-    eth->txd[n].addr = frame->phys;
-    eth->txd[n].info = IE_TXD_LEN(len) | IE_TXD_EOP | IE_TXD_IFCS | IE_TXD_RS;
-    list_add_tail(&eth->busy_frames, &frame->node);
+    for (; queued < count; queued++) {
+        const void* data = bufs[queued].data;
+        size_t len = bufs[queued].len;
+        if ((len < 60) || (len > ETH_TXBUF_DSIZE)) {
+            *status = ERR_INVALID_ARGS;
+            break;
+        }
+        framebuf_t *frame = list_remove_head_type(&eth->free_frames, framebuf_t, node);
+        if (frame == NULL) {
+            *status = ERR_NO_MEMORY;
+            break;
+        }
+        memcpy(frame->data, data, len);
+        uint64_t info = IE_TXD_LEN(len) | IE_TXD_EOP | IE_TXD_IFCS | IE_TXD_RS;
+        if (bufs[queued].csum) {
+            info |= IE_TXD_IC | IE_TXD_CSS(bufs[queued].csum_start) |
+                    IE_TXD_CSO(bufs[queued].csum_field);
+        }
+        eth->txd[n].addr = frame->phys;
+        eth->txd[n].info = info;
+        list_add_tail(&eth->busy_frames, &frame->node);
+        n = (n + 1) & (ETH_TXBUF_COUNT - 1);
+    }
 
-    // inform hw of buffer availability
-    n = (n + 1) & (ETH_TXBUF_COUNT - 1);
-    eth->tx_wr_ptr = n;
-    writel(n, IE_TDT);
+    // inform hw of buffer availability, once for the whole batch
+    if (queued > 0) {
+        eth->tx_wr_ptr = n;
+        writel(n, IE_TDT);
+    }
 
-out:
     mtx_unlock(&eth->send_lock);
-    return status;
+    return queued;
 }
 
 status_t eth_reset_hw(ethdev_t* eth) {
@@ -153,7 +234,7 @@ void eth_init_hw(ethdev_t* eth) {
 
     // setup rx ring
     eth->rx_rd_ptr = 0;
-    writel(0, IE_RXCSUM);
+    writel(IE_RXCSUM_TUOFL | IE_RXCSUM_IPOFL, IE_RXCSUM);
     writel((4 << 0) | (1 << 8) | (1 << 16) | (1 << 24), IE_RXDCTL);
     writel(eth->rxd_phys, IE_RDBAL);
     writel(eth->rxd_phys >> 32, IE_RDBAH);
@@ -170,6 +251,8 @@ void eth_init_hw(ethdev_t* eth) {
     writel(ETH_TXBUF_COUNT * 16, IE_TDLEN);
     writel(IE_TCTL_CT(15) | IE_TCTL_COLD_FD | IE_TCTL_EN, IE_TCTL);
 
+    eth_set_itr(eth, ETH_ITR_LOW);
+
     // disable all irqs (write to "clear" mask)
     writel(0xFFFF, IE_IMC);
     // enable rx irq (write to "set" mask)
@@ -42,6 +42,9 @@ struct ethdev {
 
     uint8_t mac[6];
 
+    // current interrupt throttling level (ETH_ITR_*)
+    unsigned itr;
+
     mtx_t send_lock;
 };
 
@@ -68,7 +71,40 @@ void eth_dump_regs(ethdev_t* eth);
 status_t eth_rx(ethdev_t* eth, void** data, size_t* len);
 void eth_rx_ack(ethdev_t* eth);
 
+// Look at the k-th received but not yet acked frame, so several
+// can be handed up before their buffers are returned with one
+// eth_rx_ack_many() (and a single RDT write).
+// *csum_ok is set when the hardware found a good TCP/UDP checksum.
+status_t eth_rx_peek(ethdev_t* eth, unsigned k, void** data, size_t* len, bool* csum_ok);
+void eth_rx_ack_many(ethdev_t* eth, unsigned count);
+
+typedef struct eth_txbuf {
+    const void* data;
+    size_t len;
+    // if csum is set, the hardware completes the checksum stored at
+    // csum_field, summing from csum_start to the end of the frame
+    bool csum;
+    uint8_t csum_start;
+    uint8_t csum_field;
+} eth_txbuf_t;
+
 status_t eth_tx(ethdev_t* eth, const void* data, size_t len);
 
+// Queue up to count frames, updating TDT once for all of them.
+// Returns the number queued; if short, *status says why.
+unsigned eth_tx_many(ethdev_t* eth, const eth_txbuf_t* bufs, unsigned count,
+                     mx_status_t* status);
+
 #define ETH_IRQ_RX IE_INT_RXT0
 unsigned eth_handle_irq(ethdev_t* eth);
+
+// Mask or unmask the rx interrupt, for polling the ring with it off.
+void eth_enable_rx_irq(ethdev_t* eth, bool enable);
+
+// Interrupt throttling levels, from fewest interrupts to lowest
+// latency; eth_update_itr() moves between them one step at a
+// time based on what each interrupt turned out to deliver.
+#define ETH_ITR_BULK     0 //  4000 irqs/s
+#define ETH_ITR_LOW      1 // 20000 irqs/s
+#define ETH_ITR_LOWEST   2 // 70000 irqs/s
+void eth_update_itr(ethdev_t* eth, unsigned packets, size_t bytes);
@@ -11,10 +11,12 @@
 
 #include <assert.h>
 #include <magenta/syscalls.h>
+#include <magenta/syscalls/port.h>
 #include <magenta/types.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <threads.h>
 
 #define INTEL_I915_VID (0x8086)
 #define INTEL_I915_BROADWELL_DID (0x1616)
@@ -25,6 +27,35 @@
 #define BACKLIGHT_CTRL_OFFSET (0xc8250)
 #define BACKLIGHT_CTRL_BIT ((uint32_t)(1u << 31))
 
+// Pipe A's primary plane, which the bootloader left scanning out of the
+// framebuffer.  Writes to the surface address take effect at the next vblank.
+#define DSPASURF_OFFSET (0x7019c)
+#define DSPASURFLIVE_OFFSET (0x701ac)
+
+#define MASTER_IRQ_OFFSET (0x44200)
+#define MASTER_IRQ_CONTROL ((uint32_t)(1u << 31))
+#define MASTER_IRQ_DE_PIPE_A ((uint32_t)(1u << 16))
+
+#define DE_PIPE_A_IMR_OFFSET (0x44404)
+#define DE_PIPE_A_IIR_OFFSET (0x44408)
+#define DE_PIPE_A_IER_OFFSET (0x4440c)
+#define DE_PIPE_VBLANK ((uint32_t)(1u << 0))
+
+#define GFX_FLSH_CNTL_OFFSET (0x101008)
+#define GFX_FLSH_CNTL_EN (1u)
+
+// From gen8 on, the global GTT fills the upper half of the 16MB register
+// window, with one 64 bit entry per page.
+#define GTT_PTE_PRESENT (1u)
+
+// Imported buffers are mapped past the framebuffer window, each in a slot
+// aligned as the display engine wants surfaces to be.  Buffer 0 is the
+// bootloader's framebuffer.
+#define MAX_BUFFERS (8)
+#define BUFFER_GTT_BASE (INTEL_I915_FB_WINDOW_SIZE)
+#define BUFFER_GTT_ALIGN (256 * 1024)
+#define LOOKUP_PAGES (64)
+
 #define TRACE 0
 
 #if TRACE
@@ -47,9 +78,28 @@ typedef struct intel_i915_device {
 
     mx_display_info_t info;
     uint32_t flags;
+
+    // buffers which can be flipped to, guarded by lock
+    mtx_t lock;
+    struct {
+        bool in_use;
+        mx_handle_t vmo;
+        uint32_t gtt_offset;
+    } buffers[MAX_BUFFERS];
+    size_t buffer_size;
+
+    mx_handle_t irq_handle;
+    bool edge_triggered_irq;
+    thrd_t irq_thread;
+    volatile bool irq_stop;
+
+    // where vblanks are reported, if anywhere
+    mx_handle_t vsync_port;
+    uint64_t vsync_key;
 } intel_i915_device_t;
 
 #define FLAGS_BACKLIGHT 1
+#define FLAGS_FLIP 2
 
 static void intel_i915_enable_backlight(intel_i915_device_t* dev, bool enable) {
     if (dev->flags & FLAGS_BACKLIGHT) {
@@ -65,6 +115,289 @@ static void intel_i915_enable_backlight(intel_i915_device_t* dev, bool enable) {
     }
 }
 
+static uint32_t intel_i915_read32(intel_i915_device_t* dev, uint32_t offset) {
+    return pcie_read32((volatile uint32_t*)((uint8_t*)dev->regs + offset));
+}
+
+static void intel_i915_write32(intel_i915_device_t* dev, uint32_t offset, uint32_t val) {
+    pcie_write32((volatile uint32_t*)((uint8_t*)dev->regs + offset), val);
+}
+
+static uint32_t intel_i915_pixelsize(uint32_t format) {
+    switch (format) {
+    case MX_PIXEL_FORMAT_RGB_565:
+        return 2;
+    case MX_PIXEL_FORMAT_ARGB_8888:
+    case MX_PIXEL_FORMAT_RGB_x888:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+static void intel_i915_write_gtt(intel_i915_device_t* dev, uint32_t gtt_offset,
+                                 const mx_paddr_t* pages, size_t count) {
+    volatile uint64_t* gtt = (volatile uint64_t*)((uint8_t*)dev->regs + dev->regs_size / 2);
+    for (size_t i = 0; i < count; i++) {
+        gtt[gtt_offset / PAGE_SIZE + i] = pages ? (pages[i] | GTT_PTE_PRESENT) : 0;
+    }
+}
+
+static void intel_i915_flush_gtt(intel_i915_device_t* dev) {
+    intel_i915_write32(dev, GFX_FLSH_CNTL_OFFSET, GFX_FLSH_CNTL_EN);
+    intel_i915_read32(dev, GFX_FLSH_CNTL_OFFSET);
+}
+
+// Maps the framebuffer in |vmo| into the GTT at |gtt_offset|.
+static mx_status_t intel_i915_map_vmo(intel_i915_device_t* dev, mx_handle_t vmo,
+                                      uint32_t gtt_offset) {
+    mx_status_t status = mx_vmo_op_range(vmo, MX_VMO_OP_COMMIT, 0, dev->buffer_size, NULL, 0);
+    if (status != NO_ERROR) {
+        return status;
+    }
+
+    mx_paddr_t pages[LOOKUP_PAGES];
+    for (size_t off = 0; off < dev->buffer_size; off += LOOKUP_PAGES * PAGE_SIZE) {
+        size_t len = dev->buffer_size - off;
+        if (len > LOOKUP_PAGES * PAGE_SIZE)
+            len = LOOKUP_PAGES * PAGE_SIZE;
+        size_t count = (len + PAGE_SIZE - 1) / PAGE_SIZE;
+        status = mx_vmo_op_range(vmo, MX_VMO_OP_LOOKUP, off, len, pages, count * sizeof(mx_paddr_t));
+        if (status != NO_ERROR) {
+            intel_i915_write_gtt(dev, gtt_offset, NULL, off / PAGE_SIZE);
+            intel_i915_flush_gtt(dev);
+            return status;
+        }
+        intel_i915_write_gtt(dev, gtt_offset + (uint32_t)off, pages, count);
+    }
+    intel_i915_flush_gtt(dev);
+    return NO_ERROR;
+}
+
+// Whether a buffer is being scanned out, or is about to be.
+static bool intel_i915_buffer_busy_locked(intel_i915_device_t* dev, uint32_t id) {
+    uint32_t gtt_offset = dev->buffers[id].gtt_offset;
+    return intel_i915_read32(dev, DSPASURF_OFFSET) == gtt_offset ||
+           intel_i915_read32(dev, DSPASURFLIVE_OFFSET) == gtt_offset;
+}
+
+static mx_status_t intel_i915_import_vmo(intel_i915_device_t* dev, mx_handle_t vmo,
+                                         uint32_t* out_id) {
+    uint64_t size;
+    mx_status_t status = mx_vmo_get_size(vmo, &size);
+    if (status != NO_ERROR) {
+        mx_handle_close(vmo);
+        return status;
+    }
+    if (size < dev->buffer_size) {
+        mx_handle_close(vmo);
+        return ERR_BUFFER_TOO_SMALL;
+    }
+    // Scanout doesn't snoop the CPU caches, so have the client's writes go
+    // straight through.  If it has mapped the vmo already that's too late,
+    // and flushing is up to it.
+    status = mx_vmo_set_cache_policy(vmo, MX_CACHE_POLICY_WRITE_COMBINING);
+    if (status != NO_ERROR && status != ERR_BAD_STATE) {
+        mx_handle_close(vmo);
+        return status;
+    }
+
+    mtx_lock(&dev->lock);
+    uint32_t id;
+    for (id = 1; id < MAX_BUFFERS; id++) {
+        if (!dev->buffers[id].in_use)
+            break;
+    }
+    if (id == MAX_BUFFERS) {
+        status = ERR_NO_RESOURCES;
+        goto fail;
+    }
+    if ((status = intel_i915_map_vmo(dev, vmo, dev->buffers[id].gtt_offset)) != NO_ERROR) {
+        goto fail;
+    }
+    dev->buffers[id].in_use = true;
+    dev->buffers[id].vmo = vmo;
+    mtx_unlock(&dev->lock);
+
+    *out_id = id;
+    return NO_ERROR;
+
+fail:
+    mtx_unlock(&dev->lock);
+    mx_handle_close(vmo);
+    return status;
+}
+
+static mx_status_t intel_i915_release_buffer(intel_i915_device_t* dev, uint32_t id) {
+    if (id == 0 || id >= MAX_BUFFERS) {
+        return ERR_INVALID_ARGS;
+    }
+
+    mx_status_t status = NO_ERROR;
+    mtx_lock(&dev->lock);
+    if (!dev->buffers[id].in_use) {
+        status = ERR_INVALID_ARGS;
+    } else if (intel_i915_buffer_busy_locked(dev, id)) {
+        status = ERR_BAD_STATE;
+    } else {
+        intel_i915_write_gtt(dev, dev->buffers[id].gtt_offset, NULL,
+                             (dev->buffer_size + PAGE_SIZE - 1) / PAGE_SIZE);
+        intel_i915_flush_gtt(dev);
+        mx_handle_close(dev->buffers[id].vmo);
+        dev->buffers[id].vmo = MX_HANDLE_INVALID;
+        dev->buffers[id].in_use = false;
+    }
+    mtx_unlock(&dev->lock);
+    return status;
+}
+
+static mx_status_t intel_i915_flip(intel_i915_device_t* dev, uint32_t id) {
+    if (id >= MAX_BUFFERS) {
+        return ERR_INVALID_ARGS;
+    }
+
+    mx_status_t status = NO_ERROR;
+    mtx_lock(&dev->lock);
+    if (!dev->buffers[id].in_use) {
+        status = ERR_INVALID_ARGS;
+    } else {
+        // latched at the next vblank, the last flip before it wins
+        intel_i915_write32(dev, DSPASURF_OFFSET, dev->buffers[id].gtt_offset);
+    }
+    mtx_unlock(&dev->lock);
+    return status;
+}
+
+static mx_status_t intel_i915_set_vsync_port(intel_i915_device_t* dev,
+                                             const ioctl_display_vsync_port_t* req) {
+    mtx_lock(&dev->lock);
+    if (dev->irq_handle == MX_HANDLE_INVALID) {
+        mtx_unlock(&dev->lock);
+        mx_handle_close(req->port);
+        return ERR_NOT_SUPPORTED;
+    }
+    if (dev->vsync_port != MX_HANDLE_INVALID) {
+        mx_handle_close(dev->vsync_port);
+    }
+    dev->vsync_port = req->port;
+    dev->vsync_key = req->key;
+
+    uint32_t mask = req->port != MX_HANDLE_INVALID ? DE_PIPE_VBLANK : 0;
+    intel_i915_write32(dev, DE_PIPE_A_IER_OFFSET, mask);
+    intel_i915_write32(dev, DE_PIPE_A_IMR_OFFSET, ~mask);
+    mtx_unlock(&dev->lock);
+    return NO_ERROR;
+}
+
+static void intel_i915_vsync(intel_i915_device_t* dev) {
+    mtx_lock(&dev->lock);
+    if (dev->vsync_port != MX_HANDLE_INVALID) {
+        mx_port_packet_t packet = {};
+        packet.key = dev->vsync_key;
+        packet.type = MX_PKT_TYPE_USER;
+        display_vsync_t* vsync = (display_vsync_t*)&packet.user;
+        vsync->timestamp = mx_time_get(MX_CLOCK_MONOTONIC);
+
+        uint32_t live = intel_i915_read32(dev, DSPASURFLIVE_OFFSET);
+        for (uint32_t id = 0; id < MAX_BUFFERS; id++) {
+            if (dev->buffers[id].in_use && dev->buffers[id].gtt_offset == live)
+                vsync->buffer_id = id;
+        }
+        mx_port_queue(dev->vsync_port, &packet, 0);
+    }
+    mtx_unlock(&dev->lock);
+}
+
+static int intel_i915_irq_thread(void* arg) {
+    intel_i915_device_t* dev = arg;
+    for (;;) {
+        mx_status_t status = mx_interrupt_wait(dev->irq_handle);
+        if (dev->irq_stop) {
+            break;
+        }
+        if (status < 0) {
+            printf("intel-i915: irq wait failed %d\n", status);
+            mx_interrupt_complete(dev->irq_handle);
+            break;
+        }
+
+        if (dev->edge_triggered_irq)
+            mx_interrupt_complete(dev->irq_handle);
+
+        uint32_t master = intel_i915_read32(dev, MASTER_IRQ_OFFSET);
+        intel_i915_write32(dev, MASTER_IRQ_OFFSET, 0);
+        if (master & MASTER_IRQ_DE_PIPE_A) {
+            uint32_t iir = intel_i915_read32(dev, DE_PIPE_A_IIR_OFFSET);
+            intel_i915_write32(dev, DE_PIPE_A_IIR_OFFSET, iir);
+            if (iir & DE_PIPE_VBLANK)
+                intel_i915_vsync(dev);
+        }
+        intel_i915_write32(dev, MASTER_IRQ_OFFSET, MASTER_IRQ_CONTROL);
+
+        if (!dev->edge_triggered_irq)
+            mx_interrupt_complete(dev->irq_handle);
+    }
+    return 0;
+}
+
+static void intel_i915_init_flip(intel_i915_device_t* dev) {
+    if (dev->regs_size < INTEL_I915_REG_WINDOW_SIZE) {
+        return;
+    }
+    uint32_t pixelsize = intel_i915_pixelsize(dev->info.format);
+    if (pixelsize == 0) {
+        return;
+    }
+
+    dev->buffer_size = (size_t)dev->info.stride * dev->info.height * pixelsize;
+    uint32_t slot_size = (uint32_t)((dev->buffer_size + BUFFER_GTT_ALIGN - 1) & ~(BUFFER_GTT_ALIGN - 1));
+    dev->buffers[0].in_use = true;
+    dev->buffers[0].vmo = MX_HANDLE_INVALID;
+    dev->buffers[0].gtt_offset = intel_i915_read32(dev, DSPASURF_OFFSET);
+    for (uint32_t id = 1; id < MAX_BUFFERS; id++) {
+        dev->buffers[id].vmo = MX_HANDLE_INVALID;
+        dev->buffers[id].gtt_offset = BUFFER_GTT_BASE + (id - 1) * slot_size;
+    }
+    dev->flags |= FLAGS_FLIP;
+}
+
+// Flips work without interrupts, vsync events need them.
+static void intel_i915_init_irq(intel_i915_device_t* dev, mx_device_t* pcidev, pci_protocol_t* pci) {
+    if (!(dev->flags & FLAGS_FLIP)) {
+        return;
+    }
+
+    uint32_t irq_cnt = 0;
+    if ((pci->query_irq_mode_caps(pcidev, MX_PCIE_IRQ_MODE_MSI, &irq_cnt) == NO_ERROR) &&
+        (pci->set_irq_mode(pcidev, MX_PCIE_IRQ_MODE_MSI, 1) == NO_ERROR)) {
+        dev->edge_triggered_irq = true;
+    } else if ((pci->query_irq_mode_caps(pcidev, MX_PCIE_IRQ_MODE_LEGACY, &irq_cnt) == NO_ERROR) &&
+               (pci->set_irq_mode(pcidev, MX_PCIE_IRQ_MODE_LEGACY, 1) == NO_ERROR)) {
+        dev->edge_triggered_irq = false;
+    } else {
+        return;
+    }
+    mx_handle_t irq_handle;
+    if (pci->map_interrupt(pcidev, 0, &irq_handle) != NO_ERROR) {
+        return;
+    }
+
+    // vblanks stay masked until someone asks for them
+    intel_i915_write32(dev, DE_PIPE_A_IER_OFFSET, 0);
+    intel_i915_write32(dev, DE_PIPE_A_IMR_OFFSET, ~0u);
+    intel_i915_write32(dev, DE_PIPE_A_IIR_OFFSET, ~0u);
+    intel_i915_write32(dev, MASTER_IRQ_OFFSET, MASTER_IRQ_CONTROL);
+
+    mtx_lock(&dev->lock);
+    dev->irq_handle = irq_handle;
+    if (thrd_create_with_name(&dev->irq_thread, intel_i915_irq_thread, dev,
+                              "intel-i915-irq") != thrd_success) {
+        mx_handle_close(irq_handle);
+        dev->irq_handle = MX_HANDLE_INVALID;
+    }
+    mtx_unlock(&dev->lock);
+}
+
 // implement display protocol
 
 static mx_status_t intel_i915_set_mode(mx_device_t* dev, mx_display_info_t* info) {
@@ -103,10 +436,76 @@ static mx_status_t intel_i915_close(void* ctx, uint32_t flags) {
     return NO_ERROR;
 }
 
+static mx_status_t intel_i915_ioctl(void* ctx, uint32_t op, const void* in_buf, size_t in_len,
+                                    void* out_buf, size_t out_len, size_t* out_actual) {
+    intel_i915_device_t* device = ctx;
+
+    switch (op) {
+    case IOCTL_DISPLAY_IMPORT_VMO: {
+        if (in_len < sizeof(mx_handle_t)) {
+            return ERR_INVALID_ARGS;
+        }
+        mx_handle_t vmo = *(const mx_handle_t*)in_buf;
+        if (out_len < sizeof(uint32_t)) {
+            mx_handle_close(vmo);
+            return ERR_INVALID_ARGS;
+        }
+        if (!(device->flags & FLAGS_FLIP)) {
+            mx_handle_close(vmo);
+            return ERR_NOT_SUPPORTED;
+        }
+        mx_status_t status = intel_i915_import_vmo(device, vmo, out_buf);
+        if (status == NO_ERROR) {
+            *out_actual = sizeof(uint32_t);
+        }
+        return status;
+    }
+    case IOCTL_DISPLAY_RELEASE_BUFFER:
+    case IOCTL_DISPLAY_FLIP: {
+        if (in_len < sizeof(uint32_t)) {
+            return ERR_INVALID_ARGS;
+        }
+        if (!(device->flags & FLAGS_FLIP)) {
+            return ERR_NOT_SUPPORTED;
+        }
+        uint32_t id = *(const uint32_t*)in_buf;
+        if (op == IOCTL_DISPLAY_FLIP) {
+            return intel_i915_flip(device, id);
+        }
+        return intel_i915_release_buffer(device, id);
+    }
+    case IOCTL_DISPLAY_SET_VSYNC_PORT: {
+        if (in_len < sizeof(ioctl_display_vsync_port_t)) {
+            if (in_len >= sizeof(mx_handle_t)) {
+                mx_handle_close(*(const mx_handle_t*)in_buf);
+            }
+            return ERR_INVALID_ARGS;
+        }
+        return intel_i915_set_vsync_port(device, in_buf);
+    }
+    default:
+        return ERR_NOT_SUPPORTED;
+    }
+}
+
 static void intel_i915_release(void* ctx) {
     intel_i915_device_t* device = ctx;
     intel_i915_enable_backlight(device, false);
 
+    // the irq thread reads the registers and the vsync port, so stop it
+    // before either goes away
+    if (device->irq_handle != MX_HANDLE_INVALID) {
+        intel_i915_write32(device, DE_PIPE_A_IER_OFFSET, 0);
+        intel_i915_write32(device, DE_PIPE_A_IMR_OFFSET, ~0u);
+        intel_i915_write32(device, MASTER_IRQ_OFFSET, 0);
+
+        device->irq_stop = true;
+        mx_interrupt_signal(device->irq_handle);
+        thrd_join(device->irq_thread, NULL);
+        mx_handle_close(device->irq_handle);
+        device->irq_handle = MX_HANDLE_INVALID;
+    }
+
     if (device->regs) {
         mx_handle_close(device->regs_handle);
         device->regs_handle = -1;
@@ -117,6 +516,15 @@ static void intel_i915_release(void* ctx) {
         device->framebuffer_handle = -1;
     }
 
+    for (uint32_t id = 1; id < MAX_BUFFERS; id++) {
+        if (device->buffers[id].in_use) {
+            mx_handle_close(device->buffers[id].vmo);
+        }
+    }
+    if (device->vsync_port != MX_HANDLE_INVALID) {
+        mx_handle_close(device->vsync_port);
+    }
+
     free(device);
 }
 
@@ -124,6 +532,7 @@ static mx_protocol_device_t intel_i915_device_proto = {
     .version = DEVICE_OPS_VERSION,
     .open = intel_i915_open,
     .close = intel_i915_close,
+    .ioctl = intel_i915_ioctl,
     .release = intel_i915_release,
 };
 
@@ -142,6 +551,9 @@ static mx_status_t intel_i915_bind(mx_driver_t* drv, mx_device_t* dev, void** co
     intel_i915_device_t* device = calloc(1, sizeof(intel_i915_device_t));
     if (!device)
         return ERR_NO_MEMORY;
+    mtx_init(&device->lock, mtx_plain);
+    device->irq_handle = MX_HANDLE_INVALID;
+    device->vsync_port = MX_HANDLE_INVALID;
 
     const pci_config_t* pci_config;
     mx_handle_t cfg_handle = MX_HANDLE_INVALID;
@@ -184,8 +596,11 @@ static mx_status_t intel_i915_bind(mx_driver_t* drv, mx_device_t* dev, void** co
         di->height = 1700 / 2;
         di->stride = 2560 / 2;
     }
+    di->pixelsize = intel_i915_pixelsize(di->format);
     di->flags = MX_DISPLAY_FLAG_HW_FRAMEBUFFER;
 
+    intel_i915_init_flip(device);
+
     // TODO remove when the gfxconsole moves to user space
     intel_i915_enable_backlight(device, true);
     mx_set_framebuffer(get_root_resource(), device->framebuffer, device->framebuffer_size,
@@ -207,6 +622,8 @@ static mx_status_t intel_i915_bind(mx_driver_t* drv, mx_device_t* dev, void** co
         goto fail;
     }
 
+    intel_i915_init_irq(device, dev, pci);
+
     xprintf("initialized intel i915 display driver, reg=%p regsize=0x%llx fb=%p fbsize=0x%llx\n",
             device->regs, device->regs_size, device->framebuffer, device->framebuffer_size);
 
@@ -141,6 +141,12 @@ static mx_status_t pci_set_irq_mode(mx_device_t* dev,
     return mx_pci_set_irq_mode(device->handle, mode, requested_irq_count);
 }
 
+static mx_status_t pci_set_irq_affinity(mx_device_t* dev, int which_irq, uint32_t cpu) {
+    kpci_device_t* device = dev->ctx;
+    assert(device->handle != MX_HANDLE_INVALID);
+    return mx_pci_set_irq_affinity(device->handle, which_irq, cpu);
+}
+
 static mx_status_t pci_get_device_info(mx_device_t* dev, mx_pcie_device_info_t* out_info) {
     if ((dev == NULL) || (out_info == NULL))
         return ERR_INVALID_ARGS;
@@ -163,4 +169,5 @@ static pci_protocol_t _pci_protocol = {
     .query_irq_mode_caps = pci_query_irq_mode_caps,
     .set_irq_mode = pci_set_irq_mode,
     .get_device_info = pci_get_device_info,
+    .set_irq_affinity = pci_set_irq_affinity,
 };
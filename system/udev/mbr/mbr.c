@@ -260,11 +260,22 @@ static void mbr_block_write(mx_device_t* dev, mx_handle_t vmo, uint64_t length,
     block_do_txn((mbrpart_device_t*)dev->ctx, IOTXN_OP_WRITE, vmo, length, vmo_offset, dev_offset, cookie);
 }
 
+static void mbr_block_poll(mx_device_t* dev) {
+    // our txns complete through the parent, so poll it
+    mbrpart_device_t* device = dev->ctx;
+    block_ops_t* ops;
+    if (device_op_get_protocol(device->parent, MX_PROTOCOL_BLOCK_CORE, (void**)&ops) == NO_ERROR &&
+        ops->poll != NULL) {
+        ops->poll(device->parent);
+    }
+}
+
 static block_ops_t mbr_block_ops = {
     .set_callbacks = mbr_block_set_callbacks,
     .get_info = mbr_block_get_info,
     .read = mbr_block_read,
     .write = mbr_block_write,
+    .poll = mbr_block_poll,
 };
 
 static int mbr_bind_thread(void* arg) {
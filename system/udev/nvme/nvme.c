@@ -0,0 +1,1025 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <ddk/binding.h>
+#include <ddk/device.h>
+#include <ddk/driver.h>
+#include <ddk/io-buffer.h>
+#include <ddk/iotxn.h>
+#include <ddk/protocol/block.h>
+#include <ddk/protocol/pci.h>
+
+#include <assert.h>
+#include <magenta/listnode.h>
+#include <magenta/syscalls.h>
+#include <magenta/types.h>
+#include <sync/completion.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include "nvme.h"
+
+#define TRACE 0
+
+#if TRACE
+#define xprintf(fmt...) printf(fmt)
+#else
+#define xprintf(fmt...) \
+    do {                \
+    } while (0)
+#endif
+
+// clang-format off
+#define NVME_ADMIN_QUEUE_ENTRIES 32
+#define NVME_IO_QUEUE_DEPTH      64 // commands in flight per queue pair
+#define NVME_MAX_IO_QUEUES       16
+#define NVME_MAX_NAMESPACES      8
+
+// prp1 plus one page of prp list entries
+#define NVME_MAX_PRP_PAGES       (PAGE_SIZE / sizeof(uint64_t) + 1)
+
+#define NVME_ADMIN_TIMEOUT       MX_SEC(5)
+// clang-format on
+
+typedef struct nvme_queue {
+    uint16_t qid;
+    uint16_t entries; // ring size
+    uint16_t depth;   // command ids, one less than the ring size
+
+    io_buffer_t sq_buffer;
+    io_buffer_t cq_buffer;
+    io_buffer_t prp_buffer; // one page of prp list for each command id
+    nvme_sqe_t* sq;
+    volatile nvme_cqe_t* cq;
+    uint64_t* prp_lists;
+
+    volatile uint32_t* sq_db;
+    volatile uint32_t* cq_db;
+    uint16_t sq_tail;
+    uint16_t cq_head;
+    uint16_t phase;
+
+    mtx_t lock;
+
+    uint64_t busy; // bitmask of command ids in flight
+    iotxn_t* commands[NVME_IO_QUEUE_DEPTH];
+
+    list_node_t txn_list; // iotxns waiting for a command id
+} nvme_queue_t;
+
+typedef struct nvme_device nvme_device_t;
+
+typedef struct nvme_irq {
+    nvme_device_t* dev;
+    uint32_t vector;
+    mx_handle_t handle;
+    thrd_t thread;
+} nvme_irq_t;
+
+typedef struct nvme_namespace {
+    mx_device_t* mxdev;
+    nvme_device_t* dev;
+
+    block_callbacks_t* callbacks;
+
+    uint32_t nsid;
+    uint32_t block_size;
+    mx_off_t capacity; // bytes
+} nvme_namespace_t;
+
+struct nvme_device {
+    mx_device_t* mxdev;
+    mx_driver_t* driver;
+
+    void* regs;
+    uint64_t regs_size;
+    mx_handle_t regs_handle;
+
+    mx_device_t* pcidev;
+    pci_protocol_t* pci;
+
+    uint64_t cap;
+    size_t max_xfer;
+
+    nvme_queue_t admin;
+
+    // one queue pair per cpu, as far as the controller and interrupt
+    // vectors allow; queue i is serviced by vector i % irq_count
+    nvme_queue_t io[NVME_MAX_IO_QUEUES];
+    uint32_t io_count;
+
+    nvme_irq_t irqs[NVME_MAX_IO_QUEUES];
+    uint32_t irq_count;
+    volatile bool irq_stop;
+
+    thrd_t init_thread;
+    bool init_started;
+};
+
+static inline uint32_t nvme_read32(nvme_device_t* dev, uint32_t reg) {
+    return pcie_read32((volatile uint32_t*)((uintptr_t)dev->regs + reg));
+}
+
+static inline void nvme_write32(nvme_device_t* dev, uint32_t reg, uint32_t val) {
+    pcie_write32((volatile uint32_t*)((uintptr_t)dev->regs + reg), val);
+}
+
+static inline uint64_t nvme_read64(nvme_device_t* dev, uint32_t reg) {
+    return (uint64_t)nvme_read32(dev, reg) | ((uint64_t)nvme_read32(dev, reg + 4) << 32);
+}
+
+static inline void nvme_write64(nvme_device_t* dev, uint32_t reg, uint64_t val) {
+    nvme_write32(dev, reg, (uint32_t)val);
+    nvme_write32(dev, reg + 4, (uint32_t)(val >> 32));
+}
+
+static mx_status_t nvme_wait_ready(nvme_device_t* dev, bool ready) {
+    // CAP.TO is the worst case time for CSTS.RDY to follow CC.EN
+    mx_time_t timeout = MX_MSEC(500) * MAX(NVME_CAP_TO(dev->cap), 1);
+    mx_time_t start_time = mx_time_get(MX_CLOCK_MONOTONIC);
+    do {
+        if (!!(nvme_read32(dev, NVME_REG_CSTS) & NVME_CSTS_RDY) == ready) return NO_ERROR;
+        usleep(1000);
+    } while (mx_time_get(MX_CLOCK_MONOTONIC) - start_time < timeout);
+    return ERR_TIMED_OUT;
+}
+
+static mx_status_t nvme_queue_init(nvme_device_t* dev, nvme_queue_t* q, uint16_t qid,
+                                   uint16_t entries, bool io) {
+    memset(q, 0, sizeof(*q));
+    q->qid = qid;
+    q->entries = entries;
+    q->depth = entries - 1;
+    q->phase = 1;
+    mtx_init(&q->lock, mtx_plain);
+    list_initialize(&q->txn_list);
+
+    mx_status_t status = io_buffer_init(&q->sq_buffer, entries * sizeof(nvme_sqe_t), IO_BUFFER_RW);
+    if (status != NO_ERROR) {
+        return status;
+    }
+    q->sq = io_buffer_virt(&q->sq_buffer);
+    memset(q->sq, 0, entries * sizeof(nvme_sqe_t));
+
+    status = io_buffer_init(&q->cq_buffer, entries * sizeof(nvme_cqe_t), IO_BUFFER_RW);
+    if (status != NO_ERROR) {
+        return status;
+    }
+    q->cq = io_buffer_virt(&q->cq_buffer);
+    memset((void*)q->cq, 0, entries * sizeof(nvme_cqe_t));
+
+    if (io) {
+        status = io_buffer_init(&q->prp_buffer, q->depth * PAGE_SIZE, IO_BUFFER_RW);
+        if (status != NO_ERROR) {
+            return status;
+        }
+        q->prp_lists = io_buffer_virt(&q->prp_buffer);
+    }
+
+    uint32_t stride = 4u << NVME_CAP_DSTRD(dev->cap);
+    q->sq_db = (volatile uint32_t*)((uintptr_t)dev->regs + NVME_REG_DB + (2 * qid) * stride);
+    q->cq_db = (volatile uint32_t*)((uintptr_t)dev->regs + NVME_REG_DB + (2 * qid + 1) * stride);
+    return NO_ERROR;
+}
+
+
+// admin commands are only issued while bringing up the controller, so they
+// are simply polled for; the admin completion queue's interrupt is ignored
+static mx_status_t nvme_admin_cmd(nvme_device_t* dev, nvme_sqe_t* cmd, uint32_t* result) {
+    nvme_queue_t* q = &dev->admin;
+    mx_status_t status = NO_ERROR;
+
+    mtx_lock(&q->lock);
+    cmd->cdw0 = (cmd->cdw0 & 0xffff) | ((uint32_t)q->sq_tail << 16);
+    q->sq[q->sq_tail] = *cmd;
+    q->sq_tail = (q->sq_tail + 1) % q->entries;
+    __sync_synchronize();
+    pcie_write32(q->sq_db, q->sq_tail);
+
+    mx_time_t start_time = mx_time_get(MX_CLOCK_MONOTONIC);
+    volatile nvme_cqe_t* cqe = &q->cq[q->cq_head];
+    while ((cqe->status & NVME_CQE_PHASE) != q->phase) {
+        if (mx_time_get(MX_CLOCK_MONOTONIC) - start_time > NVME_ADMIN_TIMEOUT) {
+            printf("nvme: admin command 0x%02x timed out\n", cmd->cdw0 & 0xff);
+            status = ERR_TIMED_OUT;
+            goto done;
+        }
+        usleep(10);
+    }
+    __sync_synchronize();
+
+    uint16_t st = cqe->status;
+    if (result) {
+        *result = cqe->result;
+    }
+    if (++q->cq_head == q->entries) {
+        q->cq_head = 0;
+        q->phase ^= 1;
+    }
+    pcie_write32(q->cq_db, q->cq_head);
+
+    if (NVME_CQE_STATUS(st)) {
+        printf("nvme: admin command 0x%02x failed, status 0x%x\n", cmd->cdw0 & 0xff, NVME_CQE_STATUS(st));
+        status = ERR_IO;
+    }
+done:
+    mtx_unlock(&q->lock);
+    return status;
+}
+
+// I/O queues:
+
+static inline mx_paddr_t nvme_txn_page(iotxn_t* txn, uint64_t i) {
+    // a single entry means the buffer is physically contiguous
+    return (txn->phys_count == 1) ? txn->phys[0] + i * PAGE_SIZE : txn->phys[i];
+}
+
+static mx_status_t nvme_build_cmd(nvme_queue_t* q, uint16_t cid, iotxn_t* txn, nvme_sqe_t* cmd) {
+    nvme_namespace_t* ns = txn->context;
+
+    memset(cmd, 0, sizeof(*cmd));
+    cmd->nsid = ns->nsid;
+    if (txn->length == 0) {
+        // an empty IOTXN_SYNC_BEFORE txn asks for a cache flush
+        cmd->cdw0 = NVME_SQE_CDW0(NVME_CMD_FLUSH, cid);
+        return NO_ERROR;
+    }
+
+    uint8_t opcode = (txn->opcode == IOTXN_OP_WRITE) ? NVME_CMD_WRITE : NVME_CMD_READ;
+    uint64_t lba = txn->offset / ns->block_size;
+    cmd->cdw0 = NVME_SQE_CDW0(opcode, cid);
+    cmd->cdw10 = (uint32_t)lba;
+    cmd->cdw11 = (uint32_t)(lba >> 32);
+    cmd->cdw12 = (uint32_t)(txn->length / ns->block_size - 1); // 0-based block count
+
+    // describe the buffer straight from its physical pages: prp1 may start
+    // anywhere in the first page, the rest are whole pages in prp2 or, past
+    // two pages, in this command's prp list
+    uint64_t align_adjust = txn->vmo_offset & (PAGE_SIZE - 1);
+    uint64_t pages = (align_adjust + txn->length + PAGE_SIZE - 1) / PAGE_SIZE;
+    if (pages > NVME_MAX_PRP_PAGES) {
+        return ERR_NOT_SUPPORTED;
+    }
+    cmd->prp1 = nvme_txn_page(txn, 0) + align_adjust;
+    if (pages == 2) {
+        cmd->prp2 = nvme_txn_page(txn, 1);
+    } else if (pages > 2) {
+        uint64_t* list = q->prp_lists + cid * (PAGE_SIZE / sizeof(uint64_t));
+        for (uint64_t i = 1; i < pages; i++) {
+            list[i - 1] = nvme_txn_page(txn, i);
+        }
+        cmd->prp2 = io_buffer_phys(&q->prp_buffer) + cid * PAGE_SIZE;
+    }
+    return NO_ERROR;
+}
+
+// issue waiting iotxns while there are free command ids, ringing the
+// doorbell once for the lot; iotxns that can't be issued go on failed
+static void nvme_queue_start_locked(nvme_queue_t* q, list_node_t* failed) {
+    uint64_t ids = (q->depth >= 64) ? UINT64_MAX : ((1ull << q->depth) - 1);
+    bool submitted = false;
+    iotxn_t* txn;
+    while ((txn = list_peek_head_type(&q->txn_list, iotxn_t, node)) != NULL) {
+        uint64_t free_ids = ids & ~q->busy;
+        if (!free_ids) {
+            break;
+        }
+        uint16_t cid = (uint16_t)__builtin_ctzll(free_ids);
+
+        list_delete(&txn->node);
+        mx_status_t status = nvme_build_cmd(q, cid, txn, &q->sq[q->sq_tail]);
+        if (status != NO_ERROR) {
+            txn->status = status;
+            list_add_tail(failed, &txn->node);
+            continue;
+        }
+
+        q->busy |= (1ull << cid);
+        q->commands[cid] = txn;
+        if (++q->sq_tail == q->entries) {
+            q->sq_tail = 0;
+        }
+        submitted = true;
+    }
+
+    if (submitted) {
+        __sync_synchronize();
+        pcie_write32(q->sq_db, q->sq_tail);
+    }
+}
+
+static void nvme_complete_failed(list_node_t* failed) {
+    iotxn_t* txn;
+    while ((txn = list_remove_head_type(failed, iotxn_t, node)) != NULL) {
+        iotxn_complete(txn, txn->status, 0);
+    }
+}
+
+static void nvme_queue_txn(nvme_queue_t* q, iotxn_t* txn) {
+    list_node_t failed = LIST_INITIAL_VALUE(failed);
+
+    mtx_lock(&q->lock);
+    list_add_tail(&q->txn_list, &txn->node);
+    nvme_queue_start_locked(q, &failed);
+    mtx_unlock(&q->lock);
+
+    nvme_complete_failed(&failed);
+}
+
+// reap every completion posted to the queue, then refill the freed command ids
+static void nvme_queue_reap(nvme_queue_t* q) {
+    iotxn_t* done[NVME_IO_QUEUE_DEPTH];
+    mx_status_t done_status[NVME_IO_QUEUE_DEPTH];
+    int count = 0;
+    bool consumed = false;
+    list_node_t failed = LIST_INITIAL_VALUE(failed);
+
+    mtx_lock(&q->lock);
+    for (;;) {
+        volatile nvme_cqe_t* cqe = &q->cq[q->cq_head];
+        uint16_t st = cqe->status;
+        if ((st & NVME_CQE_PHASE) != q->phase) {
+            break;
+        }
+        __sync_synchronize();
+        uint16_t cid = cqe->cid;
+        if (++q->cq_head == q->entries) {
+            q->cq_head = 0;
+            q->phase ^= 1;
+        }
+        consumed = true;
+
+        if (cid >= q->depth || !(q->busy & (1ull << cid))) {
+            printf("nvme: queue %u completion for idle command id %u\n", q->qid, cid);
+            continue;
+        }
+        done[count] = q->commands[cid];
+        done_status[count] = NVME_CQE_STATUS(st) ? ERR_IO : NO_ERROR;
+        if (NVME_CQE_STATUS(st)) {
+            xprintf("nvme: queue %u command %u failed, status 0x%x\n", q->qid, cid, NVME_CQE_STATUS(st));
+        }
+        count++;
+        q->commands[cid] = NULL;
+        q->busy &= ~(1ull << cid);
+    }
+    if (consumed) {
+        pcie_write32(q->cq_db, q->cq_head);
+    }
+    if (count) {
+        nvme_queue_start_locked(q, &failed);
+    }
+    mtx_unlock(&q->lock);
+
+    for (int i = 0; i < count; i++) {
+        iotxn_complete(done[i], done_status[i], (done_status[i] == NO_ERROR) ? done[i]->length : 0);
+    }
+    nvme_complete_failed(&failed);
+}
+
+// fail whatever the queue still holds and free its rings; the controller
+// must already be disabled so nothing is still being written to them
+static void nvme_queue_release(nvme_queue_t* q) {
+    list_node_t failed = LIST_INITIAL_VALUE(failed);
+
+    mtx_lock(&q->lock);
+    for (uint16_t cid = 0; cid < q->depth; cid++) {
+        if (q->busy & (1ull << cid)) {
+            q->commands[cid]->status = ERR_PEER_CLOSED;
+            list_add_tail(&failed, &q->commands[cid]->node);
+            q->commands[cid] = NULL;
+        }
+    }
+    q->busy = 0;
+    iotxn_t* txn;
+    while ((txn = list_remove_head_type(&q->txn_list, iotxn_t, node)) != NULL) {
+        txn->status = ERR_PEER_CLOSED;
+        list_add_tail(&failed, &txn->node);
+    }
+    mtx_unlock(&q->lock);
+    nvme_complete_failed(&failed);
+
+    if (io_buffer_is_valid(&q->sq_buffer)) {
+        io_buffer_release(&q->sq_buffer);
+    }
+    if (io_buffer_is_valid(&q->cq_buffer)) {
+        io_buffer_release(&q->cq_buffer);
+    }
+    if (io_buffer_is_valid(&q->prp_buffer)) {
+        io_buffer_release(&q->prp_buffer);
+    }
+}
+
+static nvme_queue_t* nvme_pick_queue(nvme_device_t* dev) {
+    // There is no asking which cpu we're on, so spread by submitting
+    // thread instead: each block client is served by its own thread, which
+    // keeps a client's requests and completions on one queue pair.
+    uint64_t h = (uint64_t)(uintptr_t)thrd_current() * 0x9e3779b97f4a7c15ull;
+    return &dev->io[(h >> 32) % dev->io_count];
+}
+
+// irq handler:
+
+static int nvme_irq_thread(void* arg) {
+    nvme_irq_t* irq = arg;
+    nvme_device_t* dev = irq->dev;
+    mx_status_t status;
+    for (;;) {
+        status = mx_interrupt_wait(irq->handle);
+        if (dev->irq_stop) {
+            break;
+        }
+        if (status) {
+            xprintf("nvme: error %d waiting for interrupt %u\n", status, irq->vector);
+            continue;
+        }
+        for (uint32_t i = irq->vector; i < dev->io_count; i += dev->irq_count) {
+            nvme_queue_reap(&dev->io[i]);
+        }
+        mx_interrupt_complete(irq->handle);
+    }
+    return 0;
+}
+
+// Interrupt vectors: one per queue pair with MSI-X, or as many as multiple
+// message MSI gives us (a power of two), falling back to a single vector.
+static mx_status_t nvme_setup_irqs(nvme_device_t* dev, uint32_t wanted) {
+    pci_protocol_t* pci = dev->pci;
+    mx_status_t status;
+    uint32_t count = 0;
+    if ((pci->query_irq_mode_caps(dev->pcidev, MX_PCIE_IRQ_MODE_MSI_X, &count) == NO_ERROR) &&
+        count > 0) {
+        count = MIN(count, wanted);
+        if (pci->set_irq_mode(dev->pcidev, MX_PCIE_IRQ_MODE_MSI_X, count) == NO_ERROR) {
+            xprintf("nvme: using %u MSI-X vectors\n", count);
+            goto map;
+        }
+    }
+    if ((pci->query_irq_mode_caps(dev->pcidev, MX_PCIE_IRQ_MODE_MSI, &count) == NO_ERROR) &&
+        count > 0) {
+        count = MIN(count, wanted);
+        count = 1u << (31 - __builtin_clz(count));
+        if (pci->set_irq_mode(dev->pcidev, MX_PCIE_IRQ_MODE_MSI, count) == NO_ERROR) {
+            xprintf("nvme: using %u MSI vectors\n", count);
+            goto map;
+        }
+        count = 1;
+        if (pci->set_irq_mode(dev->pcidev, MX_PCIE_IRQ_MODE_MSI, count) == NO_ERROR) {
+            xprintf("nvme: using 1 MSI vector\n");
+            goto map;
+        }
+    }
+    count = 1;
+    status = pci->set_irq_mode(dev->pcidev, MX_PCIE_IRQ_MODE_LEGACY, count);
+    if (status != NO_ERROR) {
+        printf("nvme: error %d setting irq mode\n", status);
+        return status;
+    }
+    xprintf("nvme: using legacy irq\n");
+
+map:
+    for (uint32_t i = 0; i < count; i++) {
+        nvme_irq_t* irq = &dev->irqs[i];
+        irq->dev = dev;
+        irq->vector = i;
+        status = pci->map_interrupt(dev->pcidev, i, &irq->handle);
+        if (status != NO_ERROR) {
+            printf("nvme: error %d mapping irq %u\n", status, i);
+            return status;
+        }
+        char name[16];
+        snprintf(name, sizeof(name), "nvme-irq%u", i);
+        int ret = thrd_create_with_name(&irq->thread, nvme_irq_thread, irq, name);
+        if (ret != thrd_success) {
+            printf("nvme: error %d in irq thread create\n", ret);
+            mx_handle_close(irq->handle);
+            return ERR_NO_RESOURCES;
+        }
+        dev->irq_count = i + 1;
+    }
+    return NO_ERROR;
+}
+
+static mx_status_t nvme_create_io_queue(nvme_device_t* dev, nvme_queue_t* q, uint16_t qid,
+                                        uint16_t entries, uint32_t vector) {
+    mx_status_t status = nvme_queue_init(dev, q, qid, entries, true);
+    if (status != NO_ERROR) {
+        return status;
+    }
+
+    nvme_sqe_t cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.cdw0 = NVME_SQE_CDW0(NVME_ADMIN_CREATE_CQ, 0);
+    cmd.prp1 = io_buffer_phys(&q->cq_buffer);
+    cmd.cdw10 = ((uint32_t)(entries - 1) << 16) | qid;
+    cmd.cdw11 = (vector << 16) | NVME_CQ_IEN | NVME_QUEUE_PC;
+    status = nvme_admin_cmd(dev, &cmd, NULL);
+    if (status != NO_ERROR) {
+        return status;
+    }
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.cdw0 = NVME_SQE_CDW0(NVME_ADMIN_CREATE_SQ, 0);
+    cmd.prp1 = io_buffer_phys(&q->sq_buffer);
+    cmd.cdw10 = ((uint32_t)(entries - 1) << 16) | qid;
+    cmd.cdw11 = ((uint32_t)qid << 16) | NVME_QUEUE_PC;
+    return nvme_admin_cmd(dev, &cmd, NULL);
+}
+
+// namespace device protocol:
+
+static void nvme_ns_sync_complete(iotxn_t* txn, void* cookie) {
+    completion_signal((completion_t*)cookie);
+}
+
+static void nvme_ns_get_info(nvme_namespace_t* ns, block_info_t* info) {
+    memset(info, 0, sizeof(*info));
+    info->block_size = ns->block_size;
+    info->block_count = ns->capacity / ns->block_size;
+    info->max_transfer_size = ns->dev->max_xfer;
+}
+
+static void nvme_ns_iotxn_queue(void* ctx, iotxn_t* txn) {
+    nvme_namespace_t* ns = ctx;
+
+    if (txn->opcode != IOTXN_OP_READ && txn->opcode != IOTXN_OP_WRITE) {
+        iotxn_complete(txn, ERR_NOT_SUPPORTED, 0);
+        return;
+    }
+
+    if (txn->length > 0) {
+        // offset must be aligned to block size
+        if ((txn->offset % ns->block_size) || (txn->offset > ns->capacity)) {
+            iotxn_complete(txn, ERR_INVALID_ARGS, 0);
+            return;
+        }
+        // constrain to device capacity and round down to block aligned
+        txn->length = MIN(ROUNDDOWN(txn->length, ns->block_size), ns->capacity - txn->offset);
+        if (txn->length > ns->dev->max_xfer) {
+            iotxn_complete(txn, ERR_NOT_SUPPORTED, 0);
+            return;
+        }
+        // data pointers must be dword aligned
+        if (txn->vmo_offset & 3) {
+            iotxn_complete(txn, ERR_INVALID_ARGS, 0);
+            return;
+        }
+    }
+    if (txn->length == 0 && !(txn->flags & IOTXN_SYNC_BEFORE)) {
+        iotxn_complete(txn, NO_ERROR, 0);
+        return;
+    }
+
+    if (txn->length > 0) {
+        mx_status_t status = iotxn_physmap(txn);
+        if (status != NO_ERROR) {
+            iotxn_complete(txn, status, 0);
+            return;
+        }
+    }
+
+    txn->context = ns;
+    nvme_queue_txn(nvme_pick_queue(ns->dev), txn);
+}
+
+static mx_status_t nvme_ns_ioctl(void* ctx, uint32_t op, const void* cmd, size_t cmdlen, void* reply,
+                                 size_t max, size_t* out_actual) {
+    nvme_namespace_t* ns = ctx;
+    switch (op) {
+    case IOCTL_BLOCK_GET_INFO: {
+        block_info_t* info = reply;
+        if (max < sizeof(*info))
+            return ERR_BUFFER_TOO_SMALL;
+        nvme_ns_get_info(ns, info);
+        *out_actual = sizeof(*info);
+        return NO_ERROR;
+    }
+    case IOCTL_BLOCK_RR_PART: {
+        // rebind to reread the partition table
+        return device_rebind(ns->mxdev);
+    }
+    case IOCTL_DEVICE_SYNC: {
+        iotxn_t* txn;
+        mx_status_t status = iotxn_alloc(&txn, IOTXN_ALLOC_CONTIGUOUS, 0);
+        if (status != NO_ERROR) {
+            return status;
+        }
+        completion_t completion = COMPLETION_INIT;
+        txn->opcode = IOTXN_OP_WRITE;
+        txn->flags = IOTXN_SYNC_BEFORE;
+        txn->offset = 0;
+        txn->length = 0;
+        txn->complete_cb = nvme_ns_sync_complete;
+        txn->cookie = &completion;
+        iotxn_queue(ns->mxdev, txn);
+        completion_wait(&completion, MX_TIME_INFINITE);
+        status = txn->status;
+        iotxn_release(txn);
+        return status;
+    }
+    default:
+        return ERR_NOT_SUPPORTED;
+    }
+}
+
+static mx_off_t nvme_ns_get_size(void* ctx) {
+    nvme_namespace_t* ns = ctx;
+    return ns->capacity;
+}
+
+static void nvme_ns_release(void* ctx) {
+    nvme_namespace_t* ns = ctx;
+    free(ns);
+}
+
+static mx_protocol_device_t nvme_ns_device_proto = {
+    .version = DEVICE_OPS_VERSION,
+    .ioctl = nvme_ns_ioctl,
+    .iotxn_queue = nvme_ns_iotxn_queue,
+    .get_size = nvme_ns_get_size,
+    .release = nvme_ns_release,
+};
+
+static void nvme_block_set_callbacks(mx_device_t* dev, block_callbacks_t* cb) {
+    nvme_namespace_t* ns = dev->ctx;
+    ns->callbacks = cb;
+}
+
+static void nvme_block_get_info(mx_device_t* dev, block_info_t* info) {
+    nvme_namespace_t* ns = dev->ctx;
+    nvme_ns_get_info(ns, info);
+}
+
+static void nvme_block_complete(iotxn_t* txn, void* cookie) {
+    nvme_namespace_t* ns;
+    memcpy(&ns, txn->extra, sizeof(nvme_namespace_t*));
+    ns->callbacks->complete(cookie, txn->status);
+    iotxn_release(txn);
+}
+
+static void nvme_block_txn(nvme_namespace_t* ns, uint32_t opcode, mx_handle_t vmo,
+                           uint64_t length, uint64_t vmo_offset, uint64_t dev_offset,
+                           void* cookie) {
+    if ((dev_offset % ns->block_size) || (length % ns->block_size)) {
+        ns->callbacks->complete(cookie, ERR_INVALID_ARGS);
+        return;
+    }
+    if ((dev_offset >= ns->capacity) || (length > (ns->capacity - dev_offset))) {
+        ns->callbacks->complete(cookie, ERR_OUT_OF_RANGE);
+        return;
+    }
+
+    mx_status_t status;
+    iotxn_t* txn;
+    if ((status = iotxn_alloc_vmo(&txn, IOTXN_ALLOC_POOL, vmo, vmo_offset, length)) != NO_ERROR) {
+        ns->callbacks->complete(cookie, status);
+        return;
+    }
+    txn->opcode = opcode;
+    txn->offset = dev_offset;
+    txn->complete_cb = nvme_block_complete;
+    txn->cookie = cookie;
+    memcpy(txn->extra, &ns, sizeof(nvme_namespace_t*));
+
+    iotxn_queue(ns->mxdev, txn);
+}
+
+static void nvme_block_read(mx_device_t* dev, mx_handle_t vmo, uint64_t length,
+                            uint64_t vmo_offset, uint64_t dev_offset, void* cookie) {
+    nvme_block_txn((nvme_namespace_t*)dev->ctx, IOTXN_OP_READ, vmo, length, vmo_offset, dev_offset, cookie);
+}
+
+static void nvme_block_write(mx_device_t* dev, mx_handle_t vmo, uint64_t length,
+                             uint64_t vmo_offset, uint64_t dev_offset, void* cookie) {
+    nvme_block_txn((nvme_namespace_t*)dev->ctx, IOTXN_OP_WRITE, vmo, length, vmo_offset, dev_offset, cookie);
+}
+
+static void nvme_block_poll(mx_device_t* dev) {
+    // the calling thread submitted to this queue pair, so look there
+    nvme_namespace_t* ns = dev->ctx;
+    nvme_queue_reap(nvme_pick_queue(ns->dev));
+}
+
+static block_ops_t nvme_block_ops = {
+    .set_callbacks = nvme_block_set_callbacks,
+    .get_info = nvme_block_get_info,
+    .read = nvme_block_read,
+    .write = nvme_block_write,
+    .poll = nvme_block_poll,
+};
+
+static mx_status_t nvme_ns_bind(nvme_device_t* dev, uint32_t nsid, const uint8_t* idns) {
+    uint64_t nsze;
+    memcpy(&nsze, idns + NVME_ID_NS_NSZE, sizeof(nsze));
+    if (nsze == 0) {
+        return ERR_NOT_FOUND; // inactive namespace
+    }
+    uint32_t lbaf;
+    memcpy(&lbaf, idns + NVME_ID_NS_LBAF + 4 * (idns[NVME_ID_NS_FLBAS] & 0xf), sizeof(lbaf));
+    uint32_t lbads = NVME_LBAF_LBADS(lbaf);
+    if (lbads < 9 || lbads > 16) {
+        printf("nvme: namespace %u block size 2^%u unsupported\n", nsid, lbads);
+        return ERR_NOT_SUPPORTED;
+    }
+
+    nvme_namespace_t* ns = calloc(1, sizeof(nvme_namespace_t));
+    if (!ns) {
+        return ERR_NO_MEMORY;
+    }
+    ns->dev = dev;
+    ns->nsid = nsid;
+    ns->block_size = 1u << lbads;
+    ns->capacity = nsze * ns->block_size;
+
+    char name[16];
+    snprintf(name, sizeof(name), "nvme-ns%u", nsid);
+    xprintf("%s: %" PRIu64 " blocks of %u bytes\n", name, nsze, ns->block_size);
+
+    device_add_args_t args = {
+        .version = DEVICE_ADD_ARGS_VERSION,
+        .name = name,
+        .ctx = ns,
+        .driver = dev->driver,
+        .ops = &nvme_ns_device_proto,
+        .proto_id = MX_PROTOCOL_BLOCK_CORE,
+        .proto_ops = &nvme_block_ops,
+    };
+
+    mx_status_t status = device_add(dev->mxdev, &args, &ns->mxdev);
+    if (status != NO_ERROR) {
+        free(ns);
+        return status;
+    }
+    return NO_ERROR;
+}
+
+// controller device protocol:
+
+// undo whatever the init thread got through; safe to call more than once
+static void nvme_teardown(nvme_device_t* dev) {
+    // stop the controller first so it isn't writing into rings we free
+    uint32_t cc = nvme_read32(dev, NVME_REG_CC);
+    if (cc & NVME_CC_EN) {
+        nvme_write32(dev, NVME_REG_CC, cc & ~NVME_CC_EN);
+        if (nvme_wait_ready(dev, false) != NO_ERROR) {
+            printf("nvme: controller reset timed out\n");
+        }
+    }
+
+    dev->irq_stop = true;
+    for (uint32_t i = 0; i < dev->irq_count; i++) {
+        nvme_irq_t* irq = &dev->irqs[i];
+        // the thread is waiting on the interrupt
+        mx_interrupt_signal(irq->handle);
+        thrd_join(irq->thread, NULL);
+        mx_handle_close(irq->handle);
+    }
+    if (dev->irq_count) {
+        dev->pci->set_irq_mode(dev->pcidev, MX_PCIE_IRQ_MODE_DISABLED, 0);
+    }
+    dev->irq_count = 0;
+    dev->io_count = 0;
+
+    for (uint32_t i = 0; i < NVME_MAX_IO_QUEUES; i++) {
+        // a queue that failed to come up can still hold its rings
+        if (io_buffer_is_valid(&dev->io[i].sq_buffer)) {
+            nvme_queue_release(&dev->io[i]);
+        }
+    }
+    if (io_buffer_is_valid(&dev->admin.sq_buffer)) {
+        nvme_queue_release(&dev->admin);
+    }
+}
+
+static void nvme_release(void* ctx) {
+    nvme_device_t* dev = ctx;
+    if (dev->init_started) {
+        thrd_join(dev->init_thread, NULL);
+    }
+    nvme_teardown(dev);
+    // closing the mapping handle unmaps the registers
+    mx_handle_close(dev->regs_handle);
+    free(dev);
+}
+
+static mx_protocol_device_t nvme_device_proto = {
+    .version = DEVICE_OPS_VERSION,
+    .release = nvme_release,
+};
+
+static int nvme_init_thread(void* arg) {
+    nvme_device_t* dev = arg;
+    io_buffer_t id_buffer = { .vmo_handle = MX_HANDLE_INVALID };
+    mx_status_t status;
+
+    dev->cap = nvme_read64(dev, NVME_REG_CAP);
+    if (NVME_CAP_MPSMIN(dev->cap) != 0) {
+        printf("nvme: minimum page size %u unsupported\n", 4096u << NVME_CAP_MPSMIN(dev->cap));
+        status = ERR_NOT_SUPPORTED;
+        goto fail;
+    }
+
+    // disable the controller before changing its queues
+    uint32_t cc = nvme_read32(dev, NVME_REG_CC);
+    if (cc & NVME_CC_EN) {
+        nvme_write32(dev, NVME_REG_CC, cc & ~NVME_CC_EN);
+    }
+    status = nvme_wait_ready(dev, false);
+    if (status != NO_ERROR) {
+        printf("nvme: controller reset timed out\n");
+        goto fail;
+    }
+
+    uint16_t entries = MIN(NVME_ADMIN_QUEUE_ENTRIES, NVME_CAP_MQES(dev->cap));
+    status = nvme_queue_init(dev, &dev->admin, 0, entries, false);
+    if (status != NO_ERROR) {
+        printf("nvme: error %d allocating admin queue\n", status);
+        goto fail;
+    }
+    nvme_write32(dev, NVME_REG_AQA, ((uint32_t)(entries - 1) << 16) | (entries - 1));
+    nvme_write64(dev, NVME_REG_ASQ, io_buffer_phys(&dev->admin.sq_buffer));
+    nvme_write64(dev, NVME_REG_ACQ, io_buffer_phys(&dev->admin.cq_buffer));
+
+    nvme_write32(dev, NVME_REG_CC, NVME_CC_CSS_NVM | NVME_CC_MPS(12) | NVME_CC_AMS_RR |
+                                   NVME_CC_IOSQES(NVME_SQE_SIZE_LOG2) |
+                                   NVME_CC_IOCQES(NVME_CQE_SIZE_LOG2) | NVME_CC_EN);
+    status = nvme_wait_ready(dev, true);
+    if (status != NO_ERROR || (nvme_read32(dev, NVME_REG_CSTS) & NVME_CSTS_CFS)) {
+        printf("nvme: controller failed to become ready\n");
+        status = ERR_IO;
+        goto fail;
+    }
+
+    // identify the controller
+    status = io_buffer_init(&id_buffer, PAGE_SIZE, IO_BUFFER_RW);
+    if (status != NO_ERROR) {
+        goto fail;
+    }
+    uint8_t* id = io_buffer_virt(&id_buffer);
+    nvme_sqe_t cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.cdw0 = NVME_SQE_CDW0(NVME_ADMIN_IDENTIFY, 0);
+    cmd.prp1 = io_buffer_phys(&id_buffer);
+    cmd.cdw10 = NVME_IDENTIFY_CTRL;
+    status = nvme_admin_cmd(dev, &cmd, NULL);
+    if (status != NO_ERROR) {
+        goto fail;
+    }
+    printf("nvme: model %.*s serial %.*s firmware %.*s\n",
+           NVME_ID_CTRL_MN_LEN, (char*)id + NVME_ID_CTRL_MN,
+           NVME_ID_CTRL_SN_LEN, (char*)id + NVME_ID_CTRL_SN,
+           NVME_ID_CTRL_FR_LEN, (char*)id + NVME_ID_CTRL_FR);
+    uint32_t nn;
+    memcpy(&nn, id + NVME_ID_CTRL_NN, sizeof(nn));
+    uint8_t mdts = id[NVME_ID_CTRL_MDTS];
+
+    // an unaligned buffer can take an extra page of prps
+    dev->max_xfer = (NVME_MAX_PRP_PAGES - 1) * PAGE_SIZE;
+    if (mdts && mdts < 20) {
+        dev->max_xfer = MIN(dev->max_xfer, (size_t)PAGE_SIZE << mdts);
+    }
+
+    // ask for a queue pair per cpu
+    uint32_t wanted = MIN(mx_system_get_num_cpus(), NVME_MAX_IO_QUEUES);
+    uint32_t granted;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.cdw0 = NVME_SQE_CDW0(NVME_ADMIN_SET_FEAT, 0);
+    cmd.cdw10 = NVME_FEAT_NUM_QUEUES;
+    cmd.cdw11 = ((wanted - 1) << 16) | (wanted - 1);
+    status = nvme_admin_cmd(dev, &cmd, &granted);
+    if (status != NO_ERROR) {
+        goto fail;
+    }
+    wanted = MIN(wanted, MIN(granted & 0xffff, granted >> 16) + 1);
+
+    status = nvme_setup_irqs(dev, wanted);
+    if (status != NO_ERROR) {
+        goto fail;
+    }
+
+    entries = MIN(NVME_IO_QUEUE_DEPTH + 1, NVME_CAP_MQES(dev->cap));
+    uint32_t count;
+    for (count = 0; count < wanted; count++) {
+        status = nvme_create_io_queue(dev, &dev->io[count], count + 1, entries,
+                                      count % dev->irq_count);
+        if (status != NO_ERROR) {
+            printf("nvme: error %d creating io queue %u\n", status, count + 1);
+            break;
+        }
+    }
+    if (count == 0) {
+        goto fail;
+    }
+    dev->io_count = count;
+    printf("nvme: %u io queues of depth %u on %u irqs, max transfer %zu\n",
+           dev->io_count, entries - 1, dev->irq_count, dev->max_xfer);
+
+    // publish a block device for each active namespace
+    for (uint32_t nsid = 1; nsid <= MIN(nn, NVME_MAX_NAMESPACES); nsid++) {
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.cdw0 = NVME_SQE_CDW0(NVME_ADMIN_IDENTIFY, 0);
+        cmd.nsid = nsid;
+        cmd.prp1 = io_buffer_phys(&id_buffer);
+        cmd.cdw10 = NVME_IDENTIFY_NS;
+        if (nvme_admin_cmd(dev, &cmd, NULL) == NO_ERROR) {
+            nvme_ns_bind(dev, nsid, id);
+        }
+    }
+
+    io_buffer_release(&id_buffer);
+    return NO_ERROR;
+fail:
+    nvme_teardown(dev);
+    if (io_buffer_is_valid(&id_buffer)) {
+        io_buffer_release(&id_buffer);
+    }
+    printf("nvme: controller init failed %d\n", status);
+    return status;
+}
+
+// implement driver object:
+
+static mx_status_t nvme_bind(mx_driver_t* drv, mx_device_t* dev, void** cookie) {
+    pci_protocol_t* pci;
+    if (device_op_get_protocol(dev, MX_PROTOCOL_PCI, (void**)&pci)) return ERR_NOT_SUPPORTED;
+
+    mx_status_t status = pci->claim_device(dev);
+    if (status < 0) {
+        xprintf("nvme: error %d claiming pci device\n", status);
+        return status;
+    }
+
+    nvme_device_t* device = calloc(1, sizeof(nvme_device_t));
+    if (!device) {
+        xprintf("nvme: out of memory\n");
+        return ERR_NO_MEMORY;
+    }
+    device->driver = drv;
+    device->pcidev = dev;
+    device->pci = pci;
+
+    // map register window
+    status = pci->map_mmio(dev, 0, MX_CACHE_POLICY_UNCACHED_DEVICE, &device->regs, &device->regs_size, &device->regs_handle);
+    if (status != NO_ERROR) {
+        xprintf("nvme: error %d mapping register window\n", status);
+        goto fail;
+    }
+
+    // nvme controller is bus master
+    status = pci->enable_bus_master(dev, true);
+    if (status < 0) {
+        xprintf("nvme: error %d in enable bus master\n", status);
+        goto fail;
+    }
+
+    // add the device for the controller
+    device_add_args_t args = {
+        .version = DEVICE_ADD_ARGS_VERSION,
+        .name = "nvme",
+        .ctx = device,
+        .driver = drv,
+        .ops = &nvme_device_proto,
+        .flags = DEVICE_ADD_NON_BINDABLE,
+    };
+
+    status = device_add(dev, &args, &device->mxdev);
+    if (status != NO_ERROR) {
+        xprintf("nvme: error %d in device_add\n", status);
+        goto fail;
+    }
+
+    // initialize controller and detect namespaces; release joins it
+    int ret = thrd_create_with_name(&device->init_thread, nvme_init_thread, device, "nvme-init");
+    if (ret != thrd_success) {
+        xprintf("nvme: error %d in init thread create\n", ret);
+        device_remove(device->mxdev);
+        return ERR_NO_RESOURCES;
+    }
+    device->init_started = true;
+
+    return NO_ERROR;
+fail:
+    if (device->regs_handle != MX_HANDLE_INVALID) {
+        mx_handle_close(device->regs_handle);
+    }
+    free(device);
+    return status;
+}
+
+static mx_driver_ops_t nvme_driver_ops = {
+    .version = DRIVER_OPS_VERSION,
+    .bind = nvme_bind,
+};
+
+// clang-format off
+MAGENTA_DRIVER_BEGIN(nvme, nvme_driver_ops, "magenta", "0.1", 4)
+    BI_ABORT_IF(NE, BIND_PROTOCOL, MX_PROTOCOL_PCI),
+    BI_ABORT_IF(NE, BIND_PCI_CLASS, 0x01), // mass storage
+    BI_ABORT_IF(NE, BIND_PCI_SUBCLASS, 0x08), // non-volatile memory
+    BI_MATCH_IF(EQ, BIND_PCI_INTERFACE, 0x02), // nvm express
+MAGENTA_DRIVER_END(nvme)
@@ -0,0 +1,112 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+
+// clang-format off
+
+// controller registers (BAR0)
+#define NVME_REG_CAP    0x00 // 64 bit
+#define NVME_REG_VS     0x08
+#define NVME_REG_INTMS  0x0c
+#define NVME_REG_INTMC  0x10
+#define NVME_REG_CC     0x14
+#define NVME_REG_CSTS   0x1c
+#define NVME_REG_AQA    0x24
+#define NVME_REG_ASQ    0x28 // 64 bit
+#define NVME_REG_ACQ    0x30 // 64 bit
+#define NVME_REG_DB     0x1000
+
+#define NVME_CAP_MQES(cap)   ((uint32_t)((cap) & 0xffff) + 1) // max entries per queue
+#define NVME_CAP_TO(cap)     ((uint32_t)(((cap) >> 24) & 0xff)) // 500ms units
+#define NVME_CAP_DSTRD(cap)  ((uint32_t)(((cap) >> 32) & 0xf))
+#define NVME_CAP_MPSMIN(cap) ((uint32_t)(((cap) >> 48) & 0xf))
+
+#define NVME_CC_EN           (1 << 0)
+#define NVME_CC_CSS_NVM      (0 << 4)
+#define NVME_CC_MPS(shift)   (((shift) - 12) << 7)
+#define NVME_CC_AMS_RR       (0 << 11)
+#define NVME_CC_SHN_NORMAL   (1 << 14)
+#define NVME_CC_IOSQES(log2) ((log2) << 16)
+#define NVME_CC_IOCQES(log2) ((log2) << 20)
+
+#define NVME_CSTS_RDY        (1 << 0)
+#define NVME_CSTS_CFS        (1 << 1)
+
+// admin command opcodes
+#define NVME_ADMIN_DELETE_SQ 0x00
+#define NVME_ADMIN_CREATE_SQ 0x01
+#define NVME_ADMIN_DELETE_CQ 0x04
+#define NVME_ADMIN_CREATE_CQ 0x05
+#define NVME_ADMIN_IDENTIFY  0x06
+#define NVME_ADMIN_SET_FEAT  0x09
+
+#define NVME_IDENTIFY_NS     0
+#define NVME_IDENTIFY_CTRL   1
+
+#define NVME_FEAT_NUM_QUEUES 0x07
+
+#define NVME_QUEUE_PC        (1 << 0) // physically contiguous
+#define NVME_CQ_IEN          (1 << 1) // interrupts enabled
+
+// nvm command opcodes
+#define NVME_CMD_FLUSH       0x00
+#define NVME_CMD_WRITE       0x01
+#define NVME_CMD_READ        0x02
+
+// completion status
+#define NVME_CQE_PHASE       (1 << 0)
+#define NVME_CQE_STATUS(st)  (((st) >> 1) & 0x7ff) // status code and type
+
+// identify data
+#define NVME_ID_CTRL_SN      4
+#define NVME_ID_CTRL_SN_LEN  20
+#define NVME_ID_CTRL_MN      24
+#define NVME_ID_CTRL_MN_LEN  40
+#define NVME_ID_CTRL_FR      64
+#define NVME_ID_CTRL_FR_LEN  8
+#define NVME_ID_CTRL_MDTS    77
+#define NVME_ID_CTRL_NN      516
+
+#define NVME_ID_NS_NSZE      0
+#define NVME_ID_NS_FLBAS     26
+#define NVME_ID_NS_LBAF      128
+#define NVME_LBAF_LBADS(f)   (((f) >> 16) & 0xff)
+
+// clang-format on
+
+typedef struct {
+    uint32_t cdw0;  // opcode, fused, prp/sgl select, command id
+    uint32_t nsid;
+    uint64_t rsvd;
+    uint64_t mptr;
+    uint64_t prp1;
+    uint64_t prp2;
+    uint32_t cdw10;
+    uint32_t cdw11;
+    uint32_t cdw12;
+    uint32_t cdw13;
+    uint32_t cdw14;
+    uint32_t cdw15;
+} __attribute__((packed)) nvme_sqe_t;
+
+#define NVME_SQE_CDW0(opcode, cid) ((uint32_t)(opcode) | ((uint32_t)(cid) << 16))
+
+typedef struct {
+    uint32_t result;
+    uint32_t rsvd;
+    uint16_t sq_head;
+    uint16_t sq_id;
+    uint16_t cid;
+    uint16_t status; // status field and phase tag
+} __attribute__((packed)) nvme_cqe_t;
+
+static_assert(sizeof(nvme_sqe_t) == 64, "unexpected submission queue entry size");
+static_assert(sizeof(nvme_cqe_t) == 16, "unexpected completion queue entry size");
+
+#define NVME_SQE_SIZE_LOG2 6
+#define NVME_CQE_SIZE_LOG2 4
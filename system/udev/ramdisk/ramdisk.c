@@ -83,9 +83,9 @@ static void ramdisk_fifo_read(mx_device_t* dev, mx_handle_t vmo, uint64_t length
         return;
     }
 
-    size_t actual;
-    // Reading from disk --> Write to file VMO
-    status = mx_vmo_write(vmo, (void*)rdev->mapped_addr + dev_offset, vmo_offset, len, &actual);
+    // Reading from disk --> copy from our VMO into the client's, page to
+    // page in the kernel rather than through our mapping
+    status = mx_vmo_copy(rdev->vmo, dev_offset, vmo, vmo_offset, len);
     rdev->cb->complete(cookie, status);
 }
 
@@ -99,9 +99,8 @@ static void ramdisk_fifo_write(mx_device_t* dev, mx_handle_t vmo, uint64_t lengt
         return;
     }
 
-    size_t actual = 0;
-    // Writing to disk --> Read from file VMO
-    status = mx_vmo_read(vmo, (void*)rdev->mapped_addr + dev_offset, vmo_offset, len, &actual);
+    // Writing to disk --> copy from the client's VMO into ours
+    status = mx_vmo_copy(vmo, vmo_offset, rdev->vmo, dev_offset, len);
     rdev->cb->complete(cookie, status);
 }
 
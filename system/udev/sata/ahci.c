@@ -51,6 +51,10 @@
 #define ahci_read(reg)       pcie_read32(reg)
 #define ahci_write(reg, val) pcie_write32(reg, val)
 
+// with ahci.ccc, interrupt after this many completions or this many ms
+#define AHCI_CCC_COMPLETIONS 8
+#define AHCI_CCC_TIMEOUT_MS  1
+
 #define HI32(val) (((val) >> 32) & 0xffffffff)
 #define LO32(val) ((val) & 0xffffffff)
 
@@ -97,6 +101,11 @@ typedef struct ahci_device {
 
     uint32_t cap;
 
+    // ports whose completions are coalesced, and the HBA interrupt
+    // status bit that the coalesced interrupt arrives on
+    uint32_t ccc_ports;
+    uint32_t ccc_int;
+
     ahci_port_t ports[AHCI_MAX_PORTS];
 } ahci_device_t;
 
@@ -213,28 +222,33 @@ static bool cmd_is_queued(uint8_t cmd) {
 }
 
 static void ahci_port_complete_txn(ahci_device_t* dev, ahci_port_t* port, mx_status_t status) {
-    iotxn_t* txn;
-    uint32_t sact = ahci_read(&port->regs->sact);
-    for (int i = 0; i < AHCI_MAX_COMMANDS; i++) {
-        txn = port->commands[i];
-        if (txn == NULL) {
-            continue;
-        }
-        if (!(sact & (1 << i))) {
-            mtx_lock(&port->lock);
-            // clear state before calling the complete() hook
-            port->running &= ~(1 << i);
-            port->commands[i] = NULL;
-
-            // resume the port if paused for sync and no outstanding transactions
-            if ((port->flags & AHCI_PORT_FLAG_SYNC_PAUSED) && !port->running) {
-                port->flags &= ~AHCI_PORT_FLAG_SYNC_PAUSED;
-            }
-            mtx_unlock(&port->lock);
+    iotxn_t* done[AHCI_MAX_COMMANDS];
+    int count = 0;
 
-            iotxn_complete(txn, status, txn->length);
+    // reap every slot the hardware has finished with in one pass; take the
+    // lock first so the worker can't be halfway through issuing a slot
+    mtx_lock(&port->lock);
+    uint32_t active = ahci_read(&port->regs->sact) | ahci_read(&port->regs->ci);
+    uint32_t finished = port->running & ~active;
+    while (finished) {
+        int i = __builtin_ctz(finished);
+        finished &= ~(1u << i);
+        // clear state before calling the complete() hook
+        port->running &= ~(1u << i);
+        if (port->commands[i] != NULL) {
+            done[count++] = port->commands[i];
+            port->commands[i] = NULL;
         }
     }
+    // resume the port if paused for sync and no outstanding transactions
+    if ((port->flags & AHCI_PORT_FLAG_SYNC_PAUSED) && !port->running) {
+        port->flags &= ~AHCI_PORT_FLAG_SYNC_PAUSED;
+    }
+    mtx_unlock(&port->lock);
+
+    for (int i = 0; i < count; i++) {
+        iotxn_complete(done[i], status, done[i]->length);
+    }
     // hit the worker thread to do the next txn
     completion_signal(&dev->worker_completion);
 }
@@ -496,35 +510,41 @@ static int ahci_worker_thread(void* arg) {
                 goto next;
             }
 
-            txn = list_peek_head_type(&port->txn_list, iotxn_t, node);
-            if (!txn) {
-                goto next;
-            }
-
-            // if IOTXN_SYNC_BEFORE, pause the port if there are transactions in flight
-            if ((txn->flags & IOTXN_SYNC_BEFORE) && port->running) {
-                port->flags |= AHCI_PORT_FLAG_SYNC_PAUSED;
-                goto next;
-            }
+            // issue as many queued commands as there are free slots, so an
+            // NCQ device sees the full queue depth and not one at a time.
+            // Slots the hardware still holds (e.g. after a watchdog timeout)
+            // stay off limits; bits only clear behind our back, so one read
+            // per pass is enough.
+            uint32_t hw_busy = ahci_read(&port->regs->sact) | ahci_read(&port->regs->ci);
+            while ((txn = list_peek_head_type(&port->txn_list, iotxn_t, node)) != NULL) {
+                // if IOTXN_SYNC_BEFORE, pause the port if there are transactions in flight
+                if ((txn->flags & IOTXN_SYNC_BEFORE) && port->running) {
+                    port->flags |= AHCI_PORT_FLAG_SYNC_PAUSED;
+                    break;
+                }
 
-            // find a free command tag
-            sata_pdata_t* pdata = sata_iotxn_pdata(txn);
-            int max = MIN(pdata->max_cmd, (int)((dev->cap >> 8) & 0x1f));
-            int i = 0;
-            for (i = 0; i <= max; i++) {
-                if (!ahci_port_cmd_busy(port, i)) break;
-            }
-            if (i > max) {
-                goto next;
-            }
+                // find a free command tag
+                sata_pdata_t* pdata = sata_iotxn_pdata(txn);
+                int max = MIN(pdata->max_cmd, (int)((dev->cap >> 8) & 0x1f));
+                uint32_t slots = (max >= 31) ? 0xffffffffu : ((1u << (max + 1)) - 1);
+                uint32_t free_slots = slots & ~(port->running | hw_busy);
+                if (!free_slots) {
+                    break;
+                }
+                int slot = __builtin_ctz(free_slots);
 
-            list_delete(&txn->node);
-            // if IOTXN_SYNC_AFTER, pause the port until this command is complete
-            if (txn->flags & IOTXN_SYNC_AFTER) {
-                port->flags |= AHCI_PORT_FLAG_SYNC_PAUSED;
+                list_delete(&txn->node);
+                // if IOTXN_SYNC_AFTER, pause the port until this command is complete
+                bool sync_after = txn->flags & IOTXN_SYNC_AFTER;
+                if (sync_after) {
+                    port->flags |= AHCI_PORT_FLAG_SYNC_PAUSED;
+                }
+                // run the command; it may complete (and be freed) right away
+                ahci_do_txn(dev, port, slot, txn);
+                if (sync_after) {
+                    break;
+                }
             }
-            // run the command
-            ahci_do_txn(dev, port, i, txn);
 next:
             mtx_unlock(&port->lock);
         }
@@ -584,13 +604,7 @@ static void ahci_port_irq(ahci_device_t* dev, int nr) {
     uint32_t is = ahci_read(&port->regs->is);
     ahci_write(&port->regs->is, is);
 
-    if (is & AHCI_PORT_INT_DHR) { // RFIS received
-        ahci_port_complete_txn(dev, port, NO_ERROR);
-    }
-    if (is & AHCI_PORT_INT_PS) { // PSFIS rcv
-        ahci_port_complete_txn(dev, port, NO_ERROR);
-    }
-    if (is & AHCI_PORT_INT_SDB) { // SDBFIS
+    if (is & AHCI_PORT_INT_COMPLETE) { // RFIS, PSFIS or SDBFIS received
         ahci_port_complete_txn(dev, port, NO_ERROR);
     }
     if (is & AHCI_PORT_INT_PRC) { // PhyRdy change
@@ -620,6 +634,17 @@ static int ahci_irq_thread(void* arg) {
         // handle interrupt for each port
         uint32_t is = ahci_read(&dev->regs->is);
         ahci_write(&dev->regs->is, is);
+        if (dev->ccc_ports && (is & (1u << dev->ccc_int))) {
+            // one coalesced interrupt covers every participating port
+            is &= ~(1u << dev->ccc_int);
+            for (int i = 0; i < AHCI_MAX_PORTS; i++) {
+                if (dev->ccc_ports & (1u << i)) {
+                    ahci_port_t* port = &dev->ports[i];
+                    ahci_write(&port->regs->is, AHCI_PORT_INT_COMPLETE);
+                    ahci_port_complete_txn(dev, port, NO_ERROR);
+                }
+            }
+        }
         for (int i = 0; is && i < AHCI_MAX_PORTS; i++) {
             if (is & 0x1) {
                 ahci_port_irq(dev, i);
@@ -675,6 +700,21 @@ static int ahci_init_thread(void* arg) {
         if (status) goto fail;
     }
 
+    // Command completion coalescing is off unless asked for: it trades
+    // latency for fewer interrupts, which only pays off under deep queues.
+    const char* ccc = getenv("ahci.ccc");
+    if ((dev->cap & AHCI_CAP_CCC) && ccc &&
+        strcmp(ccc, "0") && strcmp(ccc, "false") && strcmp(ccc, "off")) {
+        ahci_write(&dev->regs->ccc_ctl, 0);
+        dev->ccc_int = AHCI_CCC_CTL_INT(ahci_read(&dev->regs->ccc_ctl));
+        dev->ccc_ports = port_map;
+        ahci_write(&dev->regs->ccc_ports, dev->ccc_ports);
+        ahci_write(&dev->regs->ccc_ctl, AHCI_CCC_CTL_TV(AHCI_CCC_TIMEOUT_MS) |
+                                        AHCI_CCC_CTL_CC(AHCI_CCC_COMPLETIONS) |
+                                        AHCI_CCC_CTL_EN);
+        xprintf("ahci: completion coalescing on irq %u\n", dev->ccc_int);
+    }
+
     // clear hba interrupts
     ahci_write(&dev->regs->is, ahci_read(&dev->regs->is));
 
@@ -691,8 +731,13 @@ static int ahci_init_thread(void* arg) {
         // enable port
         ahci_port_enable(port);
 
-        // enable interrupts
-        ahci_write(&port->regs->ie, AHCI_PORT_INT_MASK);
+        // enable interrupts; completions on coalesced ports are reported
+        // through the ccc interrupt instead
+        if (dev->ccc_ports & (1u << i)) {
+            ahci_write(&port->regs->ie, AHCI_PORT_INT_MASK & ~AHCI_PORT_INT_COMPLETE);
+        } else {
+            ahci_write(&port->regs->ie, AHCI_PORT_INT_MASK);
+        }
 
         // reset port
         ahci_port_reset(port);
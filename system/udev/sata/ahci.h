@@ -86,10 +86,18 @@ typedef struct {
 } __attribute__((packed)) ahci_port_reg_t;
 
 #define AHCI_CAP_NCQ (1 << 30)
+#define AHCI_CAP_CCC (1 << 7)
 #define AHCI_GHC_HR  (1 << 0)
 #define AHCI_GHC_IE  (1 << 1)
 #define AHCI_GHC_AE  (1 << 31)
 
+#define AHCI_CCC_CTL_EN          (1 << 0)
+#define AHCI_CCC_CTL_INT(ctl)    (((ctl) >> 3) & 0x1f)
+#define AHCI_CCC_CTL_CC(n)       (((n) & 0xff) << 8)
+#define AHCI_CCC_CTL_TV(ms)      (((ms) & 0xffff) << 16)
+
+#define AHCI_PORT_INT_COMPLETE (AHCI_PORT_INT_SDB | AHCI_PORT_INT_PS | AHCI_PORT_INT_DHR)
+
 typedef struct {
     uint32_t cap;              // host capabilities
     uint32_t ghc;              // global host control
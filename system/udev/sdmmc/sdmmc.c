@@ -36,6 +36,9 @@
 #define SDMMC_STATE_RECV 0x5
 #define SDMMC_STATE_DATA 0x6
 
+// The host's block count register is 16 bits wide.
+#define SDMMC_MAX_BLOCKS_PER_CMD 0xffff
+
 #define TRACE 0
 
 #if TRACE
@@ -120,6 +123,56 @@ static void sdmmc_release(void* ctx) {
     free(sdmmc);
 }
 
+// Waits for the card to be ready for a data transfer, stopping one that was
+// left running if need be.
+static mx_status_t sdmmc_wait_for_tran(sdmmc_t* sdmmc, iotxn_t* txn) {
+    sdmmc_protocol_data_t* pdata = iotxn_pdata(txn, sdmmc_protocol_data_t);
+    const size_t max_attempts = 10;
+    for (size_t attempt = 0; attempt <= max_attempts; attempt++) {
+        mx_status_t rc = sdmmc_do_command(sdmmc->sdmmc_mxdev, SDMMC_SEND_STATUS,
+                                          sdmmc->rca << 16, txn);
+        if (rc != NO_ERROR) {
+            return rc;
+        }
+
+        uint8_t current_state = (pdata->response[0] >> 9) & 0xf;
+        if (current_state == SDMMC_STATE_RECV) {
+            sdmmc_do_command(sdmmc->sdmmc_mxdev, SDMMC_STOP_TRANSMISSION, 0, txn);
+            continue;
+        } else if (current_state == SDMMC_STATE_TRAN) {
+            return NO_ERROR;
+        }
+
+        mx_nanosleep(mx_deadline_after(MX_MSEC(10)));
+    }
+
+    // Too many retries, fail.
+    return ERR_BAD_STATE;
+}
+
+// Reads or writes the blocks of |txn|, which must be no more than
+// SDMMC_MAX_BLOCKS_PER_CMD, with a single command.
+static mx_status_t sdmmc_do_transfer(sdmmc_t* sdmmc, iotxn_t* txn) {
+    mx_status_t rc = sdmmc_wait_for_tran(sdmmc, txn);
+    if (rc != NO_ERROR) {
+        return rc;
+    }
+
+    uint32_t cmd;
+    if (txn->opcode == IOTXN_OP_READ) {
+        cmd = txn->length > SDHC_BLOCK_SIZE ? SDMMC_READ_MULTIPLE_BLOCK : SDMMC_READ_BLOCK;
+    } else {
+        cmd = txn->length > SDHC_BLOCK_SIZE ? SDMMC_WRITE_MULTIPLE_BLOCK : SDMMC_WRITE_BLOCK;
+    }
+
+    sdmmc_protocol_data_t* pdata = iotxn_pdata(txn, sdmmc_protocol_data_t);
+    pdata->blockcount = txn->length / SDHC_BLOCK_SIZE;
+    pdata->blocksize = SDHC_BLOCK_SIZE;
+
+    // SDHC cards are addressed in blocks.
+    return sdmmc_do_command(sdmmc->sdmmc_mxdev, cmd, txn->offset / SDHC_BLOCK_SIZE, txn);
+}
+
 static void sdmmc_iotxn_queue(void* ctx, iotxn_t* txn) {
     if (txn->offset % SDHC_BLOCK_SIZE) {
         xprintf("sdmmc: iotxn offset not aligned to block boundary, "
@@ -137,104 +190,40 @@ static void sdmmc_iotxn_queue(void* ctx, iotxn_t* txn) {
         return;
     }
 
-    iotxn_t* emmc_txn = NULL;
     sdmmc_t* sdmmc = ctx;
-    mx_device_t* sdmmc_mxdev = sdmmc->sdmmc_mxdev;
-    uint32_t cmd = 0;
-
-    // Figure out which SD command we need to issue.
-    switch(txn->opcode) {
-        case IOTXN_OP_READ:
-            if (txn->length > SDHC_BLOCK_SIZE) {
-                cmd = SDMMC_READ_MULTIPLE_BLOCK;
-            } else {
-                cmd = SDMMC_READ_BLOCK;
-            }
-            break;
-        case IOTXN_OP_WRITE:
-            if (txn->length > SDHC_BLOCK_SIZE) {
-                cmd = SDMMC_WRITE_MULTIPLE_BLOCK;
-            } else {
-                cmd = SDMMC_WRITE_BLOCK;
-            }
-            break;
-        default:
-            // Invalid opcode?
-            iotxn_complete(txn, ERR_INVALID_ARGS, 0);
-            return;
-    }
-
-    if (iotxn_alloc(&emmc_txn, IOTXN_ALLOC_CONTIGUOUS | IOTXN_ALLOC_POOL, txn->length) != NO_ERROR) {
-        xprintf("sdmmc: error allocating emmc iotxn\n");
-        iotxn_complete(txn, ERR_INTERNAL, 0);
+    if (txn->opcode != IOTXN_OP_READ && txn->opcode != IOTXN_OP_WRITE) {
+        iotxn_complete(txn, ERR_INVALID_ARGS, 0);
         return;
     }
-    emmc_txn->opcode = txn->opcode;
-    emmc_txn->flags = txn->flags;
-    emmc_txn->offset = txn->offset;
-    emmc_txn->length = txn->length;
-    emmc_txn->protocol = MX_PROTOCOL_SDMMC;
-    sdmmc_protocol_data_t* pdata = iotxn_pdata(emmc_txn, sdmmc_protocol_data_t);
 
-    uint8_t current_state;
-    const size_t max_attempts = 10;
-    size_t attempt = 0;
-    for (; attempt <= max_attempts; attempt++) {
-        mx_status_t rc = sdmmc_do_command(sdmmc_mxdev, SDMMC_SEND_STATUS,
-                                          sdmmc->rca << 16, emmc_txn);
+    // Transfer straight to and from the caller's buffer, as many blocks per
+    // command as the host can count, rather than bouncing through a
+    // contiguous copy.
+    mx_status_t rc = NO_ERROR;
+    mx_off_t done = 0;
+    while (done < txn->length) {
+        const mx_off_t length = MIN(txn->length - done,
+                                    (mx_off_t)SDMMC_MAX_BLOCKS_PER_CMD * SDHC_BLOCK_SIZE);
+        iotxn_t* emmc_txn = NULL;
+        rc = iotxn_clone_partial(txn, txn->vmo_offset + done, length, &emmc_txn);
         if (rc != NO_ERROR) {
-            iotxn_complete(txn, rc, 0);
-            goto out;
+            xprintf("sdmmc: error cloning iotxn, rc = %d\n", rc);
+            break;
         }
+        emmc_txn->offset = txn->offset + done;
+        emmc_txn->protocol = MX_PROTOCOL_SDMMC;
 
-        current_state = (pdata->response[0] >> 9) & 0xf;
+        rc = sdmmc_do_transfer(sdmmc, emmc_txn);
+        const mx_off_t actual = MIN(emmc_txn->actual, length);
+        iotxn_release(emmc_txn);
 
-        if (current_state == SDMMC_STATE_RECV) {
-            rc = sdmmc_do_command(sdmmc_mxdev, SDMMC_STOP_TRANSMISSION, 0, emmc_txn);
-            continue;
-        } else if (current_state == SDMMC_STATE_TRAN) {
+        done += actual;
+        if (rc != NO_ERROR || actual < length) {
             break;
         }
-
-        mx_nanosleep(mx_deadline_after(MX_MSEC(10)));
-    }
-
-    if (attempt == max_attempts) {
-        // Too many retries, fail.
-        iotxn_complete(txn, ERR_BAD_STATE, 0);
-        goto out;
     }
 
-    // Which block to operate against.
-    const uint32_t blkid = emmc_txn->offset / SDHC_BLOCK_SIZE;
-
-    pdata->blockcount = txn->length / SDHC_BLOCK_SIZE;
-    pdata->blocksize = SDHC_BLOCK_SIZE;
-
-    void* buffer;
-    size_t bytes_processed = 0;
-    if (txn->opcode == IOTXN_OP_WRITE) {
-        iotxn_mmap(txn, &buffer);
-        iotxn_copyto(emmc_txn, buffer, txn->length, 0);
-        bytes_processed = txn->length;
-    }
-
-    mx_status_t rc = sdmmc_do_command(sdmmc_mxdev, cmd, blkid, emmc_txn);
-    if (rc != NO_ERROR) {
-        iotxn_complete(txn, rc, 0);
-    }
-
-    if (txn->opcode == IOTXN_OP_READ) {
-        bytes_processed = MIN(emmc_txn->actual, txn->length);
-        iotxn_mmap(emmc_txn, &buffer);
-        iotxn_copyto(txn, buffer, bytes_processed, 0);
-    }
-
-    iotxn_complete(txn, NO_ERROR, bytes_processed);
-
-out:
-    if (emmc_txn)
-        iotxn_release(emmc_txn);
+    iotxn_complete(txn, rc, done);
 }
 
 // Block device protocol.
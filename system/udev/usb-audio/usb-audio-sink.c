@@ -5,8 +5,12 @@
 #include <ddk/device.h>
 #include <ddk/common/usb.h>
 #include <magenta/device/audio.h>
+#include <magenta/device/audio2.h>
 #include <magenta/device/usb.h>
 #include <magenta/hw/usb-audio.h>
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/port.h>
+#include <magenta/threads.h>
 #include <sync/completion.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -21,6 +25,14 @@
 // if no writes occur for 100ms
 #define WRITE_TIMEOUT_MS 100
 
+// Number of packets from the audio2 ring buffer kept queued on the endpoint.
+// This is how far ahead of the sound coming out of the device the controller
+// reads the ring, so it is most of the latency between a client writing a
+// frame and it being played.
+#define RB_QUEUE_DEPTH 3
+// USB frames between starting the ring buffer and its first packet
+#define RB_START_DELAY 2
+
 typedef struct {
     mx_device_t* mxdev;
     mx_device_t* usb_mxdev;
@@ -63,8 +75,47 @@ typedef struct {
     // the last signals we reported
     mx_signals_t signals;
 
+    // max packet size of our isochronous endpoint
+    int max_packet_size;
+
+    // audio2 ring buffer interface, published as a device of its own
+    mx_device_t* rb_mxdev;
+    mx_handle_t stream_ch;
+    mx_handle_t buffer_ch;
+    mx_handle_t rb_port;
+    thrd_t rb_port_thread;
+    bool rb_port_thread_running;    // rb_port_thread has been started and not joined
+
+    mx_handle_t rb_vmo;
+    uint32_t rb_size;
+    // one iotxn for each packet's worth of the ring, pointing straight into rb_vmo,
+    // so the controller reads the client's samples without us copying them
+    iotxn_t** rb_txns;
+    uint32_t rb_txn_count;
+    // packets completed between position notifications, or zero for none
+    uint32_t rb_notify_interval;
+
+    // mutex for the ring buffer state below, which is shared with rb_complete()
+    mtx_t rb_mutex;
+    bool rb_running;
+    uint32_t rb_next_txn;       // index in rb_txns of the next packet to queue
+    uint32_t rb_pending;        // packets queued on the endpoint
+    uint32_t rb_completed;      // packets completed since the last notification
+    uint64_t rb_next_usb_frame; // USB frame for the next packet
+    // signaled when rb_pending drops to zero after the ring buffer is stopped
+    completion_t rb_idle_completion;
 } usb_audio_sink_t;
 
+// requests which may arrive on the stream and ring buffer channels
+typedef union {
+    audio2_cmd_hdr_t hdr;
+    audio2_stream_cmd_set_format_req_t set_format_req;
+    audio2_rb_cmd_get_fifo_depth_req_t get_fifo_depth_req;
+    audio2_rb_cmd_get_buffer_req_t get_buffer_req;
+    audio2_rb_cmd_start_req_t start_req;
+    audio2_rb_cmd_stop_req_t stop_req;
+} usb_audio_sink_rb_req_t;
+
 static void update_signals(usb_audio_sink_t* sink) {
     mx_signals_t new_signals = 0;
     if (sink->dead) {
@@ -102,7 +153,10 @@ static void usb_audio_sink_unbind(void* ctx) {
     device_remove(sink->mxdev);
 }
 
+static void usb_audio_sink_rb_free_buffer(usb_audio_sink_t* sink);
+
 static void usb_audio_sink_free(usb_audio_sink_t* sink) {
+    usb_audio_sink_rb_free_buffer(sink);
     iotxn_t* txn;
     while ((txn = list_remove_head_type(&sink->free_write_reqs, iotxn_t, node)) != NULL) {
         iotxn_release(txn);
@@ -208,6 +262,10 @@ static mx_status_t usb_audio_sink_write(void* ctx, const void* data, size_t leng
     if (sink->dead) {
         return ERR_PEER_CLOSED;
     }
+    if (sink->stream_ch != MX_HANDLE_INVALID) {
+        // an audio2 client owns the endpoint
+        return ERR_BAD_STATE;
+    }
 
     mx_status_t status = NO_ERROR;
     size_t out_actual = length;
@@ -349,6 +407,503 @@ static mx_status_t usb_audio_sink_ioctl(void* ctx, uint32_t op, const void* in_b
     return ERR_NOT_SUPPORTED;
 }
 
+static void usb_audio_sink_close_handle(mx_handle_t* handle) {
+    if (*handle != MX_HANDLE_INVALID) {
+        mx_handle_close(*handle);
+        *handle = MX_HANDLE_INVALID;
+    }
+}
+
+static uint32_t gcd(uint32_t a, uint32_t b) {
+    while (b != 0) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Audio frames played in the first |usb_frames| USB frames after the ring buffer starts.
+// Each packet carries the difference, so at 44.1KHz they alternate between 44 and 45 frames.
+static uint64_t rb_audio_frames(usb_audio_sink_t* sink, uint64_t usb_frames) {
+    return (usb_frames * sink->sample_rate) / 1000;
+}
+
+// size of the largest packet we send at the current sample rate
+static uint32_t rb_max_packet_bytes(usb_audio_sink_t* sink) {
+    return ((sink->sample_rate + 999) / 1000) * sink->audio_frame_size;
+}
+
+static void usb_audio_sink_rb_free_buffer(usb_audio_sink_t* sink) {
+    for (uint32_t i = 0; i < sink->rb_txn_count; i++) {
+        if (sink->rb_txns[i]) {
+            iotxn_release(sink->rb_txns[i]);
+        }
+    }
+    free(sink->rb_txns);
+    sink->rb_txns = NULL;
+    sink->rb_txn_count = 0;
+    usb_audio_sink_close_handle(&sink->rb_vmo);
+    sink->rb_size = 0;
+}
+
+// Moves the packets needed to keep RB_QUEUE_DEPTH of them on the endpoint onto |txns|.
+// They are queued by usb_audio_sink_rb_queue() once rb_mutex is released.
+static void usb_audio_sink_rb_fill_locked(usb_audio_sink_t* sink, list_node_t* txns) {
+    while (sink->rb_running && sink->rb_pending < RB_QUEUE_DEPTH) {
+        iotxn_t* txn = sink->rb_txns[sink->rb_next_txn];
+        usb_iotxn_set_frame(txn, sink->rb_next_usb_frame++);
+        list_add_tail(txns, &txn->node);
+        sink->rb_next_txn = (sink->rb_next_txn + 1) % sink->rb_txn_count;
+        sink->rb_pending++;
+    }
+}
+
+static void usb_audio_sink_rb_queue(usb_audio_sink_t* sink, list_node_t* txns) {
+    iotxn_t* txn;
+    while ((txn = list_remove_head_type(txns, iotxn_t, node)) != NULL) {
+        iotxn_queue(sink->usb_mxdev, txn);
+    }
+}
+
+static void usb_audio_sink_rb_complete(iotxn_t* txn, void* cookie) {
+    usb_audio_sink_t* sink = (usb_audio_sink_t*)cookie;
+    list_node_t txns = LIST_INITIAL_VALUE(txns);
+
+    mtx_lock(&sink->rb_mutex);
+    sink->rb_pending--;
+    if (txn->status == ERR_PEER_CLOSED) {
+        // our device is going away
+        sink->rb_running = false;
+    }
+
+    if (sink->rb_running) {
+        if (sink->rb_notify_interval != 0 &&
+            ++sink->rb_completed == sink->rb_notify_interval) {
+            // The controller has read everything up to the end of this packet.  Timestamp
+            // the position so the client can tie it to its own clock.
+            audio2_rb_position_notify_t notify;
+            notify.hdr.transaction_id = AUDIO2_INVALID_TRANSACTION_ID;
+            notify.hdr.cmd = AUDIO2_RB_POSITION_NOTIFY;
+            notify.ring_buffer_pos = (txn->vmo_offset + txn->length) % sink->rb_size;
+            notify.position_ticks = mx_ticks_get();
+            mx_channel_write(sink->buffer_ch, 0, &notify, sizeof(notify), NULL, 0);
+            sink->rb_completed = 0;
+        }
+        usb_audio_sink_rb_fill_locked(sink, &txns);
+    } else if (sink->rb_pending == 0) {
+        completion_signal(&sink->rb_idle_completion);
+    }
+    mtx_unlock(&sink->rb_mutex);
+
+    usb_audio_sink_rb_queue(sink, &txns);
+}
+
+// Stops queueing packets from the ring buffer and waits for those on the endpoint to
+// complete, after which the ring buffer may be freed or started again.
+static mx_status_t usb_audio_sink_rb_stop(usb_audio_sink_t* sink) {
+    mtx_lock(&sink->rb_mutex);
+    bool was_running = sink->rb_running;
+    sink->rb_running = false;
+    bool wait = (sink->rb_pending > 0);
+    completion_reset(&sink->rb_idle_completion);
+    mtx_unlock(&sink->rb_mutex);
+
+    if (wait) {
+        completion_wait(&sink->rb_idle_completion, MX_TIME_INFINITE);
+    }
+    if (!was_running) {
+        return ERR_BAD_STATE;
+    }
+
+    // switch back to primary interface
+    if (sink->alternate_setting != 0) {
+        usb_set_interface(sink->usb_mxdev, sink->interface_number, 0);
+    }
+    return NO_ERROR;
+}
+
+static mx_status_t usb_audio_sink_set_format(usb_audio_sink_t* sink,
+                                             audio2_stream_cmd_set_format_req_t* req) {
+    audio2_stream_cmd_set_format_resp_t resp;
+    resp.hdr = req->hdr;
+    mx_handle_t ret_handle = MX_HANDLE_INVALID;
+    mx_status_t status = NO_ERROR;
+
+    if (sink->buffer_ch != MX_HANDLE_INVALID) {
+        if (sink->rb_running) {
+            // the client needs to stop the ring buffer before changing formats
+            status = ERR_BAD_STATE;
+            goto out;
+        }
+        usb_audio_sink_rb_free_buffer(sink);
+        usb_audio_sink_close_handle(&sink->buffer_ch);
+    }
+
+    // only 2 channel with 16 bit samples, like the write() interface
+    if (req->channels != sink->num_channels ||
+        req->sample_format != AUDIO2_SAMPLE_FORMAT_16BIT) {
+        status = ERR_NOT_SUPPORTED;
+        goto out;
+    }
+    int i;
+    for (i = 0; i < sink->sample_rate_count; i++) {
+        if (req->frames_per_second == sink->sample_rates[i]) {
+            break;
+        }
+    }
+    if (i == sink->sample_rate_count) {
+        status = ERR_NOT_SUPPORTED;
+        goto out;
+    }
+    if (req->frames_per_second != sink->sample_rate) {
+        status = usb_audio_set_sample_rate(sink->usb_mxdev, sink->ep_addr, req->frames_per_second);
+        if (status != NO_ERROR) {
+            goto out;
+        }
+        sink->sample_rate = req->frames_per_second;
+    }
+    if (rb_max_packet_bytes(sink) > (uint32_t)sink->max_packet_size) {
+        status = ERR_NOT_SUPPORTED;
+        goto out;
+    }
+
+    status = mx_channel_create(0, &sink->buffer_ch, &ret_handle);
+    if (status != NO_ERROR) {
+        goto out;
+    }
+    status = mx_port_bind(sink->rb_port, (uint64_t)sink->buffer_ch, sink->buffer_ch,
+                          MX_CHANNEL_READABLE | MX_CHANNEL_PEER_CLOSED);
+    if (status != NO_ERROR) {
+        usb_audio_sink_close_handle(&sink->buffer_ch);
+        usb_audio_sink_close_handle(&ret_handle);
+    }
+
+out:
+    resp.result = status;
+    return mx_channel_write(sink->stream_ch, 0, &resp, sizeof(resp), &ret_handle,
+                            ret_handle != MX_HANDLE_INVALID ? 1 : 0);
+}
+
+static mx_status_t usb_audio_sink_rb_get_fifo_depth(usb_audio_sink_t* sink,
+                                                    audio2_rb_cmd_get_fifo_depth_req_t* req) {
+    audio2_rb_cmd_get_fifo_depth_resp_t resp;
+    resp.hdr = req->hdr;
+    resp.result = NO_ERROR;
+    resp.fifo_depth = RB_QUEUE_DEPTH * rb_max_packet_bytes(sink);
+
+    return mx_channel_write(sink->buffer_ch, 0, &resp, sizeof(resp), NULL, 0);
+}
+
+static mx_status_t usb_audio_sink_rb_get_buffer(usb_audio_sink_t* sink,
+                                                audio2_rb_cmd_get_buffer_req_t* req) {
+    audio2_rb_cmd_get_buffer_resp_t resp;
+    resp.hdr = req->hdr;
+    mx_handle_t ret_handle = MX_HANDLE_INVALID;
+    mx_status_t status;
+
+    if (sink->rb_running) {
+        status = ERR_BAD_STATE;
+        goto out;
+    }
+    usb_audio_sink_rb_free_buffer(sink);
+
+    // The packet boundaries repeat every cycle_ms milliseconds, so a ring made of whole
+    // cycles never has a packet wrap around its end, and each packet can be a fixed window
+    // of the VMO.  The ring also needs room for the packets on the endpoint and the ones
+    // the client is writing.
+    uint32_t cycle_ms = 1000 / gcd(sink->sample_rate, 1000);
+    uint64_t ring_ms = ((uint64_t)req->min_ring_buffer_frames * 1000 + sink->sample_rate - 1) /
+                       sink->sample_rate;
+    if (ring_ms < 2 * RB_QUEUE_DEPTH) {
+        ring_ms = 2 * RB_QUEUE_DEPTH;
+    }
+    ring_ms = ((ring_ms + cycle_ms - 1) / cycle_ms) * cycle_ms;
+    uint64_t ring_size = rb_audio_frames(sink, ring_ms) * sink->audio_frame_size;
+    if (ring_size > UINT32_MAX) {
+        status = ERR_INVALID_ARGS;
+        goto out;
+    }
+
+    status = mx_vmo_create(ring_size, 0, &sink->rb_vmo);
+    if (status != NO_ERROR) {
+        goto fail;
+    }
+    status = mx_vmo_op_range(sink->rb_vmo, MX_VMO_OP_COMMIT, 0, ring_size, NULL, 0);
+    if (status != NO_ERROR) {
+        goto fail;
+    }
+    sink->rb_size = ring_size;
+
+    sink->rb_txns = calloc(ring_ms, sizeof(iotxn_t*));
+    if (!sink->rb_txns) {
+        status = ERR_NO_MEMORY;
+        goto fail;
+    }
+    sink->rb_txn_count = ring_ms;
+    for (uint32_t i = 0; i < sink->rb_txn_count; i++) {
+        uint64_t start = rb_audio_frames(sink, i) * sink->audio_frame_size;
+        uint64_t end = rb_audio_frames(sink, i + 1) * sink->audio_frame_size;
+        iotxn_t* txn;
+        status = iotxn_alloc_vmo(&txn, 0, sink->rb_vmo, start, end - start);
+        if (status != NO_ERROR) {
+            goto fail;
+        }
+        txn->protocol = MX_PROTOCOL_USB;
+        usb_protocol_data_t* pdata = iotxn_pdata(txn, usb_protocol_data_t);
+        memset(pdata, 0, sizeof(*pdata));
+        pdata->ep_address = sink->ep_addr;
+        txn->complete_cb = usb_audio_sink_rb_complete;
+        txn->cookie = sink;
+        sink->rb_txns[i] = txn;
+    }
+
+    sink->rb_notify_interval = 0;
+    if (req->notifications_per_ring != 0) {
+        sink->rb_notify_interval = sink->rb_txn_count / req->notifications_per_ring;
+        if (sink->rb_notify_interval == 0) {
+            sink->rb_notify_interval = 1;
+        }
+    }
+
+    status = mx_handle_duplicate(sink->rb_vmo, MX_RIGHT_TRANSFER | MX_RIGHT_READ |
+                                               MX_RIGHT_WRITE | MX_RIGHT_MAP, &ret_handle);
+    if (status == NO_ERROR) {
+        goto out;
+    }
+
+fail:
+    usb_audio_sink_rb_free_buffer(sink);
+out:
+    resp.result = status;
+    return mx_channel_write(sink->buffer_ch, 0, &resp, sizeof(resp), &ret_handle,
+                            ret_handle != MX_HANDLE_INVALID ? 1 : 0);
+}
+
+static mx_status_t usb_audio_sink_rb_start(usb_audio_sink_t* sink,
+                                           audio2_rb_cmd_start_req_t* req) {
+    audio2_rb_cmd_start_resp_t resp;
+    resp.hdr = req->hdr;
+    resp.start_ticks = 0;
+    list_node_t txns = LIST_INITIAL_VALUE(txns);
+
+    mtx_lock(&sink->rb_mutex);
+    if (!sink->rb_txns || sink->rb_running || sink->dead) {
+        resp.result = ERR_BAD_STATE;
+    } else {
+        // switch to alternate interface if necessary
+        if (sink->alternate_setting != 0) {
+            usb_set_interface(sink->usb_mxdev, sink->interface_number, sink->alternate_setting);
+        }
+
+        sink->rb_next_usb_frame = get_usb_current_frame(sink) + RB_START_DELAY;
+        sink->rb_next_txn = 0;
+        sink->rb_completed = 0;
+        sink->rb_running = true;
+        // the first packet goes out when the controller reaches its USB frame
+        resp.start_ticks = mx_ticks_get() + (RB_START_DELAY * mx_ticks_per_second()) / 1000;
+        resp.result = NO_ERROR;
+        usb_audio_sink_rb_fill_locked(sink, &txns);
+    }
+    mtx_unlock(&sink->rb_mutex);
+
+    usb_audio_sink_rb_queue(sink, &txns);
+    return mx_channel_write(sink->buffer_ch, 0, &resp, sizeof(resp), NULL, 0);
+}
+
+static mx_status_t usb_audio_sink_rb_stop_req(usb_audio_sink_t* sink,
+                                              audio2_rb_cmd_stop_req_t* req) {
+    audio2_rb_cmd_stop_resp_t resp;
+    resp.hdr = req->hdr;
+    resp.result = usb_audio_sink_rb_stop(sink);
+
+    return mx_channel_write(sink->buffer_ch, 0, &resp, sizeof(resp), NULL, 0);
+}
+
+#define HANDLE_REQ(_cmd, _payload, _handler)        \
+    case _cmd:                                      \
+        if (req_size != sizeof(req->_payload)) {    \
+            return ERR_INVALID_ARGS;                \
+        }                                           \
+        return _handler(sink, &req->_payload);
+static mx_status_t usb_audio_sink_rb_handle_req(usb_audio_sink_t* sink, mx_handle_t channel,
+                                                usb_audio_sink_rb_req_t* req, uint32_t req_size) {
+    if (req_size < sizeof(req->hdr)) {
+        return ERR_INVALID_ARGS;
+    }
+    if (channel == sink->stream_ch) {
+        switch (req->hdr.cmd) {
+        HANDLE_REQ(AUDIO2_STREAM_CMD_SET_FORMAT, set_format_req, usb_audio_sink_set_format);
+        default:
+            return ERR_NOT_SUPPORTED;
+        }
+    } else {
+        switch (req->hdr.cmd) {
+        HANDLE_REQ(AUDIO2_RB_CMD_GET_FIFO_DEPTH, get_fifo_depth_req,
+                   usb_audio_sink_rb_get_fifo_depth);
+        HANDLE_REQ(AUDIO2_RB_CMD_GET_BUFFER, get_buffer_req, usb_audio_sink_rb_get_buffer);
+        HANDLE_REQ(AUDIO2_RB_CMD_START, start_req, usb_audio_sink_rb_start);
+        HANDLE_REQ(AUDIO2_RB_CMD_STOP, stop_req, usb_audio_sink_rb_stop_req);
+        default:
+            return ERR_NOT_SUPPORTED;
+        }
+    }
+}
+#undef HANDLE_REQ
+
+// Serves the stream and ring buffer channels of an audio2 client until the client closes
+// the stream channel, sends us something we don't understand, or our device is unbound.
+static int usb_audio_sink_rb_thread(void* arg) {
+    usb_audio_sink_t* sink = (usb_audio_sink_t*)arg;
+
+    while (1) {
+        mx_io_packet_t packet;
+        mx_status_t status = mx_port_wait(sink->rb_port, MX_TIME_INFINITE, &packet,
+                                          sizeof(packet));
+        // usb_audio_sink_rb_unbind() queues a packet with a zero key to stop us
+        if (status != NO_ERROR || packet.hdr.key == 0) {
+            break;
+        }
+        mx_handle_t channel = (mx_handle_t)packet.hdr.key;
+        if (channel != sink->stream_ch && channel != sink->buffer_ch) {
+            // left over from a ring buffer channel we have since closed
+            continue;
+        }
+
+        if (packet.signals & MX_CHANNEL_READABLE) {
+            // drain the channel, since we only hear about it becoming readable
+            while (status == NO_ERROR) {
+                usb_audio_sink_rb_req_t req;
+                uint32_t req_size;
+                status = mx_channel_read(channel, 0, &req, NULL, sizeof(req), 0, &req_size, NULL);
+                if (status == NO_ERROR) {
+                    status = usb_audio_sink_rb_handle_req(sink, channel, &req, req_size);
+                }
+            }
+            if (status == ERR_SHOULD_WAIT) {
+                status = NO_ERROR;
+            }
+        } else if (packet.signals & MX_CHANNEL_PEER_CLOSED) {
+            if (channel == sink->stream_ch) {
+                break;
+            }
+            usb_audio_sink_rb_stop(sink);
+            usb_audio_sink_rb_free_buffer(sink);
+            usb_audio_sink_close_handle(&sink->buffer_ch);
+        }
+        if (status != NO_ERROR) {
+            if (status != ERR_PEER_CLOSED) {
+                printf("usb_audio_sink_rb_thread: dropping client: %d\n", status);
+            }
+            break;
+        }
+    }
+
+    usb_audio_sink_rb_stop(sink);
+    usb_audio_sink_rb_free_buffer(sink);
+    usb_audio_sink_close_handle(&sink->buffer_ch);
+
+    mtx_lock(&sink->mutex);
+    usb_audio_sink_close_handle(&sink->stream_ch);
+    usb_audio_sink_close_handle(&sink->rb_port);
+    mtx_unlock(&sink->mutex);
+    return 0;
+}
+
+static void usb_audio_sink_rb_unbind(void* ctx) {
+    usb_audio_sink_t* sink = ctx;
+
+    mtx_lock(&sink->mutex);
+    if (sink->rb_port != MX_HANDLE_INVALID) {
+        mx_io_packet_t packet = {};
+        mx_port_queue(sink->rb_port, &packet, sizeof(packet));
+    }
+    bool join = sink->rb_port_thread_running;
+    sink->rb_port_thread_running = false;
+    mtx_unlock(&sink->mutex);
+
+    if (join) {
+        thrd_join(sink->rb_port_thread, NULL);
+    }
+    device_remove(sink->rb_mxdev);
+}
+
+static void usb_audio_sink_rb_release(void* ctx) {
+    // the sink is freed when our parent, the usb-audio-sink device, is released
+}
+
+static mx_status_t usb_audio_sink_rb_ioctl(void* ctx, uint32_t op, const void* in_buf,
+                                           size_t in_len, void* out_buf, size_t out_len,
+                                           size_t* out_actual) {
+    usb_audio_sink_t* sink = ctx;
+
+    if (op != AUDIO2_IOCTL_GET_CHANNEL) {
+        return ERR_NOT_SUPPORTED;
+    }
+    if (out_len < sizeof(mx_handle_t)) {
+        return ERR_BUFFER_TOO_SMALL;
+    }
+
+    mx_status_t status = NO_ERROR;
+    mx_handle_t ret_handle = MX_HANDLE_INVALID;
+
+    mtx_lock(&sink->mutex);
+    if (sink->dead) {
+        status = ERR_PEER_CLOSED;
+        goto out;
+    }
+    // we serve one client at a time, and not while the write() interface is open
+    if (sink->stream_ch != MX_HANDLE_INVALID || sink->open) {
+        status = ERR_BAD_STATE;
+        goto out;
+    }
+    if (sink->rb_port_thread_running) {
+        // the previous client's thread has closed its handles and is finishing up
+        thrd_join(sink->rb_port_thread, NULL);
+        sink->rb_port_thread_running = false;
+    }
+
+    status = mx_port_create(0, &sink->rb_port);
+    if (status != NO_ERROR) {
+        goto out;
+    }
+    status = mx_channel_create(0, &sink->stream_ch, &ret_handle);
+    if (status != NO_ERROR) {
+        goto fail;
+    }
+    status = mx_port_bind(sink->rb_port, (uint64_t)sink->stream_ch, sink->stream_ch,
+                          MX_CHANNEL_READABLE | MX_CHANNEL_PEER_CLOSED);
+    if (status != NO_ERROR) {
+        goto fail;
+    }
+    int thrd_rc = thrd_create_with_name(&sink->rb_port_thread, usb_audio_sink_rb_thread, sink,
+                                        "usb_audio_sink_rb_thread");
+    if (thrd_rc != thrd_success) {
+        status = thrd_status_to_mx_status(thrd_rc);
+        goto fail;
+    }
+    sink->rb_port_thread_running = true;
+
+    *((mx_handle_t*)out_buf) = ret_handle;
+    *out_actual = sizeof(ret_handle);
+    goto out;
+
+fail:
+    usb_audio_sink_close_handle(&ret_handle);
+    usb_audio_sink_close_handle(&sink->stream_ch);
+    usb_audio_sink_close_handle(&sink->rb_port);
+out:
+    mtx_unlock(&sink->mutex);
+    return status;
+}
+
+static mx_protocol_device_t usb_audio_sink_rb_device_proto = {
+    .version = DEVICE_OPS_VERSION,
+    .unbind = usb_audio_sink_rb_unbind,
+    .release = usb_audio_sink_rb_release,
+    .ioctl = usb_audio_sink_rb_ioctl,
+};
+
 static mx_protocol_device_t usb_audio_sink_device_proto = {
     .version = DEVICE_OPS_VERSION,
     .unbind = usb_audio_sink_unbind,
@@ -391,6 +946,8 @@ mx_status_t usb_audio_sink_create(mx_driver_t* driver, mx_device_t* device, int
     sink->interface_number = intf->bInterfaceNumber;
     sink->alternate_setting = intf->bAlternateSetting;
     int packet_size = usb_ep_max_packet(ep);
+    sink->max_packet_size = packet_size;
+    mtx_init(&sink->rb_mutex, mtx_plain);
 
     for (int i = 0; i < WRITE_REQ_COUNT; i++) {
         iotxn_t* txn = usb_alloc_iotxn(sink->ep_addr, packet_size);
@@ -438,7 +995,24 @@ mx_status_t usb_audio_sink_create(mx_driver_t* driver, mx_device_t* device, int
     if (status != NO_ERROR) {
         printf("device_add failed in usb_audio_sink_create\n");
         usb_audio_sink_free(sink);
+        return status;
     }
 
-    return status;
+    // The audio2 ring buffer interface is a child of our device, so it shows up in
+    // /dev/class/audio2-output for clients like audio2.  The write() interface keeps working
+    // if this fails.
+    snprintf(name, sizeof(name), "usb-audio2-sink-%d", index);
+    device_add_args_t rb_args = {
+        .version = DEVICE_ADD_ARGS_VERSION,
+        .name = name,
+        .ctx = sink,
+        .driver = driver,
+        .ops = &usb_audio_sink_rb_device_proto,
+        .proto_id = MX_PROTOCOL_AUDIO2_OUTPUT,
+    };
+    if (device_add(sink->mxdev, &rb_args, &sink->rb_mxdev) != NO_ERROR) {
+        printf("device_add failed for audio2 device in usb_audio_sink_create\n");
+    }
+
+    return NO_ERROR;
 }
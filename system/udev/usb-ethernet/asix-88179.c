@@ -264,7 +264,14 @@ static mx_status_t ax88179_recv(ax88179_t* eth, iotxn_t* request) {
         }
         if (!drop) {
             xprintf("offset = %zd\n", offset);
-            eth->ifc->recv(eth->cookie, read_data + offset + 2, pkt_len - 2, 0);
+            // the checksum engine has checked tcp and udp
+            uint32_t flags = 0;
+            uint32_t l4 = *pkt_hdr & AX88179_RX_COE_L4_MASK;
+            if (((l4 == AX88179_RX_COE_L4_TCP) || (l4 == AX88179_RX_COE_L4_UDP)) &&
+                !(*pkt_hdr & (AX88179_RX_COE_L3_CKSUM_ERR | AX88179_RX_COE_L4_CKSUM_ERR))) {
+                flags |= ETHMAC_RX_CSUM_OK;
+            }
+            eth->ifc->recv(eth->cookie, read_data + offset + 2, pkt_len - 2, flags);
         }
 
         // Advance past this packet in the completed read
@@ -378,6 +385,15 @@ static void ax88179_send(mx_device_t* dev, uint32_t options, void* data, size_t
     iotxn_queue(eth->usb_device, request);
 }
 
+// The checksum engine is set up in init to fill in tcp and udp
+// checksums itself, so ETHMAC_FRAME_TX_CSUM needs nothing more.
+static void ax88179_send_batch(mx_device_t* dev, uint32_t options,
+                               ethmac_frame_t* frames, size_t count) {
+    for (size_t n = 0; n < count; n++) {
+        ax88179_send(dev, options, frames[n].data, frames[n].length);
+    }
+}
+
 static void ax88179_unbind(void* ctx) {
     ax88179_t* eth = ctx;
     device_remove(eth->device);
@@ -420,6 +436,7 @@ static mx_status_t ax88179_query(mx_device_t* dev, uint32_t options, ethmac_info
     }
 
     memset(info, 0, sizeof(*info));
+    info->features = ETHMAC_FEATURE_TX_CSUM | ETHMAC_FEATURE_RX_CSUM;
     info->mtu = 1500;
     memcpy(info->mac, eth->mac_addr, sizeof(eth->mac_addr));
 
@@ -454,6 +471,7 @@ static ethmac_protocol_t ethmac_ops = {
     .stop = ax88179_stop,
     .start = ax88179_start,
     .send = ax88179_send,
+    .send_batch = ax88179_send_batch,
 };
 
 
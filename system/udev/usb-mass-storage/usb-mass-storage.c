@@ -32,6 +32,12 @@ typedef struct {
 } ums_txn_extra_t;
 static_assert(sizeof(ums_txn_extra_t) <= sizeof (iotxn_extra_data_t), "");
 
+// data phase of a read or write command
+typedef struct {
+    iotxn_t*        clone;
+    completion_t    completion;
+} ums_data_transfer_t;
+
 static csw_status_t ums_verify_csw(ums_t* ums, iotxn_t* csw_request, uint32_t* out_residue);
 
 
@@ -82,12 +88,16 @@ static void ums_send_cbw(ums_t* ums, uint8_t lun, uint32_t transfer_length, uint
     ums_queue_request(ums, txn);
 }
 
-static mx_status_t ums_read_csw(ums_t* ums, uint32_t* out_residue) {
-    completion_t completion = COMPLETION_INIT;
+// queues the CSW request without waiting for it, so it can be in flight during the data phase
+static void ums_queue_csw(ums_t* ums, completion_t* completion) {
     iotxn_t* csw_request = ums->csw_iotxn;
-    csw_request->cookie = &completion;
+    csw_request->cookie = completion;
     ums_queue_request(ums, csw_request);
-    completion_wait(&completion, MX_TIME_INFINITE);
+}
+
+static mx_status_t ums_wait_csw(ums_t* ums, completion_t* completion, uint32_t* out_residue) {
+    iotxn_t* csw_request = ums->csw_iotxn;
+    completion_wait(completion, MX_TIME_INFINITE);
 
     csw_status_t csw_error = ums_verify_csw(ums, csw_request, out_residue);
 
@@ -104,6 +114,12 @@ static mx_status_t ums_read_csw(ums_t* ums, uint32_t* out_residue) {
     }
 }
 
+static mx_status_t ums_read_csw(ums_t* ums, uint32_t* out_residue) {
+    completion_t completion = COMPLETION_INIT;
+    ums_queue_csw(ums, &completion);
+    return ums_wait_csw(ums, &completion, out_residue);
+}
+
 static csw_status_t ums_verify_csw(ums_t* ums, iotxn_t* csw_request, uint32_t* out_residue) {
     ums_csw_t csw;
     iotxn_copyfrom(csw_request, &csw, sizeof(csw), 0);
@@ -271,12 +287,14 @@ static void clone_complete(iotxn_t* clone, void* cookie) {
     completion_signal((completion_t *)cookie);
 }
 
-static void ums_queue_data_transfer(ums_t* ums, iotxn_t* txn, uint8_t ep_address, size_t max_packet) {
+// Clones |txn| for the data phase.  This is done before the CBW is sent, so that running out
+// of memory fails the command before the device has been told about it.
+static mx_status_t ums_init_data_transfer(ums_t* ums, ums_data_transfer_t* transfer, iotxn_t* txn,
+                                          uint8_t ep_address, size_t max_packet) {
     iotxn_t* clone = NULL;
     mx_status_t status = iotxn_clone(txn, &clone);
     if (status != NO_ERROR) {
-        iotxn_complete(txn, status, 0);
-        return;
+        return status;
     }
 
     clone->complete_cb = clone_complete;
@@ -295,10 +313,24 @@ static void ums_queue_data_transfer(ums_t* ums, iotxn_t* txn, uint8_t ep_address
     memset(pdata, 0, sizeof(*pdata));
     pdata->ep_address = ep_address;
 
-    completion_t completion = COMPLETION_INIT;
-    clone->cookie = &completion;
-    ums_queue_request(ums, clone);
-    completion_wait(&completion, MX_TIME_INFINITE);
+    transfer->clone = clone;
+    transfer->completion = COMPLETION_INIT;
+    clone->cookie = &transfer->completion;
+    return NO_ERROR;
+}
+
+// The CSW can be queued behind the data phase if it does not share an endpoint with it, or
+// if the data phase is a single request.  Otherwise clone_complete() queues the rest of the
+// data behind the CSW, which would then take the data meant for them.
+static bool ums_can_queue_csw_early(ums_t* ums, ums_data_transfer_t* transfer, uint8_t ep_address) {
+    ums_txn_extra_t* extra = (ums_txn_extra_t *)&transfer->clone->extra;
+    return ep_address != ums->bulk_in_addr || extra->total_length <= ums->max_transfer;
+}
+
+static void ums_finish_data_transfer(ums_data_transfer_t* transfer, iotxn_t* txn) {
+    iotxn_t* clone = transfer->clone;
+    ums_txn_extra_t* extra = (ums_txn_extra_t *)&clone->extra;
+    completion_wait(&transfer->completion, MX_TIME_INFINITE);
 
     txn->status = clone->status;
     txn->actual = (txn->status == NO_ERROR ? extra->offset : 0);
@@ -306,6 +338,25 @@ static void ums_queue_data_transfer(ums_t* ums, iotxn_t* txn, uint8_t ep_address
     iotxn_release(clone);
 }
 
+// Runs the data and status phases of a command whose CBW has been queued.  The CSW request
+// is queued while the data is still moving when that is safe, so the device can send it as
+// soon as it is done instead of waiting for us to notice the data phase completing.
+static mx_status_t ums_transfer_data(ums_t* ums, ums_data_transfer_t* transfer, iotxn_t* txn,
+                                     uint8_t ep_address, uint32_t* out_residue) {
+    completion_t csw_completion = COMPLETION_INIT;
+    bool early_csw = ums_can_queue_csw_early(ums, transfer, ep_address);
+
+    ums_queue_request(ums, transfer->clone);
+    if (early_csw) {
+        ums_queue_csw(ums, &csw_completion);
+    }
+    ums_finish_data_transfer(transfer, txn);
+    if (!early_csw) {
+        ums_queue_csw(ums, &csw_completion);
+    }
+    return ums_wait_csw(ums, &csw_completion, out_residue);
+}
+
 static mx_status_t ums_read(ums_block_t* dev, iotxn_t* txn) {
     if (txn->length > UINT32_MAX) return ERR_INVALID_ARGS;
 
@@ -323,6 +374,13 @@ static mx_status_t ums_read(ums_block_t* dev, iotxn_t* txn) {
     uint32_t transfer_length = num_blocks * dev->block_size;
     ums_t* ums = block_to_ums(dev);
 
+    ums_data_transfer_t transfer;
+    mx_status_t status = ums_init_data_transfer(ums, &transfer, txn, ums->bulk_in_addr,
+                                                ums->bulk_in_max_packet);
+    if (status != NO_ERROR) {
+        return status;
+    }
+
     // CBW Configuration
 
     // Need to use UMS_READ16 if block addresses are greater than 32 bit
@@ -351,10 +409,8 @@ static mx_status_t ums_read(ums_block_t* dev, iotxn_t* txn) {
         ums_send_cbw(ums, dev->lun, transfer_length, USB_DIR_IN, sizeof(command), &command);
     }
 
-    ums_queue_data_transfer(ums, txn, ums->bulk_in_addr, ums->bulk_in_max_packet);
-
     uint32_t residue;
-    mx_status_t status = ums_read_csw(ums, &residue);
+    status = ums_transfer_data(ums, &transfer, txn, ums->bulk_in_addr, &residue);
     if (status == NO_ERROR) {
         status = txn->actual - residue;
     }
@@ -379,6 +435,13 @@ static mx_status_t ums_write(ums_block_t* dev, iotxn_t* txn) {
     uint32_t transfer_length = num_blocks * dev->block_size;
     ums_t* ums = block_to_ums(dev);
 
+    ums_data_transfer_t transfer;
+    mx_status_t status = ums_init_data_transfer(ums, &transfer, txn, ums->bulk_out_addr,
+                                                ums->bulk_out_max_packet);
+    if (status != NO_ERROR) {
+        return status;
+    }
+
     // Need to use UMS_WRITE16 if block addresses are greater than 32 bit
     if (dev->total_blocks > UINT32_MAX) {
         scsi_command16_t command;
@@ -404,11 +467,9 @@ static mx_status_t ums_write(ums_block_t* dev, iotxn_t* txn) {
         ums_send_cbw(ums, dev->lun, transfer_length, USB_DIR_OUT, sizeof(command), &command);
     }
 
-    ums_queue_data_transfer(ums, txn, ums->bulk_out_addr, ums->bulk_out_max_packet);
-
-    // receive CSW
+    // send the data and receive CSW
     uint32_t residue;
-    mx_status_t status = ums_read_csw(ums, &residue);
+    status = ums_transfer_data(ums, &transfer, txn, ums->bulk_out_addr, &residue);
     if (status == NO_ERROR) {
         status = transfer_length - residue;
     }
@@ -305,22 +305,23 @@ static mx_status_t xhci_continue_transfer_locked(xhci_t* xhci, xhci_endpoint_t*
         state->needs_data_event = false;
     }
 
-    // if we get here, then we are ready to ring the doorbell
+    // if we get here, then the transfer is ready for the doorbell, which our caller rings
     // update dequeue_ptr to TRB following this transaction
     txn->context = (void *)ring->current;
 
-    XHCI_WRITE32(&xhci->doorbells[proto_data->device_id], ep_index + 1);
-
     return NO_ERROR;
 }
 
-static void xhci_process_transactions_locked(xhci_t* xhci, xhci_endpoint_t* ep,
-                                             list_node_t* completed_txns) {
+// Returns the last iotxn that was fully queued on the transfer ring, or NULL if there were none.
+static iotxn_t* xhci_queue_transactions_locked(xhci_t* xhci, xhci_endpoint_t* ep,
+                                               list_node_t* completed_txns) {
+    iotxn_t* queued = NULL;
+
     // loop until we fill our transfer ring or run out of iotxns to process
     while (1) {
         if (xhci_transfer_ring_free_trbs(&ep->transfer_ring) == 0) {
             // no available TRBs - need to wait for some complete
-            return;
+            return queued;
         }
 
         while (!ep->current_txn) {
@@ -328,7 +329,7 @@ static void xhci_process_transactions_locked(xhci_t* xhci, xhci_endpoint_t* ep,
             iotxn_t* txn = list_remove_head_type(&ep->queued_txns, iotxn_t, node);
             if (!txn) {
                 // nothing to do
-                return;
+                return queued;
             }
 
             mx_status_t status = xhci_start_transfer_locked(xhci, ep, txn);
@@ -347,9 +348,11 @@ static void xhci_process_transactions_locked(xhci_t* xhci, xhci_endpoint_t* ep,
             mx_status_t status = xhci_continue_transfer_locked(xhci, ep, txn);
             if (status == ERR_SHOULD_WAIT) {
                 // no available TRBs - need to wait for some complete
-                return;
+                return queued;
             } else {
-                if (status != NO_ERROR) {
+                if (status == NO_ERROR) {
+                    queued = txn;
+                } else {
                     txn->status = status;
                     txn->actual = 0;
                     list_add_tail(completed_txns, &txn->node);
@@ -360,6 +363,18 @@ static void xhci_process_transactions_locked(xhci_t* xhci, xhci_endpoint_t* ep,
     }
 }
 
+static void xhci_process_transactions_locked(xhci_t* xhci, xhci_endpoint_t* ep,
+                                             list_node_t* completed_txns) {
+    // queue as much as the transfer ring will hold, then ring the doorbell once for all of it
+    // rather than once per iotxn
+    iotxn_t* txn = xhci_queue_transactions_locked(xhci, ep, completed_txns);
+    if (txn) {
+        usb_protocol_data_t* proto_data = iotxn_pdata(txn, usb_protocol_data_t);
+        uint8_t ep_index = xhci_endpoint_index(proto_data->ep_address);
+        XHCI_WRITE32(&xhci->doorbells[proto_data->device_id], ep_index + 1);
+    }
+}
+
 mx_status_t xhci_queue_transfer(xhci_t* xhci, iotxn_t* txn) {
     usb_protocol_data_t* proto_data = iotxn_pdata(txn, usb_protocol_data_t);
     uint32_t slot_id = proto_data->device_id;
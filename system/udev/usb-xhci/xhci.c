@@ -394,6 +394,9 @@ static void xhci_interruptor_init(xhci_t* xhci, int interruptor) {
 
     xhci_update_erdp(xhci, interruptor);
 
+    // hold off interrupts for a little while after each one, so a burst of completions
+    // arrives as a single batch of events rather than an interrupt apiece
+    XHCI_SET_BITS32(&intr_regs->imod, IMODI_START, IMODI_BITS, XHCI_IMOD_INTERVAL);
     XHCI_SET32(&intr_regs->iman, IMAN_IE, IMAN_IE);
     XHCI_SET32(&intr_regs->erstsz, ERSTSZ_MASK, ERST_ARRAY_SIZE);
     XHCI_WRITE64(&intr_regs->erstba, xhci->erst_arrays_phys[interruptor]);
@@ -508,6 +511,7 @@ uint64_t xhci_get_current_frame(xhci_t* xhci) {
 
 static void xhci_handle_events(xhci_t* xhci, int interruptor) {
     xhci_event_ring_t* er = &xhci->event_rings[interruptor];
+    size_t handled = 0;
 
     // process all TRBs with cycle bit matching our CCS
     while ((XHCI_READ32(&er->current->control) & TRB_C) == er->ccs) {
@@ -535,6 +539,16 @@ static void xhci_handle_events(xhci_t* xhci, int interruptor) {
             er->current = er->start;
             er->ccs ^= TRB_C;
         }
+
+        // Only tell the controller how far we have got once per batch, or often enough
+        // within a long one that it never sees the event ring as full.
+        if (++handled % XHCI_ERDP_UPDATE_INTERVAL == 0) {
+            xhci_update_erdp(xhci, interruptor);
+        }
+    }
+
+    // this also clears the busy bit, so the controller can interrupt us again
+    if (handled % XHCI_ERDP_UPDATE_INTERVAL != 0) {
         xhci_update_erdp(xhci, interruptor);
     }
 }
@@ -27,6 +27,11 @@
 #define EVENT_RING_SIZE (PAGE_SIZE / sizeof(xhci_trb_t))
 #define ERST_ARRAY_SIZE 1
 
+// Interrupter moderation interval, in 250ns units (40us)
+#define XHCI_IMOD_INTERVAL 160
+// events handled between event ring dequeue pointer updates
+#define XHCI_ERDP_UPDATE_INTERVAL (EVENT_RING_SIZE / 4)
+
 #define XHCI_RH_USB_2 0 // index of USB 2.0 virtual root hub device
 #define XHCI_RH_USB_3 1 // index of USB 2.0 virtual root hub device
 #define XHCI_RH_COUNT 2 // number of virtual root hub devices
@@ -38,6 +38,9 @@
 #define VIRTIO_BLK_S_OK         0
 #define VIRTIO_BLK_S_IOERR      1
 #define VIRTIO_BLK_S_UNSUPP     2
+
+// largest piece of a buffer described by one descriptor
+#define VIRTIO_BLK_MAX_SEG_SIZE (1u << 22)
 // clang-format on
 
 namespace virtio {
@@ -129,7 +132,14 @@ mx_status_t BlockDevice::Init() {
     // ack and set the driver status bit
     StatusAcknowledgeDriver();
 
-    // XXX check features bits and ack/nak them
+    // take up the ring features that cut down on descriptors, kicks and
+    // interrupts; the block specific ones we don't use
+    uint32_t features = ReadFeatures();
+    uint32_t accepted = features & ((1u << VIRTIO_RING_F_INDIRECT_DESC) |
+                                    (1u << VIRTIO_RING_F_EVENT_IDX));
+    WriteFeatures(accepted);
+    LTRACEF("device features %#x, accepted %#x\n", features, accepted);
+    indirect_ = accepted & (1u << VIRTIO_RING_F_INDIRECT_DESC);
 
     // allocate the main vring
     auto err = vring_.Init(0, 128); // 128 matches legacy pci
@@ -137,6 +147,7 @@ mx_status_t BlockDevice::Init() {
         VIRTIO_ERROR("failed to allocate vring\n");
         return err;
     }
+    vring_.SetEventIdx(accepted & (1u << VIRTIO_RING_F_EVENT_IDX));
 
     // allocate a queue of block requests
     size_t size = sizeof(virtio_blk_req) * blk_req_count + sizeof(uint8_t) * blk_req_count;
@@ -155,6 +166,16 @@ mx_status_t BlockDevice::Init() {
 
     LTRACEF("allocated blk responses at %p, physical address %#" PRIxPTR "\n", blk_res_, blk_res_pa_);
 
+    if (indirect_) {
+        size = sizeof(vring_desc) * (blk_max_segs + 2) * blk_req_count;
+        r = map_contiguous_memory(size, (uintptr_t*)&blk_ind_, &blk_ind_pa_);
+        if (r < 0) {
+            // carry on with direct descriptor chains
+            VIRTIO_ERROR("cannot alloc indirect descriptor tables %d\n", r);
+            indirect_ = false;
+        }
+    }
+
     // start the interrupt thread
     StartIrqThread();
 
@@ -189,45 +210,36 @@ void BlockDevice::IrqRingUpdate() {
 
     // parse our descriptor chain, add back to the free queue
     auto free_chain = [this](vring_used_elem* used_elem) {
-        uint32_t i = (uint16_t)used_elem->id;
-        struct vring_desc* desc = vring_.DescFromIndex((uint16_t)i);
-        auto head_desc = desc; // save the first element
-        for (;;) {
-            int next;
+        uint16_t head = (uint16_t)used_elem->id;
 
 #if LOCAL_TRACE > 0
-            virtio_dump_desc(desc);
+        virtio_dump_desc(vring_.DescFromIndex(head));
 #endif
 
-            if (desc->flags & VRING_DESC_F_NEXT) {
-                next = desc->next;
-            } else {
-                /* end of chain */
-                next = -1;
-            }
-
-            vring_.FreeDesc((uint16_t)i);
+        // an indirect request is a single descriptor without a next link,
+        // so this frees either kind
+        vring_.FreeDescChain(head);
 
-            if (next < 0)
-                break;
-            i = next;
-            desc = vring_.DescFromIndex((uint16_t)i);
-        }
-
-        // search our pending txn list to see if this completes it
-        iotxn_t* txn;
-        list_for_every_entry (&iotxn_list, txn, iotxn_t, node) {
-            if (txn->context == head_desc) {
-                LTRACEF("completes txn %p\n", txn);
-                list_delete(&txn->node);
-                iotxn_complete(txn, NO_ERROR, txn->length);
-                break;
+        // find the request this completes
+        for (unsigned int i = 0; i < blk_req_count; i++) {
+            iotxn_t* txn = blk_req_txn_[i];
+            if (txn == nullptr || blk_req_desc_[i] != head) {
+                continue;
             }
+            LTRACEF("completes txn %p\n", txn);
+            mx_status_t status = (blk_res_[i] == VIRTIO_BLK_S_OK) ? NO_ERROR : ERR_IO;
+            blk_req_txn_[i] = nullptr;
+            free_blk_req(i);
+            iotxn_complete(txn, status, (status == NO_ERROR) ? txn->length : 0);
+            break;
         }
     };
 
     // tell the ring to find free chains and hand it back to our lambda
     vring_.IrqRingUpdate(free_chain);
+
+    // request slots and descriptors may have come free for waiting iotxns
+    StartPendingTxnsLocked();
 }
 
 void BlockDevice::IrqConfigChange() {
@@ -239,8 +251,6 @@ void BlockDevice::QueueReadWriteTxn(iotxn_t* txn) {
 
     mxtl::AutoLock lock(&lock_);
 
-    bool write = (txn->opcode == IOTXN_OP_WRITE);
-
     // offset must be aligned to block size
     if (txn->offset % config_.blk_size) {
         TRACEF("offset %#" PRIx64 " is not aligned to sector size %u!\n", txn->offset, config_.blk_size);
@@ -251,9 +261,69 @@ void BlockDevice::QueueReadWriteTxn(iotxn_t* txn) {
     // constrain to device capacity
     txn->length = MIN(txn->length, GetSize() - txn->offset);
 
+    list_add_tail(&iotxn_list, &txn->node);
+    StartPendingTxnsLocked();
+}
+
+void BlockDevice::StartPendingTxnsLocked() {
+    bool submitted = false;
+    iotxn_t* txn;
+    while ((txn = list_peek_head_type(&iotxn_list, iotxn_t, node)) != nullptr) {
+        mx_status_t status = StartTxnLocked(txn);
+        if (status == ERR_SHOULD_WAIT) {
+            // out of request slots or descriptors; completions restart us
+            break;
+        }
+        list_delete(&txn->node);
+        if (status != NO_ERROR) {
+            iotxn_complete(txn, status, 0);
+        } else {
+            submitted = true;
+        }
+    }
+
+    /* kick off everything submitted with one notification */
+    if (submitted)
+        vring_.Kick();
+}
+
+mx_status_t BlockDevice::StartTxnLocked(iotxn_t* txn) {
+    bool write = (txn->opcode == IOTXN_OP_WRITE);
+
+    mx_status_t status = iotxn_physmap(txn);
+    if (status != NO_ERROR) {
+        return status;
+    }
+
+    // count the physically contiguous pieces of the buffer
+    iotxn_phys_iter_t iter;
+    mx_paddr_t paddr;
+    size_t segs = 0;
+    iotxn_phys_iter_init(&iter, txn, VIRTIO_BLK_MAX_SEG_SIZE);
+    while (iotxn_phys_iter_next(&iter, &paddr) > 0) {
+        segs++;
+    }
+    if (segs == 0 || segs > blk_max_segs) {
+        TRACEF("txn %p has %zu segments, can only do 1 to %zu\n", txn, segs, blk_max_segs);
+        return ERR_NOT_SUPPORTED;
+    }
+
     // allocate and start filling out a block request
     auto index = alloc_blk_req();
+    if (index == blk_req_count) {
+        return ERR_SHOULD_WAIT;
+    }
     LTRACEF("request index %u\n", index);
+
+    /* put together a transfer */
+    uint16_t head;
+    auto desc = vring_.AllocDescChain(indirect_ ? (uint16_t)1 : (uint16_t)(segs + 2), &head);
+    if (desc == nullptr) {
+        free_blk_req(index);
+        return ERR_SHOULD_WAIT;
+    }
+    LTRACEF("after alloc chain desc %p, i %u\n", desc, head);
+
     auto req = &blk_req_[index];
     req->type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
     req->ioprio = 0;
@@ -261,41 +331,53 @@ void BlockDevice::QueueReadWriteTxn(iotxn_t* txn) {
     LTRACEF("blk_req type %u ioprio %u sector %" PRIu64 "\n",
             req->type, req->ioprio, req->sector);
 
-    /* put together a transfer */
-    uint16_t i;
-    auto desc = vring_.AllocDescChain(3, &i);
-    LTRACEF("after alloc chain desc %p, i %u\n", desc, i);
-
-    /* point the iotxn at this head descriptor */
-    txn->context = desc;
+    // with indirect descriptors the chain is built in this request's table
+    // and the single ring descriptor points at it
+    vring_desc* table = nullptr;
+    if (indirect_) {
+        table = &blk_ind_[index * (blk_max_segs + 2)];
+        desc->addr = blk_ind_pa_ + index * (blk_max_segs + 2) * sizeof(vring_desc);
+        desc->len = (uint32_t)((segs + 2) * sizeof(vring_desc));
+        desc->flags = VRING_DESC_F_INDIRECT;
+        desc = &table[0];
+    }
+    auto next_desc = [this, table](vring_desc* d) {
+        if (table) {
+            d->flags |= VRING_DESC_F_NEXT;
+            d->next = (uint16_t)(d - table + 1);
+            return d + 1;
+        }
+        d->flags |= VRING_DESC_F_NEXT;
+        return vring_.DescFromIndex(d->next);
+    };
 
     /* set up the descriptor pointing to the head */
     desc->addr = blk_req_pa_ + index * sizeof(virtio_blk_req);
     desc->len = sizeof(struct virtio_blk_req);
-    desc->flags |= VRING_DESC_F_NEXT;
+    desc->flags = table ? 0 : (desc->flags & VRING_DESC_F_NEXT);
 
 #if LOCAL_TRACE > 0
     virtio_dump_desc(desc);
 #endif
 
-    /* set up the descriptor pointing to the buffer */
-    desc = vring_.DescFromIndex(desc->next);
-
-    iotxn_physmap(txn);
-
-    desc->addr = (uint64_t)iotxn_phys(txn);
-    desc->len = (uint32_t)txn->length;
-
-    if (!write)
-        desc->flags |= VRING_DESC_F_WRITE; /* mark buffer as write-only if its a block read */
-    desc->flags |= VRING_DESC_F_NEXT;
+    /* set up the descriptors pointing to the buffer */
+    iotxn_phys_iter_init(&iter, txn, VIRTIO_BLK_MAX_SEG_SIZE);
+    size_t length;
+    while ((length = iotxn_phys_iter_next(&iter, &paddr)) > 0) {
+        desc = next_desc(desc);
+        desc->addr = (uint64_t)paddr;
+        desc->len = (uint32_t)length;
+        desc->flags = table ? 0 : (desc->flags & VRING_DESC_F_NEXT);
+        if (!write)
+            desc->flags |= VRING_DESC_F_WRITE; /* mark buffer as write-only if its a block read */
 
 #if LOCAL_TRACE > 0
-    virtio_dump_desc(desc);
+        virtio_dump_desc(desc);
 #endif
+    }
 
     /* set up the descriptor pointing to the response */
-    desc = vring_.DescFromIndex(desc->next);
+    desc = next_desc(desc);
     desc->addr = blk_res_pa_ + index;
     desc->len = 1;
     desc->flags = VRING_DESC_F_WRITE;
@@ -304,14 +386,14 @@ void BlockDevice::QueueReadWriteTxn(iotxn_t* txn) {
     virtio_dump_desc(desc);
 #endif
 
-    // save the iotxn in a list
-    list_add_tail(&iotxn_list, &txn->node);
+    // remember the iotxn so completion can find it
+    blk_req_txn_[index] = txn;
+    blk_req_desc_[index] = head;
 
     /* submit the transfer */
-    vring_.SubmitChain(i);
+    vring_.SubmitChain(head);
 
-    /* kick it off */
-    vring_.Kick();
+    return NO_ERROR;
 }
 
 } // namespace virtio
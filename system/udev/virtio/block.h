@@ -7,6 +7,7 @@
 #include "ring.h"
 
 #include <magenta/compiler.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 namespace virtio {
@@ -36,6 +37,10 @@ private:
 
     void QueueReadWriteTxn(iotxn_t* txn);
 
+    // issue waiting iotxns while there are request slots and descriptors
+    void StartPendingTxnsLocked();
+    mx_status_t StartTxnLocked(iotxn_t* txn);
+
     // the main virtio ring
     Ring vring_ = {this};
 
@@ -61,25 +66,42 @@ private:
     // a queue of block request/responses
     static const size_t blk_req_count = 32;
 
+    // the most physically discontiguous pieces an iotxn may be made of
+    static const size_t blk_max_segs = 64;
+
     mx_paddr_t blk_req_pa_ = 0;
     virtio_blk_req* blk_req_ = nullptr;
 
     mx_paddr_t blk_res_pa_ = 0;
     uint8_t* blk_res_ = nullptr;
 
+    // with VIRTIO_RING_F_INDIRECT_DESC, each request slot has a table of
+    // blk_max_segs + 2 descriptors, so a request of any shape takes up
+    // just one descriptor in the ring
+    bool indirect_ = false;
+    mx_paddr_t blk_ind_pa_ = 0;
+    vring_desc* blk_ind_ = nullptr;
+
+    // the iotxn and head descriptor of each request slot in flight
+    iotxn_t* blk_req_txn_[blk_req_count] = {};
+    uint16_t blk_req_desc_[blk_req_count] = {};
+
     uint32_t blk_req_bitmap_ = 0;
 
+    // returns blk_req_count if every request slot is in use
     unsigned int alloc_blk_req() {
-        unsigned int i = 31 - __builtin_clz(blk_req_bitmap_);
-        blk_req_bitmap_ |= (1 << i);
+        if (blk_req_bitmap_ == UINT32_MAX)
+            return static_cast<unsigned int>(blk_req_count);
+        unsigned int i = __builtin_ctz(~blk_req_bitmap_);
+        blk_req_bitmap_ |= (1u << i);
         return i;
     }
 
     void free_blk_req(unsigned int i) {
-        blk_req_bitmap_ &= ~(1 << i);
+        blk_req_bitmap_ &= ~(1u << i);
     }
 
-    // pending iotxns
+    // iotxns waiting for a request slot or descriptors
     list_node iotxn_list = LIST_INITIAL_VALUE(iotxn_list);
 };
 
@@ -34,6 +34,10 @@ public:
     virtual void IrqRingUpdate() {}
     virtual void IrqConfigChange() {}
 
+    // the size of ring |index|, which legacy devices fix and Ring::Init()
+    // must be given
+    uint16_t GetRingSize(uint16_t index);
+
     // used by Ring class to manipulate config registers
     void SetRing(uint16_t index, uint16_t count, mx_paddr_t pa_desc, mx_paddr_t pa_avail, mx_paddr_t pa_used);
     void RingKick(uint16_t ring_index);
@@ -48,6 +52,11 @@ protected:
     void StatusAcknowledgeDriver();
     void StatusDriverOK();
 
+    // feature negotiation, between StatusAcknowledgeDriver() and
+    // StatusDriverOK(); only the low 32 feature bits are handled
+    uint32_t ReadFeatures();
+    void WriteFeatures(uint32_t features);
+
     static int IrqThreadEntry(void* arg);
     void IrqWorker();
 
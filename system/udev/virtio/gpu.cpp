@@ -74,6 +74,15 @@ void GpuDevice::virtio_gpu_flush(mx_device_t* dev) {
     gd->Flush();
 }
 
+void GpuDevice::virtio_gpu_flush_region(mx_device_t* dev, uint32_t x, uint32_t y,
+                                        uint32_t width, uint32_t height) {
+    GpuDevice* gd = static_cast<GpuDevice*>(dev->ctx);
+
+    LTRACEF("dev %p, x %u y %u w %u h %u\n", gd, x, y, width, height);
+
+    gd->FlushRegion(x, y, width, height);
+}
+
 GpuDevice::GpuDevice(mx_driver_t* driver, mx_device_t* bus_device)
     : Device(driver, bus_device) {
 
@@ -94,16 +103,35 @@ static void dump_gpu_config(const volatile struct virtio_gpu_config* config) {
     LTRACEF("reserved 0x%x\n", config->reserved);
 }
 
-mx_status_t GpuDevice::send_command_response(const void* cmd, size_t cmd_len, void** _res, size_t res_len) {
+void GpuDevice::queue_command(const void* cmd, size_t cmd_len, void** _res, size_t res_len, size_t* _slot) {
     LTRACEF("dev %p, cmd %p, cmd_len %zu, res %p, res_len %zu\n", this, cmd, cmd_len, _res, res_len);
 
+    assert(cmd_len + res_len <= kCommandSlotSize);
+
+    /* find a free slot, waiting for an outstanding command to finish if there are none */
+    size_t slot;
+    for (;;) {
+        for (slot = 0; slot < kMaxCommands; slot++) {
+            if (!slot_busy_[slot])
+                break;
+        }
+        if (slot < kMaxCommands)
+            break;
+        cnd_wait(&request_cond_, request_lock_.GetInternal());
+    }
+    slot_busy_[slot] = true;
+    slot_done_[slot] = false;
+
+    void* req = (void*)((uint8_t*)gpu_req_ + slot * kCommandSlotSize);
+    mx_paddr_t req_phys = gpu_req_pa_ + slot * kCommandSlotSize;
+
     uint16_t i;
     struct vring_desc* desc = vring_.AllocDescChain(2, &i);
     assert(desc);
 
-    memcpy(gpu_req_, cmd, cmd_len);
+    memcpy(req, cmd, cmd_len);
 
-    desc->addr = gpu_req_pa_;
+    desc->addr = req_phys;
     desc->len = (uint32_t)cmd_len;
     desc->flags |= VRING_DESC_F_NEXT;
 
@@ -111,23 +139,43 @@ mx_status_t GpuDevice::send_command_response(const void* cmd, size_t cmd_len, vo
     desc = vring_.DescFromIndex(desc->next);
     assert(desc);
 
-    void* res = (void*)((uint8_t*)gpu_req_ + cmd_len);
+    void* res = (void*)((uint8_t*)req + cmd_len);
     *_res = res;
-    mx_paddr_t res_phys = gpu_req_pa_ + cmd_len;
+    mx_paddr_t res_phys = req_phys + cmd_len;
     memset(res, 0, res_len);
 
     desc->addr = res_phys;
     desc->len = (uint32_t)res_len;
     desc->flags = VRING_DESC_F_WRITE;
 
-    /* submit the transfer */
+    /* submit the transfer, the caller kicks it off */
     vring_.SubmitChain(i);
 
+    *_slot = slot;
+}
+
+void GpuDevice::wait_command(size_t slot) {
+    while (!slot_done_[slot])
+        cnd_wait(&request_cond_, request_lock_.GetInternal());
+}
+
+void GpuDevice::release_command(size_t slot) {
+    /* the response stays readable until the caller drops request_lock_, since
+     * nobody can reuse the slot before then */
+    slot_busy_[slot] = false;
+    cnd_broadcast(&request_cond_);
+}
+
+mx_status_t GpuDevice::send_command_response(const void* cmd, size_t cmd_len, void** _res, size_t res_len) {
+    size_t slot;
+    queue_command(cmd, cmd_len, _res, res_len, &slot);
+
     /* kick it off */
     vring_.Kick();
 
     /* wait for result */
-    cnd_wait(&request_cond_, request_lock_.GetInternal());
+    wait_command(slot);
+    release_command(slot);
 
     return NO_ERROR;
 }
@@ -266,65 +314,82 @@ mx_status_t GpuDevice::set_scanout(uint32_t scanout_id, uint32_t resource_id, ui
     return err;
 }
 
-mx_status_t GpuDevice::flush_resource(uint32_t resource_id, uint32_t width, uint32_t height) {
-    LTRACEF("dev %p, resource_id %u, width %u, height %u\n", this, resource_id, width, height);
+mx_status_t GpuDevice::update_region(uint32_t resource_id, const virtio_gpu_rect& r) {
+    LTRACEF("dev %p, resource_id %u, x %u y %u w %u h %u\n", this, resource_id, r.x, r.y, r.width, r.height);
 
-    /* grab a lock to keep this single message at a time */
+    /* grab a lock to keep this pair of messages together */
     mxtl::AutoLock lock(&request_lock_);
 
-    /* construct the request */
-    virtio_gpu_resource_flush req;
-    memset(&req, 0, sizeof(req));
-
-    req.hdr.type = VIRTIO_GPU_CMD_RESOURCE_FLUSH;
-    req.r.x = req.r.y = 0;
-    req.r.width = width;
-    req.r.height = height;
-    req.resource_id = resource_id;
+    /* copy the damaged part of the backing store over to the host's resource */
+    virtio_gpu_transfer_to_host_2d transfer;
+    memset(&transfer, 0, sizeof(transfer));
 
-    /* send the command and get a response */
-    virtio_gpu_ctrl_hdr* res;
-    auto err = send_command_response(&req, sizeof(req), (void**)&res, sizeof(*res));
-    assert(err == NO_ERROR);
+    transfer.hdr.type = VIRTIO_GPU_CMD_TRANSFER_TO_HOST_2D;
+    transfer.r = r;
+    transfer.offset = ((uint64_t)r.y * pmode_.r.width + r.x) * 4;
+    transfer.resource_id = resource_id;
 
-    /* see if we got a valid response */
-    LTRACEF("response type 0x%x\n", res->type);
-    err = (res->type == VIRTIO_GPU_RESP_OK_NODATA) ? NO_ERROR : ERR_NO_MEMORY;
+    /* and redraw that part of the scanout from it */
+    virtio_gpu_resource_flush flush;
+    memset(&flush, 0, sizeof(flush));
 
-    return err;
-}
+    flush.hdr.type = VIRTIO_GPU_CMD_RESOURCE_FLUSH;
+    flush.r = r;
+    flush.resource_id = resource_id;
 
-mx_status_t GpuDevice::transfer_to_host_2d(uint32_t resource_id, uint32_t width, uint32_t height) {
-    LTRACEF("dev %p, resource_id %u, width %u, height %u\n", this, resource_id, width, height);
+    /* the control queue is processed in order, so both go out together rather
+     * than waiting on the transfer before sending the flush */
+    virtio_gpu_ctrl_hdr* transfer_res;
+    size_t transfer_slot;
+    queue_command(&transfer, sizeof(transfer), (void**)&transfer_res, sizeof(*transfer_res), &transfer_slot);
 
-    /* grab a lock to keep this single message at a time */
-    mxtl::AutoLock lock(&request_lock_);
+    virtio_gpu_ctrl_hdr* flush_res;
+    size_t flush_slot;
+    queue_command(&flush, sizeof(flush), (void**)&flush_res, sizeof(*flush_res), &flush_slot);
 
-    /* construct the request */
-    virtio_gpu_transfer_to_host_2d req;
-    memset(&req, 0, sizeof(req));
+    vring_.Kick();
 
-    req.hdr.type = VIRTIO_GPU_CMD_TRANSFER_TO_HOST_2D;
-    req.r.x = req.r.y = 0;
-    req.r.width = width;
-    req.r.height = height;
-    req.offset = 0;
-    req.resource_id = resource_id;
+    wait_command(transfer_slot);
+    wait_command(flush_slot);
 
-    /* send the command and get a response */
-    virtio_gpu_ctrl_hdr* res;
-    auto err = send_command_response(&req, sizeof(req), (void**)&res, sizeof(*res));
-    assert(err == NO_ERROR);
+    /* see if we got valid responses */
+    LTRACEF("response types 0x%x 0x%x\n", transfer_res->type, flush_res->type);
+    auto err = (transfer_res->type == VIRTIO_GPU_RESP_OK_NODATA &&
+                flush_res->type == VIRTIO_GPU_RESP_OK_NODATA) ? NO_ERROR : ERR_NO_MEMORY;
 
-    /* see if we got a valid response */
-    LTRACEF("response type 0x%x\n", res->type);
-    err = (res->type == VIRTIO_GPU_RESP_OK_NODATA) ? NO_ERROR : ERR_NO_MEMORY;
+    release_command(transfer_slot);
+    release_command(flush_slot);
 
     return err;
 }
 
 void GpuDevice::Flush() {
+    FlushRegion(0, 0, pmode_.r.width, pmode_.r.height);
+}
+
+void GpuDevice::FlushRegion(uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+    if (x >= pmode_.r.width || y >= pmode_.r.height)
+        return;
+    width = MIN(width, pmode_.r.width - x);
+    height = MIN(height, pmode_.r.height - y);
+    if (width == 0 || height == 0)
+        return;
+
     mxtl::AutoLock al(&flush_lock_);
+    if (damage_.width == 0) {
+        damage_.x = x;
+        damage_.y = y;
+        damage_.width = width;
+        damage_.height = height;
+    } else {
+        /* grow the pending damage to cover this region as well */
+        uint32_t x1 = MAX(damage_.x + damage_.width, x + width);
+        uint32_t y1 = MAX(damage_.y + damage_.height, y + height);
+        damage_.x = MIN(damage_.x, x);
+        damage_.y = MIN(damage_.y, y);
+        damage_.width = x1 - damage_.x;
+        damage_.height = y1 - damage_.y;
+    }
     flush_pending_ = true;
     cnd_signal(&flush_cond_);
 }
@@ -332,24 +397,21 @@ void GpuDevice::Flush() {
 void GpuDevice::virtio_gpu_flusher() {
     LTRACE_ENTRY;
     for (;;) {
+        virtio_gpu_rect r;
         {
             mxtl::AutoLock al(&flush_lock_);
-            if (!flush_pending_)
+            while (!flush_pending_)
                 cnd_wait(&flush_cond_, flush_lock_.GetInternal());
             flush_pending_ = false;
+
+            /* everything flushed while the last update was in flight goes out in one */
+            r = damage_;
+            damage_ = {};
         }
 
         LTRACEF("flushing\n");
 
-        /* transfer to host 2d */
-        auto err = transfer_to_host_2d(display_resource_id_, pmode_.r.width, pmode_.r.height);
-        if (err < 0) {
-            LTRACEF("failed to flush resource\n");
-            continue;
-        }
-
-        /* resource flush */
-        err = flush_resource(display_resource_id_, pmode_.r.width, pmode_.r.height);
+        auto err = update_region(display_resource_id_, r);
         if (err < 0) {
             LTRACEF("failed to flush resource\n");
             continue;
@@ -427,6 +489,7 @@ mx_status_t GpuDevice::virtio_gpu_start() {
     display_proto_ops_.get_mode = virtio_gpu_get_mode;
     display_proto_ops_.get_framebuffer = virtio_gpu_get_framebuffer;
     display_proto_ops_.flush = virtio_gpu_flush;
+    display_proto_ops_.flush_region = virtio_gpu_flush_region;
 
     // initialize the mx_device and publish us
     // point the ctx of our DDK device at ourself
@@ -510,7 +573,8 @@ void GpuDevice::IrqRingUpdate() {
     auto free_chain = [this](vring_used_elem* used_elem) {
         uint32_t i = (uint16_t)used_elem->id;
         struct vring_desc* desc = vring_.DescFromIndex((uint16_t)i);
-        __UNUSED auto head_desc = desc; // save the first element
+        auto head_desc = desc; // save the first element
+        size_t slot = (head_desc->addr - gpu_req_pa_) / kCommandSlotSize;
         for (;;) {
             int next;
 
@@ -529,9 +593,10 @@ void GpuDevice::IrqRingUpdate() {
             desc = vring_.DescFromIndex((uint16_t)i);
         }
 
-        // wack the request condition
+        // mark the command done and wack the request condition
         request_lock_.Acquire();
-        cnd_signal(&request_cond_);
+        slot_done_[slot] = true;
+        cnd_broadcast(&request_cond_);
         request_lock_.Release();
     };
 
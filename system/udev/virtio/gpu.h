@@ -30,6 +30,7 @@ public:
     const virtio_gpu_resp_display_info::virtio_gpu_display_one* pmode() const { return &pmode_; }
 
     void Flush();
+    void FlushRegion(uint32_t x, uint32_t y, uint32_t width, uint32_t height);
 
 private:
     // DDK driver hooks
@@ -37,15 +38,19 @@ private:
     static mx_status_t virtio_gpu_get_mode(mx_device_t* dev, mx_display_info_t* info);
     static mx_status_t virtio_gpu_get_framebuffer(mx_device_t* dev, void** framebuffer);
     static void virtio_gpu_flush(mx_device_t* dev);
+    static void virtio_gpu_flush_region(mx_device_t* dev, uint32_t x, uint32_t y,
+                                        uint32_t width, uint32_t height);
 
-    // internal routines
+    // internal routines, called with request_lock_ held
+    void queue_command(const void* cmd, size_t cmd_len, void** _res, size_t res_len, size_t* slot);
+    void wait_command(size_t slot);
+    void release_command(size_t slot);
     mx_status_t send_command_response(const void* cmd, size_t cmd_len, void** _res, size_t res_len);
     mx_status_t get_display_info();
     mx_status_t allocate_2d_resource(uint32_t* resource_id, uint32_t width, uint32_t height);
     mx_status_t attach_backing(uint32_t resource_id, mx_paddr_t ptr, size_t buf_len);
     mx_status_t set_scanout(uint32_t scanout_id, uint32_t resource_id, uint32_t width, uint32_t height);
-    mx_status_t flush_resource(uint32_t resource_id, uint32_t width, uint32_t height);
-    mx_status_t transfer_to_host_2d(uint32_t resource_id, uint32_t width, uint32_t height);
+    mx_status_t update_region(uint32_t resource_id, const virtio_gpu_rect& r);
 
     mx_status_t virtio_gpu_start();
     static int virtio_gpu_start_entry(void* arg);
@@ -57,9 +62,14 @@ private:
     // display protocol ops
     mx_display_protocol_t display_proto_ops_ = {};
 
-    // gpu op
+    // gpu ops: the request page is split into slots so that several commands
+    // can be outstanding on the control queue at once
+    static constexpr size_t kMaxCommands = 4;
+    static constexpr size_t kCommandSlotSize = PAGE_SIZE / kMaxCommands;
     void* gpu_req_ = nullptr;
     mx_paddr_t gpu_req_pa_ = 0;
+    bool slot_busy_[kMaxCommands] = {};
+    bool slot_done_[kMaxCommands] = {};
 
     // a saved copy of the display
     virtio_gpu_resp_display_info::virtio_gpu_display_one pmode_ = {};
@@ -86,6 +96,8 @@ private:
     mxtl::Mutex flush_lock_;
     cnd_t flush_cond_ = {};
     bool flush_pending_ = false;
+    // union of the regions flushed since the flusher last ran
+    virtio_gpu_rect damage_ = {};
 };
 
 } // namespace virtio
@@ -0,0 +1,630 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "net.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <magenta/compiler.h>
+#include <magenta/new.h>
+#include <magenta/syscalls.h>
+#include <mx/vmar.h>
+#include <mxtl/auto_lock.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "trace.h"
+#include "utils.h"
+
+#define LOCAL_TRACE 0
+
+// clang-format off
+#define VIRTIO_NET_F_CSUM       (1<<0)
+#define VIRTIO_NET_F_GUEST_CSUM (1<<1)
+#define VIRTIO_NET_F_MAC        (1<<5)
+#define VIRTIO_NET_F_GUEST_TSO4 (1<<7)
+#define VIRTIO_NET_F_HOST_TSO4  (1<<11)
+#define VIRTIO_NET_F_MRG_RXBUF  (1<<15)
+#define VIRTIO_NET_F_STATUS     (1<<16)
+#define VIRTIO_NET_F_CTRL_VQ    (1<<17)
+#define VIRTIO_NET_F_MQ         (1<<22)
+#define VIRTIO_F_ANY_LAYOUT     (1<<27)
+
+#define VIRTIO_NET_S_LINK_UP    1
+
+#define VIRTIO_NET_HDR_F_NEEDS_CSUM 1
+#define VIRTIO_NET_HDR_F_DATA_VALID 2
+#define VIRTIO_NET_HDR_GSO_NONE     0
+
+#define VIRTIO_NET_CTRL_MQ              4
+#define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET 0
+#define VIRTIO_NET_OK                   0
+
+// how long Init() waits for the control queue to answer
+#define VIRTIO_NET_CTRL_TIMEOUT_MS 100
+
+#define ETH_HDR_SIZE   14
+#define ETH_MTU        1500
+#define ETHERTYPE_IPV4 0x0800
+#define ETHERTYPE_IPV6 0x86dd
+#define IPPROTO_TCP    6
+#define IPPROTO_UDP    17
+// clang-format on
+
+namespace virtio {
+
+// DDK level ops
+
+mx_status_t NetDevice::virtio_net_query(mx_device_t* dev, uint32_t options, ethmac_info_t* info) {
+    NetDevice* nd = static_cast<NetDevice*>(dev->ctx);
+
+    if (options) {
+        return ERR_INVALID_ARGS;
+    }
+
+    memset(info, 0, sizeof(*info));
+    if (nd->features_ & VIRTIO_NET_F_CSUM)
+        info->features |= ETHMAC_FEATURE_TX_CSUM;
+    if (nd->features_ & VIRTIO_NET_F_GUEST_CSUM)
+        info->features |= ETHMAC_FEATURE_RX_CSUM;
+    info->mtu = ETH_MTU;
+    memcpy(info->mac, nd->config_.mac, sizeof(info->mac));
+
+    return NO_ERROR;
+}
+
+void NetDevice::virtio_net_stop(mx_device_t* dev) {
+    NetDevice* nd = static_cast<NetDevice*>(dev->ctx);
+
+    mxtl::AutoLock lock(&nd->lock_);
+    nd->ifc_ = nullptr;
+}
+
+mx_status_t NetDevice::virtio_net_start(mx_device_t* dev, ethmac_ifc_t* ifc, void* cookie) {
+    NetDevice* nd = static_cast<NetDevice*>(dev->ctx);
+
+    mxtl::AutoLock lock(&nd->lock_);
+    if (nd->ifc_) {
+        return ERR_BAD_STATE;
+    }
+    nd->ifc_ = ifc;
+    nd->cookie_ = cookie;
+    nd->ifc_->status(nd->cookie_, nd->link_up_ ? ETHMAC_STATUS_ONLINE : 0);
+
+    return NO_ERROR;
+}
+
+void NetDevice::virtio_net_send(mx_device_t* dev, uint32_t options, void* data, size_t length) {
+    NetDevice* nd = static_cast<NetDevice*>(dev->ctx);
+
+    ethmac_frame_t frame = {};
+    frame.data = data;
+    frame.length = length;
+    nd->Send(&frame, 1);
+}
+
+void NetDevice::virtio_net_send_batch(mx_device_t* dev, uint32_t options,
+                                      ethmac_frame_t* frames, size_t count) {
+    NetDevice* nd = static_cast<NetDevice*>(dev->ctx);
+
+    nd->Send(frames, count);
+}
+
+NetDevice::NetDevice(mx_driver_t* driver, mx_device_t* bus_device)
+    : Device(driver, bus_device) {
+    // so that Bind() knows how much io space to allocate
+    bar0_size_ = 0x20;
+}
+
+NetDevice::~NetDevice() {
+    // stop the device before the buffers and rings it uses are freed; the
+    // queues only exist once Init() has reset it, so the registers are there
+    if (rx_[0])
+        Reset();
+    if (ctrl_va_)
+        mx::vmar::root_self().unmap(ctrl_va_, PAGE_SIZE);
+}
+
+NetDevice::Queue::~Queue() {
+    if (buf_va)
+        mx::vmar::root_self().unmap(buf_va, buf_count * buf_size);
+    delete[] merge;
+}
+
+mx_status_t NetDevice::Init() {
+    LTRACE_ENTRY;
+
+    // reset the device
+    Reset();
+
+    // ack and set the driver status bit
+    StatusAcknowledgeDriver();
+
+    // No segmentation offload: the ethermac interface has no way to hand
+    // down or up a frame larger than the mtu. Mergeable rx buffers still
+    // spare a descriptor per buffer, and let the device split a frame over
+    // several should one outgrow a buffer.
+    uint32_t features = ReadFeatures();
+    features_ = features & (VIRTIO_NET_F_CSUM | VIRTIO_NET_F_GUEST_CSUM | VIRTIO_NET_F_MAC |
+                            VIRTIO_NET_F_MRG_RXBUF | VIRTIO_NET_F_STATUS | VIRTIO_NET_F_CTRL_VQ |
+                            VIRTIO_F_ANY_LAYOUT | (1u << VIRTIO_RING_F_EVENT_IDX));
+    // the queue pairs are turned on through the control queue
+    if ((features & VIRTIO_NET_F_MQ) && (features & VIRTIO_NET_F_CTRL_VQ))
+        features_ |= VIRTIO_NET_F_MQ;
+    WriteFeatures(features_);
+    LTRACEF("device features %#x, accepted %#x\n", features, features_);
+
+    // read our configuration
+    CopyDeviceConfig(&config_, sizeof(config_));
+
+    if (!(features_ & VIRTIO_NET_F_MAC)) {
+        // make up a locally administered unicast address
+        size_t actual;
+        mx_cprng_draw(config_.mac, sizeof(config_.mac), &actual);
+        config_.mac[0] = (uint8_t)((config_.mac[0] & ~0x01) | 0x02);
+    }
+    if (features_ & VIRTIO_NET_F_STATUS)
+        link_up_ = config_.status & VIRTIO_NET_S_LINK_UP;
+
+    LTRACEF("mac %02x:%02x:%02x:%02x:%02x:%02x\n", config_.mac[0], config_.mac[1],
+            config_.mac[2], config_.mac[3], config_.mac[4], config_.mac[5]);
+    LTRACEF("status %#x, max_virtqueue_pairs %u\n", config_.status, config_.max_virtqueue_pairs);
+
+    bool mrg = features_ & VIRTIO_NET_F_MRG_RXBUF;
+    bool any_layout = features_ & VIRTIO_F_ANY_LAYOUT;
+    hdr_len_ = mrg ? sizeof(virtio_net_hdr) : offsetof(virtio_net_hdr, num_buffers);
+    // without either, the header has to have a descriptor to itself
+    rx_descs_ = (mrg || any_layout) ? 1 : 2;
+    tx_descs_ = any_layout ? 1 : 2;
+
+    // one queue pair per cpu, as far as the device goes
+    uint16_t device_pairs = 1;
+    if (features_ & VIRTIO_NET_F_MQ)
+        device_pairs = MAX(config_.max_virtqueue_pairs, (uint16_t)1);
+    uint32_t cpus = mx_system_get_num_cpus();
+    queue_pairs_ = (uint16_t)MIN(MIN((uint32_t)device_pairs, cpus), (uint32_t)max_queue_pairs);
+
+    // rx queue i is virtqueue 2i and tx queue i 2i + 1
+    AllocChecker ac;
+    for (uint16_t i = 0; i < queue_pairs_; i++) {
+        rx_[i].reset(new (&ac) Queue(this));
+        if (!ac.check())
+            return ERR_NO_MEMORY;
+        tx_[i].reset(new (&ac) Queue(this));
+        if (!ac.check())
+            return ERR_NO_MEMORY;
+
+        mx_status_t r = InitQueue(rx_[i].get(), (uint16_t)(2 * i), true);
+        if (r < 0)
+            return r;
+        r = InitQueue(tx_[i].get(), (uint16_t)(2 * i + 1), false);
+        if (r < 0)
+            return r;
+        // senders collect tx completions, nothing waits on them
+        tx_[i]->ring.SetNoInterrupt();
+    }
+
+    // the control queue follows every queue pair the device has
+    if (features_ & VIRTIO_NET_F_CTRL_VQ) {
+        uint16_t index = (uint16_t)(2 * device_pairs);
+        ctrl_.reset(new (&ac) Ring(this));
+        if (!ac.check())
+            return ERR_NO_MEMORY;
+        mx_status_t r = ctrl_->Init(index, GetRingSize(index));
+        if (r < 0) {
+            VIRTIO_ERROR("failed to allocate control vring\n");
+            return r;
+        }
+        ctrl_->SetEventIdx(features_ & (1u << VIRTIO_RING_F_EVENT_IDX));
+        r = map_contiguous_memory(PAGE_SIZE, &ctrl_va_, &ctrl_pa_);
+        if (r < 0) {
+            VIRTIO_ERROR("cannot alloc control buffer %d\n", r);
+            return r;
+        }
+    }
+
+    // fill the rx queues
+    for (uint16_t i = 0; i < queue_pairs_; i++) {
+        Queue* q = rx_[i].get();
+        while (q->free_count > 0)
+            PostBufferLocked(q, q->free_slot[--q->free_count], buf_size, true);
+    }
+
+    // set DRIVER_OK
+    StatusDriverOK();
+
+    // the device may not be notified before DRIVER_OK
+    for (uint16_t i = 0; i < queue_pairs_; i++)
+        rx_[i]->ring.Kick();
+
+    if (queue_pairs_ > 1 && SetQueuePairs(queue_pairs_) != NO_ERROR) {
+        // the device still runs the first pair
+        VIRTIO_ERROR("cannot turn on %u queue pairs, using one\n", queue_pairs_);
+        queue_pairs_ = 1;
+    }
+
+    // start the interrupt thread
+    StartIrqThread();
+
+    // initialize the mx_device and publish us
+    // point the ctx of our DDK device at ourself
+    ethmac_ops_.query = &virtio_net_query;
+    ethmac_ops_.stop = &virtio_net_stop;
+    ethmac_ops_.start = &virtio_net_start;
+    ethmac_ops_.send = &virtio_net_send;
+    ethmac_ops_.send_batch = &virtio_net_send_batch;
+
+    device_add_args_t args = {};
+    args.version = DEVICE_ADD_ARGS_VERSION;
+    args.name = "virtio-net";
+    args.ctx = this;
+    args.driver = driver_;
+    args.ops = &device_ops_;
+    args.proto_id = MX_PROTOCOL_ETHERMAC;
+    args.proto_ops = &ethmac_ops_;
+
+    auto status = device_add(bus_device_, &args, &device_);
+    if (status < 0) {
+        device_ = nullptr;
+        return status;
+    }
+
+    return NO_ERROR;
+}
+
+mx_status_t NetDevice::InitQueue(Queue* q, uint16_t index, bool rx) {
+    uint16_t size = GetRingSize(index);
+    LTRACEF("queue %u, ring size %u\n", index, size);
+    if (size == 0 || size > max_ring_size) {
+        VIRTIO_ERROR("queue %u has an unusable ring size %u\n", index, size);
+        return ERR_NOT_SUPPORTED;
+    }
+
+    q->index = index;
+    auto err = q->ring.Init(index, size);
+    if (err < 0) {
+        VIRTIO_ERROR("failed to allocate vring\n");
+        return err;
+    }
+    q->ring.SetEventIdx(features_ & (1u << VIRTIO_RING_F_EVENT_IDX));
+
+    mx_status_t r = map_contiguous_memory(buf_count * buf_size, &q->buf_va, &q->buf_pa);
+    if (r < 0) {
+        VIRTIO_ERROR("cannot alloc buffers %d\n", r);
+        return r;
+    }
+
+    // no more buffers than the ring has chains for
+    q->slots = (uint16_t)MIN((uint32_t)buf_count, (uint32_t)(size / (rx ? rx_descs_ : tx_descs_)));
+    for (uint16_t i = 0; i < q->slots; i++)
+        q->free_slot[q->free_count++] = i;
+
+    if (rx && (features_ & VIRTIO_NET_F_MRG_RXBUF)) {
+        AllocChecker ac;
+        q->merge = new (&ac) uint8_t[max_merged_frame];
+        if (!ac.check())
+            return ERR_NO_MEMORY;
+    }
+
+    return NO_ERROR;
+}
+
+// Posts a buffer of |len| bytes, header included, for the device to fill
+// for rx or send for tx.
+void NetDevice::PostBufferLocked(Queue* q, uint16_t slot, size_t len, bool rx) {
+    uint16_t descs = rx ? rx_descs_ : tx_descs_;
+    uint16_t head;
+    auto desc = q->ring.AllocDescChain(descs, &head);
+    // there are never more buffers posted than chains
+    assert(desc);
+
+    mx_paddr_t pa = q->buf_pa + slot * buf_size;
+    uint16_t flags = rx ? VRING_DESC_F_WRITE : 0;
+    if (descs == 2) {
+        desc->addr = pa;
+        desc->len = (uint32_t)hdr_len_;
+        desc->flags |= flags;
+        desc = q->ring.DescFromIndex(desc->next);
+        pa += hdr_len_;
+        len -= hdr_len_;
+    }
+    desc->addr = pa;
+    desc->len = (uint32_t)len;
+    desc->flags = flags;
+
+#if LOCAL_TRACE > 0
+    virtio_dump_desc(q->ring.DescFromIndex(head));
+#endif
+
+    q->head_slot[head] = slot;
+    q->ring.SubmitChain(head);
+}
+
+mx_status_t NetDevice::SetQueuePairs(uint16_t pairs) {
+    if (!ctrl_)
+        return ERR_NOT_SUPPORTED;
+
+    // class and command, the argument, then the ack the device writes
+    uint8_t* buf = reinterpret_cast<uint8_t*>(ctrl_va_);
+    buf[0] = VIRTIO_NET_CTRL_MQ;
+    buf[1] = VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET;
+    memcpy(&buf[2], &pairs, sizeof(pairs));
+    buf[4] = 0xff;
+
+    uint16_t head;
+    auto desc = ctrl_->AllocDescChain(3, &head);
+    if (!desc)
+        return ERR_NO_RESOURCES;
+    desc->addr = ctrl_pa_;
+    desc->len = 2;
+    desc = ctrl_->DescFromIndex(desc->next);
+    desc->addr = ctrl_pa_ + 2;
+    desc->len = 2;
+    desc = ctrl_->DescFromIndex(desc->next);
+    desc->addr = ctrl_pa_ + 4;
+    desc->len = 1;
+    desc->flags = VRING_DESC_F_WRITE;
+
+    ctrl_->SubmitChain(head);
+    ctrl_->Kick();
+
+    // the irq thread isn't running yet, poll for the answer
+    bool done = false;
+    auto free_chain = [this, &done](vring_used_elem* used_elem) {
+        ctrl_->FreeDescChain((uint16_t)used_elem->id);
+        done = true;
+    };
+    for (int i = 0; i < VIRTIO_NET_CTRL_TIMEOUT_MS && !done; i++) {
+        ctrl_->IrqRingUpdate(free_chain);
+        if (!done)
+            mx_nanosleep(mx_deadline_after(MX_MSEC(1)));
+    }
+    if (!done)
+        return ERR_TIMED_OUT;
+
+    return (buf[4] == VIRTIO_NET_OK) ? NO_ERROR : ERR_IO;
+}
+
+void NetDevice::IrqRingUpdate() {
+    LTRACE_ENTRY;
+
+    for (uint16_t i = 0; i < queue_pairs_; i++)
+        RxUpdateLocked(rx_[i].get());
+}
+
+void NetDevice::IrqConfigChange() {
+    LTRACE_ENTRY;
+
+    if (!(features_ & VIRTIO_NET_F_STATUS))
+        return;
+
+    CopyDeviceConfig(&config_, sizeof(config_));
+    bool link_up = config_.status & VIRTIO_NET_S_LINK_UP;
+    if (link_up == link_up_)
+        return;
+    link_up_ = link_up;
+    if (ifc_)
+        ifc_->status(cookie_, link_up_ ? ETHMAC_STATUS_ONLINE : 0);
+}
+
+// Hands up the batched frames and gives their buffers back to the device.
+void NetDevice::RxFlushLocked(Queue* q, ethmac_frame_t* frames, uint16_t* slots, size_t* count) {
+    if (*count && ifc_) {
+        if (ifc_->recv_batch) {
+            ifc_->recv_batch(cookie_, frames, *count, 0);
+        } else {
+            for (size_t n = 0; n < *count; n++)
+                ifc_->recv(cookie_, frames[n].data, frames[n].length, frames[n].flags);
+        }
+    }
+    for (size_t n = 0; n < *count; n++)
+        PostBufferLocked(q, slots[n], buf_size, true);
+    *count = 0;
+}
+
+void NetDevice::RxUpdateLocked(Queue* q) {
+    ethmac_frame_t frames[rx_batch];
+    uint16_t slots[rx_batch];
+    size_t count = 0;
+
+    auto free_chain = [this, q, &frames, &slots, &count](vring_used_elem* used_elem) {
+        uint16_t head = (uint16_t)used_elem->id;
+        uint16_t slot = q->head_slot[head];
+        q->ring.FreeDescChain(head);
+
+        uint8_t* buf = SlotVa(q, slot);
+        size_t len = used_elem->len;
+
+        if (q->merge_left > 0) {
+            // the rest of a frame spread over several buffers
+            if (q->merge_len + len <= max_merged_frame)
+                memcpy(q->merge + q->merge_len, buf, len);
+            q->merge_len += len;
+            PostBufferLocked(q, slot, buf_size, true);
+            if (--q->merge_left > 0)
+                return;
+
+            // in order, behind the frames already batched
+            RxFlushLocked(q, frames, slots, &count);
+            if (q->merge_len > max_merged_frame) {
+                LTRACEF("dropping %zu byte frame\n", q->merge_len);
+                return;
+            }
+            uint32_t flags = RxCsumFlags(&q->merge_hdr, q->merge, q->merge_len);
+            if (ifc_) {
+                ethmac_frame_t frame = {};
+                frame.data = q->merge;
+                frame.length = q->merge_len;
+                frame.flags = flags;
+                if (ifc_->recv_batch) {
+                    ifc_->recv_batch(cookie_, &frame, 1, 0);
+                } else {
+                    ifc_->recv(cookie_, frame.data, frame.length, frame.flags);
+                }
+            }
+            return;
+        }
+
+        if (len < hdr_len_) {
+            PostBufferLocked(q, slot, buf_size, true);
+            return;
+        }
+        auto hdr = reinterpret_cast<virtio_net_hdr*>(buf);
+        uint16_t buffers = (features_ & VIRTIO_NET_F_MRG_RXBUF) ? hdr->num_buffers : 1;
+
+        if (buffers > 1) {
+            // gather it in the merge buffer, reposting the pieces as we go
+            q->merge_hdr = *hdr;
+            q->merge_len = len - hdr_len_;
+            q->merge_left = (uint16_t)(buffers - 1);
+            memcpy(q->merge, buf + hdr_len_, q->merge_len);
+            PostBufferLocked(q, slot, buf_size, true);
+            return;
+        }
+
+        frames[count].data = buf + hdr_len_;
+        frames[count].length = len - hdr_len_;
+        frames[count].flags = RxCsumFlags(hdr, buf + hdr_len_, len - hdr_len_);
+        slots[count] = slot;
+        if (++count == rx_batch)
+            RxFlushLocked(q, frames, slots, &count);
+    };
+
+    // tell the ring to find used chains and hand them back to our lambda
+    q->ring.IrqRingUpdate(free_chain);
+
+    RxFlushLocked(q, frames, slots, &count);
+    q->ring.Kick();
+}
+
+// Checksum flags for a received frame. A frame from elsewhere on the host
+// may come with only the pseudo-header sum in its checksum field; that
+// checksum is finished here, as the device would have on the wire.
+uint32_t NetDevice::RxCsumFlags(const virtio_net_hdr* hdr, uint8_t* data, size_t len) {
+    if (hdr->flags & VIRTIO_NET_HDR_F_DATA_VALID)
+        return ETHMAC_RX_CSUM_OK;
+    if (!(hdr->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM))
+        return 0;
+
+    size_t start = hdr->csum_start;
+    size_t field = start + hdr->csum_offset;
+    if (start >= len || field + 2 > len)
+        return 0;
+
+    uint32_t sum = 0;
+    for (size_t i = start; i + 1 < len; i += 2)
+        sum += (uint32_t)((data[i] << 8) | data[i + 1]);
+    if ((len - start) & 1)
+        sum += (uint32_t)(data[len - 1] << 8);
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    uint16_t csum = (uint16_t)~sum;
+    data[field] = (uint8_t)(csum >> 8);
+    data[field + 1] = (uint8_t)csum;
+
+    return ETHMAC_RX_CSUM_OK;
+}
+
+void NetDevice::TxReclaimLocked(Queue* q) {
+    auto free_chain = [q](vring_used_elem* used_elem) {
+        uint16_t head = (uint16_t)used_elem->id;
+        q->free_slot[q->free_count++] = q->head_slot[head];
+        q->ring.FreeDescChain(head);
+    };
+    q->ring.IrqRingUpdate(free_chain);
+}
+
+// Picks the tx queue of a frame by its addresses and ports, so each flow
+// keeps to one queue pair. The device steers the frames it receives for a
+// flow to the pair that flow last sent on, so rx spreads out the same way.
+NetDevice::Queue* NetDevice::TxQueueFor(const uint8_t* data, size_t len) {
+    if (queue_pairs_ == 1 || len < ETH_HDR_SIZE)
+        return tx_[0].get();
+
+    uint16_t ethertype = (uint16_t)((data[12] << 8) | data[13]);
+    const uint8_t* ip = data + ETH_HDR_SIZE;
+    size_t ip_len = len - ETH_HDR_SIZE;
+    const uint8_t* addrs;
+    size_t addrs_len;
+    uint8_t proto;
+    size_t l4;
+    if (ethertype == ETHERTYPE_IPV4 && ip_len >= 20) {
+        addrs = ip + 12;
+        addrs_len = 8;
+        proto = ip[9];
+        // fragments after the first have no ports
+        bool fragment = ((ip[6] & 0x3f) | ip[7]) != 0;
+        l4 = fragment ? ip_len : (size_t)(ip[0] & 0xf) * 4;
+    } else if (ethertype == ETHERTYPE_IPV6 && ip_len >= 40) {
+        addrs = ip + 8;
+        addrs_len = 32;
+        proto = ip[6];
+        l4 = 40;
+    } else {
+        return tx_[0].get();
+    }
+
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < addrs_len; i++)
+        hash = (hash ^ addrs[i]) * 16777619u;
+    if ((proto == IPPROTO_TCP || proto == IPPROTO_UDP) && l4 + 4 <= ip_len) {
+        for (size_t i = 0; i < 4; i++)
+            hash = (hash ^ ip[l4 + i]) * 16777619u;
+    }
+
+    return tx_[hash % queue_pairs_].get();
+}
+
+// Copies a frame into a free tx buffer and posts it, returning false if it
+// has to be dropped.
+bool NetDevice::TxFrameLocked(Queue* q, const ethmac_frame_t* frame) {
+    if (frame->length > buf_size - hdr_len_) {
+        LTRACEF("dropping %zu byte frame\n", frame->length);
+        return false;
+    }
+    if (q->free_count == 0) {
+        TxReclaimLocked(q);
+        if (q->free_count == 0)
+            return false;
+    }
+    uint16_t slot = q->free_slot[--q->free_count];
+    uint8_t* buf = SlotVa(q, slot);
+
+    auto hdr = reinterpret_cast<virtio_net_hdr*>(buf);
+    memset(hdr, 0, hdr_len_);
+    hdr->gso_type = VIRTIO_NET_HDR_GSO_NONE;
+    if ((frame->flags & ETHMAC_FRAME_TX_CSUM) && (features_ & VIRTIO_NET_F_CSUM)) {
+        // same contract as ethmac: the field holds the pseudo-header sum
+        hdr->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+        hdr->csum_start = frame->csum_start;
+        hdr->csum_offset = frame->csum_offset;
+    }
+    memcpy(buf + hdr_len_, frame->data, frame->length);
+
+    PostBufferLocked(q, slot, hdr_len_ + frame->length, false);
+    return true;
+}
+
+void NetDevice::Send(ethmac_frame_t* frames, size_t count) {
+    // frames are sent in order, so a run for one queue is posted under one
+    // lock and kick
+    while (count > 0) {
+        Queue* q = TxQueueFor(static_cast<const uint8_t*>(frames[0].data), frames[0].length);
+        mxtl::AutoLock lock(&q->lock);
+        do {
+            // drop what doesn't fit, as a full ring on real hardware would
+            TxFrameLocked(q, frames);
+            frames++;
+            count--;
+        } while (count > 0 &&
+                 TxQueueFor(static_cast<const uint8_t*>(frames[0].data), frames[0].length) == q);
+        q->ring.Kick();
+    }
+}
+
+} // namespace virtio
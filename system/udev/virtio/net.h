@@ -0,0 +1,141 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#pragma once
+
+#include "device.h"
+#include "ring.h"
+
+#include <ddk/protocol/ethernet.h>
+#include <magenta/compiler.h>
+#include <mxtl/mutex.h>
+#include <mxtl/unique_ptr.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+namespace virtio {
+
+class Ring;
+
+class NetDevice : public Device {
+public:
+    NetDevice(mx_driver_t* driver, mx_device_t* device);
+    virtual ~NetDevice();
+
+    virtual mx_status_t Init();
+
+    virtual void IrqRingUpdate();
+    virtual void IrqConfigChange();
+
+private:
+    // DDK driver hooks
+    static mx_status_t virtio_net_query(mx_device_t* dev, uint32_t options, ethmac_info_t* info);
+    static void virtio_net_stop(mx_device_t* dev);
+    static mx_status_t virtio_net_start(mx_device_t* dev, ethmac_ifc_t* ifc, void* cookie);
+    static void virtio_net_send(mx_device_t* dev, uint32_t options, void* data, size_t length);
+    static void virtio_net_send_batch(mx_device_t* dev, uint32_t options,
+                                      ethmac_frame_t* frames, size_t count);
+
+    // the most queue pairs used, whatever the device and cpu count
+    static const uint16_t max_queue_pairs = 8;
+    // the largest ring a queue can be given
+    static const uint16_t max_ring_size = 1024;
+    // buffers per queue, each taking one descriptor chain
+    static const uint16_t buf_count = 128;
+    // room for a header and a full sized frame
+    static const size_t buf_size = 2048;
+    // the largest frame gathered from several mergeable rx buffers
+    static const size_t max_merged_frame = 9216;
+    // received frames handed up at once
+    static const size_t rx_batch = 16;
+
+    // every buffer is prefixed by one of these, 10 bytes long unless
+    // VIRTIO_NET_F_MRG_RXBUF adds num_buffers
+    struct virtio_net_hdr {
+        uint8_t flags;
+        uint8_t gso_type;
+        uint16_t hdr_len;
+        uint16_t gso_size;
+        uint16_t csum_start;
+        uint16_t csum_offset;
+        uint16_t num_buffers;
+    } __PACKED;
+
+    // a virtqueue with its own pool of buf_count buffers, each posted as
+    // one descriptor chain
+    struct Queue {
+        explicit Queue(Device* device)
+            : ring(device) {}
+        ~Queue();
+
+        Ring ring;
+        uint16_t index = 0;
+        uint16_t slots = 0; // as many buffers as the ring can hold at once
+
+        uintptr_t buf_va = 0;
+        mx_paddr_t buf_pa = 0;
+
+        // the buffer of each posted chain, by head descriptor
+        uint16_t head_slot[max_ring_size] = {};
+        uint16_t free_slot[buf_count] = {};
+        uint16_t free_count = 0;
+
+        // tx: serializes senders, who collect completions themselves
+        mxtl::Mutex lock;
+
+        // rx: the frame being gathered from several mergeable buffers
+        uint8_t* merge = nullptr;
+        size_t merge_len = 0;
+        uint16_t merge_left = 0;
+        virtio_net_hdr merge_hdr = {};
+    };
+
+    mx_status_t InitQueue(Queue* q, uint16_t index, bool rx);
+    void PostBufferLocked(Queue* q, uint16_t slot, size_t len, bool rx);
+    mx_status_t SetQueuePairs(uint16_t pairs);
+
+    void RxUpdateLocked(Queue* q);
+    void RxFlushLocked(Queue* q, ethmac_frame_t* frames, uint16_t* slots, size_t* count);
+    uint32_t RxCsumFlags(const virtio_net_hdr* hdr, uint8_t* data, size_t len);
+
+    void TxReclaimLocked(Queue* q);
+    Queue* TxQueueFor(const uint8_t* data, size_t len);
+    bool TxFrameLocked(Queue* q, const ethmac_frame_t* frame);
+    void Send(ethmac_frame_t* frames, size_t count);
+
+    uint8_t* SlotVa(Queue* q, uint16_t slot) {
+        return reinterpret_cast<uint8_t*>(q->buf_va + slot * buf_size);
+    }
+
+    // saved network device configuration out of the pci config BAR
+    struct virtio_net_config {
+        uint8_t mac[6];
+        uint16_t status;
+        uint16_t max_virtqueue_pairs;
+    } config_ __PACKED = {};
+
+    uint32_t features_ = 0;
+    size_t hdr_len_ = 0;
+    // descriptors a buffer takes, two where the header must be on its own
+    uint16_t rx_descs_ = 1;
+    uint16_t tx_descs_ = 1;
+
+    uint16_t queue_pairs_ = 1;
+    mxtl::unique_ptr<Queue> rx_[max_queue_pairs];
+    mxtl::unique_ptr<Queue> tx_[max_queue_pairs];
+
+    // the control queue, only used at Init() to turn on the queue pairs
+    mxtl::unique_ptr<Ring> ctrl_;
+    uintptr_t ctrl_va_ = 0;
+    mx_paddr_t ctrl_pa_ = 0;
+
+    bool link_up_ = true;
+
+    // callback interface to the attached ethernet layer, under lock_
+    ethmac_ifc_t* ifc_ = nullptr;
+    void* cookie_ = nullptr;
+
+    ethmac_protocol_t ethmac_ops_ = {};
+};
+
+} // namespace virtio
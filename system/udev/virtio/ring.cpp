@@ -149,14 +149,39 @@ void Ring::SubmitChain(uint16_t desc_index) {
     struct vring_avail* avail = ring_.avail;
 
     avail->ring[avail->idx & ring_.num_mask] = desc_index;
-    //mb();
+    // the device must see the ring entry before the index that covers it
+    __sync_synchronize();
     avail->idx++;
 }
 
+void Ring::SetNoInterrupt() {
+    no_interrupt_ = true;
+    ring_.avail->flags |= VRING_AVAIL_F_NO_INTERRUPT;
+}
+
 void Ring::Kick() {
     LTRACE_ENTRY;
 
-    device_->RingKick(index_);
+    // make the new avail->idx visible before reading what the device wants
+    __sync_synchronize();
+
+    uint16_t new_idx = ring_.avail->idx;
+    uint16_t old_idx = kicked_idx_;
+    kicked_idx_ = new_idx;
+    if (new_idx == old_idx) {
+        return;
+    }
+
+    bool notify;
+    if (event_idx_) {
+        uint16_t event = *(volatile uint16_t*)&vring_avail_event(&ring_);
+        notify = vring_need_event(event, new_idx, old_idx);
+    } else {
+        notify = !(*(volatile uint16_t*)&ring_.used->flags & VRING_USED_F_NO_NOTIFY);
+    }
+    if (notify) {
+        device_->RingKick(index_);
+    }
 }
 
 } // namespace virtio
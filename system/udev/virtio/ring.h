@@ -25,8 +25,20 @@ public:
     uint16_t AllocDesc();
     struct vring_desc* AllocDescChain(uint16_t count, uint16_t* start_index);
     void SubmitChain(uint16_t desc_index);
+
+    // Notify the device of newly submitted chains, unless it has said it
+    // doesn't need to hear about them (VRING_USED_F_NO_NOTIFY, or with
+    // VIRTIO_RING_F_EVENT_IDX the avail event index it publishes).
     void Kick();
 
+    // Call once VIRTIO_RING_F_EVENT_IDX has been negotiated with the device.
+    void SetEventIdx(bool enable) { event_idx_ = enable; }
+
+    // Ask the device not to interrupt as it uses chains, for rings whose
+    // completions are collected some other way. With event indices it may
+    // still do so once each time its used index wraps.
+    void SetNoInterrupt();
+
     struct vring_desc* DescFromIndex(uint16_t index) {
         return &ring_.desc[index];
     }
@@ -43,6 +55,10 @@ private:
 
     uint16_t index_ = 0;
 
+    bool event_idx_ = false;
+    bool no_interrupt_ = false;
+    uint16_t kicked_idx_ = 0; // avail->idx as of the last Kick()
+
     vring ring_ = {};
 };
 
@@ -52,18 +68,31 @@ inline void Ring::IrqRingUpdate(T free_chain) {
     //TRACEF("used flags 0x%hhx idx 0x%hhx last_used %u\n",
     //        ring_.used->flags, ring_.used->idx, ring_.last_used);
 
-    // find a new free chain of descriptors
-    unsigned int cur_idx = ring_.used->idx;
-    for (unsigned int i = ring_.last_used; i != (cur_idx & ring_.num_mask); i = (i + 1) & ring_.num_mask) {
-        //TRACEF("looking at idx %u\n", i);
-
-        struct vring_used_elem* used_elem = &ring_.used->ring[i];
-        //TRACEF("used chain id %u, len %u\n", used_elem->id, used_elem->len);
-
-        // free the chain
-        free_chain(used_elem);
-
-        ring_.last_used = ((ring_.last_used + 1) & ring_.num_mask) & 0xffff;
+    volatile uint16_t* used_idx = &ring_.used->idx;
+    for (;;) {
+        // find a new free chain of descriptors
+        uint16_t cur_idx = *used_idx;
+        __sync_synchronize();
+        for (; ring_.last_used != cur_idx; ring_.last_used++) {
+            //TRACEF("looking at idx %u\n", ring_.last_used);
+
+            struct vring_used_elem* used_elem = &ring_.used->ring[ring_.last_used & ring_.num_mask];
+            //TRACEF("used chain id %u, len %u\n", used_elem->id, used_elem->len);
+
+            // free the chain
+            free_chain(used_elem);
+        }
+
+        if (!event_idx_ || no_interrupt_) {
+            break;
+        }
+        // ask for an interrupt on the next completion only, then look
+        // again in case one slipped in before the device saw the update
+        *(volatile uint16_t*)&vring_used_event(&ring_) = ring_.last_used;
+        __sync_synchronize();
+        if (*used_idx == ring_.last_used) {
+            break;
+        }
     }
 }
 
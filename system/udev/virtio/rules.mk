@@ -12,6 +12,7 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/block.cpp \
     $(LOCAL_DIR)/device.cpp \
     $(LOCAL_DIR)/gpu.cpp \
+    $(LOCAL_DIR)/net.cpp \
     $(LOCAL_DIR)/ring.cpp \
     $(LOCAL_DIR)/utils.cpp \
     $(LOCAL_DIR)/virtio_c.c \
@@ -20,6 +20,7 @@
 #include "block.h"
 #include "device.h"
 #include "gpu.h"
+#include "net.h"
 #include "trace.h"
 
 #define LOCAL_TRACE 0
@@ -51,6 +52,10 @@ extern "C" mx_status_t virtio_bind(mx_driver_t* driver, mx_device_t* device, voi
     mxtl::unique_ptr<virtio::Device> vd = nullptr;
     AllocChecker ac;
     switch (config->device_id) {
+    case 0x1000:
+        LTRACEF("found net device\n");
+        vd.reset(new virtio::NetDevice(driver, device));
+        break;
     case 0x1001:
         LTRACEF("found block device\n");
         vd.reset(new virtio::BlockDevice(driver, device));
@@ -98,7 +98,7 @@ struct vring {
     uint16_t free_list; /* head of a free list of descriptors per ring. 0xffff is NULL */
     uint16_t free_count;
 
-    uint16_t last_used;
+    uint16_t last_used; /* free-running, like used->idx */
 
     struct vring_desc* desc;
 
@@ -0,0 +1,126 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <bitmap/bitmap.h>
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <magenta/types.h>
+#include <mxtl/array.h>
+#include <mxtl/macros.h>
+
+namespace bitmap {
+
+// A bitmap with the same interface and storage layout as RawBitmapGeneric,
+// which also keeps two summary hierarchies in memory: one with a bit per word
+// which has any bit set, and one with a bit per word which has any bit clear.
+// Each summary level has a bit per word of the level below, up to a single
+// word, so Scan and Find skip over runs of full (or empty) words in
+// O(log n) instead of walking them one at a time.
+//
+// Storage is used for the bits themselves, exactly as with RawBitmapGeneric,
+// so the data can still be read or written in place through StorageUnsafe().
+// After modifying the data that way, call RebuildSummary().
+template <typename Storage>
+class SummaryBitmapGeneric final : public Bitmap {
+public:
+    SummaryBitmapGeneric();
+    virtual ~SummaryBitmapGeneric() = default;
+    SummaryBitmapGeneric(SummaryBitmapGeneric&& rhs) = default;
+    SummaryBitmapGeneric& operator=(SummaryBitmapGeneric&& rhs) = default;
+    DISALLOW_COPY_AND_ASSIGN_ALLOW_MOVE(SummaryBitmapGeneric);
+
+    // Returns the size of this bitmap.
+    size_t size(void) const { return size_; }
+
+    // Resets the bitmap; clearing and resizing it.
+    // Allocates memory, and can fail.
+    mx_status_t Reset(size_t size);
+
+    // Shrinks the accessible portion of the bitmap, without re-allocating
+    // the underlying storage.
+    mx_status_t Shrink(size_t size);
+
+    // Returns the lesser of bitmax and the index of the first bit that doesn't
+    // match *is_set* starting from *bitoff*.
+    size_t Scan(size_t bitoff, size_t bitmax, bool is_set) const;
+
+    // Find a run of *run_len* *is_set* bits, between bitoff and bitmax.
+    // Returns the start of the run in *out*, or bitmax if it is
+    // not found in the provided range.
+    // If the run is not found, "ERR_NO_RESOURCES" is returned.
+    mx_status_t Find(bool is_set, size_t bitoff, size_t bitmax, size_t run_len, size_t* out) const;
+
+    // Returns true if all the bits in [*bitoff*, *bitmax*) are set. Afterwards,
+    // *first_unset* will be set to the lesser of bitmax and the index of the
+    // first unset bit after *bitoff*.
+    bool Get(size_t bitoff, size_t bitmax,
+             size_t* first_unset = nullptr) const override;
+
+    // Sets all bits in the range [*bitoff*, *bitmax*).  Returns an error if
+    // bitmax < bitoff or size_ < bitmax, and NO_ERROR otherwise.
+    mx_status_t Set(size_t bitoff, size_t bitmax) override;
+
+    // Clears all bits in the range [*bitoff*, *bitmax*).  Returns an error if
+    // bitmax < bitoff or size_ < bitmax, and NO_ERROR otherwise.
+    mx_status_t Clear(size_t bitoff, size_t bitmax) override;
+
+    // Clear all bits in the bitmap.
+    void ClearAll() override;
+
+    // Recomputes the summaries from the bits in storage.  Must be called
+    // after the storage is written directly, e.g. when loading it from disk.
+    void RebuildSummary();
+
+    // This function allows access to underlying data, but is dangerous: It
+    // leaks the pointer to bits_. Reset and the bitmap destructor should not
+    // be called on the bitmap while the pointer returned from data() is alive.
+    const Storage* StorageUnsafe() const { return &bits_; }
+
+private:
+    // Enough levels to summarize any number of words down to a single one.
+    static constexpr size_t kMaxLevels = sizeof(size_t) * CHAR_BIT;
+
+    // The two summaries, laid out identically in sum_.
+    enum Summary {
+        kAnySet = 0,
+        kAnyClear = 1,
+    };
+
+    size_t* Level(Summary s, size_t level) const {
+        return sum_.get() + s * sum_words_ + level_off_[level];
+    }
+
+    // Updates the summaries after data_[idx] changed.
+    void UpdateWord(size_t idx);
+    void SetSummaryBit(Summary s, size_t idx, bool value);
+
+    // Returns the index of the first word at or after idx which has a bit
+    // in summary s, or SIZE_MAX if there is none.
+    size_t NextWord(Summary s, size_t idx) const;
+    size_t NextIndex(Summary s, size_t level, size_t idx) const;
+
+    // The size of this bitmap, in bits.
+    size_t size_;
+    // The number of words in storage.
+    size_t words_;
+
+    // The storage backing this bitmap.
+    Storage bits_;
+    // Owned by bits_, cached
+    size_t* data_;
+
+    // Both summaries, each sum_words_ long, with level i of each starting
+    // level_off_[i] words in.  Level 0 has a bit per word of data_.
+    mxtl::Array<size_t> sum_;
+    size_t sum_words_;
+    size_t levels_;
+    size_t level_off_[kMaxLevels + 1];
+};
+
+} // namespace bitmap
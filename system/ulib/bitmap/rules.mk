@@ -11,6 +11,7 @@ MODULE_TYPE := userlib
 MODULE_SRCS += \
     $(LOCAL_DIR)/raw-bitmap.cpp \
     $(LOCAL_DIR)/rle-bitmap.cpp \
+    $(LOCAL_DIR)/summary-bitmap.cpp \
 
 MODULE_SO_NAME := bitmap
 
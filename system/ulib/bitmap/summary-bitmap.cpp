@@ -0,0 +1,327 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <bitmap/summary-bitmap.h>
+#include <bitmap/storage.h>
+
+#include <limits.h>
+#include <stddef.h>
+
+#include <magenta/new.h>
+#include <magenta/types.h>
+#include <mxtl/algorithm.h>
+#include <mxtl/macros.h>
+
+namespace {
+
+const size_t kBits = sizeof(size_t) * 8;
+const size_t kNone = SIZE_MAX;
+
+// Same as in raw-bitmap.cpp: all bits set, except those outside of [off,max)
+// in the first and last words.
+size_t GetMask(bool first, bool last, size_t off, size_t max) {
+    size_t ones = 0;
+    ones = ~ones;
+    size_t mask = ones;
+    if (first) {
+        mask &= ones << (off % kBits);
+    }
+    if (last) {
+        mask &= ones >> ((kBits - (max % kBits)) % kBits);
+    }
+    return mask;
+}
+
+constexpr size_t FirstIdx(size_t bitoff) {
+    return bitoff / kBits;
+}
+
+constexpr size_t LastIdx(size_t bitmax) {
+    return (bitmax - 1) / kBits;
+}
+
+constexpr size_t Words(size_t bits) {
+    return (bits + kBits - 1) / kBits;
+}
+
+#if (SIZE_MAX == UINT_MAX)
+#define CTZ(x) __builtin_ctz(x)
+#elif (SIZE_MAX == ULONG_MAX)
+#define CTZ(x) __builtin_ctzl(x)
+#elif (SIZE_MAX == ULLONG_MAX)
+#define CTZ(x) __builtin_ctzll(x)
+#else
+#error "Unsupported size_t length"
+#endif
+// |value| must not be zero.
+size_t FirstSet(size_t idx, size_t value) {
+    return idx * kBits + CTZ(value);
+}
+#undef CTZ
+
+} // namespace
+
+namespace bitmap {
+
+template <typename Storage>
+SummaryBitmapGeneric<Storage>::SummaryBitmapGeneric()
+    : size_(0), words_(0), data_(nullptr), sum_words_(0), levels_(0) {}
+
+template <typename Storage>
+mx_status_t SummaryBitmapGeneric<Storage>::Reset(size_t size) {
+    size_ = size;
+    words_ = 0;
+    levels_ = 0;
+    sum_words_ = 0;
+    if (size_ == 0) {
+        data_ = nullptr;
+        sum_.reset();
+        return NO_ERROR;
+    }
+    size_t words = LastIdx(size) + 1;
+    mx_status_t status = bits_.Allocate(sizeof(size_t) * words);
+    if (status != NO_ERROR) {
+        return status;
+    }
+    data_ = static_cast<size_t*>(bits_.GetData());
+
+    // Each level has a bit per word of the one below, until one word is left.
+    size_t off = 0;
+    size_t n = words;
+    size_t levels = 0;
+    do {
+        level_off_[levels++] = off;
+        n = Words(n);
+        off += n;
+    } while (n > 1);
+    level_off_[levels] = off;
+
+    AllocChecker ac;
+    size_t* sum = new (&ac) size_t[2 * off];
+    if (!ac.check()) {
+        return ERR_NO_MEMORY;
+    }
+    sum_.reset(sum, 2 * off);
+    words_ = words;
+    levels_ = levels;
+    sum_words_ = off;
+    ClearAll();
+    return NO_ERROR;
+}
+
+template <typename Storage>
+mx_status_t SummaryBitmapGeneric<Storage>::Shrink(size_t size) {
+    if (size > size_) {
+        return ERR_NO_MEMORY;
+    }
+    // The summaries still cover the whole storage; bits past size_ are
+    // never reported as they are masked off by Scan.
+    size_ = size;
+    return NO_ERROR;
+}
+
+template <typename Storage>
+void SummaryBitmapGeneric<Storage>::SetSummaryBit(Summary s, size_t idx, bool value) {
+    for (size_t level = 0; level < levels_; level++) {
+        size_t* word = &Level(s, level)[idx / kBits];
+        size_t bit = static_cast<size_t>(1) << (idx % kBits);
+        bool was_empty = (*word == 0);
+        if (value) {
+            *word |= bit;
+        } else {
+            *word &= ~bit;
+        }
+        // The level above only records whether this word is empty.
+        if (was_empty == (*word == 0)) {
+            return;
+        }
+        idx /= kBits;
+    }
+}
+
+template <typename Storage>
+void SummaryBitmapGeneric<Storage>::UpdateWord(size_t idx) {
+    SetSummaryBit(kAnySet, idx, data_[idx] != 0);
+    SetSummaryBit(kAnyClear, idx, data_[idx] != ~static_cast<size_t>(0));
+}
+
+template <typename Storage>
+size_t SummaryBitmapGeneric<Storage>::NextIndex(Summary s, size_t level, size_t idx) const {
+    size_t word = idx / kBits;
+    if (word >= level_off_[level + 1] - level_off_[level]) {
+        return kNone;
+    }
+    const size_t* bits = Level(s, level);
+    size_t value = bits[word] & (~static_cast<size_t>(0) << (idx % kBits));
+    if (value != 0) {
+        return FirstSet(word, value);
+    }
+    if (level + 1 == levels_) {
+        return kNone;
+    }
+    // Find the next non-empty word of this level from the one above.
+    word = NextIndex(s, level + 1, word + 1);
+    if (word == kNone) {
+        return kNone;
+    }
+    return FirstSet(word, bits[word]);
+}
+
+template <typename Storage>
+size_t SummaryBitmapGeneric<Storage>::NextWord(Summary s, size_t idx) const {
+    if (idx >= words_) {
+        return kNone;
+    }
+    return NextIndex(s, 0, idx);
+}
+
+template <typename Storage>
+size_t SummaryBitmapGeneric<Storage>::Scan(size_t bitoff, size_t bitmax, bool is_set) const {
+    bitmax = mxtl::min(bitmax, size_);
+    if (bitoff >= bitmax) {
+        return bitmax;
+    }
+    // Looking for a clear bit if is_set, a set one otherwise.
+    Summary s = is_set ? kAnyClear : kAnySet;
+    size_t first_idx = FirstIdx(bitoff);
+    size_t last_idx = LastIdx(bitmax);
+    size_t i = first_idx;
+    while (i <= last_idx) {
+        size_t value = GetMask(i == first_idx, i == last_idx, bitoff, bitmax);
+        if (is_set) {
+            value &= ~data_[i];
+        } else {
+            value &= data_[i];
+        }
+        if (value != 0) {
+            return mxtl::min(bitmax, FirstSet(i, value));
+        }
+        i = NextWord(s, i + 1);
+        if (i == kNone) {
+            break;
+        }
+    }
+    return bitmax;
+}
+
+template <typename Storage>
+mx_status_t SummaryBitmapGeneric<Storage>::Find(bool is_set, size_t bitoff, size_t bitmax,
+                                                size_t run_len, size_t* out) const {
+    if (!out || bitmax <= bitoff) {
+        return ERR_INVALID_ARGS;
+    }
+    size_t start = bitoff;
+    while (bitoff - start < run_len && bitoff < bitmax) {
+        start = Scan(bitoff, bitmax, !is_set);
+        if (bitmax - start < run_len) {
+            *out = bitmax;
+            return ERR_NO_RESOURCES;
+        }
+        bitoff = Scan(start, start + run_len, is_set);
+    }
+    *out = start;
+    return NO_ERROR;
+}
+
+template <typename Storage>
+bool SummaryBitmapGeneric<Storage>::Get(size_t bitoff, size_t bitmax, size_t* first) const {
+    bitmax = mxtl::min(bitmax, size_);
+    size_t result = Scan(bitoff, bitmax, true);
+    if (first) {
+        *first = result;
+    }
+    return result == bitmax;
+}
+
+template <typename Storage>
+mx_status_t SummaryBitmapGeneric<Storage>::Set(size_t bitoff, size_t bitmax) {
+    if (bitoff > bitmax || bitmax > size_) {
+        return ERR_INVALID_ARGS;
+    }
+    if (bitoff == bitmax) {
+        return NO_ERROR;
+    }
+    size_t first_idx = FirstIdx(bitoff);
+    size_t last_idx = LastIdx(bitmax);
+    for (size_t i = first_idx; i <= last_idx; ++i) {
+        data_[i] |=
+                GetMask(i == first_idx, i == last_idx, bitoff, bitmax);
+        UpdateWord(i);
+    }
+    return NO_ERROR;
+}
+
+template <typename Storage>
+mx_status_t SummaryBitmapGeneric<Storage>::Clear(size_t bitoff, size_t bitmax) {
+    if (bitoff > bitmax || bitmax > size_) {
+        return ERR_INVALID_ARGS;
+    }
+    if (bitoff == bitmax) {
+        return NO_ERROR;
+    }
+    size_t first_idx = FirstIdx(bitoff);
+    size_t last_idx = LastIdx(bitmax);
+    for (size_t i = first_idx; i <= last_idx; ++i) {
+        data_[i] &=
+                ~(GetMask(i == first_idx, i == last_idx, bitoff, bitmax));
+        UpdateWord(i);
+    }
+    return NO_ERROR;
+}
+
+template <typename Storage>
+void SummaryBitmapGeneric<Storage>::ClearAll() {
+    if (size_ == 0) {
+        return;
+    }
+    for (size_t i = 0; i < words_; ++i) {
+        data_[i] = 0;
+    }
+    RebuildSummary();
+}
+
+template <typename Storage>
+void SummaryBitmapGeneric<Storage>::RebuildSummary() {
+    if (words_ == 0) {
+        return;
+    }
+    for (size_t i = 0; i < 2 * sum_words_; ++i) {
+        sum_[i] = 0;
+    }
+    const size_t ones = ~static_cast<size_t>(0);
+    size_t* any_set = Level(kAnySet, 0);
+    size_t* any_clear = Level(kAnyClear, 0);
+    for (size_t i = 0; i < words_; ++i) {
+        size_t bit = static_cast<size_t>(1) << (i % kBits);
+        if (data_[i] != 0) {
+            any_set[i / kBits] |= bit;
+        }
+        if (data_[i] != ones) {
+            any_clear[i / kBits] |= bit;
+        }
+    }
+    for (size_t level = 1; level < levels_; ++level) {
+        size_t n = level_off_[level] - level_off_[level - 1];
+        const size_t* set_below = Level(kAnySet, level - 1);
+        const size_t* clear_below = Level(kAnyClear, level - 1);
+        any_set = Level(kAnySet, level);
+        any_clear = Level(kAnyClear, level);
+        for (size_t i = 0; i < n; ++i) {
+            size_t bit = static_cast<size_t>(1) << (i % kBits);
+            if (set_below[i] != 0) {
+                any_set[i / kBits] |= bit;
+            }
+            if (clear_below[i] != 0) {
+                any_clear[i / kBits] |= bit;
+            }
+        }
+    }
+}
+
+#ifdef __Fuchsia__
+template class SummaryBitmapGeneric<VmoStorage>;
+#endif
+template class SummaryBitmapGeneric<DefaultStorage>;
+
+} // namespace bitmap
@@ -515,6 +515,45 @@ bool blkdev_test_fifo_multiple_vmo_multithreaded(void) {
     END_TEST;
 }
 
+bool blkdev_test_fifo_multiple_clients(void) {
+    BEGIN_TEST;
+    // Each open of the blkdev gets a FIFO connection of its own
+    uint64_t blk_size, blk_count;
+    int fds[2];
+    fifo_client_t* clients[2];
+    txnid_t txnids[2];
+    test_vmo_object_t objs[2];
+    for (size_t i = 0; i < countof(fds); i++) {
+        fds[i] = get_testdev(&blk_size, &blk_count);
+        mx_handle_t fifo;
+        ssize_t expected = sizeof(fifo);
+        ASSERT_EQ(ioctl_block_get_fifos(fds[i], &fifo), expected, "Failed to get FIFO");
+        expected = sizeof(txnid_t);
+        ASSERT_EQ(ioctl_block_alloc_txn(fds[i], &txnids[i]), expected, "Failed to allocate txn");
+        ASSERT_EQ(block_fifo_create_client(fifo, &clients[i]), NO_ERROR, "");
+        ASSERT_TRUE(create_vmo_helper(fds[i], &objs[i], blk_size), "");
+    }
+
+    // Interleave the clients' blocks on disk, then read them back
+    for (size_t i = 0; i < countof(fds); i++) {
+        ASSERT_TRUE(write_striped_vmo_helper(clients[i], &objs[i], i, countof(fds),
+                                             txnids[i], blk_size), "");
+    }
+    for (size_t i = 0; i < countof(fds); i++) {
+        ASSERT_TRUE(read_striped_vmo_helper(clients[i], &objs[i], i, countof(fds),
+                                            txnids[i], blk_size), "");
+    }
+
+    for (size_t i = 0; i < countof(fds); i++) {
+        ASSERT_TRUE(close_vmo_helper(clients[i], &objs[i], txnids[i]), "");
+        ASSERT_EQ(ioctl_block_free_txn(fds[i], &txnids[i]), NO_ERROR, "Failed to free txn");
+        block_fifo_release_client(clients[i]);
+        ASSERT_EQ(ioctl_block_fifo_close(fds[i]), NO_ERROR, "Failed to close fifo");
+        close(fds[i]);
+    }
+    END_TEST;
+}
+
 bool blkdev_test_fifo_unclean_shutdown(void) {
     BEGIN_TEST;
     // Set up the blkdev
@@ -902,6 +941,7 @@ RUN_TEST(blkdev_test_fifo_basic)
 //RUN_TEST(blkdev_test_fifo_whole_disk)
 RUN_TEST(blkdev_test_fifo_multiple_vmo)
 RUN_TEST(blkdev_test_fifo_multiple_vmo_multithreaded)
+RUN_TEST(blkdev_test_fifo_multiple_clients)
 // TODO(smklein): Test ops across different vmos
 RUN_TEST(blkdev_test_fifo_unclean_shutdown)
 RUN_TEST(blkdev_test_fifo_large_ops_count)
@@ -8,6 +8,7 @@
 #include <magenta/compiler.h>
 #include <magenta/device/block.h>
 #include <magenta/syscalls.h>
+#include <magenta/syscalls/port.h>
 #include <sync/completion.h>
 
 #include "block-client/client.h"
@@ -64,10 +65,15 @@ static mx_status_t do_read(mx_handle_t fifo, block_fifo_response_t* response) {
 typedef struct block_completion {
     completion_t completion;
     mx_status_t status;
+    // Set while an asynchronous group is outstanding on this txnid.
+    block_async_cb_t cb;
+    void* cookie;
 } block_completion_t;
 
 typedef struct fifo_client {
     mx_handle_t fifo;
+    // Port the async dispatcher waits on for the FIFO to become readable.
+    mx_handle_t port;
     block_completion_t txns[MAX_TXN_COUNT];
 } fifo_client_t;
 
@@ -76,6 +82,11 @@ mx_status_t block_fifo_create_client(mx_handle_t fifo, fifo_client_t** out) {
     if (client == NULL) {
         return ERR_NO_MEMORY;
     }
+    mx_status_t status;
+    if ((status = mx_port_create(MX_PORT_OPT_V2, &client->port)) != NO_ERROR) {
+        free(client);
+        return status;
+    }
     client->fifo = fifo;
     *out = client;
     return NO_ERROR;
@@ -86,10 +97,31 @@ void block_fifo_release_client(fifo_client_t* client) {
         return;
     }
 
+    mx_handle_close(client->port);
     mx_handle_close(client->fifo);
     free(client);
 }
 
+// Completes the transaction a response belongs to: runs its callback if it
+// was submitted asynchronously, otherwise wakes the synchronous waiter.
+static void complete_txn(fifo_client_t* client, const block_fifo_response_t* response) {
+    if (response->txnid >= MAX_TXN_COUNT) {
+        return;
+    }
+    block_completion_t* txn = &client->txns[response->txnid];
+    block_async_cb_t cb = txn->cb;
+    if (cb != NULL) {
+        // Clear the slot first so the callback may resubmit on this txnid.
+        void* cookie = txn->cookie;
+        txn->cb = NULL;
+        txn->cookie = NULL;
+        cb(cookie, response->status);
+    } else {
+        txn->status = response->status;
+        completion_signal(&txn->completion);
+    }
+}
+
 mx_status_t block_fifo_txn(fifo_client_t* client, block_fifo_request_t* requests, size_t count) {
     if (count == 0) {
         return NO_ERROR;
@@ -120,12 +152,89 @@ mx_status_t block_fifo_txn(fifo_client_t* client, block_fifo_request_t* requests
     }
 
     // Wake up someone who is waiting (it might be ourselves)
-    txnid_t response_txnid = response.txnid;
-    client->txns[response_txnid].status = response.status;
-    completion_signal(&client->txns[response_txnid].completion);
+    complete_txn(client, &response);
 
     // Wait for someone to signal us
     completion_wait(&client->txns[txnid].completion, MX_TIME_INFINITE);
 
     return client->txns[txnid].status;
 }
+
+mx_status_t block_fifo_async_submit(fifo_client_t* client, const block_async_txn_t* txns,
+                                    size_t count) {
+    block_fifo_request_t requests[BLOCK_FIFO_MAX_DEPTH];
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        const block_async_txn_t* txn = &txns[i];
+        if (txn->count == 0 || txn->count > MAX_TXN_MESSAGES ||
+            txn->count > BLOCK_FIFO_MAX_DEPTH - total || txn->cb == NULL) {
+            return ERR_INVALID_ARGS;
+        }
+        txnid_t txnid = txn->requests[0].txnid;
+        if (txnid >= MAX_TXN_COUNT || client->txns[txnid].cb != NULL) {
+            return ERR_INVALID_ARGS;
+        }
+        for (size_t j = 0; j < txn->count; j++) {
+            if (txn->requests[j].txnid != txnid) {
+                return ERR_INVALID_ARGS;
+            }
+            requests[total] = txn->requests[j];
+            requests[total].opcode = (requests[total].opcode & BLOCKIO_OP_MASK) |
+                                     (j == txn->count - 1 ? BLOCKIO_TXN_END : 0);
+            total++;
+        }
+    }
+    if (total == 0) {
+        return NO_ERROR;
+    }
+
+    // The callbacks must be in place before the server can possibly reply.
+    for (size_t i = 0; i < count; i++) {
+        block_completion_t* slot = &client->txns[txns[i].requests[0].txnid];
+        slot->cookie = txns[i].cookie;
+        slot->cb = txns[i].cb;
+    }
+
+    mx_status_t status;
+    if ((status = do_write(client->fifo, requests, total)) != NO_ERROR) {
+        for (size_t i = 0; i < count; i++) {
+            block_completion_t* slot = &client->txns[txns[i].requests[0].txnid];
+            slot->cb = NULL;
+            slot->cookie = NULL;
+        }
+    }
+    return status;
+}
+
+mx_status_t block_fifo_async_dispatch(fifo_client_t* client, mx_time_t deadline) {
+    while (true) {
+        block_fifo_response_t responses[BLOCK_FIFO_MAX_DEPTH];
+        uint32_t count;
+        mx_status_t status = mx_fifo_read(client->fifo, responses, sizeof(responses), &count);
+        if (status == NO_ERROR) {
+            for (uint32_t i = 0; i < count; i++) {
+                complete_txn(client, &responses[i]);
+            }
+            return NO_ERROR;
+        } else if (status != ERR_SHOULD_WAIT) {
+            return status;
+        }
+
+        status = mx_object_wait_async(client->fifo, client->port, 0,
+                                      MX_FIFO_READABLE | MX_FIFO_PEER_CLOSED,
+                                      MX_WAIT_ASYNC_ONCE);
+        if (status != NO_ERROR) {
+            return status;
+        }
+        mx_port_packet_t packet;
+        if ((status = mx_port_wait(client->port, deadline, &packet, 0)) != NO_ERROR) {
+            // Drop the armed wait so it doesn't pile up across timeouts.
+            mx_port_cancel(client->port, client->fifo, 0);
+            return status;
+        }
+        if ((packet.signal.observed & MX_FIFO_PEER_CLOSED) &&
+            !(packet.signal.observed & MX_FIFO_READABLE)) {
+            return ERR_PEER_CLOSED;
+        }
+    }
+}
@@ -37,4 +37,31 @@ void block_fifo_release_client(fifo_client_t* client);
 // dev_offset                               read, write
 mx_status_t block_fifo_txn(fifo_client_t* client, block_fifo_request_t* requests, size_t count);
 
+// Called once the group of requests submitted with it has completed.
+typedef void (*block_async_cb_t)(void* cookie, mx_status_t status);
+
+// One group of requests sharing a txnid, as for block_fifo_txn.
+typedef struct block_async_txn {
+    block_fifo_request_t* requests;
+    size_t count;
+    block_async_cb_t cb;
+    void* cookie;
+} block_async_txn_t;
+
+// Sends 'count' groups of requests in a single FIFO write without waiting
+// for them. Each group must use its own txnid, which must not already have
+// a group outstanding, and all groups together may hold at most
+// BLOCK_FIFO_MAX_DEPTH requests. On error nothing has been submitted.
+//
+// Callbacks run from block_fifo_async_dispatch(), or from block_fifo_txn()
+// if a synchronous caller happens to read the response first.
+mx_status_t block_fifo_async_submit(fifo_client_t* client, const block_async_txn_t* txns,
+                                    size_t count);
+
+// Waits until at least one response is available, or the deadline passes,
+// then runs the callbacks for every response that can be read at once.
+// Returns ERR_TIMED_OUT at the deadline and ERR_PEER_CLOSED if the server
+// went away.
+mx_status_t block_fifo_async_dispatch(fifo_client_t* client, mx_time_t deadline);
+
 __END_CDECLS
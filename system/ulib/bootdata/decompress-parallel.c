@@ -0,0 +1,175 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <bootdata/decompress.h>
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <threads.h>
+
+#include <magenta/syscalls.h>
+
+#include "decompress-private.h"
+
+// Blocks are handed to threads one at a time, so no more threads than this
+// are worth starting.
+#define MAX_THREADS 16
+
+typedef struct {
+    // Where each block starts, at its size word
+    const uint8_t** blocks;
+    size_t count;
+    const uint8_t* end;
+    uint8_t* dst;
+    size_t dst_size;
+    size_t* out_sizes;
+    atomic_size_t next;
+    // The first error any thread ran into
+    atomic_int status;
+    const char* err;
+} lz4_job_t;
+
+static int lz4_worker(void* arg) {
+    lz4_job_t* job = arg;
+    size_t i;
+    while ((i = atomic_fetch_add(&job->next, 1)) < job->count) {
+        if (atomic_load(&job->status) != NO_ERROR) {
+            break;
+        }
+        size_t off = i * BOOTDATA_LZ4_BLOCK_SIZE;
+        size_t room = job->dst_size - off;
+        if (room > BOOTDATA_LZ4_BLOCK_SIZE) {
+            room = BOOTDATA_LZ4_BLOCK_SIZE;
+        }
+        size_t in_used;
+        const char* err;
+        mx_status_t status = lz4_decompress_block(job->blocks[i], job->end - job->blocks[i],
+                                                  job->dst + off, room,
+                                                  &in_used, &job->out_sizes[i], &err);
+        int expected = NO_ERROR;
+        if (status != NO_ERROR &&
+            atomic_compare_exchange_strong(&job->status, &expected, status)) {
+            job->err = err;
+        }
+    }
+    return 0;
+}
+
+mx_status_t lz4_decompress_parallel(const void* data, size_t length,
+                                    void* dst, size_t dst_size, uint32_t threads,
+                                    size_t* in_used, size_t* out_used, bool* end,
+                                    const char** err) {
+    const uint8_t* start = data;
+    const uint8_t* limit = start + length;
+    *in_used = 0;
+    *out_used = 0;
+    *end = false;
+
+    // Find the whole blocks, one per BOOTDATA_LZ4_BLOCK_SIZE of dst, by
+    // walking their size words.
+    size_t count = 0;
+    const uint8_t* p = start;
+    while ((size_t)(limit - p) >= sizeof(uint32_t)) {
+        uint32_t blocksize = *(const uint32_t*)p;
+        if (blocksize == 0) {
+            *end = true;
+            break;
+        }
+        size_t need = sizeof(uint32_t) + (blocksize & 0x7fffffff);
+        if ((size_t)(limit - p) < need || count * BOOTDATA_LZ4_BLOCK_SIZE >= dst_size) {
+            break;
+        }
+        p += need;
+        count++;
+    }
+    if (count == 0) {
+        *in_used = *end ? sizeof(uint32_t) : 0;
+        return NO_ERROR;
+    }
+
+    lz4_job_t job = {
+        .count = count,
+        .end = limit,
+        .dst = dst,
+        .dst_size = dst_size,
+    };
+    job.blocks = malloc(count * sizeof(*job.blocks));
+    job.out_sizes = malloc(count * sizeof(*job.out_sizes));
+    if (job.blocks == NULL || job.out_sizes == NULL) {
+        free(job.blocks);
+        free(job.out_sizes);
+        *err = "out of memory for lz4 decompression";
+        return ERR_NO_MEMORY;
+    }
+    p = start;
+    for (size_t i = 0; i < count; i++) {
+        job.blocks[i] = p;
+        p += sizeof(uint32_t) + (*(const uint32_t*)p & 0x7fffffff);
+    }
+    atomic_init(&job.next, 0);
+    atomic_init(&job.status, NO_ERROR);
+
+    // This thread decompresses alongside the others, and on its own if
+    // none could be started.
+    thrd_t workers[MAX_THREADS];
+    uint32_t started = 0;
+    while (started + 1 < threads && started + 1 < MAX_THREADS && started + 1 < count) {
+        if (thrd_create(&workers[started], lz4_worker, &job) != thrd_success) {
+            break;
+        }
+        started++;
+    }
+    lz4_worker(&job);
+    for (uint32_t i = 0; i < started; i++) {
+        thrd_join(workers[i], NULL);
+    }
+
+    mx_status_t status = atomic_load(&job.status);
+    if (status != NO_ERROR) {
+        *err = job.err;
+    } else {
+        // The output is only contiguous if every block but the last was
+        // full, as the frame format promises.
+        for (size_t i = 0; i + 1 < count; i++) {
+            if (job.out_sizes[i] != BOOTDATA_LZ4_BLOCK_SIZE) {
+                *err = "lz4 block smaller than the block size";
+                status = ERR_INVALID_ARGS;
+                break;
+            }
+        }
+    }
+    if (status == NO_ERROR) {
+        *in_used = p - start + (*end ? sizeof(uint32_t) : 0);
+        *out_used = (count - 1) * BOOTDATA_LZ4_BLOCK_SIZE + job.out_sizes[count - 1];
+    }
+    free(job.blocks);
+    free(job.out_sizes);
+    return status;
+}
+
+static mx_status_t parallel_blocks(const uint8_t* data, const uint8_t* end,
+                                   uint8_t* dst, size_t* remaining,
+                                   uint32_t threads, const char** err) {
+    size_t in_used, out_used;
+    bool done;
+    mx_status_t status = lz4_decompress_parallel(data, end - data, dst, *remaining, threads,
+                                                 &in_used, &out_used, &done, err);
+    if (status < 0) {
+        return status;
+    }
+    if (!done) {
+        *err = "lz4 data truncated";
+        return ERR_INVALID_ARGS;
+    }
+    *remaining -= out_used;
+    return NO_ERROR;
+}
+
+mx_status_t decompress_bootdata_parallel(mx_handle_t vmar, mx_handle_t vmo,
+                                         size_t offset, size_t length,
+                                         uint32_t threads,
+                                         mx_handle_t* out, const char** err) {
+    return decompress_bootdata_with(vmar, vmo, offset, length, parallel_blocks, threads,
+                                    out, err);
+}
@@ -0,0 +1,26 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <magenta/compiler.h>
+#include <magenta/types.h>
+
+__BEGIN_CDECLS
+
+// Decompress the blocks of a bootfs LZ4 frame from [data, end) into dst,
+// which has *remaining bytes of room; on return *remaining is the room
+// left over.
+typedef mx_status_t (*lz4_blocks_func_t)(const uint8_t* data, const uint8_t* end,
+                                         uint8_t* dst, size_t* remaining,
+                                         uint32_t threads, const char** err);
+
+// decompress_bootdata, with the blocks of a compressed bootfs decompressed
+// by |blocks|. This keeps decompress.c free of threads, for userboot.
+mx_status_t decompress_bootdata_with(mx_handle_t vmar, mx_handle_t vmo,
+                                     size_t offset, size_t length,
+                                     lz4_blocks_func_t blocks, uint32_t threads,
+                                     mx_handle_t* out, const char** err);
+
+__END_CDECLS
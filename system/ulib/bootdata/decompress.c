@@ -13,6 +13,8 @@
 
 #include <lz4/lz4.h>
 
+#include "decompress-private.h"
+
 // The LZ4 Frame format is used to compress a bootfs image, but we cannot use
 // the LZ4 library's decompression functions in userboot. The following
 // definitions are used in the reimplementation of LZ4 Frame decompression, with
@@ -85,10 +87,75 @@ static mx_status_t check_lz4_frame(const lz4_frame_desc* fd,
     return NO_ERROR;
 }
 
+mx_status_t lz4_decompress_block(const void* data, size_t length,
+                                 void* dst, size_t dst_size,
+                                 size_t* in_used, size_t* out_used,
+                                 const char** err) {
+    // Block sizes are 32 bits.
+    if (length < sizeof(uint32_t)) {
+        *err = "lz4 data truncated";
+        return ERR_INVALID_ARGS;
+    }
+    uint32_t blocksize = *(const uint32_t*)data;
+    uint32_t actual = blocksize & 0x7fffffff;
+    const uint8_t* src = (const uint8_t*)data + sizeof(uint32_t);
+    if (length - sizeof(uint32_t) < actual) {
+        *err = "lz4 data truncated";
+        return ERR_INVALID_ARGS;
+    }
+    *in_used = sizeof(uint32_t) + actual;
+
+    if (blocksize == 0) {
+        // The end mark.
+        *out_used = 0;
+    } else if (blocksize >> 31) {
+        // If the data is uncompressed, the high bit is 1.
+        if (actual > dst_size) {
+            *err = "bootdata outsize too small for lz4 decompression";
+            return ERR_INVALID_ARGS;
+        }
+        memcpy(dst, src, actual);
+        *out_used = actual;
+    } else {
+        int dcmp = LZ4_decompress_safe((const char*)src, (char*)dst, actual,
+                                       dst_size > INT_MAX ? INT_MAX : (int)dst_size);
+        if (dcmp < 0) {
+            *err = "lz4 decompression failed";
+            return ERR_BAD_STATE;
+        }
+        *out_used = dcmp;
+    }
+    return NO_ERROR;
+}
+
+// Read each LZ4 block from [data, end) and decompress it into dst, which
+// has *remaining bytes of room left; on return *remaining is the room left
+// over.
+static mx_status_t decompress_blocks(const uint8_t* data, const uint8_t* end,
+                                     uint8_t* dst, size_t* remaining,
+                                     uint32_t threads, const char** err) {
+    for (;;) {
+        size_t in_used, out_used;
+        mx_status_t status = lz4_decompress_block(data, end - data, dst, *remaining,
+                                                  &in_used, &out_used, err);
+        if (status < 0) {
+            return status;
+        }
+        if (*(const uint32_t*)data == 0) {
+            return NO_ERROR;
+        }
+        data += in_used;
+        dst += out_used;
+        *remaining -= out_used;
+    }
+}
+
 static mx_status_t decompress_bootfs_vmo(mx_handle_t vmar,
-                                         const uint8_t* data, mx_handle_t* out,
-                                         const char** err) {
+                                         const uint8_t* data,
+                                         lz4_blocks_func_t blocks, uint32_t threads,
+                                         mx_handle_t* out, const char** err) {
     const bootdata_t* hdr = (bootdata_t*)data;
+    const uint8_t* end = data + sizeof(bootdata_t) + hdr->length;
 
     // Skip past the bootdata header
     data += sizeof(bootdata_t);
@@ -100,7 +167,11 @@ static mx_status_t decompress_bootfs_vmo(mx_handle_t vmar,
     data += sizeof(uint32_t);
 
     size_t newsize = hdr->extra;
-    check_lz4_frame((const lz4_frame_desc*)data, newsize - sizeof(bootdata_t), err);
+    mx_status_t status = check_lz4_frame((const lz4_frame_desc*)data,
+                                         newsize - sizeof(bootdata_t), err);
+    if (status < 0) {
+        return status;
+    }
     data += sizeof(lz4_frame_desc);
 
     newsize = (newsize + 4095) & ~4095;
@@ -110,7 +181,7 @@ static mx_status_t decompress_bootfs_vmo(mx_handle_t vmar,
         return ERR_NO_MEMORY;
     }
     mx_handle_t dst_vmo;
-    mx_status_t status = mx_vmo_create((uint64_t)newsize, 0, &dst_vmo);
+    status = mx_vmo_create((uint64_t)newsize, 0, &dst_vmo);
     if (status < 0) {
         *err = "mx_vmo_create failed for decompressing bootfs";
         return status;
@@ -135,40 +206,9 @@ static mx_status_t decompress_bootfs_vmo(mx_handle_t vmar,
     dst += sizeof(bootdata_t);
     remaining -= sizeof(bootdata_t);
 
-    // Read each LZ4 block and decompress it. Block sizes are 32 bits.
-    uint32_t blocksize = *(const uint32_t*)data;
-    data += sizeof(uint32_t);
-    while (blocksize) {
-        // If the data is uncompressed, the high bit is 1.
-        if (blocksize >> 31) {
-            uint32_t actual = blocksize & 0x7fffffff;
-            memcpy(dst, data, actual);
-            dst += actual;
-            data += actual;
-            if (remaining - actual > remaining) {
-                // Remaining wrapped around (would be negative if signed)
-                *err = "bootdata outsize too small for lz4 decompression";
-                return ERR_INVALID_ARGS;
-            }
-            remaining -= actual;
-        } else {
-            int dcmp = LZ4_decompress_safe((const char*)data, (char*)dst, blocksize, remaining);
-            if (dcmp < 0) {
-                *err = "lz4 decompression failed";
-                return ERR_BAD_STATE;
-            }
-            dst += dcmp;
-            data += blocksize;
-            if (remaining - dcmp > remaining) {
-                // Remaining wrapped around (would be negative if signed)
-                *err = "bootdata outsize too small for lz4 decompression";
-                return ERR_INVALID_ARGS;
-            }
-            remaining -= dcmp;
-        }
-
-        blocksize = *(uint32_t*)data;
-        data += sizeof(uint32_t);
+    status = blocks(data, end, dst, &remaining, threads, err);
+    if (status < 0) {
+        return status;
     }
 
     // Sanity check: verify that we didn't have more than one page leftover.
@@ -188,9 +228,174 @@ static mx_status_t decompress_bootfs_vmo(mx_handle_t vmar,
     return NO_ERROR;
 }
 
-mx_status_t decompress_bootdata(mx_handle_t vmar, mx_handle_t vmo,
-                                size_t offset, size_t length,
-                                mx_handle_t* out, const char** err) {
+// A bootfs whose files are compressed one at a time (or not at all) is used
+// as it is: the new VMO is a clone of the item if it starts on a page
+// boundary, or else a copy of it.
+static mx_status_t extract_bootfs_vmo(mx_handle_t vmo, size_t offset,
+                                      const uint8_t* data, mx_handle_t* out,
+                                      const char** err) {
+    const bootdata_t* hdr = (const bootdata_t*)data;
+    size_t length = sizeof(bootdata_t) + hdr->length;
+
+    mx_status_t status;
+    if ((offset & (PAGE_SIZE - 1)) == 0) {
+        status = mx_vmo_clone(vmo, MX_VMO_CLONE_COPY_ON_WRITE,
+                              offset, length, out);
+        if (status < 0) {
+            *err = "mx_vmo_clone failed on bootfs vmo";
+        }
+        return status;
+    }
+
+    mx_handle_t dst_vmo;
+    status = mx_vmo_create(length, 0, &dst_vmo);
+    if (status < 0) {
+        *err = "mx_vmo_create failed for bootfs";
+        return status;
+    }
+    size_t actual;
+    status = mx_vmo_write(dst_vmo, data, 0, length, &actual);
+    if (status == NO_ERROR && actual != length) {
+        status = ERR_IO;
+    }
+    if (status < 0) {
+        *err = "mx_vmo_write failed copying bootfs";
+        mx_handle_close(dst_vmo);
+        return status;
+    }
+    *out = dst_vmo;
+    return NO_ERROR;
+}
+
+mx_status_t lz4_frame_header(const void* data, size_t length,
+                             uint64_t* content_size, size_t* header_size,
+                             const char** err) {
+    lz4_frame_desc fd;
+    if (length < sizeof(uint32_t) + sizeof(fd) ||
+        *(const uint32_t*)data != MX_LZ4_MAGIC) {
+        *err = "bad magic number for lz4 frame";
+        return ERR_INVALID_ARGS;
+    }
+    memcpy(&fd, (const uint8_t*)data + sizeof(uint32_t), sizeof(fd));
+    mx_status_t status = check_lz4_frame(&fd, fd.content_size, err);
+    if (status < 0) {
+        return status;
+    }
+    *content_size = fd.content_size;
+    *header_size = sizeof(uint32_t) + sizeof(fd);
+    return NO_ERROR;
+}
+
+mx_status_t bootfs_file_size(mx_handle_t vmo, size_t offset, size_t length,
+                             size_t* size, const char** err) {
+    *err = "none";
+
+    // Empty files are stored with no frame at all.
+    if (length == 0) {
+        *size = 0;
+        return NO_ERROR;
+    }
+
+    uint8_t buf[sizeof(uint32_t) + sizeof(lz4_frame_desc)];
+    size_t actual;
+    mx_status_t status = mx_vmo_read(vmo, buf, offset,
+                                     length < sizeof(buf) ? length : sizeof(buf),
+                                     &actual);
+    if (status < 0) {
+        *err = "mx_vmo_read failed on bootfs vmo";
+        return status;
+    }
+    uint64_t content_size;
+    size_t header_size;
+    if ((status = lz4_frame_header(buf, actual, &content_size, &header_size, err)) < 0) {
+        return status;
+    }
+    if (content_size > SIZE_MAX) {
+        *err = "bootfs file too large";
+        return ERR_NO_MEMORY;
+    }
+    *size = content_size;
+    return NO_ERROR;
+}
+
+mx_status_t decompress_bootfs_file(mx_handle_t vmar, mx_handle_t vmo,
+                                   size_t offset, size_t length,
+                                   mx_handle_t* out, const char** err) {
+    *err = "none";
+
+    if (length == 0) {
+        mx_status_t status = mx_vmo_create(0, 0, out);
+        if (status < 0) {
+            *err = "mx_vmo_create failed for bootfs file";
+        }
+        return status;
+    }
+
+    uintptr_t addr = 0;
+    size_t aligned_offset = offset & ~(PAGE_SIZE - 1);
+    size_t align_shift = offset - aligned_offset;
+    size_t map_len = length + align_shift;
+    mx_status_t status = mx_vmar_map(vmar, 0, vmo, aligned_offset, map_len,
+                                     MX_VM_FLAG_PERM_READ, &addr);
+    if (status < 0) {
+        *err = "mx_vmar_map failed on bootfs vmo";
+        return status;
+    }
+    const uint8_t* data = (const uint8_t*)(addr + align_shift);
+    const uint8_t* end = data + length;
+
+    mx_handle_t dst_vmo = MX_HANDLE_INVALID;
+    uintptr_t dst_addr = 0;
+    size_t size = 0;
+    uint64_t content_size;
+    size_t header_size;
+    if ((status = lz4_frame_header(data, length, &content_size, &header_size, err)) < 0) {
+        goto done;
+    }
+    if (content_size > SIZE_MAX - PAGE_SIZE) {
+        *err = "bootfs file too large";
+        status = ERR_NO_MEMORY;
+        goto done;
+    }
+    size = content_size;
+    if ((status = mx_vmo_create(size, 0, &dst_vmo)) < 0) {
+        *err = "mx_vmo_create failed for bootfs file";
+        goto done;
+    }
+    if (size > 0) {
+        status = mx_vmar_map(vmar, 0, dst_vmo, 0, size,
+                             MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE,
+                             &dst_addr);
+        if (status < 0) {
+            *err = "mx_vmar_map failed on bootfs file vmo";
+            goto done;
+        }
+        size_t remaining = size;
+        status = decompress_blocks(data + header_size, end,
+                                   (uint8_t*)dst_addr, &remaining, 1, err);
+        if (status == NO_ERROR && remaining != 0) {
+            *err = "bootfs file size does not match decompressed size";
+            status = ERR_INVALID_ARGS;
+        }
+        mx_vmar_unmap(vmar, dst_addr, size);
+    }
+
+done:
+    mx_vmar_unmap(vmar, addr, map_len);
+    if (status < 0) {
+        if (dst_vmo != MX_HANDLE_INVALID) {
+            mx_handle_close(dst_vmo);
+        }
+        return status;
+    }
+    *out = dst_vmo;
+    return NO_ERROR;
+}
+
+mx_status_t decompress_bootdata_with(mx_handle_t vmar, mx_handle_t vmo,
+                                     size_t offset, size_t length,
+                                     lz4_blocks_func_t blocks, uint32_t threads,
+                                     mx_handle_t* out, const char** err) {
     *err = "none";
 
     if (length > SIZE_MAX) {
@@ -214,7 +419,10 @@ mx_status_t decompress_bootdata(mx_handle_t vmar, mx_handle_t vmo,
     case BOOTDATA_BOOTFS_BOOT:
     case BOOTDATA_BOOTFS_SYSTEM:
         if (hdr->flags & BOOTDATA_BOOTFS_FLAG_COMPRESSED) {
-            status = decompress_bootfs_vmo(vmar, (const uint8_t*)addr, out, err);
+            status = decompress_bootfs_vmo(vmar, (const uint8_t*)addr, blocks, threads,
+                                           out, err);
+        } else {
+            status = extract_bootfs_vmo(vmo, offset, (const uint8_t*)addr, out, err);
         }
         break;
     default:
@@ -226,3 +434,10 @@ mx_status_t decompress_bootdata(mx_handle_t vmar, mx_handle_t vmo,
 
     return status;
 }
+
+mx_status_t decompress_bootdata(mx_handle_t vmar, mx_handle_t vmo,
+                                size_t offset, size_t length,
+                                mx_handle_t* out, const char** err) {
+    return decompress_bootdata_with(vmar, vmo, offset, length, decompress_blocks, 1,
+                                    out, err);
+}
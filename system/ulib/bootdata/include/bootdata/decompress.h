@@ -7,7 +7,12 @@
 
 #pragma GCC visibility push(hidden)
 
+#include <magenta/compiler.h>
 #include <magenta/types.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+__BEGIN_CDECLS
 
 // Decompress bootdata at offset of total size length into a new VMO
 // On failure, errmsg is a human readable error description to provide
@@ -16,4 +21,56 @@ mx_status_t decompress_bootdata(mx_handle_t vmar, mx_handle_t vmo,
                                 size_t offset, size_t length,
                                 mx_handle_t* out, const char** errmsg);
 
+// As decompress_bootdata, but decompress a compressed bootfs on up to
+// |threads| threads. Not available in userboot, which has none.
+mx_status_t decompress_bootdata_parallel(mx_handle_t vmar, mx_handle_t vmo,
+                                         size_t offset, size_t length,
+                                         uint32_t threads,
+                                         mx_handle_t* out, const char** errmsg);
+
+// Files in a bootfs with BOOTDATA_BOOTFS_FLAG_FILE_COMPRESSED set are each
+// an LZ4 frame of their own, at the offset and of the length given in the
+// bootfs directory.
+
+// Get the decompressed size of such a file, reading only its frame header.
+mx_status_t bootfs_file_size(mx_handle_t vmo, size_t offset, size_t length,
+                             size_t* size, const char** errmsg);
+
+// Decompress such a file from the bootfs VMO into a new VMO of its own.
+mx_status_t decompress_bootfs_file(mx_handle_t vmar, mx_handle_t vmo,
+                                   size_t offset, size_t length,
+                                   mx_handle_t* out, const char** errmsg);
+
+// Bootdata LZ4 frames have independent blocks of at most 64kB with no
+// block checksums, and always give their content size. Every block but the
+// last holds a full 64kB, so each one can be decompressed on its own, at a
+// known place in the output.
+#define BOOTDATA_LZ4_BLOCK_SIZE 65536
+
+// Check that [data, data + length) starts with the header of such a frame,
+// and get its content size and the size of the header itself.
+mx_status_t lz4_frame_header(const void* data, size_t length,
+                             uint64_t* content_size, size_t* header_size,
+                             const char** errmsg);
+
+// Decompress the block at the start of [data, data + length) into dst,
+// which has room for dst_size bytes, giving the bytes of input and output
+// it took. The end mark takes just its size word and gives no output.
+mx_status_t lz4_decompress_block(const void* data, size_t length,
+                                 void* dst, size_t dst_size,
+                                 size_t* in_used, size_t* out_used,
+                                 const char** errmsg);
+
+// Decompress the whole blocks in [data, data + length) into dst, on up to
+// |threads| threads, stopping after the end mark or once dst is full. A
+// block cut off by the end of the input is left for the next call, so a
+// frame can be streamed through bounded buffers. *end is set if the end
+// mark was reached. Not available in userboot.
+mx_status_t lz4_decompress_parallel(const void* data, size_t length,
+                                    void* dst, size_t dst_size, uint32_t threads,
+                                    size_t* in_used, size_t* out_used, bool* end,
+                                    const char** errmsg);
+
+__END_CDECLS
+
 #pragma GCC visibility pop
@@ -8,7 +8,11 @@ MODULE := $(LOCAL_DIR)
 
 MODULE_TYPE := userlib
 
-MODULE_SRCS += $(LOCAL_DIR)/decompress.c
+# userboot builds decompress.c on its own, so it must stay free of threads;
+# the threaded decompression lives beside it.
+MODULE_SRCS += \
+    $(LOCAL_DIR)/decompress.c \
+    $(LOCAL_DIR)/decompress-parallel.c \
 
 MODULE_LIBS := \
     third_party/ulib/lz4 \
@@ -23,4 +23,9 @@ typedef struct block_ops {
     // Write from the VMO to the block device
     void (*write)(mx_device_t* dev, mx_handle_t vmo, uint64_t length, uint64_t vmo_offset,
                   uint64_t dev_offset, void* cookie);
+    // Optional. Reap whatever completions the device has already posted,
+    // invoking the complete callback for each on the calling thread. Lets
+    // a caller spin briefly on a fast device instead of waiting for its
+    // interrupt thread to be woken.
+    void (*poll)(mx_device_t* dev);
 } block_ops_t;
@@ -30,6 +30,10 @@ typedef struct mx_display_protocol {
     void (*flush)(mx_device_t* dev);
     // flushes the framebuffer
 
+    void (*flush_region)(mx_device_t* dev, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+    // flushes part of the framebuffer; optional, displays without it have the
+    // whole framebuffer flushed instead
+
     void (*acquire_or_release_display)(mx_device_t* dev);
     // Controls ownership of the display between multiple display clients.
     // Useful for switching to and from the gfxconsole.
@@ -26,21 +26,66 @@ __BEGIN_CDECLS;
 // these will not be loaded.
 //
 // The FEATURE_WLAN flag indicates a device that supports wlan operations.
+//
+// The FEATURE_TX_CSUM flag indicates a device that completes TCP and UDP
+// checksums (over IPv4 or IPv6) for frames given to send_batch() with
+// ETHMAC_FRAME_TX_CSUM, and FEATURE_RX_CSUM one that verifies them on
+// receive, reporting good ones with ETHMAC_RX_CSUM_OK.
 
 #define ETHMAC_FEATURE_RX_QUEUE (1u)
 #define ETHMAC_FEATURE_TX_QUEUE (2u)
 #define ETHMAC_FEATURE_WLAN     (4u)
+#define ETHMAC_FEATURE_TX_CSUM  (8u)
+#define ETHMAC_FEATURE_RX_CSUM  (16u)
+
+// The FEATURE_RSS flag indicates a device that can steer received
+// frames over info.rx_queues queues itself, as set up by set_rss(),
+// reporting the queue of each frame in its recv() flags.
+#define ETHMAC_FEATURE_RSS      (32u)
 
 typedef struct ethmac_info {
     uint32_t features;
     uint32_t mtu;
     uint8_t mac[ETH_MAC_SIZE];
     uint8_t reserved0[2];
-    uint32_t reserved1[4];
+    // number of rx queues, with FEATURE_RSS
+    uint32_t rx_queues;
+    uint32_t reserved1[3];
 } ethmac_info_t;
 
+#define ETHMAC_RSS_KEY_SIZE   40
+#define ETHMAC_RSS_TABLE_SIZE 128
+
+// The Toeplitz hash of a frame's IP addresses (and TCP/UDP ports)
+// under key selects table[hash % ETHMAC_RSS_TABLE_SIZE], which is
+// taken modulo queue_count.
+typedef struct ethmac_rss_config {
+    uint32_t queue_count;
+    uint8_t key[ETHMAC_RSS_KEY_SIZE];
+    uint8_t table[ETHMAC_RSS_TABLE_SIZE];
+} ethmac_rss_config_t;
+
 #define ETHMAC_STATUS_ONLINE (1u)
 
+// flags for recv() and recv_batch() frames
+#define ETHMAC_RX_CSUM_OK (1u) // TCP/UDP checksum was checked and is good
+#define ETHMAC_RX_QUEUE(flags) (((flags) >> 16) & 0xffu) // rx queue, with FEATURE_RSS
+#define ETHMAC_RX_QUEUE_FLAGS(queue) (((uint32_t)(queue) & 0xffu) << 16)
+
+// flags for send_batch() frames
+// The checksum field, csum_offset bytes past csum_start, holds the
+// (uncomplemented) pseudo-header sum; the device adds in everything
+// from csum_start to the end of the frame and stores the complement.
+#define ETHMAC_FRAME_TX_CSUM (1u)
+
+typedef struct ethmac_frame {
+    void* data;
+    size_t length;
+    uint32_t flags;
+    uint16_t csum_start;
+    uint16_t csum_offset;
+} ethmac_frame_t;
+
 typedef struct ethmac_ifc_virt {
     void (*status)(void* cookie, uint32_t status);
 
@@ -50,6 +95,12 @@ typedef struct ethmac_ifc_virt {
     // complete_?x() is invoked when FEATURE_?X_QUEUE is present
     void (*complete_rx)(void* cookie, uint32_t length, uint32_t flags);
     void (*complete_tx)(void* cookie, uint32_t count);
+
+    // recv_batch() may be invoked instead of recv() to hand up several
+    // received frames at once, letting the ethernet layer post them to
+    // its clients together.  Frames are only valid during the call.
+    // Optional: ethermac drivers must check for NULL.
+    void (*recv_batch)(void* cookie, ethmac_frame_t* frames, size_t count, uint32_t flags);
 } ethmac_ifc_t;
 
 
@@ -80,6 +131,17 @@ typedef struct ethmac_protocol {
                      uintptr_t pa0, uintptr_t pa1, size_t length);
     void (*queue_rx)(mx_device_t* dev, uint32_t options,
                      uintptr_t pa0, uintptr_t pa1, size_t length);
+
+    // send_batch() is an optional form of send() for several frames,
+    // which are sent in order, so a driver can fill its tx ring and
+    // notify the hardware once.  If NULL, send() is used per frame.
+    // Required with FEATURE_TX_CSUM.
+    void (*send_batch)(mx_device_t* dev, uint32_t options,
+                       ethmac_frame_t* frames, size_t count);
+
+    // set_rss() is valid if FEATURE_RSS is present.  queue_count is at
+    // most info.rx_queues; a queue_count of 1 turns steering off.
+    mx_status_t (*set_rss)(mx_device_t* dev, const ethmac_rss_config_t* config);
 } ethmac_protocol_t;
 
 
@@ -39,6 +39,9 @@ typedef struct pci_protocol {
                                 mx_pci_irq_mode_t mode,
                                 uint32_t requested_irq_count);
     mx_status_t (*get_device_info)(mx_device_t* dev, mx_pcie_device_info_t* out_info);
+    // Deliver interrupt |which_irq| to |cpu|, so that a driver with one queue
+    // per cpu can service each queue's interrupt on the cpu which owns it.
+    mx_status_t (*set_irq_affinity)(mx_device_t* dev, int which_irq, uint32_t cpu);
 } pci_protocol_t;
 
 __END_CDECLS;
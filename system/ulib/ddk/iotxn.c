@@ -38,7 +38,13 @@
 
 #define IOTXN_STATE_MASK       (IOTXN_PFLAG_FREE | IOTXN_PFLAG_QUEUED)
 
-static list_node_t free_list = LIST_INITIAL_VALUE(free_list);
+// Freed iotxns are kept in buckets hashed by the size of the buffer they
+// hold on to, so that allocation only scans txns that might fit. Bucket 0
+// holds bare txns (clones, iotxn_alloc_vmo) that carry no buffer at all.
+#define FREE_LIST_BUCKETS 16
+
+static list_node_t free_lists[FREE_LIST_BUCKETS];
+static bool free_lists_ready = false;
 static mtx_t free_list_mutex = MTX_INIT;
 #if FREE_LIST_MONITOR_LIMIT
 static size_t free_list_length = 0;
@@ -60,12 +66,26 @@ static bool do_free_phys(uint32_t pflags) {
     return (pflags & IOTXN_PFLAG_PHYSMAP);
 }
 
+static list_node_t* free_list_for(uint64_t data_size) {
+    if (!free_lists_ready) {
+        for (size_t i = 0; i < FREE_LIST_BUCKETS; i++) {
+            list_initialize(&free_lists[i]);
+        }
+        free_lists_ready = true;
+    }
+    if (data_size == 0) {
+        return &free_lists[0];
+    }
+    // buffer sizes are nearly always multiples of 512
+    return &free_lists[1 + ((data_size >> 9) % (FREE_LIST_BUCKETS - 1))];
+}
+
 static iotxn_t* find_in_free_list(uint32_t pflags, uint64_t data_size) {
     bool found = false;
     iotxn_t* txn = NULL;
     //xprintf("find_in_free_list pflags 0x%x data_size 0x%" PRIx64 "\n", pflags, data_size);
     mtx_lock(&free_list_mutex);
-    list_for_every_entry (&free_list, txn, iotxn_t, node) {
+    list_for_every_entry (free_list_for(data_size), txn, iotxn_t, node) {
         // txn->pflags has IOTXN_ALLOC_CONTIGUOUS set if the txn has a contiguous VMO we allocated,
         // or zero otherwise. And the pflags passed into this function is either zero or
         // IOTXN_ALLOC_CONTIGUOUS. So here we mask txn->pflags with IOTXN_ALLOC_CONTIGUOUS
@@ -126,7 +146,7 @@ static void iotxn_release_free_list(iotxn_t* txn) {
     txn->release_cb = iotxn_release_free_list;
 
     mtx_lock(&free_list_mutex);
-    list_add_head(&free_list, &txn->node);
+    list_add_head(free_list_for(txn->vmo_length), &txn->node);
 #if FREE_LIST_MONITOR_LIMIT
     free_list_length++;
     if (free_list_length % FREE_LIST_MONITOR_LIMIT == 0
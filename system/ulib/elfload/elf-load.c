@@ -232,15 +232,44 @@ static mx_status_t load_segment(mx_handle_t vmar, size_t vmar_offset,
         return finish_load_segment(vmar, vmo, ph, start, size,
                                    file_start, file_end, partial_page);
 
-    // For a writable segment, we need a writable VMO.
+    // For a writable segment, we need a writable VMO: a copy-on-write
+    // clone of the file's pages, extended to cover any bss.  Nothing is
+    // copied up front, and the bss pages read as zero until touched.
+    // TODO(mcgrathr,MG-698): When MG-698 is fixed, we can clone to a
+    // size that's not whole pages, and then extending it with set_size
+    // will do the partial-page zeroing for us implicitly.
     mx_handle_t writable_vmo;
     mx_status_t status = mx_vmo_clone(vmo, MX_VMO_CLONE_COPY_ON_WRITE,
                                       file_start, data_size, &writable_vmo);
+    if (status != NO_ERROR)
+        return status;
+    if (size > data_size)
+        status = mx_vmo_set_size(writable_vmo, size);
+
+    if (status == NO_ERROR && ph->p_memsz > ph->p_filesz && partial_page > 0) {
+        // The final partial page of data from the file is followed by
+        // whatever the file's contents there are, but in the memory
+        // image that's the start of the bss, so it must be zero.
+        static const char zero[PAGE_SIZE];
+        const size_t zero_size = PAGE_SIZE - partial_page;
+        size_t n;
+        status = mx_vmo_write(writable_vmo, zero,
+                              file_end - file_start + partial_page,
+                              zero_size, &n);
+        if (status == NO_ERROR && n != zero_size)
+            status = ERR_IO;
+    }
+
     if (status == NO_ERROR) {
-        status = finish_load_segment(vmar, writable_vmo, ph, start, size,
-                                     0, file_end - file_start, partial_page);
-        mx_handle_close(writable_vmo);
+        const uint32_t flags = MX_VM_FLAG_SPECIFIC |
+            ((ph->p_flags & PF_R) ? MX_VM_FLAG_PERM_READ : 0) |
+            MX_VM_FLAG_PERM_WRITE |
+            ((ph->p_flags & PF_X) ? MX_VM_FLAG_PERM_EXECUTE : 0);
+        uintptr_t mapped;
+        status = mx_vmar_map(vmar, start, writable_vmo, 0, size, flags,
+                             &mapped);
     }
+    mx_handle_close(writable_vmo);
     return status;
 }
 
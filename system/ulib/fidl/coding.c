@@ -0,0 +1,211 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fidl/coding.h>
+
+#include <magenta/syscalls.h>
+#include <string.h>
+
+// Decoding and encoding walk a message the same way: depth first through
+// the coding tables, claiming out-of-line objects from the end of the
+// primary object onwards in the order their pointers are reached, and
+// taking handles from (or putting them into) the handle table in the order
+// their slots are reached.  Only what is done at each pointer and handle
+// differs.
+
+const fidl_type_t fidl_string_type = {
+    .type_tag = fidl_type_string,
+    .coded_string = {.max_size = UINT32_MAX},
+};
+
+const fidl_type_t fidl_handle_type = {
+    .type_tag = fidl_type_handle,
+};
+
+typedef struct walker {
+    bool decoding;
+    uint8_t* bytes;
+    uint32_t num_bytes;
+    uint32_t next_out_of_line;
+
+    // When decoding, the handles to hand out; when encoding, where to put
+    // them.
+    mx_handle_t* handles;
+    uint32_t num_handles;
+    uint32_t handle_idx;
+
+    const char* error;
+} walker_t;
+
+static bool fail(walker_t* w, const char* error) {
+    w->error = error;
+    return false;
+}
+
+// Claims the next |size| bytes of out-of-line space, returning their offset.
+static bool claim_out_of_line(walker_t* w, uint64_t size, uint32_t* offset_out) {
+    uint64_t end = FIDL_ALIGN((uint64_t)w->next_out_of_line + size);
+    if (end > w->num_bytes)
+        return fail(w, "message is too short for its out-of-line data");
+    *offset_out = w->next_out_of_line;
+    w->next_out_of_line = (uint32_t)end;
+    return true;
+}
+
+static bool walk_handle(walker_t* w, mx_handle_t* slot) {
+    if (w->handle_idx == w->num_handles)
+        return fail(w, w->decoding ? "message has too few handles" : "message has too many handles");
+
+    if (w->decoding) {
+        if (*slot != FIDL_HANDLE_PRESENT)
+            return fail(w, "message is missing a handle");
+        *slot = w->handles[w->handle_idx++];
+    } else {
+        if (*slot == MX_HANDLE_INVALID)
+            return fail(w, "message is missing a handle");
+        w->handles[w->handle_idx++] = *slot;
+        *slot = FIDL_HANDLE_PRESENT;
+    }
+    return true;
+}
+
+static bool walk_string(walker_t* w, const fidl_type_t* type, fidl_string_t* string) {
+    if (string->size > type->coded_string.max_size)
+        return fail(w, "string is too long");
+
+    uint32_t offset;
+    if (w->decoding) {
+        if ((uintptr_t)string->data != FIDL_ALLOC_PRESENT)
+            return fail(w, "string data is not present");
+        if (!claim_out_of_line(w, string->size, &offset))
+            return false;
+        string->data = (char*)(w->bytes + offset);
+    } else {
+        if (!claim_out_of_line(w, string->size, &offset))
+            return false;
+        // Encoding doesn't move anything, so the characters have to be
+        // where the decoder will look for them.
+        if (string->data != (char*)(w->bytes + offset))
+            return fail(w, "string data is out of place");
+        string->data = (char*)FIDL_ALLOC_PRESENT;
+    }
+    return true;
+}
+
+static bool walk(walker_t* w, const fidl_type_t* type, uint8_t* object, uint32_t depth) {
+    if (type == NULL)
+        return true;
+    if (depth > FIDL_MAX_DEPTH)
+        return fail(w, "message nests too deeply");
+
+    switch (type->type_tag) {
+    case fidl_type_struct:
+        for (uint32_t i = 0; i < type->coded_struct.field_count; i++) {
+            const fidl_field_t* field = &type->coded_struct.fields[i];
+            if (!walk(w, field->type, object + field->offset, depth + 1))
+                return false;
+        }
+        return true;
+
+    case fidl_type_union: {
+        uint32_t tag = *(const uint32_t*)object;
+        if (tag >= type->coded_union.type_count)
+            return fail(w, "union tag is out of range");
+        return walk(w, type->coded_union.types[tag], object + type->coded_union.data_offset,
+                    depth + 1);
+    }
+
+    case fidl_type_string:
+        return walk_string(w, type, (fidl_string_t*)object);
+
+    case fidl_type_handle:
+        return walk_handle(w, (mx_handle_t*)object);
+    }
+
+    return fail(w, "bad coding table");
+}
+
+static bool walk_message(walker_t* w, const fidl_type_t* type) {
+    if (w->bytes == NULL || ((uintptr_t)w->bytes % FIDL_ALIGNMENT) != 0)
+        return fail(w, "message buffer is not aligned");
+    if (type == NULL || type->type_tag != fidl_type_struct)
+        return fail(w, "message type is not a struct");
+    if (w->num_bytes < FIDL_ALIGN(type->coded_struct.size))
+        return fail(w, "message is too short");
+
+    w->next_out_of_line = FIDL_ALIGN(type->coded_struct.size);
+    if (!walk(w, type, w->bytes, 0))
+        return false;
+
+    if (w->next_out_of_line != w->num_bytes)
+        return fail(w, "message has trailing bytes");
+    if (w->decoding && w->handle_idx != w->num_handles)
+        return fail(w, "message has unused handles");
+    return true;
+}
+
+static void close_handles(const mx_handle_t* handles, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++)
+        mx_handle_close(handles[i]);
+}
+
+mx_status_t fidl_decode(const fidl_type_t* type, void* bytes, uint32_t num_bytes,
+                        const mx_handle_t* handles, uint32_t num_handles,
+                        const char** error_msg_out) {
+    walker_t w = {
+        .decoding = true,
+        .bytes = (uint8_t*)bytes,
+        .num_bytes = num_bytes,
+        .handles = (mx_handle_t*)handles,
+        .num_handles = num_handles,
+    };
+    if (!walk_message(&w, type)) {
+        close_handles(handles, num_handles);
+        if (error_msg_out != NULL)
+            *error_msg_out = w.error;
+        return ERR_INVALID_ARGS;
+    }
+    return NO_ERROR;
+}
+
+mx_status_t fidl_encode(const fidl_type_t* type, void* bytes, uint32_t num_bytes,
+                        mx_handle_t* handles, uint32_t max_handles,
+                        uint32_t* actual_handles_out, const char** error_msg_out) {
+    walker_t w = {
+        .decoding = false,
+        .bytes = (uint8_t*)bytes,
+        .num_bytes = num_bytes,
+        .handles = handles,
+        .num_handles = max_handles,
+    };
+    if (!walk_message(&w, type)) {
+        close_handles(handles, w.handle_idx);
+        if (error_msg_out != NULL)
+            *error_msg_out = w.error;
+        return ERR_INVALID_ARGS;
+    }
+    *actual_handles_out = w.handle_idx;
+    return NO_ERROR;
+}
+
+void* fidl_builder_alloc(fidl_builder_t* builder, uint32_t size) {
+    uint64_t end = FIDL_ALIGN((uint64_t)builder->size + size);
+    if (end > builder->capacity)
+        return NULL;
+    uint8_t* ptr = builder->buffer + builder->size;
+    memset(ptr, 0, end - builder->size);
+    builder->size = (uint32_t)end;
+    return ptr;
+}
+
+bool fidl_builder_string(fidl_builder_t* builder, fidl_string_t* string,
+                         const char* data, uint32_t size) {
+    char* chars = fidl_builder_alloc(builder, size);
+    if (chars == NULL)
+        return false;
+    memcpy(chars, data, size);
+    string->size = size;
+    string->data = chars;
+    return true;
+}
@@ -0,0 +1,151 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <magenta/compiler.h>
+#include <magenta/types.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+__BEGIN_CDECLS
+
+// FIDL messages, as laid out in docs/fidl_wire_format.md.
+//
+// A message is decoded in place: fidl_decode() checks the bytes read from a
+// channel against the coding table of the message type, then patches every
+// out-of-line pointer to point into the same buffer and every handle slot to
+// hold the handle from the channel's handle table.  After that, the buffer
+// can be read as the generated C struct, with no copying and no allocation.
+// fidl_encode() undoes that before the message goes back out.
+
+// All objects in a message, inline or out-of-line, start on this boundary.
+#define FIDL_ALIGNMENT ((uint32_t)8)
+#define FIDL_ALIGN(a) (((a) + FIDL_ALIGNMENT - 1) & ~(FIDL_ALIGNMENT - 1))
+
+// What pointers and handles hold on the wire.
+#define FIDL_ALLOC_PRESENT ((uintptr_t)UINTPTR_MAX)
+#define FIDL_ALLOC_ABSENT ((uintptr_t)0)
+#define FIDL_HANDLE_PRESENT ((mx_handle_t)UINT32_MAX)
+#define FIDL_HANDLE_ABSENT ((mx_handle_t)0)
+
+// How deep structs, unions and strings may nest in one message.
+#define FIDL_MAX_DEPTH 32
+
+// The start of every message.
+typedef struct fidl_message_header {
+    uint32_t txid;
+    uint32_t reserved0;
+    uint32_t flags;
+    uint32_t ordinal;
+} fidl_message_header_t;
+
+// A string, which is not NUL terminated.  On the wire, |data| is
+// FIDL_ALLOC_PRESENT and the characters follow out-of-line.
+typedef struct fidl_string {
+    uint64_t size;
+    char* data;
+} fidl_string_t;
+
+// Coding tables
+//
+// The FIDL compiler emits one of these for each struct, union and message
+// which holds handles or out-of-line data.  Types which are nothing but
+// plain data don't need one; a NULL table means the bytes are copied and
+// checked for size only.
+
+typedef struct fidl_type fidl_type_t;
+
+typedef struct fidl_field {
+    const fidl_type_t* type;
+    uint32_t offset;
+} fidl_field_t;
+
+typedef enum fidl_type_tag {
+    fidl_type_struct,
+    fidl_type_union,
+    fidl_type_string,
+    fidl_type_handle,
+} fidl_type_tag_t;
+
+struct fidl_type {
+    fidl_type_tag_t type_tag;
+    union {
+        // Only the fields which need coding are listed, in offset order.
+        struct {
+            const fidl_field_t* fields;
+            uint32_t field_count;
+            uint32_t size;
+            const char* name;
+        } coded_struct;
+
+        // A uint32_t tag followed, at |data_offset|, by the member which it
+        // selects.  |types| has an entry, possibly NULL, for every member.
+        struct {
+            const fidl_type_t* const* types;
+            uint32_t type_count;
+            uint32_t data_offset;
+            uint32_t size;
+            const char* name;
+        } coded_union;
+
+        struct {
+            uint32_t max_size;
+        } coded_string;
+
+        // Handles need nothing more than the tag.  The kernel checks the
+        // type of a handle when it is used, so the decoder doesn't.
+    };
+};
+
+// Every string and handle field can share these.  Strings are unbounded, as
+// the language has no way to give them a bound yet.
+extern const fidl_type_t fidl_string_type;
+extern const fidl_type_t fidl_handle_type;
+
+// Decodes |num_bytes| of message in |bytes|, which must be 8 byte aligned,
+// in place, taking the |num_handles| handles for it.  The message has to use
+// up every byte and every handle exactly.  On failure all of the handles are
+// closed and |error_msg_out|, if not NULL, says what was wrong.
+mx_status_t fidl_decode(const fidl_type_t* type, void* bytes, uint32_t num_bytes,
+                        const mx_handle_t* handles, uint32_t num_handles,
+                        const char** error_msg_out);
+
+// Encodes the decoded message in |bytes| in place, moving its handles into
+// |handles| and writing the count to |actual_handles_out|.  The message's
+// out-of-line objects must already be in |bytes| in the order the wire
+// format puts them, as a fidl_builder lays them out, since encoding only
+// replaces pointers with markers and never moves data.  On failure the
+// handles which were extracted are closed.
+mx_status_t fidl_encode(const fidl_type_t* type, void* bytes, uint32_t num_bytes,
+                        mx_handle_t* handles, uint32_t max_handles,
+                        uint32_t* actual_handles_out, const char** error_msg_out);
+
+// fidl_builder
+//
+// Lays a message out in a caller-provided buffer: the primary object first,
+// then each out-of-line object after it, every one zeroed and 8 byte
+// aligned.  Allocate in the order the fields appear, depth first, and the
+// result is ready for fidl_encode().
+typedef struct fidl_builder {
+    uint8_t* buffer;
+    uint32_t capacity;
+    uint32_t size;
+} fidl_builder_t;
+
+static inline void fidl_builder_init(fidl_builder_t* builder, void* buffer, uint32_t capacity) {
+    builder->buffer = (uint8_t*)buffer;
+    builder->capacity = capacity;
+    builder->size = 0;
+}
+
+// Returns |size| zeroed bytes, or NULL if the buffer is full.
+void* fidl_builder_alloc(fidl_builder_t* builder, uint32_t size);
+
+// Copies |size| characters into the message and points |string| at them.
+bool fidl_builder_string(fidl_builder_t* builder, fidl_string_t* string,
+                         const char* data, uint32_t size);
+
+__END_CDECLS
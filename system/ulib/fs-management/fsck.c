@@ -17,8 +17,8 @@
 #include <mxio/util.h>
 #include <mxio/vfs.h>
 
-static mx_status_t fsck_minfs(const char* devicepath, const fsck_options_t* options,
-                              LaunchCallback cb) {
+static mx_status_t fsck_mxfs(const char* binary, const char* devicepath,
+                             const fsck_options_t* options, LaunchCallback cb) {
     mx_handle_t hnd[MXIO_MAX_HANDLES * 2];
     uint32_t ids[MXIO_MAX_HANDLES * 2];
     size_t n = 0;
@@ -36,10 +36,13 @@ static mx_status_t fsck_minfs(const char* devicepath, const fsck_options_t* opti
 
     const char** argv = calloc(sizeof(char*), (2 + NUM_FSCK_OPTIONS));
     size_t argc = 0;
-    argv[argc++] = "/boot/bin/minfs";
+    argv[argc++] = binary;
     if (options->verbose) {
         argv[argc++] = "-v";
     }
+    if (options->progress) {
+        argv[argc++] = "-p";
+    }
     // TODO(smklein): Add support for modify, force flags. Without them,
     // we have "always_modify=true" and "force=true" effectively on by default.
     argv[argc++] = "fsck";
@@ -71,9 +74,11 @@ mx_status_t fsck(const char* devicepath, disk_format_t df,
                  const fsck_options_t* options, LaunchCallback cb) {
     switch (df) {
     case DISK_FORMAT_MINFS:
-        return fsck_minfs(devicepath, options, cb);
+        return fsck_mxfs("/boot/bin/minfs", devicepath, options, cb);
     case DISK_FORMAT_FAT:
         return fsck_fat(devicepath, options, cb);
+    case DISK_FORMAT_BLOBFS:
+        return fsck_mxfs("/boot/bin/blobstore", devicepath, options, cb);
     default:
         return ERR_NOT_SUPPORTED;
     }
@@ -47,15 +47,17 @@ typedef struct fsck_options {
     bool never_modify; // Fsck still looks for problems, but it does not try to resolve them.
     bool always_modify; // Fsck never asks to resolve problems; it assumes it should fix them.
     bool force; // Force fsck to check the filesystem integrity, even if it is marked as "clean".
+    bool progress; // Report how far along the check is, where the filesystem supports it.
 } fsck_options_t;
 
-#define NUM_FSCK_OPTIONS 3
+#define NUM_FSCK_OPTIONS 4
 
 static const fsck_options_t default_fsck_options = {
     .verbose = false,
     .never_modify = false,
     .always_modify = false,
     .force = false,
+    .progress = false,
 };
 
 typedef mx_status_t (*LaunchCallback)(int argc, const char** argv,
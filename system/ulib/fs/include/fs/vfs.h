@@ -8,18 +8,21 @@
 
 #include <mxio/remoteio.h>
 
+#include <limits.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <sys/types.h>
 
 #include <magenta/assert.h>
 #include <magenta/compiler.h>
+#include <magenta/device/vfs.h>
 #include <magenta/types.h>
 
 #include <mxio/dispatcher.h>
 #include <mxio/vfs.h>
 
 #ifdef __Fuchsia__
+#include <pthread.h>
 #include <threads.h>
 #include <mxio/io.h>
 #endif
@@ -77,17 +80,46 @@ public:
     ~VnodeWatcher();
 
     mx_handle_t h;
+
+    // vfs_watch_msg_t records not yet sent
+    uint8_t buf[VFS_WATCH_MSG_MAX];
+    size_t len;
+    // events were dropped; the next message starts with VFS_WATCH_EVT_OVERFLOW
+    bool overflow;
 };
 
-class WatcherContainer {
+// Events are coalesced: the first one after a quiet spell of VFS_WATCH_COALESCE
+// is sent at once, and those that follow it are batched into one message per
+// watcher, sent by a flusher thread once the spell is over or the batch fills.
+class WatcherContainer : public mxtl::DoublyLinkedListable<WatcherContainer*> {
 public:
+    WatcherContainer();
+    ~WatcherContainer();
+
     virtual mx_status_t WatchDir(mx_handle_t* out) final;
-    virtual void NotifyAdd(const char* name, size_t len) final;
+    // |event| is one of VFS_WATCH_EVT_*
+    virtual void Notify(const char* name, size_t len, unsigned event) final;
+
+    // For the flusher thread
+    void Flush();
+    mx_time_t deadline() const { return deadline_; }
+    void set_deadline(mx_time_t deadline) { deadline_ = deadline; }
+
 private:
+    void FlushLocked(mx_time_t now) __TA_REQUIRES(lock_);
+    bool SendLocked(VnodeWatcher* watcher) __TA_REQUIRES(lock_);
+
     mxtl::Mutex lock_;
     mxtl::DoublyLinkedList<mxtl::unique_ptr<VnodeWatcher>> watch_list_ __TA_GUARDED(lock_);
+    mx_time_t last_flush_ __TA_GUARDED(lock_);
+    // queued with the flusher thread
+    bool scheduled_ __TA_GUARDED(lock_);
+    // when the flusher thread is to call Flush(), under its lock
+    mx_time_t deadline_;
 };
 
+class LookupCache;
+
 #endif // __Fuchsia__
 
 // Helper class used to fill direntries during calls to Readdir.
@@ -95,11 +127,17 @@ class DirentFiller {
 public:
     DISALLOW_COPY_ASSIGN_AND_MOVE(DirentFiller);
 
-    DirentFiller(void* ptr, size_t len);
+    // With 'attrs', fills vdirent_plus_t records for ReaddirPlus instead.
+    DirentFiller(void* ptr, size_t len, bool attrs = false);
 
     // Attempts to add the name to the end of the dirent buffer
-    // which is returned by readdir.
-    mx_status_t Next(const char* name, size_t len, uint32_t type);
+    // which is returned by readdir. 'attr' is only used when filling
+    // vdirent_plus_t records, which get zeroed attributes without it.
+    mx_status_t Next(const char* name, size_t len, uint32_t type,
+                     const vnattr_t* attr = nullptr);
+
+    // Whether it's worth finding the attributes to pass to Next().
+    bool WantsAttrs() const { return attrs_; }
 
     mx_status_t BytesFilled() const {
         return static_cast<mx_status_t>(pos_);
@@ -109,6 +147,7 @@ private:
     char* ptr_;
     size_t pos_;
     const size_t len_;
+    const bool attrs_;
 };
 
 // The VFS interface declares a default abtract Vnode class with
@@ -140,7 +179,7 @@ public:
 #endif
 
     virtual mx_status_t WatchDir(mx_handle_t* out) { return ERR_NOT_SUPPORTED; }
-    virtual void NotifyAdd(const char* name, size_t len) {}
+    virtual void Notify(const char* name, size_t len, unsigned event) {}
 
     // Ensure that it is valid to open vn.
     virtual mx_status_t Open(uint32_t flags) = 0;
@@ -183,6 +222,12 @@ public:
         return ERR_NOT_SUPPORTED;
     }
 
+    // Like Readdir, but fills vdirent_plus_t records, which also hold the
+    // attributes of each entry. The default looks up and Getattrs every
+    // entry Readdir returns; filesystems which already have the attributes
+    // at hand while reading the directory should do better.
+    virtual mx_status_t ReaddirPlus(void* cookie, void* dirents, size_t len);
+
     // Create a new node under vn.
     // Name is len bytes long, and does not include a null terminator.
     // Mode specifies the type of entity to create.
@@ -241,6 +286,20 @@ public:
 
 #ifdef __Fuchsia__
     virtual mx_status_t AddDispatcher(mx_handle_t h, vfs_iostate_t* cookie);
+
+    // Filesystems which may be served by several threads at once return the
+    // lock guarding them here. vfs_handler holds it shared for messages which
+    // only read from the vnode (read, seek and stat), and exclusively for
+    // everything else; those reads must then tolerate running concurrently.
+    // Vnodes returning nullptr are served one message at a time, under a
+    // lock shared by every such filesystem in the process.
+    virtual pthread_rwlock_t* DispatchLock() { return nullptr; }
+
+    // Filesystems whose directories only change through the Vfs operations
+    // below (Open with O_CREAT, Unlink, Link and Rename) may return a cache
+    // here, shared by all their vnodes, to skip repeated Lookup() calls
+    // while walking paths. See LookupCache.
+    virtual LookupCache* GetLookupCache() { return nullptr; }
 #endif
 
     // Attaches a handle to the vnode, if possible. Otherwise, returns an error.
@@ -275,6 +334,44 @@ protected:
     uint32_t flags_;
 };
 
+#ifdef __Fuchsia__
+
+// Remembers the results of recent Vnode::Lookup() calls made by Vfs::Walk(),
+// keyed by directory vnode and name, so that opening the same deep paths
+// again doesn't search every directory along the way again. Entries hold references to both
+// vnodes, and the Vfs operations which remove or replace names drop the
+// entries for them. "." and ".." are never cached, since ".." changes when
+// a directory is renamed into another.
+class LookupCache {
+public:
+    LookupCache();
+    ~LookupCache();
+    DISALLOW_COPY_ASSIGN_AND_MOVE(LookupCache);
+
+    // Returns true and the cached child if there is an entry for the name.
+    bool Lookup(Vnode* dir, const char* name, size_t len, mxtl::RefPtr<Vnode>* out);
+    void Insert(mxtl::RefPtr<Vnode> dir, const char* name, size_t len, mxtl::RefPtr<Vnode> vn);
+    void Invalidate(Vnode* dir, const char* name, size_t len);
+
+private:
+    // Direct mapped: an insert simply replaces whatever hashed to its slot.
+    static constexpr size_t kNumEntries = 256;
+
+    struct Entry {
+        mxtl::RefPtr<Vnode> dir;
+        mxtl::RefPtr<Vnode> vn;
+        size_t len;
+        char name[NAME_MAX];
+    };
+
+    static size_t Hash(const Vnode* dir, const char* name, size_t len);
+
+    mxtl::Mutex lock_;
+    Entry entries_[kNumEntries] __TA_GUARDED(lock_);
+};
+
+#endif // __Fuchsia__
+
 struct Vfs {
     // Walk from vn --> out until either only one path segment remains or we
     // encounter a remote filesystem.
@@ -16,6 +16,7 @@ MODULE_SRCS += \
     $(LOCAL_DIR)/vfs-rpc.cpp \
     $(LOCAL_DIR)/vfs-dispatcher.cpp \
     $(LOCAL_DIR)/vfs-watcher.cpp \
+    $(LOCAL_DIR)/vfs-lookup-cache.cpp \
 
 MODULE_STATIC_LIBS := \
     system/ulib/mxcpp \
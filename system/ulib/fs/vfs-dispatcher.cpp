@@ -24,12 +24,18 @@
 
 #define MXDEBUG 0
 
-// ** NOTE -- this prototype multithreaded dispatcher is only used by
-// ** minfs as part of ongoing multithread development. Not yet safe
-// ** for general consumption
+// A pool of worker threads serving handles from one port. Each handle is
+// armed with a one-shot wait, and only re-armed once its messages have been
+// handled, so any one connection is served by a single thread at a time while
+// separate connections are spread across the pool. Anything shared between
+// connections (the vnodes, and the filesystem behind them) must be locked by
+// the callback; vfs_handler does so through Vnode::DispatchLock.
 
 namespace fs {
 
+// Packets carrying this key come from the shutdown event rather than a handler
+constexpr uint64_t kShutdownKey = 0;
+
 Handler::~Handler() {
     Close();
 }
@@ -95,9 +101,11 @@ VfsDispatcher::~VfsDispatcher() {
         printf("mxio_dispatcher_destroy: error closing dispatcher port: %d\n", status);
     }
 
-    // delete handlers
+    // disconnect the handlers which are still open, so their owners release
+    // whatever they hold for them
     Handler* h;
     while ((h = handlers_.pop_front()) != nullptr) {
+        DisconnectHandler(h, true);
         delete h;
     }
 }
@@ -136,9 +144,9 @@ int VfsDispatcher::Loop() {
 
         xprintf("port_wait: thread %s \n", tname);
 
-        if ((packet.signal.observed & MX_EVENT_SIGNALED) != 0) {
+        if (packet.key == kShutdownKey) {
             // reset for the next thread
-            r = mx_object_wait_async(shutdown_event_, ioport_, 0u,
+            r = mx_object_wait_async(shutdown_event_, ioport_, kShutdownKey,
                                      MX_EVENT_SIGNALED,
                                      MX_WAIT_ASYNC_ONCE);
             if (r != NO_ERROR) {
@@ -202,7 +210,7 @@ mx_status_t VfsDispatcher::Create(mxio_dispatcher_cb_t cb, uint32_t pool_size) {
         mx_handle_close(ioport_);
         return status;
     }
-    status = mx_object_wait_async(shutdown_event_, ioport_, 0u,
+    status = mx_object_wait_async(shutdown_event_, ioport_, kShutdownKey,
                                   MX_EVENT_SIGNALED,
                                   MX_WAIT_ASYNC_ONCE);
     if (status != NO_ERROR) {
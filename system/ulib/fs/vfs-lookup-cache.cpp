@@ -0,0 +1,79 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <fs/vfs.h>
+#include <mxtl/auto_lock.h>
+
+namespace fs {
+
+LookupCache::LookupCache() {
+    for (auto& e : entries_) {
+        e.len = 0;
+    }
+}
+
+LookupCache::~LookupCache() = default;
+
+// static
+size_t LookupCache::Hash(const Vnode* dir, const char* name, size_t len) {
+    // FNV-1a over the name, seeded with the directory.
+    uint64_t h = 14695981039346656037ull ^ reinterpret_cast<uintptr_t>(dir);
+    for (size_t i = 0; i < len; i++) {
+        h ^= static_cast<uint8_t>(name[i]);
+        h *= 1099511628211ull;
+    }
+    return static_cast<size_t>(h % kNumEntries);
+}
+
+bool LookupCache::Lookup(Vnode* dir, const char* name, size_t len, mxtl::RefPtr<Vnode>* out) {
+    mxtl::AutoLock lock(&lock_);
+    const Entry& e = entries_[Hash(dir, name, len)];
+    if (e.dir.get() != dir || e.len != len || memcmp(e.name, name, len)) {
+        return false;
+    }
+    *out = e.vn;
+    return true;
+}
+
+void LookupCache::Insert(mxtl::RefPtr<Vnode> dir, const char* name, size_t len,
+                         mxtl::RefPtr<Vnode> vn) {
+    if (len > NAME_MAX || (len == 1 && name[0] == '.') ||
+        (len == 2 && name[0] == '.' && name[1] == '.')) {
+        return;
+    }
+    mxtl::RefPtr<Vnode> old_dir;
+    mxtl::RefPtr<Vnode> old_vn;
+    {
+        mxtl::AutoLock lock(&lock_);
+        Entry& e = entries_[Hash(dir.get(), name, len)];
+        // Release the evicted vnodes after dropping the lock, since that
+        // may run their destructors.
+        old_dir = mxtl::move(e.dir);
+        old_vn = mxtl::move(e.vn);
+        e.dir = mxtl::move(dir);
+        e.vn = mxtl::move(vn);
+        e.len = len;
+        memcpy(e.name, name, len);
+    }
+}
+
+void LookupCache::Invalidate(Vnode* dir, const char* name, size_t len) {
+    mxtl::RefPtr<Vnode> old_dir;
+    mxtl::RefPtr<Vnode> old_vn;
+    {
+        mxtl::AutoLock lock(&lock_);
+        Entry& e = entries_[Hash(dir, name, len)];
+        if (e.dir.get() != dir || e.len != len || memcmp(e.name, name, len)) {
+            return;
+        }
+        old_dir = mxtl::move(e.dir);
+        old_vn = mxtl::move(e.vn);
+        e.len = 0;
+    }
+}
+
+} // namespace fs
@@ -4,6 +4,7 @@
 
 #include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -341,7 +342,8 @@ mx_status_t vfs_handler_vn(mxrio_msg_t* msg, mx_handle_t rh, mxtl::RefPtr<Vnode>
         mx_status_t r = vn->Setattr((vnattr_t*)msg->data);
         return r;
     }
-    case MXRIO_READDIR: {
+    case MXRIO_READDIR:
+    case MXRIO_READDIR_PLUS: {
         if (arg > MXIO_CHUNK_SIZE) {
             return ERR_INVALID_ARGS;
         }
@@ -351,7 +353,11 @@ mx_status_t vfs_handler_vn(mxrio_msg_t* msg, mx_handle_t rh, mxtl::RefPtr<Vnode>
         mx_status_t r;
         {
             mxtl::AutoLock lock(&vfs_lock);
-            r = vn->Readdir(&ios->dircookie, msg->data, arg);
+            if (MXRIO_OP(msg->op) == MXRIO_READDIR) {
+                r = vn->Readdir(&ios->dircookie, msg->data, arg);
+            } else {
+                r = vn->ReaddirPlus(&ios->dircookie, msg->data, arg);
+            }
         }
         if (r >= 0) {
             msg->datalen = r;
@@ -509,16 +515,42 @@ mx_status_t vfs_handler_vn(mxrio_msg_t* msg, mx_handle_t rh, mxtl::RefPtr<Vnode>
     }
 }
 
-// TODO(orr): temporary; prevent multithread weirdness while we
-// make locking more fine grained
+// Serializes messages to filesystems which don't provide a DispatchLock
 static mtx_t vfs_big_lock = MTX_INIT;
 
+// Messages which leave the vnode untouched, and may be dispatched alongside
+// one another under a shared DispatchLock
+static bool vfs_message_is_read(const mxrio_msg_t* msg) {
+    switch (MXRIO_OP(msg->op)) {
+    case MXRIO_READ:
+    case MXRIO_READ_AT:
+    case MXRIO_SEEK:
+    case MXRIO_STAT:
+        return true;
+    default:
+        return false;
+    }
+}
+
 mx_status_t vfs_handler(mxrio_msg_t* msg, mx_handle_t rh, void* cookie) {
     vfs_iostate_t* ios = static_cast<vfs_iostate_t*>(cookie);
 
-    mxtl::AutoLock lock(&vfs_big_lock);
+    // The dispatcher hands each connection to one thread at a time, so 'ios'
+    // itself needs no locking
     mxtl::RefPtr<Vnode> vn = ios->vn;
+    pthread_rwlock_t* fs_lock = vn->DispatchLock();
+    if (fs_lock == nullptr) {
+        mxtl::AutoLock lock(&vfs_big_lock);
+        return vfs_handler_vn(msg, rh, mxtl::move(vn), ios);
+    }
+
+    if (vfs_message_is_read(msg)) {
+        pthread_rwlock_rdlock(fs_lock);
+    } else {
+        pthread_rwlock_wrlock(fs_lock);
+    }
     mx_status_t status = vfs_handler_vn(msg, rh, mxtl::move(vn), ios);
+    pthread_rwlock_unlock(fs_lock);
     return status;
 }
 
@@ -9,6 +9,7 @@
 #include <unistd.h>
 
 #ifdef __Fuchsia__
+#include <threads.h>
 #include <magenta/syscalls.h>
 #include <mxtl/auto_lock.h>
 #endif
@@ -16,9 +17,83 @@
 #include <fs/vfs.h>
 #include <magenta/new.h>
 
+// How long events are held back to be sent together
+#define VFS_WATCH_COALESCE MX_MSEC(5)
+
 namespace fs {
+namespace {
+
+// One thread flushes the batches of every WatcherContainer in the process.
+// A container's lock_ may be held while taking flush_lock, never the other way.
+mtx_t flush_lock = MTX_INIT;
+cnd_t flush_work = CND_INIT;
+cnd_t flush_done = CND_INIT;
+bool flusher_started;
+// containers with a batch pending, and the one being flushed
+mxtl::DoublyLinkedList<WatcherContainer*> flush_list;
+WatcherContainer* flushing;
 
-VnodeWatcher::VnodeWatcher() : h(MX_HANDLE_INVALID) {}
+int WatchFlusher(void* arg) {
+    mtx_lock(&flush_lock);
+    for (;;) {
+        if (flush_list.is_empty()) {
+            cnd_wait(&flush_work, &flush_lock);
+            continue;
+        }
+        mx_time_t now = mx_time_get(MX_CLOCK_MONOTONIC);
+        mx_time_t next = MX_TIME_INFINITE;
+        WatcherContainer* due = nullptr;
+        for (auto& c : flush_list) {
+            if (c.deadline() <= now) {
+                due = &c;
+                break;
+            }
+            if (c.deadline() < next) {
+                next = c.deadline();
+            }
+        }
+        if (due == nullptr) {
+            // Deadlines are never more than VFS_WATCH_COALESCE away, so a
+            // container scheduled meanwhile waits at most that much longer.
+            mtx_unlock(&flush_lock);
+            mx_nanosleep(next);
+            mtx_lock(&flush_lock);
+            continue;
+        }
+        flush_list.erase(*due);
+        flushing = due;
+        mtx_unlock(&flush_lock);
+        due->Flush();
+        mtx_lock(&flush_lock);
+        flushing = nullptr;
+        cnd_broadcast(&flush_done);
+    }
+    return 0;
+}
+
+// Has the flusher thread call c->Flush() at |deadline|. Fails only if the
+// thread can't be started.
+bool ScheduleFlush(WatcherContainer* c, mx_time_t deadline) {
+    mtx_lock(&flush_lock);
+    if (!flusher_started) {
+        thrd_t t;
+        if (thrd_create_with_name(&t, WatchFlusher, nullptr, "vfs-watch-flusher") != thrd_success) {
+            mtx_unlock(&flush_lock);
+            return false;
+        }
+        thrd_detach(t);
+        flusher_started = true;
+    }
+    c->set_deadline(deadline);
+    flush_list.push_back(c);
+    cnd_signal(&flush_work);
+    mtx_unlock(&flush_lock);
+    return true;
+}
+
+} // namespace
+
+VnodeWatcher::VnodeWatcher() : h(MX_HANDLE_INVALID), len(0), overflow(false) {}
 
 VnodeWatcher::~VnodeWatcher() {
     if (h != MX_HANDLE_INVALID) {
@@ -26,6 +101,19 @@ VnodeWatcher::~VnodeWatcher() {
     }
 }
 
+WatcherContainer::WatcherContainer() : last_flush_(0), scheduled_(false), deadline_(0) {}
+
+WatcherContainer::~WatcherContainer() {
+    mtx_lock(&flush_lock);
+    while (flushing == this) {
+        cnd_wait(&flush_done, &flush_lock);
+    }
+    if (InContainer()) {
+        flush_list.erase(*this);
+    }
+    mtx_unlock(&flush_lock);
+}
+
 mx_status_t WatcherContainer::WatchDir(mx_handle_t* out) {
     AllocChecker ac;
     mxtl::unique_ptr<VnodeWatcher> watcher(new (&ac) VnodeWatcher);
@@ -40,20 +128,93 @@ mx_status_t WatcherContainer::WatchDir(mx_handle_t* out) {
     return NO_ERROR;
 }
 
-void WatcherContainer::NotifyAdd(const char* name, size_t len) {
+// Sends what |watcher| has queued. Returns false if the watcher is to be
+// removed.
+bool WatcherContainer::SendLocked(VnodeWatcher* watcher) {
+    if (watcher->overflow) {
+        // Whatever was queued since the overflow, the rescan will find
+        vfs_watch_msg_t* msg = reinterpret_cast<vfs_watch_msg_t*>(watcher->buf);
+        msg->event = VFS_WATCH_EVT_OVERFLOW;
+        msg->len = 0;
+        watcher->len = sizeof(*msg);
+    } else if (watcher->len == 0) {
+        return true;
+    }
+    mx_status_t status = mx_channel_write(watcher->h, 0, watcher->buf,
+                                          static_cast<uint32_t>(watcher->len),
+                                          nullptr, 0);
+    watcher->len = 0;
+    if (status == ERR_NO_MEMORY || status == ERR_SHOULD_WAIT) {
+        // The reader can't keep up; drop events until it can take the
+        // overflow marker.
+        watcher->overflow = true;
+        return true;
+    }
+    if (status < 0) {
+        // Lazily remove watchers when their handles cannot accept incoming
+        // watch messages.
+        return false;
+    }
+    watcher->overflow = false;
+    return true;
+}
+
+void WatcherContainer::FlushLocked(mx_time_t now) {
+    last_flush_ = now;
+    bool behind = false;
+    for (auto it = watch_list_.begin(); it != watch_list_.end();) {
+        auto cur = it++;
+        if (!SendLocked(&*cur)) {
+            watch_list_.erase(cur);
+        } else if (cur->overflow) {
+            behind = true;
+        }
+    }
+    // Retry the overflow markers that didn't go out, even if no other event
+    // comes along to trigger a flush.
+    if (behind && !scheduled_) {
+        scheduled_ = ScheduleFlush(this, now + VFS_WATCH_COALESCE);
+    }
+}
+
+void WatcherContainer::Flush() {
     mxtl::AutoLock lock(&lock_);
+    scheduled_ = false;
+    FlushLocked(mx_time_get(MX_CLOCK_MONOTONIC));
+}
+
+void WatcherContainer::Notify(const char* name, size_t len, unsigned event) {
+    mxtl::AutoLock lock(&lock_);
+    if (watch_list_.is_empty()) {
+        return;
+    }
+    size_t rec_len = sizeof(vfs_watch_msg_t) + len;
     for (auto it = watch_list_.begin(); it != watch_list_.end();) {
-        mx_status_t status = mx_channel_write(it->h, 0, name,
-                                              static_cast<uint32_t>(len),
-                                              nullptr, 0);
-        if (status < 0) {
-            // Lazily remove watchers when their handles cannot accept incoming
-            // watch messages.
-            auto to_remove = it;
-            ++it;
-            watch_list_.erase(to_remove);
-        } else {
-            ++it;
+        auto cur = it++;
+        if (cur->len + rec_len > sizeof(cur->buf) && !SendLocked(&*cur)) {
+            watch_list_.erase(cur);
+            continue;
+        }
+        if (cur->overflow || len > UINT8_MAX) {
+            cur->overflow = true;
+            continue;
+        }
+        vfs_watch_msg_t* msg = reinterpret_cast<vfs_watch_msg_t*>(cur->buf + cur->len);
+        msg->event = static_cast<uint8_t>(event);
+        msg->len = static_cast<uint8_t>(len);
+        memcpy(msg->name, name, len);
+        cur->len += rec_len;
+    }
+
+    // The first event after a quiet spell goes out at once; later ones wait
+    // for the rest of the coalescing window.
+    mx_time_t now = mx_time_get(MX_CLOCK_MONOTONIC);
+    if (now - last_flush_ >= VFS_WATCH_COALESCE) {
+        FlushLocked(now);
+    } else if (!scheduled_) {
+        scheduled_ = ScheduleFlush(this, last_flush_ + VFS_WATCH_COALESCE);
+        if (!scheduled_) {
+            FlushLocked(now);
         }
     }
 }
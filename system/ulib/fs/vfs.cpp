@@ -3,12 +3,14 @@
 // found in the LICENSE file.
 
 #include <fcntl.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <mxio/dispatcher.h>
 #include <mxio/remoteio.h>
+#include <mxtl/algorithm.h>
 #include <mxtl/auto_call.h>
 
 #ifdef __Fuchsia__
@@ -51,6 +53,42 @@ mx_status_t vfs_name_trim(const char* name, size_t len, size_t* len_out, bool* d
     return NO_ERROR;
 }
 
+// Lookup() through the directory's LookupCache, if its filesystem has one.
+// Only used for the directories a path passes through, so that the cache
+// doesn't keep the files at the ends of paths (and their contents) around.
+mx_status_t vfs_lookup(mxtl::RefPtr<Vnode> vndir, mxtl::RefPtr<Vnode>* out,
+                       const char* name, size_t len) {
+#ifdef __Fuchsia__
+    LookupCache* cache = vndir->GetLookupCache();
+    if (cache == nullptr) {
+        return vndir->Lookup(out, name, len);
+    }
+    if (cache->Lookup(vndir.get(), name, len, out)) {
+        return NO_ERROR;
+    }
+    mxtl::RefPtr<Vnode> vn;
+    mx_status_t r = vndir->Lookup(&vn, name, len);
+    if (r < 0) {
+        return r;
+    }
+    cache->Insert(mxtl::move(vndir), name, len, vn);
+    *out = mxtl::move(vn);
+    return r;
+#else
+    return vndir->Lookup(out, name, len);
+#endif
+}
+
+// Forget a name which has been removed or replaced.
+void vfs_lookup_invalidate(Vnode* vndir, const char* name, size_t len) {
+#ifdef __Fuchsia__
+    LookupCache* cache = vndir->GetLookupCache();
+    if (cache != nullptr) {
+        cache->Invalidate(vndir, name, len);
+    }
+#endif
+}
+
 } // namespace anonymous
 
 bool RemoteContainer::IsRemote() const {
@@ -132,7 +170,7 @@ mx_status_t Vfs::Open(mxtl::RefPtr<Vnode> vndir, mxtl::RefPtr<Vnode>* out, const
             }
             return r;
         }
-        vndir->NotifyAdd(path, len);
+        vndir->Notify(path, len, VFS_WATCH_EVT_ADDED);
     } else {
     try_open:
         r = vndir->Lookup(&vn, path, len);
@@ -158,8 +196,11 @@ mx_status_t Vfs::Open(mxtl::RefPtr<Vnode> vndir, mxtl::RefPtr<Vnode>* out, const
             r = vn->GetRemote();
             return r;
         }
-        if ((flags & O_TRUNC) && ((r = vn->Truncate(0)) < 0)) {
-            return r;
+        if (flags & O_TRUNC) {
+            if ((r = vn->Truncate(0)) < 0) {
+                return r;
+            }
+            vndir->Notify(path, len, VFS_WATCH_EVT_MODIFIED);
         }
     }
     trace(VFS, "VfsOpen: vn=%p\n", vn.get());
@@ -174,7 +215,14 @@ mx_status_t Vfs::Unlink(mxtl::RefPtr<Vnode> vndir, const char* path, size_t len)
     if ((r = vfs_name_trim(path, len, &len, &must_be_dir)) != NO_ERROR) {
         return r;
     }
-    return vndir->Unlink(path, len, must_be_dir);
+    r = vndir->Unlink(path, len, must_be_dir);
+    // Even a failed unlink may have got partway.
+    vfs_lookup_invalidate(vndir.get(), path, len);
+    if (r != NO_ERROR) {
+        return r;
+    }
+    vndir->Notify(path, len, VFS_WATCH_EVT_REMOVED);
+    return NO_ERROR;
 }
 
 mx_status_t Vfs::Link(mxtl::RefPtr<Vnode> oldparent, mxtl::RefPtr<Vnode> newparent,
@@ -206,7 +254,7 @@ mx_status_t Vfs::Link(mxtl::RefPtr<Vnode> oldparent, mxtl::RefPtr<Vnode> newpare
     if (r != NO_ERROR) {
         return r;
     }
-    newparent->NotifyAdd(newname, newlen);
+    newparent->Notify(newname, newlen, VFS_WATCH_EVT_ADDED);
     return NO_ERROR;
 }
 
@@ -226,10 +274,14 @@ mx_status_t Vfs::Rename(mxtl::RefPtr<Vnode> oldparent, mxtl::RefPtr<Vnode> newpa
     }
     r = oldparent->Rename(newparent, oldname, oldlen, newname, newlen,
                           old_must_be_dir, new_must_be_dir);
+    // The old name goes away, and a vnode already at the new name is replaced.
+    vfs_lookup_invalidate(oldparent.get(), oldname, oldlen);
+    vfs_lookup_invalidate(newparent.get(), newname, newlen);
     if (r != NO_ERROR) {
         return r;
     }
-    newparent->NotifyAdd(newname, newlen);
+    oldparent->Notify(oldname, oldlen, VFS_WATCH_EVT_REMOVED);
+    newparent->Notify(newname, newlen, VFS_WATCH_EVT_ADDED);
     return NO_ERROR;
 }
 
@@ -336,10 +388,31 @@ mx_status_t Vnode::Close() {
     return NO_ERROR;
 }
 
-DirentFiller::DirentFiller(void* ptr, size_t len) :
-    ptr_(static_cast<char*>(ptr)), pos_(0), len_(len) {}
+DirentFiller::DirentFiller(void* ptr, size_t len, bool attrs) :
+    ptr_(static_cast<char*>(ptr)), pos_(0), len_(len), attrs_(attrs) {}
+
+mx_status_t DirentFiller::Next(const char* name, size_t len, uint32_t type,
+                               const vnattr_t* attr) {
+    if (attrs_) {
+        vdirent_plus_t* de = reinterpret_cast<vdirent_plus_t*>(ptr_ + pos_);
+        // round up to uint64 aligned, for the attributes
+        size_t sz = (sizeof(vdirent_plus_t) + len + 1 + 7) & ~7;
+        if (sz > len_ - pos_) {
+            return ERR_INVALID_ARGS;
+        }
+        de->size = static_cast<uint32_t>(sz);
+        de->type = type;
+        if (attr != nullptr) {
+            de->attr = *attr;
+        } else {
+            memset(&de->attr, 0, sizeof(de->attr));
+        }
+        memcpy(de->name, name, len);
+        de->name[len] = 0;
+        pos_ += sz;
+        return NO_ERROR;
+    }
 
-mx_status_t DirentFiller::Next(const char* name, size_t len, uint32_t type) {
     vdirent_t* de = reinterpret_cast<vdirent_t*>(ptr_ + pos_);
     size_t sz = sizeof(vdirent_t) + len + 1;
 
@@ -358,6 +431,44 @@ mx_status_t DirentFiller::Next(const char* name, size_t len, uint32_t type) {
     return NO_ERROR;
 }
 
+mx_status_t Vnode::ReaddirPlus(void* cookie, void* dirents, size_t len) {
+    // Each vdirent grows by at most this much as a vdirent_plus, and the
+    // smallest vdirent is 12 bytes; so Readdir into a sixth of the space
+    // left always fits. Keep going until the directory or the space runs out.
+    constexpr size_t kGrowth = sizeof(vdirent_plus_t) - sizeof(vdirent_t) + 4;
+    static_assert(kGrowth <= 5 * 12, "vdirent_plus_t outgrew the Readdir split");
+    char names[MXIO_CHUNK_SIZE / 6];
+    DirentFiller df(dirents, len, true);
+    for (;;) {
+        size_t filled = static_cast<size_t>(df.BytesFilled());
+        size_t space = mxtl::min((len - filled) / 6, sizeof(names));
+        if (space < sizeof(vdirent_t) + NAME_MAX + 1) {
+            break;
+        }
+        mx_status_t r = Readdir(cookie, names, space);
+        if (r < 0) {
+            return df.BytesFilled() > 0 ? df.BytesFilled() : r;
+        } else if (r == 0) {
+            break;
+        }
+        for (size_t off = 0; off < static_cast<size_t>(r);) {
+            vdirent_t* de = reinterpret_cast<vdirent_t*>(names + off);
+            size_t namelen = strlen(de->name);
+            vnattr_t attr;
+            mxtl::RefPtr<Vnode> vn;
+            if (Lookup(&vn, de->name, namelen) != NO_ERROR || vn == nullptr ||
+                vn->Getattr(&attr) != NO_ERROR) {
+                attr.mode = 0;
+            }
+            mx_status_t status = df.Next(de->name, namelen, de->type,
+                                         attr.mode != 0 ? &attr : nullptr);
+            MX_DEBUG_ASSERT(status == NO_ERROR);
+            off += de->size;
+        }
+    }
+    return df.BytesFilled();
+}
+
 // Starting at vnode vn, walk the tree described by the path string,
 // until either there is only one path segment remaining in the string
 // or we encounter a vnode that represents a remote filesystem
@@ -405,7 +516,7 @@ mx_status_t Vfs::Walk(mxtl::RefPtr<Vnode> vn, mxtl::RefPtr<Vnode>* out,
             // traverse to the next segment
             size_t len = nextpath - path;
             nextpath++;
-            r = vn->Lookup(&vn, path, len);
+            r = vfs_lookup(vn, &vn, path, len);
             assert(r <= 0);
             if (r < 0) {
                 return r;
@@ -183,10 +183,11 @@ static void FUNC(gfx_surface* surface, const gfx_font* font, unsigned ch, unsign
     TYPE* dest = &((TYPE*)surface->ptr)[x + y * surface->stride]; \
     const uint16_t* cdata = font->data + ch * font->height; \
     unsigned fw = font->width; \
+    const TYPE colors[2] = { (TYPE)bg, (TYPE)fg }; \
     for (unsigned i = font->height; i > 0; i--) { \
         uint16_t xdata = *cdata++; \
         for (unsigned j = fw; j > 0; j--) { \
-            *dest++ = (xdata & 1) ? fg : bg; \
+            *dest++ = colors[xdata & 1]; \
             xdata >>= 1; \
         } \
         dest += (surface->stride - fw); \
@@ -214,154 +215,62 @@ void gfx_putchar(gfx_surface* surface, const gfx_font* font, unsigned ch, unsign
     surface->putchar(surface, font, ch, x, y, fg, bg);
 }
 
-static void copyrect8(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned x2, unsigned y2) {
-    // copy
-    const uint8_t* src = &((const uint8_t*)surface->ptr)[x + y * surface->stride];
-    uint8_t* dest = &((uint8_t*)surface->ptr)[x2 + y2 * surface->stride];
-    unsigned stride_diff = surface->stride - width;
-
-    if (dest < src) {
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest++;
-                src++;
-            }
-            dest += stride_diff;
-            src += stride_diff;
-        }
-    } else {
-        // copy backwards
-        src += (height-1) * surface->stride + (width-1);
-        dest += (height-1) * surface->stride + (width-1);
-
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest--;
-                src--;
-            }
-            dest -= stride_diff;
-            src -= stride_diff;
-        }
-    }
-}
-
-static void fillrect8(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned color) {
-    uint8_t* dest = &((uint8_t*)surface->ptr)[x + y * surface->stride];
-    unsigned stride_diff = surface->stride - width;
-
-    uint8_t color8 = (uint8_t)(surface->translate_color(color));
-
-    unsigned i, j;
-    for (i = 0; i < height; i++) {
-        for (j = 0; j < width; j++) {
-            *dest = color8;
-            dest++;
-        }
-        dest += stride_diff;
-    }
-}
-
-static void copyrect16(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned x2, unsigned y2) {
-    // copy
-    const uint16_t* src = &((const uint16_t*)surface->ptr)[x + y * surface->stride];
-    uint16_t* dest = &((uint16_t*)surface->ptr)[x2 + y2 * surface->stride];
-    unsigned stride_diff = surface->stride - width;
-
-    if (dest < src) {
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest++;
-                src++;
-            }
-            dest += stride_diff;
-            src += stride_diff;
+// Copies whole rows with memmove(), which handles the overlap within a row, walking the
+// rows in whichever direction keeps them from overlapping each other.  This is the same
+// for every pixel size.
+static void copyrect(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned x2, unsigned y2) {
+    size_t pitch = surface->stride * surface->pixelsize;
+    size_t len = width * surface->pixelsize;
+    const uint8_t* src = (const uint8_t*)surface->ptr + x * surface->pixelsize + y * pitch;
+    uint8_t* dest = (uint8_t*)surface->ptr + x2 * surface->pixelsize + y2 * pitch;
+
+    if (len == pitch) {
+        // full rows are one contiguous run
+        memmove(dest, src, len * height);
+    } else if (dest < src) {
+        for (unsigned i = 0; i < height; i++) {
+            memmove(dest, src, len);
+            dest += pitch;
+            src += pitch;
         }
     } else {
         // copy backwards
-        src += (height-1) * surface->stride + (width-1);
-        dest += (height-1) * surface->stride + (width-1);
-
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest--;
-                src--;
-            }
-            dest -= stride_diff;
-            src -= stride_diff;
+        src += (height - 1) * pitch;
+        dest += (height - 1) * pitch;
+        for (unsigned i = 0; i < height; i++) {
+            memmove(dest, src, len);
+            dest -= pitch;
+            src -= pitch;
         }
     }
 }
 
-static void fillrect16(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned color) {
-    uint16_t* dest = &((uint16_t*)surface->ptr)[x + y * surface->stride];
-    unsigned stride_diff = surface->stride - width;
-
-    uint16_t color16 = (uint16_t)(surface->translate_color(color));
-
-    unsigned i, j;
-    for (i = 0; i < height; i++) {
-        for (j = 0; j < width; j++) {
-            *dest = color16;
-            dest++;
-        }
-        dest += stride_diff;
-    }
+// Fills the first row a pixel at a time and copies it to the rest, so most of the
+// work happens in memcpy().
+#define MKFILLRECT(FUNC,TYPE,COLOR) \
+static void FUNC(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned color) { \
+    TYPE* first = &((TYPE*)surface->ptr)[x + y * surface->stride]; \
+    TYPE value = (TYPE)(COLOR); \
+    for (unsigned j = 0; j < width; j++) { \
+        first[j] = value; \
+    } \
+    TYPE* dest = first + surface->stride; \
+    for (unsigned i = 1; i < height; i++) { \
+        memcpy(dest, first, width * sizeof(TYPE)); \
+        dest += surface->stride; \
+    } \
 }
 
-static void copyrect32(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned x2, unsigned y2) {
-    // copy
-    const uint32_t* src = &((const uint32_t*)surface->ptr)[x + y * surface->stride];
-    uint32_t* dest = &((uint32_t*)surface->ptr)[x2 + y2 * surface->stride];
-    unsigned stride_diff = surface->stride - width;
-
-    if (dest < src) {
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest++;
-                src++;
-            }
-            dest += stride_diff;
-            src += stride_diff;
-        }
-    } else {
-        // copy backwards
-        src += (height-1) * surface->stride + (width-1);
-        dest += (height-1) * surface->stride + (width-1);
-
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest--;
-                src--;
-            }
-            dest -= stride_diff;
-            src -= stride_diff;
-        }
-    }
-}
+MKFILLRECT(fillrect16, uint16_t, surface->translate_color(color))
+MKFILLRECT(fillrect32, uint32_t, color)
 
-static void fillrect32(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned color) {
-    uint32_t* dest = &((uint32_t*)surface->ptr)[x + y * surface->stride];
-    unsigned stride_diff = surface->stride - width;
+static void fillrect8(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned color) {
+    uint8_t* dest = &((uint8_t*)surface->ptr)[x + y * surface->stride];
+    uint8_t color8 = (uint8_t)(surface->translate_color(color));
 
-    unsigned i, j;
-    for (i = 0; i < height; i++) {
-        for (j = 0; j < width; j++) {
-            *dest = color;
-            dest++;
-        }
-        dest += stride_diff;
+    for (unsigned i = 0; i < height; i++) {
+        memset(dest, color8, width);
+        dest += surface->stride;
     }
 }
 
@@ -644,7 +553,7 @@ int gfx_init_surface(gfx_surface* surface, void* ptr, unsigned width, unsigned h
     switch (format) {
     case MX_PIXEL_FORMAT_RGB_565:
         surface->translate_color = &ARGB8888_to_RGB565;
-        surface->copyrect = &copyrect16;
+        surface->copyrect = &copyrect;
         surface->fillrect = &fillrect16;
         surface->putpixel = &putpixel16;
         surface->putchar = &putchar16;
@@ -654,7 +563,7 @@ int gfx_init_surface(gfx_surface* surface, void* ptr, unsigned width, unsigned h
     case MX_PIXEL_FORMAT_RGB_x888:
     case MX_PIXEL_FORMAT_ARGB_8888:
         surface->translate_color = NULL;
-        surface->copyrect = &copyrect32;
+        surface->copyrect = &copyrect;
         surface->fillrect = &fillrect32;
         surface->putpixel = &putpixel32;
         surface->putchar = &putchar32;
@@ -663,7 +572,7 @@ int gfx_init_surface(gfx_surface* surface, void* ptr, unsigned width, unsigned h
         break;
     case MX_PIXEL_FORMAT_MONO_1:
         surface->translate_color = &ARGB8888_to_Luma;
-        surface->copyrect = &copyrect8;
+        surface->copyrect = &copyrect;
         surface->fillrect = &fillrect8;
         surface->putpixel = &putpixel8;
         surface->putchar = &putchar8;
@@ -672,7 +581,7 @@ int gfx_init_surface(gfx_surface* surface, void* ptr, unsigned width, unsigned h
         break;
     case MX_PIXEL_FORMAT_RGB_332:
         surface->translate_color = &ARGB8888_to_RGB332;
-        surface->copyrect = &copyrect8;
+        surface->copyrect = &copyrect;
         surface->fillrect = &fillrect8;
         surface->putpixel = &putpixel8;
         surface->putchar = &putchar8;
@@ -681,7 +590,7 @@ int gfx_init_surface(gfx_surface* surface, void* ptr, unsigned width, unsigned h
         break;
     case MX_PIXEL_FORMAT_RGB_2220:
         surface->translate_color = &ARGB8888_to_RGB2220;
-        surface->copyrect = &copyrect8;
+        surface->copyrect = &copyrect;
         surface->fillrect = &fillrect8;
         surface->putpixel = &putpixel8;
         surface->putchar = &putchar8;
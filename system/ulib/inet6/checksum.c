@@ -0,0 +1,211 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <inet6/checksum.h>
+
+// Every implementation adds up 32 bit words into 64 bit accumulators,
+// which can't overflow for any buffer we could hold, and folds at the
+// end.  As 2^16 == 1 in one's-complement arithmetic mod 2^16 - 1, that
+// gives the same result as adding 16 bit words one at a time.
+
+static uint16_t fold64(uint64_t sum) {
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return sum;
+}
+
+// The bytes that don't make a whole 32 bit word.
+static uint64_t sum_tail(const uint8_t* data, size_t len) {
+    uint64_t sum = 0;
+    uint16_t word;
+    if (len >= 2) {
+        memcpy(&word, data, 2);
+        sum += word;
+        data += 2;
+        len -= 2;
+    }
+    if (len) {
+        // an odd byte is the first half of a word whose second is zero
+        word = 0;
+        memcpy(&word, data, 1);
+        sum += word;
+    }
+    return sum;
+}
+
+static uint16_t checksum_scalar(const void* _data, size_t len, uint16_t _sum) {
+    const uint8_t* data = _data;
+    uint64_t sum0 = _sum;
+    uint64_t sum1 = 0;
+    uint32_t word[4];
+    while (len >= 16) {
+        memcpy(word, data, 16);
+        sum0 += word[0];
+        sum1 += word[1];
+        sum0 += word[2];
+        sum1 += word[3];
+        data += 16;
+        len -= 16;
+    }
+    while (len >= 4) {
+        memcpy(word, data, 4);
+        sum0 += word[0];
+        data += 4;
+        len -= 4;
+    }
+    return fold64(sum0 + sum1 + sum_tail(data, len));
+}
+
+#if defined(__x86_64__)
+
+// SSE2 is always there on x86-64.
+static uint16_t checksum_sse2(const void* _data, size_t len, uint16_t sum) {
+    const uint8_t* data = _data;
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc0 = _mm_setzero_si128();
+    __m128i acc1 = _mm_setzero_si128();
+    while (len >= 32) {
+        __m128i a = _mm_loadu_si128((const __m128i*)data);
+        __m128i b = _mm_loadu_si128((const __m128i*)(data + 16));
+        // widen each 32 bit word to 64 bits and accumulate
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(a, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(a, zero));
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(b, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(b, zero));
+        data += 32;
+        len -= 32;
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, _mm_add_epi64(acc0, acc1));
+    // the 64 bit lanes hold at most len/4 words each, so this can't wrap
+    uint16_t partial = fold64(lanes[0] + lanes[1]);
+    // fold the vector part in as a 16 bit value so the rest stays even
+    uint64_t total = (uint64_t)sum + partial;
+    return checksum_scalar(data, len, fold64(total));
+}
+
+__attribute__((target("avx2")))
+static uint16_t checksum_avx2(const void* _data, size_t len, uint16_t sum) {
+    const uint8_t* data = _data;
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    while (len >= 64) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)data);
+        __m256i b = _mm256_loadu_si256((const __m256i*)(data + 32));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(a, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(a, zero));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(b, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(b, zero));
+        data += 64;
+        len -= 64;
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, _mm256_add_epi64(acc0, acc1));
+    uint16_t partial = fold64(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+    uint64_t total = (uint64_t)sum + partial;
+    // avoid the penalty for mixing in legacy SSE code afterwards
+    _mm256_zeroupper();
+    return checksum_sse2(data, len, fold64(total));
+}
+
+static bool cpu_has_avx2(void) {
+    unsigned a, b, c, d;
+    if (__get_cpuid_max(0, NULL) < 7) {
+        return false;
+    }
+    __cpuid(1, a, b, c, d);
+    if (!(c & bit_OSXSAVE) || !(c & bit_AVX)) {
+        return false;
+    }
+    // the os has to be saving the ymm state too
+    uint32_t xcr0_lo, xcr0_hi;
+    __asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 6) != 6) {
+        return false;
+    }
+    __cpuid_count(7, 0, a, b, c, d);
+    return b & bit_AVX2;
+}
+
+#elif defined(__aarch64__)
+
+// NEON is always there on arm64.
+static uint16_t checksum_neon(const void* _data, size_t len, uint16_t sum) {
+    const uint8_t* data = _data;
+    uint64x2_t acc0 = vdupq_n_u64(0);
+    uint64x2_t acc1 = vdupq_n_u64(0);
+    while (len >= 32) {
+        // pairwise add the 32 bit words into the 64 bit accumulators
+        acc0 = vpadalq_u32(acc0, vreinterpretq_u32_u8(vld1q_u8(data)));
+        acc1 = vpadalq_u32(acc1, vreinterpretq_u32_u8(vld1q_u8(data + 16)));
+        data += 32;
+        len -= 32;
+    }
+    uint64x2_t acc = vaddq_u64(acc0, acc1);
+    uint16_t partial = fold64(vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1));
+    uint64_t total = (uint64_t)sum + partial;
+    return checksum_scalar(data, len, fold64(total));
+}
+
+#endif
+
+static inet_checksum_impl_t impls[3];
+static size_t impl_count;
+static atomic_flag impl_once = ATOMIC_FLAG_INIT;
+static _Atomic(inet_checksum_func_t) checksum_func;
+
+static void checksum_init(void) {
+    // whoever gets here first fills in the table; the table and func are
+    // only ever set to the same values, so racing callers are harmless
+    if (atomic_flag_test_and_set(&impl_once)) {
+        while (atomic_load(&checksum_func) == NULL) {
+            ;
+        }
+        return;
+    }
+    size_t n = 0;
+    impls[n++] = (inet_checksum_impl_t){ "scalar", checksum_scalar };
+#if defined(__x86_64__)
+    impls[n++] = (inet_checksum_impl_t){ "sse2", checksum_sse2 };
+    if (cpu_has_avx2()) {
+        impls[n++] = (inet_checksum_impl_t){ "avx2", checksum_avx2 };
+    }
+#elif defined(__aarch64__)
+    impls[n++] = (inet_checksum_impl_t){ "neon", checksum_neon };
+#endif
+    impl_count = n;
+    atomic_store(&checksum_func, impls[n - 1].func);
+}
+
+uint16_t inet_checksum(const void* data, size_t len, uint16_t sum) {
+    inet_checksum_func_t func = atomic_load(&checksum_func);
+    if (func == NULL) {
+        checksum_init();
+        func = atomic_load(&checksum_func);
+    }
+    return func(data, len, sum);
+}
+
+size_t inet_checksum_impls(const inet_checksum_impl_t** out) {
+    if (atomic_load(&checksum_func) == NULL) {
+        checksum_init();
+    }
+    *out = impls;
+    return impl_count;
+}
@@ -0,0 +1,33 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <magenta/compiler.h>
+#include <stddef.h>
+#include <stdint.h>
+
+__BEGIN_CDECLS;
+
+// Add the len bytes at data, as 16 bit words in memory order, to sum,
+// using one's-complement arithmetic.  The result is folded to 16 bits
+// but not complemented, so it can be fed back in for the next piece
+// (which must then start at an even offset in the packet).
+//
+// The fastest implementation the cpu supports is picked on first use.
+uint16_t inet_checksum(const void* data, size_t len, uint16_t sum);
+
+typedef uint16_t (*inet_checksum_func_t)(const void* data, size_t len, uint16_t sum);
+
+typedef struct inet_checksum_impl {
+    const char* name;
+    inet_checksum_func_t func;
+} inet_checksum_impl_t;
+
+// Returns the implementations usable on this cpu, for tests and
+// benchmarks.  The first is the portable one; the last is the one
+// inet_checksum() uses.
+size_t inet_checksum_impls(const inet_checksum_impl_t** out);
+
+__END_CDECLS;
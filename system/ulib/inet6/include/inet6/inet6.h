@@ -128,9 +128,18 @@ static inline uint32_t _swap32(uint32_t n) {
 char* ip6toa(char* _out, void* ip6addr);
 #define IP6TOAMAX 40
 
+// flags for eth_recv()
+// the interface has verified the udp checksum
+#define ETH_RECV_CSUM_OK 1u
+
+// flags for eth_send()
+// the interface completes the udp or icmp6 checksum, whose field
+// holds the (uncomplemented) pseudo-header sum
+#define ETH_SEND_CSUM 1u
+
 // provided by inet6.c
 void ip6_init(void* macaddr);
-void eth_recv(void* data, size_t len);
+void eth_recv(void* data, size_t len, uint32_t flags);
 
 typedef struct eth_buffer eth_buffer_t;
 
@@ -138,7 +147,7 @@ typedef struct eth_buffer eth_buffer_t;
 int eth_get_buffer(size_t len, void** data, eth_buffer_t** out);
 void eth_put_buffer(eth_buffer_t* ethbuf);
 
-int eth_send(eth_buffer_t* ethbuf, size_t skip, size_t len);
+int eth_send(eth_buffer_t* ethbuf, size_t skip, size_t len, uint32_t flags);
 
 int eth_add_mcast_filter(const mac_addr_t* addr);
 
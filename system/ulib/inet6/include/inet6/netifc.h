@@ -4,6 +4,9 @@
 
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 // setup networking
 int netifc_open(void);
 
@@ -26,6 +29,7 @@ int netifc_timer_expired(void);
 // packet is discarded if too large, too small, network offline, etc
 void netifc_send(const void* data, size_t len);
 
-void netifc_recv(void* data, size_t len);
+// flags are those of eth_recv()
+void netifc_recv(void* data, size_t len, uint32_t flags);
 
 void netifc_get_info(uint8_t* addr, uint16_t* mtu);
\ No newline at end of file
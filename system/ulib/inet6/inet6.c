@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <inet6/checksum.h>
 #include <inet6/inet6.h>
 
 #if 1
@@ -142,22 +143,6 @@ static int resolve_ip6(mac_addr_t* _mac, const ip6_addr_t* _ip) {
     return -1;
 }
 
-static uint16_t checksum(const void* _data, size_t len, uint16_t _sum) {
-    uint32_t sum = _sum;
-    const uint16_t* data = _data;
-    while (len > 1) {
-        sum += *data++;
-        len -= 2;
-    }
-    if (len) {
-        sum += (*data & 0xFF);
-    }
-    while (sum > 0xFFFF) {
-        sum = (sum & 0xFFFF) + (sum >> 16);
-    }
-    return sum;
-}
-
 typedef struct {
     uint8_t eth[16];
     ip6_hdr_t ip6;
@@ -171,20 +156,13 @@ typedef struct {
     uint8_t data[0];
 } udp_pkt_t;
 
-static unsigned ip6_checksum(ip6_hdr_t* ip, unsigned type, size_t length) {
+// Only the pseudo-header: the interface sums in the rest and
+// stores the complement (see ETH_SEND_CSUM).
+static unsigned ip6_pseudo_checksum(ip6_hdr_t* ip, unsigned type) {
     uint16_t sum;
 
-    // length and protocol field for pseudo-header
-    sum = checksum(&ip->length, 2, htons(type));
-    // src/dst for pseudo-header + payload
-    sum = checksum(&ip->src, 32 + length, sum);
-
-    // 0 is illegal, so 0xffff remains 0xffff
-    if (sum != 0xffff) {
-        return ~sum;
-    } else {
-        return sum;
-    }
+    sum = inet_checksum(&ip->length, 2, htons(type));
+    return inet_checksum(&ip->src, 32, sum);
 }
 
 static int ip6_setup(ip6_pkt_t* p, const ip6_addr_t* daddr, size_t length, uint8_t type) {
@@ -230,8 +208,8 @@ int udp6_send(const void* data, size_t dlen, const ip6_addr_t* daddr, uint16_t d
     p->udp.checksum = 0;
 
     memcpy(p->data, data, dlen);
-    p->udp.checksum = ip6_checksum(&p->ip6, HDR_UDP, length);
-    return eth_send(ethbuf, 2, ETH_HDR_LEN + IP6_HDR_LEN + length);
+    p->udp.checksum = ip6_pseudo_checksum(&p->ip6, HDR_UDP);
+    return eth_send(ethbuf, 2, ETH_HDR_LEN + IP6_HDR_LEN + length, ETH_SEND_CSUM);
 
 fail:
     eth_put_buffer(ethbuf);
@@ -254,15 +232,15 @@ static int icmp6_send(const void* data, size_t length, const ip6_addr_t* daddr)
 
     icmp = (void*)p->data;
     memcpy(icmp, data, length);
-    icmp->checksum = ip6_checksum(&p->ip6, HDR_ICMP6, length);
-    return eth_send(ethbuf, 2, ETH_HDR_LEN + IP6_HDR_LEN + length);
+    icmp->checksum = ip6_pseudo_checksum(&p->ip6, HDR_ICMP6);
+    return eth_send(ethbuf, 2, ETH_HDR_LEN + IP6_HDR_LEN + length, ETH_SEND_CSUM);
 
 fail:
     eth_put_buffer(ethbuf);
     return -1;
 }
 
-void _udp6_recv(ip6_hdr_t* ip, void* _data, size_t len) {
+void _udp6_recv(ip6_hdr_t* ip, void* _data, size_t len, uint32_t flags) {
     udp_hdr_t* udp = _data;
     uint16_t sum, n;
 
@@ -270,13 +248,15 @@ void _udp6_recv(ip6_hdr_t* ip, void* _data, size_t len) {
         BAD("Bogus Header Len");
     if (udp->checksum == 0)
         BAD("Checksum Invalid");
-    if (udp->checksum == 0xFFFF)
-        udp->checksum = 0;
-
-    sum = checksum(&ip->length, 2, htons(HDR_UDP));
-    sum = checksum(&ip->src, 32 + len, sum);
-    if (sum != 0xFFFF)
-        BAD("Checksum Incorrect");
+    if (!(flags & ETH_RECV_CSUM_OK)) {
+        if (udp->checksum == 0xFFFF)
+            udp->checksum = 0;
+
+        sum = inet_checksum(&ip->length, 2, htons(HDR_UDP));
+        sum = inet_checksum(&ip->src, 32 + len, sum);
+        if (sum != 0xFFFF)
+            BAD("Checksum Incorrect");
+    }
 
     n = ntohs(udp->length);
     if (n < UDP_HDR_LEN)
@@ -299,8 +279,8 @@ void icmp6_recv(ip6_hdr_t* ip, void* _data, size_t len) {
     if (icmp->checksum == 0xFFFF)
         icmp->checksum = 0;
 
-    sum = checksum(&ip->length, 2, htons(HDR_ICMP6));
-    sum = checksum(&ip->src, 32 + len, sum);
+    sum = inet_checksum(&ip->length, 2, htons(HDR_ICMP6));
+    sum = inet_checksum(&ip->src, 32 + len, sum);
     if (sum != 0xFFFF)
         BAD("Checksum Incorrect");
 
@@ -341,7 +321,7 @@ void icmp6_recv(ip6_hdr_t* ip, void* _data, size_t len) {
     }
 }
 
-void eth_recv(void* _data, size_t len) {
+void eth_recv(void* _data, size_t len, uint32_t flags) {
     uint8_t* data = _data;
     ip6_hdr_t* ip;
     uint32_t n;
@@ -385,7 +365,7 @@ void eth_recv(void* _data, size_t len) {
         icmp6_recv(ip, data, len);
         break;
     case HDR_UDP:
-        _udp6_recv(ip, data, len);
+        _udp6_recv(ip, data, len, flags);
         break;
     default:
         // do nothing
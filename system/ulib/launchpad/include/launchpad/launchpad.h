@@ -134,6 +134,36 @@ mx_status_t launchpad_load_from_fd(launchpad_t* lp, int fd);
 mx_status_t launchpad_load_from_vmo(launchpad_t* lp, mx_handle_t vmo);
 
 
+// TEMPLATES
+// For launching the same binary many times.  A template is prepared
+// once: it follows any #! scripts, reads the ELF headers, and fetches
+// the PT_INTERP from the loader service.  Each launchpad loaded from it
+// then only has to map those VMOs into its own process, which replaces
+// launchpad_load_from_*() above (including the vDSO); arguments,
+// environment and handles are set up per launchpad as usual.
+// ---------------------------------------------------------------------
+
+// Opaque type representing a prepared binary.  Once created, it may
+// be used by several threads at once.
+typedef struct launchpad_template launchpad_template_t;
+
+// Prepare a template from an executable VMO, which is consumed.
+mx_status_t launchpad_template_create(mx_handle_t vmo,
+                                      launchpad_template_t** out);
+
+// Prepare a template from an executable file.
+mx_status_t launchpad_template_create_from_file(const char* path,
+                                                launchpad_template_t** out);
+
+// Free a template and the VMOs it holds.  Processes launched from it
+// are unaffected.
+void launchpad_template_destroy(launchpad_template_t* t);
+
+// Load the binary prepared in the template into the launchpad.
+mx_status_t launchpad_load_from_template(launchpad_t* lp,
+                                         const launchpad_template_t* t);
+
+
 // ADDING ARGUMENTS, ENVIRONMENT, AND HANDLES
 // These functions setup arguments, environment, or handles to be
 // passed to the new process via the processargs protocol.
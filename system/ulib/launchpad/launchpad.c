@@ -519,19 +519,15 @@ static mx_status_t reserve_low_address_space(launchpad_t* lp) {
     return NO_ERROR;
 }
 
-// Consumes 'vmo' on success, not on failure.
-static mx_status_t handle_interp(launchpad_t* lp, mx_handle_t vmo,
-                                 const char* interp, size_t interp_len) {
+// Maps the dynamic linker described by 'interp_elf', to be passed the
+// executable 'vmo' in the loader message. Consumes 'vmo' on success, not
+// on failure; never consumes 'interp_vmo'.
+static mx_status_t load_interp(launchpad_t* lp, mx_handle_t vmo,
+                               mx_handle_t interp_vmo, elf_load_info_t* interp_elf) {
     mx_status_t status = setup_loader_svc(lp);
     if (status != NO_ERROR)
         return status;
 
-    mx_handle_t interp_vmo = loader_svc_rpc(
-        lp->special_handles[HND_LOADER_SVC], LOADER_SVC_OP_LOAD_OBJECT,
-        interp, interp_len);
-    if (interp_vmo < 0)
-        return interp_vmo;
-
     if (lp->fresh_process) {
         // A fresh process using PT_INTERP might be loading a libc.so that
         // supports sanitizers, so in that case (the most common case)
@@ -541,16 +537,9 @@ static mx_status_t handle_interp(launchpad_t* lp, mx_handle_t vmo,
             return status;
     }
 
-    elf_load_info_t* elf;
     mx_handle_t segments_vmar;
-    status = elf_load_start(interp_vmo, NULL, 0, &elf);
-    if (status == NO_ERROR) {
-        status = elf_load_finish(lp_vmar(lp), elf, interp_vmo,
-                                 &segments_vmar, &lp->base, &lp->entry);
-        elf_load_destroy(elf);
-    }
-    mx_handle_close(interp_vmo);
-
+    status = elf_load_finish(lp_vmar(lp), interp_elf, interp_vmo,
+                             &segments_vmar, &lp->base, &lp->entry);
     if (status == NO_ERROR) {
         if (lp->special_handles[HND_EXEC_VMO] != MX_HANDLE_INVALID)
             mx_handle_close(lp->special_handles[HND_EXEC_VMO]);
@@ -564,6 +553,46 @@ static mx_status_t handle_interp(launchpad_t* lp, mx_handle_t vmo,
     return status;
 }
 
+// Consumes 'vmo' on success, not on failure.
+static mx_status_t handle_interp(launchpad_t* lp, mx_handle_t vmo,
+                                 const char* interp, size_t interp_len) {
+    mx_status_t status = setup_loader_svc(lp);
+    if (status != NO_ERROR)
+        return status;
+
+    mx_handle_t interp_vmo = loader_svc_rpc(
+        lp->special_handles[HND_LOADER_SVC], LOADER_SVC_OP_LOAD_OBJECT,
+        interp, interp_len);
+    if (interp_vmo < 0)
+        return interp_vmo;
+
+    elf_load_info_t* elf;
+    status = elf_load_start(interp_vmo, NULL, 0, &elf);
+    if (status == NO_ERROR) {
+        status = load_interp(lp, vmo, interp_vmo, elf);
+        elf_load_destroy(elf);
+    }
+    mx_handle_close(interp_vmo);
+
+    return status;
+}
+
+// Maps an executable with no PT_INTERP, to be started directly.
+static mx_status_t load_static(launchpad_t* lp, elf_load_info_t* elf, mx_handle_t vmo) {
+    mx_handle_t segments_vmar;
+    mx_status_t status = elf_load_finish(lp_vmar(lp), elf, vmo, &segments_vmar,
+                                         &lp->base, &lp->entry);
+    if (status != NO_ERROR)
+        return lp_error(lp, status, "elf_load: elf_load_finish() failed");
+
+    // With no PT_INTERP, we obey PT_GNU_STACK.p_memsz for
+    // the stack size setting.  With PT_INTERP, the dynamic
+    // linker is responsible for that.
+    check_elf_stack_size(lp, elf);
+    lp->loader_message = false;
+    return launchpad_add_handle(lp, segments_vmar, PA_HND(PA_VMAR_LOADED, 0));
+}
+
 static mx_status_t launchpad_elf_load_body(launchpad_t* lp, const char* hdr_buf,
                                            size_t buf_sz, mx_handle_t vmo) {
     elf_load_info_t* elf;
@@ -581,21 +610,7 @@ static mx_status_t launchpad_elf_load_body(launchpad_t* lp, const char* hdr_buf,
             lp_error(lp, status, "elf_load: get_interp() failed");
         } else {
             if (interp == NULL) {
-                mx_handle_t segments_vmar;
-                status = elf_load_finish(lp_vmar(lp), elf, vmo, &segments_vmar,
-                                         &lp->base, &lp->entry);
-                if (status != NO_ERROR) {
-                    lp_error(lp, status, "elf_load: elf_load_finish() failed");
-                } else {
-                    // With no PT_INTERP, we obey PT_GNU_STACK.p_memsz for
-                    // the stack size setting.  With PT_INTERP, the dynamic
-                    // linker is responsible for that.
-                    check_elf_stack_size(lp, elf);
-                    lp->loader_message = false;
-                    launchpad_add_handle(
-                        lp, segments_vmar,
-                        PA_HND(PA_VMAR_LOADED, 0));
-                }
+                load_static(lp, elf, vmo);
             } else {
                 if ((status = handle_interp(lp, vmo, interp, interp_len))) {
                     lp_error(lp, status, "elf_load: handle_interp failed");
@@ -653,12 +668,13 @@ static mx_status_t parse_interp_spec(char *line, char **interp_start,
     return NO_ERROR;
 }
 
-mx_status_t launchpad_file_load(launchpad_t* lp, mx_handle_t vmo) {
-    if (vmo < 0)
-        return lp_error(lp, vmo, "file_load: negative vmo");
-    if (vmo == MX_HANDLE_INVALID)
-        return lp_error(lp, ERR_INVALID_ARGS, "file_load: invalid vmo");
-
+// Follows any chain of #! scripts starting at '*vmop', collecting their
+// interpreters and arguments in lp->script_args, and leaves the ELF file
+// at the end of it in '*vmop' and its first bytes in 'first_line'. On
+// failure, the VMO has been consumed.
+static mx_status_t resolve_scripts(launchpad_t* lp, mx_handle_t* vmop,
+                                   char* first_line, size_t* chars_readp) {
+    mx_handle_t vmo = *vmop;
     if (lp->script_args != NULL) {
         free(lp->script_args);
         lp->script_args = NULL;
@@ -668,12 +684,11 @@ mx_status_t launchpad_file_load(launchpad_t* lp, mx_handle_t vmo) {
 
     size_t script_nest_level = 0;
     mx_status_t status;
-    char first_line[LP_MAX_INTERP_LINE_LEN + 1];
     size_t chars_read;
 
     while (1) {
         // Read enough to get the interpreter specification of a script
-        status = mx_vmo_read(vmo, first_line, 0, sizeof(first_line),
+        status = mx_vmo_read(vmo, first_line, 0, LP_MAX_INTERP_LINE_LEN + 1,
                              &chars_read);
 
         // This is not a script -- load as an ELF file
@@ -697,7 +712,7 @@ mx_status_t launchpad_file_load(launchpad_t* lp, mx_handle_t vmo) {
         char* newline_pos = memchr(first_line, '\n', chars_read);
         if (newline_pos)
             *newline_pos = '\0';
-        else if (chars_read == sizeof(first_line))
+        else if (chars_read == LP_MAX_INTERP_LINE_LEN + 1)
             return lp_error(lp, ERR_OUT_OF_RANGE,
                             "file_load: first line of script too long");
         else
@@ -751,6 +766,23 @@ mx_status_t launchpad_file_load(launchpad_t* lp, mx_handle_t vmo) {
             return lp_error(lp, vmo, "file_load: loader_svc_rpc() failed");
     }
 
+    *vmop = vmo;
+    *chars_readp = chars_read;
+    return NO_ERROR;
+}
+
+mx_status_t launchpad_file_load(launchpad_t* lp, mx_handle_t vmo) {
+    if (vmo < 0)
+        return lp_error(lp, vmo, "file_load: negative vmo");
+    if (vmo == MX_HANDLE_INVALID)
+        return lp_error(lp, ERR_INVALID_ARGS, "file_load: invalid vmo");
+
+    char first_line[LP_MAX_INTERP_LINE_LEN + 1];
+    size_t chars_read;
+    mx_status_t status = resolve_scripts(lp, &vmo, first_line, &chars_read);
+    if (status != NO_ERROR)
+        return status;
+
     // Finally, load the interpreter itself
     status = launchpad_elf_load_body(lp, first_line, chars_read, vmo);
 
@@ -1275,3 +1307,162 @@ mx_status_t launchpad_load_from_fd(launchpad_t* lp, int fd) {
 mx_status_t launchpad_load_from_vmo(launchpad_t* lp, mx_handle_t vmo) {
     return launchpad_file_load_with_vdso(lp, vmo);
 }
+
+struct launchpad_template {
+    size_t num_script_args;
+    char* script_args;
+    size_t script_args_len;
+
+    // The ELF file at the end of any chain of scripts, and its headers
+    mx_handle_t exec_vmo;
+    elf_load_info_t* exec_elf;
+
+    // Its PT_INTERP, if it has one
+    mx_handle_t interp_vmo;
+    elf_load_info_t* interp_elf;
+
+    mx_handle_t vdso_vmo;
+    elf_load_info_t* vdso_elf;
+};
+
+void launchpad_template_destroy(launchpad_template_t* t) {
+    if (t == NULL)
+        return;
+    close_handles(&t->exec_vmo, 1);
+    close_handles(&t->interp_vmo, 1);
+    close_handles(&t->vdso_vmo, 1);
+    if (t->exec_elf != NULL)
+        elf_load_destroy(t->exec_elf);
+    if (t->interp_elf != NULL)
+        elf_load_destroy(t->interp_elf);
+    if (t->vdso_elf != NULL)
+        elf_load_destroy(t->vdso_elf);
+    free(t->script_args);
+    free(t);
+}
+
+mx_status_t launchpad_template_create(mx_handle_t vmo, launchpad_template_t** out) {
+    if (vmo < 0)
+        return vmo;
+    if (vmo == MX_HANDLE_INVALID)
+        return ERR_INVALID_ARGS;
+
+    // Following scripts and asking the loader service for the interpreter
+    // are done on a launchpad of their own, with no process behind it.
+    launchpad_template_t* t = calloc(1, sizeof(*t));
+    launchpad_t* lp = calloc(1, sizeof(*lp));
+    if (t == NULL || lp == NULL) {
+        free(t);
+        free(lp);
+        mx_handle_close(vmo);
+        return ERR_NO_MEMORY;
+    }
+
+    char first_line[LP_MAX_INTERP_LINE_LEN + 1];
+    size_t chars_read;
+    mx_status_t status = resolve_scripts(lp, &vmo, first_line, &chars_read);
+    if (status != NO_ERROR)
+        goto fail;
+    t->exec_vmo = vmo;
+    t->num_script_args = lp->num_script_args;
+    t->script_args = lp->script_args;
+    t->script_args_len = lp->script_args_len;
+    lp->script_args = NULL;
+
+    if ((status = elf_load_start(t->exec_vmo, first_line, chars_read,
+                                 &t->exec_elf)) != NO_ERROR)
+        goto fail;
+    char* interp;
+    size_t interp_len;
+    if ((status = elf_load_get_interp(t->exec_elf, t->exec_vmo,
+                                      &interp, &interp_len)) != NO_ERROR)
+        goto fail;
+    if (interp != NULL) {
+        status = setup_loader_svc(lp);
+        if (status == NO_ERROR) {
+            t->interp_vmo = loader_svc_rpc(
+                lp->special_handles[HND_LOADER_SVC], LOADER_SVC_OP_LOAD_OBJECT,
+                interp, interp_len);
+            if (t->interp_vmo < 0) {
+                status = t->interp_vmo;
+                t->interp_vmo = MX_HANDLE_INVALID;
+            }
+        }
+        free(interp);
+        if ((status != NO_ERROR) ||
+            ((status = elf_load_start(t->interp_vmo, NULL, 0,
+                                      &t->interp_elf)) != NO_ERROR))
+            goto fail;
+    }
+
+    t->vdso_vmo = launchpad_get_vdso_vmo();
+    if (t->vdso_vmo < 0) {
+        status = t->vdso_vmo;
+        t->vdso_vmo = MX_HANDLE_INVALID;
+        goto fail;
+    }
+    if ((status = elf_load_start(t->vdso_vmo, NULL, 0, &t->vdso_elf)) != NO_ERROR)
+        goto fail;
+
+    launchpad_destroy(lp);
+    *out = t;
+    return NO_ERROR;
+
+fail:
+    launchpad_destroy(lp);
+    launchpad_template_destroy(t);
+    return status;
+}
+
+mx_status_t launchpad_template_create_from_file(const char* path,
+                                                launchpad_template_t** out) {
+    return launchpad_template_create(launchpad_vmo_from_file(path), out);
+}
+
+mx_status_t launchpad_load_from_template(launchpad_t* lp,
+                                         const launchpad_template_t* t) {
+    if (lp->error)
+        return lp->error;
+
+    free(lp->script_args);
+    lp->script_args = NULL;
+    lp->script_args_len = 0;
+    lp->num_script_args = 0;
+    if (t->script_args_len != 0) {
+        lp->script_args = malloc(t->script_args_len);
+        if (lp->script_args == NULL)
+            return lp_error(lp, ERR_NO_MEMORY, "load_from_template: out of memory");
+        memcpy(lp->script_args, t->script_args, t->script_args_len);
+        lp->script_args_len = t->script_args_len;
+        lp->num_script_args = t->num_script_args;
+    }
+
+    mx_status_t status;
+    if (t->interp_elf == NULL) {
+        status = load_static(lp, t->exec_elf, t->exec_vmo);
+    } else {
+        // The dynamic linker gets a handle to the executable of its own
+        mx_handle_t vmo;
+        status = mx_handle_duplicate(t->exec_vmo, MX_RIGHT_SAME_RIGHTS, &vmo);
+        if (status != NO_ERROR)
+            return lp_error(lp, status, "load_from_template: cannot duplicate vmo");
+        if ((status = load_interp(lp, vmo, t->interp_vmo, t->interp_elf)) != NO_ERROR) {
+            mx_handle_close(vmo);
+            lp_error(lp, status, "load_from_template: load_interp failed");
+        }
+    }
+    if (status != NO_ERROR)
+        return lp->error;
+
+    if ((status = elf_load_finish(lp_vmar(lp), t->vdso_elf, t->vdso_vmo, NULL,
+                                  &lp->vdso_base, NULL)) != NO_ERROR)
+        return lp_error(lp, status, "load_from_template: cannot load vDSO");
+
+    mx_handle_t vdso;
+    if ((status = mx_handle_duplicate(t->vdso_vmo, MX_RIGHT_SAME_RIGHTS, &vdso)) != NO_ERROR)
+        return lp_error(lp, status, "load_from_template: cannot duplicate vDSO vmo");
+    status = launchpad_add_handle(lp, vdso, PA_HND(PA_VMO_VDSO, 0));
+    if (status != NO_ERROR)
+        mx_handle_close(vdso);
+    return status;
+}
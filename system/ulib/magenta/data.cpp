@@ -14,3 +14,9 @@ const struct vdso_constants DATA_CONSTANTS = {
     0,
     0,
 };
+
+// The kernel keeps updating this one after boot, so it is only ever read
+// with atomic loads.
+const struct vdso_clock DATA_CLOCK = {
+    0xdeadbeef,
+};
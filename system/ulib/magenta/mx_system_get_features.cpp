@@ -0,0 +1,20 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <magenta/features.h>
+#include <magenta/syscalls.h>
+
+#include "private.h"
+
+mx_status_t _mx_system_get_features(uint32_t kind, uint32_t* out) {
+    switch (kind) {
+    case MX_FEATURE_KIND_CPU:
+        *out = DATA_CONSTANTS.cpu_features;
+        return NO_ERROR;
+    default:
+        return ERR_NOT_SUPPORTED;
+    }
+}
+
+VDSO_PUBLIC_ALIAS(mx_system_get_features);
@@ -0,0 +1,17 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <magenta/syscalls.h>
+
+#include "private.h"
+
+mx_time_t _mx_time_get_coarse(uint32_t clock_id) {
+    // Only the monotonic clock is published by the kernel, everything
+    // else takes the precise path.
+    if (clock_id == MX_CLOCK_MONOTONIC)
+        return __atomic_load_n(&DATA_CLOCK.monotonic, __ATOMIC_RELAXED);
+    return VDSO_mx_time_get(clock_id);
+}
+
+VDSO_PUBLIC_ALIAS(mx_time_get_coarse);
@@ -20,9 +20,11 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/mx_status_get_string.cpp \
     $(LOCAL_DIR)/mx_system_get_num_cpus.cpp \
     $(LOCAL_DIR)/mx_system_get_physmem.cpp \
+    $(LOCAL_DIR)/mx_system_get_features.cpp \
     $(LOCAL_DIR)/mx_system_get_version.cpp \
     $(LOCAL_DIR)/mx_ticks_get.cpp \
     $(LOCAL_DIR)/mx_ticks_per_second.cpp \
+    $(LOCAL_DIR)/mx_time_get_coarse.cpp \
     $(LOCAL_DIR)/syscall-wrappers.cpp \
 
 ifeq ($(ARCH),arm64)
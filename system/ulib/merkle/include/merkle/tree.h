@@ -101,13 +101,15 @@ public:
 
     // Writes a Merkle tree for the given data and saves its root digest.
     // |tree_len| must be at least as much as returned by GetTreeLength().
+    // With all the data at hand, the leaves are hashed on several threads.
     mx_status_t Create(const void* data, size_t data_len, void* tree,
                        size_t tree_len, Digest* digest);
 
     // Sets the range of addresses within the tree that will need to be read to
     // fulfill a corresponding call to Verify. |offset| and |length| must
-    // describe a range wholly within |data_len|. If the ranges fail to be set
-    // due to low memory, this will return ERR_NO_MEMORY.
+    // describe a range wholly within |data_len|. This may be called before
+    // the tree itself is available. If the ranges fail to be set due to low
+    // memory, this will return ERR_NO_MEMORY.
     mx_status_t SetRanges(size_t data_len, uint64_t offset, size_t length);
 
     // Checks the integrity of a the region of data given by the offset and
@@ -135,6 +137,11 @@ private:
     // tree and writes the digests to |tree|.
     mx_status_t HashData(const void* data, size_t length, void* tree);
 
+    // Calculates the digests of the nodes in |data| from |offset_| up to
+    // |finish| on the current |level_|, and writes them out in order to
+    // |out|.  Large spans are split up between several threads.
+    void HashNodes(const void* data, uint64_t finish, uint8_t* out);
+
     // This method adds the given offset |off| to the appropriate list of
     // failures.
     void AddFailure();
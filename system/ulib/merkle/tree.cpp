@@ -4,7 +4,9 @@
 
 #include <merkle/tree.h>
 
+#include <pthread.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <magenta/errors.h>
 #include <magenta/new.h>
@@ -17,6 +19,53 @@ constexpr size_t Tree::kNodeSize;
 const size_t kDigestsPerNode = Tree::kNodeSize / Digest::kLength;
 const size_t kMaxFailures = kDigestsPerNode;
 
+// Hashing is split between at most this many threads, each getting at least
+// |kMinNodesPerThread| nodes to make starting it worthwhile.
+const size_t kMaxThreads = 8;
+const size_t kMinNodesPerThread = 64;
+
+namespace {
+
+// A run of nodes on one level of the tree, to be hashed by one thread.
+struct HashJob {
+    const uint8_t* bytes;
+    // The offset of the start of the level within |bytes|
+    uint64_t base;
+    uint64_t level;
+    uint64_t start;
+    uint64_t finish;
+    uint8_t* out;
+};
+
+// Does the same as |Tree::HashNode|, for each node of the job in turn.
+void* HashJobRun(void* arg) {
+    HashJob* job = static_cast<HashJob*>(arg);
+    Digest digest;
+    uint8_t* out = job->out;
+    for (uint64_t offset = job->start; offset < job->finish;
+         offset += Tree::kNodeSize) {
+        digest.Init();
+        uint64_t locality = (offset - job->base) | job->level;
+        digest.Update(&locality, sizeof(locality));
+        // Only the last data node can come up short
+        size_t to_digest = static_cast<size_t>(
+            mxtl::min(static_cast<uint64_t>(Tree::kNodeSize), job->finish - offset));
+        digest.Update(job->bytes + offset, to_digest);
+        if (to_digest != Tree::kNodeSize) {
+            size_t pad_len = Tree::kNodeSize - to_digest;
+            uint8_t pad[pad_len];
+            memset(pad, 0, pad_len);
+            digest.Update(pad, pad_len);
+        }
+        digest.Final();
+        digest.CopyTo(out, Digest::kLength);
+        out += Digest::kLength;
+    }
+    return nullptr;
+}
+
+} // namespace
+
 Tree::~Tree() {}
 
 // Public methods
@@ -114,9 +163,18 @@ mx_status_t Tree::Create(const void* data, size_t data_len, void* tree,
     if (rc != NO_ERROR) {
         return rc;
     }
-    rc = CreateUpdate(data, data_len, tree);
-    if (rc != NO_ERROR) {
-        return rc;
+    if (data_len > kNodeSize) {
+        if (!data) {
+            return ERR_INVALID_ARGS;
+        }
+        // The leaves don't depend on each other, so they can all be hashed at
+        // once.  The levels above are a tiny fraction of the work.
+        HashNodes(data, data_len, static_cast<uint8_t*>(tree));
+    } else {
+        rc = CreateUpdate(data, data_len, tree);
+        if (rc != NO_ERROR) {
+            return rc;
+        }
     }
     rc = CreateFinal(tree, digest);
     if (rc != NO_ERROR) {
@@ -130,6 +188,12 @@ mx_status_t Tree::SetRanges(size_t data_len, uint64_t offset, size_t length) {
     if (finish < offset || finish > data_len) {
         return ERR_INVALID_ARGS;
     }
+    // The geometry may not be known yet, if this is used to prefetch ahead of
+    // the first Verify
+    mx_status_t rc = SetLengths(data_len, GetTreeLength(data_len));
+    if (rc != NO_ERROR) {
+        return rc;
+    }
     offset -= offset % kNodeSize;
     if (finish != data_len) {
         finish = mxtl::roundup(finish, kNodeSize);
@@ -197,6 +261,29 @@ mx_status_t Tree::Verify(const void* data, size_t data_len, const void* tree,
             hash_offset = offsets_[level_] +
                           (offset_ - offsets_[level_ - 1]) / kDigestsPerNode;
         }
+        size_t nodes = static_cast<size_t>(
+            mxtl::roundup(finish - offset_, kNodeSize) / kNodeSize);
+        if (nodes >= kMinNodesPerThread * 2) {
+            // Hash the whole span at once, then check each digest in turn
+            AllocChecker ac;
+            mxtl::unique_ptr<uint8_t[]> digests(
+                new (&ac) uint8_t[nodes * Digest::kLength]);
+            if (ac.check()) {
+                uint64_t start = offset_;
+                HashNodes(level_ == 0 ? data : tree, finish, digests.get());
+                for (size_t i = 0; i < nodes; ++i) {
+                    if (memcmp(digests.get() + i * Digest::kLength,
+                               hashes + hash_offset, Digest::kLength) != 0) {
+                        // Where HashNode would have left off for this node
+                        offset_ = start + (i + 1) * kNodeSize;
+                        AddFailure();
+                    }
+                    hash_offset += Digest::kLength;
+                }
+                offset_ = finish;
+                continue;
+            }
+        }
         while (offset_ < finish) {
             HashNode(level_ == 0 ? data : tree);
             if (digest_ != hashes + hash_offset) {
@@ -315,6 +402,52 @@ mx_status_t Tree::HashData(const void* data, size_t length, void* tree) {
     return NO_ERROR;
 }
 
+void Tree::HashNodes(const void* data, uint64_t finish, uint8_t* out) {
+    size_t nodes = static_cast<size_t>(
+        mxtl::roundup(finish - offset_, kNodeSize) / kNodeSize);
+    size_t num_threads = mxtl::min(nodes / kMinNodesPerThread, kMaxThreads);
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_cpus > 0) {
+        num_threads = mxtl::min(num_threads, static_cast<size_t>(num_cpus));
+    }
+    if (num_threads == 0) {
+        num_threads = 1;
+    }
+
+    HashJob jobs[kMaxThreads];
+    uint64_t base = 0;
+    if (offsets_.size() > 0 && level_ != 0) {
+        base = offsets_[level_ - 1];
+    }
+    for (size_t i = 0; i < num_threads; ++i) {
+        size_t first = nodes * i / num_threads;
+        size_t last = nodes * (i + 1) / num_threads;
+        jobs[i].bytes = static_cast<const uint8_t*>(data);
+        jobs[i].base = base;
+        jobs[i].level = level_;
+        jobs[i].start = offset_ + first * kNodeSize;
+        jobs[i].finish = mxtl::min(offset_ + last * kNodeSize, finish);
+        jobs[i].out = out + first * Digest::kLength;
+    }
+
+    // This thread takes the first share itself, and any others that no thread
+    // could be started for.
+    pthread_t threads[kMaxThreads];
+    bool started[kMaxThreads] = {false};
+    for (size_t i = 1; i < num_threads; ++i) {
+        started[i] = pthread_create(&threads[i], nullptr, HashJobRun, &jobs[i]) == 0;
+    }
+    HashJobRun(&jobs[0]);
+    for (size_t i = 1; i < num_threads; ++i) {
+        if (started[i]) {
+            pthread_join(threads[i], nullptr);
+        } else {
+            HashJobRun(&jobs[i]);
+        }
+    }
+    offset_ = finish;
+}
+
 void Tree::AddFailure() {
     mxtl::Array<uint64_t>* failures =
         (level_ == 0 ? &data_failures_ : &tree_failures_);
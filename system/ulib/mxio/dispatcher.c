@@ -2,6 +2,7 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -44,6 +45,7 @@ struct mxio_dispatcher {
     mx_handle_t ioport;
     mxio_dispatcher_cb_t default_cb;
     thrd_t t;
+    atomic_int threads;
 };
 
 static void mxio_dispatcher_destroy(mxio_dispatcher_t* md) {
@@ -147,7 +149,10 @@ static int mxio_dispatcher_thread(void* _md) {
     }
 
     xprintf("dispatcher: FATAL ERROR, EXITING\n");
-    mxio_dispatcher_destroy(md);
+    // The last thread out of a pool cleans up after it
+    if (atomic_fetch_sub(&md->threads, 1) == 1) {
+        mxio_dispatcher_destroy(md);
+    }
     return NO_ERROR;
 }
 
@@ -170,16 +175,39 @@ mx_status_t mxio_dispatcher_create(mxio_dispatcher_t** out, mxio_dispatcher_cb_t
 }
 
 mx_status_t mxio_dispatcher_start(mxio_dispatcher_t* md, const char* name) {
+    return mxio_dispatcher_start_pool(md, name, 1);
+}
+
+mx_status_t mxio_dispatcher_start_pool(mxio_dispatcher_t* md, const char* name,
+                                       uint32_t count) {
+#if !USE_WAIT_ONCE
+    // Repeating waits may deliver a handle's packets to several threads
+    // at once, so only a single thread can serve them.
+    count = 1;
+#endif
+    if (count == 0) {
+        return ERR_INVALID_ARGS;
+    }
     mx_status_t r;
     mtx_lock(&md->lock);
     if (md->t == NULL) {
+        atomic_store(&md->threads, count);
         if (thrd_create_with_name(&md->t, mxio_dispatcher_thread, md, name) != thrd_success) {
+            mtx_unlock(&md->lock);
             mxio_dispatcher_destroy(md);
-            r = ERR_NO_RESOURCES;
-        } else {
-            thrd_detach(md->t);
-            r = NO_ERROR;
+            return ERR_NO_RESOURCES;
+        }
+        thrd_detach(md->t);
+        for (uint32_t n = 1; n < count; n++) {
+            // A smaller pool still works; carry on with the threads we have
+            thrd_t t;
+            if (thrd_create_with_name(&t, mxio_dispatcher_thread, md, name) != thrd_success) {
+                atomic_fetch_sub(&md->threads, count - n);
+                break;
+            }
+            thrd_detach(t);
         }
+        r = NO_ERROR;
     } else {
         r = ERR_BAD_STATE;
     }
@@ -188,6 +216,7 @@ mx_status_t mxio_dispatcher_start(mxio_dispatcher_t* md, const char* name) {
 }
 
 void mxio_dispatcher_run(mxio_dispatcher_t* md) {
+    atomic_fetch_add(&md->threads, 1);
     mxio_dispatcher_thread(md);
 }
 
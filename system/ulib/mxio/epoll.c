@@ -11,6 +11,7 @@
 
 #include <magenta/listnode.h>
 #include <magenta/syscalls.h>
+#include <magenta/syscalls/port.h>
 #include <mxio/io.h>
 #include <mxio/util.h>
 
@@ -20,11 +21,21 @@
 // TODO: should use a system default
 #define MAX_WAIT_EVENTS 1024
 
+// Each registered fd has a repeating async wait on the epoll port, so
+// registration happens once and a wait only touches the fds that are ready.
+// The port reports edges; level triggered fds that were reported stay on the
+// ready list and are polled again by the next epoll_wait(). EPOLLONESHOT fds
+// get a single shot wait instead, which the port drops once it fires, so they
+// stay quiet until EPOLL_CTL_MOD arms them again.
 typedef struct mxio_epoll_cookie {
     list_node_t node;
+    list_node_t ready_node;
     mxio_t* io;
     struct epoll_event ep_event;
     int fd;
+    mx_handle_t h;
+    mx_signals_t signals;
+    bool ready;
 } mxio_epoll_cookie_t;
 
 typedef struct mxio_epoll {
@@ -32,6 +43,7 @@ typedef struct mxio_epoll {
     mx_handle_t h;
     mtx_t cookies_lock;
     list_node_t cookies;
+    list_node_t ready;
 } mxio_epoll_t;
 
 static void mxio_epoll_cookie_add(mxio_epoll_t* epio,
@@ -51,6 +63,10 @@ static mxio_epoll_cookie_t* mxio_epoll_cookie_get(mxio_epoll_t* epio, int fd,
         if (entry->fd == fd) {
             if (remove) {
                 list_delete(&entry->node);
+                if (entry->ready) {
+                    list_delete(&entry->ready_node);
+                    entry->ready = false;
+                }
             }
             cookie = entry;
             break;
@@ -115,13 +131,14 @@ static mxio_t* mxio_epoll_create(mx_handle_t h) {
     epio->h = h;
     mtx_init(&epio->cookies_lock, mtx_plain);
     list_initialize(&epio->cookies);
+    list_initialize(&epio->ready);
     return &epio->io;
 }
 
 mx_status_t mxio_epoll(mxio_t** out) {
     mx_handle_t h;
     mx_status_t status;
-    if ((status = mx_waitset_create(0, &h)) < 0) {
+    if ((status = mx_port_create(MX_PORT_OPT_V2, &h)) < 0) {
         return status;
     }
     mxio_t* io;
@@ -201,7 +218,8 @@ int epoll_ctl(int epfd, int op, int fd, struct epoll_event* ep_event) {
             r = ERR_NOT_FOUND;
             goto end;
         }
-        if ((r = mx_waitset_remove(epio->h, (uint64_t)(uintptr_t)cookie)) < 0) {
+        // Cancelling also discards a packet still queued for the cookie.
+        if ((r = mx_port_cancel(epio->h, cookie->h, (uint64_t)(uintptr_t)cookie)) < 0) {
             mxio_epoll_cookie_add(epio, cookie);
             goto end;
         }
@@ -229,7 +247,12 @@ int epoll_ctl(int epfd, int op, int fd, struct epoll_event* ep_event) {
         }
 
         cookie->ep_event = *ep_event;
-        if ((r = mx_waitset_add(epio->h, (uint64_t)(uintptr_t)cookie, h, signals)) < 0) {
+        cookie->h = h;
+        cookie->signals = signals;
+        uint32_t options = (ep_event->events & EPOLLONESHOT) ?
+                           MX_WAIT_ASYNC_ONCE : MX_WAIT_ASYNC_REPEATING;
+        if ((r = mx_object_wait_async(h, epio->h, (uint64_t)(uintptr_t)cookie, signals,
+                                      options)) < 0) {
             mxio_release(cookie->io);
             free(cookie);
             goto end;
@@ -245,6 +268,18 @@ int epoll_ctl(int epfd, int op, int fd, struct epoll_event* ep_event) {
     return STATUS(r);
 }
 
+static void mxio_epoll_report(mxio_epoll_cookie_t* cookie, mx_signals_t observed,
+                              struct epoll_event* ep_event) {
+    mxio_t* io = cookie->io;
+    uint32_t events;
+
+    io->ops->wait_end(io, observed, &events);
+    // mask unrequested events except HUP/ERR
+    ep_event->events = events & (cookie->ep_event.events | EPOLLHUP | EPOLLERR) &
+                       ~(EPOLLET | EPOLLONESHOT);
+    ep_event->data = cookie->ep_event.data;
+}
+
 int epoll_wait(int epfd, struct epoll_event* ep_events, int maxevents, int timeout) {
     if (maxevents <= 0 || timeout < -1) {
         return ERRNO(EINVAL);
@@ -265,29 +300,73 @@ int epoll_wait(int epfd, struct epoll_event* ep_events, int maxevents, int timeo
     }
     mxio_epoll_t* epio = (mxio_epoll_t*)io;
 
-    mx_status_t r;
-    uint32_t num_results = maxevents;
-    mx_waitset_result_t results[maxevents];
-    mx_time_t tmo = (timeout >= 0) ? mx_deadline_after(MX_MSEC(timeout)) : MX_TIME_INFINITE;
+    int n = 0;
+    mtx_lock(&epio->cookies_lock);
+    // Level triggered fds reported last time are reported again as long as
+    // they are still ready.
+    mxio_epoll_cookie_t* cookie;
+    mxio_epoll_cookie_t* tmp;
+    list_for_every_entry_safe(&epio->ready, cookie, tmp, mxio_epoll_cookie_t, ready_node) {
+        if (n == maxevents) {
+            break;
+        }
+        mx_signals_t observed = 0;
+        mx_status_t r = mx_object_wait_one(cookie->h, cookie->signals, 0, &observed);
+        if (r < 0 && r != ERR_TIMED_OUT) {
+            observed = 0;
+        }
+        if (!(observed & cookie->signals)) {
+            list_delete(&cookie->ready_node);
+            cookie->ready = false;
+            continue;
+        }
+        mxio_epoll_report(cookie, observed, &ep_events[n++]);
+    }
+    mtx_unlock(&epio->cookies_lock);
 
-    if ((r = mx_waitset_wait(epio->h, tmo, results, &num_results)) < 0) {
+    if (n == maxevents) {
         mxio_release(io);
-        return (r == ERR_TIMED_OUT) ? 0 : ERROR(r);
+        return n;
     }
 
-    for (uint32_t i = 0; i < num_results; i++) {
-        mxio_epoll_cookie_t* cookie = (mxio_epoll_cookie_t*)(uintptr_t)results[i].cookie;
-        mxio_t* io = cookie->io;
-        uint32_t events;
+    // Don't block if something is already being reported.
+    mx_time_t deadline = 0;
+    if (n == 0) {
+        deadline = (timeout >= 0) ? mx_deadline_after(MX_MSEC(timeout)) : MX_TIME_INFINITE;
+    }
 
-        io->ops->wait_end(io, results[i].observed, &events);
-        // mask unrequested events except HUP/ERR
-        ep_events[i].events = events & (cookie->ep_event.events | EPOLLHUP | EPOLLERR);
+    uint32_t count = maxevents - n;
+    if (count > MX_PORT_MAX_BATCH) {
+        count = MX_PORT_MAX_BATCH;
+    }
+    mx_port_packet_t packets[count];
+    uint32_t actual = 0;
+    mx_status_t r = mx_port_wait_many(epio->h, deadline, packets, count, &actual);
+    if (r < 0) {
+        mxio_release(io);
+        if (r == ERR_TIMED_OUT) {
+            return n;
+        }
+        return (n > 0) ? n : ERROR(r);
+    }
 
-        ep_events[i].data = cookie->ep_event.data;
+    mtx_lock(&epio->cookies_lock);
+    for (uint32_t i = 0; i < actual; i++) {
+        cookie = (mxio_epoll_cookie_t*)(uintptr_t)packets[i].key;
+        // Already reported from the ready list.
+        if (cookie->ready) {
+            continue;
+        }
+        mxio_epoll_report(cookie, packets[i].signal.observed, &ep_events[n++]);
+        if (!(cookie->ep_event.events & (EPOLLET | EPOLLONESHOT))) {
+            list_add_tail(&epio->ready, &cookie->ready_node);
+            cookie->ready = true;
+        }
     }
+    mtx_unlock(&epio->cookies_lock);
+
     mxio_release(io);
-    return (int)num_results;
+    return n;
 }
 
 int epoll_pwait(int epfd, struct epoll_event* events, int maxevents, int timeout, const sigset_t* sigmask) {
@@ -29,6 +29,12 @@ mx_status_t mxio_dispatcher_create(mxio_dispatcher_t** out, mxio_dispatcher_cb_t
 // create a thread for a dispatcher and start it running
 mx_status_t mxio_dispatcher_start(mxio_dispatcher_t* md, const char* name);
 
+// create 'count' threads for a dispatcher and start them running; each
+// channel is served by one thread at a time, but separate channels may be
+// served concurrently, so the callback must lock anything they share
+mx_status_t mxio_dispatcher_start_pool(mxio_dispatcher_t* md, const char* name,
+                                       uint32_t count);
+
 // run the dispatcher loop on the current thread, never to return
 void mxio_dispatcher_run(mxio_dispatcher_t* md);
 
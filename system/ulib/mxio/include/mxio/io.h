@@ -48,6 +48,15 @@ int mxio_handle_fd(mx_handle_t h, mx_signals_t signals_in, mx_signals_t signals_
 // invoke a raw mxio ioctl
 ssize_t mxio_ioctl(int fd, int op, const void* in_buf, size_t in_len, void* out_buf, size_t out_len);
 
+// read the next batch of entries of the directory 'fd' into 'buf', as
+// vdirent_plus_t records (see <mxio/vfs.h>) holding each entry's attributes
+// along with its name, so that listing a directory with its attributes
+// doesn't take a stat() per entry. returns the number of bytes filled, 0 at
+// the end of the directory, or a negative error; ERR_NOT_SUPPORTED means the
+// directory's server can't do this, and readdir() and stat() have to do.
+// 'rewind' starts over from the first entry.
+ssize_t mxio_readdir_plus(int fd, void* buf, size_t len, bool rewind);
+
 // create a pipe, installing one half in a fd, returning the other
 // for transport to another process
 mx_status_t mxio_pipe_half(mx_handle_t* handle, uint32_t* type);
@@ -50,7 +50,8 @@ __BEGIN_CDECLS
 #define MXRIO_SYNC         0x00000019
 #define MXRIO_LINK        (0x0000001a | MXRIO_ONE_HANDLE)
 #define MXRIO_MMAP         0x0000001b
-#define MXRIO_NUM_OPS      28
+#define MXRIO_READDIR_PLUS 0x0000001c
+#define MXRIO_NUM_OPS      29
 
 #define MXRIO_OP(n)        ((n) & 0x3FF) // opcode
 #define MXRIO_HC(n)        (((n) >> 8) & 3) // handle count
@@ -63,7 +64,8 @@ __BEGIN_CDECLS
     "read_at", "write_at", "truncate", "rename", \
     "connect", "bind", "listen", "getsockname", \
     "getpeername", "getsockopt", "setsockopt", "getaddrinfo", \
-    "setattr", "sync", "link", "mmap" }
+    "setattr", "sync", "link", "mmap", \
+    "readdir_plus" }
 
 const char* mxio_opname(uint32_t op);
 
@@ -145,6 +147,10 @@ struct mxrio_msg {
 #define MXIO_MMAP_FLAG_WRITE   (1u << 1)
 #define MXIO_MMAP_FLAG_EXEC    (1u << 2)
 #define MXIO_MMAP_FLAG_PRIVATE (1u << 10)
+// The mapping only stands in for read() calls. Servers for which handing
+// out the VMO costs more than answering the reads, for example because the
+// whole file has to be loaded up front, should refuse it.
+#define MXIO_MMAP_FLAG_READS   (1u << 11)
 
 static_assert(MXIO_MMAP_FLAG_READ == MX_VM_FLAG_PERM_READ, "Vmar / Mmap flags should be aligned");
 static_assert(MXIO_MMAP_FLAG_WRITE == MX_VM_FLAG_PERM_WRITE, "Vmar / Mmap flags should be aligned");
@@ -66,6 +66,13 @@ mxio_t* mxio_service_create(mx_handle_t);
 // entire log-lines and flush them on newline or buffer full.
 mxio_t* mxio_logger_create(mx_handle_t);
 
+// like mxio_logger_create(), but rather than making a call per line, the
+// lines are queued and written out several at a time by a thread of the
+// logger's own. When the queue is full, lines are dropped, not waited on,
+// and how many were dropped is logged once there is room again.
+// Closing the logger writes out what is still queued.
+mxio_t* mxio_logger_create_batched(mx_handle_t);
+
 // Attempt to connect a channel to a named service.
 // On success the channel is connected.  On failure
 // an error is returned and the handle is closed.
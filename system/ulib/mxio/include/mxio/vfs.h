@@ -71,4 +71,15 @@ typedef struct vdirent {
     char name[0];
 } vdirent_t;
 
+// The records returned by MXRIO_READDIR_PLUS: a vdirent along with the
+// entry's attributes, as MXRIO_STAT would return them. 'attr.mode' is zero
+// for entries whose attributes the filesystem could not provide. Records
+// are 8 byte aligned.
+typedef struct vdirent_plus {
+    uint32_t size;
+    uint32_t type;
+    vnattr_t attr;
+    char name[0];
+} vdirent_plus_t;
+
 __END_CDECLS
@@ -36,9 +36,17 @@ typedef mx_status_t (*watchdir_func_t)(int dirfd, int event, const char* fn, voi
 // files to be added.
 #define WATCH_EVENT_WAITING 2
 
+// These events occur when a file is removed from the directory,
+// and when its contents are replaced (it is opened with O_TRUNC).
+#define WATCH_EVENT_REMOVE_FILE 3
+#define WATCH_EVENT_MODIFY_FILE 4
+
 // Call cb for each file in directory and each time a
 // new file is added to the directory, and also, first,
 // for each existing file in the directory.  If cb
 // returns non-zero, stop watching and return NO_ERROR.
+// Should events be lost, the existing files are passed
+// to cb again, so a file may be reported as added more
+// than once.
 mx_status_t mxio_watch_directory(int dirfd, watchdir_func_t cb, void* cookie);
 __END_CDECLS
@@ -12,6 +12,7 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <stdarg.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -48,12 +49,107 @@ static const char* libpaths[] = {
     "/boot/lib",
 };
 
+// Libraries and interpreters loaded through default_load_object are kept
+// around, keyed by path and the identity of the file found there, so that
+// launching many processes doesn't open and read the same files over and
+// over. A hit hands out a duplicate of the cached read-only VMO; the
+// loader clones whatever it needs to write to.
+#define LOAD_CACHE_SIZE 32
+
+typedef struct load_cache_entry {
+    char path[PATH_MAX];
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    mx_handle_t vmo;
+    uint64_t last_used;
+} load_cache_entry_t;
+
+static mtx_t load_cache_lock = MTX_INIT;
+static load_cache_entry_t load_cache[LOAD_CACHE_SIZE];
+static uint64_t load_cache_clock;
+
+static bool load_cache_match(const load_cache_entry_t* e, const char* path,
+                             const struct stat* st) {
+    return (e->vmo != MX_HANDLE_INVALID) && !strcmp(e->path, path) &&
+        (e->ino == st->st_ino) && (e->size == st->st_size) &&
+        (e->mtime.tv_sec == st->st_mtim.tv_sec) &&
+        (e->mtime.tv_nsec == st->st_mtim.tv_nsec);
+}
+
+static mx_handle_t load_cache_lookup(const char* path, const struct stat* st) {
+    mx_handle_t vmo = MX_HANDLE_INVALID;
+    mtx_lock(&load_cache_lock);
+    for (unsigned n = 0; n < countof(load_cache); n++) {
+        load_cache_entry_t* e = &load_cache[n];
+        if (load_cache_match(e, path, st)) {
+            if (mx_handle_duplicate(e->vmo, MX_RIGHT_SAME_RIGHTS, &vmo) != NO_ERROR) {
+                vmo = MX_HANDLE_INVALID;
+            } else {
+                e->last_used = ++load_cache_clock;
+            }
+            break;
+        }
+    }
+    mtx_unlock(&load_cache_lock);
+    return vmo;
+}
+
+// Replaces any stale entry for the path, or else the least recently used one
+static void load_cache_insert(const char* path, const struct stat* st, mx_handle_t vmo) {
+    if (strlen(path) >= sizeof(load_cache[0].path)) {
+        return;
+    }
+    mx_handle_t dup;
+    if (mx_handle_duplicate(vmo, MX_RIGHT_SAME_RIGHTS, &dup) != NO_ERROR) {
+        return;
+    }
+
+    mtx_lock(&load_cache_lock);
+    load_cache_entry_t* victim = &load_cache[0];
+    for (unsigned n = 0; n < countof(load_cache); n++) {
+        load_cache_entry_t* e = &load_cache[n];
+        if ((e->vmo == MX_HANDLE_INVALID) || !strcmp(e->path, path)) {
+            victim = e;
+            break;
+        }
+        if (e->last_used < victim->last_used) {
+            victim = e;
+        }
+    }
+    mx_handle_t old = victim->vmo;
+    strcpy(victim->path, path);
+    victim->ino = st->st_ino;
+    victim->size = st->st_size;
+    victim->mtime = st->st_mtim;
+    victim->vmo = dup;
+    victim->last_used = ++load_cache_clock;
+    mtx_unlock(&load_cache_lock);
+
+    if (old != MX_HANDLE_INVALID) {
+        mx_handle_close(old);
+    }
+}
+
 // Always consumes the fd.
-static mx_handle_t load_object_fd(int fd) {
+static mx_handle_t load_object_fd(int fd, const char* path) {
+    struct stat st;
+    bool cacheable = fstat(fd, &st) == 0;
     mx_handle_t vmo;
+    if (cacheable && ((vmo = load_cache_lookup(path, &st)) != MX_HANDLE_INVALID)) {
+        close(fd);
+        return vmo;
+    }
+
     mx_status_t status = mxio_get_vmo(fd, &vmo);
     close(fd);
-    return status == NO_ERROR ? vmo : status;
+    if (status != NO_ERROR) {
+        return status;
+    }
+    if (cacheable) {
+        load_cache_insert(path, &st, vmo);
+    }
+    return vmo;
 }
 
 static mx_handle_t default_load_object(void* ignored,
@@ -67,7 +163,7 @@ static mx_handle_t default_load_object(void* ignored,
             snprintf(path, sizeof(path), "%s/%s", libpaths[n], fn);
             int fd = open(path, O_RDONLY);
             if (fd >= 0)
-                return load_object_fd(fd);
+                return load_object_fd(fd, path);
         }
         break;
     case LOADER_SVC_OP_LOAD_SCRIPT_INTERP:
@@ -79,7 +175,7 @@ static mx_handle_t default_load_object(void* ignored,
         }
         int fd = open(fn, O_RDONLY);
         if (fd >= 0)
-            return load_object_fd(fd);
+            return load_object_fd(fd, fn);
         break;
     default:
         __builtin_trap();
@@ -121,8 +217,7 @@ static mx_status_t handle_loader_rpc(mx_handle_t h, mxio_loader_service_function
     switch (msg->opcode) {
     case LOADER_SVC_OP_LOAD_OBJECT:
     case LOADER_SVC_OP_LOAD_SCRIPT_INTERP:
-        // TODO(MG-491): Use a threadpool for loading, and guard against
-        // other starvation attacks.
+        // TODO(MG-491): Guard against starvation attacks.
         handle = (*loader)(loader_arg, msg->opcode, (const char*) msg->data);
         msg->arg = handle < 0 ? handle : NO_ERROR;
         break;
@@ -178,6 +273,10 @@ done:
     return 0;
 }
 
+// Requests from separate channels are answered concurrently; the only
+// state they share is the load cache, which has a lock of its own.
+#define MULTILOADER_THREADS 4
+
 struct mxio_multiloader {
     char name[MX_MAX_NAME_LEN];
     mtx_t dispatcher_lock;
@@ -228,7 +327,8 @@ mx_handle_t mxio_multiloader_new_service(mxio_multiloader_t* ml) {
                                         multiloader_cb)) < 0) {
             goto done;
         }
-        if ((r = mxio_dispatcher_start(ml->dispatcher, ml->name)) < 0) {
+        if ((r = mxio_dispatcher_start_pool(ml->dispatcher, ml->name,
+                                            MULTILOADER_THREADS)) < 0) {
             //TODO: destroy dispatcher once support exists
             ml->dispatcher = NULL;
             goto done;
@@ -5,7 +5,10 @@
 #include <mxio/io.h>
 
 #include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <threads.h>
 
 #include <magenta/syscalls.h>
@@ -14,14 +17,112 @@
 
 #include "private.h"
 
+// How many bytes of entries a batched logger holds while its thread is
+// busy writing out the last lot; lines beyond that are counted and dropped.
+#define LOGQ_MAX (4 * MX_LOG_WRITE_MULTIPLE_MAX)
+
+typedef struct mxio_logq {
+    mtx_t lock;
+    cnd_t work;
+    thrd_t thread;
+    bool closing;
+    uint32_t dropped;
+    // lines are queued in buf while the thread writes out spare
+    size_t len;
+    char* buf;
+    char* spare;
+    char bufs[2][LOGQ_MAX] __ALIGNED(4);
+} mxio_logq_t;
+
 typedef struct mxio_log mxio_log_t;
 struct mxio_log {
     mxio_t io;
     mx_handle_t handle;
+    mxio_logq_t* q; // NULL unless batched
 };
 
 #define LOGBUF_MAX (MX_LOG_RECORD_MAX - sizeof(mx_log_record_t))
 
+// Writes out |len| bytes of entries, as few calls as it takes.
+static void log_submit(mx_handle_t h, const char* buf, size_t len) {
+    while (len > 0) {
+        size_t n = 0;
+        while (n < len) {
+            size_t sz = MX_LOG_ENTRY_SIZE((const mx_log_entry_t*)(buf + n));
+            if (n + sz > MX_LOG_WRITE_MULTIPLE_MAX) {
+                break;
+            }
+            n += sz;
+        }
+        mx_log_write(h, n, buf, MX_LOG_WRITE_MULTIPLE);
+        buf += n;
+        len -= n;
+    }
+}
+
+static int log_drain(void* arg) {
+    mxio_log_t* log_io = arg;
+    mxio_logq_t* q = log_io->q;
+
+    mtx_lock(&q->lock);
+    for (;;) {
+        if (q->len == 0 && q->dropped == 0) {
+            if (q->closing) {
+                break;
+            }
+            cnd_wait(&q->work, &q->lock);
+            continue;
+        }
+        char* buf = q->buf;
+        size_t len = q->len;
+        uint32_t dropped = q->dropped;
+        q->buf = q->spare;
+        q->spare = buf;
+        q->len = 0;
+        q->dropped = 0;
+        mtx_unlock(&q->lock);
+
+        log_submit(log_io->handle, buf, len);
+        if (dropped > 0) {
+            // The dropped lines all came after the ones just written.
+            char msg[64];
+            int n = snprintf(msg, sizeof(msg), "mxio: %u log lines dropped", dropped);
+            mx_log_write(log_io->handle, n, msg, 0);
+        }
+
+        mtx_lock(&q->lock);
+    }
+    mtx_unlock(&q->lock);
+    return 0;
+}
+
+static void log_line(mxio_log_t* log_io, const char* data, size_t len) {
+    mxio_logq_t* q = log_io->q;
+    if (q == NULL) {
+        mx_log_write(log_io->handle, len, data, 0);
+        return;
+    }
+
+    mtx_lock(&q->lock);
+    size_t sz = (sizeof(mx_log_entry_t) + len + 3u) & ~3u;
+    if (q->closing) {
+        // too late; the thread is gone or about to be
+    } else if (q->len + sz > LOGQ_MAX) {
+        q->dropped++;
+    } else {
+        mx_log_entry_t* entry = (mx_log_entry_t*)(q->buf + q->len);
+        entry->datalen = (uint16_t)len;
+        entry->reserved = 0;
+        memcpy(entry->data, data, len);
+        // The thread only waits with nothing queued.
+        if (q->len == 0) {
+            cnd_signal(&q->work);
+        }
+        q->len += sz;
+    }
+    mtx_unlock(&q->lock);
+}
+
 static ssize_t log_write(mxio_t* io, const void* _data, size_t len) {
     static thread_local struct {
         unsigned next;
@@ -42,7 +143,7 @@ static ssize_t log_write(mxio_t* io, const void* _data, size_t len) {
     while (len-- > 0) {
         char c = *data++;
         if (c == '\n') {
-            mx_log_write(log_io->handle, logbuf->next, logbuf->data, 0);
+            log_line(log_io, logbuf->data, logbuf->next);
             logbuf->next = 0;
             continue;
         }
@@ -51,7 +152,7 @@ static ssize_t log_write(mxio_t* io, const void* _data, size_t len) {
         }
         logbuf->data[logbuf->next++] = c;
         if (logbuf->next == LOGBUF_MAX) {
-            mx_log_write(log_io->handle, logbuf->next, logbuf->data, 0);
+            log_line(log_io, logbuf->data, logbuf->next);
             logbuf->next = 0;
             continue;
         }
@@ -61,6 +162,15 @@ static ssize_t log_write(mxio_t* io, const void* _data, size_t len) {
 
 static mx_status_t log_close(mxio_t* io) {
     mxio_log_t* log_io = (mxio_log_t*)io;
+    mxio_logq_t* q = log_io->q;
+    if (q != NULL) {
+        // The thread writes out whatever is queued before it exits.
+        mtx_lock(&q->lock);
+        q->closing = true;
+        cnd_signal(&q->work);
+        mtx_unlock(&q->lock);
+        thrd_join(q->thread, NULL);
+    }
     mx_handle_t h = log_io->handle;
     log_io->handle = 0;
     mx_handle_close(h);
@@ -106,3 +216,26 @@ mxio_t* mxio_logger_create(mx_handle_t handle) {
     log->handle = handle;
     return &log->io;
 }
+
+mxio_t* mxio_logger_create_batched(mx_handle_t handle) {
+    mxio_log_t* log = calloc(1, sizeof(mxio_log_t) + sizeof(mxio_logq_t));
+    if (log == NULL) {
+        return NULL;
+    }
+    log->io.ops = &log_io_ops;
+    log->io.magic = MXIO_MAGIC;
+    atomic_init(&log->io.refcount, 1);
+    log->handle = handle;
+
+    mxio_logq_t* q = (mxio_logq_t*)(log + 1);
+    mtx_init(&q->lock, mtx_plain);
+    cnd_init(&q->work);
+    q->buf = q->bufs[0];
+    q->spare = q->bufs[1];
+    log->q = q;
+    if (thrd_create_with_name(&q->thread, log_drain, log, "mxio-logger") != thrd_success) {
+        // Still a logger, just an unbatched one.
+        log->q = NULL;
+    }
+    return &log->io;
+}
@@ -19,8 +19,24 @@ struct mxrio {
 
     // transaction id used for synchronous remoteio calls
     _Atomic mx_txid_t txid;
+
+    // Read-only files whose server hands out a VMO for them are read
+    // from a local mapping of it; the seek pointer then lives here too.
+    mtx_t map_lock;
+    int map_state;
+    mx_handle_t map_vmo;
+    uintptr_t map_base;
+    size_t map_len;
+    const uint8_t* map_data;
+    mx_off_t map_size;
+    mx_off_t map_ptr;
 };
 
+// map_state
+#define MXRIO_MAP_UNTRIED 0
+#define MXRIO_MAP_MAPPED  1
+#define MXRIO_MAP_NONE    2
+
 // These are for the benefit of namespace.c
 // which needs lower level access to remoteio internals
 
@@ -13,6 +13,7 @@
 #include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <threads.h>
+#include <unistd.h>
 
 #include <magenta/device/device.h>
 #include <magenta/device/ioctl.h>
@@ -24,6 +25,7 @@
 #include <mxio/io.h>
 #include <mxio/remoteio.h>
 #include <mxio/util.h>
+#include <mxio/vfs.h>
 
 #include "private-remoteio.h"
 
@@ -418,16 +420,7 @@ static ssize_t read_common(uint32_t op, mxio_t* io, void* _data, size_t len, off
     return count ? count : r;
 }
 
-static ssize_t mxrio_read(mxio_t* io, void* _data, size_t len) {
-    return read_common(MXRIO_READ, io, _data, len, 0);
-}
-
-static ssize_t mxrio_read_at(mxio_t* io, void* _data, size_t len, mx_off_t offset) {
-    return read_common(MXRIO_READ_AT, io, _data, len, offset);
-}
-
-static off_t mxrio_seek(mxio_t* io, off_t offset, int whence) {
-    mxrio_t* rio = (mxrio_t*)io;
+static off_t seek_remote(mxrio_t* rio, off_t offset, int whence) {
     mxrio_msg_t msg;
     mx_status_t r;
 
@@ -444,6 +437,142 @@ static off_t mxrio_seek(mxio_t* io, off_t offset, int whence) {
     return msg.arg2.off;
 }
 
+// Try to set up a mapping to read the file from. Only read-only
+// filesystems hand out VMOs for files (see Vnode::Mmap), so neither
+// the contents nor the size can change under the mapping. Filesystems
+// opt in by accepting MXIO_MMAP_FLAG_READS.
+static void map_file_locked(mxrio_t* rio) {
+    rio->map_state = MXRIO_MAP_NONE;
+
+    vnattr_t attr;
+    mx_status_t r = mxrio_misc(&rio->io, MXRIO_STAT, 0, sizeof(attr), &attr, 0);
+    if ((r < (mx_status_t)sizeof(attr)) ||
+        ((attr.mode & V_TYPE_MASK) != V_TYPE_FILE) || (attr.size == 0)) {
+        return;
+    }
+
+    mxrio_mmap_data_t data;
+    data.offset = 0;
+    data.length = attr.size;
+    data.flags = MXIO_MMAP_FLAG_READ | MXIO_MMAP_FLAG_READS;
+    if ((r = mxrio_misc(&rio->io, MXRIO_MMAP, 0, sizeof(data), &data, sizeof(data))) < 0) {
+        return;
+    }
+    mx_handle_t vmo = r;
+
+    // Reads carry on from wherever the server's seek pointer got to
+    off_t ptr = seek_remote(rio, 0, SEEK_CUR);
+    if (ptr < 0) {
+        mx_handle_close(vmo);
+        return;
+    }
+
+    size_t start = data.offset & ~(PAGE_SIZE - 1);
+    size_t len = ((data.offset + attr.size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1)) - start;
+    uintptr_t base;
+    if (mx_vmar_map(mx_vmar_root_self(), 0, vmo, start, len,
+                    MX_VM_FLAG_PERM_READ, &base) < 0) {
+        mx_handle_close(vmo);
+        return;
+    }
+
+    rio->map_vmo = vmo;
+    rio->map_base = base;
+    rio->map_len = len;
+    rio->map_data = (const uint8_t*)(base + (data.offset - start));
+    rio->map_size = attr.size;
+    rio->map_ptr = ptr;
+    rio->map_state = MXRIO_MAP_MAPPED;
+}
+
+static void unmap_file(mxrio_t* rio) {
+    mtx_lock(&rio->map_lock);
+    if (rio->map_state == MXRIO_MAP_MAPPED) {
+        mx_vmar_unmap(mx_vmar_root_self(), rio->map_base, rio->map_len);
+        mx_handle_close(rio->map_vmo);
+        rio->map_vmo = MX_HANDLE_INVALID;
+    }
+    rio->map_state = MXRIO_MAP_NONE;
+    mtx_unlock(&rio->map_lock);
+}
+
+// Returns with map_lock held if the file is mapped. A mapping is only
+// set up for reads that would otherwise take more than one message;
+// files which are only read in small pieces never pay for the attempt.
+static bool lock_mapped(mxrio_t* rio, size_t len) {
+    mtx_lock(&rio->map_lock);
+    if ((rio->map_state == MXRIO_MAP_UNTRIED) && (len > MXIO_CHUNK_SIZE)) {
+        map_file_locked(rio);
+    }
+    if (rio->map_state == MXRIO_MAP_MAPPED) {
+        return true;
+    }
+    mtx_unlock(&rio->map_lock);
+    return false;
+}
+
+static size_t read_mapped_locked(mxrio_t* rio, void* data, size_t len, mx_off_t offset) {
+    if (offset >= rio->map_size) {
+        return 0;
+    }
+    if (len > rio->map_size - offset) {
+        len = rio->map_size - offset;
+    }
+    memcpy(data, rio->map_data + offset, len);
+    return len;
+}
+
+static ssize_t mxrio_read(mxio_t* io, void* _data, size_t len) {
+    mxrio_t* rio = (mxrio_t*)io;
+    if (lock_mapped(rio, len)) {
+        len = read_mapped_locked(rio, _data, len, rio->map_ptr);
+        rio->map_ptr += len;
+        mtx_unlock(&rio->map_lock);
+        return len;
+    }
+    return read_common(MXRIO_READ, io, _data, len, 0);
+}
+
+static ssize_t mxrio_read_at(mxio_t* io, void* _data, size_t len, mx_off_t offset) {
+    mxrio_t* rio = (mxrio_t*)io;
+    if (lock_mapped(rio, len)) {
+        len = read_mapped_locked(rio, _data, len, offset);
+        mtx_unlock(&rio->map_lock);
+        return len;
+    }
+    return read_common(MXRIO_READ_AT, io, _data, len, offset);
+}
+
+static off_t mxrio_seek(mxio_t* io, off_t offset, int whence) {
+    mxrio_t* rio = (mxrio_t*)io;
+    if (!lock_mapped(rio, 0)) {
+        return seek_remote(rio, offset, whence);
+    }
+
+    off_t at;
+    switch (whence) {
+    case SEEK_SET:
+        at = offset;
+        break;
+    case SEEK_CUR:
+        at = rio->map_ptr + offset;
+        break;
+    case SEEK_END:
+        at = rio->map_size + offset;
+        break;
+    default:
+        mtx_unlock(&rio->map_lock);
+        return ERR_INVALID_ARGS;
+    }
+    if (at < 0) {
+        at = ERR_INVALID_ARGS;
+    } else {
+        rio->map_ptr = at;
+    }
+    mtx_unlock(&rio->map_lock);
+    return at;
+}
+
 mx_status_t mxrio_close(mxio_t* io) {
     mxrio_t* rio = (mxrio_t*)io;
     mxrio_msg_t msg;
@@ -456,6 +585,8 @@ mx_status_t mxrio_close(mxio_t* io) {
         discard_handles(msg.handle, msg.hcount);
     }
 
+    unmap_file(rio);
+
     mx_handle_t h = rio->h;
     rio->h = 0;
     mx_handle_close(h);
@@ -829,6 +960,15 @@ mx_status_t __mxrio_clone(mx_handle_t h, mx_handle_t* handles, uint32_t* types)
 static mx_status_t mxrio_unwrap(mxio_t* io, mx_handle_t* handles, uint32_t* types) {
     mxrio_t* rio = (void*)io;
     mx_status_t r;
+
+    // Whoever gets the handle picks up at the server's seek pointer
+    mtx_lock(&rio->map_lock);
+    if (rio->map_state == MXRIO_MAP_MAPPED) {
+        seek_remote(rio, rio->map_ptr, SEEK_SET);
+    }
+    mtx_unlock(&rio->map_lock);
+    unmap_file(rio);
+
     handles[0] = rio->h;
     types[0] = PA_MXIO_REMOTE;
     if (rio->h2 != 0) {
@@ -885,5 +1025,6 @@ mxio_t* mxio_remote_create(mx_handle_t h, mx_handle_t e) {
     atomic_init(&rio->io.refcount, 1);
     rio->h = h;
     rio->h2 = e;
+    mtx_init(&rio->map_lock, mtx_plain);
     return &rio->io;
 }
@@ -660,6 +660,20 @@ ssize_t mxio_ioctl(int fd, int op, const void* in_buf, size_t in_len, void* out_
     return r;
 }
 
+ssize_t mxio_readdir_plus(int fd, void* buf, size_t len, bool rewind) {
+    mxio_t* io;
+    if ((io = fd_to_io(fd)) == NULL) {
+        return ERR_BAD_HANDLE;
+    }
+    if (len > MXIO_CHUNK_SIZE) {
+        len = MXIO_CHUNK_SIZE;
+    }
+    int64_t cmd = rewind ? READDIR_CMD_RESET : READDIR_CMD_NONE;
+    ssize_t r = io->ops->misc(io, MXRIO_READDIR_PLUS, cmd, len, buf, 0);
+    mxio_release(io);
+    return r;
+}
+
 mx_status_t mxio_wait(mxio_t* io, uint32_t events, mx_time_t deadline,
                       uint32_t* out_pending) {
     mx_handle_t h = MX_HANDLE_INVALID;
@@ -6,6 +6,7 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <magenta/syscalls.h>
@@ -17,6 +18,10 @@
 struct mxio_watcher {
     mx_handle_t h;
     bool want_waiting_event;
+    // the last message read, of which off bytes have been handed out
+    size_t off;
+    size_t len;
+    uint8_t buf[VFS_WATCH_MSG_MAX];
 };
 
 mx_status_t mxio_watcher_create(int dirfd, mxio_watcher_t** out) {
@@ -32,15 +37,33 @@ mx_status_t mxio_watcher_create(int dirfd, mxio_watcher_t** out) {
     }
 
     watcher->want_waiting_event = false;
+    watcher->off = 0;
+    watcher->len = 0;
     *out = watcher;
     return NO_ERROR;
 }
 
-mx_status_t mxio_watcher_wait(mxio_watcher_t* watcher, char name[MXIO_MAX_FILENAME + 1]) {
+// Returns the next event, one of VFS_WATCH_EVT_*, and the name it is about.
+static mx_status_t mxio_watcher_next(mxio_watcher_t* watcher, unsigned* event,
+                                     char name[MXIO_MAX_FILENAME + 1]) {
     for (;;) {
+        if (watcher->off < watcher->len) {
+            vfs_watch_msg_t* msg = (vfs_watch_msg_t*)(watcher->buf + watcher->off);
+            size_t avail = watcher->len - watcher->off;
+            if ((avail < sizeof(*msg)) || (avail - sizeof(*msg) < msg->len)) {
+                watcher->len = 0;
+                return ERR_IO;
+            }
+            memcpy(name, msg->name, msg->len);
+            name[msg->len] = 0;
+            *event = msg->event;
+            watcher->off += sizeof(*msg) + msg->len;
+            return NO_ERROR;
+        }
+
         mx_status_t status;
-        uint32_t sz = MXIO_MAX_FILENAME;
-        if ((status = mx_channel_read(watcher->h, 0, name, NULL, sz, 0, &sz, NULL)) < 0) {
+        uint32_t sz = sizeof(watcher->buf);
+        if ((status = mx_channel_read(watcher->h, 0, watcher->buf, NULL, sz, 0, &sz, NULL)) < 0) {
             if (status != ERR_SHOULD_WAIT) {
                 return status;
             }
@@ -55,8 +78,21 @@ mx_status_t mxio_watcher_wait(mxio_watcher_t* watcher, char name[MXIO_MAX_FILENA
             }
             continue;
         }
-        name[sz] = 0;
-        return NO_ERROR;
+        watcher->off = 0;
+        watcher->len = sz;
+    }
+}
+
+mx_status_t mxio_watcher_wait(mxio_watcher_t* watcher, char name[MXIO_MAX_FILENAME + 1]) {
+    for (;;) {
+        unsigned event;
+        mx_status_t status;
+        if ((status = mxio_watcher_next(watcher, &event, name)) < 0) {
+            return status;
+        }
+        if (event == VFS_WATCH_EVT_ADDED) {
+            return NO_ERROR;
+        }
     }
 }
 
@@ -65,10 +101,10 @@ void mxio_watcher_destroy(mxio_watcher_t* watcher) {
     free(watcher);
 }
 
-mx_status_t mxio_watch_directory(int dirfd, watchdir_func_t cb, void *cookie) {
-    char name[MXIO_MAX_FILENAME + 1];
-    mxio_watcher_t* watcher;
-
+// Calls cb for each file in the directory, leaving in cb_status NO_ERROR if
+// cb was happy to see them all, or else what cb returned.
+static mx_status_t mxio_watch_scan(int dirfd, watchdir_func_t cb, void* cookie,
+                                   mx_status_t* cb_status) {
     DIR* dir;
 
     {
@@ -85,13 +121,7 @@ mx_status_t mxio_watch_directory(int dirfd, watchdir_func_t cb, void *cookie) {
         }
     }
 
-    mx_status_t status;
-    if ((status = mxio_watcher_create(dirfd, &watcher)) < 0) {
-        closedir(dir);
-        return status;
-    }
-    watcher->want_waiting_event = true;
-
+    *cb_status = NO_ERROR;
     struct dirent* de;
     while ((de = readdir(dir)) != NULL) {
         if (de->d_name[0] == '.') {
@@ -102,18 +132,54 @@ mx_status_t mxio_watch_directory(int dirfd, watchdir_func_t cb, void *cookie) {
                 continue;
             }
         }
-        if (cb(dirfd, WATCH_EVENT_ADD_FILE, de->d_name, cookie) != NO_ERROR) {
-            closedir(dir);
-            return NO_ERROR;
+        if ((*cb_status = cb(dirfd, WATCH_EVENT_ADD_FILE, de->d_name, cookie)) != NO_ERROR) {
+            break;
         }
     }
     closedir(dir);
+    return NO_ERROR;
+}
+
+mx_status_t mxio_watch_directory(int dirfd, watchdir_func_t cb, void *cookie) {
+    char name[MXIO_MAX_FILENAME + 1];
+    mxio_watcher_t* watcher;
+
+    mx_status_t status;
+    if ((status = mxio_watcher_create(dirfd, &watcher)) < 0) {
+        return status;
+    }
+    watcher->want_waiting_event = true;
+
+    // Events from before the scan may repeat what it finds.
+    mx_status_t cb_status;
+    if ((status = mxio_watch_scan(dirfd, cb, cookie, &cb_status)) != NO_ERROR ||
+        cb_status != NO_ERROR) {
+        mxio_watcher_destroy(watcher);
+        return status;
+    }
 
     do {
-        status = mxio_watcher_wait(watcher, name);
+        unsigned event;
+        status = mxio_watcher_next(watcher, &event, name);
         switch (status) {
         case NO_ERROR:
-            status = cb(dirfd, WATCH_EVENT_ADD_FILE, name, cookie);
+            switch (event) {
+            case VFS_WATCH_EVT_ADDED:
+                status = cb(dirfd, WATCH_EVENT_ADD_FILE, name, cookie);
+                break;
+            case VFS_WATCH_EVT_REMOVED:
+                status = cb(dirfd, WATCH_EVENT_REMOVE_FILE, name, cookie);
+                break;
+            case VFS_WATCH_EVT_MODIFIED:
+                status = cb(dirfd, WATCH_EVENT_MODIFY_FILE, name, cookie);
+                break;
+            case VFS_WATCH_EVT_OVERFLOW:
+                // Events were lost; what is there now is all there is to know.
+                if ((status = mxio_watch_scan(dirfd, cb, cookie, &cb_status)) == NO_ERROR) {
+                    status = cb_status;
+                }
+                break;
+            }
             break;
         case ERR_SHOULD_WAIT:
             status = cb(dirfd, WATCH_EVENT_WAITING, NULL, cookie);
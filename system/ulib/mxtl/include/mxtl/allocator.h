@@ -0,0 +1,45 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// TODO(vtl): Rectify this difference.
+#ifdef _KERNEL
+#include <new.h>
+#else
+#include <magenta/new.h>
+#endif
+
+namespace mxtl {
+
+// DefaultAllocator
+//
+// Where the growable containers (Vector, InlineString) get their heap
+// storage from, unless told otherwise.
+//
+// An allocator for these containers is a class with two static methods...
+//
+// Allocate : Returns |bytes| bytes of storage, aligned for any fundamental
+//            type, and arms |ac| with whether that worked, in the same way
+//            new (&ac) does.
+// Free     : Gives back storage which came from Allocate.
+//
+// The methods are static, so the containers don't carry any allocator state
+// around with them.  Backing a container with an arena or a slab means
+// writing a small allocator class whose methods go to that arena, which is
+// usually a global or per-thread one.
+struct DefaultAllocator {
+    static void* Allocate(size_t bytes, AllocChecker* ac) {
+        return new (ac) uint8_t[bytes];
+    }
+
+    static void Free(void* ptr) {
+        delete[] static_cast<uint8_t*>(ptr);
+    }
+};
+
+}  // namespace mxtl
@@ -0,0 +1,15 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+
+namespace mxtl {
+
+// The cache line size to pad to when keeping data written by different cpus
+// apart.  This is 64 bytes on all of the architectures we run on.
+constexpr size_t kCacheLineSize = 64;
+
+}  // namespace mxtl
@@ -0,0 +1,187 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+#include <magenta/assert.h>
+#include <mxtl/allocator.h>
+#include <mxtl/macros.h>
+#include <mxtl/string_piece.h>
+
+namespace mxtl {
+
+// InlineString
+//
+// An owned, NUL terminated, mutable string which keeps up to
+// |inline_capacity| characters inside the object itself and only goes to
+// |Allocator| (see mxtl/allocator.h) for longer ones.  Most names and paths
+// fit in the default String, so building one is a copy, not a malloc.
+//
+// It converts to a StringPiece, which is how it is compared and passed
+// around; it doesn't duplicate StringPiece's interface.
+//
+// Operations which may allocate take an AllocChecker, which is always armed;
+// if the allocation failed it doesn't check and the string is left
+// unchanged:
+//
+//   mxtl::String name;
+//   AllocChecker ac;
+//   name.Set(args->name, &ac);
+//   if (!ac.check())
+//       return ERR_NO_MEMORY;
+//
+// Any StringPiece argument may point into the string itself.
+template <size_t inline_capacity, typename Allocator = DefaultAllocator>
+class InlineString {
+public:
+    InlineString() : data_(inline_) { inline_[0] = '\0'; }
+
+    InlineString(StringPiece str, AllocChecker* ac) : InlineString() { Set(str, ac); }
+
+    InlineString(InlineString&& other) : InlineString() { MoveFrom(&other); }
+
+    InlineString& operator=(InlineString&& other) {
+        if (this != &other) {
+            reset();
+            MoveFrom(&other);
+        }
+        return *this;
+    }
+
+    ~InlineString() { reset(); }
+
+    DISALLOW_COPY_AND_ASSIGN_ALLOW_MOVE(InlineString);
+
+    const char* data()   const { return data_; }
+    const char* c_str()  const { return data_; }
+    size_t      length() const { return length_; }
+    size_t      size()   const { return length_; }
+    bool      is_empty() const { return length_ == 0; }
+
+    // The longest string which fits in the current storage.
+    size_t capacity() const { return capacity_; }
+
+    char operator[](size_t i) const {
+        MX_DEBUG_ASSERT(i < length_);
+        return data_[i];
+    }
+
+    StringPiece ToStringPiece() const { return StringPiece(data_, length_); }
+    operator StringPiece() const { return ToStringPiece(); }
+
+    // Set
+    //
+    // Replaces the contents with |str|.
+    void Set(StringPiece str, AllocChecker* ac) {
+        Assign(0, str, ac);
+    }
+
+    // Append
+    //
+    // Adds |str| to the end.  The storage at least doubles when it has to
+    // grow, so building a string piece by piece is linear.
+    void Append(StringPiece str, AllocChecker* ac) {
+        Assign(length_, str, ac);
+    }
+
+    // reserve
+    //
+    // Makes room for at least |capacity| characters (not counting the NUL).
+    void reserve(size_t capacity, AllocChecker* ac) {
+        if (capacity <= capacity_) {
+            ac->arm(0, true);
+            return;
+        }
+        char* data = static_cast<char*>(Allocator::Allocate(capacity + 1, ac));
+        if (!CheckAndRearm(ac, capacity))
+            return;
+        memcpy(data, data_, length_ + 1);
+        Replace(data, capacity);
+    }
+
+    // clear
+    //
+    // Empties the string, but keeps the storage for reuse.
+    void clear() {
+        length_ = 0;
+        data_[0] = '\0';
+    }
+
+    // reset
+    //
+    // Empties the string and gives back any heap storage.
+    void reset() {
+        Replace(inline_, inline_capacity);
+        clear();
+    }
+
+private:
+    static_assert(inline_capacity > 0, "InlineString needs room for at least one character");
+
+    bool is_inline() const { return data_ == inline_; }
+
+    static bool CheckAndRearm(AllocChecker* ac, size_t capacity) {
+        bool ok = ac->check();
+        ac->arm(capacity + 1, ok);
+        return ok;
+    }
+
+    // Puts |str| at offset |pos|, which is at most length_, and ends the
+    // string after it.
+    void Assign(size_t pos, StringPiece str, AllocChecker* ac) {
+        MX_DEBUG_ASSERT(pos <= length_);
+        size_t length = pos + str.length();
+        if (length <= capacity_) {
+            ac->arm(0, true);
+            memmove(data_ + pos, str.data(), str.length());
+        } else {
+            size_t capacity = (capacity_ * 2 > length) ? capacity_ * 2 : length;
+            char* data = static_cast<char*>(Allocator::Allocate(capacity + 1, ac));
+            if (!CheckAndRearm(ac, capacity))
+                return;
+            // Copy out before the old storage, which |str| may point into,
+            // goes away.
+            memcpy(data, data_, pos);
+            memcpy(data + pos, str.data(), str.length());
+            Replace(data, capacity);
+        }
+        length_ = length;
+        data_[length_] = '\0';
+    }
+
+    // Switches to |data|, freeing any heap storage in use.
+    void Replace(char* data, size_t capacity) {
+        if (!is_inline())
+            Allocator::Free(data_);
+        data_ = data;
+        capacity_ = capacity;
+    }
+
+    // Takes |other|'s contents, leaving it empty.  |this| must be empty and
+    // inline.
+    void MoveFrom(InlineString* other) {
+        if (other->is_inline()) {
+            memcpy(inline_, other->inline_, other->length_ + 1);
+        } else {
+            data_ = other->data_;
+            capacity_ = other->capacity_;
+            other->data_ = other->inline_;
+            other->capacity_ = inline_capacity;
+        }
+        length_ = other->length_;
+        other->clear();
+    }
+
+    char* data_;
+    size_t length_ = 0;
+    size_t capacity_ = inline_capacity;
+    char inline_[inline_capacity + 1];
+};
+
+// Fits the common 31 character device and file names inline.
+using String = InlineString<31>;
+
+}  // namespace mxtl
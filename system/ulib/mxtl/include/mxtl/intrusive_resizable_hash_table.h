@@ -0,0 +1,627 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <magenta/assert.h>
+#include <mxtl/intrusive_container_utils.h>
+#include <mxtl/intrusive_pointer_traits.h>
+#include <mxtl/intrusive_single_list.h>
+#include <mxtl/macros.h>
+
+// TODO(vtl): Rectify this difference.
+#ifdef _KERNEL
+#include <new.h>
+#else
+#include <magenta/new.h>
+#endif
+
+namespace mxtl {
+
+// DefaultResizableHashTraits defines the default hash function for a
+// ResizableHashTable.  Unlike the fixed size HashTable, the hash does not
+// need to be reduced to a bucket index; the table takes care of that, so a
+// hash traits class only needs...
+//
+// GetHash : A static method which takes a constant reference to an instance
+//           of the container's KeyType and returns a size_t hash of it.
+//
+// The default calls a static GetHash method of ObjType.
+template <typename KeyType, typename ObjType>
+struct DefaultResizableHashTraits {
+    static size_t GetHash(const KeyType& key) {
+        return static_cast<size_t>(ObjType::GetHash(key));
+    }
+};
+
+// ResizableHashTable
+//
+// An intrusive hash table which works like HashTable, but grows its bucket
+// array as elements are added instead of having a fixed number of buckets.
+//
+// The first kInitialBuckets buckets are stored inline, so a table which
+// stays small never allocates.  Once the table holds more elements than it
+// has buckets, a bucket array twice the size is allocated and elements are
+// moved over to it a few buckets at a time by each following insert, so no
+// single insert ever has to rehash the whole table.  While that happens,
+// lookups check whichever of the two arrays the key currently lives in.
+// Old bucket i only ever splits into new buckets 2i and 2i + 1, so those are
+// constructed as they are needed, and the new array isn't touched up front
+// either.
+//
+// Growing is best effort: if the new array can't be allocated the table
+// keeps working with longer chains, and tries again on a later insert.  The
+// table never shrinks, except for clear() which releases everything.
+//
+// Since inserts move elements between buckets, they invalidate all
+// iterators.  Erasing does not move other elements, so it is safe to erase
+// while iterating.
+template <typename  _KeyType,
+          typename  _PtrType,
+          typename  _BucketType = SinglyLinkedList<_PtrType>,
+          typename  _KeyTraits  = DefaultKeyedObjectTraits<
+                                    _KeyType,
+                                    typename internal::ContainerPtrTraits<_PtrType>::ValueType>,
+          typename  _HashTraits = DefaultResizableHashTraits<
+                                    _KeyType,
+                                    typename internal::ContainerPtrTraits<_PtrType>::ValueType>>
+class ResizableHashTable {
+private:
+    // Private fwd decls of the iterator implementation.
+    template <typename IterTraits> class iterator_impl;
+    struct iterator_traits;
+    struct const_iterator_traits;
+
+public:
+    // Pointer types/traits
+    using PtrType      = _PtrType;
+    using PtrTraits    = internal::ContainerPtrTraits<PtrType>;
+    using ValueType    = typename PtrTraits::ValueType;
+
+    // Key types/traits
+    using KeyType      = _KeyType;
+    using KeyTraits    = _KeyTraits;
+
+    // Hash traits
+    using HashTraits   = _HashTraits;
+
+    // Bucket types/traits
+    using BucketType   = _BucketType;
+    using NodeTraits   = typename BucketType::NodeTraits;
+
+    // Declarations of the standard iterator types.
+    using iterator       = iterator_impl<iterator_traits>;
+    using const_iterator = iterator_impl<const_iterator_traits>;
+
+    using ContainerType = ResizableHashTable<_KeyType, _PtrType, _BucketType,
+                                             _KeyTraits, _HashTraits>;
+
+    // The number of buckets a table starts out with, stored inline.  Bucket
+    // counts are always powers of two; the hash is spread over them with a
+    // multiplicative (Fibonacci) hash, so weak low bits in the user's hash
+    // function don't matter.
+    static constexpr size_t kInitialBuckets = 16;
+
+    // The number of old buckets moved to the new array by each insert while
+    // the table is growing.  As the table grows when it holds as many elements
+    // as buckets, this finishes well before the next time it needs to grow.
+    static constexpr size_t kRehashStep = 4;
+
+    static constexpr bool SupportsConstantOrderErase = BucketType::SupportsConstantOrderErase;
+    static constexpr bool SupportsConstantOrderSize = true;
+    static constexpr bool IsAssociative = true;
+    static constexpr bool IsSequenced = false;
+
+    ResizableHashTable() {}
+    ~ResizableHashTable() {
+        MX_DEBUG_ASSERT(PtrTraits::IsManaged || is_empty());
+        FreeBuckets();
+    }
+
+    // Standard begin/end, cbegin/cend iterator accessors.
+    iterator begin()              { return       iterator(this,       iterator::BEGIN); }
+    const_iterator begin()  const { return const_iterator(this, const_iterator::BEGIN); }
+    const_iterator cbegin() const { return const_iterator(this, const_iterator::BEGIN); }
+
+    iterator end()              { return       iterator(this,       iterator::END); }
+    const_iterator end()  const { return const_iterator(this, const_iterator::END); }
+    const_iterator cend() const { return const_iterator(this, const_iterator::END); }
+
+    // make_iterator : construct an iterator out of a reference to an object.
+    iterator make_iterator(ValueType& obj) {
+        size_t ndx = SeqIndex(HashTraits::GetHash(KeyTraits::GetKey(obj)));
+        return iterator(this, ndx, SeqBucket(ndx).make_iterator(obj));
+    }
+
+    void insert(const PtrType& ptr) { insert(PtrType(ptr)); }
+    void insert(PtrType&& ptr) {
+        MX_DEBUG_ASSERT(ptr != nullptr);
+        Rehash();
+        KeyType key = KeyTraits::GetKey(*ptr);
+        BucketType& bucket = GetBucket(key);
+
+        // Duplicate keys are disallowed, see HashTable::insert.
+        MX_DEBUG_ASSERT(FindInBucket(bucket, key).IsValid() == false);
+
+        bucket.push_front(mxtl::move(ptr));
+        ++count_;
+        MaybeGrow();
+    }
+
+    // insert_or_find
+    //
+    // Insert the element pointed to by ptr if it is not already in the
+    // table, or find the element that the ptr collided with instead.
+    //
+    // 'iter' is an optional out parameter pointer to an iterator which
+    // will reference either the newly inserted item, or the item whose key
+    // collided with ptr.
+    //
+    // insert_or_find returns true if there was no collision and the item was
+    // successfully inserted, otherwise it returns false.
+    bool insert_or_find(const PtrType& ptr, iterator* iter = nullptr) {
+        return insert_or_find(PtrType(ptr), iter);
+    }
+
+    bool insert_or_find(PtrType&& ptr, iterator* iter = nullptr) {
+        MX_DEBUG_ASSERT(ptr != nullptr);
+        Rehash();
+        KeyType  key         = KeyTraits::GetKey(*ptr);
+        size_t   hash        = HashTraits::GetHash(key);
+        size_t   ndx         = SeqIndex(hash);
+        auto&    bucket      = SeqBucket(ndx);
+        auto     bucket_iter = FindInBucket(bucket, key);
+
+        if (bucket_iter.IsValid()) {
+            if (iter) *iter = iterator(this, ndx, bucket_iter);
+            return false;
+        }
+
+        bucket.push_front(mxtl::move(ptr));
+        ++count_;
+        MaybeGrow();
+        if (iter) *iter = iterator(this, SeqIndex(hash), bucket.begin());
+        return true;
+    }
+
+    iterator find(const KeyType& key) {
+        size_t ndx         = SeqIndex(HashTraits::GetHash(key));
+        auto&  bucket      = SeqBucket(ndx);
+        auto   bucket_iter = FindInBucket(bucket, key);
+
+        return bucket_iter.IsValid() ? iterator(this, ndx, bucket_iter)
+                                     : iterator(this, iterator::END);
+    }
+
+    const_iterator find(const KeyType& key) const {
+        size_t      ndx         = SeqIndex(HashTraits::GetHash(key));
+        const auto& bucket      = SeqBucket(ndx);
+        auto        bucket_iter = FindInBucket(bucket, key);
+
+        return bucket_iter.IsValid() ? const_iterator(this, ndx, bucket_iter)
+                                     : const_iterator(this, const_iterator::END);
+    }
+
+    PtrType erase(const KeyType& key) {
+        BucketType& bucket = GetBucket(key);
+
+        PtrType ret = internal::KeyEraseUtils<BucketType, KeyTraits>::erase(bucket, key);
+        if (ret != nullptr)
+            --count_;
+
+        return ret;
+    }
+
+    PtrType erase(const iterator& iter) {
+        if (!iter.IsValid())
+            return PtrType(nullptr);
+
+        return direct_erase(SeqBucket(iter.bucket_ndx_), *iter);
+    }
+
+    PtrType erase(ValueType& obj) {
+        return direct_erase(GetBucket(KeyTraits::GetKey(obj)), obj);
+    }
+
+    // clear
+    //
+    // Clear out all of the buckets and go back to the inline ones.  For
+    // managed pointer types, this will release all references held by the
+    // table to the objects which were in it.
+    void clear() {
+        for (size_t i = 0; i < SeqCount(); ++i)
+            SeqBucket(i).clear();
+        FreeBuckets();
+        count_ = 0;
+    }
+
+    // clear_unsafe
+    //
+    // Perform a clear_unsafe on all buckets and reset the internal count to
+    // zero.  See comments in mxtl/intrusive_single_list.h
+    // Think carefully before calling this!
+    void clear_unsafe() {
+        static_assert(PtrTraits::IsManaged == false,
+                     "clear_unsafe is not allowed for containers of managed pointers");
+
+        for (size_t i = 0; i < SeqCount(); ++i)
+            SeqBucket(i).clear_unsafe();
+        FreeBuckets();
+        count_ = 0;
+    }
+
+    size_t size()      const { return count_; }
+    bool   is_empty()  const { return count_ == 0; }
+
+    // The number of buckets new elements are added to.
+    size_t bucket_count() const { return static_cast<size_t>(1) << bits_; }
+
+    // erase_if
+    //
+    // Find the first member of the table which satisfies the predicate
+    // given by 'fn' and erase it, returning a referenced pointer to the
+    // removed element.  Return nullptr if no member satisfies the predicate.
+    template <typename UnaryFn>
+    PtrType erase_if(UnaryFn fn) {
+        if (is_empty())
+            return PtrType(nullptr);
+
+        for (size_t i = 0; i < SeqCount(); ++i) {
+            auto& bucket = SeqBucket(i);
+            if (!bucket.is_empty()) {
+                PtrType ret = bucket.erase_if(fn);
+                if (ret != nullptr) {
+                    --count_;
+                    return ret;
+                }
+            }
+        }
+
+        return PtrType(nullptr);
+    }
+
+    // find_if
+    //
+    // Find the first member of the table which satisfies the predicate
+    // given by 'fn' and return an iterator to it.  Return end() if no member
+    // satisfies the predicate.
+    template <typename UnaryFn>
+    const_iterator find_if(UnaryFn fn) const {
+        for (auto iter = begin(); iter.IsValid(); ++iter)
+            if (fn(*iter))
+                return iter;
+
+        return end();
+    }
+
+    template <typename UnaryFn>
+    iterator find_if(UnaryFn fn) {
+        for (auto iter = begin(); iter.IsValid(); ++iter)
+            if (fn(*iter))
+                return iter;
+
+        return end();
+    }
+
+private:
+    static constexpr size_t kInitialBits = 4;
+    static_assert((static_cast<size_t>(1) << kInitialBits) == kInitialBuckets,
+                  "kInitialBits must match kInitialBuckets");
+    static constexpr size_t kSizeBits = sizeof(size_t) * 8;
+    static constexpr size_t kFibonacci =
+        (sizeof(size_t) == 8) ? static_cast<size_t>(0x9e3779b97f4a7c15ull)
+                              : static_cast<size_t>(0x9e3779b9u);
+
+    // The traits of a non-const iterator
+    struct iterator_traits {
+        using RefType    = typename PtrTraits::RefType;
+        using RawPtrType = typename PtrTraits::RawPtrType;
+        using IterType   = typename BucketType::iterator;
+
+        static IterType BucketBegin(BucketType& bucket) { return bucket.begin(); }
+        static IterType BucketEnd  (BucketType& bucket) { return bucket.end(); }
+    };
+
+    // The traits of a const iterator
+    struct const_iterator_traits {
+        using RefType    = typename PtrTraits::ConstRefType;
+        using RawPtrType = typename PtrTraits::ConstRawPtrType;
+        using IterType   = typename BucketType::const_iterator;
+
+        static IterType BucketBegin(const BucketType& bucket) { return bucket.cbegin(); }
+        static IterType BucketEnd  (const BucketType& bucket) { return bucket.cend(); }
+    };
+
+    // The shared implementation of the iterator.  Iterators walk the buckets
+    // in "sequence" order: the old buckets which haven't been moved yet, and
+    // then the current ones.
+    template <class IterTraits>
+    class iterator_impl {
+    public:
+        iterator_impl() { }
+        iterator_impl(const iterator_impl& other) {
+            hash_table_ = other.hash_table_;
+            bucket_ndx_ = other.bucket_ndx_;
+            iter_       = other.iter_;
+        }
+
+        iterator_impl& operator=(const iterator_impl& other) {
+            hash_table_ = other.hash_table_;
+            bucket_ndx_ = other.bucket_ndx_;
+            iter_       = other.iter_;
+            return *this;
+        }
+
+        bool IsValid() const { return iter_.IsValid(); }
+        bool operator==(const iterator_impl& other) const { return iter_ == other.iter_; }
+        bool operator!=(const iterator_impl& other) const { return iter_ != other.iter_; }
+
+        // Prefix
+        iterator_impl& operator++() {
+            if (!IsValid()) return *this;
+            MX_DEBUG_ASSERT(hash_table_);
+
+            ++iter_;
+            advance_if_invalid_iter();
+
+            return *this;
+        }
+
+        iterator_impl& operator--() {
+            if (!hash_table_) {
+                MX_DEBUG_ASSERT(!IsValid());
+                return *this;
+            }
+
+            --iter_;
+            if (iter_.IsValid())
+                return *this;
+
+            while (bucket_ndx_) {
+                --bucket_ndx_;
+                auto& bucket = GetBucket(bucket_ndx_);
+                if (!bucket.is_empty()) {
+                    iter_ = --IterTraits::BucketEnd(bucket);
+                    MX_DEBUG_ASSERT(iter_.IsValid());
+                    return *this;
+                }
+            }
+
+            bucket_ndx_ = hash_table_->SeqCount() - 1;
+            iter_ = IterTraits::BucketEnd(GetBucket(bucket_ndx_));
+
+            return *this;
+        }
+
+        // Postfix
+        iterator_impl operator++(int) {
+            iterator_impl ret(*this);
+            ++(*this);
+            return ret;
+        }
+
+        iterator_impl operator--(int) {
+            iterator_impl ret(*this);
+            --(*this);
+            return ret;
+        }
+
+        typename PtrTraits::PtrType CopyPointer()          { return iter_.CopyPointer(); }
+        typename IterTraits::RefType operator*()     const { return iter_.operator*(); }
+        typename IterTraits::RawPtrType operator->() const { return iter_.operator->(); }
+
+    private:
+        friend ContainerType;
+        using IterType = typename IterTraits::IterType;
+
+        enum BeginTag { BEGIN };
+        enum EndTag { END };
+
+        iterator_impl(const ContainerType* hash_table, BeginTag)
+            : hash_table_(hash_table),
+              bucket_ndx_(0),
+              iter_(IterTraits::BucketBegin(GetBucket(0))) {
+            advance_if_invalid_iter();
+        }
+
+        iterator_impl(const ContainerType* hash_table, EndTag)
+            : hash_table_(hash_table),
+              bucket_ndx_(hash_table->SeqCount() - 1),
+              iter_(IterTraits::BucketEnd(GetBucket(bucket_ndx_))) { }
+
+        iterator_impl(const ContainerType* hash_table, size_t bucket_ndx, const IterType& iter)
+            : hash_table_(hash_table),
+              bucket_ndx_(bucket_ndx),
+              iter_(iter) { }
+
+        BucketType& GetBucket(size_t ndx) {
+            return const_cast<ContainerType*>(hash_table_)->SeqBucket(ndx);
+        }
+
+        void advance_if_invalid_iter() {
+            if (!iter_.IsValid()) {
+                size_t last = hash_table_->SeqCount() - 1;
+                while (bucket_ndx_ < last) {
+                    ++bucket_ndx_;
+                    auto& bucket = GetBucket(bucket_ndx_);
+
+                    if (!bucket.is_empty()) {
+                        iter_ = IterTraits::BucketBegin(bucket);
+                        MX_DEBUG_ASSERT(iter_.IsValid());
+                        break;
+                    } else if (bucket_ndx_ == last) {
+                        iter_ = IterTraits::BucketEnd(bucket);
+                    }
+                }
+            }
+        }
+
+        const ContainerType* hash_table_ = nullptr;
+        size_t bucket_ndx_ = 0;
+        IterType iter_;
+    };
+
+    PtrType direct_erase(BucketType& bucket, ValueType& obj) {
+        PtrType ret = internal::DirectEraseUtils<BucketType>::erase(bucket, obj);
+
+        if (ret != nullptr)
+            --count_;
+
+        return ret;
+    }
+
+    static typename BucketType::iterator FindInBucket(BucketType& bucket,
+                                                      const KeyType& key) {
+        return bucket.find_if(
+            [key](const ValueType& other) -> bool {
+                return KeyTraits::EqualTo(key, KeyTraits::GetKey(other));
+            });
+    }
+
+    static typename BucketType::const_iterator FindInBucket(const BucketType& bucket,
+                                                            const KeyType& key) {
+        return bucket.find_if(
+            [key](const ValueType& other) -> bool {
+                return KeyTraits::EqualTo(key, KeyTraits::GetKey(other));
+            });
+    }
+
+    // Iterators need to access our buckets in order to iterate.
+    friend iterator;
+    friend const_iterator;
+
+    // Hash tables may not currently be copied, assigned or moved.
+    DISALLOW_COPY_ASSIGN_AND_MOVE(ResizableHashTable);
+
+    static size_t BucketIndex(size_t hash, size_t bits) {
+        return (hash * kFibonacci) >> (kSizeBits - bits);
+    }
+
+    size_t OldCount() const { return old_ ? (static_cast<size_t>(1) << old_bits_) : 0; }
+
+    // The number of old buckets still to be moved.
+    size_t OldLeft() const { return OldCount() - rehash_ndx_; }
+
+    // The number of current buckets which have been constructed.  The rest
+    // can only be filled from old buckets which haven't been moved yet.
+    size_t NewLive() const { return old_ ? (2 * rehash_ndx_) : bucket_count(); }
+
+    size_t SeqCount() const { return OldLeft() + NewLive(); }
+
+    BucketType& SeqBucket(size_t ndx) {
+        size_t old_left = OldLeft();
+        return (ndx < old_left) ? old_[rehash_ndx_ + ndx] : buckets_[ndx - old_left];
+    }
+
+    const BucketType& SeqBucket(size_t ndx) const {
+        return const_cast<ContainerType*>(this)->SeqBucket(ndx);
+    }
+
+    // Elements live in their old bucket until that bucket has been moved.
+    size_t SeqIndex(size_t hash) const {
+        if (old_ != nullptr) {
+            size_t ndx = BucketIndex(hash, old_bits_);
+            if (ndx >= rehash_ndx_)
+                return ndx - rehash_ndx_;
+        }
+        return OldLeft() + BucketIndex(hash, bits_);
+    }
+
+    BucketType& GetBucket(const KeyType& key) {
+        return SeqBucket(SeqIndex(HashTraits::GetHash(key)));
+    }
+
+    // Moves the next few old buckets over to the current array.
+    void Rehash() {
+        for (size_t step = 0; old_ != nullptr && step < kRehashStep; ++step) {
+            new (&buckets_[2 * rehash_ndx_]) BucketType();
+            new (&buckets_[2 * rehash_ndx_ + 1]) BucketType();
+            BucketType& bucket = old_[rehash_ndx_];
+            while (!bucket.is_empty()) {
+                PtrType ptr = bucket.pop_front();
+                size_t hash = HashTraits::GetHash(KeyTraits::GetKey(*ptr));
+                buckets_[BucketIndex(hash, bits_)].push_front(mxtl::move(ptr));
+            }
+            if (++rehash_ndx_ == OldCount()) {
+                if (old_ != inline_buckets_)
+                    DestroyBuckets(old_, OldCount());
+                old_ = nullptr;
+                rehash_ndx_ = 0;
+            }
+        }
+    }
+
+    void MaybeGrow() {
+        if (old_ != nullptr || count_ <= bucket_count() || bits_ >= kSizeBits - 1)
+            return;
+
+        // Just the memory; Rehash constructs the buckets as it goes.
+        AllocChecker ac;
+        uint8_t* mem = new (&ac) uint8_t[bucket_count() * 2 * sizeof(BucketType)];
+        if (!ac.check())
+            return;
+        BucketType* buckets = reinterpret_cast<BucketType*>(mem);
+
+        old_ = buckets_;
+        old_bits_ = bits_;
+        rehash_ndx_ = 0;
+        buckets_ = buckets;
+        ++bits_;
+    }
+
+    static void DestroyBuckets(BucketType* buckets, size_t count) {
+        for (size_t i = 0; i < count; ++i)
+            buckets[i].~BucketType();
+        delete[] reinterpret_cast<uint8_t*>(buckets);
+    }
+
+    // All buckets must be empty.
+    void FreeBuckets() {
+        if (old_ != nullptr && old_ != inline_buckets_)
+            DestroyBuckets(old_, OldCount());
+        if (buckets_ != inline_buckets_)
+            DestroyBuckets(buckets_, NewLive());
+        old_ = nullptr;
+        rehash_ndx_ = 0;
+        buckets_ = inline_buckets_;
+        bits_ = kInitialBits;
+    }
+
+    size_t count_ = 0UL;
+
+    // The buckets new elements go into, 2^bits_ of them.
+    BucketType* buckets_ = inline_buckets_;
+    size_t bits_ = kInitialBits;
+
+    // While growing, the previous buckets, 2^old_bits_ of them, of which
+    // those before rehash_ndx_ have been emptied.
+    BucketType* old_ = nullptr;
+    size_t old_bits_ = 0;
+    size_t rehash_ndx_ = 0;
+
+    BucketType inline_buckets_[kInitialBuckets];
+};
+
+// Explicit declaration of constexpr storage.
+#define RESIZABLE_HASH_TABLE_PROP(_type, _name) \
+template <typename KeyType, typename PtrType, typename BucketType, \
+          typename KeyTraits, typename HashTraits> \
+constexpr _type ResizableHashTable<KeyType, PtrType, BucketType, \
+                                   KeyTraits, HashTraits>::_name
+
+RESIZABLE_HASH_TABLE_PROP(size_t, kInitialBuckets);
+RESIZABLE_HASH_TABLE_PROP(size_t, kRehashStep);
+RESIZABLE_HASH_TABLE_PROP(size_t, kInitialBits);
+RESIZABLE_HASH_TABLE_PROP(size_t, kSizeBits);
+RESIZABLE_HASH_TABLE_PROP(size_t, kFibonacci);
+RESIZABLE_HASH_TABLE_PROP(bool, SupportsConstantOrderErase);
+RESIZABLE_HASH_TABLE_PROP(bool, SupportsConstantOrderSize);
+RESIZABLE_HASH_TABLE_PROP(bool, IsAssociative);
+RESIZABLE_HASH_TABLE_PROP(bool, IsSequenced);
+
+#undef RESIZABLE_HASH_TABLE_PROP
+
+}  // namespace mxtl
@@ -666,6 +666,7 @@ private:
 
             ++count_;
             Observer::RecordInsert();
+            RecordPathChanged(PtrTraits::GetRaw(root_));
             return;
         }
 
@@ -741,6 +742,7 @@ private:
 
         ++count_;
         Observer::RecordInsert();
+        RecordPathChanged(PtrTraits::GetRaw(*owner));
 
         // Finally, perform post-insert balance operations.
         BalancePostInsert(PtrTraits::GetRaw(*owner));
@@ -881,6 +883,7 @@ private:
         // Update the count bookkeeping.
         --count_;
         Observer::RecordErase();
+        RecordPathChanged(parent);
 
         // Time to rebalance.  We know that we don't need to rebalance if we
         // just removed the root (IOW - its parent was the sentinel value).
@@ -1260,6 +1263,25 @@ private:
         Z_ns.parent_ = X;
         if (Y)
             NodeTraits::node_state(*Y).parent_ = Z;
+
+        // Z lost X's subtree and gained Y's, X gained Z.  Everything above X
+        // has the same descendants it had before.
+        if (Observer::kRecordSubtreeChanges) {
+            Observer::RecordSubtreeChanged(Z);
+            Observer::RecordSubtreeChanged(X);
+        }
+    }
+
+    // Report every node from 'node' up to the root as having changed its set
+    // of descendants, for observers which keep per-subtree summaries.
+    void RecordPathChanged(RawPtrType node) {
+        if (!Observer::kRecordSubtreeChanges)
+            return;
+
+        while (PtrTraits::IsValid(node)) {
+            Observer::RecordSubtreeChanged(node);
+            node = NodeTraits::node_state(*node).parent_;
+        }
     }
 
     // PostInsertFixupLR<LRTraits>
@@ -26,7 +26,15 @@ class WAVLTreeChecker;
 // phase of rebalancing are considered to be part of the cost of rotation and
 // are not tallied in the overall promote/demote accounting.
 //
+// Observers may also keep a summary of each subtree in its root node (an
+// "augmented" tree).  When kRecordSubtreeChanges is true, the tree calls
+// RecordSubtreeChanged(node) on every node whose set of descendants changed,
+// children before their parents, so that the summary can be recomputed from
+// the node itself and the summaries of its children.
+//
 struct DefaultWAVLTreeObserver {
+    static constexpr bool kRecordSubtreeChanges = false;
+
     static void RecordInsert()               { }
     static void RecordInsertPromote()        { }
     static void RecordInsertRotation()       { }
@@ -37,6 +45,9 @@ struct DefaultWAVLTreeObserver {
     static void RecordEraseRotation()        { }
     static void RecordEraseDoubleRotation()  { }
 
+    template <typename RawPtrType>
+    static void RecordSubtreeChanged(RawPtrType node) { }
+
     template <typename TreeType>
     static bool VerifyRankRule(const TreeType& tree, typename TreeType::RawPtrType node) {
         return true;
@@ -0,0 +1,129 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+#include <magenta/assert.h>
+#include <mxtl/cache_line.h>
+#include <mxtl/macros.h>
+
+namespace mxtl {
+
+// The link every element of an MpscQueue carries.
+struct MpscQueueNode {
+    MpscQueueNode* mpsc_next_ = nullptr;
+};
+
+// MpscQueueable
+//
+// Objects derive from MpscQueueable<T> to be put in an MpscQueue<T>, the same
+// way they derive from SinglyLinkedListable to be put in a list.  An object
+// can only be in one MpscQueue at a time.
+template <typename T>
+struct MpscQueueable : public MpscQueueNode {
+};
+
+// MpscQueue
+//
+// An intrusive, unbounded FIFO queue which any number of threads can push
+// to, but only one thread pops from.
+//
+// push() is wait-free: a swap of the head pointer and a store, no matter how
+// many other producers there are.  pop() is lock-free and never waits for a
+// producer either; if it catches a producer in the middle of a push (after
+// the swap, before the store), it returns nullptr, even though the queue is
+// not empty, and the consumer should try again later.  A consumer which is
+// woken up by each producer after its push() always finds the element.
+//
+// Memory ordering: a push() happens-before the pop() which returns that
+// element.
+//
+// The queue holds raw pointers and never owns the elements.  It must be
+// empty when it is destroyed.
+template <typename T>
+class MpscQueue {
+public:
+    MpscQueue() : head_(&stub_), tail_(&stub_) {}
+    ~MpscQueue() { MX_DEBUG_ASSERT(is_empty()); }
+
+    // May be called from any thread.
+    void push(T* obj) {
+        MX_DEBUG_ASSERT(obj != nullptr);
+        push_node(static_cast<MpscQueueable<T>*>(obj));
+    }
+
+    // Consumer only.  Returns the oldest element, or nullptr if the queue
+    // is empty or the oldest element is still being pushed.
+    T* pop() {
+        MpscQueueNode* tail = tail_;
+        MpscQueueNode* next = load_next(tail);
+
+        // Skip the stub if it's at the tail.
+        if (tail == &stub_) {
+            if (next == nullptr)
+                return nullptr;
+            tail_ = next;
+            tail = next;
+            next = load_next(tail);
+        }
+
+        if (next != nullptr) {
+            tail_ = next;
+            return to_obj(tail);
+        }
+
+        // tail is the last linked node.  If it isn't the head as well, a
+        // producer has swapped the head but not linked its node in yet.
+        if (tail != __atomic_load_n(&head_, __ATOMIC_ACQUIRE))
+            return nullptr;
+
+        // Put the stub behind tail, so tail can be handed out without
+        // leaving the queue empty of nodes.
+        push_node(&stub_);
+        next = load_next(tail);
+        if (next != nullptr) {
+            tail_ = next;
+            return to_obj(tail);
+        }
+        return nullptr;
+    }
+
+    // Consumer only.  Producers may make the queue non-empty at any time.
+    bool is_empty() const {
+        return tail_ == &stub_ && load_next(&stub_) == nullptr &&
+               __atomic_load_n(&head_, __ATOMIC_ACQUIRE) == &stub_;
+    }
+
+private:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(MpscQueue);
+
+    static MpscQueueNode* load_next(const MpscQueueNode* node) {
+        return __atomic_load_n(&node->mpsc_next_, __ATOMIC_ACQUIRE);
+    }
+
+    static T* to_obj(MpscQueueNode* node) {
+        return static_cast<T*>(static_cast<MpscQueueable<T>*>(node));
+    }
+
+    void push_node(MpscQueueNode* node) {
+        __atomic_store_n(&node->mpsc_next_, nullptr, __ATOMIC_RELAXED);
+        // The acquire half orders our link below after the previous
+        // producer's initialization of prev; the release half publishes
+        // node to the next producer.
+        MpscQueueNode* prev = __atomic_exchange_n(&head_, node, __ATOMIC_ACQ_REL);
+        // Publishes node, and everything written before the push, to the
+        // consumer.
+        __atomic_store_n(&prev->mpsc_next_, node, __ATOMIC_RELEASE);
+    }
+
+    // Swapped by producers.
+    alignas(kCacheLineSize) MpscQueueNode* head_;
+
+    // Only touched by the consumer.
+    alignas(kCacheLineSize) MpscQueueNode* tail_;
+    MpscQueueNode stub_;
+};
+
+}  // namespace mxtl
@@ -28,6 +28,10 @@
 class __TA_CAPABILITY("mutex") Mutex {
 public:
     constexpr Mutex() : mutex_(MUTEX_INITIAL_VALUE(mutex_)) { }
+    // |lock_class| names the lock for lock statistics, such as
+    // "ChannelDispatcher::lock_", so all instances are counted together.
+    explicit constexpr Mutex(const char* lock_class)
+        : mutex_(MUTEX_INITIAL_VALUE_NAMED(mutex_, lock_class)) { }
     ~Mutex() { mutex_destroy(&mutex_); }
     void Acquire() __TA_ACQUIRE() { mutex_acquire(&mutex_); }
     void Release() __TA_RELEASE() { mutex_release(&mutex_); }
@@ -0,0 +1,229 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <magenta/assert.h>
+#include <mxtl/macros.h>
+#include <mxtl/type_support.h>
+
+// TODO(vtl): Rectify this difference.
+#ifdef _KERNEL
+#include <new.h>
+#else
+#include <magenta/new.h>
+#endif
+
+namespace mxtl {
+
+// DefaultOpenHashTraits hashes integer and pointer keys by their value.
+//
+// A traits class for an OpenHashMap must define...
+//
+// GetHash : A static method which takes a constant reference to a key and
+//           returns a size_t hash of it.  The map mixes the bits itself, so
+//           the identity is fine for most keys.
+template <typename KeyType, bool = is_integral<KeyType>::value>
+struct DefaultOpenHashTraits {
+    static size_t GetHash(const KeyType& key) {
+        return static_cast<size_t>(reinterpret_cast<uintptr_t>(key));
+    }
+};
+
+template <typename KeyType>
+struct DefaultOpenHashTraits<KeyType, true> {
+    static size_t GetHash(const KeyType& key) { return static_cast<size_t>(key); }
+};
+
+// OpenHashMap
+//
+// A non-intrusive map for small keys and values, such as from a pointer to an
+// index, which keeps all entries inline in a single array and resolves
+// collisions by linear probing.  A lookup usually touches a single cache
+// line and never chases pointers.
+//
+// The default constructed key (nullptr or 0) marks empty slots, so it can't
+// be stored in the map.  Both KeyType and ValueType must be default
+// constructible and cheap to copy.
+//
+// The array is allocated on the first insert and doubles when it becomes 3/4
+// full, moving every entry, so the cost of an insert is only amortized
+// constant; use ResizableHashTable where a long pause is not acceptable.
+// Erasing shifts the following entries of the probe sequence back, so there
+// are no tombstones and lookups don't slow down as entries come and go.
+//
+// Pointers returned by find() are invalidated by insert and erase.
+template <typename KeyType,
+          typename ValueType,
+          typename HashTraits = DefaultOpenHashTraits<KeyType>>
+class OpenHashMap {
+public:
+    static constexpr size_t kInitialCapacity = 16;
+
+    OpenHashMap() {}
+    ~OpenHashMap() { delete[] slots_; }
+
+    size_t size()     const { return count_; }
+    bool   is_empty() const { return count_ == 0; }
+
+    // The number of slots, of which at most 3/4 are used.
+    size_t capacity() const { return slots_ ? (mask_ + 1) : 0; }
+
+    // insert
+    //
+    // Adds |key| with |value| to the map, and returns true, if it is not
+    // already in it; otherwise leaves the map alone and returns false.  The
+    // AllocChecker is always armed; if growing the map failed it doesn't
+    // check and the entry was not added.
+    bool insert(const KeyType& key, const ValueType& value, AllocChecker* ac) {
+        MX_DEBUG_ASSERT(!IsEmptyKey(key));
+        if (slots_ != nullptr) {
+            size_t ndx = Probe(key);
+            if (!IsEmptyKey(slots_[ndx].key)) {
+                ac->arm(0, true);
+                return false;
+            }
+        }
+        if ((count_ + 1) * 4 > capacity() * 3) {
+            if (!Grow(ac))
+                return false;
+        } else {
+            ac->arm(0, true);
+        }
+        size_t ndx = Probe(key);
+        slots_[ndx].key = key;
+        slots_[ndx].value = value;
+        ++count_;
+        return true;
+    }
+
+    // find
+    //
+    // Returns a pointer to the value stored for |key|, or nullptr.
+    ValueType* find(const KeyType& key) {
+        if (slots_ == nullptr || IsEmptyKey(key))
+            return nullptr;
+        Slot& slot = slots_[Probe(key)];
+        return IsEmptyKey(slot.key) ? nullptr : &slot.value;
+    }
+
+    const ValueType* find(const KeyType& key) const {
+        return const_cast<OpenHashMap*>(this)->find(key);
+    }
+
+    // erase
+    //
+    // Removes |key| from the map; returns false if it wasn't there.
+    bool erase(const KeyType& key) {
+        if (slots_ == nullptr || IsEmptyKey(key))
+            return false;
+        size_t hole = Probe(key);
+        if (IsEmptyKey(slots_[hole].key))
+            return false;
+
+        // Move back any following entry whose home slot is not between the
+        // hole and where it is now, so that probing still finds it.
+        for (size_t ndx = (hole + 1) & mask_; !IsEmptyKey(slots_[ndx].key);
+             ndx = (ndx + 1) & mask_) {
+            size_t home = Home(slots_[ndx].key);
+            if (((ndx - home) & mask_) >= ((ndx - hole) & mask_)) {
+                slots_[hole] = slots_[ndx];
+                hole = ndx;
+            }
+        }
+        slots_[hole] = Slot();
+        --count_;
+        return true;
+    }
+
+    // clear
+    //
+    // Removes all entries, but keeps the array for reuse.
+    void clear() {
+        for (size_t i = 0; i < capacity(); ++i)
+            slots_[i] = Slot();
+        count_ = 0;
+    }
+
+    // for_each
+    //
+    // Calls fn(key, value) for every entry, in no particular order.  The map
+    // must not be modified during the walk.
+    template <typename BinaryFn>
+    void for_each(BinaryFn fn) const {
+        for (size_t i = 0; i < capacity(); ++i) {
+            if (!IsEmptyKey(slots_[i].key))
+                fn(slots_[i].key, slots_[i].value);
+        }
+    }
+
+private:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(OpenHashMap);
+
+    struct Slot {
+        KeyType key = KeyType();
+        ValueType value = ValueType();
+    };
+
+    static constexpr size_t kSizeBits = sizeof(size_t) * 8;
+    static constexpr size_t kFibonacci =
+        (sizeof(size_t) == 8) ? static_cast<size_t>(0x9e3779b97f4a7c15ull)
+                              : static_cast<size_t>(0x9e3779b9u);
+
+    static bool IsEmptyKey(const KeyType& key) { return key == KeyType(); }
+
+    size_t Home(const KeyType& key) const {
+        return (HashTraits::GetHash(key) * kFibonacci) >> (kSizeBits - bits_);
+    }
+
+    // Returns the slot holding |key|, or the empty slot where it would go.
+    // There is always at least one empty slot.
+    size_t Probe(const KeyType& key) const {
+        size_t ndx = Home(key);
+        while (!IsEmptyKey(slots_[ndx].key) && !(slots_[ndx].key == key))
+            ndx = (ndx + 1) & mask_;
+        return ndx;
+    }
+
+    bool Grow(AllocChecker* ac) {
+        size_t capacity = slots_ ? 2 * (mask_ + 1) : kInitialCapacity;
+        Slot* slots = new (ac) Slot[capacity];
+        if (!ac->check()) {
+            // Re-arm so the caller still has something to check.
+            ac->arm(capacity * sizeof(Slot), false);
+            return false;
+        }
+        ac->arm(capacity * sizeof(Slot), true);
+
+        Slot* old = slots_;
+        size_t old_capacity = this->capacity();
+        slots_ = slots;
+        mask_ = capacity - 1;
+        bits_ = 0;
+        while ((static_cast<size_t>(1) << bits_) < capacity)
+            ++bits_;
+        for (size_t i = 0; i < old_capacity; ++i) {
+            if (!IsEmptyKey(old[i].key))
+                slots_[Probe(old[i].key)] = old[i];
+        }
+        delete[] old;
+        return true;
+    }
+
+    Slot* slots_ = nullptr;
+    size_t mask_ = 0;
+    size_t bits_ = 0;
+    size_t count_ = 0;
+};
+
+template <typename KeyType, typename ValueType, typename HashTraits>
+constexpr size_t OpenHashMap<KeyType, ValueType, HashTraits>::kInitialCapacity;
+template <typename KeyType, typename ValueType, typename HashTraits>
+constexpr size_t OpenHashMap<KeyType, ValueType, HashTraits>::kSizeBits;
+template <typename KeyType, typename ValueType, typename HashTraits>
+constexpr size_t OpenHashMap<KeyType, ValueType, HashTraits>::kFibonacci;
+
+}  // namespace mxtl
@@ -0,0 +1,89 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mxtl/atomic.h>
+#include <mxtl/cache_line.h>
+#include <mxtl/macros.h>
+
+#ifdef _KERNEL
+#include <arch/ops.h>
+#endif
+
+namespace mxtl {
+
+namespace internal {
+
+#ifdef _KERNEL
+constexpr size_t kPerCpuCounterShards = SMP_MAX_CPUS;
+
+inline size_t PerCpuCounterShard() {
+    return arch_curr_cpu_num();
+}
+#else
+// Userspace can't ask which cpu it is on, so each thread sticks to one shard
+// instead, handed out round robin.
+constexpr size_t kPerCpuCounterShards = 16;
+
+inline size_t PerCpuCounterShard() {
+    static atomic<size_t> next_shard(0);
+    static __thread size_t shard_plus_one;
+    if (shard_plus_one == 0)
+        shard_plus_one = next_shard.fetch_add(1, memory_order_relaxed) % kPerCpuCounterShards + 1;
+    return shard_plus_one - 1;
+}
+#endif
+
+}  // namespace internal
+
+// PerCpuCounter
+//
+// A statistics counter which is cheap to bump from many cpus at once.  Each
+// cpu (each thread, in userspace) adds to its own cache line, so cpus don't
+// fight over one, and reading sums them up.
+//
+// Adds are relaxed atomic increments, so they are safe without disabling
+// preemption or interrupts; a thread which migrates in between just bumps
+// another cpu's slot.  value() is not a snapshot: adds which race with it may
+// or may not be included, and it imposes no ordering with other memory.
+//
+// The alignment is only honoured for counters which are statics or members of
+// suitably aligned objects; heap allocated ones may share lines at the edges.
+class PerCpuCounter {
+public:
+    constexpr PerCpuCounter() {}
+
+    void Add(int64_t delta) {
+        shards_[internal::PerCpuCounterShard()].value.fetch_add(delta, memory_order_relaxed);
+    }
+    void Inc() { Add(1); }
+    void Dec() { Add(-1); }
+
+    int64_t value() const {
+        int64_t sum = 0;
+        for (const auto& shard : shards_)
+            sum += shard.value.load(memory_order_relaxed);
+        return sum;
+    }
+
+    // Not atomic with respect to concurrent adds.
+    void Reset() {
+        for (auto& shard : shards_)
+            shard.value.store(0, memory_order_relaxed);
+    }
+
+private:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(PerCpuCounter);
+
+    struct alignas(kCacheLineSize) Shard {
+        atomic<int64_t> value = {0};
+    };
+
+    Shard shards_[internal::kPerCpuCounterShards];
+};
+
+}  // namespace mxtl
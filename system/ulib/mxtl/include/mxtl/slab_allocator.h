@@ -433,6 +433,12 @@ public:
 
     size_t max_slabs() const { return max_slabs_; }
 
+    // Occupancy statistics.  These are sampled without the allocator's lock,
+    // so they are only a snapshot and are meant for diagnostics.
+    size_t slab_count() const { return slab_count_; }
+    size_t obj_count() const { return obj_count_; }
+    size_t max_obj_count() const { return max_obj_count_; }
+
 protected:
     void* AllocateLocked() {
         // If we can alloc from the free list, do so.
@@ -486,6 +492,12 @@ private:
     SinglyLinkedList<Slab*>          slab_list_;
     size_t                           slab_count_ = 0;
 
+protected:
+    // Objects currently handed out, and the most ever handed out at once.
+    size_t obj_count_ = 0;
+    size_t max_obj_count_ = 0;
+
+private:
 #if MX_DEBUG_ASSERT_IMPLEMENTED
     inline void inc_free_list_size() { ++free_list_size_; }
     inline void dec_free_list_size() { --free_list_size_; }
@@ -577,13 +589,21 @@ protected:
 
     void* Allocate() {
         AutoLock alloc_lock(&this->alloc_lock_);
-        return AllocateLocked();
+        void* mem = AllocateLocked();
+        if (mem != nullptr) {
+            ++this->obj_count_;
+            if (this->obj_count_ > this->max_obj_count_)
+                this->max_obj_count_ = this->obj_count_;
+        }
+        return mem;
     }
 
     void ReturnToFreeList(void* ptr) {
         FreeListEntry* free_obj = new (ptr) FreeListEntry;
         {
             AutoLock alloc_lock(&alloc_lock_);
+            MX_DEBUG_ASSERT(this->obj_count_ > 0);
+            --this->obj_count_;
             ReturnToFreeListLocked(free_obj);
         }
     }
@@ -802,6 +822,9 @@ public:
     }
 
     static size_t max_slabs() { return allocator_.max_slabs(); }
+    static size_t slab_count() { return allocator_.slab_count(); }
+    static size_t obj_count() { return allocator_.obj_count(); }
+    static size_t max_obj_count() { return allocator_.max_obj_count(); }
 
 private:
     friend class SlabAllocated<SATraits>;           // SlabAllocated<> gets to call ReturnToFreeList
@@ -0,0 +1,91 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+#include <mxtl/atomic.h>
+#include <mxtl/cache_line.h>
+#include <mxtl/macros.h>
+
+namespace mxtl {
+
+// SpscRing
+//
+// A bounded, wait-free ring buffer for passing values from exactly one
+// producer thread to exactly one consumer thread.  push() and pop() never
+// block or retry; they fail when the ring is full or empty instead.
+//
+// The producer's and consumer's indices live on separate cache lines, and
+// each side keeps a cached copy of the other's index, so the shared lines
+// are only read when the ring looks full (or empty) from the cached value.
+//
+// kCapacity must be a power of two.  T must be default constructible and
+// copy assignable; values are copied in and out of the ring.
+//
+// Memory ordering: a push() happens-before the pop() which returns the
+// value, so anything the producer wrote before pushing is visible to the
+// consumer after popping.
+template <typename T, size_t kCapacity>
+class SpscRing {
+public:
+    static_assert(kCapacity > 0 && (kCapacity & (kCapacity - 1)) == 0,
+                  "SpscRing capacity must be a power of two");
+
+    SpscRing() {}
+
+    // Producer side.  Returns false if the ring is full.
+    bool push(const T& value) {
+        size_t head = head_.load(memory_order_relaxed);
+        if (head - cached_tail_ == kCapacity) {
+            cached_tail_ = tail_.load(memory_order_acquire);
+            if (head - cached_tail_ == kCapacity)
+                return false;
+        }
+        slots_[head & kMask] = value;
+        head_.store(head + 1, memory_order_release);
+        return true;
+    }
+
+    // Consumer side.  Returns false if the ring is empty.
+    bool pop(T* out) {
+        size_t tail = tail_.load(memory_order_relaxed);
+        if (tail == cached_head_) {
+            cached_head_ = head_.load(memory_order_acquire);
+            if (tail == cached_head_)
+                return false;
+        }
+        *out = slots_[tail & kMask];
+        tail_.store(tail + 1, memory_order_release);
+        return true;
+    }
+
+    // These may be called from either side, or a third thread, but are
+    // only a snapshot which can be stale by the time it is looked at.
+    size_t size() const {
+        return head_.load(memory_order_acquire) - tail_.load(memory_order_acquire);
+    }
+    bool is_empty() const { return size() == 0; }
+    static constexpr size_t capacity() { return kCapacity; }
+
+private:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(SpscRing);
+
+    static constexpr size_t kMask = kCapacity - 1;
+
+    // Written by the producer.
+    alignas(kCacheLineSize) atomic<size_t> head_ = {0};
+    size_t cached_tail_ = 0;
+
+    // Written by the consumer.
+    alignas(kCacheLineSize) atomic<size_t> tail_ = {0};
+    size_t cached_head_ = 0;
+
+    alignas(kCacheLineSize) T slots_[kCapacity] = {};
+};
+
+template <typename T, size_t kCapacity>
+constexpr size_t SpscRing<T, kCapacity>::kMask;
+
+}  // namespace mxtl
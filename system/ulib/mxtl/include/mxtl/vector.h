@@ -0,0 +1,222 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+#include <magenta/assert.h>
+#include <mxtl/allocator.h>
+#include <mxtl/macros.h>
+#include <mxtl/type_support.h>
+
+namespace mxtl {
+
+namespace internal {
+
+// Uninitialized room for |count| T's inside the owning object.
+template <typename T, size_t count>
+struct VectorInlineStorage {
+    T* get() { return reinterpret_cast<T*>(storage); }
+    const T* get() const { return reinterpret_cast<const T*>(storage); }
+    alignas(T) uint8_t storage[count * sizeof(T)];
+};
+
+template <typename T>
+struct VectorInlineStorage<T, 0> {
+    T* get() { return nullptr; }
+    const T* get() const { return nullptr; }
+};
+
+}  // namespace internal
+
+// Vector
+//
+// A growable array.  The first |inline_count| elements are kept inside the
+// Vector itself, so a Vector sized for the common case (on the stack, or
+// embedded in another object) never goes to the heap unless it overflows.
+// Beyond that, storage comes from |Allocator| (see mxtl/allocator.h) and
+// doubles whenever it fills up.
+//
+// Elements are move constructed into new storage when the Vector grows, so
+// move-only types such as unique_ptr work, and growing a Vector of
+// RefPtrs doesn't touch the reference counts.  Growing invalidates pointers
+// and iterators into the Vector.
+//
+// Operations which may grow the Vector take an AllocChecker, which is always
+// armed; if the allocation failed it doesn't check and the Vector is left
+// unchanged.  For example:
+//
+//   mxtl::Vector<mx_handle_t, 8> handles;
+//   AllocChecker ac;
+//   handles.push_back(handle, &ac);
+//   if (!ac.check())
+//       return ERR_NO_MEMORY;
+template <typename T, size_t inline_count = 0, typename Allocator = DefaultAllocator>
+class Vector {
+public:
+    Vector() : capacity_(inline_count) { data_ = inline_.get(); }
+
+    Vector(Vector&& other) : Vector() { MoveFrom(&other); }
+
+    Vector& operator=(Vector&& other) {
+        if (this != &other) {
+            reset();
+            MoveFrom(&other);
+        }
+        return *this;
+    }
+
+    ~Vector() { reset(); }
+
+    DISALLOW_COPY_AND_ASSIGN_ALLOW_MOVE(Vector);
+
+    size_t size()     const { return size_; }
+    bool   is_empty() const { return size_ == 0; }
+    size_t capacity() const { return capacity_; }
+
+    T*       data()       { return data_; }
+    const T* data() const { return data_; }
+
+    T& operator[](size_t i) {
+        MX_DEBUG_ASSERT(i < size_);
+        return data_[i];
+    }
+    const T& operator[](size_t i) const {
+        MX_DEBUG_ASSERT(i < size_);
+        return data_[i];
+    }
+
+    T* begin() { return data_; }
+    T* end()   { return data_ + size_; }
+    const T* begin() const { return data_; }
+    const T* end()   const { return data_ + size_; }
+
+    // reserve
+    //
+    // Makes room for at least |capacity| elements without growing again.
+    void reserve(size_t capacity, AllocChecker* ac) {
+        if (capacity <= capacity_) {
+            ac->arm(0, true);
+            return;
+        }
+        T* data = static_cast<T*>(Allocator::Allocate(capacity * sizeof(T), ac));
+        if (!CheckAndRearm(ac, capacity))
+            return;
+        MoveTo(data, capacity);
+    }
+
+    void push_back(const T& value, AllocChecker* ac) { emplace_back(ac, value); }
+    void push_back(T&& value, AllocChecker* ac) { emplace_back(ac, mxtl::move(value)); }
+
+    // emplace_back
+    //
+    // Constructs a new last element from |args|, which may refer to an
+    // existing element of the Vector.
+    template <typename... Args>
+    void emplace_back(AllocChecker* ac, Args&&... args) {
+        if (size_ < capacity_) {
+            ac->arm(0, true);
+            new (&data_[size_]) T(mxtl::forward<Args>(args)...);
+            ++size_;
+            return;
+        }
+
+        size_t capacity = capacity_ ? capacity_ * 2 : kMinHeapCapacity;
+        T* data = static_cast<T*>(Allocator::Allocate(capacity * sizeof(T), ac));
+        if (!CheckAndRearm(ac, capacity))
+            return;
+        // Build the new element before the old ones move out from under
+        // |args|.
+        new (&data[size_]) T(mxtl::forward<Args>(args)...);
+        MoveTo(data, capacity);
+        ++size_;
+    }
+
+    void pop_back() {
+        MX_DEBUG_ASSERT(size_ > 0);
+        data_[--size_].~T();
+    }
+
+    // erase
+    //
+    // Removes the element at |index|, moving the ones after it down.
+    void erase(size_t index) {
+        MX_DEBUG_ASSERT(index < size_);
+        for (size_t i = index + 1; i < size_; ++i)
+            data_[i - 1] = mxtl::move(data_[i]);
+        pop_back();
+    }
+
+    // clear
+    //
+    // Destroys all the elements, but keeps the storage for reuse.
+    void clear() {
+        while (size_ > 0)
+            pop_back();
+    }
+
+    // reset
+    //
+    // Destroys all the elements and gives back any heap storage.
+    void reset() {
+        clear();
+        if (!is_inline())
+            Allocator::Free(data_);
+        data_ = inline_.get();
+        capacity_ = inline_count;
+    }
+
+private:
+    static constexpr size_t kMinHeapCapacity = (inline_count * 2 > 4) ? inline_count * 2 : 4;
+
+    bool is_inline() const { return data_ == inline_.get(); }
+
+    static bool CheckAndRearm(AllocChecker* ac, size_t capacity) {
+        // Allocate armed the checker; check it here and arm it again so the
+        // caller still has something to check.
+        bool ok = ac->check();
+        ac->arm(capacity * sizeof(T), ok);
+        return ok;
+    }
+
+    // Moves the elements into |data| and frees the current storage.
+    void MoveTo(T* data, size_t capacity) {
+        for (size_t i = 0; i < size_; ++i) {
+            new (&data[i]) T(mxtl::move(data_[i]));
+            data_[i].~T();
+        }
+        if (!is_inline())
+            Allocator::Free(data_);
+        data_ = data;
+        capacity_ = capacity;
+    }
+
+    // Takes |other|'s elements, leaving it empty.  Heap storage changes hands;
+    // inline elements are moved one by one.  |this| must be empty and inline.
+    void MoveFrom(Vector* other) {
+        if (other->is_inline()) {
+            for (size_t i = 0; i < other->size_; ++i)
+                new (&data_[i]) T(mxtl::move(other->data_[i]));
+            size_ = other->size_;
+            other->clear();
+        } else {
+            data_ = other->data_;
+            size_ = other->size_;
+            capacity_ = other->capacity_;
+            other->data_ = other->inline_.get();
+            other->size_ = 0;
+            other->capacity_ = inline_count;
+        }
+    }
+
+    T* data_;
+    size_t size_ = 0;
+    size_t capacity_;
+    internal::VectorInlineStorage<T, inline_count> inline_;
+};
+
+template <typename T, size_t inline_count, typename Allocator>
+constexpr size_t Vector<T, inline_count, Allocator>::kMinHeapCapacity;
+
+}  // namespace mxtl
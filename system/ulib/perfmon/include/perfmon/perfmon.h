@@ -0,0 +1,39 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <magenta/compiler.h>
+#include <magenta/mtrace.h>
+#include <magenta/types.h>
+
+__BEGIN_CDECLS
+
+// Wrappers for driving the performance monitoring counters through
+// mx_mtrace_control(). Every call needs the root resource, which
+// perfmon_get_resource() fetches from sysinfo.
+
+mx_status_t perfmon_get_resource(mx_handle_t* resource);
+
+mx_status_t perfmon_get_properties(mx_handle_t resource,
+                                   mx_perfmon_properties_t* props);
+
+// Programs every cpu with |config| and starts counting.
+mx_status_t perfmon_start(mx_handle_t resource, const mx_perfmon_config_t* config);
+
+// Stops counting; the counts stay readable until the next start.
+mx_status_t perfmon_stop(mx_handle_t resource);
+
+// Fetches the counts of one cpu, or of all of them with
+// MTRACE_PERFMON_ALL_CPUS. This works while counting too.
+mx_status_t perfmon_get_counts(mx_handle_t resource, uint32_t cpu,
+                               mx_perfmon_counts_t* counts);
+
+// The name of an MX_PERFMON_EVENT_* value, as Linux perf spells it, or NULL.
+const char* perfmon_event_name(uint32_t event);
+
+// The MX_PERFMON_EVENT_* value called |name|, or MX_PERFMON_EVENT_NONE.
+uint32_t perfmon_event_from_name(const char* name);
+
+__END_CDECLS
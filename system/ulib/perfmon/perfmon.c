@@ -0,0 +1,75 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <perfmon/perfmon.h>
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <magenta/device/sysinfo.h>
+#include <magenta/syscalls.h>
+
+static const char* const event_names[MX_PERFMON_NUM_EVENTS] = {
+    [MX_PERFMON_EVENT_CYCLES] = "cycles",
+    [MX_PERFMON_EVENT_INSTRUCTIONS] = "instructions",
+    [MX_PERFMON_EVENT_REF_CYCLES] = "ref-cycles",
+    [MX_PERFMON_EVENT_CACHE_REFERENCES] = "cache-references",
+    [MX_PERFMON_EVENT_CACHE_MISSES] = "cache-misses",
+    [MX_PERFMON_EVENT_BRANCHES] = "branches",
+    [MX_PERFMON_EVENT_BRANCH_MISSES] = "branch-misses",
+};
+
+mx_status_t perfmon_get_resource(mx_handle_t* resource) {
+    int fd = open("/dev/misc/sysinfo", O_RDONLY);
+    if (fd < 0) {
+        return ERR_NOT_FOUND;
+    }
+    ssize_t r = ioctl_sysinfo_get_root_resource(fd, resource);
+    close(fd);
+    if (r != sizeof(*resource)) {
+        return r < 0 ? (mx_status_t)r : ERR_IO;
+    }
+    return NO_ERROR;
+}
+
+mx_status_t perfmon_get_properties(mx_handle_t resource,
+                                   mx_perfmon_properties_t* props) {
+    return mx_mtrace_control(resource, MTRACE_KIND_PERFMON,
+                             MTRACE_PERFMON_GET_PROPERTIES, 0,
+                             props, sizeof(*props));
+}
+
+mx_status_t perfmon_start(mx_handle_t resource, const mx_perfmon_config_t* config) {
+    // The syscall takes a pointer it may write through, but start only reads.
+    mx_perfmon_config_t copy = *config;
+    return mx_mtrace_control(resource, MTRACE_KIND_PERFMON,
+                             MTRACE_PERFMON_START, 0, &copy, sizeof(copy));
+}
+
+mx_status_t perfmon_stop(mx_handle_t resource) {
+    return mx_mtrace_control(resource, MTRACE_KIND_PERFMON,
+                             MTRACE_PERFMON_STOP, 0, NULL, 0);
+}
+
+mx_status_t perfmon_get_counts(mx_handle_t resource, uint32_t cpu,
+                               mx_perfmon_counts_t* counts) {
+    return mx_mtrace_control(resource, MTRACE_KIND_PERFMON,
+                             MTRACE_PERFMON_GET_COUNTS,
+                             MTRACE_PERFMON_OPTIONS(cpu),
+                             counts, sizeof(*counts));
+}
+
+const char* perfmon_event_name(uint32_t event) {
+    return event < MX_PERFMON_NUM_EVENTS ? event_names[event] : NULL;
+}
+
+uint32_t perfmon_event_from_name(const char* name) {
+    for (uint32_t event = 0; event < MX_PERFMON_NUM_EVENTS; event++) {
+        if (event_names[event] != NULL && !strcmp(event_names[event], name)) {
+            return event;
+        }
+    }
+    return MX_PERFMON_EVENT_NONE;
+}
@@ -0,0 +1,148 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <magenta/syscalls.h>
+#include <mxtl/macros.h>
+#include <mxtl/vector.h>
+
+// perftest
+//
+// A harness for microbenchmarks.  A test is a function which sets up
+// whatever it needs and then does the operation being measured once for
+// each call to KeepRunning():
+//
+//   bool EventSignal(perftest::RepeatState* state) {
+//       mx_handle_t event;
+//       if (mx_event_create(0u, &event) != NO_ERROR)
+//           return false;
+//       while (state->KeepRunning()) {
+//           if (mx_object_signal(event, 0u, MX_EVENT_SIGNALED) != NO_ERROR)
+//               return false;
+//       }
+//       mx_handle_close(event);
+//       return true;
+//   }
+//   PERFTEST_REGISTER("Event/Signal", EventSignal);
+//
+// Each run is timed on its own, so that the results are a distribution
+// rather than one average: the median and quartiles are not thrown off by
+// a few runs which were preempted, and two sets of results can be told
+// apart from noise.  The first runs are thrown away as warm up.
+//
+// A test binary's main() calls perftest::PerfTestMain(), which takes
+// options for the number of runs, a filter on test names, a JSON file to
+// write the results to, and a baseline JSON file to compare them against.
+// runperftests runs every test binary in /boot/test/perf that way.
+
+namespace perftest {
+
+class RepeatState {
+public:
+    // Returns true while there are more runs to do.  A test has to call it
+    // until it returns false.
+    bool KeepRunning() {
+        *next_ = mx_ticks_get();
+        if (next_ == last_)
+            return false;
+        next_++;
+        return true;
+    }
+
+private:
+    friend class Runner;
+
+    // |timestamps| has room for |runs| + 1 of them.
+    RepeatState(uint64_t* timestamps, uint32_t runs)
+        : next_(timestamps), last_(timestamps + runs) {}
+
+    DISALLOW_COPY_ASSIGN_AND_MOVE(RepeatState);
+
+    // The timestamp at the start of each run, and one after the last.
+    uint64_t* next_;
+    uint64_t* const last_;
+};
+
+typedef bool TestFunc(RepeatState* state);
+
+// Summary statistics of one test's runs, in nanoseconds per run.
+struct Result {
+    const char* label;
+    uint32_t runs;
+    double mean;
+    double stddev;
+    double min;
+    double p25;
+    double median;
+    double p75;
+    double max;
+};
+
+// Fills in |result| from |count| > 0 durations in nanoseconds, for tools
+// which take their own measurements rather than running registered tests.
+// Sorts |durations| in place.
+void Summarize(const char* label, double* durations, uint32_t count, Result* result);
+
+// Interpolates between the two nearest ranks of |count| > 0 sorted values.
+double Percentile(const double* sorted, uint32_t count, double fraction);
+
+// A set of results, as written to and read back from JSON.  The labels
+// are owned by the set.
+class ResultSet {
+public:
+    ResultSet() {}
+    ~ResultSet();
+
+    bool Add(const Result& result);
+
+    size_t size() const { return results_.size(); }
+    const Result& operator[](size_t index) const { return results_[index]; }
+    const Result* Find(const char* label) const;
+
+    // The JSON is an array with one object per result, holding each of the
+    // fields of Result under the same name, plus "unit": "ns".
+    bool WriteJson(FILE* out) const;
+    // Only reads what WriteJson() writes.  Returns false, with |error| set,
+    // if |text| is something else.
+    bool ReadJson(const char* text, const char** error);
+    bool ReadJsonFile(const char* path, const char** error);
+
+    // Compares each result with the one in |baseline| with the same label
+    // and prints what changed to |out|.  A test has regressed if its median
+    // is more than |threshold_percent| slower and the middle halves of the
+    // two distributions don't overlap, which keeps noisy tests from being
+    // flagged.  Returns the number of regressions.
+    uint32_t Compare(const ResultSet& baseline, double threshold_percent, FILE* out) const;
+
+private:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(ResultSet);
+
+    mxtl::Vector<Result> results_;
+};
+
+void RegisterTest(const char* name, TestFunc* func);
+
+struct Registration {
+    Registration(const char* name, TestFunc* func) { RegisterTest(name, func); }
+};
+
+// Defines a static object whose constructor registers the test.
+#define PERFTEST_REGISTER(name, func) \
+    static ::perftest::Registration PERFTEST_UNIQUE(perftest_registration_)(name, func)
+#define PERFTEST_UNIQUE(prefix) PERFTEST_CONCAT(prefix, __LINE__)
+#define PERFTEST_CONCAT(a, b) PERFTEST_CONCAT2(a, b)
+#define PERFTEST_CONCAT2(a, b) a##b
+
+// Runs the registered tests whose names contain |filter| (all of them if
+// it is null) |runs| times each, after |runs| / 10 runs of warm up, and adds
+// their results to |results|.  Returns false if any test failed.
+bool RunTests(uint32_t runs, const char* filter, FILE* log, ResultSet* results);
+
+int PerfTestMain(int argc, char** argv);
+
+} // namespace perftest
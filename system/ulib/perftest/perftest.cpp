@@ -0,0 +1,252 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <perftest/perftest.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <magenta/new.h>
+#include <mxtl/unique_ptr.h>
+
+namespace perftest {
+
+namespace {
+
+struct TestEntry {
+    const char* name;
+    TestFunc* func;
+};
+
+// Tests register themselves from static constructors, so the list is made
+// on first use rather than relying on the order those run in.
+mxtl::Vector<TestEntry>* Tests() {
+    static mxtl::Vector<TestEntry> tests;
+    return &tests;
+}
+
+int CompareDoubles(const void* a, const void* b) {
+    double x = *static_cast<const double*>(a);
+    double y = *static_cast<const double*>(b);
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+} // namespace
+
+double Percentile(const double* sorted, uint32_t count, double fraction) {
+    double rank = fraction * (count - 1);
+    uint32_t lower = static_cast<uint32_t>(rank);
+    if (lower + 1 >= count)
+        return sorted[count - 1];
+    double weight = rank - lower;
+    return sorted[lower] * (1.0 - weight) + sorted[lower + 1] * weight;
+}
+
+void Summarize(const char* label, double* durations, uint32_t count, Result* result) {
+    double sum = 0.0;
+    for (uint32_t i = 0; i < count; i++)
+        sum += durations[i];
+    double mean = sum / count;
+    double squares = 0.0;
+    for (uint32_t i = 0; i < count; i++)
+        squares += (durations[i] - mean) * (durations[i] - mean);
+
+    qsort(durations, count, sizeof(double), CompareDoubles);
+    result->label = label;
+    result->runs = count;
+    result->mean = mean;
+    result->stddev = count > 1 ? sqrt(squares / (count - 1)) : 0.0;
+    result->min = durations[0];
+    result->p25 = Percentile(durations, count, 0.25);
+    result->median = Percentile(durations, count, 0.5);
+    result->p75 = Percentile(durations, count, 0.75);
+    result->max = durations[count - 1];
+}
+
+// Runner is RepeatState's friend, which keeps its constructor out of
+// tests' reach.
+class Runner {
+public:
+    static bool Run(const TestEntry& test, uint32_t runs, FILE* log, Result* result) {
+        uint32_t warm_up = runs / 10;
+        uint32_t total = warm_up + runs;
+
+        AllocChecker ac;
+        mxtl::unique_ptr<uint64_t[]> timestamps(new (&ac) uint64_t[total + 1]);
+        if (!ac.check()) {
+            fprintf(log, "%s: out of memory\n", test.name);
+            return false;
+        }
+        mxtl::unique_ptr<double[]> durations(new (&ac) double[runs]);
+        if (!ac.check()) {
+            fprintf(log, "%s: out of memory\n", test.name);
+            return false;
+        }
+
+        RepeatState state(timestamps.get(), total);
+        if (!test.func(&state)) {
+            fprintf(log, "%s: FAILED\n", test.name);
+            return false;
+        }
+        if (state.next_ != state.last_) {
+            fprintf(log, "%s: FAILED: stopped before KeepRunning() returned false\n", test.name);
+            return false;
+        }
+
+        double ns_per_tick = 1e9 / static_cast<double>(mx_ticks_per_second());
+        for (uint32_t i = 0; i < runs; i++) {
+            uint64_t ticks = timestamps[warm_up + i + 1] - timestamps[warm_up + i];
+            durations[i] = static_cast<double>(ticks) * ns_per_tick;
+        }
+        Summarize(test.name, durations.get(), runs, result);
+        return true;
+    }
+};
+
+void RegisterTest(const char* name, TestFunc* func) {
+    AllocChecker ac;
+    Tests()->push_back(TestEntry{name, func}, &ac);
+    if (!ac.check()) {
+        fprintf(stderr, "perftest: out of memory registering %s\n", name);
+        abort();
+    }
+}
+
+bool RunTests(uint32_t runs, const char* filter, FILE* log, ResultSet* results) {
+    fprintf(log, "%-40s %12s %12s %12s %12s %12s\n", "test", "median ns", "mean ns",
+            "stddev", "min ns", "max ns");
+
+    bool ok = true;
+    for (const auto& test : *Tests()) {
+        if (filter != nullptr && strstr(test.name, filter) == nullptr)
+            continue;
+
+        Result result;
+        if (!Runner::Run(test, runs, log, &result)) {
+            ok = false;
+            continue;
+        }
+        fprintf(log, "%-40s %12.0f %12.0f %12.0f %12.0f %12.0f\n", result.label, result.median,
+                result.mean, result.stddev, result.min, result.max);
+        if (!results->Add(result)) {
+            fprintf(log, "%s: out of memory\n", test.name);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+namespace {
+
+void Usage(const char* argv0) {
+    fprintf(stderr,
+            "Usage: %s [options ...]\n"
+            "\n"
+            "Options:\n"
+            "  -h       show help (this)\n"
+            "  -l       list the tests and exit\n"
+            "  -r N     time N runs of each test (default: 1000)\n"
+            "  -f NAME  only run the tests whose names contain NAME\n"
+            "  -o FILE  write the results to FILE as JSON\n"
+            "  -c FILE  compare the results with the JSON baseline in FILE\n"
+            "  -t PCT   how much slower a median has to be to count as a\n"
+            "           regression (default: 10)\n"
+            "\n"
+            "Exits with 1 if a test fails or regresses.\n",
+            argv0);
+}
+
+} // namespace
+
+int PerfTestMain(int argc, char** argv) {
+    uint32_t runs = 1000u;
+    const char* filter = nullptr;
+    const char* out_path = nullptr;
+    const char* baseline_path = nullptr;
+    double threshold = 10.0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "hlr:f:o:c:t:")) != -1) {
+        switch (opt) {
+        case 'h':
+            Usage(argv[0]);
+            return 0;
+        case 'l':
+            for (const auto& test : *Tests())
+                printf("%s\n", test.name);
+            return 0;
+        case 'r': {
+            errno = 0;
+            char* end;
+            unsigned long value = strtoul(optarg, &end, 10);
+            if (errno != 0 || *end != '\0' || value == 0 || value > UINT32_MAX / 2) {
+                fprintf(stderr, "%s: invalid run count %s\n", argv[0], optarg);
+                return 1;
+            }
+            runs = static_cast<uint32_t>(value);
+            break;
+        }
+        case 'f':
+            filter = optarg;
+            break;
+        case 'o':
+            out_path = optarg;
+            break;
+        case 'c':
+            baseline_path = optarg;
+            break;
+        case 't': {
+            char* end;
+            threshold = strtod(optarg, &end);
+            if (*end != '\0' || threshold < 0.0) {
+                fprintf(stderr, "%s: invalid threshold %s\n", argv[0], optarg);
+                return 1;
+            }
+            break;
+        }
+        default:
+            Usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // Read the baseline first, so a bad path doesn't waste a run.
+    ResultSet baseline;
+    if (baseline_path != nullptr) {
+        const char* error;
+        if (!baseline.ReadJsonFile(baseline_path, &error)) {
+            fprintf(stderr, "%s: %s: %s\n", argv[0], baseline_path, error);
+            return 1;
+        }
+    }
+
+    ResultSet results;
+    bool ok = RunTests(runs, filter, stdout, &results);
+
+    if (out_path != nullptr) {
+        FILE* out = fopen(out_path, "w");
+        bool written = out != nullptr && results.WriteJson(out);
+        if (out != nullptr && fclose(out) != 0)
+            written = false;
+        if (!written) {
+            fprintf(stderr, "%s: couldn't write %s\n", argv[0], out_path);
+            ok = false;
+        }
+    }
+
+    if (baseline_path != nullptr) {
+        printf("\nCompared with %s:\n", baseline_path);
+        uint32_t regressions = results.Compare(baseline, threshold, stdout);
+        printf("%u regression%s\n", regressions, regressions == 1 ? "" : "s");
+        if (regressions != 0)
+            ok = false;
+    }
+
+    return ok ? 0 : 1;
+}
+
+} // namespace perftest
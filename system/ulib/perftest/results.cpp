@@ -0,0 +1,289 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <perftest/perftest.h>
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <magenta/new.h>
+#include <mxtl/unique_ptr.h>
+
+namespace perftest {
+
+namespace {
+
+// The numeric fields of Result, in the order they are written.
+struct Field {
+    const char* name;
+    double Result::*member;
+};
+
+const Field kFields[] = {
+    {"mean", &Result::mean},
+    {"stddev", &Result::stddev},
+    {"min", &Result::min},
+    {"p25", &Result::p25},
+    {"median", &Result::median},
+    {"p75", &Result::p75},
+    {"max", &Result::max},
+};
+
+// Reads the subset of JSON which WriteJson() produces: an array of objects
+// whose values are strings or numbers.
+class JsonReader {
+public:
+    explicit JsonReader(const char* text) : pos_(text) {}
+
+    const char* error() const { return error_; }
+
+    bool Read(ResultSet* results) {
+        if (!Expect('['))
+            return false;
+        if (Peek() == ']')
+            return true;
+        for (;;) {
+            if (!ReadResult(results))
+                return false;
+            if (Peek() == ',') {
+                pos_++;
+                continue;
+            }
+            if (!Expect(']'))
+                return false;
+            SkipSpace();
+            if (*pos_ != '\0')
+                return Fail("trailing characters after the results");
+            return true;
+        }
+    }
+
+private:
+    bool Fail(const char* error) {
+        error_ = error;
+        return false;
+    }
+
+    void SkipSpace() {
+        while (isspace(static_cast<unsigned char>(*pos_)))
+            pos_++;
+    }
+
+    char Peek() {
+        SkipSpace();
+        return *pos_;
+    }
+
+    bool Expect(char c) {
+        if (Peek() != c)
+            return Fail("malformed JSON");
+        pos_++;
+        return true;
+    }
+
+    // Strings are written with only \" and \\ escaped.
+    bool ReadString(char* out, size_t size) {
+        if (!Expect('"'))
+            return false;
+        size_t len = 0;
+        for (;;) {
+            char c = *pos_++;
+            if (c == '\0')
+                return Fail("unterminated string");
+            if (c == '"')
+                break;
+            if (c == '\\') {
+                c = *pos_++;
+                if (c != '"' && c != '\\')
+                    return Fail("unsupported escape in string");
+            }
+            if (len + 1 == size)
+                return Fail("string is too long");
+            out[len++] = c;
+        }
+        out[len] = '\0';
+        return true;
+    }
+
+    bool ReadNumber(double* out) {
+        SkipSpace();
+        char* end;
+        *out = strtod(pos_, &end);
+        if (end == pos_)
+            return Fail("expected a number");
+        pos_ = end;
+        return true;
+    }
+
+    bool ReadResult(ResultSet* results) {
+        Result result = {};
+        char label[256] = "";
+        if (!Expect('{'))
+            return false;
+        for (;;) {
+            char key[32];
+            if (!ReadString(key, sizeof(key)) || !Expect(':'))
+                return false;
+
+            if (!strcmp(key, "label") || !strcmp(key, "unit")) {
+                char value[sizeof(label)];
+                if (!ReadString(value, sizeof(value)))
+                    return false;
+                if (!strcmp(key, "label"))
+                    memcpy(label, value, sizeof(label));
+                else if (strcmp(value, "ns"))
+                    return Fail("results are not in nanoseconds");
+            } else {
+                double value;
+                if (!ReadNumber(&value))
+                    return false;
+                if (!strcmp(key, "runs"))
+                    result.runs = static_cast<uint32_t>(value);
+                for (const auto& field : kFields) {
+                    if (!strcmp(key, field.name))
+                        result.*field.member = value;
+                }
+            }
+
+            if (Peek() == ',') {
+                pos_++;
+                continue;
+            }
+            if (!Expect('}'))
+                return false;
+            break;
+        }
+        if (label[0] == '\0')
+            return Fail("result has no label");
+        result.label = label;
+        if (!results->Add(result))
+            return Fail("out of memory");
+        return true;
+    }
+
+    const char* pos_;
+    const char* error_ = nullptr;
+};
+
+void WriteJsonString(FILE* out, const char* string) {
+    fputc('"', out);
+    for (const char* c = string; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\')
+            fputc('\\', out);
+        fputc(*c, out);
+    }
+    fputc('"', out);
+}
+
+} // namespace
+
+ResultSet::~ResultSet() {
+    for (auto& result : results_)
+        free(const_cast<char*>(result.label));
+}
+
+bool ResultSet::Add(const Result& result) {
+    Result copy = result;
+    copy.label = strdup(result.label);
+    if (copy.label == nullptr)
+        return false;
+    AllocChecker ac;
+    results_.push_back(copy, &ac);
+    if (!ac.check()) {
+        free(const_cast<char*>(copy.label));
+        return false;
+    }
+    return true;
+}
+
+const Result* ResultSet::Find(const char* label) const {
+    for (const auto& result : results_) {
+        if (!strcmp(result.label, label))
+            return &result;
+    }
+    return nullptr;
+}
+
+bool ResultSet::WriteJson(FILE* out) const {
+    fprintf(out, "[");
+    for (size_t i = 0; i < results_.size(); i++) {
+        const Result& result = results_[i];
+        fprintf(out, "%s\n  {\"label\": ", i == 0 ? "" : ",");
+        WriteJsonString(out, result.label);
+        fprintf(out, ", \"unit\": \"ns\", \"runs\": %u", result.runs);
+        for (const auto& field : kFields)
+            fprintf(out, ", \"%s\": %.3f", field.name, result.*field.member);
+        fprintf(out, "}");
+    }
+    fprintf(out, "\n]\n");
+    return !ferror(out);
+}
+
+bool ResultSet::ReadJson(const char* text, const char** error) {
+    JsonReader reader(text);
+    if (!reader.Read(this)) {
+        *error = reader.error();
+        return false;
+    }
+    return true;
+}
+
+bool ResultSet::ReadJsonFile(const char* path, const char** error) {
+    *error = nullptr;
+    FILE* file = fopen(path, "r");
+    if (file == nullptr) {
+        *error = "couldn't open file";
+        return false;
+    }
+
+    bool ok = false;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        long size = ftell(file);
+        if (size >= 0 && fseek(file, 0, SEEK_SET) == 0) {
+            AllocChecker ac;
+            mxtl::unique_ptr<char[]> text(new (&ac) char[size + 1]);
+            if (!ac.check()) {
+                *error = "out of memory";
+            } else if (fread(text.get(), 1, size, file) != static_cast<size_t>(size)) {
+                *error = "couldn't read file";
+            } else {
+                text[size] = '\0';
+                ok = ReadJson(text.get(), error);
+            }
+        }
+    }
+    if (!ok && *error == nullptr)
+        *error = "couldn't read file";
+    fclose(file);
+    return ok;
+}
+
+uint32_t ResultSet::Compare(const ResultSet& baseline, double threshold_percent,
+                            FILE* out) const {
+    uint32_t regressions = 0;
+    for (const auto& result : results_) {
+        const Result* base = baseline.Find(result.label);
+        if (base == nullptr) {
+            fprintf(out, "%-40s %12.0f ns (new)\n", result.label, result.median);
+            continue;
+        }
+
+        double change = base->median > 0.0
+                            ? (result.median - base->median) * 100.0 / base->median
+                            : 0.0;
+        const char* verdict = "";
+        if (change > threshold_percent && result.p25 > base->p75) {
+            verdict = "  REGRESSED";
+            regressions++;
+        } else if (change < -threshold_percent && result.p75 < base->p25) {
+            verdict = "  improved";
+        }
+        fprintf(out, "%-40s %12.0f -> %12.0f ns %+7.1f%%%s\n", result.label, base->median,
+                result.median, change, verdict);
+    }
+    return regressions;
+}
+
+} // namespace perftest
@@ -0,0 +1,23 @@
+# Copyright 2017 The Fuchsia Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+LOCAL_DIR := $(GET_LOCAL_DIR)
+
+MODULE := $(LOCAL_DIR)
+
+MODULE_TYPE := userlib
+
+MODULE_SRCS += \
+    $(LOCAL_DIR)/perftest.cpp \
+    $(LOCAL_DIR)/results.cpp \
+
+MODULE_STATIC_LIBS := \
+    system/ulib/mxtl \
+    system/ulib/mxcpp \
+
+MODULE_LIBS := \
+    system/ulib/magenta \
+    system/ulib/c \
+
+include make/module.mk
@@ -474,9 +474,15 @@ public:
     }
 
 private:
+    // How many misaligned regions a sized allocation will look at, looking
+    // for a best fit, before settling for the smallest region which is sure
+    // to fit.
+    static constexpr size_t kMaxAlignedFitProbes = 8;
+
     mx_status_t AddSubtractSanityCheckLocked(const ralloc_region_t& region);
     void ReleaseRegion(Region* region);
     void AddRegionToAvailLocked(Region* region, bool allow_overlap = false);
+    void ShrinkAvailLocked(Region* region, uint64_t base, uint64_t size);
 
     mx_status_t AllocFromAvailLocked(Region::WAVLTreeSortBySize::iterator source,
                                      Region::UPtr& out_region,
@@ -295,10 +295,19 @@ mx_status_t RegionAllocator::GetRegion(uint64_t size,
     // is large enough to hold this allocation (if any)
     auto iter = avail_regions_by_size_.lower_bound({ .base = 0, .size = size });
 
+    // Any region which is at least size + mask long can hold the allocation no
+    // matter how its base is aligned, so only the regions smaller than that
+    // might have to be skipped.  Probe a few of them for a best fit, then jump
+    // straight to the first sure fit instead of walking what could be a long
+    // run of misaligned regions.
+    uint64_t sure_fit = size + mask;
+    bool can_skip = sure_fit >= size;
+    size_t probes = 0;
+
     // Consider all of the regions which are large enough to hold our
     // allocation.  Stop as soon as we find one which can satisfy the alignment
     // restrictions.
-    uint64_t aligned_base;
+    uint64_t aligned_base = 0;
     while (iter.IsValid()) {
         MX_DEBUG_ASSERT(iter->size >= size);
         aligned_base = (iter->base + mask) & inv_mask;
@@ -313,6 +322,9 @@ mx_status_t RegionAllocator::GetRegion(uint64_t size,
             break;
 
         ++iter;
+        if (can_skip && (++probes == kMaxAlignedFitProbes) &&
+            iter.IsValid() && (iter->size < sure_fit))
+            iter = avail_regions_by_size_.lower_bound({ .base = 0, .size = sure_fit });
     }
 
     if (!iter.IsValid())
@@ -444,14 +456,12 @@ mx_status_t RegionAllocator::AllocFromAvailLocked(Region::WAVLTreeSortBySize::it
         if (before_region == nullptr)
             return ERR_NO_MEMORY;
 
-        Region* after_region = avail_regions_by_size_.erase(source);
+        Region* after_region = &(*source);
 
         before_region->base = after_region->base;
         before_region->size = size;
-        after_region->base += size;
-        after_region->size -= size;
+        ShrinkAvailLocked(after_region, after_region->base + size, after_region->size - size);
 
-        avail_regions_by_size_.insert(after_region);
         allocated_regions_by_base_.insert(before_region);
 
         out_region.reset(before_region);
@@ -464,13 +474,12 @@ mx_status_t RegionAllocator::AllocFromAvailLocked(Region::WAVLTreeSortBySize::it
         if (after_region == nullptr)
             return ERR_NO_MEMORY;
 
-        Region* before_region = avail_regions_by_size_.erase(source);
+        Region* before_region = &(*source);
 
         after_region->base   = base;
         after_region->size   = size;
-        before_region->size -= size;
+        ShrinkAvailLocked(before_region, before_region->base, before_region->size - size);
 
-        avail_regions_by_size_.insert(before_region);
         allocated_regions_by_base_.insert(after_region);
 
         out_region.reset(after_region);
@@ -488,15 +497,14 @@ mx_status_t RegionAllocator::AllocFromAvailLocked(Region::WAVLTreeSortBySize::it
             return ERR_NO_MEMORY;
         }
 
-        Region* before_region = avail_regions_by_size_.erase(source);
+        Region* before_region = &(*source);
 
         region->base        = before_region->base + overhead;
         region->size        = size;
         after_region->base  = region->base + region->size;
         after_region->size  = before_region->size - size - overhead;
-        before_region->size = overhead;
+        ShrinkAvailLocked(before_region, before_region->base, overhead);
 
-        avail_regions_by_size_.insert(before_region);
         avail_regions_by_size_.insert(after_region);
         avail_regions_by_base_.insert(after_region);
         allocated_regions_by_base_.insert(region);
@@ -506,6 +514,34 @@ mx_status_t RegionAllocator::AllocFromAvailLocked(Region::WAVLTreeSortBySize::it
     return NO_ERROR;
 }
 
+void RegionAllocator::ShrinkAvailLocked(Region* region, uint64_t base, uint64_t size) {
+    MX_DEBUG_ASSERT(region->ns_tree_sort_by_size_.InContainer());
+    MX_DEBUG_ASSERT(size > 0);
+    MX_DEBUG_ASSERT(size < region->size);
+    MX_DEBUG_ASSERT(base >= region->base);
+    MX_DEBUG_ASSERT((base + size) <= (region->base + region->size));
+
+    // Shrinking a region can only move it towards the front of the size
+    // index.  If it still sorts after the region before it, it is already in
+    // the right place and its key can be updated without touching the tree.
+    // This is the usual case when a run of allocations are carved out of the
+    // same large region.  The base index never needs fixing up; the region
+    // still lies between its neighbors.
+    const ralloc_region_t key = { .base = base, .size = size };
+    auto prev = avail_regions_by_size_.make_iterator(*region);
+    --prev;
+    if (!prev.IsValid() || Region::KeyTraitsSortBySize::LessThan(*prev, key)) {
+        region->base = base;
+        region->size = size;
+        return;
+    }
+
+    avail_regions_by_size_.erase(*region);
+    region->base = base;
+    region->size = size;
+    avail_regions_by_size_.insert(region);
+}
+
 void RegionAllocator::AddRegionToAvailLocked(Region* region, bool allow_overlap) {
     // Sanity checks.  This region should not exist in any bookkeeping, and
     // should not overlap with any of the regions we are currently tracking.
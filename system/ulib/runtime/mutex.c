@@ -6,6 +6,7 @@
 
 #include <magenta/syscalls.h>
 #include <stdatomic.h>
+#include <stdbool.h>
 
 // This mutex implementation is based on Ulrich Drepper's paper "Futexes
 // Are Tricky" (dated November 5, 2011; see
@@ -21,6 +22,39 @@ enum {
     LOCKED_WITH_WAITERS = 2
 };
 
+// How many times a contended lock polls the mutex before going to sleep.
+// A futex wait and the matching wake cost two syscalls and a context
+// switch, which is far longer than most critical sections last.
+#define SPIN_COUNT 100
+
+static inline void spin_pause(void) {
+#if defined(__x86_64__)
+    __asm__ volatile("pause" ::: "memory");
+#elif defined(__aarch64__)
+    __asm__ volatile("yield" ::: "memory");
+#else
+    atomic_signal_fence(memory_order_seq_cst);
+#endif
+}
+
+// Poll the mutex for a while in the hope that its owner releases it soon.
+// This gives up as soon as anyone is asleep on the mutex: they are queued
+// ahead of us, and the owner's unlock will hand it to one of them.
+static bool lock_spin(mxr_mutex_t* mutex, int* old_state) {
+    for (int i = 0; i < SPIN_COUNT; ++i) {
+        if (*old_state == LOCKED_WITH_WAITERS)
+            return false;
+        if (*old_state == UNLOCKED &&
+            atomic_compare_exchange_strong(&mutex->futex, old_state,
+                                           LOCKED_WITHOUT_WAITERS)) {
+            return true;
+        }
+        spin_pause();
+        *old_state = atomic_load_explicit(&mutex->futex, memory_order_relaxed);
+    }
+    return false;
+}
+
 // On success, this will leave the mutex in the LOCKED_WITH_WAITERS state.
 static mx_status_t lock_slow_path(mxr_mutex_t* mutex, mx_time_t abstime,
                                   int old_state) {
@@ -67,6 +101,8 @@ mx_status_t __mxr_mutex_timedlock(mxr_mutex_t* mutex, mx_time_t abstime) {
                                        LOCKED_WITHOUT_WAITERS)) {
         return NO_ERROR;
     }
+    if (lock_spin(mutex, &old_state))
+        return NO_ERROR;
     return lock_slow_path(mutex, abstime, old_state);
 }
 
@@ -76,7 +76,7 @@ public:
     mx_status_t Lookup(mxtl::RefPtr<fs::Vnode>* out, const char* name, size_t len) override final;
     mx_status_t Getattr(vnattr_t* a) override final;
 
-    void NotifyAdd(const char* name, size_t len) override final;
+    void Notify(const char* name, size_t len, unsigned event) override final;
     mx_status_t WatchDir(mx_handle_t* out) final;
 
     mx_status_t Readdir(void* cookie, void* dirents, size_t len) override final;
@@ -107,7 +107,9 @@ mx_status_t VnodeDir::Getattr(vnattr_t* attr) {
     return NO_ERROR;
 }
 
-void VnodeDir::NotifyAdd(const char* name, size_t len) { watcher_.NotifyAdd(name, len); }
+void VnodeDir::Notify(const char* name, size_t len, unsigned event) {
+    watcher_.Notify(name, len, event);
+}
 mx_status_t VnodeDir::WatchDir(mx_handle_t* out) { return watcher_.WatchDir(out); }
 
 mx_status_t VnodeDir::Readdir(void* cookie, void* data, size_t len) {
@@ -164,13 +166,14 @@ bool VnodeDir::AddService(const char* name, size_t len, ServiceProvider* provide
     }
 
     services_.push_back(mxtl::move(vn));
-    NotifyAdd(name, len);
+    Notify(name, len, VFS_WATCH_EVT_ADDED);
     return true;
 }
 
 void VnodeDir::RemoveAllServices() {
     for (VnodeSvc& vn : services_) {
         vn.ClearProvider();
+        Notify(vn.name().get(), vn.name().size(), VFS_WATCH_EVT_REMOVED);
     }
     services_.clear();
 }
@@ -11,12 +11,12 @@
 enum {
     UNSIGNALED = 0,
     SIGNALED = 1,
+    // Unsignaled, and someone may be blocked in the kernel waiting for the
+    // signal. Only then does signaling have to enter the kernel too.
+    UNSIGNALED_WITH_WAITERS = 2,
 };
 
 mx_status_t completion_wait(completion_t* completion, mx_time_t timeout) {
-    // TODO(kulakowski): With a little more state (a waiters count),
-    // this could optimistically spin before entering the kernel.
-
     atomic_int* futex = &completion->futex;
 
     for (;;) {
@@ -24,8 +24,12 @@ mx_status_t completion_wait(completion_t* completion, mx_time_t timeout) {
         if (current_value == SIGNALED) {
             return NO_ERROR;
         }
+        if (current_value == UNSIGNALED &&
+            !atomic_compare_exchange_strong(futex, &current_value, UNSIGNALED_WITH_WAITERS)) {
+            continue;
+        }
         mx_time_t deadline = (timeout == MX_TIME_INFINITE) ? timeout : mx_deadline_after(timeout);
-        switch (mx_futex_wait(futex, current_value, deadline)) {
+        switch (mx_futex_wait(futex, UNSIGNALED_WITH_WAITERS, deadline)) {
         case NO_ERROR:
             continue;
         case ERR_BAD_STATE:
@@ -44,10 +48,14 @@ mx_status_t completion_wait(completion_t* completion, mx_time_t timeout) {
 
 void completion_signal(completion_t* completion) {
     atomic_int* futex = &completion->futex;
-    atomic_store(futex, SIGNALED);
-    mx_futex_wake(futex, UINT32_MAX);
+    if (atomic_exchange(futex, SIGNALED) == UNSIGNALED_WITH_WAITERS) {
+        mx_futex_wake(futex, UINT32_MAX);
+    }
 }
 
 void completion_reset(completion_t* completion) {
-    atomic_store(&completion->futex, UNSIGNALED);
+    // An unsignaled completion is left alone, so one with waiters stays
+    // marked and the next signal still wakes them.
+    int expected = SIGNALED;
+    atomic_compare_exchange_strong(&completion->futex, &expected, UNSIGNALED);
 }
@@ -0,0 +1,35 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <magenta/types.h>
+#include <magenta/compiler.h>
+
+#include <stdatomic.h>
+
+__BEGIN_CDECLS;
+
+// A counting semaphore for the threads of one process. Posting and taking
+// a count are atomic operations on |count|; the kernel is only entered to
+// block when there is nothing to take, and to wake a blocked taker.
+typedef struct {
+    atomic_int count;
+    atomic_int waiters;
+} semaphore_t;
+
+#define SEMAPHORE_INIT(n) ((semaphore_t){(n), 0})
+
+// Takes one from the count, waiting until there is one to take. Returns
+// ERR_TIMED_OUT if timeout elapses first, and NO_ERROR otherwise.
+mx_status_t semaphore_wait(semaphore_t* semaphore, mx_time_t timeout);
+
+// Takes one from the count if there is one to take, without waiting.
+// Returns ERR_SHOULD_WAIT if there was not.
+mx_status_t semaphore_try_wait(semaphore_t* semaphore);
+
+// Adds one to the count, waking a waiter if there is one.
+void semaphore_post(semaphore_t* semaphore);
+
+__END_CDECLS;
@@ -10,6 +10,7 @@ MODULE_TYPE := userlib
 
 MODULE_SRCS += \
     $(LOCAL_DIR)/completion.c \
+    $(LOCAL_DIR)/semaphore.c \
 
 MODULE_LIBS := \
     system/ulib/magenta \
@@ -0,0 +1,50 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <sync/semaphore.h>
+
+#include <magenta/syscalls.h>
+#include <stdatomic.h>
+
+mx_status_t semaphore_try_wait(semaphore_t* semaphore) {
+    int count = atomic_load(&semaphore->count);
+    while (count > 0) {
+        if (atomic_compare_exchange_weak(&semaphore->count, &count, count - 1)) {
+            return NO_ERROR;
+        }
+    }
+    return ERR_SHOULD_WAIT;
+}
+
+mx_status_t semaphore_wait(semaphore_t* semaphore, mx_time_t timeout) {
+    if (semaphore_try_wait(semaphore) == NO_ERROR) {
+        return NO_ERROR;
+    }
+
+    mx_time_t deadline = (timeout == MX_TIME_INFINITE) ? timeout : mx_deadline_after(timeout);
+    atomic_fetch_add(&semaphore->waiters, 1);
+    mx_status_t status;
+    for (;;) {
+        if ((status = semaphore_try_wait(semaphore)) == NO_ERROR) {
+            break;
+        }
+        // A post after we counted ourselves as a waiter either changes the
+        // count before this sees it, or sees us and wakes us.
+        status = mx_futex_wait(&semaphore->count, 0, deadline);
+        if (status == ERR_TIMED_OUT) {
+            break;
+        } else if (status != NO_ERROR && status != ERR_BAD_STATE) {
+            __builtin_trap();
+        }
+    }
+    atomic_fetch_sub(&semaphore->waiters, 1);
+    return status;
+}
+
+void semaphore_post(semaphore_t* semaphore) {
+    atomic_fetch_add(&semaphore->count, 1);
+    if (atomic_load(&semaphore->waiters) > 0) {
+        mx_futex_wake(&semaphore->count, 1);
+    }
+}
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <magenta/compiler.h>
+#include <magenta/syscalls/object.h>
 #include <magenta/types.h>
 
 __BEGIN_CDECLS
@@ -38,4 +39,13 @@ mx_status_t walk_root_job_tree(task_callback_t job_callback,
                                task_callback_t process_callback,
                                task_callback_t thread_callback);
 
+// Fetches the job/process/thread tree rooted in root_job with a single
+// MX_INFO_JOB_TREE query. On success, *records points to *count records in
+// the same order that walk_job_tree() visits tasks; the caller must free() it.
+mx_status_t get_job_tree(mx_handle_t root_job,
+                         mx_info_task_record_t** records, size_t* count);
+
+// Calls get_job_tree() on the system's root job.
+mx_status_t get_root_job_tree(mx_info_task_record_t** records, size_t* count);
+
 __END_CDECLS
@@ -301,25 +301,86 @@ mx_status_t walk_job_tree(mx_handle_t root_job,
         root_job, root_job_koid, /* depth */ 1);
 }
 
-mx_status_t walk_root_job_tree(task_callback_t job_callback,
-                               task_callback_t process_callback,
-                               task_callback_t thread_callback) {
+// Gets a handle to the system's root job from sysinfo.
+static mx_status_t get_root_job(mx_handle_t* root_job) {
     int fd = open("/dev/misc/sysinfo", O_RDWR);
     if (fd < 0) {
         fprintf(stderr, "task-utils/walker: cannot open sysinfo: %d\n", errno);
         return ERR_NOT_FOUND;
     }
 
-    mx_handle_t root_job;
-    size_t n = ioctl_sysinfo_get_root_job(fd, &root_job);
+    size_t n = ioctl_sysinfo_get_root_job(fd, root_job);
     close(fd);
-    if (n != sizeof(root_job)) {
+    if (n != sizeof(*root_job)) {
         fprintf(stderr, "task-utils/walker: cannot obtain root job\n");
         return ERR_NOT_FOUND;
     }
+    return NO_ERROR;
+}
 
-    mx_status_t s = walk_job_tree(
+mx_status_t walk_root_job_tree(task_callback_t job_callback,
+                               task_callback_t process_callback,
+                               task_callback_t thread_callback) {
+    mx_handle_t root_job;
+    mx_status_t s = get_root_job(&root_job);
+    if (s != NO_ERROR) {
+        return s;
+    }
+
+    s = walk_job_tree(
         root_job, job_callback, process_callback, thread_callback);
     mx_handle_close(root_job);
     return s;
 }
+
+mx_status_t get_job_tree(mx_handle_t root_job,
+                         mx_info_task_record_t** records, size_t* count) {
+    size_t capacity = kNumInitialKoids;
+    mx_info_task_record_t* buf = NULL;
+    size_t actual = 0;
+    size_t avail = 0;
+    mx_status_t status;
+
+    // the tree can grow between calls, so retry with a bit of slop until
+    // everything fits
+    for (int pass = 0; pass < 4; ++pass) {
+        if (actual < avail) {
+            capacity = avail + kNumExtraKoids;
+        }
+        buf = realloc(buf, capacity * sizeof(buf[0]));
+        status = mx_object_get_info(root_job, MX_INFO_JOB_TREE,
+                                    buf, capacity * sizeof(buf[0]),
+                                    &actual, &avail);
+        if (status != NO_ERROR) {
+            fprintf(stderr, "ERROR: mx_object_get_info(MX_INFO_JOB_TREE) failed: %s (%d)\n",
+                    mx_status_get_string(status), status);
+            free(buf);
+            return status;
+        }
+        if (actual == avail) {
+            break;
+        }
+    }
+
+    // if we're still too small at least warn the user
+    if (actual < avail) {
+        fprintf(stderr, "WARNING: mx_object_get_info(MX_INFO_JOB_TREE) truncated %zu/%zu results\n",
+                avail - actual, avail);
+    }
+
+    *records = buf;
+    *count = actual;
+    return NO_ERROR;
+}
+
+mx_status_t get_root_job_tree(mx_info_task_record_t** records, size_t* count) {
+    mx_handle_t root_job;
+    mx_status_t s = get_root_job(&root_job);
+    if (s != NO_ERROR) {
+        return s;
+    }
+
+    s = get_job_tree(root_job, records, count);
+    mx_handle_close(root_job);
+    return s;
+}
@@ -150,8 +150,11 @@ tftp_status tftp_prepare_data(tftp_session* session,
                               void* cookie);
 
 // If no response from the peer is received before the most recent timeout_ms
-// value, this function should be called to take the next appropriate action
-// (e.g., retransmit or cancel). |outgoing| must point to a scratch buffer the
+// value, this function should be called to take the next appropriate action.
+// A sender goes back to the first block that was not acknowledged (continue
+// while tftp_session_has_pending() is true), and a receiver repeats its last
+// ACK. After too many timeouts in a row the transfer is abandoned and
+// TFTP_ERR_TIMED_OUT is returned. |outgoing| must point to a scratch buffer the
 // library can use to assemble the next packet to send. |outlen| is the size of
 // the outgoing scratch buffer. |timeout_ms| is set to the next timeout value
 // the user of the library should use when waiting for a response. |cookie| will
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -42,6 +43,7 @@ typedef struct tftp_data_msg_t {
 #define DEFAULT_FILESIZE 0
 #define DEFAULT_WINDOWSIZE 1
 #define DEFAULT_MODE MODE_OCTET
+#define DEFAULT_MAX_TIMEOUTS 5
 
 typedef struct tftp_options_t {
     // Maximum filename really is 505 including \0
@@ -98,9 +100,23 @@ struct tftp_session_t {
     tftp_state state;
     size_t offset;
 
+    // Block numbers are kept in 32 bits so that transfers of more than
+    // 65535 blocks work; only the low 16 bits go on the wire.
+    //
+    // Sending: the last block acknowledged, and how many blocks past it
+    // have been sent. Receiving: the last block received in order, and
+    // how many of those have not been acknowledged yet.
     uint32_t block_number;
     uint32_t window_index;
 
+    // true on the side that sends DATA
+    bool sending;
+    // receiving: we have asked for a resend and are waiting for it
+    bool out_of_order;
+    // timeouts since the last progress, and how many we tolerate
+    uint32_t timeouts;
+    uint32_t max_timeouts;
+
     // "Negotiated" values
     size_t file_size;
     tftp_mode mode;
@@ -273,11 +273,12 @@ tftp_status tftp_send_file(tftp_session* session,
             }
             if (errno == EAGAIN) {
                 fprintf(stdout, "Timed out\n");
+                out = SCRATCHSZ;
                 ret = tftp_timeout(session,
                                    outgoing,
                                    &out,
                                    &timeout_ms,
-                                   connection);
+                                   &f);
                 if (out) {
                     n = connection_send(connection, outgoing, out);
                     if (n < 0) {
@@ -289,6 +290,11 @@ tftp_status tftp_send_file(tftp_session* session,
                     fprintf(stderr, "Failed to parse request (%d)\n", ret);
                     return -1;
                 }
+                // the rest of the window goes out again too
+                if (tftp_session_has_pending(session)) {
+                    pending = 1;
+                    block = false;
+                }
                 continue;
             }
             fprintf(stdout, "Failed %d\n", errno);
@@ -955,7 +955,9 @@ static bool test_tftp_send_data_receive_ack(void) {
     status = tftp_handle_msg(ts.session, ack_buf, sizeof(ack_buf), ts.out, &ts.outlen, &ts.timeout, &td);
     EXPECT_EQ(TFTP_NO_ERROR, status, "receive error");
     EXPECT_EQ(TRANSMITTING, ts.session->state, "session should be TRANSMITTING");
-    EXPECT_EQ(2, ts.session->block_number, "tftp session block number mismatch");
+    // The window slides when the ack comes in; block 2 is now in flight
+    EXPECT_EQ(1, ts.session->block_number, "tftp session block number mismatch");
+    EXPECT_EQ(1, ts.session->window_index, "tftp session window index mismatch");
     EXPECT_EQ(ts.outlen, sizeof(tftp_data_msg) + DEFAULT_BLOCKSIZE, "bad outlen");
     EXPECT_TRUE(verify_read_data(ts, td), "bad test data");
 
@@ -1043,7 +1045,8 @@ static bool test_tftp_send_data_receive_ack_skipped_block(void) {
     status = tftp_handle_msg(ts.session, ack_buf, sizeof(ack_buf), ts.out, &ts.outlen, &ts.timeout, &td2);
     EXPECT_EQ(TFTP_NO_ERROR, status, "receive error");
     EXPECT_EQ(TRANSMITTING, ts.session->state, "session should be TRANSMITTING");
-    EXPECT_EQ(1, ts.session->block_number, "tftp session block number mismatch");
+    EXPECT_EQ(0, ts.session->block_number, "tftp session block number mismatch");
+    EXPECT_EQ(1, ts.session->window_index, "tftp session window index mismatch");
     EXPECT_EQ(ts.outlen, sizeof(tftp_data_msg) + DEFAULT_BLOCKSIZE, "bad outlen");
     EXPECT_TRUE(verify_read_data(ts, td2), "bad test data");
 
@@ -1086,8 +1089,8 @@ static bool test_tftp_send_data_receive_ack_window_size(void) {
     td.expected.data[0]++;
     status = tftp_prepare_data(ts.session, ts.out, &ts.outlen, &ts.timeout, &td);
     ASSERT_EQ(TFTP_NO_ERROR, status, "receive error");
-    ASSERT_EQ(2, ts.session->block_number, "tftp session block number mismatch");
-    ASSERT_EQ(0, ts.session->window_index, "tftp session window index mismatch");
+    ASSERT_EQ(0, ts.session->block_number, "tftp session block number mismatch");
+    ASSERT_EQ(2, ts.session->window_index, "tftp session window index mismatch");
     ASSERT_EQ(ts.outlen, sizeof(tftp_data_msg) + DEFAULT_BLOCKSIZE, "bad outlen");
     ASSERT_TRUE(verify_read_data(ts, td), "bad test data");
     ASSERT_FALSE(tftp_session_has_pending(ts.session), "expected to wait for ack");
@@ -1112,6 +1115,259 @@ static bool test_tftp_send_data_receive_ack_window_size(void) {
     END_TEST;
 }
 
+static bool test_tftp_send_data_timeout(void) {
+    constexpr uint8_t kWindowSize = 2;
+    BEGIN_TEST;
+
+    test_state ts;
+    ts.reset(1024, 2048, 1500);
+
+    auto status = tftp_generate_write_request(ts.session, kFilename, MODE_OCTET,
+        ts.msg_size, 0, 0, kWindowSize, ts.out, &ts.outlen, &ts.timeout);
+    ASSERT_EQ(TFTP_NO_ERROR, status, "error generating write request");
+
+    uint8_t oack_buf[] = {
+        0x00, 0x06,                     // Opcode (OACK)
+        'T', 'S', 'I', 'Z', 'E', 0x00,  // Option
+        '2', '0', '4', '8', 0x00,       // TSIZE value
+        'W', 'I', 'N', 'D', 'O', 'W', 'S', 'I', 'Z', 'E', 0x00,      // Option
+        '2', 0x00,                                              // WINDOWSIZE value
+    };
+
+    tftp_session_set_read_cb(ts.session, mock_read);
+
+    tx_test_data td;
+    status = tftp_handle_msg(ts.session, oack_buf, sizeof(oack_buf), ts.out, &ts.outlen, &ts.timeout, &td);
+    ASSERT_EQ(TFTP_NO_ERROR, status, "receive error");
+    ts.outlen = ts.out_size;
+    status = tftp_prepare_data(ts.session, ts.out, &ts.outlen, &ts.timeout, &td);
+    ASSERT_EQ(TFTP_NO_ERROR, status, "prepare error");
+    ASSERT_EQ(2, ts.session->window_index, "tftp session window index mismatch");
+
+    // No ack: the whole window goes out again, starting with block 1
+    tx_test_data td2;
+    ts.outlen = ts.out_size;
+    status = tftp_timeout(ts.session, ts.out, &ts.outlen, &ts.timeout, &td2);
+    EXPECT_EQ(TFTP_NO_ERROR, status, "timeout error");
+    EXPECT_EQ(ts.outlen, sizeof(tftp_data_msg) + DEFAULT_BLOCKSIZE, "bad outlen");
+    EXPECT_TRUE(verify_read_data(ts, td2), "bad test data");
+    EXPECT_EQ(0, ts.session->block_number, "tftp session block number mismatch");
+    EXPECT_EQ(1, ts.session->window_index, "tftp session window index mismatch");
+    EXPECT_TRUE(tftp_session_has_pending(ts.session), "expected pending data to transmit");
+    EXPECT_EQ(DEFAULT_TIMEOUT * 1000, ts.timeout, "timeout not set correctly");
+
+    // Keep timing out until the session gives up
+    for (int i = 1; i < DEFAULT_MAX_TIMEOUTS; i++) {
+        ts.outlen = ts.out_size;
+        status = tftp_timeout(ts.session, ts.out, &ts.outlen, &ts.timeout, &td2);
+        ASSERT_EQ(TFTP_NO_ERROR, status, "timeout error");
+    }
+    ts.outlen = ts.out_size;
+    status = tftp_timeout(ts.session, ts.out, &ts.outlen, &ts.timeout, &td2);
+    EXPECT_EQ(TFTP_ERR_TIMED_OUT, status, "session should have timed out");
+    EXPECT_EQ(0, ts.outlen, "no outgoing message expected");
+    EXPECT_EQ(ERROR, ts.session->state, "session should be in ERROR");
+
+    END_TEST;
+}
+
+static bool test_tftp_send_data_receive_stale_ack(void) {
+    BEGIN_TEST;
+
+    test_state ts;
+    ts.reset(1024, 2048, 1500);
+
+    auto status = tftp_generate_write_request(ts.session, kFilename, MODE_OCTET,
+        ts.msg_size, 0, 0, 0, ts.out, &ts.outlen, &ts.timeout);
+    ASSERT_EQ(TFTP_NO_ERROR, status, "error generating write request");
+
+    uint8_t oack_buf[] = {
+        0x00, 0x06,                     // Opcode (OACK)
+        'T', 'S', 'I', 'Z', 'E', 0x00,  // Option
+        '2', '0', '4', '8', 0x00,       // TSIZE value
+    };
+
+    tftp_session_set_read_cb(ts.session, mock_read);
+
+    tx_test_data td;
+    status = tftp_handle_msg(ts.session, oack_buf, sizeof(oack_buf), ts.out, &ts.outlen, &ts.timeout, &td);
+    ASSERT_EQ(TFTP_NO_ERROR, status, "receive error");
+
+    uint8_t ack_buf[] = {
+        0x00, 0x04,  // Opcode (ACK)
+        0x02, 0x00,  // Block
+    };
+
+    // acks may cover more than we think is in flight, e.g. after a resend
+    ts.outlen = ts.out_size;
+    status = tftp_handle_msg(ts.session, ack_buf, sizeof(ack_buf), ts.out, &ts.outlen, &ts.timeout, &td);
+    ASSERT_EQ(TFTP_NO_ERROR, status, "receive error");
+    ASSERT_EQ(2, ts.session->block_number, "tftp session block number mismatch");
+    ASSERT_EQ(1, ts.session->window_index, "tftp session window index mismatch");
+
+    // an older ack showing up late must not rewind the transfer
+    ack_buf[2] = 1;
+    ts.outlen = ts.out_size;
+    status = tftp_handle_msg(ts.session, ack_buf, sizeof(ack_buf), ts.out, &ts.outlen, &ts.timeout, &td);
+    EXPECT_EQ(TFTP_NO_ERROR, status, "receive error");
+    EXPECT_EQ(0, ts.outlen, "no outgoing message expected");
+    EXPECT_EQ(2, ts.session->block_number, "tftp session block number mismatch");
+    EXPECT_EQ(1, ts.session->window_index, "tftp session window index mismatch");
+
+    END_TEST;
+}
+
+static bool test_tftp_receive_data_block_wrap(void) {
+    BEGIN_TEST;
+
+    test_state ts;
+    ts.reset(1024, 1024, 1500);
+    tftp_session_set_open_cb(ts.session, dummy_open);
+
+    // 65537 blocks of 8 bytes, so the block number has to wrap around
+    uint8_t req_buf[] = {
+        0x00, 0x02,                                   // Opcode (WRQ)
+        'f', 'i', 'l', 'e', 'n', 'a', 'm', 'e', 0x00, // Filename
+        'O', 'C', 'T', 'E', 'T', 0x00,                // Mode
+        'T', 'S', 'I', 'Z', 'E', 0x00,                // Option
+        '5', '2', '4', '2', '9', '6', 0x00,           // TSIZE value
+        'B', 'L', 'K', 'S', 'I', 'Z', 'E', 0x00,      // Option
+        '8', 0x00,                                    // BLKSIZE value
+    };
+    auto status = tftp_handle_msg(ts.session, req_buf, sizeof(req_buf), ts.out, &ts.outlen, &ts.timeout, nullptr);
+    ASSERT_EQ(TFTP_NO_ERROR, status, "receive write request failed");
+
+    off_t offset = -1;
+    tftp_session_set_write_cb(ts.session,
+            [](const void* data, size_t* len, off_t off, void* cookie) -> tftp_status {
+                *static_cast<off_t*>(cookie) = off;
+                return static_cast<tftp_status>(*len);
+            });
+
+    // pretend the first 65535 blocks already made it
+    ts.session->state = TRANSMITTING;
+    ts.session->block_number = 65535;
+
+    uint8_t data_buf[12] = {
+        0x00, 0x03,  // Opcode (DATA)
+        0x00, 0x00,  // Block (65536, wrapped)
+    };
+    ts.outlen = ts.out_size;
+    status = tftp_handle_msg(ts.session, data_buf, sizeof(data_buf), ts.out, &ts.outlen, &ts.timeout, &offset);
+    EXPECT_EQ(TFTP_NO_ERROR, status, "receive data failed");
+    EXPECT_EQ(65535 * 8, offset, "bad write offset");
+    EXPECT_EQ(65536u, ts.session->block_number, "tftp session block number mismatch");
+    ASSERT_TRUE(verify_response_opcode(ts, OPCODE_ACK), "bad response");
+    auto msg = reinterpret_cast<tftp_data_msg*>(ts.out);
+    EXPECT_EQ(0, msg->block, "bad block number");
+
+    data_buf[2] = 0x01;
+    ts.outlen = ts.out_size;
+    status = tftp_handle_msg(ts.session, data_buf, sizeof(data_buf), ts.out, &ts.outlen, &ts.timeout, &offset);
+    EXPECT_EQ(TFTP_TRANSFER_COMPLETED, status, "transfer should be complete");
+    EXPECT_EQ(65536 * 8, offset, "bad write offset");
+
+    END_TEST;
+}
+
+static bool test_tftp_receive_data_timeout(void) {
+    BEGIN_TEST;
+
+    test_state ts;
+    ts.reset(1024, 2048, 1500);
+    tftp_session_set_open_cb(ts.session, dummy_open);
+
+    uint8_t req_buf[] = {
+        0x00, 0x02,                                   // Opcode (WRQ)
+        'f', 'i', 'l', 'e', 'n', 'a', 'm', 'e', 0x00, // Filename
+        'O', 'C', 'T', 'E', 'T', 0x00,                // Mode
+        'T', 'S', 'I', 'Z', 'E', 0x00,                // Option
+        '2', '0', '4', '8', 0x00,                     // TSIZE value
+        'W', 'I', 'N', 'D', 'O', 'W', 'S', 'I', 'Z', 'E', 0x00,      // Option
+        '4', 0x00,                                              // WINDOWSIZE value
+    };
+    auto status = tftp_handle_msg(ts.session, req_buf, sizeof(req_buf), ts.out, &ts.outlen, &ts.timeout, nullptr);
+    ASSERT_EQ(TFTP_NO_ERROR, status, "receive write request failed");
+
+    // If the first DATA never shows up, resend the OACK
+    ts.outlen = ts.out_size;
+    status = tftp_timeout(ts.session, ts.out, &ts.outlen, &ts.timeout, nullptr);
+    EXPECT_EQ(TFTP_NO_ERROR, status, "timeout error");
+    EXPECT_TRUE(verify_response_opcode(ts, OPCODE_OACK), "bad response");
+
+    uint8_t data_buf[516] = {
+        0x00, 0x03,  // Opcode (DATA)
+        0x01, 0x00,  // Block
+    };
+    tftp_session_set_write_cb(ts.session, mock_write);
+    tx_test_data td;
+    ts.outlen = ts.out_size;
+    status = tftp_handle_msg(ts.session, data_buf, sizeof(data_buf), ts.out, &ts.outlen, &ts.timeout, &td);
+    ASSERT_EQ(TFTP_NO_ERROR, status, "receive data failed");
+    ASSERT_EQ(0, ts.outlen, "no response expected");
+
+    // The rest of the window got lost; say again what we have
+    ts.outlen = ts.out_size;
+    status = tftp_timeout(ts.session, ts.out, &ts.outlen, &ts.timeout, &td);
+    EXPECT_EQ(TFTP_NO_ERROR, status, "timeout error");
+    ASSERT_TRUE(verify_response_opcode(ts, OPCODE_ACK), "bad response");
+    auto msg = reinterpret_cast<tftp_data_msg*>(ts.out);
+    EXPECT_EQ(1, msg->block, "bad block number");
+    EXPECT_EQ(0, ts.session->window_index, "tftp session window index mismatch");
+
+    END_TEST;
+}
+
+static bool test_tftp_receive_data_out_of_order_once(void) {
+    BEGIN_TEST;
+
+    test_state ts;
+    ts.reset(1024, 2048, 1500);
+    tftp_session_set_open_cb(ts.session, dummy_open);
+
+    uint8_t req_buf[] = {
+        0x00, 0x02,                                   // Opcode (WRQ)
+        'f', 'i', 'l', 'e', 'n', 'a', 'm', 'e', 0x00, // Filename
+        'O', 'C', 'T', 'E', 'T', 0x00,                // Mode
+        'T', 'S', 'I', 'Z', 'E', 0x00,                // Option
+        '2', '0', '4', '8', 0x00,                     // TSIZE value
+        'W', 'I', 'N', 'D', 'O', 'W', 'S', 'I', 'Z', 'E', 0x00,      // Option
+        '4', 0x00,                                              // WINDOWSIZE value
+    };
+    auto status = tftp_handle_msg(ts.session, req_buf, sizeof(req_buf), ts.out, &ts.outlen, &ts.timeout, nullptr);
+    ASSERT_EQ(TFTP_NO_ERROR, status, "receive write request failed");
+    tftp_session_set_write_cb(ts.session, mock_write);
+
+    // Block 1 was lost: only the first block past the gap asks for a resend
+    uint8_t data_buf[516] = {
+        0x00, 0x03,  // Opcode (DATA)
+        0x02, 0x00,  // Block
+    };
+    ts.outlen = ts.out_size;
+    status = tftp_handle_msg(ts.session, data_buf, sizeof(data_buf), ts.out, &ts.outlen, &ts.timeout, nullptr);
+    EXPECT_EQ(TFTP_NO_ERROR, status, "receive data failed");
+    ASSERT_TRUE(verify_response_opcode(ts, OPCODE_ACK), "bad response");
+    auto msg = reinterpret_cast<tftp_data_msg*>(ts.out);
+    EXPECT_EQ(0, msg->block, "bad block number");
+
+    data_buf[2] = 3;
+    ts.outlen = ts.out_size;
+    status = tftp_handle_msg(ts.session, data_buf, sizeof(data_buf), ts.out, &ts.outlen, &ts.timeout, nullptr);
+    EXPECT_EQ(TFTP_NO_ERROR, status, "receive data failed");
+    EXPECT_EQ(0, ts.outlen, "no response expected");
+
+    // The resend arrives
+    tx_test_data td;
+    data_buf[2] = 1;
+    ts.outlen = ts.out_size;
+    status = tftp_handle_msg(ts.session, data_buf, sizeof(data_buf), ts.out, &ts.outlen, &ts.timeout, &td);
+    EXPECT_EQ(TFTP_NO_ERROR, status, "receive data failed");
+    EXPECT_EQ(1, ts.session->block_number, "tftp session block number mismatch");
+    EXPECT_FALSE(ts.session->out_of_order, "tftp session should be back in order");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(tftp_setup)
 RUN_TEST(test_tftp_init)
 RUN_TEST(test_tftp_session_options)
@@ -1148,6 +1404,9 @@ RUN_TEST(test_tftp_receive_data_blocksize)
 RUN_TEST(test_tftp_receive_data_windowsize)
 RUN_TEST(test_tftp_receive_data_skipped_block)
 RUN_TEST(test_tftp_receive_data_windowsize_skipped_block)
+RUN_TEST(test_tftp_receive_data_block_wrap)
+RUN_TEST(test_tftp_receive_data_timeout)
+RUN_TEST(test_tftp_receive_data_out_of_order_once)
 END_TEST_CASE(tftp_receive_data)
 
 BEGIN_TEST_CASE(tftp_send_data)
@@ -1155,6 +1414,8 @@ RUN_TEST(test_tftp_send_data_receive_ack)
 RUN_TEST(test_tftp_send_data_receive_final_ack)
 RUN_TEST(test_tftp_send_data_receive_ack_skipped_block)
 RUN_TEST(test_tftp_send_data_receive_ack_window_size)
+RUN_TEST(test_tftp_send_data_receive_stale_ack)
+RUN_TEST(test_tftp_send_data_timeout)
 END_TEST_CASE(tftp_send_data)
 
 int main(int argc, char* argv[]) {
@@ -133,17 +133,35 @@ static void set_error(tftp_session* session, uint16_t opcode, tftp_msg* resp, si
     session->state = ERROR;
 }
 
+// Block numbers on the wire are only 16 bits and wrap around; turn one into
+// the full block number closest to |base|.
+static uint32_t unwrap_block(uint32_t base, uint16_t block) {
+    int32_t delta = (int16_t)(uint16_t)(block - (uint16_t)base);
+    if (delta < 0 && (uint32_t)-delta > base) {
+        delta += 65536;
+    }
+    return base + delta;
+}
+
+static bool all_blocks_sent(tftp_session* session) {
+    return (size_t)(session->block_number + session->window_index) * session->block_size >=
+            session->file_size;
+}
+
+// Send the next block of the window. The window only slides when an ACK
+// comes in, so up to window_size blocks are in flight at any time.
 tftp_status tx_data(tftp_session* session, tftp_data_msg* resp, size_t* outlen, void* cookie) {
-    session->offset = (session->block_number + session->window_index) * session->block_size;
+    uint32_t block = session->block_number + session->window_index + 1;
+    session->offset = (size_t)(block - 1) * session->block_size;
     *outlen = 0;
     if (session->offset < session->file_size) {
         session->window_index++;
         OPCODE(resp, OPCODE_DATA);
-        resp->block = session->block_number + session->window_index;
+        resp->block = (uint16_t)block;
         size_t len = MIN(session->file_size - session->offset, session->block_size);
-        xprintf(" -> Copying block #%d (size:%zu/%d) from %zu/%zu [%d/%d]\n",
-                session->block_number + session->window_index, len, session->block_size,
-                session->offset, session->file_size, session->window_index, session->window_size);
+        xprintf(" -> Copying block #%u (size:%zu/%d) from %zu/%zu [%d/%d]\n",
+                block, len, session->block_size, session->offset, session->file_size,
+                session->window_index, session->window_size);
         // TODO(tkilbourn): assert that these function pointers are set
         tftp_status s = session->read_fn(resp->data, &len, session->offset, cookie);
         if (s < 0) {
@@ -157,8 +175,6 @@ tftp_status tx_data(tftp_session* session, tftp_data_msg* resp, size_t* outlen,
         } else {
             xprintf(" -> TRANSMIT_WAIT_ON_ACK(%d >= %d)\n", session->window_index,
                     session->window_size);
-            session->block_number += session->window_size;
-            session->window_index = 0;
         }
     } else {
         xprintf(" -> TRANSMIT_WAIT_ON_ACK(completed)\n");
@@ -187,6 +203,7 @@ int tftp_init(tftp_session** session, void* buffer, size_t size) {
     s->block_size = s->options.block_size = DEFAULT_BLOCKSIZE;
     s->timeout = s->options.timeout = DEFAULT_TIMEOUT;
     s->mode = s->options.mode = DEFAULT_MODE;
+    s->max_timeouts = DEFAULT_MAX_TIMEOUTS;
 
     return TFTP_NO_ERROR;
 }
@@ -216,24 +233,19 @@ int tftp_session_set_write_cb(tftp_session* session, tftp_write cb) {
 }
 
 bool tftp_session_has_pending(tftp_session* session) {
-    return session->window_index > 0 && session->window_index < session->window_size;
+    return session->sending && session->window_index > 0 &&
+            session->window_index < session->window_size && !all_blocks_sent(session);
 }
 
-tftp_status tftp_generate_write_request(tftp_session* session,
-                                        const char* filename,
-                                        tftp_mode mode,
-                                        size_t datalen,
-                                        size_t block_size,
-                                        uint8_t timeout,
-                                        uint8_t window_size,
-                                        void* outgoing,
-                                        size_t* outlen,
-                                        uint32_t* timeout_ms) {
+// Assemble a WRQ from the options in the session. This is also used to
+// resend the request if the server does not answer.
+static tftp_status tx_write_request(tftp_session* session, void* outgoing, size_t* outlen) {
     if (*outlen < 2) {
         xprintf("outlen too short: %zd\n", *outlen);
         return TFTP_ERR_BUFFER_TOO_SMALL;
     }
 
+    const char* filename = session->options.filename;
     tftp_msg* ack = outgoing;
     OPCODE(ack, OPCODE_WRQ);
     char* body = ack->data;
@@ -243,11 +255,10 @@ tftp_status tftp_generate_write_request(tftp_session* session,
         xprintf("filename too long %zd > %zd\n", strlen(filename), left - kMaxMode);
         return TFTP_ERR_INVALID_ARGS;
     }
-    strncpy(session->options.filename, filename, sizeof(session->options.filename));
     memcpy(body, filename, strlen(filename));
     body += strlen(filename) + 1;
     left -= strlen(filename) + 1;
-    switch (mode) {
+    switch (session->options.mode) {
     case MODE_NETASCII:
         append_option_name(&body, &left, kNetascii);
         break;
@@ -260,50 +271,111 @@ tftp_status tftp_generate_write_request(tftp_session* session,
     default:
         return TFTP_ERR_INVALID_ARGS;
     }
-    session->options.mode = mode;
 
     if (left < kMaxTsizeOpt) {
         return TFTP_ERR_BUFFER_TOO_SMALL;
     }
-    append_option(&body, &left, kTsize, "%ld", datalen);
-    session->file_size = datalen;
+    append_option(&body, &left, kTsize, "%zu", session->file_size);
 
-    if (block_size > 0) {
+    if (session->options.requested & BLOCKSIZE_OPTION) {
         if (left < kMaxBlkSizeOpt) {
             return TFTP_ERR_BUFFER_TOO_SMALL;
         }
-        append_option(&body, &left, kBlkSize, "%ld", block_size);
-        session->options.block_size = block_size;
-        session->options.requested |= BLOCKSIZE_OPTION;
+        append_option(&body, &left, kBlkSize, "%d", session->options.block_size);
     }
 
-    if (timeout > 0) {
+    if (session->options.requested & TIMEOUT_OPTION) {
         if (left < kMaxTimeoutOpt) {
             return TFTP_ERR_BUFFER_TOO_SMALL;
         }
-        append_option(&body, &left, kTimeout, "%d", timeout);
-        session->options.timeout = timeout;
-        session->options.requested |= TIMEOUT_OPTION;
+        append_option(&body, &left, kTimeout, "%d", session->options.timeout);
     }
 
-    if (window_size > 1) {
+    if (session->options.requested & WINDOWSIZE_OPTION) {
         if (left < kMaxWindowSizeOpt) {
             return TFTP_ERR_BUFFER_TOO_SMALL;
         }
-        append_option(&body, &left, kWindowSize, "%d", window_size);
+        append_option(&body, &left, kWindowSize, "%d", session->options.window_size);
+    }
+
+    *outlen = *outlen - left;
+    return TFTP_NO_ERROR;
+}
+
+tftp_status tftp_generate_write_request(tftp_session* session,
+                                        const char* filename,
+                                        tftp_mode mode,
+                                        size_t datalen,
+                                        size_t block_size,
+                                        uint8_t timeout,
+                                        uint8_t window_size,
+                                        void* outgoing,
+                                        size_t* outlen,
+                                        uint32_t* timeout_ms) {
+    switch (mode) {
+    case MODE_NETASCII:
+    case MODE_OCTET:
+    case MODE_MAIL:
+        break;
+    default:
+        return TFTP_ERR_INVALID_ARGS;
+    }
+    if (strlen(filename) >= sizeof(session->options.filename)) {
+        xprintf("filename too long %zd\n", strlen(filename));
+        return TFTP_ERR_INVALID_ARGS;
+    }
+    strncpy(session->options.filename, filename, sizeof(session->options.filename));
+    session->options.mode = mode;
+    session->file_size = datalen;
+
+    if (block_size > 0) {
+        session->options.block_size = block_size;
+        session->options.requested |= BLOCKSIZE_OPTION;
+    }
+    if (timeout > 0) {
+        session->options.timeout = timeout;
+        session->options.requested |= TIMEOUT_OPTION;
+    }
+    if (window_size > 1) {
         session->options.window_size = window_size;
         session->options.requested |= WINDOWSIZE_OPTION;
     }
 
-    *outlen = *outlen - left;
+    tftp_status ret = tx_write_request(session, outgoing, outlen);
+    if (ret < 0) {
+        return ret;
+    }
     // Nothing has been negotiated yet so use default
     *timeout_ms = 1000 * session->timeout;
 
+    session->sending = true;
+    session->timeouts = 0;
     session->state = WRITE_REQUESTED;
     xprintf("Generated write request, len=%zu\n", *outlen);
     return TFTP_NO_ERROR;
 }
 
+// Assemble the OACK for the options we accepted from a WRQ. This is also
+// used to resend it if the first DATA does not arrive.
+static void tx_oack(tftp_session* session, tftp_msg* resp, size_t* resp_len) {
+    char* body = resp->data;
+    memset(body, 0, *resp_len - sizeof(*resp));
+    size_t left = *resp_len - sizeof(*resp);
+
+    OPCODE(resp, OPCODE_OACK);
+    append_option(&body, &left, kTsize, "%u", session->options.file_size);
+    if (session->options.requested & BLOCKSIZE_OPTION) {
+        append_option(&body, &left, kBlkSize, "%d", session->options.block_size);
+    }
+    if (session->options.requested & TIMEOUT_OPTION) {
+        append_option(&body, &left, kTimeout, "%d", session->options.timeout);
+    }
+    if (session->options.requested & WINDOWSIZE_OPTION) {
+        append_option(&body, &left, kWindowSize, "%d", session->options.window_size);
+    }
+    *resp_len = *resp_len - left;
+}
+
 tftp_status tftp_handle_rrq(tftp_session* session,
                             tftp_msg* rrq,
                             size_t rrq_len,
@@ -323,6 +395,12 @@ tftp_status tftp_handle_wrq(tftp_session* session,
                             size_t* resp_len,
                             uint32_t* timeout_ms,
                             void* cookie) {
+    if (session->state == WRITE_REQUESTED && !session->sending) {
+        // The sender did not get our OACK and asked again
+        xprintf("Repeated write request\n");
+        tx_oack(session, resp, resp_len);
+        return TFTP_NO_ERROR;
+    }
     if (session->state != NONE) {
         xprintf("Invalid state transition %d -> %d\n", session->state, WRITE_REQUESTED);
         set_error(session, OPCODE_ERROR, resp, resp_len);
@@ -424,34 +502,22 @@ tftp_status tftp_handle_wrq(tftp_session* session,
         left -= offset;
     }
 
-    char* body = resp->data;
-    memset(body, 0, *resp_len - sizeof(*resp));
-    left = *resp_len - sizeof(*resp);
-
-    OPCODE(resp, OPCODE_OACK);
-    if (session->options.requested & FILESIZE_OPTION) {
-        append_option(&body, &left, kTsize, "%d", session->options.file_size);
-        session->file_size = session->options.file_size;
-    } else {
+    if (!(session->options.requested & FILESIZE_OPTION)) {
         xprintf("No TSIZE option specified\n");
         set_error(session, OPCODE_ERROR, resp, resp_len);
         return TFTP_ERR_BAD_STATE;
     }
+    session->file_size = session->options.file_size;
     if (session->options.requested & BLOCKSIZE_OPTION) {
         // TODO(jpoichet) Make sure this block size is possible. Need API upwards to
         // request allocation of block size * window size memory
-        append_option(&body, &left, kBlkSize, "%d", session->options.block_size);
         session->block_size = session->options.block_size;
     }
     if (session->options.requested & TIMEOUT_OPTION) {
-        // TODO(jpoichet) Make sure this timeout is possible. Need API upwards to
-        // request allocation of block size * window size memory
-        append_option(&body, &left, kTimeout, "%d", session->options.timeout);
         session->timeout = session->options.timeout;
         *timeout_ms = 1000 * session->timeout;
     }
     if (session->options.requested & WINDOWSIZE_OPTION) {
-        append_option(&body, &left, kWindowSize, "%d", session->options.window_size);
         session->window_size = session->options.window_size;
     }
     if (!session->open_fn ||
@@ -460,7 +526,9 @@ tftp_status tftp_handle_wrq(tftp_session* session,
         set_error(session, OPCODE_ERROR, resp, resp_len);
         return TFTP_ERR_BAD_STATE;
     }
-    *resp_len = *resp_len - left;
+    tx_oack(session, resp, resp_len);
+    session->sending = false;
+    session->timeouts = 0;
     session->state = WRITE_REQUESTED;
 
     xprintf("Read/Write Request Parsed\n");
@@ -502,41 +570,48 @@ tftp_status tftp_handle_data(tftp_session* session,
 
     tftp_data_msg* data = (tftp_data_msg*)msg;
     tftp_data_msg* ack_data = (tftp_data_msg*)resp;
-    xprintf(" <- Block %u (Last = %u, Offset = %d, Size = %ld, Left = %ld)\n", data->block,
-            session->block_number, session->block_number * session->block_size,
-            session->file_size, session->file_size - session->block_number * session->block_size);
-    if (data->block == session->block_number + 1) {
+    uint32_t block = unwrap_block(session->block_number + 1, data->block);
+    xprintf(" <- Block %u (Last = %u, Offset = %zu, Size = %zu, Left = %zu)\n", block,
+            session->block_number, (size_t)session->block_number * session->block_size,
+            session->file_size,
+            session->file_size - (size_t)session->block_number * session->block_size);
+    if (block == session->block_number + 1) {
         xprintf("Advancing normally + 1\n");
         size_t wr = msg_len - sizeof(tftp_data_msg);
         // TODO(tkilbourn): assert that these function pointers are set
         tftp_status ret = session->write_fn(data->data, &wr,
-                session->block_number * session->block_size, cookie);
+                (size_t)session->block_number * session->block_size, cookie);
         if (ret < 0) {
             xprintf("Error writing: %d\n", ret);
             return ret;
         }
         session->block_number++;
         session->window_index++;
-    } else if (data->block > session->block_number + 1) {
-        // Force sending a ACK with the last block_number we received
-        xprintf("Skipped: got %d, expected %d\n", data->block, session->block_number + 1);
-        session->window_index = session->window_size;
+        session->timeouts = 0;
+        session->out_of_order = false;
     } else {
-        xprintf("Resetting to block %d\n", data->block);
-        // Skip writing this block; subsequent blocks will get overwritten
-        // though.
-        session->block_number = data->block;
-        session->window_index = 1;
+        // Either we skipped ahead, or this is a resend of something we already
+        // have because our last ACK got lost. Send an ACK with the last block
+        // we got in order, so the sender resends from the first one we are
+        // missing. Only do it once until we make progress again; the rest of
+        // the window would otherwise trigger one resend each.
+        xprintf("Out of order: got %u, expected %u\n", block, session->block_number + 1);
+        if (session->out_of_order) {
+            *resp_len = 0;
+            return TFTP_NO_ERROR;
+        }
+        session->out_of_order = true;
+        session->window_index = session->window_size;
     }
 
-    if (session->window_index == session->window_size ||
-            session->block_number * session->block_size >= session->file_size) {
-        xprintf(" -> Ack %d\n", session->block_number);
+    bool last = (size_t)session->block_number * session->block_size >= session->file_size;
+    if (session->window_index >= session->window_size || last) {
+        xprintf(" -> Ack %u\n", session->block_number);
         session->window_index = 0;
         OPCODE(ack_data, OPCODE_ACK);
-        ack_data->block = session->block_number;
+        ack_data->block = (uint16_t)session->block_number;
         *resp_len = sizeof(*ack_data);
-        if (session->block_number * session->block_size >= session->file_size) {
+        if (last) {
             return TFTP_TRANSFER_COMPLETED;
         }
     } else {
@@ -570,12 +645,27 @@ tftp_status tftp_handle_ack(tftp_session* session,
     tftp_data_msg* ack_data = (void*)ack;
     tftp_data_msg* resp_data = (void*)resp;
 
-    xprintf(" <- Ack %d\n", ack_data->block);
-    session->block_number = ack_data->block;
+    uint32_t block = unwrap_block(session->block_number, ack_data->block);
+    xprintf(" <- Ack %u\n", block);
+    if (block < session->block_number) {
+        // A stale ACK from before we last went back tells us nothing new.
+        xprintf("Ignoring ack %u (window %u+%u)\n", block, session->block_number,
+                session->window_index);
+        *resp_len = 0;
+        return TFTP_NO_ERROR;
+    }
+    if (block > session->block_number) {
+        session->timeouts = 0;
+    }
+    // The receiver acknowledges at the end of each window, or early with the
+    // last block it got in order when it sees a gap. Either way whatever we
+    // sent past |block| has to go out again, starting right after it.
+    session->block_number = block;
     session->window_index = 0;
 
-    if ((session->block_number + session->window_index) * session->block_size >= session->file_size) {
+    if (all_blocks_sent(session)) {
         *resp_len = 0;
+        session->state = COMPLETED;
         return TFTP_TRANSFER_COMPLETED;
     }
 
@@ -704,6 +794,8 @@ tftp_status tftp_handle_oack(tftp_session* session,
     tftp_data_msg* resp_data = (void*)resp;
     session->offset = 0;
     session->block_number = 0;
+    session->window_index = 0;
+    session->timeouts = 0;
 
     tftp_status ret = tx_data(session, resp_data, resp_len, cookie);
     if (ret < 0) {
@@ -770,9 +862,9 @@ tftp_status tftp_prepare_data(tftp_session* session,
                               void* cookie) {
     tftp_data_msg* resp_data = outgoing;
 
-    if ((session->block_number + session->window_index) * session->block_size >= session->file_size) {
+    if (all_blocks_sent(session)) {
         *outlen = 0;
-        return TFTP_TRANSFER_COMPLETED;
+        return TFTP_NO_ERROR;
     }
 
     tftp_status ret = tx_data(session, resp_data, outlen, cookie);
@@ -787,6 +879,59 @@ tftp_status tftp_timeout(tftp_session* session,
                          size_t* outlen,
                          uint32_t* timeout_ms,
                          void* cookie) {
-    // TODO: really handle timeouts
-    return TFTP_NO_ERROR;
+    switch (session->state) {
+    case WRITE_REQUESTED:
+    case TRANSMITTING:
+        break;
+    case NONE:
+        // Nothing started yet, so nothing to resend
+        *outlen = 0;
+        return TFTP_NO_ERROR;
+    case LAST_PACKET:
+    case ERROR:
+    case COMPLETED:
+    default:
+        *outlen = 0;
+        return TFTP_ERR_BAD_STATE;
+    }
+
+    if (++session->timeouts > session->max_timeouts) {
+        xprintf("Too many timeouts\n");
+        session->state = ERROR;
+        *outlen = 0;
+        return TFTP_ERR_TIMED_OUT;
+    }
+    *timeout_ms = 1000 * session->timeout;
+
+    tftp_status ret = TFTP_NO_ERROR;
+    if (session->sending) {
+        if (session->state == WRITE_REQUESTED) {
+            xprintf("Resending write request\n");
+            ret = tx_write_request(session, outgoing, outlen);
+        } else {
+            // Go back to the first block not acknowledged. The caller sends
+            // the rest of the window as tftp_session_has_pending() says.
+            xprintf("Resending from block %u\n", session->block_number + 1);
+            session->window_index = 0;
+            ret = tx_data(session, outgoing, outlen, cookie);
+        }
+    } else {
+        if (session->state == WRITE_REQUESTED) {
+            xprintf("Resending option ack\n");
+            tx_oack(session, outgoing, outlen);
+        } else {
+            // Our ACK may have been lost; tell the sender again where we are.
+            xprintf("Resending ack %u\n", session->block_number);
+            tftp_data_msg* ack_data = outgoing;
+            OPCODE(ack_data, OPCODE_ACK);
+            ack_data->block = (uint16_t)session->block_number;
+            *outlen = sizeof(*ack_data);
+            session->window_index = 0;
+            session->out_of_order = false;
+        }
+    }
+    if (ret < 0) {
+        set_error(session, OPCODE_ERROR, outgoing, outlen);
+    }
+    return ret;
 }
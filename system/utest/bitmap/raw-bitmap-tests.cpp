@@ -4,6 +4,7 @@
 
 #include <bitmap/raw-bitmap.h>
 #include <bitmap/storage.h>
+#include <bitmap/summary-bitmap.h>
 
 #include <magenta/new.h>
 #include <mxtl/algorithm.h>
@@ -352,6 +353,8 @@ static bool SetOutOfOrder(void) {
 BEGIN_TEST_CASE(raw_bitmap_tests)
 ALL_TESTS(RawBitmapGeneric<DefaultStorage>)
 ALL_TESTS(RawBitmapGeneric<VmoStorage>)
+ALL_TESTS(SummaryBitmapGeneric<DefaultStorage>)
+ALL_TESTS(SummaryBitmapGeneric<VmoStorage>)
 END_TEST_CASE(raw_bitmap_tests);
 
 } // namespace tests
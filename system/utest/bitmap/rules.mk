@@ -12,6 +12,7 @@ MODULE_SRCS += \
     $(LOCAL_DIR)/main.c \
     $(LOCAL_DIR)/raw-bitmap-tests.cpp \
     $(LOCAL_DIR)/rle-bitmap-tests.cpp \
+    $(LOCAL_DIR)/summary-bitmap-tests.cpp \
 
 MODULE_NAME := bitmap-test
 
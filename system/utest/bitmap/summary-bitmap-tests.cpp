@@ -0,0 +1,130 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <bitmap/raw-bitmap.h>
+#include <bitmap/storage.h>
+#include <bitmap/summary-bitmap.h>
+
+#include <string.h>
+
+#include <magenta/new.h>
+#include <mxtl/algorithm.h>
+#include <unittest/unittest.h>
+
+namespace bitmap {
+namespace tests {
+
+// A small deterministic generator, so failures can be reproduced.
+static uint64_t Next(uint64_t* state) {
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return *state >> 17;
+}
+
+// Random operations on a summary bitmap and a raw one with the same bits,
+// checking that every Scan and Find gives the same answer.
+static bool MatchesRawBitmap(void) {
+    BEGIN_TEST;
+
+    const size_t kSizes[] = { 1, 63, 64, 65, 200, 4096 + 7, 64 * 64 * 3 + 1 };
+    uint64_t state = 1;
+    for (size_t size : kSizes) {
+        SummaryBitmapGeneric<DefaultStorage> sbm;
+        RawBitmapGeneric<DefaultStorage> rbm;
+        ASSERT_EQ(sbm.Reset(size), NO_ERROR, "");
+        ASSERT_EQ(rbm.Reset(size), NO_ERROR, "");
+
+        for (int op = 0; op < 2000; op++) {
+            size_t a = Next(&state) % (size + 1);
+            size_t b = Next(&state) % (size + 1);
+            size_t lo = mxtl::min(a, b);
+            size_t hi = mxtl::max(a, b);
+            // mostly small ranges, so the map fills up unevenly
+            if (hi - lo > 130 && (Next(&state) % 4)) {
+                hi = lo + Next(&state) % 130;
+            }
+            if (Next(&state) % 3) {
+                ASSERT_EQ(sbm.Set(lo, hi), NO_ERROR, "");
+                ASSERT_EQ(rbm.Set(lo, hi), NO_ERROR, "");
+            } else {
+                ASSERT_EQ(sbm.Clear(lo, hi), NO_ERROR, "");
+                ASSERT_EQ(rbm.Clear(lo, hi), NO_ERROR, "");
+            }
+
+            a = Next(&state) % (size + 1);
+            b = Next(&state) % (size + 1);
+            lo = mxtl::min(a, b);
+            hi = mxtl::max(a, b);
+            bool is_set = Next(&state) & 1;
+            ASSERT_EQ(sbm.Scan(lo, hi, is_set), rbm.Scan(lo, hi, is_set), "scan");
+
+            if (lo < hi) {
+                size_t run_len = 1 + Next(&state) % 100;
+                size_t sout, rout;
+                ASSERT_EQ(sbm.Find(is_set, lo, hi, run_len, &sout),
+                          rbm.Find(is_set, lo, hi, run_len, &rout), "find");
+                ASSERT_EQ(sout, rout, "find result");
+            }
+        }
+    }
+
+    END_TEST;
+}
+
+static bool NearlyFull(void) {
+    BEGIN_TEST;
+
+    const size_t kSize = 1 << 22;
+    SummaryBitmapGeneric<DefaultStorage> bitmap;
+    ASSERT_EQ(bitmap.Reset(kSize), NO_ERROR, "");
+    ASSERT_EQ(bitmap.Set(0, kSize), NO_ERROR, "");
+
+    size_t out;
+    EXPECT_EQ(bitmap.Find(false, 0, kSize, 1, &out), ERR_NO_RESOURCES, "");
+    EXPECT_EQ(out, kSize, "");
+
+    const size_t kHole = kSize - 1000;
+    ASSERT_EQ(bitmap.Clear(kHole, kHole + 3), NO_ERROR, "");
+    EXPECT_EQ(bitmap.Find(false, 0, kSize, 1, &out), NO_ERROR, "");
+    EXPECT_EQ(out, kHole, "");
+    EXPECT_EQ(bitmap.Find(false, 0, kSize, 3, &out), NO_ERROR, "");
+    EXPECT_EQ(out, kHole, "");
+    EXPECT_EQ(bitmap.Find(false, 0, kSize, 4, &out), ERR_NO_RESOURCES, "");
+    EXPECT_EQ(bitmap.Find(false, kHole + 1, kSize, 1, &out), NO_ERROR, "");
+    EXPECT_EQ(out, kHole + 1, "");
+
+    EXPECT_EQ(bitmap.Set(kHole, kHole + 3), NO_ERROR, "");
+    EXPECT_EQ(bitmap.Find(false, 0, kSize, 1, &out), ERR_NO_RESOURCES, "");
+
+    END_TEST;
+}
+
+static bool RebuildAfterDirectWrite(void) {
+    BEGIN_TEST;
+
+    const size_t kSize = 64 * 64 * 4;
+    SummaryBitmapGeneric<DefaultStorage> bitmap;
+    ASSERT_EQ(bitmap.Reset(kSize), NO_ERROR, "");
+
+    // Fill the storage behind the bitmap's back, as loading it from disk does.
+    void* data = bitmap.StorageUnsafe()->GetData();
+    memset(data, 0xff, kSize / 8);
+    static_cast<uint8_t*>(data)[kSize / 8 - 100] = 0xf7;
+    bitmap.RebuildSummary();
+
+    size_t out;
+    EXPECT_EQ(bitmap.Find(false, 0, kSize, 1, &out), NO_ERROR, "");
+    EXPECT_EQ(out, kSize - 800 + 3, "");
+    EXPECT_TRUE(bitmap.Get(0, kSize - 800), "");
+
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(summary_bitmap_tests)
+RUN_TEST(MatchesRawBitmap)
+RUN_TEST(NearlyFull)
+RUN_TEST(RebuildAfterDirectWrite)
+END_TEST_CASE(summary_bitmap_tests);
+
+} // namespace tests
+} // namespace bitmap
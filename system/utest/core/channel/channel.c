@@ -3,13 +3,16 @@
 // found in the LICENSE file.
 
 #include <assert.h>
+#include <limits.h>
 #include <magenta/compiler.h>
+#include <magenta/process.h>
 #include <magenta/syscalls.h>
 #include <magenta/syscalls/object.h>
 #include <unittest/unittest.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <threads.h>
 #include <unistd.h>
 
@@ -268,6 +271,47 @@ static bool channel_duplicate_handles(void) {
     END_TEST;
 }
 
+// Handles move in and out of the process in bulk; a bad handle part way
+// through must leave every handle before it where it was.
+static bool channel_many_handles(void) {
+    BEGIN_TEST;
+
+    mx_handle_t channel[2];
+    ASSERT_EQ(mx_channel_create(0, &channel[0], &channel[1]), NO_ERROR, "");
+
+    enum { kNumHandles = 64 };
+    mx_handle_t events[kNumHandles + 1];
+    for (int i = 0; i < kNumHandles; i++)
+        ASSERT_EQ(mx_event_create(0u, &events[i]), NO_ERROR, "");
+    events[kNumHandles] = MX_HANDLE_INVALID;
+
+    EXPECT_EQ(mx_channel_write(channel[0], 0u, NULL, 0, events, kNumHandles + 1),
+              ERR_BAD_HANDLE, "");
+    for (int i = 0; i < kNumHandles; i++)
+        EXPECT_EQ(mx_object_signal(events[i], 0u, MX_USER_SIGNAL_0), NO_ERROR,
+                  "handle not put back");
+
+    ASSERT_EQ(mx_channel_write(channel[0], 0u, NULL, 0, events, kNumHandles), NO_ERROR, "");
+    for (int i = 0; i < kNumHandles; i++)
+        EXPECT_EQ(mx_handle_close(events[i]), ERR_BAD_HANDLE, "handle not transferred");
+
+    mx_handle_t received[kNumHandles];
+    uint32_t num_handles = 0u;
+    ASSERT_EQ(mx_channel_read(channel[1], 0u, NULL, received, 0, kNumHandles,
+                              NULL, &num_handles), NO_ERROR, "");
+    EXPECT_EQ(num_handles, (uint32_t)kNumHandles, "");
+    for (uint32_t i = 0; i < num_handles; i++) {
+        mx_signals_t pending;
+        EXPECT_EQ(mx_object_wait_one(received[i], MX_USER_SIGNAL_0, 0u, &pending), NO_ERROR, "");
+        EXPECT_EQ(mx_handle_close(received[i]), NO_ERROR, "");
+    }
+
+    EXPECT_EQ(mx_handle_close(channel[0]), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(channel[1]), NO_ERROR, "");
+
+    END_TEST;
+}
+
 static const uint32_t multithread_read_num_messages = 5000u;
 
 #define MSG_UNSET       ((uint32_t)-1)
@@ -773,17 +817,215 @@ static bool channel_nest(void) {
     END_TEST;
 }
 
+static bool map_buffer(size_t size, mx_handle_t* vmo, uintptr_t* addr) {
+    ASSERT_EQ(mx_vmo_create(size, 0, vmo), NO_ERROR, "");
+    ASSERT_EQ(mx_vmar_map(mx_vmar_root_self(), 0, *vmo, 0, size,
+                          MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, addr),
+              NO_ERROR, "");
+    return true;
+}
+
+static bool channel_move_pages(void) {
+    BEGIN_TEST;
+
+    mx_handle_t channel[2];
+    ASSERT_EQ(mx_channel_create(0, &channel[0], &channel[1]), NO_ERROR, "");
+
+    // eight whole pages plus a partial one that has to be copied
+    const uint32_t msg_size = 8 * PAGE_SIZE + 100;
+    const size_t buf_size = 9 * PAGE_SIZE;
+
+    mx_handle_t src_vmo, dst_vmo;
+    uintptr_t src_addr, dst_addr;
+    ASSERT_TRUE(map_buffer(buf_size, &src_vmo, &src_addr), "");
+    ASSERT_TRUE(map_buffer(buf_size, &dst_vmo, &dst_addr), "");
+
+    uint8_t* src = (uint8_t*)src_addr;
+    uint8_t* dst = (uint8_t*)dst_addr;
+    for (uint32_t i = 0; i < msg_size; i++)
+        src[i] = (uint8_t)(i * 7 + 1);
+
+    ASSERT_EQ(mx_channel_write(channel[0], MX_CHANNEL_WRITE_MOVE_PAGES, src, msg_size, NULL, 0),
+              NO_ERROR, "");
+
+    // the whole pages were taken away from the sender, the partial page was copied
+    EXPECT_EQ(src[0], 0u, "page was not moved");
+    EXPECT_EQ(src[8 * PAGE_SIZE], (uint8_t)(8 * PAGE_SIZE * 7 + 1), "tail was modified");
+
+    uint32_t actual;
+    ASSERT_EQ(mx_channel_read(channel[1], MX_CHANNEL_READ_MOVE_PAGES, dst, NULL, buf_size, 0,
+                              &actual, NULL),
+              NO_ERROR, "");
+    EXPECT_EQ(actual, msg_size, "wrong size");
+
+    bool match = true;
+    for (uint32_t i = 0; i < msg_size; i++) {
+        if (dst[i] != (uint8_t)(i * 7 + 1))
+            match = false;
+    }
+    EXPECT_TRUE(match, "payload corrupted");
+
+    // small and unaligned payloads silently fall back to copying
+    char small[16] = "hello";
+    ASSERT_EQ(mx_channel_write(channel[0], MX_CHANNEL_WRITE_MOVE_PAGES, small, sizeof(small),
+                               NULL, 0),
+              NO_ERROR, "");
+    EXPECT_EQ(small[0], 'h', "small payload was modified");
+    ASSERT_EQ(mx_channel_read(channel[1], MX_CHANNEL_READ_MOVE_PAGES, dst + 1, NULL, buf_size - 1,
+                              0, &actual, NULL),
+              NO_ERROR, "");
+    EXPECT_EQ(actual, sizeof(small), "wrong size");
+    EXPECT_EQ(memcmp(dst + 1, small, sizeof(small)), 0, "payload corrupted");
+
+    EXPECT_EQ(mx_vmar_unmap(mx_vmar_root_self(), src_addr, buf_size), NO_ERROR, "");
+    EXPECT_EQ(mx_vmar_unmap(mx_vmar_root_self(), dst_addr, buf_size), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(src_vmo), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(dst_vmo), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(channel[0]), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(channel[1]), NO_ERROR, "");
+
+    END_TEST;
+}
+
+static bool channel_batch(void) {
+    BEGIN_TEST;
+
+    mx_handle_t channel[2];
+    ASSERT_EQ(mx_channel_create(0, &channel[0], &channel[1]), NO_ERROR, "");
+
+    mx_handle_t event;
+    ASSERT_EQ(mx_event_create(0u, &event), NO_ERROR, "");
+
+    uint32_t data[4] = { 1, 2, 3, 4 };
+    mx_channel_msg_t wr[4];
+    memset(wr, 0, sizeof(wr));
+    for (int i = 0; i < 4; i++) {
+        wr[i].bytes = &data[i];
+        wr[i].num_bytes = sizeof(uint32_t);
+    }
+    wr[1].handles = &event;
+    wr[1].num_handles = 1;
+
+    uint32_t actual;
+    ASSERT_EQ(mx_channel_write_many(channel[0], 0u, wr, 4, &actual), NO_ERROR, "");
+    EXPECT_EQ(actual, 4u, "not all messages written");
+    for (int i = 0; i < 4; i++)
+        EXPECT_EQ(wr[i].status, NO_ERROR, "");
+
+    // the third slot is too small, so reading stops there without consuming it
+    uint32_t out[4] = {};
+    mx_handle_t out_handle = MX_HANDLE_INVALID;
+    mx_channel_msg_t rd[4];
+    memset(rd, 0, sizeof(rd));
+    for (int i = 0; i < 4; i++) {
+        rd[i].bytes = &out[i];
+        rd[i].num_bytes = (i == 2) ? 1u : sizeof(uint32_t);
+    }
+    rd[1].handles = &out_handle;
+    rd[1].num_handles = 1;
+
+    ASSERT_EQ(mx_channel_read_many(channel[1], 0u, rd, 4, &actual), NO_ERROR, "");
+    EXPECT_EQ(actual, 2u, "wrong message count");
+    EXPECT_EQ(out[0], 1u, "");
+    EXPECT_EQ(out[1], 2u, "");
+    EXPECT_EQ(rd[1].num_handles, 1u, "");
+    EXPECT_NEQ(out_handle, MX_HANDLE_INVALID, "handle not transferred");
+    EXPECT_EQ(rd[2].status, ERR_BUFFER_TOO_SMALL, "");
+    EXPECT_EQ(rd[2].num_bytes, sizeof(uint32_t), "size of next message not reported");
+
+    rd[2].num_bytes = sizeof(uint32_t);
+    ASSERT_EQ(mx_channel_read_many(channel[1], 0u, &rd[2], 2, &actual), NO_ERROR, "");
+    EXPECT_EQ(actual, 2u, "wrong message count");
+    EXPECT_EQ(out[2], 3u, "");
+    EXPECT_EQ(out[3], 4u, "");
+    EXPECT_EQ(mx_channel_read_many(channel[1], 0u, rd, 4, &actual), ERR_SHOULD_WAIT, "");
+
+    // a bad handle in the second message stops the batch after the first
+    mx_handle_t bad = MX_HANDLE_INVALID;
+    wr[1].handles = &bad;
+    ASSERT_EQ(mx_channel_write_many(channel[0], 0u, wr, 4, &actual), NO_ERROR, "");
+    EXPECT_EQ(actual, 1u, "wrong message count");
+    EXPECT_EQ(wr[0].status, NO_ERROR, "");
+    EXPECT_EQ(wr[1].status, ERR_BAD_HANDLE, "");
+
+    EXPECT_EQ(mx_channel_write_many(channel[0], 0u, wr, 0, &actual), ERR_INVALID_ARGS, "");
+    EXPECT_EQ(mx_channel_write_many(channel[0], 0u, wr, MX_CHANNEL_MAX_BATCH + 1, &actual),
+              ERR_INVALID_ARGS, "");
+
+    // a closed peer leaves the handles with the writer
+    EXPECT_EQ(mx_handle_close(channel[1]), NO_ERROR, "");
+    wr[1].handles = &out_handle;
+    EXPECT_EQ(mx_channel_write_many(channel[0], 0u, wr, 2, &actual), ERR_PEER_CLOSED, "");
+    EXPECT_EQ(actual, 0u, "");
+    EXPECT_EQ(mx_handle_close(out_handle), NO_ERROR, "handle not returned");
+    EXPECT_EQ(mx_handle_close(channel[0]), NO_ERROR, "");
+
+    END_TEST;
+}
+
+static bool channel_writev(void) {
+    BEGIN_TEST;
+
+    mx_handle_t channel[2];
+    ASSERT_EQ(mx_channel_create(0, &channel[0], &channel[1]), NO_ERROR, "");
+
+    mx_handle_t event;
+    ASSERT_EQ(mx_event_create(0u, &event), NO_ERROR, "");
+
+    uint32_t header = 0xcafe;
+    char payload[] = "payload";
+    mx_iovec_t vec[3] = {
+        { &header, sizeof(header) },
+        { NULL, 0u },
+        { payload, sizeof(payload) },
+    };
+    ASSERT_EQ(mx_channel_writev(channel[0], 0u, vec, 3, &event, 1), NO_ERROR, "");
+
+    char out[64] = {};
+    mx_handle_t out_handle = MX_HANDLE_INVALID;
+    uint32_t actual_bytes, actual_handles;
+    ASSERT_EQ(mx_channel_read(channel[1], 0u, out, sizeof(out), &actual_bytes,
+                              &out_handle, 1, &actual_handles), NO_ERROR, "");
+    EXPECT_EQ(actual_bytes, sizeof(header) + sizeof(payload), "");
+    EXPECT_EQ(actual_handles, 1u, "");
+    EXPECT_EQ(memcmp(out, &header, sizeof(header)), 0, "");
+    EXPECT_EQ(memcmp(out + sizeof(header), payload, sizeof(payload)), 0, "");
+
+    // An empty message.
+    ASSERT_EQ(mx_channel_writev(channel[0], 0u, NULL, 0, NULL, 0), NO_ERROR, "");
+    ASSERT_EQ(mx_channel_read(channel[1], 0u, out, sizeof(out), &actual_bytes,
+                              NULL, 0, &actual_handles), NO_ERROR, "");
+    EXPECT_EQ(actual_bytes, 0u, "");
+
+    mx_iovec_t too_many[MX_IOVEC_MAX + 1];
+    memset(too_many, 0, sizeof(too_many));
+    EXPECT_EQ(mx_channel_writev(channel[0], 0u, too_many, MX_IOVEC_MAX + 1, NULL, 0),
+              ERR_OUT_OF_RANGE, "");
+    mx_iovec_t bad = { NULL, 4u };
+    EXPECT_EQ(mx_channel_writev(channel[0], 0u, &bad, 1, NULL, 0), ERR_INVALID_ARGS, "");
+
+    mx_handle_close(out_handle);
+    mx_handle_close(channel[0]);
+    mx_handle_close(channel[1]);
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(channel_tests)
 RUN_TEST(channel_test)
 RUN_TEST(channel_read_error_test)
 RUN_TEST(channel_close_test)
 RUN_TEST(channel_non_transferable)
 RUN_TEST(channel_duplicate_handles)
+RUN_TEST(channel_many_handles)
 RUN_TEST(channel_multithread_read)
 RUN_TEST(channel_may_discard)
 RUN_TEST(channel_call)
 RUN_TEST(channel_call2)
 RUN_TEST(channel_nest)
+RUN_TEST(channel_move_pages)
+RUN_TEST(channel_batch)
+RUN_TEST(channel_writev)
 END_TEST_CASE(channel_tests)
 
 #ifndef BUILD_COMBINED_TESTS
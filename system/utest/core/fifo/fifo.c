@@ -108,8 +108,79 @@ static bool basic_test(void) {
     END_TEST;
 }
 
+static bool shared_ring_test(void) {
+    BEGIN_TEST;
+    mx_handle_t a, b, rx, tx;
+
+    EXPECT_EQ(mx_fifo_create(8, 8, 2, &a, &b), ERR_INVALID_ARGS, "");
+
+    ASSERT_EQ(mx_fifo_create(8, 8, 0, &a, &b), NO_ERROR, "");
+    EXPECT_EQ(mx_fifo_get_rings(a, &rx, &tx), ERR_NOT_SUPPORTED, "");
+    EXPECT_EQ(mx_fifo_ring_update(a), ERR_NOT_SUPPORTED, "");
+    mx_handle_close(a);
+    mx_handle_close(b);
+
+    ASSERT_EQ(mx_fifo_create(8, 8, MX_FIFO_SHARED_RING, &a, &b), NO_ERROR, "");
+    ASSERT_EQ(mx_fifo_get_rings(a, &rx, &tx), NO_ERROR, "");
+
+    uint64_t vmo_size;
+    ASSERT_EQ(mx_vmo_get_size(tx, &vmo_size), NO_ERROR, "");
+    uintptr_t tx_addr, rx_addr;
+    const uint32_t flags = MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE;
+    ASSERT_EQ(mx_vmar_map(mx_vmar_root_self(), 0, tx, 0, vmo_size, flags, &tx_addr),
+              NO_ERROR, "");
+    ASSERT_EQ(mx_vmar_map(mx_vmar_root_self(), 0, rx, 0, vmo_size, flags, &rx_addr),
+              NO_ERROR, "");
+    mx_fifo_ring_t* tx_ring = (mx_fifo_ring_t*)tx_addr;
+    mx_fifo_ring_t* rx_ring = (mx_fifo_ring_t*)rx_addr;
+    uint64_t* tx_data = (uint64_t*)(tx_addr + MX_FIFO_RING_DATA_OFFSET);
+    EXPECT_EQ(tx_ring->elem_count, 8u, "");
+    EXPECT_EQ(tx_ring->elem_size, 8u, "");
+
+    // Fill the ring directly; nothing changes until the kernel is told.
+    for (uint32_t i = 0; i < 8; i++) {
+        tx_data[i] = i + 1;
+    }
+    __atomic_store_n(&tx_ring->head, 8u, __ATOMIC_RELEASE);
+    EXPECT_SIGNALS(b, MX_FIFO_WRITABLE);
+    ASSERT_EQ(mx_fifo_ring_update(a), NO_ERROR, "");
+    EXPECT_SIGNALS(a, 0u);
+    EXPECT_SIGNALS(b, MX_FIFO_READABLE | MX_FIFO_WRITABLE);
+
+    // The other end can still use the syscalls on the same ring.
+    uint64_t n[8] = {};
+    uint32_t actual;
+    ASSERT_EQ(mx_fifo_read(b, n, sizeof(uint64_t) * 3, &actual), NO_ERROR, "");
+    ASSERT_EQ(actual, 3u, "");
+    EXPECT_EQ(n[0], 1u, "");
+    EXPECT_EQ(n[2], 3u, "");
+    EXPECT_EQ(__atomic_load_n(&tx_ring->tail, __ATOMIC_ACQUIRE), 3u, "");
+    EXPECT_SIGNALS(a, MX_FIFO_WRITABLE);
+
+    n[0] = 42u;
+    ASSERT_EQ(mx_fifo_write(b, n, sizeof(uint64_t), &actual), NO_ERROR, "");
+    EXPECT_EQ(__atomic_load_n(&rx_ring->head, __ATOMIC_ACQUIRE), 1u, "");
+    EXPECT_EQ(((uint64_t*)(rx_addr + MX_FIFO_RING_DATA_OFFSET))[0], 42u, "");
+    EXPECT_SIGNALS(a, MX_FIFO_READABLE | MX_FIFO_WRITABLE);
+
+    // Consume directly.
+    __atomic_store_n(&rx_ring->tail, 1u, __ATOMIC_RELEASE);
+    ASSERT_EQ(mx_fifo_ring_update(a), NO_ERROR, "");
+    EXPECT_SIGNALS(a, MX_FIFO_WRITABLE);
+
+    mx_vmar_unmap(mx_vmar_root_self(), tx_addr, vmo_size);
+    mx_vmar_unmap(mx_vmar_root_self(), rx_addr, vmo_size);
+    mx_handle_close(rx);
+    mx_handle_close(tx);
+    mx_handle_close(a);
+    mx_handle_close(b);
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(fifo_tests)
 RUN_TEST(basic_test)
+RUN_TEST(shared_ring_test)
 END_TEST_CASE(fifo_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -497,6 +497,52 @@ static bool test_event_signaling() {
     END_TEST;
 }
 
+static int pi_waiter_thread(void* arg) {
+    auto futex_value = reinterpret_cast<volatile int*>(arg);
+    mx_handle_t owner = static_cast<mx_handle_t>(futex_value[1]);
+    mx_status_t rc = mx_futex_wait_pi(const_cast<int*>(&futex_value[0]), 1, owner,
+                                      MX_TIME_INFINITE);
+    futex_value[0] = 2;
+    return rc;
+}
+
+static bool test_futex_wait_pi() {
+    BEGIN_TEST;
+
+    mx_handle_t self = thrd_get_mx_handle(thrd_current());
+    int futex_value = 1;
+    EXPECT_EQ(mx_futex_wait_pi(&futex_value, 1, self, 0), ERR_INVALID_ARGS,
+              "a thread can't wait on itself");
+    EXPECT_EQ(mx_futex_wait_pi(&futex_value, 1, MX_HANDLE_INVALID, 0), ERR_BAD_HANDLE, "");
+
+    mx_handle_t event;
+    ASSERT_EQ(mx_event_create(0u, &event), NO_ERROR, "");
+    EXPECT_EQ(mx_futex_wait_pi(&futex_value, 1, event, 0), ERR_WRONG_TYPE, "");
+    mx_handle_close(event);
+
+    // Block another thread with the main thread as the owner.
+    mx_handle_t owner;
+    ASSERT_EQ(mx_handle_duplicate(self, MX_RIGHT_SAME_RIGHTS, &owner), NO_ERROR, "");
+    volatile int values[2] = { 1, static_cast<int>(owner) };
+    thrd_t thread;
+    ASSERT_EQ(thrd_create_with_name(&thread, pi_waiter_thread, const_cast<int*>(values),
+                                    "pi_waiter"), thrd_success, "");
+
+    // Give the waiter time to block, then release it like an unlock would.
+    mx_nanosleep(mx_deadline_after(MX_MSEC(100)));
+    EXPECT_EQ(values[0], 1, "waiter returned before being woken");
+    ASSERT_EQ(mx_futex_wake(const_cast<int*>(&values[0]), 1u), NO_ERROR, "");
+
+    int result;
+    ASSERT_EQ(thrd_join(thread, &result), thrd_success, "");
+    EXPECT_EQ(result, NO_ERROR, "");
+    EXPECT_EQ(values[0], 2, "");
+
+    mx_handle_close(owner);
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(futex_tests)
 RUN_TEST(test_futex_wait_value_mismatch);
 RUN_TEST(test_futex_wait_timeout);
@@ -514,6 +560,7 @@ RUN_TEST(test_futex_requeue);
 RUN_TEST(test_futex_requeue_unqueued_on_timeout);
 RUN_TEST(test_futex_thread_killed);
 RUN_TEST(test_futex_misaligned);
+RUN_TEST(test_futex_wait_pi);
 RUN_TEST(test_event_signaling);
 END_TEST_CASE(futex_tests)
 
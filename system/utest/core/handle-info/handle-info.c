@@ -2,8 +2,10 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <threads.h>
 
 #include <magenta/process.h>
 #include <magenta/syscalls.h>
@@ -144,10 +146,63 @@ static bool handle_rights_test(void) {
     END_TEST;
 }
 
+static atomic_int lookup_handle;
+static atomic_bool lookup_done;
+
+static int lookup_thread(void* arg) {
+    while (!atomic_load(&lookup_done)) {
+        mx_info_handle_basic_t info;
+        mx_status_t status = mx_object_get_info(atomic_load(&lookup_handle), MX_INFO_HANDLE_BASIC,
+                                                &info, sizeof(info), NULL, NULL);
+        // The handle may have been closed under us, but must never look like
+        // something other than the event it was.
+        if (status == NO_ERROR && info.type != MX_OBJ_TYPE_EVENT)
+            return -1;
+        if (status != NO_ERROR && status != ERR_BAD_HANDLE)
+            return -1;
+    }
+    return 0;
+}
+
+// Handle lookups don't take the handle table lock, make sure they are safe
+// against handles being closed and their slots being reused concurrently.
+static bool handle_lookup_race_test(void) {
+    BEGIN_TEST;
+
+    mx_handle_t event;
+    ASSERT_EQ(mx_event_create(0u, &event), NO_ERROR, "");
+    atomic_store(&lookup_handle, event);
+    atomic_store(&lookup_done, false);
+
+    thrd_t threads[4];
+    for (size_t i = 0; i < countof(threads); i++)
+        ASSERT_EQ(thrd_create_with_name(&threads[i], lookup_thread, NULL, "lookup"),
+                  thrd_success, "");
+
+    for (int i = 0; i < 10000; i++) {
+        mx_handle_t dup;
+        ASSERT_EQ(mx_handle_duplicate(event, MX_RIGHT_SAME_RIGHTS, &dup), NO_ERROR, "");
+        atomic_store(&lookup_handle, dup);
+        ASSERT_EQ(mx_handle_close(dup), NO_ERROR, "");
+    }
+
+    atomic_store(&lookup_done, true);
+    for (size_t i = 0; i < countof(threads); i++) {
+        int ret;
+        ASSERT_EQ(thrd_join(threads[i], &ret), thrd_success, "");
+        EXPECT_EQ(ret, 0, "lookup saw a bad handle");
+    }
+
+    EXPECT_EQ(mx_handle_close(event), NO_ERROR, "");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(handle_info_tests)
 RUN_TEST(handle_info_test)
 RUN_TEST(handle_related_koid_test)
 RUN_TEST(handle_rights_test)
+RUN_TEST(handle_lookup_race_test)
 END_TEST_CASE(handle_info_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -0,0 +1,78 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/port.h>
+#include <magenta/types.h>
+#include <unittest/unittest.h>
+
+extern mx_handle_t root_resource;
+
+// Claims an ISA interrupt line nothing else is using.
+static mx_handle_t create_interrupt(void) {
+    static const uint32_t kVectors[] = {7u, 5u, 6u, 9u, 10u, 11u};
+    for (size_t i = 0; i < countof(kVectors); i++) {
+        mx_handle_t h = mx_interrupt_create(root_resource, kVectors[i], MX_FLAG_REMAP_IRQ);
+        if (h > 0)
+            return h;
+    }
+    return MX_HANDLE_INVALID;
+}
+
+static bool interrupt_bind_test(void) {
+    BEGIN_TEST;
+
+    ASSERT_NEQ(root_resource, MX_HANDLE_INVALID, "no root resource handle");
+    mx_handle_t irq = create_interrupt();
+    ASSERT_NEQ(irq, MX_HANDLE_INVALID, "no free interrupt");
+
+    mx_handle_t port;
+    ASSERT_EQ(mx_port_create(MX_PORT_OPT_V2, &port), NO_ERROR, "");
+
+    EXPECT_EQ(mx_interrupt_bind(irq, port, 42u, 1u), ERR_INVALID_ARGS, "");
+    EXPECT_EQ(mx_interrupt_bind(port, port, 42u, 0u), ERR_WRONG_TYPE, "");
+    ASSERT_EQ(mx_interrupt_bind(irq, port, 42u, 0u), NO_ERROR, "");
+    EXPECT_EQ(mx_interrupt_bind(irq, port, 43u, 0u), ERR_ALREADY_BOUND, "");
+    EXPECT_EQ(mx_interrupt_wait(irq), ERR_BAD_STATE, "");
+
+    // Both land in the one packet.
+    mx_time_t before = mx_time_get(MX_CLOCK_MONOTONIC);
+    ASSERT_EQ(mx_interrupt_signal(irq), NO_ERROR, "");
+    ASSERT_EQ(mx_interrupt_signal(irq), NO_ERROR, "");
+
+    mx_port_packet_t packet;
+    ASSERT_EQ(mx_port_wait(port, MX_TIME_INFINITE, &packet, 0u), NO_ERROR, "");
+    EXPECT_EQ(packet.key, 42u, "");
+    EXPECT_EQ(packet.type, MX_PKT_TYPE_INTERRUPT, "");
+    EXPECT_EQ(packet.status, NO_ERROR, "");
+    EXPECT_GE(packet.interrupt.count, 2u, "");
+    EXPECT_GE(packet.interrupt.timestamp, before, "");
+    EXPECT_LE(packet.interrupt.timestamp, mx_time_get(MX_CLOCK_MONOTONIC), "");
+    EXPECT_EQ(mx_interrupt_complete(irq), NO_ERROR, "");
+
+    // The packet is reused once it has been dequeued.
+    ASSERT_EQ(mx_interrupt_signal(irq), NO_ERROR, "");
+    ASSERT_EQ(mx_port_wait(port, MX_TIME_INFINITE, &packet, 0u), NO_ERROR, "");
+    EXPECT_EQ(packet.type, MX_PKT_TYPE_INTERRUPT, "");
+    EXPECT_GE(packet.interrupt.count, 1u, "");
+    EXPECT_EQ(mx_interrupt_complete(irq), NO_ERROR, "");
+
+    // Closing the interrupt takes back a packet which is still queued.
+    ASSERT_EQ(mx_interrupt_signal(irq), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(irq), NO_ERROR, "");
+    EXPECT_EQ(mx_port_wait(port, 0u, &packet, 0u), ERR_TIMED_OUT, "");
+
+    EXPECT_EQ(mx_handle_close(port), NO_ERROR, "");
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(interrupt_tests)
+RUN_TEST(interrupt_bind_test)
+END_TEST_CASE(interrupt_tests)
+
+#ifndef BUILD_COMBINED_TESTS
+int main(int argc, char** argv) {
+    return unittest_run_all_tests(argc, argv) ? 0 : -1;
+}
+#endif
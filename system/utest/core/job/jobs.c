@@ -90,6 +90,102 @@ static bool policy_basic_test(void) {
     END_TEST;
 }
 
+static bool policy_cpu_test(void) {
+    BEGIN_TEST;
+
+    mx_handle_t job_parent = mx_job_default();
+    ASSERT_NEQ(job_parent, MX_HANDLE_INVALID, "");
+
+    mx_handle_t job_child;
+    ASSERT_EQ(mx_job_create(job_parent, 0u, &job_child), NO_ERROR, "");
+
+    // half a cpu, and a lower share of it
+    mx_policy_cpu_t policy = {
+        .weight = MX_CPU_WEIGHT_DEFAULT / 2,
+        .quota = MX_MSEC(50),
+        .period = MX_MSEC(100),
+    };
+    ASSERT_EQ(mx_job_set_policy(job_child, MX_JOB_POL_RELATIVE,
+        MX_JOB_POL_CPU, &policy, 1u), NO_ERROR, "");
+
+    // can be changed again, also once there are child jobs
+    mx_handle_t job_grandchild;
+    ASSERT_EQ(mx_job_create(job_child, 0u, &job_grandchild), NO_ERROR, "");
+    policy.quota = MX_MSEC(200);
+    ASSERT_EQ(mx_job_set_policy(job_child, MX_JOB_POL_RELATIVE,
+        MX_JOB_POL_CPU, &policy, 1u), NO_ERROR, "");
+
+    mx_policy_cpu_t bad = policy;
+    bad.weight = 0u;
+    EXPECT_EQ(mx_job_set_policy(job_child, MX_JOB_POL_RELATIVE,
+        MX_JOB_POL_CPU, &bad, 1u), ERR_INVALID_ARGS, "");
+    bad = policy;
+    bad.period = 0u;
+    EXPECT_EQ(mx_job_set_policy(job_child, MX_JOB_POL_RELATIVE,
+        MX_JOB_POL_CPU, &bad, 1u), ERR_INVALID_ARGS, "");
+    EXPECT_EQ(mx_job_set_policy(job_child, MX_JOB_POL_RELATIVE,
+        MX_JOB_POL_CPU, &policy, 2u), ERR_INVALID_ARGS, "");
+
+    // back to unlimited
+    policy.quota = 0u;
+    policy.period = 0u;
+    EXPECT_EQ(mx_job_set_policy(job_child, MX_JOB_POL_RELATIVE,
+        MX_JOB_POL_CPU, &policy, 1u), NO_ERROR, "");
+
+    ASSERT_EQ(mx_handle_close(job_grandchild), NO_ERROR, "");
+    ASSERT_EQ(mx_handle_close(job_child), NO_ERROR, "");
+    END_TEST;
+}
+
+static bool policy_memory_test(void) {
+    BEGIN_TEST;
+
+    mx_handle_t job_parent = mx_job_default();
+    ASSERT_NEQ(job_parent, MX_HANDLE_INVALID, "");
+
+    mx_handle_t job_child;
+    ASSERT_EQ(mx_job_create(job_parent, 0u, &job_child), NO_ERROR, "");
+    mx_handle_t job_grandchild;
+    ASSERT_EQ(mx_job_create(job_child, 0u, &job_grandchild), NO_ERROR, "");
+
+    mx_policy_memory_t policy = {
+        .soft_limit = 1024 * 1024,
+        .hard_limit = 4 * 1024 * 1024,
+    };
+    ASSERT_EQ(mx_job_set_policy(job_child, MX_JOB_POL_RELATIVE,
+        MX_JOB_POL_MEMORY, &policy, 1u), NO_ERROR, "");
+
+    mx_info_job_memory_t info;
+    ASSERT_EQ(mx_object_get_info(job_child, MX_INFO_JOB_MEMORY, &info, sizeof(info),
+                                 NULL, NULL), NO_ERROR, "");
+    EXPECT_EQ(info.committed_bytes, 0u, "");
+    EXPECT_EQ(info.soft_limit, policy.soft_limit, "");
+    EXPECT_EQ(info.hard_limit, policy.hard_limit, "");
+    EXPECT_EQ(info.failed_commits, 0u, "");
+
+    // nothing is committed, so neither limit is signaled
+    mx_signals_t pending;
+    EXPECT_EQ(mx_object_wait_one(job_child,
+        MX_JOB_MEMORY_OVER_SOFT_LIMIT | MX_JOB_MEMORY_HARD_LIMIT, 0u, &pending),
+        ERR_TIMED_OUT, "");
+
+    mx_policy_memory_t bad = { .soft_limit = 2 * policy.hard_limit, .hard_limit = policy.hard_limit };
+    EXPECT_EQ(mx_job_set_policy(job_child, MX_JOB_POL_RELATIVE,
+        MX_JOB_POL_MEMORY, &bad, 1u), ERR_INVALID_ARGS, "");
+    EXPECT_EQ(mx_job_set_policy(job_child, MX_JOB_POL_RELATIVE,
+        MX_JOB_POL_MEMORY, &policy, 2u), ERR_INVALID_ARGS, "");
+
+    // back to unlimited
+    policy.soft_limit = 0u;
+    policy.hard_limit = 0u;
+    EXPECT_EQ(mx_job_set_policy(job_child, MX_JOB_POL_RELATIVE,
+        MX_JOB_POL_MEMORY, &policy, 1u), NO_ERROR, "");
+
+    ASSERT_EQ(mx_handle_close(job_grandchild), NO_ERROR, "");
+    ASSERT_EQ(mx_handle_close(job_child), NO_ERROR, "");
+    END_TEST;
+}
+
 static bool kill_test(void) {
     BEGIN_TEST;
 
@@ -167,6 +263,8 @@ static bool info_task_stats_fails(void) {
 BEGIN_TEST_CASE(job_tests)
 RUN_TEST(basic_test)
 RUN_TEST(policy_basic_test)
+RUN_TEST(policy_cpu_test)
+RUN_TEST(policy_memory_test)
 RUN_TEST(create_test)
 RUN_TEST(kill_test)
 RUN_TEST(wait_test)
@@ -34,6 +34,105 @@ bool info_task_stats_smoke(void) {
     END_TEST;
 }
 
+// Tests that MX_INFO_THREAD_STATS counts this thread's time, and that a
+// process and a job report at least as much as the threads within them.
+bool info_thread_stats_smoke(void) {
+    BEGIN_TEST;
+    mx_info_thread_stats_t thread;
+    ASSERT_EQ(mx_object_get_info(mx_thread_self(), MX_INFO_THREAD_STATS,
+                                 &thread, sizeof(thread), NULL, NULL),
+              NO_ERROR, "");
+    ASSERT_GT(thread.runtime_ns, 0u, "");
+
+    mx_info_thread_stats_t process;
+    ASSERT_EQ(mx_object_get_info(mx_process_self(), MX_INFO_THREAD_STATS,
+                                 &process, sizeof(process), NULL, NULL),
+              NO_ERROR, "");
+    EXPECT_GE(process.runtime_ns, thread.runtime_ns, "");
+    EXPECT_GE(process.voluntary_switches, thread.voluntary_switches, "");
+    EXPECT_GE(process.page_faults, thread.page_faults, "");
+
+    mx_info_thread_stats_t job;
+    ASSERT_EQ(mx_object_get_info(mx_job_default(), MX_INFO_THREAD_STATS,
+                                 &job, sizeof(job), NULL, NULL),
+              NO_ERROR, "");
+    EXPECT_GE(job.runtime_ns, process.runtime_ns, "");
+    EXPECT_GE(job.page_faults, process.page_faults, "");
+    END_TEST;
+}
+
+bool info_thread_stats_wrong_type_fails(void) {
+    BEGIN_TEST;
+    mx_handle_t event;
+    ASSERT_EQ(mx_event_create(0, &event), NO_ERROR, "");
+    mx_info_thread_stats_t info;
+    EXPECT_EQ(mx_object_get_info(event, MX_INFO_THREAD_STATS,
+                                 &info, sizeof(info), NULL, NULL),
+              ERR_WRONG_TYPE, "");
+    mx_handle_close(event);
+    END_TEST;
+}
+
+// Tests that MX_INFO_JOB_TREE starts with the job itself and includes this
+// process, followed by this thread.
+bool info_job_tree_smoke(void) {
+    BEGIN_TEST;
+    mx_info_handle_basic_t job, proc, thread;
+    ASSERT_EQ(mx_object_get_info(mx_job_default(), MX_INFO_HANDLE_BASIC,
+                                 &job, sizeof(job), NULL, NULL),
+              NO_ERROR, "");
+    ASSERT_EQ(mx_object_get_info(mx_process_self(), MX_INFO_HANDLE_BASIC,
+                                 &proc, sizeof(proc), NULL, NULL),
+              NO_ERROR, "");
+    ASSERT_EQ(mx_object_get_info(mx_thread_self(), MX_INFO_HANDLE_BASIC,
+                                 &thread, sizeof(thread), NULL, NULL),
+              NO_ERROR, "");
+
+    size_t actual, avail;
+    ASSERT_EQ(mx_object_get_info(mx_job_default(), MX_INFO_JOB_TREE,
+                                 NULL, 0, &actual, &avail),
+              NO_ERROR, "");
+    EXPECT_EQ(actual, 0u, "");
+    ASSERT_GE(avail, 3u, "");
+
+    // Leave room for tasks created since the first call.
+    size_t max = avail + 16;
+    mx_info_task_record_t* records = malloc(max * sizeof(*records));
+    ASSERT_NONNULL(records, "");
+    ASSERT_EQ(mx_object_get_info(mx_job_default(), MX_INFO_JOB_TREE,
+                                 records, max * sizeof(*records), &actual, &avail),
+              NO_ERROR, "");
+    EXPECT_EQ(actual, avail, "");
+
+    EXPECT_EQ(records[0].koid, job.koid, "");
+    EXPECT_EQ(records[0].type, (uint32_t)MX_OBJ_TYPE_JOB, "");
+    EXPECT_EQ(records[0].depth, 0u, "");
+
+    size_t proc_index = actual;
+    bool found_thread = false;
+    for (size_t i = 0; i < actual; i++) {
+        if (records[i].koid == proc.koid) {
+            proc_index = i;
+            EXPECT_EQ(records[i].type, (uint32_t)MX_OBJ_TYPE_PROCESS, "");
+            EXPECT_TRUE(records[i].process.started, "");
+            EXPECT_GT(records[i].task.mem_committed_bytes, 0u, "");
+        } else if (records[i].koid == thread.koid) {
+            found_thread = true;
+            ASSERT_LT(proc_index, i, "thread should follow its process");
+            EXPECT_EQ(records[i].type, (uint32_t)MX_OBJ_TYPE_THREAD, "");
+            EXPECT_EQ(records[i].parent_koid, proc.koid, "");
+            EXPECT_EQ(records[i].depth, records[proc_index].depth + 1, "");
+            EXPECT_EQ(records[i].thread.state, MX_THREAD_STATE_RUNNING, "");
+            EXPECT_GT(records[i].sched.runtime_ns, 0u, "");
+        }
+    }
+    ASSERT_LT(proc_index, actual, "process not found");
+    EXPECT_TRUE(found_thread, "thread not found");
+    EXPECT_GE(records[0].sched.runtime_ns, records[proc_index].sched.runtime_ns, "");
+    free(records);
+    END_TEST;
+}
+
 // Structs to keep track of VMARs/mappings in the test child process.
 typedef struct test_mapping {
     uintptr_t base;
@@ -801,11 +900,114 @@ bool info_job_children_bad_avail_fails(void) {
     return jobch_helper_bad_avail_fails(MX_INFO_JOB_CHILDREN);
 }
 
+extern mx_handle_t root_resource;
+
+// Tests that MX_INFO_SYSCALL_LATENCY reports the syscalls we have made.
+bool info_syscall_latency_smoke(void) {
+    BEGIN_TEST;
+    ASSERT_NEQ(root_resource, MX_HANDLE_INVALID, "no root resource handle");
+
+    // make sure there is at least one call to look for
+    mx_info_task_stats_t stats;
+    ASSERT_EQ(mx_object_get_info(mx_process_self(), MX_INFO_TASK_STATS,
+                                 &stats, sizeof(stats), NULL, NULL),
+              NO_ERROR, "");
+
+    size_t avail = 0;
+    ASSERT_EQ(mx_object_get_info(root_resource, MX_INFO_SYSCALL_LATENCY,
+                                 NULL, 0, NULL, &avail),
+              NO_ERROR, "");
+    ASSERT_GT(avail, 0u, "");
+
+    mx_info_syscall_latency_t* info = calloc(avail, sizeof(*info));
+    ASSERT_NONNULL(info, "");
+    size_t actual = 0;
+    ASSERT_EQ(mx_object_get_info(root_resource, MX_INFO_SYSCALL_LATENCY,
+                                 info, avail * sizeof(*info), &actual, NULL),
+              NO_ERROR, "");
+    ASSERT_GT(actual, 0u, "");
+    ASSERT_LE(actual, avail, "");
+
+    for (size_t i = 0; i < actual; i++) {
+        uint64_t sum = 0;
+        for (size_t b = 0; b < MX_INFO_SYSCALL_LATENCY_BUCKETS; b++)
+            sum += info[i].buckets[b];
+        EXPECT_EQ(sum, info[i].count, "buckets don't add up to the count");
+        EXPECT_GT(info[i].count, 0u, "");
+        if (i > 0)
+            EXPECT_GT(info[i].syscall_num, info[i - 1].syscall_num, "out of order");
+    }
+    free(info);
+    END_TEST;
+}
+
+bool info_syscall_latency_non_resource_fails(void) {
+    BEGIN_TEST;
+    size_t avail = 0;
+    EXPECT_EQ(mx_object_get_info(mx_process_self(), MX_INFO_SYSCALL_LATENCY,
+                                 NULL, 0, NULL, &avail),
+              ERR_WRONG_TYPE, "");
+    END_TEST;
+}
+
+// Tests that MX_INFO_KMEM_STATS reports a breakdown that fits in memory.
+bool info_kmem_stats_smoke(void) {
+    BEGIN_TEST;
+    ASSERT_NEQ(root_resource, MX_HANDLE_INVALID, "no root resource handle");
+
+    // a committed page of our own for the vmo count to include
+    mx_handle_t vmo;
+    ASSERT_EQ(mx_vmo_create(PAGE_SIZE, 0, &vmo), NO_ERROR, "");
+    uint8_t byte = 1;
+    size_t written;
+    ASSERT_EQ(mx_vmo_write(vmo, &byte, 0, 1, &written), NO_ERROR, "");
+
+    mx_info_kmem_stats_t stats;
+    size_t actual = 0;
+    size_t avail = 0;
+    ASSERT_EQ(mx_object_get_info(root_resource, MX_INFO_KMEM_STATS,
+                                 &stats, sizeof(stats), &actual, &avail),
+              NO_ERROR, "");
+    EXPECT_EQ(actual, 1u, "");
+    EXPECT_EQ(avail, 1u, "");
+
+    EXPECT_GT(stats.total_bytes, 0u, "");
+    EXPECT_GE(stats.vmo_bytes, (uint64_t)PAGE_SIZE, "");
+    EXPECT_GT(stats.heap_bytes, 0u, "");
+    EXPECT_LE(stats.heap_used_bytes, stats.heap_bytes, "");
+    EXPECT_GT(stats.handle_count, 0u, "");
+    uint64_t sum = stats.free_bytes + stats.wired_bytes + stats.heap_bytes +
+                   stats.mmu_bytes + stats.vmo_bytes + stats.other_bytes;
+    EXPECT_LE(sum, stats.total_bytes, "categories add up to more than there is");
+
+    EXPECT_EQ(mx_object_get_info(root_resource, MX_INFO_KMEM_STATS,
+                                 &stats, sizeof(stats) - 1, NULL, NULL),
+              ERR_BUFFER_TOO_SMALL, "");
+    mx_handle_close(vmo);
+    END_TEST;
+}
+
+bool info_kmem_stats_non_resource_fails(void) {
+    BEGIN_TEST;
+    mx_info_kmem_stats_t stats;
+    EXPECT_EQ(mx_object_get_info(mx_process_self(), MX_INFO_KMEM_STATS,
+                                 &stats, sizeof(stats), NULL, NULL),
+              ERR_WRONG_TYPE, "");
+    END_TEST;
+}
+
 // TODO(dbort): A lot of these tests would be good to run on any
 // MX_INFO_* arg.
 
 BEGIN_TEST_CASE(object_info_tests)
 RUN_TEST(info_task_stats_smoke);
+RUN_TEST(info_thread_stats_smoke);
+RUN_TEST(info_thread_stats_wrong_type_fails);
+RUN_TEST(info_job_tree_smoke);
+RUN_TEST(info_syscall_latency_smoke);
+RUN_TEST(info_syscall_latency_non_resource_fails);
+RUN_TEST(info_kmem_stats_smoke);
+RUN_TEST(info_kmem_stats_non_resource_fails);
 RUN_TEST(info_process_maps_smoke);
 RUN_TEST(info_process_maps_self_fails);
 RUN_TEST(info_process_maps_invalid_handle_fails);
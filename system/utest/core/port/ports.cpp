@@ -412,6 +412,37 @@ static bool cancel_event_key_repeat() {
     return cancel_event(MX_WAIT_ASYNC_REPEATING);
 }
 
+static bool cancel_discards_queued_packet() {
+    BEGIN_TEST;
+
+    mx_handle_t port;
+    mx_handle_t ev;
+    EXPECT_EQ(mx_port_create(MX_PORT_OPT_V2, &port), NO_ERROR, "");
+    EXPECT_EQ(mx_event_create(0u, &ev), NO_ERROR, "");
+
+    EXPECT_EQ(mx_object_wait_async(
+        ev, port, 5u, MX_EVENT_SIGNALED | MX_USER_SIGNAL_0, MX_WAIT_ASYNC_REPEATING), NO_ERROR, "");
+
+    // Both signals land in the one queued packet.
+    EXPECT_EQ(mx_object_signal(ev, 0u, MX_EVENT_SIGNALED), NO_ERROR, "");
+    EXPECT_EQ(mx_object_signal(ev, 0u, MX_USER_SIGNAL_0), NO_ERROR, "");
+
+    mx_port_packet_t out = {};
+    EXPECT_EQ(mx_port_wait(port, 0ull, &out, 0u), NO_ERROR, "");
+    EXPECT_EQ(out.key, 5u, "");
+    EXPECT_EQ(out.signal.observed, MX_EVENT_SIGNALED | MX_USER_SIGNAL_0, "");
+    EXPECT_EQ(mx_port_wait(port, 0ull, &out, 0u), ERR_TIMED_OUT, "");
+
+    // A packet queued before the cancel is not delivered.
+    EXPECT_EQ(mx_object_signal(ev, MX_USER_SIGNAL_0, 0u), NO_ERROR, "");
+    EXPECT_EQ(mx_port_cancel(port, ev, 5u), NO_ERROR, "");
+    EXPECT_EQ(mx_port_wait(port, 0ull, &out, 0u), ERR_TIMED_OUT, "");
+
+    EXPECT_EQ(mx_handle_close(port), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(ev), NO_ERROR, "");
+    END_TEST;
+}
+
 struct test_context {
     mx_handle_t port;
     uint32_t count;
@@ -475,9 +506,118 @@ static bool threads_event_repeat() {
     return threads_event(MX_WAIT_ASYNC_REPEATING);
 }
 
+static bool wait_many_test(void) {
+    BEGIN_TEST;
+    mx_status_t status;
+
+    mx_handle_t port;
+    status = mx_port_create(MX_PORT_OPT_V2, &port);
+    EXPECT_EQ(status, NO_ERROR, "could not create port v2");
+
+    mx_port_packet_t out[MX_PORT_MAX_BATCH] = {};
+    uint32_t actual = 0u;
+    status = mx_port_wait_many(port, mx_deadline_after(MX_USEC(1)), out, 4u, &actual);
+    EXPECT_EQ(status, ERR_TIMED_OUT, "");
+
+    // More than one internal chunk, and more than fits in one call.
+    const uint32_t kPackets = 40u;
+    for (uint32_t i = 0; i < kPackets; ++i) {
+        mx_port_packet_t in = {};
+        in.key = i;
+        in.type = MX_PKT_TYPE_USER;
+        status = mx_port_queue(port, &in, 0u);
+        EXPECT_EQ(status, NO_ERROR, "");
+    }
+
+    status = mx_port_wait_many(port, 0ull, out, 32u, &actual);
+    EXPECT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(actual, 32u, "");
+
+    uint32_t next = 0u;
+    for (uint32_t i = 0; i < actual; ++i, ++next)
+        EXPECT_EQ(out[i].key, next, "packets out of order");
+
+    // Only what is queued is returned, without waiting for the rest.
+    status = mx_port_wait_many(port, MX_TIME_INFINITE, out, MX_PORT_MAX_BATCH, &actual);
+    EXPECT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(actual, kPackets - 32u, "");
+    for (uint32_t i = 0; i < actual; ++i, ++next)
+        EXPECT_EQ(out[i].key, next, "packets out of order");
+
+    status = mx_port_wait_many(port, 0ull, out, MX_PORT_MAX_BATCH + 1, &actual);
+    EXPECT_EQ(status, ERR_INVALID_ARGS, "");
+    status = mx_port_wait_many(port, 0ull, out, 0u, &actual);
+    EXPECT_EQ(status, ERR_INVALID_ARGS, "");
+
+    status = mx_handle_close(port);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    END_TEST;
+}
+
+static bool percpu_test(void) {
+    BEGIN_TEST;
+
+    mx_handle_t port;
+    EXPECT_EQ(mx_port_create(MX_PORT_OPT_PERCPU, &port), ERR_INVALID_ARGS,
+              "per cpu queues require port v2");
+    EXPECT_EQ(mx_port_create(MX_PORT_OPT_V2 | MX_PORT_OPT_PERCPU, &port), NO_ERROR, "");
+
+    // Packets are only FIFO per cpu but none may be lost or duplicated.
+    const uint32_t kPackets = 48u;
+    bool seen[kPackets] = {};
+    for (uint32_t i = 0; i < kPackets; ++i) {
+        mx_port_packet_t in = {};
+        in.key = i;
+        in.type = MX_PKT_TYPE_USER;
+        EXPECT_EQ(mx_port_queue(port, &in, 0u), NO_ERROR, "");
+    }
+
+    mx_port_packet_t out[MX_PORT_MAX_BATCH] = {};
+    uint32_t received = 0u;
+    while (received < kPackets) {
+        uint32_t actual = 0u;
+        ASSERT_EQ(mx_port_wait_many(port, 0ull, out, 16u, &actual), NO_ERROR, "");
+        for (uint32_t i = 0; i < actual; ++i) {
+            ASSERT_LT(out[i].key, kPackets, "");
+            EXPECT_FALSE(seen[out[i].key], "packet dequeued twice");
+            seen[out[i].key] = true;
+        }
+        received += actual;
+    }
+    uint32_t actual = 0u;
+    EXPECT_EQ(mx_port_wait_many(port, 0ull, out, 16u, &actual), ERR_TIMED_OUT, "");
+
+    // Each packet wakes exactly one of several blocked readers.
+    thrd_t threads[4];
+    test_context ctx[4];
+    for (size_t ix = 0; ix != countof(threads); ++ix) {
+        ctx[ix] = { port, 3u };
+        EXPECT_EQ(thrd_create(&threads[ix], port_reader_thread, &ctx[ix]),
+                  thrd_success, "");
+    }
+    for (uint32_t i = 0; i < countof(threads) * 3u; ++i) {
+        mx_port_packet_t in = {};
+        in.key = i;
+        in.type = MX_PKT_TYPE_USER;
+        EXPECT_EQ(mx_port_queue(port, &in, 0u), NO_ERROR, "");
+    }
+    for (size_t ix = 0; ix != countof(threads); ++ix) {
+        int res;
+        EXPECT_EQ(thrd_join(threads[ix], &res), thrd_success, "");
+        EXPECT_EQ(res, 0, "");
+    }
+    EXPECT_EQ(mx_port_wait(port, 0ull, &out[0], 0u), ERR_TIMED_OUT, "");
+
+    EXPECT_EQ(mx_handle_close(port), NO_ERROR, "");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(port_tests)
 RUN_TEST(basic_test)
 RUN_TEST(queue_and_close_test)
+RUN_TEST(wait_many_test)
 RUN_TEST(async_wait_channel_test)
 RUN_TEST(async_wait_event_test_single)
 RUN_TEST(async_wait_event_test_repeat)
@@ -491,8 +631,10 @@ RUN_TEST(channel_pre_writes_once)
 RUN_TEST(channel_pre_writes_repeat)
 RUN_TEST(cancel_event_key_once)
 RUN_TEST(cancel_event_key_repeat)
+RUN_TEST(cancel_discards_queued_packet)
 RUN_TEST(threads_event_once)
 RUN_TEST(threads_event_repeat)
+RUN_TEST(percpu_test)
 END_TEST_CASE(port_tests)
 
 #ifndef BUILD_COMBINED_TESTS
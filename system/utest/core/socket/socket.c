@@ -3,11 +3,13 @@
 // found in the LICENSE file.
 
 #include <assert.h>
+#include <magenta/process.h>
 #include <magenta/syscalls.h>
 #include <unittest/unittest.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 static mx_signals_t get_satisfied_signals(mx_handle_t handle) {
@@ -328,6 +330,127 @@ static bool socket_short_write(void) {
     END_TEST;
 }
 
+static bool socket_shared_ring(void) {
+    BEGIN_TEST;
+
+    mx_status_t status;
+    mx_handle_t h0, h1, rx, tx;
+
+    status = mx_socket_create(0, &h0, &h1);
+    ASSERT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(mx_socket_get_rings(h0, &rx, &tx), ERR_NOT_SUPPORTED, "");
+    EXPECT_EQ(mx_socket_ring_update(h0), ERR_NOT_SUPPORTED, "");
+    mx_handle_close(h0);
+    mx_handle_close(h1);
+
+    status = mx_socket_create(MX_SOCKET_SHARED_RING, &h0, &h1);
+    ASSERT_EQ(status, NO_ERROR, "");
+    status = mx_socket_get_rings(h0, &rx, &tx);
+    ASSERT_EQ(status, NO_ERROR, "");
+
+    uint64_t vmo_size;
+    ASSERT_EQ(mx_vmo_get_size(tx, &vmo_size), NO_ERROR, "");
+    uintptr_t tx_addr, rx_addr;
+    const uint32_t flags = MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE;
+    ASSERT_EQ(mx_vmar_map(mx_vmar_root_self(), 0, tx, 0, vmo_size, flags, &tx_addr),
+              NO_ERROR, "");
+    ASSERT_EQ(mx_vmar_map(mx_vmar_root_self(), 0, rx, 0, vmo_size, flags, &rx_addr),
+              NO_ERROR, "");
+    mx_socket_ring_t* tx_ring = (mx_socket_ring_t*)tx_addr;
+    mx_socket_ring_t* rx_ring = (mx_socket_ring_t*)rx_addr;
+    char* tx_data = (char*)tx_addr + MX_SOCKET_RING_DATA_OFFSET;
+    char* rx_data = (char*)rx_addr + MX_SOCKET_RING_DATA_OFFSET;
+    EXPECT_EQ(tx_ring->size + MX_SOCKET_RING_DATA_OFFSET, vmo_size, "");
+
+    // Produce into the ring directly; the peer only becomes readable once the
+    // kernel is told about it.
+    memcpy(tx_data, "hello", 5);
+    __atomic_store_n(&tx_ring->head, 5u, __ATOMIC_RELEASE);
+    EXPECT_EQ(get_satisfied_signals(h1), MX_SOCKET_WRITABLE, "");
+    status = mx_socket_ring_update(h0);
+    ASSERT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(get_satisfied_signals(h1), MX_SOCKET_READABLE | MX_SOCKET_WRITABLE, "");
+
+    // The other end can still use the syscalls.
+    char buf[8] = {};
+    size_t count;
+    status = mx_socket_read(h1, 0u, buf, sizeof(buf), &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(count, 5u, "");
+    EXPECT_EQ(memcmp(buf, "hello", 5), 0, "");
+    EXPECT_EQ(__atomic_load_n(&tx_ring->tail, __ATOMIC_ACQUIRE), 5u, "");
+    EXPECT_EQ(get_satisfied_signals(h1), MX_SOCKET_WRITABLE, "");
+
+    status = mx_socket_write(h1, 0u, "world", 5u, &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(__atomic_load_n(&rx_ring->head, __ATOMIC_ACQUIRE), 5u, "");
+    EXPECT_EQ(memcmp(rx_data, "world", 5), 0, "");
+    EXPECT_EQ(get_satisfied_signals(h0), MX_SOCKET_READABLE | MX_SOCKET_WRITABLE, "");
+
+    // Consume directly.
+    __atomic_store_n(&rx_ring->tail, 5u, __ATOMIC_RELEASE);
+    status = mx_socket_ring_update(h0);
+    ASSERT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(get_satisfied_signals(h0), MX_SOCKET_WRITABLE, "");
+
+    mx_vmar_unmap(mx_vmar_root_self(), tx_addr, vmo_size);
+    mx_vmar_unmap(mx_vmar_root_self(), rx_addr, vmo_size);
+    mx_handle_close(rx);
+    mx_handle_close(tx);
+    mx_handle_close(h0);
+    mx_handle_close(h1);
+
+    END_TEST;
+}
+
+static bool socket_writev(void) {
+    BEGIN_TEST;
+
+    mx_status_t status;
+    mx_handle_t h0, h1;
+    status = mx_socket_create(0, &h0, &h1);
+    ASSERT_EQ(status, NO_ERROR, "");
+
+    mx_iovec_t vec[3] = {
+        { "head", 4u },
+        { NULL, 0u },
+        { "tail", 4u },
+    };
+    size_t count;
+    status = mx_socket_writev(h0, 0u, vec, 3, &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(count, 8u, "");
+
+    char buf[16] = {};
+    status = mx_socket_read(h1, 0u, buf, sizeof(buf), &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(count, 8u, "");
+    EXPECT_EQ(memcmp(buf, "headtail", 8), 0, "");
+
+    // A full socket stops the write part way.
+    const size_t big_size = 256 * 1024;
+    char* big = malloc(big_size);
+    ASSERT_NONNULL(big, "");
+    mx_iovec_t big_vec[2] = {
+        { big, big_size - 16 },
+        { big, 32 },
+    };
+    status = mx_socket_writev(h0, 0u, big_vec, 2, &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+    EXPECT_GT(count, big_size - 16, "");
+    EXPECT_LT(count, big_size + 16, "");
+    free(big);
+
+    mx_iovec_t too_many[MX_IOVEC_MAX + 1];
+    memset(too_many, 0, sizeof(too_many));
+    EXPECT_EQ(mx_socket_writev(h0, 0u, too_many, MX_IOVEC_MAX + 1, NULL), ERR_OUT_OF_RANGE, "");
+
+    mx_handle_close(h0);
+    mx_handle_close(h1);
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(socket_tests)
 RUN_TEST(socket_basic)
 RUN_TEST(socket_signals)
@@ -335,6 +458,8 @@ RUN_TEST(socket_half_close)
 RUN_TEST(socket_bytes_outstanding)
 RUN_TEST(socket_bytes_outstanding_half_close)
 RUN_TEST(socket_short_write)
+RUN_TEST(socket_shared_ring)
+RUN_TEST(socket_writev)
 END_TEST_CASE(socket_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -0,0 +1,96 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <sync/semaphore.h>
+
+#include <magenta/syscalls.h>
+#include <unittest/unittest.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
+#include <threads.h>
+
+#define NUM_THREADS 8
+#define ITERATIONS 1000
+
+static semaphore_t items = SEMAPHORE_INIT(0);
+static atomic_int consumed;
+
+static int semaphore_thread_consume(void* arg) {
+    for (int iteration = 0; iteration < ITERATIONS; iteration++) {
+        mx_status_t status = semaphore_wait(&items, MX_TIME_INFINITE);
+        ASSERT_EQ(status, NO_ERROR, "semaphore wait failed!");
+        atomic_fetch_add(&consumed, 1);
+    }
+    return 0;
+}
+
+static bool test_initializer(void) {
+    BEGIN_TEST;
+    // Let's not accidentally break .bss'd semaphores
+    static semaphore_t static_semaphore;
+    semaphore_t semaphore = SEMAPHORE_INIT(0);
+    int status = memcmp(&static_semaphore, &semaphore, sizeof(semaphore_t));
+    EXPECT_EQ(status, 0, "semaphore's initializer is not all zeroes");
+    END_TEST;
+}
+
+static bool test_try_wait(void) {
+    BEGIN_TEST;
+    semaphore_t semaphore = SEMAPHORE_INIT(2);
+    EXPECT_EQ(semaphore_try_wait(&semaphore), NO_ERROR, "");
+    EXPECT_EQ(semaphore_try_wait(&semaphore), NO_ERROR, "");
+    EXPECT_EQ(semaphore_try_wait(&semaphore), ERR_SHOULD_WAIT, "");
+    semaphore_post(&semaphore);
+    EXPECT_EQ(semaphore_wait(&semaphore, 0u), NO_ERROR, "");
+    EXPECT_EQ(semaphore_wait(&semaphore, 0u), ERR_TIMED_OUT, "");
+    END_TEST;
+}
+
+static bool test_producer_consumer(void) {
+    BEGIN_TEST;
+    thrd_t consumers[NUM_THREADS];
+    atomic_store(&consumed, 0);
+    for (int idx = 0; idx < NUM_THREADS; idx++)
+        thrd_create_with_name(consumers + idx, semaphore_thread_consume, NULL, "consumer");
+
+    // Every post is taken exactly once, whether or not its taker blocked.
+    for (int idx = 0; idx < NUM_THREADS * ITERATIONS; idx++) {
+        semaphore_post(&items);
+        if (idx % 64 == 0)
+            mx_nanosleep(mx_deadline_after(MX_USEC(10)));
+    }
+
+    for (int idx = 0; idx < NUM_THREADS; idx++)
+        thrd_join(consumers[idx], NULL);
+    EXPECT_EQ(atomic_load(&consumed), NUM_THREADS * ITERATIONS, "");
+    EXPECT_EQ(semaphore_try_wait(&items), ERR_SHOULD_WAIT, "posts left over");
+    END_TEST;
+}
+
+static bool test_timeout(void) {
+    BEGIN_TEST;
+    mx_time_t timeout = 0u;
+    semaphore_t semaphore = SEMAPHORE_INIT(0);
+    for (int iteration = 0; iteration < 100; iteration++) {
+        timeout += 2000u;
+        mx_status_t status = semaphore_wait(&semaphore, timeout);
+        ASSERT_EQ(status, ERR_TIMED_OUT, "wait returned spuriously!");
+    }
+    EXPECT_EQ(atomic_load(&semaphore.waiters), 0, "timed out waiters still counted");
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(semaphore_tests)
+RUN_TEST(test_initializer)
+RUN_TEST(test_try_wait)
+RUN_TEST(test_producer_consumer)
+RUN_TEST(test_timeout)
+END_TEST_CASE(semaphore_tests)
+
+#ifndef BUILD_COMBINED_TESTS
+int main(int argc, char** argv) {
+    return unittest_run_all_tests(argc, argv) ? 0 : -1;
+}
+#endif
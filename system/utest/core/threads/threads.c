@@ -11,6 +11,7 @@
 #include <magenta/syscalls/exception.h>
 #include <magenta/syscalls/object.h>
 #include <magenta/syscalls/port.h>
+#include <magenta/syscalls/profile.h>
 
 #include <unittest/unittest.h>
 #include <runtime/thread.h>
@@ -520,6 +521,50 @@ static bool test_suspend_stops_thread(void) {
     END_TEST;
 }
 
+static bool test_set_deadline_profile(void) {
+    BEGIN_TEST;
+
+    mxr_thread_t thread;
+    ASSERT_TRUE(start_thread(test_sleep_thread_fn, (void*)mx_deadline_after(MX_MSEC(100)),
+                             &thread), "");
+    mx_handle_t thread_h = mxr_thread_get_handle(&thread);
+
+    // Capacity larger than the deadline can never be met.
+    mx_profile_t profile = {
+        .type = MX_PROFILE_TYPE_DEADLINE,
+        .deadline = { .capacity = MX_MSEC(2), .deadline = MX_MSEC(1), .period = MX_MSEC(10) },
+    };
+    EXPECT_EQ(mx_object_set_profile(thread_h, &profile, 0), ERR_INVALID_ARGS, "");
+
+    // Periods past a second are rejected rather than overflowing the
+    // bandwidth computation.
+    profile.deadline.capacity = MX_SEC(10);
+    profile.deadline.deadline = MX_SEC(10);
+    profile.deadline.period = MX_SEC(10);
+    EXPECT_EQ(mx_object_set_profile(thread_h, &profile, 0), ERR_INVALID_ARGS, "");
+    profile.deadline.capacity = UINT64_MAX;
+    profile.deadline.deadline = UINT64_MAX;
+    profile.deadline.period = UINT64_MAX;
+    EXPECT_EQ(mx_object_set_profile(thread_h, &profile, 0), ERR_INVALID_ARGS, "");
+
+    profile.deadline.capacity = MX_USEC(100);
+    profile.deadline.deadline = MX_MSEC(1);
+    profile.deadline.period = MX_MSEC(10);
+    EXPECT_EQ(mx_object_set_profile(thread_h, &profile, 1u), ERR_INVALID_ARGS, "");
+    EXPECT_EQ(mx_object_set_profile(thread_h, &profile, 0), NO_ERROR, "");
+
+    profile.type = MX_PROFILE_TYPE_PRIORITY;
+    EXPECT_EQ(mx_object_set_profile(thread_h, &profile, 0), NO_ERROR, "");
+
+    profile.type = 100u;
+    EXPECT_EQ(mx_object_set_profile(thread_h, &profile, 0), ERR_INVALID_ARGS, "");
+
+    ASSERT_EQ(mx_object_wait_one(thread_h, MX_THREAD_SIGNALED, MX_TIME_INFINITE, NULL),
+              NO_ERROR, "");
+    ASSERT_EQ(mx_handle_close(thread_h), NO_ERROR, "");
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(threads_tests)
 RUN_TEST(test_basics)
 RUN_TEST(test_long_name_succeeds)
@@ -535,6 +580,7 @@ RUN_TEST(test_suspend_sleeping)
 RUN_TEST(test_suspend_channel_call)
 RUN_TEST(test_suspend_port_call)
 RUN_TEST(test_suspend_stops_thread)
+RUN_TEST(test_set_deadline_profile)
 END_TEST_CASE(threads_tests)
 
 #ifndef BUILD_COMBINED_TESTS
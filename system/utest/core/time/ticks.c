@@ -25,8 +25,29 @@ static bool elapsed_time_using_ticks(void) {
     END_TEST;
 }
 
+// The coarse monotonic clock trails the precise one by at most a few
+// update periods and keeps moving.
+static bool coarse_monotonic_time(void) {
+    BEGIN_TEST;
+
+    mx_time_t coarse = mx_time_get_coarse(MX_CLOCK_MONOTONIC);
+    mx_time_t precise = mx_time_get(MX_CLOCK_MONOTONIC);
+    ASSERT_GT(coarse, 0u, "Coarse clock not running");
+    ASSERT_LE(coarse, precise, "Coarse clock ahead of the precise one");
+    EXPECT_LT(precise - coarse, MX_SEC(1), "Coarse clock too far behind");
+
+    ASSERT_EQ(mx_nanosleep(mx_deadline_after(MX_MSEC(50))), NO_ERROR, "");
+    mx_time_t later = mx_time_get_coarse(MX_CLOCK_MONOTONIC);
+    EXPECT_GT(later, coarse, "Coarse clock did not advance");
+
+    EXPECT_NE(mx_time_get_coarse(MX_CLOCK_UTC), 0u, "UTC not passed through");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(ticks_tests)
 RUN_TEST(elapsed_time_using_ticks)
+RUN_TEST(coarse_monotonic_time)
 END_TEST_CASE(ticks_tests)
 
 #ifndef BUILD_COMBINED_TESTS
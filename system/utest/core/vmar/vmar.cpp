@@ -6,6 +6,7 @@
 #include <errno.h>
 #include <limits.h>
 #include <stdalign.h>
+#include <threads.h>
 #include <unistd.h>
 
 #include <magenta/process.h>
@@ -329,6 +330,82 @@ bool allocate_unsatisfiable_test() {
     END_TEST;
 }
 
+// Fill a region a page at a time, punch holes in it and fill them again,
+// checking that every allocation lands in a free page
+bool allocate_fill_test() {
+    BEGIN_TEST;
+
+    mx_handle_t process;
+    mx_handle_t vmar;
+    mx_handle_t region;
+    uintptr_t region_addr;
+
+    ASSERT_EQ(mx_process_create(mx_job_default(), kProcessName, sizeof(kProcessName) - 1,
+                                0, &process, &vmar), NO_ERROR, "");
+
+    const size_t page_count = 64;
+    ASSERT_EQ(mx_vmar_allocate(vmar, 0, page_count * PAGE_SIZE,
+                               MX_VM_FLAG_CAN_MAP_READ | MX_VM_FLAG_CAN_MAP_WRITE,
+                               &region, &region_addr),
+              NO_ERROR, "");
+
+    mx_handle_t pages[page_count];
+    uint64_t used = 0;
+    auto allocate_page = [&]() -> bool {
+        BEGIN_HELPER;
+        mx_handle_t child;
+        uintptr_t child_addr;
+        ASSERT_EQ(mx_vmar_allocate(region, 0, PAGE_SIZE,
+                                   MX_VM_FLAG_CAN_MAP_READ | MX_VM_FLAG_CAN_MAP_WRITE,
+                                   &child, &child_addr),
+                  NO_ERROR, "");
+        ASSERT_GE(child_addr, region_addr, "");
+        const size_t index = (child_addr - region_addr) / PAGE_SIZE;
+        ASSERT_LT(index, page_count, "");
+        ASSERT_EQ(used & (1ull << index), 0u, "page handed out twice");
+        used |= 1ull << index;
+        pages[index] = child;
+        END_HELPER;
+    };
+
+    for (size_t i = 0; i < page_count; ++i) {
+        ASSERT_TRUE(allocate_page(), "");
+    }
+    EXPECT_EQ(used, UINT64_MAX, "");
+
+    mx_handle_t child;
+    uintptr_t child_addr;
+    EXPECT_EQ(mx_vmar_allocate(region, 0, PAGE_SIZE,
+                               MX_VM_FLAG_CAN_MAP_READ | MX_VM_FLAG_CAN_MAP_WRITE,
+                               &child, &child_addr),
+              ERR_NO_MEMORY, "");
+
+    // Free every other page.  Nothing larger than a page fits anymore.
+    for (size_t i = 0; i < page_count; i += 2) {
+        EXPECT_EQ(mx_vmar_destroy(pages[i]), NO_ERROR, "");
+        EXPECT_EQ(mx_handle_close(pages[i]), NO_ERROR, "");
+        used &= ~(1ull << i);
+    }
+    EXPECT_EQ(mx_vmar_allocate(region, 0, PAGE_SIZE * 2,
+                               MX_VM_FLAG_CAN_MAP_READ | MX_VM_FLAG_CAN_MAP_WRITE,
+                               &child, &child_addr),
+              ERR_NO_MEMORY, "");
+
+    for (size_t i = 0; i < page_count / 2; ++i) {
+        ASSERT_TRUE(allocate_page(), "");
+    }
+    EXPECT_EQ(used, UINT64_MAX, "");
+
+    for (size_t i = 0; i < page_count; ++i) {
+        EXPECT_EQ(mx_handle_close(pages[i]), NO_ERROR, "");
+    }
+    EXPECT_EQ(mx_handle_close(region), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(vmar), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(process), NO_ERROR, "");
+
+    END_TEST;
+}
+
 // Validate that when we destroy a VMAR, all operations on it
 // and its children fail.
 bool destroyed_vmar_test() {
@@ -1099,6 +1176,65 @@ bool unmap_split_test() {
     END_TEST;
 }
 
+// Verify that unmapping the head of a mapping leaves the tree consistent
+// when another mapping immediately follows it
+bool unmap_head_with_neighbor_test() {
+    BEGIN_TEST;
+
+    mx_handle_t process;
+    mx_handle_t vmar;
+    mx_handle_t vmo;
+    uintptr_t mapping_addr[3];
+
+    ASSERT_EQ(mx_process_create(mx_job_default(), kProcessName, sizeof(kProcessName) - 1,
+                                0, &process, &vmar), NO_ERROR, "");
+
+    const size_t mapping_size = 4 * PAGE_SIZE;
+    ASSERT_EQ(mx_vmo_create(mapping_size, 0, &vmo), NO_ERROR, "");
+
+    // Three back to back mappings, so the one we shrink has neighbors on
+    // both sides in the region's tree
+    for (size_t i = 0; i < 3; ++i) {
+        ASSERT_EQ(mx_vmar_map(vmar, i * mapping_size, vmo, 0, mapping_size,
+                              MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE | MX_VM_FLAG_SPECIFIC,
+                              &mapping_addr[i]),
+                  NO_ERROR, "");
+    }
+    EXPECT_EQ(mapping_addr[0] + mapping_size, mapping_addr[1], "");
+    EXPECT_EQ(mapping_addr[1] + mapping_size, mapping_addr[2], "");
+
+    // Unmap the front of the middle one, then the front of the last one
+    EXPECT_EQ(mx_vmar_unmap(vmar, mapping_addr[1], 3 * PAGE_SIZE), NO_ERROR, "");
+    EXPECT_TRUE(check_pages_mapped(process, mapping_addr[0], 0b1111'1000'1111, 12), "");
+    EXPECT_EQ(mx_vmar_unmap(vmar, mapping_addr[2], PAGE_SIZE), NO_ERROR, "");
+    EXPECT_TRUE(check_pages_mapped(process, mapping_addr[0], 0b1110'1000'1111, 12), "");
+
+    // The holes left behind are exactly the unmapped pages
+    uintptr_t addr;
+    EXPECT_EQ(mx_vmar_map(vmar, mapping_addr[1] - mapping_addr[0], vmo, 0, 4 * PAGE_SIZE,
+                          MX_VM_FLAG_PERM_READ | MX_VM_FLAG_SPECIFIC, &addr),
+              ERR_NO_MEMORY, "");
+    EXPECT_EQ(mx_vmar_map(vmar, mapping_addr[1] - mapping_addr[0], vmo, 0, 3 * PAGE_SIZE,
+                          MX_VM_FLAG_PERM_READ | MX_VM_FLAG_SPECIFIC, &addr),
+              NO_ERROR, "");
+    EXPECT_EQ(mx_vmar_map(vmar, mapping_addr[2] - mapping_addr[0], vmo, 0, PAGE_SIZE,
+                          MX_VM_FLAG_PERM_READ | MX_VM_FLAG_SPECIFIC, &addr),
+              NO_ERROR, "");
+    EXPECT_TRUE(check_pages_mapped(process, mapping_addr[0], 0b1111'1111'1111, 12), "");
+
+    // Allocations still find space elsewhere in the region
+    EXPECT_EQ(mx_vmar_map(vmar, 0, vmo, 0, mapping_size, MX_VM_FLAG_PERM_READ, &addr),
+              NO_ERROR, "");
+    EXPECT_TRUE(addr >= mapping_addr[2] + mapping_size ||
+                addr + mapping_size <= mapping_addr[0], "");
+
+    EXPECT_EQ(mx_handle_close(vmar), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(vmo), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(process), NO_ERROR, "");
+
+    END_TEST;
+}
+
 // Verify that we can unmap multiple ranges simultaneously
 bool unmap_multiple_test() {
     BEGIN_TEST;
@@ -1593,6 +1729,184 @@ bool protect_over_demand_paged_test() {
     END_TEST;
 }
 
+// Write faults on a fault-around mapping should commit the following pages
+// too, whether the flag is given on the mapping or inherited from its VMAR.
+bool fault_around_test() {
+    BEGIN_TEST;
+
+    const size_t size = 4 * PAGE_SIZE;
+    mx_paddr_t paddr;
+
+    for (int inherit = 0; inherit < 2; inherit++) {
+        mx_handle_t vmo;
+        ASSERT_EQ(mx_vmo_create(size, 0, &vmo), NO_ERROR, "");
+
+        mx_handle_t region = MX_HANDLE_INVALID;
+        mx_handle_t target_vmar = mx_vmar_root_self();
+        uint32_t map_flags = MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE;
+        if (inherit) {
+            uintptr_t region_addr;
+            ASSERT_EQ(mx_vmar_allocate(mx_vmar_root_self(), 0, size,
+                                       MX_VM_FLAG_CAN_MAP_READ | MX_VM_FLAG_CAN_MAP_WRITE |
+                                       MX_VM_FLAG_FAULT_AROUND,
+                                       &region, &region_addr),
+                      NO_ERROR, "");
+            target_vmar = region;
+        } else {
+            map_flags |= MX_VM_FLAG_FAULT_AROUND;
+        }
+
+        uintptr_t mapping_addr;
+        ASSERT_EQ(mx_vmar_map(target_vmar, 0, vmo, 0, size, map_flags, &mapping_addr),
+                  NO_ERROR, "");
+
+        EXPECT_EQ(mx_vmo_op_range(vmo, MX_VMO_OP_LOOKUP, PAGE_SIZE, PAGE_SIZE,
+                                  &paddr, sizeof(paddr)),
+                  ERR_NO_MEMORY, "page should not be committed yet");
+
+        volatile uint8_t* target = reinterpret_cast<volatile uint8_t*>(mapping_addr);
+        target[0] = 5;
+
+        EXPECT_EQ(mx_vmo_op_range(vmo, MX_VMO_OP_LOOKUP, PAGE_SIZE, PAGE_SIZE,
+                                  &paddr, sizeof(paddr)),
+                  NO_ERROR, "following page should have been faulted in");
+        target[PAGE_SIZE] = 6;
+        EXPECT_EQ(target[PAGE_SIZE], 6, "");
+
+        EXPECT_EQ(mx_vmar_unmap(target_vmar, mapping_addr, size), NO_ERROR, "");
+        if (region != MX_HANDLE_INVALID) {
+            EXPECT_EQ(mx_vmar_destroy(region), NO_ERROR, "");
+            EXPECT_EQ(mx_handle_close(region), NO_ERROR, "");
+        }
+        EXPECT_EQ(mx_handle_close(vmo), NO_ERROR, "");
+    }
+
+    END_TEST;
+}
+
+// Populating a mapping should commit and map every page up front, and a
+// populated clone should see its parent's contents.
+bool map_populate_test() {
+    BEGIN_TEST;
+
+    const size_t size = 16 * PAGE_SIZE;
+    mx_paddr_t paddr;
+
+    mx_handle_t vmo;
+    ASSERT_EQ(mx_vmo_create(size, 0, &vmo), NO_ERROR, "");
+
+    uintptr_t mapping_addr;
+    ASSERT_EQ(mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, size,
+                          MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE | MX_VM_FLAG_MAP_POPULATE,
+                          &mapping_addr),
+              NO_ERROR, "");
+    for (size_t off = 0; off < size; off += PAGE_SIZE) {
+        EXPECT_EQ(mx_vmo_op_range(vmo, MX_VMO_OP_LOOKUP, off, PAGE_SIZE,
+                                  &paddr, sizeof(paddr)),
+                  NO_ERROR, "page should have been committed");
+    }
+
+    volatile uint8_t* target = reinterpret_cast<volatile uint8_t*>(mapping_addr);
+    for (size_t off = 0; off < size; off += PAGE_SIZE) {
+        EXPECT_EQ(target[off], 0, "populated pages should be zero");
+        target[off] = static_cast<uint8_t>(off / PAGE_SIZE + 1);
+    }
+
+    mx_handle_t clone;
+    ASSERT_EQ(mx_vmo_clone(vmo, MX_VMO_CLONE_COPY_ON_WRITE, 0, size, &clone), NO_ERROR, "");
+    uintptr_t clone_addr;
+    ASSERT_EQ(mx_vmar_map(mx_vmar_root_self(), 0, clone, 0, size,
+                          MX_VM_FLAG_PERM_READ | MX_VM_FLAG_MAP_POPULATE, &clone_addr),
+              NO_ERROR, "");
+    EXPECT_EQ(mx_vmo_op_range(clone, MX_VMO_OP_LOOKUP, 0, PAGE_SIZE, &paddr, sizeof(paddr)),
+              NO_ERROR, "clone page should have been committed");
+
+    volatile uint8_t* clone_target = reinterpret_cast<volatile uint8_t*>(clone_addr);
+    for (size_t off = 0; off < size; off += PAGE_SIZE) {
+        EXPECT_EQ(clone_target[off], off / PAGE_SIZE + 1, "clone should copy its parent");
+    }
+
+    // the clone has its own copies now
+    target[0] = 42;
+    EXPECT_EQ(clone_target[0], 1, "");
+
+    EXPECT_EQ(mx_vmar_unmap(mx_vmar_root_self(), clone_addr, size), NO_ERROR, "");
+    EXPECT_EQ(mx_vmar_unmap(mx_vmar_root_self(), mapping_addr, size), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(clone), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(vmo), NO_ERROR, "");
+
+    END_TEST;
+}
+
+struct FaultThreadArgs {
+    uintptr_t base;
+    size_t size;
+    uint8_t value;
+};
+
+int fault_pages_thread(void* arg) {
+    auto args = static_cast<FaultThreadArgs*>(arg);
+    volatile uint8_t* target = reinterpret_cast<volatile uint8_t*>(args->base);
+    for (size_t off = 0; off < args->size; off += PAGE_SIZE)
+        target[off] = args->value;
+    for (size_t off = 0; off < args->size; off += PAGE_SIZE) {
+        if (target[off] != args->value)
+            return -1;
+    }
+    return 0;
+}
+
+// Faults on separate mappings run under a shared aspace lock.  Fault from
+// several threads at once while the main thread keeps changing the layout,
+// and check every thread saw its own pages.
+bool concurrent_fault_test() {
+    BEGIN_TEST;
+
+    const size_t kThreads = 4;
+    const size_t size = 64 * PAGE_SIZE;
+
+    FaultThreadArgs args[kThreads];
+    thrd_t threads[kThreads];
+    for (size_t i = 0; i < kThreads; i++) {
+        mx_handle_t vmo;
+        ASSERT_EQ(mx_vmo_create(size, 0, &vmo), NO_ERROR, "");
+        ASSERT_EQ(mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, size,
+                              MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE,
+                              &args[i].base),
+                  NO_ERROR, "");
+        EXPECT_EQ(mx_handle_close(vmo), NO_ERROR, "");
+        args[i].size = size;
+        args[i].value = static_cast<uint8_t>(i + 1);
+    }
+
+    for (size_t i = 0; i < kThreads; i++) {
+        ASSERT_EQ(thrd_create(&threads[i], fault_pages_thread, &args[i]), thrd_success, "");
+    }
+
+    // structural changes take the aspace lock exclusively in between the faults
+    for (int i = 0; i < 16; i++) {
+        mx_handle_t region;
+        uintptr_t region_addr;
+        ASSERT_EQ(mx_vmar_allocate(mx_vmar_root_self(), 0, 4 * PAGE_SIZE,
+                                   MX_VM_FLAG_CAN_MAP_READ, &region, &region_addr),
+                  NO_ERROR, "");
+        EXPECT_EQ(mx_vmar_destroy(region), NO_ERROR, "");
+        EXPECT_EQ(mx_handle_close(region), NO_ERROR, "");
+    }
+
+    for (size_t i = 0; i < kThreads; i++) {
+        int ret;
+        EXPECT_EQ(thrd_join(threads[i], &ret), thrd_success, "");
+        EXPECT_EQ(ret, 0, "thread saw the wrong contents");
+    }
+
+    for (size_t i = 0; i < kThreads; i++) {
+        EXPECT_EQ(mx_vmar_unmap(mx_vmar_root_self(), args[i].base, size), NO_ERROR, "");
+    }
+
+    END_TEST;
+}
+
 }
 
 BEGIN_TEST_CASE(vmar_tests)
@@ -1600,6 +1914,7 @@ RUN_TEST(destroy_root_test);
 RUN_TEST(basic_allocate_test);
 RUN_TEST(allocate_oob_test);
 RUN_TEST(allocate_unsatisfiable_test);
+RUN_TEST(allocate_fill_test);
 RUN_TEST(destroyed_vmar_test);
 RUN_TEST(map_over_destroyed_test);
 RUN_TEST(map_in_compact_test);
@@ -1611,11 +1926,15 @@ RUN_TEST(protect_test);
 RUN_TEST(nested_region_perms_test);
 RUN_TEST(object_info_test);
 RUN_TEST(unmap_split_test);
+RUN_TEST(unmap_head_with_neighbor_test);
 RUN_TEST(unmap_multiple_test);
 RUN_TEST(map_specific_overwrite_test);
 RUN_TEST(protect_split_test);
 RUN_TEST(protect_multiple_test);
 RUN_TEST(protect_over_demand_paged_test);
+RUN_TEST(fault_around_test);
+RUN_TEST(map_populate_test);
+RUN_TEST(concurrent_fault_test);
 END_TEST_CASE(vmar_tests)
 
 #ifndef BUILD_COMBINED_TESTS
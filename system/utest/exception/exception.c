@@ -9,11 +9,13 @@
 
 #include <assert.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <threads.h>
 #include <unistd.h>
 #include <magenta/compiler.h>
 #include <magenta/process.h>
@@ -1171,6 +1173,62 @@ static bool kill_while_stopped_at_start_test(void)
     END_TEST;
 }
 
+static uintptr_t upcall_page;
+static int upcall_count;
+static uint32_t upcall_excp_type;
+
+static void upcall_handler(mx_exception_frame_t* frame)
+{
+    ++upcall_count;
+    upcall_excp_type = frame->report.header.type;
+    // Make the page writable and let the faulting write retry.
+    mx_vmar_protect(mx_vmar_root_self(), upcall_page, PAGE_SIZE,
+                    MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE);
+}
+
+static bool in_thread_handler_test(void)
+{
+    BEGIN_TEST;
+    unittest_printf("in-thread exception handler test\n");
+
+    mx_handle_t vmo;
+    ASSERT_EQ(mx_vmo_create(PAGE_SIZE, 0, &vmo), NO_ERROR, "");
+    ASSERT_EQ(mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, PAGE_SIZE,
+                          MX_VM_FLAG_PERM_READ, &upcall_page), NO_ERROR, "");
+
+    static uint8_t handler_stack[8192] __ALIGNED(16);
+    mx_exception_handler_t handler = {
+        .pc = (uintptr_t)upcall_handler,
+        .stack = (uintptr_t)handler_stack,
+        .stack_size = sizeof(handler_stack),
+    };
+    mx_handle_t self = thrd_get_mx_handle(thrd_current());
+
+    // The stack has to hold the frame.
+    mx_exception_handler_t small = handler;
+    small.stack_size = sizeof(mx_exception_frame_t) / 2;
+    EXPECT_EQ(mx_object_set_property(self, MX_PROP_EXCEPTION_HANDLER,
+                                     &small, sizeof(small)), ERR_INVALID_ARGS, "");
+
+    ASSERT_EQ(mx_object_set_property(self, MX_PROP_EXCEPTION_HANDLER,
+                                     &handler, sizeof(handler)), NO_ERROR, "");
+
+    volatile int* p = (volatile int*)upcall_page;
+    *p = 42;
+    EXPECT_EQ(*p, 42, "write did not complete");
+    EXPECT_EQ(upcall_count, 1, "handler not called once");
+    EXPECT_EQ(upcall_excp_type, (uint32_t)MX_EXCP_FATAL_PAGE_FAULT, "");
+
+    mx_exception_handler_t none = {};
+    EXPECT_EQ(mx_object_set_property(self, MX_PROP_EXCEPTION_HANDLER,
+                                     &none, sizeof(none)), NO_ERROR, "");
+
+    mx_vmar_unmap(mx_vmar_root_self(), upcall_page, PAGE_SIZE);
+    tu_handle_close(vmo);
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(exceptions_tests)
 RUN_TEST(process_set_close_set_test);
 RUN_TEST(process_debugger_set_close_set_test);
@@ -1193,6 +1251,7 @@ RUN_TEST(trigger_test);
 RUN_TEST(unbind_while_stopped_test);
 RUN_TEST(unbind_rebind_while_stopped_test);
 RUN_TEST(kill_while_stopped_at_start_test);
+RUN_TEST(in_thread_handler_test);
 END_TEST_CASE(exceptions_tests)
 
 static void check_verbosity(int argc, char** argv)
@@ -0,0 +1,302 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stddef.h>
+#include <string.h>
+
+#include <fidl/coding.h>
+#include <magenta/syscalls.h>
+#include <unittest/unittest.h>
+
+// Coding tables as `fidl c` writes them for:
+//
+//   struct Named {
+//       string name;
+//       uint32 count;
+//       handle<event> event;
+//   };
+//   union Thing {
+//       uint64 number;
+//       Named named;
+//   };
+//   interface Things {
+//       1: Put(Thing thing, handle extra);
+//   };
+
+typedef struct Named {
+    fidl_string_t name;
+    uint32_t count;
+    mx_handle_t event;
+} Named;
+
+#define Thing_tag_number ((uint32_t)0)
+#define Thing_tag_named ((uint32_t)1)
+typedef struct Thing {
+    uint32_t tag;
+    union {
+        uint64_t number;
+        Named named;
+    };
+} Thing;
+
+typedef struct Things_Put_Request {
+    fidl_message_header_t hdr;
+    Thing thing;
+    mx_handle_t extra;
+} Things_Put_Request;
+
+static const fidl_field_t Named_fields[] = {
+    {&fidl_string_type, offsetof(Named, name)},
+    {&fidl_handle_type, offsetof(Named, event)},
+};
+static const fidl_type_t Named_table = {
+    .type_tag = fidl_type_struct,
+    .coded_struct = {
+        .fields = Named_fields,
+        .field_count = 2,
+        .size = sizeof(Named),
+        .name = "Named",
+    },
+};
+
+static const fidl_type_t* const Thing_types[] = {
+    NULL,
+    &Named_table,
+};
+static const fidl_type_t Thing_table = {
+    .type_tag = fidl_type_union,
+    .coded_union = {
+        .types = Thing_types,
+        .type_count = 2,
+        .data_offset = offsetof(Thing, number),
+        .size = sizeof(Thing),
+        .name = "Thing",
+    },
+};
+
+static const fidl_field_t Things_Put_Request_fields[] = {
+    {&Thing_table, offsetof(Things_Put_Request, thing)},
+    {&fidl_handle_type, offsetof(Things_Put_Request, extra)},
+};
+static const fidl_type_t Things_Put_Request_table = {
+    .type_tag = fidl_type_struct,
+    .coded_struct = {
+        .fields = Things_Put_Request_fields,
+        .field_count = 2,
+        .size = sizeof(Things_Put_Request),
+        .name = "Things.Put_Request",
+    },
+};
+
+static const char kName[] = "a name which is longer than eight bytes";
+
+// Room for the request and its out-of-line string.
+static uint64_t buffer[32];
+
+// Builds and encodes a Put request holding a Named, leaving the bytes in
+// |buffer| and the two handles in |handles|.
+static bool build_named(uint32_t* num_bytes, mx_handle_t* handles) {
+    BEGIN_HELPER;
+
+    mx_handle_t event, extra;
+    ASSERT_EQ(mx_event_create(0u, &event), NO_ERROR, "");
+    ASSERT_EQ(mx_event_create(0u, &extra), NO_ERROR, "");
+
+    fidl_builder_t builder;
+    fidl_builder_init(&builder, buffer, sizeof(buffer));
+    Things_Put_Request* request = fidl_builder_alloc(&builder, sizeof(*request));
+    ASSERT_NONNULL(request, "");
+    request->hdr.ordinal = 1u;
+    request->thing.tag = Thing_tag_named;
+    ASSERT_TRUE(fidl_builder_string(&builder, &request->thing.named.name, kName,
+                                    sizeof(kName) - 1),
+                "");
+    request->thing.named.count = 42u;
+    request->thing.named.event = event;
+    request->extra = extra;
+
+    uint32_t actual_handles = 0u;
+    const char* error = NULL;
+    ASSERT_EQ(fidl_encode(&Things_Put_Request_table, buffer, builder.size, handles, 2u,
+                          &actual_handles, &error),
+              NO_ERROR, error);
+    ASSERT_EQ(actual_handles, 2u, "");
+    EXPECT_EQ(handles[0], event, "");
+    EXPECT_EQ(handles[1], extra, "");
+    EXPECT_EQ((uintptr_t)request->thing.named.name.data, FIDL_ALLOC_PRESENT, "");
+    EXPECT_EQ(request->thing.named.event, FIDL_HANDLE_PRESENT, "");
+    EXPECT_EQ(request->extra, FIDL_HANDLE_PRESENT, "");
+    EXPECT_EQ(builder.size, FIDL_ALIGN(sizeof(*request)) + FIDL_ALIGN(sizeof(kName) - 1), "");
+
+    *num_bytes = builder.size;
+    END_HELPER;
+}
+
+static bool handles_closed(const mx_handle_t* handles, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (mx_handle_close(handles[i]) != ERR_BAD_HANDLE)
+            return false;
+    }
+    return true;
+}
+
+static bool round_trip_test(void) {
+    BEGIN_TEST;
+
+    uint32_t num_bytes;
+    mx_handle_t handles[2];
+    ASSERT_TRUE(build_named(&num_bytes, handles), "");
+
+    const char* error = NULL;
+    ASSERT_EQ(fidl_decode(&Things_Put_Request_table, buffer, num_bytes, handles, 2u, &error),
+              NO_ERROR, error);
+
+    // Everything is read in place, out of the same buffer.
+    Things_Put_Request* request = (Things_Put_Request*)buffer;
+    EXPECT_EQ(request->hdr.ordinal, 1u, "");
+    EXPECT_EQ(request->thing.tag, Thing_tag_named, "");
+    EXPECT_EQ(request->thing.named.count, 42u, "");
+    EXPECT_EQ(request->thing.named.name.size, sizeof(kName) - 1, "");
+    EXPECT_EQ((uint8_t*)request->thing.named.name.data,
+              (uint8_t*)buffer + FIDL_ALIGN(sizeof(*request)), "");
+    EXPECT_EQ(memcmp(request->thing.named.name.data, kName, sizeof(kName) - 1), 0, "");
+    EXPECT_EQ(request->thing.named.event, handles[0], "");
+    EXPECT_EQ(request->extra, handles[1], "");
+
+    // A decoded message encodes back to the same bytes and handles.
+    mx_handle_t out_handles[2];
+    uint32_t actual_handles = 0u;
+    ASSERT_EQ(fidl_encode(&Things_Put_Request_table, buffer, num_bytes, out_handles, 2u,
+                          &actual_handles, &error),
+              NO_ERROR, error);
+    EXPECT_EQ(actual_handles, 2u, "");
+    EXPECT_EQ(out_handles[0], handles[0], "");
+    EXPECT_EQ(out_handles[1], handles[1], "");
+
+    EXPECT_EQ(mx_handle_close(handles[0]), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(handles[1]), NO_ERROR, "");
+    END_TEST;
+}
+
+static bool plain_union_test(void) {
+    BEGIN_TEST;
+
+    mx_handle_t extra;
+    ASSERT_EQ(mx_event_create(0u, &extra), NO_ERROR, "");
+
+    Things_Put_Request* request = (Things_Put_Request*)buffer;
+    memset(buffer, 0, sizeof(buffer));
+    request->thing.tag = Thing_tag_number;
+    request->thing.number = 0x1234u;
+    request->extra = FIDL_HANDLE_PRESENT;
+
+    const char* error = NULL;
+    ASSERT_EQ(fidl_decode(&Things_Put_Request_table, buffer, FIDL_ALIGN(sizeof(*request)),
+                          &extra, 1u, &error),
+              NO_ERROR, error);
+    EXPECT_EQ(request->thing.number, 0x1234u, "");
+    EXPECT_EQ(request->extra, extra, "");
+
+    EXPECT_EQ(mx_handle_close(extra), NO_ERROR, "");
+    END_TEST;
+}
+
+// Checks that decoding refuses a message which has been broken in some way,
+// and closes the handles which came with it.
+static bool decode_rejects(uint32_t num_bytes, const mx_handle_t* handles, uint32_t num_handles) {
+    BEGIN_HELPER;
+
+    const char* error = NULL;
+    EXPECT_EQ(fidl_decode(&Things_Put_Request_table, buffer, num_bytes, handles, num_handles,
+                          &error),
+              ERR_INVALID_ARGS, "");
+    EXPECT_NONNULL(error, "");
+    EXPECT_TRUE(handles_closed(handles, num_handles), "");
+
+    END_HELPER;
+}
+
+static bool malformed_test(void) {
+    BEGIN_TEST;
+
+    Things_Put_Request* request = (Things_Put_Request*)buffer;
+    uint32_t num_bytes;
+    mx_handle_t handles[2];
+
+    // Too few handles.  Only the one which was passed in is closed.
+    ASSERT_TRUE(build_named(&num_bytes, handles), "");
+    EXPECT_TRUE(decode_rejects(num_bytes, handles, 1u), "");
+    EXPECT_EQ(mx_handle_close(handles[1]), NO_ERROR, "");
+
+    // Out-of-line data which runs off the end of the message.
+    ASSERT_TRUE(build_named(&num_bytes, handles), "");
+    request->thing.named.name.size = sizeof(buffer);
+    EXPECT_TRUE(decode_rejects(num_bytes, handles, 2u), "");
+
+    // Bytes which nothing points at.
+    ASSERT_TRUE(build_named(&num_bytes, handles), "");
+    EXPECT_TRUE(decode_rejects(num_bytes + FIDL_ALIGNMENT, handles, 2u), "");
+
+    // Too short for the primary object.
+    ASSERT_TRUE(build_named(&num_bytes, handles), "");
+    EXPECT_TRUE(decode_rejects(sizeof(*request) / 2, handles, 2u), "");
+
+    // A pointer which isn't the present marker.
+    ASSERT_TRUE(build_named(&num_bytes, handles), "");
+    request->thing.named.name.data = (char*)buffer;
+    EXPECT_TRUE(decode_rejects(num_bytes, handles, 2u), "");
+
+    // A handle slot which doesn't expect a handle.
+    ASSERT_TRUE(build_named(&num_bytes, handles), "");
+    request->extra = FIDL_HANDLE_ABSENT;
+    EXPECT_TRUE(decode_rejects(num_bytes, handles, 2u), "");
+
+    // A union tag past the last member.
+    ASSERT_TRUE(build_named(&num_bytes, handles), "");
+    request->thing.tag = 2u;
+    EXPECT_TRUE(decode_rejects(num_bytes, handles, 2u), "");
+
+    END_TEST;
+}
+
+static bool encode_misplaced_test(void) {
+    BEGIN_TEST;
+
+    mx_handle_t event;
+    ASSERT_EQ(mx_event_create(0u, &event), NO_ERROR, "");
+
+    // The string data isn't where the wire format puts it, so encoding
+    // without moving anything can't work.
+    static char elsewhere[] = "somewhere else";
+    Things_Put_Request* request = (Things_Put_Request*)buffer;
+    memset(buffer, 0, sizeof(buffer));
+    request->thing.tag = Thing_tag_named;
+    request->thing.named.event = event;
+    request->thing.named.name.size = sizeof(elsewhere) - 1;
+    request->thing.named.name.data = elsewhere;
+
+    mx_handle_t handles[2];
+    uint32_t actual_handles = 0u;
+    const char* error = NULL;
+    EXPECT_EQ(fidl_encode(&Things_Put_Request_table, buffer, sizeof(buffer), handles, 2u,
+                          &actual_handles, &error),
+              ERR_INVALID_ARGS, "");
+    EXPECT_NONNULL(error, "");
+    // The string comes before the handle, so nothing was taken out.
+    EXPECT_EQ(request->thing.named.event, event, "");
+    EXPECT_EQ(mx_handle_close(event), NO_ERROR, "");
+
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(fidl_coding_tests)
+RUN_TEST(round_trip_test)
+RUN_TEST(plain_union_test)
+RUN_TEST(malformed_test)
+RUN_TEST(encode_misplaced_test)
+END_TEST_CASE(fidl_coding_tests)
+
+int main(int argc, char** argv) {
+    return unittest_run_all_tests(argc, argv) ? 0 : -1;
+}
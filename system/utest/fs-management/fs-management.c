@@ -251,6 +251,21 @@ static bool mount_fsck(void) {
     END_TEST;
 }
 
+static bool mkfs_fsck_blobstore(void) {
+    const char* ramdisk_name = "mkfs_fsck_blobstore";
+    char ramdisk_path[PATH_MAX];
+
+    BEGIN_TEST;
+    ASSERT_EQ(create_ramdisk(ramdisk_name, ramdisk_path, 512, 1 << 16), 0, "");
+    ASSERT_EQ(mkfs(ramdisk_path, DISK_FORMAT_BLOBFS, launch_stdio_sync), NO_ERROR, "");
+    fsck_options_t options = default_fsck_options;
+    options.progress = true;
+    ASSERT_EQ(fsck(ramdisk_path, DISK_FORMAT_BLOBFS, &options, launch_stdio_sync),
+              NO_ERROR, "");
+    ASSERT_EQ(destroy_ramdisk(ramdisk_path), 0, "");
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(fs_management_tests)
 RUN_TEST_MEDIUM(mount_unmount)
 RUN_TEST_MEDIUM(mount_mkdir_unmount)
@@ -259,6 +274,7 @@ RUN_TEST_MEDIUM(mount_evil_memfs)
 RUN_TEST_MEDIUM(mount_evil_minfs)
 RUN_TEST_MEDIUM(mount_remount)
 RUN_TEST_MEDIUM(mount_fsck)
+RUN_TEST_MEDIUM(mkfs_fsck_blobstore)
 END_TEST_CASE(fs_management_tests)
 
 int main(int argc, char** argv) {
@@ -15,6 +15,8 @@
 #include <unistd.h>
 
 #include <magenta/compiler.h>
+#include <mxio/io.h>
+#include <mxio/vfs.h>
 
 #include "filesystems.h"
 #include "misc.h"
@@ -252,6 +254,76 @@ bool test_directory_readdir(void) {
     END_TEST;
 }
 
+bool test_directory_readdir_plus(void) {
+    BEGIN_TEST;
+
+    const int num_files = 100;
+    ASSERT_EQ(mkdir("::a", 0755), 0, "");
+    ASSERT_EQ(mkdir("::a/dir", 0755), 0, "");
+    char data[num_files];
+    memset(data, 'x', sizeof(data));
+    for (int i = 0; i < num_files; i++) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "::a/file%d", i);
+        int fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+        ASSERT_GT(fd, 0, "");
+        ASSERT_EQ(write(fd, data, i), i, "");
+        ASSERT_EQ(close(fd), 0, "");
+    }
+
+    DIR* dir = opendir("::a");
+    ASSERT_NONNULL(dir, "");
+    // A small buffer, so that the listing takes several batches
+    uint64_t buf[1024 / sizeof(uint64_t)];
+    int files_seen = 0;
+    bool dir_seen = false;
+    ssize_t len = mxio_readdir_plus(dirfd(dir), buf, sizeof(buf), true);
+    ASSERT_GT(len, 0, "");
+    while (len > 0) {
+        for (ssize_t off = 0; off < len;) {
+            vdirent_plus_t* de = (vdirent_plus_t*)((char*)buf + off);
+            ASSERT_EQ(off % 8, 0, "records are not 8 byte aligned");
+            off += de->size;
+            if (!strcmp(de->name, ".") || !strcmp(de->name, "..")) {
+                continue;
+            }
+            // Every entry's attributes match what stat() says
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "::a/%s", de->name);
+            struct stat st;
+            ASSERT_EQ(stat(path, &st), 0, "");
+            ASSERT_EQ(de->attr.mode & V_TYPE_MASK, st.st_mode & V_TYPE_MASK, "");
+            ASSERT_EQ(de->attr.size, (uint64_t)st.st_size, "");
+            ASSERT_EQ(de->attr.nlink, (uint64_t)st.st_nlink, "");
+            if (!strcmp(de->name, "dir")) {
+                ASSERT_EQ(de->type, DT_DIR, "");
+                dir_seen = true;
+                continue;
+            }
+            int n;
+            ASSERT_EQ(sscanf(de->name, "file%d", &n), 1, "");
+            ASSERT_EQ(de->type, DT_REG, "");
+            ASSERT_EQ(de->attr.size, (uint64_t)n, "");
+            files_seen++;
+        }
+        len = mxio_readdir_plus(dirfd(dir), buf, sizeof(buf), false);
+    }
+    ASSERT_EQ(len, 0, "");
+    ASSERT_EQ(files_seen, num_files, "");
+    ASSERT_TRUE(dir_seen, "");
+    ASSERT_EQ(closedir(dir), 0, "");
+
+    for (int i = 0; i < num_files; i++) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "::a/file%d", i);
+        ASSERT_EQ(unlink(path), 0, "");
+    }
+    ASSERT_EQ(rmdir("::a/dir"), 0, "");
+    ASSERT_EQ(rmdir("::a"), 0, "");
+
+    END_TEST;
+}
+
 // Create a directory named "::dir" with entries "00000", "00001" ... up to
 // num_entries.
 bool large_dir_setup(size_t num_entries) {
@@ -411,6 +483,7 @@ RUN_FOR_ALL_FILESYSTEMS(directory_tests,
     RUN_TEST_LARGE(test_directory_large)
     RUN_TEST_MEDIUM(test_directory_trailing_slash)
     RUN_TEST_MEDIUM(test_directory_readdir)
+    RUN_TEST_MEDIUM(test_directory_readdir_plus)
     RUN_TEST_MEDIUM(test_directory_readdir_rm_all)
     RUN_TEST_MEDIUM(test_directory_rewind)
     RUN_TEST_MEDIUM(test_directory_after_rmdir)
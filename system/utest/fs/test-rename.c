@@ -243,9 +243,54 @@ bool test_rename_at(void) {
     END_TEST;
 }
 
+// Paths walked before a rename or unlink must not resolve to the old
+// directories afterwards, even though the filesystem may remember them.
+bool test_rename_walked_dirs(void) {
+    BEGIN_TEST;
+    ASSERT_EQ(mkdir("::alpha", 0755), 0, "");
+    ASSERT_EQ(mkdir("::alpha/bravo", 0755), 0, "");
+    int fd = open("::alpha/bravo/charlie", O_RDWR | O_CREAT | O_EXCL, 0644);
+    ASSERT_GT(fd, 0, "");
+    ASSERT_EQ(close(fd), 0, "");
+    fd = open("::alpha/bravo/charlie", O_RDWR, 0644);
+    ASSERT_GT(fd, 0, "");
+    ASSERT_EQ(close(fd), 0, "");
+
+    ASSERT_EQ(rename("::alpha/bravo", "::alpha/delta"), 0, "");
+    ASSERT_EQ(open("::alpha/bravo/charlie", O_RDWR, 0644), -1, "");
+    fd = open("::alpha/delta/charlie", O_RDWR, 0644);
+    ASSERT_GT(fd, 0, "");
+    ASSERT_EQ(close(fd), 0, "");
+
+    // A new directory under the old name starts out empty
+    ASSERT_EQ(mkdir("::alpha/bravo", 0755), 0, "");
+    ASSERT_EQ(open("::alpha/bravo/charlie", O_RDWR, 0644), -1, "");
+
+    // Replacing a walked directory
+    ASSERT_EQ(unlink("::alpha/delta/charlie"), 0, "");
+    ASSERT_EQ(rename("::alpha/delta", "::alpha/bravo"), 0, "");
+    ASSERT_EQ(open("::alpha/delta/charlie", O_RDWR, 0644), -1, "");
+    fd = open("::alpha/bravo/echo", O_RDWR | O_CREAT | O_EXCL, 0644);
+    ASSERT_GT(fd, 0, "");
+    ASSERT_EQ(close(fd), 0, "");
+
+    // Removing and recreating a walked directory
+    ASSERT_EQ(unlink("::alpha/bravo/echo"), 0, "");
+    ASSERT_EQ(rmdir("::alpha/bravo"), 0, "");
+    ASSERT_EQ(open("::alpha/bravo/echo", O_RDWR, 0644), -1, "");
+    ASSERT_EQ(mkdir("::alpha/bravo", 0755), 0, "");
+    ASSERT_EQ(open("::alpha/bravo/echo", O_RDWR, 0644), -1, "");
+
+    // Clean up
+    ASSERT_EQ(rmdir("::alpha/bravo"), 0, "");
+    ASSERT_EQ(rmdir("::alpha"), 0, "");
+    END_TEST;
+}
+
 RUN_FOR_ALL_FILESYSTEMS(rename_tests,
     RUN_TEST_MEDIUM(test_rename_basic)
     RUN_TEST_MEDIUM(test_rename_with_children)
     RUN_TEST_MEDIUM(test_rename_absolute_relative)
     RUN_TEST_MEDIUM(test_rename_at)
+    RUN_TEST_MEDIUM(test_rename_walked_dirs)
 )
@@ -22,27 +22,45 @@
 #include "filesystems.h"
 #include "misc.h"
 
+typedef struct {
+    mx_handle_t h;
+    // the last message read, of which off bytes have been checked
+    size_t off;
+    size_t len;
+    uint8_t buf[VFS_WATCH_MSG_MAX];
+} watch_buf_t;
+
 // Try to read from the channel when it should be empty.
-bool check_for_empty(mx_handle_t h) {
+bool check_for_empty(watch_buf_t* wb) {
     char name[NAME_MAX + 1];
-    ASSERT_EQ(mx_channel_read(h, 0, &name, NULL, sizeof(name), 0, NULL, NULL),
+    ASSERT_EQ(wb->off, wb->len, "");
+    ASSERT_EQ(mx_channel_read(wb->h, 0, &name, NULL, sizeof(name), 0, NULL, NULL),
               ERR_SHOULD_WAIT, "");
     return true;
 }
 
-// Try to read the 'expected' name off the channel.
-bool check_for_watched(mx_handle_t h, const char* expected, size_t expected_len) {
-    mx_signals_t observed;
-    ASSERT_EQ(mx_object_wait_one(h, MX_CHANNEL_READABLE,
-                                 mx_deadline_after(MX_SEC(5)), &observed),
-              NO_ERROR, "");
-    ASSERT_EQ(observed & MX_CHANNEL_READABLE, MX_CHANNEL_READABLE, "");
-    uint32_t actual;
-    char name[NAME_MAX + 1];
-    ASSERT_EQ(mx_channel_read(h, 0, &name, NULL, expected_len, 0, &actual, NULL),
-              NO_ERROR, "");
-    ASSERT_EQ(actual, expected_len, "");
-    ASSERT_EQ(strncmp(name, expected, expected_len), 0, "");
+// Try to read the 'expected' event about the 'expected' name off the channel.
+bool check_for_event(watch_buf_t* wb, const char* expected, uint8_t event) {
+    if (wb->off == wb->len) {
+        mx_signals_t observed;
+        ASSERT_EQ(mx_object_wait_one(wb->h, MX_CHANNEL_READABLE,
+                                     mx_deadline_after(MX_SEC(5)), &observed),
+                  NO_ERROR, "");
+        ASSERT_EQ(observed & MX_CHANNEL_READABLE, MX_CHANNEL_READABLE, "");
+        uint32_t actual;
+        ASSERT_EQ(mx_channel_read(wb->h, 0, wb->buf, NULL, sizeof(wb->buf), 0, &actual, NULL),
+                  NO_ERROR, "");
+        wb->off = 0;
+        wb->len = actual;
+    }
+    size_t expected_len = strlen(expected);
+    ASSERT_GE(wb->len - wb->off, sizeof(vfs_watch_msg_t), "");
+    vfs_watch_msg_t* msg = (vfs_watch_msg_t*)(wb->buf + wb->off);
+    ASSERT_EQ(msg->event, event, "");
+    ASSERT_EQ(msg->len, expected_len, "");
+    ASSERT_GE(wb->len - wb->off - sizeof(vfs_watch_msg_t), expected_len, "");
+    ASSERT_EQ(strncmp(msg->name, expected, expected_len), 0, "");
+    wb->off += sizeof(vfs_watch_msg_t) + expected_len;
     return true;
 }
 
@@ -55,33 +73,91 @@ bool test_watcher_basic(void) {
     ASSERT_EQ(mkdir("::dir", 0666), 0, "");
     DIR* dir = opendir("::dir");
     ASSERT_NONNULL(dir, "");
-    mx_handle_t h;
-    ASSERT_EQ(ioctl_vfs_watch_dir(dirfd(dir), &h), (ssize_t) sizeof(mx_handle_t), "");
+    watch_buf_t wb;
+    memset(&wb, 0, sizeof(wb));
+    ASSERT_EQ(ioctl_vfs_watch_dir(dirfd(dir), &wb.h), (ssize_t) sizeof(mx_handle_t), "");
 
     // The channel should be empty
-    ASSERT_TRUE(check_for_empty(h), "");
+    ASSERT_TRUE(check_for_empty(&wb), "");
 
     // Creating a file in the directory should trigger the watcher
     int fd = open("::dir/foo", O_RDWR | O_CREAT);
     ASSERT_GT(fd, 0, "");
     ASSERT_EQ(close(fd), 0, "");
-    ASSERT_TRUE(check_for_watched(h, "foo", sizeof("foo") - 1), "");
+    ASSERT_TRUE(check_for_event(&wb, "foo", VFS_WATCH_EVT_ADDED), "");
+
+    // Truncating it on open should too
+    fd = open("::dir/foo", O_RDWR | O_TRUNC);
+    ASSERT_GT(fd, 0, "");
+    ASSERT_EQ(close(fd), 0, "");
+    ASSERT_TRUE(check_for_event(&wb, "foo", VFS_WATCH_EVT_MODIFIED), "");
 
-    // Renaming into directory should trigger the watcher
+    // Renaming within the directory should trigger the watcher twice
     ASSERT_EQ(rename("::dir/foo", "::dir/bar"), 0, "");
-    ASSERT_TRUE(check_for_watched(h, "bar", sizeof("bar") - 1), "");
+    ASSERT_TRUE(check_for_event(&wb, "foo", VFS_WATCH_EVT_REMOVED), "");
+    ASSERT_TRUE(check_for_event(&wb, "bar", VFS_WATCH_EVT_ADDED), "");
 
     // Linking into directory should trigger the watcher
     ASSERT_EQ(link("::dir/bar", "::dir/blat"), 0, "");
-    ASSERT_TRUE(check_for_watched(h, "blat", sizeof("blat") - 1), "");
+    ASSERT_TRUE(check_for_event(&wb, "blat", VFS_WATCH_EVT_ADDED), "");
 
-    // Clean up
+    // Clean up, which the watcher should see too
     ASSERT_EQ(unlink("::dir/bar"), 0, "");
     ASSERT_EQ(unlink("::dir/blat"), 0, "");
+    ASSERT_TRUE(check_for_event(&wb, "bar", VFS_WATCH_EVT_REMOVED), "");
+    ASSERT_TRUE(check_for_event(&wb, "blat", VFS_WATCH_EVT_REMOVED), "");
 
     // There shouldn't be anything else sitting around on the channel
-    ASSERT_TRUE(check_for_empty(h), "");
-    ASSERT_EQ(mx_handle_close(h), 0, "");
+    ASSERT_TRUE(check_for_empty(&wb), "");
+    ASSERT_EQ(mx_handle_close(wb.h), 0, "");
+
+    ASSERT_EQ(closedir(dir), 0, "");
+    ASSERT_EQ(rmdir("::dir"), 0, "");
+
+    END_TEST;
+}
+
+// Enough events to be coalesced into several messages, all of which should
+// arrive in order.
+bool test_watcher_many(void) {
+    if (!test_info->supports_watchers) {
+        return true;
+    }
+    BEGIN_TEST;
+
+    const int file_count = 500;
+
+    ASSERT_EQ(mkdir("::dir", 0666), 0, "");
+    DIR* dir = opendir("::dir");
+    ASSERT_NONNULL(dir, "");
+    watch_buf_t wb;
+    memset(&wb, 0, sizeof(wb));
+    ASSERT_EQ(ioctl_vfs_watch_dir(dirfd(dir), &wb.h), (ssize_t) sizeof(mx_handle_t), "");
+
+    char path[PATH_MAX];
+    for (int i = 0; i < file_count; i++) {
+        snprintf(path, sizeof(path), "::dir/file-with-a-longish-name-%d", i);
+        int fd = open(path, O_RDWR | O_CREAT);
+        ASSERT_GT(fd, 0, "");
+        ASSERT_EQ(close(fd), 0, "");
+    }
+    for (int i = 0; i < file_count; i++) {
+        snprintf(path, sizeof(path), "::dir/file-with-a-longish-name-%d", i);
+        ASSERT_EQ(unlink(path), 0, "");
+    }
+
+    char name[NAME_MAX + 1];
+    for (int i = 0; i < file_count; i++) {
+        snprintf(name, sizeof(name), "file-with-a-longish-name-%d", i);
+        ASSERT_TRUE(check_for_event(&wb, name, VFS_WATCH_EVT_ADDED), "");
+    }
+    for (int i = 0; i < file_count; i++) {
+        snprintf(name, sizeof(name), "file-with-a-longish-name-%d", i);
+        ASSERT_TRUE(check_for_event(&wb, name, VFS_WATCH_EVT_REMOVED), "");
+    }
+
+    ASSERT_TRUE(check_for_empty(&wb), "");
+    ASSERT_EQ(mx_handle_close(wb.h), 0, "");
 
     ASSERT_EQ(closedir(dir), 0, "");
     ASSERT_EQ(rmdir("::dir"), 0, "");
@@ -91,4 +167,5 @@ bool test_watcher_basic(void) {
 
 RUN_FOR_ALL_FILESYSTEMS(directory_watcher_tests,
     RUN_TEST_MEDIUM(test_watcher_basic)
+    RUN_TEST_MEDIUM(test_watcher_many)
 )
@@ -9,10 +9,15 @@
 #include <magenta/process.h>
 #include <magenta/syscalls.h>
 #include <magenta/syscalls/hypervisor.h>
+#include <magenta/syscalls/port.h>
 #include <pretty/hexdump.h>
 #include <unittest/unittest.h>
 
 static const uint64_t kVmoSize = 2 << 20;
+#if __x86_64__
+static const uint16_t kTrapIoPort = 0x1000;
+static const uint64_t kTrapKey = 0x6b;
+#endif // __x86_64__
 
 extern const char guest_start[];
 extern const char guest_end[];
@@ -150,6 +155,19 @@ static bool guest_start_test(void) {
     ASSERT_EQ(mx_hypervisor_op(guest, MX_HYPERVISOR_OP_GUEST_SET_ESI,
                                &guest_esi, sizeof(guest_esi), NULL, 0),
               NO_ERROR, "");
+    mx_handle_t port;
+    ASSERT_EQ(mx_port_create(MX_PORT_OPT_V2, &port), NO_ERROR, "");
+    mx_guest_io_trap_t io_trap = {
+        .port = port,
+        .io_port = kTrapIoPort,
+        .key = kTrapKey,
+    };
+    ASSERT_EQ(mx_hypervisor_op(guest, MX_HYPERVISOR_OP_GUEST_SET_IO_TRAP,
+                               &io_trap, sizeof(io_trap), NULL, 0),
+              NO_ERROR, "");
+    ASSERT_EQ(mx_hypervisor_op(guest, MX_HYPERVISOR_OP_GUEST_SET_IO_TRAP,
+                               &io_trap, sizeof(io_trap), NULL, 0),
+              ERR_ALREADY_EXISTS, "");
 #endif // __x86_64__
 
     ASSERT_EQ(mx_hypervisor_op(guest, MX_HYPERVISOR_OP_GUEST_SET_ENTRY,
@@ -166,6 +184,20 @@ static bool guest_start_test(void) {
     ASSERT_EQ(mx_fifo_read(guest_serial_fifo, buffer, PAGE_SIZE, &num_entries_read), NO_ERROR, "");
     ASSERT_EQ(memcmp(buffer, "mx", 2), 0, "");
 
+#if __x86_64__
+    // Both writes to the trapped port were folded into one packet, without
+    // leaving the kernel.
+    mx_port_packet_t packet;
+    ASSERT_EQ(mx_port_wait(port, 0, &packet, sizeof(packet)), NO_ERROR, "");
+    EXPECT_EQ(packet.key, kTrapKey, "");
+    EXPECT_EQ(packet.type, MX_PKT_TYPE_GUEST_IO, "");
+    EXPECT_EQ(packet.guest_io.port, kTrapIoPort, "");
+    EXPECT_EQ(packet.guest_io.access_size, 1u, "");
+    EXPECT_EQ(packet.guest_io.data, 'k', "");
+    EXPECT_EQ(packet.guest_io.count, 2u, "");
+    ASSERT_EQ(mx_handle_close(port), NO_ERROR, "");
+#endif // __x86_64__
+
     ASSERT_EQ(mx_handle_close(guest), NO_ERROR, "");
     ASSERT_EQ(mx_handle_close(guest_serial_fifo), NO_ERROR, "");
     ASSERT_EQ(mx_handle_close(guest_phys_mem), NO_ERROR, "");
@@ -0,0 +1,117 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inet6/checksum.h>
+#include <magenta/syscalls.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unittest/unittest.h>
+
+#define MAX_LEN 300
+#define MAX_OFFSET 8
+
+#define BENCH_SIZE (1024 * 1024)
+#define BENCH_ROUNDS 64
+
+// One byte at a time, as RFC 1071 describes it, in memory order.
+static uint16_t reference_checksum(const uint8_t* data, size_t len, uint16_t sum) {
+    uint32_t acc = sum;
+    for (size_t i = 0; i < len; i++) {
+        // on little endian machines the first byte of a word is the low half
+        acc += (i & 1) ? ((uint32_t)data[i] << 8) : data[i];
+        acc = (acc & 0xffff) + (acc >> 16);
+    }
+    return acc;
+}
+
+static void fill(uint8_t* buf, size_t len, uint32_t seed) {
+    for (size_t i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = seed >> 16;
+    }
+}
+
+static bool checksum_matches_reference(void) {
+    BEGIN_TEST;
+    const inet_checksum_impl_t* impls;
+    size_t count = inet_checksum_impls(&impls);
+    ASSERT_GT(count, 0u, "no checksum implementations");
+
+    static uint8_t buf[MAX_LEN + MAX_OFFSET];
+    fill(buf, sizeof(buf), 1);
+    for (size_t n = 0; n < count; n++) {
+        for (size_t off = 0; off < MAX_OFFSET; off++) {
+            for (size_t len = 0; len <= MAX_LEN; len++) {
+                uint16_t seed = len * 257;
+                uint16_t want = reference_checksum(buf + off, len, seed);
+                uint16_t got = impls[n].func(buf + off, len, seed);
+                if (got != want) {
+                    unittest_printf_critical("\n%s: off %zu len %zu: got %#x want %#x\n",
+                                             impls[n].name, off, len, got, want);
+                }
+                ASSERT_EQ(got, want, "checksum mismatch");
+            }
+        }
+    }
+    END_TEST;
+}
+
+static bool checksum_all_ones(void) {
+    BEGIN_TEST;
+    const inet_checksum_impl_t* impls;
+    size_t count = inet_checksum_impls(&impls);
+
+    // the worst case for carries
+    static uint8_t buf[4096];
+    memset(buf, 0xff, sizeof(buf));
+    for (size_t n = 0; n < count; n++) {
+        for (size_t len = 0; len <= sizeof(buf); len += 61) {
+            uint16_t want = reference_checksum(buf, len, 0xffff);
+            EXPECT_EQ(impls[n].func(buf, len, 0xffff), want, impls[n].name);
+        }
+    }
+    END_TEST;
+}
+
+static bool checksum_benchmark(void) {
+    BEGIN_TEST;
+    const inet_checksum_impl_t* impls;
+    size_t count = inet_checksum_impls(&impls);
+
+    uint8_t* buf = malloc(BENCH_SIZE);
+    ASSERT_NONNULL(buf, "out of memory");
+    fill(buf, BENCH_SIZE, 2);
+    unittest_printf_critical("\n");
+    // a full buffer and a typical ethernet frame
+    static const size_t sizes[] = { BENCH_SIZE, 1514 };
+    for (size_t n = 0; n < count; n++) {
+        for (size_t s = 0; s < countof(sizes); s++) {
+            size_t reps = (size_t)BENCH_ROUNDS * BENCH_SIZE / sizes[s];
+            volatile uint16_t sink = 0;
+            mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+            for (size_t i = 0; i < reps; i++) {
+                sink = impls[n].func(buf, sizes[s], sink);
+            }
+            mx_time_t ns = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+            if (ns == 0) {
+                ns = 1;
+            }
+            unittest_printf_critical("    %-8s %7zu bytes: %6llu MB/s\n", impls[n].name, sizes[s],
+                                     (unsigned long long)(reps * sizes[s] * 1000ull / ns));
+        }
+    }
+    free(buf);
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(inet_checksum_tests)
+RUN_TEST(checksum_matches_reference)
+RUN_TEST(checksum_all_ones)
+RUN_TEST_PERFORMANCE(checksum_benchmark)
+END_TEST_CASE(inet_checksum_tests)
+
+int main(int argc, char** argv) {
+    return unittest_run_all_tests(argc, argv) ? 0 : -1;
+}
@@ -0,0 +1,91 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <merkle/digest.h>
+#include <merkle/tree.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <magenta/new.h>
+#include <magenta/status.h>
+#include <magenta/syscalls.h>
+#include <mxtl/unique_ptr.h>
+#include <unittest/unittest.h>
+
+// These benchmarks compare the ways of building a Merkle tree: Create, which
+// has all the data up front and hashes the leaves on several threads, and
+// CreateInit/CreateUpdate/CreateFinal, which stream the data through one.
+
+namespace {
+
+using merkle::Tree;
+using merkle::Digest;
+
+constexpr size_t kMB = 1 << 20;
+constexpr int kRounds = 4;
+
+void time_end(const char* str, uint64_t start, size_t len) {
+    uint64_t ticks = mx_ticks_get() - start;
+    uint64_t ticks_per_msec = mx_ticks_per_second() / 1000;
+    uint64_t msec = ticks / ticks_per_msec;
+    printf("Benchmark %-16s: [%8lu] msec, [%6lu] MB/s\n", str, msec,
+           msec == 0 ? 0 : (len / kMB) * 1000 / msec);
+}
+
+template <size_t DataSize>
+bool BenchmarkCreateVerify(void) {
+    BEGIN_TEST;
+    printf("\nBenchmarking Merkle tree of %lu MB\n", DataSize / kMB);
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[DataSize]);
+    ASSERT_TRUE(ac.check(), "");
+    size_t tree_len = Tree::GetTreeLength(DataSize);
+    mxtl::unique_ptr<uint8_t[]> tree(new (&ac) uint8_t[tree_len]);
+    ASSERT_TRUE(ac.check(), "");
+    for (size_t i = 0; i < DataSize; ++i) {
+        data[i] = static_cast<uint8_t>(rand());
+    }
+
+    Tree merkleTree;
+    Digest streamed;
+    mx_status_t rc;
+    uint64_t start = mx_ticks_get();
+    for (int i = 0; i < kRounds; ++i) {
+        rc = merkleTree.CreateInit(DataSize, tree.get(), tree_len);
+        ASSERT_EQ(rc, NO_ERROR, mx_status_get_string(rc));
+        rc = merkleTree.CreateUpdate(data.get(), DataSize, tree.get());
+        ASSERT_EQ(rc, NO_ERROR, mx_status_get_string(rc));
+        rc = merkleTree.CreateFinal(tree.get(), &streamed);
+        ASSERT_EQ(rc, NO_ERROR, mx_status_get_string(rc));
+    }
+    time_end("streamed create", start, DataSize * kRounds);
+
+    Digest digest;
+    start = mx_ticks_get();
+    for (int i = 0; i < kRounds; ++i) {
+        rc = merkleTree.Create(data.get(), DataSize, tree.get(), tree_len,
+                               &digest);
+        ASSERT_EQ(rc, NO_ERROR, mx_status_get_string(rc));
+    }
+    time_end("create", start, DataSize * kRounds);
+    ASSERT_TRUE(digest == streamed, "Root digests differ");
+
+    start = mx_ticks_get();
+    for (int i = 0; i < kRounds; ++i) {
+        rc = merkleTree.Verify(data.get(), DataSize, tree.get(), tree_len, 0,
+                               DataSize, digest);
+        ASSERT_EQ(rc, NO_ERROR, mx_status_get_string(rc));
+    }
+    time_end("verify", start, DataSize * kRounds);
+    END_TEST;
+}
+
+} // namespace
+
+BEGIN_TEST_CASE(MerkleTreeBenchmarks)
+RUN_TEST_PERFORMANCE(BenchmarkCreateVerify<1 * kMB>)
+RUN_TEST_PERFORMANCE(BenchmarkCreateVerify<16 * kMB>)
+RUN_TEST_PERFORMANCE(BenchmarkCreateVerify<64 * kMB>)
+END_TEST_CASE(MerkleTreeBenchmarks)
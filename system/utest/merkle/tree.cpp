@@ -10,6 +10,8 @@
 #include <magenta/assert.h>
 #include <magenta/new.h>
 #include <magenta/status.h>
+#include <mxtl/algorithm.h>
+#include <mxtl/unique_ptr.h>
 #include <unittest/unittest.h>
 
 namespace {
@@ -435,6 +437,38 @@ bool CreateDataUnaligned(void) {
     END_TEST;
 }
 
+bool CreateMatchesStreaming(void) {
+    BEGIN_TEST;
+    // Big enough for Create to split the leaves between threads, and with a
+    // partial node on the end.
+    InitData(kNodeSize * 1000 + 1234);
+    for (size_t i = 0; i < gDataLen; ++i) {
+        gData[i] = static_cast<uint8_t>(rand());
+    }
+    Tree merkleTree;
+    size_t tree_len = merkleTree.GetTreeLength(gDataLen);
+    mx_status_t rc =
+        merkleTree.Create(gData, gDataLen, gTree, tree_len, &gDigest);
+    ASSERT_EQ(rc, NO_ERROR, mx_status_get_string(rc));
+
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> tree(new (&ac) uint8_t[tree_len]);
+    ASSERT_TRUE(ac.check(), "");
+    Digest digest;
+    rc = merkleTree.CreateInit(gDataLen, tree.get(), tree_len);
+    ASSERT_EQ(rc, NO_ERROR, mx_status_get_string(rc));
+    for (size_t i = 0; i < gDataLen; i += 5000) {
+        rc = merkleTree.CreateUpdate(gData + i, mxtl::min(gDataLen - i, static_cast<size_t>(5000)),
+                                     tree.get());
+        ASSERT_EQ(rc, NO_ERROR, mx_status_get_string(rc));
+    }
+    rc = merkleTree.CreateFinal(tree.get(), &digest);
+    ASSERT_EQ(rc, NO_ERROR, mx_status_get_string(rc));
+    ASSERT_TRUE(gDigest == digest, "Root digests differ");
+    ASSERT_EQ(memcmp(gTree, tree.get(), tree_len), 0, "Trees differ");
+    END_TEST;
+}
+
 bool SetRanges(void) {
     BEGIN_TEST;
     Tree merkleTree;
@@ -537,6 +571,21 @@ bool SetRangesOutOfBounds(void) {
     END_TEST;
 }
 
+bool SetRangesBeforeCreate(void) {
+    BEGIN_TEST;
+    Tree merkleTree;
+    InitData(kLarge);
+    mx_status_t rc = merkleTree.SetRanges(gDataLen, gOffset, gLength);
+    ASSERT_EQ(rc, NO_ERROR, mx_status_get_string(rc));
+    const auto& ranges = merkleTree.ranges();
+    ASSERT_EQ(ranges.size(), 2, "number of ranges");
+    ASSERT_EQ(ranges[0].offset, 0, "offset 0");
+    ASSERT_EQ(ranges[0].length, kNodeSize, "length 0");
+    ASSERT_EQ(ranges[1].offset, kNodeSize * 2, "offset 1");
+    ASSERT_EQ(ranges[1].length, kNodeSize, "length 1");
+    END_TEST;
+}
+
 bool Verify(void) {
     BEGIN_TEST;
     Tree merkleTree;
@@ -1006,12 +1055,14 @@ RUN_TEST(CreateMissingData)
 RUN_TEST(CreateMissingTree)
 RUN_TEST(CreateTreeTooSmall)
 RUN_TEST(CreateDataUnaligned)
+RUN_TEST(CreateMatchesStreaming)
 RUN_TEST(SetRanges)
 RUN_TEST(SetRangesEmpty)
 RUN_TEST(SetRangesFull)
 RUN_TEST(SetRangesUnalignedOffset)
 RUN_TEST(SetRangesUnalignedLength)
 RUN_TEST(SetRangesOutOfBounds)
+RUN_TEST(SetRangesBeforeCreate)
 RUN_TEST(Verify)
 RUN_TEST(VerifyCWrapper)
 RUN_TEST(VerifyNodeByNode)
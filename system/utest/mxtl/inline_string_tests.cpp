@@ -0,0 +1,154 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string.h>
+
+#include <magenta/new.h>
+#include <mxtl/inline_string.h>
+#include <mxtl/type_support.h>
+#include <unittest/unittest.h>
+
+namespace {
+
+// Hands out storage from a fixed buffer and never reuses it, the way a
+// per-request arena would.
+struct ArenaAllocator {
+    static void* Allocate(size_t bytes, AllocChecker* ac) {
+        bytes = (bytes + 15) & ~static_cast<size_t>(15);
+        if (used_ + bytes > sizeof(buffer_)) {
+            ac->arm(bytes, false);
+            return nullptr;
+        }
+        void* ptr = buffer_ + used_;
+        used_ += bytes;
+        ac->arm(bytes, true);
+        return ptr;
+    }
+    static void Free(void* ptr) { frees_++; }
+
+    alignas(16) static uint8_t buffer_[256];
+    static size_t used_;
+    static size_t frees_;
+};
+
+alignas(16) uint8_t ArenaAllocator::buffer_[256];
+size_t ArenaAllocator::used_;
+size_t ArenaAllocator::frees_;
+
+using ArenaString = mxtl::InlineString<7, ArenaAllocator>;
+
+bool inline_test() {
+    BEGIN_TEST;
+
+    mxtl::String str;
+    EXPECT_TRUE(str.is_empty(), "");
+    EXPECT_STR_EQ("", str.c_str(), sizeof(""), "");
+    EXPECT_EQ(31u, str.capacity(), "");
+
+    AllocChecker ac;
+    str.Set("sys", &ac);
+    EXPECT_TRUE(ac.check(), "");
+    str.Append("/platform", &ac);
+    EXPECT_TRUE(ac.check(), "");
+    EXPECT_STR_EQ("sys/platform", str.c_str(), sizeof("sys/platform"), "");
+    EXPECT_EQ(12u, str.length(), "");
+    EXPECT_EQ(31u, str.capacity(), "still inline");
+    EXPECT_TRUE(str == mxtl::StringPiece("sys/platform"), "");
+    EXPECT_EQ('/', str[3], "");
+
+    mxtl::String moved(mxtl::move(str));
+    EXPECT_STR_EQ("sys/platform", moved.c_str(), sizeof("sys/platform"), "");
+    EXPECT_TRUE(str.is_empty(), "");
+    EXPECT_STR_EQ("", str.c_str(), sizeof(""), "");
+
+    moved.clear();
+    EXPECT_TRUE(moved.is_empty(), "");
+    EXPECT_STR_EQ("", moved.c_str(), sizeof(""), "");
+
+    END_TEST;
+}
+
+bool heap_test() {
+    BEGIN_TEST;
+
+    ArenaAllocator::used_ = 0;
+    ArenaAllocator::frees_ = 0;
+    {
+        ArenaString str;
+        AllocChecker ac;
+        str.Set("abcdefg", &ac);
+        EXPECT_TRUE(ac.check(), "");
+        EXPECT_EQ(0u, ArenaAllocator::used_, "seven fit inline");
+
+        str.Append("h", &ac);
+        EXPECT_TRUE(ac.check(), "");
+        EXPECT_STR_EQ("abcdefgh", str.c_str(), sizeof("abcdefgh"), "");
+        EXPECT_EQ(14u, str.capacity(), "doubled");
+        EXPECT_NEQ(0u, ArenaAllocator::used_, "");
+
+        // Appending the string to itself, across a grow.
+        str.Append(str, &ac);
+        EXPECT_TRUE(ac.check(), "");
+        EXPECT_STR_EQ("abcdefghabcdefgh", str.c_str(), sizeof("abcdefghabcdefgh"), "");
+        EXPECT_EQ(1u, ArenaAllocator::frees_, "");
+
+        // Setting from a piece of itself, without a grow.
+        str.Set(mxtl::StringPiece(str.data() + 4, 4), &ac);
+        EXPECT_TRUE(ac.check(), "");
+        EXPECT_STR_EQ("efgh", str.c_str(), sizeof("efgh"), "");
+
+        // Heap storage changes hands on a move.
+        size_t used = ArenaAllocator::used_;
+        ArenaString moved;
+        moved = mxtl::move(str);
+        EXPECT_STR_EQ("efgh", moved.c_str(), sizeof("efgh"), "");
+        EXPECT_EQ(used, ArenaAllocator::used_, "");
+        EXPECT_EQ(7u, str.capacity(), "");
+
+        // Running the arena dry leaves the string alone.
+        ArenaAllocator::used_ = sizeof(ArenaAllocator::buffer_);
+        moved.Append("0123456789abcdef0123456789abcdef", &ac);
+        EXPECT_FALSE(ac.check(), "");
+        EXPECT_STR_EQ("efgh", moved.c_str(), sizeof("efgh"), "");
+
+        moved.reset();
+        EXPECT_EQ(2u, ArenaAllocator::frees_, "");
+        EXPECT_EQ(7u, moved.capacity(), "");
+    }
+    EXPECT_EQ(2u, ArenaAllocator::frees_, "");
+
+    END_TEST;
+}
+
+bool build_test() {
+    BEGIN_TEST;
+
+    // Piece by piece growth keeps doubling rather than growing by the
+    // appended length.
+    mxtl::String path;
+    size_t grows = 0;
+    size_t capacity = path.capacity();
+    for (int i = 0; i < 100; i++) {
+        AllocChecker ac;
+        path.Append("/dir", &ac);
+        ASSERT_TRUE(ac.check(), "");
+        if (path.capacity() != capacity) {
+            grows++;
+            capacity = path.capacity();
+        }
+    }
+    EXPECT_EQ(400u, path.length(), "");
+    EXPECT_EQ(400u, strlen(path.c_str()), "");
+    EXPECT_LE(grows, 4u, "");
+
+    END_TEST;
+}
+
+}  // namespace
+
+BEGIN_TEST_CASE(inline_string_tests)
+RUN_NAMED_TEST("inline storage", inline_test)
+RUN_NAMED_TEST("heap storage", heap_test)
+RUN_NAMED_TEST("appending", build_test)
+END_TEST_CASE(inline_string_tests);
@@ -138,6 +138,10 @@ public:
     static void RecordEraseRotation()           { ++op_counts_.erase_rotations_; }
     static void RecordEraseDoubleRotation()     { ++op_counts_.erase_double_rotations_; }
 
+    static constexpr bool kRecordSubtreeChanges = false;
+    template <typename RawPtrType>
+    static void RecordSubtreeChanged(RawPtrType node) { }
+
     template <typename TreeType>
     static bool VerifyRankRule(const TreeType& tree, typename TreeType::RawPtrType node) {
         BEGIN_TEST;
@@ -421,6 +425,118 @@ static bool WAVLBalanceTest() {
     END_TEST;
 }
 
+// Objects for the augmentation test keep the number of nodes in the subtree
+// they root, maintained by the observer below.
+class AugmentedTestObj {
+public:
+    void Init(BalanceTestKeyType val) { key_ = val; }
+    BalanceTestKeyType GetKey() const { return key_; }
+    size_t subtree_size() const { return subtree_size_; }
+    bool InContainer() const { return wavl_node_state_.InContainer(); }
+
+private:
+    friend DefaultWAVLTreeTraits<AugmentedTestObj*>;
+    friend struct WAVLAugmentedTestObserver;
+
+    BalanceTestKeyType key_;
+    size_t subtree_size_ = 0;
+    WAVLTreeNodeState<AugmentedTestObj*> wavl_node_state_;
+};
+
+struct WAVLAugmentedTestObserver : public DefaultWAVLTreeObserver {
+    using PtrTraits = ::mxtl::internal::ContainerPtrTraits<AugmentedTestObj*>;
+
+    static constexpr bool kRecordSubtreeChanges = true;
+
+    static size_t SubtreeSize(AugmentedTestObj* node) {
+        return PtrTraits::IsValid(node) ? node->subtree_size_ : 0;
+    }
+
+    static void RecordSubtreeChanged(AugmentedTestObj* node) {
+        node->subtree_size_ = 1 + SubtreeSize(node->wavl_node_state_.left_)
+                                + SubtreeSize(node->wavl_node_state_.right_);
+    }
+
+    // Recount the subtree rooted at node from scratch, returning false if any
+    // node's recorded size is wrong.
+    static bool Verify(AugmentedTestObj* node, size_t* count) {
+        if (!PtrTraits::IsValid(node)) {
+            *count = 0;
+            return true;
+        }
+        size_t left, right;
+        if (!Verify(node->wavl_node_state_.left_, &left) ||
+            !Verify(node->wavl_node_state_.right_, &right))
+            return false;
+        *count = 1 + left + right;
+        return node->subtree_size_ == *count;
+    }
+};
+
+using AugmentedTestTree = WAVLTree<BalanceTestKeyType,
+                                   AugmentedTestObj*,
+                                   DefaultKeyedObjectTraits<BalanceTestKeyType, AugmentedTestObj>,
+                                   DefaultWAVLTreeTraits<AugmentedTestObj*>,
+                                   WAVLAugmentedTestObserver>;
+
+static bool VerifyAugmentedTree(const AugmentedTestTree& tree, AugmentedTestObj* root) {
+    BEGIN_TEST;
+
+    size_t count;
+    ASSERT_TRUE(WAVLAugmentedTestObserver::Verify(root, &count), "stale subtree size");
+    ASSERT_EQ(tree.size(), count, "");
+
+    END_TEST;
+}
+
+static bool WAVLAugmentedTest() {
+    BEGIN_TEST;
+
+    static constexpr size_t kAugmentedTestSize = 512;
+
+    unique_ptr<AugmentedTestObj[]> objects;
+    {
+        AllocChecker ac;
+        objects.reset(new (&ac) AugmentedTestObj[kAugmentedTestSize]);
+        ASSERT_TRUE(ac.check(), "Failed to allocate test objects!");
+    }
+
+    Lfsr<BalanceTestKeyType> rng;
+    rng.SetCore(0x5a17c0de1234abcdu);
+    for (size_t i = 0; i < kAugmentedTestSize; ++i)
+        objects[i].Init(rng.GetNext());
+
+    // The root of the tree is the node whose subtree holds everything.
+    auto root = [&](const AugmentedTestTree& tree) -> AugmentedTestObj* {
+        for (auto& obj : tree) {
+            if (obj.subtree_size() == tree.size())
+                return const_cast<AugmentedTestObj*>(&obj);
+        }
+        return nullptr;
+    };
+
+    AugmentedTestTree tree;
+    for (size_t i = 0; i < kAugmentedTestSize; ++i) {
+        ASSERT_TRUE(tree.insert_or_find(&objects[i]), "");
+        ASSERT_TRUE(VerifyAugmentedTree(tree, root(tree)), "");
+    }
+
+    // Erase every other object, which exercises erasing nodes with two
+    // children, then the rest.
+    for (size_t i = 0; i < kAugmentedTestSize; i += 2) {
+        ASSERT_EQ(&objects[i], tree.erase(objects[i]), "");
+        ASSERT_TRUE(VerifyAugmentedTree(tree, root(tree)), "");
+    }
+    for (size_t i = 1; i < kAugmentedTestSize; i += 2) {
+        ASSERT_EQ(&objects[i], tree.erase(objects[i]), "");
+        if (tree.size())
+            ASSERT_TRUE(VerifyAugmentedTree(tree, root(tree)), "");
+    }
+    ASSERT_EQ(0u, tree.size(), "");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(wavl_tree_tests)
 //////////////////////////////////////////
 // General container specific tests.
@@ -540,6 +656,7 @@ RUN_NAMED_TEST("LowerBound (RefPtr)",            RPTE::LowerBoundTest)
 // WAVLTree specific tests.
 ////////////////////////////
 RUN_NAMED_TEST("BalanceTest", WAVLBalanceTest)
+RUN_NAMED_TEST("AugmentedTest", WAVLAugmentedTest)
 
 END_TEST_CASE(wavl_tree_tests);
 
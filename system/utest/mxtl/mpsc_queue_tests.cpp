@@ -0,0 +1,128 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <threads.h>
+
+#include <magenta/new.h>
+#include <mxtl/mpsc_queue.h>
+#include <mxtl/unique_ptr.h>
+#include <unittest/unittest.h>
+
+namespace {
+
+struct Item : public mxtl::MpscQueueable<Item> {
+    size_t producer = 0;
+    size_t seq = 0;
+    // Written before the push, checked after the pop.
+    size_t payload = 0;
+};
+
+bool basic_test() {
+    BEGIN_TEST;
+
+    mxtl::MpscQueue<Item> queue;
+    EXPECT_TRUE(queue.is_empty(), "");
+    EXPECT_NULL(queue.pop(), "");
+
+    Item items[3];
+    for (auto& item : items)
+        queue.push(&item);
+    EXPECT_FALSE(queue.is_empty(), "");
+    for (auto& item : items)
+        EXPECT_EQ(&item, queue.pop(), "");
+    EXPECT_NULL(queue.pop(), "");
+    EXPECT_TRUE(queue.is_empty(), "");
+
+    // Interleaved, so the queue keeps running down to its last element.
+    for (auto& item : items) {
+        queue.push(&item);
+        EXPECT_EQ(&item, queue.pop(), "");
+        EXPECT_TRUE(queue.is_empty(), "");
+    }
+    queue.push(&items[0]);
+    queue.push(&items[1]);
+    EXPECT_EQ(&items[0], queue.pop(), "");
+    queue.push(&items[2]);
+    EXPECT_EQ(&items[1], queue.pop(), "");
+    EXPECT_EQ(&items[2], queue.pop(), "");
+    EXPECT_TRUE(queue.is_empty(), "");
+
+    END_TEST;
+}
+
+constexpr size_t kProducers = 4;
+constexpr size_t kPerProducer = 100000;
+
+struct Producer {
+    mxtl::MpscQueue<Item>* queue;
+    Item* items;
+    size_t id;
+};
+
+int producer(void* arg) {
+    Producer* p = static_cast<Producer*>(arg);
+    for (size_t i = 0; i < kPerProducer; i++) {
+        Item* item = &p->items[i];
+        item->producer = p->id;
+        item->seq = i;
+        item->payload = p->id * kPerProducer + i;
+        p->queue->push(item);
+    }
+    return 0;
+}
+
+bool threads_test() {
+    BEGIN_TEST;
+
+    AllocChecker ac;
+    mxtl::unique_ptr<Item[]> items(new (&ac) Item[kProducers * kPerProducer]);
+    ASSERT_TRUE(ac.check(), "");
+
+    mxtl::MpscQueue<Item> queue;
+    Producer producers[kProducers];
+    thrd_t threads[kProducers];
+    for (size_t i = 0; i < kProducers; i++) {
+        producers[i] = Producer{ &queue, &items[i * kPerProducer], i };
+        ASSERT_EQ(thrd_success, thrd_create(&threads[i], producer, &producers[i]), "");
+    }
+
+    // Every producer's items come out in the order it pushed them, and with
+    // everything it wrote before the push visible.
+    size_t next_seq[kProducers] = {};
+    size_t popped = 0;
+    bool ok = true;
+    while (popped < kProducers * kPerProducer) {
+        Item* item = queue.pop();
+        if (item == nullptr) {
+            thrd_yield();
+            continue;
+        }
+        if (item->producer >= kProducers ||
+            item->seq != next_seq[item->producer] ||
+            item->payload != item->producer * kPerProducer + item->seq) {
+            ok = false;
+            break;
+        }
+        next_seq[item->producer]++;
+        popped++;
+    }
+    EXPECT_TRUE(ok, "items out of order or not published");
+
+    for (size_t i = 0; i < kProducers; i++)
+        thrd_join(threads[i], nullptr);
+
+    // Drain whatever is left if we bailed out early.
+    while (!queue.is_empty())
+        queue.pop();
+    EXPECT_EQ(kProducers * kPerProducer, popped, "");
+
+    END_TEST;
+}
+
+}  // namespace
+
+BEGIN_TEST_CASE(mpsc_queue_tests)
+RUN_NAMED_TEST("basic", basic_test)
+RUN_NAMED_TEST("producer threads", threads_test)
+END_TEST_CASE(mpsc_queue_tests);
@@ -0,0 +1,168 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <magenta/new.h>
+#include <magenta/syscalls.h>
+#include <mxtl/intrusive_resizable_hash_table.h>
+#include <mxtl/intrusive_single_list.h>
+#include <mxtl/open_hash_map.h>
+#include <mxtl/unique_ptr.h>
+#include <unittest/unittest.h>
+
+namespace {
+
+using PtrMap = mxtl::OpenHashMap<const void*, uint32_t>;
+
+const void* KeyFor(size_t n) {
+    // Aligned like real object pointers, so the low bits are all zero.
+    return reinterpret_cast<const void*>((n + 1) * 64);
+}
+
+bool basic_test() {
+    BEGIN_TEST;
+
+    PtrMap map;
+    EXPECT_TRUE(map.is_empty(), "");
+    EXPECT_EQ(0u, map.capacity(), "");
+    EXPECT_NULL(map.find(KeyFor(0)), "");
+    EXPECT_FALSE(map.erase(KeyFor(0)), "");
+
+    constexpr size_t kCount = 1000;
+    for (size_t i = 0; i < kCount; i++) {
+        AllocChecker ac;
+        EXPECT_TRUE(map.insert(KeyFor(i), static_cast<uint32_t>(i), &ac), "");
+        EXPECT_TRUE(ac.check(), "");
+    }
+    EXPECT_EQ(kCount, map.size(), "");
+    EXPECT_LE(map.size() * 4, map.capacity() * 3, "");
+
+    // Duplicates are refused and leave the value alone.
+    AllocChecker ac;
+    EXPECT_FALSE(map.insert(KeyFor(10), 12345u, &ac), "");
+    EXPECT_TRUE(ac.check(), "");
+
+    for (size_t i = 0; i < kCount; i++) {
+        const uint32_t* value = map.find(KeyFor(i));
+        ASSERT_NONNULL(value, "");
+        EXPECT_EQ(i, *value, "");
+    }
+    EXPECT_NULL(map.find(KeyFor(kCount)), "");
+
+    size_t sum = 0;
+    size_t entries = 0;
+    map.for_each([&sum, &entries](const void* key, uint32_t value) {
+        sum += value;
+        entries++;
+    });
+    EXPECT_EQ(kCount, entries, "");
+    EXPECT_EQ(kCount * (kCount - 1) / 2, sum, "");
+
+    size_t capacity = map.capacity();
+    map.clear();
+    EXPECT_TRUE(map.is_empty(), "");
+    EXPECT_EQ(capacity, map.capacity(), "");
+    EXPECT_NULL(map.find(KeyFor(1)), "");
+
+    END_TEST;
+}
+
+// Mixes inserts and erases over a small key space, so that probe sequences
+// wrap and get broken up, and checks the map against a plain array.
+bool erase_test() {
+    BEGIN_TEST;
+
+    constexpr size_t kKeys = 300;
+    bool present[kKeys] = {};
+    mxtl::OpenHashMap<uint32_t, uint32_t> map;
+
+    uint32_t state = 1;
+    for (int op = 0; op < 20000; op++) {
+        state = state * 1103515245u + 12345u;
+        size_t n = (state >> 8) % kKeys;
+        uint32_t key = static_cast<uint32_t>(n + 1);
+        if ((state >> 24) & 1) {
+            AllocChecker ac;
+            EXPECT_EQ(!present[n], map.insert(key, key * 3, &ac), "");
+            ASSERT_TRUE(ac.check(), "");
+            present[n] = true;
+        } else {
+            EXPECT_EQ(present[n], map.erase(key), "");
+            present[n] = false;
+        }
+
+        if (op % 1000 == 0) {
+            size_t count = 0;
+            for (size_t i = 0; i < kKeys; i++) {
+                const uint32_t* value = map.find(static_cast<uint32_t>(i + 1));
+                EXPECT_EQ(present[i], value != nullptr, "");
+                if (value != nullptr) {
+                    EXPECT_EQ((i + 1) * 3, *value, "");
+                    count++;
+                }
+            }
+            EXPECT_EQ(count, map.size(), "");
+        }
+    }
+
+    END_TEST;
+}
+
+class TestObj : public mxtl::SinglyLinkedListable<TestObj*> {
+public:
+    const void* GetKey() const { return key_; }
+    void SetKey(const void* key) { key_ = key; }
+    static size_t GetHash(const void* key) { return reinterpret_cast<uintptr_t>(key); }
+
+private:
+    const void* key_ = nullptr;
+};
+
+bool open_hash_map_benchmark() {
+    BEGIN_TEST;
+
+    constexpr size_t kCount = 100000;
+    constexpr size_t kLookups = 1000000;
+
+    PtrMap map;
+    mxtl::ResizableHashTable<const void*, TestObj*> table;
+    AllocChecker objs_ac;
+    mxtl::unique_ptr<TestObj[]> objs(new (&objs_ac) TestObj[kCount]);
+    ASSERT_TRUE(objs_ac.check(), "");
+    for (size_t i = 0; i < kCount; i++) {
+        AllocChecker ac;
+        ASSERT_TRUE(map.insert(KeyFor(i), static_cast<uint32_t>(i), &ac), "");
+        ASSERT_TRUE(ac.check(), "");
+        objs[i].SetKey(KeyFor(i));
+        table.insert(&objs[i]);
+    }
+
+    uint32_t sum = 0;
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    for (size_t i = 0; i < kLookups; i++)
+        sum += *map.find(KeyFor((i * 7919) % kCount));
+    mx_time_t map_ns = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+
+    start = mx_time_get(MX_CLOCK_MONOTONIC);
+    for (size_t i = 0; i < kLookups; i++)
+        sum -= static_cast<uint32_t>(
+            reinterpret_cast<uintptr_t>(table.find(KeyFor((i * 7919) % kCount))->GetKey()) / 64 - 1);
+    mx_time_t table_ns = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+    EXPECT_EQ(0u, sum, "");
+
+    unittest_printf_critical("\n    %zu entries: open map %llu ns/lookup, chained table %llu ns/lookup\n",
+                             kCount,
+                             (unsigned long long)(map_ns / kLookups),
+                             (unsigned long long)(table_ns / kLookups));
+    table.clear();
+
+    END_TEST;
+}
+
+}  // namespace
+
+BEGIN_TEST_CASE(open_hash_map_tests)
+RUN_NAMED_TEST("basic", basic_test)
+RUN_NAMED_TEST("erase", erase_test)
+RUN_TEST_PERFORMANCE(open_hash_map_benchmark)
+END_TEST_CASE(open_hash_map_tests);
@@ -0,0 +1,61 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <threads.h>
+
+#include <mxtl/per_cpu_counter.h>
+#include <unittest/unittest.h>
+
+namespace {
+
+mxtl::PerCpuCounter counter;
+
+bool basic_test() {
+    BEGIN_TEST;
+
+    counter.Reset();
+    EXPECT_EQ(0, counter.value(), "");
+    counter.Inc();
+    counter.Inc();
+    counter.Dec();
+    counter.Add(41);
+    EXPECT_EQ(42, counter.value(), "");
+    counter.Reset();
+    EXPECT_EQ(0, counter.value(), "");
+
+    END_TEST;
+}
+
+constexpr int kThreads = 8;
+constexpr int kAdds = 100000;
+
+int adder(void* arg) {
+    for (int i = 0; i < kAdds; i++)
+        counter.Add(3);
+    counter.Add(-static_cast<int64_t>(kAdds));
+    return 0;
+}
+
+bool threads_test() {
+    BEGIN_TEST;
+
+    counter.Reset();
+    thrd_t threads[kThreads];
+    for (int i = 0; i < kThreads; i++)
+        ASSERT_EQ(thrd_success, thrd_create(&threads[i], adder, nullptr), "");
+    for (int i = 0; i < kThreads; i++)
+        thrd_join(threads[i], nullptr);
+
+    // No adds are lost, whichever shards the threads ended up on.
+    EXPECT_EQ(static_cast<int64_t>(kThreads) * kAdds * 2, counter.value(), "");
+
+    END_TEST;
+}
+
+}  // namespace
+
+BEGIN_TEST_CASE(per_cpu_counter_tests)
+RUN_NAMED_TEST("basic", basic_test)
+RUN_NAMED_TEST("concurrent adds", threads_test)
+END_TEST_CASE(per_cpu_counter_tests);
@@ -0,0 +1,230 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <magenta/new.h>
+#include <magenta/syscalls.h>
+#include <mxtl/intrusive_double_list.h>
+#include <mxtl/intrusive_hash_table.h>
+#include <mxtl/intrusive_resizable_hash_table.h>
+#include <mxtl/intrusive_single_list.h>
+#include <mxtl/unique_ptr.h>
+#include <unittest/unittest.h>
+
+namespace {
+
+class TestObj : public mxtl::SinglyLinkedListable<TestObj*> {
+public:
+    explicit TestObj(size_t key) : key_(key) {}
+
+    size_t GetKey() const { return key_; }
+    // A deliberately poor hash, which the table has to spread out itself.
+    static size_t GetHash(size_t key) { return key << 8; }
+
+    size_t key_;
+    bool visited_ = false;
+};
+
+using Table = mxtl::ResizableHashTable<size_t, TestObj*>;
+
+class ManagedObj : public mxtl::DoublyLinkedListable<mxtl::unique_ptr<ManagedObj>> {
+public:
+    explicit ManagedObj(size_t key) : key_(key) { ++live_count_; }
+    ~ManagedObj() { --live_count_; }
+
+    size_t GetKey() const { return key_; }
+    static size_t GetHash(size_t key) { return key; }
+
+    static size_t live_count_;
+
+private:
+    size_t key_;
+};
+
+size_t ManagedObj::live_count_ = 0;
+
+using ManagedTable = mxtl::ResizableHashTable<size_t, mxtl::unique_ptr<ManagedObj>,
+                                              mxtl::DoublyLinkedList<mxtl::unique_ptr<ManagedObj>>>;
+
+constexpr size_t kCount = 10000;
+
+bool MakeObjs(TestObj** objs, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        AllocChecker ac;
+        objs[i] = new (&ac) TestObj(i * 7 + 1);
+        if (!ac.check())
+            return false;
+    }
+    return true;
+}
+
+void FreeObjs(TestObj** objs, size_t count) {
+    for (size_t i = 0; i < count; i++)
+        delete objs[i];
+}
+
+bool grow_test() {
+    BEGIN_TEST;
+
+    mxtl::unique_ptr<TestObj*[]> objs(new TestObj*[kCount]);
+    ASSERT_TRUE(MakeObjs(objs.get(), kCount), "");
+
+    Table table;
+    EXPECT_EQ(Table::kInitialBuckets, table.bucket_count(), "");
+    for (size_t i = 0; i < kCount; i++) {
+        table.insert(objs[i]);
+
+        // Everything inserted so far has to be found, whichever array it is in.
+        size_t probe = (i * 31) % (i + 1);
+        auto iter = table.find(objs[probe]->GetKey());
+        ASSERT_TRUE(iter.IsValid(), "");
+        EXPECT_EQ(objs[probe], &(*iter), "");
+    }
+    EXPECT_EQ(kCount, table.size(), "");
+    EXPECT_GE(table.bucket_count(), kCount / 2, "");
+    EXPECT_FALSE(table.find(0).IsValid(), "");
+
+    // Each element is visited exactly once.
+    size_t visited = 0;
+    for (auto& obj : table) {
+        EXPECT_FALSE(obj.visited_, "");
+        obj.visited_ = true;
+        visited++;
+    }
+    EXPECT_EQ(kCount, visited, "");
+
+    for (size_t i = 0; i < kCount; i += 2)
+        EXPECT_EQ(objs[i], table.erase(objs[i]->GetKey()), "");
+    for (size_t i = 0; i < kCount; i++)
+        EXPECT_EQ(i & 1, table.find(objs[i]->GetKey()).IsValid() ? 1u : 0u, "");
+
+    // Erasing doesn't move other elements, so it is fine while iterating.
+    for (auto iter = table.begin(); iter.IsValid(); )
+        EXPECT_NONNULL(table.erase(iter++), "");
+    EXPECT_TRUE(table.is_empty(), "");
+
+    table.clear();
+    EXPECT_EQ(Table::kInitialBuckets, table.bucket_count(), "");
+
+    FreeObjs(objs.get(), kCount);
+    END_TEST;
+}
+
+bool insert_or_find_test() {
+    BEGIN_TEST;
+
+    mxtl::unique_ptr<TestObj*[]> objs(new TestObj*[kCount]);
+    ASSERT_TRUE(MakeObjs(objs.get(), kCount), "");
+
+    Table table;
+    for (size_t i = 0; i < kCount; i++) {
+        Table::iterator iter;
+        EXPECT_TRUE(table.insert_or_find(objs[i], &iter), "");
+        EXPECT_EQ(objs[i], &(*iter), "");
+    }
+    EXPECT_GT(table.bucket_count(), Table::kInitialBuckets, "");
+
+    TestObj dup(objs[kCount / 2]->GetKey());
+    Table::iterator iter;
+    EXPECT_FALSE(table.insert_or_find(&dup, &iter), "");
+    EXPECT_EQ(objs[kCount / 2], &(*iter), "");
+
+    size_t visited = 0;
+    for (auto it = table.begin(); it != table.end(); ++it)
+        visited++;
+    EXPECT_EQ(kCount, visited, "");
+
+    table.clear();
+    FreeObjs(objs.get(), kCount);
+    END_TEST;
+}
+
+bool managed_test() {
+    BEGIN_TEST;
+
+    {
+        ManagedTable table;
+        for (size_t i = 0; i < kCount; i++) {
+            AllocChecker ac;
+            mxtl::unique_ptr<ManagedObj> obj(new (&ac) ManagedObj(i));
+            ASSERT_TRUE(ac.check(), "");
+            table.insert(mxtl::move(obj));
+        }
+        EXPECT_EQ(kCount, ManagedObj::live_count_, "");
+
+        auto obj = table.erase(kCount - 1);
+        EXPECT_NONNULL(obj, "");
+        obj.reset();
+        EXPECT_EQ(kCount - 1, ManagedObj::live_count_, "");
+        EXPECT_EQ(kCount - 1, table.size(), "");
+
+        // Doubly linked buckets can be walked backwards as well.
+        size_t visited = 0;
+        auto iter = table.end();
+        for (--iter; iter.IsValid(); --iter)
+            visited++;
+        EXPECT_EQ(kCount - 1, visited, "");
+    }
+    // The table released everything it still held.
+    EXPECT_EQ(0u, ManagedObj::live_count_, "");
+
+    END_TEST;
+}
+
+constexpr size_t kBenchCount = 100000;
+
+using FixedTable = mxtl::HashTable<size_t, TestObj*>;
+
+template <typename T>
+bool RunBenchmark(const char* name, TestObj** objs) {
+    T table;
+
+    mx_time_t max_insert = 0;
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    for (size_t i = 0; i < kBenchCount; i++) {
+        mx_time_t before = mx_time_get(MX_CLOCK_MONOTONIC);
+        table.insert(objs[i]);
+        mx_time_t took = mx_time_get(MX_CLOCK_MONOTONIC) - before;
+        if (took > max_insert)
+            max_insert = took;
+    }
+    mx_time_t insert_ns = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+
+    start = mx_time_get(MX_CLOCK_MONOTONIC);
+    for (size_t i = 0; i < kBenchCount; i++) {
+        if (!table.find(objs[(i * 7919) % kBenchCount]->GetKey()).IsValid())
+            return false;
+    }
+    mx_time_t find_ns = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+
+    unittest_printf_critical("    %-10s insert %6llu ns/op (max %7llu ns), find %6llu ns/op\n",
+                             name,
+                             (unsigned long long)(insert_ns / kBenchCount),
+                             (unsigned long long)max_insert,
+                             (unsigned long long)(find_ns / kBenchCount));
+    table.clear();
+    return true;
+}
+
+bool resizable_hash_table_benchmark() {
+    BEGIN_TEST;
+
+    mxtl::unique_ptr<TestObj*[]> objs(new TestObj*[kBenchCount]);
+    ASSERT_TRUE(MakeObjs(objs.get(), kBenchCount), "");
+
+    unittest_printf_critical("\n    %zu elements\n", kBenchCount);
+    EXPECT_TRUE(RunBenchmark<FixedTable>("fixed(37)", objs.get()), "");
+    EXPECT_TRUE(RunBenchmark<Table>("resizable", objs.get()), "");
+
+    FreeObjs(objs.get(), kBenchCount);
+    END_TEST;
+}
+
+}  // namespace
+
+BEGIN_TEST_CASE(resizable_hash_table_tests)
+RUN_NAMED_TEST("grow", grow_test)
+RUN_NAMED_TEST("insert_or_find", insert_or_find_test)
+RUN_NAMED_TEST("managed pointers", managed_test)
+RUN_TEST_PERFORMANCE(resizable_hash_table_benchmark)
+END_TEST_CASE(resizable_hash_table_tests);
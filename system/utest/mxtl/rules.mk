@@ -17,6 +17,7 @@ MODULE_SRCS += \
     $(LOCAL_DIR)/auto_call_tests.cpp \
     $(LOCAL_DIR)/forward_tests.cpp \
     $(LOCAL_DIR)/inline_array_tests.cpp \
+    $(LOCAL_DIR)/inline_string_tests.cpp \
     $(LOCAL_DIR)/intrusive_container_tests.cpp \
     $(LOCAL_DIR)/intrusive_doubly_linked_list_tests.cpp \
     $(LOCAL_DIR)/intrusive_hash_table_dll_tests.cpp \
@@ -24,14 +25,20 @@ MODULE_SRCS += \
     $(LOCAL_DIR)/intrusive_singly_linked_list_tests.cpp \
     $(LOCAL_DIR)/intrusive_wavl_tree_tests.cpp \
     $(LOCAL_DIR)/main.c \
+    $(LOCAL_DIR)/mpsc_queue_tests.cpp \
+    $(LOCAL_DIR)/open_hash_map_tests.cpp \
+    $(LOCAL_DIR)/per_cpu_counter_tests.cpp \
     $(LOCAL_DIR)/recycler_tests.cpp \
     $(LOCAL_DIR)/ref_counted_tests.cpp \
     $(LOCAL_DIR)/ref_ptr_tests.cpp \
+    $(LOCAL_DIR)/resizable_hash_table_tests.cpp \
     $(LOCAL_DIR)/slab_allocator_tests.cpp \
+    $(LOCAL_DIR)/spsc_ring_tests.cpp \
     $(LOCAL_DIR)/string_piece_tests.cpp \
     $(LOCAL_DIR)/type_support_tests.cpp \
     $(LOCAL_DIR)/unique_free_ptr_tests.cpp \
     $(LOCAL_DIR)/unique_ptr_tests.cpp \
+    $(LOCAL_DIR)/vector_tests.cpp \
 
 MODULE_NAME := mxtl-test
 
@@ -218,6 +218,7 @@ bool do_slab_test(typename Traits::AllocatorType& allocator, size_t test_allocs)
         }
 
         EXPECT_EQ(mxtl::min(i + 1, MAX_ALLOCS), TestBase::allocated_obj_count(), "");
+        EXPECT_EQ(mxtl::min(i + 1, MAX_ALLOCS), allocator.obj_count(), "");
     }
 
     // Now remove and de-allocate.
@@ -248,6 +249,9 @@ bool do_slab_test(typename Traits::AllocatorType& allocator, size_t test_allocs)
     }
 
     EXPECT_EQ(mxtl::min(test_allocs, MAX_ALLOCS), i, "");
+    EXPECT_EQ(0u, allocator.obj_count(), "");
+    EXPECT_LE(mxtl::min(test_allocs, MAX_ALLOCS), allocator.max_obj_count(), "");
+    EXPECT_LE(allocator.slab_count(), allocator.max_slabs(), "");
 
     END_TEST;
 }
@@ -377,6 +381,7 @@ bool do_static_slab_test(size_t test_allocs) {
         }
 
         EXPECT_EQ(mxtl::min(i + 1, MAX_ALLOCS), TestBase::allocated_obj_count(), "");
+        EXPECT_EQ(mxtl::min(i + 1, MAX_ALLOCS), AllocatorType::obj_count(), "");
     }
 
     // Now remove and de-allocate.
@@ -407,6 +412,9 @@ bool do_static_slab_test(size_t test_allocs) {
     }
 
     EXPECT_EQ(mxtl::min(test_allocs, MAX_ALLOCS), i, "");
+    EXPECT_EQ(0u, AllocatorType::obj_count(), "");
+    EXPECT_LE(mxtl::min(test_allocs, MAX_ALLOCS), AllocatorType::max_obj_count(), "");
+    EXPECT_LE(AllocatorType::slab_count(), AllocatorType::max_slabs(), "");
     END_TEST;
 }
 
@@ -0,0 +1,94 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <threads.h>
+
+#include <mxtl/spsc_ring.h>
+#include <unittest/unittest.h>
+
+namespace {
+
+bool basic_test() {
+    BEGIN_TEST;
+
+    mxtl::SpscRing<int, 4> ring;
+    EXPECT_TRUE(ring.is_empty(), "");
+    EXPECT_EQ(4u, ring.capacity(), "");
+
+    int value = -1;
+    EXPECT_FALSE(ring.pop(&value), "");
+    EXPECT_EQ(-1, value, "");
+
+    // Wrap around the end of the slots a few times.
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 4; i++)
+            EXPECT_TRUE(ring.push(round * 10 + i), "");
+        EXPECT_FALSE(ring.push(99), "full");
+        EXPECT_EQ(4u, ring.size(), "");
+        for (int i = 0; i < 4; i++) {
+            EXPECT_TRUE(ring.pop(&value), "");
+            EXPECT_EQ(round * 10 + i, value, "");
+        }
+        EXPECT_FALSE(ring.pop(&value), "empty");
+    }
+
+    END_TEST;
+}
+
+// Each value carries a check word derived from the sequence number, so a
+// consumer which sees the index move before the slot is written reads a bad
+// pair.
+struct Item {
+    uint64_t seq;
+    uint64_t check;
+};
+
+constexpr uint64_t kItems = 1000000;
+
+using Ring = mxtl::SpscRing<Item, 64>;
+
+int producer(void* arg) {
+    Ring* ring = static_cast<Ring*>(arg);
+    for (uint64_t seq = 1; seq <= kItems; ) {
+        if (ring->push(Item{ seq, ~seq * 0x9e3779b97f4a7c15ull }))
+            seq++;
+        else
+            thrd_yield();
+    }
+    return 0;
+}
+
+bool threads_test() {
+    BEGIN_TEST;
+
+    Ring ring;
+    thrd_t thread;
+    ASSERT_EQ(thrd_success, thrd_create(&thread, producer, &ring), "");
+
+    uint64_t expected = 1;
+    bool ok = true;
+    while (expected <= kItems) {
+        Item item;
+        if (!ring.pop(&item)) {
+            thrd_yield();
+            continue;
+        }
+        if (item.seq != expected || item.check != ~expected * 0x9e3779b97f4a7c15ull)
+            ok = false;
+        expected++;
+    }
+    EXPECT_TRUE(ok, "items out of order or torn");
+    EXPECT_TRUE(ring.is_empty(), "");
+
+    thrd_join(thread, nullptr);
+
+    END_TEST;
+}
+
+}  // namespace
+
+BEGIN_TEST_CASE(spsc_ring_tests)
+RUN_NAMED_TEST("basic", basic_test)
+RUN_NAMED_TEST("producer and consumer threads", threads_test)
+END_TEST_CASE(spsc_ring_tests);
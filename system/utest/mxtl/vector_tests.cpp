@@ -0,0 +1,240 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <magenta/new.h>
+#include <mxtl/unique_ptr.h>
+#include <mxtl/vector.h>
+#include <unittest/unittest.h>
+
+namespace {
+
+// Counts what goes through it, and can be told to fail.
+struct CountingAllocator {
+    static void* Allocate(size_t bytes, AllocChecker* ac) {
+        if (fail_) {
+            ac->arm(bytes, false);
+            return nullptr;
+        }
+        allocs_++;
+        return mxtl::DefaultAllocator::Allocate(bytes, ac);
+    }
+    static void Free(void* ptr) {
+        frees_++;
+        mxtl::DefaultAllocator::Free(ptr);
+    }
+
+    static void Reset() {
+        allocs_ = 0;
+        frees_ = 0;
+        fail_ = false;
+    }
+
+    static size_t allocs_;
+    static size_t frees_;
+    static bool fail_;
+};
+
+size_t CountingAllocator::allocs_;
+size_t CountingAllocator::frees_;
+bool CountingAllocator::fail_;
+
+// Tracks how many are alive, and how often they were copied.
+class Obj {
+public:
+    explicit Obj(int value) : value_(value) { ++live_; }
+    Obj(const Obj& other) : value_(other.value_) { ++live_; ++copies_; }
+    Obj(Obj&& other) : value_(other.value_) { other.value_ = -1; ++live_; }
+    Obj& operator=(Obj&& other) {
+        value_ = other.value_;
+        other.value_ = -1;
+        return *this;
+    }
+    ~Obj() { --live_; }
+
+    int value() const { return value_; }
+
+    static int live_;
+    static int copies_;
+
+private:
+    int value_;
+};
+
+int Obj::live_;
+int Obj::copies_;
+
+using ObjVector = mxtl::Vector<Obj, 4, CountingAllocator>;
+
+bool inline_test() {
+    BEGIN_TEST;
+
+    CountingAllocator::Reset();
+    Obj::copies_ = 0;
+    {
+        ObjVector vec;
+        EXPECT_TRUE(vec.is_empty(), "");
+        EXPECT_EQ(4u, vec.capacity(), "");
+
+        for (int i = 0; i < 4; i++) {
+            AllocChecker ac;
+            vec.emplace_back(&ac, i);
+            EXPECT_TRUE(ac.check(), "");
+        }
+        EXPECT_EQ(4u, vec.size(), "");
+        EXPECT_EQ(4, Obj::live_, "");
+        EXPECT_EQ(0u, CountingAllocator::allocs_, "no heap while it fits");
+
+        int expected = 0;
+        for (const auto& obj : vec)
+            EXPECT_EQ(expected++, obj.value(), "");
+
+        vec.erase(1);
+        EXPECT_EQ(3u, vec.size(), "");
+        EXPECT_EQ(0, vec[0].value(), "");
+        EXPECT_EQ(2, vec[1].value(), "");
+        EXPECT_EQ(3, vec[2].value(), "");
+        EXPECT_EQ(3, Obj::live_, "");
+    }
+    EXPECT_EQ(0, Obj::live_, "");
+    EXPECT_EQ(0u, CountingAllocator::allocs_, "");
+    EXPECT_EQ(0, Obj::copies_, "");
+
+    END_TEST;
+}
+
+bool grow_test() {
+    BEGIN_TEST;
+
+    CountingAllocator::Reset();
+    Obj::copies_ = 0;
+    {
+        ObjVector vec;
+        for (int i = 0; i < 100; i++) {
+            AllocChecker ac;
+            vec.push_back(Obj(i), &ac);
+            ASSERT_TRUE(ac.check(), "");
+        }
+        EXPECT_EQ(100u, vec.size(), "");
+        EXPECT_GE(vec.capacity(), 100u, "");
+        for (int i = 0; i < 100; i++)
+            EXPECT_EQ(i, vec[i].value(), "");
+        // Capacity doubles: 8, 16, 32, 64, 128.
+        EXPECT_EQ(5u, CountingAllocator::allocs_, "");
+        EXPECT_EQ(4u, CountingAllocator::frees_, "");
+        EXPECT_EQ(0, Obj::copies_, "growth moves, never copies");
+
+        // Appending an element of the Vector to itself, across a grow.
+        while (vec.size() < vec.capacity()) {
+            AllocChecker ac;
+            vec.emplace_back(&ac, 0);
+            ASSERT_TRUE(ac.check(), "");
+        }
+        AllocChecker ac;
+        vec.push_back(vec[10], &ac);
+        ASSERT_TRUE(ac.check(), "");
+        EXPECT_EQ(10, vec[vec.size() - 1].value(), "");
+
+        vec.clear();
+        EXPECT_EQ(0, Obj::live_, "");
+        EXPECT_GT(vec.capacity(), 4u, "clear keeps the storage");
+        vec.reset();
+        EXPECT_EQ(4u, vec.capacity(), "");
+        EXPECT_EQ(CountingAllocator::allocs_, CountingAllocator::frees_, "");
+    }
+    EXPECT_EQ(0, Obj::live_, "");
+
+    END_TEST;
+}
+
+bool move_test() {
+    BEGIN_TEST;
+
+    CountingAllocator::Reset();
+    {
+        ObjVector small;
+        ObjVector big;
+        for (int i = 0; i < 3; i++) {
+            AllocChecker ac;
+            small.emplace_back(&ac, i);
+            ASSERT_TRUE(ac.check(), "");
+        }
+        for (int i = 0; i < 10; i++) {
+            AllocChecker ac;
+            big.emplace_back(&ac, i);
+            ASSERT_TRUE(ac.check(), "");
+        }
+        size_t allocs = CountingAllocator::allocs_;
+
+        ObjVector small2(mxtl::move(small));
+        EXPECT_TRUE(small.is_empty(), "");
+        EXPECT_EQ(3u, small2.size(), "");
+        EXPECT_EQ(2, small2[2].value(), "");
+
+        // Heap storage changes hands without a new allocation.
+        ObjVector big2;
+        big2 = mxtl::move(big);
+        EXPECT_TRUE(big.is_empty(), "");
+        EXPECT_EQ(4u, big.capacity(), "");
+        EXPECT_EQ(10u, big2.size(), "");
+        EXPECT_EQ(9, big2[9].value(), "");
+        EXPECT_EQ(allocs, CountingAllocator::allocs_, "");
+        EXPECT_EQ(13, Obj::live_, "");
+    }
+    EXPECT_EQ(0, Obj::live_, "");
+    EXPECT_EQ(CountingAllocator::allocs_, CountingAllocator::frees_, "");
+
+    // Move-only elements.
+    mxtl::Vector<mxtl::unique_ptr<int>> ptrs;
+    for (int i = 0; i < 20; i++) {
+        AllocChecker ac;
+        mxtl::unique_ptr<int> ptr(new (&ac) int(i));
+        ASSERT_TRUE(ac.check(), "");
+        ptrs.push_back(mxtl::move(ptr), &ac);
+        ASSERT_TRUE(ac.check(), "");
+    }
+    for (int i = 0; i < 20; i++)
+        EXPECT_EQ(i, *ptrs[i], "");
+
+    END_TEST;
+}
+
+bool alloc_failure_test() {
+    BEGIN_TEST;
+
+    CountingAllocator::Reset();
+    {
+        ObjVector vec;
+        for (int i = 0; i < 4; i++) {
+            AllocChecker ac;
+            vec.emplace_back(&ac, i);
+            ASSERT_TRUE(ac.check(), "");
+        }
+
+        CountingAllocator::fail_ = true;
+        AllocChecker ac;
+        vec.emplace_back(&ac, 4);
+        EXPECT_FALSE(ac.check(), "");
+        vec.reserve(100, &ac);
+        EXPECT_FALSE(ac.check(), "");
+
+        // Untouched.
+        EXPECT_EQ(4u, vec.size(), "");
+        EXPECT_EQ(4u, vec.capacity(), "");
+        EXPECT_EQ(3, vec[3].value(), "");
+        EXPECT_EQ(4, Obj::live_, "");
+        CountingAllocator::fail_ = false;
+    }
+    EXPECT_EQ(0, Obj::live_, "");
+
+    END_TEST;
+}
+
+}  // namespace
+
+BEGIN_TEST_CASE(vector_tests)
+RUN_NAMED_TEST("inline storage", inline_test)
+RUN_NAMED_TEST("grow", grow_test)
+RUN_NAMED_TEST("move", move_test)
+RUN_NAMED_TEST("allocation failure", alloc_failure_test)
+END_TEST_CASE(vector_tests);
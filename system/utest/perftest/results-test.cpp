@@ -0,0 +1,183 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <perftest/perftest.h>
+#include <unittest/unittest.h>
+
+namespace {
+
+perftest::Result MakeResult(const char* label, double median, double spread) {
+    perftest::Result result = {};
+    result.label = label;
+    result.runs = 100;
+    result.mean = median;
+    result.stddev = spread;
+    result.min = median - 2 * spread;
+    result.p25 = median - spread;
+    result.median = median;
+    result.p75 = median + spread;
+    result.max = median + 2 * spread;
+    return result;
+}
+
+// Writes |results| out and reads them back into |out|.
+bool RoundTrip(const perftest::ResultSet& results, perftest::ResultSet* out) {
+    BEGIN_HELPER;
+
+    char buffer[4096] = {};
+    FILE* file = fmemopen(buffer, sizeof(buffer) - 1, "w");
+    ASSERT_NONNULL(file, "");
+    EXPECT_TRUE(results.WriteJson(file), "");
+    EXPECT_EQ(fclose(file), 0, "");
+
+    const char* error = nullptr;
+    EXPECT_TRUE(out->ReadJson(buffer, &error), error);
+
+    END_HELPER;
+}
+
+bool json_round_trip_test() {
+    BEGIN_TEST;
+
+    perftest::ResultSet results;
+    ASSERT_TRUE(results.Add(MakeResult("Channel/WriteRead", 1234.5, 10.25)), "");
+    ASSERT_TRUE(results.Add(MakeResult("Odd \"label\" \\ here", 7.0, 0.5)), "");
+
+    perftest::ResultSet read;
+    ASSERT_TRUE(RoundTrip(results, &read), "");
+    ASSERT_EQ(read.size(), 2u, "");
+    for (size_t i = 0; i < read.size(); i++) {
+        EXPECT_EQ(strcmp(read[i].label, results[i].label), 0, "");
+        EXPECT_EQ(read[i].runs, 100u, "");
+        EXPECT_EQ(read[i].median, results[i].median, "");
+        EXPECT_EQ(read[i].p25, results[i].p25, "");
+        EXPECT_EQ(read[i].max, results[i].max, "");
+    }
+
+    // Nothing at all is fine too.
+    perftest::ResultSet empty;
+    perftest::ResultSet read_empty;
+    ASSERT_TRUE(RoundTrip(empty, &read_empty), "");
+    EXPECT_EQ(read_empty.size(), 0u, "");
+
+    END_TEST;
+}
+
+bool json_malformed_test() {
+    BEGIN_TEST;
+
+    static const char* const kBad[] = {
+        "",
+        "{}",
+        "[{\"label\": \"a\", \"median\": }]",
+        "[{\"median\": 1}]",
+        "[{\"label\": \"a\", \"unit\": \"ms\"}]",
+        "[{\"label\": \"a\"}",
+        "[{\"label\": \"a\"}] trailing",
+        "[{\"label\": \"unterminated}]",
+    };
+    for (const char* text : kBad) {
+        perftest::ResultSet results;
+        const char* error = nullptr;
+        EXPECT_FALSE(results.ReadJson(text, &error), text);
+        EXPECT_NONNULL(error, text);
+    }
+
+    END_TEST;
+}
+
+bool compare_test() {
+    BEGIN_TEST;
+
+    perftest::ResultSet baseline;
+    ASSERT_TRUE(baseline.Add(MakeResult("steady", 100.0, 5.0)), "");
+    ASSERT_TRUE(baseline.Add(MakeResult("slower", 100.0, 5.0)), "");
+    ASSERT_TRUE(baseline.Add(MakeResult("noisy", 100.0, 50.0)), "");
+    ASSERT_TRUE(baseline.Add(MakeResult("faster", 100.0, 5.0)), "");
+
+    perftest::ResultSet current;
+    ASSERT_TRUE(current.Add(MakeResult("steady", 104.0, 5.0)), "");
+    ASSERT_TRUE(current.Add(MakeResult("slower", 130.0, 5.0)), "");
+    // Much slower, but the quartiles still overlap.
+    ASSERT_TRUE(current.Add(MakeResult("noisy", 150.0, 50.0)), "");
+    ASSERT_TRUE(current.Add(MakeResult("faster", 50.0, 5.0)), "");
+    ASSERT_TRUE(current.Add(MakeResult("new one", 10.0, 1.0)), "");
+
+    char buffer[4096] = {};
+    FILE* out = fmemopen(buffer, sizeof(buffer) - 1, "w");
+    ASSERT_NONNULL(out, "");
+    EXPECT_EQ(current.Compare(baseline, 10.0, out), 1u, "");
+    EXPECT_EQ(fclose(out), 0, "");
+    EXPECT_NONNULL(strstr(buffer, "REGRESSED"), "");
+    EXPECT_NONNULL(strstr(buffer, "improved"), "");
+    EXPECT_NONNULL(strstr(buffer, "(new)"), "");
+
+    // A higher threshold lets the slower test through.
+    out = fopen("/dev/null", "w");
+    ASSERT_NONNULL(out, "");
+    EXPECT_EQ(current.Compare(baseline, 50.0, out), 0u, "");
+    fclose(out);
+
+    END_TEST;
+}
+
+uint32_t counted_runs;
+
+bool CountingTest(perftest::RepeatState* state) {
+    while (state->KeepRunning())
+        counted_runs++;
+    return true;
+}
+PERFTEST_REGISTER("Test/Counting", CountingTest);
+
+bool QuitterTest(perftest::RepeatState* state) {
+    state->KeepRunning();
+    return true;
+}
+PERFTEST_REGISTER("Test/Quitter", QuitterTest);
+
+bool run_tests_test() {
+    BEGIN_TEST;
+
+    FILE* log = fopen("/dev/null", "w");
+    ASSERT_NONNULL(log, "");
+
+    // Warm up runs are on top of the ones which are kept.
+    perftest::ResultSet results;
+    counted_runs = 0;
+    EXPECT_TRUE(perftest::RunTests(50u, "Counting", log, &results), "");
+    EXPECT_EQ(counted_runs, 55u, "");
+    ASSERT_EQ(results.size(), 1u, "");
+    EXPECT_EQ(strcmp(results[0].label, "Test/Counting"), 0, "");
+    EXPECT_EQ(results[0].runs, 50u, "");
+    EXPECT_LE(results[0].min, results[0].p25, "");
+    EXPECT_LE(results[0].p25, results[0].median, "");
+    EXPECT_LE(results[0].median, results[0].p75, "");
+    EXPECT_LE(results[0].p75, results[0].max, "");
+
+    // A test which stops early fails, and has no result.
+    perftest::ResultSet quitter;
+    EXPECT_FALSE(perftest::RunTests(50u, "Quitter", log, &quitter), "");
+    EXPECT_EQ(quitter.size(), 0u, "");
+
+    fclose(log);
+    END_TEST;
+}
+
+} // namespace
+
+BEGIN_TEST_CASE(perftest_results_tests)
+RUN_TEST(json_round_trip_test)
+RUN_TEST(json_malformed_test)
+RUN_TEST(compare_test)
+RUN_TEST(run_tests_test)
+END_TEST_CASE(perftest_results_tests)
+
+int main(int argc, char** argv) {
+    return unittest_run_all_tests(argc, argv) ? 0 : -1;
+}
@@ -2,6 +2,7 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <magenta/syscalls.h>
 #include <region-alloc/region-alloc.h>
 #include <stdio.h>
 #include <unittest/unittest.h>
@@ -235,6 +236,137 @@ static bool ralloc_subtract_test() {
     END_TEST;
 }
 
+// Regions which are big enough for a 4KB allocation, but whose base is placed
+// so that a 4KB aligned one never fits.
+static constexpr size_t   MISALIGNED_REGION_COUNT = 1000;
+static constexpr uint64_t MISALIGNED_REGION_SIZE  = 0x1800;
+
+static ralloc_region_t misaligned_region(size_t i) {
+    return { .base = (i << 16) + 1, .size = MISALIGNED_REGION_SIZE };
+}
+
+static bool ralloc_aligned_fit_test() {
+    BEGIN_TEST;
+
+    RegionAllocator alloc(RegionAllocator::RegionPool::Create(1 << 20));
+
+    for (size_t i = 0; i < MISALIGNED_REGION_COUNT; ++i)
+        ASSERT_EQ(NO_ERROR, alloc.AddRegion(misaligned_region(i)), "");
+
+    // An exact fit, and a much larger region.
+    constexpr ralloc_region_t EXACT = { .base = 0x200000000, .size = 0x1000 };
+    constexpr ralloc_region_t LARGE = { .base = 0x100000000, .size = 0x100000 };
+    ASSERT_EQ(NO_ERROR, alloc.AddRegion(EXACT), "");
+    ASSERT_EQ(NO_ERROR, alloc.AddRegion(LARGE), "");
+
+    // The best fit wins while it is there, and the large region is found past
+    // all of the misaligned ones after that.
+    auto r1 = alloc.GetRegion(0x1000, 0x1000);
+    ASSERT_NONNULL(r1, "");
+    EXPECT_EQ(EXACT.base, r1->base, "");
+
+    auto r2 = alloc.GetRegion(0x1000, 0x1000);
+    ASSERT_NONNULL(r2, "");
+    EXPECT_TRUE(region_contains_region(&LARGE, r2.get()), "");
+    EXPECT_EQ(0u, r2->base & 0xFFF, "");
+
+    // Unaligned requests still fit in the small regions.
+    auto r3 = alloc.GetRegion(MISALIGNED_REGION_SIZE, 1);
+    ASSERT_NONNULL(r3, "");
+    EXPECT_EQ(MISALIGNED_REGION_SIZE, r3->size, "");
+    EXPECT_EQ(1u, r3->base & 0xFFFF, "");
+
+    // Nothing at all fits this alignment.
+    EXPECT_NULL(alloc.GetRegion(0x1000, 1ull << 40), "");
+
+    r1.reset();
+    r2.reset();
+    r3.reset();
+    EXPECT_EQ(0u, alloc.AllocatedRegionCount(), "");
+    EXPECT_EQ(MISALIGNED_REGION_COUNT + 2, alloc.AvailableRegionCount(), "");
+
+    END_TEST;
+}
+
+static bool ralloc_shrink_reorder_test() {
+    BEGIN_TEST;
+
+    RegionAllocator alloc(RegionAllocator::RegionPool::Create(REGION_POOL_MAX_SIZE));
+
+    // Carve A down past the size of B, which sorts before it to begin with,
+    // so that at some point A has to move in the size index.
+    constexpr ralloc_region_t A = { .base = 0x100000, .size = 64 << 10 };
+    constexpr ralloc_region_t B = { .base = 0x200000, .size = 40 << 10 };
+    ASSERT_EQ(NO_ERROR, alloc.AddRegion(A), "");
+    ASSERT_EQ(NO_ERROR, alloc.AddRegion(B), "");
+
+    RegionAllocator::Region::UPtr chunks[8];
+    for (size_t i = 0; i < countof(chunks); ++i) {
+        chunks[i] = alloc.GetRegion({ .base = A.base + (i << 12), .size = 4 << 10 });
+        ASSERT_NONNULL(chunks[i], "");
+    }
+
+    // What is left of A is now the best fit for anything up to its size.
+    auto rest_of_a = alloc.GetRegion(32 << 10, 1);
+    ASSERT_NONNULL(rest_of_a, "");
+    EXPECT_EQ(A.base + (32 << 10), rest_of_a->base, "");
+
+    auto all_of_b = alloc.GetRegion(40 << 10, 1);
+    ASSERT_NONNULL(all_of_b, "");
+    EXPECT_EQ(B.base, all_of_b->base, "");
+
+    // Everything merges back together.
+    for (auto& chunk : chunks)
+        chunk.reset();
+    rest_of_a.reset();
+    all_of_b.reset();
+    EXPECT_EQ(2u, alloc.AvailableRegionCount(), "");
+    EXPECT_NONNULL(alloc.GetRegion(A), "");
+
+    END_TEST;
+}
+
+static bool ralloc_benchmark() {
+    BEGIN_TEST;
+
+    constexpr size_t ALLOC_COUNT = 4096;
+    RegionAllocator::Region::UPtr* regions = new RegionAllocator::Region::UPtr[ALLOC_COUNT];
+    RegionAllocator alloc(RegionAllocator::RegionPool::Create(2 << 20));
+
+    for (size_t i = 0; i < MISALIGNED_REGION_COUNT; ++i)
+        ASSERT_EQ(NO_ERROR, alloc.AddRegion(misaligned_region(i)), "");
+    ASSERT_EQ(NO_ERROR, alloc.AddRegion({ .base = 1ull << 40, .size = 1ull << 30 }), "");
+
+    // Lots of same sized allocations carved out of one window, as a bus
+    // driver handing out BARs does.
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    for (size_t i = 0; i < ALLOC_COUNT; ++i) {
+        regions[i] = alloc.GetRegion(MISALIGNED_REGION_SIZE + 1, 1);
+        ASSERT_NONNULL(regions[i], "");
+    }
+    mx_time_t fixed_ns = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+    for (size_t i = 0; i < ALLOC_COUNT; ++i)
+        regions[i].reset();
+
+    // Aligned allocations which can't use any of the small regions.
+    start = mx_time_get(MX_CLOCK_MONOTONIC);
+    for (size_t i = 0; i < ALLOC_COUNT; ++i) {
+        regions[i] = alloc.GetRegion(0x1000, 0x1000);
+        ASSERT_NONNULL(regions[i], "");
+    }
+    mx_time_t aligned_ns = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+    for (size_t i = 0; i < ALLOC_COUNT; ++i)
+        regions[i].reset();
+
+    unittest_printf_critical("\n    %zu regions: fixed size %llu ns/alloc, aligned %llu ns/alloc\n",
+                             MISALIGNED_REGION_COUNT + 1,
+                             (unsigned long long)(fixed_ns / ALLOC_COUNT),
+                             (unsigned long long)(aligned_ns / ALLOC_COUNT));
+
+    delete[] regions;
+    END_TEST;
+}
+
 } //namespace
 
 BEGIN_TEST_CASE(ralloc_tests)
@@ -243,4 +375,7 @@ RUN_NAMED_TEST("Alloc by size",  ralloc_by_size_test)
 RUN_NAMED_TEST("Alloc specific", ralloc_specific_test)
 RUN_NAMED_TEST("Add/Overlap",    ralloc_add_overlap_test)
 RUN_NAMED_TEST("Subtract",       ralloc_subtract_test)
+RUN_NAMED_TEST("Aligned fit",    ralloc_aligned_fit_test)
+RUN_NAMED_TEST("Shrink/Reorder", ralloc_shrink_reorder_test)
+RUN_TEST_PERFORMANCE(ralloc_benchmark)
 END_TEST_CASE(ralloc_tests)
@@ -0,0 +1,297 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <magenta/syscalls.h>
+#include <unittest/unittest.h>
+
+// Called through these so the compiler can't expand or drop the calls.
+static void* (*volatile memcpy_fn)(void*, const void*, size_t) = memcpy;
+static void* (*volatile memmove_fn)(void*, const void*, size_t) = memmove;
+static void* (*volatile memset_fn)(void*, int, size_t) = memset;
+static int (*volatile memcmp_fn)(const void*, const void*, size_t) = memcmp;
+static void* (*volatile memchr_fn)(const void*, int, size_t) = memchr;
+static size_t (*volatile strlen_fn)(const char*) = strlen;
+
+#define BUF_SIZE 12288
+#define BIG_SIZE (1 << 20)
+
+static unsigned char src[BUF_SIZE];
+static unsigned char dst[BUF_SIZE];
+static unsigned char ref[BUF_SIZE];
+
+// Every size up to 300, some either side of where the implementations
+// change strategy, and a few large ones.
+static const size_t sizes[] = {
+    0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65, 127, 128,
+    129, 255, 256, 257, 511, 512, 513, 1023, 1024, 2047, 2048, 2049, 4095,
+    4096, 4097, 8000,
+};
+
+static void fill_random(unsigned char* buf, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = (unsigned char)rand();
+    }
+}
+
+static int sign(int x) {
+    return (x > 0) - (x < 0);
+}
+
+static int ref_memcmp(const unsigned char* l, const unsigned char* r, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (l[i] != r[i]) {
+            return l[i] - r[i];
+        }
+    }
+    return 0;
+}
+
+static bool memcpy_test(void) {
+    BEGIN_TEST;
+    for (size_t i = 0; i < countof(sizes); i++) {
+        size_t n = sizes[i];
+        for (size_t da = 0; da < 16; da++) {
+            for (size_t sa = 0; sa < 16; sa += 5) {
+                fill_random(src, sizeof(src));
+                fill_random(dst, sizeof(dst));
+                memmove(ref, dst, sizeof(ref));
+                for (size_t k = 0; k < n; k++) {
+                    ref[64 + da + k] = src[sa + k];
+                }
+                void* r = memcpy_fn(dst + 64 + da, src + sa, n);
+                ASSERT_EQ(r, dst + 64 + da, "wrong return value");
+                ASSERT_EQ(ref_memcmp(dst, ref, sizeof(dst)), 0, "bad copy");
+            }
+        }
+    }
+    END_TEST;
+}
+
+static bool memmove_test(void) {
+    BEGIN_TEST;
+    for (size_t i = 0; i < countof(sizes); i++) {
+        size_t n = sizes[i];
+        if (n > BUF_SIZE - 512) {
+            continue;
+        }
+        for (int off = -80; off <= 80; off += (off >= -3 && off < 3) ? 1 : 19) {
+            for (size_t sa = 0; sa < 16; sa += 3) {
+                fill_random(dst, sizeof(dst));
+                memcpy(ref, dst, sizeof(ref));
+                unsigned char* s = dst + 256 + sa;
+                unsigned char* d = s + off;
+                // Both directions through a temporary
+                for (size_t k = 0; k < n; k++) {
+                    src[k] = ref[256 + sa + k];
+                }
+                for (size_t k = 0; k < n; k++) {
+                    ref[256 + sa + off + k] = src[k];
+                }
+                void* r = memmove_fn(d, s, n);
+                ASSERT_EQ(r, d, "wrong return value");
+                ASSERT_EQ(ref_memcmp(dst, ref, sizeof(dst)), 0, "bad move");
+            }
+        }
+    }
+    END_TEST;
+}
+
+static bool memset_test(void) {
+    BEGIN_TEST;
+    for (size_t i = 0; i < countof(sizes); i++) {
+        size_t n = sizes[i];
+        for (size_t da = 0; da < 16; da++) {
+            int c = rand();
+            fill_random(dst, sizeof(dst));
+            memcpy(ref, dst, sizeof(ref));
+            for (size_t k = 0; k < n; k++) {
+                ref[64 + da + k] = (unsigned char)c;
+            }
+            void* r = memset_fn(dst + 64 + da, c, n);
+            ASSERT_EQ(r, dst + 64 + da, "wrong return value");
+            ASSERT_EQ(ref_memcmp(dst, ref, sizeof(dst)), 0, "bad fill");
+        }
+    }
+    END_TEST;
+}
+
+static bool memcmp_test(void) {
+    BEGIN_TEST;
+    for (size_t i = 0; i < countof(sizes); i++) {
+        size_t n = sizes[i];
+        for (size_t la = 0; la < 16; la += 3) {
+            for (size_t ra = 0; ra < 16; ra += 5) {
+                fill_random(src, sizeof(src));
+                memcpy(dst + ra, src + la, n);
+                ASSERT_EQ(memcmp_fn(src + la, dst + ra, n), 0, "equal buffers differ");
+                if (n == 0) {
+                    continue;
+                }
+                // Differences first, last and in between
+                size_t at[3] = { 0, n - 1, (size_t)rand() % n };
+                for (size_t k = 0; k < countof(at); k++) {
+                    memcpy(dst + ra, src + la, n);
+                    dst[ra + at[k]] ^= (unsigned char)(1 + rand() % 255);
+                    ASSERT_EQ(sign(memcmp_fn(src + la, dst + ra, n)),
+                              sign(ref_memcmp(src + la, dst + ra, n)), "wrong order");
+                }
+            }
+        }
+    }
+    END_TEST;
+}
+
+static bool memchr_strlen_test(void) {
+    BEGIN_TEST;
+    for (size_t i = 0; i < countof(sizes); i++) {
+        size_t n = sizes[i];
+        if (n > BUF_SIZE - 64) {
+            continue;
+        }
+        for (size_t a = 0; a < 16; a++) {
+            memset(dst, 'x', sizeof(dst));
+            dst[a + n] = 'y';
+            if (a > 0) {
+                dst[a - 1] = 'y';
+            }
+            ASSERT_EQ(memchr_fn(dst + a, 'y', n), NULL, "found outside the buffer");
+            if (n > 0) {
+                size_t k = (size_t)rand() % n;
+                dst[a + k] = 'y';
+                ASSERT_EQ(memchr_fn(dst + a, 'y', n), dst + a + k, "wrong match");
+                dst[a + k] = 'x';
+            }
+
+            dst[a + n] = 0;
+            ASSERT_EQ(strlen_fn((const char*)dst + a), n, "wrong length");
+        }
+    }
+    END_TEST;
+}
+
+// Strings and buffers that end at the last byte before an unmapped page
+static bool overread_test(void) {
+    BEGIN_TEST;
+    unsigned char* page = mmap(NULL, 2 * PAGE_SIZE, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ASSERT_NEQ(page, MAP_FAILED, "");
+    ASSERT_EQ(mprotect(page + PAGE_SIZE, PAGE_SIZE, PROT_NONE), 0, "");
+    unsigned char* end = page + PAGE_SIZE;
+    for (size_t n = 0; n < 100; n++) {
+        memset(end - n - 1, 'a', n);
+        end[-1] = 0;
+        ASSERT_EQ(strlen_fn((const char*)end - n - 1), n, "");
+        ASSERT_EQ(memchr_fn(end - n, 'q', n), NULL, "");
+        ASSERT_EQ(memcmp_fn(end - n, end - n, n), 0, "");
+        memcpy_fn(page, end - n, n);
+    }
+    ASSERT_EQ(munmap(page, 2 * PAGE_SIZE), 0, "");
+    END_TEST;
+}
+
+// Benchmarks: each prints the time per call and the throughput at a range
+// of sizes, with both buffers aligned and with both misaligned.
+
+static const size_t bench_sizes[] = { 8, 32, 128, 512, 4096, 65536, BIG_SIZE };
+
+static size_t bench_iterations(size_t n) {
+    size_t iters = (64 * BIG_SIZE) / (n + 64);
+    return iters < 16 ? 16 : iters;
+}
+
+static void bench_report(const char* name, size_t n, size_t misalign, size_t iters,
+                         mx_time_t elapsed) {
+    uint64_t ns = elapsed / iters;
+    uint64_t mbps = elapsed ? ((uint64_t)n * iters * 1000) / elapsed : 0;
+    printf("%-8s %8zu bytes%s: %6" PRIu64 " ns  %6" PRIu64 " MB/s\n", name, n,
+           misalign ? " (misaligned)" : "            ", ns, mbps);
+}
+
+static bool bench_memory(void) {
+    BEGIN_TEST;
+    unsigned char* a = malloc(BIG_SIZE + 64);
+    unsigned char* b = malloc(BIG_SIZE + 64);
+    ASSERT_NONNULL(a, "");
+    ASSERT_NONNULL(b, "");
+    memset(a, 'a', BIG_SIZE + 64);
+    memset(b, 'a', BIG_SIZE + 64);
+
+    printf("\n");
+    for (size_t i = 0; i < countof(bench_sizes); i++) {
+        for (size_t misalign = 0; misalign < 2; misalign++) {
+            size_t n = bench_sizes[i];
+            size_t iters = bench_iterations(n);
+            unsigned char* s = a + (misalign ? 3 : 0);
+            unsigned char* d = b + (misalign ? 13 : 0);
+
+            mx_time_t t = mx_time_get(MX_CLOCK_MONOTONIC);
+            for (size_t k = 0; k < iters; k++) {
+                memcpy_fn(d, s, n);
+            }
+            bench_report("memcpy", n, misalign, iters, mx_time_get(MX_CLOCK_MONOTONIC) - t);
+
+            t = mx_time_get(MX_CLOCK_MONOTONIC);
+            for (size_t k = 0; k < iters; k++) {
+                memmove_fn(d + 1, d, n);
+            }
+            bench_report("memmove", n, misalign, iters, mx_time_get(MX_CLOCK_MONOTONIC) - t);
+
+            t = mx_time_get(MX_CLOCK_MONOTONIC);
+            for (size_t k = 0; k < iters; k++) {
+                memset_fn(d, 'a', n);
+            }
+            bench_report("memset", n, misalign, iters, mx_time_get(MX_CLOCK_MONOTONIC) - t);
+
+            memset(b, 'a', BIG_SIZE + 64);
+            t = mx_time_get(MX_CLOCK_MONOTONIC);
+            for (size_t k = 0; k < iters; k++) {
+                memcmp_fn(d, s, n);
+            }
+            bench_report("memcmp", n, misalign, iters, mx_time_get(MX_CLOCK_MONOTONIC) - t);
+
+            t = mx_time_get(MX_CLOCK_MONOTONIC);
+            for (size_t k = 0; k < iters; k++) {
+                memchr_fn(s, 'z', n);
+            }
+            bench_report("memchr", n, misalign, iters, mx_time_get(MX_CLOCK_MONOTONIC) - t);
+
+            s[n] = 0;
+            t = mx_time_get(MX_CLOCK_MONOTONIC);
+            for (size_t k = 0; k < iters; k++) {
+                strlen_fn((const char*)s);
+            }
+            bench_report("strlen", n, misalign, iters, mx_time_get(MX_CLOCK_MONOTONIC) - t);
+            s[n] = 'a';
+        }
+    }
+
+    free(a);
+    free(b);
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(string_tests)
+RUN_TEST(memcpy_test)
+RUN_TEST(memmove_test)
+RUN_TEST(memset_test)
+RUN_TEST(memcmp_test)
+RUN_TEST(memchr_strlen_test)
+RUN_TEST(overread_test)
+END_TEST_CASE(string_tests)
+
+BEGIN_TEST_CASE(string_benchmarks)
+RUN_TEST_PERFORMANCE(bench_memory)
+END_TEST_CASE(string_benchmarks)
+
+int main(int argc, char** argv) {
+    return unittest_run_all_tests(argc, argv) ? 0 : -1;
+}
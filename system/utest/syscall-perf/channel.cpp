@@ -0,0 +1,109 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <threads.h>
+
+#include <magenta/syscalls.h>
+#include <perftest/perftest.h>
+
+namespace {
+
+// Writes a message to one end of a channel and reads it from the other, on
+// the same thread.
+template <uint32_t kBytes, uint32_t kHandles>
+bool ChannelWriteRead(perftest::RepeatState* state) {
+    mx_handle_t channel[2];
+    if (mx_channel_create(0u, &channel[0], &channel[1]) != NO_ERROR)
+        return false;
+
+    static uint8_t data[kBytes ? kBytes : 1];
+    mx_handle_t handles[kHandles ? kHandles : 1];
+    bool ok = true;
+    for (uint32_t i = 0; i < kHandles && ok; i++)
+        ok = mx_event_create(0u, &handles[i]) == NO_ERROR;
+
+    while (ok && state->KeepRunning()) {
+        uint32_t actual_bytes, actual_handles;
+        if (mx_channel_write(channel[0], 0u, data, kBytes, handles, kHandles) != NO_ERROR ||
+            mx_channel_read(channel[1], 0u, data, handles, kBytes, kHandles, &actual_bytes,
+                            &actual_handles) != NO_ERROR)
+            ok = false;
+    }
+
+    for (uint32_t i = 0; i < kHandles; i++)
+        mx_handle_close(handles[i]);
+    mx_handle_close(channel[0]);
+    mx_handle_close(channel[1]);
+    return ok;
+}
+PERFTEST_REGISTER("Channel/WriteRead/0bytes", (ChannelWriteRead<0, 0>));
+PERFTEST_REGISTER("Channel/WriteRead/64bytes", (ChannelWriteRead<64, 0>));
+PERFTEST_REGISTER("Channel/WriteRead/1024bytes", (ChannelWriteRead<1024, 0>));
+PERFTEST_REGISTER("Channel/WriteRead/32768bytes", (ChannelWriteRead<32768, 0>));
+PERFTEST_REGISTER("Channel/WriteRead/64bytes/1handle", (ChannelWriteRead<64, 1>));
+PERFTEST_REGISTER("Channel/WriteRead/64bytes/8handles", (ChannelWriteRead<64, 8>));
+
+// Echoes every message back until the other end is closed.
+int EchoThread(void* arg) {
+    mx_handle_t channel = *static_cast<mx_handle_t*>(arg);
+    uint8_t data[64];
+    for (;;) {
+        mx_signals_t observed;
+        if (mx_object_wait_one(channel, MX_CHANNEL_READABLE | MX_CHANNEL_PEER_CLOSED,
+                               MX_TIME_INFINITE, &observed) != NO_ERROR)
+            break;
+        if (!(observed & MX_CHANNEL_READABLE))
+            break;
+        uint32_t actual_bytes, actual_handles;
+        if (mx_channel_read(channel, 0u, data, nullptr, sizeof(data), 0u, &actual_bytes,
+                            &actual_handles) != NO_ERROR ||
+            mx_channel_write(channel, 0u, data, actual_bytes, nullptr, 0u) != NO_ERROR)
+            break;
+    }
+    mx_handle_close(channel);
+    return 0;
+}
+
+// A round trip through mx_channel_call() to a thread which answers right
+// away, so this includes two thread switches.
+bool ChannelCall(perftest::RepeatState* state) {
+    mx_handle_t client, server;
+    if (mx_channel_create(0u, &client, &server) != NO_ERROR)
+        return false;
+    thrd_t thread;
+    if (thrd_create(&thread, EchoThread, &server) != thrd_success) {
+        mx_handle_close(client);
+        mx_handle_close(server);
+        return false;
+    }
+
+    // The first four bytes are the transaction id, which the kernel fills
+    // in and the echo preserves.
+    uint8_t request[64] = {};
+    uint8_t reply[64];
+    mx_channel_call_args_t args = {};
+    args.wr_bytes = request;
+    args.wr_num_bytes = sizeof(request);
+    args.rd_bytes = reply;
+    args.rd_num_bytes = sizeof(reply);
+
+    bool ok = true;
+    while (state->KeepRunning()) {
+        uint32_t actual_bytes, actual_handles;
+        mx_status_t read_status;
+        if (mx_channel_call(client, 0u, MX_TIME_INFINITE, &args, &actual_bytes,
+                            &actual_handles, &read_status) != NO_ERROR) {
+            ok = false;
+            break;
+        }
+    }
+
+    // The echo thread stops when it sees the peer go away.
+    mx_handle_close(client);
+    thrd_join(thread, nullptr);
+    return ok;
+}
+PERFTEST_REGISTER("Channel/Call/64bytes", ChannelCall);
+
+} // namespace
@@ -0,0 +1,28 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <magenta/syscalls.h>
+#include <perftest/perftest.h>
+
+namespace {
+
+bool HandleDuplicateClose(perftest::RepeatState* state) {
+    mx_handle_t event;
+    if (mx_event_create(0u, &event) != NO_ERROR)
+        return false;
+    bool ok = true;
+    while (state->KeepRunning()) {
+        mx_handle_t dup;
+        if (mx_handle_duplicate(event, MX_RIGHT_SAME_RIGHTS, &dup) != NO_ERROR ||
+            mx_handle_close(dup) != NO_ERROR) {
+            ok = false;
+            break;
+        }
+    }
+    mx_handle_close(event);
+    return ok;
+}
+PERFTEST_REGISTER("Handle/DuplicateClose", HandleDuplicateClose);
+
+} // namespace
@@ -0,0 +1,35 @@
+# Copyright 2017 The Fuchsia Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+LOCAL_DIR := $(GET_LOCAL_DIR)
+
+MODULE := $(LOCAL_DIR)
+
+MODULE_TYPE := usertest
+
+# Timing runs are too slow, and too noisy on emulators, for the normal test
+# groups; runperftests runs this group.
+MODULE_USERTEST_GROUP := perf
+
+MODULE_SRCS += \
+    $(LOCAL_DIR)/channel.cpp \
+    $(LOCAL_DIR)/handle.cpp \
+    $(LOCAL_DIR)/main.cpp \
+    $(LOCAL_DIR)/sync.cpp \
+    $(LOCAL_DIR)/thread.cpp \
+    $(LOCAL_DIR)/vmo.cpp \
+
+MODULE_NAME := syscall-perftest
+
+MODULE_STATIC_LIBS := \
+    system/ulib/perftest \
+    system/ulib/mxtl \
+    system/ulib/mxcpp \
+
+MODULE_LIBS := \
+    system/ulib/magenta \
+    system/ulib/mxio \
+    system/ulib/c \
+
+include make/module.mk
@@ -0,0 +1,121 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <threads.h>
+
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/port.h>
+#include <perftest/perftest.h>
+
+namespace {
+
+bool EventSignal(perftest::RepeatState* state) {
+    mx_handle_t event;
+    if (mx_event_create(0u, &event) != NO_ERROR)
+        return false;
+    bool ok = true;
+    while (state->KeepRunning()) {
+        if (mx_object_signal(event, 0u, MX_EVENT_SIGNALED) != NO_ERROR) {
+            ok = false;
+            break;
+        }
+    }
+    mx_handle_close(event);
+    return ok;
+}
+PERFTEST_REGISTER("Event/Signal", EventSignal);
+
+// Waiting on an event which is already signaled, so the wait never blocks.
+bool EventSignalWait(perftest::RepeatState* state) {
+    mx_handle_t event;
+    if (mx_event_create(0u, &event) != NO_ERROR)
+        return false;
+    bool ok = true;
+    while (state->KeepRunning()) {
+        if (mx_object_signal(event, MX_EVENT_SIGNALED, MX_EVENT_SIGNALED) != NO_ERROR ||
+            mx_object_wait_one(event, MX_EVENT_SIGNALED, MX_TIME_INFINITE, nullptr) !=
+                NO_ERROR) {
+            ok = false;
+            break;
+        }
+    }
+    mx_handle_close(event);
+    return ok;
+}
+PERFTEST_REGISTER("Event/SignalWait", EventSignalWait);
+
+bool PortQueueWait(perftest::RepeatState* state) {
+    mx_handle_t port;
+    if (mx_port_create(MX_PORT_OPT_V2, &port) != NO_ERROR)
+        return false;
+    mx_port_packet_t packet = {};
+    packet.type = MX_PKT_TYPE_USER;
+    bool ok = true;
+    while (state->KeepRunning()) {
+        mx_port_packet_t out;
+        if (mx_port_queue(port, &packet, 0u) != NO_ERROR ||
+            mx_port_wait(port, MX_TIME_INFINITE, &out, 0u) != NO_ERROR) {
+            ok = false;
+            break;
+        }
+    }
+    mx_handle_close(port);
+    return ok;
+}
+PERFTEST_REGISTER("Port/QueueWait", PortQueueWait);
+
+bool FutexWakeNoWaiters(perftest::RepeatState* state) {
+    mx_futex_t futex = 0;
+    while (state->KeepRunning()) {
+        if (mx_futex_wake(&futex, 1u) != NO_ERROR)
+            return false;
+    }
+    return true;
+}
+PERFTEST_REGISTER("Futex/WakeNoWaiters", FutexWakeNoWaiters);
+
+// Two threads take turns, each waking the other and then waiting for its
+// own turn.  Each run is one round trip.
+enum : int {
+    kMainTurn,
+    kHelperTurn,
+    kQuit,
+};
+
+void WaitWhile(mx_futex_t* futex, int value) {
+    while (__atomic_load_n(futex, __ATOMIC_ACQUIRE) == value)
+        mx_futex_wait(futex, value, MX_TIME_INFINITE);
+}
+
+void SetAndWake(mx_futex_t* futex, int value) {
+    __atomic_store_n(futex, value, __ATOMIC_RELEASE);
+    mx_futex_wake(futex, 1u);
+}
+
+int FutexHelperThread(void* arg) {
+    mx_futex_t* futex = static_cast<mx_futex_t*>(arg);
+    for (;;) {
+        WaitWhile(futex, kMainTurn);
+        if (__atomic_load_n(futex, __ATOMIC_ACQUIRE) == kQuit)
+            return 0;
+        SetAndWake(futex, kMainTurn);
+    }
+}
+
+bool FutexPingPong(perftest::RepeatState* state) {
+    mx_futex_t futex = kMainTurn;
+    thrd_t thread;
+    if (thrd_create(&thread, FutexHelperThread, &futex) != thrd_success)
+        return false;
+    while (state->KeepRunning()) {
+        SetAndWake(&futex, kHelperTurn);
+        WaitWhile(&futex, kHelperTurn);
+    }
+    SetAndWake(&futex, kQuit);
+    thrd_join(thread, nullptr);
+    return true;
+}
+PERFTEST_REGISTER("Futex/PingPong", FutexPingPong);
+
+} // namespace
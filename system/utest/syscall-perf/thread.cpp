@@ -0,0 +1,30 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <threads.h>
+
+#include <perftest/perftest.h>
+
+namespace {
+
+int NopThread(void* arg) {
+    return 0;
+}
+
+// Includes what the C library does to set up and tear down a thread: its
+// stacks, TLS and the join handshake.
+bool ThreadCreateJoin(perftest::RepeatState* state) {
+    while (state->KeepRunning()) {
+        thrd_t thread;
+        if (thrd_create(&thread, NopThread, nullptr) != thrd_success)
+            return false;
+        int result;
+        if (thrd_join(thread, &result) != thrd_success)
+            return false;
+    }
+    return true;
+}
+PERFTEST_REGISTER("Thread/CreateJoin", ThreadCreateJoin);
+
+} // namespace
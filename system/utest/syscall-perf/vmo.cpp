@@ -0,0 +1,74 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <magenta/process.h>
+#include <magenta/syscalls.h>
+#include <perftest/perftest.h>
+
+namespace {
+
+constexpr size_t kPageSize = 4096u;
+
+template <size_t kSize>
+bool VmoCreateClose(perftest::RepeatState* state) {
+    while (state->KeepRunning()) {
+        mx_handle_t vmo;
+        if (mx_vmo_create(kSize, 0u, &vmo) != NO_ERROR || mx_handle_close(vmo) != NO_ERROR)
+            return false;
+    }
+    return true;
+}
+PERFTEST_REGISTER("Vmo/CreateClose/4KB", VmoCreateClose<kPageSize>);
+PERFTEST_REGISTER("Vmo/CreateClose/1MB", VmoCreateClose<1024u * 1024u>);
+
+// Maps and unmaps without touching anything, so nothing is faulted in.
+template <size_t kSize>
+bool VmoMapUnmap(perftest::RepeatState* state) {
+    mx_handle_t vmo;
+    if (mx_vmo_create(kSize, 0u, &vmo) != NO_ERROR)
+        return false;
+    bool ok = true;
+    while (state->KeepRunning()) {
+        uintptr_t addr;
+        if (mx_vmar_map(mx_vmar_root_self(), 0u, vmo, 0u, kSize,
+                        MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &addr) != NO_ERROR ||
+            mx_vmar_unmap(mx_vmar_root_self(), addr, kSize) != NO_ERROR) {
+            ok = false;
+            break;
+        }
+    }
+    mx_handle_close(vmo);
+    return ok;
+}
+PERFTEST_REGISTER("Vmo/MapUnmap/4KB", VmoMapUnmap<kPageSize>);
+PERFTEST_REGISTER("Vmo/MapUnmap/1MB", VmoMapUnmap<1024u * 1024u>);
+
+// Writes one byte in each page of a fresh mapping, so every page is a
+// fault which allocates and maps a zero page.  Each run creates the VMO
+// too, as a VMO keeps its pages once they are committed; subtract
+// Vmo/CreateClose and Vmo/MapUnmap of the same size for the fault cost.
+template <size_t kPages>
+bool VmoFault(perftest::RepeatState* state) {
+    constexpr size_t kSize = kPages * kPageSize;
+    while (state->KeepRunning()) {
+        mx_handle_t vmo;
+        if (mx_vmo_create(kSize, 0u, &vmo) != NO_ERROR)
+            return false;
+        uintptr_t addr;
+        mx_status_t status = mx_vmar_map(mx_vmar_root_self(), 0u, vmo, 0u, kSize,
+                                         MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &addr);
+        mx_handle_close(vmo);
+        if (status != NO_ERROR)
+            return false;
+        for (size_t i = 0; i < kPages; i++)
+            reinterpret_cast<volatile uint8_t*>(addr)[i * kPageSize] = 1u;
+        if (mx_vmar_unmap(mx_vmar_root_self(), addr, kSize) != NO_ERROR)
+            return false;
+    }
+    return true;
+}
+PERFTEST_REGISTER("Vmo/CreateMapFault/4KB", VmoFault<1>);
+PERFTEST_REGISTER("Vmo/CreateMapFault/1MB", VmoFault<256>);
+
+} // namespace
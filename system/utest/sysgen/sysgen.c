@@ -5,6 +5,7 @@
 #include <string.h>
 
 #include <magenta/syscalls.h>
+#include <magenta/syscalls/batch-ops.h>
 #include <unittest/unittest.h>
 
 static bool wrapper_test(void) {
@@ -15,8 +16,36 @@ static bool wrapper_test(void) {
     END_TEST;
 }
 
+static bool batch_test(void) {
+    BEGIN_TEST;
+    mx_batch_op_t ops[3];
+    mx_batch_op_syscall_test_2(&ops[0], 1, 2);
+    mx_batch_op_syscall_test_1(&ops[1], ERR_NO_MEMORY);
+    mx_batch_op_syscall_test_8(&ops[2], 1, 2, 3, 4, 5, 6, 7, 8);
+
+    ASSERT_EQ(mx_syscall_batch(ops, 3, 0), NO_ERROR, "");
+    EXPECT_EQ(ops[0].status, 3, "first op doesn't add up");
+    EXPECT_EQ(ops[1].status, ERR_NO_MEMORY, "second op should have failed");
+    EXPECT_EQ(ops[2].status, 36, "an error shouldn't stop the batch");
+
+    ASSERT_EQ(mx_syscall_batch(ops, 3, MX_BATCH_STOP_ON_ERROR), NO_ERROR, "");
+    EXPECT_EQ(ops[0].status, 3, "");
+    EXPECT_EQ(ops[1].status, ERR_NO_MEMORY, "");
+    EXPECT_EQ(ops[2].status, ERR_CANCELED, "op after the error should be skipped");
+
+    // Only calls that can run back to back in one trap are allowed.
+    ops[0].syscall_num = ops[2].syscall_num + 1000;
+    ASSERT_EQ(mx_syscall_batch(ops, 1, 0), NO_ERROR, "");
+    EXPECT_EQ(ops[0].status, ERR_BAD_SYSCALL, "");
+
+    EXPECT_EQ(mx_syscall_batch(ops, MX_BATCH_MAX_OPS + 1, 0), ERR_OUT_OF_RANGE, "");
+    EXPECT_EQ(mx_syscall_batch(ops, 1, ~0u), ERR_INVALID_ARGS, "");
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(launchpad_tests)
 RUN_TEST(wrapper_test);
+RUN_TEST(batch_test);
 END_TEST_CASE(launchpad_tests)
 
 int main(int argc, char **argv) {
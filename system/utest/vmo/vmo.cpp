@@ -8,11 +8,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <threads.h>
 #include <unistd.h>
 
 #include <magenta/process.h>
 #include <magenta/syscalls.h>
 #include <magenta/syscalls/object.h>
+#include <magenta/syscalls/port.h>
 #include <pretty/hexdump.h>
 #include <unittest/unittest.h>
 
@@ -414,6 +416,105 @@ bool vmo_lookup_test() {
     END_TEST;
 }
 
+bool vmo_pin_test() {
+    BEGIN_TEST;
+
+    const size_t size = 16384;
+    mx_paddr_t buf[size / PAGE_SIZE];
+    mx_paddr_t lookup[size / PAGE_SIZE];
+
+    mx_handle_t vmo;
+    EXPECT_EQ(NO_ERROR, mx_vmo_create(size, 0, &vmo), "vm_object_create");
+
+    // pinning commits the pages and hands back their addresses
+    memset(buf, 0, sizeof(buf));
+    EXPECT_EQ(NO_ERROR, mx_vmo_op_range(vmo, MX_VMO_OP_LOCK, 0, size, buf, sizeof(buf)), "pin");
+    EXPECT_EQ(NO_ERROR, mx_vmo_op_range(vmo, MX_VMO_OP_LOOKUP, 0, size, lookup, sizeof(lookup)),
+              "lookup");
+    for (size_t i = 0; i < countof(buf); i++) {
+        EXPECT_NEQ(0u, buf[i], "pinned address");
+        EXPECT_EQ(lookup[i], buf[i], "pinned address matches lookup");
+    }
+
+    // pins nest and overlap, and keep the pages in place
+    EXPECT_EQ(NO_ERROR, mx_vmo_op_range(vmo, MX_VMO_OP_LOCK, PAGE_SIZE, PAGE_SIZE, nullptr, 0),
+              "pin one page");
+    EXPECT_EQ(ERR_BAD_STATE, mx_vmo_op_range(vmo, MX_VMO_OP_DECOMMIT, 0, size, nullptr, 0),
+              "decommit pinned");
+    EXPECT_EQ(ERR_BAD_STATE, mx_vmo_set_size(vmo, PAGE_SIZE), "shrink pinned");
+    EXPECT_EQ(ERR_BUFFER_TOO_SMALL, mx_vmo_op_range(vmo, MX_VMO_OP_LOCK, 0, size, buf, 8),
+              "pin with small buffer");
+    EXPECT_EQ(ERR_OUT_OF_RANGE, mx_vmo_op_range(vmo, MX_VMO_OP_LOCK, 0, size + 1, nullptr, 0),
+              "pin out of range");
+
+    // unpinning takes the exact range that was pinned
+    EXPECT_EQ(ERR_NOT_FOUND, mx_vmo_op_range(vmo, MX_VMO_OP_UNLOCK, 0, PAGE_SIZE, nullptr, 0),
+              "unpin unknown range");
+    EXPECT_EQ(NO_ERROR, mx_vmo_op_range(vmo, MX_VMO_OP_UNLOCK, 0, size, nullptr, 0), "unpin");
+    EXPECT_EQ(ERR_BAD_STATE, mx_vmo_op_range(vmo, MX_VMO_OP_DECOMMIT, 0, size, nullptr, 0),
+              "decommit still pinned");
+    EXPECT_EQ(NO_ERROR, mx_vmo_op_range(vmo, MX_VMO_OP_DECOMMIT, 2 * PAGE_SIZE, PAGE_SIZE,
+                                        nullptr, 0), "decommit unpinned");
+    EXPECT_EQ(NO_ERROR, mx_vmo_op_range(vmo, MX_VMO_OP_UNLOCK, PAGE_SIZE, PAGE_SIZE, nullptr, 0),
+              "unpin one page");
+    EXPECT_EQ(NO_ERROR, mx_vmo_op_range(vmo, MX_VMO_OP_DECOMMIT, 0, size, nullptr, 0),
+              "decommit");
+
+    // pins still held when the handle goes away are dropped with it
+    EXPECT_EQ(NO_ERROR, mx_vmo_op_range(vmo, MX_VMO_OP_LOCK, 0, size, nullptr, 0), "pin");
+    EXPECT_EQ(NO_ERROR, mx_handle_close(vmo), "handle_close");
+
+    END_TEST;
+}
+
+bool vmo_cache_policy_test() {
+    BEGIN_TEST;
+
+    const size_t size = 4 * PAGE_SIZE;
+    mx_handle_t vmo;
+    EXPECT_EQ(NO_ERROR, mx_vmo_create(size, 0, &vmo), "vm_object_create");
+
+    // committed pages are written back before the policy changes
+    const uint32_t value = 0x12345678;
+    size_t actual;
+    EXPECT_EQ(NO_ERROR, mx_vmo_write(vmo, &value, 0, sizeof(value), &actual), "write");
+
+    EXPECT_EQ(ERR_INVALID_ARGS, mx_vmo_set_cache_policy(vmo, 0xff), "bad policy");
+    EXPECT_EQ(NO_ERROR, mx_vmo_set_cache_policy(vmo, MX_CACHE_POLICY_UNCACHED), "uncached");
+    EXPECT_EQ(NO_ERROR, mx_vmo_set_cache_policy(vmo, MX_CACHE_POLICY_WRITE_COMBINING),
+              "write combining");
+
+    uintptr_t ptr;
+    EXPECT_EQ(NO_ERROR, mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, size,
+                                    MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &ptr), "map");
+    EXPECT_EQ(value, *reinterpret_cast<volatile uint32_t*>(ptr), "read through mapping");
+    *reinterpret_cast<volatile uint32_t*>(ptr + PAGE_SIZE) = value;
+
+    // mappings have to agree, so the policy is fixed while mapped
+    EXPECT_EQ(ERR_BAD_STATE, mx_vmo_set_cache_policy(vmo, MX_CACHE_POLICY_CACHED),
+              "set while mapped");
+    EXPECT_EQ(NO_ERROR, mx_vmar_unmap(mx_vmar_root_self(), ptr, size), "unmap");
+    EXPECT_EQ(NO_ERROR, mx_vmo_set_cache_policy(vmo, MX_CACHE_POLICY_CACHED), "cached");
+
+    uint32_t readback = 0;
+    EXPECT_EQ(NO_ERROR, mx_vmo_read(vmo, &readback, PAGE_SIZE, sizeof(readback), &actual),
+              "read");
+    EXPECT_EQ(value, readback, "write through mapping landed");
+
+    // nor can it change under clones
+    mx_handle_t clone;
+    EXPECT_EQ(NO_ERROR, mx_vmo_clone(vmo, MX_VMO_CLONE_COPY_ON_WRITE, 0, size, &clone), "clone");
+    EXPECT_EQ(ERR_BAD_STATE, mx_vmo_set_cache_policy(vmo, MX_CACHE_POLICY_UNCACHED),
+              "set with clone");
+    EXPECT_EQ(ERR_BAD_STATE, mx_vmo_set_cache_policy(clone, MX_CACHE_POLICY_UNCACHED),
+              "set on clone");
+    EXPECT_EQ(NO_ERROR, mx_handle_close(clone), "handle_close");
+
+    EXPECT_EQ(NO_ERROR, mx_handle_close(vmo), "handle_close");
+
+    END_TEST;
+}
+
 bool vmo_commit_test() {
     BEGIN_TEST;
 
@@ -866,6 +967,283 @@ bool vmo_clone_test_4() {
     END_TEST;
 }
 
+// test set 5: a chain of clones whose middle has been closed still sees the right pages
+bool vmo_clone_test_5() {
+    BEGIN_TEST;
+
+    size_t handled_bytes;
+    auto read_page = [&handled_bytes](mx_handle_t vmo, size_t page) {
+        uint64_t val = 99;
+        mx_vmo_read(vmo, &val, page * PAGE_SIZE, sizeof(val), &handled_bytes);
+        return val;
+    };
+    auto write_page = [&handled_bytes](mx_handle_t vmo, size_t page, uint64_t val) {
+        return mx_vmo_write(vmo, &val, page * PAGE_SIZE, sizeof(val), &handled_bytes);
+    };
+
+    // create a vmo with a value in every page
+    mx_handle_t vmo;
+    const size_t size = PAGE_SIZE * 4;
+    EXPECT_EQ(NO_ERROR, mx_vmo_create(size, 0, &vmo), "vm_object_create");
+    for (size_t i = 0; i < 4; i++)
+        EXPECT_EQ(NO_ERROR, write_page(vmo, i, i + 1), "writing to original");
+
+    // clone it and copy-on-write one page of the clone
+    mx_handle_t clone;
+    EXPECT_EQ(NO_ERROR, mx_vmo_clone(vmo, MX_VMO_CLONE_COPY_ON_WRITE, 0, size, &clone), "vm_clone");
+    EXPECT_EQ(NO_ERROR, write_page(clone, 1, 20), "writing to clone");
+
+    // clone the clone one page in, so its last page hangs off the end of the first clone
+    mx_handle_t clone2;
+    EXPECT_EQ(NO_ERROR, mx_vmo_clone(clone, MX_VMO_CLONE_COPY_ON_WRITE, PAGE_SIZE, size, &clone2),
+              "vm_clone");
+
+    // drop the middle of the chain, it now only lives on through the second clone
+    EXPECT_EQ(NO_ERROR, mx_handle_close(clone), "handle_close");
+
+    EXPECT_EQ(20u, read_page(clone2, 0), "page copied into the first clone");
+    EXPECT_EQ(3u, read_page(clone2, 1), "page from the original");
+    EXPECT_EQ(4u, read_page(clone2, 2), "page from the original");
+    EXPECT_EQ(0u, read_page(clone2, 3), "page past the end of the first clone");
+
+    // writes to the original still show through, except past the end of the first clone
+    EXPECT_EQ(NO_ERROR, write_page(vmo, 2, 33), "writing to original");
+    EXPECT_EQ(NO_ERROR, mx_vmo_set_size(vmo, size * 2), "extend the vmo");
+    EXPECT_EQ(NO_ERROR, write_page(vmo, 4, 55), "writing to original");
+    EXPECT_EQ(33u, read_page(clone2, 1), "modified page from the original");
+    EXPECT_EQ(0u, read_page(clone2, 3), "page past the end of the first clone");
+
+    EXPECT_EQ(NO_ERROR, mx_handle_close(vmo), "handle_close");
+    EXPECT_EQ(NO_ERROR, mx_handle_close(clone2), "handle_close");
+
+    END_TEST;
+}
+
+bool vmo_discardable_test() {
+    BEGIN_TEST;
+
+    mx_handle_t vmo;
+    const size_t size = PAGE_SIZE * 4;
+    EXPECT_EQ(NO_ERROR, mx_vmo_create(size, MX_VMO_DISCARDABLE, &vmo), "vm_object_create");
+
+    // discardable objects start out unlocked
+    EXPECT_EQ(ERR_BAD_STATE, mx_vmo_op_range(vmo, MX_VMO_OP_UNLOCK, 0, size, nullptr, 0),
+              "unlock while unlocked");
+
+    // nothing has been committed, so nothing can have been discarded
+    uint32_t discarded = 99;
+    EXPECT_EQ(NO_ERROR, mx_vmo_op_range(vmo, MX_VMO_OP_LOCK, 0, size, &discarded,
+                                        sizeof(discarded)), "lock");
+    EXPECT_EQ(0u, discarded, "not discarded");
+
+    // locks nest
+    EXPECT_EQ(NO_ERROR, mx_vmo_op_range(vmo, MX_VMO_OP_LOCK, 0, size, nullptr, 0), "lock again");
+
+    // the contents stay put while locked
+    size_t val = 42;
+    size_t handled_bytes = 0;
+    EXPECT_EQ(NO_ERROR, mx_vmo_write(vmo, &val, 0, sizeof(val), &handled_bytes), "write");
+    val = 0;
+    EXPECT_EQ(NO_ERROR, mx_vmo_read(vmo, &val, 0, sizeof(val), &handled_bytes), "read");
+    EXPECT_EQ(42u, val, "read back");
+
+    // a lock with too small a buffer fails and leaves the count alone
+    uint8_t small;
+    EXPECT_EQ(ERR_INVALID_ARGS, mx_vmo_op_range(vmo, MX_VMO_OP_LOCK, 0, size, &small,
+                                                sizeof(small)), "lock with small buffer");
+
+    EXPECT_EQ(NO_ERROR, mx_vmo_op_range(vmo, MX_VMO_OP_UNLOCK, 0, size, nullptr, 0), "unlock");
+    EXPECT_EQ(NO_ERROR, mx_vmo_op_range(vmo, MX_VMO_OP_UNLOCK, 0, size, nullptr, 0), "unlock");
+    EXPECT_EQ(ERR_BAD_STATE, mx_vmo_op_range(vmo, MX_VMO_OP_UNLOCK, 0, size, nullptr, 0),
+              "unlock while unlocked");
+
+    // discardable objects can't be cloned
+    mx_handle_t clone;
+    EXPECT_EQ(ERR_NOT_SUPPORTED, mx_vmo_clone(vmo, MX_VMO_CLONE_COPY_ON_WRITE, 0, size, &clone),
+              "clone");
+
+    EXPECT_EQ(NO_ERROR, mx_handle_close(vmo), "handle_close");
+
+    END_TEST;
+}
+
+bool vmo_numa_options_test() {
+    BEGIN_TEST;
+
+    mx_handle_t vmo;
+    const size_t size = PAGE_SIZE * 4;
+
+    // placement options work on any machine, even one with a single node
+    const uint32_t valid_options[] = {
+        MX_VMO_NUMA_INTERLEAVE,
+        MX_VMO_NUMA_NODE(0),
+        MX_VMO_NUMA_NODE(1),
+        MX_VMO_NUMA_NODE(0) | MX_VMO_DISCARDABLE,
+    };
+    for (uint32_t options : valid_options) {
+        EXPECT_EQ(NO_ERROR, mx_vmo_create(size, options, &vmo), "vm_object_create");
+
+        size_t val = 42;
+        size_t handled_bytes = 0;
+        EXPECT_EQ(NO_ERROR, mx_vmo_write(vmo, &val, PAGE_SIZE, sizeof(val), &handled_bytes),
+                  "write");
+        val = 0;
+        EXPECT_EQ(NO_ERROR, mx_vmo_read(vmo, &val, PAGE_SIZE, sizeof(val), &handled_bytes),
+                  "read");
+        EXPECT_EQ(42u, val, "read back");
+        EXPECT_EQ(NO_ERROR, mx_vmo_read(vmo, &val, 0, sizeof(val), &handled_bytes), "read");
+        EXPECT_EQ(0u, val, "untouched page is zero");
+
+        EXPECT_EQ(NO_ERROR, mx_vmo_op_range(vmo, MX_VMO_OP_COMMIT, 0, size, nullptr, 0),
+                  "commit");
+        EXPECT_EQ(NO_ERROR, mx_handle_close(vmo), "handle_close");
+    }
+
+    const uint32_t invalid_options[] = {
+        MX_VMO_NUMA_INTERLEAVE | MX_VMO_NUMA_NODE(0),
+        MX_VMO_NUMA_NODE(200),
+        1u << MX_VMO_NUMA_NODE_SHIFT,
+    };
+    for (uint32_t options : invalid_options) {
+        EXPECT_EQ(ERR_INVALID_ARGS, mx_vmo_create(size, options, &vmo), "vm_object_create");
+    }
+
+    END_TEST;
+}
+
+bool vmo_memory_pressure_event_test() {
+    BEGIN_TEST;
+
+    EXPECT_EQ(ERR_INVALID_ARGS, mx_system_get_memory_pressure_event(1u, nullptr), "bad options");
+
+    mx_handle_t event;
+    EXPECT_EQ(NO_ERROR, mx_system_get_memory_pressure_event(0u, &event), "get event");
+
+    // whichever state it is in, it can be waited on
+    mx_signals_t pending;
+    mx_status_t status = mx_object_wait_one(event, MX_EVENT_SIGNALED, 0u, &pending);
+    EXPECT_TRUE(status == NO_ERROR || status == ERR_TIMED_OUT, "wait");
+
+    // but only the kernel gets to signal it
+    EXPECT_EQ(ERR_ACCESS_DENIED, mx_object_signal(event, 0u, MX_EVENT_SIGNALED), "signal");
+
+    EXPECT_EQ(NO_ERROR, mx_handle_close(event), "handle_close");
+
+    END_TEST;
+}
+
+bool vmo_copy_test() {
+    BEGIN_TEST;
+
+    const size_t size = PAGE_SIZE * 4;
+    mx_handle_t src, dst;
+    EXPECT_EQ(NO_ERROR, mx_vmo_create(size, 0, &src), "vm_object_create");
+    EXPECT_EQ(NO_ERROR, mx_vmo_create(size, 0, &dst), "vm_object_create");
+
+    uint8_t buf[PAGE_SIZE * 4];
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        buf[i] = static_cast<uint8_t>(i * 7 + 1);
+    }
+    size_t actual;
+    EXPECT_EQ(NO_ERROR, mx_vmo_write(src, buf, 0, 3 * PAGE_SIZE, &actual), "write");
+
+    // whole pages into uncommitted ones, with the last source page a hole
+    EXPECT_EQ(NO_ERROR, mx_vmo_copy(src, 0, dst, 0, size), "copy");
+    uint8_t out[PAGE_SIZE * 4];
+    EXPECT_EQ(NO_ERROR, mx_vmo_read(dst, out, 0, size, &actual), "read");
+    EXPECT_EQ(0, memcmp(out, buf, 3 * PAGE_SIZE), "copied pages");
+    for (size_t i = 3 * PAGE_SIZE; i < size; i++) {
+        EXPECT_EQ(0, out[i], "hole copied as zeros");
+    }
+
+    // unaligned, straddling page boundaries on both sides
+    EXPECT_EQ(NO_ERROR, mx_vmo_copy(src, 100, dst, PAGE_SIZE + 3000, PAGE_SIZE + 50), "copy");
+    EXPECT_EQ(NO_ERROR, mx_vmo_read(dst, out, PAGE_SIZE + 3000, PAGE_SIZE + 50, &actual), "read");
+    EXPECT_EQ(0, memcmp(out, buf + 100, PAGE_SIZE + 50), "unaligned copy");
+
+    // within one vmo, but not overlapping
+    EXPECT_EQ(NO_ERROR, mx_vmo_copy(src, 0, src, 2 * PAGE_SIZE, PAGE_SIZE), "self copy");
+    EXPECT_EQ(ERR_INVALID_ARGS, mx_vmo_copy(src, 0, src, 100, PAGE_SIZE), "overlap");
+
+    EXPECT_EQ(ERR_OUT_OF_RANGE, mx_vmo_copy(src, PAGE_SIZE, dst, 0, size), "past end");
+
+    // the destination needs write rights
+    mx_handle_t ro;
+    EXPECT_EQ(NO_ERROR, mx_handle_duplicate(dst, MX_RIGHT_READ, &ro), "duplicate");
+    EXPECT_EQ(ERR_ACCESS_DENIED, mx_vmo_copy(src, 0, ro, 0, PAGE_SIZE), "read only dst");
+
+    EXPECT_EQ(NO_ERROR, mx_handle_close(ro), "handle_close");
+    EXPECT_EQ(NO_ERROR, mx_handle_close(src), "handle_close");
+    EXPECT_EQ(NO_ERROR, mx_handle_close(dst), "handle_close");
+
+    END_TEST;
+}
+
+static int pager_reader_thread(void* arg) {
+    // faults on the pager vmo's second page, which isn't there until supplied
+    const volatile uint8_t* p = static_cast<const volatile uint8_t*>(arg);
+    return p[PAGE_SIZE + 5];
+}
+
+bool vmo_pager_test() {
+    BEGIN_TEST;
+
+    mx_handle_t port;
+    ASSERT_EQ(NO_ERROR, mx_port_create(MX_PORT_OPT_V2, &port), "port_create");
+    mx_handle_t vmo;
+    ASSERT_EQ(NO_ERROR, mx_pager_vmo_create(port, 42u, PAGE_SIZE * 4, 0, &vmo),
+              "pager_vmo_create");
+    EXPECT_EQ(ERR_NOT_SUPPORTED, mx_vmo_op_range(vmo, MX_VMO_OP_COMMIT, 0, PAGE_SIZE, nullptr, 0),
+              "commit");
+
+    uintptr_t ptr;
+    ASSERT_EQ(NO_ERROR, mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, PAGE_SIZE * 4,
+                                    MX_VM_FLAG_PERM_READ, &ptr), "map");
+
+    thrd_t thread;
+    ASSERT_EQ(thrd_success, thrd_create(&thread, pager_reader_thread, (void*)ptr),
+              "thrd_create");
+
+    mx_port_packet_t packet;
+    ASSERT_EQ(NO_ERROR, mx_port_wait(port, MX_TIME_INFINITE, &packet, sizeof(packet)),
+              "port_wait");
+    EXPECT_EQ(42u, packet.key, "key");
+    EXPECT_EQ(MX_PKT_TYPE_PAGE_REQUEST, packet.type, "type");
+    EXPECT_EQ(static_cast<uint64_t>(PAGE_SIZE), packet.page_request.offset, "offset");
+    EXPECT_EQ(static_cast<uint64_t>(PAGE_SIZE), packet.page_request.length, "length");
+
+    // fill the page in a vmo of our own and move it over
+    mx_handle_t aux;
+    ASSERT_EQ(NO_ERROR, mx_vmo_create(PAGE_SIZE, 0, &aux), "vmo_create");
+    uint8_t buf[PAGE_SIZE];
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        buf[i] = static_cast<uint8_t>(i * 3 + 1);
+    }
+    size_t actual;
+    EXPECT_EQ(NO_ERROR, mx_vmo_write(aux, buf, 0, sizeof(buf), &actual), "write");
+    EXPECT_EQ(ERR_NOT_SUPPORTED, mx_pager_supply_pages(aux, 0, PAGE_SIZE, vmo, 0),
+              "supply to a plain vmo");
+    EXPECT_EQ(NO_ERROR, mx_pager_supply_pages(vmo, PAGE_SIZE, PAGE_SIZE, aux, 0), "supply");
+
+    int result;
+    EXPECT_EQ(thrd_success, thrd_join(thread, &result), "thrd_join");
+    EXPECT_EQ(buf[5], result, "faulted data");
+
+    // the page moved, so the aux vmo is empty again and the data stays put
+    uint8_t out[PAGE_SIZE];
+    EXPECT_EQ(NO_ERROR, mx_vmo_read(aux, out, 0, sizeof(out), &actual), "read aux");
+    EXPECT_EQ(0, out[5], "aux page moved out");
+    EXPECT_EQ(NO_ERROR, mx_vmo_read(vmo, out, PAGE_SIZE, sizeof(out), &actual), "read");
+    EXPECT_EQ(0, memcmp(out, buf, sizeof(out)), "supplied page");
+
+    EXPECT_EQ(NO_ERROR, mx_vmar_unmap(mx_vmar_root_self(), ptr, PAGE_SIZE * 4), "unmap");
+    EXPECT_EQ(NO_ERROR, mx_handle_close(aux), "handle_close");
+    EXPECT_EQ(NO_ERROR, mx_handle_close(vmo), "handle_close");
+    EXPECT_EQ(NO_ERROR, mx_handle_close(port), "handle_close");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(vmo_tests)
 RUN_TEST(vmo_create_test);
 RUN_TEST(vmo_read_write_test);
@@ -874,12 +1252,20 @@ RUN_TEST(vmo_read_only_map_test);
 RUN_TEST(vmo_resize_test);
 RUN_TEST(vmo_rights_test);
 RUN_TEST(vmo_lookup_test);
+RUN_TEST(vmo_pin_test);
+RUN_TEST(vmo_cache_policy_test);
 RUN_TEST(vmo_commit_test);
 RUN_TEST(vmo_zero_page_test);
 RUN_TEST(vmo_clone_test_1);
 RUN_TEST(vmo_clone_test_2);
 RUN_TEST(vmo_clone_test_3);
 RUN_TEST(vmo_clone_test_4);
+RUN_TEST(vmo_clone_test_5);
+RUN_TEST(vmo_discardable_test);
+RUN_TEST(vmo_numa_options_test);
+RUN_TEST(vmo_memory_pressure_event_test);
+RUN_TEST(vmo_copy_test);
+RUN_TEST(vmo_pager_test);
 END_TEST_CASE(vmo_tests)
 
 int main(int argc, char** argv) {
@@ -16,6 +16,8 @@
 #include <unistd.h>
 
 #include <magenta/syscalls.h>
+#include <mxio/io.h>
+#include <mxio/vfs.h>
 #include <pretty/hexdump.h>
 
 int mxc_dump(int argc, char** argv) {
@@ -102,6 +104,32 @@ int mxc_ls(int argc, char** argv) {
         printf("%s %8jd %s\n", modestr(s.st_mode), (intmax_t)s.st_size, dirn);
         return 0;
     }
+    // Ask for the attributes along with the names, and only fall back to a
+    // stat() per entry if the filesystem can't provide them.
+    uint64_t buf[MXIO_CHUNK_SIZE / sizeof(uint64_t)];
+    ssize_t len = mxio_readdir_plus(dirfd(dir), buf, sizeof(buf), true);
+    if (len != ERR_NOT_SUPPORTED) {
+        while (len > 0) {
+            for (ssize_t off = 0; off < len;) {
+                vdirent_plus_t* vde = (vdirent_plus_t*)((char*)buf + off);
+                memset(&s, 0, sizeof(struct stat));
+                s.st_mode = vde->attr.mode;
+                s.st_size = vde->attr.size;
+                s.st_nlink = vde->attr.nlink;
+                if ((vde->attr.mode == 0) &&
+                    ((strlen(vde->name) + dirln + 2) <= sizeof(tmp))) {
+                    snprintf(tmp, sizeof(tmp), "%s/%s", dirn, vde->name);
+                    stat(tmp, &s);
+                }
+                printf("%s %2ju %8jd %s\n", modestr(s.st_mode), s.st_nlink,
+                       (intmax_t)s.st_size, vde->name);
+                off += vde->size;
+            }
+            len = mxio_readdir_plus(dirfd(dir), buf, sizeof(buf), false);
+        }
+        closedir(dir);
+        return 0;
+    }
     while((de = readdir(dir)) != NULL) {
         memset(&s, 0, sizeof(struct stat));
         if ((strlen(de->d_name) + dirln + 2) <= sizeof(tmp)) {
@@ -201,6 +201,60 @@ const z_crc_t FAR * ZEXPORT get_crc_table()
 #define DO1 crc = crc_table[0][((int)crc ^ (*buf++)) & 0xff] ^ (crc >> 8)
 #define DO8 DO1; DO1; DO1; DO1; DO1; DO1; DO1; DO1
 
+/* ========================================================================= */
+/* ARMv8 CRC32 instructions.  On Magenta the vDSO says whether the CPU has
+   them; elsewhere they're only used when the build targets them. */
+#if defined(__aarch64__) && \
+    (defined(__ARM_FEATURE_CRC32) || defined(__Fuchsia__))
+#define HAVE_ARMV8_CRC32
+#include <arm_acle.h>
+#include <string.h>
+#ifndef __ARM_FEATURE_CRC32
+#include <magenta/features.h>
+#include <magenta/syscalls.h>
+#endif
+
+local int armv8_crc32_supported(void)
+{
+#ifdef __ARM_FEATURE_CRC32
+    return 1;
+#else
+    /* 0 until checked, then 1 for no and 2 for yes */
+    static int supported;
+    int cached = __atomic_load_n(&supported, __ATOMIC_RELAXED);
+    if (cached == 0) {
+        uint32_t features = 0;
+        if (mx_system_get_features(MX_FEATURE_KIND_CPU, &features) != NO_ERROR)
+            features = 0;
+        cached = (features & MX_ARM64_FEATURE_ISA_CRC32) ? 2 : 1;
+        __atomic_store_n(&supported, cached, __ATOMIC_RELAXED);
+    }
+    return cached == 2;
+#endif
+}
+
+__attribute__((target("+crc")))
+local unsigned long crc32_armv8(unsigned long crc,
+                                const unsigned char FAR *buf, uInt len)
+{
+    uint32_t c = (uint32_t)crc ^ 0xffffffffU;
+    while (len && ((uintptr_t)buf & 7)) {
+        c = __crc32b(c, *buf++);
+        len--;
+    }
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, buf, sizeof(word));
+        c = __crc32d(c, word);
+        buf += 8;
+        len -= 8;
+    }
+    while (len--)
+        c = __crc32b(c, *buf++);
+    return c ^ 0xffffffffUL;
+}
+#endif
+
 /* ========================================================================= */
 unsigned long ZEXPORT crc32(crc, buf, len)
     unsigned long crc;
@@ -214,6 +268,11 @@ unsigned long ZEXPORT crc32(crc, buf, len)
         make_crc_table();
 #endif /* DYNAMIC_CRC_TABLE */
 
+#ifdef HAVE_ARMV8_CRC32
+    if (armv8_crc32_supported())
+        return crc32_armv8(crc, buf, len);
+#endif
+
 #ifdef BYFOUR
     if (sizeof(void *) == sizeof(ptrdiff_t)) {
         z_crc_t endian;
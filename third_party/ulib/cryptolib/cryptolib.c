@@ -108,85 +108,274 @@ int clEqual(const uint8_t* a, int a_len, const uint8_t* b, int b_len) {
 
 // SHA256 code section ==================================================
 
-static void _SHA256_transform(clHASH_CTX* ctx) {
-  static const uint32_t _SHA256_K[64] = {
-    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
-    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
-    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
-    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
-    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
-    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
-    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
-    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
-    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
-    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
-    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
-    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
-    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
-    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
-    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
-    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
-
+static const uint32_t _SHA256_K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+  0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+  0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+  0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+  0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+  0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+
+static void _SHA256_blocks_generic(uint32_t* state, const uint8_t* p, size_t nblocks) {
 #define _ROR(value, bits) (((value) >> (bits)) | ((value) << (32 - (bits))))
 #define _SHR(value, bits) ((value) >> (bits))
 
   uint32_t W[64];
   uint32_t A, B, C, D, E, F, G, H;
-  const uint8_t* p = ctx->buf;
   int t;
 
-  for(t = 0; t < 16; ++t) {
-    uint32_t tmp =  *p++ << 24;
-    tmp |= *p++ << 16;
-    tmp |= *p++ << 8;
-    tmp |= *p++;
-    W[t] = tmp;
+  while (nblocks--) {
+    for(t = 0; t < 16; ++t) {
+      uint32_t tmp =  *p++ << 24;
+      tmp |= *p++ << 16;
+      tmp |= *p++ << 8;
+      tmp |= *p++;
+      W[t] = tmp;
+    }
+
+    for(; t < 64; t++) {
+      uint32_t s0 = _ROR(W[t-15], 7) ^ _ROR(W[t-15], 18) ^ _SHR(W[t-15], 3);
+      uint32_t s1 = _ROR(W[t-2], 17) ^ _ROR(W[t-2], 19) ^ _SHR(W[t-2], 10);
+      W[t] = W[t-16] + s0 + W[t-7] + s1;
+    }
+
+    A = state[0];
+    B = state[1];
+    C = state[2];
+    D = state[3];
+    E = state[4];
+    F = state[5];
+    G = state[6];
+    H = state[7];
+
+    for(t = 0; t < 64; t++) {
+      uint32_t s0 = _ROR(A, 2) ^ _ROR(A, 13) ^ _ROR(A, 22);
+      uint32_t maj = (A & B) ^ (A & C) ^ (B & C);
+      uint32_t t2 = s0 + maj;
+      uint32_t s1 = _ROR(E, 6) ^ _ROR(E, 11) ^ _ROR(E, 25);
+      uint32_t ch = (E & F) ^ ((~E) & G);
+      uint32_t t1 = H + s1 + ch + _SHA256_K[t] + W[t];
+
+      H = G;
+      G = F;
+      F = E;
+      E = D + t1;
+      D = C;
+      C = B;
+      B = A;
+      A = t1 + t2;
+    }
+
+    state[0] += A;
+    state[1] += B;
+    state[2] += C;
+    state[3] += D;
+    state[4] += E;
+    state[5] += F;
+    state[6] += G;
+    state[7] += H;
   }
 
-  for(; t < 64; t++) {
-    uint32_t s0 = _ROR(W[t-15], 7) ^ _ROR(W[t-15], 18) ^ _SHR(W[t-15], 3);
-    uint32_t s1 = _ROR(W[t-2], 17) ^ _ROR(W[t-2], 19) ^ _SHR(W[t-2], 10);
-    W[t] = W[t-16] + s0 + W[t-7] + s1;
+#undef _SHR
+#undef _ROR
+}
+
+// The SHA extensions need the vector registers, which the kernel doesn't
+// touch; it always uses the generic code.
+#if defined(__x86_64__) && !defined(_KERNEL)
+#define _SHA256_HAVE_SHANI 1
+#include <cpuid.h>
+#include <immintrin.h>
+
+// Intel SHA extensions. Each sha256rnds2 does two rounds, on the state split
+// into ABEF and CDGH halves; sha256msg1/msg2 extend the message schedule four
+// words at a time.
+__attribute__((target("sha,sse4.1")))
+static void _SHA256_blocks_shani(uint32_t* state, const uint8_t* p, size_t nblocks) {
+  const __m128i kByteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  __m128i msg[4];
+  __m128i tmp, abef, cdgh, abef_save, cdgh_save;
+  int r;
+
+  tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) &state[0]), 0xB1);  // CDAB
+  cdgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) &state[4]), 0x1B); // HGFE
+  abef = _mm_alignr_epi8(tmp, cdgh, 8);
+  cdgh = _mm_blend_epi16(cdgh, tmp, 0xF0);
+
+  while (nblocks--) {
+    abef_save = abef;
+    cdgh_save = cdgh;
+    for (r = 0; r < 4; ++r) {
+      msg[r] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (p + r * 16)), kByteSwap);
+    }
+    for (r = 0; r < 16; ++r) {
+      tmp = _mm_add_epi32(msg[r & 3], _mm_loadu_si128((const __m128i*) &_SHA256_K[r * 4]));
+      cdgh = _mm_sha256rnds2_epu32(cdgh, abef, tmp);
+      abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(tmp, 0x0E));
+      if (r < 12) {
+        // W[r+4] from W[r..r+3], one group of four words each
+        tmp = _mm_sha256msg1_epu32(msg[r & 3], msg[(r + 1) & 3]);
+        tmp = _mm_add_epi32(tmp, _mm_alignr_epi8(msg[(r + 3) & 3], msg[(r + 2) & 3], 4));
+        msg[r & 3] = _mm_sha256msg2_epu32(tmp, msg[(r + 3) & 3]);
+      }
+    }
+    abef = _mm_add_epi32(abef, abef_save);
+    cdgh = _mm_add_epi32(cdgh, cdgh_save);
+    p += 64;
   }
 
-  A = ctx->state[0];
-  B = ctx->state[1];
-  C = ctx->state[2];
-  D = ctx->state[3];
-  E = ctx->state[4];
-  F = ctx->state[5];
-  G = ctx->state[6];
-  H = ctx->state[7];
-
-  for(t = 0; t < 64; t++) {
-    uint32_t s0 = _ROR(A, 2) ^ _ROR(A, 13) ^ _ROR(A, 22);
-    uint32_t maj = (A & B) ^ (A & C) ^ (B & C);
-    uint32_t t2 = s0 + maj;
-    uint32_t s1 = _ROR(E, 6) ^ _ROR(E, 11) ^ _ROR(E, 25);
-    uint32_t ch = (E & F) ^ ((~E) & G);
-    uint32_t t1 = H + s1 + ch + _SHA256_K[t] + W[t];
-
-    H = G;
-    G = F;
-    F = E;
-    E = D + t1;
-    D = C;
-    C = B;
-    B = A;
-    A = t1 + t2;
+  tmp = _mm_shuffle_epi32(abef, 0x1B);  // FEBA
+  cdgh = _mm_shuffle_epi32(cdgh, 0xB1); // DCHG
+  _mm_storeu_si128((__m128i*) &state[0], _mm_blend_epi16(tmp, cdgh, 0xF0)); // DCBA
+  _mm_storeu_si128((__m128i*) &state[4], _mm_alignr_epi8(cdgh, tmp, 8));    // HGFE
+}
+
+static int _SHA256_shani_supported(void) {
+  // 0 until checked, then 1 for no and 2 for yes
+  static int supported;
+  int cached = __atomic_load_n(&supported, __ATOMIC_RELAXED);
+  if (cached == 0) {
+    unsigned int eax, ebx, ecx, edx;
+    int sse41 = 0, sha = 0;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+      sse41 = (ecx & bit_SSE4_1) != 0;
+    }
+    if (__get_cpuid_max(0, NULL) >= 7) {
+      __cpuid_count(7, 0, eax, ebx, ecx, edx);
+      sha = (ebx & (1u << 29)) != 0;
+    }
+    cached = (sse41 && sha) ? 2 : 1;
+    __atomic_store_n(&supported, cached, __ATOMIC_RELAXED);
+  }
+  return cached == 2;
+}
+#endif // __x86_64__ && !_KERNEL
+
+// ARMv8 crypto extensions. On Magenta the vDSO says whether the CPU has
+// them; elsewhere they're only used when the build targets them.
+#if defined(__aarch64__) && !defined(_KERNEL) && \
+    (defined(__ARM_FEATURE_CRYPTO) || defined(__Fuchsia__))
+#define _SHA256_HAVE_ARMCE 1
+#include <arm_neon.h>
+#if !defined(__ARM_FEATURE_CRYPTO)
+#include <magenta/features.h>
+#include <magenta/syscalls.h>
+#endif
+
+__attribute__((target("+crypto")))
+static void _SHA256_blocks_armce(uint32_t* state, const uint8_t* p, size_t nblocks) {
+  uint32x4_t msg[4];
+  uint32x4_t tmp, abcd, efgh, abcd_save, efgh_save;
+  int r;
+
+  abcd = vld1q_u32(&state[0]);
+  efgh = vld1q_u32(&state[4]);
+
+  while (nblocks--) {
+    abcd_save = abcd;
+    efgh_save = efgh;
+    for (r = 0; r < 4; ++r) {
+      msg[r] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(p + r * 16)));
+    }
+    for (r = 0; r < 16; ++r) {
+      uint32x4_t abcd_prev = abcd;
+      tmp = vaddq_u32(msg[r & 3], vld1q_u32(&_SHA256_K[r * 4]));
+      abcd = vsha256hq_u32(abcd, efgh, tmp);
+      efgh = vsha256h2q_u32(efgh, abcd_prev, tmp);
+      if (r < 12) {
+        // W[r+4] from W[r..r+3], one group of four words each
+        msg[r & 3] = vsha256su0q_u32(msg[r & 3], msg[(r + 1) & 3]);
+        msg[r & 3] = vsha256su1q_u32(msg[r & 3], msg[(r + 2) & 3], msg[(r + 3) & 3]);
+      }
+    }
+    abcd = vaddq_u32(abcd, abcd_save);
+    efgh = vaddq_u32(efgh, efgh_save);
+    p += 64;
   }
 
-  ctx->state[0] += A;
-  ctx->state[1] += B;
-  ctx->state[2] += C;
-  ctx->state[3] += D;
-  ctx->state[4] += E;
-  ctx->state[5] += F;
-  ctx->state[6] += G;
-  ctx->state[7] += H;
+  vst1q_u32(&state[0], abcd);
+  vst1q_u32(&state[4], efgh);
+}
 
-#undef _SHR
-#undef _ROR
+static int _SHA256_armce_supported(void) {
+#if defined(__ARM_FEATURE_CRYPTO)
+  return 1;
+#else
+  // 0 until checked, then 1 for no and 2 for yes
+  static int supported;
+  int cached = __atomic_load_n(&supported, __ATOMIC_RELAXED);
+  if (cached == 0) {
+    uint32_t features = 0;
+    if (mx_system_get_features(MX_FEATURE_KIND_CPU, &features) != NO_ERROR) {
+      features = 0;
+    }
+    cached = (features & MX_ARM64_FEATURE_ISA_SHA2) ? 2 : 1;
+    __atomic_store_n(&supported, cached, __ATOMIC_RELAXED);
+  }
+  return cached == 2;
+#endif
+}
+#endif // __aarch64__ && !_KERNEL
+
+// Runs the compression function over |nblocks| whole 64 byte blocks at |p|.
+static void _SHA256_blocks(uint32_t* state, const uint8_t* p, size_t nblocks) {
+#if _SHA256_HAVE_SHANI
+  if (_SHA256_shani_supported()) {
+    _SHA256_blocks_shani(state, p, nblocks);
+    return;
+  }
+#endif
+#if _SHA256_HAVE_ARMCE
+  if (_SHA256_armce_supported()) {
+    _SHA256_blocks_armce(state, p, nblocks);
+    return;
+  }
+#endif
+  _SHA256_blocks_generic(state, p, nblocks);
+}
+
+static void _SHA256_transform(clHASH_CTX* ctx) {
+  _SHA256_blocks(ctx->state, ctx->buf, 1);
+}
+
+// Like _HASH_update, but whole blocks are compressed straight from |data|
+// rather than being copied through ctx->buf a byte at a time.
+static void _SHA256_update(clHASH_CTX* ctx, const void* data, int len) {
+  int i = (int) (ctx->count & 63);
+  const uint8_t* p = (const uint8_t*)data;
+  size_t nblocks;
+
+  ctx->count += len;
+
+  if (i != 0) {
+    int fill = 64 - i;
+    if (len < fill) {
+      memcpy(ctx->buf + i, p, len);
+      return;
+    }
+    memcpy(ctx->buf + i, p, fill);
+    _SHA256_blocks(ctx->state, ctx->buf, 1);
+    p += fill;
+    len -= fill;
+  }
+
+  nblocks = (size_t) len / 64;
+  if (nblocks != 0) {
+    _SHA256_blocks(ctx->state, p, nblocks);
+    p += nblocks * 64;
+    len -= (int) (nblocks * 64);
+  }
+  memcpy(ctx->buf, p, len);
 }
 
 const uint8_t* clSHA256(const void* data, int len, uint8_t* digest) {
@@ -209,7 +398,7 @@ static const uint8_t kExpectedPadRsa2kSha256[clSHA256_DIGEST_SIZE] = {
 
 static const clHASH_vtab _SHA256_vtab = {
   clSHA256_init,
-  _HASH_update,
+  _SHA256_update,
   _HASH_final,
   _SHA256_transform,
   clSHA256_DIGEST_SIZE,
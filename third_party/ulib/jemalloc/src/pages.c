@@ -5,6 +5,12 @@
 #include <sys/sysctl.h>
 #endif
 
+#ifdef __Fuchsia__
+#include <magenta/process.h>
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/object.h>
+#endif
+
 /******************************************************************************/
 /* Data. */
 
@@ -15,8 +21,214 @@ static int	mmap_flags;
 #endif
 static bool	os_overcommits;
 
+#ifdef __Fuchsia__
+/*
+ * Every mapping made by pages_map() is backed by its own VMO.  Magenta can
+ * only return pages to the system through the VMO that holds them, so the
+ * VMO handles are kept in a table sorted by base address, which is what lets
+ * pages_purge_forced() decommit an arbitrary range of an existing mapping.
+ */
+typedef struct {
+	uintptr_t	base;
+	size_t		size;
+	uint64_t	offset;	/* Offset of base within vmo. */
+	mx_handle_t	vmo;
+} pages_region_t;
+
+static pthread_mutex_t	pages_regions_lock = PTHREAD_MUTEX_INITIALIZER;
+static pages_region_t	*pages_regions;
+static size_t		pages_nregions;
+static size_t		pages_regions_max;
+#endif
+
 /******************************************************************************/
 
+#ifdef __Fuchsia__
+/* Index of the first region that ends after addr.  Requires the lock. */
+static size_t
+pages_region_find(uintptr_t addr)
+{
+	size_t lo = 0, hi = pages_nregions;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const pages_region_t *r = &pages_regions[mid];
+
+		if (r->base + r->size <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return (lo);
+}
+
+/* Open a gap at index i in the table.  Requires the lock. */
+static bool
+pages_region_insert(size_t i)
+{
+	if (pages_nregions == pages_regions_max) {
+		/*
+		 * The table lives in a mapping of its own that is not
+		 * tracked in itself; growing it re-maps and copies.
+		 */
+		size_t max = pages_regions_max == 0 ? PAGE /
+		    sizeof(pages_region_t) : pages_regions_max * 2;
+		size_t size = PAGE_CEILING(max * sizeof(pages_region_t));
+		mx_handle_t vmo;
+		uintptr_t ptr;
+
+		if (_mx_vmo_create(size, 0, &vmo) != NO_ERROR)
+			return (true);
+		mx_status_t status = _mx_vmar_map(_mx_vmar_root_self(), 0, vmo,
+		    0, size, MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE,
+		    &ptr);
+		_mx_handle_close(vmo);
+		if (status != NO_ERROR)
+			return (true);
+		if (pages_regions != NULL) {
+			memcpy((void *)ptr, pages_regions,
+			    pages_nregions * sizeof(pages_region_t));
+			_mx_vmar_unmap(_mx_vmar_root_self(),
+			    (uintptr_t)pages_regions, PAGE_CEILING(
+			    pages_regions_max * sizeof(pages_region_t)));
+		}
+		pages_regions = (pages_region_t *)ptr;
+		pages_regions_max = size / sizeof(pages_region_t);
+	}
+	memmove(&pages_regions[i + 1], &pages_regions[i],
+	    (pages_nregions - i) * sizeof(pages_region_t));
+	pages_nregions++;
+	return (false);
+}
+
+static void
+pages_region_remove(size_t i)
+{
+	pages_nregions--;
+	memmove(&pages_regions[i], &pages_regions[i + 1],
+	    (pages_nregions - i) * sizeof(pages_region_t));
+}
+
+static void *
+pages_map_fuchsia(void *addr, size_t size)
+{
+	uint32_t flags = MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE;
+	size_t offset = 0;
+	mx_handle_t vmo;
+	uintptr_t ptr;
+
+	if (addr != NULL) {
+		mx_info_vmar_t info;
+
+		if (_mx_object_get_info(_mx_vmar_root_self(), MX_INFO_VMAR,
+		    &info, sizeof(info), NULL, NULL) != NO_ERROR ||
+		    (uintptr_t)addr < info.base)
+			return (NULL);
+		flags |= MX_VM_FLAG_SPECIFIC;
+		offset = (uintptr_t)addr - info.base;
+	}
+
+	if (_mx_vmo_create(size, 0, &vmo) != NO_ERROR)
+		return (NULL);
+	if (_mx_vmar_map(_mx_vmar_root_self(), offset, vmo, 0, size, flags,
+	    &ptr) != NO_ERROR) {
+		_mx_handle_close(vmo);
+		return (NULL);
+	}
+
+	pthread_mutex_lock(&pages_regions_lock);
+	size_t i = pages_region_find(ptr);
+	bool err = pages_region_insert(i);
+	if (!err) {
+		pages_regions[i].base = ptr;
+		pages_regions[i].size = size;
+		pages_regions[i].offset = 0;
+		pages_regions[i].vmo = vmo;
+	}
+	pthread_mutex_unlock(&pages_regions_lock);
+
+	if (err) {
+		_mx_vmar_unmap(_mx_vmar_root_self(), ptr, size);
+		_mx_handle_close(vmo);
+		return (NULL);
+	}
+	return ((void *)ptr);
+}
+
+/*
+ * Decommit [addr, addr+size) from the VMOs behind it, and drop that range
+ * from the table too if unmapping.  Returns true if any part of the range was
+ * not mapped by pages_map().
+ */
+static bool
+pages_decommit_fuchsia(void *addr, size_t size, bool unmap)
+{
+	const uintptr_t start = (uintptr_t)addr, end = start + size;
+	uintptr_t pos = start;
+	bool err = false;
+
+	pthread_mutex_lock(&pages_regions_lock);
+	size_t i = pages_region_find(start);
+	while (pos < end && i < pages_nregions) {
+		pages_region_t *r = &pages_regions[i];
+		const uintptr_t r_end = r->base + r->size;
+
+		if (r->base >= end)
+			break;
+		if (r->base > pos)
+			err = true;
+
+		const uintptr_t lo = r->base > pos ? r->base : pos;
+		const uintptr_t hi = r_end < end ? r_end : end;
+		if (_mx_vmo_op_range(r->vmo, MX_VMO_OP_DECOMMIT,
+		    r->offset + (lo - r->base), hi - lo, NULL, 0) != NO_ERROR)
+			err = true;
+		pos = hi;
+
+		if (!unmap) {
+			i++;
+		} else if (lo == r->base && hi == r_end) {
+			_mx_handle_close(r->vmo);
+			pages_region_remove(i);
+		} else if (lo == r->base) {
+			r->offset += hi - r->base;
+			r->size = r_end - hi;
+			r->base = hi;
+			i++;
+		} else if (hi == r_end) {
+			r->size = lo - r->base;
+			i++;
+		} else {
+			/*
+			 * A hole in the middle leaves two mappings of the one
+			 * VMO.  If the tail can't get its own entry it simply
+			 * can't be purged any more; nothing is lost.
+			 */
+			mx_handle_t tail_vmo;
+			r->size = lo - r->base;
+			if (_mx_handle_duplicate(r->vmo, MX_RIGHT_SAME_RIGHTS,
+			    &tail_vmo) == NO_ERROR) {
+				if (pages_region_insert(i + 1)) {
+					_mx_handle_close(tail_vmo);
+				} else {
+					r = &pages_regions[i];
+					pages_regions[i + 1].base = hi;
+					pages_regions[i + 1].size = r_end - hi;
+					pages_regions[i + 1].offset =
+					    r->offset + (hi - r->base);
+					pages_regions[i + 1].vmo = tail_vmo;
+				}
+			}
+			i++;
+		}
+	}
+	pthread_mutex_unlock(&pages_regions_lock);
+
+	return (err || pos < end);
+}
+#endif
+
+
 void *
 pages_map(void *addr, size_t size, bool *commit)
 {
@@ -34,6 +246,8 @@ pages_map(void *addr, size_t size, bool *commit)
 	 */
 	ret = VirtualAlloc(addr, size, MEM_RESERVE | (*commit ? MEM_COMMIT : 0),
 	    PAGE_READWRITE);
+#elif defined(__Fuchsia__)
+	ret = pages_map_fuchsia(addr, size);
 #else
 	/*
 	 * We don't use MAP_FIXED here, because it can cause the *replacement*
@@ -64,6 +278,14 @@ pages_map(void *addr, size_t size, bool *commit)
 void
 pages_unmap(void *addr, size_t size)
 {
+#ifdef __Fuchsia__
+	/*
+	 * Forget the range before it is unmapped, so that someone else's
+	 * new mapping there can't meet a stale entry.  This also releases
+	 * the pages right away, even when the rest of the VMO stays mapped.
+	 */
+	pages_decommit_fuchsia(addr, size, true);
+#endif
 #ifdef _WIN32
 	if (VirtualFree(addr, 0, MEM_RELEASE) == 0)
 #else
@@ -180,7 +402,10 @@ pages_purge_forced(void *addr, size_t size)
 	if (!pages_can_purge_forced)
 		return (true);
 
-#if defined(JEMALLOC_PURGE_MADVISE_DONTNEED)
+#if defined(__Fuchsia__)
+	/* Decommitted pages of an anonymous VMO read back as zero. */
+	return (pages_decommit_fuchsia(addr, size, false));
+#elif defined(JEMALLOC_PURGE_MADVISE_DONTNEED)
 	return (madvise(addr, size, MADV_DONTNEED) != 0);
 #else
 	not_reached();
@@ -288,6 +513,9 @@ pages_boot(void)
 	if (os_overcommits)
 		mmap_flags |= MAP_NORESERVE;
 #  endif
+#elif defined(__Fuchsia__)
+	/* VMO pages are only committed when first touched. */
+	os_overcommits = true;
 #else
 	os_overcommits = false;
 #endif
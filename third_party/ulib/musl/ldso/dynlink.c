@@ -361,6 +361,16 @@ __NO_SAFESTACK static struct symdef find_sym(struct dso* dso,
 
 __attribute__((__visibility__("hidden"))) ptrdiff_t __tlsdesc_static(void), __tlsdesc_dynamic(void);
 
+// Store a relocated value only if it differs from what is already
+// there.  A prelinked DSO loaded at its link-time address (see
+// map_library) has most of its relocations already right in the file;
+// leaving those words alone keeps their pages shared copy-on-write with
+// the file VMO rather than copied into every process.
+__NO_SAFESTACK static inline void store_reloc(size_t* reloc_addr, size_t val) {
+    if (*reloc_addr != val)
+        *reloc_addr = val;
+}
+
 __NO_SAFESTACK static void do_relocs(struct dso* dso, size_t* rel,
                                      size_t rel_size, size_t stride) {
     unsigned char* base = dso->base;
@@ -437,16 +447,16 @@ __NO_SAFESTACK static void do_relocs(struct dso* dso, size_t* rel,
         case REL_SYMBOLIC:
         case REL_GOT:
         case REL_PLT:
-            *reloc_addr = sym_val + addend;
+            store_reloc(reloc_addr, sym_val + addend);
             break;
         case REL_RELATIVE:
-            *reloc_addr = (size_t)base + addend;
+            store_reloc(reloc_addr, (size_t)base + addend);
             break;
         case REL_SYM_OR_REL:
             if (sym)
-                *reloc_addr = sym_val + addend;
+                store_reloc(reloc_addr, sym_val + addend);
             else
-                *reloc_addr = (size_t)base + addend;
+                store_reloc(reloc_addr, (size_t)base + addend);
             break;
         case REL_COPY:
             memcpy(reloc_addr, (void*)sym_val, sym->st_size);
@@ -465,10 +475,10 @@ __NO_SAFESTACK static void do_relocs(struct dso* dso, size_t* rel,
             reloc_addr[1] = def.sym ? (size_t)def.dso->got : 0;
             break;
         case REL_DTPMOD:
-            *reloc_addr = def.dso->tls_id;
+            store_reloc(reloc_addr, def.dso->tls_id);
             break;
         case REL_DTPOFF:
-            *reloc_addr = tls_val + addend - DTP_OFFSET;
+            store_reloc(reloc_addr, tls_val + addend - DTP_OFFSET);
             break;
 #ifdef TLS_ABOVE_TP
         case REL_TPOFF:
@@ -601,13 +611,28 @@ __NO_SAFESTACK static mx_status_t map_library(mx_handle_t vmo,
     // Allocate a VMAR to reserve the whole address range.  Stash
     // the new VMAR's handle until relocation has finished, because
     // we need it to adjust page protections for RELRO.
+    const uint32_t vmar_flags =
+        MX_VM_FLAG_CAN_MAP_READ | MX_VM_FLAG_CAN_MAP_WRITE |
+        MX_VM_FLAG_CAN_MAP_EXECUTE | MX_VM_FLAG_CAN_MAP_SPECIFIC;
     uintptr_t vmar_base;
-    status = _mx_vmar_allocate(__magenta_vmar_root_self, 0, map_len,
-                               MX_VM_FLAG_CAN_MAP_READ |
-                                   MX_VM_FLAG_CAN_MAP_WRITE |
-                                   MX_VM_FLAG_CAN_MAP_EXECUTE |
-                                   MX_VM_FLAG_CAN_MAP_SPECIFIC,
-                               &dso->vmar, &vmar_base);
+    status = ERR_NOT_FOUND;
+    if (addr_min != 0) {
+        // A DSO linked at a nonzero address has been prelinked to be
+        // loaded there.  If that range is free, use it: with no load
+        // bias, do_relocs finds most of its relocations already in
+        // place.  If not, it goes anywhere, like any other DSO.
+        mx_info_vmar_t root;
+        if (_mx_object_get_info(__magenta_vmar_root_self, MX_INFO_VMAR,
+                                &root, sizeof(root), NULL, NULL) == NO_ERROR &&
+            addr_min >= root.base && addr_max <= root.base + root.len)
+            status = _mx_vmar_allocate(__magenta_vmar_root_self,
+                                       addr_min - root.base, map_len,
+                                       vmar_flags | MX_VM_FLAG_SPECIFIC,
+                                       &dso->vmar, &vmar_base);
+    }
+    if (status != NO_ERROR)
+        status = _mx_vmar_allocate(__magenta_vmar_root_self, 0, map_len,
+                                   vmar_flags, &dso->vmar, &vmar_base);
     if (status != NO_ERROR) {
         error("failed to reserve %zu bytes of address space: %d\n",
               map_len, status);
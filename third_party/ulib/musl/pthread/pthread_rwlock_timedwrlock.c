@@ -15,10 +15,10 @@ int pthread_rwlock_timedwrlock(pthread_rwlock_t* restrict rw, const struct times
         if (!(r = atomic_load(&rw->_rw_lock)))
             continue;
         t = r | PTHREAD_MUTEX_OWNED_LOCK_BIT;
-        atomic_fetch_add(&rw->_rw_waiters, 1);
+        atomic_fetch_add(&rw->_rw_waiters, PTHREAD_RWLOCK_WRITER_WAITER);
         a_cas_shim(&rw->_rw_lock, r, t);
         r = __timedwait(&rw->_rw_lock, t, CLOCK_REALTIME, at);
-        atomic_fetch_sub(&rw->_rw_waiters, 1);
+        atomic_fetch_sub(&rw->_rw_waiters, PTHREAD_RWLOCK_WRITER_WAITER);
         if (r)
             return r;
     }
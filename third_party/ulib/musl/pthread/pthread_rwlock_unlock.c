@@ -11,8 +11,11 @@ int pthread_rwlock_unlock(pthread_rwlock_t* rw) {
         new = (cnt == 0x7fffffff || cnt == 1) ? 0 : val - 1;
     } while (a_cas_shim(&rw->_rw_lock, val, new) != val);
 
+    // When only writers are waiting, just one of them can take the lock,
+    // so waking the rest would only send them straight back to sleep.
     if (!new && (waiters || val < 0))
-        __wake(&rw->_rw_lock, cnt);
+        __wake(&rw->_rw_lock,
+               (waiters & PTHREAD_RWLOCK_READER_WAITER_MASK) ? cnt : 1);
 
     return 0;
 }
@@ -126,6 +126,12 @@ static inline struct pthread* tp_to_pthread(void* tp) {
 #define PTHREAD_MUTEX_OWNED_LOCK_BIT 0x80000000
 #define PTHREAD_MUTEX_OWNED_LOCK_MASK 0x7fffffff
 
+// A rwlock's _rw_waiters counts blocked readers in its low bits and
+// blocked writers in units of this, so that unlocking can tell whether
+// waking a single thread is enough.
+#define PTHREAD_RWLOCK_WRITER_WAITER 0x10000
+#define PTHREAD_RWLOCK_READER_WAITER_MASK (PTHREAD_RWLOCK_WRITER_WAITER - 1)
+
 extern void* __pthread_tsd_main[];
 extern volatile size_t __pthread_tsd_size;
 
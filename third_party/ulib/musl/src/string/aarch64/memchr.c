@@ -0,0 +1,34 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string.h>
+
+#include "simd.h"
+
+// Reads whole aligned 16-byte blocks, which may run past either end of the
+// buffer but never onto another page.
+void* memchr(const void* src, int c, size_t n) {
+    if (!n)
+        return 0;
+
+    uintptr_t skew = (uintptr_t)src & 15;
+    const unsigned char* p = (const unsigned char*)src - skew;
+    const v16 v = (v16){0} + (uint8_t)c;
+
+    // Count from p, saturating rather than wrapping.
+    size_t left = n + skew < n ? SIZE_MAX : n + skew;
+    // Forget the bytes before the buffer.
+    unsigned __int128 m = v16_mask((v16)(*(const v16*)p == v)) >> (8 * skew) << (8 * skew);
+    for (;;) {
+        if (m) {
+            unsigned i = mask_first(m);
+            return i < left ? (void*)(p + i) : 0;
+        }
+        if (left <= 16)
+            return 0;
+        left -= 16;
+        p += 16;
+        m = v16_mask((v16)(*(const v16*)p == v));
+    }
+}
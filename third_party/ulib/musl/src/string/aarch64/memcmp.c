@@ -0,0 +1,23 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string.h>
+
+#include "simd.h"
+
+int memcmp(const void* vl, const void* vr, size_t n) {
+    const unsigned char* l = vl;
+    const unsigned char* r = vr;
+
+    for (; n >= 16; n -= 16, l += 16, r += 16) {
+        unsigned __int128 ne = v16_mask((v16)(*(const v16u*)l != *(const v16u*)r));
+        if (ne) {
+            unsigned i = mask_first(ne);
+            return l[i] - r[i];
+        }
+    }
+    for (; n && *l == *r; n--, l++, r++)
+        ;
+    return n ? *l - *r : 0;
+}
@@ -0,0 +1,69 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string.h>
+
+#include "simd.h"
+
+// Every size loads its ragged ends with overlapping unaligned accesses
+// rather than byte loops; past 64 bytes, the middle goes 64 bytes at a time
+// to 16-byte aligned destinations.
+void* memcpy(void* restrict dest, const void* restrict src, size_t n) {
+    unsigned char* d = dest;
+    const unsigned char* s = src;
+
+    if (n <= 16) {
+        if (n >= 8) {
+            uint64_t a = *(const u64u*)s, b = *(const u64u*)(s + n - 8);
+            *(u64u*)d = a;
+            *(u64u*)(d + n - 8) = b;
+        } else if (n >= 4) {
+            uint32_t a = *(const u32u*)s, b = *(const u32u*)(s + n - 4);
+            *(u32u*)d = a;
+            *(u32u*)(d + n - 4) = b;
+        } else if (n >= 2) {
+            uint16_t a = *(const u16u*)s, b = *(const u16u*)(s + n - 2);
+            *(u16u*)d = a;
+            *(u16u*)(d + n - 2) = b;
+        } else if (n) {
+            *d = *s;
+        }
+        return dest;
+    }
+
+    if (n <= 32) {
+        v16u a = *(const v16u*)s, b = *(const v16u*)(s + n - 16);
+        *(v16u*)d = a;
+        *(v16u*)(d + n - 16) = b;
+        return dest;
+    }
+
+    if (n <= 64) {
+        v16u a = *(const v16u*)s, b = *(const v16u*)(s + 16);
+        v16u c = *(const v16u*)(s + n - 32), e = *(const v16u*)(s + n - 16);
+        *(v16u*)d = a;
+        *(v16u*)(d + 16) = b;
+        *(v16u*)(d + n - 32) = c;
+        *(v16u*)(d + n - 16) = e;
+        return dest;
+    }
+
+    v16u head = *(const v16u*)s;
+    v16u t0 = *(const v16u*)(s + n - 64), t1 = *(const v16u*)(s + n - 48);
+    v16u t2 = *(const v16u*)(s + n - 32), t3 = *(const v16u*)(s + n - 16);
+    for (size_t i = 16 - ((uintptr_t)d & 15); i < n - 64; i += 64) {
+        v16u a = *(const v16u*)(s + i), b = *(const v16u*)(s + i + 16);
+        v16u c = *(const v16u*)(s + i + 32), e = *(const v16u*)(s + i + 48);
+        *(v16*)(d + i) = a;
+        *(v16*)(d + i + 16) = b;
+        *(v16*)(d + i + 32) = c;
+        *(v16*)(d + i + 48) = e;
+    }
+    *(v16u*)(d + n - 64) = t0;
+    *(v16u*)(d + n - 48) = t1;
+    *(v16u*)(d + n - 32) = t2;
+    *(v16u*)(d + n - 16) = t3;
+    *(v16u*)d = head;
+    return dest;
+}
@@ -0,0 +1,55 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string.h>
+
+#include "simd.h"
+
+void* memset(void* dest, int c, size_t n) {
+    unsigned char* d = dest;
+    uint64_t w = 0x0101010101010101ull * (unsigned char)c;
+
+    if (n <= 16) {
+        if (n >= 8) {
+            *(u64u*)d = w;
+            *(u64u*)(d + n - 8) = w;
+        } else if (n >= 4) {
+            *(u32u*)d = (uint32_t)w;
+            *(u32u*)(d + n - 4) = (uint32_t)w;
+        } else if (n >= 2) {
+            *(u16u*)d = (uint16_t)w;
+            *(u16u*)(d + n - 2) = (uint16_t)w;
+        } else if (n) {
+            *d = (unsigned char)c;
+        }
+        return dest;
+    }
+
+    v16u v = (v16u){0} + (uint8_t)c;
+    if (n <= 32) {
+        *(v16u*)d = v;
+        *(v16u*)(d + n - 16) = v;
+        return dest;
+    }
+    if (n <= 64) {
+        *(v16u*)d = v;
+        *(v16u*)(d + 16) = v;
+        *(v16u*)(d + n - 32) = v;
+        *(v16u*)(d + n - 16) = v;
+        return dest;
+    }
+
+    *(v16u*)d = v;
+    for (size_t i = 16 - ((uintptr_t)d & 15); i < n - 64; i += 64) {
+        *(v16*)(d + i) = v;
+        *(v16*)(d + i + 16) = v;
+        *(v16*)(d + i + 32) = v;
+        *(v16*)(d + i + 48) = v;
+    }
+    *(v16u*)(d + n - 64) = v;
+    *(v16u*)(d + n - 48) = v;
+    *(v16u*)(d + n - 32) = v;
+    *(v16u*)(d + n - 16) = v;
+    return dest;
+}
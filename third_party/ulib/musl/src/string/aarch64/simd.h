@@ -0,0 +1,30 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+
+// 16 bytes in a NEON q register. The compiler turns these into plain
+// ldr/str q and the comparisons into cmeq, so the string routines here
+// need no assembly.
+typedef uint8_t v16 __attribute__((vector_size(16), may_alias));
+// The same at any alignment
+typedef uint8_t v16u __attribute__((vector_size(16), aligned(1), may_alias));
+
+typedef uint64_t u64u __attribute__((aligned(1), may_alias));
+typedef uint32_t u32u __attribute__((aligned(1), may_alias));
+typedef uint16_t u16u __attribute__((aligned(1), may_alias));
+
+// A comparison result (0 or 0xff in each byte) as one 128-bit number, whose
+// lowest set byte is that of the lowest address.
+static inline unsigned __int128 v16_mask(v16 v) {
+    return (unsigned __int128)v;
+}
+
+// The index of the lowest set byte of a nonzero mask
+static inline unsigned mask_first(unsigned __int128 m) {
+    uint64_t lo = (uint64_t)m;
+    return lo ? __builtin_ctzll(lo) / 8 : 8 + __builtin_ctzll((uint64_t)(m >> 64)) / 8;
+}
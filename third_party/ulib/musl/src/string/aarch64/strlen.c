@@ -0,0 +1,23 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string.h>
+
+#include "simd.h"
+
+// Reads whole aligned 16-byte blocks, which may run past the terminator
+// but never onto another page.
+size_t strlen(const char* s) {
+    uintptr_t skew = (uintptr_t)s & 15;
+    const unsigned char* p = (const unsigned char*)s - skew;
+    const v16 zero = {0};
+
+    // Forget the bytes before the string.
+    unsigned __int128 m = v16_mask((v16)(*(const v16*)p == zero)) >> (8 * skew) << (8 * skew);
+    while (!m) {
+        p += 16;
+        m = v16_mask((v16)(*(const v16*)p == zero));
+    }
+    return p + mask_first(m) - (const unsigned char*)s;
+}
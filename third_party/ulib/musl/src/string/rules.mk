@@ -4,8 +4,6 @@ LOCAL_SRCS += \
     $(GET_LOCAL_DIR)/bzero.c \
     $(GET_LOCAL_DIR)/index.c \
     $(GET_LOCAL_DIR)/memccpy.c \
-    $(GET_LOCAL_DIR)/memchr.c \
-    $(GET_LOCAL_DIR)/memcmp.c \
     $(GET_LOCAL_DIR)/memmem.c \
     $(GET_LOCAL_DIR)/memrchr.c \
     $(GET_LOCAL_DIR)/rindex.c \
@@ -23,7 +21,6 @@ LOCAL_SRCS += \
     $(GET_LOCAL_DIR)/strerror_r.c \
     $(GET_LOCAL_DIR)/strlcat.c \
     $(GET_LOCAL_DIR)/strlcpy.c \
-    $(GET_LOCAL_DIR)/strlen.c \
     $(GET_LOCAL_DIR)/strncasecmp.c \
     $(GET_LOCAL_DIR)/strncat.c \
     $(GET_LOCAL_DIR)/strncmp.c \
@@ -69,17 +66,24 @@ LOCAL_SRCS += \
 
 ifeq ($(ARCH),arm64)
 LOCAL_SRCS += \
-    $(GET_LOCAL_DIR)/memcpy.c \
+    $(GET_LOCAL_DIR)/aarch64/memchr.c \
+    $(GET_LOCAL_DIR)/aarch64/memcmp.c \
+    $(GET_LOCAL_DIR)/aarch64/memcpy.c \
+    $(GET_LOCAL_DIR)/aarch64/memset.c \
+    $(GET_LOCAL_DIR)/aarch64/strlen.c \
     $(GET_LOCAL_DIR)/memmove.c \
     $(GET_LOCAL_DIR)/mempcpy.c \
-    $(GET_LOCAL_DIR)/memset.c \
 
 else ifeq ($(SUBARCH),x86-64)
 LOCAL_SRCS += \
+    $(GET_LOCAL_DIR)/x86_64/features.S \
+    $(GET_LOCAL_DIR)/x86_64/memchr.S \
+    $(GET_LOCAL_DIR)/x86_64/memcmp.S \
     $(GET_LOCAL_DIR)/x86_64/memcpy.S \
     $(GET_LOCAL_DIR)/x86_64/memmove.S \
     $(GET_LOCAL_DIR)/x86_64/mempcpy.S \
     $(GET_LOCAL_DIR)/x86_64/memset.S \
+    $(GET_LOCAL_DIR)/x86_64/strlen.S \
 
 else
 error Unsupported architecture for musl build!
@@ -0,0 +1,22 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+// Bits of __x86_string_features
+#define STRING_FEATURE_KNOWN 1
+// rep movsb and rep stosb are fast
+#define STRING_FEATURE_ERMS 2
+// AVX2, with its state saved by the OS
+#define STRING_FEATURE_AVX2 4
+// only while detecting
+#define STRING_FEATURE_AVX_STATE 8
+
+// Leaves __x86_string_features in %ecx, detecting them on first use.
+#define LOAD_STRING_FEATURES \
+    movzbl __x86_string_features(%rip), %ecx; \
+    test %ecx, %ecx; \
+    jnz 9f; \
+    call __x86_string_features_detect; \
+9:
@@ -32,6 +32,17 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.  */
 
 #include "libunwind_i.h"
 
+// The thread is stopped while we unwind it, so its registers and memory
+// can be cached. The unwinder reads eh_frame_hdr, eh_frame and the stack
+// a word at a time, so reading whole pages saves most of the syscalls.
+#define UNW_FUCHSIA_MEM_CACHE_PAGE_SIZE 4096
+#define UNW_FUCHSIA_MEM_CACHE_NUM_PAGES 8
+
+struct unw_fuchsia_mem_cache_page {
+    mx_vaddr_t vaddr; // 0 if empty
+    uint8_t data[UNW_FUCHSIA_MEM_CACHE_PAGE_SIZE];
+};
+
 struct unw_fuchsia_info {
 #if 0
     struct _Unwind_Context context; // must be first
@@ -46,6 +57,14 @@ struct unw_fuchsia_info {
 
     uintptr_t segbase;
     struct as_elf_dyn_info edi;
+
+    // The general regs, read on first use.
+    char* gregs;
+    uint32_t gregs_size;
+
+    // Round-robin cache of process memory.
+    unsigned mem_cache_next;
+    struct unw_fuchsia_mem_cache_page mem_cache[UNW_FUCHSIA_MEM_CACHE_NUM_PAGES];
 };
 
 extern const int fuchsia_greg_offset[];
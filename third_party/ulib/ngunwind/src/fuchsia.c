@@ -68,6 +68,66 @@ read_mem (mx_handle_t h, mx_vaddr_t vaddr, void* ptr, size_t len)
   return NO_ERROR;
 }
 
+// Reads through the page cache in |cxt|. Pages which can't be read whole
+// (e.g., the last page of a mapping) are read directly instead.
+
+static mx_status_t
+cached_read_mem (unw_fuchsia_info_t* cxt, mx_vaddr_t vaddr, void* ptr, size_t len)
+{
+  const mx_vaddr_t page_mask = UNW_FUCHSIA_MEM_CACHE_PAGE_SIZE - 1;
+  uint8_t* dst = ptr;
+
+  while (len > 0)
+  {
+    mx_vaddr_t page = vaddr & ~page_mask;
+    size_t offset = vaddr - page;
+    size_t chunk = UNW_FUCHSIA_MEM_CACHE_PAGE_SIZE - offset;
+    if (chunk > len)
+      chunk = len;
+
+    struct unw_fuchsia_mem_cache_page* entry = NULL;
+    for (unsigned i = 0; i < UNW_FUCHSIA_MEM_CACHE_NUM_PAGES; ++i)
+    {
+      if (cxt->mem_cache[i].vaddr == page && page != 0)
+      {
+        entry = &cxt->mem_cache[i];
+        break;
+      }
+    }
+    if (entry == NULL && page != 0)
+    {
+      entry = &cxt->mem_cache[cxt->mem_cache_next];
+      if (read_mem (cxt->process, page, entry->data,
+                    UNW_FUCHSIA_MEM_CACHE_PAGE_SIZE) == NO_ERROR)
+      {
+        entry->vaddr = page;
+        cxt->mem_cache_next =
+          (cxt->mem_cache_next + 1) % UNW_FUCHSIA_MEM_CACHE_NUM_PAGES;
+      }
+      else
+      {
+        entry->vaddr = 0;
+        entry = NULL;
+      }
+    }
+
+    if (entry != NULL)
+    {
+      memcpy (dst, entry->data + offset, chunk);
+    }
+    else
+    {
+      mx_status_t status = read_mem (cxt->process, vaddr, dst, chunk);
+      if (status < 0)
+        return status;
+    }
+    dst += chunk;
+    vaddr += chunk;
+    len -= chunk;
+  }
+  return NO_ERROR;
+}
+
 static mx_status_t
 get_inferior_greg_buf_size (mx_handle_t thread, uint32_t* regset_size)
 {
@@ -234,13 +294,12 @@ remote_access_mem (unw_addr_space_t as, unw_word_t addr, unw_word_t *val,
 {
   Debug (3, "called, addr 0x%lx\n", (long) addr);
   unw_fuchsia_info_t* cxt = arg;
-  mx_handle_t process = cxt->process;
   if (write)
   {
     Debug (3, "writing to mem\n");
     return -UNW_EINVAL;
   }
-  mx_status_t status = read_mem (process, addr, val, sizeof(*val));
+  mx_status_t status = cached_read_mem (cxt, addr, val, sizeof(*val));
   if (status < 0)
       return -UNW_EINVAL;
   char dump[3 * 8 + 1];
@@ -255,13 +314,12 @@ remote_access_raw_mem (unw_addr_space_t as, unw_word_t addr,
 {
   Debug (3, "called, addr 0x%lx, size %lu\n", (long) addr, (long) size);
   unw_fuchsia_info_t* cxt = arg;
-  mx_handle_t process = cxt->process;
   if (write)
   {
     Debug (3, "writing to mem\n");
     return -UNW_EINVAL;
   }
-  mx_status_t status = read_mem (process, addr, buf, size);
+  mx_status_t status = cached_read_mem (cxt, addr, buf, size);
   if (status < 0)
   {
     Debug (3, "read failed: %d\n", status);
@@ -293,32 +351,37 @@ remote_access_reg (unw_addr_space_t as, unw_regnum_t reg, unw_word_t *val,
     Debug (3, "bad regnum: %d\n", (int) reg);
     return -UNW_EBADREG;
   }
-  uint32_t regset_size;
-  mx_status_t status = get_inferior_greg_buf_size (thread, &regset_size);
-  if (status != NO_ERROR)
-  {
-    Debug (3, "unable to get greg buf size: %d\n", status);
-    return -UNW_EUNSPEC;
-  }
-  char* buf = malloc (regset_size);
-  if (buf == NULL)
-  {
-    Debug (3, "malloc failed\n");
-    return -UNW_ENOMEM;
-  }
-  mx_status_t r = read_inferior_gregs (thread, buf, regset_size);
-  if (r < 0)
+  if (cxt->gregs == NULL)
   {
-    Debug (3, "error reading gregs: %d\n", r);
-    free (buf);
-    return -UNW_EUNSPEC;
+    uint32_t regset_size;
+    mx_status_t status = get_inferior_greg_buf_size (thread, &regset_size);
+    if (status != NO_ERROR)
+    {
+      Debug (3, "unable to get greg buf size: %d\n", status);
+      return -UNW_EUNSPEC;
+    }
+    char* buf = malloc (regset_size);
+    if (buf == NULL)
+    {
+      Debug (3, "malloc failed\n");
+      return -UNW_ENOMEM;
+    }
+    mx_status_t r = read_inferior_gregs (thread, buf, regset_size);
+    if (r < 0)
+    {
+      Debug (3, "error reading gregs: %d\n", r);
+      free (buf);
+      return -UNW_EUNSPEC;
+    }
+    cxt->gregs = buf;
+    cxt->gregs_size = regset_size;
   }
+  char* buf = cxt->gregs;
   if (sizeof(*val) == sizeof(uint32_t))
     *val = get_uint32 (buf + fuchsia_greg_offset[reg]);
   else
     *val = get_uint64 (buf + fuchsia_greg_offset[reg]);
   Debug (3, "reg val: 0x%llx\n", (long long) *val);
-  free (buf);
   return 0;
 }
 
@@ -380,5 +443,7 @@ unw_create_fuchsia(mx_handle_t process, mx_handle_t thread,
 void
 unw_destroy_fuchsia(unw_fuchsia_info_t* info)
 {
+    if (info != NULL)
+        free (info->gregs);
     free (info);
 }